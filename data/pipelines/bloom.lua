@@ -76,8 +76,8 @@ function autoexposure(env, hdr_buffer)
 
 	env.bindTextures({ hdr_buffer }, 0)
 	env.bindShaderBuffer(env.lum_buf, 1, true)
-	env.drawcallUniforms(env.viewport_w, env.viewport_h, accomodation_speed) 
-	env.dispatch(env.avg_luminance_shader, (env.viewport_w + 15) / 16, (env.viewport_h + 15) / 16, 1);
+	env.drawcallUniforms(env.scene_w, env.scene_h, accomodation_speed) 
+	env.dispatch(env.avg_luminance_shader, (env.scene_w + 15) / 16, (env.scene_h + 15) / 16, 1);
 
 	env.bindShaderBuffer(env.lum_buf, 1, true)
 	env.dispatch(env.avg_luminance_shader, 256, 1, 1, "PASS2");
@@ -123,10 +123,10 @@ function postprocess(env, transparent_phase, hdr_buffer, gbuffer0, gbuffer1, gbu
 
 	if not only_autoexposure then
 		env.beginBlock("bloom")
-		local bloom_rb = env.createRenderbuffer { width = 0.5 * env.viewport_w, height = 0.5 * env.viewport_h, format = "rgba16f", debug_name = "bloom" }
+		local bloom_rb = env.createRenderbuffer { width = 0.5 * env.scene_w, height = 0.5 * env.scene_h, format = "rgba16f", debug_name = "bloom" }
 	
 		env.setRenderTargets(bloom_rb)
-		env.viewport(0, 0, 0.5 * env.viewport_w, 0.5 * env.viewport_h)
+		env.viewport(0, 0, 0.5 * env.scene_w, 0.5 * env.scene_h)
 		env.drawcallUniforms(luma_limit)
 		env.bindShaderBuffer(env.lum_buf, 5, false)
 		env.drawArray(0
@@ -140,16 +140,16 @@ function postprocess(env, transparent_phase, hdr_buffer, gbuffer0, gbuffer1, gbu
 		if debug then
 			env.debugRenderbuffer(bloom_rb, hdr_buffer, {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}, {0, 0, 0, 1})
 		else 
-			local bloom2_rb = downscale(env, bloom_rb, env.viewport_w * 0.25, env.viewport_h * 0.25)
-			local bloom4_rb = downscale(env, bloom2_rb, env.viewport_w * 0.125, env.viewport_h * 0.125)
-			local bloom8_rb = downscale(env, bloom4_rb, env.viewport_w * 0.0625, env.viewport_h * 0.0625)
-			local bloom16_rb = downscale(env, bloom8_rb, env.viewport_w * 0.03125, env.viewport_h * 0.03125)
-
-			blur(env, bloom16_rb, "rgba16f", env.viewport_w * 0.03125, env.viewport_h * 0.03125, "bloom_blur")
-			blurUpscale(env, bloom8_rb, bloom16_rb, "rgba16f", env.viewport_w * 0.0625, env.viewport_h * 0.0625, "bloom_blur")
-			blurUpscale(env, bloom4_rb, bloom8_rb, "rgba16f", env.viewport_w * 0.125, env.viewport_h * 0.125, "bloom_blur")
-			blurUpscale(env, bloom2_rb, bloom4_rb, "rgba16f", env.viewport_w * 0.25, env.viewport_h * 0.25, "bloom_blur")
-			blurUpscale(env, bloom_rb, bloom2_rb, "rgba16f", env.viewport_w * 0.5, env.viewport_h * 0.5, "bloom_blur")
+			local bloom2_rb = downscale(env, bloom_rb, env.scene_w * 0.25, env.scene_h * 0.25)
+			local bloom4_rb = downscale(env, bloom2_rb, env.scene_w * 0.125, env.scene_h * 0.125)
+			local bloom8_rb = downscale(env, bloom4_rb, env.scene_w * 0.0625, env.scene_h * 0.0625)
+			local bloom16_rb = downscale(env, bloom8_rb, env.scene_w * 0.03125, env.scene_h * 0.03125)
+
+			blur(env, bloom16_rb, "rgba16f", env.scene_w * 0.03125, env.scene_h * 0.03125, "bloom_blur")
+			blurUpscale(env, bloom8_rb, bloom16_rb, "rgba16f", env.scene_w * 0.0625, env.scene_h * 0.0625, "bloom_blur")
+			blurUpscale(env, bloom4_rb, bloom8_rb, "rgba16f", env.scene_w * 0.125, env.scene_h * 0.125, "bloom_blur")
+			blurUpscale(env, bloom2_rb, bloom4_rb, "rgba16f", env.scene_w * 0.25, env.scene_h * 0.25, "bloom_blur")
+			blurUpscale(env, bloom_rb, bloom2_rb, "rgba16f", env.scene_w * 0.5, env.scene_h * 0.5, "bloom_blur")
 
 			env.setRenderTargets(hdr_buffer)
 			env.drawArray(0, 3, env.bloom_shader
@@ -63,6 +63,7 @@ struct Cluster {
 	int lights_count;
 	int env_probes_count;
 	int refl_probes_count;
+	int decals_count;
 };
 
 struct Surface {
@@ -241,6 +242,63 @@ float toLinearDepth(mat4 inv_proj, float ndc_depth)
 	}
 #endif
 
+float cross2(vec2 a, vec2 b) { return a.x * b.y - a.y * b.x; }
+
+// from shadertoy by iq
+vec2 sdBezier(vec2 pos, vec2 A, vec2 B, vec2 C) {    
+	vec2 a = B - A;
+	vec2 b = A - 2.0*B + C;
+	vec2 c = a * 2.0;
+	vec2 d = A - pos;
+
+	float kk = 1.0 / dot(b, b);
+	float kx = kk * dot(a, b);
+	float ky = kk * (2.0 * dot(a, a) + dot(d, b)) / 3.0;
+	float kz = kk * dot(d, a);
+
+	float res = 0.0;
+	float sgn = 0.0;
+
+	float p = ky - kx * kx;
+	float p3 = p * p * p;
+	float q = kx * (2.0 * kx * kx - 3.0 * ky) + kz;
+	float h = q * q + 4.0 * p3;
+	float res_t;
+
+	if (h >= 0.0) { // 1 root
+		h = sqrt(h);
+		vec2 x = (vec2(h, -h) - q) / 2.0;
+		vec2 uv = sign(x) * pow(abs(x), vec2(1.0 / 3.0));
+		float t = saturate(uv.x + uv.y - kx);
+		vec2 q = d + (c + b * t) * t;
+		res = dot(q, q);
+		sgn = cross2(c + 2.0 * b * t, q);
+		res_t = t;
+	}
+	else { // 3 roots
+		float z = sqrt(-p);
+		float v = acos(q / (p * z * 2.0)) / 3.0;
+		float m = cos(v);
+		float n = sin(v) * 1.732050808;
+		vec3 t = saturate(vec3(m + m, -n - m, n - m) * z - kx);
+		vec2 qx = d + (c + b * t.x) * t.x;
+		float dx = dot(qx, qx), sx = cross2(c + 2.0 * b * t.x, qx);
+		vec2 qy = d + (c + b * t.y) * t.y;
+		float dy = dot(qy, qy), sy = cross2(c + 2.0 * b * t.y, qy);
+		if (dx < dy) {
+			res = dx;
+			sgn = sx;
+			res_t = t.x;
+		} else {
+			res = dy;
+			sgn = sy;
+			res_t = t.y;
+		}
+	}
+    
+	return vec2(sqrt(res) * sign(sgn), res_t);
+}
+
 vec2 raySphereIntersect(vec3 r0, vec3 rd, vec3 s0, float sr) {
 	vec3 s0_r0 = s0 - r0;
 	float tc = dot(s0_r0, rd);
@@ -470,8 +528,7 @@ vec3 reflProbesLighting(Cluster cluster, Surface surface, samplerCubeArray refle
 		vec4 rot = b_refl_probes[probe_idx].rot;
 		vec3 lpos = b_refl_probes[probe_idx].pos_layer.xyz - surface.wpos;
 		uint layer = floatBitsToUint(b_refl_probes[probe_idx].pos_layer.w);
-		vec4 radiance_rgbm = textureLod(reflection_probes, vec4(RV, layer), lod);
-		vec3 radiance = radiance_rgbm.rgb * radiance_rgbm.a * 4;
+		vec3 radiance = textureLod(reflection_probes, vec4(RV, layer), lod).rgb;
 
 		lpos = rotateByQuat(rot, lpos);
 		vec3 half_extents = b_refl_probes[probe_idx].half_extents.xyz;
@@ -12,7 +12,7 @@ function postprocess(env, phase, input, gbuffer0, gbuffer1, gbuffer2, gbuffer_de
 		env.dof_blur_shader = env.preloadShader("pipelines/dof_blur.shd")
 	end
 
-	local tmp_rb = env.createRenderbuffer { width = env.viewport_w, height = env.viewport_h, format = "rgba16f", debug_name = "dof_tmp" }
+	local tmp_rb = env.createRenderbuffer { width = env.scene_w, height = env.scene_h, format = "rgba16f", debug_name = "dof_tmp" }
 	
 	env.setRenderTargets(tmp_rb)
 	env.drawcallUniforms(near_blur, near_sharp, far_sharp, far_blur)
@@ -15,8 +15,8 @@ function postprocess(env, phase, hdr_buffer, gbuffer0, gbuffer1, gbuffer2, gbuff
 	if env.ssao_blit_shader == nil then
 		env.ssao_blit_shader = env.preloadShader("pipelines/ssao_blit.shd")
 	end
-	local w = env.viewport_w * 0.5
-	local h = env.viewport_h * 0.5
+	local w = env.scene_w * 0.5
+	local h = env.scene_h * 0.5
 	local ssao_rb = env.createRenderbuffer { width = w, height = h, format = "r8", debug_name = "ssao" }
 	env.setRenderTargets(ssao_rb)
 	local state = {
@@ -36,10 +36,10 @@ function postprocess(env, phase, hdr_buffer, gbuffer0, gbuffer1, gbuffer2, gbuff
 	
 	env.setRenderTargets()
 
-	env.drawcallUniforms( env.viewport_w, env.viewport_h, 0, 0 )
+	env.drawcallUniforms( env.scene_w, env.scene_h, 0, 0 )
 	env.bindTextures({ssao_rb}, 0)
 	env.bindImageTexture(gbuffer2, 1)
-	env.dispatch(env.ssao_blit_shader, (env.viewport_w + 15) / 16, (env.viewport_h + 15) / 16, 1)
+	env.dispatch(env.ssao_blit_shader, (env.scene_w + 15) / 16, (env.scene_h + 15) / 16, 1)
 
 	env.endBlock()
 
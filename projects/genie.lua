@@ -19,6 +19,7 @@ end
 local ROOT_DIR = path.getabsolute("../")
 local BINARY_DIR = LOCATION .. "/bin/"
 build_app = false
+build_server = false
 local use_basisu = false
 build_studio = true
 local working_dir = nil
@@ -60,6 +61,11 @@ function linkPlugin(plugin_name)
 		project "app"
 			links {plugin_name}
 	end
+
+	if build_server then
+		project "server"
+			links {plugin_name}
+	end
 end
 
 newoption {
@@ -127,6 +133,16 @@ newoption {
 	description = "Do build app."
 }
 
+newoption {
+	trigger = "with-server",
+	description = "Do build headless dedicated server app."
+}
+
+newoption {
+	trigger = "with-benchmarks",
+	description = "Do build engine microbenchmarks."
+}
+
 newoption {
 	trigger = "with-basis-universal",
 	description = "Use basis universal compression."
@@ -221,6 +237,10 @@ if _OPTIONS["with-app"] then
 	build_app = true
 end
 
+if _OPTIONS["with-server"] then
+	build_server = true
+end
+
 if _OPTIONS["with-basis-universal"] then
 	use_basisu = true
 end
@@ -567,7 +587,6 @@ if has_plugin("renderer") then
 		files { "../src/renderer/**.h", "../src/renderer/**.cpp", "../src/renderer/**.c", "../external/meshoptimizer/**.*" }
 		files { "../data/pipelines/**.*" }
 		excludes { 
-			"../external/meshoptimizer/clusterizer.cpp",
 			"../external/meshoptimizer/overdrawanalyzer.cpp",
 			"../external/meshoptimizer/overdrawoptimizer.cpp",
 			"../external/meshoptimizer/simplifier.cpp",
@@ -575,7 +594,6 @@ if has_plugin("renderer") then
 			"../external/meshoptimizer/stripifier.cpp",
 			"../external/meshoptimizer/vcacheanalyzer.cpp",
 			"../external/meshoptimizer/vcacheoptimizer.cpp",
-			"../external/meshoptimizer/vertexcodec.cpp",
 			"../external/meshoptimizer/vertexfilter.cpp",
 			"../external/meshoptimizer/vfetchanalyzer.cpp",
 			"../external/meshoptimizer/vfetchoptimizer.cpp"
@@ -739,8 +757,8 @@ function dbgHelp()
 	configuration {}
 end
 
-if build_app then
-	project "app"
+function appProject(name)
+	project(name)
 		if working_dir then
 			debugdir ("../../" .. working_dir)
 		else 
@@ -795,8 +813,13 @@ if build_app then
 		linkLib "recast"
 		files { "../src/app/main.cpp" }
 
-		configuration { "windows" }
-			kind "WindowedApp"
+		-- dedicated server runs in a console, without window
+		if name == "server" then
+			defines { "LUMIX_HEADLESS_SERVER" }
+		else
+			configuration { "windows" }
+				kind "WindowedApp"
+		end
 
 		configuration { "linux" }
 			links { "GL", "X11", "dl", "rt", "Xi" }
@@ -815,6 +838,35 @@ if build_app then
 		defaultConfigurations()
 end
 
+if build_app then
+	appProject("app")
+end
+
+if build_server then
+	appProject("server")
+end
+
+if _OPTIONS["with-benchmarks"] then
+	project "benchmarks"
+		kind "ConsoleApp"
+		debugdir "../data"
+
+		files { "../src/benchmarks/**.cpp" }
+		includedirs { "../src" }
+		links { "engine" }
+		linkLib "freetype"
+
+		configuration { "linux" }
+			links { "X11", "dl", "rt", "Xi", "gtk-3", "gobject-2.0" }
+
+		configuration {"vs*"}
+			links { "psapi", "dxguid", "winmm", "imm32", "version" }
+		configuration {}
+
+		useLua()
+		defaultConfigurations()
+end
+
 -- write plugins.inl
 for _, plugin in ipairs(base_plugins) do
 	linkPlugin(plugin)
@@ -1,9 +1,11 @@
 #include "animation/animation.h"
+#include "engine/allocator.h"
+#include "engine/atomic.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
-#include "engine/math.h"
 #include "renderer/model.h"
 #include "renderer/pose.h"
 
@@ -12,34 +14,315 @@ namespace Lumix
 {
 
 
-enum class Version
-{
-	FIRST = 0,
+const ResourceType Animation::TYPE("animation");
 
-	LAST
-};
 
+static volatile i32 s_bone_mask_generation = 0;
 
-const ResourceType Animation::TYPE("animation");
+
+BoneMask::BoneMask(IAllocator& allocator)
+	: bones(allocator)
+{
+	bonesChanged();
+}
+
+
+void BoneMask::bonesChanged() {
+	generation = (u32)atomicIncrement(&s_bone_mask_generation);
+}
 
 
 Animation::Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
+	, m_allocator(allocator)
 	, m_mem(allocator)
 	, m_translations(allocator)
 	, m_rotations(allocator)
+	, m_key_luts(allocator)
+	, m_bone_remaps(allocator)
 {
 }
 
 
+Animation::~Animation() {
+	clearBoneRemaps();
+}
+
+
+void Animation::clearBoneRemaps() {
+	MutexGuard lock(m_bone_remaps_mutex);
+	for (BoneRemap* remap : m_bone_remaps) LUMIX_DELETE(m_allocator, remap);
+	m_bone_remaps.clear();
+}
+
+
+const Animation::BoneRemap& Animation::getBoneRemap(const Model& model, const BoneMask* mask) const {
+	const void* model_bones = model.getBoneCount() > 0 ? &model.getBone(0) : nullptr;
+	const u32 mask_generation = mask ? mask->generation : 0;
+	
+	MutexGuard lock(m_bone_remaps_mutex);
+	for (const BoneRemap* remap : m_bone_remaps) {
+		if (remap->model == &model && remap->model_bones == model_bones && remap->mask_generation == mask_generation) return *remap;
+	}
+
+	// first sample of this animation with this model and mask
+	BoneRemap* remap = LUMIX_NEW(m_allocator, BoneRemap)(m_allocator);
+	remap->model = &model;
+	remap->model_bones = model_bones;
+	remap->mask_generation = mask_generation;
+	auto getIndex = [&](u32 name) -> i16 {
+		Model::BoneMap::const_iterator iter = model.getBoneIndex(name);
+		if (!iter.isValid()) return -1;
+		if (mask && !mask->bones.find(name).isValid()) return -1;
+		return (i16)iter.value();
+	};
+	remap->translations.resize(m_translations.size());
+	for (i32 i = 0, c = m_translations.size(); i < c; ++i) remap->translations[i] = getIndex(m_translations[i].name);
+	remap->rotations.resize(m_rotations.size());
+	for (i32 i = 0, c = m_rotations.size(); i < c; ++i) remap->rotations[i] = getIndex(m_rotations[i].name);
+	m_bone_remaps.push(remap);
+	return *remap;
+}
+
+
 struct AnimationSampler {
-	template <bool use_mask, bool use_weight>
+	// see Animation::Version::COMPRESSED
+	static constexpr float QROT_SCALE = 1.41421356f / 0x7fff;
+	static constexpr float QROT_OFFSET = 0.70710678f;
+
+	struct SampleTime {
+		bool end;
+		u16 anim_t;
+		u32 frame_idx;
+		float frame_t;
+	};
+
+	static SampleTime getSampleTime(const Animation& anim, Time time) {
+		SampleTime res = {};
+		res.end = time >= anim.getLength();
+		if (res.end) return res;
+
+		const u64 anim_t_highres = ((u64)time.raw() << 16) / (anim.m_length.raw());
+		ASSERT(anim_t_highres <= 0xffFF);
+		res.anim_t = u16(anim_t_highres);
+		const u64 frame_48_16 = (anim.m_frame_count - 1) * anim_t_highres;
+		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
+		res.frame_idx = u32(frame_48_16 >> 16);
+		res.frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
+		return res;
+	}
+
+	// keys k0 and k1 are interpolated by t
+	template <typename Curve>
+	static LUMIX_FORCE_INLINE void getKeys(const Curve& curve, const SampleTime& st, u32& k0, u32& k1, float& t) {
+		if (st.end) {
+			k0 = k1 = curve.count - 1;
+			t = 0;
+		}
+		else if (curve.times) {
+			k1 = findKeyframe(curve, st.anim_t);
+			k0 = k1 - 1;
+			t = float(st.anim_t - curve.times[k0]) / (curve.times[k1] - curve.times[k0]);
+		}
+		else {
+			k0 = st.frame_idx;
+			k1 = k0 + 1;
+			t = st.frame_t;
+		}
+	}
+
+	static LUMIX_FORCE_INLINE Vec3 getPos(const Animation::TranslationCurve& curve, u32 idx) {
+		if (curve.pos) return curve.pos[idx];
+		const u16* q = curve.qpos + idx * 3;
+		return curve.min + Vec3(q[0], q[1], q[2]) * curve.scale;
+	}
+
+	static LUMIX_FORCE_INLINE Quat getRot(const Animation::RotationCurve& curve, u32 idx) {
+		if (curve.rot) return curve.rot[idx];
+		const u16* q = curve.qrot + idx * 3;
+		const float a = (q[0] & 0x7fff) * QROT_SCALE - QROT_OFFSET;
+		const float b = (q[1] & 0x7fff) * QROT_SCALE - QROT_OFFSET;
+		const float c = (q[2] & 0x7fff) * QROT_SCALE - QROT_OFFSET;
+		const float largest = sqrtf(maximum(0.f, 1 - a * a - b * b - c * c));
+		switch ((q[0] >> 15) | ((q[1] >> 15) << 1)) {
+			case 0: return Quat(largest, a, b, c);
+			case 1: return Quat(a, largest, b, c);
+			case 2: return Quat(a, b, largest, c);
+			default: return Quat(a, b, c, largest);
+		}
+	}
+
+	// `largest` - index of the largest component, as float
+	static LUMIX_FORCE_INLINE void decodeRotations(float4 a, float4 b, float4 c, float4 largest, float4* out) {
+		const float4 scale = f4Splat(QROT_SCALE);
+		const float4 offset = f4Splat(QROT_OFFSET);
+		a = f4Sub(f4Mul(a, scale), offset);
+		b = f4Sub(f4Mul(b, scale), offset);
+		c = f4Sub(f4Mul(c, scale), offset);
+		float4 l = f4Sub(f4Splat(1), f4Add(f4Add(f4Mul(a, a), f4Mul(b, b)), f4Mul(c, c)));
+		l = f4Sqrt(f4Max(l, f4Splat(0)));
+		const float4 lt1 = f4CmpLT(largest, f4Splat(0.5f));
+		const float4 lt2 = f4CmpLT(largest, f4Splat(1.5f));
+		const float4 lt3 = f4CmpLT(largest, f4Splat(2.5f));
+		out[0] = f4Select(lt1, l, a);
+		out[1] = f4Select(lt1, a, f4Select(lt2, l, b));
+		out[2] = f4Select(lt2, b, f4Select(lt3, l, c));
+		out[3] = f4Select(lt3, c, l);
+	}
+
+	// decodes and interpolates 4 curves at once
+	template <bool use_weight>
+	static void sampleCompressedTranslations(const Animation& anim, const SampleTime& st, const Animation::BoneRemap& remap, Vec3* pos, float weight) {
+		alignas(16) float q0[3][4];
+		alignas(16) float q1[3][4];
+		alignas(16) float mins[3][4];
+		alignas(16) float scales[3][4];
+		alignas(16) float ts[4];
+		alignas(16) float res[3][4];
+		i32 bones[4];
+		u32 lanes = 0;
+
+		auto flush = [&](){
+			const float4 t = f4Load(ts);
+			float4 p[3];
+			for (u32 j = 0; j < 3; ++j) {
+				const float4 a = f4Load(q0[j]);
+				const float4 b = f4Load(q1[j]);
+				const float4 q = f4Add(a, f4Mul(f4Sub(b, a), t));
+				p[j] = f4Add(f4Load(mins[j]), f4Mul(q, f4Load(scales[j])));
+			}
+			if constexpr (use_weight) {
+				alignas(16) float cur[3][4] = {};
+				for (u32 l = 0; l < lanes; ++l) {
+					for (u32 j = 0; j < 3; ++j) cur[j][l] = (&pos[bones[l]].x)[j];
+				}
+				const float4 w = f4Splat(weight);
+				for (u32 j = 0; j < 3; ++j) {
+					const float4 c = f4Load(cur[j]);
+					p[j] = f4Add(c, f4Mul(f4Sub(p[j], c), w));
+				}
+			}
+			for (u32 j = 0; j < 3; ++j) f4Store(res[j], p[j]);
+			for (u32 l = 0; l < lanes; ++l) {
+				pos[bones[l]] = Vec3(res[0][l], res[1][l], res[2][l]);
+			}
+			lanes = 0;
+		};
+
+		for (i32 i = 0, c = anim.m_translations.size(); i < c; ++i) {
+			const i32 model_bone_index = remap.translations[i];
+			if (model_bone_index < 0) continue;
+			const Animation::TranslationCurve& curve = anim.m_translations[i];
+
+			u32 k0, k1;
+			getKeys(curve, st, k0, k1, ts[lanes]);
+			const u16* a = curve.qpos + k0 * 3;
+			const u16* b = curve.qpos + k1 * 3;
+			for (u32 j = 0; j < 3; ++j) {
+				q0[j][lanes] = a[j];
+				q1[j][lanes] = b[j];
+				mins[j][lanes] = (&curve.min.x)[j];
+				scales[j][lanes] = (&curve.scale.x)[j];
+			}
+			bones[lanes] = model_bone_index;
+			++lanes;
+			if (lanes == 4) flush();
+		}
+
+		if (lanes > 0) {
+			for (u32 l = lanes; l < 4; ++l) {
+				ts[l] = 0;
+				for (u32 j = 0; j < 3; ++j) q0[j][l] = q1[j][l] = mins[j][l] = scales[j][l] = 0;
+			}
+			flush();
+		}
+	}
+
+	// decodes and interpolates 4 curves at once
+	template <bool use_weight>
+	static void sampleCompressedRotations(const Animation& anim, const SampleTime& st, const Animation::BoneRemap& remap, Quat* rot, float weight) {
+		// abc + index of the largest component
+		alignas(16) float q0[4][4];
+		alignas(16) float q1[4][4];
+		alignas(16) float ts[4];
+		i32 bones[4];
+		u32 lanes = 0;
+
+		auto flush = [&](){
+			float4 a[4], b[4];
+			decodeRotations(f4Load(q0[0]), f4Load(q0[1]), f4Load(q0[2]), f4Load(q0[3]), a);
+			decodeRotations(f4Load(q1[0]), f4Load(q1[1]), f4Load(q1[2]), f4Load(q1[3]), b);
+			
+			float4 r[4];
+			f4Nlerp(a, b, f4Load(ts), r);
+			if constexpr (use_weight) {
+				// pose is blended in SoA too, unused lanes blend with identity
+				float4 cur[4];
+				for (u32 l = 0; l < 4; ++l) cur[l] = f4LoadUnaligned(l < lanes ? &rot[bones[l]] : &Quat::IDENTITY);
+				f4Transpose(cur[0], cur[1], cur[2], cur[3]);
+				f4Nlerp(cur, r, f4Splat(weight), r);
+			}
+			f4Transpose(r[0], r[1], r[2], r[3]);
+			// Pose::rotations are aligned
+			for (u32 l = 0; l < lanes; ++l) f4Store(&rot[bones[l]], r[l]);
+			lanes = 0;
+		};
+
+		for (i32 i = 0, c = anim.m_rotations.size(); i < c; ++i) {
+			const i32 model_bone_index = remap.rotations[i];
+			if (model_bone_index < 0) continue;
+			const Animation::RotationCurve& curve = anim.m_rotations[i];
+
+			u32 k0, k1;
+			getKeys(curve, st, k0, k1, ts[lanes]);
+			const u16* a = curve.qrot + k0 * 3;
+			const u16* b = curve.qrot + k1 * 3;
+			for (u32 j = 0; j < 3; ++j) {
+				q0[j][lanes] = float(a[j] & 0x7fff);
+				q1[j][lanes] = float(b[j] & 0x7fff);
+			}
+			q0[3][lanes] = float((a[0] >> 15) | ((a[1] >> 15) << 1));
+			q1[3][lanes] = float((b[0] >> 15) | ((b[1] >> 15) << 1));
+			bones[lanes] = model_bone_index;
+			++lanes;
+			if (lanes == 4) flush();
+		}
+
+		if (lanes > 0) {
+			// identity in unused lanes
+			for (u32 l = lanes; l < 4; ++l) {
+				ts[l] = 0;
+				for (u32 j = 0; j < 3; ++j) q0[j][l] = q1[j][l] = QROT_OFFSET / QROT_SCALE;
+				q0[3][l] = q1[3][l] = 3;
+			}
+			flush();
+		}
+	}
+
+	// returns idx such that times[idx - 1] <= anim_t < times[idx], clamped to the last keyframe
+	template <typename Curve>
+	static LUMIX_FORCE_INLINE u32 findKeyframe(const Curve& curve, u16 anim_t) {
+		u32 idx = curve.key_lut[anim_t >> Animation::KEY_LUT_SHIFT];
+		const u32 last = curve.count - 1;
+		while (idx < last && curve.times[idx] <= anim_t) ++idx;
+		return idx;
+	}
+
+	template <bool use_weight>
 	static void getRelativePose(const Animation& anim, Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) {
 		ASSERT(!pose.is_absolute);
 		ASSERT(model.isReady());
 
 		Vec3* pos = pose.positions;
 		Quat* rot = pose.rotations;
+		const Animation::BoneRemap& remap = anim.getBoneRemap(model, mask);
+
+		if (anim.m_compressed) {
+			const SampleTime st = getSampleTime(anim, time);
+			sampleCompressedTranslations<use_weight>(anim, st, remap, pos, weight);
+			sampleCompressedRotations<use_weight>(anim, st, remap, rot, weight);
+			return;
+		}
 
 		if (time < anim.getLength()) {
 			const u64 anim_t_highres = ((u64)time.raw() << 16) / (anim.m_length.raw());
@@ -50,19 +333,14 @@ struct AnimationSampler {
 			const u32 frame_idx = u32(frame_48_16 >> 16);
 			const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
 		
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (i32 i = 0, c = anim.m_translations.size(); i < c; ++i) {
+				const i32 model_bone_index = remap.translations[i];
+				if (model_bone_index < 0) continue;
+				const Animation::TranslationCurve& curve = anim.m_translations[i];
 
 				Vec3 anim_pos;
 				if (curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
-					}
+					const u32 idx = findKeyframe(curve, anim_t);
 					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
 					anim_pos = lerp(curve.pos[idx - 1], curve.pos[idx], t);
 				}
@@ -70,7 +348,6 @@ struct AnimationSampler {
 					anim_pos = lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
 				}
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
 					pos[model_bone_index] = lerp(pos[model_bone_index], anim_pos, weight);
 				}
@@ -79,19 +356,14 @@ struct AnimationSampler {
 				}
 			}
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (i32 i = 0, c = anim.m_rotations.size(); i < c; ++i) {
+				const i32 model_bone_index = remap.rotations[i];
+				if (model_bone_index < 0) continue;
+				const Animation::RotationCurve& curve = anim.m_rotations[i];
 
 				Quat anim_rot;
 				if(curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
-					}
+					const u32 idx = findKeyframe(curve, anim_t);
 					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
 					anim_rot = nlerp(curve.rot[idx - 1], curve.rot[idx], t);
 				}
@@ -99,7 +371,6 @@ struct AnimationSampler {
 					anim_rot = nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
 				}
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
 					rot[model_bone_index] = nlerp(rot[model_bone_index], anim_rot, weight);
 				}
@@ -109,14 +380,11 @@ struct AnimationSampler {
 			}
 		}
 		else {
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (i32 i = 0, c = anim.m_translations.size(); i < c; ++i) {
+				const i32 model_bone_index = remap.translations[i];
+				if (model_bone_index < 0) continue;
+				const Animation::TranslationCurve& curve = anim.m_translations[i];
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
 					pos[model_bone_index] = lerp(pos[model_bone_index], curve.pos[curve.count - 1], weight);
 				}
@@ -125,14 +393,11 @@ struct AnimationSampler {
 				}
 			}
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+			for (i32 i = 0, c = anim.m_rotations.size(); i < c; ++i) {
+				const i32 model_bone_index = remap.rotations[i];
+				if (model_bone_index < 0) continue;
+				const Animation::RotationCurve& curve = anim.m_rotations[i];
 
-				const int model_bone_index = iter.value();
 				if constexpr (use_weight) {
 					rot[model_bone_index] = nlerp(rot[model_bone_index], curve.rot[curve.count - 1], weight);
 				}
@@ -145,51 +410,22 @@ struct AnimationSampler {
 }; // AnimationSampler
 
 void Animation::getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) const {
-	if (mask) {
-		if (weight < 0.9999f) {
-			AnimationSampler::getRelativePose<true, true>(*this, time, pose, model, weight, mask);
-		}
-		else {
-			AnimationSampler::getRelativePose<true, false>(*this, time, pose, model, weight, mask);
-		}
+	if (weight < 0.9999f) {
+		AnimationSampler::getRelativePose<true>(*this, time, pose, model, weight, mask);
 	}
 	else {
-		if (weight < 0.9999f) {
-			AnimationSampler::getRelativePose<false, true>(*this, time, pose, model, weight, mask);
-		}
-		else {
-			AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, weight, mask);
-		}
+		AnimationSampler::getRelativePose<false>(*this, time, pose, model, weight, mask);
 	}
 }
 
 Vec3 Animation::getTranslation(Time time, u32 curve_idx) const
 {
 	const TranslationCurve& curve = m_translations[curve_idx];
-	if (time < m_length) {
-		const u64 anim_t_highres = ((u64)time.raw() << 16) / (m_length.raw());
-		ASSERT(anim_t_highres <= 0xffFF);
-		const u16 anim_t = u16(anim_t_highres);
-
-		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
-
-			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return lerp(curve.pos[idx - 1], curve.pos[idx], t);
-		}
-
-		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
-		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
-		const u32 frame_idx = u32(frame_48_16 >> 16);
-		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
-
-		return lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
-	}
-
-	return curve.pos[curve.count - 1];
+	const AnimationSampler::SampleTime st = AnimationSampler::getSampleTime(*this, time);
+	u32 k0, k1;
+	float t;
+	AnimationSampler::getKeys(curve, st, k0, k1, t);
+	return lerp(AnimationSampler::getPos(curve, k0), AnimationSampler::getPos(curve, k1), t);
 }
 
 int Animation::getTranslationCurveIndex(u32 name_hash) const {
@@ -209,39 +445,15 @@ int Animation::getRotationCurveIndex(u32 name_hash) const {
 Quat Animation::getRotation(Time time, u32 curve_idx) const
 {
 	const RotationCurve& curve = m_rotations[curve_idx];
-	if (time < m_length) {
-		const u64 anim_t_highres = ((u64)time.raw() << 16) / (m_length.raw());
-		ASSERT(anim_t_highres <= 0xffFF);
-		const u16 anim_t = u16(anim_t_highres);
-
-		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
-
-			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return nlerp(curve.rot[idx - 1], curve.rot[idx], t);
-		}
-
-		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
-		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
-		const u32 frame_idx = u32(frame_48_16 >> 16);
-		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
-
-		return nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
-	}
-
-	return curve.rot[curve.count - 1];
+	const AnimationSampler::SampleTime st = AnimationSampler::getSampleTime(*this, time);
+	u32 k0, k1;
+	float t;
+	AnimationSampler::getKeys(curve, st, k0, k1, t);
+	return nlerp(AnimationSampler::getRot(curve, k0), AnimationSampler::getRot(curve, k1), t);
 }
 
 void Animation::getRelativePose(Time time, Pose& pose, const Model& model, const BoneMask* mask) const {
-	if(mask) {
-		AnimationSampler::getRelativePose<true, false>(*this, time, pose, model, 1, mask);
-	}
-	else {
-		AnimationSampler::getRelativePose<false, false>(*this, time, pose, model, 1, mask);
-	}
+	AnimationSampler::getRelativePose<false>(*this, time, pose, model, 1, mask);
 }
 
 bool Animation::load(u64 mem_size, const u8* mem)
@@ -249,6 +461,8 @@ bool Animation::load(u64 mem_size, const u8* mem)
 	m_translations.clear();
 	m_rotations.clear();
 	m_mem.clear();
+	m_key_luts.clear();
+	clearBoneRemaps();
 	Header header;
 	InputMemoryStream file(mem, mem_size);
 	file.read(&header, sizeof(header));
@@ -257,6 +471,12 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		return false;
 	}
 
+	if (header.version >= (u32)Version::LAST) {
+		logError("Unsupported animation version ", header.version, " in ", getPath());
+		return false;
+	}
+	m_compressed = header.version >= (u32)Version::COMPRESSED;
+
 	m_length = header.length;
 	m_frame_count = header.frame_count;
 	u32 translations_count;
@@ -275,7 +495,16 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		curve.count = blob.read<u32>();
 		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.pos = (const Vec3*)blob.skip(curve.count * sizeof(Vec3));
+		if (m_compressed) {
+			blob.read(curve.min);
+			blob.read(curve.scale);
+			curve.pos = nullptr;
+			curve.qpos = (const u16*)blob.skip(curve.count * sizeof(u16) * 3);
+		}
+		else {
+			curve.pos = (const Vec3*)blob.skip(curve.count * sizeof(Vec3));
+			curve.qpos = nullptr;
+		}
 	}
 	
 	const u32 rotations_count = blob.read<u32>();
@@ -288,9 +517,37 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		curve.count = blob.read<u32>();
 		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.rot = (const Quat*)blob.skip(curve.count * sizeof(Quat));
+		if (m_compressed) {
+			curve.rot = nullptr;
+			curve.qrot = (const u16*)blob.skip(curve.count * sizeof(u16) * 3);
+		}
+		else {
+			curve.rot = (const Quat*)blob.skip(curve.count * sizeof(Quat));
+			curve.qrot = nullptr;
+		}
 	}
 
+	u32 keyframed_count = 0;
+	for (const TranslationCurve& curve : m_translations) if (curve.times) ++keyframed_count;
+	for (const RotationCurve& curve : m_rotations) if (curve.times) ++keyframed_count;
+	m_key_luts.resize(keyframed_count * KEY_LUT_SIZE);
+	u16* lut = m_key_luts.begin();
+	auto initLUT = [&](auto& curve){
+		curve.key_lut = nullptr;
+		if (!curve.times) return;
+		curve.key_lut = lut;
+		// same as linear search from the first keyframe for the start of each lut bucket
+		u32 idx = 1;
+		for (u32 i = 0; i < KEY_LUT_SIZE; ++i) {
+			const u32 t = i << KEY_LUT_SHIFT;
+			while (idx < curve.count - 1 && curve.times[idx] <= t) ++idx;
+			lut[i] = (u16)idx;
+		}
+		lut += KEY_LUT_SIZE;
+	};
+	for (TranslationCurve& curve : m_translations) initLUT(curve);
+	for (RotationCurve& curve : m_rotations) initLUT(curve);
+
 	return true;
 }
 
@@ -300,6 +557,8 @@ void Animation::unload()
 	m_translations.clear();
 	m_rotations.clear();
 	m_mem.clear();
+	m_key_luts.clear();
+	clearBoneRemaps();
 	m_length = Time::fromSeconds(0);
 }
 
@@ -1,24 +1,29 @@
 #pragma once
 
 #include "engine/hash_map.h"
+#include "engine/math.h"
 #include "engine/resource.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 
 namespace Lumix
 {
 
 struct Model;
 struct Pose;
-struct Quat;
-struct Vec3;
 
 
 struct BoneMask
 {
-	BoneMask(IAllocator& allocator) : bones(allocator) {}
+	BoneMask(IAllocator& allocator);
 	BoneMask(BoneMask&& rhs) = default;
+	// call after `bones` is modified
+	void bonesChanged();
+
 	StaticString<32> name;
 	HashMap<u32, u8, HashFuncDirect<u32>> bones;
+	// unique for each content of `bones`, used to find cached remaps in Animation
+	u32 generation;
 };
 
 
@@ -34,6 +39,16 @@ struct Animation final : Resource
 			SAMPLED
 		};
 
+		enum class Version : u32 {
+			FIRST = 3,
+			// rotation key is 3x u16, 15 bits each - smallest three components of normalized quat with positive largest component,
+			// quantized from [-1/sqrt(2), 1/sqrt(2)]; top bits of the first two u16 are index of the largest component
+			// translation key is 3x u16, Vec3 min and Vec3 scale per curve
+			COMPRESSED,
+
+			LAST // keep this last
+		};
+
 		struct Header
 		{
 			u32 magic;
@@ -44,6 +59,7 @@ struct Animation final : Resource
 
 	public:
 		Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
+		~Animation();
 
 		ResourceType getType() const override { return TYPE; }
 
@@ -56,29 +72,56 @@ struct Animation final : Resource
 		Time getLength() const { return m_length; }
 
 	private:
+		// model's bone index for each curve, -1 if the bone is not in the model or it's masked out
+		struct BoneRemap {
+			BoneRemap(IAllocator& allocator) : translations(allocator), rotations(allocator) {}
+			const Model* model;
+			const void* model_bones; // changes when model is reloaded
+			u32 mask_generation; // 0 if there's no mask
+			Array<i16> translations;
+			Array<i16> rotations;
+		};
+
+		// keyframes are found starting from key_lut[anim_t >> KEY_LUT_SHIFT]
+		static constexpr u32 KEY_LUT_SHIFT = 10;
+		static constexpr u32 KEY_LUT_SIZE = 0x10000 >> KEY_LUT_SHIFT;
+
 		void unload() override;
 		bool load(u64 size, const u8* mem) override;
+		const BoneRemap& getBoneRemap(const Model& model, const BoneMask* mask) const;
+		void clearBoneRemaps();
 
 	private:
+		IAllocator& m_allocator;
 		Time m_length;
 		struct TranslationCurve
 		{
 			u32 name;
 			u32 count;
 			const u16* times;
-			const Vec3* pos;
+			const u16* key_lut;
+			const Vec3* pos; // null if compressed
+			const u16* qpos; // null if not compressed
+			Vec3 min;
+			Vec3 scale;
 		};
 		struct RotationCurve
 		{
 			u32 name;
 			u32 count;
 			const u16* times;
-			const Quat* rot;
+			const u16* key_lut;
+			const Quat* rot; // null if compressed
+			const u16* qrot; // null if not compressed
 		};
 		Array<TranslationCurve> m_translations;
 		Array<RotationCurve> m_rotations;
 		Array<u8> m_mem;
+		Array<u16> m_key_luts;
 		u32 m_frame_count = 0;
+		bool m_compressed = false;
+		mutable Mutex m_bone_remaps_mutex;
+		mutable Array<BoneRemap*> m_bone_remaps;
 
 		friend struct AnimationSampler;
 };
@@ -13,6 +13,7 @@
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
 #include "engine/universe.h"
 #include "nodes.h"
@@ -56,8 +57,32 @@ struct AnimationSceneImpl final : AnimationScene
 			float weight = 0;
 			Vec3 target;
 		} inverse_kinematics[4];
+
+		// distant animators are evaluated once per `interval` frames, poses are interpolated in between
+		struct LOD {
+			u32 interval = 1;
+			u32 frame = 0; // since the last evaluation
+			float time = 0; // accumulated since the last evaluation
+			// root motion of the last evaluation, it's extrapolated in the following frames
+			LocalRigidTransform root_motion = {{0, 0, 0}, {0, 0, 0, 1}};
+			float root_motion_time = 0;
+			LocalRigidTransform predicted_root_motion = {{0, 0, 0}, {0, 0, 0, 1}};
+			// relative poses of the last two evaluations
+			Pose* from = nullptr;
+			Pose* to = nullptr;
+			bool fresh = false; // `from` is not initialized yet
+		} lod;
+
+		// valid only during update
+		bool updating = false; // endUpdate should be called
+		Pose* eval_pose = nullptr; // relative pose to sample this frame, null if the graph is not evaluated
+		u32 eval_hash = 0;
+		i32 eval_source = -1; // animator in identical state, its sampled pose is copied instead of sampling
 	};
 
+	// frames between evaluations of animator for each model LOD, the last one is for instances beyond all LODs
+	static constexpr u32 LOD_UPDATE_INTERVALS[] = { 1, 2, 4, 8, 16 };
+
 
 	struct PropertyAnimator
 	{
@@ -81,9 +106,21 @@ struct AnimationSceneImpl final : AnimationScene
 		Array<Key> keys;
 
 		FlagSet<Flags, u32> flags;
+		// not up to date while the animator is in a PropertyAnimatorGroup, see invalidatePropertyAnimatorGroups
 		float time;
 	};
 
+	// enabled animators sharing an animation, evaluated together
+	// arrays are padded to multiple of 4
+	struct PropertyAnimatorGroup {
+		PropertyAnimatorGroup(IAllocator& allocator) : entities(allocator), times(allocator), frames(allocator), values(allocator) {}
+
+		Array<EntityRef> entities;
+		Array<float> times;
+		Array<float> frames;
+		Array<float> values;
+	};
+
 
 	AnimationSceneImpl(Engine& engine, IPlugin& anim_system, Universe& universe, IAllocator& allocator)
 		: m_universe(universe)
@@ -94,6 +131,8 @@ struct AnimationSceneImpl final : AnimationScene
 		, m_animators(allocator)
 		, m_allocator(allocator)
 		, m_animator_map(allocator)
+		, m_eval_groups(allocator)
+		, m_property_animator_groups(allocator)
 	{
 		m_is_game_running = false;
 	}
@@ -109,6 +148,8 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void clear() override
 	{
+		m_property_animator_groups.clear();
+		m_property_animator_groups_dirty = true;
 		for (PropertyAnimator& anim : m_property_animators)
 		{
 			unloadResource(anim.animation);
@@ -125,6 +166,7 @@ struct AnimationSceneImpl final : AnimationScene
 		{
 			unloadResource(animator.resource);
 			setSource(animator, nullptr);
+			releaseLOD(animator);
 		}
 		m_animators.clear();
 	}
@@ -274,6 +316,13 @@ struct AnimationSceneImpl final : AnimationScene
 	}
 
 
+	void releaseLOD(Animator& animator) {
+		LUMIX_DELETE(m_allocator, animator.lod.from);
+		LUMIX_DELETE(m_allocator, animator.lod.to);
+		animator.lod = {};
+	}
+
+
 	void onControllerResourceChanged(Resource::State old_state, Resource::State new_state, Resource& resource)
 	{
 		for (Animator& animator : m_animators) {
@@ -296,6 +345,7 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void destroyPropertyAnimator(EntityRef entity)
 	{
+		invalidatePropertyAnimatorGroups();
 		int idx = m_property_animators.find(entity);
 		auto& animator = m_property_animators.at(idx);
 		unloadResource(animator.animation);
@@ -319,6 +369,7 @@ struct AnimationSceneImpl final : AnimationScene
 		Animator& animator = m_animators[idx];
 		unloadResource(animator.resource);
 		setSource(animator, nullptr);
+		releaseLOD(animator);
 		const Animator& last = m_animators.back();
 		m_animator_map[last.entity] = idx;
 		m_animator_map.erase(entity);
@@ -375,6 +426,7 @@ struct AnimationSceneImpl final : AnimationScene
 		}
 
 		serializer.read(count);
+		invalidatePropertyAnimatorGroups();
 		m_property_animators.reserve(count + m_property_animators.size());
 		for (u32 i = 0; i < count; ++i)
 		{
@@ -438,6 +490,7 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void enablePropertyAnimator(EntityRef entity, bool enabled) override
 	{
+		invalidatePropertyAnimatorGroups();
 		PropertyAnimator& animator = m_property_animators.get(entity);
 		animator.flags.set(PropertyAnimator::DISABLED, !enabled);
 		animator.time = 0;
@@ -457,6 +510,7 @@ struct AnimationSceneImpl final : AnimationScene
 	
 	void setPropertyAnimation(EntityRef entity, const Path& path) override
 	{
+		invalidatePropertyAnimatorGroups();
 		auto& animator = m_property_animators.get(entity);
 		animator.time = 0;
 		unloadResource(animator.animation);
@@ -514,7 +568,7 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void updateAnimator(EntityRef entity, float time_delta) override {
 		Animator& animator = m_animators[m_animator_map[entity]];
-		updateAnimator(animator, time_delta);
+		updateAnimator(animator, time_delta, nullptr);
 	}
 
 	void setAnimatorInput(EntityRef entity, u32 input_idx, float value) override {
@@ -616,8 +670,25 @@ struct AnimationSceneImpl final : AnimationScene
 		return animator.default_set;
 	}
 
-	void updateAnimator(Animator& animator, float time_delta)
-	{
+	static void copyPose(Pose& dst, const Pose& src) {
+		ASSERT(dst.count == src.count);
+		memcpy(dst.positions, src.positions, sizeof(dst.positions[0]) * src.count);
+		memcpy(dst.rotations, src.rotations, sizeof(dst.rotations[0]) * src.count);
+		dst.is_absolute = src.is_absolute;
+	}
+
+	// `camera_pos` is null if LOD should not be used
+	u32 getLODUpdateInterval(EntityRef entity, Model& model, const DVec3* camera_pos) const {
+		if (!camera_pos) return 1;
+		const float squared_dist = float(squaredLength(m_universe.getPosition(entity) - *camera_pos));
+		return LOD_UPDATE_INTERVALS[model.getLODMeshIndices(squared_dist)];
+	}
+
+	// updates graph's state, the pose is sampled later, so animators in identical state can share it
+	void beginUpdate(Animator& animator, float time_delta, const DVec3* camera_pos) {
+		animator.updating = false;
+		animator.eval_pose = nullptr;
+		animator.eval_source = -1;
 		if (!animator.resource || !animator.resource->isReady()) return;
 		if (!animator.ctx) {
 			animator.ctx = animator.resource->createRuntime(animator.default_set);
@@ -632,23 +703,113 @@ struct AnimationSceneImpl final : AnimationScene
 		Pose* pose = m_render_scene->lockPose(entity);
 		if (!pose) return;
 
-		animator.ctx->model = model;
-		animator.ctx->time_delta = Time::fromSeconds(time_delta);
-		animator.ctx->root_bone_hash = crc32(animator.resource->m_root_motion_bone);
-		animator.resource->update(*animator.ctx, animator.root_motion);
+		animator.updating = true;
+		anim::RuntimeContext& ctx = *animator.ctx;
+		ctx.model = model;
+		ctx.root_bone_hash = crc32(animator.resource->m_root_motion_bone);
+
+		Animator::LOD& lod = animator.lod;
+		const u32 interval = getLODUpdateInterval(entity, *model, camera_pos);
+		if (interval == 1 && lod.interval == 1) {
+			ctx.time_delta = Time::fromSeconds(time_delta);
+			animator.resource->update(ctx, animator.root_motion);
+			animator.eval_pose = pose;
+		}
+		else {
+			lod.time += time_delta;
+			if (!lod.to || lod.to->count != pose->count || lod.frame >= lod.interval) {
+				if (!lod.to || lod.to->count != pose->count) {
+					releaseLOD(animator);
+					lod.from = LUMIX_NEW(m_allocator, Pose)(m_allocator);
+					lod.to = LUMIX_NEW(m_allocator, Pose)(m_allocator);
+					lod.from->resize(pose->count);
+					lod.to->resize(pose->count);
+					lod.fresh = true;
+				}
+				swap(lod.from, lod.to);
+				LocalRigidTransform root_motion;
+				ctx.time_delta = Time::fromSeconds(lod.time);
+				animator.resource->update(ctx, root_motion);
+				animator.eval_pose = lod.to;
+
+				// part of the root motion was already applied by extrapolation
+				animator.root_motion = lod.predicted_root_motion.inverted() * root_motion;
+				lod.root_motion = root_motion;
+				lod.root_motion_time = lod.time;
+				lod.predicted_root_motion = {{0, 0, 0}, {0, 0, 0, 1}};
+				lod.interval = interval;
+				lod.frame = 0;
+				lod.time = 0;
+			}
+			else {
+				const LocalRigidTransform identity = {{0, 0, 0}, {0, 0, 0, 1}};
+				const float t = lod.root_motion_time > 0 ? time_delta / lod.root_motion_time : 0;
+				animator.root_motion = identity.interpolate(lod.root_motion, t);
+				lod.predicted_root_motion = lod.predicted_root_motion * animator.root_motion;
+				// events were processed in the last evaluation
+				ctx.events.clear();
+			}
+		}
 
-		model->getRelativePose(*pose);
-		animator.resource->getPose(*animator.ctx, *pose);
-		
-		for (Animator::IK& ik : animator.inverse_kinematics) {
-			if (ik.weight == 0) break;
-			const u32 idx = u32(&ik - animator.inverse_kinematics);
-			updateIK(animator.resource->m_ik[idx], ik, *pose, *model);
+		if (animator.eval_pose) {
+			// everything the sampled pose depends on
+			u32 hash = crc32(ctx.data.data(), (u32)ctx.data.size());
+			hash = continueCrc32(hash, ctx.inputs.begin(), ctx.inputs.byte_size());
+			hash = continueCrc32(hash, ctx.animations.begin(), ctx.animations.byte_size());
+			const void* keys[] = { animator.resource, model };
+			animator.eval_hash = continueCrc32(hash, keys, sizeof(keys));
 		}
+	}
 
-		pose->computeAbsolute(*model);
+	static bool isSameState(const Animator& a, const Animator& b) {
+		if (a.resource != b.resource) return false;
+		const anim::RuntimeContext& ca = *a.ctx;
+		const anim::RuntimeContext& cb = *b.ctx;
+		if (ca.model != cb.model) return false;
+		if (ca.data.size() != cb.data.size() || memcmp(ca.data.data(), cb.data.data(), ca.data.size()) != 0) return false;
+		if (ca.inputs.size() != cb.inputs.size() || memcmp(ca.inputs.begin(), cb.inputs.begin(), ca.inputs.byte_size()) != 0) return false;
+		if (ca.animations.size() != cb.animations.size() || memcmp(ca.animations.begin(), cb.animations.begin(), ca.animations.byte_size()) != 0) return false;
+		return true;
+	}
 
-		m_render_scene->unlockPose(entity, true);
+	void samplePose(Animator& animator) {
+		Model& model = *animator.ctx->model;
+		model.getRelativePose(*animator.eval_pose);
+		animator.resource->getPose(*animator.ctx, *animator.eval_pose);
+	}
+
+	void endUpdate(Animator& animator) {
+		Pose* pose = m_render_scene->lockPose(animator.entity);
+		Model& model = *animator.ctx->model;
+		Animator::LOD& lod = animator.lod;
+		if (animator.eval_pose == pose) {
+			for (Animator::IK& ik : animator.inverse_kinematics) {
+				if (ik.weight == 0) break;
+				const u32 idx = u32(&ik - animator.inverse_kinematics);
+				updateIK(animator.resource->m_ik[idx], ik, *pose, model);
+			}
+		}
+		else {
+			if (lod.fresh) {
+				copyPose(*lod.from, *lod.to);
+				lod.fresh = false;
+			}
+			++lod.frame;
+			copyPose(*pose, *lod.from);
+			pose->blend(*lod.to, float(lod.frame) / lod.interval);
+			// IK is skipped for distant animators
+		}
+
+		pose->computeAbsolute(model);
+
+		m_render_scene->unlockPose(animator.entity, true);
+	}
+
+	void updateAnimator(Animator& animator, float time_delta, const DVec3* camera_pos)
+	{
+		beginUpdate(animator, time_delta, camera_pos);
+		if (animator.eval_pose) samplePose(animator);
+		if (animator.updating) endUpdate(animator);
 	}
 
 	static LocalRigidTransform getAbsolutePosition(const Pose& pose, const Model& model, int bone_index)
@@ -784,22 +945,107 @@ struct AnimationSceneImpl final : AnimationScene
 	}
 
 
+	// must be called before animators are changed, groups are rebuilt in the next update
+	void invalidatePropertyAnimatorGroups() {
+		if (m_property_animator_groups_dirty) return;
+		m_property_animator_groups_dirty = true;
+
+		// animators did not change since groups were built, so all entities exist
+		for (const PropertyAnimatorGroup& group : m_property_animator_groups) {
+			for (i32 i = 0, c = group.entities.size(); i < c; ++i) {
+				m_property_animators.get(group.entities[i]).time = group.times[i];
+			}
+		}
+	}
+
+	void rebuildPropertyAnimatorGroups() {
+		if (!m_property_animator_groups_dirty) return;
+		m_property_animator_groups_dirty = false;
+
+		for (PropertyAnimatorGroup& group : m_property_animator_groups) {
+			group.entities.clear();
+			group.times.clear();
+		}
+		for (i32 i = 0, c = m_property_animators.size(); i < c; ++i) {
+			const PropertyAnimator& animator = m_property_animators.at(i);
+			if (!animator.animation || animator.flags.isSet(PropertyAnimator::DISABLED)) continue;
+
+			auto iter = m_property_animator_groups.find(animator.animation);
+			if (!iter.isValid()) iter = m_property_animator_groups.insert(animator.animation, PropertyAnimatorGroup(m_allocator));
+			PropertyAnimatorGroup& group = iter.value();
+			group.entities.push(m_property_animators.getKey(i));
+			group.times.push(animator.time);
+		}
+		m_property_animator_groups.eraseIf([](const PropertyAnimatorGroup& group){ return group.entities.empty(); });
+		for (PropertyAnimatorGroup& group : m_property_animator_groups) {
+			const i32 padded = (group.entities.size() + 3) & ~3;
+			group.times.resize(padded);
+			for (i32 i = group.entities.size(); i < padded; ++i) group.times[i] = 0;
+			group.frames.resize(padded);
+			group.values.resize(padded);
+		}
+	}
+
+	void updatePropertyAnimatorGroup(const PropertyAnimation& animation, PropertyAnimatorGroup& group, float time_delta) {
+		const float length = (float)animation.curves[0].frames.back();
+		if (length <= 0) return;
+
+		// times are wrapped to animation's duration, so frames stay precise
+		const float4 dt4 = f4Splat(time_delta);
+		const float4 fps4 = f4Splat((float)animation.fps);
+		const float4 half4 = f4Splat(0.5f);
+		const float4 length4 = f4Splat(length);
+		const float duration = length / animation.fps;
+		const float4 duration4 = f4Splat(duration);
+		const float4 inv_duration4 = f4Splat(1 / duration);
+		for (i32 i = 0, c = group.times.size(); i < c; i += 4) {
+			float4 t = f4Add(f4Load(&group.times[i]), dt4);
+			t = f4Sub(t, f4Mul(f4Trunc(f4Mul(t, inv_duration4)), duration4));
+			f4Store(&group.times[i], t);
+			// int(time * fps + 0.5) % length
+			float4 frame = f4Trunc(f4Add(f4Mul(t, fps4), half4));
+			frame = f4Select(f4CmpLT(frame, length4), frame, f4Sub(frame, length4));
+			f4Store(&group.frames[i], frame);
+		}
+
+		const Span<const EntityRef> entities(group.entities.begin(), group.entities.end());
+		for (const PropertyAnimation::Curve& curve : animation.curves) {
+			const i32 keys_count = curve.frames.size();
+			if (keys_count < 2) continue;
+
+			for (i32 i = 0, c = group.frames.size(); i < c; i += 4) {
+				const float4 frame = f4Load(&group.frames[i]);
+				// frames after the last key keep its value
+				float4 v = f4Splat(curve.values.back());
+				// backwards, so the first key not before the frame wins
+				for (i32 k = keys_count - 1; k > 0; --k) {
+					const float f0 = (float)curve.frames[k - 1];
+					const float f1 = (float)curve.frames[k];
+					const float inv_range = f1 != f0 ? 1 / (f1 - f0) : 0;
+					const float4 rel = f4Mul(f4Sub(frame, f4Splat(f0)), f4Splat(inv_range));
+					const float4 segment_v = f4Add(f4Splat(curve.values[k - 1]), f4Mul(rel, f4Splat(curve.values[k] - curve.values[k - 1])));
+					v = f4Select(f4CmpGT(frame, f4Splat(f1)), v, segment_v);
+				}
+				f4Store(&group.values[i], v);
+			}
+
+			ASSERT(curve.property->setter);
+			IScene* scene = m_universe.getScene(curve.cmp_type);
+			curve.property->set(scene, curve.cmp_type, entities, -1, Span<const float>(group.values.begin(), (u32)group.entities.size()));
+		}
+	}
+
 	void updatePropertyAnimators(float time_delta)
 	{
 		PROFILE_FUNCTION();
-		for (int anim_idx = 0, c = m_property_animators.size(); anim_idx < c; ++anim_idx)
-		{
-			EntityRef entity = m_property_animators.getKey(anim_idx);
-			PropertyAnimator& animator = m_property_animators.at(anim_idx);
-			const PropertyAnimation* animation = animator.animation;
-			if (!animation || !animation->isReady()) continue;
+		rebuildPropertyAnimatorGroups();
+		for (auto iter = m_property_animator_groups.begin(), end = m_property_animator_groups.end(); iter != end; ++iter) {
+			const PropertyAnimation* animation = iter.key();
+			if (!animation->isReady()) continue;
 			if (animation->curves.empty()) continue;
 			if (animation->curves[0].frames.empty()) continue;
-			if (animator.flags.isSet(PropertyAnimator::DISABLED)) continue;
 
-			animator.time += time_delta;
-			
-			applyPropertyAnimator(entity, animator);
+			updatePropertyAnimatorGroup(*animation, iter.value(), time_delta);
 		}
 	}
 
@@ -809,9 +1055,11 @@ struct AnimationSceneImpl final : AnimationScene
 		PROFILE_FUNCTION();
 		if (m_animables.size() == 0) return;
 
-		jobs::forEach(m_animables.size(), 1, [&](i32 idx, i32){
-			Animable& animable = m_animables.at(idx);
-			updateAnimable(animable, time_delta);
+		jobs::forEach(m_animables.size(), jobs::GrainHint{5000}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			for (i32 idx = from; idx < to; ++idx) {
+				Animable& animable = m_animables.at(idx);
+				updateAnimable(animable, time_delta);
+			}
 		});
 	}
 
@@ -825,9 +1073,72 @@ struct AnimationSceneImpl final : AnimationScene
 		updateAnimables(time_delta);
 		updatePropertyAnimators(time_delta);
 
-		jobs::forEach(m_animators.size(), 1, [&](i32 idx, i32){
-			updateAnimator(m_animators[idx], time_delta);
+		updateAnimators(time_delta);
+	}
+
+
+	SceneAccess getUpdateAccess() const override {
+		// property animators set arbitrary properties of arbitrary components
+		if (m_property_animators.size() > 0) return {};
+		SceneAccess access;
+		// endUpdate writes poses, which moves bone attachments
+		access.reads = SceneAccess::TRANSFORMS | SceneAccess::POSES;
+		access.writes = SceneAccess::TRANSFORMS | SceneAccess::POSES;
+		return access;
+	}
+
+
+	void updateAnimators(float time_delta) {
+		PROFILE_FUNCTION();
+		if (m_animators.empty()) return;
+
+		const EntityPtr camera = m_render_scene->getActiveCamera();
+		const DVec3 camera_pos = camera.isValid() ? m_universe.getPosition((EntityRef)camera) : DVec3(0);
+		const DVec3* lod_ref_point = camera.isValid() ? &camera_pos : nullptr;
+		jobs::forEach(m_animators.size(), jobs::GrainHint{10000}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			for (i32 idx = from; idx < to; ++idx) {
+				beginUpdate(m_animators[idx], time_delta, lod_ref_point);
+			}
+		});
+
+		// animators with the same controller in the same state, e.g. crowds, sample the pose only once
+		m_eval_groups.clear();
+		for (i32 i = 0, c = m_animators.size(); i < c; ++i) {
+			Animator& animator = m_animators[i];
+			if (!animator.eval_pose) continue;
+			auto iter = m_eval_groups.find(animator.eval_hash);
+			if (!iter.isValid()) {
+				m_eval_groups.insert(animator.eval_hash, i);
+				continue;
+			}
+			const Animator& source = m_animators[iter.value()];
+			if (isSameState(animator, source)) animator.eval_source = iter.value();
+		}
+
+		jobs::forEach(m_animators.size(), jobs::GrainHint{10000}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			for (i32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (animator.eval_pose && animator.eval_source < 0) samplePose(animator);
+			}
+		});
+
+		// sources' poses must not be modified by endUpdate yet
+		jobs::forEach(m_animators.size(), jobs::GrainHint{10000}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			for (i32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (animator.eval_source >= 0) copyPose(*animator.eval_pose, *m_animators[animator.eval_source].eval_pose);
+			}
+		});
+
+		// endUpdate moves bone attachments, their hierarchies are updated once after all animators
+		m_universe.beginDeferredTransforms();
+		jobs::forEach(m_animators.size(), jobs::GrainHint{10000}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			for (i32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (animator.updating) endUpdate(animator);
+			}
 		});
+		m_universe.endDeferredTransforms();
 	}
 
 
@@ -855,6 +1166,7 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void createPropertyAnimator(EntityRef entity)
 	{
+		invalidatePropertyAnimatorGroups();
 		PropertyAnimator& animator = m_property_animators.emplace(entity, m_allocator);
 		animator.animation = nullptr;
 		animator.time = 0;
@@ -894,6 +1206,9 @@ struct AnimationSceneImpl final : AnimationScene
 	AssociativeArray<EntityRef, PropertyAnimator> m_property_animators;
 	HashMap<EntityRef, u32> m_animator_map;
 	Array<Animator> m_animators;
+	HashMap<u32, i32, HashFuncDirect<u32>> m_eval_groups;
+	HashMap<PropertyAnimation*, PropertyAnimatorGroup> m_property_animator_groups;
+	bool m_property_animator_groups_dirty = true;
 	RenderScene* m_render_scene;
 	bool m_is_game_running;
 };
@@ -195,140 +195,6 @@ private:
 };
 
 
-struct ExpressionVM
-{
-public:
-	static const int STACK_SIZE = 50;
-
-	struct ReturnValue
-	{
-		ReturnValue()
-		{
-			type = Types::NONE;
-		}
-
-		explicit ReturnValue(float f)
-		{
-			f_value = f;
-			type = Types::FLOAT;
-		}
-
-		explicit ReturnValue(bool b)
-		{
-			b_value = b;
-			type = Types::BOOL;
-		}
-
-		Types type;
-		union
-		{
-			float f_value;
-			bool b_value;
-		};
-	};
-
-public:
-	ReturnValue evaluate(const u8* code, const RuntimeContext& rc);
-
-private:
-	void callFunction(u16 idx, const RuntimeContext& rc);
-
-	template<typename T>
-	T& pop()
-	{
-		m_stack_pointer -= sizeof(T);
-		return *(T*)(m_stack + m_stack_pointer);
-	}
-
-
-	template <typename T>
-	const u8* pushStackConst(const u8* cp)
-	{
-		*(T*)(m_stack + m_stack_pointer) = *(T*)cp;
-		m_stack_pointer += sizeof(T);
-		return cp + sizeof(T);
-	}
-
-
-	template <typename T>
-	void push(T value)
-	{
-		*(T*)(m_stack + m_stack_pointer) = value;
-		m_stack_pointer += sizeof(T);
-	}
-
-private:
-	u8 m_stack[STACK_SIZE];
-	int m_stack_pointer;
-};
-
-
-ExpressionVM::ReturnValue ExpressionVM::evaluate(const u8* code, const RuntimeContext& rc)
-{
-	m_stack_pointer = 0;
-	const u8* cp = code;
-	for (;;)
-	{
-		u8 type = *cp;
-		++cp;
-		switch (type)
-		{
-			case Instruction::CALL:
-				callFunction(*(u16*)cp, rc);
-				cp += sizeof(u16);
-				break;
-			case Instruction::INPUT_FLOAT:
-				push<float>(*(float*)(rc.inputs.begin() + *(int*)cp));
-				cp += sizeof(int);
-				break;
-			case Instruction::INPUT_BOOL:
-				push<bool>(*(bool*)(rc.inputs.begin() + *(int*)cp));
-				cp += sizeof(int);
-				break;
-			case Instruction::INPUT_U32:
-				push<u32>(*(u32*)(rc.inputs.begin() + *(int*)cp));
-				cp += sizeof(u32);
-				break;
-			case Instruction::RET_FLOAT: return ExpressionVM::ReturnValue(pop<float>());
-			case Instruction::RET_BOOL: return ExpressionVM::ReturnValue(pop<bool>());
-			case Instruction::ADD_FLOAT: push<float>(pop<float>() + pop<float>()); break;
-			case Instruction::SUB_FLOAT: push<float>(-pop<float>() + pop<float>()); break;
-			case Instruction::PUSH_BOOL: cp = pushStackConst<bool>(cp); break;
-			case Instruction::PUSH_FLOAT: cp = pushStackConst<float>(cp); break;
-			case Instruction::PUSH_U32: cp = pushStackConst<u32>(cp); break;
-			case Instruction::FLOAT_LT: push<bool>(pop<float>() > pop<float>()); break;
-			case Instruction::FLOAT_GT: push<bool>(pop<float>() < pop<float>()); break;
-			case Instruction::INT_EQ: push<bool>(pop<int>() == pop<int>()); break;
-			case Instruction::INT_NEQ: push<bool>(pop<int>() != pop<int>()); break;
-			case Instruction::MUL_FLOAT: push<float>(pop<float>() * pop<float>()); break;
-			case Instruction::DIV_FLOAT:
-			{
-				float f = pop<float>();
-				push<float>(pop<float>() / f);
-			}
-			break;
-			case Instruction::UNARY_MINUS: push<float>(-pop<float>()); break;
-			case Instruction::OR:
-			{
-				bool b1 = pop<bool>();
-				bool b2 = pop<bool>();
-				push<bool>(b1 || b2);
-			}
-			break;
-			case Instruction::AND:
-			{
-				bool b1 = pop<bool>();
-				bool b2 = pop<bool>();
-				push<bool>(b1 && b2);
-			}
-			break;
-			case Instruction::NOT: push<bool>(!pop<bool>()); break;
-			default: ASSERT(false); break;
-		}
-	}
-}
-
-
 int ExpressionCompiler::toPostfix(const char* src, const Token* input, Token* output, int count)
 {
 	Token func_stack[64];
@@ -438,30 +304,6 @@ int ExpressionCompiler::toPostfix(const char* src, const Token* input, Token* ou
 }
 
 
-void ExpressionVM::callFunction(u16 idx, const RuntimeContext& rc)
-{
-	switch(idx)
-	{
-		case 0: push<float>(sinf(pop<float>())); break;
-		case 1: push<float>(cosf(pop<float>())); break;
-		case 2: {
-			const float a = pop<float>();
-			const float b = pop<float>();
-			const float epsilon = pop<float>();
-			ASSERT(epsilon >= 0);
-			const bool res = a-b > -epsilon && a-b < epsilon;
-			push<bool>(res); 
-			break;
-		}
-		// TODO
-		//case 3: push<float>(rc.current->getTime()); break;
-		//case 4: push<float>(rc.current->getLength()); break;
-		//case 5: push<bool>(rc.current->getTime() > rc.current->getLength() - rc.edge->length); break;
-		default: ASSERT(false); break;
-	}
-}
-
-
 static const struct
 {
 	ExpressionCompiler::Token::Operator op;
@@ -880,6 +722,160 @@ int ExpressionCompiler::tokenize(const char* src, const Span<Token>& tokens)
 }
 
 
+union Value {
+	float f;
+	u32 u;
+	bool b;
+};
+
+
+static Value evalOp(const Condition::Op* ops, u32 idx, const u8* inputs)
+{
+	const Condition::Op& op = ops[idx];
+	Value res;
+	switch (op.instr)
+	{
+		case Instruction::PUSH_BOOL: res.b = op.b_value; break;
+		case Instruction::PUSH_FLOAT: res.f = op.f_value; break;
+		case Instruction::PUSH_U32: res.u = op.u_value; break;
+		case Instruction::INPUT_FLOAT: memcpy(&res.f, inputs + op.offset, sizeof(res.f)); break;
+		case Instruction::INPUT_U32: memcpy(&res.u, inputs + op.offset, sizeof(res.u)); break;
+		case Instruction::INPUT_BOOL: res.b = inputs[op.offset] != 0; break;
+		case Instruction::ADD_FLOAT: res.f = evalOp(ops, op.args[0], inputs).f + evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::SUB_FLOAT: res.f = evalOp(ops, op.args[0], inputs).f - evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::MUL_FLOAT: res.f = evalOp(ops, op.args[0], inputs).f * evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::DIV_FLOAT: res.f = evalOp(ops, op.args[0], inputs).f / evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::UNARY_MINUS: res.f = -evalOp(ops, op.args[0], inputs).f; break;
+		case Instruction::FLOAT_LT: res.b = evalOp(ops, op.args[0], inputs).f < evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::FLOAT_GT: res.b = evalOp(ops, op.args[0], inputs).f > evalOp(ops, op.args[1], inputs).f; break;
+		case Instruction::INT_EQ: res.b = evalOp(ops, op.args[0], inputs).u == evalOp(ops, op.args[1], inputs).u; break;
+		case Instruction::INT_NEQ: res.b = evalOp(ops, op.args[0], inputs).u != evalOp(ops, op.args[1], inputs).u; break;
+		// short-circuit
+		case Instruction::AND: res.b = evalOp(ops, op.args[0], inputs).b && evalOp(ops, op.args[1], inputs).b; break;
+		case Instruction::OR: res.b = evalOp(ops, op.args[0], inputs).b || evalOp(ops, op.args[1], inputs).b; break;
+		case Instruction::NOT: res.b = !evalOp(ops, op.args[0], inputs).b; break;
+		case Instruction::CALL:
+			switch (op.func_idx) {
+				case 0: res.f = sinf(evalOp(ops, op.args[0], inputs).f); break;
+				case 1: res.f = cosf(evalOp(ops, op.args[0], inputs).f); break;
+				case 2: {
+					const float epsilon = evalOp(ops, op.args[0], inputs).f;
+					const float b = evalOp(ops, op.args[1], inputs).f;
+					const float a = evalOp(ops, op.args[2], inputs).f;
+					ASSERT(epsilon >= 0);
+					res.b = a - b > -epsilon && a - b < epsilon;
+					break;
+				}
+				// TODO time, length, finishing
+				default: ASSERT(false); res.u = 0; break;
+			}
+			break;
+		default: ASSERT(false); res.u = 0; break;
+	}
+	return res;
+}
+
+
+static Types getRetType(const Condition::Op& op)
+{
+	if (op.instr == Instruction::CALL) return FUNCTIONS[op.func_idx].ret_type;
+	for (const auto& fn : OPERATOR_FUNCTIONS) {
+		if (fn.instr == op.instr) return fn.ret_type;
+	}
+	ASSERT(false);
+	return Types::NONE;
+}
+
+
+static u32 getInputIdxByOffset(const InputDecl& decl, u32 offset)
+{
+	for (u32 i = 0; i < lengthOf(decl.inputs); ++i) {
+		if (decl.inputs[i].type != InputDecl::EMPTY && decl.inputs[i].offset == (int)offset) return i;
+	}
+	ASSERT(false);
+	return 0;
+}
+
+
+// converts bytecode to expression tree, folds subexpressions with only constant operands
+static void buildOps(const u8* code, const InputDecl& decl, Condition& condition)
+{
+	condition.ops.clear();
+	condition.inputs_mask = 0;
+	u16 stack[64];
+	u32 stack_size = 0;
+	for (const u8* cp = code;;) {
+		Condition::Op op;
+		op.instr = *cp;
+		++cp;
+		switch (op.instr) {
+			case Instruction::RET_FLOAT:
+			case Instruction::RET_BOOL:
+				ASSERT(stack_size == 1);
+				return;
+			case Instruction::PUSH_BOOL: op.b_value = *(bool*)cp; cp += sizeof(bool); break;
+			case Instruction::PUSH_FLOAT: memcpy(&op.f_value, cp, sizeof(float)); cp += sizeof(float); break;
+			case Instruction::PUSH_U32: memcpy(&op.u_value, cp, sizeof(u32)); cp += sizeof(u32); break;
+			case Instruction::INPUT_FLOAT:
+			case Instruction::INPUT_U32:
+			case Instruction::INPUT_BOOL: {
+				int offset;
+				memcpy(&offset, cp, sizeof(offset));
+				cp += sizeof(offset);
+				op.offset = offset;
+				condition.inputs_mask |= 1 << getInputIdxByOffset(decl, offset);
+				break;
+			}
+			case Instruction::CALL: {
+				u16 func_idx;
+				memcpy(&func_idx, cp, sizeof(func_idx));
+				cp += sizeof(func_idx);
+				op.func_idx = func_idx;
+				op.args_count = FUNCTIONS[func_idx].arity();
+				break;
+			}
+			case Instruction::UNARY_MINUS:
+			case Instruction::NOT:
+				op.args_count = 1;
+				break;
+			default:
+				op.args_count = 2;
+				break;
+		}
+
+		ASSERT(stack_size >= op.args_count);
+		bool all_const = true;
+		for (u32 i = 0; i < op.args_count; ++i) {
+			const u16 arg = stack[stack_size - op.args_count + i];
+			op.args[i] = arg;
+			const u8 arg_instr = condition.ops[arg].instr;
+			all_const = all_const && (arg_instr == Instruction::PUSH_BOOL || arg_instr == Instruction::PUSH_FLOAT || arg_instr == Instruction::PUSH_U32);
+		}
+		stack_size -= op.args_count;
+
+		if (op.args_count > 0 && all_const) {
+			// constant args are the last ops, replace them with the result
+			const Types type = getRetType(op);
+			condition.ops.push(op);
+			const Value v = evalOp(condition.ops.begin(), condition.ops.size() - 1, nullptr);
+			condition.ops.shrink(condition.ops.size() - op.args_count - 1);
+			op = {};
+			switch (type) {
+				case Types::FLOAT: op.instr = Instruction::PUSH_FLOAT; op.f_value = v.f; break;
+				case Types::BOOL: op.instr = Instruction::PUSH_BOOL; op.b_value = v.b; break;
+				case Types::U32: op.instr = Instruction::PUSH_U32; op.u_value = v.u; break;
+				default: ASSERT(false); break;
+			}
+		}
+
+		ASSERT(stack_size < lengthOf(stack));
+		stack[stack_size] = (u16)condition.ops.size();
+		++stack_size;
+		condition.ops.push(op);
+	}
+}
+
+
 const char* Condition::errorToString(Error error)
 {
 	switch (error)
@@ -901,16 +897,28 @@ const char* Condition::errorToString(Error error)
 
 
 Condition::Condition(IAllocator& allocator)
-	: bytecode(allocator)
+	: ops(allocator)
 {}
 
 
-bool Condition::eval(const RuntimeContext& rc) const
+bool Condition::eval(RuntimeContext& rc) const
 {
-	if(bytecode.size() == 0) return true;
-	ExpressionVM vm;
-	auto ret = vm.evaluate(&bytecode[0], rc);
-	return ret.b_value;
+	if (ops.empty()) return true;
+	const Op& root = ops.back();
+	if (root.instr == Instruction::PUSH_BOOL) return root.b_value;
+
+	if (cache_idx >= rc.condition_cache.size()) return evalOp(ops.begin(), ops.size() - 1, rc.inputs.begin()).b;
+
+	RuntimeContext::ConditionCache& cache = rc.condition_cache[cache_idx];
+	bool valid = cache.stamp != 0;
+	for (u32 i = 0; valid && (inputs_mask >> i) != 0; ++i) {
+		if ((inputs_mask & (1 << i)) && rc.input_stamps[i] > cache.stamp) valid = false;
+	}
+	if (valid) return cache.value;
+
+	cache.value = evalOp(ops.begin(), ops.size() - 1, rc.inputs.begin()).b;
+	cache.stamp = rc.update_counter;
+	return cache.value;
 }
 
 
@@ -933,15 +941,17 @@ void Condition::compile(const char* expression, InputDecl& decl)
 		error = compiler.getError();
 		return;
 	}
-	bytecode.resize(128);
-	int size = compiler.compile(expression, postfix_tokens, tokens_count, &bytecode[0], bytecode.size(), decl);
+	u8 bytecode[128];
+	int size = compiler.compile(expression, postfix_tokens, tokens_count, bytecode, sizeof(bytecode), decl);
 	if (size < 0)
 	{
 		compile("1 < 0", decl);
 		error = compiler.getError();
 		return;
 	}
-	bytecode.resize(size);
+	buildOps(bytecode, decl, *this);
+	// recompiled conditions (e.g. in editor) can not reuse results cached for the old expression
+	cache_idx = 0xffFFffFF;
 	error = Condition::Error::NONE;
 }
 
@@ -68,6 +68,20 @@ struct InputDecl
 
 struct Condition
 {
+	// node of compiled expression tree, nodes are in postfix order, root is the last one
+	struct Op {
+		u8 instr;
+		u8 args_count = 0;
+		u16 args[3];
+		union {
+			float f_value;
+			u32 u_value;
+			bool b_value;
+			u32 offset; // input byte offset
+			u32 func_idx;
+		};
+	};
+
 	enum class Error
 	{
 		NONE,
@@ -87,10 +101,15 @@ struct Condition
 
 	explicit Condition(IAllocator& allocator);
 
-	bool eval(const struct RuntimeContext& rc) const;
+	// result is cached in `rc` until some of the inputs it reads change
+	bool eval(struct RuntimeContext& rc) const;
 	void compile(const char* expression, InputDecl& decl);
 
-	Array<u8> bytecode;
+	Array<Op> ops;
+	// bit per InputDecl::inputs index read by the expression
+	u32 inputs_mask = 0;
+	// index to RuntimeContext::condition_cache, assigned when the controller is loaded
+	u32 cache_idx = 0xffFFffFF;
 	Error error = Error::NONE;
 };
 
@@ -37,6 +37,7 @@ void Controller::unload() {
 	m_animation_slots.clear();
 	m_bone_masks.clear();
 	m_inputs = InputDecl();
+	m_conditions_count = 0;
 	LUMIX_DELETE(m_allocator, m_root);
 	m_root = nullptr;
 }
@@ -74,6 +75,9 @@ RuntimeContext* Controller::createRuntime(u32 anim_set) {
 	RuntimeContext* ctx = LUMIX_NEW(m_allocator, RuntimeContext)(*this, m_allocator);
 	ctx->inputs.resize(computeInputsSize(*this));
 	memset(ctx->inputs.begin(), 0, ctx->inputs.byte_size());
+	ctx->prev_inputs.resize(ctx->inputs.size());
+	memset(ctx->prev_inputs.begin(), 0, ctx->prev_inputs.byte_size());
+	ctx->condition_cache.resize(m_conditions_count);
 	ctx->animations.resize(m_animation_slots.size());
 	memset(ctx->animations.begin(), 0, ctx->animations.byte_size());
 	for (AnimationEntry& anim : m_animation_entries) {
@@ -114,8 +118,30 @@ void Controller::processEvents(RuntimeContext& ctx) const {
 	}
 }
 
+void Controller::updateInputStamps(RuntimeContext& ctx) const {
+	++ctx.update_counter;
+	if (ctx.prev_inputs.size() != ctx.inputs.size()) {
+		// inputs were redeclared
+		ctx.prev_inputs.resize(ctx.inputs.size());
+		for (u32& stamp : ctx.input_stamps) stamp = ctx.update_counter;
+	}
+	else {
+		for (u32 i = 0; i < lengthOf(m_inputs.inputs); ++i) {
+			const InputDecl::Input& input = m_inputs.inputs[i];
+			if (input.type == InputDecl::EMPTY) continue;
+			const u32 size = InputDecl::getSize(input.type);
+			if (input.offset + size > ctx.inputs.size()) continue;
+			if (memcmp(&ctx.inputs[input.offset], &ctx.prev_inputs[input.offset], size) != 0) {
+				ctx.input_stamps[i] = ctx.update_counter;
+			}
+		}
+	}
+	memcpy(ctx.prev_inputs.begin(), ctx.inputs.begin(), ctx.inputs.byte_size());
+}
+
 void Controller::update(RuntimeContext& ctx, LocalRigidTransform& root_motion) const {
 	ASSERT(&ctx.controller == this);
+	updateInputStamps(ctx);
 	// TODO better allocation strategy
 	const Span<u8> mem = ctx.data.releaseOwnership();
 	ctx.data.reserve(mem.length());
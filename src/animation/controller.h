@@ -63,10 +63,12 @@ public:
 		u32 bones[MAX_BONES_COUNT];
 	} m_ik[4];
 	u32 m_ik_count = 0;
+	u32 m_conditions_count = 0;
 	StaticString<64> m_root_motion_bone;
 
 private:
 	void processEvents(RuntimeContext& ctx) const;
+	void updateInputStamps(RuntimeContext& ctx) const;
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 };
@@ -544,7 +544,7 @@ struct ControllerEditorImpl : ControllerEditor {
 		return false;
 	}
 
-	static bool nodeInput(const char* label, u32& value, const Array<GroupNode::Child>& children, bool has_any) {
+	static bool nodeInput(const char* label, u32& value, const InlineArray<GroupNode::Child, 4>& children, bool has_any) {
 		ImGuiEx::Label(label);		
 		bool changed = false;
 		if (!ImGui::BeginCombo(StaticString<64>("##_", label), value == 0xffFFffFF ? "*" : children[value].node->m_name.c_str())) return false;
@@ -1119,6 +1119,7 @@ struct ControllerEditorImpl : ControllerEditor {
 								else {
 									mask.bones.insert(bone_name_hash, 1);
 								}
+								mask.bonesChanged();
 							}
 						}
 						ImGui::TreePop();
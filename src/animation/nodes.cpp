@@ -82,6 +82,8 @@ RuntimeContext::RuntimeContext(Controller& controller, IAllocator& allocator)
 	, animations(allocator)
 	, events(allocator)
 	, input_runtime(nullptr, 0)
+	, condition_cache(allocator)
+	, prev_inputs(allocator)
 {
 }
 
@@ -600,6 +602,8 @@ void GroupNode::deserialize(InputMemoryStream& stream, Controller& ctrl, u32 ver
 		const char* tmp = stream.readString();
 		m_children[i].condition_str = tmp;
 		m_children[i].condition.compile(tmp, ctrl.m_inputs);
+		m_children[i].condition.cache_idx = ctrl.m_conditions_count;
+		++ctrl.m_conditions_count;
 		m_children[i].node = Node::create(this, type, m_allocator);
 		m_children[i].node->deserialize(stream, ctrl, version);
 	}
@@ -637,4 +641,4 @@ Node* Node::create(GroupNode* parent, Type type, IAllocator& allocator) {
 }
 
 
-} // namespace Lumix::anim
\ No newline at end of file
+} // namespace Lumix::anim
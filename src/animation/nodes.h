@@ -1,6 +1,7 @@
 #pragma once
 
 #include "engine/array.h"
+#include "engine/inline_array.h"
 #include "engine/stream.h"
 
 
@@ -32,6 +33,18 @@ struct RuntimeContext {
 	Time time_delta;
 	Model* model = nullptr;
 	InputMemoryStream input_runtime;
+
+	// condition results are reused until any of the inputs they read change
+	struct ConditionCache {
+		u32 stamp = 0;
+		bool value;
+	};
+	Array<ConditionCache> condition_cache;
+	// inputs from previous update, to detect changes
+	Array<u8> prev_inputs;
+	// value of `update_counter` when the input last changed
+	u32 input_stamps[32] = {};
+	u32 update_counter = 1;
 };
 
 struct Node {
@@ -107,7 +120,7 @@ struct Blend1DNode final : Node {
 		u32 slot = 0;
 	};
 
-	Array<Child> m_children;
+	InlineArray<Child, 4> m_children;
 	u32 m_input_index = 0;
 };
 
@@ -158,7 +171,7 @@ struct GroupNode final : Node {
 
 	IAllocator& m_allocator;
 	Time m_blend_length = Time::fromSeconds(0.3f);
-	Array<Child> m_children;
+	InlineArray<Child, 4> m_children;
 	Array<Transition> m_transitions;
 };
 
@@ -3,6 +3,7 @@
 #include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/command_line_parser.h"
+#include "engine/core.h"
 #include "engine/crc32.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
@@ -18,6 +19,7 @@
 #include "engine/resource_manager.h"
 #include "engine/thread.h"
 #include "engine/universe.h"
+#include "engine/world_partition.h"
 #include "gui/gui_system.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/pipeline.h"
@@ -33,6 +35,223 @@ using namespace Lumix;
 
 static const ComponentType ENVIRONMENT_TYPE = reflection::getComponentType("environment");
 static const ComponentType LUA_SCRIPT_TYPE = reflection::getComponentType("lua_script");
+static const ComponentType SPLINE_TYPE = reflection::getComponentType("spline");
+
+static bool isCommandLineOption(const char* option) {
+	char cmd_line[2048];
+	os::getCommandLine(Span(cmd_line));
+
+	CommandLineParser parser(cmd_line);
+	while (parser.next())
+	{
+		if (parser.currentEquals(option)) return true;
+	}
+	return false;
+}
+
+// value of `-option value`
+static bool getCommandLineValue(const char* option, Span<char> value) {
+	char cmd_line[2048];
+	os::getCommandLine(Span(cmd_line));
+
+	CommandLineParser parser(cmd_line);
+	while (parser.next()) {
+		if (!parser.currentEquals(option)) continue;
+		if (!parser.next()) return false;
+		parser.getCurrent(value.begin(), value.length());
+		return true;
+	}
+	return false;
+}
+
+
+// -benchmark <out.json> flies the camera along a spline with fixed time step, then writes per-frame profiler counters
+// -benchmark_spline <entity name>, default is the first entity with a spline
+// -benchmark_duration <seconds>, -benchmark_budget_us, -benchmark_gpu_budget_us <p95 frame time>
+struct Benchmark {
+	static constexpr u32 WARMUP_FRAMES = 60;
+	static constexpr float TIME_DELTA = 1 / 60.f;
+
+	explicit Benchmark(IAllocator& allocator)
+		: m_allocator(allocator)
+		, m_points(allocator)
+		, m_values(allocator)
+	{}
+
+	static u32 getU32Option(const char* option, u32 default_value) {
+		char tmp[32];
+		u32 res;
+		if (!getCommandLineValue(option, Span(tmp))) return default_value;
+		if (!fromCString(Span(tmp, stringLength(tmp)), res)) return default_value;
+		return res;
+	}
+
+	// returns false if benchmark is not requested
+	bool init(Engine& engine, Universe& universe) {
+		if (!getCommandLineValue("-benchmark", Span(m_output_path))) return false;
+
+		m_duration = (float)getU32Option("-benchmark_duration", 30);
+		m_budget_us = getU32Option("-benchmark_budget_us", 0);
+		m_gpu_budget_us = getU32Option("-benchmark_gpu_budget_us", 0);
+
+		char spline_name[64] = "";
+		getCommandLineValue("-benchmark_spline", Span(spline_name));
+		EntityPtr spline_entity = INVALID_ENTITY;
+		for (EntityPtr e = universe.getFirstEntity(); e.isValid(); e = universe.getNextEntity((EntityRef)e)) {
+			if (!universe.hasComponent((EntityRef)e, SPLINE_TYPE)) continue;
+			if (spline_name[0] && !equalStrings(universe.getEntityName((EntityRef)e), spline_name)) continue;
+			spline_entity = e;
+			break;
+		}
+
+		m_active = true;
+		if (!spline_entity.isValid()) {
+			logError("Benchmark: spline not found");
+			m_failed = true;
+			return true;
+		}
+		CoreScene* core_scene = (CoreScene*)universe.getScene(SPLINE_TYPE);
+		const Spline& spline = core_scene->getSpline((EntityRef)spline_entity);
+		if (spline.points.size() < 2) {
+			logError("Benchmark: spline needs at least 2 points");
+			m_failed = true;
+			return true;
+		}
+		// points are relative to entity's position
+		const DVec3 origin = universe.getPosition((EntityRef)spline_entity);
+		for (const Vec3& p : spline.points) m_points.push(origin + p);
+
+		engine.setFixedTimeDelta(TIME_DELTA);
+		m_frame_time_counter = profiler::createCounter("frame time (us)", profiler::CounterType::GAUGE);
+		m_gpu_frame_time_counter = profiler::createCounter("gpu frame time (us)", profiler::CounterType::GAUGE);
+		return true;
+	}
+
+	// catmull-rom through all points, t in [0, 1]
+	DVec3 samplePath(float t) const {
+		const u32 segments = m_points.size() - 1;
+		const float f = clamp(t, 0.f, 1.f) * segments;
+		const i32 i = minimum(i32(f), i32(segments) - 1);
+		const float s = f - i;
+		const DVec3 p0 = m_points[maximum(i - 1, 0)];
+		const DVec3 p1 = m_points[i];
+		const DVec3 p2 = m_points[i + 1];
+		const DVec3 p3 = m_points[minimum(i + 2, m_points.size() - 1)];
+		const double s2 = s * s;
+		const double s3 = s2 * s;
+		return (p1 * 2.0 + (p2 - p0) * s + (p0 * 2.0 - p1 * 5.0 + p2 * 4.0 - p3) * s2 + (p1 * 3.0 - p0 - p2 * 3.0 + p3) * s3) * 0.5;
+	}
+
+	// returns false when the fly-through is finished
+	bool update(Viewport& viewport) {
+		if (m_failed) return false;
+
+		// values sampled in the previous profiler::frame()
+		if (m_frame > WARMUP_FRAMES) {
+			if (m_counters_count == 0) m_counters_count = profiler::getCountersCount();
+			for (u32 i = 0; i < m_counters_count; ++i) m_values.push(profiler::getCounterValue(i));
+		}
+
+		const float t = m_frame * TIME_DELTA / m_duration;
+		if (t > 1) return false;
+		++m_frame;
+
+		viewport.pos = samplePath(t);
+		const Vec3 dir = Vec3(samplePath(t + 0.01f) - viewport.pos);
+		if (squaredLength(dir) > 1e-6f) {
+			// camera looks along -z
+			const float yaw = atan2f(-dir.x, -dir.z);
+			const float pitch = atan2f(dir.y, sqrtf(dir.x * dir.x + dir.z * dir.z));
+			viewport.rot = Quat(Vec3(0, 1, 0), yaw) * Quat(Vec3(1, 0, 0), pitch);
+		}
+		return true;
+	}
+
+	i64 percentile(u32 counter, u32 p, Array<i64>& tmp) const {
+		const u32 frames = m_counters_count ? m_values.size() / m_counters_count : 0;
+		if (frames == 0) return 0;
+		tmp.clear();
+		for (u32 f = 0; f < frames; ++f) tmp.push(m_values[f * m_counters_count + counter]);
+		qsort(tmp.begin(), tmp.size(), sizeof(i64), [](const void* a, const void* b) {
+			const i64 x = *(const i64*)a;
+			const i64 y = *(const i64*)b;
+			return x < y ? -1 : (x > y ? 1 : 0);
+		});
+		return tmp[(frames - 1) * p / 100];
+	}
+
+	bool checkBudget(u32 counter, u32 budget, const char* name, Array<i64>& tmp) const {
+		if (budget == 0 || counter >= m_counters_count) return true;
+		const i64 p95 = percentile(counter, 95, tmp);
+		if (p95 <= budget) return true;
+		logError("Benchmark: p95 ", name, " ", u64(p95), "us is over budget ", budget, "us");
+		return false;
+	}
+
+	// writes results, returns process exit code
+	int finish() {
+		if (!m_active) return 0;
+		if (m_failed) return 1;
+
+		const u32 frames = m_counters_count ? m_values.size() / m_counters_count : 0;
+		Array<i64> tmp(m_allocator);
+		OutputMemoryStream json(m_allocator);
+		json << "{\n\t\"frames\": " << frames << ",\n\t\"time_delta\": " << TIME_DELTA << ",\n\t\"counters\": [";
+		for (u32 i = 0; i < m_counters_count; ++i) {
+			profiler::CounterStats stats;
+			if (!profiler::getCounterStats(i, stats)) continue;
+			double sum = 0;
+			for (u32 f = 0; f < frames; ++f) sum += m_values[f * m_counters_count + i];
+			json << (i == 0 ? "\n" : ",\n");
+			json << "\t\t{\"name\": \"" << stats.name << "\", \"avg\": " << (frames ? sum / frames : 0.0)
+				<< ", \"p50\": " << percentile(i, 50, tmp)
+				<< ", \"p95\": " << percentile(i, 95, tmp)
+				<< ", \"p99\": " << percentile(i, 99, tmp)
+				<< ", \"max\": " << percentile(i, 100, tmp)
+				<< ", \"values\": [";
+			for (u32 f = 0; f < frames; ++f) {
+				if (f > 0) json << ",";
+				json << m_values[f * m_counters_count + i];
+			}
+			json << "]}";
+		}
+		json << "\n\t]\n}\n";
+
+		os::OutputFile file;
+		if (!file.open(m_output_path)) {
+			logError("Could not open ", m_output_path);
+			return 1;
+		}
+		const bool written = file.write(json.data(), json.size());
+		file.close();
+		if (!written) {
+			logError("Could not write ", m_output_path);
+			return 1;
+		}
+
+		bool in_budget = checkBudget(m_frame_time_counter, m_budget_us, "frame time", tmp);
+		in_budget = checkBudget(m_gpu_frame_time_counter, m_gpu_budget_us, "gpu frame time", tmp) && in_budget;
+		return in_budget ? 0 : 2;
+	}
+
+	bool isActive() const { return m_active; }
+
+	IAllocator& m_allocator;
+	char m_output_path[LUMIX_MAX_PATH] = "";
+	Array<DVec3> m_points;
+	// m_counters_count values per frame
+	Array<i64> m_values;
+	u32 m_counters_count = 0;
+	u32 m_frame = 0;
+	float m_duration = 30;
+	u32 m_budget_us = 0;
+	u32 m_gpu_budget_us = 0;
+	u32 m_frame_time_counter = profiler::INVALID_COUNTER;
+	u32 m_gpu_frame_time_counter = profiler::INVALID_COUNTER;
+	bool m_active = false;
+	bool m_failed = false;
+};
+
 
 struct GUIInterface : GUISystem::Interface {
 	Pipeline* getPipeline() override { return pipeline; }
@@ -50,6 +269,7 @@ struct Runner final
 {
 	Runner() 
 		: m_allocator(m_main_allocator) 
+		, m_benchmark(m_allocator)
 	{
 		if (!jobs::init(os::getCPUsCount(), m_allocator)) {
 			logError("Failed to initialize job system.");
@@ -89,6 +309,13 @@ struct Runner final
 		}
 
 		m_pipeline->setUniverse(m_universe);
+
+		// -dynamic_resolution <target gpu frame time in ms>
+		char tmp[32];
+		u32 target_ms;
+		if (getCommandLineValue("-dynamic_resolution", Span(tmp)) && fromCString(Span(tmp, stringLength(tmp)), target_ms)) {
+			m_pipeline->setDynamicResolution(true, (float)target_ms, 0.5f);
+		}
 	}
 
 	void initDemoScene() {
@@ -111,10 +338,12 @@ struct Runner final
 
 	bool loadUniverse(const char* path, const char* universe_name) {
 		FileSystem& fs = m_engine->getFileSystem();
+		os::MappedFile mapped;
 		OutputMemoryStream data(m_allocator);
-		if (!fs.getContentSync(Path(path), data)) return false;
+		const bool is_mapped = fs.mapContent(Path(path), mapped);
+		if (!is_mapped && !fs.getContentSync(Path(path), data)) return false;
 
-		InputMemoryStream tmp(data);
+		InputMemoryStream tmp = is_mapped ? InputMemoryStream(mapped.data(), mapped.size()) : InputMemoryStream(data);
 		EntityMap entity_map(m_allocator);
 		struct Header {
 			u32 magic;
@@ -133,16 +362,37 @@ struct Runner final
 		return true;
 	}
 
-	static bool isWindowCommandLineOption() {
-		char cmd_line[2048];
-		os::getCommandLine(Span(cmd_line));
+	// partitioned universe is used instead of .unv if it exists, see WorldEditor::saveWorldPartition
+	bool loadWorldPartition() {
+		const StaticString<LUMIX_MAX_PATH> dir("universes/", m_startup_universe);
+		char header_path[LUMIX_MAX_PATH];
+		WorldPartition::getHeaderPath(Span(header_path), dir);
+		if (!m_engine->getFileSystem().fileExists(header_path)) return false;
+
+		m_universe->setName(m_startup_universe);
+		m_world_partition = UniquePtr<WorldPartition>::create(m_allocator, *m_engine, *m_universe, m_allocator);
+		if (!m_world_partition->load(dir)) {
+			m_world_partition.reset();
+			return false;
+		}
 
-		CommandLineParser parser(cmd_line);
-		while (parser.next())
-		{
-			if (parser.currentEquals("-window")) return true;
+		// in meters
+		const u32 radius = Benchmark::getU32Option("-stream_radius", 0);
+		if (radius > 0) m_world_partition->setRadius((float)radius, radius * 1.25f);
+		return true;
+	}
+
+	void updateWorldPartition() {
+		if (!m_world_partition.get()) return;
+		if (m_headless) {
+			// there's no camera, everything around origin is streamed
+			m_world_partition->setStreamingSource(0, DVec3(0));
+			m_world_partition->update();
+			return;
 		}
-		return false;
+		const EntityPtr camera = m_pipeline->getScene()->getActiveCamera();
+		if (camera.isValid()) m_world_partition->setStreamingSource(0, m_universe->getPosition((EntityRef)camera));
+		m_world_partition->update();
 	}
 
 	void loadProject() {
@@ -155,22 +405,49 @@ struct Runner final
 	}
 
 	void onInit() {
+		#ifdef LUMIX_HEADLESS_SERVER
+			m_headless = true;
+		#else
+			m_headless = isCommandLineOption("-headless");
+		#endif
+
+		// workers do not wait on log callbacks, servers log a lot
+		if (m_headless || isCommandLineOption("-async_log")) setLogAsync(true);
+		const u32 log_rate_limit = Benchmark::getU32Option("-log_rate_limit", 0);
+		setLogRateLimit(LogLevel::INFO, log_rate_limit);
+		setLogRateLimit(LogLevel::WARNING, log_rate_limit);
+
 		Engine::InitArgs init_data;
 		init_data.window_title = "On the hunt";
+		init_data.headless = m_headless;
+		init_data.binary_log = isCommandLineOption("-binary_log");
 
 		if (os::fileExists("main.pak")) {
 			init_data.file_system = FileSystem::createPacked("main.pak", m_allocator);
 		}
 
 		m_engine = Engine::create(static_cast<Engine::InitArgs&&>(init_data), m_allocator);
+		if (isCommandLineOption("-profiler_server")) profiler::startServer(profiler::DEFAULT_SERVER_PORT);
 		
-		if (!isWindowCommandLineOption()) {
+		m_universe = &m_engine->createUniverse(true);
+		if (m_headless) {
+			initHeadless();
+			return;
+		}
+
+		if (!isCommandLineOption("-window")) {
 			os::setFullscreen(m_engine->getWindowHandle());
 			captureMouse(true);
 		}
 
-		m_universe = &m_engine->createUniverse(true);
 		initRenderPipeline();
+
+		// warm up program binary cache and quit
+		if (isCommandLineOption("-precompile_shaders")) {
+			m_renderer->precompileShaders();
+			m_finished = true;
+			return;
+		}
 		
 		auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
 		m_gui_interface.pipeline = m_pipeline.get();
@@ -178,9 +455,11 @@ struct Runner final
 
 		loadProject();
 
-		const StaticString<LUMIX_MAX_PATH> unv_path("universes/", m_startup_universe, ".unv");
-		if (!loadUniverse(unv_path, m_startup_universe)) {
-			initDemoScene();
+		if (!loadWorldPartition()) {
+			const StaticString<LUMIX_MAX_PATH> unv_path("universes/", m_startup_universe, ".unv");
+			if (!loadUniverse(unv_path, m_startup_universe)) {
+				initDemoScene();
+			}
 		}
 		os::showCursor(false);
 		while (m_engine->getFileSystem().hasWork()) {
@@ -191,16 +470,82 @@ struct Runner final
 
 		os::showCursor(false);
 		onResize();
+		// scenes are updated at fixed rate, independent of frame rate
+		const u32 simulation_rate = Benchmark::getU32Option("-simulation_rate", 0);
+		if (simulation_rate > 0) m_engine->setSimulationRate((float)simulation_rate);
+		// controllers are sampled on their own thread, e.g. -input_poll_rate 1000
+		const u32 input_poll_rate = Benchmark::getU32Option("-input_poll_rate", 0);
+		if (input_poll_rate > 0) m_engine->getInputSystem().setPollingRate(minimum(input_poll_rate, 8000u));
+
 		m_engine->startGame(*m_universe);
+		m_benchmark.init(*m_engine, *m_universe);
+	}
+
+	// simulation only, no window, pipeline nor gui; ticks at fixed rate and sleeps the rest of each tick
+	void initHeadless() {
+		const u32 tick_rate = clamp(Benchmark::getU32Option("-tick_rate", 30), 1u, 1000u);
+		m_tick_duration = 1.f / tick_rate;
+		// same fixed step as clients with -simulation_rate, steps are added if a tick takes too long
+		m_engine->setSimulationRate((float)tick_rate);
+		logInfo("Running headless at ", tick_rate, " ticks per second");
+
+		loadProject();
+		if (!loadWorldPartition()) {
+			const StaticString<LUMIX_MAX_PATH> unv_path("universes/", m_startup_universe, ".unv");
+			if (!loadUniverse(unv_path, m_startup_universe)) {
+				logError("Could not load ", unv_path);
+				m_finished = true;
+				return;
+			}
+		}
+		while (m_engine->getFileSystem().hasWork()) {
+			os::sleep(10);
+			m_engine->getFileSystem().processCallbacks();
+		}
+		m_engine->getFileSystem().processCallbacks();
+
+		m_engine->startGame(*m_universe);
+		m_tick_timer.tick();
+	}
+
+	void onHeadlessIdle() {
+		updateWorldPartition();
+		m_engine->update(*m_universe);
+		profiler::frame();
+
+		const float remaining = m_tick_duration - m_tick_timer.getTimeSinceTick();
+		if (remaining > 0.001f) {
+			PROFILE_BLOCK("sleeping");
+			os::sleep(u32(remaining * 1000));
+		}
+		m_tick_timer.tick();
 	}
 
 	void shutdown() {
+		profiler::stopServer();
+		m_exit_code = m_benchmark.finish();
+		// profiler counters stats, e.g. for perf CI
+		char csv_path[LUMIX_MAX_PATH];
+		if (getCommandLineValue("-counters_csv", Span(csv_path))) {
+			OutputMemoryStream csv(m_allocator);
+			profiler::countersToCSV(csv, false);
+			os::OutputFile file;
+			if (file.open(csv_path)) {
+				if (!file.write(csv.data(), csv.size())) logError("Could not write ", csv_path);
+				file.close();
+			}
+			else {
+				logError("Could not open ", csv_path);
+			}
+		}
+		m_world_partition.reset();
 		m_engine->destroyUniverse(*m_universe);
 		auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
 		gui->setInterface(nullptr);
 		m_pipeline.reset();
 		m_engine.reset();
 		m_universe = nullptr;
+		setLogAsync(false);
 	}
 
 	void captureMouse(bool capture) {
@@ -242,6 +587,11 @@ struct Runner final
 	}
 
 	void onIdle() {
+		if (m_headless) {
+			onHeadlessIdle();
+			return;
+		}
+		updateWorldPartition();
 		m_engine->update(*m_universe);
 
 		EntityPtr camera = m_pipeline->getScene()->getActiveCamera();
@@ -252,10 +602,12 @@ struct Runner final
 			m_viewport.w = w;
 			m_viewport.h = h;
 		}
+		if (m_benchmark.isActive() && !m_benchmark.update(m_viewport)) m_finished = true;
 
 		m_pipeline->setViewport(m_viewport);
 		m_pipeline->render(false);
 		m_renderer->frame();
+		profiler::frame();
 	}
 
 	DefaultAllocator m_main_allocator;
@@ -263,12 +615,18 @@ struct Runner final
 	UniquePtr<Engine> m_engine;
 	Renderer* m_renderer = nullptr;
 	Universe* m_universe = nullptr;
+	UniquePtr<WorldPartition> m_world_partition;
 	UniquePtr<Pipeline> m_pipeline;
 	char m_startup_universe[96] = "main";
 
 	Viewport m_viewport;
+	Benchmark m_benchmark;
+	int m_exit_code = 0;
 	bool m_finished = false;
 	bool m_focused = true;
+	bool m_headless = false;
+	float m_tick_duration = 0;
+	os::Timer m_tick_timer;
 	GUIInterface m_gui_interface;
 };
 
@@ -301,7 +659,7 @@ int main(int args, char* argv[])
 	PROFILE_BLOCK("sleeping");
 	data.semaphore.wait();
 
-	return 0;
+	return data.app.m_exit_code;
 }
 
 #else
@@ -25,6 +25,19 @@ struct Path;
 template <typename T> struct UniquePtr;
 
 
+// source of pcm data for buffers created with createStreamBuffer
+struct AudioStream
+{
+	virtual ~AudioStream() {}
+	// can be called from the device's mixing thread, returns less than `frames` on underrun
+	virtual u32 read(i16* output, u32 frames) = 0;
+	// no more data will be produced
+	virtual bool isEnd() const = 0;
+	// called from the game thread once the device does not reference the stream anymore, after stop()
+	virtual void release() = 0;
+};
+
+
 struct LUMIX_AUDIO_API AudioDevice
 {
 	enum class BufferFlags {
@@ -41,6 +54,8 @@ struct LUMIX_AUDIO_API AudioDevice
 	static UniquePtr<AudioDevice> create(Engine& engine);
 
 	virtual BufferHandle createBuffer(const void* data, int size_bytes, int channels, int sample_rate, int flags) = 0;
+	// device owns `stream` until it calls AudioStream::release(), which can be after stop() returns
+	virtual BufferHandle createStreamBuffer(AudioStream& stream, int channels, int sample_rate, int flags) = 0;
 	virtual void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
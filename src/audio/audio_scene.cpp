@@ -5,10 +5,12 @@
 #include "clip.h"
 #include "engine/associative_array.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/allocator.h"
 #include "engine/log.h"
 #include "engine/math.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
@@ -39,12 +41,31 @@ struct AmbientSound
 };
 
 
+// sound without a device voice is virtual, only its cursor advances until it's audible enough to get a voice
 struct PlayingSound
 {
+	// INVALID_BUFFER_HANDLE if the sound is virtual
 	AudioDevice::BufferHandle buffer_id;
 	EntityPtr entity;
+	// nullptr if the slot is free
 	Clip* clip = nullptr;
+	ClipStream* stream = nullptr;
 	bool is_3d;
+	bool paused = false;
+	float volume = 1;
+	float priority = 1;
+	// 0 == clip's sample rate
+	u32 frequency = 0;
+	// seconds, valid only while the sound is virtual
+	float cursor = 0;
+	// applied to volume while the voice is promoted or demoted
+	float fade = 1;
+	// 1 fading in, -1 fading out and demoted at 0
+	i8 fade_dir = 0;
+	float audibility = 0;
+	// reapplied when the sound gets a voice
+	bool has_echo = false;
+	float echo[4];
 };
 
 
@@ -56,6 +77,13 @@ struct AudioSceneImpl final : AudioScene
 		LATEST
 	};
 
+	static constexpr u32 DEFAULT_MAX_VOICES = 32;
+	static constexpr float VOICE_FADE_TIME = 0.1f;
+	// 3d sounds are ranked with inverse distance attenuation starting at this distance
+	static constexpr float REFERENCE_DISTANCE = 2;
+	// voices are kept until a virtual sound is this much more audible, so they do not flip every frame
+	static constexpr float VOICE_HYSTERESIS = 1.25f;
+
 	AudioSceneImpl(AudioSystem& system, Universe& context, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_universe(context)
@@ -71,10 +99,190 @@ struct AudioSceneImpl final : AudioScene
 			i.entity = INVALID_ENTITY;
 			i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
 		}
+		m_real_voices_counter = profiler::createCounter("audio real voices", profiler::CounterType::GAUGE);
+		m_virtual_voices_counter = profiler::createCounter("audio virtual voices", profiler::CounterType::GAUGE);
+	}
+
+	~AudioSceneImpl() {
+		for (PlayingSound& sound : m_playing_sounds) {
+			if (sound.clip) releaseSound(sound);
+		}
 	}
 
 	i32 getVersion() const override { return (i32)Version::LATEST; }
 
+
+	static bool isVirtual(const PlayingSound& sound) { return sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE; }
+
+
+	void releaseVoice(PlayingSound& sound) {
+		m_device.stop(sound.buffer_id);
+		sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		// device releases the stream once it does not read it
+		sound.stream = nullptr;
+		--m_real_voices_count;
+	}
+
+
+	void releaseSound(PlayingSound& sound) {
+		if (!isVirtual(sound)) releaseVoice(sound);
+		sound.clip->decRefCount();
+		sound.clip = nullptr;
+	}
+
+
+	bool createVoice(PlayingSound& sound, float start_time) {
+		Clip* clip = sound.clip;
+		const int flags = sound.is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
+		AudioDevice::BufferHandle buffer;
+		if (clip->isStreamed()) {
+			sound.stream = LUMIX_NEW(m_allocator, ClipStream)(*clip, clip->m_looped, m_allocator);
+			buffer = m_device.createStreamBuffer(*sound.stream, clip->getChannels(), clip->getSampleRate(), flags);
+			if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) {
+				LUMIX_DELETE(m_allocator, sound.stream);
+				sound.stream = nullptr;
+				return false;
+			}
+		}
+		else {
+			buffer = m_device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
+			if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return false;
+		}
+
+		if (start_time > 0) m_device.setCurrentTime(buffer, start_time);
+		if (!sound.paused) m_device.play(buffer, clip->m_looped);
+		m_device.setVolume(buffer, sound.volume * sound.fade);
+		if (sound.frequency != 0) m_device.setFrequency(buffer, sound.frequency);
+
+		const DVec3 pos = m_universe.getPosition((EntityRef)sound.entity);
+		m_device.setSourcePosition(buffer, pos);
+
+		for (const EchoZone& zone : m_echo_zones) {
+			const double dist2 = squaredLength(pos - m_universe.getPosition(zone.entity));
+			const double r2 = zone.radius * zone.radius;
+			if (dist2 > r2) continue;
+
+			const float w = float(dist2 / r2);
+			m_device.setEcho(buffer, 1, 1 - w, zone.delay, zone.delay);
+			break;
+		}
+
+		for (const ChorusZone& zone : m_chorus_zones) {
+			const double dist2 = squaredLength(pos - m_universe.getPosition(zone.entity));
+			double r2 = zone.radius * zone.radius;
+			if (dist2 > r2) continue;
+
+			m_device.setChorus(buffer, 1, 1, 0, 1, zone.delay, 0);
+			break;
+		}
+
+		if (sound.has_echo) m_device.setEcho(buffer, sound.echo[0], sound.echo[1], sound.echo[2], sound.echo[3]);
+
+		sound.buffer_id = buffer;
+		++m_real_voices_count;
+		return true;
+	}
+
+
+	void demote(PlayingSound& sound) {
+		sound.cursor = maximum(0.f, m_device.getCurrentTime(sound.buffer_id));
+		releaseVoice(sound);
+		sound.fade = 0;
+		sound.fade_dir = 0;
+	}
+
+
+	struct VoiceCandidate {
+		float score;
+		u16 idx;
+	};
+
+
+	// the most audible sounds get device voices, at most m_max_voices including those fading out
+	void updateVoices(float time_delta) {
+		PROFILE_FUNCTION();
+		const DVec3 listener_pos = m_listener.entity.isValid() ? m_universe.getPosition((EntityRef)m_listener.entity) : DVec3(0);
+		
+		VoiceCandidate candidates[AudioDevice::MAX_PLAYING_SOUNDS];
+		u32 candidates_count = 0;
+		u32 streamed_count = 0;
+		u32 virtual_count = 0;
+		for (PlayingSound& sound : m_playing_sounds) {
+			if (!sound.clip) continue;
+
+			float audibility = sound.volume * sound.priority;
+			if (sound.is_3d && sound.entity.isValid()) {
+				const float dist = (float)length(m_universe.getPosition((EntityRef)sound.entity) - listener_pos);
+				audibility *= REFERENCE_DISTANCE / maximum(dist, REFERENCE_DISTANCE);
+			}
+			sound.audibility = audibility;
+
+			if (isVirtual(sound)) {
+				const float length = sound.clip->getLengthSeconds();
+				const float pitch = sound.frequency != 0 ? sound.frequency / float(sound.clip->getSampleRate()) : 1.f;
+				if (!sound.paused) sound.cursor += time_delta * pitch;
+				if (sound.cursor >= length) {
+					if (!sound.clip->m_looped || length <= 0) {
+						releaseSound(sound);
+						continue;
+					}
+					sound.cursor = fmodf(sound.cursor, length);
+				}
+				++virtual_count;
+			}
+
+			if (sound.stream) {
+				++streamed_count;
+				continue;
+			}
+			const float score = isVirtual(sound) || sound.fade_dir < 0 ? audibility : audibility * VOICE_HYSTERESIS;
+			candidates[candidates_count++] = { score, u16(&sound - m_playing_sounds) };
+		}
+
+		qsort(candidates, candidates_count, sizeof(candidates[0]), [](const void* a, const void* b){
+			const float sa = ((const VoiceCandidate*)a)->score;
+			const float sb = ((const VoiceCandidate*)b)->score;
+			return sa > sb ? -1 : (sa < sb ? 1 : 0);
+		});
+
+		const u32 budget = m_max_voices > streamed_count ? m_max_voices - streamed_count : 0;
+		for (u32 i = 0; i < candidates_count; ++i) {
+			PlayingSound& sound = m_playing_sounds[candidates[i].idx];
+			if (i < budget) {
+				if (!isVirtual(sound)) {
+					if (sound.fade_dir < 0) sound.fade_dir = 1;
+				}
+				else if (m_real_voices_count < m_max_voices) {
+					sound.fade = 0;
+					sound.fade_dir = 1;
+					if (createVoice(sound, sound.cursor)) --virtual_count;
+				}
+			}
+			else if (!isVirtual(sound)) {
+				sound.fade_dir = -1;
+			}
+		}
+
+		for (PlayingSound& sound : m_playing_sounds) {
+			if (!sound.clip || isVirtual(sound) || sound.fade_dir == 0) continue;
+			
+			sound.fade += sound.fade_dir * time_delta / VOICE_FADE_TIME;
+			if (sound.fade <= 0) {
+				demote(sound);
+				++virtual_count;
+				continue;
+			}
+			if (sound.fade >= 1) {
+				sound.fade = 1;
+				sound.fade_dir = 0;
+			}
+			m_device.setVolume(sound.buffer_id, sound.volume * sound.fade);
+		}
+
+		profiler::setCounter(m_real_voices_counter, m_real_voices_count);
+		profiler::setCounter(m_virtual_voices_counter, virtual_count);
+	}
+
 	void clear() override 	{
 		for (const AmbientSound& snd : m_ambient_sounds) {
 			if (snd.clip) snd.clip->decRefCount();
@@ -129,20 +337,23 @@ struct AudioSceneImpl final : AudioScene
 			m_device.setListenerOrientation(front.x, front.y, front.z, up.x, up.y, up.z);
 		}
 
+		updateVoices(time_delta);
+
 		for (PlayingSound & sound : m_playing_sounds)
 		{
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE) continue;
+			if (!sound.clip || isVirtual(sound)) continue;
 			if (sound.is_3d && sound.entity.isValid())
 			{
 				const DVec3 pos = m_universe.getPosition((EntityRef)sound.entity);
 				m_device.setSourcePosition(sound.buffer_id, pos);
 			}
 
+			if (sound.stream) sound.stream->update();
+
 			Clip* clip_info = sound.clip;
 			if (!clip_info->m_looped && m_device.isEnd(sound.buffer_id))
 			{
-				m_device.stop(sound.buffer_id);
-				sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+				releaseSound(sound);
 			}
 		}
 		m_device.update(time_delta);
@@ -151,6 +362,14 @@ struct AudioSceneImpl final : AudioScene
 	}
 
 
+	SceneAccess getUpdateAccess() const override {
+		SceneAccess access;
+		access.reads = SceneAccess::TRANSFORMS;
+		access.writes = 0;
+		return access;
+	}
+
+
 	bool isAmbientSound3D(EntityRef entity) override
 	{
 		return m_ambient_sounds[entity].is_3d;
@@ -165,14 +384,18 @@ struct AudioSceneImpl final : AudioScene
 	void pauseAmbientSound(EntityRef entity) override {
 		const i32 idx = m_ambient_sounds[entity].playing_sound;
 		if (idx < 0) return;
-		m_device.pause(m_playing_sounds[idx].buffer_id);
+		PlayingSound& sound = m_playing_sounds[idx];
+		sound.paused = true;
+		if (!isVirtual(sound)) m_device.pause(sound.buffer_id);
 	}
 
 	void resumeAmbientSound(EntityRef entity) override {
 		const AmbientSound& as = m_ambient_sounds[entity];
 		const i32 idx = as.playing_sound;
 		if (idx < 0) return;
-		m_device.play(m_playing_sounds[idx].buffer_id, as.clip->m_looped);
+		PlayingSound& sound = m_playing_sounds[idx];
+		sound.paused = false;
+		if (!isVirtual(sound)) m_device.play(sound.buffer_id, as.clip->m_looped);
 	}
 
 	void startGame() override
@@ -190,11 +413,7 @@ struct AudioSceneImpl final : AudioScene
 		m_animation_scene = nullptr;
 		for (auto& i : m_playing_sounds)
 		{
-			if (i.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				m_device.stop(i.buffer_id);
-				i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
+			if (i.clip) releaseSound(i);
 		}
 
 		for (AmbientSound& sound : m_ambient_sounds)
@@ -390,50 +609,35 @@ struct AudioSceneImpl final : AudioScene
 	
 	SoundHandle play(EntityRef entity, Clip* clip, bool is_3d) override {
 		for (PlayingSound& sound : m_playing_sounds) {
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE) {
-				if (!clip->isReady()) return INVALID_SOUND_HANDLE;
-
-				int flags = is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
-				if (is_3d && clip->getChannels() > 1) {
-					logWarning(clip->getPath(), ": can not play sound with 2 channels as 3d");
-					flags = 0;
-				}
-				auto buffer = m_device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
-				if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return INVALID_SOUND_HANDLE;
+			if (sound.clip) continue;
+			if (!clip->isReady()) return INVALID_SOUND_HANDLE;
 
-				m_device.play(buffer, clip->m_looped);
-				m_device.setVolume(buffer, clip->m_volume);
-
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_device.setSourcePosition(buffer, pos);
-
-				sound.is_3d = is_3d;
-				sound.buffer_id = buffer;
-				sound.entity = entity;
-				clip->incRefCount();
-				sound.clip = clip;
-
-				for (const EchoZone& zone : m_echo_zones) {
-					const double dist2 = squaredLength(pos - m_universe.getPosition(zone.entity));
-					const double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
-
-					const float w = float(dist2 / r2);
-					m_device.setEcho(buffer, 1, 1 - w, zone.delay, zone.delay);
-					break;
-				}
-
-				for (const ChorusZone& zone : m_chorus_zones) {
-					const double dist2 = squaredLength(pos - m_universe.getPosition(zone.entity));
-					double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
-
-					m_device.setChorus(buffer, 1, 1, 0, 1, zone.delay, 0);
-					break;
-				}
+			if (is_3d && clip->getChannels() > 1) {
+				logWarning(clip->getPath(), ": can not play sound with 2 channels as 3d");
+				is_3d = false;
+			}
 
-				return SoundHandle(&sound - m_playing_sounds);
+			sound.is_3d = is_3d;
+			sound.entity = entity;
+			sound.clip = clip;
+			sound.paused = false;
+			sound.volume = clip->m_volume;
+			sound.priority = 1;
+			sound.frequency = 0;
+			sound.cursor = 0;
+			sound.fade = 1;
+			sound.fade_dir = 0;
+			sound.has_echo = false;
+
+			// otherwise it starts virtual and gets a voice in update if it's audible enough
+			// streams can not seek, so they are never virtual
+			const bool has_voice = m_real_voices_count < m_max_voices || clip->isStreamed();
+			if (has_voice && !createVoice(sound, 0)) {
+				sound.clip = nullptr;
+				return INVALID_SOUND_HANDLE;
 			}
+			clip->incRefCount();
+			return SoundHandle(&sound - m_playing_sounds);
 		}
 
 		return INVALID_SOUND_HANDLE;
@@ -441,18 +645,18 @@ struct AudioSceneImpl final : AudioScene
 
 	bool isEnd(SoundHandle sound_id) override {
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		return m_device.isEnd(m_playing_sounds[sound_id].buffer_id);
+		const PlayingSound& sound = m_playing_sounds[sound_id];
+		if (!sound.clip) return true;
+		// ended virtual sounds are released in update
+		if (isVirtual(sound)) return false;
+		return m_device.isEnd(sound.buffer_id);
 	}
 
 	void stop(SoundHandle sound_id) override
 	{
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.stop(m_playing_sounds[sound_id].buffer_id);
-		m_playing_sounds[sound_id].buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-		if (m_playing_sounds[sound_id].clip) {
-			m_playing_sounds[sound_id].clip->decRefCount();
-			m_playing_sounds[sound_id].clip = nullptr;
-		}
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		if (sound.clip) releaseSound(sound);
 	}
 
 
@@ -463,19 +667,38 @@ struct AudioSceneImpl final : AudioScene
 	{
 		ASSERT(sound_id != AudioScene::INVALID_SOUND_HANDLE);
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setVolume(m_playing_sounds[sound_id].buffer_id, volume);
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.volume = volume;
+		if (!isVirtual(sound)) m_device.setVolume(sound.buffer_id, volume * sound.fade);
 	}
 
 	void setFrequency(SoundHandle sound_id, u32 frequency) override {
 		ASSERT(sound_id != AudioScene::INVALID_SOUND_HANDLE);
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setFrequency(m_playing_sounds[sound_id].buffer_id, frequency);
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.frequency = frequency;
+		if (!isVirtual(sound)) m_device.setFrequency(sound.buffer_id, frequency);
 	}
 
+	void setPriority(SoundHandle sound_id, float priority) override {
+		ASSERT(sound_id != AudioScene::INVALID_SOUND_HANDLE);
+		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
+		m_playing_sounds[sound_id].priority = priority;
+	}
+
+	void setMaxVoices(u32 count) override { m_max_voices = minimum(count, (u32)AudioDevice::MAX_PLAYING_SOUNDS); }
+	u32 getMaxVoices() const override { return m_max_voices; }
+
 	void setEcho(SoundHandle sound_id, float wet_dry_mix, float feedback, float left_delay, float right_delay) override
 	{
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setEcho(m_playing_sounds[sound_id].buffer_id, wet_dry_mix, feedback, left_delay, right_delay);
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.has_echo = true;
+		sound.echo[0] = wet_dry_mix;
+		sound.echo[1] = feedback;
+		sound.echo[2] = left_delay;
+		sound.echo[3] = right_delay;
+		if (!isVirtual(sound)) m_device.setEcho(sound.buffer_id, wet_dry_mix, feedback, left_delay, right_delay);
 	}
 
 	Universe& getUniverse() override { return m_universe; }
@@ -490,6 +713,10 @@ struct AudioSceneImpl final : AudioScene
 	Universe& m_universe;
 	AudioSystem& m_system;
 	PlayingSound m_playing_sounds[AudioDevice::MAX_PLAYING_SOUNDS];
+	u32 m_real_voices_count = 0;
+	u32 m_max_voices = DEFAULT_MAX_VOICES;
+	u32 m_real_voices_counter;
+	u32 m_virtual_voices_counter;
 	AnimationScene* m_animation_scene = nullptr;
 };
 
@@ -509,6 +736,8 @@ void AudioScene::reflect(Engine& engine) {
 		.LUMIX_FUNC(AudioScene::isEnd)
 		.LUMIX_FUNC(AudioScene::setFrequency)
 		.LUMIX_FUNC(AudioScene::setVolume)
+		.LUMIX_FUNC(AudioScene::setPriority)
+		.LUMIX_FUNC(AudioScene::setMaxVoices)
 		.LUMIX_FUNC(AudioScene::setEcho)
 		.LUMIX_CMP(AmbientSound, "ambient_sound", "Audio / Ambient sound")
 			.LUMIX_FUNC_EX(AudioScene::pauseAmbientSound, "pause")
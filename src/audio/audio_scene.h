@@ -73,6 +73,11 @@ struct AudioScene : IScene
 	virtual void stop(SoundHandle sound_id) = 0;
 	virtual void setVolume(SoundHandle sound_id, float volume) = 0;
 	virtual void setFrequency(SoundHandle sound_id, u32 frequency_hz) = 0;
+	// scales audibility when sounds compete for device voices, does not change volume
+	virtual void setPriority(SoundHandle sound_id, float priority) = 0;
+	// the most audible sounds get device voices, the rest is virtual, i.e. only their play position advances
+	virtual void setMaxVoices(u32 count) = 0;
+	virtual u32 getMaxVoices() const = 0;
 
 	virtual void setEcho(SoundHandle sound_id,
 		float wet_dry_mix,
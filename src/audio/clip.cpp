@@ -1,7 +1,9 @@
 #include "clip.h"
 #include "engine/allocator.h"
+#include "engine/atomic.h"
 #include "engine/crt.h"
 #include "engine/lumix.h"
+#include "engine/math.h"
 #include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/string.h"
@@ -20,6 +22,9 @@ const ResourceType Clip::TYPE("clip");
 void Clip::unload()
 {
 	m_data.clear();
+	m_compressed.clear();
+	m_is_streamed = false;
+	m_length_frames = 0;
 }
 
 struct WAVHeader {
@@ -58,20 +63,138 @@ bool Clip::load(u64 size, const u8* mem)
 			m_channels = header.channels;
 			m_sample_rate = header.frequency;
 			m_data.resize(u32(blob.size() - blob.getPosition()) / (header.bits_per_sample / 8));
+			m_length_frames = m_data.size() / maximum(m_channels, 1);
 			return blob.read(m_data.begin(), m_data.byte_size());
 		}
 		case Format::OGG: {
-			short* output = nullptr;
-			auto res = stb_vorbis_decode_memory((unsigned char*)blob.skip(0), (int)(size - blob.getPosition()), &m_channels, &m_sample_rate, &output);
-			if (res <= 0) return false;
+			const u8* ogg = (const u8*)blob.skip(0);
+			const int ogg_size = (int)(size - blob.getPosition());
+			stb_vorbis* decoder = stb_vorbis_open_memory(ogg, ogg_size, nullptr, nullptr);
+			if (!decoder) return false;
 
-			m_data.resize(res * m_channels);
-			memcpy(&m_data[0], output, res * m_channels * sizeof(m_data[0]));
-			free(output);
+			const stb_vorbis_info info = stb_vorbis_get_info(decoder);
+			m_channels = info.channels;
+			m_sample_rate = info.sample_rate;
+			m_length_frames = stb_vorbis_stream_length_in_samples(decoder);
+			if (m_length_frames > STREAMING_THRESHOLD_SECONDS * m_sample_rate) {
+				stb_vorbis_close(decoder);
+				m_is_streamed = true;
+				m_compressed.resize(ogg_size);
+				memcpy(m_compressed.begin(), ogg, ogg_size);
+				return true;
+			}
+
+			m_data.resize(m_length_frames * m_channels);
+			const int decoded = stb_vorbis_get_samples_short_interleaved(decoder, m_channels, (short*)m_data.begin(), m_data.size());
+			stb_vorbis_close(decoder);
+			if (decoded <= 0) return false;
+			m_length_frames = decoded;
+			m_data.resize(decoded * m_channels);
 			return true;
 		}
 	}
 }
 
 
+ClipStream::ClipStream(Clip& clip, bool looped, IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_clip(clip)
+	, m_looped(looped)
+	, m_ring(allocator)
+{
+	ASSERT(clip.isStreamed());
+	clip.incRefCount();
+	const Span<const u8> ogg = clip.getCompressedData();
+	m_decoder = stb_vorbis_open_memory(ogg.begin(), ogg.length(), nullptr, nullptr);
+	if (!m_decoder) {
+		m_decoded_all = true;
+		return;
+	}
+	m_ring.resize(RING_FRAMES * clip.getChannels());
+	// prefill so playback does not start with an underrun
+	decode();
+}
+
+
+ClipStream::~ClipStream()
+{
+	jobs::wait(m_signal);
+	if (m_decoder) stb_vorbis_close(m_decoder);
+	m_clip.decRefCount();
+}
+
+
+void ClipStream::release()
+{
+	LUMIX_DELETE(m_allocator, this);
+}
+
+
+void ClipStream::decodeJob(void* data)
+{
+	PROFILE_FUNCTION();
+	ClipStream* stream = (ClipStream*)data;
+	stream->decode();
+	stream->m_decoding = false;
+}
+
+
+// only one decode runs at a time, it's the only writer of m_written
+void ClipStream::decode()
+{
+	const u32 channels = m_clip.getChannels();
+	u32 free = RING_FRAMES - u32(m_written - m_read);
+	u32 to_decode = minimum(free, DECODE_CHUNK_FRAMES);
+	while (to_decode > 0 && !m_decoded_all) {
+		const u32 offset = u32(m_written) % RING_FRAMES;
+		const u32 frames = minimum(to_decode, RING_FRAMES - offset);
+		const int decoded = stb_vorbis_get_samples_short_interleaved(m_decoder, channels, m_ring.begin() + offset * channels, frames * channels);
+		if (decoded <= 0) {
+			if (m_looped) {
+				stb_vorbis_seek_start(m_decoder);
+				continue;
+			}
+			m_decoded_all = true;
+			break;
+		}
+		// publish data before the cursor
+		memoryBarrier();
+		m_written = m_written + decoded;
+		to_decode -= decoded;
+	}
+}
+
+
+void ClipStream::update()
+{
+	if (m_decoded_all || m_decoding) return;
+	if (u32(m_written - m_read) > RING_FRAMES / 2) return;
+	
+	m_decoding = true;
+	jobs::run(this, &decodeJob, &m_signal, jobs::Priority::LOW);
+}
+
+
+u32 ClipStream::read(i16* output, u32 frames)
+{
+	const u32 channels = m_clip.getChannels();
+	const u32 available = u32(m_written - m_read);
+	memoryBarrier();
+	const u32 to_read = minimum(frames, available);
+	const u32 offset = u32(m_read) % RING_FRAMES;
+	const u32 first = minimum(to_read, RING_FRAMES - offset);
+	memcpy(output, m_ring.begin() + offset * channels, first * channels * sizeof(i16));
+	memcpy(output + first * channels, m_ring.begin(), (to_read - first) * channels * sizeof(i16));
+	memoryBarrier();
+	m_read = m_read + to_read;
+	return to_read;
+}
+
+
+bool ClipStream::isEnd() const
+{
+	return m_decoded_all && m_written == m_read;
+}
+
+
 } // namespace Lumix
@@ -1,10 +1,15 @@
 #pragma once
 
 
+#include "audio_device.h"
 #include "engine/array.h"
+#include "engine/job_system.h"
 #include "engine/resource.h"
 
 
+struct stb_vorbis;
+
+
 namespace Lumix {
 
 
@@ -18,6 +23,7 @@ struct Clip final : Resource
 	Clip(const Path& path, ResourceManager& manager, IAllocator& allocator)
 		: Resource(path, manager, allocator)
 		, m_data(allocator)
+		, m_compressed(allocator)
 	{
 	}
 
@@ -27,18 +33,60 @@ struct Clip final : Resource
 	bool load(u64 size, const u8* mem) override;
 	int getChannels() const { return m_channels; }
 	int getSampleRate() const { return m_sample_rate; }
+	// streamed clips keep only compressed data, play them through ClipStream
+	bool isStreamed() const { return m_is_streamed; }
 	int getSize() const { return m_data.size() * sizeof(m_data[0]); }
-	u16* getData() { return &m_data[0]; }
-	float getLengthSeconds() const { return m_data.size() / float(m_channels * m_sample_rate); }
+	u16* getData() { return m_data.begin(); }
+	Span<const u8> getCompressedData() const { return Span<const u8>(m_compressed.begin(), m_compressed.end()); }
+	float getLengthSeconds() const { return m_length_frames / float(m_sample_rate); }
 
 	static const ResourceType TYPE;
+	// longer ogg clips are decoded while they are played
+	static constexpr float STREAMING_THRESHOLD_SECONDS = 10;
 	bool m_looped = false;
 	float m_volume = 1;
 
 private:
 	int m_channels;
 	int m_sample_rate;
+	u32 m_length_frames = 0;
+	bool m_is_streamed = false;
 	Array<u16> m_data;
+	Array<u8> m_compressed;
+};
+
+
+// decodes a streamed clip ahead of the read cursor on a worker
+struct ClipStream final : AudioStream
+{
+	ClipStream(Clip& clip, bool looped, IAllocator& allocator);
+	~ClipStream();
+
+	u32 read(i16* output, u32 frames) override;
+	bool isEnd() const override;
+	void release() override;
+	// call from the main thread, schedules decoding when the ring buffer runs low
+	void update();
+
+private:
+	static void decodeJob(void* data);
+	void decode();
+
+	static constexpr u32 RING_FRAMES = 1 << 16;
+	static constexpr u32 DECODE_CHUNK_FRAMES = 1 << 13;
+
+	IAllocator& m_allocator;
+	// referenced until the stream is released, decoder reads its compressed data
+	Clip& m_clip;
+	stb_vorbis* m_decoder = nullptr;
+	bool m_looped;
+	Array<i16> m_ring;
+	// total frames, ring index is modulo RING_FRAMES
+	volatile i32 m_written = 0;
+	volatile i32 m_read = 0;
+	volatile bool m_decoded_all = false;
+	volatile bool m_decoding = false;
+	jobs::SignalHandle m_signal = jobs::INVALID_HANDLE;
 };
 
 
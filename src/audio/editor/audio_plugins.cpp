@@ -79,6 +79,8 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 		getAudioDevice(m_app.getEngine()).stop(m_playing_clip);
 		m_playing_clip = -1;
+		LUMIX_DELETE(m_app.getAllocator(), m_playing_stream);
+		m_playing_stream = nullptr;
 	}
 
 
@@ -113,7 +115,11 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			}
 			float time = device.getCurrentTime(m_playing_clip);
 			ImGuiEx::Label("Time");
-			if (ImGui::SliderFloat("##time", &time, 0, clip->getLengthSeconds(), "%.2fs"))
+			if (m_playing_stream) {
+				m_playing_stream->update();
+				ImGui::Text("%.2fs", time);
+			}
+			else if (ImGui::SliderFloat("##time", &time, 0, clip->getLengthSeconds(), "%.2fs"))
 			{
 				device.setCurrentTime(m_playing_clip, time);
 			}
@@ -123,8 +129,19 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		{
 			stopAudio();
 
-			AudioDevice::BufferHandle handle = device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
-			if (handle != AudioDevice::INVALID_BUFFER_HANDLE) {
+			AudioDevice::BufferHandle handle;
+			if (clip->isStreamed()) {
+				m_playing_stream = LUMIX_NEW(m_app.getAllocator(), ClipStream)(*clip, true, m_app.getAllocator());
+				handle = device.createStreamBuffer(*m_playing_stream, clip->getChannels(), clip->getSampleRate(), 0);
+			}
+			else {
+				handle = device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
+			}
+			if (handle == AudioDevice::INVALID_BUFFER_HANDLE) {
+				LUMIX_DELETE(m_app.getAllocator(), m_playing_stream);
+				m_playing_stream = nullptr;
+			}
+			else {
 				device.setVolume(handle, clip->m_volume);
 				device.play(handle, true);
 				m_playing_clip = handle;
@@ -157,6 +174,7 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 
 	int m_playing_clip;
+	ClipStream* m_playing_stream = nullptr;
 	StudioApp& m_app;
 	AssetBrowser& m_browser;
 	Meta m_meta;
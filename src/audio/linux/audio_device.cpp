@@ -1,13 +1,14 @@
 #include "audio_device.h"
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/log.h"
 #include "engine/engine.h"
 #include "engine/plugin.h"
 #include "engine/log.h"
 #include "engine/math.h"
-#include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
+#include "engine/simd.h"
 #include <alsa/asoundlib.h>
 
 
@@ -30,15 +31,124 @@ struct AudioTask : Thread
 };
 
 
+// single producer, single consumer, neither side ever waits on the other
+template <typename T, i32 SIZE>
+struct SPSCRing
+{
+	static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be power of 2");
+
+	bool push(const T& value) {
+		const i32 write = m_write;
+		const i32 read = m_read;
+		readBarrier();
+		if (write - read >= SIZE) return false;
+		m_items[write & (SIZE - 1)] = value;
+		writeBarrier();
+		m_write = write + 1;
+		return true;
+	}
+
+	bool pop(T& value) {
+		const i32 read = m_read;
+		const i32 write = m_write;
+		readBarrier();
+		if (read == write) return false;
+		value = m_items[read & (SIZE - 1)];
+		// the slot must be read before the producer can reuse it
+		memoryBarrier();
+		m_read = read + 1;
+		return true;
+	}
+
+	T m_items[SIZE];
+	volatile i32 m_write = 0;
+	volatile i32 m_read = 0;
+};
+
+
 struct AudioDeviceImpl : AudioDevice
 {
+	static constexpr int MAX_BUFFERS_COUNT = 256;
+	// more voices are advanced but not mixed, the least audible are dropped
+	static constexpr int MAX_MIXED_VOICES = 32;
+	static constexpr int OUTPUT_CHANNELS = 2;
+	static constexpr int BLOCK_FRAMES = 1024;
+	// distance at which 3d sounds start to attenuate
+	static constexpr float REFERENCE_DISTANCE = 1.f;
+	// streams are resampled at most this much faster than realtime
+	static constexpr u32 MAX_STREAM_STEP = 4;
+	static constexpr u32 STREAM_SCRATCH_FRAMES = BLOCK_FRAMES * MAX_STREAM_STEP + 2;
+	static constexpr i32 COMMAND_RING_SIZE = 4096;
+	static constexpr i32 STATUS_RING_SIZE = 1024;
+
+	// game thread -> mixer
+	struct Command
+	{
+		enum class Type : u8 {
+			INIT,
+			PLAY,
+			PAUSE,
+			STOP,
+			SEEK,
+			VOLUME,
+			FREQUENCY,
+			POSITION,
+			LISTENER
+		};
+
+		Type type;
+		u16 buffer;
+		union {
+			struct {
+				const i16* data;
+				AudioStream* stream;
+				u32 frames;
+				u32 channels;
+				u32 sample_rate;
+				bool is_3d;
+			} init;
+			struct {
+				i32 play_id;
+				bool looped;
+				bool restart;
+			} play;
+			struct {
+				i32 play_id;
+				i32 frame;
+			} seek;
+			float volume;
+			u32 frequency;
+			double position[3];
+			struct {
+				double pos[3];
+				float front[3];
+				float up[3];
+			} listener;
+		};
+	};
+
+	// mixer -> game thread
+	struct Status
+	{
+		enum class Type : u8 {
+			ENDED,
+			// mixer does not reference the buffer's data nor stream anymore
+			RELEASED
+		};
+
+		Type type;
+		u16 buffer;
+		i32 play_id;
+	};
+
+	// owned by the game thread, the mixer knows only what it gets through commands
 	struct Buffer
 	{
-		enum class RuntimeFlags
-		{
-			READY = 1 << 0,
-			PLAYING = 1 << 1,
-			LOOPED = 1 << 2
+		enum class State : u8 {
+			FREE,
+			USED,
+			// stopped, waiting for the mixer to let go
+			RELEASING
 		};
 
 		Buffer(IAllocator& allocator) : data(allocator) {}
@@ -47,10 +157,121 @@ struct AudioDeviceImpl : AudioDevice
 		int channels;
 		int sample_rate;
 		int flags;
-		int cursor;
-		u8 runtime_flags;
+		State state = State::FREE;
+		bool playing;
+		DVec3 position;
+		// valid until the mixer processes command number `seek_command`
+		i32 seek_frame;
+		i32 seek_command;
+		i32 play_id;
+		i32 end_play_id;
+		AudioStream* stream;
 	};
 
+	// owned by the mixer
+	struct Voice
+	{
+		const i16* data = nullptr;
+		u32 frames = 0;
+		u32 channels = 1;
+		u32 frequency = 0;
+		bool is_3d = false;
+		float volume = 1;
+		DVec3 position = DVec3(0);
+		double pos = 0;
+		double step = 1;
+		float gain[2] = {};
+		float audibility = 0;
+		i32 play_id = 0;
+		i32 end_play_id = -1;
+		bool looped = false;
+		bool playing = false;
+		bool active = false;
+		// status could not be pushed because the ring was full, retried next block
+		bool end_pending = false;
+		bool release_pending = false;
+		AudioStream* stream = nullptr;
+		// last frames of the previous block, interpolation continues from them
+		i16 stream_carry[4];
+		u32 stream_carry_frames = 0;
+		i32 stream_cursor = 0;
+	};
+
+
+	// game thread
+	void pushCommand(const Command& cmd) {
+		++m_commands_pushed;
+		// keep the order, overflow is flushed before anything new is pushed to the ring
+		if (!m_overflow.empty() || !m_commands.push(cmd)) m_overflow.push(cmd);
+	}
+
+
+	// game thread
+	void flushOverflow() {
+		u32 flushed = 0;
+		while (flushed < (u32)m_overflow.size() && m_commands.push(m_overflow[flushed])) ++flushed;
+		for (u32 i = flushed, c = m_overflow.size(); i < c; ++i) m_overflow[i - flushed] = m_overflow[i];
+		m_overflow.resize(m_overflow.size() - flushed);
+	}
+
+
+	// game thread
+	void pollStatus() {
+		if (!m_overflow.empty()) flushOverflow();
+		Status status;
+		while (m_statuses.pop(status)) {
+			Buffer& buffer = m_buffers[status.buffer];
+			switch (status.type) {
+				case Status::Type::ENDED:
+					buffer.end_play_id = status.play_id;
+					break;
+				case Status::Type::RELEASED:
+					ASSERT(buffer.state == Buffer::State::RELEASING);
+					if (buffer.stream) buffer.stream->release();
+					buffer.stream = nullptr;
+					buffer.state = Buffer::State::FREE;
+					break;
+			}
+		}
+	}
+
+
+	i32 findFreeBuffer() {
+		pollStatus();
+		for (int i = 0, c = m_buffers.size(); i < c; ++i) {
+			if (m_buffers[i].state == Buffer::State::FREE) return i;
+		}
+		return INVALID_BUFFER_HANDLE;
+	}
+
+
+	void initBuffer(i32 idx, int channels, int sample_rate, int flags, AudioStream* stream) {
+		Buffer& buffer = m_buffers[idx];
+		buffer.channels = channels;
+		buffer.sample_rate = sample_rate;
+		buffer.flags = flags;
+		buffer.state = Buffer::State::USED;
+		buffer.playing = false;
+		buffer.position = DVec3(0);
+		buffer.seek_frame = 0;
+		buffer.seek_command = m_commands_pushed;
+		buffer.play_id = 0;
+		buffer.end_play_id = -1;
+		buffer.stream = stream;
+		m_cursors[idx] = 0;
+
+		Command cmd;
+		cmd.type = Command::Type::INIT;
+		cmd.buffer = u16(idx);
+		cmd.init.data = (const i16*)buffer.data.begin();
+		cmd.init.stream = stream;
+		cmd.init.channels = maximum(channels, 1);
+		cmd.init.frames = buffer.data.size() / (sizeof(i16) * cmd.init.channels);
+		cmd.init.sample_rate = sample_rate;
+		cmd.init.is_3d = flags & (int)BufferFlags::IS3D;
+		pushCommand(cmd);
+	}
+
 
 	BufferHandle createBuffer(const void* data,
 		int size_bytes,
@@ -58,24 +279,27 @@ struct AudioDeviceImpl : AudioDevice
 		int sample_rate,
 		int flags) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(flags == 0); // nothing else supported yet
-		for(int i = 0, c = m_buffers.size(); i < c; ++i)
-		{
-			Buffer& buffer = m_buffers[i];
-			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::READY)) continue;
-
-			buffer.channels = channels;
-			buffer.sample_rate = sample_rate;
-			buffer.flags = flags;
-			buffer.data.resize(size_bytes);
-			buffer.runtime_flags = (u8)Buffer::RuntimeFlags::READY;
-			buffer.cursor = 0;
-			memcpy(&buffer.data[0], data, size_bytes);
-
-			return i;
-		}
-		return INVALID_BUFFER_HANDLE;
+		const i32 idx = findFreeBuffer();
+		if (idx == INVALID_BUFFER_HANDLE) return INVALID_BUFFER_HANDLE;
+
+		// the mixer released the slot, so it does not read the old data
+		Buffer& buffer = m_buffers[idx];
+		buffer.data.resize(size_bytes);
+		memcpy(buffer.data.begin(), data, size_bytes);
+		initBuffer(idx, channels, sample_rate, flags, nullptr);
+		return idx;
+	}
+
+
+	BufferHandle createStreamBuffer(AudioStream& stream, int channels, int sample_rate, int flags) override
+	{
+		if (channels > OUTPUT_CHANNELS) return INVALID_BUFFER_HANDLE;
+		const i32 idx = findFreeBuffer();
+		if (idx == INVALID_BUFFER_HANDLE) return INVALID_BUFFER_HANDLE;
+		
+		m_buffers[idx].data.clear();
+		initBuffer(idx, channels, sample_rate, flags, &stream);
+		return idx;
 	}
 
 
@@ -85,7 +309,6 @@ struct AudioDeviceImpl : AudioDevice
 		float left_delay,
 		float right_delay) override 
 	{
-		MutexGuard lock(m_mutex);
 		ASSERT(false); // not implemented yet
 	}
 
@@ -98,142 +321,412 @@ struct AudioDeviceImpl : AudioDevice
 		float delay,
 		i32 phase) override
 	{
-		MutexGuard lock(m_mutex);
 		ASSERT(false); // not implemented yet
 	}
 
 
-	void mix(u16* output, int size_bytes)
+	// mixer thread
+	void updateGain(Voice& voice) const
 	{
-		memset(output, 0, size_bytes);
+		float volume = voice.volume;
+		if (voice.is_3d) {
+			const DVec3 d = voice.position - m_mix_listener_pos;
+			const Vec3 delta((float)d.x, (float)d.y, (float)d.z);
+			const float dist = length(delta);
+			volume *= REFERENCE_DISTANCE / maximum(REFERENCE_DISTANCE, dist);
+			// equal power panning
+			const float pan = dist > 0.001f ? clamp(dot(delta, m_mix_listener_right) / dist, -1.f, 1.f) : 0.f;
+			const float angle = (pan + 1) * PI * 0.25f;
+			voice.gain[0] = volume * cosf(angle);
+			voice.gain[1] = volume * sinf(angle);
+		}
+		else {
+			voice.gain[0] = volume;
+			voice.gain[1] = volume;
+		}
+		voice.audibility = maximum(voice.gain[0], voice.gain[1]);
+	}
 
-		MutexGuard lock(m_mutex);
-		for (Buffer& buffer : m_buffers)
-		{
-			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING) == 0) continue;
-			
-			mixBuffer(output, size_bytes, buffer);
+
+	// mixer thread
+	void updateStep(Voice& voice) const {
+		voice.step = voice.frequency / double(m_output_rate);
+		if (voice.stream) voice.step = minimum(voice.step, (double)MAX_STREAM_STEP);
+	}
+
+
+	// mixer thread
+	void executeCommand(const Command& cmd)
+	{
+		Voice& voice = m_voices[cmd.buffer];
+		switch (cmd.type) {
+			case Command::Type::INIT:
+				voice = Voice();
+				voice.data = cmd.init.data;
+				voice.stream = cmd.init.stream;
+				voice.frames = cmd.init.frames;
+				voice.channels = cmd.init.channels;
+				voice.frequency = cmd.init.sample_rate;
+				voice.is_3d = cmd.init.is_3d;
+				updateStep(voice);
+				updateGain(voice);
+				break;
+			case Command::Type::PLAY:
+				voice.playing = true;
+				voice.looped = cmd.play.looped;
+				if (cmd.play.restart) {
+					voice.play_id = cmd.play.play_id;
+					voice.pos = 0;
+				}
+				break;
+			case Command::Type::PAUSE:
+				voice.playing = false;
+				break;
+			case Command::Type::STOP:
+				voice = Voice();
+				voice.release_pending = true;
+				break;
+			case Command::Type::SEEK:
+				voice.play_id = cmd.seek.play_id;
+				voice.pos = minimum((u32)cmd.seek.frame, voice.frames);
+				voice.end_pending = false;
+				m_cursors[cmd.buffer] = cmd.seek.frame;
+				break;
+			case Command::Type::VOLUME:
+				voice.volume = cmd.volume;
+				updateGain(voice);
+				break;
+			case Command::Type::FREQUENCY:
+				voice.frequency = cmd.frequency;
+				updateStep(voice);
+				break;
+			case Command::Type::POSITION:
+				voice.position = DVec3(cmd.position[0], cmd.position[1], cmd.position[2]);
+				updateGain(voice);
+				break;
+			case Command::Type::LISTENER: {
+				m_mix_listener_pos = DVec3(cmd.listener.pos[0], cmd.listener.pos[1], cmd.listener.pos[2]);
+				const Vec3 front = normalize(Vec3(cmd.listener.front[0], cmd.listener.front[1], cmd.listener.front[2]));
+				const Vec3 up(cmd.listener.up[0], cmd.listener.up[1], cmd.listener.up[2]);
+				m_mix_listener_right = normalize(cross(front, up));
+				for (Voice& v : m_voices) {
+					if (v.is_3d) updateGain(v);
+				}
+				return;
+			}
 		}
+		// an ended voice is restarted by PLAY or SEEK with a new play_id
+		voice.active = voice.playing && voice.play_id != voice.end_play_id && (voice.frames > 0 || voice.stream);
 	}
 
 
-	void mixBuffer(u16* output, int size_bytes, Buffer& buffer)
+	// mixer thread
+	void pushPendingStatuses()
 	{
-		ASSERT(buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING);
-		ASSERT(buffer.channels == 1); // nothing else supported yet
-		if (buffer.cursor >= buffer.data.size()) return;
-		int total = size_bytes;
-		bool is_looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
-		do
-		{
-			int to_copy = minimum(total, buffer.data.size() - buffer.cursor);
-			memcpy(output, &buffer.data[buffer.cursor], to_copy);
-			buffer.cursor += to_copy;
-			if(is_looped) buffer.cursor = buffer.cursor % buffer.data.size();
-			total -= to_copy;
-		} while(total > 0 && is_looped);
+		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i) {
+			Voice& voice = m_voices[i];
+			if (voice.end_pending) {
+				Status status;
+				status.type = Status::Type::ENDED;
+				status.buffer = u16(i);
+				status.play_id = voice.play_id;
+				if (m_statuses.push(status)) voice.end_pending = false;
+			}
+			if (voice.release_pending) {
+				Status status;
+				status.type = Status::Type::RELEASED;
+				status.buffer = u16(i);
+				status.play_id = 0;
+				if (m_statuses.push(status)) voice.release_pending = false;
+			}
+		}
 	}
 
-	void play(BufferHandle buffer, bool looped) override 
+
+	// returns false when a non-looped voice reaches its end
+	static bool advance(Voice& voice, double frames) {
+		voice.pos += frames;
+		if (voice.pos < voice.frames) return true;
+		if (voice.looped) {
+			voice.pos = fmod(voice.pos, (double)voice.frames);
+			return true;
+		}
+		voice.pos = voice.frames;
+		return false;
+	}
+
+
+	static bool mixVoice(Voice& voice, float* LUMIX_RESTRICT out, u32 frames) {
+		const i16* LUMIX_RESTRICT data = voice.data;
+		const u32 channels = voice.channels;
+		// stereo sources are mixed channel to channel, mono to both, extra channels are ignored
+		const u32 right_channel = channels > 1 ? 1 : 0;
+		const float gl = voice.gain[0] * (1.f / 32768.f);
+		const float gr = voice.gain[1] * (1.f / 32768.f);
+		// seeked to the end
+		if (voice.pos >= voice.frames && !advance(voice, 0)) return false;
+		for (u32 i = 0; i < frames; ++i) {
+			const u32 i0 = (u32)voice.pos;
+			u32 i1 = i0 + 1;
+			if (i1 >= voice.frames) i1 = voice.looped ? 0 : i0;
+			const float t = float(voice.pos - i0);
+			// linear interpolation
+			const i16* s0 = data + i0 * channels;
+			const i16* s1 = data + i1 * channels;
+			const float l = s0[0] + (s1[0] - s0[0]) * t;
+			const float r = s0[right_channel] + (s1[right_channel] - s0[right_channel]) * t;
+			out[i * 2] += l * gl;
+			out[i * 2 + 1] += r * gr;
+			if (!advance(voice, voice.step)) return false;
+		}
+		return true;
+	}
+
+
+	// mixes from the part of stream needed for this block, `out` is null for voices over the limit
+	bool mixStreamVoice(Voice& voice, float* out, u32 frames) {
+		const u32 channels = voice.channels;
+		const u32 needed = minimum(u32(voice.pos + voice.step * frames) + 2, STREAM_SCRATCH_FRAMES);
+		i16* scratch = m_stream_scratch;
+		memcpy(scratch, voice.stream_carry, voice.stream_carry_frames * channels * sizeof(i16));
+		const u32 read = voice.stream->read(scratch + voice.stream_carry_frames * channels, needed - voice.stream_carry_frames);
+		const u32 available = voice.stream_carry_frames + read;
+		if (available == 0) return !voice.stream->isEnd();
+
+		Voice view = voice;
+		view.data = scratch;
+		view.frames = available;
+		view.looped = false;
+		// on underrun the rest of the block is silent
+		if (out) mixVoice(view, out, frames);
+		else advance(view, voice.step * frames);
+
+		const u32 base = minimum(u32(view.pos), available - 1);
+		voice.stream_carry_frames = minimum(available - base, 2u);
+		memcpy(voice.stream_carry, scratch + base * channels, voice.stream_carry_frames * channels * sizeof(i16));
+		voice.pos = view.pos - base;
+		voice.stream_cursor += base;
+		return read > 0 || !voice.stream->isEnd();
+	}
+
+
+	static void toS16(const float* LUMIX_RESTRICT in, i16* LUMIX_RESTRICT out, u32 count, float scale) {
+		u32 i = 0;
+		#ifdef LUMIX_SSE2
+			const __m128 s = _mm_set1_ps(scale * 32767.f);
+			for (; i + 8 <= count; i += 8) {
+				const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), s));
+				const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s));
+				// saturating
+				_mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+			}
+		#endif
+		for (; i < count; ++i) {
+			out[i] = (i16)clamp(in[i] * scale * 32767.f, -32768.f, 32767.f);
+		}
+	}
+
+
+	// mixer thread
+	void mix(i16* output, u32 frames)
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::PLAYING;
-		if(looped)
-		{
-			m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::LOOPED;
+		ASSERT(frames <= BLOCK_FRAMES);
+		Command cmd;
+		i32 processed = 0;
+		while (m_commands.pop(cmd)) {
+			executeCommand(cmd);
+			++processed;
 		}
-		else
-		{
-			m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::LOOPED;
+		if (processed) m_commands_processed = m_commands_processed + processed;
+
+		u32 active_count = 0;
+		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i) {
+			if (m_voices[i].active) m_active[active_count++] = i;
+		}
+
+		if (active_count > MAX_MIXED_VOICES) {
+			// insertion sort by audibility, descending
+			for (u32 i = 1; i < active_count; ++i) {
+				const u16 idx = m_active[i];
+				const float a = m_voices[idx].audibility;
+				u32 j = i;
+				for (; j > 0 && m_voices[m_active[j - 1]].audibility < a; --j) m_active[j] = m_active[j - 1];
+				m_active[j] = idx;
+			}
+		}
+
+		memset(m_accum, 0, sizeof(m_accum[0]) * frames * OUTPUT_CHANNELS);
+		for (u32 i = 0; i < active_count; ++i) {
+			const u16 idx = m_active[i];
+			Voice& voice = m_voices[idx];
+			const bool is_mixed = i < MAX_MIXED_VOICES;
+			bool running;
+			if (voice.stream) {
+				// the stream is released only after the mixer acknowledges stop
+				running = mixStreamVoice(voice, is_mixed ? m_accum : nullptr, frames);
+			}
+			else {
+				running = is_mixed ? mixVoice(voice, m_accum, frames) : advance(voice, voice.step * frames);
+			}
+			
+			m_cursors[idx] = voice.stream ? voice.stream_cursor : (i32)voice.pos;
+			if (!running) {
+				voice.active = false;
+				voice.end_play_id = voice.play_id;
+				voice.end_pending = true;
+			}
+		}
+		pushPendingStatuses();
+
+		toS16(m_accum, output, frames * OUTPUT_CHANNELS, m_master_volume);
+	}
+
+
+	bool isEnded(const Buffer& buffer) const { return buffer.end_play_id == buffer.play_id; }
+
+
+	void play(BufferHandle buffer, bool looped) override 
+	{
+		Buffer& b = m_buffers[buffer];
+		ASSERT(b.state == Buffer::State::USED);
+		pollStatus();
+		Command cmd;
+		cmd.type = Command::Type::PLAY;
+		cmd.buffer = u16(buffer);
+		cmd.play.looped = looped;
+		cmd.play.restart = isEnded(b);
+		if (cmd.play.restart) {
+			++b.play_id;
+			b.seek_frame = 0;
 		}
+		cmd.play.play_id = b.play_id;
+		b.playing = true;
+		pushCommand(cmd);
+		if (cmd.play.restart) b.seek_command = m_commands_pushed;
 	}
 
 
 	bool isPlaying(BufferHandle buffer) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING;
+		const Buffer& b = m_buffers[buffer];
+		ASSERT(b.state == Buffer::State::USED);
+		pollStatus();
+		return b.playing && !isEnded(b);
 	}
 
 
+	// returns immediately, the slot and the stream are released when the mixer acknowledges it
 	void stop(BufferHandle buffer) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
-		m_buffers[buffer].cursor = 0;
+		Buffer& b = m_buffers[buffer];
+		ASSERT(b.state == Buffer::State::USED);
+		b.state = Buffer::State::RELEASING;
+		Command cmd;
+		cmd.type = Command::Type::STOP;
+		cmd.buffer = u16(buffer);
+		pushCommand(cmd);
 	}
 
 
 	bool isEnd(BufferHandle buffer) override
 	{ 
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].cursor >= m_buffers[buffer].data.size();
+		ASSERT(m_buffers[buffer].state == Buffer::State::USED);
+		pollStatus();
+		return isEnded(m_buffers[buffer]);
 	}
 
 
 	void pause(BufferHandle buffer) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
+		Buffer& b = m_buffers[buffer];
+		ASSERT(b.state == Buffer::State::USED);
+		b.playing = false;
+		Command cmd;
+		cmd.type = Command::Type::PAUSE;
+		cmd.buffer = u16(buffer);
+		pushCommand(cmd);
 	}
 
 
 	void setMasterVolume(float volume) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		m_master_volume = volume;
 	}
 
 
 	void setVolume(BufferHandle buffer, float volume) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_buffers[buffer].state == Buffer::State::USED);
+		Command cmd;
+		cmd.type = Command::Type::VOLUME;
+		cmd.buffer = u16(buffer);
+		cmd.volume = volume;
+		pushCommand(cmd);
 	}
 
 
 	void setFrequency(BufferHandle buffer, u32 frequency_hz) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(m_buffers[buffer].state == Buffer::State::USED);
+		Command cmd;
+		cmd.type = Command::Type::FREQUENCY;
+		cmd.buffer = u16(buffer);
+		cmd.frequency = frequency_hz;
+		pushCommand(cmd);
 	}
 
 
 	void setCurrentTime(BufferHandle handle, float time_seconds) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
 		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		float rel = time_seconds / length;
-		buffer.cursor = rel * buffer.data.size();
-		buffer.cursor = clamp(buffer.cursor, 0, buffer.data.size());
+		ASSERT(buffer.state == Buffer::State::USED);
+		if (buffer.stream) return;
+
+		pollStatus();
+		const i32 frames = buffer.data.size() / (sizeof(i16) * maximum(buffer.channels, 1));
+		buffer.seek_frame = clamp(i32(time_seconds * buffer.sample_rate), 0, frames);
+		if (isEnded(buffer) && buffer.seek_frame < frames) ++buffer.play_id;
+
+		Command cmd;
+		cmd.type = Command::Type::SEEK;
+		cmd.buffer = u16(handle);
+		cmd.seek.frame = buffer.seek_frame;
+		cmd.seek.play_id = buffer.play_id;
+		pushCommand(cmd);
+		buffer.seek_command = m_commands_pushed;
 	}
 
 
 	float getCurrentTime(BufferHandle handle) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
-		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		return float(length * double(buffer.cursor) / buffer.data.size());
+		const Buffer& buffer = m_buffers[handle];
+		ASSERT(buffer.state == Buffer::State::USED);
+		// mixer did not get to the seek yet
+		const bool seek_pending = buffer.seek_command - m_commands_processed > 0;
+		const i32 cursor = seek_pending ? buffer.seek_frame : m_cursors[handle];
+		return float(cursor / double(buffer.sample_rate));
+	}
+
+
+	void pushListener()
+	{
+		Command cmd;
+		cmd.type = Command::Type::LISTENER;
+		cmd.buffer = 0;
+		for (u32 i = 0; i < 3; ++i) {
+			cmd.listener.pos[i] = (&m_listener_pos.x)[i];
+			cmd.listener.front[i] = (&m_listener_front.x)[i];
+			cmd.listener.up[i] = (&m_listener_up.x)[i];
+		}
+		pushCommand(cmd);
 	}
 
 
 	void setListenerPosition(const DVec3& pos) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		if (pos.x == m_listener_pos.x && pos.y == m_listener_pos.y && pos.z == m_listener_pos.z) return;
+		m_listener_pos = pos;
+		pushListener();
 	}
 
 
@@ -244,35 +737,51 @@ struct AudioDeviceImpl : AudioDevice
 		float up_y,
 		float up_z) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		const Vec3 front(front_x, front_y, front_z);
+		const Vec3 up(up_x, up_y, up_z);
+		if (front == m_listener_front && up == m_listener_up) return;
+		m_listener_front = front;
+		m_listener_up = up;
+		pushListener();
 	}
 	
 
 	void setSourcePosition(BufferHandle buffer, const DVec3& pos) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		Buffer& b = m_buffers[buffer];
+		ASSERT(b.state == Buffer::State::USED);
+		// scenes set positions every frame, mostly the same
+		if (b.position.x == pos.x && b.position.y == pos.y && b.position.z == pos.z) return;
+		b.position = pos;
+		Command cmd;
+		cmd.type = Command::Type::POSITION;
+		cmd.buffer = u16(buffer);
+		cmd.position[0] = pos.x;
+		cmd.position[1] = pos.y;
+		cmd.position[2] = pos.z;
+		pushCommand(cmd);
 	}
 	
 	
 	void update(float time_delta) override 
 	{
+		pollStatus();
 	}
 
 
 	AudioDeviceImpl(Engine& engine)
 		: m_allocator(engine.getAllocator())
-		, m_engine(engine)
 		, m_buffers(m_allocator)
+		, m_overflow(m_allocator)
+		, m_engine(engine)
 	{
 		m_buffers.reserve(MAX_BUFFERS_COUNT);
 		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
 		{
-			Buffer& buffer = m_buffers.emplace(m_allocator);
-			buffer.runtime_flags = 0;
+			m_buffers.emplace(m_allocator);
+			m_cursors[i] = 0;
 		}
+		pushListener();
 	}
 
 
@@ -284,6 +793,10 @@ struct AudioDeviceImpl : AudioDevice
 			m_task->destroy();
 			LUMIX_DELETE(m_allocator, m_task);
 		}
+		// mixer is not running, nothing else can reference streams
+		for (Buffer& buffer : m_buffers) {
+			if (buffer.stream) buffer.stream->release();
+		}
 		if (m_device) m_api.snd_pcm_close(m_device);
 		if (m_alsa_lib) os::unloadLibrary(m_alsa_lib);
 	}
@@ -336,8 +849,8 @@ struct AudioDeviceImpl : AudioDevice
 	{
 		if (!loadAlsa()) return false;
 		
-		unsigned int rate = 44100;
-		int channels = 1;
+		unsigned int rate = m_output_rate;
+		int channels = OUTPUT_CHANNELS;
 		snd_pcm_hw_params_t* hw_params;
 		snd_pcm_uframes_t buffer_size = 1024;
 
@@ -355,6 +868,7 @@ struct AudioDeviceImpl : AudioDevice
 		if (m_api.snd_pcm_hw_params_set_buffer_size_near(m_device, hw_params, &buffer_size) < 0) goto error;
 		res = m_api.snd_pcm_hw_params(m_device, hw_params);
 		if(res < 0) goto error;
+		m_output_rate = rate;
 		
 		res = m_api.snd_pcm_start(m_device);
 		if(res < 0) goto error;
@@ -399,14 +913,33 @@ struct AudioDeviceImpl : AudioDevice
 	};
 
 
-	static const int MAX_BUFFERS_COUNT = 256;
-
-
 	IAllocator& m_allocator;
+	// game thread only
 	Array<Buffer> m_buffers;
+	// commands which did not fit in the ring
+	Array<Command> m_overflow;
+	i32 m_commands_pushed = 0;
+	DVec3 m_listener_pos = DVec3(0);
+	Vec3 m_listener_front = Vec3(0, 0, -1);
+	Vec3 m_listener_up = Vec3(0, 1, 0);
+	// shared, each side writes only its end
+	SPSCRing<Command, COMMAND_RING_SIZE> m_commands;
+	SPSCRing<Status, STATUS_RING_SIZE> m_statuses;
+	volatile i32 m_commands_processed = 0;
+	// written by the mixer, in frames
+	volatile i32 m_cursors[MAX_BUFFERS_COUNT];
+	volatile float m_master_volume = 1;
+	// mixer thread only
+	Voice m_voices[MAX_BUFFERS_COUNT];
+	u16 m_active[MAX_BUFFERS_COUNT];
+	float m_accum[BLOCK_FRAMES * OUTPUT_CHANNELS];
+	i16 m_stream_scratch[STREAM_SCRATCH_FRAMES * OUTPUT_CHANNELS];
+	DVec3 m_mix_listener_pos = DVec3(0);
+	Vec3 m_mix_listener_right = Vec3(1, 0, 0);
+	// set before the mixer starts
+	u32 m_output_rate = 44100;
 	AudioTask* m_task = nullptr;
 	Engine& m_engine;
-	Mutex m_mutex;
 	void* m_alsa_lib = nullptr;
 	snd_pcm_t* m_device = nullptr;
 	API m_api;
@@ -424,14 +957,14 @@ int AudioTask::task()
 {
 	while(!m_finished)
 	{
-		u16 buffer[2*1024];
-		int frames_avail = lengthOf(buffer);
-		m_device.mix(buffer, frames_avail * 2);
+		i16 buffer[AudioDeviceImpl::BLOCK_FRAMES * AudioDeviceImpl::OUTPUT_CHANNELS];
+		int frames_avail = AudioDeviceImpl::BLOCK_FRAMES;
+		m_device.mix(buffer, frames_avail);
 
-		u16* iter = buffer;
+		i16* iter = buffer;
 		while(frames_avail > 0)
 		{		
-			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
+			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, iter, frames_avail);
 			if (frames_written < 0)
 			{
 				if (frames_written == -EAGAIN) continue;
@@ -443,13 +976,7 @@ int AudioTask::task()
 						handleError(recover_result);
 						break;
 					}
-
-					frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
-					if (frames_written < 0)
-					{
-						handleError(recover_result);
-						break;
-					}
+					continue;
 				} 
 				else 
 				{
@@ -459,7 +986,7 @@ int AudioTask::task()
 			else
 			{
 				frames_avail -= frames_written;
-				iter += frames_written;
+				iter += frames_written * AudioDeviceImpl::OUTPUT_CHANNELS;
 			}
 		}
 	}
@@ -489,6 +1016,10 @@ struct NullAudioDevice final : AudioDevice
 		float frequency,
 		float delay,
 		i32 phase) override {}
+	BufferHandle createStreamBuffer(AudioStream& stream, int channels, int sample_rate, int flags) override
+	{
+		return INVALID_BUFFER_HANDLE;
+	}
 	void play(BufferHandle buffer, bool looped) override {}
 	bool isPlaying(BufferHandle buffer) override { return false; }
 	void stop(BufferHandle buffer) override {}
@@ -26,6 +26,10 @@ struct AudioDeviceImpl final : AudioDevice
 		DWORD written_total;
 		int sparse_idx;
 		bool looped;
+		AudioStream* stream;
+		// written_total at which the stream ran out of data
+		DWORD stream_end;
+		DWORD frame_size;
 	};
 
 	Engine* m_engine;
@@ -155,10 +159,40 @@ struct AudioDeviceImpl final : AudioDevice
 		int channels,
 		int sample_rate,
 		int flags) override
+	{
+		return createBuffer(data, nullptr, data_size, channels, sample_rate, flags);
+	}
+
+
+	BufferHandle createStreamBuffer(AudioStream& stream, int channels, int sample_rate, int flags) override
+	{
+		// length is unknown, such buffers are always streamed
+		return createBuffer(nullptr, &stream, 0xffFFffFF, channels, sample_rate, flags);
+	}
+
+
+	// fills `size` bytes from stream, the rest is silence on underrun
+	static void readStream(Buffer& buffer, void* dst, DWORD size)
+	{
+		const u32 frames = buffer.stream->read((i16*)dst, size / buffer.frame_size);
+		const DWORD read = frames * buffer.frame_size;
+		if (read < size) {
+			ZeroMemory((u8*)dst + read, size - read);
+			if (buffer.stream->isEnd() && buffer.stream_end == 0xffFFffFF) buffer.stream_end = buffer.written_total + read;
+		}
+	}
+
+
+	BufferHandle createBuffer(const void* data,
+		AudioStream* stream,
+		DWORD data_size,
+		int channels,
+		int sample_rate,
+		int flags)
 	{
 		if (m_buffer_count == MAX_PLAYING_SOUNDS) return INVALID_BUFFER_HANDLE;
 
-		int buffer_size = data_size > STREAM_SIZE ? STREAM_SIZE : data_size;
+		DWORD buffer_size = data_size > STREAM_SIZE ? STREAM_SIZE : data_size;
 		DSBUFFERDESC desc = {};
 		LPDIRECTSOUNDBUFFER buffer;
 		desc.dwSize = sizeof(desc);
@@ -190,7 +224,12 @@ struct AudioDeviceImpl final : AudioDevice
 			buffer->Release();
 			return INVALID_BUFFER_HANDLE;
 		}
-		memcpy(p1, data, s1);
+		Buffer tmp = {};
+		tmp.stream = stream;
+		tmp.stream_end = 0xffFFffFF;
+		tmp.frame_size = channels * sizeof(i16);
+		if (stream) readStream(tmp, p1, s1);
+		else memcpy(p1, data, s1);
 		result = SUCCEEDED(buffer->Unlock(p1, s1, p2, s2));
 		if (!result)
 		{
@@ -228,6 +267,9 @@ struct AudioDeviceImpl final : AudioDevice
 				m_buffers[m_buffer_count].sparse_idx = i;
 				m_buffers[m_buffer_count].handle_3d = source;
 				m_buffers[m_buffer_count].handle8 = nullptr;
+				m_buffers[m_buffer_count].stream = stream;
+				m_buffers[m_buffer_count].stream_end = tmp.stream_end;
+				m_buffers[m_buffer_count].frame_size = tmp.frame_size;
 				buffer->QueryInterface(IID_IDirectSoundBuffer8, (void**)&m_buffers[m_buffer_count].handle8);
 				++m_buffer_count;
 				return i;
@@ -391,7 +433,7 @@ struct AudioDeviceImpl final : AudioDevice
 		auto rel_written = DWORD(buffer.written_total % STREAM_SIZE);
 		DWORD abs_pc = buffer.written_total - (rel_written - rel_pc);
 		if (rel_pc >= rel_written) abs_pc -= STREAM_SIZE;
-		return abs_pc >= buffer.data_size;
+		return abs_pc >= (buffer.stream ? buffer.stream_end : buffer.data_size);
 	}
 
 
@@ -405,6 +447,8 @@ struct AudioDeviceImpl final : AudioDevice
 		if (buffer.handle_3d) buffer.handle_3d->Release();
 		if (buffer.handle8) buffer.handle8->Release();
 		buffer.handle->Release();
+		// streams are read only in update(), so they can be released immediately
+		if (buffer.stream) buffer.stream->release();
 
 		m_buffers[dense_idx] = m_buffers[m_buffer_count];
 		m_buffers[m_buffer_count].handle = nullptr;
@@ -459,6 +503,8 @@ struct AudioDeviceImpl final : AudioDevice
 	void setCurrentTime(BufferHandle handle, float time_seconds) override
 	{
 		auto& buffer = m_buffers[m_buffer_map[handle]];
+		// streams can not seek
+		if (buffer.stream) return;
 		WAVEFORMATEX format;
 		if (SUCCEEDED(buffer.handle->GetFormat(&format, sizeof(format), nullptr)))
 		{
@@ -487,6 +533,13 @@ struct AudioDeviceImpl final : AudioDevice
 		}
 		auto updateBuffer = [&buffer](void* p, DWORD size) {
 			if (!p) return;
+			if (buffer.stream)
+			{
+				readStream(buffer, p, size);
+				buffer.written += size;
+				buffer.written_total += size;
+				return;
+			}
 			if (buffer.written + size > buffer.data_size)
 			{
 				memcpy(p, (u8*)buffer.data + buffer.written, buffer.data_size - buffer.written);
@@ -592,6 +645,10 @@ struct NullAudioDevice final : AudioDevice
 		float delay,
 		i32 phase) override {}
 
+	BufferHandle createStreamBuffer(AudioStream& stream, int channels, int sample_rate, int flags) override
+	{
+		return INVALID_BUFFER_HANDLE;
+	}
 	void play(BufferHandle buffer, bool looped) override {}
 	bool isPlaying(BufferHandle buffer) override { return false; }
 	void stop(BufferHandle buffer) override {}
@@ -0,0 +1,409 @@
+#include "engine/allocators.h"
+#include "engine/array.h"
+#include "engine/associative_array.h"
+#include "engine/atomic.h"
+#include "engine/crc32.h"
+#include "engine/geometry.h"
+#include "engine/hash_map.h"
+#include "engine/job_system.h"
+#include "engine/lz4.h"
+#include "engine/math.h"
+#include "engine/os.h"
+#include "engine/radix_sort.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include "engine/sync.h"
+#include <stdio.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#else
+	#include <x86intrin.h>
+#endif
+
+using namespace Lumix;
+
+// benchmarks [name filter] [-csv <path>]
+// each benchmark is run WARMUP_RUNS times, then measured MEASURED_RUNS times, min and median are reported
+// cycles are from rdtsc, which ticks at constant rate on modern cpus, so they are comparable only on the same machine
+
+// results are accumulated here, so the compiler can not remove benchmarked code
+static volatile u64 g_sink = 0;
+// set by benchmarks which also check results, the process then returns 1
+static bool g_failed = false;
+
+struct Random {
+	u32 next() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+	float nextFloat(float from, float to) { return from + (next() & 0xffFF) / 65535.f * (to - from); }
+	u32 state = 0x12345678;
+};
+
+struct BenchmarkRunner {
+	static constexpr u32 WARMUP_RUNS = 3;
+	static constexpr u32 MEASURED_RUNS = 15;
+
+	explicit BenchmarkRunner(IAllocator& allocator) : m_csv(allocator) {
+		m_csv << "name,elements,min_ms,median_ms,ns_per_element,cycles_per_element\n";
+	}
+
+	static void sort(u64* values, u32 count) {
+		for (u32 i = 1; i < count; ++i) {
+			for (u32 j = i; j > 0 && values[j - 1] > values[j]; --j) swap(values[j - 1], values[j]);
+		}
+	}
+
+	// `setup` is called before each run and is not measured
+	template <typename Setup, typename F>
+	void run(const char* name, u32 elements, const Setup& setup, const F& f) {
+		if (m_filter && !findSubstring(name, m_filter)) return;
+
+		for (u32 i = 0; i < WARMUP_RUNS; ++i) {
+			setup();
+			f();
+		}
+
+		u64 times[MEASURED_RUNS];
+		u64 cycles[MEASURED_RUNS];
+		for (u32 i = 0; i < MEASURED_RUNS; ++i) {
+			setup();
+			const u64 t0 = os::Timer::getRawTimestamp();
+			const u64 c0 = __rdtsc();
+			f();
+			const u64 c1 = __rdtsc();
+			const u64 t1 = os::Timer::getRawTimestamp();
+			times[i] = t1 - t0;
+			cycles[i] = c1 - c0;
+		}
+		sort(times, MEASURED_RUNS);
+		sort(cycles, MEASURED_RUNS);
+
+		const double freq = (double)os::Timer::getFrequency();
+		const double min_ms = times[0] * 1000.0 / freq;
+		const double median_ms = times[MEASURED_RUNS / 2] * 1000.0 / freq;
+		const double ns = times[0] * 1e9 / freq / elements;
+		const double cpe = cycles[0] / double(elements);
+		printf("%-40s %10u %10.3f %10.3f %10.2f %10.2f\n", name, elements, min_ms, median_ms, ns, cpe);
+		m_csv << name << "," << elements << "," << min_ms << "," << median_ms << "," << ns << "," << cpe << "\n";
+	}
+
+	template <typename F>
+	void run(const char* name, u32 elements, const F& f) {
+		run(name, elements, [](){}, f);
+	}
+
+	const char* m_filter = nullptr;
+	OutputMemoryStream m_csv;
+};
+
+static void benchmarkContainers(BenchmarkRunner& runner, IAllocator& allocator) {
+	constexpr u32 COUNT = 1024 * 1024;
+	// multiplication by odd constant is a bijection, so keys are unique and scattered
+	Array<u32> keys(allocator);
+	for (u32 i = 0; i < COUNT; ++i) keys.push(i * 2654435761u);
+
+	runner.run("Array::push", COUNT, [&](){
+		Array<u32> array(allocator);
+		for (u32 i = 0; i < COUNT; ++i) array.push(i);
+		g_sink += array.size();
+	});
+
+	HashMap<u32, u32> map(allocator);
+	runner.run("HashMap::insert", COUNT, [&](){ map.clear(); }, [&](){
+		for (u32 key : keys) map.insert(key, key);
+	});
+	runner.run("HashMap::find", COUNT, [&](){
+		u64 sum = 0;
+		for (u32 key : keys) {
+			auto iter = map.find(key);
+			if (iter.isValid()) sum += iter.value();
+		}
+		g_sink += sum;
+	});
+	runner.run("HashMap::find missing", COUNT, [&](){
+		u64 sum = 0;
+		for (u32 i = 0; i < COUNT; ++i) sum += map.find((i + COUNT) * 2654435761u).isValid() ? 1 : 0;
+		g_sink += sum;
+	});
+	runner.run("HashMap::erase", COUNT, [&](){
+		map.clear();
+		for (u32 key : keys) map.insert(key, key);
+	}, [&](){
+		for (u32 key : keys) map.erase(key);
+	});
+
+	// inserts shift the sorted arrays, so fewer elements
+	constexpr u32 ASSOC_COUNT = 16 * 1024;
+	AssociativeArray<u32, u32> assoc(allocator);
+	runner.run("AssociativeArray::insert", ASSOC_COUNT, [&](){ assoc.clear(); }, [&](){
+		for (u32 i = 0; i < ASSOC_COUNT; ++i) {
+			if (assoc.find(keys[i]) < 0) assoc.insert(keys[i], i);
+		}
+	});
+	runner.run("AssociativeArray::find", ASSOC_COUNT, [&](){
+		u64 sum = 0;
+		for (u32 i = 0; i < ASSOC_COUNT; ++i) sum += assoc.find(keys[i]);
+		g_sink += sum;
+	});
+	runner.run("AssociativeArray::erase", ASSOC_COUNT, [&](){
+		assoc.clear();
+		for (u32 i = 0; i < ASSOC_COUNT; ++i) {
+			if (assoc.find(keys[i]) < 0) assoc.insert(keys[i], i);
+		}
+	}, [&](){
+		for (u32 i = 0; i < ASSOC_COUNT; ++i) assoc.erase(keys[i]);
+	});
+}
+
+static void benchmarkMath(BenchmarkRunner& runner, IAllocator& allocator) {
+	constexpr u32 COUNT = 1024 * 1024;
+	Array<Transform> transforms(allocator);
+	Array<Vec3> points(allocator);
+	Array<Matrix> matrices(allocator);
+	Random rnd;
+	for (u32 i = 0; i < COUNT; ++i) {
+		const Vec3 axis = normalize(Vec3(rnd.nextFloat(-1, 1), rnd.nextFloat(-1, 1), rnd.nextFloat(-1, 1) + 2));
+		const Quat rot(axis, rnd.nextFloat(0, PI));
+		const DVec3 pos(rnd.nextFloat(-100, 100), rnd.nextFloat(-100, 100), rnd.nextFloat(-100, 100));
+		transforms.push(Transform(pos, rot, rnd.nextFloat(0.5f, 2)));
+		points.push(Vec3(rnd.nextFloat(-10, 10), rnd.nextFloat(-10, 10), rnd.nextFloat(-10, 10)));
+		Matrix m;
+		m.fromEuler(rnd.nextFloat(0, PI), rnd.nextFloat(0, PI), rnd.nextFloat(0, PI));
+		matrices.push(m);
+	}
+
+	runner.run("Transform * Transform", COUNT - 1, [&](){
+		double sum = 0;
+		for (u32 i = 0; i < COUNT - 1; ++i) sum += (transforms[i] * transforms[i + 1]).pos.x;
+		g_sink += u64(sum);
+	});
+	runner.run("Transform::transform", COUNT, [&](){
+		double sum = 0;
+		for (u32 i = 0; i < COUNT; ++i) sum += transforms[i].transform(points[i]).y;
+		g_sink += u64(sum);
+	});
+	runner.run("Quat::rotate", COUNT, [&](){
+		float sum = 0;
+		for (u32 i = 0; i < COUNT; ++i) sum += transforms[i].rot.rotate(points[i]).z;
+		g_sink += u64(sum);
+	});
+	runner.run("Matrix * Matrix", COUNT - 1, [&](){
+		float sum = 0;
+		for (u32 i = 0; i < COUNT - 1; ++i) sum += (matrices[i] * matrices[i + 1]).columns[3].x;
+		g_sink += u64(sum);
+	});
+}
+
+static void benchmarkSort(BenchmarkRunner& runner, IAllocator& allocator) {
+	constexpr u32 COUNT = 1024 * 1024;
+	Array<u64> src(allocator);
+	Array<u64> keys(allocator);
+	Array<u64> values(allocator);
+	Random rnd;
+	for (u32 i = 0; i < COUNT; ++i) src.push((u64(rnd.next()) << 32) | rnd.next());
+	keys.resize(COUNT);
+	values.resize(COUNT);
+
+	runner.run("radixSort random", COUNT, [&](){
+		memcpy(keys.begin(), src.begin(), keys.byte_size());
+		for (u32 i = 0; i < COUNT; ++i) values[i] = i;
+	}, [&](){
+		radixSort(keys.begin(), values.begin(), COUNT, allocator);
+	});
+
+	// typical sort keys, only some low bits differ
+	runner.run("radixSort 24 bits", COUNT, [&](){
+		for (u32 i = 0; i < COUNT; ++i) {
+			keys[i] = (u64(7) << 56) | (src[i] & 0xffFFff);
+			values[i] = i;
+		}
+	}, [&](){
+		radixSort(keys.begin(), values.begin(), COUNT, allocator);
+	});
+}
+
+static void benchmarkCulling(BenchmarkRunner& runner, IAllocator& allocator) {
+	constexpr u32 COUNT = 64 * 1024;
+	Array<Vec4> spheres(allocator);
+	Array<DVec3> boxes(allocator);
+	Random rnd;
+	for (u32 i = 0; i < COUNT; ++i) {
+		spheres.push(Vec4(rnd.nextFloat(-500, 500), rnd.nextFloat(-50, 50), rnd.nextFloat(-500, 500), rnd.nextFloat(0.5f, 5)));
+		boxes.push(DVec3(rnd.nextFloat(-500, 500), rnd.nextFloat(-50, 50), rnd.nextFloat(-500, 500)));
+	}
+
+	Frustum frustum;
+	frustum.computePerspective(Vec3(0), Vec3(0, 0, -1), Vec3(0, 1, 0), degreesToRadians(60.f), 16 / 9.f, 0.1f, 300.f);
+	ShiftedFrustum shifted_frustum;
+	shifted_frustum.computePerspective(DVec3(0), Vec3(0, 0, -1), Vec3(0, 1, 0), degreesToRadians(60.f), 16 / 9.f, 0.1f, 300.f);
+
+	runner.run("Frustum::isSphereInside", COUNT, [&](){
+		u32 visible = 0;
+		for (const Vec4& s : spheres) visible += frustum.isSphereInside(s.xyz(), s.w) ? 1 : 0;
+		g_sink += visible;
+	});
+	runner.run("ShiftedFrustum::intersectsAABB", COUNT, [&](){
+		u32 visible = 0;
+		for (const DVec3& p : boxes) visible += shifted_frustum.intersectsAABB(p, Vec3(4)) ? 1 : 0;
+		g_sink += visible;
+	});
+}
+
+static void benchmarkJobs(BenchmarkRunner& runner) {
+	constexpr u32 ROUNDTRIPS = 1000;
+	runner.run("jobs::run + wait roundtrip", ROUNDTRIPS, [&](){
+		for (u32 i = 0; i < ROUNDTRIPS; ++i) {
+			jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+			jobs::run(nullptr, [](void*){ atomicIncrement((volatile i32*)&g_sink); }, &signal);
+			jobs::wait(signal);
+		}
+	});
+
+	constexpr u32 FAN_OUT = 256;
+	constexpr u32 FAN_ROUNDS = 100;
+	runner.run("jobs fan-out/fan-in 256", FAN_ROUNDS * FAN_OUT, [&](){
+		for (u32 r = 0; r < FAN_ROUNDS; ++r) {
+			jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+			for (u32 i = 0; i < FAN_OUT; ++i) {
+				jobs::run(nullptr, [](void*){ atomicIncrement((volatile i32*)&g_sink); }, &signal);
+			}
+			jobs::wait(signal);
+		}
+	});
+
+	constexpr u32 COUNT = 1024 * 1024;
+	runner.run("jobs::forEach step 1024", COUNT, [&](){
+		volatile i32 sum = 0;
+		jobs::forEach(COUNT, 1024, [&](i32 from, i32 to){
+			i32 s = 0;
+			for (i32 i = from; i < to; ++i) s += i & 7;
+			atomicAdd(&sum, s);
+		});
+		g_sink += sum;
+	});
+	runner.run("jobs::forEach grain hint", COUNT, [&](){
+		volatile i32 sum = 0;
+		jobs::forEach(COUNT, jobs::GrainHint{1}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+			i32 s = 0;
+			for (i32 i = from; i < to; ++i) s += i & 7;
+			atomicAdd(&sum, s);
+		});
+		g_sink += sum;
+	});
+
+	// nested forEach waits in the callback, so other fibers run on the worker and the fiber can continue on other worker,
+	// scratch allocated before the nested call must stay intact
+	constexpr u32 OUTER = 64;
+	constexpr u32 INNER = 16 * 1024;
+	constexpr u32 SCRATCH_VALUES = 1024;
+	runner.run("jobs::forEach nested + scratch", OUTER * INNER, [&](){
+		volatile i32 corrupted = 0;
+		jobs::forEach(OUTER, jobs::GrainHint{1'000'000}, [&](i32 from, i32 to, const jobs::ForEachContext& ctx){
+			for (i32 i = from; i < to; ++i) {
+				u32* values = (u32*)ctx.scratch.allocate(SCRATCH_VALUES * sizeof(u32));
+				for (u32 j = 0; j < SCRATCH_VALUES; ++j) values[j] = i;
+				jobs::forEach(INNER, jobs::GrainHint{1}, [&](i32 inner_from, i32 inner_to, const jobs::ForEachContext& inner_ctx){
+					u32* tmp = (u32*)inner_ctx.scratch.allocate(SCRATCH_VALUES * sizeof(u32));
+					for (u32 j = 0; j < SCRATCH_VALUES; ++j) tmp[j] = 0xffFFffFF;
+					g_sink += tmp[0] + inner_to - inner_from;
+				});
+				for (u32 j = 0; j < SCRATCH_VALUES; ++j) {
+					if (values[j] != (u32)i) {
+						atomicIncrement(&corrupted);
+						break;
+					}
+				}
+			}
+		});
+		if (corrupted) {
+			printf("jobs::forEach scratch corrupted by nested forEach\n");
+			g_failed = true;
+		}
+	});
+}
+
+static void benchmarkCompression(BenchmarkRunner& runner, IAllocator& allocator) {
+	constexpr u32 SIZE = 16 * 1024 * 1024;
+	// repeated runs of random bytes, compresses roughly like mesh data
+	Array<u8> src(allocator);
+	src.resize(SIZE);
+	Random rnd;
+	for (u32 i = 0; i < SIZE;) {
+		const u32 run = 1 + (rnd.next() & 15);
+		const u8 value = u8(rnd.next());
+		for (u32 j = 0; j < run && i < SIZE; ++j, ++i) src[i] = (rnd.next() & 3) ? value : u8(rnd.next());
+	}
+
+	Array<u8> compressed(allocator);
+	compressed.resize(LZ4_compressBound(SIZE));
+	int compressed_size = 0;
+	runner.run("LZ4 compress (bytes)", SIZE, [&](){
+		compressed_size = LZ4_compress_default((const char*)src.begin(), (char*)compressed.begin(), SIZE, compressed.size());
+		g_sink += compressed_size;
+	});
+
+	Array<u8> decompressed(allocator);
+	decompressed.resize(SIZE);
+	runner.run("LZ4 decompress (bytes)", SIZE, [&](){
+		g_sink += LZ4_decompress_safe((const char*)compressed.begin(), (char*)decompressed.begin(), compressed_size, SIZE);
+	});
+
+	runner.run("crc32 (bytes)", SIZE, [&](){
+		g_sink += crc32(src.begin(), SIZE);
+	});
+}
+
+int main(int argc, char* argv[]) {
+	DefaultAllocator allocator;
+	if (!jobs::init(os::getCPUsCount(), allocator)) {
+		printf("Failed to initialize job system.\n");
+		return 1;
+	}
+
+	struct Data {
+		Data(IAllocator& allocator) : runner(allocator), semaphore(0, 1) {}
+		BenchmarkRunner runner;
+		IAllocator* allocator;
+		const char* csv_path = nullptr;
+		Semaphore semaphore;
+	} data(allocator);
+	data.allocator = &allocator;
+	for (int i = 1; i < argc; ++i) {
+		if (equalStrings(argv[i], "-csv") && i + 1 < argc) data.csv_path = argv[++i];
+		else data.runner.m_filter = argv[i];
+	}
+
+	// jobs::wait works only in fibers
+	jobs::runEx(&data, [](void* ptr) {
+		Data* data = (Data*)ptr;
+		IAllocator& allocator = *data->allocator;
+		printf("%-40s %10s %10s %10s %10s %10s\n", "name", "elements", "min ms", "median ms", "ns/elem", "cycles/elem");
+		benchmarkContainers(data->runner, allocator);
+		benchmarkMath(data->runner, allocator);
+		benchmarkSort(data->runner, allocator);
+		benchmarkCulling(data->runner, allocator);
+		benchmarkJobs(data->runner);
+		benchmarkCompression(data->runner, allocator);
+		data->semaphore.signal();
+	}, nullptr, jobs::INVALID_HANDLE, 0);
+	data.semaphore.wait();
+
+	int res = g_failed ? 1 : 0;
+	if (data.csv_path) {
+		os::OutputFile file;
+		if (file.open(data.csv_path)) {
+			if (!file.write(data.runner.m_csv.data(), data.runner.m_csv.size())) res = 1;
+			file.close();
+		}
+		else {
+			printf("Could not open %s\n", data.csv_path);
+			res = 1;
+		}
+	}
+
+	jobs::shutdown();
+	return res;
+}
@@ -75,7 +75,7 @@ bool AssetBrowser::IPlugin::createTile(const char* in_path, const char* out_path
 struct AssetBrowserImpl : AssetBrowser {
 	struct FileInfo {
 		StaticString<LUMIX_MAX_PATH> clamped_filename;
-		StaticString<LUMIX_MAX_PATH> filepath;
+		Path filepath;
 		u32 file_path_hash;
 		void* tex = nullptr;
 		bool create_called = false;
@@ -85,6 +85,14 @@ struct AssetBrowserImpl : AssetBrowser {
 		u32 gc_counter;
 	};
 
+	// tiles visible in the last frame, others were scrolled out and are dropped
+	struct TileRequest {
+		u32 file_path_hash;
+		u32 frame;
+	};
+
+	static constexpr u32 MAX_TILE_REQUESTS_PER_FRAME = 4;
+
 	AssetBrowserImpl(StudioApp& app)
 		: m_selected_resources(app.getAllocator())
 		, m_is_focus_requested(false)
@@ -99,6 +107,7 @@ struct AssetBrowserImpl : AssetBrowser {
 		, m_immediate_tiles(app.getAllocator())
 		, m_filtered_file_infos(app.getAllocator())
 		, m_subdirs(app.getAllocator())
+		, m_tile_requests(app.getAllocator())
 	{
 		m_filter[0] = '\0';
 
@@ -161,7 +170,7 @@ struct AssetBrowserImpl : AssetBrowser {
 
 		for (i32 i = 0; i < m_file_infos.size(); ++i) {
 			FileInfo& info = m_file_infos[i];
-			if (info.filepath != path.c_str()) continue;
+			if (info.filepath != path) continue;
 			
 			switch (getState(info, fs)) {
 				case TileState::DELETED:
@@ -212,9 +221,49 @@ struct AssetBrowserImpl : AssetBrowser {
 			}
 		}
 
+		processTileRequests();
 		for (auto* plugin : m_plugins) plugin->update();
 	}
 
+	FileInfo* findFileInfo(u32 file_path_hash) {
+		for (FileInfo& fi : m_file_infos) {
+			if (fi.file_path_hash == file_path_hash) return &fi;
+		}
+		for (FileInfo& fi : m_immediate_tiles) {
+			if (fi.file_path_hash == file_path_hash) return &fi;
+		}
+		return nullptr;
+	}
+
+	void requestTile(const FileInfo& tile) {
+		if (tile.create_called) return;
+		for (TileRequest& req : m_tile_requests) {
+			if (req.file_path_hash == tile.file_path_hash) {
+				req.frame = m_frame;
+				return;
+			}
+		}
+		m_tile_requests.push({tile.file_path_hash, m_frame});
+	}
+
+	// requests are passed to plugins in the order tiles are drawn, few per frame
+	void processTileRequests() {
+		m_tile_requests.eraseItems([&](const TileRequest& req){ return req.frame + 1 < m_frame; });
+
+		u32 count = 0;
+		while (!m_tile_requests.empty() && count < MAX_TILE_REQUESTS_PER_FRAME) {
+			const TileRequest req = m_tile_requests[0];
+			m_tile_requests.erase(0);
+			FileInfo* fi = findFileInfo(req.file_path_hash);
+			if (!fi) continue;
+			
+			StaticString<LUMIX_MAX_PATH> path(".lumix/asset_tiles/", fi->file_path_hash, ".lbc");
+			createTile(*fi, path);
+			++count;
+		}
+		++m_frame;
+	}
+
 	void addTile(const Path& path) {
 		if (!m_show_subresources && contains(path.c_str(), ':')) return;
 
@@ -232,7 +281,7 @@ struct AssetBrowserImpl : AssetBrowser {
 		clampText(filename, int(TILE_SIZE * m_thumbnail_size));
 
 		tile.file_path_hash = path.getHash();
-		tile.filepath = path.c_str();
+		tile.filepath = path;
 		tile.clamped_filename = filename;
 
 		m_file_infos.push(tile);
@@ -246,6 +295,7 @@ struct AssetBrowserImpl : AssetBrowser {
 			ri->unloadTexture(info.tex);
 		}
 		m_file_infos.clear();
+		m_tile_requests.clear();
 
 		Path::normalize(path, Span(m_dir.data));
 		int len = stringLength(m_dir);
@@ -282,7 +332,7 @@ struct AssetBrowserImpl : AssetBrowser {
 		qsort(m_file_infos.begin(), m_file_infos.size(), sizeof(m_file_infos[0]), [](const void* a, const void* b){
 			FileInfo* m = (FileInfo*)a;
 			FileInfo* n = (FileInfo*)b;
-			return strcmp(m->filepath.data, n->filepath.data);
+			return strcmp(m->filepath.c_str(), n->filepath.c_str());
 		});
 	}
 
@@ -358,7 +408,7 @@ struct AssetBrowserImpl : AssetBrowser {
 
 		for (int i = 0, c = m_file_infos.size(); i < c; ++i)
 		{
-			if (stristr(m_file_infos[i].filepath, m_filter)) m_filtered_file_infos.push(i);
+			if (stristr(m_file_infos[i].filepath.c_str(), m_filter)) m_filtered_file_infos.push(i);
 		}
 	}
 
@@ -386,8 +436,8 @@ struct AssetBrowserImpl : AssetBrowser {
 		tile.create_called = true;
 		const AssetCompiler& compiler = m_app.getAssetCompiler();
 		for (IPlugin* plugin : m_plugins) {
-			ResourceType type = compiler.getResourceType(tile.filepath);
-			if (plugin->createTile(tile.filepath, out_path, type)) break;
+			ResourceType type = compiler.getResourceType(tile.filepath.c_str());
+			if (plugin->createTile(tile.filepath.c_str(), out_path, type)) break;
 		}
 	}
 
@@ -400,16 +450,16 @@ struct AssetBrowserImpl : AssetBrowser {
 	
 	static TileState getState(const FileInfo& info, FileSystem& fs) {
 		StaticString<LUMIX_MAX_PATH> path(".lumix/asset_tiles/", info.file_path_hash, ".lbc");
-		if (!fs.fileExists(info.filepath)) return TileState::DELETED;
+		if (!fs.fileExists(info.filepath.c_str())) return TileState::DELETED;
 		if (!fs.fileExists(path)) return TileState::NOT_CREATED;
 
 		StaticString<LUMIX_MAX_PATH> compiled_path(".lumix/assets/", info.file_path_hash, ".res");
 		const u64 last_modified = fs.getLastModified(path);
-		if (last_modified < fs.getLastModified(info.filepath) || last_modified < fs.getLastModified(compiled_path)) {
+		if (last_modified < fs.getLastModified(info.filepath.c_str()) || last_modified < fs.getLastModified(compiled_path)) {
 			return TileState::OUTDATED;
 		}
 
-		StaticString<LUMIX_MAX_PATH> meta_path(info.filepath, ".meta");
+		StaticString<LUMIX_MAX_PATH> meta_path(info.filepath.c_str(), ".meta");
 		if (fs.getLastModified(meta_path) > last_modified) {
 			return TileState::OUTDATED;
 		}
@@ -443,7 +493,7 @@ struct AssetBrowserImpl : AssetBrowser {
 					break;
 				case TileState::NOT_CREATED:
 				case TileState::OUTDATED:
-					createTile(tile, path);
+					requestTile(tile);
 					break;
 				case TileState::DELETED:
 					break;
@@ -466,7 +516,7 @@ struct AssetBrowserImpl : AssetBrowser {
 		FileSystem& fs = m_app.getEngine().getFileSystem();
 		StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", m_file_infos[idx].file_path_hash, ".res");
 		fs.deleteFile(res_path);
-		if (!fs.deleteFile(m_file_infos[idx].filepath)) {
+		if (!fs.deleteFile(m_file_infos[idx].filepath.c_str())) {
 			logError("Failed to delete ", m_file_infos[idx].filepath);
 		}
 	}
@@ -499,18 +549,18 @@ struct AssetBrowserImpl : AssetBrowser {
 		int row_count = m_show_thumbnails ? (tile_count + columns - 1) / columns : tile_count;
 	
 		auto callbacks = [this](FileInfo& tile, int idx) {
-			if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", tile.filepath.data);
+			if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", tile.filepath.c_str());
 			if (ImGui::BeginDragDropSource(ImGuiDragDropFlags_SourceAllowNullID))
 			{
-				ImGui::Text("%s", (const char*)tile.filepath);
-				ImGui::SetDragDropPayload("path", tile.filepath, stringLength(tile.filepath) + 1, ImGuiCond_Once);
+				ImGui::Text("%s", tile.filepath.c_str());
+				ImGui::SetDragDropPayload("path", tile.filepath.c_str(), tile.filepath.length() + 1, ImGuiCond_Once);
 				ImGui::EndDragDropSource();
 			}
 			else if (ImGui::IsItemHovered())
 			{
 				if (ImGui::IsMouseReleased(0)) {
 					const bool additive = os::isKeyDown(os::Keycode::LSHIFT);
-					selectResource(Path(tile.filepath), true, additive);
+					selectResource(tile.filepath, true, additive);
 				}
 				else if(ImGui::IsMouseReleased(1)) {
 					m_context_resource = idx;
@@ -546,7 +596,7 @@ struct AssetBrowserImpl : AssetBrowser {
 					const int idx = (!m_filtered_file_infos.empty()) ? m_filtered_file_infos[j] : j;
 					FileInfo& tile = m_file_infos[idx];
 					bool b = m_selected_resources.find([&](Resource* res){ return res->getPath().getHash() == tile.file_path_hash; }) >= 0;
-					ImGui::Selectable(tile.filepath, b);
+					ImGui::Selectable(tile.filepath.c_str(), b);
 					callbacks(tile, idx);
 				}
 			}
@@ -600,12 +650,12 @@ struct AssetBrowserImpl : AssetBrowser {
 				m_selected_resources.reserve(m_file_infos.size());
 				if(m_filtered_file_infos.empty()) {
 					for (const FileInfo& fi : m_file_infos) {
-						selectResource(Path(fi.filepath), false, true);
+						selectResource(fi.filepath, false, true);
 					}
 				}
 				else {
 					for (int i : m_filtered_file_infos) {
-						selectResource(Path(m_file_infos[i].filepath), false, true);
+						selectResource(m_file_infos[i].filepath, false, true);
 					}
 				}
 			}
@@ -617,14 +667,14 @@ struct AssetBrowserImpl : AssetBrowser {
 			ImGui::Text("%s", m_file_infos[m_context_resource].clamped_filename.data);
 			ImGui::Separator();
 			if (ImGui::MenuItem(ICON_FA_EXTERNAL_LINK_ALT "Open externally")) {
-				openInExternalEditor(m_file_infos[m_context_resource].filepath);
+				openInExternalEditor(m_file_infos[m_context_resource].filepath.c_str());
 			}
 			if (ImGui::BeginMenu("Rename")) {
 				ImGui::InputTextWithHint("##New name", "New name", tmp, sizeof(tmp));
 				if (ImGui::Button("Rename", ImVec2(100, 0))) {
-					PathInfo fi(m_file_infos[m_context_resource].filepath);
+					PathInfo fi(m_file_infos[m_context_resource].filepath.c_str());
 					StaticString<LUMIX_MAX_PATH> new_path(fi.m_dir, tmp, ".", fi.m_extension);
-					if (!fs.moveFile(m_file_infos[m_context_resource].filepath, new_path)) {
+					if (!fs.moveFile(m_file_infos[m_context_resource].filepath.c_str(), new_path)) {
 						logError("Failed to rename ", m_file_infos[m_context_resource].filepath, " to ", new_path);
 					}
 					ImGui::CloseCurrentPopup();
@@ -785,13 +835,13 @@ struct AssetBrowserImpl : AssetBrowser {
 	void refreshLabels() {
 		for (FileInfo& tile : m_file_infos) {
 			char filename[LUMIX_MAX_PATH];
-			Span<const char> subres = getSubresource(tile.filepath.data);
+			Span<const char> subres = getSubresource(tile.filepath.c_str());
 			if (*subres.end()) {
 				copyNString(Span(filename), subres.begin(), subres.length());
 				catString(filename, ":");
-				catString(Span(filename), Path::getBasename(tile.filepath.data));
+				catString(Span(filename), Path::getBasename(tile.filepath.c_str()));
 			} else {
-				copyString(Span(filename), Path::getBasename(tile.filepath.data));
+				copyString(Span(filename), Path::getBasename(tile.filepath.c_str()));
 			}
 			clampText(filename, int(TILE_SIZE * m_thumbnail_size));
 
@@ -1088,7 +1138,7 @@ struct AssetBrowserImpl : AssetBrowser {
 		if (idx < 0) {
 			FileInfo& fi = m_immediate_tiles.emplace();
 			fi.file_path_hash = path.getHash();
-			fi.filepath = path.c_str();
+			fi.filepath = path;
 
 			char filename[LUMIX_MAX_PATH];
 			Span<const char> subres = getSubresource(path.c_str());
@@ -1239,6 +1289,8 @@ struct AssetBrowserImpl : AssetBrowser {
 	Array<StaticString<LUMIX_MAX_PATH> > m_subdirs;
 	Array<FileInfo> m_file_infos;
 	Array<ImmediateTile> m_immediate_tiles;
+	Array<TileRequest> m_tile_requests;
+	u32 m_frame = 0;
 	Array<int> m_filtered_file_infos;
 	Array<Path> m_history;
 	EntityPtr m_dropped_entity = INVALID_ENTITY;
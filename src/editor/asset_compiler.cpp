@@ -6,6 +6,7 @@
 #include "editor/studio_app.h"
 #include "editor/utils.h"
 #include "editor/world_editor.h"
+#include "engine/command_line_parser.h"
 #include "engine/crc32.h"
 #include "engine/engine.h"
 #include "engine/log.h"
@@ -55,6 +56,27 @@ struct AssetCompilerTask : Thread
 };
 
 
+static constexpr u32 CACHE_MAGIC = 'LACH';
+static constexpr u32 CACHE_VERSION = 0;
+static constexpr u64 HASH_SEED = 0xcbf29ce484222325;
+// bigger resources are compressed well enough without a dictionary
+static constexpr u32 DICTIONARY_SIZE_LIMIT = 64 * 1024;
+// resource types with less small resources do not get a dictionary
+static constexpr u32 DICTIONARY_MIN_SAMPLES = 16;
+
+// outputs and dependencies of a single compile, stored in the shared cache
+struct CacheRecord {
+	CacheRecord(IAllocator& allocator) : deps(allocator), outputs(allocator) {}
+
+	OutputMemoryStream deps;
+	OutputMemoryStream outputs;
+	u32 outputs_count = 0;
+};
+
+// set while a worker compiles an asset which should end up in the shared cache
+static thread_local CacheRecord* g_cache_record = nullptr;
+
+
 void AssetCompiler::IPlugin::addSubresources(AssetCompiler& compiler, const char* path)
 {
 	const ResourceType type = compiler.getResourceType(path);
@@ -65,9 +87,13 @@ void AssetCompiler::IPlugin::addSubresources(AssetCompiler& compiler, const char
 
 
 struct AssetCompilerImpl : AssetCompiler {
+	static constexpr u32 MAX_WORKERS = 8;
+	static constexpr u64 CHANGED_FILES_DEBOUNCE_MS = 100;
+
 	struct CompileJob {
 		u32 generation;
 		Path path;
+		IPlugin* plugin = nullptr;
 	};
 
 	struct LoadHook : ResourceManagerHub::LoadHook
@@ -87,10 +113,11 @@ struct AssetCompilerImpl : AssetCompiler {
 		: m_app(app)
 		, m_load_hook(*this)
 		, m_plugins(app.getAllocator())
-		, m_task(*this, app.getAllocator())
+		, m_tasks(app.getAllocator())
 		, m_to_compile(app.getAllocator())
+		, m_in_progress(app.getAllocator())
+		, m_blocked(app.getAllocator())
 		, m_compiled(app.getAllocator())
-		, m_semaphore(0, 0x7fFFffFF)
 		, m_registered_extensions(app.getAllocator())
 		, m_resources(app.getAllocator())
 		, m_generations(app.getAllocator())
@@ -104,11 +131,42 @@ struct AssetCompilerImpl : AssetCompiler {
 		const char* base_path = fs.getBasePath();
 		m_watcher = FileSystemWatcher::create(base_path, app.getAllocator());
 		m_watcher->getCallback().bind<&AssetCompilerImpl::onFileChanged>(this);
-		m_task.create("Asset compiler", true);
+		// plugins use jobs internally too, so do not take all cores
+		const u32 workers_count = clamp(os::getCPUsCount() / 2, (u32)1, (u32)MAX_WORKERS);
+		for (u32 i = 0; i < workers_count; ++i) {
+			UniquePtr<AssetCompilerTask>& task = m_tasks.emplace();
+			task = UniquePtr<AssetCompilerTask>::create(app.getAllocator(), *this, app.getAllocator());
+			task->create("Asset compiler", true);
+		}
 		StaticString<LUMIX_MAX_PATH> path(base_path, ".lumix/assets");
 		if (!os::makePath(path)) logError("Could not create ", path);
 		ResourceManagerHub& rm = engine.getResourceManager();
 		rm.setLoadHook(&m_load_hook);
+		rm.enableDependencyRecording(true);
+		m_dictionaries_hash = getFileHash(Path(ResourceManagerHub::DICTIONARIES_PATH));
+		initSharedCache();
+	}
+
+	void initSharedCache() {
+		char cmd_line[2048];
+		os::getCommandLine(Span(cmd_line));
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (!parser.currentEquals("-asset_cache")) continue;
+			if (!parser.next()) {
+				logError("command line option '-asset_cache` without value");
+				return;
+			}
+			parser.getCurrent(m_cache_dir.data, sizeof(m_cache_dir.data));
+			if (!os::makePath(m_cache_dir)) {
+				logError("Could not create shared asset cache ", m_cache_dir);
+				m_cache_dir = "";
+				return;
+			}
+			logInfo("Using shared asset cache ", m_cache_dir);
+			return;
+		}
 	}
 
 	~AssetCompilerImpl()
@@ -122,6 +180,7 @@ struct AssetCompilerImpl : AssetCompiler {
 			}
 			file << "}\n\n";
 			file << "dependencies = {\n";
+			MutexGuard lock(m_to_compile_mutex);
 			for (auto iter = m_dependencies.begin(), end = m_dependencies.end(); iter != end; ++iter) {
 				file << "\t[\"" << iter.key().c_str() << "\"] = {\n";
 				for (const Path& p : iter.value()) {
@@ -139,12 +198,29 @@ struct AssetCompilerImpl : AssetCompiler {
 			logError("Could not save .lumix/assets/_list.txt");
 		}
 
-		ASSERT(m_plugins.empty());
-		m_task.m_finished = true;
-		m_to_compile.emplace();
-		m_semaphore.signal();
-		m_task.destroy();
 		ResourceManagerHub& rm = m_app.getEngine().getResourceManager();
+		OutputMemoryStream manifest(m_app.getAllocator());
+		rm.saveDependencyManifest(manifest);
+		if (fs.open(ResourceManagerHub::DEPENDENCY_MANIFEST_PATH, file)) {
+			if (!file.write(manifest.data(), manifest.size())) {
+				logError("Could not write ", ResourceManagerHub::DEPENDENCY_MANIFEST_PATH);
+			}
+			file.close();
+		}
+		else {
+			logError("Could not save ", ResourceManagerHub::DEPENDENCY_MANIFEST_PATH);
+		}
+
+		ASSERT(m_plugins.empty());
+		{
+			MutexGuard lock(m_to_compile_mutex);
+			for (UniquePtr<AssetCompilerTask>& task : m_tasks) {
+				task->m_finished = true;
+				task->wakeup();
+			}
+		}
+		for (UniquePtr<AssetCompilerTask>& task : m_tasks) task->destroy();
+		rm.enableDependencyRecording(false);
 		rm.setLoadHook(nullptr);
 	}
 	
@@ -154,8 +230,14 @@ struct AssetCompilerImpl : AssetCompiler {
 		const char* base_path = fs.getBasePath();
 		m_watcher = FileSystemWatcher::create(base_path, m_app.getAllocator());
 		m_watcher->getCallback().bind<&AssetCompilerImpl::onFileChanged>(this);
-		m_dependencies.clear();
+		{
+			MutexGuard lock(m_to_compile_mutex);
+			m_dependencies.clear();
+			m_blocked.clear();
+		}
 		m_resources.clear();
+		engine.getResourceManager().loadDictionaries();
+		m_dictionaries_hash = getFileHash(Path(ResourceManagerHub::DICTIONARIES_PATH));
 		fillDB();
 	}
 
@@ -175,14 +257,30 @@ struct AssetCompilerImpl : AssetCompiler {
 		return writeCompiledResource(src.c_str(), Span(tmp.data(), (u32)tmp.size()));
 	}
 
+	static i32 compressWithDictionary(Span<const u8> dictionary, Span<const u8> data, OutputMemoryStream& compressed) {
+		LZ4_stream_t* stream = LZ4_createStream();
+		LZ4_loadDict(stream, (const char*)dictionary.begin(), (i32)dictionary.length());
+		const i32 res = LZ4_compress_fast_continue(stream, (const char*)data.begin(), (char*)compressed.getMutableData(), (i32)data.length(), (i32)compressed.size(), 1);
+		LZ4_freeStream(stream);
+		return res;
+	}
+
 	bool writeCompiledResource(const char* locator, Span<const u8> data) override {
 		constexpr u32 COMPRESSION_SIZE_LIMIT = 4096;
+		ResourceManagerHub& rm = m_app.getEngine().getResourceManager();
+		// small resources are compressed only if there's a dictionary for their type
+		const u32 dictionary = data.length() > 0 && data.length() <= DICTIONARY_SIZE_LIMIT ? rm.getDictionaryHash(getResourceType(locator)) : 0;
 		OutputMemoryStream compressed(m_app.getAllocator());
 		i32 compressed_size = 0;
-		if (data.length() > COMPRESSION_SIZE_LIMIT) {
+		if (dictionary != 0 || data.length() > COMPRESSION_SIZE_LIMIT) {
 			const i32 cap = LZ4_compressBound((i32)data.length());
 			compressed.resize(cap);
-			compressed_size = LZ4_compress_default((const char*)data.begin(), (char*)compressed.getMutableData(), (i32)data.length(), cap); 
+			if (dictionary != 0) {
+				compressed_size = compressWithDictionary(rm.getDictionary(dictionary), data, compressed);
+			}
+			else {
+				compressed_size = LZ4_compress_default((const char*)data.begin(), (char*)compressed.getMutableData(), (i32)data.length(), cap); 
+			}
 			if (compressed_size == 0) {
 				logError("Could not compress ", locator);
 				return false;
@@ -203,18 +301,197 @@ struct AssetCompilerImpl : AssetCompiler {
 		}
 		CompiledResourceHeader header;
 		header.decompressed_size = data.length();
-		if (data.length() > COMPRESSION_SIZE_LIMIT && compressed_size < i32(data.length() / 4 * 3)) {
+		Span<const u8> payload = data;
+		if (compressed_size > 0 && compressed_size < i32(data.length() / 4 * 3)) {
 			header.flags |= CompiledResourceHeader::COMPRESSED;
-			(void)file.write(&header, sizeof(header));
-			(void)file.write(compressed.data(), compressed_size);
+			if (dictionary != 0) {
+				header.flags |= CompiledResourceHeader::DICTIONARY;
+				header.dictionary = dictionary;
+			}
+			payload = Span((const u8*)compressed.data(), (u32)compressed_size);
 		}
-		else {
-			(void)file.write(&header, sizeof(header));
-			(void)file.write(data.begin(), data.length());
+		(void)file.write(&header, sizeof(header));
+		(void)file.write(payload.begin(), payload.length());
+		file.close();
+		if (file.isError()) {
+			logError("Could not write ", out_path);
+			return false;
 		}
+
+		if (g_cache_record) {
+			g_cache_record->outputs.write(hash);
+			g_cache_record->outputs.write(u32(sizeof(header) + payload.length()));
+			g_cache_record->outputs.write(header);
+			g_cache_record->outputs.write(payload.begin(), payload.length());
+			++g_cache_record->outputs_count;
+		}
+		return true;
+	}
+
+	bool writeCompiledResource(const char* locator, const OutputPagedStream& data) override {
+		// lz4 needs contiguous input, this is the only copy of the data
+		OutputMemoryStream tmp(m_app.getAllocator());
+		data.copyTo(tmp);
+		ASSERT(tmp.size() < 0xffFFffFF);
+		return writeCompiledResource(locator, Span(tmp.data(), (u32)tmp.size()));
+	}
+
+	// FNV-1a
+	static u64 hashContent(u64 hash, const void* data, u64 size) {
+		const u8* c = (const u8*)data;
+		for (u64 i = 0; i < size; ++i) {
+			hash ^= c[i];
+			hash *= 0x100000001b3;
+		}
+		return hash;
+	}
+
+	// 0 if the file does not exist
+	u64 getFileHash(const Path& path) {
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		OutputMemoryStream content(m_app.getAllocator());
+		if (!fs.getContentSync(path, content)) return 0;
+		return hashContent(HASH_SEED, content.data(), content.size());
+	}
+
+	// key of compiled outputs in shared cache; dependencies are checked separately, since they are known only after the compile
+	bool getCacheKey(const CompileJob& job, u64& key) {
+		const u64 src_hash = getFileHash(Path(getResourceFilePath(job.path.c_str())));
+		if (src_hash == 0) return false;
+
+		const StaticString<LUMIX_MAX_PATH> meta_path(getResourceFilePath(job.path.c_str()), ".meta");
+		const u64 meta_hash = getFileHash(Path(meta_path));
+		const u32 version = job.plugin->getVersion();
+		key = hashContent(HASH_SEED, &CACHE_VERSION, sizeof(CACHE_VERSION));
+		key = hashContent(key, job.path.c_str(), job.path.length());
+		key = hashContent(key, &version, sizeof(version));
+		key = hashContent(key, &src_hash, sizeof(src_hash));
+		key = hashContent(key, &meta_hash, sizeof(meta_hash));
+		// outputs compressed with dictionaries are useless to others without the same dictionaries
+		key = hashContent(key, &m_dictionaries_hash, sizeof(m_dictionaries_hash));
+		return true;
+	}
+
+	bool loadFromCache(u64 key) {
+		PROFILE_FUNCTION();
+		const StaticString<LUMIX_MAX_PATH> cache_path(m_cache_dir, "/", key, ".lac");
+		os::InputFile file;
+		if (!file.open(cache_path)) return false;
+
+		OutputMemoryStream blob(m_app.getAllocator());
+		blob.resize(file.size());
+		const bool read = file.read(blob.getMutableData(), blob.size());
 		file.close();
-		if (file.isError()) logError("Could not write ", out_path);
-		return !file.isError();
+		if (!read) return false;
+
+		InputMemoryStream in(blob);
+		if (in.read<u32>() != CACHE_MAGIC) return false;
+		if (in.read<u32>() != CACHE_VERSION) return false;
+
+		// outputs are stale if any dependency changed
+		const u32 deps_count = in.read<u32>();
+		const u64 deps_pos = in.getPosition();
+		for (u32 i = 0; i < deps_count; ++i) {
+			in.readString();
+			const char* dependency = in.readString();
+			if (in.read<u64>() != getFileHash(Path(dependency))) return false;
+		}
+		
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		const u32 outputs_count = in.read<u32>();
+		for (u32 i = 0; i < outputs_count; ++i) {
+			const u32 hash = in.read<u32>();
+			const u32 size = in.read<u32>();
+			if (in.getPosition() + size > in.size()) return false;
+			const void* data = in.skip(size);
+			const StaticString<LUMIX_MAX_PATH> out_path(".lumix/assets/", hash, ".res");
+			os::OutputFile out;
+			if (!fs.open(out_path, out)) {
+				logError("Could not create ", out_path);
+				return false;
+			}
+			(void)out.write(data, size);
+			out.close();
+			if (out.isError()) {
+				logError("Could not write ", out_path);
+				return false;
+			}
+		}
+
+		in.setPosition(deps_pos);
+		for (u32 i = 0; i < deps_count; ++i) {
+			const char* included_from = in.readString();
+			const char* dependency = in.readString();
+			registerDependency(Path(included_from), Path(dependency));
+			in.read<u64>();
+		}
+		return true;
+	}
+
+	void saveToCache(u64 key, const CompileJob& job, const CacheRecord& record) {
+		PROFILE_FUNCTION();
+		Array<Path> deps(m_app.getAllocator());
+		InputMemoryStream recorded(record.deps);
+		while (recorded.getPosition() < recorded.size()) {
+			deps.push(Path(recorded.readString()));
+			deps.push(Path(recorded.readString()));
+		}
+		{
+			// dependencies registered before the compile, e.g. shader includes found when scanning
+			MutexGuard lock(m_to_compile_mutex);
+			for (auto iter = m_dependencies.begin(), end = m_dependencies.end(); iter != end; ++iter) {
+				if (iter.value().indexOf(job.path) < 0) continue;
+				deps.push(job.path);
+				deps.push(iter.key());
+			}
+		}
+
+		OutputMemoryStream blob(m_app.getAllocator());
+		blob.write(CACHE_MAGIC);
+		blob.write(CACHE_VERSION);
+		blob.write(u32(deps.size() / 2));
+		for (i32 i = 0; i < deps.size(); i += 2) {
+			blob.writeString(deps[i].c_str());
+			blob.writeString(deps[i + 1].c_str());
+			blob.write(getFileHash(deps[i + 1]));
+		}
+		blob.write(record.outputs_count);
+		blob.write(record.outputs.data(), record.outputs.size());
+
+		// other editors and build agents may read the same entry, so write it whole and then rename
+		const StaticString<LUMIX_MAX_PATH> cache_path(m_cache_dir, "/", key, ".lac");
+		const StaticString<LUMIX_MAX_PATH> tmp_path(cache_path, "_", os::Timer::getRawTimestamp());
+		os::OutputFile file;
+		if (!file.open(tmp_path)) {
+			logError("Could not create ", tmp_path);
+			return;
+		}
+		(void)file.write(blob.data(), blob.size());
+		file.close();
+		if (file.isError()) {
+			logError("Could not write ", tmp_path);
+			os::deleteFile(tmp_path);
+			return;
+		}
+		if (!os::moveFile(tmp_path, cache_path)) {
+			os::deleteFile(tmp_path);
+		}
+	}
+
+	// called from worker thread
+	bool compileJob(const CompileJob& job) {
+		if (!job.plugin) return compile(job.path);
+
+		u64 key;
+		if (m_cache_dir[0] == '\0' || !getCacheKey(job, key)) return job.plugin->compile(job.path);
+		if (loadFromCache(key)) return true;
+
+		CacheRecord record(m_app.getAllocator());
+		g_cache_record = &record;
+		const bool compiled = job.plugin->compile(job.path);
+		g_cache_record = nullptr;
+		if (compiled) saveToCache(key, job, record);
+		return compiled;
 	}
 
 	static u32 dirHash(const char* path) {
@@ -334,6 +611,11 @@ struct AssetCompilerImpl : AssetCompiler {
 
 	void registerDependency(const Path& included_from, const Path& dependency) override
 	{
+		if (g_cache_record) {
+			g_cache_record->deps.writeString(included_from.c_str());
+			g_cache_record->deps.writeString(dependency.c_str());
+		}
+		MutexGuard lock(m_to_compile_mutex);
 		auto iter = m_dependencies.find(dependency);
 		if (!iter.isValid()) {
 			IAllocator& allocator = m_app.getAllocator();
@@ -395,6 +677,7 @@ struct AssetCompilerImpl : AssetCompiler {
 				lua_getglobal(L, "dependencies");
 				if (lua_type(L, -1) != LUA_TTABLE) return;
 
+				MutexGuard lock(m_to_compile_mutex);
 				lua_pushnil(L);
 				while (lua_next(L, -2) != 0) {
 					if (!lua_isstring(L, -2) || !lua_istable(L, -1)) {
@@ -444,8 +727,52 @@ struct AssetCompilerImpl : AssetCompiler {
 		if (startsWith(path, ".")) return;
 		if (equalIStrings(path, "lumix.log")) return;
 		
+		// editors and vcs tools can touch the same file several times, so only the last event is kept
+		const u64 now = os::Timer::getRawTimestamp();
 		MutexGuard lock(m_changed_mutex);
-		m_changed_files.push(Path(path));
+		auto iter = m_changed_files.find(Path(path));
+		if (iter.isValid()) iter.value() = now;
+		else m_changed_files.insert(Path(path), now);
+	}
+
+	// returns changed files which did not change for at least CHANGED_FILES_DEBOUNCE_MS
+	// dependencies are sorted before other files
+	void popChangedFiles(Array<Path>& batch) {
+		const u64 now = os::Timer::getRawTimestamp();
+		const u64 debounce = os::Timer::getFrequency() * CHANGED_FILES_DEBOUNCE_MS / 1000;
+		{
+			MutexGuard lock(m_changed_mutex);
+			if (m_changed_files.empty()) return;
+			for (auto iter = m_changed_files.begin(), end = m_changed_files.end(); iter != end; ++iter) {
+				if (now - iter.value() < debounce) continue;
+
+				const Path& path = iter.key();
+				if (Path::hasExtension(path.c_str(), "meta")) {
+					char tmp[LUMIX_MAX_PATH];
+					copyNString(Span(tmp), path.c_str(), path.length() - 5);
+					batch.push(Path(tmp));
+				}
+				else {
+					batch.push(path);
+				}
+			}
+			for (const Path& path : batch) {
+				m_changed_files.erase(path);
+				const StaticString<LUMIX_MAX_PATH> meta_path(path.c_str(), ".meta");
+				m_changed_files.erase(Path(meta_path));
+			}
+		}
+		if (batch.empty()) return;
+
+		batch.removeDuplicates();
+
+		MutexGuard lock(m_to_compile_mutex);
+		u32 dependencies_count = 0;
+		for (u32 i = 0; i < (u32)batch.size(); ++i) {
+			if (!m_dependencies.find(batch[i]).isValid()) continue;
+			if (i != dependencies_count) swap(batch[i], batch[dependencies_count]);
+			++dependencies_count;
+		}
 	}
 
 	bool getMeta(const Path& res, void* user_ptr, void (*callback)(void*, lua_State*)) const override
@@ -495,7 +822,7 @@ struct AssetCompilerImpl : AssetCompiler {
 	}
 
 
-	bool compile(const Path& src) override
+	IPlugin* getPlugin(const Path& src)
 	{
 		Span<const char> ext = Path::getExtension(Span(src.c_str(), src.length()));
 		char tmp[64];
@@ -504,11 +831,17 @@ struct AssetCompilerImpl : AssetCompiler {
 		const u32 hash = crc32(tmp);
 		MutexGuard lock(m_plugin_mutex);
 		auto iter = m_plugins.find(hash);
-		if (!iter.isValid()) {
+		return iter.isValid() ? iter.value() : nullptr;
+	}
+
+	bool compile(const Path& src) override
+	{
+		IPlugin* plugin = getPlugin(src);
+		if (!plugin) {
 			logError("Unknown resource type ", src);
 			return false;
 		}
-		return iter.value()->compile(src);
+		return plugin->compile(src);
 	}
 	
 
@@ -560,6 +893,11 @@ struct AssetCompilerImpl : AssetCompiler {
 
 	void pushToCompileQueue(const Path& path) {
 		MutexGuard lock(m_to_compile_mutex);
+		pushToCompileQueueLocked(path);
+	}
+
+	// m_to_compile_mutex must be locked
+	void pushToCompileQueueLocked(const Path& path) {
 		auto iter = m_generations.find(path);
 		if (!iter.isValid()) {
 			iter = m_generations.insert(path, 0);
@@ -571,19 +909,102 @@ struct AssetCompilerImpl : AssetCompiler {
 		CompileJob job;
 		job.path = path;
 		job.generation = iter.value();
+		job.plugin = getPlugin(path);
 
 		m_to_compile.push(job);
+		if (m_compile_batch_count == 0) m_batch_timer.tick();
 		++m_compile_batch_count;
 		++m_batch_remaining_count;
-		m_semaphore.signal();
+		setBlocking(path, true);
+		for (UniquePtr<AssetCompilerTask>& task : m_tasks) task->wakeup();
+	}
+
+	// dependents of queued or in progress `path` wait for it to be compiled first
+	void setBlocking(const Path& path, bool block) {
+		auto dep_iter = m_dependencies.find(path);
+		if (!dep_iter.isValid()) return;
+
+		for (const Path& dependent : dep_iter.value()) {
+			auto iter = m_blocked.find(dependent);
+			if (block) {
+				if (iter.isValid()) ++iter.value();
+				else m_blocked.insert(dependent, 1);
+			}
+			else if (iter.isValid() && iter.value() > 0) {
+				--iter.value();
+			}
+		}
+	}
+
+	bool canCompile(const CompileJob& job) const {
+		auto blocked_iter = m_blocked.find(job.path);
+		if (blocked_iter.isValid() && blocked_iter.value() > 0) return false;
+
+		u32 plugin_jobs = 0;
+		for (const CompileJob& j : m_in_progress) {
+			if (j.path == job.path) return false;
+			if (j.plugin == job.plugin) ++plugin_jobs;
+		}
+		return !job.plugin || plugin_jobs < job.plugin->getMaxConcurrency();
+	}
+
+	// called from worker thread, returns empty job if the worker should exit
+	CompileJob popCompileJob(AssetCompilerTask& task) {
+		MutexGuard lock(m_to_compile_mutex);
+		for (;;) {
+			if (task.m_finished) return {};
+
+			i32 picked = -1;
+			for (i32 i = m_to_compile.size() - 1; i >= 0; --i) {
+				const CompileJob& job = m_to_compile[i];
+				const bool is_most_recent = job.generation == m_generations[job.path];
+				if (!is_most_recent) {
+					setBlocking(job.path, false);
+					m_to_compile.erase(i);
+					--m_batch_remaining_count;
+					continue;
+				}
+				if (canCompile(job)) {
+					picked = i;
+					break;
+				}
+			}
+			// cyclic dependencies, ignore the order
+			if (picked < 0 && m_in_progress.empty() && !m_to_compile.empty()) picked = m_to_compile.size() - 1;
+
+			if (picked >= 0) {
+				const CompileJob job = m_to_compile[picked];
+				m_to_compile.erase(picked);
+				m_in_progress.push(job);
+				return job;
+			}
+			task.sleep(m_to_compile_mutex);
+		}
+	}
+
+	void onJobCompiled(const CompileJob& job) {
+		{
+			MutexGuard lock(m_to_compile_mutex);
+			const i32 idx = m_in_progress.find([&](const CompileJob& j){ return j.path == job.path; });
+			ASSERT(idx >= 0);
+			m_in_progress.swapAndPop(idx);
+			setBlocking(job.path, false);
+			for (UniquePtr<AssetCompilerTask>& task : m_tasks) task->wakeup();
+		}
+		MutexGuard lock(m_compiled_mutex);
+		m_compiled.push(job);
 	}
 
 	CompileJob popCompiledResource()
 	{
-		MutexGuard lock(m_compiled_mutex);
-		if (m_compiled.empty()) return {};
-		const CompileJob p = m_compiled.back();
-		m_compiled.pop();
+		CompileJob p;
+		{
+			MutexGuard lock(m_compiled_mutex);
+			if (m_compiled.empty()) return {};
+			p = m_compiled.back();
+			m_compiled.pop();
+		}
+		MutexGuard lock(m_to_compile_mutex);
 		--m_batch_remaining_count;
 		if (m_batch_remaining_count == 0) m_compile_batch_count = 0;
 		return p;
@@ -608,8 +1029,146 @@ struct AssetCompilerImpl : AssetCompiler {
 		return 1;
 	}
 
+	static int LUA_trainDictionaries(lua_State* L) {
+		const int index = lua_upvalueindex(1);
+		if (!LuaWrapper::isType<AssetCompilerImpl*>(L, index)) {
+			logError("Invalid Lua closure");
+			ASSERT(false);
+			return 0;
+		}
+		AssetCompilerImpl* compiler = LuaWrapper::toType<AssetCompilerImpl*>(L, index);
+		ASSERT(compiler);
+		lua_pushboolean(L, compiler->trainDictionaries());
+		return 1;
+	}
+
 	void registerLuaAPI(lua_State* L) {
 		LuaWrapper::createSystemClosure(L, "Assets", this, "getResources", &LUA_getResources);
+		LuaWrapper::createSystemClosure(L, "Assets", this, "trainDictionaries", &LUA_trainDictionaries);
+	}
+
+	struct DictionarySample {
+		DictionarySample(IAllocator& allocator) : data(allocator) {}
+		Path path;
+		ResourceType type;
+		OutputMemoryStream data;
+	};
+
+	// dictionary is made of pieces of evenly picked samples, lz4 has no dictionary trainer
+	static void trainDictionary(Span<const DictionarySample*> samples, OutputMemoryStream& dictionary) {
+		const u32 piece_size = clamp(ResourceManagerHub::MAX_DICTIONARY_SIZE / samples.length(), 64u, 4096u);
+		const u32 stride = maximum(1u, samples.length() * piece_size / ResourceManagerHub::MAX_DICTIONARY_SIZE);
+		for (u32 i = 0; i < samples.length(); i += stride) {
+			const OutputMemoryStream& data = samples[i]->data;
+			const u32 size = (u32)minimum(data.size(), u64(piece_size), u64(ResourceManagerHub::MAX_DICTIONARY_SIZE - dictionary.size()));
+			if (size == 0) break;
+			dictionary.write(data.data(), size);
+		}
+	}
+
+	bool trainDictionaries() override {
+		{
+			MutexGuard lock(m_to_compile_mutex);
+			if (m_batch_remaining_count > 0 || !m_in_progress.empty()) {
+				logError("Can not train compression dictionaries while resources are compiling");
+				return false;
+			}
+		}
+
+		IAllocator& allocator = m_app.getAllocator();
+		ResourceManagerHub& rm = m_app.getEngine().getResourceManager();
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+
+		Array<ResourceItem> resources(allocator);
+		{
+			MutexGuard lock(m_resources_mutex);
+			for (const ResourceItem& ri : m_resources) resources.push(ri);
+		}
+
+		// resources compressed with current dictionaries must be decompressed before the dictionaries change
+		Array<DictionarySample> samples(allocator);
+		u64 size_before = 0;
+		OutputMemoryStream content(allocator);
+		for (const ResourceItem& ri : resources) {
+			const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", ri.path.getHash(), ".res");
+			content.clear();
+			if (!fs.getContentSync(Path(res_path), content)) continue;
+			CompiledResourceHeader header;
+			if (content.size() < sizeof(header)) continue;
+			memcpy(&header, content.data(), sizeof(header));
+			if (header.magic != CompiledResourceHeader::MAGIC || header.decompressed_size > DICTIONARY_SIZE_LIMIT) continue;
+
+			DictionarySample& sample = samples.emplace(allocator);
+			sample.path = ri.path;
+			sample.type = ri.type;
+			const Span<const u8> payload(content.data() + sizeof(header), u32(content.size() - sizeof(header)));
+			if (header.flags & CompiledResourceHeader::COMPRESSED) {
+				if (!rm.decompress(header, payload, sample.data)) {
+					logError("Failed to decompress ", ri.path);
+					samples.pop();
+					continue;
+				}
+			}
+			else {
+				sample.data.write(payload.begin(), payload.length());
+			}
+			size_before += content.size();
+		}
+
+		OutputMemoryStream blob(allocator);
+		blob.write(ResourceManagerHub::DICTIONARIES_MAGIC);
+		blob.write(ResourceManagerHub::DICTIONARIES_VERSION);
+		blob.write((u32)0);
+		u32 count = 0;
+		Array<const DictionarySample*> type_samples(allocator);
+		OutputMemoryStream dictionary(allocator);
+		for (i32 i = 0; i < samples.size(); ++i) {
+			const ResourceType type = samples[i].type;
+			bool is_first = true;
+			for (i32 j = 0; j < i; ++j) is_first = is_first && samples[j].type != type;
+			if (!is_first) continue;
+
+			type_samples.clear();
+			for (const DictionarySample& s : samples) {
+				if (s.type == type) type_samples.push(&s);
+			}
+			if ((u32)type_samples.size() < DICTIONARY_MIN_SAMPLES) continue;
+
+			dictionary.clear();
+			trainDictionary(type_samples, dictionary);
+			blob.write(type.type);
+			blob.write((u32)dictionary.size());
+			blob.write(dictionary.data(), dictionary.size());
+			++count;
+		}
+		memcpy(blob.getMutableData() + sizeof(u32) * 2, &count, sizeof(count));
+
+		os::OutputFile file;
+		if (!fs.open(ResourceManagerHub::DICTIONARIES_PATH, file)) {
+			logError("Could not create ", ResourceManagerHub::DICTIONARIES_PATH);
+			return false;
+		}
+		const bool written = file.write(blob.data(), blob.size());
+		file.close();
+		if (!written || file.isError()) {
+			logError("Could not write ", ResourceManagerHub::DICTIONARIES_PATH);
+			return false;
+		}
+		rm.loadDictionaries();
+		m_dictionaries_hash = hashContent(HASH_SEED, blob.data(), blob.size());
+
+		bool success = true;
+		for (const DictionarySample& sample : samples) {
+			success = writeCompiledResource(sample.path.c_str(), Span(sample.data.data(), (u32)sample.data.size())) && success;
+		}
+
+		u64 size_after = 0;
+		for (const DictionarySample& sample : samples) {
+			const StaticString<LUMIX_MAX_PATH> res_path(fs.getBasePath(), ".lumix/assets/", sample.path.getHash(), ".res");
+			size_after += os::getFileSize(res_path);
+		}
+		logInfo("Trained ", count, " compression dictionaries, small resources take ", size_after, " B instead of ", size_before, " B");
+		return success;
 	}
 
 	void onGUI() override {
@@ -629,14 +1188,18 @@ struct AssetCompilerImpl : AssetCompiler {
 			| ImGuiWindowFlags_NoSavedSettings;
 		ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 1);
 		if (ImGui::Begin("Resource compilation", nullptr, flags)) {
-			ImGui::Text("%s", "Compiling resources...");
-			ImGui::ProgressBar(((float)m_compile_batch_count - m_batch_remaining_count) / m_compile_batch_count);
-			StaticString<LUMIX_MAX_PATH> path;
-			{
-				MutexGuard lock(m_to_compile_mutex);
-				path = m_res_in_progress;
+			MutexGuard lock(m_to_compile_mutex);
+			const u32 done = m_compile_batch_count - m_batch_remaining_count;
+			ImGui::Text("Compiling resources... %d / %d", done, m_compile_batch_count);
+			ImGui::ProgressBar(float(done) / m_compile_batch_count);
+			const float elapsed = m_batch_timer.getTimeSinceTick();
+			if (done > 0) {
+				const u32 eta = u32(elapsed / done * m_batch_remaining_count);
+				ImGui::Text("%d workers, ETA %d:%02d", m_tasks.size(), eta / 60, eta % 60);
+			}
+			for (const CompileJob& job : m_in_progress) {
+				ImGui::TextWrapped("%s", job.path.c_str());
 			}
-			ImGui::TextWrapped("%s", path.data);
 		}
 		ImGui::End();
 		ImGui::PopStyleVar();
@@ -645,7 +1208,7 @@ struct AssetCompilerImpl : AssetCompiler {
 	Resource* getResource(const Path& path) const {
 		ResourceManagerHub& rman = m_app.getEngine().getResourceManager();
 		for (ResourceManager* rm : rman.getAll()) {
-			auto iter = rm->getResourceTable().find(path.getHash());
+			auto iter = rm->getResourceTable().find(path.getStableHash());
 			if (iter.isValid()) return iter.value();
 		}
 		return nullptr;
@@ -665,42 +1228,31 @@ struct AssetCompilerImpl : AssetCompiler {
 			}();
 			if (p.generation != generation) continue;
 
-			MutexGuard lock(m_compiled_mutex);
-			// reload/continue loading resource and its subresources
-			for (const ResourceItem& ri : m_resources) {
-				if (!endsWithInsensitive(ri.path.c_str(), p.path.c_str())) continue;;
-				
-				Resource* r = getResource(ri.path);
-				if (r && r->isReady()) r->getResourceManager().reload(*r);
-				else if (r && r->isHooked()) m_load_hook.continueLoad(*r);
+			{
+				MutexGuard lock(m_compiled_mutex);
+				// reload/continue loading resource and its subresources
+				for (const ResourceItem& ri : m_resources) {
+					if (!endsWithInsensitive(ri.path.c_str(), p.path.c_str())) continue;;
+					
+					Resource* r = getResource(ri.path);
+					if (r && r->isReady()) r->getResourceManager().reload(*r);
+					else if (r && r->isHooked()) m_load_hook.continueLoad(*r);
+				}
 			}
 
 			// compile all dependents
+			MutexGuard lock(m_to_compile_mutex);
 			auto dep_iter = m_dependencies.find(p.path);
 			if (dep_iter.isValid()) {
 				for (const Path& p : dep_iter.value()) {
-					pushToCompileQueue(p);
+					pushToCompileQueueLocked(p);
 				}
 			}
 		}
 
-		for (;;) {
-			Path path_obj;
-			{
-				MutexGuard lock(m_changed_mutex);
-				if (m_changed_files.empty()) break;
-
-				m_changed_files.removeDuplicates();
-				path_obj = m_changed_files.back();
-				m_changed_files.pop();
-			}
-
-			if (Path::hasExtension(path_obj.c_str(), "meta")) {
-				char tmp[LUMIX_MAX_PATH];
-				copyNString(Span(tmp), path_obj.c_str(), path_obj.length() - 5);
-				path_obj = tmp;
-			}
-
+		Array<Path> changed(m_app.getAllocator());
+		popChangedFiles(changed);
+		for (const Path& path_obj : changed) {
 			if (getResourceType(path_obj.c_str()) != INVALID_RESOURCE_TYPE) {
 				if (!m_app.getEngine().getFileSystem().fileExists(path_obj.c_str())) {
 					MutexGuard lock(m_resources_mutex);
@@ -716,10 +1268,11 @@ struct AssetCompilerImpl : AssetCompiler {
 				}
 			}
 			else {
+				MutexGuard lock(m_to_compile_mutex);
 				auto dep_iter = m_dependencies.find(path_obj);
 				if (dep_iter.isValid()) {
 					for (const Path& p : dep_iter.value()) {
-						pushToCompileQueue(p);
+						pushToCompileQueueLocked(p);
 					}
 				}
 			}
@@ -762,20 +1315,24 @@ struct AssetCompilerImpl : AssetCompiler {
 		return m_resources;
 	}
 
-	Semaphore m_semaphore;
+	// guards compile queue, in progress jobs, generations, dependencies and batch counters
 	Mutex m_to_compile_mutex;
 	Mutex m_compiled_mutex;
 	Mutex m_plugin_mutex;
 	Mutex m_changed_mutex;
 	HashMap<Path, u32> m_generations; 
 	HashMap<Path, Array<Path>> m_dependencies; 
-	Array<Path> m_changed_files;
+	// path -> timestamp of the last change event
+	HashMap<Path, u64> m_changed_files;
 	Array<CompileJob> m_to_compile;
+	Array<CompileJob> m_in_progress;
+	// number of queued or in progress dependencies of a path
+	HashMap<Path, u32> m_blocked;
 	Array<CompileJob> m_compiled;
 	StudioApp& m_app;
 	LoadHook m_load_hook;
 	HashMap<u32, IPlugin*, HashFuncDirect<u32>> m_plugins;
-	AssetCompilerTask m_task;
+	Array<UniquePtr<AssetCompilerTask>> m_tasks;
 	UniquePtr<FileSystemWatcher> m_watcher;
 	Mutex m_resources_mutex;
 	HashMap<u32, ResourceItem, HashFuncDirect<u32>> m_resources;
@@ -786,39 +1343,25 @@ struct AssetCompilerImpl : AssetCompiler {
 
 	u32 m_compile_batch_count = 0;
 	u32 m_batch_remaining_count = 0;
-	StaticString<LUMIX_MAX_PATH> m_res_in_progress;
+	os::Timer m_batch_timer;
+	// shared by all developers and build agents, empty if not used
+	StaticString<LUMIX_MAX_PATH> m_cache_dir;
+	// content hash of ResourceManagerHub::DICTIONARIES_PATH, part of shared cache keys
+	u64 m_dictionaries_hash = 0;
 };
 
 
 int AssetCompilerTask::task()
 {
-	while (!m_finished) {
-		m_compiler.m_semaphore.wait();
-		const AssetCompilerImpl::CompileJob p = [&]{
-			MutexGuard lock(m_compiler.m_to_compile_mutex);
-			AssetCompilerImpl::CompileJob p = m_compiler.m_to_compile.back();
-			if (p.path.isEmpty()) return p;
-
-			auto iter = m_compiler.m_generations.find(p.path);
-			const bool is_most_recent = p.generation == iter.value();
-			if (is_most_recent) {
-				m_compiler.m_res_in_progress = p.path.c_str();
-			}
-			else {
-				p.path = Path();
-				--m_compiler.m_batch_remaining_count;
-			}
-			m_compiler.m_to_compile.pop();
-			return p;
-		}();
-		if (!p.path.isEmpty()) {
-			PROFILE_BLOCK("compile asset");
-			profiler::pushString(p.path.c_str());
-			const bool compiled = m_compiler.compile(p.path);
-			if (!compiled) logError("Failed to compile resource ", p.path);
-			MutexGuard lock(m_compiler.m_compiled_mutex);
-			m_compiler.m_compiled.push(p);
-		}
+	for (;;) {
+		const AssetCompilerImpl::CompileJob p = m_compiler.popCompileJob(*this);
+		if (p.path.isEmpty()) break;
+
+		PROFILE_BLOCK("compile asset");
+		profiler::pushString(p.path.c_str());
+		const bool compiled = m_compiler.compileJob(p);
+		if (!compiled) logError("Failed to compile resource ", p.path);
+		m_compiler.onJobCompiled(p);
 	}
 	return 0;
 }
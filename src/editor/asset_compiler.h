@@ -13,8 +13,13 @@ struct StudioApp;
 struct LUMIX_EDITOR_API AssetCompiler {
 	struct LUMIX_EDITOR_API IPlugin {
 		virtual ~IPlugin() {}
+		// called from compile worker threads
 		virtual bool compile(const Path& src) = 0;
 		virtual void addSubresources(AssetCompiler& compiler, const char* path);
+		// max number of assets of this plugin compiled at the same time
+		virtual u32 getMaxConcurrency() const { return 0xffFFffFF; }
+		// change when the compiled output changes, invalidates shared cache
+		virtual u32 getVersion() const { return 0; }
 	};
 
 	struct ResourceItem {
@@ -39,8 +44,12 @@ struct LUMIX_EDITOR_API AssetCompiler {
 	virtual void unlockResources() = 0;
 	virtual void registerDependency(const Path& included_from, const Path& dependency) = 0;
 	virtual void addResource(ResourceType type, const char* path) = 0;
+	// call from the thread running IPlugin::compile, otherwise the output is not stored in the shared cache
 	virtual bool writeCompiledResource(const char* locator, Span<const u8> data) = 0;
+	virtual bool writeCompiledResource(const char* locator, const struct OutputPagedStream& data) = 0;
 	virtual bool copyCompile(const Path& src) = 0;
+	// offline build step, trains lz4 dictionaries per resource type and recompresses small compiled resources with them
+	virtual bool trainDictionaries() = 0;
 	virtual DelegateList<void(const Path&)>& listChanged() = 0;
 	virtual void onBasePathChanged() = 0;
 	virtual ResourceType getResourceType(const char* path) const = 0;
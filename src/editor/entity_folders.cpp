@@ -43,6 +43,7 @@ void EntityFolders::onEntityDestroyed(EntityRef e) {
 	entity.folder = INVALID_FOLDER;
 	entity.next = INVALID_ENTITY;
 	entity.prev = INVALID_ENTITY;
+	++m_version;
 }
 
 void EntityFolders::onEntityCreated(EntityRef e) {
@@ -55,6 +56,7 @@ EntityPtr EntityFolders::getNextEntity(EntityRef e) const {
 
 void EntityFolders::moveToFolder(EntityRef e, FolderID folder_id) {
 	ASSERT(folder_id != INVALID_FOLDER);
+	++m_version;
 	while (m_entities.size() <= e.index) {
 		m_entities.emplace();
 	}
@@ -107,6 +109,7 @@ void EntityFolders::destroyFolder(FolderID folder) {
 		p.next_folder = f.next_folder;
 	}
 	m_folders.free(folder);
+	++m_version;
 }
 
 EntityFolders::FolderID EntityFolders::emplaceFolder(FolderID folder, FolderID parent) {
@@ -128,6 +131,7 @@ EntityFolders::FolderID EntityFolders::emplaceFolder(FolderID folder, FolderID p
 		getFolder(p.child_folder).prev_folder = folder;
 	}
 	p.child_folder = folder;
+	++m_version;
 
 	return folder;
 }
@@ -187,6 +191,7 @@ void EntityFolders::deserialize(InputMemoryStream& blob, const EntityMap& entity
 	blob.read(m_folders.first_free);
 	
 	fix(m_folders.getObject(0), entity_map);
+	++m_version;
 }
 
 EntityFolders::FreeList::FreeList(IAllocator& allocator) 
@@ -37,6 +37,8 @@ struct LUMIX_EDITOR_API EntityFolders final {
 	FolderID getFolder(EntityRef e) const;
 	void selectFolder(FolderID folder) { m_selected_folder = folder; }
 	FolderID getSelectedFolder() const { return m_selected_folder; }
+	// changed when an entity or a folder is moved, created or destroyed
+	u32 getVersion() const { return m_version; }
 	void serialize(OutputMemoryStream& blob);
 	void deserialize(InputMemoryStream& blob, const struct EntityMap& entity_map);
 
@@ -62,6 +64,7 @@ private:
 	Array<Entity> m_entities;
 	FreeList m_folders;
 	FolderID m_selected_folder;
+	u32 m_version = 0;
 };
 
 } // namespace Lumix
\ No newline at end of file
@@ -124,6 +124,32 @@ static void addWatch(FileSystemWatcherTask& task, const char* path, int root_len
 }
 
 
+// files created in a new directory before its watch is added do not generate events,
+// so all files in a new or moved in directory are reported
+static void reportFiles(FileSystemWatcherTask& task, const char* path, int root_length)
+{
+    auto iter = os::createFileIterator(path, task.allocator);
+    os::FileInfo info;
+    while (os::getNextFile(iter, &info))
+    {
+		if (Lumix::equalStrings(info.filename, ".")) continue;
+		if (Lumix::equalStrings(info.filename, "..")) continue;
+
+        if (info.is_directory)
+        {
+            Lumix::StaticString<LUMIX_MAX_PATH> tmp(path, info.filename, "/");
+            reportFiles(task, tmp, root_length);
+        }
+        else
+        {
+            Lumix::StaticString<LUMIX_MAX_PATH> tmp(path, info.filename);
+            task.watcher.callback.invoke(tmp.data + root_length);
+        }
+    }
+    os::destroyFileIterator(iter);
+}
+
+
 static void getName(FileSystemWatcherTask& task, inotify_event* event, char* out, int max_size)
 {
     auto iter = task.watched.find(event->wd);
@@ -159,8 +185,16 @@ int FileSystemWatcherTask::task()
         {
             char tmp[LUMIX_MAX_PATH];
             getName(*this, event, tmp, Lumix::lengthOf(tmp));
-            if (event->mask & IN_CREATE) addWatch(*this, tmp, root_length);
-            watcher.callback.invoke(tmp);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+            {
+                const Lumix::StaticString<LUMIX_MAX_PATH> dir(path, tmp, "/");
+                addWatch(*this, dir, root_length);
+                reportFiles(*this, dir, root_length);
+            }
+            else
+            {
+                watcher.callback.invoke(tmp);
+            }
 
             event = (inotify_event*)((char*)event + sizeof(*event) + event->len);
         }
@@ -233,25 +233,20 @@ public:
 		}
 		
 		Engine& engine = m_editor.getEngine();
-		EntityMap entity_map(m_editor.getAllocator());
 		const PrefabHandle prefab = prefab_res.getPath().getHash();
 		m_roots.reserve(m_roots.size() + transforms.size());
 		
-		for (const Transform& tr : transforms) {
-			entity_map.m_map.clear();
-			if (!engine.instantiatePrefab(*m_universe, prefab_res, tr.pos, tr.rot, tr.scale, entity_map)) {
-				logError("Failed to instantiate prefab ", prefab_res.getPath());
-				return;
-			}
-
-			for (const EntityPtr& e : entity_map.m_map) {
-				setPrefab((EntityRef)e, prefab);
-			}
-
-			const EntityRef root = (EntityRef)entity_map.m_map[0];
-			m_roots.insert(root, prefab);
-			entities.push(root);
+		Array<EntityRef> all_entities(m_editor.getAllocator());
+		const i32 first_root = entities.size();
+		const bool success = engine.instantiatePrefabs(*m_universe, prefab_res, transforms, entities, all_entities);
+		
+		for (EntityRef e : all_entities) {
+			setPrefab(e, prefab);
+		}
+		for (i32 i = first_root, c = entities.size(); i < c; ++i) {
+			m_roots.insert(entities[i], prefab);
 		}
+		if (!success) logError("Failed to instantiate prefab ", prefab_res.getPath());
 	}
 
 
@@ -458,6 +453,25 @@ public:
 		return dst;
 	}
 
+	Universe& cloneToUniverse(Span<const EntityRef> roots) override {
+		Engine& engine = m_editor.getEngine();
+		Universe& dst = engine.createUniverse(false);
+		Universe& src = *m_editor.getUniverse();
+
+		HashMap<EntityPtr, EntityPtr> map(m_editor.getAllocator());
+		map.reserve(256);
+		// all entities must be mapped before any properties are cloned, so references between roots are kept
+		for (EntityRef root : roots) {
+			cloneHierarchy(src, root, dst, false, map);
+			dst.setTransform((EntityRef)map[root], src.getTransform(root));
+		}
+		Array<EntityRef> entities(m_editor.getAllocator());
+		for (EntityRef root : roots) {
+			cloneEntity(src, root, dst, INVALID_ENTITY, entities, map);
+		}
+		return dst;
+	}
+
 
 	static void destroySubtree(Universe& universe, EntityPtr entity)
 	{
@@ -29,6 +29,8 @@ struct LUMIX_EDITOR_API PrefabSystem
 	virtual void savePrefab(EntityRef entity, const struct Path& path) = 0;
 	virtual void breakPrefab(EntityRef e) = 0;
 	virtual PrefabResource* getPrefabResource(EntityRef entity) = 0;
+	// copies subtrees of `roots` to a new universe, roots keep their world transforms, caller destroys the universe
+	virtual struct Universe& cloneToUniverse(Span<const EntityRef> roots) = 0;
 };
 
 
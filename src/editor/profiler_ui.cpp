@@ -2,14 +2,17 @@
 
 #include "profiler_ui.h"
 #include "engine/allocators.h"
+#include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
 #include "engine/atomic.h"
+#include "engine/heap_profiler.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
+#include "engine/network.h"
 #include "engine/os.h"
 #include "engine/page_allocator.h"
 #include "engine/profiler.h"
@@ -170,7 +173,9 @@ struct ProfilerUIImpl final : ProfilerUI
 	ProfilerUIImpl(debug::Allocator* allocator, Engine& engine)
 		: m_main_allocator(allocator)
 		, m_threads(m_allocator)
+	, m_pass_budgets(m_allocator)
 		, m_data(m_allocator)
+		, m_sampled_tags(m_allocator)
 		, m_resource_manager(engine.getResourceManager())
 		, m_engine(engine)
 	{
@@ -180,12 +185,14 @@ struct ProfilerUIImpl final : ProfilerUI
 		m_is_open = false;
 		m_is_paused = true;
 		m_allocation_root = LUMIX_NEW(m_allocator, AllocationStackNode)(nullptr, 0, m_allocator);
+		m_sampled_root = LUMIX_NEW(m_allocator, AllocationStackNode)(nullptr, 0, m_allocator);
 		m_filter[0] = 0;
 		m_resource_filter[0] = 0;
 	}
 
 	~ProfilerUIImpl()
 	{
+		disconnect();
 		while (m_engine.getFileSystem().hasWork())
 		{
 			m_engine.getFileSystem().processCallbacks();
@@ -193,16 +200,42 @@ struct ProfilerUIImpl final : ProfilerUI
 
 		m_allocation_root->clear(m_allocator);
 		LUMIX_DELETE(m_allocator, m_allocation_root);
+		m_sampled_root->clear(m_allocator);
+		LUMIX_DELETE(m_allocator, m_sampled_root);
 	}
 
 	void onPause() {
 		ASSERT(m_is_paused);
 		m_data.clear();
-		profiler::serialize(m_data);
+		if (m_remote) {
+			if (!profiler::fetchRemote(m_remote, m_data, m_remote_frequency)) {
+				logError("Lost connection to remote profiler");
+				disconnect();
+				m_data.clear();
+				return;
+			}
+		}
+		else {
+			profiler::serialize(m_data);
+		}
 		patchStrings();
 		findEnd();
 	}
 
+	u64 getFrequency() const { return m_remote ? m_remote_frequency : profiler::frequency(); }
+
+	void connect() {
+		disconnect();
+		m_remote = os::connectTCP(m_remote_host, (u16)m_remote_port);
+		if (!m_remote) logError("Could not connect to ", m_remote_host, ":", m_remote_port);
+	}
+
+	void disconnect() {
+		if (!m_remote) return;
+		os::close(m_remote);
+		m_remote = nullptr;
+	}
+
 	void findEnd() {
 		m_end = 0;
 		forEachThread([&](ThreadContextProxy& ctx){
@@ -328,6 +361,39 @@ struct ProfilerUIImpl final : ProfilerUI
 		}	
 	}
 
+	// live data, m_data has patched strings
+	void exportChromeTrace() {
+		char path[LUMIX_MAX_PATH];
+		if (!os::getSaveFilename(Span(path), "Chrome trace\0*.json\0", "json")) return;
+
+		OutputMemoryStream data(m_allocator);
+		profiler::serialize(data);
+		OutputMemoryStream json(m_allocator);
+		if (!profiler::exportChromeTrace(Span(data.data(), (u32)data.size()), json)) {
+			logError("Failed to export profiler data");
+			return;
+		}
+
+		os::OutputFile file;
+		if (!file.open(path)) {
+			logError("Could not open ", path);
+			return;
+		}
+		if (!file.write(json.data(), json.size())) logError("Could not write ", path);
+		file.close();
+	}
+
+	void toggleCapture() {
+		if (m_is_capturing) {
+			profiler::stopCapture();
+			m_is_capturing = false;
+			return;
+		}
+		char path[LUMIX_MAX_PATH];
+		if (!os::getSaveFilename(Span(path), "Profiler capture\0*.lpc\0", "lpc")) return;
+		m_is_capturing = profiler::startCapture(path);
+	}
+
 	void onGUI() override
 	{
 		PROFILE_FUNCTION();
@@ -338,6 +404,8 @@ struct ProfilerUIImpl final : ProfilerUI
 			onGUICPUProfiler();
 			onGUIMemoryProfiler();
 			onGUIResources();
+			onGUICounters();
+			onGUIGPUPasses();
 		}
 		ImGui::End();
 	}
@@ -376,6 +444,7 @@ struct ProfilerUIImpl final : ProfilerUI
 
 		size_t m_inclusive_size;
 		bool m_open;
+		char m_name[100] = ""; // cached function name, see getName()
 		debug::StackNode* m_stack_node;
 		Array<AllocationStackNode*> m_children;
 		Array<debug::Allocator::AllocationInfo*> m_allocations;
@@ -385,9 +454,15 @@ struct ProfilerUIImpl final : ProfilerUI
 	void onGUICPUProfiler();
 	void onGUIMemoryProfiler();
 	void onGUIResources();
+	void onGUICounters();
+	void onGUIGPUPasses();
+	void exportCounters(bool per_frame);
 	void onFrame();
 	void addToTree(debug::Allocator::AllocationInfo* info);
 	void refreshAllocations();
+	void refreshSamples();
+	void onGUIHeapSampler();
+	void showFlameGraph(AllocationStackNode* node, ImDrawList* dl, const ImVec2& pos, float width, u32 depth);
 	void showAllocationTree(AllocationStackNode* node, int column) const;
 	AllocationStackNode* getOrCreate(AllocationStackNode* my_node,
 		debug::StackNode* external_node, size_t size);
@@ -396,10 +471,25 @@ struct ProfilerUIImpl final : ProfilerUI
 	debug::Allocator* m_main_allocator;
 	ResourceManagerHub& m_resource_manager;
 	AllocationStackNode* m_allocation_root;
+	// estimated live bytes of heap_profiler samples
+	struct SampledTag {
+		const char* tag;
+		u64 size;
+		u32 count;
+	};
+	AllocationStackNode* m_sampled_root;
+	Array<SampledTag> m_sampled_tags;
+	u32 m_sampled_depth = 0;
+	u32 m_samples_count = 0;
 	int m_allocation_size_from;
 	int m_allocation_size_to;
 	int m_current_frame;
 	bool m_is_paused;
+	bool m_is_capturing = false;
+	os::Socket* m_remote = nullptr;
+	u64 m_remote_frequency = 0;
+	char m_remote_host[64] = "127.0.0.1";
+	int m_remote_port = profiler::DEFAULT_SERVER_PORT;
 	u64 m_end;
 	u64 m_range = DEFAULT_RANGE;
 	char m_filter[100];
@@ -420,6 +510,8 @@ struct ProfilerUIImpl final : ProfilerUI
 	i64 hovered_link = 0;
 	profiler::GPUMemStatsBlock m_gpu_mem_stats;
 	bool m_is_gpu_mem_stats_valid = false;
+	// gpu budget in ms, key is crc32 of the pass name
+	HashMap<u32, float> m_pass_budgets;
 };
 
 
@@ -436,6 +528,131 @@ static const char* getResourceStateString(Resource::State state)
 }
 
 
+void ProfilerUIImpl::exportCounters(bool per_frame)
+{
+	char path[LUMIX_MAX_PATH];
+	if (!os::getSaveFilename(Span(path), "CSV\0*.csv\0", "csv")) return;
+
+	OutputMemoryStream csv(m_allocator);
+	profiler::countersToCSV(csv, per_frame);
+	os::OutputFile file;
+	if (!file.open(path)) {
+		logError("Could not open ", path);
+		return;
+	}
+	if (!file.write(csv.data(), csv.size())) logError("Could not write ", path);
+	file.close();
+}
+
+
+void ProfilerUIImpl::onGUICounters()
+{
+	if (!ImGui::CollapsingHeader("Counters")) return;
+
+	if (ImGui::Button("Export stats")) exportCounters(false);
+	ImGui::SameLine();
+	if (ImGui::Button("Export per frame")) exportCounters(true);
+
+	if (!ImGui::BeginTable("counters", 7)) return;
+	ImGui::TableSetupColumn("Name");
+	ImGui::TableSetupColumn("Last");
+	ImGui::TableSetupColumn("Avg");
+	ImGui::TableSetupColumn("P50");
+	ImGui::TableSetupColumn("P95");
+	ImGui::TableSetupColumn("P99");
+	ImGui::TableSetupColumn("Max");
+	ImGui::TableHeadersRow();
+	auto value = [](i64 v){
+		char tmp[32];
+		toCString(v, Span(tmp));
+		ImGui::TextUnformatted(tmp);
+	};
+	for (u32 i = 0, c = profiler::getCountersCount(); i < c; ++i) {
+		profiler::CounterStats stats;
+		if (!profiler::getCounterStats(i, stats)) continue;
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(stats.name);
+		ImGui::TableNextColumn();
+		value(stats.last);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.1f", stats.avg);
+		ImGui::TableNextColumn();
+		value(stats.p50);
+		ImGui::TableNextColumn();
+		value(stats.p95);
+		ImGui::TableNextColumn();
+		value(stats.p99);
+		ImGui::TableNextColumn();
+		value(stats.max);
+	}
+	ImGui::EndTable();
+}
+
+
+void ProfilerUIImpl::onGUIGPUPasses()
+{
+	if (!ImGui::CollapsingHeader("GPU passes")) return;
+
+	profiler::GPUPassStats passes[profiler::MAX_GPU_PASSES];
+	const u32 count = profiler::getGPUPassStats(Span(passes));
+	if (count == 0) {
+		ImGui::TextUnformatted("No data");
+		return;
+	}
+
+	if (!ImGui::BeginTable("gpu_passes", 7, ImGuiTableFlags_Resizable)) return;
+	ImGui::TableSetupColumn("Pass");
+	ImGui::TableSetupColumn("GPU ms");
+	ImGui::TableSetupColumn("CPU ms");
+	ImGui::TableSetupColumn("Draw calls");
+	ImGui::TableSetupColumn("Triangles");
+	ImGui::TableSetupColumn("State changes");
+	ImGui::TableSetupColumn("Budget ms");
+	ImGui::TableHeadersRow();
+	for (u32 i = 0; i < count; ++i) {
+		const profiler::GPUPassStats& p = passes[i];
+		const u32 key = crc32(p.name);
+		auto iter = m_pass_budgets.find(key);
+		float budget = iter.isValid() ? iter.value() : 0;
+
+		// pass was not rendered for a while, e.g. disabled shadows
+		const bool is_stale = p.age > 60;
+		const bool over_budget = budget > 0 && p.avg_gpu_ms > budget;
+		if (is_stale) ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_TextDisabled]);
+		else if (over_budget) ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(0xff, 0x40, 0x40, 0xff));
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Indent(p.depth * ImGui::GetStyle().IndentSpacing + 1);
+		ImGui::TextUnformatted(p.name);
+		ImGui::Unindent(p.depth * ImGui::GetStyle().IndentSpacing + 1);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f (%.3f)", p.avg_gpu_ms, p.gpu_ms);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f (%.3f)", p.avg_cpu_ms, p.cpu_ms);
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", p.draw_calls);
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", p.triangles);
+		ImGui::TableNextColumn();
+		ImGui::Text("%u", p.state_changes);
+		ImGui::TableNextColumn();
+		if (is_stale || over_budget) ImGui::PopStyleColor();
+
+		ImGui::PushID(i);
+		ImGui::SetNextItemWidth(-1);
+		if (ImGui::DragFloat("##budget", &budget, 0.01f, 0, 100, budget > 0 ? "%.2f" : "none")) {
+			if (iter.isValid()) iter.value() = budget;
+			else m_pass_budgets.insert(key, budget);
+		}
+		ImGui::PopID();
+	}
+	ImGui::EndTable();
+	ImGui::TextUnformatted("GPU and CPU times are averages, last frame in parentheses");
+}
+
+
 void ProfilerUIImpl::onGUIResources()
 {
 	if (!ImGui::CollapsingHeader("Resources")) return;
@@ -562,32 +779,39 @@ void ProfilerUIImpl::refreshAllocations()
 }
 
 
-void ProfilerUIImpl::showAllocationTree(AllocationStackNode* node, int column) const
+static const char* getName(ProfilerUIImpl::AllocationStackNode* node)
 {
-	if (column == FUNCTION)
+	if (node->m_name[0]) return node->m_name;
+
+	char* fn_name = node->m_name;
+	int line;
+	if (debug::StackTree::getFunction(node->m_stack_node, Span(node->m_name), line))
 	{
-		char fn_name[100];
-		int line;
-		if (debug::StackTree::getFunction(node->m_stack_node, Span(fn_name), line))
+		if (line >= 0)
 		{
-			if (line >= 0)
+			int len = stringLength(fn_name);
+			if (len + 2 < sizeof(node->m_name))
 			{
-				int len = stringLength(fn_name);
-				if (len + 2 < sizeof(fn_name))
-				{
-					fn_name[len] = ' ';
-					fn_name[len + 1] = '\0';
-					++len;
-					toCString(line, Span(fn_name).fromLeft(len));
-				}
+				fn_name[len] = ' ';
+				fn_name[len + 1] = '\0';
+				++len;
+				toCString(line, Span(node->m_name).fromLeft(len));
 			}
 		}
-		else
-		{
-			copyString(fn_name, "N/A");
-		}
+	}
+	else
+	{
+		copyString(node->m_name, "N/A");
+	}
+	return fn_name;
+}
 
-		if (ImGui::TreeNode(node, "%s", fn_name))
+
+void ProfilerUIImpl::showAllocationTree(AllocationStackNode* node, int column) const
+{
+	if (column == FUNCTION)
+	{
+		if (ImGui::TreeNode(node, "%s", getName(node)))
 		{
 			node->m_open = true;
 			for (auto* child : node->m_children)
@@ -619,6 +843,132 @@ void ProfilerUIImpl::showAllocationTree(AllocationStackNode* node, int column) c
 }
 
 
+void ProfilerUIImpl::refreshSamples()
+{
+	m_sampled_root->clear(m_allocator);
+	m_sampled_root->m_inclusive_size = 0;
+	m_sampled_tags.clear();
+	m_sampled_depth = 0;
+
+	Array<heap_profiler::Sample> samples(m_allocator);
+	heap_profiler::getSamples(samples);
+	m_samples_count = samples.size();
+
+	for (const heap_profiler::Sample& sample : samples) {
+		debug::StackNode* nodes[1024];
+		const int count = debug::StackTree::getPath(sample.stack, Span(nodes));
+		m_sampled_depth = maximum(m_sampled_depth, (u32)count);
+		m_sampled_root->m_inclusive_size += sample.estimated_size;
+		AllocationStackNode* node = m_sampled_root;
+		for (int i = count - 1; i >= 0; --i) {
+			node = getOrCreate(node, nodes[i], sample.estimated_size);
+		}
+
+		const char* tag = sample.tag ? sample.tag : "untagged";
+		SampledTag* tag_stats = nullptr;
+		for (SampledTag& t : m_sampled_tags) {
+			if (t.tag == tag) tag_stats = &t;
+		}
+		if (!tag_stats) {
+			tag_stats = &m_sampled_tags.emplace();
+			tag_stats->tag = tag;
+			tag_stats->size = 0;
+			tag_stats->count = 0;
+		}
+		tag_stats->size += sample.estimated_size;
+		++tag_stats->count;
+	}
+
+	qsort(m_sampled_tags.begin(), m_sampled_tags.size(), sizeof(m_sampled_tags[0]), [](const void* a, const void* b) -> int {
+		const u64 sa = ((const SampledTag*)a)->size;
+		const u64 sb = ((const SampledTag*)b)->size;
+		return sa > sb ? -1 : (sa < sb ? 1 : 0);
+	});
+}
+
+
+// icicle graph, callers at the top, width of each frame is proportional to estimated live bytes allocated under it
+void ProfilerUIImpl::showFlameGraph(AllocationStackNode* node, ImDrawList* dl, const ImVec2& pos, float width, u32 depth)
+{
+	const float row_height = ImGui::GetTextLineHeightWithSpacing();
+	float x = pos.x;
+	for (AllocationStackNode* child : node->m_children) {
+		const float w = width * child->m_inclusive_size / float(node->m_inclusive_size);
+		if (w < 1) {
+			x += w;
+			continue;
+		}
+		const ImVec2 a(x, pos.y + depth * row_height);
+		const ImVec2 b(x + w - 1, a.y + row_height - 1);
+		const u32 hash = crc32(&child->m_stack_node, sizeof(child->m_stack_node));
+		const ImU32 color = IM_COL32(0xc0 + (hash & 0x3f), 0x60 + ((hash >> 8) & 0x7f), 0x20 + ((hash >> 16) & 0x3f), 0xff);
+		dl->AddRectFilled(a, b, color);
+		if (w > 40) {
+			dl->PushClipRect(a, b, true);
+			dl->AddText(ImVec2(a.x + 2, a.y), IM_COL32(0, 0, 0, 0xff), getName(child));
+			dl->PopClipRect();
+		}
+		if (ImGui::IsMouseHoveringRect(a, b)) {
+			char size[50];
+			toCStringPretty(child->m_inclusive_size, Span(size));
+			ImGui::SetTooltip("%s\n%s B (%.1f%%)", getName(child), size, 100.f * child->m_inclusive_size / float(m_sampled_root->m_inclusive_size));
+		}
+		ImVec2 child_pos = pos;
+		child_pos.x = x;
+		showFlameGraph(child, dl, child_pos, w, depth + 1);
+		x += w;
+	}
+}
+
+
+void ProfilerUIImpl::onGUIHeapSampler()
+{
+	if (!ImGui::TreeNode("Sampling heap profiler")) return;
+
+	bool enabled = heap_profiler::isEnabled();
+	if (ImGui::Checkbox("Enabled", &enabled)) heap_profiler::enable(enabled);
+	ImGui::SameLine();
+	int interval_kb = heap_profiler::getSampleInterval() / 1024;
+	ImGui::SetNextItemWidth(100);
+	if (ImGui::InputInt("Sample interval (KB)", &interval_kb)) {
+		heap_profiler::setSampleInterval(maximum(interval_kb, 1) * 1024);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Refresh##heap_samples")) refreshSamples();
+
+	ImGui::Text("Estimated live: %.3fMB, %d samples", m_sampled_root->m_inclusive_size / (1024.f * 1024.f), m_samples_count);
+	if (!m_sampled_tags.empty() && ImGui::BeginTable("sampled_tags", 3)) {
+		ImGui::TableSetupColumn("Tag");
+		ImGui::TableSetupColumn("Estimated live (MB)");
+		ImGui::TableSetupColumn("Samples");
+		ImGui::TableHeadersRow();
+		for (const SampledTag& tag : m_sampled_tags) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(tag.tag);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", tag.size / (1024.f * 1024.f));
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", tag.count);
+		}
+		ImGui::EndTable();
+	}
+
+	if (m_sampled_root->m_inclusive_size > 0) {
+		const float height = m_sampled_depth * ImGui::GetTextLineHeightWithSpacing();
+		if (ImGui::BeginChild("flame", ImVec2(0, minimum(height + 2, 400.f)), false, ImGuiWindowFlags_HorizontalScrollbar)) {
+			const ImVec2 pos = ImGui::GetCursorScreenPos();
+			const float width = ImGui::GetContentRegionAvail().x;
+			showFlameGraph(m_sampled_root, ImGui::GetWindowDrawList(), pos, width, 0);
+			ImGui::Dummy(ImVec2(width, height));
+		}
+		ImGui::EndChild();
+	}
+
+	ImGui::TreePop();
+}
+
+
 void ProfilerUIImpl::onGUIMemoryProfiler()
 {
 	if (!ImGui::CollapsingHeader("Memory")) return;
@@ -643,6 +993,30 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 	const float reserved_pages_size = (page_allocator.getReservedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
 	ImGui::Text("Page allocator: %.3fMB", reserved_pages_size);
 
+	if (TagAllocator::getFirst() && ImGui::BeginTable("tags", 4)) {
+		ImGui::TableSetupColumn("Tag");
+		ImGui::TableSetupColumn("Live (MB)");
+		ImGui::TableSetupColumn("Peak (MB)");
+		ImGui::TableSetupColumn("Budget (MB)");
+		ImGui::TableHeadersRow();
+		for (const TagAllocator* tag = TagAllocator::getFirst(); tag; tag = tag->getNext()) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(tag->getTagName());
+			ImGui::TableNextColumn();
+			const bool over_budget = tag->getBudget() != 0 && tag->getLiveBytes() > tag->getBudget();
+			if (over_budget) ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(0xff, 0, 0, 0xff));
+			ImGui::Text("%.3f", tag->getLiveBytes() / (1024.f * 1024.f));
+			if (over_budget) ImGui::PopStyleColor();
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", tag->getPeakBytes() / (1024.f * 1024.f));
+			ImGui::TableNextColumn();
+			if (tag->getBudget() != 0) ImGui::Text("%.3f", tag->getBudget() / (1024.f * 1024.f));
+			else ImGui::TextUnformatted("-");
+		}
+		ImGui::EndTable();
+	}
+
 	if (m_is_gpu_mem_stats_valid) {
 		const float current = m_gpu_mem_stats.current / (1024.f * 1024.f);
 		const float total = m_gpu_mem_stats.total / (1024.f * 1024.f);
@@ -650,6 +1024,8 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 		ImGui::Text("GPU: %.02fMB/%.02f (%.02fMB dedicated)", current, total, dedicated);
 	}
 
+	onGUIHeapSampler();
+
 	ImGui::Columns(2, "memc");
 	for (auto* child : m_allocation_root->m_children)
 	{
@@ -715,6 +1091,21 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	if (ImGui::BeginMenu("Advanced")) {
 		if (ImGui::MenuItem("Load")) load();
 		if (ImGui::MenuItem("Save")) save();
+		if (ImGui::MenuItem("Export chrome trace")) exportChromeTrace();
+		if (ImGui::MenuItem(m_is_capturing ? "Stop capture" : "Start capture")) toggleCapture();
+		if (ImGui::BeginMenu("Remote")) {
+			// pausing fetches data from the remote process instead of this one
+			if (m_remote) {
+				ImGui::Text("Connected to %s:%d", m_remote_host, m_remote_port);
+				if (ImGui::MenuItem("Disconnect")) disconnect();
+			}
+			else {
+				ImGui::InputText("Host", m_remote_host, sizeof(m_remote_host));
+				ImGui::InputInt("Port", &m_remote_port);
+				if (ImGui::MenuItem("Connect")) connect();
+			}
+			ImGui::EndMenu();
+		}
 		ImGui::Checkbox("Show frames", &m_show_frames);
 		ImGui::Text("Zoom: %f", m_range / double(DEFAULT_RANGE));
 		if (ImGui::MenuItem("Reset zoom")) m_range = DEFAULT_RANGE;
@@ -826,7 +1217,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 				dl->AddText(ImVec2(x_start + 2, block_y), 0xff000000, name);
 			}
 			if (ImGui::IsMouseHoveringRect(ra, rb)) {
-				const u64 freq = profiler::frequency();
+				const u64 freq = getFrequency();
 				const float t = 1000 * float((to - from) / double(freq));
 				ImGui::BeginTooltip();
 				ImGui::Text("%s (%.3f ms)", name, t);
@@ -1088,7 +1479,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 							dl->AddText(ImVec2(x_start + 2, block_y), 0xff000000, data.name);
 						}
 						if (ImGui::IsMouseHoveringRect(ra, rb)) {
-							const u64 freq = profiler::frequency();
+							const u64 freq = getFrequency();
 							const float t = 1000 * float((to - from) / double(freq));
 							ImGui::BeginTooltip();
 							ImGui::Text("%s (%.3f ms)", data.name, t);
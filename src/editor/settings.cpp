@@ -401,6 +401,9 @@ bool Settings::load()
 	m_mouse_sensitivity.y = getFloat(L, "mouse_sensitivity_y", 200.f);
 	m_app.setFOV(degreesToRadians(getFloat(L, "fov", 60)));
 	m_font_size = getInteger(L, "font_size", 13);
+	m_undo_memory_limit_mb = getInteger(L, "undo_memory_limit_mb", 512);
+	m_render_on_demand = getBoolean(L, "render_on_demand", true);
+	m_unfocused_view_fps = getInteger(L, "unfocused_view_fps", 10);
 
 	auto& actions = m_app.getActions();
 	lua_getglobal(L, "actions");
@@ -582,6 +585,9 @@ bool Settings::save()
 	file << "mouse_sensitivity_x = " << m_mouse_sensitivity.x << "\n";
 	file << "mouse_sensitivity_y = " << m_mouse_sensitivity.y << "\n";
 	file << "font_size = " << m_font_size << "\n";
+	file << "undo_memory_limit_mb = " << m_undo_memory_limit_mb << "\n";
+	writeBool("render_on_demand", m_render_on_demand);
+	file << "unfocused_view_fps = " << m_unfocused_view_fps << "\n";
 
 	saveStyle(file);
 
@@ -1084,6 +1090,9 @@ void Settings::onGUI()
 					m_app.setFOV(fov);
 				}
 				ImGui::DragFloat("Gizmo scale", &m_app.getGizmoConfig().scale, 0.1f);
+				ImGui::DragInt("Undo memory limit (MB)", &m_undo_memory_limit_mb, 1, 16, 64 * 1024);
+				ImGui::Checkbox("Render views only when changed", &m_render_on_demand);
+				ImGui::DragInt("Unfocused views FPS limit (0 - no limit)", &m_unfocused_view_fps, 1, 0, 240);
 				ImGui::EndTabItem();
 			}
 
@@ -43,6 +43,11 @@ struct LUMIX_EDITOR_API Settings {
 	Vec2 m_mouse_sensitivity;
 	float m_mouse_sensitivity_y;
 	int m_font_size = 13;
+	int m_undo_memory_limit_mb = 512;
+	// editor views render only when their content can change, see RenderThrottle
+	bool m_render_on_demand = true;
+	// 0 - unlimited
+	int m_unfocused_view_fps = 10;
 	String m_imgui_state;
 
 	explicit Settings(struct StudioApp& app);
@@ -25,10 +25,12 @@
 #include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/lz4.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
+#include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/universe.h"
 #include "log_ui.h"
@@ -190,6 +192,8 @@ struct StudioAppImpl final : StudioApp
 		, m_events(m_allocator)
 		, m_windows(m_allocator)
 		, m_deferred_destroy_windows(m_allocator)
+		, m_hierarchy_rows(m_allocator)
+		, m_filtered_entities(m_allocator)
 	{
 		u32 cpus_count = minimum(os::getCPUsCount(), 64);
 		u32 workers;
@@ -394,6 +398,9 @@ struct StudioAppImpl final : StudioApp
 
 		m_asset_compiler = AssetCompiler::create(*this);
 		m_editor = WorldEditor::create(*m_engine, m_allocator);
+		m_editor->universeCreated().bind<&StudioAppImpl::onHierarchyUniverseCreated>(this);
+		m_editor->universeDestroyed().bind<&StudioAppImpl::onHierarchyUniverseDestroyed>(this);
+		if (m_editor->getUniverse()) onHierarchyUniverseCreated();
 		scanUniverses();
 		loadUserPlugins();
 		addActions();
@@ -484,6 +491,9 @@ struct StudioAppImpl final : StudioApp
 		m_log_ui.destroy();
 		ASSERT(!m_render_interface);
 		m_asset_compiler.reset();
+		if (m_editor->getUniverse()) onHierarchyUniverseDestroyed();
+		m_editor->universeCreated().unbind<&StudioAppImpl::onHierarchyUniverseCreated>(this);
+		m_editor->universeDestroyed().unbind<&StudioAppImpl::onHierarchyUniverseDestroyed>(this);
 		m_editor.reset();
 
 		for (Action* action : m_owned_actions) {
@@ -887,6 +897,7 @@ struct StudioAppImpl final : StudioApp
 		if (m_reset_pivot_action.isActive()) m_editor->getView().resetPivot();
 
 		m_editor->getView().setMouseSensitivity(m_settings.m_mouse_sensitivity.x, m_settings.m_mouse_sensitivity.y);
+		m_editor->setUndoMemoryLimit(u64(maximum(m_settings.m_undo_memory_limit_mb, 1)) * 1024 * 1024);
 		m_editor->update();
 		showGizmos();
 		
@@ -1673,15 +1684,99 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
-	void showHierarchy(EntityRef entity, const Array<EntityRef>& selected_entities)
+	// hierarchy is flattened into rows and only visible rows are drawn, so it does not iterate all entities every frame
+	// rows are rebuilt when entities are created/destroyed, reparented, moved to another folder or a node is (un)folded
+	struct HierarchyRow {
+		EntityPtr entity; // invalid for folder rows
+		EntityFolders::FolderID folder;
+		u32 depth;
+		bool open;
+	};
+
+	static ImGuiID getEntityNodeID(EntityRef e) { return ImGui::GetID((void*)(intptr_t)e.index); }
+	static ImGuiID getFolderNodeID(EntityFolders::FolderID folder) { return ImGui::GetID((void*)(intptr_t)(-1 - (i32)folder)); }
+
+	void onHierarchyEntityChanged(EntityRef) { m_hierarchy_dirty = true; }
+
+	void onHierarchyUniverseCreated() {
+		Universe* universe = m_editor->getUniverse();
+		universe->entityCreated().bind<&StudioAppImpl::onHierarchyEntityChanged>(this);
+		universe->entityDestroyed().bind<&StudioAppImpl::onHierarchyEntityChanged>(this);
+		m_hierarchy_dirty = true;
+	}
+
+	void onHierarchyUniverseDestroyed() {
+		Universe* universe = m_editor->getUniverse();
+		universe->entityCreated().unbind<&StudioAppImpl::onHierarchyEntityChanged>(this);
+		universe->entityDestroyed().unbind<&StudioAppImpl::onHierarchyEntityChanged>(this);
+		m_hierarchy_rows.clear();
+		m_filtered_entities.clear();
+		m_hierarchy_dirty = true;
+	}
+
+	void gatherHierarchyRows(Universe& universe, EntityRef e, u32 depth) {
+		const bool has_child = universe.getFirstChild(e).isValid();
+		const bool open = has_child && ImGui::TreeNodeBehaviorIsOpen(getEntityNodeID(e), ImGuiTreeNodeFlags_OpenOnArrow);
+		m_hierarchy_rows.push({e, EntityFolders::INVALID_FOLDER, depth, open});
+		if (!open) return;
+
+		for (EntityPtr child = universe.getFirstChild(e); child.isValid(); child = universe.getNextSibling((EntityRef)child)) {
+			gatherHierarchyRows(universe, (EntityRef)child, depth + 1);
+		}
+	}
+
+	void gatherHierarchyRows(Universe& universe, EntityFolders& folders, EntityFolders::FolderID folder_id, u32 depth) {
+		const ImGuiTreeNodeFlags flags = depth == 0 ? ImGuiTreeNodeFlags_DefaultOpen : 0;
+		const bool open = ImGui::TreeNodeBehaviorIsOpen(getFolderNodeID(folder_id), flags | ImGuiTreeNodeFlags_OpenOnArrow);
+		m_hierarchy_rows.push({INVALID_ENTITY, folder_id, depth, open});
+		if (!open) return;
+
+		const EntityFolders::Folder& folder = folders.getFolder(folder_id);
+		for (EntityFolders::FolderID child = folder.child_folder; child != EntityFolders::INVALID_FOLDER; child = folders.getFolder(child).next_folder) {
+			gatherHierarchyRows(universe, folders, child, depth + 1);
+		}
+		for (EntityPtr e = folder.first_entity; e.isValid(); e = folders.getNextEntity((EntityRef)e)) {
+			if (!universe.getParent((EntityRef)e).isValid()) gatherHierarchyRows(universe, (EntityRef)e, depth + 1);
+		}
+	}
+
+	// must be called in the same ID scope as the rows are drawn, open state of nodes is read from imgui's storage
+	void updateHierarchyRows(Universe& universe, EntityFolders& folders, const char* filter) {
+		if (universe.getHierarchyVersion() != m_hierarchy_version) m_hierarchy_dirty = true;
+		if (folders.getVersion() != m_hierarchy_folders_version) m_hierarchy_dirty = true;
+		if (m_hierarchy_filter != filter) m_hierarchy_dirty = true;
+		if (!m_hierarchy_dirty) return;
+
+		PROFILE_FUNCTION();
+		m_hierarchy_dirty = false;
+		m_hierarchy_version = universe.getHierarchyVersion();
+		m_hierarchy_folders_version = folders.getVersion();
+		m_hierarchy_filter = filter;
+		m_hierarchy_rows.clear();
+		m_filtered_entities.clear();
+
+		if (filter[0] == '\0') {
+			gatherHierarchyRows(universe, folders, folders.getRoot(), 0);
+			return;
+		}
+
+		for (EntityPtr e = universe.getFirstEntity(); e.isValid(); e = universe.getNextEntity((EntityRef)e)) {
+			char buffer[1024];
+			getEntityListDisplayName(*this, universe, Span(buffer), e);
+			if (stristr(buffer, filter) != nullptr) m_filtered_entities.push((EntityRef)e);
+		}
+	}
+
+	// returns true if the node is open
+	bool entityRowUI(EntityRef entity, const Array<EntityRef>& selected_entities)
 	{
 		Universe* universe = m_editor->getUniverse();
 		bool selected = selected_entities.indexOf(entity) >= 0;
-		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
+		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap | ImGuiTreeNodeFlags_NoTreePushOnOpen;
 		bool has_child = universe->getFirstChild(entity).isValid();
-		if (!has_child) flags = ImGuiTreeNodeFlags_Leaf;
+		if (!has_child) flags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
 		if (selected) flags |= ImGuiTreeNodeFlags_Selected;
-		
+
 		bool node_open;
 		if (m_renaming_entity == entity) {
 			node_open = ImGui::TreeNodeEx((void*)(intptr_t)entity.index, flags, "%s", "");
@@ -1706,102 +1801,60 @@ struct StudioAppImpl final : StudioApp
 			ImGui::PopStyleColor();
 		}
 		else {
-			const ImVec2 cp = ImGui::GetCursorPos();
-			ImGui::Dummy(ImVec2(1.f, ImGui::GetTextLineHeightWithSpacing()));
-			if (ImGui::IsItemVisible()) {
-				ImGui::SetCursorPos(cp);
-				char buffer[1024];
-				getEntityListDisplayName(*this, *universe, Span(buffer), entity);
-				node_open = ImGui::TreeNodeEx((void*)(intptr_t)entity.index, flags, "%s", buffer);
-			}
-			else {
-				const char* dummy = "";
-				const ImGuiID id = ImGui::GetCurrentWindow()->GetID((void*)(intptr_t)entity.index);
-				if (ImGui::TreeNodeBehaviorIsOpen(id, flags)) {
-					ImGui::SetCursorPos(cp);
-					node_open = ImGui::TreeNodeBehavior(id, flags, dummy, dummy);
-				}
-				else {
-					node_open = false;
-				}
-			}
+			char buffer[1024];
+			getEntityListDisplayName(*this, *universe, Span(buffer), entity);
+			node_open = ImGui::TreeNodeEx((void*)(intptr_t)entity.index, flags, "%s", buffer);
 		}
-		
-		if (ImGui::IsItemVisible()) {
-			ImGui::PushID(entity.index);
-			if (ImGui::IsMouseReleased(1) && ImGui::IsItemHovered()) ImGui::OpenPopup("entity_context_menu");
-			if (ImGui::BeginPopup("entity_context_menu"))
+
+		ImGui::PushID(entity.index);
+		if (ImGui::IsMouseReleased(1) && ImGui::IsItemHovered()) ImGui::OpenPopup("entity_context_menu");
+		if (ImGui::BeginPopup("entity_context_menu"))
+		{
+			if (ImGui::MenuItem("Create child"))
 			{
-				if (ImGui::MenuItem("Create child"))
-				{
-					m_editor->beginCommandGroup("create_child_entity");
-					EntityRef child = m_editor->addEntity();
-					m_editor->makeParent(entity, child);
-					const DVec3 pos = m_editor->getUniverse()->getPosition(entity);
-					m_editor->setEntitiesPositions(&child, &pos, 1);
-					m_editor->endCommandGroup();
-				}
-				if (ImGui::MenuItem("Select all children"))
-				{
-					Array<EntityRef> tmp(m_allocator);
-					Universe* universe = m_editor->getUniverse();
-					for (EntityPtr e = universe->getFirstChild(entity); e.isValid(); e = universe->getNextSibling(*e)) {
-						tmp.push(*e);
-					}
-					m_editor->selectEntities(tmp, false);
-				}
-				ImGui::EndPopup();
+				m_editor->beginCommandGroup("create_child_entity");
+				EntityRef child = m_editor->addEntity();
+				m_editor->makeParent(entity, child);
+				const DVec3 pos = m_editor->getUniverse()->getPosition(entity);
+				m_editor->setEntitiesPositions(&child, &pos, 1);
+				m_editor->endCommandGroup();
 			}
-			ImGui::PopID();
-			if (ImGui::BeginDragDropSource())
+			if (ImGui::MenuItem("Select all children"))
 			{
-				char buffer[1024];
-				getEntityListDisplayName(*this, *universe, Span(buffer), entity);
-				ImGui::Text("%s", buffer);
-				ImGui::SetDragDropPayload("entity", &entity, sizeof(entity));
-				ImGui::EndDragDropSource();
-			}
-			else {
-				if (ImGui::IsItemHovered() && ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
-					m_editor->selectEntities(Span(&entity, 1), ImGui::GetIO().KeyCtrl);
+				Array<EntityRef> tmp(m_allocator);
+				Universe* universe = m_editor->getUniverse();
+				for (EntityPtr e = universe->getFirstChild(entity); e.isValid(); e = universe->getNextSibling(*e)) {
+					tmp.push(*e);
 				}
+				m_editor->selectEntities(tmp, false);
 			}
-			if (ImGui::BeginDragDropTarget())
-			{
-				if (auto* payload = ImGui::AcceptDragDropPayload("entity"))
-				{
-					EntityRef dropped_entity = *(EntityRef*)payload->Data;
-					if (dropped_entity != entity)
-					{
-						m_editor->makeParent(entity, dropped_entity);
-						ImGui::EndDragDropTarget();
-						if (node_open) ImGui::TreePop();
-						return;
-					}
-				}
-
-				ImGui::EndDragDropTarget();
+			ImGui::EndPopup();
+		}
+		ImGui::PopID();
+		if (ImGui::BeginDragDropSource())
+		{
+			char buffer[1024];
+			getEntityListDisplayName(*this, *universe, Span(buffer), entity);
+			ImGui::Text("%s", buffer);
+			ImGui::SetDragDropPayload("entity", &entity, sizeof(entity));
+			ImGui::EndDragDropSource();
+		}
+		else {
+			if (ImGui::IsItemHovered() && ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
+				m_editor->selectEntities(Span(&entity, 1), ImGui::GetIO().KeyCtrl);
 			}
 		}
-
-		if (node_open)
+		if (ImGui::BeginDragDropTarget())
 		{
-			for (EntityPtr e_ptr = universe->getFirstChild(entity); e_ptr.isValid();
-				 e_ptr = universe->getNextSibling((EntityRef)e_ptr))
+			if (auto* payload = ImGui::AcceptDragDropPayload("entity"))
 			{
-				showHierarchy((EntityRef)e_ptr, selected_entities);
-			}
-			if (ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows) && m_is_f2_pressed) {
-				m_renaming_entity = selected_entities.empty() ? INVALID_ENTITY : selected_entities[0];
-				if (m_renaming_entity.isValid()) {
-					m_set_rename_focus = true;
-					const char* name = m_editor->getUniverse()->getEntityName(selected_entities[0]);
-					copyString(m_rename_buf, name);
-				}
+				EntityRef dropped_entity = *(EntityRef*)payload->Data;
+				if (dropped_entity != entity) m_editor->makeParent(entity, dropped_entity);
 			}
 
-			ImGui::TreePop();
+			ImGui::EndDragDropTarget();
 		}
+		return has_child && node_open;
 	}
 
 
@@ -1824,15 +1877,16 @@ struct StudioAppImpl final : StudioApp
 		ImGui::End();
 	}
 
-	void folderUI(EntityFolders::FolderID folder_id, EntityFolders& folders, u32 level) {
+	// returns true if the node is open
+	bool folderRowUI(EntityFolders::FolderID folder_id, EntityFolders& folders, u32 level) {
 		const EntityFolders::Folder& folder = folders.getFolder(folder_id);
-		ImGui::PushID(&folder);
+		const void* node_id = (void*)(intptr_t)(-1 - (i32)folder_id);
 		bool node_open;
 		ImGuiTreeNodeFlags flags = level == 0 ? ImGuiTreeNodeFlags_DefaultOpen : 0;
-		flags |= ImGuiTreeNodeFlags_OpenOnArrow;
+		flags |= ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_NoTreePushOnOpen;
 		if (folders.getSelectedFolder() == folder_id) flags |= ImGuiTreeNodeFlags_Selected;
 		if (m_renaming_folder == folder_id) {
-			node_open = ImGui::TreeNodeEx((void*)&folder, flags, "%s", ICON_FA_FOLDER);
+			node_open = ImGui::TreeNodeEx(node_id, flags, "%s", ICON_FA_FOLDER);
 			ImGui::SameLine();
 			ImGui::SetNextItemWidth(-1);
 			ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, {0, 0});
@@ -1853,9 +1907,9 @@ struct StudioAppImpl final : StudioApp
 			ImGui::PopStyleColor();
 		}
 		else {
-			node_open = ImGui::TreeNodeEx((void*)&folder, flags, "%s%s", ICON_FA_FOLDER, folder.name);
+			node_open = ImGui::TreeNodeEx(node_id, flags, "%s%s", ICON_FA_FOLDER, folder.name);
 		}
-		
+
 		if (ImGui::BeginDragDropTarget()) {
 			if (auto* payload = ImGui::AcceptDragDropPayload("entity")) {
 				EntityRef dropped_entity = *(EntityRef*)payload->Data;
@@ -1871,6 +1925,7 @@ struct StudioAppImpl final : StudioApp
 			folders.selectFolder(folder_id);
 		}
 
+		ImGui::PushID(node_id);
 		if (ImGui::IsMouseReleased(1) && ImGui::IsItemHovered()) {
 			ImGui::OpenPopup("folder_context_menu");
 		}
@@ -1901,29 +1956,28 @@ struct StudioAppImpl final : StudioApp
 			}
 			ImGui::EndPopup();
 		}
+		ImGui::PopID();
 
-		if (!node_open) {
-			ImGui::PopID();
-			return;
-		}
-
-		u16 child_id = folder.child_folder;
-		while (child_id != EntityFolders::INVALID_FOLDER) {
-			const EntityFolders::Folder& child = folders.getFolder(child_id);
-			folderUI(child_id, folders, level + 1);
-			child_id = child.next_folder;
-		}
+		return node_open;
+	}
 
-		EntityPtr child_e = folder.first_entity;
-		while (child_e.isValid()) {
-			if (!m_editor->getUniverse()->getParent((EntityRef)child_e).isValid()) {
-				showHierarchy((EntityRef)child_e, m_editor->getSelectedEntities());
-			}
-			child_e = folders.getNextEntity((EntityRef)child_e);
+	void hierarchyRowUI(const HierarchyRow& row, Universe& universe, EntityFolders& folders) {
+		// rows can be invalidated by a previous row in the same frame, e.g. by deleting a folder
+		const bool valid = row.entity.isValid()
+			? universe.hasEntity((EntityRef)row.entity)
+			: folders.getVersion() == m_hierarchy_folders_version;
+		if (!valid) {
+			ImGui::Dummy(ImVec2(1.f, ImGui::GetTextLineHeightWithSpacing()));
+			return;
 		}
 
-		ImGui::TreePop();
-		ImGui::PopID();
+		const float indent = row.depth * ImGui::GetStyle().IndentSpacing;
+		if (indent > 0) ImGui::Indent(indent);
+		const bool open = row.entity.isValid()
+			? entityRowUI((EntityRef)row.entity, m_editor->getSelectedEntities())
+			: folderRowUI(row.folder, folders, row.depth);
+		if (indent > 0) ImGui::Unindent(indent);
+		if (open != row.open) m_hierarchy_dirty = true;
 	}
 
 	void onEntityListGUI()
@@ -1945,27 +1999,50 @@ struct StudioAppImpl final : StudioApp
 
 			if (ImGui::BeginChild("entities")) {
 				ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x - ImGui::GetStyle().FramePadding.x);
-				
+
+				EntityFolders& folders = m_editor->getEntityFolders();
+				updateHierarchyRows(*universe, folders, filter);
 				if (filter[0] == '\0') {
-					EntityFolders& folders = m_editor->getEntityFolders();
-					folderUI(folders.getRoot(), folders, 0);
-				} else {
-					for (EntityPtr e = universe->getFirstEntity(); e.isValid(); e = universe->getNextEntity((EntityRef)e)) {
-						char buffer[1024];
-						getEntityListDisplayName(*this, *universe, Span(buffer), e);
-						if (stristr(buffer, filter) == nullptr) continue;
-						ImGui::PushID(e.index);
-						const EntityRef e_ref = (EntityRef)e;
-						bool selected = entities.indexOf(e_ref) >= 0;
-						if (ImGui::Selectable(buffer, &selected)) {
-							m_editor->selectEntities(Span(&e_ref, 1), ImGui::GetIO().KeyCtrl);
+					ImGuiListClipper clipper;
+					clipper.Begin(m_hierarchy_rows.size(), ImGui::GetTextLineHeightWithSpacing());
+					while (clipper.Step()) {
+						for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+							hierarchyRowUI(m_hierarchy_rows[i], *universe, folders);
 						}
-						if (ImGui::BeginDragDropSource()) {
-							ImGui::Text("%s", buffer);
-							ImGui::SetDragDropPayload("entity", &e, sizeof(e));
-							ImGui::EndDragDropSource();
+					}
+				} else {
+					ImGuiListClipper clipper;
+					clipper.Begin(m_filtered_entities.size(), ImGui::GetTextLineHeightWithSpacing());
+					while (clipper.Step()) {
+						for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+							const EntityRef e = m_filtered_entities[i];
+							if (!universe->hasEntity(e)) {
+								ImGui::Dummy(ImVec2(1.f, ImGui::GetTextLineHeightWithSpacing()));
+								continue;
+							}
+							char buffer[1024];
+							getEntityListDisplayName(*this, *universe, Span(buffer), e);
+							ImGui::PushID(e.index);
+							bool selected = entities.indexOf(e) >= 0;
+							if (ImGui::Selectable(buffer, &selected)) {
+								m_editor->selectEntities(Span(&e, 1), ImGui::GetIO().KeyCtrl);
+							}
+							if (ImGui::BeginDragDropSource()) {
+								ImGui::Text("%s", buffer);
+								ImGui::SetDragDropPayload("entity", &e, sizeof(e));
+								ImGui::EndDragDropSource();
+							}
+							ImGui::PopID();
 						}
-						ImGui::PopID();
+					}
+				}
+
+				if (ImGui::IsWindowFocused(ImGuiFocusedFlags_ChildWindows) && m_is_f2_pressed) {
+					m_renaming_entity = entities.empty() ? INVALID_ENTITY : entities[0];
+					if (m_renaming_entity.isValid()) {
+						m_set_rename_focus = true;
+						const char* name = universe->getEntityName(entities[0]);
+						copyString(m_rename_buf, name);
 					}
 				}
 				ImGui::PopItemWidth();
@@ -2955,6 +3032,9 @@ struct StudioAppImpl final : StudioApp
 	void saveUniverse() { save(); }
 
 
+	void saveWorldPartition(const char* basename, float cell_size) { m_editor->saveWorldPartition(basename, cell_size); }
+
+
 	void createLua()
 	{
 		lua_State* L = m_engine->getState();
@@ -2976,6 +3056,7 @@ struct StudioAppImpl final : StudioApp
 		REGISTER_FUNCTION(newUniverse);
 		REGISTER_FUNCTION(saveUniverse);
 		REGISTER_FUNCTION(saveUniverseAs);
+		REGISTER_FUNCTION(saveWorldPartition);
 		REGISTER_FUNCTION(exitWithCode);
 		REGISTER_FUNCTION(exitGameMode);
 
@@ -3024,27 +3105,26 @@ struct StudioAppImpl final : StudioApp
 	}
 
 	struct ExportFileInfo {
-		u32 hash;
+		u64 hash; // StableHash of path
 		u64 offset;
 		u64 size;
 
 		char path[LUMIX_MAX_PATH];
 	};
 
-	void scanCompiled(AssociativeArray<u32, ExportFileInfo>& infos) {
+	void scanCompiled(AssociativeArray<u64, ExportFileInfo>& infos) {
 		os::FileIterator* iter = m_engine->getFileSystem().createFileIterator(".lumix/assets");
 		const char* base_path = m_engine->getFileSystem().getBasePath();
 		os::FileInfo info;
 		while (os::getNextFile(iter, &info)) {
 			if (info.is_directory) continue;
 
-			Span<const char> basename = Path::getBasename(info.filename);
 			ExportFileInfo rec;
-			fromCString(Span(basename), rec.hash);
 			rec.offset = 0;
 			rec.size = os::getFileSize(StaticString<LUMIX_MAX_PATH>(base_path, ".lumix/assets/", info.filename));
 			copyString(rec.path, ".lumix/assets/");
 			catString(rec.path, info.filename);
+			rec.hash = Path(rec.path).getStableHash().getHashValue();
 			infos.insert(rec.hash, rec);
 		}
 		
@@ -3054,7 +3134,7 @@ struct StudioAppImpl final : StudioApp
 		exportDataScan("universes/", infos);
 	}
 
-	void exportDataScan(const char* dir_path, AssociativeArray<u32, ExportFileInfo>& infos)
+	void exportDataScan(const char* dir_path, AssociativeArray<u64, ExportFileInfo>& infos)
 	{
 		auto* iter = m_engine->getFileSystem().createFileIterator(dir_path);
 		const char* base_path = m_engine->getFileSystem().getBasePath();
@@ -3086,7 +3166,7 @@ struct StudioAppImpl final : StudioApp
 				copyString(out_path.data, dir_path);
 				catString(out_path.data, normalized_path);
 			}
-			u32 hash = crc32(out_path.data);
+			const u64 hash = Path(out_path.data).getStableHash().getHashValue();
 			if (infos.find(hash) >= 0) continue;
 
 			auto& out_info = infos.emplace(hash);
@@ -3099,14 +3179,14 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
-	void exportDataScanResources(AssociativeArray<u32, ExportFileInfo>& infos)
+	void exportDataScanResources(AssociativeArray<u64, ExportFileInfo>& infos)
 	{
 		ResourceManagerHub& rm = m_engine->getResourceManager();
 		for (auto iter = rm.getAll().begin(), end = rm.getAll().end(); iter != end; ++iter) {
 			const auto& resources = iter.value()->getResourceTable();
 			for (Resource* res : resources) {
-				u32 hash = res->getPath().getHash();
-				const StaticString<LUMIX_MAX_PATH> baked_path(".lumix/assets/", hash, ".res");
+				const StaticString<LUMIX_MAX_PATH> baked_path(".lumix/assets/", res->getPath().getHash(), ".res");
+				const u64 hash = Path(baked_path).getStableHash().getHashValue();
 
 				auto& out_info = infos.emplace(hash);
 				copyString(Span(out_info.path), baked_path);
@@ -3115,6 +3195,15 @@ struct StudioAppImpl final : StudioApp
 				out_info.offset = ~0UL;
 			}
 		}
+		// needed by resources compressed with a dictionary
+		if (m_engine->getFileSystem().fileExists(ResourceManagerHub::DICTIONARIES_PATH)) {
+			const u64 hash = Path(ResourceManagerHub::DICTIONARIES_PATH).getStableHash().getHashValue();
+			auto& out_info = infos.emplace(hash);
+			copyString(Span(out_info.path), ResourceManagerHub::DICTIONARIES_PATH);
+			out_info.hash = hash;
+			out_info.size = os::getFileSize(StaticString<LUMIX_MAX_PATH>(m_engine->getFileSystem().getBasePath(), ResourceManagerHub::DICTIONARIES_PATH));
+			out_info.offset = ~0UL;
+		}
 		exportDataScan("pipelines/", infos);
 		exportDataScan("universes/", infos);
 	}
@@ -3154,15 +3243,167 @@ struct StudioAppImpl final : StudioApp
 			}
 
 			if (ImGui::Button("Export")) exportData();
+			ImGui::SameLine();
+			// small compiled resources shrink, e.g. in exports without packing
+			if (ImGui::Button("Train compression dictionaries")) m_asset_compiler->trainDictionaries();
 		}
 		ImGui::End();
 	}
 
 
+	// compressed compiled resources are stored decompressed and compressed by pack codec instead,
+	// so they are decompressed on i/o workers and not in Resource::fileLoaded
+	void decompressCompiledResource(OutputMemoryStream& data) {
+		CompiledResourceHeader header;
+		if (data.size() < sizeof(header)) return;
+		memcpy(&header, data.data(), sizeof(header));
+		if (header.magic != CompiledResourceHeader::MAGIC) return;
+		if ((header.flags & CompiledResourceHeader::COMPRESSED) == 0) return;
+
+		OutputMemoryStream decompressed(m_allocator);
+		const Span<const u8> payload(data.data() + sizeof(header), u32(data.size() - sizeof(header)));
+		if (!m_engine->getResourceManager().decompress(header, payload, decompressed)) return;
+
+		header.flags &= ~(CompiledResourceHeader::COMPRESSED | CompiledResourceHeader::DICTIONARY);
+		header.dictionary = 0;
+		OutputMemoryStream tmp(m_allocator);
+		tmp.reserve(sizeof(header) + decompressed.size());
+		tmp.write(header);
+		tmp.write(decompressed.data(), decompressed.size());
+		data = static_cast<OutputMemoryStream&&>(tmp);
+	}
+
+	// writes data with the best codec, compressed data is used only if it's worth it
+	bool writePackData(os::OutputFile& file, Span<const u8> data, OutputMemoryStream& compressed, PackCodec& codec, u64& stored_size) {
+		const i32 cap = LZ4_compressBound((i32)data.length());
+		compressed.resize(cap);
+		const i32 compressed_size = LZ4_compress_default((const char*)data.begin(), (char*)compressed.getMutableData(), (i32)data.length(), cap);
+		if (compressed_size > 0 && compressed_size < i32(data.length() / 4 * 3)) {
+			codec = PackCodec::LZ4;
+			stored_size = compressed_size;
+			return file.write(compressed.data(), compressed_size);
+		}
+		codec = PackCodec::NONE;
+		stored_size = data.length();
+		return file.write(data.begin(), data.length());
+	}
+
+	// see PackFooter for the layout
+	bool writePack(const char* dest, const AssociativeArray<u64, ExportFileInfo>& infos) {
+		// files up to this size are stored in blocks
+		constexpr u64 SOLID_FILE_SIZE_LIMIT = 16 * 1024;
+		constexpr u64 BLOCK_SIZE = 256 * 1024;
+
+		os::OutputFile file;
+		if (!file.open(dest)) {
+			logError("Could not create ", dest);
+			return false;
+		}
+
+		FileSystem& fs = m_engine->getFileSystem();
+		Array<PackEntry> entries(m_allocator);
+		Array<PackBlock> blocks(m_allocator);
+		Array<const ExportFileInfo*> small_files(m_allocator);
+		OutputMemoryStream data(m_allocator);
+		OutputMemoryStream compressed(m_allocator);
+		OutputMemoryStream block_data(m_allocator);
+		entries.reserve(infos.size());
+		u64 offset = 0;
+		bool success = true;
+
+		auto read = [&](const ExportFileInfo& info){
+			data.clear();
+			if (!fs.getContentSync(Path(info.path), data)) {
+				logError("Could not read ", info.path);
+				return false;
+			}
+			if (startsWith(info.path, ".lumix/assets/")) decompressCompiledResource(data);
+			return true;
+		};
+
+		auto flush_block = [&](){
+			if (block_data.empty()) return;
+			PackBlock& block = blocks.emplace();
+			block.offset = offset;
+			block.size = (u32)block_data.size();
+			u64 stored_size;
+			success = writePackData(file, Span(block_data.data(), (u32)block_data.size()), compressed, block.codec, stored_size) && success;
+			block.stored_size = (u32)stored_size;
+			offset += stored_size;
+			block_data.clear();
+		};
+
+		for (const ExportFileInfo& info : infos) {
+			if (info.size <= SOLID_FILE_SIZE_LIMIT) {
+				small_files.push(&info);
+				continue;
+			}
+
+			if (!read(info)) {
+				file.close();
+				return false;
+			}
+			PackEntry& entry = entries.emplace();
+			entry.hash = info.hash;
+			entry.block = PackEntry::NO_BLOCK;
+			entry.offset = offset;
+			entry.size = data.size();
+			success = writePackData(file, Span(data.data(), (u32)data.size()), compressed, entry.codec, entry.stored_size) && success;
+			offset += entry.stored_size;
+		}
+
+		// files in the same directory are likely to be loaded together, so they should end in the same block
+		qsort(small_files.begin(), small_files.size(), sizeof(small_files[0]), [](const void* a, const void* b){
+			const ExportFileInfo* m = *(const ExportFileInfo**)a;
+			const ExportFileInfo* n = *(const ExportFileInfo**)b;
+			return compareString(m->path, n->path);
+		});
+
+		for (const ExportFileInfo* info : small_files) {
+			if (!read(*info)) {
+				file.close();
+				return false;
+			}
+			if (block_data.size() + data.size() > BLOCK_SIZE) flush_block();
+
+			PackEntry& entry = entries.emplace();
+			entry.hash = info->hash;
+			entry.block = blocks.size();
+			entry.offset = block_data.size();
+			entry.size = data.size();
+			entry.stored_size = 0;
+			entry.codec = PackCodec::NONE;
+			block_data.write(data.data(), data.size());
+		}
+		flush_block();
+
+		qsort(entries.begin(), entries.size(), sizeof(entries[0]), [](const void* a, const void* b){
+			const u64 m = ((const PackEntry*)a)->hash;
+			const u64 n = ((const PackEntry*)b)->hash;
+			return m < n ? -1 : (m > n ? 1 : 0);
+		});
+
+		PackFooter footer;
+		footer.index_offset = offset;
+		footer.files_count = entries.size();
+		footer.blocks_count = blocks.size();
+		success = file.write(entries.begin(), entries.byte_size()) && success;
+		success = file.write(blocks.begin(), blocks.byte_size()) && success;
+		success = file.write(&footer, sizeof(footer)) && success;
+		file.close();
+
+		if (!success) {
+			logError("Could not write ", dest);
+			return false;
+		}
+		return true;
+	}
+
+
 	void exportData() {
 		if (m_export.dest_dir.empty()) return;
 
-		AssociativeArray<u32, ExportFileInfo> infos(m_allocator);
+		AssociativeArray<u64, ExportFileInfo> infos(m_allocator);
 		infos.reserve(10000);
 
 		switch (m_export.mode) {
@@ -3201,43 +3442,7 @@ struct StudioAppImpl final : StudioApp
 				logError("No files found while trying to create ", dest);
 				return;
 			}
-			u64 total_size = 0;
-			for (ExportFileInfo& info : infos) {
-				info.offset = total_size;
-				total_size += info.size;
-			}
-			
-			os::OutputFile file;
-			if (!file.open(dest)) {
-				logError("Could not create ", dest);
-				return;
-			}
-
-			const u32 count = (u32)infos.size();
-			bool success = file.write(&count, sizeof(count));
-
-			for (auto& info : infos) {
-				success = file.write(&info.hash, sizeof(info.hash)) && success;
-				success = file.write(&info.offset, sizeof(info.offset)) && success;
-				success = file.write(&info.size, sizeof(info.size)) && success;
-			}
-
-			OutputMemoryStream src(m_allocator);
-			for (const ExportFileInfo& info : infos) {
-				src.clear();
-				if (!fs.getContentSync(Path(info.path), src)) {
-					logError("Could not read ", info.path);
-					file.close();
-					return;
-				}
-				success = file.write(src.data(), src.size()) && success;
-			}
-			file.close();
-
-			if (!success) {
-				logError("Could not write ", dest);
-				return;
-			}
+			if (!writePack(dest, infos)) return;
 		}
 		else {
 			char dest[LUMIX_MAX_PATH];
@@ -3488,6 +3693,12 @@ struct StudioAppImpl final : StudioApp
 	bool m_is_export_game_dialog_open;
 	bool m_is_entity_list_open;
 	EntityPtr m_renaming_entity = INVALID_ENTITY;
+	Array<HierarchyRow> m_hierarchy_rows;
+	Array<EntityRef> m_filtered_entities;
+	StaticString<64> m_hierarchy_filter;
+	bool m_hierarchy_dirty = true;
+	u32 m_hierarchy_version = 0;
+	u32 m_hierarchy_folders_version = 0;
 	EntityFolders::FolderID m_renaming_folder = EntityFolders::INVALID_FOLDER;
 	bool m_set_rename_focus = false;
 	char m_rename_buf[Universe::ENTITY_NAME_MAX_LENGTH];
@@ -1,10 +1,13 @@
 #include <imgui/imgui.h>
 
 #include "utils.h"
+#include "engine/engine.h"
+#include "engine/file_system.h"
 #include "engine/math.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "editor/render_interface.h"
+#include "editor/settings.h"
 #include "editor/studio_app.h"
 #include "editor/world_editor.h"
 #include "engine/universe.h"
@@ -14,6 +17,32 @@ namespace Lumix
 {
 
 
+void RenderThrottle::setViewport(const Viewport& vp) {
+	const bool same = vp.is_ortho == m_viewport.is_ortho && vp.fov == m_viewport.fov && vp.ortho_size == m_viewport.ortho_size
+		&& vp.w == m_viewport.w && vp.h == m_viewport.h
+		&& vp.pos.x == m_viewport.pos.x && vp.pos.y == m_viewport.pos.y && vp.pos.z == m_viewport.pos.z
+		&& vp.rot.x == m_viewport.rot.x && vp.rot.y == m_viewport.rot.y && vp.rot.z == m_viewport.rot.z && vp.rot.w == m_viewport.rot.w
+		&& vp.near == m_viewport.near && vp.far == m_viewport.far;
+	if (same) return;
+	m_viewport = vp;
+	invalidate();
+}
+
+
+bool RenderThrottle::shouldRender(bool focused) {
+	const Settings& settings = m_app.getSettings();
+	if (settings.m_render_on_demand) {
+		if (m_app.getEventsCount() > 0 || m_app.getEngine().getFileSystem().hasWork()) invalidate();
+		if (m_invalid_frames == 0) return false;
+	}
+	if (!focused && settings.m_unfocused_view_fps > 0 && m_timer.getTimeSinceTick() < 1.f / settings.m_unfocused_view_fps) return false;
+
+	m_timer.tick();
+	if (m_invalid_frames > 0) --m_invalid_frames;
+	return true;
+}
+
+
 ResourceLocator::ResourceLocator(const Span<const char>& path)
 {
 	full = path;
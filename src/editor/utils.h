@@ -1,7 +1,9 @@
 #pragma once
 
 #include "engine/delegate.h"
+#include "engine/geometry.h"
 #include "engine/lumix.h"
+#include "engine/os.h"
 #include "engine/string.h"
 
 namespace Lumix {
@@ -50,6 +52,27 @@ struct LUMIX_EDITOR_API Action
 	Delegate<bool ()> is_selected;
 };
 
+// decides if an editor view (scene view, game view, preview) is rendered this frame
+// views are rendered only when invalidated, unfocused views at most Settings::m_unfocused_view_fps times per second
+struct LUMIX_EDITOR_API RenderThrottle {
+	explicit RenderThrottle(struct StudioApp& app) : m_app(app) {}
+
+	// view is rendered a few more frames after it's invalidated, so temporal effects and readbacks settle
+	void invalidate() { m_invalid_frames = SETTLE_FRAMES; }
+	// invalidates if `vp` differs from the last one
+	void setViewport(const Viewport& vp);
+	// input and resource loading invalidate all views, since they can change anything
+	bool shouldRender(bool focused);
+
+private:
+	static constexpr u32 SETTLE_FRAMES = 30;
+
+	StudioApp& m_app;
+	os::Timer m_timer;
+	Viewport m_viewport = {};
+	u32 m_invalid_frames = SETTLE_FRAMES;
+};
+
 LUMIX_EDITOR_API void getShortcut(const Action& action, Span<char> buf);
 LUMIX_EDITOR_API void menuItem(Action& a, bool enabled);
 LUMIX_EDITOR_API void getEntityListDisplayName(struct StudioApp& app, struct Universe& editor, Span<char> buf, EntityPtr entity);
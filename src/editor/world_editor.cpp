@@ -25,6 +25,7 @@
 #include "engine/stream.h"
 #include "engine/string.h"
 #include "engine/universe.h"
+#include "engine/world_partition.h"
 #include "render_interface.h"
 
 
@@ -1173,16 +1174,41 @@ public:
 		Universe* universe = m_editor.getUniverse();
 
 		const reflection::ComponentBase* cmp_desc = reflection::getComponent(component_type);
+		m_property = array[0] == '\0' ? findProperty(*cmp_desc, property_name) : nullptr;
 
 		for (u32 i = 0; i < entities.length(); ++i) {
 			ComponentUID component = universe->getComponent(entities[i], component_type);
 			if (!component.isValid()) continue;
 
-			PropertySerializeVisitor v(m_old_values, component);
-			v.idx = -1;
-			cmp_desc->visit(v);
+			if (!m_property) {
+				PropertySerializeVisitor v(m_old_values, component);
+				v.idx = -1;
+				cmp_desc->visit(v);
+			}
 			m_entities.push(entities[i]);
 		}
+
+		// only the edited property is stored for undo, so selecting many entities is cheap
+		if (m_property && !m_entities.empty()) {
+			Array<T> values(editor.getAllocator());
+			values.resize(m_entities.size());
+			m_property->get(universe->getScene(component_type), component_type, m_entities, m_index, values);
+			for (const T& v : values) writeToStream(m_old_values, v);
+		}
+	}
+
+
+	static const reflection::Property<T>* findProperty(const reflection::ComponentBase& cmp_desc, const char* name) {
+		struct : reflection::IEmptyPropertyVisitor {
+			void visit(const reflection::Property<T>& prop) override {
+				if (equalIStrings(prop.name, name) && !prop.isReadonly()) res = &prop;
+			}
+			const char* name;
+			const reflection::Property<T>* res = nullptr;
+		} v;
+		v.name = name;
+		cmp_desc.visit(v);
+		return v.res;
 	}
 
 
@@ -1204,11 +1230,11 @@ public:
 				if (array[0] != '\0') return;
 				if (!equalIStrings(prop_name, prop.name)) return;
 				found = true;
-				for (EntityPtr entity : cmd->m_entities) {
-					const ComponentUID cmp = cmd->m_editor.getUniverse()->getComponent((EntityRef)entity, cmd->m_component_type);
-					ASSERT(prop.setter);
-					prop.set(cmp, cmd->m_index, StoredType<T>::get(cmd->m_new_value));
-				}
+				if (cmd->m_entities.empty()) return;
+				ASSERT(prop.setter);
+				IScene* scene = cmd->m_editor.getUniverse()->getScene(cmd->m_component_type);
+				const T value = StoredType<T>::get(cmd->m_new_value);
+				prop.set(scene, cmd->m_component_type, cmd->m_entities, cmd->m_index, Span<const T>(&value, 1));
 			}
 
 			void visit(const reflection::ArrayProperty& prop) override { 
@@ -1251,9 +1277,18 @@ public:
 	void undo() override
 	{
 		InputMemoryStream blob(m_old_values);
+		Universe* universe = m_editor.getUniverse();
+		if (m_property) {
+			if (m_entities.empty()) return;
+			Array<T> values(m_editor.getAllocator());
+			values.reserve(m_entities.size());
+			for (u32 i = 0, c = m_entities.size(); i < c; ++i) values.push(readFromStream<T>(blob));
+			m_property->set(universe->getScene(m_component_type), m_component_type, m_entities, m_index, values);
+			return;
+		}
+
 		const reflection::ComponentBase* cmp_desc = reflection::getComponent(m_component_type);
 		HashMap<EntityPtr, u32> map(m_editor.getAllocator());
-		Universe* universe = m_editor.getUniverse();
 		Span<const EntityRef> entities(nullptr, nullptr);
 		for (int i = 0; i < m_entities.size(); ++i) {
 			const ComponentUID cmp = universe->getComponent(m_entities[i], m_component_type);
@@ -1290,6 +1325,8 @@ private:
 	WorldEditor& m_editor;
 	ComponentType m_component_type;
 	Array<EntityRef> m_entities;
+	// plain (not array nor dynamic) property, nullptr if whole components are stored in m_old_values
+	const reflection::Property<T>* m_property;
 	typename StoredType<T>::Type m_new_value;
 	OutputMemoryStream m_old_values;
 	String m_array;
@@ -1459,7 +1496,9 @@ private:
 
 			for (EntityRef e : m_entities) {
 				ASSERT(!universe->hasComponent(e, m_type));
-				universe->createComponent(m_type, e);
+			}
+			universe->createComponents(m_type, m_entities);
+			for (EntityRef e : m_entities) {
 				if (universe->hasComponent(e, m_type)) {
 					ret = true;
 				}
@@ -1988,28 +2027,131 @@ public:
 	}
 
 
+	bool saveWorldPartitionBlob(Span<const EntityRef> roots, const char* path) {
+		Universe& universe = m_prefab_system->cloneToUniverse(roots);
+		OutputMemoryStream blob(m_allocator);
+		blob.reserve(64 * 1024);
+		m_engine.serialize(universe, blob);
+		m_engine.destroyUniverse(universe);
+
+		os::OutputFile file;
+		if (!m_engine.getFileSystem().open(path, file)) {
+			logError("Failed to create ", path);
+			return false;
+		}
+		const bool res = file.write(blob.data(), blob.size());
+		file.close();
+		if (!res) logError("Failed to write ", path);
+		return res;
+	}
+
+
+	void saveWorldPartition(const char* basename, float cell_size) override {
+		ASSERT(m_universe);
+		ASSERT(cell_size > 0);
+		FileSystem& fs = m_engine.getFileSystem();
+		while (fs.hasWork()) fs.processCallbacks();
+
+		logInfo("Saving world partition ", basename, "...");
+		const StaticString<LUMIX_MAX_PATH> dir("universes/", basename);
+		const StaticString<LUMIX_MAX_PATH> full_dir(fs.getBasePath(), dir);
+		if (!os::makePath(full_dir)) {
+			logError("Could not create directory ", full_dir);
+			return;
+		}
+
+		struct Root {
+			IVec2 cell;
+			EntityRef entity;
+		};
+		// environment is not streamed, it goes to global.wpc
+		static const ComponentType ENVIRONMENT_TYPE = reflection::getComponentType("environment");
+		Array<Root> roots(m_allocator);
+		Array<EntityRef> global(m_allocator);
+		for (EntityPtr e = m_universe->getFirstEntity(); e.isValid(); e = m_universe->getNextEntity((EntityRef)e)) {
+			const EntityRef entity = (EntityRef)e;
+			if (m_universe->getParent(entity).isValid()) continue;
+			if (m_universe->hasComponent(entity, ENVIRONMENT_TYPE)) {
+				global.push(entity);
+				continue;
+			}
+			const IVec2 cell = WorldPartition::getCellCoord(m_universe->getPosition(entity), cell_size);
+			roots.push({cell, entity});
+		}
+
+		qsort(roots.begin(), roots.size(), sizeof(roots[0]), [](const void* a, const void* b) {
+			const IVec2& ca = ((const Root*)a)->cell;
+			const IVec2& cb = ((const Root*)b)->cell;
+			if (ca.x != cb.x) return ca.x < cb.x ? -1 : 1;
+			if (ca.y != cb.y) return ca.y < cb.y ? -1 : 1;
+			return 0;
+		});
+
+		char path[LUMIX_MAX_PATH];
+		Array<IVec2> cells(m_allocator);
+		Array<EntityRef> cell_roots(m_allocator);
+		for (i32 i = 0, c = roots.size(); i < c;) {
+			const IVec2 cell = roots[i].cell;
+			cell_roots.clear();
+			for (; i < c && roots[i].cell.x == cell.x && roots[i].cell.y == cell.y; ++i) cell_roots.push(roots[i].entity);
+
+			WorldPartition::getCellPath(Span(path), dir, cell);
+			if (!saveWorldPartitionBlob(cell_roots, path)) return;
+			cells.push(cell);
+		}
+
+		WorldPartition::getGlobalPath(Span(path), dir);
+		if (global.empty()) {
+			if (fs.fileExists(path) && !fs.deleteFile(path)) logError("Failed to delete ", path);
+		}
+		else if (!saveWorldPartitionBlob(global, path)) {
+			return;
+		}
+
+		// header is written last, so a failed save does not leave header pointing to missing cells
+		OutputMemoryStream blob(m_allocator);
+		WorldPartition::Header header;
+		header.cell_size = cell_size;
+		header.cells_count = cells.size();
+		blob.write(header);
+		blob.write(cells.begin(), cells.byte_size());
+
+		WorldPartition::getHeaderPath(Span(path), dir);
+		os::OutputFile file;
+		if (!fs.open(path, file)) {
+			logError("Failed to create ", path);
+			return;
+		}
+		if (!file.write(blob.data(), blob.size())) logError("Failed to write ", path);
+		file.close();
+		logInfo("World partition ", basename, " saved, ", cells.size(), " cells");
+	}
+
+
 	void save(IOutputStream& file)
 	{
 		while (m_engine.getFileSystem().hasWork()) m_engine.getFileSystem().processCallbacks();
 
 		ASSERT(m_universe);
 
-		OutputMemoryStream blob(m_allocator);
-		blob.reserve(64 * 1024);
+		// paged, big universes are not copied around while the blob grows
+		OutputPagedStream blob(m_engine.getPageAllocator());
 
 		Header header = {0xffffFFFF, (int)SerializedVersion::LATEST, 0, 0};
-		blob.write(header);
-		int hashed_offset = sizeof(header);
+		void* header_ptr = blob.skip(sizeof(header));
+		const u64 hashed_offset = sizeof(header);
 
 		header.engine_hash = m_engine.serialize(*m_universe, blob);
-		m_prefab_system->serialize(blob);
-		m_entity_folders->serialize(blob);
+		OutputMemoryStream tmp(m_allocator);
+		m_prefab_system->serialize(tmp);
+		m_entity_folders->serialize(tmp);
 		const Viewport& vp = getView().getViewport();
-		blob.write(vp.pos);
-		blob.write(vp.rot);
-		header.hash = crc32((const u8*)blob.data() + hashed_offset, (int)blob.size() - hashed_offset);
-		memcpy(blob.getMutableData(), &header, sizeof(header));
-		file.write(blob.data(), blob.size());
+		tmp.write(vp.pos);
+		tmp.write(vp.rot);
+		blob.write(tmp.data(), tmp.size());
+		header.hash = blob.computeCrc32(hashed_offset);
+		memcpy(header_ptr, &header, sizeof(header));
+		blob.writeTo(file);
 
 		logInfo("Universe saved");
 	}
@@ -2217,10 +2359,56 @@ public:
 			m_undo_stack.resize(m_undo_index + 1);
 		}
 
+		if (m_undo_index >= 0) m_undo_stack[m_undo_index]->compact();
+
 		UniquePtr<EndGroupCommand> cmd = UniquePtr<EndGroupCommand>::create(m_allocator);
 		cmd->group_type = m_current_group_type;
 		m_undo_stack.push(cmd.move());
 		++m_undo_index;
+		trimUndoStack();
+	}
+
+
+	void setUndoMemoryLimit(u64 bytes) override {
+		if (m_undo_memory_limit == bytes) return;
+		m_undo_memory_limit = bytes;
+		trimUndoStack();
+	}
+
+
+	// removes the oldest commands (whole groups) until undo stack fits in the memory limit
+	void trimUndoStack() {
+		// game mode commands are popped in stopGameMode
+		if (m_is_game_mode) return;
+
+		static const u32 begin_group_hash = crc32("begin_group");
+		static const u32 end_group_hash = crc32("end_group");
+
+		u64 total = 0;
+		for (const UniquePtr<IEditorCommand>& cmd : m_undo_stack) total += cmd->getMemorySize();
+		if (total <= m_undo_memory_limit) return;
+
+		i32 count = 0;
+		while (total > m_undo_memory_limit && count < m_undo_index) {
+			i32 end = count;
+			if (crc32(m_undo_stack[count]->getType()) == begin_group_hash) {
+				while (end < m_undo_index && crc32(m_undo_stack[end]->getType()) != end_group_hash) ++end;
+				// unfinished group
+				if (crc32(m_undo_stack[end]->getType()) != end_group_hash) break;
+			}
+			// keep the current command
+			if (end >= m_undo_index) break;
+			for (i32 i = count; i <= end; ++i) total -= m_undo_stack[i]->getMemorySize();
+			count = end + 1;
+		}
+		if (count == 0) return;
+
+		for (i32 i = 0; i < count; ++i) m_undo_stack[i].reset();
+		for (i32 i = count, c = m_undo_stack.size(); i < c; ++i) {
+			m_undo_stack[i - count] = m_undo_stack[i].move();
+		}
+		m_undo_stack.shrink(m_undo_stack.size() - count);
+		m_undo_index -= count;
 	}
 
 	void executeCommand(UniquePtr<IEditorCommand>&& command) override
@@ -2246,9 +2434,11 @@ public:
 			if (m_undo_index < m_undo_stack.size() - 1) {
 				m_undo_stack.resize(m_undo_index + 1);
 			}
+			if (m_undo_index >= 0) m_undo_stack[m_undo_index]->compact();
 			m_undo_stack.emplace(command.move());
 			if (m_is_game_mode) ++m_game_mode_commands;
 			++m_undo_index;
+			trimUndoStack();
 			return;
 		}
 		else {
@@ -2270,8 +2460,11 @@ public:
 		}
 
 		m_selected_entity_on_game_mode = m_selected_entities.empty() ? INVALID_ENTITY : m_selected_entities[0];
+		// restored in place by stopGameMode, much faster than loading it again
 		m_game_mode_file.clear();
-		save(m_game_mode_file);
+		m_universe->saveSnapshot(m_game_mode_file);
+		m_prefab_system->serialize(m_game_mode_file);
+		m_entity_folders->serialize(m_game_mode_file);
 		m_is_game_mode = true;
 		beginCommandGroup("");
 		endCommandGroup();
@@ -2295,21 +2488,21 @@ public:
 		m_is_game_mode = false;
 		if (reload)
 		{
-			m_universe_destroyed.invoke();
-			m_prefab_system->setUniverse(nullptr);
-			StaticString<64> name(m_universe->getName());
-			m_entity_folders.destroy();
-			m_engine.destroyUniverse(*m_universe);
-			
-			m_universe = &m_engine.createUniverse(true);
-			m_entity_folders.create(*m_universe, m_allocator);
-			m_prefab_system->setUniverse(m_universe);
-			m_universe_created.invoke();
-			m_universe->setName(name);
-			m_universe->entityDestroyed().bind<&WorldEditorImpl::onEntityDestroyed>(this);
+			os::Timer timer;
 			m_selected_entities.clear();
-            InputMemoryStream file(m_game_mode_file);
-			load(file);
+			InputMemoryStream blob(m_game_mode_file);
+			if (m_universe->restoreSnapshot(blob)) {
+				EntityMap identity(m_allocator);
+				for (EntityPtr e = m_universe->getFirstEntity(); e.isValid(); e = m_universe->getNextEntity((EntityRef)e)) {
+					identity.set((EntityRef)e, (EntityRef)e);
+				}
+				m_prefab_system->setUniverse(nullptr);
+				m_prefab_system->setUniverse(m_universe);
+				m_prefab_system->deserialize(blob, identity);
+				m_entity_folders->deserialize(blob, identity);
+				if (m_view) m_view->refreshIcons();
+				logInfo("Universe restored in ", timer.getTimeSinceStart(), " seconds");
+			}
 		}
 		m_game_mode_file.clear();
 		if(m_selected_entity_on_game_mode.isValid()) {
@@ -2485,10 +2678,12 @@ public:
 		createUniverse();
 		m_universe->setName(basename);
 		logInfo("Loading universe ", basename, "...");
-		os::InputFile file;
+		// mapped, so the universe is deserialized in place without reading it to a buffer first
+		os::MappedFile file;
 		const StaticString<LUMIX_MAX_PATH> path(m_engine.getFileSystem().getBasePath(), "universes/", basename, ".unv");
 		if (file.open(path)) {
-			if (!load(file)) {
+			InputMemoryStream blob(file.data(), file.size());
+			if (!load(blob)) {
 				logError("Failed to parse ", path);
 				newUniverse();
 			}
@@ -2865,6 +3060,7 @@ private:
 
 	bool m_is_game_mode;
 	int m_game_mode_commands;
+	u64 m_undo_memory_limit = 512 * 1024 * 1024;
 	OutputMemoryStream m_game_mode_file;
 	DelegateList<void()> m_universe_destroyed;
 	DelegateList<void()> m_universe_created;
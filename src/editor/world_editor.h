@@ -25,6 +25,10 @@ struct IEditorCommand
 	virtual void undo() = 0;
 	virtual const char* getType() = 0;
 	virtual bool merge(IEditorCommand& command) = 0;
+	// called once the command can no longer be merged, it can compress its undo data
+	virtual void compact() {}
+	// approximate size of undo data, used to limit memory used by undo stack
+	virtual u64 getMemorySize() const { return 0; }
 };
 
 struct UniverseView {
@@ -102,6 +106,8 @@ struct LUMIX_EDITOR_API WorldEditor
 	virtual bool canRedo() const = 0;
 	virtual void undo() = 0;
 	virtual void redo() = 0;
+	// oldest commands are removed from undo stack when it uses more memory
+	virtual void setUndoMemoryLimit(u64 bytes) = 0;
 	virtual void addComponent(Span<const EntityRef> entities, ComponentType type) = 0;
 	virtual void destroyComponent(Span<const EntityRef> entities, ComponentType cmp_type) = 0;
 	virtual EntityRef addEntity() = 0;
@@ -146,6 +152,8 @@ struct LUMIX_EDITOR_API WorldEditor
 
 	virtual void loadUniverse(const char* basename) = 0;
 	virtual void saveUniverse(const char* basename, bool save_path) = 0;
+	// saves universe as grid of cells streamed by WorldPartition, to universes/<basename>/
+	virtual void saveWorldPartition(const char* basename, float cell_size) = 0;
 	virtual bool isLoading() const = 0;
 	virtual void newUniverse() = 0;
 	virtual void toggleGameMode() = 0;
@@ -1,8 +1,11 @@
 #include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/crt.h"
+#include "engine/heap_profiler.h"
+#include "engine/log.h"
 #include "engine/math.h"
 #include "engine/os.h"
+#include "engine/page_allocator.h"
 #if !defined _WIN32 || defined __clang__
 	#include <string.h>
 	#include <malloc.h>
@@ -14,6 +17,70 @@ namespace Lumix
 	static constexpr u32 PAGE_SIZE = 4096;
 	static constexpr size_t MAX_PAGE_COUNT = 16384;
 	static constexpr u32 SMALL_ALLOC_MAX_SIZE = 64;
+	// number of items moved between a thread cache and the shared free lists at once
+	static constexpr u32 THREAD_CACHE_BATCH = 32;
+	static constexpr u32 THREAD_CACHE_MAX_ITEMS = THREAD_CACHE_BATCH * 2;
+
+	static constexpr i32 NO_THREAD_CACHE = 64;
+
+	// bit per thread cache slot, a slot is released when its thread exits
+	static volatile i64 g_used_thread_cache_slots = 0;
+	// guards g_first_allocator, plain spin lock, since it's used in static constructors and at thread exit
+	static volatile i32 g_allocators_lock = 0;
+	static DefaultAllocator* g_first_allocator = nullptr;
+
+	static void lockAllocators() {
+		while (!compareAndExchange(&g_allocators_lock, 1, 0)) {}
+	}
+
+	static void unlockAllocators() {
+		memoryBarrier();
+		g_allocators_lock = 0;
+	}
+
+	static i32 acquireThreadCacheSlot() {
+		for (;;) {
+			const i64 used = g_used_thread_cache_slots;
+			const u64 free_slots = ~(u64)used;
+			if (free_slots == 0) return NO_THREAD_CACHE;
+			#ifdef _WIN32
+				unsigned long idx;
+				_BitScanForward64(&idx, free_slots);
+			#else
+				const u32 idx = __builtin_ctzll(free_slots);
+			#endif
+			if (compareAndExchange64(&g_used_thread_cache_slots, used | ((i64)1 << idx), used)) return (i32)idx;
+		}
+	}
+
+	static void flushThreadCache(DefaultAllocator& allocator, DefaultAllocator::ThreadCache& cache);
+
+	// returns cached blocks to their allocators and releases the slot when the thread exits
+	struct ThreadCacheSlot {
+		~ThreadCacheSlot() {
+			if (idx < 0 || idx == NO_THREAD_CACHE) {
+				idx = NO_THREAD_CACHE;
+				return;
+			}
+
+			lockAllocators();
+			for (DefaultAllocator* a = g_first_allocator; a; a = a->m_next) {
+				flushThreadCache(*a, a->m_thread_caches[idx]);
+			}
+			unlockAllocators();
+
+			for (;;) {
+				const i64 used = g_used_thread_cache_slots;
+				if (compareAndExchange64(&g_used_thread_cache_slots, used & ~((i64)1 << idx), used)) break;
+			}
+			// thread_local destructors running after this one must not grab a new slot
+			idx = NO_THREAD_CACHE;
+		}
+
+		i32 idx = -1;
+	};
+
+	static thread_local ThreadCacheSlot g_thread_cache_slot;
 
 	struct DefaultAllocator::Page {
 		struct Header {
@@ -56,11 +123,11 @@ namespace Lumix
 		return (DefaultAllocator::Page*)((uintptr)ptr & ~u64(PAGE_SIZE - 1));
 	}
 
-	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+	// call only with allocator.m_mutex locked
+	static void freeSmallLocked(DefaultAllocator& allocator, void* mem) {
 		u8* ptr = (u8*)mem;
 		DefaultAllocator::Page* page = getPage(ptr);
 		
-		MutexGuard guard(allocator.m_mutex);
 		if (page->header.first_free + page->header.item_size > sizeof(page->data)) {
 			ASSERT(!page->header.next);
 			ASSERT(!page->header.prev);
@@ -99,11 +166,8 @@ namespace Lumix
 		return new_mem;
 	}
 
-	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
-		const u32 bin = sizeToBin(n);
-
-		MutexGuard guard(allocator.m_mutex);
-
+	// call only with allocator.m_mutex locked
+	static void* allocSmallLocked(DefaultAllocator& allocator, u32 bin) {
 		if (!allocator.m_small_allocations) {
 			allocator.m_small_allocations = (u8*)os::memReserve(PAGE_SIZE * MAX_PAGE_COUNT);
 		}
@@ -118,7 +182,7 @@ namespace Lumix
 		}
 
 		ASSERT(p->header.item_size > 0);
-		ASSERT(p->header.first_free + n < sizeof(p->data));
+		ASSERT(p->header.first_free + p->header.item_size <= sizeof(p->data));
 		void* res = &p->data[p->header.first_free];
 		p->header.first_free = *(u32*)res;
 
@@ -139,6 +203,76 @@ namespace Lumix
 		return res;
 	}
 
+	static DefaultAllocator::ThreadCache* getThreadCache(DefaultAllocator& allocator) {
+		i32& idx = g_thread_cache_slot.idx;
+		if (idx < 0) idx = acquireThreadCacheSlot();
+		// threads over the limit go directly to the shared free lists
+		if (idx >= (i32)lengthOf(allocator.m_thread_caches)) return nullptr;
+		return &allocator.m_thread_caches[idx];
+	}
+
+	static void flushThreadCache(DefaultAllocator& allocator, DefaultAllocator::ThreadCache& cache) {
+		MutexGuard guard(allocator.m_mutex);
+		for (u32 bin = 0; bin < lengthOf(cache.free_items); ++bin) {
+			while (cache.free_items[bin]) {
+				void* item = cache.free_items[bin];
+				cache.free_items[bin] = *(void**)item;
+				freeSmallLocked(allocator, item);
+			}
+			cache.counts[bin] = 0;
+		}
+	}
+
+	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
+		const u32 bin = sizeToBin(n);
+		DefaultAllocator::ThreadCache* cache = getThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			return allocSmallLocked(allocator, bin);
+		}
+
+		if (cache->counts[bin] == 0) {
+			MutexGuard guard(allocator.m_mutex);
+			for (u32 i = 0; i < THREAD_CACHE_BATCH; ++i) {
+				void* item = allocSmallLocked(allocator, bin);
+				if (!item) break;
+				*(void**)item = cache->free_items[bin];
+				cache->free_items[bin] = item;
+				++cache->counts[bin];
+			}
+			if (cache->counts[bin] == 0) return nullptr;
+		}
+
+		void* res = cache->free_items[bin];
+		cache->free_items[bin] = *(void**)res;
+		--cache->counts[bin];
+		return res;
+	}
+
+	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+		DefaultAllocator::ThreadCache* cache = getThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			freeSmallLocked(allocator, mem);
+			return;
+		}
+
+		const u32 bin = sizeToBin(getPage(mem)->header.item_size);
+		*(void**)mem = cache->free_items[bin];
+		cache->free_items[bin] = mem;
+		++cache->counts[bin];
+
+		if (cache->counts[bin] > THREAD_CACHE_MAX_ITEMS) {
+			MutexGuard guard(allocator.m_mutex);
+			for (u32 i = 0; i < THREAD_CACHE_BATCH; ++i) {
+				void* item = cache->free_items[bin];
+				cache->free_items[bin] = *(void**)item;
+				freeSmallLocked(allocator, item);
+			}
+			cache->counts[bin] -= THREAD_CACHE_BATCH;
+		}
+	}
+
 	static bool isSmallAlloc(DefaultAllocator& allocator, void* p) {
 		return allocator.m_small_allocations && p >= allocator.m_small_allocations && p < allocator.m_small_allocations + (PAGE_SIZE * MAX_PAGE_COUNT);
 	}
@@ -146,23 +280,35 @@ namespace Lumix
 	DefaultAllocator::DefaultAllocator() {
 		m_page_count = 0;
 		memset(m_free_lists, 0, sizeof(m_free_lists));
+
+		lockAllocators();
+		m_next = g_first_allocator;
+		if (g_first_allocator) g_first_allocator->m_prev = this;
+		g_first_allocator = this;
+		unlockAllocators();
 	}
 
 	DefaultAllocator::~DefaultAllocator() {
+		lockAllocators();
+		if (m_prev) m_prev->m_next = m_next;
+		else g_first_allocator = m_next;
+		if (m_next) m_next->m_prev = m_prev;
+		unlockAllocators();
+
 		os::memRelease(m_small_allocations, PAGE_SIZE * MAX_PAGE_COUNT);
 	}
 
 	void* DefaultAllocator::allocate(size_t n)
 	{
-		if (n <= SMALL_ALLOC_MAX_SIZE) {
-			return allocSmall(*this, n);
-		}
-		return malloc(n);
+		void* res = n <= SMALL_ALLOC_MAX_SIZE ? allocSmall(*this, n) : malloc(n);
+		heap_profiler::onAllocated(res, n);
+		return res;
 	}
 
 
 	void DefaultAllocator::deallocate(void* p)
 	{
+		heap_profiler::onFreed(p);
 		if (isSmallAlloc(*this, p)) {
 			freeSmall(*this, p);
 			return;
@@ -173,24 +319,24 @@ namespace Lumix
 
 	void* DefaultAllocator::reallocate(void* ptr, size_t size)
 	{
-		if (isSmallAlloc(*this, ptr)) {
-			return reallocSmall(*this, ptr, size);
-		}
-		return realloc(ptr, size);
+		heap_profiler::onFreed(ptr);
+		void* res = isSmallAlloc(*this, ptr) ? reallocSmall(*this, ptr, size) : realloc(ptr, size);
+		heap_profiler::onAllocated(res, size);
+		return res;
 	}
 
 #ifdef _WIN32
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
-		if (size <= SMALL_ALLOC_MAX_SIZE && align <= size) {
-			return allocSmall(*this, size);
-		}
-		return _aligned_malloc(size, align);
+		void* res = size <= SMALL_ALLOC_MAX_SIZE && align <= size ? allocSmall(*this, size) : _aligned_malloc(size, align);
+		heap_profiler::onAllocated(res, size);
+		return res;
 	}
 
 
 	void DefaultAllocator::deallocate_aligned(void* ptr)
 	{
+		heap_profiler::onFreed(ptr);
 		if (isSmallAlloc(*this, ptr)) {
 			freeSmall(*this, ptr);
 			return;
@@ -201,26 +347,30 @@ namespace Lumix
 
 	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
 	{
-		if (isSmallAlloc(*this, ptr)) {
-			return reallocSmallAligned(*this, ptr, size, align);
-		}
-		return _aligned_realloc(ptr, size, align);
+		heap_profiler::onFreed(ptr);
+		void* res = isSmallAlloc(*this, ptr) ? reallocSmallAligned(*this, ptr, size, align) : _aligned_realloc(ptr, size, align);
+		heap_profiler::onAllocated(res, size);
+		return res;
 	}
 #else
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
-		return aligned_alloc(align, size);
+		void* res = aligned_alloc(align, size);
+		heap_profiler::onAllocated(res, size);
+		return res;
 	}
 
 
 	void DefaultAllocator::deallocate_aligned(void* ptr)
 	{
+		heap_profiler::onFreed(ptr);
 		free(ptr);
 	}
 
 
 	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
 	{
+		heap_profiler::onFreed(ptr);
 		// POSIX and glibc do not provide a way to realloc with alignment preservation
 		if (size == 0) {
 			free(ptr);
@@ -230,12 +380,171 @@ namespace Lumix
 		if (newptr == nullptr) {
 			return nullptr;
 		}
-		memcpy(newptr, ptr, malloc_usable_size(ptr));
+		if (ptr) memcpy(newptr, ptr, malloc_usable_size(ptr));
 		free(ptr);
+		heap_profiler::onAllocated(newptr, size);
 		return newptr;
 	}
 #endif
 
+
+static u32 roundUp(u32 val, u32 align) {
+	ASSERT((align & (align - 1)) == 0);
+	return (val + align - 1) & ~(align - 1);
+}
+
+LinearAllocator::LinearAllocator(u32 reserve) {
+	m_reserved = roundUp(reserve, os::getMemPageAlignment());
+	m_mem = (u8*)os::memReserve(m_reserved);
+}
+
+LinearAllocator::~LinearAllocator() {
+	os::memRelease(m_mem, m_reserved);
+}
+
+void LinearAllocator::rewind(u32 offset) {
+	ASSERT(offset <= (u32)m_end);
+	m_end = offset;
+}
+
+void* LinearAllocator::allocate_aligned(size_t size, size_t align) {
+	// size is stored just before the returned block, so reallocate knows how much to copy
+	align = maximum(align, alignof(u32));
+	const u32 total = u32(size + align + sizeof(u32));
+	const u32 start = atomicAdd(&m_end, total);
+	const u32 end = start + total;
+	LUMIX_FATAL(end <= m_reserved);
+
+	if (end > (u32)m_commited_bytes) {
+		MutexGuard guard(m_mutex);
+		if (end > (u32)m_commited_bytes) {
+			const u32 commited = m_commited_bytes;
+			const u32 new_commited = roundUp(end, os::getMemPageSize());
+			os::memCommit(m_mem + commited, new_commited - commited);
+			m_commited_bytes = new_commited;
+		}
+	}
+
+	u8* ptr = (u8*)((uintptr(m_mem + start + sizeof(u32)) + align - 1) & ~uintptr(align - 1));
+	((u32*)ptr)[-1] = u32(size);
+	return ptr;
+}
+
+void LinearAllocator::deallocate_aligned(void* ptr) {}
+
+void* LinearAllocator::reallocate_aligned(void* ptr, size_t size, size_t align) {
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) return nullptr;
+	
+	const u32 old_size = ((u32*)ptr)[-1];
+	if (old_size >= size) return ptr;
+
+	void* new_mem = allocate_aligned(size, align);
+	memcpy(new_mem, ptr, old_size);
+	return new_mem;
+}
+
+void* LinearAllocator::allocate(size_t size) { return allocate_aligned(size, 16); }
+void LinearAllocator::deallocate(void* ptr) {}
+void* LinearAllocator::reallocate(void* ptr, size_t size) { return reallocate_aligned(ptr, size, 16); }
+
+
+struct FramePage {
+	u32 epoch = 0;
+	u8* pos = nullptr;
+	u8* end = nullptr;
+};
+
+static volatile i32 g_frame_epoch = 0;
+static thread_local FramePage g_frame_page;
+
+FrameAllocator::FrameAllocator(PageAllocator& page_allocator, IAllocator& fallback)
+	: m_page_allocator(page_allocator)
+	, m_fallback(fallback)
+{
+	m_epoch = atomicIncrement(&g_frame_epoch);
+}
+
+FrameAllocator::~FrameAllocator() {
+	reset();
+}
+
+void FrameAllocator::reset() {
+	m_epoch = atomicIncrement(&g_frame_epoch);
+
+	m_page_allocator.lock();
+	while (m_pages) {
+		void* next = *(void**)m_pages;
+		m_page_allocator.deallocate(m_pages, false);
+		m_pages = next;
+	}
+	m_page_allocator.unlock();
+
+	while (m_big_allocations) {
+		void* next = *(void**)m_big_allocations;
+		m_fallback.deallocate_aligned(m_big_allocations);
+		m_big_allocations = next;
+	}
+}
+
+void* FrameAllocator::allocateBig(size_t size, size_t align) {
+	// [next big allocation] ... [u32 size][data]
+	const size_t offset = maximum(align, (size_t)16);
+	u8* mem = (u8*)m_fallback.allocate_aligned(size + offset, maximum(align, alignof(void*)));
+	{
+		MutexGuard guard(m_mutex);
+		*(void**)mem = m_big_allocations;
+		m_big_allocations = mem;
+	}
+	u8* ptr = mem + offset;
+	((u32*)ptr)[-1] = u32(size);
+	return ptr;
+}
+
+void* FrameAllocator::allocate_aligned(size_t size, size_t align) {
+	ASSERT((align & (align - 1)) == 0);
+	align = maximum(align, alignof(u32));
+	if (size + align + sizeof(u32) > PageAllocator::PAGE_SIZE / 4) return allocateBig(size, align);
+
+	// size is stored just before the returned block, so reallocate knows how much to copy
+	FramePage& page = g_frame_page;
+	u8* ptr = (u8*)((uintptr(page.pos + sizeof(u32)) + align - 1) & ~uintptr(align - 1));
+	if (page.epoch != m_epoch || ptr + size > page.end) {
+		u8* mem = (u8*)m_page_allocator.allocate(true);
+		{
+			MutexGuard guard(m_mutex);
+			*(void**)mem = m_pages;
+			m_pages = mem;
+		}
+		page.epoch = m_epoch;
+		page.pos = mem + sizeof(void*);
+		page.end = mem + PageAllocator::PAGE_SIZE;
+		ptr = (u8*)((uintptr(page.pos + sizeof(u32)) + align - 1) & ~uintptr(align - 1));
+	}
+
+	page.pos = ptr + size;
+	((u32*)ptr)[-1] = u32(size);
+	return ptr;
+}
+
+void FrameAllocator::deallocate_aligned(void* ptr) {}
+
+void* FrameAllocator::reallocate_aligned(void* ptr, size_t size, size_t align) {
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) return nullptr;
+	
+	const u32 old_size = ((u32*)ptr)[-1];
+	if (old_size >= size) return ptr;
+
+	void* new_mem = allocate_aligned(size, align);
+	memcpy(new_mem, ptr, old_size);
+	return new_mem;
+}
+
+void* FrameAllocator::allocate(size_t size) { return allocate_aligned(size, 16); }
+void FrameAllocator::deallocate(void* ptr) {}
+void* FrameAllocator::reallocate(void* ptr, size_t size) { return reallocate_aligned(ptr, size, 16); }
+
 	
 BaseProxyAllocator::BaseProxyAllocator(IAllocator& source)
 	: m_source(source)
@@ -294,4 +603,125 @@ void* BaseProxyAllocator::reallocate(void* ptr, size_t size)
 }
 
 
+static TagAllocator* g_first_tag_allocator = nullptr;
+static Mutex g_tag_allocators_mutex;
+// [u64 header size][u64 size][block], keeps 16B alignment of the block
+static constexpr size_t TAG_HEADER_SIZE = 16;
+
+TagAllocator::TagAllocator(IAllocator& source, const char* tag_name)
+	: m_source(source)
+	, m_tag_name(tag_name)
+{
+	MutexGuard guard(g_tag_allocators_mutex);
+	m_next = g_first_tag_allocator;
+	if (m_next) m_next->m_prev = this;
+	g_first_tag_allocator = this;
+}
+
+TagAllocator::~TagAllocator() {
+	ASSERT(m_live_bytes == 0);
+	MutexGuard guard(g_tag_allocators_mutex);
+	if (m_prev) m_prev->m_next = m_next;
+	else g_first_tag_allocator = m_next;
+	if (m_next) m_next->m_prev = m_prev;
+}
+
+TagAllocator* TagAllocator::getFirst() { return g_first_tag_allocator; }
+
+void TagAllocator::setBudget(u64 bytes, bool assert_on_overflow) {
+	m_budget = bytes;
+	m_assert_on_overflow = assert_on_overflow;
+	m_is_over_budget = false;
+}
+
+void TagAllocator::onAllocated(i64 size) {
+	const i64 live = atomicAdd(&m_live_bytes, size) + size;
+	if (size <= 0) {
+		if (m_is_over_budget && (u64)live <= m_budget) m_is_over_budget = false;
+		return;
+	}
+
+	for (;;) {
+		const i64 peak = m_peak_bytes;
+		if (live <= peak || compareAndExchange64(&m_peak_bytes, live, peak)) break;
+	}
+
+	if (m_budget != 0 && (u64)live > m_budget && !m_is_over_budget) {
+		// report only once until we get back under budget
+		m_is_over_budget = true;
+		logError("Memory budget of ", m_tag_name, " exceeded: ", (u64)live, " / ", m_budget, " bytes");
+		ASSERT(!m_assert_on_overflow);
+	}
+}
+
+void* TagAllocator::allocate_aligned(size_t size, size_t align) {
+	const size_t header_size = maximum(align, TAG_HEADER_SIZE);
+	heap_profiler::TagScope tag_scope(m_tag_name);
+	u8* mem = (u8*)m_source.allocate_aligned(size + header_size, header_size);
+	if (!mem) return nullptr;
+	u8* ptr = mem + header_size;
+	((u64*)ptr)[-1] = size;
+	((u64*)ptr)[-2] = header_size;
+	onAllocated(size);
+	return ptr;
+}
+
+void TagAllocator::deallocate_aligned(void* ptr) {
+	if (!ptr) return;
+	onAllocated(-(i64)((u64*)ptr)[-1]);
+	m_source.deallocate_aligned((u8*)ptr - ((u64*)ptr)[-2]);
+}
+
+void* TagAllocator::reallocate_aligned(void* ptr, size_t size, size_t align) {
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+
+	const u64 old_size = ((u64*)ptr)[-1];
+	const size_t header_size = maximum(align, TAG_HEADER_SIZE);
+	ASSERT(((u64*)ptr)[-2] == header_size);
+	heap_profiler::TagScope tag_scope(m_tag_name);
+	u8* mem = (u8*)m_source.reallocate_aligned((u8*)ptr - header_size, size + header_size, header_size);
+	if (!mem) return nullptr;
+	u8* new_ptr = mem + header_size;
+	((u64*)new_ptr)[-1] = size;
+	onAllocated(i64(size) - i64(old_size));
+	return new_ptr;
+}
+
+void* TagAllocator::allocate(size_t size) {
+	heap_profiler::TagScope tag_scope(m_tag_name);
+	u8* mem = (u8*)m_source.allocate(size + TAG_HEADER_SIZE);
+	if (!mem) return nullptr;
+	u8* ptr = mem + TAG_HEADER_SIZE;
+	((u64*)ptr)[-1] = size;
+	onAllocated(size);
+	return ptr;
+}
+
+void TagAllocator::deallocate(void* ptr) {
+	if (!ptr) return;
+	onAllocated(-(i64)((u64*)ptr)[-1]);
+	m_source.deallocate((u8*)ptr - TAG_HEADER_SIZE);
+}
+
+void* TagAllocator::reallocate(void* ptr, size_t size) {
+	if (!ptr) return allocate(size);
+	if (size == 0) {
+		deallocate(ptr);
+		return nullptr;
+	}
+
+	const u64 old_size = ((u64*)ptr)[-1];
+	heap_profiler::TagScope tag_scope(m_tag_name);
+	u8* mem = (u8*)m_source.reallocate((u8*)ptr - TAG_HEADER_SIZE, size + TAG_HEADER_SIZE);
+	if (!mem) return nullptr;
+	u8* new_ptr = mem + TAG_HEADER_SIZE;
+	((u64*)new_ptr)[-1] = size;
+	onAllocated(i64(size) - i64(old_size));
+	return new_ptr;
+}
+
 } // namespace Lumix
@@ -18,10 +18,79 @@ struct LUMIX_ENGINE_API DefaultAllocator final : IAllocator {
 	void deallocate_aligned(void* ptr) override;
 	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
 
+	// small allocations freed by a thread are kept for reuse by the same thread, without locking m_mutex
+	// each cache has its own cache line, so threads do not false-share
+	struct alignas(64) ThreadCache {
+		void* free_items[4] = {};
+		u32 counts[4] = {};
+	};
+
 	u8* m_small_allocations = nullptr;
 	Page* m_free_lists[4];
 	u32 m_page_count = 0;
 	Mutex m_mutex;
+	ThreadCache m_thread_caches[64];
+	// all default allocators are linked in a global list, so an exiting thread can flush its caches
+	DefaultAllocator* m_next = nullptr;
+	DefaultAllocator* m_prev = nullptr;
+};
+
+
+// allocates by bumping an offset in reserved virtual memory, deallocate is noop
+// memory is freed all at once by reset() or rewind()
+struct LUMIX_ENGINE_API LinearAllocator final : IAllocator {
+	explicit LinearAllocator(u32 reserve);
+	~LinearAllocator();
+
+	void reset() { rewind(0); }
+	// frees everything allocated after getOffset() returned `offset`
+	void rewind(u32 offset);
+	u32 getOffset() const { return m_end; }
+	u32 getCommitedBytes() const { return m_commited_bytes; }
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+private:
+	u32 m_reserved;
+	volatile i32 m_end = 0;
+	volatile i32 m_commited_bytes = 0;
+	u8* m_mem;
+	Mutex m_mutex;
+};
+
+
+// memory for data living at most one frame, allocated by bumping a pointer in thread-local pages from PageAllocator
+// deallocate is noop, everything is freed at once by reset(), which must not run concurrently with allocations
+struct LUMIX_ENGINE_API FrameAllocator final : IAllocator {
+	FrameAllocator(struct PageAllocator& page_allocator, IAllocator& fallback);
+	~FrameAllocator();
+
+	void reset();
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+private:
+	void* allocateBig(size_t size, size_t align);
+
+	PageAllocator& m_page_allocator;
+	// allocations too big for a page
+	IAllocator& m_fallback;
+	// thread-local pages from older epochs are not used
+	u32 m_epoch;
+	// linked through the first pointer in each page / big block
+	void* m_pages = nullptr;
+	void* m_big_allocations = nullptr;
+	Mutex m_mutex;
 };
 
 
@@ -43,4 +112,44 @@ private:
 };
 
 
-} // namespace Lumix
\ No newline at end of file
+// counts live bytes allocated by a subsystem, all tag allocators are linked in a global list
+// memory must be freed through the same tag allocator, since each block has a size header
+struct LUMIX_ENGINE_API TagAllocator final : IAllocator {
+	TagAllocator(IAllocator& source, const char* tag_name);
+	~TagAllocator();
+
+	// 0 == no budget; exceeding the budget logs an error and, if `assert_on_overflow`, asserts
+	void setBudget(u64 bytes, bool assert_on_overflow = false);
+	u64 getBudget() const { return m_budget; }
+	u64 getLiveBytes() const { return (u64)m_live_bytes; }
+	u64 getPeakBytes() const { return (u64)m_peak_bytes; }
+	const char* getTagName() const { return m_tag_name; }
+	IAllocator& getSourceAllocator() { return m_source; }
+
+	// the list must not be modified while iterating, i.e. do not create or destroy tag allocators in the meantime
+	static TagAllocator* getFirst();
+	TagAllocator* getNext() const { return m_next; }
+
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+
+private:
+	void onAllocated(i64 size);
+
+	IAllocator& m_source;
+	const char* m_tag_name;
+	volatile i64 m_live_bytes = 0;
+	volatile i64 m_peak_bytes = 0;
+	u64 m_budget = 0;
+	bool m_assert_on_overflow = false;
+	bool m_is_over_budget = false;
+	TagAllocator* m_next = nullptr;
+	TagAllocator* m_prev = nullptr;
+};
+
+
+} // namespace Lumix
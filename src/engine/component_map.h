@@ -0,0 +1,121 @@
+#pragma once
+
+#include "engine/array.h"
+#include "engine/lumix.h"
+
+namespace Lumix {
+
+// component storage, values are packed in a dense array, removal is swap-and-pop
+// sparse array maps entity index to dense index
+// API mirrors HashMap<EntityRef, T>, but iteration is linear and pointers are not stable
+template <typename T> struct ComponentMap {
+	template <typename Map, typename V>
+	struct IteratorBase {
+		Map* map;
+		u32 idx;
+
+		bool isValid() const { return idx < map->m_values.size(); }
+		EntityRef key() const { return map->m_keys[idx]; }
+		V& value() const { return map->m_values[idx]; }
+		V& operator*() const { return value(); }
+		IteratorBase& operator++() { ++idx; return *this; }
+		bool operator!=(const IteratorBase& rhs) const { return idx != rhs.idx; }
+		bool operator==(const IteratorBase& rhs) const { return idx == rhs.idx; }
+	};
+
+	using Iterator = IteratorBase<ComponentMap, T>;
+	using ConstIterator = IteratorBase<const ComponentMap, const T>;
+
+	explicit ComponentMap(IAllocator& allocator)
+		: m_values(allocator)
+		, m_keys(allocator)
+		, m_sparse(allocator)
+	{}
+
+	Iterator begin() { return {this, 0}; }
+	Iterator end() { return {this, (u32)m_values.size()}; }
+	ConstIterator begin() const { return {this, 0}; }
+	ConstIterator end() const { return {this, (u32)m_values.size()}; }
+
+	Iterator find(EntityRef e) { return {this, getDenseIndex(e)}; }
+	ConstIterator find(EntityRef e) const { return {this, getDenseIndex(e)}; }
+
+	T& operator[](EntityRef e) {
+		const u32 idx = getDenseIndex(e);
+		ASSERT(idx < m_values.size());
+		return m_values[idx];
+	}
+
+	const T& operator[](EntityRef e) const {
+		const u32 idx = getDenseIndex(e);
+		ASSERT(idx < m_values.size());
+		return m_values[idx];
+	}
+
+	T& insert(EntityRef e) {
+		addKey(e);
+		return m_values.emplace();
+	}
+
+	T& insert(EntityRef e, const T& value) {
+		addKey(e);
+		m_values.push(value);
+		return m_values.back();
+	}
+
+	T& insert(EntityRef e, T&& value) {
+		addKey(e);
+		m_values.push(static_cast<T&&>(value));
+		return m_values.back();
+	}
+
+	void erase(EntityRef e) {
+		const u32 idx = getDenseIndex(e);
+		ASSERT(idx < m_values.size());
+		const EntityRef last = m_keys.back();
+		m_sparse[last.index] = idx;
+		m_sparse[e.index] = -1;
+		m_values.swapAndPop(idx);
+		m_keys.swapAndPop(idx);
+	}
+
+	void erase(const Iterator& iter) { erase(iter.key()); }
+
+	void reserve(u32 capacity) {
+		m_values.reserve(capacity);
+		m_keys.reserve(capacity);
+	}
+
+	void clear() {
+		m_values.clear();
+		m_keys.clear();
+		m_sparse.clear();
+	}
+
+	u32 size() const { return m_values.size(); }
+	bool empty() const { return m_values.empty(); }
+
+private:
+	u32 getDenseIndex(EntityRef e) const {
+		if (e.index >= (i32)m_sparse.size()) return m_values.size();
+		const i32 idx = m_sparse[e.index];
+		return idx < 0 ? m_values.size() : (u32)idx;
+	}
+
+	void addKey(EntityRef e) {
+		if (e.index >= (i32)m_sparse.size()) {
+			const u32 old_size = m_sparse.size();
+			m_sparse.resize(e.index + 1);
+			for (u32 i = old_size; i < m_sparse.size(); ++i) m_sparse[i] = -1;
+		}
+		ASSERT(m_sparse[e.index] < 0);
+		m_sparse[e.index] = m_values.size();
+		m_keys.push(e);
+	}
+
+	Array<T> m_values;
+	Array<EntityRef> m_keys;
+	Array<i32> m_sparse;
+};
+
+} // namespace Lumix
@@ -50,6 +50,26 @@ struct CoreSceneImpl : CoreScene {
 		}
 	}
 
+	// only fills m_splines
+	bool isDeserializeThreadSafe() const override { return true; }
+
+	// splines are small, so they are simply serialized
+	bool registerSnapshot(SnapshotLayout& layout) override { return true; }
+	void serializeSnapshot(OutputMemoryStream& blob) override { serialize(blob); }
+
+	void deserializeSnapshot(InputMemoryStream& blob) override {
+		m_splines.clear();
+		const u32 count = blob.read<u32>();
+		m_splines.reserve(count);
+		for (u32 i = 0; i < count; ++i) {
+			Spline spline(m_allocator);
+			const EntityRef e = blob.read<EntityRef>();
+			spline.points.resize(blob.read<u32>());
+			blob.read(spline.points.begin(), spline.points.byte_size());
+			m_splines.insert(e, static_cast<Spline&&>(spline));
+		}
+	}
+
 	IPlugin& getPlugin() const override { return m_plugin; }
 	void update(float time_delta, bool paused) override {}
 	Universe& getUniverse() override { return m_universe; }
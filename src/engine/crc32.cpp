@@ -1,4 +1,6 @@
 #include "engine/crc32.h"
+#include "engine/crt.h"
+#include "engine/string.h"
 
 
 namespace Lumix
@@ -51,58 +53,74 @@ static u32 crc32Table[256] = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d};
 
 
-u32 crc32(const void* data, u32 length)
-{
-	const u8* c = static_cast<const u8*>(data);
-	u32 crc = 0xffffFFFF;
-	u32 len = length;
-	while (len)
-	{
+// tables for slicing-by-8, k-th table is crc of a byte followed by k zero bytes
+// generated at compile time, so crc32 can be used in static initializers of other modules
+struct Crc32Tables {
+	u32 t[8][256];
+};
+
+static constexpr Crc32Tables makeCrc32Tables() {
+	Crc32Tables res = {};
+	for (u32 i = 0; i < 256; ++i) {
+		u32 crc = i;
+		for (u32 j = 0; j < 8; ++j) crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		res.t[0][i] = crc;
+	}
+	for (u32 i = 0; i < 256; ++i) {
+		for (u32 k = 1; k < 8; ++k) {
+			const u32 prev = res.t[k - 1][i];
+			res.t[k][i] = (prev >> 8) ^ res.t[0][prev & 0xff];
+		}
+	}
+	return res;
+}
+
+static constexpr Crc32Tables crc32Tables = makeCrc32Tables();
+
+
+// 8 bytes per iteration, byte table is used for the rest
+static u32 update(u32 crc, const u8* c, u32 length) {
+	const auto& t = crc32Tables.t;
+	while (length >= 8) {
+		u32 one, two;
+		memcpy(&one, c, sizeof(one));
+		memcpy(&two, c + 4, sizeof(two));
+		one ^= crc;
+		crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^ t[5][(one >> 16) & 0xff] ^ t[4][one >> 24]
+			^ t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^ t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+		c += 8;
+		length -= 8;
+	}
+	while (length) {
 		crc = (crc >> 8) ^ crc32Table[(crc & 0xFF) ^ *c];
-		--len;
+		--length;
 		++c;
 	}
-	return ~crc;
+	return crc;
+}
+
+
+u32 crc32(const void* data, u32 length)
+{
+	return ~update(0xffffFFFF, static_cast<const u8*>(data), length);
 }
 
 
 u32 crc32(const char* str)
 {
-	const u8* c = reinterpret_cast<const u8*>(str);
-	u32 crc = 0xffffFFFF;
-	while (*c)
-	{
-		crc = (crc >> 8) ^ crc32Table[(crc & 0xFF) ^ *c];
-		++c;
-	}
-	return ~crc;
+	return ~update(0xffffFFFF, reinterpret_cast<const u8*>(str), stringLength(str));
 }
 
 
 u32 continueCrc32(u32 original_crc, const char* str)
 {
-	const u8* c = reinterpret_cast<const u8*>(str);
-	u32 crc = ~original_crc;
-	while (*c)
-	{
-		crc = (crc >> 8) ^ crc32Table[(crc & 0xFF) ^ *c];
-		++c;
-	}
-	return ~crc;
+	return ~update(~original_crc, reinterpret_cast<const u8*>(str), stringLength(str));
 }
 
 
 u32 continueCrc32(u32 original_crc, const void* data, u32 length)
 {
-	const u8* c = reinterpret_cast<const u8*>(data);
-	u32 crc = ~original_crc;
-	while (length)
-	{
-		crc = (crc >> 8) ^ crc32Table[(crc & 0xFF) ^ *c];
-		++c;
-		--length;
-	}
-	return ~crc;
+	return ~update(~original_crc, static_cast<const u8*>(data), length);
 }
 
 
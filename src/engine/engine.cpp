@@ -1,13 +1,17 @@
+#include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/core.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
 #include "engine/input_system.h"
 #include "engine/plugin.h"
+#include "engine/job_graph.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
+#include "engine/lua_wrapper.h"
 #include "engine/math.h"
 #include "engine/page_allocator.h"
 #include "engine/path.h"
@@ -66,26 +70,50 @@ public:
 
 	EngineImpl(InitArgs&& init_data, IAllocator& allocator)
 		: m_allocator(allocator)
+		, m_lua_tag_allocator(allocator, "lua")
+		, m_lua_allocator(m_lua_tag_allocator)
+		, m_page_allocator(init_data.use_large_pages)
+		, m_frame_allocator(m_page_allocator, m_allocator)
 		, m_prefab_resource_manager(m_allocator)
 		, m_resource_manager(m_allocator)
 		, m_lua_resources(m_allocator)
+		, m_scene_graphs(m_allocator)
+		, m_scene_stages(m_allocator)
+		, m_scene_nodes(m_allocator)
+		, m_scene_graph_scenes(m_allocator)
+		, m_scene_graph_accesses(m_allocator)
 		, m_last_lua_resource_idx(-1)
 		, m_is_game_running(false)
 		, m_last_time_delta(0)
 		, m_time_multiplier(1.0f)
 		, m_paused(false)
 		, m_next_frame(false)
+		, m_headless(init_data.headless)
+		, m_binary_log(init_data.binary_log)
+		, m_window_handle(os::INVALID_WINDOW)
 	{
 		os::init();
-		os::InitWindowArgs init_win_args;
-		init_win_args.handle_file_drops = init_data.handle_file_drops;
-		init_win_args.name = init_data.window_title;
-		m_window_handle = os::createWindow(init_win_args);
-		if (m_window_handle == os::INVALID_WINDOW) {
-			logError("Failed to create main window.");
+		if (!m_headless) {
+			os::InitWindowArgs init_win_args;
+			init_win_args.handle_file_drops = init_data.handle_file_drops;
+			init_win_args.name = init_data.window_title;
+			m_window_handle = os::createWindow(init_win_args);
+			if (m_window_handle == os::INVALID_WINDOW) {
+				logError("Failed to create main window.");
+			}
 		}
 
-		m_is_log_file_open = m_log_file.open("lumix.log");
+		m_is_log_file_open = m_log_file.open(m_binary_log ? "lumix_log.bin" : "lumix.log");
+		if (m_is_log_file_open && m_binary_log) {
+			LogFileHeader header;
+			header.frequency = os::Timer::getFrequency();
+			if (!m_log_file.write(&header, sizeof(header))) {
+				m_log_file.close();
+				m_is_log_file_open = false;
+				m_binary_log = false;
+				logError("Failed to write binary log header, binary logging disabled.");
+			}
+		}
 		
 		logInfo("Creating engine...");
 		profiler::setThreadName("Worker");
@@ -96,7 +124,7 @@ public:
 
 		os::logInfo();
 
-		m_state = luaL_newstate();
+		m_state = LuaWrapper::newState(m_lua_allocator);
 		luaL_openlibs(m_state);
 
 		registerEngineAPI(m_state, this);
@@ -114,6 +142,7 @@ public:
 		}
 
 		m_resource_manager.init(*m_file_system);
+		m_resource_manager.setUnusedBudget(init_data.unused_resources_budget);
 		m_prefab_resource_manager.create(PrefabResource::TYPE, m_resource_manager);
 
 		m_plugin_manager = PluginManager::create(*this);
@@ -121,23 +150,27 @@ public:
 
 		logInfo("Engine created.");
 
-		PluginManager::createAllStatic(*this);
+		// startup timeline is visible in profiler
+		{
+			PROFILE_BLOCK("create plugins");
+			PluginManager::createAllStatic(*this);
 
-		m_plugin_manager->addPlugin(createCorePlugin(*this));
+			m_plugin_manager->addPlugin(createCorePlugin(*this));
 
-		#ifdef LUMIXENGINE_PLUGINS
-			const char* plugins[] = { LUMIXENGINE_PLUGINS };
-			for (auto* plugin_name : plugins) {
+			#ifdef LUMIXENGINE_PLUGINS
+				const char* plugins[] = { LUMIXENGINE_PLUGINS };
+				for (auto* plugin_name : plugins) {
+					if (plugin_name[0] && !m_plugin_manager->load(plugin_name)) {
+						logInfo(plugin_name, " plugin has not been loaded");
+					}
+				}
+			#endif
+
+			for (auto* plugin_name : init_data.plugins) {
 				if (plugin_name[0] && !m_plugin_manager->load(plugin_name)) {
 					logInfo(plugin_name, " plugin has not been loaded");
 				}
 			}
-		#endif
-
-		for (auto* plugin_name : init_data.plugins) {
-			if (plugin_name[0] && !m_plugin_manager->load(plugin_name)) {
-				logInfo(plugin_name, " plugin has not been loaded");
-			}
 		}
 
 		m_plugin_manager->initPlugins();
@@ -145,6 +178,9 @@ public:
 
 	~EngineImpl()
 	{
+		// unused resources hold their dependencies, flush them while all managers are still alive
+		m_resource_manager.setUnusedBudget(0);
+		m_resource_manager.releasePrefetched();
 		m_prefab_resource_manager.destroy();
 		for (Resource* res : m_lua_resources) {
 			res->decRefCount();
@@ -159,7 +195,7 @@ public:
 		unregisterLogCallback<&EngineImpl::logToFile>(this);
 		m_log_file.close();
 		m_is_log_file_open = false;
-		os::destroyWindow(m_window_handle);
+		if (m_window_handle != os::INVALID_WINDOW) os::destroyWindow(m_window_handle);
 	}
 
 	static void logToDebugOutput(LogLevel level, const char* message)
@@ -174,6 +210,25 @@ public:
 	void logToFile(LogLevel level, const char* message)
 	{
 		if (!m_is_log_file_open) return;
+		if (m_binary_log) {
+			LogRecord record;
+			record.timestamp = getLogTimestamp();
+			record.level = (u32)level;
+			record.size = stringLength(message);
+			bool success = m_log_file.write(&record, sizeof(record));
+			success = m_log_file.write(message, record.size) && success;
+			if (!success) {
+				// we are inside a log callback, logError would reenter the logger
+				m_log_file.close();
+				m_is_log_file_open = false;
+				m_binary_log = false;
+				logToDebugOutput(LogLevel::ERROR, "Failed to write to binary log, binary logging disabled.");
+				return;
+			}
+			// no formatting and no flush of every message, for high volume server logs
+			if (level == LogLevel::ERROR) m_log_file.flush();
+			return;
+		}
 		bool success = true;
 		if (level == LogLevel::ERROR) {
 			success = m_log_file.write("Error: ", stringLength("Error :"));
@@ -185,8 +240,10 @@ public:
 	}
 
 	os::WindowHandle getWindowHandle() override { return m_window_handle; }
+	bool isHeadless() const override { return m_headless; }
 	IAllocator& getAllocator() override { return m_allocator; }
 	PageAllocator& getPageAllocator() override { return m_page_allocator; }
+	FrameAllocator& getFrameAllocator() override { return m_frame_allocator; }
 
 	bool instantiatePrefab(Universe& universe,
 		const struct PrefabResource& prefab,
@@ -210,6 +267,120 @@ public:
 		return true;
 	}
 
+	// full parse, also records offsets of universe and scene data in `prefab.compiled`
+	bool compilePrefab(Universe& universe, PrefabResource& prefab, EntityMap& entity_map)
+	{
+		PROFILE_FUNCTION();
+		PrefabResource::Template& tpl = prefab.compiled;
+		tpl.scenes.clear();
+
+		InputMemoryStream blob(prefab.data);
+		SerializedEngineHeader header;
+		blob.read(header);
+		if (header.magic != SERIALIZED_ENGINE_MAGIC) {
+			logError("Wrong or corrupted file");
+			return false;
+		}
+		if (header.version > (u32)SerializedEngineVersion::LATEST) {
+			logError("Unsupported version");
+			return false;
+		}
+		if (!hasSerializedPlugins(blob)) return false;
+
+		const SerializedEngineVersion version = (SerializedEngineVersion)header.version;
+		tpl.version = header.version;
+		tpl.universe_offset = (u32)blob.getPosition();
+		universe.deserialize(blob, entity_map, version);
+		i32 scene_count;
+		blob.read(scene_count);
+		for (i32 i = 0; i < scene_count; ++i) {
+			const char* tmp = blob.readString();
+			const u32 scene_hash = crc32(tmp);
+			IScene* scene = universe.getScene(scene_hash);
+			const i32 scene_version = blob.read<i32>();
+			if (version < SerializedEngineVersion::CHUNKED) {
+				scene->deserialize(blob, entity_map, scene_version);
+				continue;
+			}
+
+			const u32 block_size = blob.read<u32>();
+			const u32 offset = (u32)blob.getPosition();
+			const void* block = blob.skip(block_size);
+			if (!scene) {
+				logWarning("Skipping data of unknown scene ", tmp);
+				continue;
+			}
+			InputMemoryStream block_blob(block, block_size);
+			scene->deserialize(block_blob, entity_map, scene_version);
+			tpl.scenes.push({scene_hash, scene_version, offset, block_size});
+		}
+		// old prefabs do not have size prefixed scene blocks, so they are always fully parsed
+		tpl.is_compiled = version >= SerializedEngineVersion::CHUNKED;
+		return true;
+	}
+
+
+	bool instantiatePrefabs(Universe& universe,
+		PrefabResource& prefab,
+		Span<const Transform> transforms,
+		Array<EntityRef>& roots,
+		Array<EntityRef>& entities) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(prefab.isReady());
+		if (transforms.length() == 0) return true;
+
+		// flat hierarchy would be rebuilt after each instance
+		const bool flat_hierarchy = universe.isFlatHierarchyEnabled();
+		if (flat_hierarchy) universe.enableFlatHierarchy(false);
+
+		EntityMap entity_map(m_allocator);
+		Array<IScene*> scenes(m_allocator);
+		const PrefabResource::Template& tpl = prefab.compiled;
+		roots.reserve(roots.size() + transforms.length());
+		bool success = true;
+		for (const Transform& tr : transforms) {
+			entity_map.m_map.clear();
+			if (!tpl.is_compiled) {
+				if (!compilePrefab(universe, prefab, entity_map)) {
+					logError("Failed to instantiate prefab ", prefab.getPath());
+					success = false;
+					break;
+				}
+				scenes.clear();
+			}
+			else {
+				if (scenes.empty()) {
+					for (const PrefabResource::SceneBlock& block : tpl.scenes) {
+						scenes.push(universe.getScene(block.scene_hash));
+					}
+				}
+				InputMemoryStream blob(prefab.data);
+				blob.setPosition(tpl.universe_offset);
+				universe.deserialize(blob, entity_map, (SerializedEngineVersion)tpl.version);
+				for (i32 i = 0, c = tpl.scenes.size(); i < c; ++i) {
+					const PrefabResource::SceneBlock& block = tpl.scenes[i];
+					InputMemoryStream block_blob(prefab.data.data() + block.offset, block.size);
+					if (scenes[i]) scenes[i]->deserialize(block_blob, entity_map, block.version);
+				}
+			}
+
+			ASSERT(!entity_map.m_map.empty());
+			const EntityRef root = (EntityRef)entity_map.m_map[0];
+			ASSERT(!universe.getParent(root).isValid());
+			ASSERT(!universe.getNextSibling(root).isValid());
+			universe.setTransform(root, tr);
+			roots.push(root);
+			for (EntityPtr e : entity_map.m_map) {
+				if (e.isValid()) entities.push((EntityRef)e);
+			}
+		}
+
+		if (flat_hierarchy) universe.enableFlatHierarchy(true);
+		return success;
+	}
+
+
 	Universe& createUniverse(bool is_main_universe) override
 	{
 		Universe* universe = LUMIX_NEW(m_allocator, Universe)(*this, m_allocator);
@@ -270,6 +441,7 @@ public:
 	{
 		ASSERT(m_is_game_running);
 		m_is_game_running = false;
+		context.restoreSimulatedTransforms();
 		for (UniquePtr<IScene>& scene : context.getScenes())
 		{
 			scene->stopGame();
@@ -302,39 +474,213 @@ public:
 	}
 
 
+	void setFixedTimeDelta(float dt) override
+	{
+		m_fixed_time_delta = maximum(dt, 0.f);
+	}
+
+
+	void setSimulationRate(float hz) override
+	{
+		m_simulation_dt = hz > 0 ? 1 / hz : 0;
+		m_simulation_accumulator = 0;
+		m_simulation_alpha = 0;
+	}
+
+
+	float getSimulationAlpha() const override { return m_simulation_alpha; }
+	float getSimulationRate() const override { return m_simulation_dt > 0 ? 1 / m_simulation_dt : 0; }
+
+
+	void simulate(Universe& universe, float dt)
+	{
+		PROFILE_FUNCTION();
+		// it would take longer and longer to catch up if a step is slower than `m_simulation_dt`
+		static constexpr u32 MAX_STEPS_PER_FRAME = 4;
+
+		m_simulation_accumulator += dt;
+		u32 steps = 0;
+		while (m_simulation_accumulator >= m_simulation_dt && steps < MAX_STEPS_PER_FRAME) {
+			universe.beginSimulationStep();
+			updateScenes(universe, m_simulation_dt, false);
+			m_simulation_accumulator -= m_simulation_dt;
+			++steps;
+		}
+		if (steps == MAX_STEPS_PER_FRAME) m_simulation_accumulator = minimum(m_simulation_accumulator, m_simulation_dt * 0.99f);
+		if (steps > 0) universe.endSimulationStep();
+		profiler::pushInt("steps", steps);
+
+		m_simulation_alpha = m_simulation_accumulator / m_simulation_dt;
+	}
+
+
+	static void updateScene(IScene& scene, float dt, bool late, bool paused)
+	{
+		profiler::pushString(scene.getPlugin().getName());
+		if (late) scene.lateUpdate(dt, paused);
+		else scene.update(dt, paused);
+	}
+
+
+	static void updateSceneNode(void* data)
+	{
+		const SceneNode& node = *(const SceneNode*)data;
+		const EngineImpl& engine = *node.engine;
+		updateScene(*node.scene, engine.m_scene_update_dt, engine.m_scene_update_late, engine.m_paused);
+	}
+
+
+	// graphs are rebuilt only when scenes or their access change
+	bool areSceneGraphsValid(Universe& universe)
+	{
+		Array<UniquePtr<IScene>>& scenes = universe.getScenes();
+		if (scenes.size() != m_scene_graph_scenes.size()) return false;
+		for (i32 i = 0, c = scenes.size(); i < c; ++i) {
+			if (scenes[i].get() != m_scene_graph_scenes[i]) return false;
+			const SceneAccess access = scenes[i]->getUpdateAccess();
+			if (access.reads != m_scene_graph_accesses[i].reads || access.writes != m_scene_graph_accesses[i].writes) return false;
+		}
+		return true;
+	}
+
+
+	// exclusive scenes split scenes into stages, other scenes in a stage form a graph,
+	// in which each scene depends on the preceding scenes it conflicts with
+	void buildSceneGraphs(Universe& universe)
+	{
+		PROFILE_FUNCTION();
+		Array<UniquePtr<IScene>>& scenes = universe.getScenes();
+		m_scene_stages.clear();
+		m_scene_graph_scenes.clear();
+		m_scene_graph_accesses.clear();
+		m_scene_nodes.clear();
+		// nodes point to these, so they must not move
+		m_scene_nodes.reserve(scenes.size());
+		for (UniquePtr<jobs::Graph>& graph : m_scene_graphs) graph->clear();
+
+		u32 used_graphs = 0;
+		jobs::Graph* graph = nullptr;
+		// first scene of the current graph in m_scene_graph_accesses
+		i32 graph_begin = 0;
+		for (UniquePtr<IScene>& scene : scenes) {
+			const SceneAccess access = scene->getUpdateAccess();
+			m_scene_graph_scenes.push(scene.get());
+			m_scene_graph_accesses.push(access);
+
+			const bool is_exclusive = access.reads == SceneAccess::ALL && access.writes == SceneAccess::ALL;
+			if (is_exclusive) {
+				m_scene_stages.push({scene.get(), nullptr});
+				graph = nullptr;
+				continue;
+			}
+
+			if (!graph) {
+				if (used_graphs == (u32)m_scene_graphs.size()) {
+					m_scene_graphs.push(UniquePtr<jobs::Graph>::create(m_allocator, m_allocator));
+				}
+				graph = m_scene_graphs[used_graphs].get();
+				++used_graphs;
+				m_scene_stages.push({nullptr, graph});
+				graph_begin = m_scene_graph_accesses.size() - 1;
+			}
+
+			m_scene_nodes.push({this, scene.get()});
+			const jobs::Graph::NodeHandle node = graph->addNode("update scene", &m_scene_nodes.back(), &updateSceneNode, jobs::Priority::HIGH);
+			// each scene iterates its own components
+			const u32 reads = access.reads | SceneAccess::COMPONENTS;
+			for (i32 i = graph_begin, c = m_scene_graph_accesses.size() - 1; i < c; ++i) {
+				const SceneAccess& prev = m_scene_graph_accesses[i];
+				const u32 prev_reads = prev.reads | SceneAccess::COMPONENTS;
+				const bool conflicts = (access.writes & (prev_reads | prev.writes)) || (reads & prev.writes);
+				// nodes are added in scene order, so the node of `prev` is `i - graph_begin`
+				if (conflicts) graph->addDependency(node, jobs::Graph::NodeHandle(i - graph_begin));
+			}
+		}
+	}
+
+
+	// keeps the order of conflicting scenes, non-conflicting scenes are updated at the same time
+	void updateScenes(Universe& universe, float dt, bool late)
+	{
+		if (!areSceneGraphsValid(universe)) buildSceneGraphs(universe);
+
+		m_scene_update_dt = dt;
+		m_scene_update_late = late;
+		for (const SceneStage& stage : m_scene_stages) {
+			if (stage.exclusive) {
+				PROFILE_BLOCK("update scene");
+				updateScene(*stage.exclusive, dt, late, m_paused);
+			}
+			else {
+				stage.graph->run();
+				stage.graph->wait();
+			}
+		}
+	}
+
+
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
+		m_frame_allocator.reset();
 		float dt = m_timer.tick() * m_time_multiplier;
+		if (m_fixed_time_delta > 0) dt = m_fixed_time_delta * m_time_multiplier;
 		if (m_next_frame)
 		{
 			m_paused = false;
 			dt = 1 / 30.0f;
 		}
 		m_last_time_delta = dt;
-		{
+		if (m_simulation_dt > 0) {
+			// interpolated in the previous frame, steps and lateUpdate work with simulated transforms
+			context.restoreSimulatedTransforms();
+			simulate(context, dt);
+		}
+		else {
 			PROFILE_BLOCK("update scenes");
-			for (UniquePtr<IScene>& scene : context.getScenes())
-			{
-				scene->update(dt, m_paused);
-			}
+			updateScenes(context, dt, false);
 		}
 		{
 			PROFILE_BLOCK("late update scenes");
-			for (UniquePtr<IScene>& scene : context.getScenes())
-			{
-				scene->lateUpdate(dt, m_paused);
-			}
+			updateScenes(context, dt, true);
 		}
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		m_file_system->processCallbacks();
+		// all loads, which could reference prefetched resources, are done by now
+		if (!m_file_system->hasWork()) m_resource_manager.releasePrefetched();
 
 		if (m_next_frame)
 		{
 			m_paused = true;
 			m_next_frame = false;
 		}
+		context.advanceJournal();
+
+		if (m_lua_gc_budget_ms > 0) {
+			PROFILE_BLOCK("lua gc");
+			LuaWrapper::stepGC(m_state, m_lua_gc_budget_ms);
+			profiler::pushInt("allocated KB", int(m_lua_allocator.getAllocatedBytes() >> 10));
+			profiler::pushInt("pooled KB", int(m_lua_allocator.getPooledBytes() >> 10));
+		}
+		publishCounters();
+		// the frame is rendered next, nothing in this frame reads or modifies interpolated transforms
+		if (m_simulation_dt > 0) context.interpolateTransforms(m_simulation_alpha);
+	}
+
+
+	void publishCounters()
+	{
+		if (m_queued_jobs_counter == profiler::INVALID_COUNTER) {
+			m_queued_jobs_counter = profiler::createCounter("queued jobs", profiler::CounterType::GAUGE);
+		}
+		profiler::setCounter(m_queued_jobs_counter, jobs::getQueuedJobsCount());
+
+		// tag allocators are created and destroyed with plugins, so counters are looked up by name
+		for (TagAllocator* a = TagAllocator::getFirst(); a; a = a->getNext()) {
+			const StaticString<32> name(a->getTagName(), " KB");
+			profiler::setCounter(profiler::createCounter(name, profiler::CounterType::GAUGE), a->getLiveBytes() >> 10);
+		}
 	}
 
 
@@ -416,9 +762,10 @@ public:
 
 	u32 serialize(Universe& ctx, OutputMemoryStream& serializer) override
 	{
+		ctx.restoreSimulatedTransforms();
 		SerializedEngineHeader header;
 		header.magic = SERIALIZED_ENGINE_MAGIC; // == '_LEN'
-		header.version = 0;
+		header.version = (u32)SerializedEngineVersion::LATEST;
 		serializer.write(header);
 		serializePluginList(serializer);
 		i32 pos = (i32)serializer.size();
@@ -427,15 +774,49 @@ public:
 		for (UniquePtr<IScene>& scene : ctx.getScenes()) {
 			serializer.writeString(scene->getPlugin().getName());
 			serializer.write(scene->getVersion());
+			// size prefixed, so the block can be skipped or handed out without parsing it
+			const u64 size_pos = serializer.size();
+			serializer.write((u32)0);
 			scene->serialize(serializer);
+			const u32 block_size = u32(serializer.size() - size_pos - sizeof(u32));
+			memcpy(serializer.getMutableData() + size_pos, &block_size, sizeof(block_size));
 		}
 		u32 crc = crc32((const u8*)serializer.data() + pos, (i32)serializer.size() - pos);
 		return crc;
 	}
 
 
+	u32 serialize(Universe& ctx, OutputPagedStream& serializer) override
+	{
+		ctx.restoreSimulatedTransforms();
+		OutputMemoryStream scratch(m_allocator);
+		SerializedEngineHeader header;
+		header.magic = SERIALIZED_ENGINE_MAGIC; // == '_LEN'
+		header.version = (u32)SerializedEngineVersion::LATEST;
+		scratch.write(header);
+		serializePluginList(scratch);
+		serializer.write(scratch.data(), scratch.size());
+		const u64 pos = serializer.size();
+
+		scratch.clear();
+		ctx.serialize(scratch);
+		serializer.write(scratch.data(), scratch.size());
+		serializer.write((i32)ctx.getScenes().size());
+		for (UniquePtr<IScene>& scene : ctx.getScenes()) {
+			serializer.writeString(scene->getPlugin().getName());
+			serializer.write(scene->getVersion());
+			scratch.clear();
+			scene->serialize(scratch);
+			serializer.write((u32)scratch.size());
+			serializer.write(scratch.data(), scratch.size());
+		}
+		return serializer.computeCrc32(pos);
+	}
+
+
 	bool deserialize(Universe& ctx, InputMemoryStream& serializer, EntityMap& entity_map) override
 	{
+		PROFILE_FUNCTION();
 		SerializedEngineHeader header;
 		serializer.read(header);
 		if (header.magic != SERIALIZED_ENGINE_MAGIC)
@@ -443,22 +824,72 @@ public:
 			logError("Wrong or corrupted file");
 			return false;
 		}
+		if (header.version > (u32)SerializedEngineVersion::LATEST) {
+			logError("Unsupported version");
+			return false;
+		}
 		if (!hasSerializedPlugins(serializer)) return false;
 
-		ctx.deserialize(serializer, entity_map);
+		const SerializedEngineVersion version = (SerializedEngineVersion)header.version;
+		ctx.deserialize(serializer, entity_map, version);
 		i32 scene_count;
 		serializer.read(scene_count);
+		Array<SceneBlock> blocks(m_allocator);
+		Array<IScene*> thread_safe_scenes(m_allocator);
 		for (int i = 0; i < scene_count; ++i)
 		{
 			const char* tmp = serializer.readString();
 			IScene* scene = ctx.getScene(crc32(tmp));
-			const i32 version = serializer.read<i32>();
-			scene->deserialize(serializer, entity_map, version);
+			const i32 scene_version = serializer.read<i32>();
+			if (version < SerializedEngineVersion::CHUNKED) {
+				scene->deserialize(serializer, entity_map, scene_version);
+				continue;
+			}
+
+			const u32 block_size = serializer.read<u32>();
+			const void* block = serializer.skip(block_size);
+			if (!scene) {
+				logWarning("Skipping data of unknown scene ", tmp);
+				continue;
+			}
+			blocks.push({scene, block, block_size, scene_version, &entity_map});
+			if (scene->isDeserializeThreadSafe()) thread_safe_scenes.push(scene);
+		}
+
+		// thread safe scenes are deserialized in jobs, the rest runs here in order at the same time
+		jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+		if (!thread_safe_scenes.empty()) ctx.beginDeferredComponents(thread_safe_scenes);
+		for (SceneBlock& block : blocks) {
+			if (!block.scene->isDeserializeThreadSafe()) continue;
+			jobs::run(&block, [](void* data){
+				deserializeSceneBlock(*(SceneBlock*)data);
+			}, &signal, jobs::Priority::HIGH, jobs::StackSize::LARGE);
 		}
+		for (SceneBlock& block : blocks) {
+			if (!block.scene->isDeserializeThreadSafe()) deserializeSceneBlock(block);
+		}
+		jobs::wait(signal);
+		if (!thread_safe_scenes.empty()) ctx.endDeferredComponents();
 		return true;
 	}
 
 
+	// size prefixed data of one scene, see serialize
+	struct SceneBlock {
+		IScene* scene;
+		const void* data;
+		u32 size;
+		i32 version;
+		const EntityMap* entity_map;
+	};
+
+	static void deserializeSceneBlock(const SceneBlock& block) {
+		PROFILE_BLOCK("deserialize scene");
+		InputMemoryStream blob(block.data, block.size);
+		block.scene->deserialize(blob, *block.entity_map, block.version);
+	}
+
+
 	void unloadLuaResource(LuaResourceHandle resource) override
 	{
 		auto iter = m_lua_resources.find(resource);
@@ -492,11 +923,15 @@ public:
 	InputSystem& getInputSystem() override { return *m_input_system; }
 	ResourceManagerHub& getResourceManager() override { return m_resource_manager; }
 	lua_State* getState() override { return m_state; }
+	void setLuaGCBudget(float ms) override { m_lua_gc_budget_ms = ms; }
 	float getLastTimeDelta() const override { return m_last_time_delta / m_time_multiplier; }
 
 private:
 	IAllocator& m_allocator;
+	TagAllocator m_lua_tag_allocator;
+	LuaWrapper::LuaAllocator m_lua_allocator;
 	PageAllocator m_page_allocator;
+	FrameAllocator m_frame_allocator;
 	UniquePtr<FileSystem> m_file_system;
 	ResourceManagerHub m_resource_manager;
 	UniquePtr<PluginManager> m_plugin_manager;
@@ -504,15 +939,41 @@ private:
 	UniquePtr<InputSystem> m_input_system;
 	os::Timer m_timer;
 	float m_time_multiplier;
+	float m_fixed_time_delta = 0;
+	float m_simulation_dt = 0;
+	float m_simulation_accumulator = 0;
+	float m_simulation_alpha = 0;
 	float m_last_time_delta;
 	bool m_is_game_running;
 	bool m_paused;
 	bool m_next_frame;
+	bool m_headless;
+	bool m_binary_log;
 	os::WindowHandle m_window_handle;
 	lua_State* m_state;
+	// time spent each frame in incremental gc steps, 0 == only automatic gc
+	float m_lua_gc_budget_ms = 0.5f;
+	u32 m_queued_jobs_counter = profiler::INVALID_COUNTER;
 	os::OutputFile m_log_file;
 	bool m_is_log_file_open = false;
 	HashMap<int, Resource*> m_lua_resources;
+	// scene updates, see buildSceneGraphs
+	struct SceneStage {
+		IScene* exclusive; // updated on the calling thread
+		jobs::Graph* graph; // if there's no exclusive scene
+	};
+	struct SceneNode {
+		EngineImpl* engine;
+		IScene* scene;
+	};
+	Array<UniquePtr<jobs::Graph>> m_scene_graphs;
+	Array<SceneStage> m_scene_stages;
+	Array<SceneNode> m_scene_nodes;
+	// scenes and their access the graphs were built for
+	Array<IScene*> m_scene_graph_scenes;
+	Array<SceneAccess> m_scene_graph_accesses;
+	float m_scene_update_dt = 0;
+	bool m_scene_update_late = false;
 	u32 m_last_lua_resource_idx;
 };
 
@@ -8,6 +8,7 @@ struct lua_State;
 namespace Lumix {
 
 namespace os { using WindowHandle = void*; }
+template <typename T> struct Array;
 
 struct LUMIX_ENGINE_API Engine {
 	struct InitArgs {
@@ -16,6 +17,14 @@ struct LUMIX_ENGINE_API Engine {
 		bool handle_file_drops = false;
 		const char* window_title = "Lumix App";
 		UniquePtr<struct FileSystem> file_system; 
+		// back PageAllocator with OS large pages, if available
+		bool use_large_pages = false;
+		// no window is created, renderer does not touch gpu, e.g. dedicated server
+		bool headless = false;
+		// log file is written as LogFileHeader and LogRecords (see log.h) instead of text
+		bool binary_log = false;
+		// per resource type, unreferenced resources are kept loaded within this budget, see ResourceManager::setUnusedBudget
+		u64 unused_resources_budget = 64 * 1024 * 1024;
 	};
 
 	using LuaResourceHandle = u32;
@@ -27,6 +36,7 @@ struct LUMIX_ENGINE_API Engine {
 	virtual struct Universe& createUniverse(bool is_main_universe) = 0;
 	virtual void destroyUniverse(Universe& context) = 0;
 	virtual os::WindowHandle getWindowHandle() = 0;
+	virtual bool isHeadless() const = 0;
 
 	virtual struct FileSystem& getFileSystem() = 0;
 	virtual struct InputSystem& getInputSystem() = 0;
@@ -34,27 +44,49 @@ struct LUMIX_ENGINE_API Engine {
 	virtual struct ResourceManagerHub& getResourceManager() = 0;
 	virtual struct PageAllocator& getPageAllocator() = 0;
 	virtual IAllocator& getAllocator() = 0;
+	// memory allocated from this is freed at the beginning of next update()
+	virtual struct FrameAllocator& getFrameAllocator() = 0;
 	virtual bool instantiatePrefab(Universe& universe,
 		const struct PrefabResource& prefab,
 		const struct DVec3& pos,
 		const struct Quat& rot,
 		float scale,
 		struct EntityMap& entity_map) = 0;
+	// much faster than calling instantiatePrefab for each transform, prefab data is parsed only once
+	// `roots` gets root of each instance, `entities` gets all created entities
+	virtual bool instantiatePrefabs(Universe& universe,
+		struct PrefabResource& prefab,
+		Span<const struct Transform> transforms,
+		Array<EntityRef>& roots,
+		Array<EntityRef>& entities) = 0;
 
 	virtual void startGame(Universe& context) = 0;
 	virtual void stopGame(Universe& context) = 0;
 
 	virtual void update(Universe& context) = 0;
 	virtual u32 serialize(Universe& ctx, struct OutputMemoryStream& serializer) = 0;
+	// same data as above, only the biggest scene is contiguous in memory at once
+	virtual u32 serialize(Universe& ctx, struct OutputPagedStream& serializer) = 0;
 	virtual bool deserialize(Universe& ctx, struct InputMemoryStream& serializer, struct EntityMap& entity_map) = 0;
 	virtual bool deserializeProject(InputMemoryStream& serializer, Span<char> startup_universe) = 0;
 	virtual void serializeProject(OutputMemoryStream& serializer, const char* startup_universe) const = 0;
 	virtual float getLastTimeDelta() const = 0;
 	virtual void setTimeMultiplier(float multiplier) = 0;
+	// each update advances time by `dt` regardless of real time, for deterministic runs; 0 == real time
+	virtual void setFixedTimeDelta(float dt) = 0;
+	// scenes are updated in fixed steps of 1 / `hz`, zero or more times per frame; lateUpdate is still called once per frame
+	// transforms are interpolated between the last two steps until the next step, see Universe::interpolateTransforms
+	// 0 == scenes are updated once per frame
+	virtual void setSimulationRate(float hz) = 0;
+	virtual float getSimulationRate() const = 0;
+	// how far the current frame is between the last two simulation steps, [0, 1)
+	virtual float getSimulationAlpha() const = 0;
 	virtual void pause(bool pause) = 0;
 	virtual bool isPaused() const = 0;
 	virtual void nextFrame() = 0;
 	virtual lua_State* getState() = 0;
+	// ms spent every frame in incremental lua gc steps, so that automatic gc has less work in random frames
+	virtual void setLuaGCBudget(float ms) = 0;
 
 	virtual struct Resource* getLuaResource(LuaResourceHandle idx) const = 0;
 	virtual LuaResourceHandle addLuaResource(const struct Path& path, struct ResourceType type) = 0;
@@ -5,9 +5,9 @@
 #include "engine/crc32.h"
 #include "engine/delegate_list.h"
 #include "engine/flag_set.h"
-#include "engine/hash_map.h"
 #include "engine/metaprogramming.h"
 #include "engine/log.h"
+#include "engine/lz4.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
@@ -32,8 +32,12 @@ struct AsyncItem {
 
 	FileSystem::ContentCallback callback;
 	OutputMemoryStream data;
+	// used instead of data for big files
+	os::MappedFile mapped;
 	StaticString<LUMIX_MAX_PATH> path;
+	StableHash path_hash;
 	u32 id = 0;
+	FileSystem::Priority priority = FileSystem::Priority::NORMAL;
 	FlagSet<Flags, u32> flags;
 };
 
@@ -59,22 +63,36 @@ private:
 
 
 struct FileSystemImpl : FileSystem {
+	// smaller files are read, mapping them is not worth it
+	static constexpr u64 MAPPED_FILE_MIN_SIZE = 256 * 1024;
+	// several reads in flight, so fast drives are not idle while one thread waits
+	static constexpr u32 WORKERS_COUNT = 4;
+
 	explicit FileSystemImpl(const char* base_path, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_queue(allocator)	
+		, m_in_progress(allocator)	
 		, m_finished(allocator)	
 		, m_last_id(0)
 		, m_semaphore(0, 0xffFF)
 	{
 		setBasePath(base_path);
-		m_task.create(*this, m_allocator);
-		m_task->create("Filesystem", true);
+		m_in_flight_counter = profiler::createCounter("io requests in flight", profiler::CounterType::GAUGE);
+		m_read_bytes_counter = profiler::createCounter("io bytes read", profiler::CounterType::SUM);
+		for (Local<FSTask>& task : m_tasks) {
+			task.create(*this, m_allocator);
+			task->create("Filesystem", true);
+		}
 	}
 
 	~FileSystemImpl() override {
-		m_task->stop();
-		m_task->destroy();
-		m_task.destroy();
+		// all workers must be stopped before waking them up, otherwise a running one could eat the signal
+		for (Local<FSTask>& task : m_tasks) task->stop();
+		for (u32 i = 0; i < WORKERS_COUNT; ++i) m_semaphore.signal();
+		for (Local<FSTask>& task : m_tasks) {
+			task->destroy();
+			task.destroy();
+		}
 	}
 
 
@@ -109,7 +127,14 @@ struct FileSystemImpl : FileSystem {
 		return true;
 	}
 
-	AsyncHandle getContent(const Path& file, const ContentCallback& callback) override
+	// big files are mapped, so they are not copied while loading
+	bool mapContent(const Path& path, os::MappedFile& file) override {
+		StaticString<LUMIX_MAX_PATH> full_path(m_base_path, path.c_str());
+		if (os::getFileSize(full_path) < MAPPED_FILE_MIN_SIZE) return false;
+		return file.open(full_path);
+	}
+
+	AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority) override
 	{
 		if (file.isEmpty()) return AsyncHandle::invalid();
 
@@ -120,7 +145,9 @@ struct FileSystemImpl : FileSystem {
 		if (m_last_id == 0) ++m_last_id;
 		item.id = m_last_id;
 		item.path = file.c_str();
+		item.path_hash = file.getStableHash();
 		item.callback = callback;
+		item.priority = priority;
 		m_semaphore.signal();
 		return AsyncHandle(item.id);
 	}
@@ -136,6 +163,13 @@ struct FileSystemImpl : FileSystem {
 				return;
 			}
 		}
+		for (AsyncItem& item : m_in_progress) {
+			if (item.id == async.value) {
+				item.flags.set(AsyncItem::Flags::CANCELED);
+				--m_work_counter;
+				return;
+			}
+		}
 		for (AsyncItem& item : m_finished) {
 			if (item.id == async.value) {
 				item.flags.set(AsyncItem::Flags::CANCELED);
@@ -228,6 +262,7 @@ struct FileSystemImpl : FileSystem {
 	void processCallbacks() override
 	{
 		PROFILE_FUNCTION();
+		profiler::setCounter(m_in_flight_counter, m_work_counter);
 
 		os::Timer timer;
 		for(;;) {
@@ -245,7 +280,12 @@ struct FileSystemImpl : FileSystem {
 			m_mutex.exit();
 
 			if(!item.isCanceled()) {
-				item.callback.invoke(item.data.size(), (const u8*)item.data.data(), !item.isFailed());
+				if (item.mapped.data()) {
+					item.callback.invoke(item.mapped.size(), item.mapped.data(), true);
+				}
+				else {
+					item.callback.invoke(item.data.size(), (const u8*)item.data.data(), !item.isFailed());
+				}
 			}
 
 			if (timer.getTimeSinceStart() > 0.1f) {
@@ -254,11 +294,63 @@ struct FileSystemImpl : FileSystem {
 		}
 	}
 
+	// takes the most important queued request and all other queued requests of the same file, so it's read only once
+	// returns false if there's nothing to read, call only with m_mutex locked
+	bool popQueued(StaticString<LUMIX_MAX_PATH>& path, StableHash& path_hash) {
+		m_queue.eraseItems([](const AsyncItem& item){ return item.isCanceled(); });
+		if (m_queue.empty()) return false;
+
+		u32 best = 0;
+		for (u32 i = 1, c = m_queue.size(); i < c; ++i) {
+			if (m_queue[i].priority < m_queue[best].priority) best = i;
+		}
+
+		path = m_queue[best].path;
+		path_hash = m_queue[best].path_hash;
+		for (i32 i = m_queue.size() - 1; i >= 0; --i) {
+			if (m_queue[i].path_hash != path_hash) continue;
+			m_in_progress.emplace(static_cast<AsyncItem&&>(m_queue[i]));
+			m_queue.erase(i);
+		}
+		// semaphore is still signaled for coalesced items, the workers woken by them find nothing and wait again
+		return true;
+	}
+
+	// moves all requests of the file to m_finished, call only with m_mutex locked
+	void finish(StableHash path_hash, OutputMemoryStream& data, os::MappedFile& mapped, bool success) {
+		const u8* mem = mapped.data() ? mapped.data() : data.data();
+		const u64 size = mapped.data() ? mapped.size() : data.size();
+		bool moved = false;
+		for (i32 i = m_in_progress.size() - 1; i >= 0; --i) {
+			AsyncItem& item = m_in_progress[i];
+			if (item.path_hash != path_hash) continue;
+
+			if (!item.isCanceled()) {
+				AsyncItem& f = m_finished.emplace(static_cast<AsyncItem&&>(item));
+				if (!success) {
+					f.flags.set(AsyncItem::Flags::FAILED);
+				}
+				else if (moved) {
+					f.data.write(mem, size);
+				}
+				else {
+					f.data = static_cast<OutputMemoryStream&&>(data);
+					f.mapped = static_cast<os::MappedFile&&>(mapped);
+					moved = true;
+				}
+			}
+			m_in_progress.erase(i);
+		}
+	}
+
 	IAllocator& m_allocator;
-	Local<FSTask> m_task;
+	Local<FSTask> m_tasks[WORKERS_COUNT];
 	StaticString<LUMIX_MAX_PATH> m_base_path;
 	Array<AsyncItem> m_queue;
+	Array<AsyncItem> m_in_progress;
 	u32 m_work_counter = 0;
+	u32 m_in_flight_counter;
+	u32 m_read_bytes_counter;
 	Array<AsyncItem> m_finished;
 	Mutex m_mutex;
 	Semaphore m_semaphore;
@@ -274,30 +366,19 @@ int FSTask::task()
 		if (m_finish) break;
 
 		StaticString<LUMIX_MAX_PATH> path;
+		StableHash path_hash;
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			ASSERT(!m_fs.m_queue.empty());
-			path = m_fs.m_queue[0].path;
-			if (m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_queue.erase(0);
-				continue;
-			}
+			if (!m_fs.popQueued(path, path_hash)) continue;
 		}
 
 		OutputMemoryStream data(m_fs.m_allocator);
-		bool success = m_fs.getContentSync(Path(path), data);
+		os::MappedFile mapped;
+		const bool success = m_fs.mapContent(Path(path), mapped) || m_fs.getContentSync(Path(path), data);
+		profiler::addCounter(m_fs.m_read_bytes_counter, mapped.data() ? mapped.size() : data.size());
 
-		{
-			MutexGuard lock(m_fs.m_mutex);
-			if (!m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(m_fs.m_queue[0]));
-				m_fs.m_finished.back().data = static_cast<OutputMemoryStream&&>(data);
-				if(!success) {
-					m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
-				}
-			}
-			m_fs.m_queue.erase(0);
-		}
+		MutexGuard lock(m_fs.m_mutex);
+		m_fs.finish(path_hash, data, mapped, success);
 	}
 	return 0;
 }
@@ -306,25 +387,28 @@ int FSTask::task()
 void FSTask::stop()
 {
 	m_finish = true;
-	m_fs.m_semaphore.signal();
 }
 
 struct PackFileSystem : FileSystemImpl {
+	static constexpr u32 BLOCK_CACHE_SIZE = 4;
+
 	PackFileSystem(const char* pak_path, IAllocator& allocator) 
 		: FileSystemImpl("pack://", allocator) 
-		, m_map(allocator)
+		, m_files(allocator)
+		, m_blocks(allocator)
+		, m_block_cache(allocator)
 		, m_allocator(allocator)
 	{
+		for (u32 i = 0; i < BLOCK_CACHE_SIZE; ++i) m_block_cache.emplace(allocator);
+
 		if (!m_file.open(pak_path)) {
 			logError("Failed to open game.pak");
 			return;
 		}
-		const u32 count = m_file.read<u32>();
-		for (u32 i = 0; i < count; ++i) {
-			const u32 hash = m_file.read<u32>();
-			PackFile& f = m_map.insert(hash);
-			f.offset = m_file.read<u64>();
-			f.size = m_file.read<u64>();
+		if (!readIndex()) {
+			logError("Failed to read game.pak");
+			m_files.clear();
+			m_blocks.clear();
 		}
 	}
 
@@ -332,40 +416,183 @@ struct PackFileSystem : FileSystemImpl {
 		m_file.close();
 	}
 
+	bool readIndex() {
+		const u64 file_size = m_file.size();
+		PackFooter footer;
+		if (file_size >= sizeof(footer) 
+			&& m_file.readAt(file_size - sizeof(footer), &footer, sizeof(footer))
+			&& footer.magic == PackFooter::MAGIC)
+		{
+			if (footer.version > PackFooter::VERSION || footer.version < (u32)PackFooter::Version::CRC32_HASH) return false;
+
+			m_files.resize(footer.files_count);
+			m_blocks.resize(footer.blocks_count);
+			if (footer.version == (u32)PackFooter::Version::CRC32_HASH) {
+				#pragma pack(1)
+				struct CRC32Entry {
+					u32 hash;
+					u32 block;
+					u64 offset;
+					u64 size;
+					u64 stored_size;
+					PackCodec codec;
+				};
+				#pragma pack()
+				
+				Array<CRC32Entry> entries(m_allocator);
+				entries.resize(footer.files_count);
+				if (!m_file.readAt(footer.index_offset, entries.begin(), entries.byte_size())) return false;
+				for (u32 i = 0; i < footer.files_count; ++i) {
+					PackEntry& f = m_files[i];
+					const CRC32Entry& e = entries[i];
+					f.hash = e.hash;
+					f.block = e.block;
+					f.offset = e.offset;
+					f.size = e.size;
+					f.stored_size = e.stored_size;
+					f.codec = e.codec;
+				}
+				m_crc32_hashes = true;
+				return m_file.readAt(footer.index_offset + entries.byte_size(), m_blocks.begin(), m_blocks.byte_size());
+			}
+
+			// index is stored sorted by hash, so it's read as is and searched with binary search
+			return m_file.readAt(footer.index_offset, m_files.begin(), m_files.byte_size())
+				&& m_file.readAt(footer.index_offset + m_files.byte_size(), m_blocks.begin(), m_blocks.byte_size());
+		}
+
+		#pragma pack(1)
+		struct LegacyEntry {
+			u32 hash;
+			u64 offset;
+			u64 size;
+		};
+		#pragma pack()
+
+		u32 count;
+		if (!m_file.readAt(0, &count, sizeof(count))) return false;
+		Array<LegacyEntry> legacy(m_allocator);
+		legacy.resize(count);
+		if (!m_file.readAt(sizeof(count), legacy.begin(), legacy.byte_size())) return false;
+
+		const u64 header_size = sizeof(count) + legacy.byte_size();
+		m_crc32_hashes = true;
+		m_files.resize(count);
+		for (u32 i = 0; i < count; ++i) {
+			PackEntry& f = m_files[i];
+			f.hash = legacy[i].hash;
+			f.block = PackEntry::NO_BLOCK;
+			f.offset = legacy[i].offset + header_size;
+			f.size = legacy[i].size;
+			f.stored_size = legacy[i].size;
+			f.codec = PackCodec::NONE;
+		}
+		return true;
+	}
+
+	bool mapContent(const Path& path, os::MappedFile& file) override { return false; }
+
 	bool getContentSync(const Path& path, OutputMemoryStream& content) override {
 		ASSERT(content.size() == 0);
+		const PackEntry* file = m_crc32_hashes ? findCRC32(path) : find(path.getStableHash().getHashValue());
+		if (!file) return false;
+
+		const bool res = file->block == PackEntry::NO_BLOCK
+			? readData(file->offset, file->stored_size, file->size, file->codec, content)
+			: readFromBlock(*file, content);
+		if (!res) logError("Could not read ", path);
+		return res;
+	}
+
+	// positional reads, so workers do not wait for each other
+	bool readData(u64 offset, u64 stored_size, u64 size, PackCodec codec, OutputMemoryStream& out) {
+		out.resize(size);
+		switch (codec) {
+			case PackCodec::NONE:
+				return stored_size == size && m_file.readAt(offset, out.getMutableData(), size);
+			case PackCodec::LZ4: {
+				OutputMemoryStream compressed(m_allocator);
+				compressed.resize(stored_size);
+				if (!m_file.readAt(offset, compressed.getMutableData(), stored_size)) return false;
+				const i32 res = LZ4_decompress_safe((const char*)compressed.data(), (char*)out.getMutableData(), (i32)stored_size, (i32)size);
+				return res == (i32)size;
+			}
+		}
+		return false;
+	}
+
+	// files in a block are usually loaded together, so last few decompressed blocks are kept
+	bool readFromBlock(const PackEntry& file, OutputMemoryStream& content) {
+		{
+			MutexGuard lock(m_block_cache_mutex);
+			for (CachedBlock& cached : m_block_cache) {
+				if (cached.block != file.block) continue;
+
+				cached.last_used = ++m_block_cache_timestamp;
+				if (file.offset + file.size > cached.data.size()) return false;
+				content.write(cached.data.data() + file.offset, file.size);
+				return true;
+			}
+		}
+
+		// block is decompressed without lock, if another worker does the same meanwhile, it's just a wasted work
+		const PackBlock& block = m_blocks[file.block];
+		OutputMemoryStream data(m_allocator);
+		if (!readData(block.offset, block.stored_size, block.size, block.codec, data)) return false;
+		if (file.offset + file.size > data.size()) return false;
+		content.write(data.data() + file.offset, file.size);
+
+		MutexGuard lock(m_block_cache_mutex);
+		CachedBlock* lru = &m_block_cache[0];
+		for (CachedBlock& cached : m_block_cache) {
+			if (cached.last_used < lru->last_used) lru = &cached;
+		}
+		lru->block = file.block;
+		lru->last_used = ++m_block_cache_timestamp;
+		lru->data = static_cast<OutputMemoryStream&&>(data);
+		return true;
+	}
+
+	// old paks are indexed by 32bit hashes, these can collide, so it has a fallback
+	const PackEntry* findCRC32(const Path& path) const {
 		Span<const char> basename = Path::getBasename(path.c_str());
 		u32 hash;
 		fromCString(basename, hash);
 		if (basename[0] < '0' || basename[0] > '9' || hash == 0) {
 			hash = path.getHash();
 		}
-		auto iter = m_map.find(hash);
-		if (!iter.isValid()) {
-			iter = m_map.find(path.getHash());
-			if (!iter.isValid()) return false;
-		}
+		const PackEntry* file = find(hash);
+		if (!file) file = find(path.getHash());
+		return file;
+	}
 
-		content.resize(iter.value().size);
-		MutexGuard lock(m_mutex);
-		const u32 header_size = sizeof(u32) + m_map.size() * (2 * sizeof(u64) + sizeof(u32));
-		if (!m_file.seek(iter.value().offset + header_size) || !m_file.read(content.getMutableData(), content.size())) {
-			logError("Could not read ", path);
-			return false;
+	const PackEntry* find(u64 hash) const {
+		u32 from = 0;
+		u32 to = m_files.size();
+		while (from < to) {
+			const u32 mid = (from + to) / 2;
+			if (m_files[mid].hash < hash) from = mid + 1;
+			else to = mid;
 		}
-
-		return true;
+		return from < (u32)m_files.size() && m_files[from].hash == hash ? &m_files[from] : nullptr;
 	}
-	
-	struct PackFile {
-		u64 offset;
-		u64 size;
+
+	struct CachedBlock {
+		CachedBlock(IAllocator& allocator) : data(allocator) {}
+
+		u32 block = PackEntry::NO_BLOCK;
+		u32 last_used = 0;
+		OutputMemoryStream data;
 	};
 
+	Array<PackEntry> m_files;
+	Array<PackBlock> m_blocks;
+	Array<CachedBlock> m_block_cache;
+	Mutex m_block_cache_mutex;
+	u32 m_block_cache_timestamp = 0;
 	IAllocator& m_allocator;
-	HashMap<u32, PackFile> m_map;
-	Mutex m_mutex;
 	os::InputFile m_file;
+	bool m_crc32_hashes = false;
 };
 
 
@@ -10,12 +10,66 @@ template <typename T> struct UniquePtr;
 namespace os {
 	struct FileIterator;
 	struct InputFile;
+	struct MappedFile;
 	struct OutputFile;
 }
 
+#pragma pack(1)
+// packed file layout: data, PackEntry files_count times sorted by hash, PackBlock blocks_count times, PackFooter
+// old version 1 paks do not have a footer, they start with u32 count, followed by {u32 hash, u64 offset, u64 size} and data
+// version 2 paks have 32bit crc32 hashes, files in .lumix/assets/ are indexed by the hash in their name
+enum class PackCodec : u8 {
+	NONE,
+	LZ4
+};
+
+struct PackEntry {
+	static constexpr u32 NO_BLOCK = 0xffFFffFF;
+	u64 hash; // StableHash of path
+	// NO_BLOCK if the file is stored on its own, offset is then absolute, otherwise it's offset in decompressed block
+	u32 block;
+	u64 offset;
+	u64 size;
+	// ignored for files in blocks
+	u64 stored_size;
+	PackCodec codec;
+};
+
+// small files are stored and compressed together, so they do not need a read each
+struct PackBlock {
+	u64 offset;
+	u32 size;
+	u32 stored_size;
+	PackCodec codec;
+};
+
+struct PackFooter {
+	static constexpr u32 MAGIC = 'LPAK';
+	enum class Version : u32 {
+		CRC32_HASH = 2,
+		STABLE_HASH,
+
+		LAST
+	};
+	static constexpr u32 VERSION = (u32)Version::LAST - 1;
+	u64 index_offset;
+	u32 files_count;
+	u32 blocks_count;
+	u32 version = VERSION;
+	u32 magic = MAGIC;
+};
+#pragma pack()
+
 struct LUMIX_ENGINE_API FileSystem {
 	using ContentCallback = Delegate<void(u64, const u8*, bool)>;
 
+	// requests with higher priority are read first
+	enum class Priority : u8 {
+		HIGH,
+		NORMAL,
+		LOW
+	};
+
 	struct LUMIX_ENGINE_API AsyncHandle {
 		static AsyncHandle invalid() { return AsyncHandle(0xffFFffFF); }
 		explicit AsyncHandle(u32 value) : value(value) {}
@@ -45,7 +99,9 @@ struct LUMIX_ENGINE_API FileSystem {
 	virtual void makeAbsolute(Span<char> absolute, const char* relative) const = 0;
 
 	[[nodiscard]] virtual bool getContentSync(const struct Path& file, struct OutputMemoryStream& content) =  0;
-	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback) = 0;
+	// maps big files, so they are not copied; false for small and packed files, use getContentSync then
+	[[nodiscard]] virtual bool mapContent(const struct Path& file, os::MappedFile& mapped) = 0;
+	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority = Priority::NORMAL) = 0;
 	virtual void cancel(AsyncHandle handle) = 0;
 };
 
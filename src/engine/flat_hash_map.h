@@ -0,0 +1,348 @@
+#pragma once
+
+
+#include "engine/allocator.h"
+#include "engine/crt.h"
+#include "engine/hash_map.h"
+#include "engine/lumix.h"
+#include "engine/simd.h"
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
+
+
+namespace Lumix
+{
+
+
+// open addressing hash map with the same API as HashMap
+// each slot has a control byte (EMPTY or top 7 bits of hash), 16 of them are matched at once with simd
+// linear probing with backward shift erase, so there are no tombstones and lookups stop at the first empty slot
+template<typename Key, typename Value, typename Hasher = HashFunc<Key>>
+struct FlatHashMap
+{
+private:
+	static constexpr u8 EMPTY = 0x80;
+	static constexpr u32 GROUP_SIZE = 16;
+	static constexpr u32 MIN_CAPACITY = GROUP_SIZE;
+
+	template <typename HM, typename K, typename V>
+	struct iterator_base {
+		HM* hm;
+		u32 idx;
+
+		template <typename HM2, typename K2, typename V2>
+		bool operator !=(const iterator_base<HM2, K2, V2>& rhs) const {
+			ASSERT(hm == rhs.hm);
+			return idx != rhs.idx;
+		}
+
+		template <typename HM2, typename K2, typename V2>
+		bool operator ==(const iterator_base<HM2, K2, V2>& rhs) const {
+			ASSERT(hm == rhs.hm);
+			return idx == rhs.idx;
+		}
+
+		void operator++() {
+			const u8* ctrl = hm->m_ctrl;
+			for(u32 i = idx + 1, c = hm->m_capacity; i < c; ++i) {
+				if (ctrl[i] != EMPTY) {
+					idx = i;
+					return;
+				}
+			}
+			idx = hm->m_capacity;
+		}
+
+		K& key() {
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
+			return hm->m_keys[idx];
+		}
+
+		const V& value() const {
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
+			return hm->m_values[idx];
+		}
+
+		V& value() {
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
+			return hm->m_values[idx];
+		}
+
+		V& operator*() {
+			ASSERT(hm->m_ctrl[idx] != EMPTY);
+			return hm->m_values[idx];
+		}
+
+		bool isValid() const { return idx != hm->m_capacity; }
+	};
+
+public:
+	using iterator = iterator_base<FlatHashMap, Key, Value>;
+	using const_iterator = iterator_base<const FlatHashMap, const Key, const Value>;
+
+	explicit FlatHashMap(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+	}
+
+	FlatHashMap(u32 size, IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+		reserve(size);
+	}
+
+	FlatHashMap(FlatHashMap&& rhs)
+		: m_allocator(rhs.m_allocator)
+	{
+		m_ctrl = rhs.m_ctrl;
+		m_keys = rhs.m_keys;
+		m_values = rhs.m_values;
+		m_capacity = rhs.m_capacity;
+		m_size = rhs.m_size;
+		m_mask = rhs.m_mask;
+
+		rhs.m_ctrl = nullptr;
+		rhs.m_keys = nullptr;
+		rhs.m_values = nullptr;
+		rhs.m_capacity = 0;
+		rhs.m_size = 0;
+		rhs.m_mask = 0;
+	}
+
+	~FlatHashMap()
+	{
+		destroyAll();
+		m_allocator.deallocate(m_ctrl);
+		m_allocator.deallocate_aligned(m_keys);
+		m_allocator.deallocate_aligned(m_values);
+	}
+
+	void operator =(FlatHashMap&& rhs) = delete;
+
+	iterator begin() {
+		for (u32 i = 0, c = m_capacity; i < c; ++i) {
+			if (m_ctrl[i] != EMPTY) return { this, i };
+		}
+		return { this, m_capacity };
+	}
+
+	const_iterator begin() const {
+		for (u32 i = 0, c = m_capacity; i < c; ++i) {
+			if (m_ctrl[i] != EMPTY) return { this, i };
+		}
+		return { this, m_capacity };
+	}
+
+	iterator end() { return iterator { this, m_capacity }; }
+	const_iterator end() const { return const_iterator { this, m_capacity }; }
+
+	// keeps the memory, so refilling the map does not allocate
+	void clear() {
+		destroyAll();
+		if (m_ctrl) memset(m_ctrl, EMPTY, m_capacity + GROUP_SIZE - 1);
+		m_size = 0;
+	}
+
+	const_iterator find(const Key& key) const {
+		return { this, findPos(key) };
+	}
+
+	iterator find(const Key& key) {
+		return { this, findPos(key) };
+	}
+
+	Value& operator[](const Key& key) {
+		const u32 pos = findPos(key);
+		ASSERT(pos < m_capacity);
+		return m_values[pos];
+	}
+
+	const Value& operator[](const Key& key) const {
+		const u32 pos = findPos(key);
+		ASSERT(pos < m_capacity);
+		return m_values[pos];
+	}
+
+	Value& insert(const Key& key) {
+		auto iter = insert(key, {});
+		return iter.value();
+	}
+
+	iterator insert(const Key& key, Value&& value) {
+		const u32 pos = allocSlot(key);
+		new (NewPlaceholder(), &m_keys[pos]) Key(key);
+		new (NewPlaceholder(), &m_values[pos]) Value(static_cast<Value&&>(value));
+		return { this, pos };
+	}
+
+	iterator insert(const Key& key, const Value& value) {
+		const u32 pos = allocSlot(key);
+		new (NewPlaceholder(), &m_keys[pos]) Key(key);
+		new (NewPlaceholder(), &m_values[pos]) Value(value);
+		return { this, pos };
+	}
+
+	template <typename F>
+	void eraseIf(F predicate) {
+		for (u32 i = 0; i < m_capacity; ++i) {
+			if (m_ctrl[i] == EMPTY) continue;
+			if (predicate(m_values[i])) {
+				eraseAt(i);
+				// some other item could be shifted to i
+				--i;
+			}
+		}
+	}
+
+	void erase(const iterator& key) {
+		ASSERT(key.isValid());
+		eraseAt(key.idx);
+	}
+
+	void erase(const Key& key) {
+		const u32 pos = findPos(key);
+		if (pos != m_capacity) eraseAt(pos);
+	}
+
+	bool empty() const { return m_size == 0; }
+	u32 size() const { return m_size; }
+
+	// after this, inserting up to `count` items in total does not allocate
+	void reserve(u32 count) {
+		u32 capacity = MIN_CAPACITY;
+		while (count > capacity * 3 / 4) capacity <<= 1;
+		if (capacity > m_capacity) grow(capacity);
+	}
+
+private:
+	static u32 firstBit(u32 mask) {
+		ASSERT(mask != 0);
+		#ifdef _WIN32
+			unsigned long res;
+			_BitScanForward(&res, mask);
+			return res;
+		#else
+			return __builtin_ctz(mask);
+		#endif
+	}
+
+	static u8 getH2(u32 hash) { return u8(hash >> 25); }
+
+	void setCtrl(u32 pos, u8 value) {
+		m_ctrl[pos] = value;
+		// first GROUP_SIZE - 1 bytes are mirrored after the end, so a group can be loaded at any position
+		if (pos < GROUP_SIZE - 1) m_ctrl[m_capacity + pos] = value;
+	}
+
+	void destroyAll() {
+		for (u32 i = 0, c = m_capacity; i < c; ++i) {
+			if (m_ctrl[i] != EMPTY) {
+				m_keys[i].~Key();
+				m_values[i].~Value();
+			}
+		}
+	}
+
+	u32 allocSlot(const Key& key) {
+		if (m_size >= m_capacity * 3 / 4) {
+			grow(m_capacity < MIN_CAPACITY ? MIN_CAPACITY : m_capacity << 1);
+		}
+		const u32 hash = Hasher::get(key);
+		const u32 pos = findEmptySlot(hash);
+		setCtrl(pos, getH2(hash));
+		++m_size;
+		return pos;
+	}
+
+	u32 findEmptySlot(u32 hash) const {
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u32 empty = u8x16MatchMask(m_ctrl + pos, EMPTY);
+			if (empty) return (pos + firstBit(empty)) & m_mask;
+			pos = (pos + GROUP_SIZE) & m_mask;
+		}
+	}
+
+	u32 findPos(const Key& key) const {
+		if (!m_ctrl) return m_capacity;
+		const u32 hash = Hasher::get(key);
+		const u8 h2 = getH2(hash);
+		const Key* LUMIX_RESTRICT keys = m_keys;
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u8* group = m_ctrl + pos;
+			u32 matches = u8x16MatchMask(group, h2);
+			while (matches) {
+				const u32 idx = (pos + firstBit(matches)) & m_mask;
+				if (keys[idx] == key) return idx;
+				matches &= matches - 1;
+			}
+			if (u8x16MatchMask(group, EMPTY)) return m_capacity;
+			pos = (pos + GROUP_SIZE) & m_mask;
+		}
+	}
+
+	void eraseAt(u32 pos) {
+		ASSERT(m_ctrl[pos] != EMPTY);
+		m_keys[pos].~Key();
+		m_values[pos].~Value();
+		--m_size;
+
+		// move following items of the probe sequence back, so it does not have a gap
+		u32 hole = pos;
+		for (u32 i = (pos + 1) & m_mask; m_ctrl[i] != EMPTY; i = (i + 1) & m_mask) {
+			const u32 home = Hasher::get(m_keys[i]) & m_mask;
+			if (((i - home) & m_mask) < ((i - hole) & m_mask)) continue;
+
+			new (NewPlaceholder(), &m_keys[hole]) Key(static_cast<Key&&>(m_keys[i]));
+			new (NewPlaceholder(), &m_values[hole]) Value(static_cast<Value&&>(m_values[i]));
+			m_keys[i].~Key();
+			m_values[i].~Value();
+			setCtrl(hole, m_ctrl[i]);
+			hole = i;
+		}
+		setCtrl(hole, EMPTY);
+	}
+
+	void grow(u32 new_capacity) {
+		ASSERT(new_capacity >= MIN_CAPACITY && (new_capacity & (new_capacity - 1)) == 0);
+		u8* old_ctrl = m_ctrl;
+		Key* old_keys = m_keys;
+		Value* old_values = m_values;
+		const u32 old_capacity = m_capacity;
+
+		m_ctrl = (u8*)m_allocator.allocate(new_capacity + GROUP_SIZE - 1);
+		m_keys = (Key*)m_allocator.allocate_aligned(sizeof(Key) * new_capacity, alignof(Key));
+		m_values = (Value*)m_allocator.allocate_aligned(sizeof(Value) * new_capacity, alignof(Value));
+		memset(m_ctrl, EMPTY, new_capacity + GROUP_SIZE - 1);
+		m_capacity = new_capacity;
+		m_mask = new_capacity - 1;
+
+		for (u32 i = 0; i < old_capacity; ++i) {
+			if (old_ctrl[i] == EMPTY) continue;
+			const u32 hash = Hasher::get(old_keys[i]);
+			const u32 pos = findEmptySlot(hash);
+			setCtrl(pos, getH2(hash));
+			new (NewPlaceholder(), &m_keys[pos]) Key(static_cast<Key&&>(old_keys[i]));
+			new (NewPlaceholder(), &m_values[pos]) Value(static_cast<Value&&>(old_values[i]));
+			old_keys[i].~Key();
+			old_values[i].~Value();
+		}
+
+		m_allocator.deallocate(old_ctrl);
+		m_allocator.deallocate_aligned(old_keys);
+		m_allocator.deallocate_aligned(old_values);
+	}
+
+	IAllocator& m_allocator;
+	u8* m_ctrl = nullptr;
+	Key* m_keys = nullptr;
+	Value* m_values = nullptr;
+	u32 m_capacity = 0;
+	u32 m_size = 0;
+	u32 m_mask = 0;
+};
+
+
+} // namespace Lumix
@@ -0,0 +1,109 @@
+#include "engine/hash.h"
+#include "engine/crt.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+static constexpr u64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr u64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr u64 PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr u64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr u64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+
+static u64 rotl(u64 x, u32 r) { return (x << r) | (x >> (64 - r)); }
+
+static u64 read64(const u8* p) {
+	u64 res;
+	memcpy(&res, p, sizeof(res));
+	return res;
+}
+
+static u32 read32(const u8* p) {
+	u32 res;
+	memcpy(&res, p, sizeof(res));
+	return res;
+}
+
+static u64 round(u64 acc, u64 input) {
+	acc += input * PRIME64_2;
+	acc = rotl(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static u64 mergeRound(u64 acc, u64 val) {
+	acc ^= round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+static u64 xxh64(const u8* p, u32 len) {
+	const u8* const end = p + len;
+	u64 h;
+
+	if (len >= 32) {
+		const u8* const limit = end - 32;
+		u64 v1 = PRIME64_1 + PRIME64_2;
+		u64 v2 = PRIME64_2;
+		u64 v3 = 0;
+		u64 v4 = 0 - PRIME64_1;
+		do {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = mergeRound(h, v1);
+		h = mergeRound(h, v2);
+		h = mergeRound(h, v3);
+		h = mergeRound(h, v4);
+	}
+	else {
+		h = PRIME64_5;
+	}
+
+	h += len;
+
+	while (p + 8 <= end) {
+		h ^= round(0, read64(p));
+		h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+
+	if (p + 4 <= end) {
+		h ^= read32(p) * PRIME64_1;
+		h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end) {
+		h ^= *p * PRIME64_5;
+		h = rotl(h, 11) * PRIME64_1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+StableHash::StableHash(const void* data, u32 len)
+	: hash(xxh64((const u8*)data, len))
+{}
+
+
+StableHash::StableHash(const char* str)
+	: hash(xxh64((const u8*)str, stringLength(str)))
+{}
+
+
+} // namespace Lumix
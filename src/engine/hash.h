@@ -0,0 +1,42 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// 64bit hash (xxh64), same on all platforms and in all runs, so it can be serialized
+// use it where 32bit crc32 collisions are likely, e.g. paths in big projects
+struct LUMIX_ENGINE_API StableHash
+{
+	static StableHash fromU64(u64 hash) { StableHash res; res.hash = hash; return res; }
+
+	StableHash() {}
+	explicit StableHash(const void* data, u32 len);
+	explicit StableHash(const char* str);
+
+	bool operator==(const StableHash& rhs) const { return hash == rhs.hash; }
+	bool operator!=(const StableHash& rhs) const { return hash != rhs.hash; }
+	bool operator<(const StableHash& rhs) const { return hash < rhs.hash; }
+
+	u64 getHashValue() const { return hash; }
+
+private:
+	u64 hash = 0;
+};
+
+
+template <typename Key> struct HashFunc;
+
+// xxh64 is well distributed, so the low bits can be used directly
+template<>
+struct HashFunc<StableHash>
+{
+	static u32 get(const StableHash& key) { return (u32)key.getHashValue(); }
+};
+
+
+} // namespace Lumix
@@ -367,7 +367,7 @@ public:
 
 	void erase(const Key& key) {
 		const u32 pos = findPos(key);
-		if (m_keys[pos].valid) erase({this, pos});
+		if (m_keys[pos].valid) erase(iterator{this, pos});
 	}
 
 	bool empty() const { return m_size == 0; }
@@ -0,0 +1,140 @@
+#include "engine/heap_profiler.h"
+#include "engine/allocators.h"
+#include "engine/array.h"
+#include "engine/crt.h"
+#include "engine/debug.h"
+#include "engine/hash_map.h"
+#include "engine/math.h"
+#include "engine/sync.h"
+
+
+namespace Lumix::heap_profiler {
+
+
+// counting filter of sampled pointers, so frees of not sampled memory do not need to lock
+static constexpr u32 FILTER_SIZE = 64 * 1024;
+
+struct HeapProfiler {
+	HeapProfiler() : samples(allocator) {}
+
+	DefaultAllocator allocator;
+	HashMap<void*, Sample> samples;
+	debug::StackTree stack_tree;
+	u16 filter[FILTER_SIZE] = {};
+};
+
+static volatile bool g_enabled = false;
+static u32 g_sample_interval = 512 * 1024;
+static Mutex g_mutex;
+// created on first enable and never destroyed, memory can be freed after static destructors run
+alignas(HeapProfiler) static u8 g_storage[sizeof(HeapProfiler)];
+static HeapProfiler* g_profiler = nullptr;
+
+static thread_local i64 t_bytes_to_sample = 0;
+static thread_local u32 t_rng = 0;
+static thread_local const char* t_tag = nullptr;
+// set while the profiler itself allocates or holds g_mutex
+static thread_local bool t_in_profiler = false;
+
+
+static u32 getFilterIndex(void* ptr) {
+	return u32(((uintptr)ptr >> 4) * 0x9E3779B1u) >> 16;
+}
+
+
+// randomized, so allocation patterns repeating with the same period are not always (or never) sampled
+static i64 getNextInterval() {
+	if (t_rng == 0) t_rng = u32(uintptr(&t_rng) >> 3) | 1;
+	t_rng ^= t_rng << 13;
+	t_rng ^= t_rng >> 17;
+	t_rng ^= t_rng << 5;
+	const u32 interval = g_sample_interval;
+	return interval / 2 + t_rng % interval;
+}
+
+
+const char* setThreadTag(const char* tag) {
+	const char* prev = t_tag;
+	t_tag = tag;
+	return prev;
+}
+
+
+void onAllocated(void* ptr, size_t size) {
+	if (!g_enabled || !ptr || size == 0 || t_in_profiler) return;
+	t_bytes_to_sample -= (i64)size;
+	if (t_bytes_to_sample > 0) return;
+	t_bytes_to_sample = getNextInterval();
+
+	t_in_profiler = true;
+	{
+		MutexGuard guard(g_mutex);
+		if (g_enabled) {
+			Sample& sample = g_profiler->samples.insert(ptr);
+			sample.stack = g_profiler->stack_tree.record();
+			sample.tag = t_tag;
+			sample.size = size;
+			sample.estimated_size = maximum((u64)size, (u64)g_sample_interval);
+			++g_profiler->filter[getFilterIndex(ptr)];
+		}
+	}
+	t_in_profiler = false;
+}
+
+
+void onFreed(void* ptr) {
+	if (!g_enabled || !ptr || t_in_profiler) return;
+	const u32 filter_idx = getFilterIndex(ptr);
+	if (g_profiler->filter[filter_idx] == 0) return;
+
+	t_in_profiler = true;
+	{
+		MutexGuard guard(g_mutex);
+		auto iter = g_profiler->samples.find(ptr);
+		if (iter.isValid()) {
+			g_profiler->samples.erase(iter);
+			--g_profiler->filter[filter_idx];
+		}
+	}
+	t_in_profiler = false;
+}
+
+
+void enable(bool enable) {
+	t_in_profiler = true;
+	{
+		MutexGuard guard(g_mutex);
+		if (!g_profiler) g_profiler = new (NewPlaceholder(), g_storage) HeapProfiler;
+		if (!enable) {
+			g_profiler->samples.clear();
+			memset(g_profiler->filter, 0, sizeof(g_profiler->filter));
+		}
+		g_enabled = enable;
+	}
+	t_in_profiler = false;
+}
+
+
+bool isEnabled() { return g_enabled; }
+
+
+void setSampleInterval(u32 bytes) { g_sample_interval = maximum(bytes, 1u); }
+
+
+u32 getSampleInterval() { return g_sample_interval; }
+
+
+void getSamples(Array<Sample>& out) {
+	t_in_profiler = true;
+	{
+		MutexGuard guard(g_mutex);
+		if (g_profiler) {
+			out.reserve(out.size() + g_profiler->samples.size());
+			for (const Sample& sample : g_profiler->samples) out.push(sample);
+		}
+	}
+	t_in_profiler = false;
+}
+
+
+} // namespace Lumix::heap_profiler
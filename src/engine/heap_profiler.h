@@ -0,0 +1,48 @@
+#pragma once
+
+#include "engine/lumix.h"
+
+namespace Lumix {
+
+template <typename T> struct Array;
+namespace debug { struct StackNode; }
+
+// samples allocations made through DefaultAllocator, on average one allocation per getSampleInterval() bytes
+// only sampled allocations capture their call stack, everything else costs a thread-local counter decrement
+// sampled allocations are tracked until freed, so samples approximate live memory
+namespace heap_profiler {
+
+struct Sample {
+	debug::StackNode* stack; // see debug::StackTree
+	const char* tag; // name of the innermost TagAllocator, null if none
+	u64 size;
+	// `size` scaled by sampling probability, sum of these estimates live bytes
+	u64 estimated_size;
+};
+
+// allocations made while it's alive are attributed to `tag`
+struct TagScope {
+	explicit TagScope(const char* tag);
+	~TagScope();
+
+	const char* prev;
+};
+
+LUMIX_ENGINE_API void enable(bool enable);
+LUMIX_ENGINE_API bool isEnabled();
+LUMIX_ENGINE_API void setSampleInterval(u32 bytes);
+LUMIX_ENGINE_API u32 getSampleInterval();
+// copies all live samples to `out`
+LUMIX_ENGINE_API void getSamples(Array<Sample>& out);
+
+// called by allocators
+LUMIX_ENGINE_API void onAllocated(void* ptr, size_t size);
+LUMIX_ENGINE_API void onFreed(void* ptr);
+LUMIX_ENGINE_API const char* setThreadTag(const char* tag);
+
+inline TagScope::TagScope(const char* tag) : prev(setThreadTag(tag)) {}
+inline TagScope::~TagScope() { setThreadTag(prev); }
+
+} // namespace heap_profiler
+
+} // namespace Lumix
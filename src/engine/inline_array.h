@@ -0,0 +1,290 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/crt.h"
+
+namespace Lumix {
+
+// same as Array, but the first N elements are stored inline, allocator is used only when it grows over N
+template <typename T, u32 N> struct InlineArray {
+	static_assert(N > 0);
+
+	explicit InlineArray(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+		m_data = (T*)m_inline;
+		m_capacity = N;
+		m_size = 0;
+	}
+
+	InlineArray(const InlineArray& rhs) = delete;
+	void operator=(const InlineArray& rhs) = delete;
+
+
+	InlineArray(InlineArray&& rhs)
+		: m_allocator(rhs.m_allocator)
+	{
+		m_data = (T*)m_inline;
+		m_capacity = N;
+		m_size = 0;
+		steal(rhs);
+	}
+
+
+	void operator=(InlineArray&& rhs)
+	{
+		ASSERT(&m_allocator == &rhs.m_allocator);
+		if (this != &rhs) {
+			free();
+			steal(rhs);
+		}
+	}
+
+
+	~InlineArray()
+	{
+		callDestructors(m_data, m_data + m_size);
+		if (!isInline()) m_allocator.deallocate_aligned(m_data);
+	}
+
+
+	InlineArray&& move() { return static_cast<InlineArray&&>(*this); }
+
+
+	T* begin() const { return m_data; }
+
+
+	T* end() const { return m_data + m_size; }
+
+
+	operator Span<T>() const { return Span(begin(), end()); }
+	operator Span<const T>() const { return Span(begin(), end()); }
+
+
+	void swap(InlineArray& rhs)
+	{
+		ASSERT(&rhs.m_allocator == &m_allocator);
+		InlineArray tmp(static_cast<InlineArray&&>(rhs));
+		rhs = static_cast<InlineArray&&>(*this);
+		*this = static_cast<InlineArray&&>(tmp);
+	}
+
+
+	void free()
+	{
+		clear();
+		if (!isInline()) m_allocator.deallocate_aligned(m_data);
+		m_data = (T*)m_inline;
+		m_capacity = N;
+	}
+
+	template <typename F>
+	int find(F predicate) const
+	{
+		for (u32 i = 0; i < m_size; ++i) {
+			if (predicate(m_data[i])) return i;
+		}
+		return -1;
+	}
+
+	int indexOf(const T& item) const
+	{
+		for (u32 i = 0; i < m_size; ++i) {
+			if (m_data[i] == item) return i;
+		}
+		return -1;
+	}
+
+	template <typename F>
+	void eraseItems(F predicate)
+	{
+		for (u32 i = m_size - 1; i != 0xffFFffFF; --i) {
+			if (predicate(m_data[i])) erase(i);
+		}
+	}
+
+	void swapAndPopItem(const T& item)
+	{
+		const int idx = indexOf(item);
+		if (idx >= 0) swapAndPop(idx);
+	}
+
+	void swapAndPop(u32 index)
+	{
+		if (index >= m_size) return;
+		if (index != m_size - 1) {
+			m_data[index].~T();
+			new (NewPlaceholder(), m_data + index) T(static_cast<T&&>(m_data[m_size - 1]));
+		}
+		m_data[m_size - 1].~T();
+		--m_size;
+	}
+
+	void eraseItem(const T& item)
+	{
+		const int idx = indexOf(item);
+		if (idx >= 0) erase(idx);
+	}
+
+	void erase(u32 index)
+	{
+		if (index >= m_size) return;
+		m_data[index].~T();
+		for (u32 i = index; i < m_size - 1; ++i) {
+			new (NewPlaceholder(), &m_data[i]) T(static_cast<T&&>(m_data[i + 1]));
+			m_data[i + 1].~T();
+		}
+		--m_size;
+	}
+
+	void push(T&& value)
+	{
+		if (m_size == m_capacity) grow(m_capacity * 2);
+		new (NewPlaceholder(), (char*)(m_data + m_size)) T(static_cast<T&&>(value));
+		++m_size;
+	}
+
+	void push(const T& value)
+	{
+		if (m_size == m_capacity) grow(m_capacity * 2);
+		new (NewPlaceholder(), (char*)(m_data + m_size)) T(value);
+		++m_size;
+	}
+
+	template <typename... Params> T& emplace(Params&&... params)
+	{
+		if (m_size == m_capacity) grow(m_capacity * 2);
+		new (NewPlaceholder(), (char*)(m_data + m_size)) T(static_cast<Params&&>(params)...);
+		++m_size;
+		return m_data[m_size - 1];
+	}
+
+	template <typename... Params> T& emplaceAt(u32 idx, Params&&... params)
+	{
+		ASSERT(idx <= m_size);
+		if (m_size == m_capacity) grow(m_capacity * 2);
+		moveRange(m_data + idx + 1, m_data + idx, m_size - idx);
+		new (NewPlaceholder(), m_data + idx) T(static_cast<Params&&>(params)...);
+		++m_size;
+		return m_data[idx];
+	}
+
+	void insert(u32 index, const T& value) { emplaceAt(index, value); }
+	void insert(u32 index, T&& value) { emplaceAt(index, static_cast<T&&>(value)); }
+
+	bool empty() const { return m_size == 0; }
+
+	void clear()
+	{
+		callDestructors(m_data, m_data + m_size);
+		m_size = 0;
+	}
+
+	const T& back() const { ASSERT(m_size > 0); return m_data[m_size - 1]; }
+	T& back() { ASSERT(m_size > 0); return m_data[m_size - 1]; }
+
+	void pop()
+	{
+		if (m_size > 0) {
+			m_data[m_size - 1].~T();
+			--m_size;
+		}
+	}
+
+	void resize(u32 size)
+	{
+		reserve(size);
+		for (u32 i = m_size; i < size; ++i) {
+			new (NewPlaceholder(), (char*)(m_data + i)) T;
+		}
+		callDestructors(m_data + size, m_data + m_size);
+		m_size = size;
+	}
+
+	void reserve(u32 capacity)
+	{
+		if (capacity > m_capacity) grow(capacity);
+	}
+
+	const T& operator[](u32 index) const
+	{
+		ASSERT(index < m_size);
+		return m_data[index];
+	}
+
+	T& operator[](u32 index)
+	{
+		ASSERT(index < m_size);
+		return m_data[index];
+	}
+
+	u32 byte_size() const { return m_size * sizeof(T); }
+	int size() const { return m_size; }
+
+	void shrink(u32 new_size) {
+		ASSERT(new_size <= m_size);
+		callDestructors(m_data + new_size, m_data + m_size);
+		m_size = new_size;
+	}
+
+	u32 capacity() const { return m_capacity; }
+
+private:
+	bool isInline() const { return m_data == (const T*)m_inline; }
+
+	// takes rhs' elements, rhs ends up empty and inline
+	void steal(InlineArray& rhs)
+	{
+		ASSERT(m_size == 0 && isInline());
+		if (rhs.isInline()) {
+			moveRange(m_data, rhs.m_data, rhs.m_size);
+			m_size = rhs.m_size;
+			rhs.m_size = 0;
+			return;
+		}
+
+		m_data = rhs.m_data;
+		m_capacity = rhs.m_capacity;
+		m_size = rhs.m_size;
+		rhs.m_data = (T*)rhs.m_inline;
+		rhs.m_capacity = N;
+		rhs.m_size = 0;
+	}
+
+	// moves from src to dst and destroys src, ranges can overlap if dst > src
+	static void moveRange(T* dst, T* src, u32 count) {
+		if constexpr (__is_trivially_copyable(T)) {
+			memmove(dst, src, sizeof(T) * count);
+		}
+		else {
+			for (u32 i = count - 1; i < count; --i) {
+				new (NewPlaceholder(), dst + i) T(static_cast<T&&>(src[i]));
+				src[i].~T();
+			}
+		}
+	}
+
+	void grow(u32 new_capacity)
+	{
+		T* new_data = (T*)m_allocator.allocate_aligned(new_capacity * sizeof(T), alignof(T));
+		moveRange(new_data, m_data, m_size);
+		if (!isInline()) m_allocator.deallocate_aligned(m_data);
+		m_data = new_data;
+		m_capacity = new_capacity;
+	}
+
+	static void callDestructors(T* begin, T* end)
+	{
+		for (; begin < end; ++begin) {
+			begin->~T();
+		}
+	}
+
+	IAllocator& m_allocator;
+	u32 m_capacity;
+	u32 m_size;
+	T* m_data;
+	alignas(T) u8 m_inline[sizeof(T) * N];
+};
+
+} // namespace Lumix
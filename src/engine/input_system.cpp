@@ -1,12 +1,16 @@
 #include "engine/input_system.h"
 #include "engine/os.h"
+#include "engine/atomic.h"
 #include "engine/controller_device.h"
 #include "engine/delegate.h"
 #include "engine/delegate_list.h"
 #include "engine/engine.h"
+#include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/profiler.h"
 #include "engine/math.h"
+#include "engine/sync.h"
+#include "engine/thread.h"
 
 
 namespace Lumix
@@ -28,8 +32,34 @@ struct KeyboardDevice : InputSystem::Device
 };
 
 
+// events injected from the polling thread go to the ring instead of m_events
+static thread_local bool g_is_polling_thread = false;
+
+
+struct InputSystemImpl;
+
+
+struct PollingThread final : Thread
+{
+	PollingThread(InputSystemImpl& system, u32 hz, IAllocator& allocator)
+		: Thread(allocator)
+		, system(system)
+		, period(1.f / hz)
+	{}
+
+	int task() override;
+
+	InputSystemImpl& system;
+	float period;
+	volatile bool finished = false;
+};
+
+
 struct InputSystemImpl final : InputSystem
 {
+	// power of 2
+	static constexpr i32 RING_SIZE = 1024;
+
 	explicit InputSystemImpl(Engine& engine)
 		: m_engine(engine)
 		, m_allocator(engine.getAllocator())
@@ -50,6 +80,7 @@ struct InputSystemImpl final : InputSystem
 
 	~InputSystemImpl()
 	{
+		setPollingRate(0);
 		ControllerDevice::shutdown();
 		for (Device* device : m_devices)
 		{
@@ -63,7 +94,10 @@ struct InputSystemImpl final : InputSystem
 	
 	void addDevice(Device* device) override
 	{
-		m_devices.push(device);
+		{
+			MutexGuard lock(m_devices_mutex);
+			m_devices.push(device);
+		}
 		Event event;
 		event.type = Event::DEVICE_ADDED;
 		event.device = device;
@@ -75,6 +109,11 @@ struct InputSystemImpl final : InputSystem
 	{ 
 		ASSERT(device != m_keyboard_device);
 		ASSERT(device != m_mouse_device);
+		{
+			// polling thread must not touch the device after this, it's deleted in the next update
+			MutexGuard lock(m_devices_mutex);
+			m_devices.eraseItem(device);
+		}
 		m_to_remove.push(device);
 
 		Event event;
@@ -88,19 +127,89 @@ struct InputSystemImpl final : InputSystem
 	{
 		PROFILE_FUNCTION();
 
-		for (Device* device : m_to_remove)
-		{
-			m_devices.eraseItem(device);
-			LUMIX_DELETE(m_allocator, device);
+		m_consumed_timestamp = 0;
+		for (const Event& e : m_events) {
+			if (m_consumed_timestamp == 0 || e.timestamp < m_consumed_timestamp) m_consumed_timestamp = e.timestamp;
 		}
-
 		m_events.clear();
 
-		for (Device* device : m_devices) device->update(dt);
+		for (Device* device : m_to_remove) LUMIX_DELETE(m_allocator, device);
+		m_to_remove.clear();
+
+		for (Device* device : m_devices) {
+			if (!m_polling_thread || device->type != Device::CONTROLLER) device->update(dt);
+		}
+		if (m_polling_thread) consumeRing();
 		ControllerDevice::frame(dt);
 	}
 
 
+	void setPollingRate(u32 hz) override
+	{
+		if (m_polling_thread) {
+			m_polling_thread->finished = true;
+			m_polling_thread->destroy();
+			LUMIX_DELETE(m_allocator, m_polling_thread);
+			m_polling_thread = nullptr;
+			consumeRing();
+		}
+		if (hz == 0) return;
+
+		m_polling_thread = LUMIX_NEW(m_allocator, PollingThread)(*this, hz, m_allocator);
+		if (!m_polling_thread->create("input polling", true)) {
+			logError("Failed to create input polling thread");
+			LUMIX_DELETE(m_allocator, m_polling_thread);
+			m_polling_thread = nullptr;
+		}
+	}
+
+
+	// called only from the polling thread
+	void pollDevices(float dt)
+	{
+		MutexGuard lock(m_devices_mutex);
+		for (Device* device : m_devices) {
+			if (device->type == Device::CONTROLLER) device->update(dt);
+		}
+	}
+
+
+	// single producer (polling thread), single consumer (main thread)
+	void pushToRing(const Event& event)
+	{
+		const i32 write = m_ring_write;
+		const i32 read = m_ring_read;
+		readBarrier();
+		if (write - read >= RING_SIZE) {
+			// main thread is stalled, drop the event rather than block the polling thread
+			atomicIncrement(&m_ring_dropped);
+			return;
+		}
+		m_ring[write & (RING_SIZE - 1)] = event;
+		writeBarrier();
+		m_ring_write = write + 1;
+	}
+
+
+	void consumeRing()
+	{
+		const i32 write = m_ring_write;
+		readBarrier();
+		for (i32 i = m_ring_read; i != write; ++i) {
+			m_events.push(m_ring[i & (RING_SIZE - 1)]);
+		}
+		// the slots must be read before the producer can reuse them
+		memoryBarrier();
+		m_ring_read = write;
+
+		const i32 dropped = m_ring_dropped;
+		if (dropped > 0) {
+			atomicSubtract(&m_ring_dropped, dropped);
+			logWarning("Input ring is full, ", dropped, " events dropped");
+		}
+	}
+
+
 	void injectEvent(const os::Event& event, int mouse_base_x, int mouse_base_y) override
 	{
 		switch (event.type) {
@@ -152,12 +261,16 @@ struct InputSystemImpl final : InputSystem
 	
 	void injectEvent(const Event& event) override
 	{
-		m_events.push(event);
+		Event e = event;
+		if (e.timestamp == 0) e.timestamp = os::Timer::getRawTimestamp();
+		if (g_is_polling_thread) pushToRing(e);
+		else m_events.push(e);
 	}
 
 
 	int getEventsCount() const override { return m_events.size(); }
 	const Event* getEvents() const override { return m_events.empty() ? nullptr : &m_events[0]; }
+	u64 getConsumedEventsTimestamp() const override { return m_consumed_timestamp; }
 
 	int getDevicesCount() const override { return m_devices.size(); }
 	Device* getDevice(int index) override { return m_devices[index]; }
@@ -171,9 +284,31 @@ struct InputSystemImpl final : InputSystem
 	Array<Event> m_events;
 	Array<Device*> m_devices;
 	Array<Device*> m_to_remove;
+	u64 m_consumed_timestamp = 0;
+	// guards m_devices against the polling thread
+	Mutex m_devices_mutex;
+	PollingThread* m_polling_thread = nullptr;
+	Event m_ring[RING_SIZE];
+	volatile i32 m_ring_write = 0;
+	volatile i32 m_ring_read = 0;
+	volatile i32 m_ring_dropped = 0;
 };
 
 
+int PollingThread::task()
+{
+	g_is_polling_thread = true;
+	os::Timer timer;
+	while (!finished) {
+		const float dt = timer.tick();
+		system.pollDevices(dt);
+		const float remaining = period - timer.getTimeSinceTick();
+		os::sleep(u32(maximum(remaining * 1000, 1.f)));
+	}
+	return 0;
+}
+
+
 void InputSystemImpl::registerLuaAPI()
 {
 	lua_State* state = m_engine.getState();
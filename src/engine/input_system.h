@@ -60,6 +60,8 @@ struct LUMIX_ENGINE_API InputSystem {
 
 		Type type;
 		Device* device;
+		// os::Timer::getRawTimestamp() when the event happened, filled by injectEvent if 0
+		u64 timestamp = 0;
 		union EventData {
 			ButtonEvent button;
 			AxisEvent axis;
@@ -77,6 +79,11 @@ struct LUMIX_ENGINE_API InputSystem {
 	virtual void injectEvent(const os::Event& event, int mouse_base_x, int mouse_base_y) = 0;
 	virtual int getEventsCount() const = 0;
 	virtual const Event* getEvents() const = 0;
+	// timestamp of the oldest event consumed in the last frame, 0 if there were no events
+	virtual u64 getConsumedEventsTimestamp() const = 0;
+	// controllers are polled on a dedicated thread at `hz` and their events are queued in a lock-free ring
+	// 0 polls controllers once per frame in update()
+	virtual void setPollingRate(u32 hz) = 0;
 
 	virtual void addDevice(Device* device) = 0;
 	virtual void removeDevice(Device* device) = 0;
@@ -0,0 +1,219 @@
+#include "engine/atomic.h"
+#include "engine/job_graph.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
+
+
+namespace Lumix::jobs
+{
+
+
+Graph::Graph(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_nodes(allocator)
+	, m_edges(allocator)
+	, m_dependents(allocator)
+	, m_dependencies(allocator)
+	, m_critical_path(allocator)
+{}
+
+
+Graph::~Graph()
+{
+	ASSERT(!isRunning());
+}
+
+
+Graph::NodeHandle Graph::addNode(const char* name_literal, void* data, void (*task)(void*), Priority priority)
+{
+	ASSERT(!isRunning());
+	Node& node = m_nodes.emplace();
+	node.name = name_literal;
+	node.data = data;
+	node.task = task;
+	node.priority = priority;
+	node.graph = this;
+	m_is_dirty = true;
+	return m_nodes.size() - 1;
+}
+
+
+void Graph::addDependency(NodeHandle node, NodeHandle dependency)
+{
+	ASSERT(!isRunning());
+	ASSERT(node != dependency);
+	m_edges.push({node, dependency});
+	m_is_dirty = true;
+}
+
+
+void Graph::clear()
+{
+	ASSERT(!isRunning());
+	m_nodes.clear();
+	m_edges.clear();
+	m_dependents.clear();
+	m_dependencies.clear();
+	m_is_dirty = false;
+}
+
+
+void Graph::compile()
+{
+	for (Node& node : m_nodes) {
+		node.dependencies_count = 0;
+		node.dependents_count = 0;
+	}
+	for (const Edge& edge : m_edges) {
+		++m_nodes[edge.node].dependencies_count;
+		++m_nodes[edge.dependency].dependents_count;
+	}
+
+	u32 dependents_offset = 0;
+	u32 dependencies_offset = 0;
+	for (Node& node : m_nodes) {
+		node.dependents_offset = dependents_offset;
+		node.dependencies_offset = dependencies_offset;
+		dependents_offset += node.dependents_count;
+		dependencies_offset += node.dependencies_count;
+		// used as fill counters below
+		node.dependents_count = 0;
+		node.dependencies_count = 0;
+	}
+
+	m_dependents.resize(m_edges.size());
+	m_dependencies.resize(m_edges.size());
+	for (const Edge& edge : m_edges) {
+		Node& node = m_nodes[edge.node];
+		Node& dependency = m_nodes[edge.dependency];
+		m_dependencies[node.dependencies_offset + node.dependencies_count] = edge.dependency;
+		++node.dependencies_count;
+		m_dependents[dependency.dependents_offset + dependency.dependents_count] = edge.node;
+		++dependency.dependents_count;
+	}
+
+	#ifdef LUMIX_DEBUG
+		// Kahn's algorithm, every node must be reachable, otherwise there's a cycle
+		Array<u32> counts(m_allocator);
+		Array<NodeHandle> queue(m_allocator);
+		counts.resize(m_nodes.size());
+		for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+			counts[i] = m_nodes[i].dependencies_count;
+			if (counts[i] == 0) queue.push(i);
+		}
+		for (u32 i = 0; i < (u32)queue.size(); ++i) {
+			const Node& node = m_nodes[queue[i]];
+			for (u32 j = 0; j < node.dependents_count; ++j) {
+				const NodeHandle dependent = m_dependents[node.dependents_offset + j];
+				--counts[dependent];
+				if (counts[dependent] == 0) queue.push(dependent);
+			}
+		}
+		ASSERT(queue.size() == m_nodes.size());
+	#endif
+
+	m_is_dirty = false;
+}
+
+
+void Graph::launch(Node& node)
+{
+	jobs::run(&node, &Graph::runNode, nullptr, node.priority);
+}
+
+
+void Graph::runNode(void* data)
+{
+	Node& node = *(Node*)data;
+	Graph& graph = *node.graph;
+
+	{
+		profiler::Scope scope(node.name);
+		node.start = os::Timer::getRawTimestamp();
+		node.task(node.data);
+		node.end = os::Timer::getRawTimestamp();
+	}
+
+	for (u32 i = 0; i < node.dependents_count; ++i) {
+		Node& dependent = graph.m_nodes[graph.m_dependents[node.dependents_offset + i]];
+		if (atomicDecrement(&dependent.remaining_dependencies) == 0) {
+			graph.launch(dependent);
+		}
+	}
+
+	// graph can be run again as soon as m_remaining is zero, so read m_done before
+	const SignalHandle done = graph.m_done;
+	if (atomicDecrement(&graph.m_remaining) == 0) {
+		jobs::decSignal(done);
+	}
+}
+
+
+void Graph::run()
+{
+	ASSERT(!isRunning());
+	if (m_nodes.empty()) return;
+	if (m_is_dirty) compile();
+
+	for (Node& node : m_nodes) {
+		node.remaining_dependencies = node.dependencies_count;
+	}
+	m_remaining = m_nodes.size();
+	m_done = INVALID_HANDLE;
+	jobs::incSignal(&m_done);
+	memoryBarrier();
+
+	for (Node& node : m_nodes) {
+		if (node.dependencies_count == 0) launch(node);
+	}
+}
+
+
+void Graph::wait()
+{
+	jobs::wait(m_done);
+
+	getCriticalPath(m_critical_path);
+	if (m_critical_path.empty()) return;
+
+	PROFILE_BLOCK("job graph critical path");
+	const u64 freq = os::Timer::getFrequency();
+	for (NodeHandle node : m_critical_path) {
+		profiler::pushString(m_nodes[node].name);
+		profiler::pushInt("duration us", int(getNodeDuration(node) * 1'000'000 / freq));
+	}
+}
+
+
+void Graph::getCriticalPath(Array<NodeHandle>& path) const
+{
+	path.clear();
+	if (m_nodes.empty() || m_is_dirty) return;
+
+	NodeHandle last = 0;
+	for (u32 i = 1, c = m_nodes.size(); i < c; ++i) {
+		if (m_nodes[i].end > m_nodes[last].end) last = i;
+	}
+
+	// walk back through the dependency which finished last, that's the one `last` waited for
+	for (;;) {
+		path.push(last);
+		const Node& node = m_nodes[last];
+		if (node.dependencies_count == 0) break;
+		NodeHandle latest = m_dependencies[node.dependencies_offset];
+		for (u32 i = 1; i < node.dependencies_count; ++i) {
+			const NodeHandle dependency = m_dependencies[node.dependencies_offset + i];
+			if (m_nodes[dependency].end > m_nodes[latest].end) latest = dependency;
+		}
+		last = latest;
+	}
+
+	for (i32 i = 0, j = path.size() - 1; i < j; ++i, --j) {
+		const NodeHandle tmp = path[i];
+		path[i] = path[j];
+		path[j] = tmp;
+	}
+}
+
+
+} // namespace Lumix::jobs
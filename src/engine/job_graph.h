@@ -0,0 +1,73 @@
+#pragma once
+
+#include "engine/array.h"
+#include "engine/job_system.h"
+
+
+namespace Lumix::jobs
+{
+
+// DAG of jobs, declared once and launched many times without allocating
+struct LUMIX_ENGINE_API Graph {
+	using NodeHandle = u32;
+
+	explicit Graph(IAllocator& allocator);
+	~Graph();
+
+	Graph(const Graph&) = delete;
+	void operator=(const Graph&) = delete;
+
+	NodeHandle addNode(const char* name_literal, void* data, void (*task)(void*), Priority priority = Priority::NORMAL);
+	// `node` does not start before `dependency` finishes
+	void addDependency(NodeHandle node, NodeHandle dependency);
+	void clear();
+
+	// launches all nodes without dependencies, the rest are launched once their dependencies finish
+	// can not be called while the previous run is not finished
+	void run();
+	// waits for the end of run() and pushes its critical path to the profiler
+	void wait();
+	bool isRunning() const { return m_remaining > 0; }
+	// chain of dependencies which finished last in the previous run, first node first
+	void getCriticalPath(Array<NodeHandle>& path) const;
+	u64 getNodeDuration(NodeHandle node) const { return m_nodes[node].end - m_nodes[node].start; }
+	const char* getNodeName(NodeHandle node) const { return m_nodes[node].name; }
+
+private:
+	struct Node {
+		const char* name;
+		void* data;
+		void (*task)(void*);
+		Priority priority;
+		Graph* graph;
+		u32 dependencies_count = 0;
+		// ranges in m_dependents and m_dependencies
+		u32 dependents_offset = 0;
+		u32 dependents_count = 0;
+		u32 dependencies_offset = 0;
+		volatile i32 remaining_dependencies = 0;
+		u64 start = 0;
+		u64 end = 0;
+	};
+
+	struct Edge {
+		NodeHandle node;
+		NodeHandle dependency;
+	};
+
+	static void runNode(void* data);
+	void compile();
+	void launch(Node& node);
+
+	IAllocator& m_allocator;
+	Array<Node> m_nodes;
+	Array<Edge> m_edges;
+	Array<NodeHandle> m_dependents;
+	Array<NodeHandle> m_dependencies;
+	Array<NodeHandle> m_critical_path;
+	bool m_is_dirty = false;
+	volatile i32 m_remaining = 0;
+	SignalHandle m_done = INVALID_HANDLE;
+};
+
+} // namespace Lumix::jobs
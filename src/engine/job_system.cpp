@@ -1,5 +1,6 @@
 #include "engine/atomic.h"
 #include "job_system.h"
+#include "engine/allocators.h"
 #include "engine/array.h"
 #include "engine/engine.h"
 #include "engine/fibers.h"
@@ -20,6 +21,17 @@ enum {
 	HANDLE_GENERATION_MASK = 0xffFF0000 
 };
 
+enum {
+	MAX_SIGNALS = 4096,
+	MAX_WAITING_JOBS = 4096,
+	SCRATCH_RESERVE = 16 * 1024 * 1024,
+	// forEach tries to keep each callback call this long, short enough for load balancing, long enough to amortize the overhead
+	FOR_EACH_CHUNK_NS = 50 * 1000,
+	// special values of the index part of Signal::waiters
+	WAITERS_EMPTY = 0xffFF,
+	WAITERS_CLOSED = 0xffFE
+};
+
 
 struct Job
 {
@@ -28,27 +40,166 @@ struct Job
 	SignalHandle dec_on_finish;
 	SignalHandle precondition;
 	u8 worker_index;
+	Priority priority;
+	StackSize stack_size;
 };
 
 
 struct Signal {
-	volatile int value;
-	u32 generation;
-	Job next_job;
-	SignalHandle sibling;
+	// generation in high 32 bits, counter in low 32 bits, so both can be checked and changed by one CAS
+	volatile i64 state;
+	// low 16 bits of generation in high 16 bits, index of the first waiting job in low 16 bits
+	volatile i32 waiters;
+};
+
+
+struct WaitingJob {
+	Job job;
+	volatile i32 next;
+};
+
+
+// lock-free stack of indices, tagged to avoid ABA
+template <u32 N>
+struct IndexFreeList {
+	void init() {
+		for (u32 i = 0; i < N; ++i) m_next[i] = i + 1 < N ? i + 1 : -1;
+		m_head = 0;
+	}
+
+	void push(i32 idx) {
+		for (;;) {
+			const i64 head = m_head;
+			m_next[idx] = i32(head);
+			const i64 new_head = ((head >> 32) + 1) << 32 | u32(idx);
+			if (compareAndExchange64(&m_head, new_head, head)) return;
+		}
+	}
+
+	i32 pop() {
+		for (;;) {
+			const i64 head = m_head;
+			const i32 idx = i32(head);
+			if (idx < 0) return -1;
+			const i32 next = m_next[idx];
+			const i64 new_head = ((head >> 32) + 1) << 32 | u32(next);
+			if (compareAndExchange64(&m_head, new_head, head)) return idx;
+		}
+	}
+
+	volatile i64 m_head;
+	volatile i32 m_next[N];
 };
 
 
 struct WorkerTask;
 
 
+// Chase-Lev deque, only the owning worker pushes and pops from the bottom, other workers steal from the top
+struct WorkStealingQueue
+{
+	enum { CAPACITY = 1024, MASK = CAPACITY - 1 };
+
+	// called only by owner
+	bool push(const Job& job)
+	{
+		const i32 b = m_bottom;
+		const i32 t = m_top;
+		if (b - t >= CAPACITY) return false;
+		m_jobs[b & MASK] = job;
+		memoryBarrier();
+		m_bottom = b + 1;
+		return true;
+	}
+
+	// called only by owner
+	bool pop(Job& job)
+	{
+		const i32 b = m_bottom - 1;
+		m_bottom = b;
+		memoryBarrier();
+		const i32 t = m_top;
+		if (t > b) {
+			m_bottom = b + 1;
+			return false;
+		}
+		job = m_jobs[b & MASK];
+		if (t != b) return true;
+
+		// last job, race with thieves
+		const bool res = compareAndExchange(&m_top, t + 1, t);
+		m_bottom = b + 1;
+		return res;
+	}
+
+	// can be called from any thread
+	bool steal(Job& job)
+	{
+		const i32 t = m_top;
+		memoryBarrier();
+		const i32 b = m_bottom;
+		if (t >= b) return false;
+		job = m_jobs[t & MASK];
+		return compareAndExchange(&m_top, t + 1, t);
+	}
+
+	bool isEmpty() const { return m_bottom <= m_top; }
+
+	volatile i32 m_top = 0;
+	volatile i32 m_bottom = 0;
+	Job m_jobs[CAPACITY];
+};
+
+
+// locked queue with one bucket per priority
+struct JobQueue
+{
+	explicit JobQueue(IAllocator& allocator)
+		: m_jobs{Array<Job>(allocator), Array<Job>(allocator), Array<Job>(allocator)}
+	{}
+
+	void push(const Job& job) {
+		m_jobs[(u32)job.priority].push(job);
+		atomicIncrement(&m_counts[(u32)job.priority]);
+	}
+
+	bool pop(Priority priority, Job& job) {
+		Array<Job>& jobs = m_jobs[(u32)priority];
+		if (jobs.empty()) return false;
+		job = jobs.back();
+		jobs.pop();
+		atomicDecrement(&m_counts[(u32)priority]);
+		return true;
+	}
+
+	// can be called without lock, to check whether it's worth locking
+	bool mightHave(Priority priority) const { return m_counts[(u32)priority] > 0; }
+
+	Array<Job> m_jobs[(u32)Priority::COUNT];
+	volatile i32 m_counts[(u32)Priority::COUNT] = {};
+};
+
+static_assert((u32)Priority::COUNT == 3, "update JobQueue constructor");
+
+
 struct FiberDecl
 {
 	int idx;
 	Fiber::Handle fiber = Fiber::INVALID_FIBER;
+	StackSize stack_size;
+	// if set while the fiber is not running, it's a job handed over to this fiber because it needs bigger stack
 	Job current_job;
+	// forEach scratch, created lazily; bound to the fiber, since a fiber waiting in forEach's callback
+	// can continue on other worker and other fibers can run on this worker in the meantime
+	LinearAllocator* scratch = nullptr;
 };
 
+
+static constexpr u32 FIBERS_COUNT[] = { 512, 64 };
+static constexpr u32 FIBER_STACK_SIZES[] = { 64 * 1024, 1024 * 1024 };
+static_assert(lengthOf(FIBERS_COUNT) == (u32)StackSize::COUNT);
+static_assert(lengthOf(FIBER_STACK_SIZES) == (u32)StackSize::COUNT);
+
 #ifdef _WIN32
 	static void __stdcall manage(void* data);
 #else
@@ -62,37 +213,44 @@ struct System
 		, m_workers(allocator)
 		, m_job_queue(allocator)
 		, m_ready_fibers(allocator)
-		, m_signals_pool(allocator)
-		, m_free_queue(allocator)
-		, m_free_fibers(allocator)
+		, m_free_fibers{Array<FiberDecl*>(allocator), Array<FiberDecl*>(allocator)}
 		, m_backup_workers(allocator)
+		, m_thread_scratches(allocator)
 	{
-		m_signals_pool.resize(4096);
-		m_free_queue.resize(4096);
-		for(int i = 0; i < 4096; ++i) {
-			m_free_queue[i] = i;
-			m_signals_pool[i].sibling = jobs::INVALID_HANDLE;
-			m_signals_pool[i].generation = 0;
+		m_free_signals.init();
+		m_free_waiting_jobs.init();
+		for (Signal& signal : m_signals_pool) {
+			signal.state = 0;
+			signal.waiters = WAITERS_CLOSED;
 		}
 	}
 
 
+	// protects m_free_fibers and is held across fiber switches in wait(), signals do not use it
 	Mutex m_sync;
 	Mutex m_job_queue_sync;
+	// number of fibers in m_ready_fibers, so workers do not need to lock to check it
+	volatile i32 m_ready_fibers_count = 0;
+	volatile i32 m_sleeping_workers = 0;
 	Array<WorkerTask*> m_workers;
 	Array<WorkerTask*> m_backup_workers;
-	Array<Job> m_job_queue;
-	Array<Signal> m_signals_pool;
-	FiberDecl m_fiber_pool[512];
-	Array<FiberDecl*> m_free_fibers;
+	JobQueue m_job_queue;
+	Signal m_signals_pool[MAX_SIGNALS];
+	IndexFreeList<MAX_SIGNALS> m_free_signals;
+	WaitingJob m_waiting_jobs[MAX_WAITING_JOBS];
+	IndexFreeList<MAX_WAITING_JOBS> m_free_waiting_jobs;
+	FiberDecl m_fiber_pool[FIBERS_COUNT[0] + FIBERS_COUNT[1]];
+	Array<FiberDecl*> m_free_fibers[(u32)StackSize::COUNT];
 	Array<FiberDecl*> m_ready_fibers;
 	IAllocator& m_allocator;
-	Array<u32> m_free_queue;
+	// scratch allocators of threads which are not workers, protected by m_sync
+	Array<LinearAllocator*> m_thread_scratches;
 };
 
 
 static Local<System> g_system;
 static thread_local WorkerTask* g_worker = nullptr;
+static thread_local LinearAllocator* g_thread_scratch = nullptr;
 
 #pragma optimize( "", off )
 WorkerTask* getWorker()
@@ -103,6 +261,21 @@ WorkerTask* getWorker()
 
 static bool isValid(SignalHandle waitable) { return waitable != INVALID_HANDLE; }
 
+// call only with m_sync locked
+static FiberDecl* popFreeFiber(StackSize stack_size)
+{
+	Array<FiberDecl*>& free_fibers = g_system->m_free_fibers[(u32)stack_size];
+	LUMIX_FATAL(!free_fibers.empty());
+	FiberDecl* fiber = free_fibers.back();
+	free_fibers.pop();
+	if (!Fiber::isValid(fiber->fiber)) {
+		// created lazily, so we pay only for the stacks we need
+		fiber->fiber = Fiber::create(FIBER_STACK_SIZES[(u32)stack_size], manage, fiber);
+	}
+	return fiber;
+}
+
+
 struct WorkerTask : Thread
 {
 	WorkerTask(System& system, u8 worker_index) 
@@ -131,11 +304,7 @@ struct WorkerTask : Thread
 	#endif
 	{
 		g_system->m_sync.enter();
-		FiberDecl* fiber = g_system->m_free_fibers.back();
-		g_system->m_free_fibers.pop();
-		if (!Fiber::isValid(fiber->fiber)) {
-			fiber->fiber = Fiber::create(64 * 1024, manage, fiber);
-		}
+		FiberDecl* fiber = popFreeFiber(StackSize::DEFAULT);
 		getWorker()->m_current_fiber = fiber;
 		Fiber::switchTo(&getWorker()->m_primary_fiber, fiber->fiber);
 	}
@@ -145,130 +314,210 @@ struct WorkerTask : Thread
 	FiberDecl* m_current_fiber = nullptr;
 	Fiber::Handle m_primary_fiber;
 	System& m_system;
-	Array<Job> m_job_queue;
+	WorkStealingQueue m_work_queues[(u32)Priority::COUNT];
+	// jobs pinned to this worker and fibers waiting to be resumed on this worker, protected by m_job_queue_sync
+	JobQueue m_job_queue;
 	Array<FiberDecl*> m_ready_fibers;
+	volatile i32 m_ready_fibers_count = 0;
 	u8 m_worker_index;
 	bool m_is_enabled = false;
 	bool m_is_backup = false;
+	// on slower cores of hybrid CPUs, see popJob
+	bool m_is_efficiency_core = false;
+	// protected by m_job_queue_sync
+	bool m_is_sleeping = false;
 };
 
 
+// call only with m_job_queue_sync locked
+static void wakeupWorker(WorkerTask* worker)
+{
+	if (worker->m_is_sleeping) {
+		worker->m_is_sleeping = false;
+		atomicDecrement(&g_system->m_sleeping_workers);
+	}
+	worker->wakeup();
+}
+
+
+// call only with m_job_queue_sync locked
+static void wakeupAnySleepingWorker()
+{
+	for (WorkerTask* worker : g_system->m_workers) {
+		if (worker->m_is_sleeping) {
+			wakeupWorker(worker);
+			return;
+		}
+	}
+	for (WorkerTask* worker : g_system->m_backup_workers) {
+		if (worker->m_is_enabled && worker->m_is_sleeping) {
+			wakeupWorker(worker);
+			return;
+		}
+	}
+}
+
+
+static LUMIX_FORCE_INLINE u32 toHandleGeneration(i64 state) { return u32((state >> 32) & 0xffFF) << 16; }
+
+
+static LUMIX_FORCE_INLINE bool isAlive(i64 state, SignalHandle handle)
+{
+	return u32(state) != 0 && toHandleGeneration(state) == (handle & HANDLE_GENERATION_MASK);
+}
+
+
 static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
 {
-	LUMIX_FATAL(!g_system->m_free_queue.empty());
+	const i32 id = g_system->m_free_signals.pop();
+	LUMIX_FATAL(id >= 0);
+
+	Signal& signal = g_system->m_signals_pool[id];
+	// generation was bumped when the signal was freed
+	const i64 state = signal.state;
+	ASSERT(u32(state) == 0);
+	const u32 generation = toHandleGeneration(state);
+	signal.waiters = i32(generation | WAITERS_EMPTY);
+	memoryBarrier();
+	signal.state = state | 1;
+
+	return u32(id) | generation;
+}
 
-	const u32 handle = g_system->m_free_queue.back();
-	Signal& w = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
-	w.value = 1;
-	w.sibling = jobs::INVALID_HANDLE;
-	w.next_job.task = nullptr;
-	g_system->m_free_queue.pop();
 
-	return (handle & HANDLE_ID_MASK) | w.generation;
+// returns `handle` with incremented counter, or a new signal if `handle` is already triggered
+static SignalHandle addSignalRef(SignalHandle handle)
+{
+	if (isValid(handle)) {
+		Signal& signal = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+		for (;;) {
+			const i64 state = signal.state;
+			if (!isAlive(state, handle)) break;
+			if (compareAndExchange64(&signal.state, state + 1, state)) return handle;
+		}
+	}
+	return allocateSignal();
 }
 
 
 static void pushJob(const Job& job)
 {
 	if (job.worker_index != ANY_WORKER) {
+		MutexGuard queue_lock(g_system->m_job_queue_sync);
 		WorkerTask* worker = g_system->m_workers[job.worker_index % g_system->m_workers.size()];
 		worker->m_job_queue.push(job);
-		worker->wakeup();
+		wakeupWorker(worker);
 		return;
 	}
-	g_system->m_job_queue.push(job);
-	for (WorkerTask* worker : g_system->m_workers) {
-		worker->wakeup();
-	}
-	for (WorkerTask* worker : g_system->m_backup_workers) {
-		if (worker->m_is_enabled) worker->wakeup();
+
+	// backup workers can get disabled, so they do not own any jobs
+	WorkerTask* worker = getWorker();
+	if (worker && !worker->m_is_backup && worker->m_work_queues[(u32)job.priority].push(job)) {
+		// pairs with the barrier in manage() before a worker goes to sleep
+		memoryBarrier();
+		if (g_system->m_sleeping_workers > 0) {
+			MutexGuard queue_lock(g_system->m_job_queue_sync);
+			wakeupAnySleepingWorker();
+		}
+		return;
 	}
+
+	MutexGuard queue_lock(g_system->m_job_queue_sync);
+	g_system->m_job_queue.push(job);
+	wakeupAnySleepingWorker();
 }
 
 
 void trigger(SignalHandle handle)
 {
-	LUMIX_FATAL((handle & HANDLE_ID_MASK) < 4096);
-
-	MutexGuard lock(g_system->m_sync);
-	
-	Signal& counter = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
-	--counter.value;
-	if (counter.value > 0) return;
-
-	SignalHandle iter = handle;
-	while (isValid(iter)) {
-		Signal& signal = g_system->m_signals_pool[iter & HANDLE_ID_MASK];
-		if(signal.next_job.task) {
-			MutexGuard queue_lock(g_system->m_job_queue_sync);
-			pushJob(signal.next_job);
+	LUMIX_FATAL((handle & HANDLE_ID_MASK) < MAX_SIGNALS);
+
+	Signal& signal = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+	for (;;) {
+		const i64 state = signal.state;
+		ASSERT(isAlive(state, handle));
+		if (u32(state) > 1) {
+			if (compareAndExchange64(&signal.state, state - 1, state)) return;
+			continue;
 		}
-		signal.generation = (((signal.generation >> 16) + 1) & 0xffFF) << 16;
-		g_system->m_free_queue.push((iter & HANDLE_ID_MASK) | signal.generation);
-		signal.next_job.task = nullptr;
-		iter = signal.sibling;
+		// last decrement, bump generation so the handle becomes stale
+		const i64 new_state = ((state >> 32) + 1) << 32;
+		if (compareAndExchange64(&signal.state, new_state, state)) break;
+	}
+
+	// nobody can add a waiting job after this
+	i32 waiters;
+	for (;;) {
+		waiters = signal.waiters;
+		if (compareAndExchange(&signal.waiters, (waiters & HANDLE_GENERATION_MASK) | WAITERS_CLOSED, waiters)) break;
 	}
+
+	u32 idx = waiters & HANDLE_ID_MASK;
+	while (idx != WAITERS_EMPTY) {
+		WaitingJob& waiting = g_system->m_waiting_jobs[idx];
+		const Job job = waiting.job;
+		const u32 next = waiting.next;
+		g_system->m_free_waiting_jobs.push(idx);
+		pushJob(job);
+		idx = next;
+	}
+
+	g_system->m_free_signals.push(handle & HANDLE_ID_MASK);
 }
 
 
-static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle, bool lock)
+static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle)
 {
 	if (!isValid(handle)) return true;
+	return !isAlive(g_system->m_signals_pool[handle & HANDLE_ID_MASK].state, handle);
+}
 
-	const u32 gen = handle & HANDLE_GENERATION_MASK;
-	const u32 id = handle & HANDLE_ID_MASK;
-	
-	if (lock) g_system->m_sync.enter();
-	Signal& counter = g_system->m_signals_pool[id];
-	bool is_zero = counter.generation != gen || counter.value == 0;
-	if (lock) g_system->m_sync.exit();
-	return is_zero;
+
+// returns false if `precondition` is already triggered, job is not queued in such case
+static bool addWaitingJob(SignalHandle precondition, const Job& job)
+{
+	const i32 idx = g_system->m_free_waiting_jobs.pop();
+	LUMIX_FATAL(idx >= 0);
+	WaitingJob& waiting = g_system->m_waiting_jobs[idx];
+	waiting.job = job;
+
+	Signal& signal = g_system->m_signals_pool[precondition & HANDLE_ID_MASK];
+	for (;;) {
+		const i32 waiters = signal.waiters;
+		const bool is_closed = (waiters & HANDLE_ID_MASK) == WAITERS_CLOSED;
+		if (is_closed || u32(waiters & HANDLE_GENERATION_MASK) != (precondition & HANDLE_GENERATION_MASK)) {
+			g_system->m_free_waiting_jobs.push(idx);
+			return false;
+		}
+		waiting.next = waiters & HANDLE_ID_MASK;
+		if (compareAndExchange(&signal.waiters, (waiters & HANDLE_GENERATION_MASK) | idx, waiters)) return true;
+	}
 }
 
 
 static LUMIX_FORCE_INLINE void runInternal(void* data
 	, void (*task)(void*)
 	, SignalHandle precondition
-	, bool do_lock
 	, SignalHandle* on_finish
-	, u8 worker_index)
+	, u8 worker_index
+	, Priority priority
+	, StackSize stack_size)
 {
+	ASSERT(priority < Priority::COUNT);
+	ASSERT(stack_size < StackSize::COUNT);
 	Job j;
 	j.data = data;
 	j.task = task;
 	j.worker_index = worker_index != ANY_WORKER ? worker_index % getWorkersCount() : worker_index;
 	j.precondition = precondition;
-
-	if (do_lock) g_system->m_sync.enter();
-	j.dec_on_finish = [&]() -> SignalHandle {
-		if (!on_finish) return INVALID_HANDLE;
-		if (isValid(*on_finish) && !isSignalZero(*on_finish, false)) {
-			++g_system->m_signals_pool[*on_finish & HANDLE_ID_MASK].value;
-			return *on_finish;
-		}
-		return allocateSignal();
-	}();
+	j.priority = priority;
+	j.stack_size = stack_size;
+	j.dec_on_finish = on_finish ? addSignalRef(*on_finish) : INVALID_HANDLE;
 	if (on_finish) *on_finish = j.dec_on_finish;
 
-	if (!isValid(precondition) || isSignalZero(precondition, false)) {
-		MutexGuard lock(g_system->m_job_queue_sync);
+	if (!isValid(precondition) || !addWaitingJob(precondition, j)) {
 		pushJob(j);
 	}
-	else {
-		Signal& counter = g_system->m_signals_pool[precondition & HANDLE_ID_MASK];
-		if(counter.next_job.task) {
-			const SignalHandle ch = allocateSignal();
-			Signal& c = g_system->m_signals_pool[ch & HANDLE_ID_MASK];
-			c.next_job = j;
-			c.sibling = counter.sibling;
-			counter.sibling = ch;
-		}
-		else {
-			counter.next_job = j;
-		}
-	}
-
-	if (do_lock) g_system->m_sync.exit();
 }
 
 
@@ -279,6 +528,7 @@ void enableBackupWorker(bool enable)
 	for (WorkerTask* task : g_system->m_backup_workers) {
 		if (task->m_is_enabled != enable) {
 			task->m_is_enabled = enable;
+			if (enable) task->wakeup();
 			return;
 		}
 	}
@@ -301,14 +551,7 @@ void enableBackupWorker(bool enable)
 void incSignal(SignalHandle* signal)
 {
 	ASSERT(signal);
-	MutexGuard lock(g_system->m_sync);
-	
-	if (isValid(*signal) && !isSignalZero(*signal, false)) {
-		++g_system->m_signals_pool[*signal & HANDLE_ID_MASK].value;
-	}
-	else {
-		*signal = allocateSignal();
-	}
+	*signal = addSignalRef(*signal);
 }
 
 
@@ -318,15 +561,72 @@ void decSignal(SignalHandle signal)
 }
 
 
-void run(void* data, void(*task)(void*), SignalHandle* on_finished)
+void run(void* data, void(*task)(void*), SignalHandle* on_finished, Priority priority, StackSize stack_size)
+{
+	runInternal(data, task, INVALID_HANDLE, on_finished, ANY_WORKER, priority, stack_size);
+}
+
+
+void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index, Priority priority, StackSize stack_size)
 {
-	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER);
+	runInternal(data, task, precondition, on_finished, worker_index, priority, stack_size);
 }
 
 
-void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index)
+// call only with m_job_queue_sync locked
+static bool popReadyFiber(WorkerTask* worker, FiberDecl*& fiber)
 {
-	runInternal(data, task, precondition, true, on_finished, worker_index);
+	if (!worker->m_ready_fibers.empty()) {
+		fiber = worker->m_ready_fibers.back();
+		worker->m_ready_fibers.pop();
+		atomicDecrement(&worker->m_ready_fibers_count);
+		return true;
+	}
+	if (!g_system->m_ready_fibers.empty()) {
+		fiber = g_system->m_ready_fibers.back();
+		g_system->m_ready_fibers.pop();
+		atomicDecrement(&g_system->m_ready_fibers_count);
+		return true;
+	}
+	return false;
+}
+
+
+// call only with m_job_queue_sync locked
+static bool popLockedJob(WorkerTask* worker, Priority priority, Job& job)
+{
+	return worker->m_job_queue.pop(priority, job) || g_system->m_job_queue.pop(priority, job);
+}
+
+
+static bool popLockFreeJob(WorkerTask* worker, Priority priority, Job& job)
+{
+	if (worker->m_work_queues[(u32)priority].pop(job)) return true;
+
+	const i32 count = g_system->m_workers.size();
+	const i32 start = worker->m_is_backup ? 0 : worker->m_worker_index + 1;
+	for (i32 i = 0; i < count; ++i) {
+		WorkerTask* victim = g_system->m_workers[(start + i) % count];
+		if (victim == worker) continue;
+		if (victim->m_work_queues[(u32)priority].steal(job)) return true;
+	}
+	return false;
+}
+
+
+// picks the most important job with at least `lowest` priority
+static bool popJob(WorkerTask* worker, Priority lowest, Job& job)
+{
+	for (u32 i = 0; i <= (u32)lowest; ++i) {
+		// efficiency cores prefer background work, so frame critical jobs end up on performance cores
+		const Priority priority = worker->m_is_efficiency_core ? Priority((u32)lowest - i) : (Priority)i;
+		if (worker->m_job_queue.mightHave(priority) || g_system->m_job_queue.mightHave(priority)) {
+			MutexGuard lock(g_system->m_job_queue_sync);
+			if (popLockedJob(worker, priority, job)) return true;
+		}
+		if (popLockFreeJob(worker, priority, job)) return true;
+	}
+	return false;
 }
 
 
@@ -353,33 +653,46 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 
 		FiberDecl* fiber = nullptr;
 		Job job;
-		while (!worker->m_finished) {
-			MutexGuard lock(g_system->m_job_queue_sync);
-
-			if (!worker->m_ready_fibers.empty()) {
-				fiber = worker->m_ready_fibers.back();
-				worker->m_ready_fibers.pop();
-				break;
+		if (this_fiber->current_job.task) {
+			job = this_fiber->current_job;
+		}
+		else while (!worker->m_finished) {
+			if (worker->m_ready_fibers_count > 0 || g_system->m_ready_fibers_count > 0) {
+				MutexGuard lock(g_system->m_job_queue_sync);
+				if (popReadyFiber(worker, fiber)) break;
 			}
-			if (!worker->m_job_queue.empty()) {
-				job = worker->m_job_queue.back();
-				worker->m_job_queue.pop();
-				break;
+			if (popJob(worker, Priority::LOW, job)) break;
+
+			MutexGuard lock(g_system->m_job_queue_sync);
+			if (popReadyFiber(worker, fiber)) break;
+			bool found = false;
+			for (u32 i = 0; i < (u32)Priority::COUNT && !found; ++i) {
+				found = popLockedJob(worker, (Priority)i, job);
 			}
-			if (!g_system->m_ready_fibers.empty()) {
-				fiber = g_system->m_ready_fibers.back();
-				g_system->m_ready_fibers.pop();
-				break;
+			if (found) break;
+
+			worker->m_is_sleeping = true;
+			atomicIncrement(&g_system->m_sleeping_workers);
+			// pairs with the barrier in pushJob(), either we see the pushed job or the pusher sees us sleeping
+			memoryBarrier();
+			for (u32 i = 0; i < (u32)Priority::COUNT && !found; ++i) {
+				found = popLockFreeJob(worker, (Priority)i, job);
 			}
-			if(!g_system->m_job_queue.empty()) {
-				job = g_system->m_job_queue.back();
-				g_system->m_job_queue.pop();
+			if (found) {
+				if (worker->m_is_sleeping) {
+					worker->m_is_sleeping = false;
+					atomicDecrement(&g_system->m_sleeping_workers);
+				}
 				break;
 			}
 
 			PROFILE_BLOCK("sleeping");
 			profiler::blockColor(0xff, 0, 0xff);
 			worker->sleep(g_system->m_job_queue_sync);
+			if (worker->m_is_sleeping) {
+				worker->m_is_sleeping = false;
+				atomicDecrement(&g_system->m_sleeping_workers);
+			}
 		}
 		if (worker->m_finished) break;
 
@@ -389,13 +702,27 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 
 			g_system->m_sync.enter();
             LUMIX_FATAL(!this_fiber->current_job.task);
-			g_system->m_free_fibers.push(this_fiber);
+			g_system->m_free_fibers[(u32)this_fiber->stack_size].push(this_fiber);
 			Fiber::switchTo(&this_fiber->fiber, fiber->fiber);
 			g_system->m_sync.exit();
 
 			worker = getWorker();
 			worker->m_current_fiber = this_fiber;
 		}
+		else if (job.stack_size > this_fiber->stack_size) {
+			// hand the job over to a fiber with big enough stack
+			profiler::endBlock();
+			g_system->m_sync.enter();
+			FiberDecl* big_fiber = popFreeFiber(job.stack_size);
+			big_fiber->current_job = job;
+			worker->m_current_fiber = big_fiber;
+			g_system->m_free_fibers[(u32)this_fiber->stack_size].push(this_fiber);
+			Fiber::switchTo(&this_fiber->fiber, big_fiber->fiber);
+			g_system->m_sync.exit();
+
+			worker = getWorker();
+			worker->m_current_fiber = this_fiber;
+		}
 		else {
 			profiler::endBlock();
 			profiler::beginBlock("job");
@@ -417,28 +744,51 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 }
 
 
+// workers are spread over physical cores first, fastest cores first, SMT siblings are used only if there are more workers than cores
+static u64 getWorkerAffinity(Span<const os::CPUCore> cores, u32 worker_idx, bool& is_efficiency_core)
+{
+	is_efficiency_core = false;
+	if (cores.length() == 0) return (u64)1 << worker_idx;
+
+	const os::CPUCore& core = cores[worker_idx % cores.length()];
+	is_efficiency_core = core.performance < cores[0].performance;
+	u64 mask = core.mask;
+	for (u32 i = 0, c = worker_idx / cores.length(); i < c && (mask & (mask - 1)); ++i) mask &= mask - 1;
+	return mask & (~mask + 1);
+}
+
+
 bool init(u8 workers_count, IAllocator& allocator)
 {
 	g_system.create(allocator);
 
-	g_system->m_free_fibers.reserve(lengthOf(g_system->m_fiber_pool));
-	for (FiberDecl& fiber : g_system->m_fiber_pool) {
-		g_system->m_free_fibers.push(&fiber);
+	u32 fiber_idx = 0;
+	for (u32 i = 0; i < (u32)StackSize::COUNT; ++i) {
+		g_system->m_free_fibers[i].reserve(FIBERS_COUNT[i]);
+		for (u32 j = 0; j < FIBERS_COUNT[i]; ++j) {
+			FiberDecl& decl = g_system->m_fiber_pool[fiber_idx];
+			decl.idx = fiber_idx;
+			decl.stack_size = (StackSize)i;
+			g_system->m_free_fibers[i].push(&decl);
+			++fiber_idx;
+		}
 	}
 
-	const int fiber_num = lengthOf(g_system->m_fiber_pool);
-	for(int i = 0; i < fiber_num; ++i) { 
-		FiberDecl& decl = g_system->m_fiber_pool[i];
-		decl.idx = i;
-	}
+	os::CPUCore cores[64];
+	const u32 cores_count = os::getCPUCores(Span(cores));
+	u32 efficiency_workers = 0;
 
 	int count = maximum(1, int(workers_count));
+	// running workers iterate m_workers when stealing, so it must not be reallocated
+	g_system->m_workers.reserve(count);
 	for (int i = 0; i < count; ++i) {
-		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i < 64 ? u64(1) << i : 0);
+		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, u8(i));
+		const u64 affinity = getWorkerAffinity(Span(cores, cores_count), i, task->m_is_efficiency_core);
 		if (task->create("Worker", false)) {
 			task->m_is_enabled = true;
 			g_system->m_workers.push(task);
-			task->setAffinityMask((u64)1 << i);
+			task->setAffinityMask(affinity);
+			if (task->m_is_efficiency_core) ++efficiency_workers;
 		}
 		else {
 			logError("Job system worker failed to initialize.");
@@ -446,6 +796,9 @@ bool init(u8 workers_count, IAllocator& allocator)
 		}
 	}
 
+	if (cores_count > 0) {
+		logInfo("Job system: ", g_system->m_workers.size(), " workers on ", cores_count, " cores, ", efficiency_workers, " on efficiency cores");
+	}
 	return !g_system->m_workers.empty();
 }
 
@@ -458,6 +811,23 @@ u8 getWorkersCount()
 }
 
 
+u32 getQueuedJobsCount()
+{
+	auto count = [](const JobQueue& queue){
+		i32 res = 0;
+		for (i32 c : queue.m_counts) res += c;
+		return res;
+	};
+	// read without locks, so it's only an estimate
+	i32 res = count(g_system->m_job_queue);
+	for (WorkerTask* worker : g_system->m_workers) {
+		res += count(worker->m_job_queue);
+		for (const WorkStealingQueue& q : worker->m_work_queues) res += maximum(q.m_bottom - q.m_top, 0);
+	}
+	return u32(maximum(res, 0));
+}
+
+
 void shutdown()
 {
 	IAllocator& allocator = g_system->m_allocator;
@@ -491,6 +861,11 @@ void shutdown()
 		if(Fiber::isValid(fiber.fiber)) {
 			Fiber::destroy(fiber.fiber);
 		}
+		if (fiber.scratch) LUMIX_DELETE(allocator, fiber.scratch);
+	}
+
+	for (LinearAllocator* scratch : g_system->m_thread_scratches) {
+		LUMIX_DELETE(allocator, scratch);
 	}
 
 	g_system.destroy();
@@ -499,58 +874,157 @@ void shutdown()
 
 void wait(SignalHandle handle)
 {
-	g_system->m_sync.enter();
-	if (isSignalZero(handle, false)) {
-		g_system->m_sync.exit();
-		return;
-	}
+	if (isSignalZero(handle)) return;
 	
 	if (!getWorker()) {
-		while (!isSignalZero(handle, false)) {
-			g_system->m_sync.exit();
+		while (!isSignalZero(handle)) {
 			os::sleep(1);
-			g_system->m_sync.enter();
 		}
-		g_system->m_sync.exit();
 		return;
 	}
 
 	profiler::blockColor(0xff, 0, 0);
 	FiberDecl* this_fiber = getWorker()->m_current_fiber;
 
+	// m_sync is held until this fiber is switched out, so the fiber is not resumed before that
+	g_system->m_sync.enter();
 	runInternal(this_fiber, [](void* data){
+		MutexGuard sync_lock(g_system->m_sync);
 		MutexGuard lock(g_system->m_job_queue_sync);
 		FiberDecl* fiber = (FiberDecl*)data;
 		if (fiber->current_job.worker_index == ANY_WORKER) {
 			g_system->m_ready_fibers.push(fiber);
-			for (WorkerTask* worker : g_system->m_workers) {
-				worker->wakeup();
-			}
+			atomicIncrement(&g_system->m_ready_fibers_count);
+			wakeupAnySleepingWorker();
 		}
 		else {
 			WorkerTask* worker = g_system->m_workers[fiber->current_job.worker_index % g_system->m_workers.size()];
 			worker->m_ready_fibers.push(fiber);
-			worker->wakeup();
+			atomicIncrement(&worker->m_ready_fibers_count);
+			wakeupWorker(worker);
 		}
-	}, handle, false, nullptr, 0);
+	}, handle, nullptr, 0, Priority::HIGH, StackSize::DEFAULT);
 	
 	const profiler::FiberSwitchData& switch_data = profiler::beginFiberWait(handle);
-	FiberDecl* new_fiber = g_system->m_free_fibers.back();
-	g_system->m_free_fibers.pop();
-	if (!Fiber::isValid(new_fiber->fiber)) {
-		new_fiber->fiber = Fiber::create(64 * 1024, manage, new_fiber);
-	}
+	FiberDecl* new_fiber = popFreeFiber(StackSize::DEFAULT);
 	getWorker()->m_current_fiber = new_fiber;
 	Fiber::switchTo(&this_fiber->fiber, new_fiber->fiber);
 	getWorker()->m_current_fiber = this_fiber;
 	g_system->m_sync.exit();
 	profiler::endFiberWait(handle, switch_data);
 	
-	#ifdef LUMIX_DEBUG
-		g_system->m_sync.enter();
-		ASSERT(isSignalZero(handle, false));
-		g_system->m_sync.exit();
-	#endif
+	ASSERT(isSignalZero(handle));
+}
+
+
+
+void wait(SignalHandle handle, Priority lowest)
+{
+	if (!getWorker() || isSignalZero(handle)) {
+		wait(handle);
+		return;
+	}
+
+	FiberDecl* this_fiber = getWorker()->m_current_fiber;
+	const Job outer_job = this_fiber->current_job;
+	PROFILE_BLOCK("wait running jobs");
+	u32 idle_polls = 0;
+	while (!isSignalZero(handle)) {
+		Job job;
+		if (!popJob(getWorker(), lowest, job)) {
+			// the signal might depend on less important jobs, do not spin forever
+			if (++idle_polls > 1024) {
+				wait(handle);
+				break;
+			}
+			continue;
+		}
+		idle_polls = 0;
+
+		if (job.stack_size > this_fiber->stack_size) {
+			// would overflow this fiber's stack, requeue it so manage() hands it to a big enough fiber
+			pushJob(job);
+			wait(handle);
+			break;
+		}
+
+		profiler::beginBlock("job");
+		if (isValid(job.dec_on_finish) || isValid(job.precondition)) {
+			profiler::pushJobInfo(job.dec_on_finish, job.precondition);
+		}
+		// if the inner job waits, this fiber must be resumed where the outer job is allowed to run
+		this_fiber->current_job = job;
+		if (outer_job.worker_index != ANY_WORKER) this_fiber->current_job.worker_index = outer_job.worker_index;
+		job.task(job.data);
+		this_fiber->current_job = outer_job;
+		if (isValid(job.dec_on_finish)) {
+			trigger(job.dec_on_finish);
+		}
+		profiler::endBlock();
+	}
+}
+
+static LinearAllocator& getScratch()
+{
+	WorkerTask* worker = getWorker();
+	if (worker) {
+		FiberDecl* fiber = worker->m_current_fiber;
+		if (!fiber->scratch) fiber->scratch = LUMIX_NEW(g_system->m_allocator, LinearAllocator)(SCRATCH_RESERVE);
+		return *fiber->scratch;
+	}
+
+	if (!g_thread_scratch) {
+		MutexGuard lock(g_system->m_sync);
+		g_thread_scratch = LUMIX_NEW(g_system->m_allocator, LinearAllocator)(SCRATCH_RESERVE);
+		g_system->m_thread_scratches.push(g_thread_scratch);
+	}
+	return *g_thread_scratch;
+}
+
+
+void forEach(i32 count, GrainHint hint, void* user_ptr, void (*f)(void*, i32, i32, const ForEachContext&))
+{
+	if (count <= 0) return;
+
+	const i32 workers_count = getWorkersCount();
+	// keep enough chunks so that workers finishing early have something to steal
+	const i32 max_grain = maximum(1, count / (workers_count * 4));
+	const i32 initial_grain = clamp(i32(FOR_EACH_CHUNK_NS / maximum(hint.item_cost_ns, 1u)), 1, max_grain);
+	
+	if (workers_count == 1 || count <= initial_grain) {
+		LinearAllocator& scratch = getScratch();
+		const u32 offset = scratch.getOffset();
+		const ForEachContext ctx = { 0, scratch };
+		f(user_ptr, 0, count, ctx);
+		scratch.rewind(offset);
+		return;
+	}
+
+	const u64 target_ticks = maximum(u64(1), os::Timer::getFrequency() * FOR_EACH_CHUNK_NS / 1'000'000'000);
+	volatile i32 offset = 0;
+	volatile i32 grain = initial_grain;
+	volatile i32 worker_counter = 0;
+
+	runOnWorkers([&](){
+		LinearAllocator& scratch = getScratch();
+		const ForEachContext ctx = { u32(atomicIncrement(&worker_counter) - 1), scratch };
+		for (;;) {
+			const i32 step = grain;
+			const i32 from = atomicAdd(&offset, step);
+			if (from >= count) break;
+			const i32 to = minimum(from + step, count);
+
+			const u32 scratch_offset = scratch.getOffset();
+			const u64 start = os::Timer::getRawTimestamp();
+			f(user_ptr, from, to, ctx);
+			const u64 duration = os::Timer::getRawTimestamp() - start;
+			scratch.rewind(scratch_offset);
+
+			// move only halfway to the ideal grain, so a single outlier does not make it oscillate
+			const u64 ideal = duration > 0 ? u64(to - from) * target_ticks / duration : u64(max_grain);
+			grain = clamp(i32((u64(step) + minimum(ideal, u64(max_grain))) / 2), 1, max_grain);
+		}
+	});
 }
 
-} // namespace Lumix::jobs
\ No newline at end of file
+} // namespace Lumix::jobs
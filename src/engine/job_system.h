@@ -1,4 +1,5 @@
 #pragma once
+#include "atomic.h"
 #include "lumix.h"
 
 namespace Lumix {
@@ -11,18 +12,56 @@ using SignalHandle = u32;
 constexpr u8 ANY_WORKER = 0xff;
 constexpr u32 INVALID_HANDLE = 0xffFFffFF;
 
+// workers pick more important jobs first
+enum class Priority : u8 {
+	HIGH,	// frame critical work, e.g. render setup
+	NORMAL,
+	LOW,	// background work, e.g. navmesh generation
+
+	COUNT
+};
+
+// jobs are run on fibers with at least this big stack
+enum class StackSize : u8 {
+	DEFAULT,	// 64kB
+	LARGE,		// 1MB, for deep recursion or big stack arrays, e.g. physx tasks
+
+	COUNT
+};
+
 LUMIX_ENGINE_API bool init(u8 workers_count, IAllocator& allocator);
 LUMIX_ENGINE_API void shutdown();
 LUMIX_ENGINE_API u8 getWorkersCount();
+// jobs waiting to be executed, approximate
+LUMIX_ENGINE_API u32 getQueuedJobsCount();
 
 LUMIX_ENGINE_API void enableBackupWorker(bool enable);
 
 LUMIX_ENGINE_API void incSignal(SignalHandle* signal);
 LUMIX_ENGINE_API void decSignal(SignalHandle signal);
 
-LUMIX_ENGINE_API void run(void* data, void(*task)(void*), SignalHandle* on_finish);
-LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index);
+LUMIX_ENGINE_API void run(void* data, void(*task)(void*), SignalHandle* on_finish, Priority priority = Priority::NORMAL, StackSize stack_size = StackSize::DEFAULT);
+LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index, Priority priority = Priority::NORMAL, StackSize stack_size = StackSize::DEFAULT);
 LUMIX_ENGINE_API void wait(SignalHandle waitable);
+// runs only jobs with at least `lowest` priority on the calling fiber until `waitable` is triggered,
+// so a long less important job can not delay the waiting one; falls back to wait(waitable) if there's nothing to run
+LUMIX_ENGINE_API void wait(SignalHandle waitable, Priority lowest);
+
+struct ForEachContext {
+	// in [0, getWorkersCount()), unique among the concurrent callers in one forEach
+	u32 worker_index;
+	// rewound after each call of the callback, so the memory is valid only until the callback returns
+	// owned by the calling fiber, so the callback can jobs::wait or run nested forEach while using it
+	IAllocator& scratch;
+};
+
+struct GrainHint {
+	// expected time to process one item, used to pick the initial number of items per call
+	u32 item_cost_ns;
+};
+
+// number of items per call is tuned from `hint` and measured time of previous calls
+LUMIX_ENGINE_API void forEach(i32 count, GrainHint hint, void* user_ptr, void (*f)(void*, i32, i32, const ForEachContext&));
 
 
 template <typename F>
@@ -61,6 +100,14 @@ void forEach(i32 count, i32 step, const F& f)
 	});
 }
 
+template <typename F>
+void forEach(i32 count, GrainHint hint, const F& f)
+{
+	forEach(count, hint, (void*)&f, [](void* user_ptr, i32 from, i32 to, const ForEachContext& ctx){
+		(*(const F*)user_ptr)(from, to, ctx);
+	});
+}
+
 } // namespace jobs
 
 } // namespace Lumix
\ No newline at end of file
@@ -24,6 +24,11 @@ i32 atomicAdd(i32 volatile* addend, i32 value)
 	return __sync_fetch_and_add(addend, value);
 }
 
+i64 atomicAdd(i64 volatile* addend, i64 value)
+{
+	return __sync_fetch_and_add(addend, value);
+}
+
 i32 atomicSubtract(i32 volatile* addend, i32 value)
 {
 	return __sync_fetch_and_sub(addend, value);
@@ -46,4 +51,16 @@ LUMIX_ENGINE_API void memoryBarrier()
 }
 
 
+LUMIX_ENGINE_API void writeBarrier()
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+LUMIX_ENGINE_API void readBarrier()
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+
 } // namespace Lumix
@@ -1,9 +1,12 @@
 #include "engine/fibers.h"
+#include "engine/log.h"
 #include "engine/lumix.h"
 #include "engine/profiler.h"
 #include <ucontext.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace Lumix
 {
@@ -25,14 +28,28 @@ void initThread(FiberProc proc, Handle* out)
 }
 
 
+static size_t getPageSize()
+{
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	return page_size;
+}
+
+
 Handle create(int stack_size, FiberProc proc, void* parameter)
 {
 	ucontext_t fib;
 	getcontext(&fib);
-    fib.uc_stack.ss_sp = (::malloc)(stack_size);
-    fib.uc_stack.ss_size = stack_size;
-    fib.uc_link = 0;
-    makecontext(&fib, (void(*)())proc, 1, parameter); 
+	// stack grows down, so the guard page at the lowest address catches overflows
+	const size_t page_size = getPageSize();
+	const size_t size = (stack_size + page_size - 1) & ~(page_size - 1);
+	u8* mem = (u8*)mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	LUMIX_FATAL(mem != MAP_FAILED);
+	const int res = mprotect(mem, page_size, PROT_NONE);
+	LUMIX_FATAL(res == 0);
+	fib.uc_stack.ss_sp = mem + page_size;
+	fib.uc_stack.ss_size = size;
+	fib.uc_link = 0;
+	makecontext(&fib, (void(*)())proc, 1, parameter); 
 	return fib;
 }
 
@@ -43,7 +60,8 @@ bool isValid(Handle handle)
 
 void destroy(Handle fiber)
 {
-	ASSERT(false);
+	const size_t page_size = getPageSize();
+	munmap((u8*)fiber.uc_stack.ss_sp - page_size, fiber.uc_stack.ss_size + page_size);
 }
 
 
@@ -0,0 +1,101 @@
+#include "engine/network.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace Lumix::os {
+
+
+// fd 0 is valid, so handles are offset by one
+static int toFD(Socket* socket) { return int((uintptr)socket - 1); }
+static Socket* toSocket(int fd) { return fd < 0 ? nullptr : (Socket*)(uintptr)(fd + 1); }
+
+
+Socket* listenTCP(u16 port) {
+	const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return nullptr;
+
+	const int reuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, 1) != 0) {
+		::close(fd);
+		return nullptr;
+	}
+	return toSocket(fd);
+}
+
+
+Socket* acceptTCP(Socket* listener) {
+	const int fd = ::accept(toFD(listener), nullptr, nullptr);
+	if (fd < 0) return nullptr;
+	const int no_delay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	return toSocket(fd);
+}
+
+
+Socket* connectTCP(const char* host, u16 port) {
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* info;
+	if (getaddrinfo(host, nullptr, &hints, &info) != 0) return nullptr;
+
+	sockaddr_in addr;
+	memcpy(&addr, info->ai_addr, sizeof(addr));
+	freeaddrinfo(info);
+	addr.sin_port = htons(port);
+
+	const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return nullptr;
+	if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		::close(fd);
+		return nullptr;
+	}
+	const int no_delay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	return toSocket(fd);
+}
+
+
+bool send(Socket* socket, const void* data, u64 size) {
+	const u8* iter = (const u8*)data;
+	while (size > 0) {
+		const ssize_t sent = ::send(toFD(socket), iter, size, MSG_NOSIGNAL);
+		if (sent <= 0) return false;
+		iter += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+
+bool receive(Socket* socket, void* data, u64 size) {
+	u8* iter = (u8*)data;
+	while (size > 0) {
+		const ssize_t received = ::recv(toFD(socket), iter, size, 0);
+		if (received <= 0) return false;
+		iter += received;
+		size -= received;
+	}
+	return true;
+}
+
+
+void close(Socket* socket) {
+	if (!socket) return;
+	shutdown(toFD(socket), SHUT_RDWR);
+	::close(toFD(socket));
+}
+
+
+} // namespace Lumix::os
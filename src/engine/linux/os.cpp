@@ -100,7 +100,6 @@ void init() {
 
 	XInitThreads();
 	G.display = XOpenDisplay(nullptr);
-	G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
 
 	struct {
 		KeySym x11;
@@ -286,6 +285,10 @@ void init() {
 		s_keycode_names[(u8)m.lumix] = m.name;
 	}
 
+	// headless, e.g. dedicated server in a container
+	if (!G.display) return;
+
+	G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
 	G.net_wm_state_atom = XInternAtom(G.display, "_NET_WM_STATE", False);
 	G.net_wm_state_maximized_horz_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_HORZ", False);
 	G.net_wm_state_maximized_vert_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_VERT", False);
@@ -406,9 +409,165 @@ bool InputFile::seek(u64 pos) {
 }
 
 
+bool InputFile::readAt(u64 offset, void* data, u64 size) {
+	ASSERT(nullptr != m_handle);
+	const int fd = fileno((FILE*)m_handle);
+	u8* dst = (u8*)data;
+	while (size > 0) {
+		const ssize_t res = pread(fd, dst, size, offset);
+		if (res <= 0) return false;
+		dst += res;
+		offset += res;
+		size -= res;
+	}
+	return true;
+}
+
+
+void MappedFile::operator=(MappedFile&& rhs) {
+	if (this == &rhs) return;
+	close();
+	m_data = rhs.m_data;
+	m_size = rhs.m_size;
+	m_copy_on_write = rhs.m_copy_on_write;
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+}
+
+
+bool MappedFile::open(const char* path, bool copy_on_write) {
+	ASSERT(!m_data);
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void* mem = mmap(nullptr, st.st_size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+	// mapping keeps the file referenced
+	::close(fd);
+	if (mem == MAP_FAILED) return false;
+
+	// start reading ahead now, so the reader does not stall on every page
+	// copy on write views are usually accessed only partially, so they are read on demand
+	if (!copy_on_write) madvise(mem, st.st_size, MADV_WILLNEED);
+	m_data = (const u8*)mem;
+	m_size = st.st_size;
+	m_copy_on_write = copy_on_write;
+	return true;
+}
+
+
+void MappedFile::close() {
+	if (m_data) {
+		munmap((void*)m_data, m_size);
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
+
+
 u32 getCPUsCount() {
 	return sysconf(_SC_NPROCESSORS_ONLN);
 }
+
+
+static bool readSysFile(const char* path, Span<char> out) {
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	const size_t read = fread(out.begin(), 1, out.length() - 1, f);
+	fclose(f);
+	out[(u32)read] = '\0';
+	return read > 0;
+}
+
+
+// e.g. "0-3,8,10-11"
+static u64 parseCPUList(const char* list) {
+	u64 mask = 0;
+	const char* c = list;
+	while (*c >= '0' && *c <= '9') {
+		char* end;
+		const u32 from = (u32)strtoul(c, &end, 10);
+		u32 to = from;
+		if (*end == '-') to = (u32)strtoul(end + 1, &end, 10);
+		for (u32 i = from; i <= to && i < 64; ++i) mask |= (u64)1 << i;
+		c = *end == ',' ? end + 1 : end;
+	}
+	return mask;
+}
+
+
+u32 getCPUCores(Span<CPUCore> cores) {
+	const u32 cpus_count = minimum(getCPUsCount(), 64u);
+	u32 count = 0;
+	u64 capacities[64];
+	for (u32 cpu = 0; cpu < cpus_count && count < cores.length(); ++cpu) {
+		char path[128];
+		char tmp[256];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+		if (!readSysFile(path, Span(tmp))) return 0;
+		const u64 mask = parseCPUList(tmp);
+		// each core is reported by its first logical processor
+		if ((mask & (((u64)1 << cpu) - 1)) != 0) continue;
+
+		// cpu_capacity exists on hybrid CPUs with recent kernels, max frequency is the fallback
+		u64 capacity = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+		if (!readSysFile(path, Span(tmp))) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+			if (!readSysFile(path, Span(tmp))) tmp[0] = '\0';
+		}
+		capacity = strtoull(tmp, nullptr, 10);
+
+		u32 domain = 0;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index3/id", cpu);
+		if (readSysFile(path, Span(tmp))) domain = (u32)strtoul(tmp, nullptr, 10);
+
+		capacities[count] = capacity;
+		cores[count].mask = mask;
+		cores[count].cache_domain = (u8)domain;
+		cores[count].performance = 0;
+		++count;
+	}
+
+	// performance is the index of the core's capacity class, so it's 0 everywhere on non-hybrid CPUs
+	// max frequencies of cores of one type differ slightly, classes start at least 10% apart
+	u64 sorted[64];
+	memcpy(sorted, capacities, sizeof(sorted[0]) * count);
+	qsort(sorted, count, sizeof(sorted[0]), [](const void* a, const void* b) -> int {
+		const u64 ca = *(const u64*)a;
+		const u64 cb = *(const u64*)b;
+		return ca < cb ? -1 : (ca > cb ? 1 : 0);
+	});
+	u64 class_starts[64];
+	u32 classes_count = 0;
+	for (u32 i = 0; i < count; ++i) {
+		if (classes_count == 0 || sorted[i] > class_starts[classes_count - 1] * 11 / 10) {
+			class_starts[classes_count] = sorted[i];
+			++classes_count;
+		}
+	}
+	for (u32 i = 0; i < count; ++i) {
+		u32 cls = 0;
+		while (cls + 1 < classes_count && capacities[i] >= class_starts[cls + 1]) ++cls;
+		cores[i].performance = (u8)cls;
+	}
+
+	for (u32 i = 1; i < count; ++i) {
+		const CPUCore core = cores[i];
+		u32 j = i;
+		while (j > 0 && (cores[j - 1].performance < core.performance || (cores[j - 1].performance == core.performance && cores[j - 1].cache_domain > core.cache_domain))) {
+			cores[j] = cores[j - 1];
+			--j;
+		}
+		cores[j] = core;
+	}
+	return count;
+}
 void sleep(u32 milliseconds) {
 	if (milliseconds) usleep(useconds_t(milliseconds * 1000));
 }
@@ -460,6 +619,8 @@ bool getEvent(Event& e) {
 		return true;
 	}
 
+	if (!G.display) return false;
+
 next:
 	if (XPending(G.display) <= 0) return false;
 	XEvent xevent;
@@ -916,6 +1077,29 @@ void memRelease(void* ptr, size_t size) {
 	munmap(ptr, size);
 }
 
+size_t getLargeMemPageSize() {
+	return 2 * 1024 * 1024;
+}
+
+void* memReserveLargePages(size_t size) {
+	ASSERT(size % getLargeMemPageSize() == 0);
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mem != MAP_FAILED) return mem;
+
+	// no preallocated huge pages, ask for transparent huge pages instead
+	const size_t alignment = getLargeMemPageSize();
+	u8* raw = (u8*)mmap(nullptr, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) return nullptr;
+	u8* aligned = (u8*)((uintptr(raw) + alignment - 1) & ~uintptr(alignment - 1));
+	if (aligned != raw) munmap(raw, aligned - raw);
+	munmap(aligned + size, raw + alignment - aligned);
+	if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+		munmap(aligned, size);
+		return nullptr;
+	}
+	return aligned;
+}
+
 struct FileIterator {};
 
 FileIterator* createFileIterator(const char* path, IAllocator& allocator) {
@@ -1068,7 +1252,7 @@ bool moveFile(const char* from, const char* to) {
 
 size_t getFileSize(const char* path) {
 	struct stat tmp;
-	stat(path, &tmp);
+	if (stat(path, &tmp) != 0) return 0;
 	return tmp.st_size;
 }
 
@@ -1,11 +1,14 @@
 #include "engine/allocators.h"
+#include "engine/atomic.h"
 #include "engine/crt.h"
 #include "engine/delegate_list.h"
 #include "engine/log.h"
+#include "engine/os.h"
 #include "engine/path.h"
 #include "engine/stream.h"
 #include "engine/string.h"
 #include "engine/sync.h"
+#include "engine/thread.h"
 
 
 namespace Lumix
@@ -20,12 +23,90 @@ void fatal(bool cond, const char* msg)
 }
 
 namespace detail {
+	// bounded MPMC queue (D. Vyukov), producers are logging threads, consumer is whoever holds Logger::mutex
+	struct LogQueue {
+		static constexpr u32 SIZE = 256; // power of 2
+		// longer messages are dispatched synchronously
+		static constexpr u32 SLOT_SIZE = 512;
+
+		struct Slot {
+			volatile i64 seq;
+			u64 timestamp;
+			LogLevel level;
+			char text[SLOT_SIZE];
+		};
+
+		LogQueue() {
+			for (u32 i = 0; i < SIZE; ++i) slots[i].seq = i;
+		}
+
+		bool push(LogLevel level, u64 timestamp, const char* text, u32 len) {
+			i64 pos = enqueue_pos;
+			for (;;) {
+				Slot& slot = slots[pos & (SIZE - 1)];
+				const i64 seq = slot.seq;
+				readBarrier();
+				if (seq == pos) {
+					if (compareAndExchange64(&enqueue_pos, pos + 1, pos)) break;
+				}
+				else if (seq < pos) {
+					// full
+					return false;
+				}
+				pos = enqueue_pos;
+			}
+			Slot& slot = slots[pos & (SIZE - 1)];
+			slot.timestamp = timestamp;
+			slot.level = level;
+			memcpy(slot.text, text, len + 1);
+			memoryBarrier();
+			slot.seq = pos + 1;
+			return true;
+		}
+
+		Slot* front() {
+			Slot& slot = slots[dequeue_pos & (SIZE - 1)];
+			const i64 seq = slot.seq;
+			readBarrier();
+			return seq == dequeue_pos + 1 ? &slot : nullptr;
+		}
+
+		void pop() {
+			Slot& slot = slots[dequeue_pos & (SIZE - 1)];
+			memoryBarrier();
+			slot.seq = dequeue_pos + SIZE;
+			++dequeue_pos;
+		}
+
+		Slot slots[SIZE];
+		volatile i64 enqueue_pos = 0;
+		i64 dequeue_pos = 0;
+	};
+
+	struct RateLimit {
+		u32 max_per_second = 0;
+		volatile i64 window_start = 0;
+		volatile i32 count = 0;
+		volatile i32 suppressed = 0;
+	};
+
+	struct FlushThread final : Thread {
+		FlushThread(IAllocator& allocator) : Thread(allocator) {}
+		int task() override;
+		volatile bool finished = false;
+	};
+
 	struct Logger {
 		Logger() : callback(allocator) {}
+		~Logger() { setLogAsync(false); }
 
 		Mutex mutex;
 		DefaultAllocator allocator;
 		LogCallback callback;
+		LogQueue queue;
+		FlushThread* flush_thread = nullptr;
+		RateLimit rate_limits[(u32)LogLevel::COUNT];
+		u64 dispatched_timestamp = 0;
 	};
 
 	struct Log {
@@ -44,20 +125,118 @@ namespace detail {
 	void addLog(i32 val) { g_log.message << val; }
 	void addLog(float val) { g_log.message << val; }
 
-	void lock() { g_logger.mutex.enter(); }
+	// call with g_logger.mutex locked
+	static void dispatch(LogLevel level, u64 timestamp, const char* text) {
+		g_logger.dispatched_timestamp = timestamp;
+		g_logger.callback.invoke(level, text);
+	}
+
+	// call with g_logger.mutex locked
+	static void drainQueue() {
+		while (LogQueue::Slot* slot = g_logger.queue.front()) {
+			dispatch(slot->level, slot->timestamp, slot->text);
+			g_logger.queue.pop();
+		}
+	}
+
+	// queued messages are dispatched first, so callbacks see messages in order and are not unbound before they get them
+	void lock() {
+		g_logger.mutex.enter();
+		drainQueue();
+	}
+
 	void unlock() { g_logger.mutex.exit(); }
 
+	static void emit(LogLevel level, u64 timestamp, const char* text, u32 len) {
+		if (g_logger.flush_thread && level != LogLevel::ERROR && len < LogQueue::SLOT_SIZE) {
+			if (g_logger.queue.push(level, timestamp, text, len)) return;
+		}
+		MutexGuard guard(g_logger.mutex);
+		drainQueue();
+		dispatch(level, timestamp, text);
+	}
+
+	static bool checkRateLimit(LogLevel level, u64 timestamp) {
+		RateLimit& limit = g_logger.rate_limits[(u32)level];
+		if (limit.max_per_second == 0) return true;
+
+		const i64 start = limit.window_start;
+		if (timestamp - start > os::Timer::getFrequency() && compareAndExchange64(&limit.window_start, timestamp, start)) {
+			atomicSubtract(&limit.count, limit.count);
+			const i32 suppressed = limit.suppressed;
+			if (suppressed > 0) {
+				atomicSubtract(&limit.suppressed, suppressed);
+				StaticString<64> msg(suppressed, " messages suppressed by rate limit");
+				emit(level, timestamp, msg, stringLength(msg));
+			}
+		}
+		if (atomicIncrement(&limit.count) > (i32)limit.max_per_second) {
+			atomicIncrement(&limit.suppressed);
+			return false;
+		}
+		return true;
+	}
+
 	void emitLog(LogLevel level) {
-		g_log.message.write('\0');
-		{
-			MutexGuard lock(g_logger.mutex);
-			g_logger.callback.invoke(level, (const char*)g_log.message.data());
+		const u64 timestamp = os::Timer::getRawTimestamp();
+		if (checkRateLimit(level, timestamp)) {
+			g_log.message.write('\0');
+			emit(level, timestamp, (const char*)g_log.message.data(), u32(g_log.message.size() - 1));
 		}
 		g_log.message.clear();
 	}
 
+	int FlushThread::task() {
+		while (!finished) {
+			g_logger.mutex.enter();
+			drainQueue();
+			g_logger.mutex.exit();
+			os::sleep(5);
+		}
+		return 0;
+	}
+
 	LogCallback& getLogCallback() { return g_logger.callback; }
 } // namespace detail
 
 
+void setLogAsync(bool enable) {
+	using namespace detail;
+	if (enable == (g_logger.flush_thread != nullptr)) return;
+
+	if (enable) {
+		FlushThread* thread = LUMIX_NEW(g_logger.allocator, FlushThread)(g_logger.allocator);
+		if (!thread->create("log flush", true)) {
+			LUMIX_DELETE(g_logger.allocator, thread);
+			logError("Failed to create log flush thread");
+			return;
+		}
+		g_logger.flush_thread = thread;
+		return;
+	}
+
+	// producers check flush_thread without a lock, a message queued in between is dispatched by the next log call
+	FlushThread* thread = g_logger.flush_thread;
+	g_logger.flush_thread = nullptr;
+	thread->finished = true;
+	thread->destroy();
+	LUMIX_DELETE(g_logger.allocator, thread);
+	flushLog();
+}
+
+
+void flushLog() {
+	detail::lock();
+	detail::unlock();
+}
+
+
+void setLogRateLimit(LogLevel level, u32 max_per_second) {
+	detail::g_logger.rate_limits[(u32)level].max_per_second = max_per_second;
+}
+
+
+u64 getLogTimestamp() { return detail::g_logger.dispatched_timestamp; }
+
+
 } // namespace Lumix
@@ -23,6 +23,28 @@ enum class LogLevel {
 };
 
 LUMIX_ENGINE_API void fatal(bool cond, const char* msg);
+// messages are queued and dispatched to callbacks from a background thread, errors are still dispatched immediately
+LUMIX_ENGINE_API void setLogAsync(bool enable);
+// dispatches all queued messages on the calling thread
+LUMIX_ENGINE_API void flushLog();
+// messages of `level` over `max_per_second` are dropped and counted, 0 is unlimited
+LUMIX_ENGINE_API void setLogRateLimit(LogLevel level, u32 max_per_second);
+// os::Timer::getRawTimestamp() of the message being dispatched, call only from log callbacks
+LUMIX_ENGINE_API u64 getLogTimestamp();
+
+// binary log file is a header followed by records, each record is followed by `size` bytes of text without '\0'
+struct LogFileHeader {
+	static constexpr u32 MAGIC = '_LOG';
+	u32 magic = MAGIC;
+	u32 version = 0;
+	u64 frequency;
+};
+
+struct LogRecord {
+	u64 timestamp;
+	u32 level; // LogLevel
+	u32 size;
+};
 
 namespace detail {
 	using LogCallback = DelegateList<void (LogLevel, const char*)>;
@@ -641,6 +641,13 @@ static Vec3 LUA_getEntityDirection(Universe* universe, i32 entity)
 	return rot.rotate(Vec3(0, 0, 1));
 }
 
+// called from lua through ffi, only plain C types, so jit traces do not have to exit to the interpreter
+static void FFI_getEntityPosition(Universe* universe, i32 entity, DVec3* out) { *out = universe->getPosition({entity}); }
+static void FFI_getEntityRotation(Universe* universe, i32 entity, Quat* out) { *out = universe->getRotation({entity}); }
+static float FFI_getEntityScale(Universe* universe, i32 entity) { return universe->getScale({entity}); }
+static void FFI_setEntityPosition(Universe* universe, i32 entity, double x, double y, double z) { universe->setPosition({entity}, DVec3(x, y, z)); }
+static void FFI_setEntityRotation(Universe* universe, i32 entity, float x, float y, float z, float w) { universe->setRotation({entity}, Quat(x, y, z, w)); }
+static void FFI_setEntityScale(Universe* universe, i32 entity, float scale) { universe->setScale({entity}, scale); }
 static void LUA_setEntityScale(Universe* univ, i32 entity, float scale) { univ->setScale({entity}, scale); }
 static void LUA_setEntityPosition(Universe* univ, i32 entity, const DVec3& pos) { univ->setPosition({entity}, pos); }
 static float LUA_getLastTimeDelta(Engine* engine) { return engine->getLastTimeDelta(); }
@@ -1010,6 +1017,62 @@ void registerEngineAPI(lua_State* L, Engine* engine)
 		logError("Failed to init entity api");
 	}
 
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_getEntityPosition", (void*)&FFI_getEntityPosition);
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_getEntityRotation", (void*)&FFI_getEntityRotation);
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_getEntityScale", (void*)&FFI_getEntityScale);
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_setEntityPosition", (void*)&FFI_setEntityPosition);
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_setEntityRotation", (void*)&FFI_setEntityRotation);
+	LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_setEntityScale", (void*)&FFI_setEntityScale);
+
+	// replaces transform functions with ffi calls, the rest of the api stays as is
+	static const char* ffi_src = R"#(
+		local ok, ffi = pcall(require, "ffi")
+		if not ok then return end
+		ffi.cdef[[
+			typedef struct { double x, y, z; } LumixDVec3;
+			typedef struct { float x, y, z, w; } LumixQuat;
+		]]
+		local api = LumixAPI
+		local get_pos = ffi.cast("void (*)(void*, int, LumixDVec3*)", api._ffi_getEntityPosition)
+		local get_rot = ffi.cast("void (*)(void*, int, LumixQuat*)", api._ffi_getEntityRotation)
+		local get_scale = ffi.cast("float (*)(void*, int)", api._ffi_getEntityScale)
+		local set_pos = ffi.cast("void (*)(void*, int, double, double, double)", api._ffi_setEntityPosition)
+		local set_rot = ffi.cast("void (*)(void*, int, float, float, float, float)", api._ffi_setEntityRotation)
+		local set_scale = ffi.cast("void (*)(void*, int, float)", api._ffi_setEntityScale)
+		local tmp_pos = ffi.new("LumixDVec3[1]")
+		local tmp_rot = ffi.new("LumixQuat[1]")
+		local c_set_rot = api.setEntityRotation
+
+		api.getEntityPosition = function(universe, entity)
+			get_pos(universe, entity, tmp_pos)
+			local p = tmp_pos[0]
+			return { p.x, p.y, p.z }
+		end
+		api.getEntityRotation = function(universe, entity)
+			get_rot(universe, entity, tmp_rot)
+			local r = tmp_rot[0]
+			return { r.x, r.y, r.z, r.w }
+		end
+		api.getEntityScale = function(universe, entity)
+			return get_scale(universe, entity)
+		end
+		api.setEntityPosition = function(universe, entity, pos)
+			set_pos(universe, entity, pos[1], pos[2], pos[3])
+		end
+		api.setEntityRotation = function(universe, entity, rot, angle)
+			-- axis & angle variant
+			if angle ~= nil then return c_set_rot(universe, entity, rot, angle) end
+			if entity < 0 then return end
+			set_rot(universe, entity, rot[1], rot[2], rot[3], rot[4])
+		end
+		api.setEntityScale = function(universe, entity, scale)
+			set_scale(universe, entity, scale)
+		end
+	)#";
+	if (!LuaWrapper::execute(L, Span(ffi_src, stringLength(ffi_src)), __FILE__ "(" TO_STR(__LINE__) ")", 0)) {
+		logError("Failed to init ffi api");
+	}
+
 	installLuaPackageLoader(L);
 }
 
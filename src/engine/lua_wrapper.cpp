@@ -1,5 +1,9 @@
 #include "lua_wrapper.h"
+#include "allocator.h"
+#include "crt.h"
 #include "log.h"
+#include "os.h"
+#include "profiler.h"
 #include "string.h"
 
 namespace Lumix::LuaWrapper {
@@ -25,6 +29,117 @@ namespace Lumix::LuaWrapper {
 	}
 #endif
 
+static const u32 SIZE_CLASSES[LuaAllocator::SIZE_CLASSES_COUNT] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+static u32 getSizeClass(size_t size) {
+	ASSERT(size <= LuaAllocator::MAX_SMALL_SIZE);
+	u32 i = 0;
+	while (SIZE_CLASSES[i] < size) ++i;
+	return i;
+}
+
+LuaAllocator::LuaAllocator(IAllocator& source)
+	: m_source(source)
+{}
+
+LuaAllocator::~LuaAllocator() {
+	void* chunk = m_chunks;
+	while (chunk) {
+		void* next = *(void**)chunk;
+		m_source.deallocate(chunk);
+		chunk = next;
+	}
+}
+
+bool LuaAllocator::allocateChunk(u32 size_class) {
+	u8* chunk = (u8*)m_source.allocate(CHUNK_SIZE);
+	if (!chunk) return false;
+	*(void**)chunk = m_chunks;
+	m_chunks = chunk;
+	m_pooled_bytes += CHUNK_SIZE;
+
+	// first 16 bytes are the link, so blocks stay 16B aligned
+	const u32 block_size = SIZE_CLASSES[size_class];
+	for (u32 offset = 16; offset + block_size <= CHUNK_SIZE; offset += block_size) {
+		FreeBlock* block = (FreeBlock*)(chunk + offset);
+		block->next = m_free_lists[size_class];
+		m_free_lists[size_class] = block;
+	}
+	return true;
+}
+
+void* LuaAllocator::allocate(size_t size) {
+	m_allocated_bytes += size;
+	if (size > MAX_SMALL_SIZE) return m_source.allocate(size);
+
+	const u32 size_class = getSizeClass(size);
+	if (!m_free_lists[size_class] && !allocateChunk(size_class)) return nullptr;
+	FreeBlock* block = m_free_lists[size_class];
+	m_free_lists[size_class] = block->next;
+	return block;
+}
+
+void LuaAllocator::deallocate(void* ptr, size_t size) {
+	m_allocated_bytes -= size;
+	if (size > MAX_SMALL_SIZE) {
+		m_source.deallocate(ptr);
+		return;
+	}
+	const u32 size_class = getSizeClass(size);
+	FreeBlock* block = (FreeBlock*)ptr;
+	block->next = m_free_lists[size_class];
+	m_free_lists[size_class] = block;
+}
+
+void* LuaAllocator::reallocate(void* ptr, size_t osize, size_t nsize) {
+	if (osize > MAX_SMALL_SIZE && nsize > MAX_SMALL_SIZE) {
+		void* res = m_source.reallocate(ptr, nsize);
+		if (res) m_allocated_bytes = m_allocated_bytes - osize + nsize;
+		return res;
+	}
+	if (osize <= MAX_SMALL_SIZE && nsize <= MAX_SMALL_SIZE && getSizeClass(osize) == getSizeClass(nsize)) {
+		m_allocated_bytes = m_allocated_bytes - osize + nsize;
+		return ptr;
+	}
+
+	void* res = allocate(nsize);
+	if (!res) return nullptr;
+	memcpy(res, ptr, osize < nsize ? osize : nsize);
+	deallocate(ptr, osize);
+	return res;
+}
+
+void* LuaAllocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+	LuaAllocator* allocator = (LuaAllocator*)ud;
+	if (nsize == 0) {
+		if (ptr) allocator->deallocate(ptr, osize);
+		return nullptr;
+	}
+	if (!ptr) return allocator->allocate(nsize);
+	return allocator->reallocate(ptr, osize, nsize);
+}
+
+lua_State* newState(LuaAllocator& allocator) {
+	lua_State* L = lua_newstate(&LuaAllocator::alloc, &allocator);
+	if (L) return L;
+	logInfo("Lua does not support custom allocator, using default one.");
+	return luaL_newstate();
+}
+
+u32 stepGC(lua_State* L, float budget_ms) {
+	PROFILE_FUNCTION();
+	os::Timer timer;
+	u32 steps = 0;
+	while (timer.getTimeSinceStart() * 1000 < budget_ms) {
+		++steps;
+		// cycle is finished
+		if (lua_gc(L, LUA_GCSTEP, 0)) break;
+	}
+	profiler::pushInt("steps", steps);
+	profiler::pushInt("heap KB", lua_gc(L, LUA_GCCOUNT, 0));
+	return steps;
+}
+
 int traceback (lua_State *L) {
 	if (!lua_isstring(L, 1)) return 1;
 	
@@ -237,4 +352,4 @@ void argError(lua_State* L, int index, const char* expected_type) {
 }
 
 
-} // namespace Lumix::LuaWrapper
\ No newline at end of file
+} // namespace Lumix::LuaWrapper
@@ -9,6 +9,7 @@
 
 namespace Lumix {
 
+struct IAllocator;
 struct Universe;
 struct CameraParams;
 struct PipelineTexture;
@@ -49,6 +50,38 @@ struct Optional {
 	bool valid = false;
 };
 
+// lua passes old size to its allocator, so small blocks are pooled in size classes without any header
+// not thread safe, each lua state needs its own
+struct LUMIX_ENGINE_API LuaAllocator {
+	explicit LuaAllocator(IAllocator& source);
+	~LuaAllocator();
+
+	static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+	u64 getAllocatedBytes() const { return m_allocated_bytes; }
+	u64 getPooledBytes() const { return m_pooled_bytes; }
+
+	enum { SIZE_CLASSES_COUNT = 8, MAX_SMALL_SIZE = 256, CHUNK_SIZE = 64 * 1024 };
+
+private:
+	struct FreeBlock { FreeBlock* next; };
+
+	void* allocate(size_t size);
+	void deallocate(void* ptr, size_t size);
+	void* reallocate(void* ptr, size_t osize, size_t nsize);
+	bool allocateChunk(u32 size_class);
+
+	IAllocator& m_source;
+	FreeBlock* m_free_lists[SIZE_CLASSES_COUNT] = {};
+	void* m_chunks = nullptr; // linked through the first pointer in each chunk
+	u64 m_allocated_bytes = 0;
+	u64 m_pooled_bytes = 0;
+};
+
+// uses `allocator` if lua supports custom allocators, otherwise (64bit luajit without GC64) falls back to luaL_newstate
+LUMIX_ENGINE_API lua_State* newState(LuaAllocator& allocator);
+// incremental gc steps until a cycle is finished or `budget_ms` runs out, heap size is published to profiler
+LUMIX_ENGINE_API u32 stepGC(lua_State* L, float budget_ms);
+
 LUMIX_ENGINE_API int traceback (lua_State *L);
 LUMIX_ENGINE_API bool pcall(lua_State* L, int nargs, int nres);
 LUMIX_ENGINE_API bool execute(lua_State* L, Span<const char> content, const char* name, int nresults);
@@ -50,4 +50,8 @@ template <typename R, typename C, typename... Args> struct ArgsCount<R(C::*)(Arg
 template <typename R, typename C> struct ArgsCount<R(C::*)> { static constexpr u32 value = 0; };
 
 
+template <u32 I, typename T, typename... Ts> struct TypeAt { using Type = typename TypeAt<I - 1, Ts...>::Type; };
+template <typename T, typename... Ts> struct TypeAt<0, T, Ts...> { using Type = T; };
+
+
 } // namespace Lumix
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix::os {
+
+
+// blocking tcp sockets, nullptr is an invalid socket
+struct Socket;
+
+LUMIX_ENGINE_API Socket* listenTCP(u16 port);
+LUMIX_ENGINE_API Socket* acceptTCP(Socket* listener);
+LUMIX_ENGINE_API Socket* connectTCP(const char* host, u16 port);
+// send and receive transfer all of `size` bytes or fail
+LUMIX_ENGINE_API [[nodiscard]] bool send(Socket* socket, const void* data, u64 size);
+LUMIX_ENGINE_API [[nodiscard]] bool receive(Socket* socket, void* data, u64 size);
+// unblocks other threads waiting in acceptTCP or receive on this socket
+LUMIX_ENGINE_API void close(Socket* socket);
+
+
+} // namespace Lumix::os
@@ -119,6 +119,9 @@ struct LUMIX_ENGINE_API InputFile final : IInputStream {
 	u64 pos();
 
 	[[nodiscard]] bool seek(u64 pos);
+	// positional read, can be called from multiple threads at once
+	// do not mix it with read and seek, position of the file is undefined after this
+	[[nodiscard]] bool readAt(u64 offset, void* data, u64 size);
 	
 private:
 	void* m_handle;
@@ -142,6 +145,30 @@ private:
 	void* m_handle;
     bool m_is_error;
 };
+
+
+// view of a whole file, valid until close
+struct LUMIX_ENGINE_API MappedFile {
+	MappedFile() = default;
+	MappedFile(MappedFile&& rhs) : m_data(rhs.m_data), m_size(rhs.m_size), m_copy_on_write(rhs.m_copy_on_write) { rhs.m_data = nullptr; rhs.m_size = 0; }
+	~MappedFile() { close(); }
+	void operator=(MappedFile&& rhs);
+
+	// fails for empty files, since they can not be mapped
+	// copy on write views can be modified, modified pages are private copies and are never written to the file
+	[[nodiscard]] bool open(const char* path, bool copy_on_write = false);
+	void close();
+
+	const u8* data() const { return m_data; }
+	u8* getMutableData() const { ASSERT(m_copy_on_write); return (u8*)m_data; }
+	u64 size() const { return m_size; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	const u8* m_data = nullptr;
+	u64 m_size = 0;
+	bool m_copy_on_write = false;
+};
 	
 
 struct FileInfo {
@@ -159,12 +186,25 @@ struct WindowState {
 LUMIX_ENGINE_API void init();
 LUMIX_ENGINE_API void logInfo();
 LUMIX_ENGINE_API u32 getCPUsCount();
+
+struct CPUCore {
+	u64 mask;			// logical processors of the core, only the first 64 processors are reported
+	u8 performance;		// relative, higher is faster, all cores have 0 on non-hybrid CPUs
+	u8 cache_domain;	// cores sharing L3 cache have the same value
+};
+// physical cores, fastest first, cores sharing cache next to each other
+// returns number of cores written to `cores`, 0 if the topology is unknown
+LUMIX_ENGINE_API u32 getCPUCores(Span<CPUCore> cores);
 LUMIX_ENGINE_API void sleep(u32 milliseconds);
 LUMIX_ENGINE_API ThreadID getCurrentThreadID();
 
 LUMIX_ENGINE_API void* memReserve(size_t size);
 LUMIX_ENGINE_API void memCommit(void* ptr, size_t size);
 LUMIX_ENGINE_API void memRelease(void* ptr, size_t size); // size must be full size used in reserve
+// reserves and commits memory backed by large (usually 2MB) pages, returns nullptr if they are not available
+// size must be multiple of getLargeMemPageSize(), release with memRelease
+LUMIX_ENGINE_API void* memReserveLargePages(size_t size);
+LUMIX_ENGINE_API size_t getLargeMemPageSize();
 LUMIX_ENGINE_API u32 getMemPageSize();
 LUMIX_ENGINE_API u32 getMemPageAlignment();
 
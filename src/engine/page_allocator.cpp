@@ -9,22 +9,142 @@
 namespace Lumix
 {
 
-PageAllocator::PageAllocator() {
+static constexpr u32 MAX_THREAD_CACHE_PAGES = 8;
+
+static constexpr i32 NO_THREAD_CACHE = 64;
+
+// bit per thread cache slot, a slot is released when its thread exits
+static volatile i64 g_used_thread_cache_slots = 0;
+// guards g_first_allocator, plain spin lock, since it's used in static constructors and at thread exit
+static volatile i32 g_allocators_lock = 0;
+static PageAllocator* g_first_allocator = nullptr;
+
+static void lockAllocators() {
+	while (!compareAndExchange(&g_allocators_lock, 1, 0)) {}
+}
+
+static void unlockAllocators() {
+	memoryBarrier();
+	g_allocators_lock = 0;
+}
+
+static i32 acquireThreadCacheSlot() {
+	for (;;) {
+		const i64 used = g_used_thread_cache_slots;
+		const u64 free_slots = ~(u64)used;
+		if (free_slots == 0) return NO_THREAD_CACHE;
+		#ifdef _WIN32
+			unsigned long idx;
+			_BitScanForward64(&idx, free_slots);
+		#else
+			const u32 idx = __builtin_ctzll(free_slots);
+		#endif
+		if (compareAndExchange64(&g_used_thread_cache_slots, used | ((i64)1 << idx), used)) return (i32)idx;
+	}
+}
+
+// returns cached pages to their allocators and releases the slot when the thread exits
+struct PageCacheSlot {
+	~PageCacheSlot() {
+		if (idx < 0 || idx == NO_THREAD_CACHE) {
+			idx = NO_THREAD_CACHE;
+			return;
+		}
+
+		lockAllocators();
+		for (PageAllocator* a = g_first_allocator; a; a = a->next) {
+			a->flushThreadCache(a->thread_caches[idx]);
+		}
+		unlockAllocators();
+
+		for (;;) {
+			const i64 used = g_used_thread_cache_slots;
+			if (compareAndExchange64(&g_used_thread_cache_slots, used & ~((i64)1 << idx), used)) break;
+		}
+		// thread_local destructors running after this one must not grab a new slot
+		idx = NO_THREAD_CACHE;
+	}
+
+	i32 idx = -1;
+};
+
+static thread_local PageCacheSlot g_thread_cache_slot;
+
+template <typename T, u32 N>
+static T* getThreadCache(T (&caches)[N]) {
+	i32& idx = g_thread_cache_slot.idx;
+	if (idx < 0) idx = acquireThreadCacheSlot();
+	// threads over the limit do not have a cache
+	if (idx >= (i32)N) return nullptr;
+	return &caches[idx];
+}
+
+PageAllocator::PageAllocator(bool large_pages)
+	: use_large_pages(large_pages)
+{
 	LUMIX_FATAL(os::getMemPageAlignment() % PAGE_SIZE == 0);
+	if (use_large_pages) {
+		large_block_size = os::getLargeMemPageSize();
+		use_large_pages = large_block_size > 0 && large_block_size % PAGE_SIZE == 0;
+	}
+
+	lockAllocators();
+	next = g_first_allocator;
+	if (g_first_allocator) g_first_allocator->prev = this;
+	g_first_allocator = this;
+	unlockAllocators();
 }
 
 PageAllocator::~PageAllocator()
 {
 	ASSERT(allocated_count == 0);
+	lockAllocators();
+	if (prev) prev->next = next;
+	else g_first_allocator = next;
+	if (next) next->prev = prev;
+	unlockAllocators();
+
+	for (ThreadCache& cache : thread_caches) {
+		while (cache.pages) {
+			void* tmp = cache.pages;
+			memcpy(&cache.pages, tmp, sizeof(tmp)); //-V579
+			memcpy(tmp, &free_pages, sizeof(free_pages));
+			free_pages = tmp;
+		}
+	}
+
 	void* p = free_pages;
 	while (p) {
 		void* tmp = p;
 		memcpy(&p, p, sizeof(p)); //-V579
-		os::memRelease(tmp, PAGE_SIZE);
+		bool is_in_block = false;
+		for (u8* block = (u8*)large_blocks; block && !is_in_block; memcpy(&block, block, sizeof(block))) { //-V579
+			is_in_block = tmp >= block && tmp < block + large_block_size;
+		}
+		if (!is_in_block) os::memRelease(tmp, PAGE_SIZE);
+	}
+
+	while (large_blocks) {
+		void* tmp = large_blocks;
+		memcpy(&large_blocks, tmp, sizeof(tmp)); //-V579
+		os::memRelease(tmp, large_block_size);
 	}
 }
 
 
+void PageAllocator::flushThreadCache(ThreadCache& cache)
+{
+	MutexGuard guard(mutex);
+	while (cache.pages) {
+		void* tmp = cache.pages;
+		memcpy(&cache.pages, tmp, sizeof(tmp)); //-V579
+		memcpy(tmp, &free_pages, sizeof(free_pages));
+		free_pages = tmp;
+	}
+	cache.count = 0;
+}
+
+
 void PageAllocator::lock()
 {
 	mutex.enter();
@@ -37,16 +157,54 @@ void PageAllocator::unlock()
 }
 
 
+// call only with mutex locked, returns one of the new pages, the rest is put in free_pages
+void* PageAllocator::reserveLargePages()
+{
+	u8* block = (u8*)os::memReserveLargePages(large_block_size);
+	if (!block) {
+		logWarning("Large pages are not available.");
+		use_large_pages = false;
+		return nullptr;
+	}
+
+	memcpy(block, &large_blocks, sizeof(large_blocks));
+	large_blocks = block;
+	const u32 count = u32(large_block_size / PAGE_SIZE);
+	reserved_count += count - 1;
+	for (u32 i = 2; i < count; ++i) {
+		void* page = block + i * PAGE_SIZE;
+		memcpy(page, &free_pages, sizeof(free_pages));
+		free_pages = page;
+	}
+	return block + PAGE_SIZE;
+}
+
+
 void* PageAllocator::allocate(bool lock)
 {
+	atomicIncrement(&allocated_count);
+	ThreadCache* cache = getThreadCache(thread_caches);
+	if (cache && cache->pages) {
+		void* tmp = cache->pages;
+		memcpy(&cache->pages, tmp, sizeof(tmp)); //-V579
+		--cache->count;
+		return tmp;
+	}
+
 	if (lock) mutex.enter();
-	++allocated_count;
 	if (free_pages) {
 		void* tmp = free_pages;
 		memcpy(&free_pages, free_pages, sizeof(free_pages)); //-V579
 		if (lock) mutex.exit();
 		return tmp;
 	}
+	if (use_large_pages) {
+		void* mem = reserveLargePages();
+		if (mem) {
+			if (lock) mutex.exit();
+			return mem;
+		}
+	}
 	++reserved_count;
 	if (lock) mutex.exit();
 	void* mem = os::memReserve(PAGE_SIZE);
@@ -58,12 +216,20 @@ void* PageAllocator::allocate(bool lock)
 
 void PageAllocator::deallocate(void* mem, bool lock)
 {
+	atomicDecrement(&allocated_count);
+	ThreadCache* cache = getThreadCache(thread_caches);
+	if (cache && cache->count < MAX_THREAD_CACHE_PAGES) {
+		memcpy(mem, &cache->pages, sizeof(cache->pages));
+		cache->pages = mem;
+		++cache->count;
+		return;
+	}
+
 	if (lock) mutex.enter();
-	--allocated_count;
 	memcpy(mem, &free_pages, sizeof(free_pages));
 	free_pages = mem;
 	if (lock) mutex.exit();
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -18,9 +18,11 @@ public:
 		enum { PAGE_SIZE = 16384 };
 	#endif
 
-	PageAllocator();
+	// with large_pages, pages are carved from blocks backed by OS large pages, if available, to reduce TLB misses
+	explicit PageAllocator(bool large_pages = false);
 	~PageAllocator();
 		
+	// pages are first taken from / returned to a cache of the calling thread, `lock` is used only if the cache can not be used
 	void* allocate(bool lock);
 	void deallocate(void* mem, bool lock);
 	u32 getAllocatedCount() const { return allocated_count; }
@@ -30,10 +32,28 @@ public:
 	void unlock();
 		
 private:
-	u32 allocated_count = 0;
+	struct ThreadCache {
+		void* pages = nullptr;
+		u32 count = 0;
+	};
+
+	friend struct PageCacheSlot;
+
+	void* reserveLargePages();
+	void flushThreadCache(ThreadCache& cache);
+
+	volatile i32 allocated_count = 0;
 	u32 reserved_count = 0;
 	void* free_pages = nullptr;
+	// linked through the first pointer in the block, first page of each block is never allocated
+	void* large_blocks = nullptr;
+	size_t large_block_size = 0;
+	bool use_large_pages;
 	Mutex mutex;
+	ThreadCache thread_caches[64];
+	// all page allocators are linked in a global list, so an exiting thread can return its cached pages
+	PageAllocator* next = nullptr;
+	PageAllocator* prev = nullptr;
 };
 
 
@@ -1,8 +1,11 @@
 #include "engine/lumix.h"
 #include "engine/path.h"
 
+#include "engine/atomic.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/hash_map.h"
+#include "engine/os.h"
 #include "engine/sync.h"
 #include "engine/path.h"
 #include "engine/stream.h"
@@ -13,50 +16,140 @@ namespace Lumix
 {
 
 
-Path::Path()
-	: m_hash(0)
-	, m_path{}
-{}
+namespace {
+
+// append only table of normalized paths, lookups and inserts are lock free
+// strings are never freed, so c_str() of any path is valid until the process ends
+struct PathTable {
+	static constexpr u32 SLOTS_COUNT = 1 << 21;
+	static constexpr u64 ARENA_SIZE = 1ull << 30;
+	static constexpr u32 ALIGN = 8;
+
+	struct Entry {
+		StableHash stable_hash;
+		u32 hash;
+		u32 length;
+		char str[1];
+	};
+
+	PathTable() {
+		m_slots = (volatile i32*)os::memReserve(SLOTS_COUNT * sizeof(m_slots[0]));
+		os::memCommit((void*)m_slots, SLOTS_COUNT * sizeof(m_slots[0]));
+		m_arena = (u8*)os::memReserve(ARENA_SIZE);
+		// handle 0 is the empty path, so default constructed Path does not need the table
+		const u64 offset = alloc(0);
+		ASSERT(offset == 0);
+		Entry* empty = getEntry(0);
+		empty->hash = 0;
+		empty->length = 0;
+		empty->str[0] = '\0';
+	}
+
+	Entry* getEntry(u32 handle) const { return (Entry*)(m_arena + u64(handle) * ALIGN); }
+
+	u64 alloc(u32 length) {
+		const u64 size = (sizeof(Entry) + length + ALIGN - 1) & ~u64(ALIGN - 1);
+		const u64 offset = (u64)atomicAdd(&m_arena_size, (i64)size);
+		ASSERT(offset + size <= ARENA_SIZE);
+		// committing already committed memory is fine, so there's no need to synchronize this
+		const u64 page = os::getMemPageSize();
+		const u64 from = offset & ~(page - 1);
+		const u64 to = (offset + size + page - 1) & ~(page - 1);
+		os::memCommit(m_arena + from, to - from);
+		return offset;
+	}
+
+	static bool equal(const Entry& entry, const char* str, u32 length) {
+		if (entry.length != length) return false;
+		#ifdef _WIN32
+			return equalIStrings(entry.str, str);
+		#else
+			return equalStrings(entry.str, str);
+		#endif
+	}
+
+	// `path` must be normalized
+	u32 intern(const char* path) {
+		const u32 length = stringLength(path);
+		if (length == 0) return 0;
+
+		#ifdef _WIN32
+			char tmp[LUMIX_MAX_PATH];
+			makeLowercase(Span(tmp), path);
+			const StableHash stable_hash(tmp, length);
+			const u32 hash = crc32(tmp, length);
+		#else
+			const StableHash stable_hash(path, length);
+			const u32 hash = crc32(path, length);
+		#endif
+
+		u32 new_handle = 0;
+		for (u32 i = 0; i < SLOTS_COUNT; ++i) {
+			const u32 slot_idx = ((u32)stable_hash.getHashValue() + i) & (SLOTS_COUNT - 1);
+			i32 handle = m_slots[slot_idx];
+			if (handle == 0) {
+				if (new_handle == 0) {
+					const u64 offset = alloc(length);
+					Entry* entry = (Entry*)(m_arena + offset);
+					entry->stable_hash = stable_hash;
+					entry->hash = hash;
+					entry->length = length;
+					memcpy(entry->str, path, length + 1);
+					new_handle = u32(offset / ALIGN);
+				}
+				// entry must be written before it's visible to other threads
+				writeBarrier();
+				if (compareAndExchange(&m_slots[slot_idx], new_handle, 0)) return new_handle;
+				// other thread was faster, our entry stays unused in the arena
+				handle = m_slots[slot_idx];
+			}
+			const Entry& entry = *getEntry(handle);
+			if (entry.stable_hash == stable_hash && equal(entry, path, length)) return handle;
+		}
+		ASSERT(false); // table is full
+		return 0;
+	}
+
+	volatile i32* m_slots;
+	u8* m_arena;
+	volatile i64 m_arena_size = 0;
+};
+
+static PathTable& getPathTable() {
+	// constructed on first use, since paths can be created in static initializers
+	static PathTable table;
+	return table;
+}
+
+} // anonymous namespace
 
 
 Path::Path(const char* path) {
-	normalize(path, Span(m_path));
-	#ifdef _WIN32
-		char tmp[LUMIX_MAX_PATH];
-		makeLowercase(Span(tmp), m_path);
-		m_hash = crc32(tmp);
-	#else
-		m_hash = crc32(m_path);
-	#endif
+	char tmp[LUMIX_MAX_PATH];
+	normalize(path, Span(tmp));
+	m_handle = getPathTable().intern(tmp);
 }
 
 i32 Path::length() const {
-	return stringLength(m_path);
+	return getPathTable().getEntry(m_handle)->length;
 }
 
-void Path::operator =(const char* rhs) {
-	normalize(rhs, Span(m_path));
-	#ifdef _WIN32
-		char tmp[LUMIX_MAX_PATH];
-		makeLowercase(Span(tmp), m_path);
-		m_hash = crc32(tmp);
-	#else
-		m_hash = crc32(m_path);
-	#endif
+u32 Path::getHash() const {
+	return getPathTable().getEntry(m_handle)->hash;
 }
 
-bool Path::operator==(const Path& rhs) const {
-	ASSERT(equalIStrings(m_path, rhs.m_path) == (m_hash == rhs.m_hash));
-	return m_hash == rhs.m_hash;
+StableHash Path::getStableHash() const {
+	return getPathTable().getEntry(m_handle)->stable_hash;
 }
 
-bool Path::operator!=(const Path& rhs) const {
-	ASSERT(equalIStrings(m_path, rhs.m_path) == (m_hash == rhs.m_hash));
-	#ifdef _WIN32
-		return m_hash != rhs.m_hash || !equalIStrings(m_path, rhs.m_path);
-	#else
-		return m_hash != rhs.m_hash || !equalStrings(m_path, rhs.m_path);
-	#endif
+const char* Path::c_str() const {
+	return getPathTable().getEntry(m_handle)->str;
+}
+
+void Path::operator =(const char* rhs) {
+	char tmp[LUMIX_MAX_PATH];
+	normalize(rhs, Span(tmp));
+	m_handle = getPathTable().intern(tmp);
 }
 
 void Path::normalize(const char* path, Span<char> output)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "engine/lumix.h"
+#include "engine/hash.h"
 
 
 namespace Lumix
@@ -23,21 +24,26 @@ struct LUMIX_ENGINE_API Path {
 	static bool hasExtension(const char* filename, const char* ext);
 	static bool replaceExtension(char* path, const char* ext);
 
-	Path();
+	// paths are interned in a global append only table, so Path is just a handle into it
+	// equal paths have equal handles, so comparison is O(1)
+	Path() {}
 	explicit Path(const char* path);
 
 	void operator=(const char* rhs);
-	bool operator==(const Path& rhs) const;
-	bool operator!=(const Path& rhs) const;
+	bool operator==(const Path& rhs) const { return m_handle == rhs.m_handle; }
+	bool operator!=(const Path& rhs) const { return m_handle != rhs.m_handle; }
 
 	i32 length() const;
-	u32 getHash() const { return m_hash; }
-	const char* c_str() const { return m_path; }
-	bool isEmpty() const { return m_path[0] == '\0'; }
+	// crc32, it's a part of asset cache file names and serialized data, prefer getStableHash in lookups
+	u32 getHash() const;
+	StableHash getStableHash() const;
+	// valid for the whole lifetime of the process
+	const char* c_str() const;
+	bool isEmpty() const { return m_handle == 0; }
+	u32 getHandle() const { return m_handle; }
 
 private:
-	char m_path[LUMIX_MAX_PATH];
-	u32 m_hash;
+	u32 m_handle = 0;
 };
 
 
@@ -2,6 +2,7 @@
 #include "engine/debug.h"
 #include "engine/delegate_list.h"
 #include "engine/engine.h"
+#include "engine/job_system.h"
 #include "engine/plugin.h"
 #include "engine/log.h"
 #include "engine/os.h"
@@ -44,13 +45,109 @@ namespace Lumix
 			}
 
 
+			// stable topological sort by init dependencies, plugins without dependencies keep the order they were added in
+			void sortByInitDependencies(Array<i32>& order) {
+				const i32 count = m_plugins.size();
+				Array<i32> state(m_allocator); // 0 - not visited, 1 - visiting, 2 - done
+				state.resize(count);
+				for (i32& s : state) s = 0;
+
+				struct Visitor {
+					void visit(i32 idx) {
+						if (state[idx] == 2) return;
+						if (state[idx] == 1) {
+							logError("Cyclic init dependency of plugin ", manager.m_plugins[idx]->getName());
+							return;
+						}
+						state[idx] = 1;
+						for (const char* dep : manager.m_plugins[idx]->getInitDependencies()) {
+							const i32 dep_idx = manager.getPluginIndex(dep);
+							if (dep_idx < 0) {
+								logError("Plugin ", manager.m_plugins[idx]->getName(), " depends on unknown plugin ", dep);
+								continue;
+							}
+							visit(dep_idx);
+						}
+						state[idx] = 2;
+						order.push(idx);
+					}
+					PluginManagerImpl& manager;
+					Array<i32>& state;
+					Array<i32>& order;
+				} visitor{*this, state, order};
+
+				order.reserve(count);
+				for (i32 i = 0; i < count; ++i) visitor.visit(i);
+			}
+
+
+			i32 getPluginIndex(const char* name) const {
+				for (i32 i = 0, c = m_plugins.size(); i < c; ++i) {
+					if (equalStrings(m_plugins[i]->getName(), name)) return i;
+				}
+				return -1;
+			}
+
+
+			void waitForInitDependencies(const Array<jobs::SignalHandle>& signals, i32 idx) const {
+				for (const char* dep : m_plugins[idx]->getInitDependencies()) {
+					const i32 dep_idx = getPluginIndex(dep);
+					if (dep_idx >= 0 && dep_idx != idx) jobs::wait(signals[dep_idx]);
+				}
+			}
+
+
+			static void initPlugin(IPlugin& plugin) {
+				PROFILE_BLOCK("init plugin");
+				profiler::pushString(plugin.getName());
+				plugin.init();
+			}
+
+
 			void initPlugins() override
 			{
 				PROFILE_FUNCTION();
-				for (int i = 0, c = m_plugins.size(); i < c; ++i)
-				{
-					m_plugins[i]->init();
+				os::Timer timer;
+				Array<i32> order(m_allocator);
+				sortByInitDependencies(order);
+
+				// every plugin has a signal, triggered when its init finishes
+				// thread safe plugins run in jobs waiting for their dependencies, the rest runs here in sorted order,
+				// since dependencies precede dependents in `order`, this can not deadlock
+				struct InitJob {
+					PluginManagerImpl* manager;
+					Array<jobs::SignalHandle>* signals;
+					i32 idx;
+				};
+				Array<jobs::SignalHandle> signals(m_allocator);
+				Array<InitJob> init_jobs(m_allocator);
+				signals.resize(m_plugins.size());
+				init_jobs.resize(m_plugins.size());
+				for (jobs::SignalHandle& s : signals) {
+					s = jobs::INVALID_HANDLE;
+					jobs::incSignal(&s);
+				}
+
+				for (i32 idx : order) {
+					if (!m_plugins[idx]->isInitThreadSafe()) continue;
+					init_jobs[idx] = {this, &signals, idx};
+					jobs::run(&init_jobs[idx], [](void* data){
+						InitJob* job = (InitJob*)data;
+						job->manager->waitForInitDependencies(*job->signals, job->idx);
+						initPlugin(*job->manager->m_plugins[job->idx]);
+						jobs::decSignal((*job->signals)[job->idx]);
+					}, nullptr, jobs::Priority::HIGH, jobs::StackSize::LARGE);
 				}
+
+				for (i32 idx : order) {
+					if (m_plugins[idx]->isInitThreadSafe()) continue;
+					waitForInitDependencies(signals, idx);
+					initPlugin(*m_plugins[idx]);
+					jobs::decSignal(signals[idx]);
+				}
+
+				for (jobs::SignalHandle s : signals) jobs::wait(s);
+				logInfo("Plugins initialized in ", timer.getTimeSinceStart(), " s");
 			}
 
 
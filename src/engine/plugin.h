@@ -30,6 +30,28 @@ struct LUMIX_ENGINE_API PluginManager
 	virtual DelegateList<void(void*)>& libraryLoaded() = 0;
 };
 
+// data shared between scenes, engine runs updates of scenes which do not conflict at the same time
+// access can change from frame to frame, e.g. a scene invoking script callbacks only when some are bound
+struct SceneAccess {
+	enum : u32 {
+		// includes hierarchy, writers also trigger transform callbacks in scenes reading TRANSFORMS
+		TRANSFORMS = 1 << 0,
+		// creating and destroying entities and components; every scene implicitly reads this,
+		// so scenes writing it are never updated concurrently with other scenes
+		COMPONENTS = 1 << 1,
+		POSES = 1 << 2,
+		INPUT = 1 << 3,
+		SCRIPTS = 1 << 4,
+		// queueing renderer jobs, Renderer::queue is not thread safe
+		RENDERER = 1 << 5,
+
+		ALL = 0xffFFffFF
+	};
+
+	u32 reads = ALL;
+	u32 writes = ALL;
+};
+
 struct LUMIX_ENGINE_API IScene
 {
 	virtual ~IScene() {}
@@ -37,14 +59,26 @@ struct LUMIX_ENGINE_API IScene
 	virtual void init() {}
 	virtual void serialize(struct OutputMemoryStream& serializer) = 0;
 	virtual void deserialize(struct InputMemoryStream& serialize, const struct EntityMap& entity_map, i32 version) = 0;
+	// true if deserialize touches only the scene's own data, does not load resources and only reads the universe,
+	// such scenes are deserialized on workers, concurrently with other scenes, see Universe::beginDeferredComponents
+	virtual bool isDeserializeThreadSafe() const { return false; }
 	virtual IPlugin& getPlugin() const = 0;
 	virtual void update(float time_delta, bool paused) = 0;
 	virtual void lateUpdate(float time_delta, bool paused) {}
+	// scenes which do not override this are updated exclusively on the calling thread, in order
+	// others can be updated from any worker, concurrently with scenes they do not conflict with
+	virtual SceneAccess getUpdateAccess() const { return {}; }
 	virtual struct Universe& getUniverse() = 0;
 	virtual void startGame() {}
 	virtual void stopGame() {}
 	virtual i32 getVersion() const { return -1; }
 	virtual void clear() = 0;
+	// fast snapshots, see Universe::saveSnapshot; trivially copyable state is registered in `layout`,
+	// the rest is written in serializeSnapshot; component masks of entities are restored by the universe
+	// scenes returning false have their components destroyed and go through serialize / deserialize
+	virtual bool registerSnapshot(struct SnapshotLayout& layout) { return false; }
+	virtual void serializeSnapshot(OutputMemoryStream& blob) {}
+	virtual void deserializeSnapshot(InputMemoryStream& blob) {}
 };
 
 
@@ -53,6 +87,11 @@ struct LUMIX_ENGINE_API IPlugin
 	virtual ~IPlugin();
 
 	virtual void init() {}
+	// names of plugins whose init must finish before this plugin's init starts
+	virtual Span<const char* const> getInitDependencies() const { return {}; }
+	// init does not touch shared engine state (Lua, resource managers, ...), so it can run on a worker
+	// concurrently with other plugins' init; everything else is initialized on the main thread in order
+	virtual bool isInitThreadSafe() const { return false; }
 	virtual void update(float) {}
 	virtual const char* getName() const = 0;
 	virtual u32 getVersion() const = 0;
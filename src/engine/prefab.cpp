@@ -1,5 +1,9 @@
 #include "engine/crc32.h"
 #include "engine/crt.h"
+#include "engine/engine.h"
+#include "engine/log.h"
+#include "engine/profiler.h"
+#include "engine/universe.h"
 #include "prefab.h"
 
 namespace Lumix
@@ -12,6 +16,7 @@ const ResourceType PrefabResource::TYPE("prefab");
 PrefabResource::PrefabResource(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
 	, data(allocator)
+	, compiled(allocator)
 {
 }
 
@@ -19,7 +24,11 @@ PrefabResource::PrefabResource(const Path& path, ResourceManager& resource_manag
 ResourceType PrefabResource::getType() const { return TYPE; }
 
 
-void PrefabResource::unload() { data.clear(); }
+void PrefabResource::unload() {
+	data.clear();
+	compiled.is_compiled = false;
+	compiled.scenes.clear();
+}
 
 
 bool PrefabResource::load(u64 size, const u8* mem)
@@ -31,4 +40,107 @@ bool PrefabResource::load(u64 size, const u8* mem)
 }
 
 
+PrefabPool::PrefabPool(Engine& engine, Universe& universe, PrefabResource& prefab, IAllocator& allocator)
+	: m_engine(engine)
+	, m_universe(universe)
+	, m_prefab(prefab)
+	, m_instances(allocator)
+	, m_entities(allocator)
+	, m_free(allocator)
+	, m_root_to_instance(allocator)
+{
+	prefab.incRefCount();
+}
+
+
+PrefabPool::~PrefabPool() {
+	ASSERT(m_instances.empty());
+	m_prefab.decRefCount();
+}
+
+
+bool PrefabPool::reserve(u32 count) {
+	PROFILE_FUNCTION();
+	if (!m_prefab.isReady()) {
+		logError("Prefab ", m_prefab.getPath(), " is not ready");
+		return false;
+	}
+	if (count == 0) return true;
+
+	IAllocator& allocator = m_universe.getAllocator();
+	Array<Transform> transforms(allocator);
+	transforms.resize(count);
+	for (Transform& tr : transforms) tr = {DVec3(0), Quat::IDENTITY, 1};
+	
+	Array<EntityRef> roots(allocator);
+	Array<EntityRef> entities(allocator);
+	if (!m_engine.instantiatePrefabs(m_universe, m_prefab, transforms, roots, entities)) return false;
+	if (roots.empty()) return false;
+
+	// all instances of a prefab have the same number of entities
+	const u32 per_instance = entities.size() / roots.size();
+	m_instances.reserve(m_instances.size() + roots.size());
+	m_free.reserve(m_free.size() + roots.size());
+	m_root_to_instance.reserve(m_instances.size() + roots.size());
+	for (i32 i = 0, c = roots.size(); i < c; ++i) {
+		Instance& inst = m_instances.emplace();
+		inst.root = roots[i];
+		inst.first_entity = m_entities.size() + i * per_instance;
+		inst.entity_count = per_instance;
+		m_root_to_instance.insert(inst.root, m_instances.size() - 1);
+		m_free.push(m_instances.size() - 1);
+	}
+	for (EntityRef e : entities) {
+		m_entities.push(e);
+		m_universe.enableEntity(e, false);
+	}
+	return true;
+}
+
+
+void PrefabPool::enableInstance(const Instance& instance, bool enable) {
+	for (u32 i = 0; i < instance.entity_count; ++i) {
+		m_universe.enableEntity(m_entities[instance.first_entity + i], enable);
+	}
+}
+
+
+EntityPtr PrefabPool::acquire(const Transform& transform) {
+	if (m_free.empty() && !reserve(maximum(m_instances.size(), 1))) return INVALID_ENTITY;
+
+	const u32 idx = m_free.back();
+	m_free.pop();
+	const Instance& instance = m_instances[idx];
+	m_universe.setTransform(instance.root, transform);
+	enableInstance(instance, true);
+	return instance.root;
+}
+
+
+void PrefabPool::release(EntityRef root) {
+	auto iter = m_root_to_instance.find(root);
+	if (!iter.isValid()) {
+		ASSERT(false);
+		return;
+	}
+	const Instance& instance = m_instances[iter.value()];
+	if (!m_universe.isEntityEnabled(instance.root)) return; // already released
+	enableInstance(instance, false);
+	m_free.push(iter.value());
+}
+
+
+void PrefabPool::destroyInstances() {
+	for (const Instance& instance : m_instances) {
+		for (u32 i = 0; i < instance.entity_count; ++i) {
+			m_universe.destroyEntity(m_entities[instance.first_entity + i]);
+		}
+	}
+	m_instances.clear();
+	m_entities.clear();
+	m_free.clear();
+	m_root_to_instance.clear();
+}
+
+
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 
+#include "engine/array.h"
+#include "engine/hash_map.h"
 #include "engine/resource.h"
 #include "engine/stream.h"
 
@@ -25,10 +27,64 @@ struct LUMIX_ENGINE_API PrefabResource final : Resource
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 
+	// filled by Engine::instantiatePrefabs on the first instance
+	// following instances skip header and plugin validation and scene lookups
+	struct SceneBlock {
+		u32 scene_hash;
+		i32 version;
+		u32 offset;
+		u32 size;
+	};
+
+	struct Template {
+		Template(IAllocator& allocator) : scenes(allocator) {}
+
+		bool is_compiled = false;
+		u32 version;
+		u32 universe_offset;
+		Array<SceneBlock> scenes;
+	};
+
 	OutputMemoryStream data;
 	u32 content_hash;
+	Template compiled;
 	static const ResourceType TYPE;
 };
 
 
+// instances are created up front and disabled, acquire and release only set transform and toggle enabled state
+// instances are not destroyed with the pool, call destroyInstances while the universe is alive
+struct LUMIX_ENGINE_API PrefabPool
+{
+	PrefabPool(struct Engine& engine, struct Universe& universe, PrefabResource& prefab, IAllocator& allocator);
+	~PrefabPool();
+
+	// creates `count` more disabled instances
+	bool reserve(u32 count);
+	// returns root of enabled instance, the pool grows if there is no free instance
+	EntityPtr acquire(const struct Transform& transform);
+	void release(EntityRef root);
+	void destroyInstances();
+	u32 getFreeCount() const { return m_free.size(); }
+	u32 getInstancesCount() const { return m_instances.size(); }
+
+private:
+	struct Instance {
+		EntityRef root;
+		u32 first_entity;
+		u32 entity_count;
+	};
+
+	void enableInstance(const Instance& instance, bool enable);
+
+	Engine& m_engine;
+	Universe& m_universe;
+	PrefabResource& m_prefab;
+	Array<Instance> m_instances;
+	Array<EntityRef> m_entities;
+	Array<u32> m_free;
+	HashMap<EntityRef, u32> m_root_to_instance;
+};
+
+
 } // namespace Lumix
\ No newline at end of file
@@ -9,9 +9,12 @@
 #include "engine/array.h"
 #include "engine/crt.h"
 #include "engine/hash_map.h"
+#include "engine/log.h"
+#include "engine/lz4.h"
 #include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/math.h"
+#include "engine/network.h"
 #include "engine/string.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
@@ -26,24 +29,54 @@ namespace profiler
 {
 
 
+// events are written without locks by the owning thread, readers take snapshots, see serialize()
 struct ThreadContext
 {
-	ThreadContext(IAllocator& allocator) 
+	static constexpr u32 BUFFER_SIZE = 1 << 19;
+
+	ThreadContext(IAllocator& allocator, bool shared) 
 		: buffer(allocator)
 		, open_blocks(allocator)
+		, shared(shared)
 	{
-		buffer.resize(1024 * 512);
+		buffer.resize(BUFFER_SIZE);
 		open_blocks.reserve(64);
 	}
 
 	Array<const char*> open_blocks;
 	OutputMemoryStream buffer;
-	u32 begin = 0;
-	u32 end = 0;
+	// byte offsets, ring index is offset % BUFFER_SIZE
+	volatile u32 begin = 0;
+	volatile u32 end = 0;
+	// written from many threads, writers lock `mutex`
+	const bool shared;
+	// protects name and show_in_profiler, and events if shared
 	Mutex mutex;
 	StaticString<64> name;
 	bool show_in_profiler = false;
 	u32 thread_id;
+	// events before this were already written by the continuous capture
+	u32 captured_end = 0;
+};
+
+// continuous capture file is a header followed by lz4 compressed chunks, each chunk is the same as serialize() output
+static constexpr u32 CAPTURE_MAGIC = 'LPRC';
+static constexpr u32 CAPTURE_VERSION = 0;
+// remote client sends a command, server answers with magic, frequency, size and serialize() output
+static constexpr u32 REMOTE_MAGIC = 'LPRS';
+static constexpr u32 REMOTE_SNAPSHOT_COMMAND = 0;
+
+struct RemoteServer : Thread {
+	RemoteServer(os::Socket* listener, IAllocator& allocator)
+		: Thread(allocator)
+		, listener(listener)
+	{}
+
+	int task() override;
+
+	os::Socket* listener;
+	os::Socket* volatile client = nullptr;
+	volatile bool finished = false;
 };
 
 #ifdef _WIN32
@@ -93,12 +126,20 @@ struct ThreadContext
 	void CloseTrace(int) {}
 #endif
 
+struct Counter {
+	StaticString<32> name;
+	CounterType type;
+	volatile i64 value;
+	i64 history[COUNTER_HISTORY];
+};
+
+
 static struct Instance
 {
 	Instance()
 		: contexts(allocator)
 		, trace_task(allocator)
-		, global_context(allocator)
+		, global_context(allocator, true)
 	{
 		startTrace();
 	}
@@ -153,7 +194,7 @@ static struct Instance
 	ThreadContext* getThreadContext()
 	{
 		thread_local ThreadContext* ctx = [&](){
-			ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator);
+			ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator, false);
 			new_ctx->thread_id = os::getCurrentThreadID();
 			MutexGuard lock(mutex);
 			contexts.push(new_ctx);
@@ -176,118 +217,103 @@ static struct Instance
 	volatile i32 fiber_wait_id = 0;
 	TraceTask trace_task;
 	ThreadContext global_context;
+	os::OutputFile capture_file;
+	bool capturing = false;
+	float spike_threshold = 0;
+	StaticString<LUMIX_MAX_PATH> spike_path;
+	u32 spike_count = 0;
+	RemoteServer* remote_server = nullptr;
+	Counter counters[MAX_COUNTERS];
+	volatile i32 counters_count = 0;
+	u32 counter_frames = 0;
+	u32 frame_time_counter = INVALID_COUNTER;
+	GPUPassStats gpu_passes[MAX_GPU_PASSES];
+	u32 gpu_passes_count = 0;
+	u32 gpu_frames = 0;
+	u32 gpu_pass_frames[MAX_GPU_PASSES];
 } g_instance;
 
 
-template <typename T>
-void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
+static void copyToRing(u8* buf, u32 offset, const void* data, u32 size)
 {
-	if (g_instance.paused && timestamp > g_instance.paused_time) return;
-
-	#pragma pack(1)
-		struct {
-			EventHeader header;
-			T value;
-		} v;
-	#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = timestamp;
-	v.value = value;
-
-	MutexGuard lock(ctx.mutex);
-	u8* buf = ctx.buffer.getMutableData();
-	const u32 buf_size = (u32)ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
-
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
+	const u32 l = offset % ThreadContext::BUFFER_SIZE;
+	if (ThreadContext::BUFFER_SIZE - l >= size) {
+		memcpy(buf + l, data, size);
 	}
 	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
+		memcpy(buf + l, data, ThreadContext::BUFFER_SIZE - l);
+		memcpy(buf, (const u8*)data + ThreadContext::BUFFER_SIZE - l, size - (ThreadContext::BUFFER_SIZE - l));
 	}
+}
 
-	ctx.end += sizeof(v);
-};
 
-template <typename T>
-void write(ThreadContext& ctx, EventType type, const T& value)
+static u16 eventSizeAt(const u8* buf, u32 offset)
 {
-	if (g_instance.paused) return;
+	// EventHeader::size is the first member
+	const u32 l = offset % ThreadContext::BUFFER_SIZE;
+	return u16(buf[l] | (buf[(l + 1) % ThreadContext::BUFFER_SIZE] << 8));
+}
 
-#pragma pack(1)
-	struct {
-		EventHeader header;
-		T value;
-	} v;
-#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = os::Timer::getRawTimestamp();
-	v.value = value;
 
-	MutexGuard lock(ctx.mutex);
+// single producer, no locks, safe against a concurrent snapshot
+static void push(ThreadContext& ctx, const EventHeader& header, const void* data, u32 data_size)
+{
 	u8* buf = ctx.buffer.getMutableData();
-	const u32 buf_size = (u32)ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
-
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
+	const u32 end = ctx.end;
+	u32 begin = ctx.begin;
+	if (header.size + end - begin > ThreadContext::BUFFER_SIZE) {
+		while (header.size + end - begin > ThreadContext::BUFFER_SIZE) {
+			begin += eventSizeAt(buf, begin);
+		}
+		// readers must see the dropped events before we overwrite them
+		ctx.begin = begin;
+		writeBarrier();
 	}
 
-	ctx.end += sizeof(v);
-};
+	copyToRing(buf, end, &header, sizeof(header));
+	copyToRing(buf, end + sizeof(header), data, data_size);
+	writeBarrier();
+	ctx.end = end + header.size;
+}
 
 
-void write(ThreadContext& ctx, EventType type, const u8* data, int size)
+static void push(ThreadContext& ctx, EventType type, u64 timestamp, const void* data, u32 data_size)
 {
-	if (g_instance.paused) return;
-
 	EventHeader header;
 	header.type = type;
-	ASSERT(sizeof(header) + size <= 0xffff);
-	header.size = u16(sizeof(header) + size);
-	header.time = os::Timer::getRawTimestamp();
-
-	MutexGuard lock(ctx.mutex);
-	u8* buf = ctx.buffer.getMutableData();
-	const u32 buf_size = (u32)ctx.buffer.size();
+	ASSERT(sizeof(header) + data_size <= 0xffff);
+	header.size = u16(sizeof(header) + data_size);
+	header.time = timestamp;
 
-	while (header.size + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
+	if (ctx.shared) {
+		MutexGuard lock(ctx.mutex);
+		push(ctx, header, data, data_size);
+	}
+	else {
+		push(ctx, header, data, data_size);
 	}
+}
 
-	auto cpy = [&](const u8* ptr, u32 size) {
-		const u32 lend = ctx.end % buf_size;
-		if (buf_size - lend >= size) {
-			memcpy(buf + lend, ptr, size);
-		}
-		else {
-			memcpy(buf + lend, ptr, buf_size - lend);
-			memcpy(buf, ((u8*)ptr) + buf_size - lend, size - (buf_size - lend));
-		}
 
-		ctx.end += size;
-	};
+template <typename T>
+void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
+{
+	if (g_instance.paused && timestamp > g_instance.paused_time) return;
+	push(ctx, type, timestamp, &value, sizeof(value));
+};
+
+template <typename T>
+void write(ThreadContext& ctx, EventType type, const T& value)
+{
+	if (g_instance.paused) return;
+	push(ctx, type, os::Timer::getRawTimestamp(), &value, sizeof(value));
+};
+
 
-	cpy((u8*)&header, sizeof(header));
-	cpy(data, size);
+void write(ThreadContext& ctx, EventType type, const u8* data, int size)
+{
+	if (g_instance.paused) return;
+	push(ctx, type, os::Timer::getRawTimestamp(), data, size);
 };
 
 #ifdef _WIN32
@@ -389,7 +415,51 @@ void link(i64 link)
 void gpuFrame()
 {
 	write(g_instance.global_context, EventType::GPU_FRAME, (int)0);
+	// gpu frames and pass stats are reported only from the render thread
+	++g_instance.gpu_frames;
+}
+
+
+void gpuPassStats(const char* name, u32 depth, float gpu_ms, float cpu_ms, u32 draw_calls, u32 triangles, u32 state_changes)
+{
+	MutexGuard lock(g_instance.mutex);
+	u32 idx = 0;
+	for (; idx < g_instance.gpu_passes_count; ++idx) {
+		if (equalStrings(g_instance.gpu_passes[idx].name, name)) break;
+	}
+	if (idx == g_instance.gpu_passes_count) {
+		if (idx == MAX_GPU_PASSES) return;
+		++g_instance.gpu_passes_count;
+		GPUPassStats& p = g_instance.gpu_passes[idx];
+		copyString(p.name, name);
+		p.avg_gpu_ms = gpu_ms;
+		p.avg_cpu_ms = cpu_ms;
+	}
+
+	// exponential moving average, roughly last 30 frames
+	constexpr float AVG_WEIGHT = 1 / 30.f;
+	GPUPassStats& p = g_instance.gpu_passes[idx];
+	p.depth = depth;
+	p.gpu_ms = gpu_ms;
+	p.cpu_ms = cpu_ms;
+	p.avg_gpu_ms += (gpu_ms - p.avg_gpu_ms) * AVG_WEIGHT;
+	p.avg_cpu_ms += (cpu_ms - p.avg_cpu_ms) * AVG_WEIGHT;
+	p.draw_calls = draw_calls;
+	p.triangles = triangles;
+	p.state_changes = state_changes;
+	g_instance.gpu_pass_frames[idx] = g_instance.gpu_frames;
+}
+
 
+u32 getGPUPassStats(Span<GPUPassStats> stats)
+{
+	MutexGuard lock(g_instance.mutex);
+	const u32 count = minimum(stats.length(), g_instance.gpu_passes_count);
+	for (u32 i = 0; i < count; ++i) {
+		stats[i] = g_instance.gpu_passes[i];
+		stats[i].age = g_instance.gpu_frames - g_instance.gpu_pass_frames[i];
+	}
+	return count;
 }
 
 
@@ -478,6 +548,143 @@ bool contextSwitchesEnabled()
 }
 
 
+static void writeCaptureChunk();
+static void saveSpike();
+
+u32 createCounter(const char* name, CounterType type) {
+	// compare truncated names, otherwise long names would never match
+	const StaticString<sizeof(Counter::name)> tmp(name);
+	MutexGuard lock(g_instance.mutex);
+	for (i32 i = 0; i < g_instance.counters_count; ++i) {
+		if (equalStrings(g_instance.counters[i].name, tmp)) return i;
+	}
+	if (g_instance.counters_count == MAX_COUNTERS) return INVALID_COUNTER;
+	Counter& c = g_instance.counters[g_instance.counters_count];
+	c.name = tmp;
+	c.type = type;
+	c.value = 0;
+	memset(c.history, 0, sizeof(c.history));
+	writeBarrier();
+	++g_instance.counters_count;
+	return g_instance.counters_count - 1;
+}
+
+
+void addCounter(u32 counter, i64 value) {
+	if (counter == INVALID_COUNTER) return;
+	atomicAdd(&g_instance.counters[counter].value, value);
+}
+
+
+void setCounter(u32 counter, i64 value) {
+	if (counter == INVALID_COUNTER) return;
+	g_instance.counters[counter].value = value;
+}
+
+
+u64 getCounterTimestamp() {
+	return os::Timer::getRawTimestamp();
+}
+
+
+void addCounterTime(u32 counter, u64 start_timestamp) {
+	const u64 duration = os::Timer::getRawTimestamp() - start_timestamp;
+	addCounter(counter, i64(duration * 1'000'000 / frequency()));
+}
+
+
+static void sampleCounters() {
+	MutexGuard lock(g_instance.mutex);
+	const u32 idx = g_instance.counter_frames % COUNTER_HISTORY;
+	for (i32 i = 0; i < g_instance.counters_count; ++i) {
+		Counter& c = g_instance.counters[i];
+		const i64 v = c.value;
+		// subtract instead of zeroing, so adds from other threads made in the meantime are not lost
+		if (c.type == CounterType::SUM) atomicAdd(&c.value, -v);
+		c.history[idx] = v;
+	}
+	++g_instance.counter_frames;
+}
+
+
+u32 getCountersCount() {
+	return g_instance.counters_count;
+}
+
+
+i64 getCounterValue(u32 counter) {
+	MutexGuard lock(g_instance.mutex);
+	if (counter >= (u32)g_instance.counters_count || g_instance.counter_frames == 0) return 0;
+	return g_instance.counters[counter].history[(g_instance.counter_frames - 1) % COUNTER_HISTORY];
+}
+
+
+static int compareI64(const void* a, const void* b) {
+	const i64 x = *(const i64*)a;
+	const i64 y = *(const i64*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+bool getCounterStats(u32 counter, CounterStats& stats) {
+	MutexGuard lock(g_instance.mutex);
+	if (counter >= (u32)g_instance.counters_count) return false;
+
+	const Counter& c = g_instance.counters[counter];
+	stats.name = c.name;
+	stats.frames = minimum(g_instance.counter_frames, COUNTER_HISTORY);
+	if (stats.frames == 0) {
+		stats.last = stats.min = stats.max = stats.p50 = stats.p95 = stats.p99 = 0;
+		stats.avg = 0;
+		return true;
+	}
+
+	stats.last = c.history[(g_instance.counter_frames - 1) % COUNTER_HISTORY];
+	Array<i64> sorted(g_instance.allocator);
+	sorted.resize(stats.frames);
+	// history is a ring, the first `frames` entries are the valid ones until it wraps
+	memcpy(sorted.begin(), c.history, stats.frames * sizeof(i64));
+	qsort(sorted.begin(), stats.frames, sizeof(i64), compareI64);
+
+	double sum = 0;
+	for (i64 v : sorted) sum += v;
+	stats.avg = sum / stats.frames;
+	stats.min = sorted[0];
+	stats.max = sorted.back();
+	stats.p50 = sorted[(stats.frames - 1) * 50 / 100];
+	stats.p95 = sorted[(stats.frames - 1) * 95 / 100];
+	stats.p99 = sorted[(stats.frames - 1) * 99 / 100];
+	return true;
+}
+
+
+void countersToCSV(OutputMemoryStream& csv, bool per_frame) {
+	const u32 count = getCountersCount();
+	if (!per_frame) {
+		csv << "name,frames,last,min,max,avg,p50,p95,p99\n";
+		for (u32 i = 0; i < count; ++i) {
+			CounterStats stats;
+			if (!getCounterStats(i, stats)) continue;
+			csv << "\"" << stats.name << "\"," << stats.frames << "," << stats.last << "," << stats.min << "," << stats.max << ","
+				<< stats.avg << "," << stats.p50 << "," << stats.p95 << "," << stats.p99 << "\n";
+		}
+		return;
+	}
+
+	MutexGuard lock(g_instance.mutex);
+	csv << "frame";
+	for (u32 i = 0; i < count; ++i) csv << ",\"" << g_instance.counters[i].name << "\"";
+	csv << "\n";
+	const u32 frames = minimum(g_instance.counter_frames, COUNTER_HISTORY);
+	const u32 first = g_instance.counter_frames - frames;
+	for (u32 f = first; f < g_instance.counter_frames; ++f) {
+		csv << f;
+		for (u32 i = 0; i < count; ++i) csv << "," << g_instance.counters[i].history[f % COUNTER_HISTORY];
+		csv << "\n";
+	}
+}
+
+
 void frame()
 {
 	const u64 n = os::Timer::getRawTimestamp();
@@ -486,6 +693,17 @@ void frame()
 	}
 	g_instance.last_frame_time = n;
 	write(g_instance.global_context, EventType::FRAME, 0);
+
+	if (g_instance.frame_time_counter == INVALID_COUNTER) {
+		g_instance.frame_time_counter = createCounter("frame time (us)", CounterType::GAUGE);
+	}
+	setCounter(g_instance.frame_time_counter, i64(g_instance.last_frame_duration * 1'000'000 / frequency()));
+	sampleCounters();
+
+	if (g_instance.capturing) writeCaptureChunk();
+	if (g_instance.spike_threshold > 0 && g_instance.last_frame_duration > g_instance.spike_threshold * frequency()) {
+		saveSpike();
+	}
 }
 
 
@@ -507,10 +725,9 @@ void setThreadName(const char* name)
 }
 
 template <typename T>
-static void read(const ThreadContext& ctx, u32 p, T& value)
+static void read(const u8* buf, u32 p, T& value)
 {
-	const u8* buf = ctx.buffer.data();
-	const u32 buf_size = (u32)ctx.buffer.size();
+	const u32 buf_size = ThreadContext::BUFFER_SIZE;
 	const u32 l = p % buf_size;
 	if (l + sizeof(value) <= buf_size) {
 		memcpy(&value, buf + l, sizeof(value));
@@ -521,19 +738,26 @@ static void read(const ThreadContext& ctx, u32 p, T& value)
 	memcpy((u8*)&value + (buf_size - l), buf, sizeof(value) - (buf_size - l));
 }
 
-static void saveStrings(OutputMemoryStream& blob) {
+struct Snapshot {
+	u64 offset; // of the buffer copy in the blob
+	u32 begin;
+	u32 end;
+};
+
+static void saveStrings(OutputMemoryStream& blob, Span<const Snapshot> snapshots) {
 	HashMap<const char*, const char*> map(g_instance.allocator);
 	map.reserve(512);
-	auto gather = [&](const ThreadContext& ctx){
-		u32 p = ctx.begin;
-		const u32 end = ctx.end;
+	for (const Snapshot& snapshot : snapshots) {
+		const u8* buf = blob.data() + snapshot.offset;
+		u32 p = snapshot.begin;
+		const u32 end = snapshot.end;
 		while (p != end) {
 			profiler::EventHeader header;
-			read(ctx, p, header);
+			read(buf, p, header);
 			switch (header.type) {
 				case profiler::EventType::BEGIN_BLOCK: {
 					const char* name;
-					read(ctx, p + sizeof(profiler::EventHeader), name);
+					read(buf, p + sizeof(profiler::EventHeader), name);
 					if (!map.find(name).isValid()) {
 						map.insert(name, name);
 					}
@@ -541,7 +765,7 @@ static void saveStrings(OutputMemoryStream& blob) {
 				}
 				case profiler::EventType::INT: {
 					IntRecord r;
-					read(ctx, p + sizeof(profiler::EventHeader), r);
+					read(buf, p + sizeof(profiler::EventHeader), r);
 					if (!map.find(r.key).isValid()) {
 						map.insert(r.key, r.key);
 					}
@@ -551,11 +775,6 @@ static void saveStrings(OutputMemoryStream& blob) {
 			}
 			p += header.size;
 		}
-	};
-
-	gather(g_instance.global_context);
-	for (const ThreadContext* ctx : g_instance.contexts) {
-		gather(*ctx);
 	}
 
 	blob.write(map.size());
@@ -565,26 +784,437 @@ static void saveStrings(OutputMemoryStream& blob) {
 	}
 }
 
-void serialize(OutputMemoryStream& blob, ThreadContext& ctx) {
+// does not block the writer, events overwritten during the copy are cut off
+// `delta` serializes only events since the previous delta, as a linear buffer
+static Snapshot serialize(OutputMemoryStream& blob, ThreadContext& ctx, bool delta) {
 	MutexGuard lock(ctx.mutex);
 	blob.writeString(ctx.name);
 	blob.write(ctx.thread_id);
-	blob.write(ctx.begin);
-	blob.write(ctx.end);
+	const u64 range_offset = blob.size();
+	blob.write((u32)0);
+	blob.write((u32)0);
 	blob.write((u8)ctx.show_in_profiler);
+	const u64 size_offset = blob.size();
 	blob.write((u32)ctx.buffer.size());
-	blob.write(ctx.buffer.data(), ctx.buffer.size());
+
+	Snapshot snapshot;
+	snapshot.offset = blob.size();
+	if (delta) {
+		const u32 end = ctx.end;
+		u32 from = ctx.captured_end;
+		const u32 begin = ctx.begin;
+		if (end - from > end - begin) from = begin;
+		readBarrier();
+		const u32 len = end - from;
+		blob.resize(snapshot.offset + len);
+		const u8* buf = ctx.buffer.data();
+		const u32 l = from % ThreadContext::BUFFER_SIZE;
+		const u32 first = minimum(len, ThreadContext::BUFFER_SIZE - l);
+		memcpy(blob.getMutableData() + snapshot.offset, buf + l, first);
+		memcpy(blob.getMutableData() + snapshot.offset + first, buf, len - first);
+		readBarrier();
+		const u32 begin_after = ctx.begin;
+		const u32 lost = i32(begin_after - from) > 0 ? minimum(begin_after - from, len) : 0;
+		if (lost > 0) {
+			u8* data = blob.getMutableData() + snapshot.offset;
+			memmove(data, data + lost, len - lost);
+			blob.resize(snapshot.offset + len - lost);
+		}
+		ctx.captured_end = end;
+		snapshot.begin = 0;
+		snapshot.end = len - lost;
+		const u32 buffer_size = snapshot.end;
+		memcpy(blob.getMutableData() + size_offset, &buffer_size, sizeof(buffer_size));
+	}
+	else {
+		snapshot.end = ctx.end;
+		readBarrier();
+		blob.write(ctx.buffer.data(), ctx.buffer.size());
+		readBarrier();
+		// anything before `begin` might have been overwritten while we copied
+		snapshot.begin = ctx.begin;
+		if (snapshot.end - snapshot.begin > ThreadContext::BUFFER_SIZE) snapshot.begin = snapshot.end;
+	}
+	
+	memcpy(blob.getMutableData() + range_offset, &snapshot.begin, sizeof(snapshot.begin));
+	memcpy(blob.getMutableData() + range_offset + sizeof(u32), &snapshot.end, sizeof(snapshot.end));
+	return snapshot;
 }
 
-void serialize(OutputMemoryStream& blob) {
+static void serialize(OutputMemoryStream& blob, bool delta) {
 	MutexGuard lock(g_instance.mutex);
 	blob.write<u32>(0); // version
 	blob.write((u32)g_instance.contexts.size());
-	serialize(blob, g_instance.global_context);
+	Array<Snapshot> snapshots(g_instance.allocator);
+	snapshots.reserve(g_instance.contexts.size() + 1);
+	snapshots.push(serialize(blob, g_instance.global_context, delta));
 	for (ThreadContext* ctx : g_instance.contexts) {
-		serialize(blob, *ctx);
+		snapshots.push(serialize(blob, *ctx, delta));
 	}	
-	saveStrings(blob);
+	saveStrings(blob, snapshots);
+}
+
+void serialize(OutputMemoryStream& blob) {
+	serialize(blob, false);
+}
+
+static void writeCaptureChunk() {
+	PROFILE_FUNCTION();
+	OutputMemoryStream raw(g_instance.allocator);
+	serialize(raw, true);
+	OutputMemoryStream compressed(g_instance.allocator);
+	compressed.resize(LZ4_compressBound((int)raw.size()));
+	const int compressed_size = LZ4_compress_default((const char*)raw.data(), (char*)compressed.getMutableData(), (int)raw.size(), (int)compressed.size());
+	if (compressed_size <= 0) {
+		logError("Failed to compress profiler capture");
+		stopCapture();
+		return;
+	}
+	bool res = g_instance.capture_file.write((u32)raw.size());
+	res = g_instance.capture_file.write((u32)compressed_size) && res;
+	res = g_instance.capture_file.write(compressed.data(), compressed_size) && res;
+	if (!res) {
+		logError("Failed to write profiler capture");
+		stopCapture();
+	}
+}
+
+static void saveSpike() {
+	PROFILE_FUNCTION();
+	OutputMemoryStream blob(g_instance.allocator);
+	serialize(blob, false);
+	const StaticString<LUMIX_MAX_PATH> path(g_instance.spike_path, "_", g_instance.spike_count, ".lpd");
+	++g_instance.spike_count;
+	os::OutputFile file;
+	if (!file.open(path)) {
+		logError("Could not open ", path);
+		return;
+	}
+	if (!file.write(blob.data(), blob.size())) logError("Could not write ", path);
+	file.close();
+	logInfo("Frame took ", float(g_instance.last_frame_duration / double(frequency()) * 1000), " ms, profiler data saved to ", path);
+}
+
+bool startCapture(const char* path) {
+	stopCapture();
+	if (!g_instance.capture_file.open(path)) {
+		logError("Could not open ", path);
+		return false;
+	}
+	// only events from now on
+	{
+		MutexGuard lock(g_instance.mutex);
+		g_instance.global_context.captured_end = g_instance.global_context.end;
+		for (ThreadContext* ctx : g_instance.contexts) ctx->captured_end = ctx->end;
+	}
+	bool res = g_instance.capture_file.write(CAPTURE_MAGIC);
+	res = g_instance.capture_file.write(CAPTURE_VERSION) && res;
+	res = g_instance.capture_file.write(frequency()) && res;
+	if (!res) {
+		logError("Could not write ", path);
+		g_instance.capture_file.close();
+		return false;
+	}
+	g_instance.capturing = true;
+	return true;
+}
+
+void stopCapture() {
+	if (!g_instance.capturing) return;
+	g_instance.capturing = false;
+	g_instance.capture_file.close();
+}
+
+void setSpikeCapture(float threshold_seconds, const char* path_prefix) {
+	g_instance.spike_threshold = threshold_seconds;
+	g_instance.spike_path = path_prefix;
+}
+
+static void writeJSONString(OutputMemoryStream& json, const char* str) {
+	json << "\"";
+	for (const char* c = str; *c; ++c) {
+		if (*c == '"' || *c == '\\') json.write(u8('\\'));
+		if ((u8)*c < 0x20) continue;
+		json.write(*c);
+	}
+	json << "\"";
+}
+
+struct ChromeTraceWriter {
+	ChromeTraceWriter(OutputMemoryStream& json, u64 frequency)
+		: json(json)
+		, frequency(frequency)
+		, strings(g_instance.allocator)
+		, named_threads(g_instance.allocator)
+	{}
+
+	void event(const char* ph, const char* name, u64 time, u32 tid) {
+		json << (first ? "\n" : ",\n");
+		first = false;
+		json << "{\"ph\":\"" << ph << "\",\"name\":";
+		writeJSONString(json, name);
+		json << ",\"pid\":0,\"tid\":" << tid << ",\"ts\":" << toMicroseconds(time);
+	}
+
+	double toMicroseconds(u64 time) {
+		if (base_time == 0) base_time = time;
+		return (i64(time - base_time)) * 1e6 / frequency;
+	}
+
+	const char* getString(const void* ptr) {
+		auto iter = strings.find((u64)(uintptr)ptr);
+		return iter.isValid() ? iter.value() : "N/A";
+	}
+
+	// one serialize() blob
+	bool write(InputMemoryStream& blob) {
+		const u32 version = blob.read<u32>();
+		if (version != 0) return false;
+		const u32 count = blob.read<u32>();
+
+		struct Thread {
+			const char* name;
+			u32 thread_id;
+			u32 begin;
+			u32 end;
+			const u8* buffer;
+			u32 buffer_size;
+		};
+		Array<Thread> threads(g_instance.allocator);
+		for (u32 i = 0; i < count + 1; ++i) {
+			Thread& t = threads.emplace();
+			t.name = blob.readString();
+			blob.read(t.thread_id);
+			blob.read(t.begin);
+			blob.read(t.end);
+			blob.read<u8>();
+			blob.read(t.buffer_size);
+			if (blob.getPosition() + t.buffer_size > blob.size()) return false;
+			t.buffer = (const u8*)blob.skip(t.buffer_size);
+		}
+		
+		strings.clear();
+		const u32 strings_count = blob.read<u32>();
+		for (u32 i = 0; i < strings_count; ++i) {
+			const u64 ptr = blob.read<u64>();
+			strings.insert(ptr, blob.readString());
+		}
+		if (blob.getPosition() > blob.size()) return false;
+
+		for (const Thread& t : threads) {
+			// the first one is the global context
+			const bool is_global = &t == threads.begin();
+			if (!is_global && t.name[0] && !named_threads.find(t.thread_id).isValid()) {
+				named_threads.insert(t.thread_id, true);
+				json << (first ? "\n" : ",\n");
+				first = false;
+				json << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << t.thread_id << ",\"args\":{\"name\":";
+				writeJSONString(json, t.name);
+				json << "}}";
+			}
+			writeEvents(t.buffer, t.buffer_size, t.begin, t.end, is_global ? 0 : t.thread_id);
+		}
+		return true;
+	}
+
+	template <typename T>
+	static void read(const u8* buf, u32 buf_size, u32 p, T& value)
+	{
+		const u32 l = p % buf_size;
+		if (l + sizeof(value) <= buf_size) {
+			memcpy(&value, buf + l, sizeof(value));
+			return;
+		}
+		memcpy(&value, buf + l, buf_size - l);
+		memcpy((u8*)&value + (buf_size - l), buf, sizeof(value) - (buf_size - l));
+	}
+
+	void writeEvents(const u8* buf, u32 buf_size, u32 begin, u32 end, u32 tid) {
+		// gpu blocks are shown as a separate thread
+		const u32 gpu_tid = 0xffFFffFF;
+		for (u32 p = begin; p != end;) {
+			EventHeader header;
+			read(buf, buf_size, p, header);
+			const u32 data_p = p + sizeof(header);
+			switch (header.type) {
+				case EventType::BEGIN_BLOCK: {
+					const char* name;
+					read(buf, buf_size, data_p, name);
+					event("B", getString(name), header.time, tid);
+					json << "}";
+					break;
+				}
+				case EventType::END_BLOCK:
+					event("E", "", header.time, tid);
+					json << "}";
+					break;
+				case EventType::FRAME:
+					event("i", "frame", header.time, tid);
+					json << ",\"s\":\"g\"}";
+					break;
+				case EventType::INT: {
+					IntRecord r;
+					read(buf, buf_size, data_p, r);
+					event("C", getString(r.key), header.time, tid);
+					json << ",\"args\":{\"value\":" << r.value << "}}";
+					break;
+				}
+				case EventType::JOB_INFO: {
+					JobRecord r;
+					read(buf, buf_size, data_p, r);
+					event("i", "job", header.time, tid);
+					json << ",\"s\":\"t\",\"args\":{\"signal\":" << r.signal_on_finish << ",\"precondition\":" << r.precondition << "}}";
+					break;
+				}
+				case EventType::BEGIN_FIBER_WAIT:
+				case EventType::END_FIBER_WAIT: {
+					FiberWaitRecord r;
+					read(buf, buf_size, data_p, r);
+					const bool is_begin = header.type == EventType::BEGIN_FIBER_WAIT;
+					event(is_begin ? "b" : "e", "fiber wait", header.time, tid);
+					json << ",\"cat\":\"fiber\",\"id\":" << r.id << ",\"args\":{\"signal\":" << r.job_system_signal << "}}";
+					break;
+				}
+				case EventType::CONTEXT_SWITCH: {
+					ContextSwitchRecord r;
+					read(buf, buf_size, data_p, r);
+					event("i", "context switch", r.timestamp, r.new_thread_id);
+					json << ",\"s\":\"t\",\"args\":{\"old_thread\":" << r.old_thread_id << ",\"reason\":" << (i32)r.reason << "}}";
+					break;
+				}
+				case EventType::BEGIN_GPU_BLOCK: {
+					GPUBlock r;
+					read(buf, buf_size, data_p, r);
+					r.name[lengthOf(r.name) - 1] = '\0';
+					event("B", r.name, r.timestamp, gpu_tid);
+					json << "}";
+					break;
+				}
+				case EventType::END_GPU_BLOCK: {
+					u64 timestamp;
+					read(buf, buf_size, data_p, timestamp);
+					event("E", "", timestamp, gpu_tid);
+					json << "}";
+					break;
+				}
+				default: break;
+			}
+			p += header.size;
+		}
+	}
+
+	OutputMemoryStream& json;
+	u64 frequency;
+	u64 base_time = 0;
+	bool first = true;
+	HashMap<u64, const char*> strings;
+	HashMap<u32, bool> named_threads;
+};
+
+bool exportChromeTrace(Span<const u8> data, OutputMemoryStream& json) {
+	InputMemoryStream blob(data.begin(), data.length());
+	if (data.length() < sizeof(u32)) return false;
+
+	u32 magic;
+	memcpy(&magic, data.begin(), sizeof(magic));
+	const bool is_capture = magic == CAPTURE_MAGIC;
+	u64 freq = frequency();
+	if (is_capture) {
+		blob.read<u32>();
+		if (blob.read<u32>() != CAPTURE_VERSION) return false;
+		blob.read(freq);
+	}
+
+	json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	ChromeTraceWriter writer(json, freq);
+	bool res = true;
+	if (is_capture) {
+		OutputMemoryStream chunk(g_instance.allocator);
+		while (res && blob.getPosition() < blob.size()) {
+			const u32 raw_size = blob.read<u32>();
+			const u32 compressed_size = blob.read<u32>();
+			if (blob.getPosition() + compressed_size > blob.size()) return false;
+			const void* compressed = blob.skip(compressed_size);
+			chunk.resize(raw_size);
+			if (LZ4_decompress_safe((const char*)compressed, (char*)chunk.getMutableData(), compressed_size, raw_size) != (int)raw_size) return false;
+			InputMemoryStream chunk_blob(chunk);
+			res = writer.write(chunk_blob);
+		}
+	}
+	else {
+		res = writer.write(blob);
+	}
+	json << "\n]}\n";
+	return res;
+}
+
+int RemoteServer::task() {
+	setThreadName("profiler server");
+	OutputMemoryStream blob(g_instance.allocator);
+	while (!finished) {
+		os::Socket* socket = os::acceptTCP(listener);
+		if (!socket) break;
+		client = socket;
+		for (;;) {
+			u32 command;
+			if (!os::receive(socket, &command, sizeof(command))) break;
+			if (command != REMOTE_SNAPSHOT_COMMAND) break;
+
+			blob.clear();
+			serialize(blob, false);
+			const u64 freq = frequency();
+			const u64 size = blob.size();
+			if (!os::send(socket, &REMOTE_MAGIC, sizeof(REMOTE_MAGIC))) break;
+			if (!os::send(socket, &freq, sizeof(freq))) break;
+			if (!os::send(socket, &size, sizeof(size))) break;
+			if (!os::send(socket, blob.data(), size)) break;
+		}
+		client = nullptr;
+		if (!finished) os::close(socket);
+	}
+	return 0;
+}
+
+bool startServer(u16 port) {
+	stopServer();
+	os::Socket* listener = os::listenTCP(port);
+	if (!listener) {
+		logError("Profiler server failed to listen on port ", port);
+		return false;
+	}
+	g_instance.remote_server = LUMIX_NEW(g_instance.allocator, RemoteServer)(listener, g_instance.allocator);
+	if (!g_instance.remote_server->create("profiler server", true)) {
+		os::close(listener);
+		LUMIX_DELETE(g_instance.allocator, g_instance.remote_server);
+		g_instance.remote_server = nullptr;
+		return false;
+	}
+	logInfo("Profiler server listening on port ", port);
+	return true;
+}
+
+void stopServer() {
+	RemoteServer* server = g_instance.remote_server;
+	if (!server) return;
+	server->finished = true;
+	// unblocks accept and receive
+	os::close(server->listener);
+	os::Socket* client = server->client;
+	if (client) os::close(client);
+	server->destroy();
+	LUMIX_DELETE(g_instance.allocator, server);
+	g_instance.remote_server = nullptr;
+}
+
+bool fetchRemote(os::Socket* socket, OutputMemoryStream& blob, u64& remote_frequency) {
+	if (!os::send(socket, &REMOTE_SNAPSHOT_COMMAND, sizeof(REMOTE_SNAPSHOT_COMMAND))) return false;
+	u32 magic;
+	u64 size;
+	if (!os::receive(socket, &magic, sizeof(magic)) || magic != REMOTE_MAGIC) return false;
+	if (!os::receive(socket, &remote_frequency, sizeof(remote_frequency))) return false;
+	if (!os::receive(socket, &size, sizeof(size))) return false;
+	blob.resize(size);
+	return os::receive(socket, blob.getMutableData(), size);
 }
 
 void pause(bool paused)
@@ -5,6 +5,7 @@
 namespace Lumix {
 
 struct OutputMemoryStream;
+namespace os { struct Socket; }
 
 namespace profiler {
 // writing API
@@ -26,9 +27,77 @@ LUMIX_ENGINE_API void beginGPUBlock(const char* name, u64 timestamp, i64 profile
 LUMIX_ENGINE_API void endGPUBlock(u64 timestamp);
 LUMIX_ENGINE_API void gpuMemStats(u64 total, u64 current, u64 dedicated);
 LUMIX_ENGINE_API void gpuFrame();
+// cost of a gpu block (render pass) in the last resolved gpu frame, blocks with the same name are summed
+LUMIX_ENGINE_API void gpuPassStats(const char* name, u32 depth, float gpu_ms, float cpu_ms, u32 draw_calls, u32 triangles, u32 state_changes);
 LUMIX_ENGINE_API void link(i64 link);
 LUMIX_ENGINE_API i64 createNewLinkID();
 LUMIX_ENGINE_API void serialize(OutputMemoryStream& blob);
+// continuously writes all events to a file, lz4 compressed, one chunk per frame()
+LUMIX_ENGINE_API bool startCapture(const char* path);
+LUMIX_ENGINE_API void stopCapture();
+// when a frame takes longer than `threshold_seconds`, what's left in the rings is saved to <path_prefix>_<n>.lpd, 0 disables
+LUMIX_ENGINE_API void setSpikeCapture(float threshold_seconds, const char* path_prefix);
+// converts serialize() output or a capture file to chrome trace event json, works with chrome://tracing and ui.perfetto.dev
+LUMIX_ENGINE_API bool exportChromeTrace(Span<const u8> data, OutputMemoryStream& json);
+// lets a remote profiler ui read this process' events
+constexpr u16 DEFAULT_SERVER_PORT = 10001;
+LUMIX_ENGINE_API bool startServer(u16 port);
+LUMIX_ENGINE_API void stopServer();
+// requests serialize() output from a process which called startServer
+LUMIX_ENGINE_API bool fetchRemote(os::Socket* socket, OutputMemoryStream& blob, u64& remote_frequency);
+
+// named metrics sampled once per frame(), last COUNTER_HISTORY frames are kept
+constexpr u32 MAX_COUNTERS = 64;
+constexpr u32 COUNTER_HISTORY = 1024;
+constexpr u32 INVALID_COUNTER = 0xffFFffFF;
+enum class CounterType : u8 {
+	SUM,	// accumulated during frame, reset in frame()
+	GAUGE	// keeps the last value
+};
+// returns existing counter if `name` is already used, INVALID_COUNTER if there are too many counters
+LUMIX_ENGINE_API u32 createCounter(const char* name, CounterType type);
+// thread safe
+LUMIX_ENGINE_API void addCounter(u32 counter, i64 value);
+LUMIX_ENGINE_API void setCounter(u32 counter, i64 value);
+// adds time since start_timestamp in microseconds
+LUMIX_ENGINE_API u64 getCounterTimestamp();
+LUMIX_ENGINE_API void addCounterTime(u32 counter, u64 start_timestamp);
+
+struct CounterStats {
+	const char* name;
+	u32 frames;
+	i64 last;
+	i64 min;
+	i64 max;
+	double avg;
+	i64 p50;
+	i64 p95;
+	i64 p99;
+};
+
+LUMIX_ENGINE_API u32 getCountersCount();
+LUMIX_ENGINE_API bool getCounterStats(u32 counter, CounterStats& stats);
+// value sampled in the last frame()
+LUMIX_ENGINE_API i64 getCounterValue(u32 counter);
+
+constexpr u32 MAX_GPU_PASSES = 64;
+struct GPUPassStats {
+	char name[32];
+	u32 depth;
+	// gpu frames since the pass was last reported
+	u32 age;
+	float gpu_ms;
+	float cpu_ms; // render thread
+	float avg_gpu_ms;
+	float avg_cpu_ms;
+	u32 draw_calls;
+	u32 triangles;
+	u32 state_changes;
+};
+// in order of first appearance, returns number of passes
+LUMIX_ENGINE_API u32 getGPUPassStats(Span<GPUPassStats> stats);
+// one row per counter with stats, or one row per frame if `per_frame`
+LUMIX_ENGINE_API void countersToCSV(OutputMemoryStream& csv, bool per_frame);
 
 struct FiberSwitchData {
 	i32 id;
@@ -47,6 +116,14 @@ struct Scope
 	~Scope() { endBlock(); }
 };
 
+struct CounterScope
+{
+	explicit CounterScope(u32 counter) : counter(counter), start(getCounterTimestamp()) {}
+	~CounterScope() { addCounterTime(counter, start); }
+	u32 counter;
+	u64 start;
+};
+
 
 // reading API
 
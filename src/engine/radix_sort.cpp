@@ -0,0 +1,139 @@
+#include "engine/radix_sort.h"
+#include "engine/array.h"
+#include "engine/crt.h"
+#include "engine/job_system.h"
+#include "engine/math.h"
+#include "engine/profiler.h"
+
+
+namespace Lumix
+{
+
+
+// keys are split into blocks, each block has its own histogram, so scatter is parallel and stable
+// digits which are the same in all keys (e.g. bucket in a single bucket view) are skipped
+struct RadixSort {
+	static constexpr u32 BITS = 11;
+	static constexpr u32 SIZE = 1 << BITS;
+	static constexpr u32 BIT_MASK = SIZE - 1;
+	static constexpr u32 PASSES = (64 + BITS - 1) / BITS;
+	static constexpr i32 MIN_BLOCK_SIZE = 4096;
+	static constexpr i32 MAX_BLOCKS = 64;
+
+	struct BlockInfo {
+		u64 and_mask;
+		u64 or_mask;
+		bool sorted;
+	};
+};
+
+void radixSort(u64* _keys, u64* _values, i32 size, IAllocator& allocator) {
+	PROFILE_FUNCTION();
+	profiler::pushInt("count", size);
+	if (size == 0) return;
+
+	const i32 block_size = maximum(RadixSort::MIN_BLOCK_SIZE, (size + RadixSort::MAX_BLOCKS - 1) / RadixSort::MAX_BLOCKS);
+	const i32 blocks_count = (size + block_size - 1) / block_size;
+
+	RadixSort::BlockInfo infos[RadixSort::MAX_BLOCKS];
+	jobs::forEach(blocks_count, 1, [&](i32 block, i32){
+		PROFILE_BLOCK("analyze");
+		const i32 begin = block * block_size;
+		const i32 end = minimum(size, begin + block_size);
+		u64 and_mask = ~(u64)0;
+		u64 or_mask = 0;
+		bool sorted = true;
+		u64 prev_key = begin > 0 ? _keys[begin - 1] : _keys[0];
+		for (i32 i = begin; i < end; ++i) {
+			const u64 key = _keys[i];
+			and_mask &= key;
+			or_mask |= key;
+			sorted &= prev_key <= key;
+			prev_key = key;
+		}
+		infos[block] = { and_mask, or_mask, sorted };
+	});
+
+	u64 and_mask = ~(u64)0;
+	u64 or_mask = 0;
+	bool sorted = true;
+	for (i32 i = 0; i < blocks_count; ++i) {
+		and_mask &= infos[i].and_mask;
+		or_mask |= infos[i].or_mask;
+		sorted &= infos[i].sorted;
+	}
+	if (sorted) return;
+	const u64 varying_bits = and_mask ^ or_mask;
+
+	Array<u64> tmp_mem(allocator);
+	tmp_mem.resize(size * 2);
+	Array<u32> histograms(allocator);
+	histograms.resize(blocks_count * RadixSort::SIZE);
+
+	u64* keys = _keys;
+	u64* values = _values;
+	u64* tmp_keys = tmp_mem.begin();
+	u64* tmp_values = &tmp_mem[size];
+
+	for (u32 pass = 0; pass < RadixSort::PASSES; ++pass) {
+		const u32 shift = pass * RadixSort::BITS;
+		if (((varying_bits >> shift) & RadixSort::BIT_MASK) == 0) continue;
+
+		jobs::forEach(blocks_count, 1, [&](i32 block, i32){
+			PROFILE_BLOCK("histogram");
+			u32* LUMIX_RESTRICT histogram = &histograms[block * RadixSort::SIZE];
+			memset(histogram, 0, sizeof(u32) * RadixSort::SIZE);
+			const i32 begin = block * block_size;
+			const i32 end = minimum(size, begin + block_size);
+			for (i32 i = begin; i < end; ++i) {
+				++histogram[(keys[i] >> shift) & RadixSort::BIT_MASK];
+			}
+		});
+
+		// histograms -> destination offsets, ordered by digit and then by block
+		u32 digit_offsets[RadixSort::SIZE];
+		memset(digit_offsets, 0, sizeof(digit_offsets));
+		for (i32 block = 0; block < blocks_count; ++block) {
+			const u32* histogram = &histograms[block * RadixSort::SIZE];
+			for (u32 i = 0; i < RadixSort::SIZE; ++i) digit_offsets[i] += histogram[i];
+		}
+		u32 offset = 0;
+		for (u32 i = 0; i < RadixSort::SIZE; ++i) {
+			const u32 count = digit_offsets[i];
+			digit_offsets[i] = offset;
+			offset += count;
+		}
+		for (i32 block = 0; block < blocks_count; ++block) {
+			u32* histogram = &histograms[block * RadixSort::SIZE];
+			for (u32 i = 0; i < RadixSort::SIZE; ++i) {
+				const u32 count = histogram[i];
+				histogram[i] = digit_offsets[i];
+				digit_offsets[i] += count;
+			}
+		}
+
+		jobs::forEach(blocks_count, 1, [&](i32 block, i32){
+			PROFILE_BLOCK("scatter");
+			u32* LUMIX_RESTRICT offsets = &histograms[block * RadixSort::SIZE];
+			const i32 begin = block * block_size;
+			const i32 end = minimum(size, begin + block_size);
+			for (i32 i = begin; i < end; ++i) {
+				const u64 key = keys[i];
+				const u32 dest = offsets[(key >> shift) & RadixSort::BIT_MASK]++;
+				tmp_keys[dest] = key;
+				tmp_values[dest] = values[i];
+			}
+		});
+
+		swap(tmp_keys, keys);
+		swap(tmp_values, values);
+	}
+
+	if (keys != _keys) {
+		memcpy(_keys, keys, sizeof(keys[0]) * size);
+		memcpy(_values, values, sizeof(values[0]) * size);
+	}
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,15 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// parallel stable LSD radix sort of key-value pairs, uses jobs::forEach
+LUMIX_ENGINE_API void radixSort(u64* keys, u64* values, i32 size, struct IAllocator& allocator);
+
+
+} // namespace Lumix
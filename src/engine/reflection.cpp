@@ -3,6 +3,7 @@
 #include "engine/allocators.h"
 #include "engine/crc32.h"
 #include "engine/log.h"
+#include "engine/plugin.h"
 #include "engine/stream.h"
 #include "engine/string.h"
 #include "engine/universe.h"
@@ -224,8 +225,18 @@ void BlobProperty::getValue(ComponentUID cmp, u32 idx, OutputMemoryStream& strea
 	getter(cmp.scene, (EntityRef)cmp.entity, idx, stream);
 }
 
+void journalPropertyChanged(ComponentUID cmp, const char* prop_name) {
+	cmp.scene->getUniverse().journalPropertyChanged((EntityRef)cmp.entity, cmp.type, prop_name);
+}
+
+void journalPropertyChanged(IScene* scene, ComponentType cmp_type, Span<const EntityRef> entities, const char* prop_name) {
+	Universe& universe = scene->getUniverse();
+	for (EntityRef e : entities) universe.journalPropertyChanged(e, cmp_type, prop_name);
+}
+
 void BlobProperty::setValue(ComponentUID cmp, u32 idx, InputMemoryStream& stream) const {
 	setter(cmp.scene, (EntityRef)cmp.entity, idx, stream);
+	journalPropertyChanged(cmp, name);
 }
 
 ArrayProperty::ArrayProperty(IAllocator& allocator)
@@ -239,10 +250,12 @@ u32 ArrayProperty::getCount(ComponentUID cmp) const {
 
 void ArrayProperty::addItem(ComponentUID cmp, u32 idx) const {
 	adder(cmp.scene, (EntityRef)cmp.entity, idx);
+	journalPropertyChanged(cmp, name);
 }
 
 void ArrayProperty::removeItem(ComponentUID cmp, u32 idx) const {
 	remover(cmp.scene, (EntityRef)cmp.entity, idx);
+	journalPropertyChanged(cmp, name);
 }
 
 
@@ -51,6 +51,7 @@ struct IAttribute {
 // we don't use method pointers here because VS has sizeof issues if IScene is forward declared
 using CreateComponent = void (*)(IScene*, EntityRef);
 using DestroyComponent = void (*)(IScene*, EntityRef);
+using CreateComponents = void (*)(IScene*, Span<const EntityRef>);
 
 struct RegisteredComponent {
 	u32 name_hash = 0;
@@ -175,12 +176,19 @@ template <> inline void set(DynamicProperties::Value& v, bool val) { v.b = val;
 template <> inline void set(DynamicProperties::Value& v, Vec3 val) { v.v3 = val; }
 
 
+// records the change in universe's journal, see Universe::enableJournal
+LUMIX_ENGINE_API void journalPropertyChanged(ComponentUID cmp, const char* prop_name);
+LUMIX_ENGINE_API void journalPropertyChanged(IScene* scene, ComponentType cmp_type, Span<const EntityRef> entities, const char* prop_name);
+
 template <typename T>
 struct Property : PropertyBase {
 	Property(IAllocator& allocator) : PropertyBase(allocator) {}
 
 	typedef void (*Setter)(IScene*, EntityRef, u32, const T&);
 	typedef T (*Getter)(IScene*, EntityRef, u32);
+	typedef void (*BulkGetter)(IScene*, Span<const EntityRef>, u32, Span<T>);
+	// `values` has either one value per entity or a single value, which is set to all entities
+	typedef void (*BulkSetter)(IScene*, Span<const EntityRef>, u32, Span<const T>);
 
 	void visit(IPropertyVisitor& visitor) const override;
 
@@ -190,12 +198,45 @@ struct Property : PropertyBase {
 
 	virtual void set(ComponentUID cmp, u32 idx, T val) const {
 		setter(cmp.scene, (EntityRef)cmp.entity, idx, val);
+		journalPropertyChanged(cmp, name);
+	}
+
+	// bulk access, all `entities` must have the component in `scene`
+	// there's one call instead of one per entity, so use these for many entities at once
+	virtual void get(IScene* scene, ComponentType cmp_type, Span<const EntityRef> entities, u32 idx, Span<T> out) const {
+		ASSERT(out.length() == entities.length());
+		if (bulk_getter) {
+			bulk_getter(scene, entities, idx, out);
+			return;
+		}
+		ComponentUID cmp(INVALID_ENTITY, cmp_type, scene);
+		for (u32 i = 0; i < entities.length(); ++i) {
+			cmp.entity = entities[i];
+			out[i] = get(cmp, idx);
+		}
+	}
+
+	virtual void set(IScene* scene, ComponentType cmp_type, Span<const EntityRef> entities, u32 idx, Span<const T> values) const {
+		ASSERT(values.length() == entities.length() || values.length() == 1);
+		if (!bulk_setter) {
+			ComponentUID cmp(INVALID_ENTITY, cmp_type, scene);
+			for (u32 i = 0; i < entities.length(); ++i) {
+				cmp.entity = entities[i];
+				set(cmp, idx, values[values.length() == 1 ? 0 : i]);
+			}
+			return;
+		}
+		bulk_setter(scene, entities, idx, values);
+		journalPropertyChanged(scene, cmp_type, entities, name);
 	}
 
 	virtual bool isReadonly() const { return setter == nullptr; }
 
 	Setter setter = nullptr;
 	Getter getter = nullptr;
+	// optional, generated by builder from the scene's accessors, so there's no indirect call per entity
+	BulkSetter bulk_setter = nullptr;
+	BulkGetter bulk_getter = nullptr;
 };
 
 struct IPropertyVisitor {
@@ -500,6 +541,8 @@ struct LUMIX_ENGINE_API ComponentBase {
 
 	u32 scene;
 	CreateComponent creator;
+	// optional, must call Universe::onComponentsCreated
+	CreateComponents bulk_creator = nullptr;
 	DestroyComponent destroyer;
 	ComponentType component_type;
 	Array<PropertyBase*> props;
@@ -560,6 +603,15 @@ struct LUMIX_ENGINE_API builder {
 		return *this;
 	}
 
+	// used by Universe::createComponents for the last registered component
+	template <auto Creator>
+	builder& bulk_create() {
+		scene->cmps.back()->bulk_creator = [](IScene* scene, Span<const EntityRef> entities){
+			(scene->*static_cast<void (IScene::*)(Span<const EntityRef>)>(Creator))(entities);
+		};
+		return *this;
+	}
+
 	template <auto Getter, auto PropGetter>
 	builder& var_enum_prop(const char* name) {
 		using T = typename ResultOf<decltype(PropGetter)>::Type;
@@ -640,6 +692,19 @@ struct LUMIX_ENGINE_API builder {
 					(static_cast<C*>(scene)->*Setter)(e, idx, value);
 				}
 			};
+			p->bulk_setter = [](IScene* scene, Span<const EntityRef> entities, u32 idx, Span<const T> values) {
+				using C = typename ClassOf<decltype(Setter)>::Type;
+				C* s = static_cast<C*>(scene);
+				const u32 step = values.length() == 1 ? 0 : 1;
+				for (u32 i = 0; i < entities.length(); ++i) {
+					if constexpr (ArgsCount<decltype(Setter)>::value == 2) {
+						(s->*Setter)(entities[i], values[i * step]);
+					}
+					else {
+						(s->*Setter)(entities[i], idx, values[i * step]);
+					}
+				}
+			};
 		}
 
 		p->getter = [](IScene* scene, EntityRef e, u32 idx) -> T {
@@ -651,6 +716,18 @@ struct LUMIX_ENGINE_API builder {
 				return (static_cast<C*>(scene)->*Getter)(e, idx);
 			}
 		};
+		p->bulk_getter = [](IScene* scene, Span<const EntityRef> entities, u32 idx, Span<T> out) {
+			using C = typename ClassOf<decltype(Getter)>::Type;
+			C* s = static_cast<C*>(scene);
+			for (u32 i = 0; i < entities.length(); ++i) {
+				if constexpr (ArgsCount<decltype(Getter)>::value == 1) {
+					out[i] = (s->*Getter)(entities[i]);
+				}
+				else {
+					out[i] = (s->*Getter)(entities[i], idx);
+				}
+			}
+		};
 
 		p->name = name;
 		addProp(p);
@@ -681,6 +758,23 @@ struct LUMIX_ENGINE_API builder {
 			auto& v = c.*PropGetter;
 			return static_cast<T>(v);
 		};
+		p->bulk_setter = [](IScene* scene, Span<const EntityRef> entities, u32, Span<const T> values) {
+			using C = typename ClassOf<decltype(Getter)>::Type;
+			C* s = static_cast<C*>(scene);
+			const u32 step = values.length() == 1 ? 0 : 1;
+			for (u32 i = 0; i < entities.length(); ++i) {
+				auto& c = (s->*Getter)(entities[i]);
+				c.*PropGetter = values[i * step];
+			}
+		};
+		p->bulk_getter = [](IScene* scene, Span<const EntityRef> entities, u32, Span<T> out) {
+			using C = typename ClassOf<decltype(Getter)>::Type;
+			C* s = static_cast<C*>(scene);
+			for (u32 i = 0; i < entities.length(); ++i) {
+				auto& c = (s->*Getter)(entities[i]);
+				out[i] = static_cast<T>(c.*PropGetter);
+			}
+		};
 		p->name = name;
 		addProp(p);
 		return *this;
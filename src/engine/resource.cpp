@@ -2,7 +2,6 @@
 #include "engine/crc32.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
-#include "engine/lz4.h"
 #include "engine/path.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
@@ -35,7 +34,9 @@ Resource::Resource(const Path& path, ResourceManager& resource_manager, IAllocat
 }
 
 
-Resource::~Resource() = default;
+Resource::~Resource() {
+	if (m_is_unused) m_resource_manager.removeUnused(*this);
+}
 
 
 void Resource::refresh() {
@@ -110,6 +111,7 @@ void Resource::checkState()
 void Resource::fileLoaded(u64 size, const u8* mem, bool success) {
 	ASSERT(m_async_op.isValid());
 	m_async_op = FileSystem::AsyncHandle::invalid();
+	m_resource_manager.getOwner().onLoadFinished(success ? size : 0);
 	if (m_desired_state != State::READY) return;
 	
 	ASSERT(m_current_state != State::READY);
@@ -146,9 +148,8 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success) {
 	}
 	else if (header->flags & CompiledResourceHeader::COMPRESSED) {
 		OutputMemoryStream tmp(m_resource_manager.m_allocator);
-		tmp.resize(header->decompressed_size);
-		const i32 res = LZ4_decompress_safe((const char*)mem + sizeof(*header), (char*)tmp.getMutableData(), i32(size - sizeof(*header)), (i32)tmp.size());
-		if (res != header->decompressed_size || !load(header->decompressed_size, tmp.data())) {
+		const Span<const u8> payload(mem + sizeof(*header), u32(size - sizeof(*header)));
+		if (!m_resource_manager.getOwner().decompress(*header, payload, tmp) || !load(header->decompressed_size, tmp.data())) {
 			++m_failed_dep_count;
 		}
 		m_size = header->decompressed_size;
@@ -174,8 +175,10 @@ void Resource::doUnload()
 		FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
 		fs.cancel(m_async_op);
 		m_async_op = FileSystem::AsyncHandle::invalid();
+		m_resource_manager.getOwner().onLoadFinished(0);
 	}
 
+	if (m_is_unused) m_resource_manager.removeUnused(*this);
 	m_hooked = false;
 	m_desired_state = State::EMPTY;
 	unload();
@@ -213,12 +216,13 @@ void Resource::doLoad()
 	FileSystem::ContentCallback cb = makeDelegate<&Resource::fileLoaded>(this);
 
 	const u32 hash = m_path.getHash();
+	m_resource_manager.getOwner().onLoadStarted();
 	if (startsWith(m_path.c_str(), ".lumix/asset_tiles/")) {
-		m_async_op = fs.getContent(m_path, cb);
+		m_async_op = fs.getContent(m_path, cb, getLoadPriority());
 	}
 	else {	
 		const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", hash, ".res");
-		m_async_op = fs.getContent(Path(res_path), cb);
+		m_async_op = fs.getContent(Path(res_path), cb, getLoadPriority());
 	}
 }
 
@@ -227,6 +231,7 @@ void Resource::addDependency(Resource& dependent_resource)
 {
 	ASSERT(m_desired_state != State::EMPTY);
 
+	m_resource_manager.getOwner().onDependencyAdded(*this, dependent_resource);
 	dependent_resource.m_cb.bind<&Resource::onStateChanged>(this);
 	if (dependent_resource.isEmpty()) ++m_empty_dep_count;
 	if (dependent_resource.isFailure()) {
@@ -257,11 +262,17 @@ void Resource::removeDependency(Resource& dependent_resource)
 	checkState();
 }
 
+u32 Resource::incRefCount() {
+	if (m_is_unused) m_resource_manager.removeUnused(*this);
+	return ++m_ref_count;
+}
+
+
 u32 Resource::decRefCount() {
 	ASSERT(m_ref_count > 0);
 	--m_ref_count;
 	if (m_ref_count == 0 && m_resource_manager.m_is_unload_enabled) {
-		doUnload();
+		m_resource_manager.onUnreferenced(*this);
 	}
 	return m_ref_count;
 }
@@ -24,12 +24,14 @@ const ResourceType INVALID_RESOURCE_TYPE("");
 struct CompiledResourceHeader {
 	static constexpr u32 MAGIC = 'LRES';
 	enum Flags {
-		COMPRESSED = 1 << 0
+		COMPRESSED = 1 << 0,
+		// compressed using `dictionary`, see ResourceManagerHub::getDictionary
+		DICTIONARY = 1 << 1
 	};
 	u32 magic = MAGIC;
 	u32 version = 0;
 	u32 flags = 0;
-	u32 padding = 0;
+	u32 dictionary = 0; // crc32 of the dictionary
 	u64 decompressed_size = 0;
 };
 #pragma pack()
@@ -59,7 +61,8 @@ struct LUMIX_ENGINE_API Resource {
 	const Path& getPath() const { return m_path; }
 	struct ResourceManager& getResourceManager() { return m_resource_manager; }
 	u32 decRefCount();
-	u32 incRefCount() { return ++m_ref_count; }
+	// revives the resource if it's in the unused cache
+	u32 incRefCount();
 	bool wantReady() const { return m_desired_state == State::READY; }
 	bool isHooked() const { return m_hooked; }
 
@@ -76,6 +79,8 @@ protected:
 	Resource(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
 
 	virtual void onBeforeReady() {}
+	// resources with lower priority are loaded after those with higher
+	virtual FileSystem::Priority getLoadPriority() const { return FileSystem::Priority::NORMAL; }
 	virtual void unload() = 0;
 	virtual bool load(u64 size, const u8* mem) = 0;
 
@@ -106,6 +111,10 @@ private:
 	State m_current_state;
 	FileSystem::AsyncHandle m_async_op;
 	bool m_hooked = false;
+	// unreferenced but still loaded, see ResourceManager::setUnusedBudget
+	bool m_is_unused = false;
+	Resource* m_unused_prev = nullptr;
+	Resource* m_unused_next = nullptr;
 	#ifdef LUMIX_DEBUG
 		bool m_invoking = false;
 	#endif
@@ -1,7 +1,12 @@
+#include "engine/crc32.h"
+#include "engine/file_system.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/lz4.h"
+#include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
@@ -16,6 +21,7 @@ void ResourceManager::create(ResourceType type, ResourceManagerHub& owner)
 
 void ResourceManager::destroy()
 {
+	while (m_unused_first) m_unused_first->doUnload();
 	for (auto iter = m_resources.begin(), end = m_resources.end(); iter != end; ++iter)
 	{
 		Resource* resource = iter.value();
@@ -30,7 +36,7 @@ void ResourceManager::destroy()
 
 Resource* ResourceManager::get(const Path& path)
 {
-	ResourceTable::iterator it = m_resources.find(path.getHash());
+	ResourceTable::iterator it = m_resources.find(path.getStableHash());
 
 	if(m_resources.end() != it)
 	{
@@ -48,7 +54,7 @@ Resource* ResourceManager::load(const Path& path)
 	if(nullptr == resource)
 	{
 		resource = createResource(path);
-		m_resources.insert(path.getHash(), resource);
+		m_resources.insert(path.getStableHash(), resource);
 	}
 
 	if(resource->isEmpty() && resource->m_desired_state == Resource::State::EMPTY)
@@ -60,15 +66,62 @@ Resource* ResourceManager::load(const Path& path)
 			resource->m_desired_state = Resource::State::READY;
 			resource->incRefCount(); // for hook
 			resource->incRefCount(); // for return value
+			m_owner->prefetchDependencies(path);
 			return resource;
 		}
 		resource->doLoad();
+		// dependencies' loads are recursive, so the whole closure is requested now
+		m_owner->prefetchDependencies(path);
 	}
 
 	resource->incRefCount();
 	return resource;
 }
 
+void ResourceManager::setUnusedBudget(u64 bytes)
+{
+	m_unused_budget = bytes;
+	evictUnused();
+}
+
+void ResourceManager::onUnreferenced(Resource& resource)
+{
+	ASSERT(!resource.m_is_unused);
+	// only resources loaded from files are cached, size of the others is unknown and their owners may destroy them
+	if (m_unused_budget == 0 || !resource.isReady() || resource.m_size == 0 || resource.m_size > m_unused_budget) {
+		resource.doUnload();
+		return;
+	}
+
+	resource.m_is_unused = true;
+	resource.m_unused_prev = nullptr;
+	resource.m_unused_next = m_unused_first;
+	if (m_unused_first) m_unused_first->m_unused_prev = &resource;
+	else m_unused_last = &resource;
+	m_unused_first = &resource;
+	m_unused_size += resource.m_size;
+	evictUnused();
+}
+
+void ResourceManager::removeUnused(Resource& resource)
+{
+	ASSERT(resource.m_is_unused);
+	if (resource.m_unused_prev) resource.m_unused_prev->m_unused_next = resource.m_unused_next;
+	else m_unused_first = resource.m_unused_next;
+	if (resource.m_unused_next) resource.m_unused_next->m_unused_prev = resource.m_unused_prev;
+	else m_unused_last = resource.m_unused_prev;
+	resource.m_unused_prev = resource.m_unused_next = nullptr;
+	resource.m_is_unused = false;
+	ASSERT(m_unused_size >= resource.m_size);
+	m_unused_size -= resource.m_size;
+}
+
+void ResourceManager::evictUnused()
+{
+	// doUnload removes the resource from the list
+	while (m_unused_last && m_unused_size > m_unused_budget) m_unused_last->doUnload();
+}
+
 void ResourceManager::removeUnreferenced()
 {
 	if (!m_is_unload_enabled) return;
@@ -81,7 +134,7 @@ void ResourceManager::removeUnreferenced()
 
 	for (auto* i : to_remove)
 	{
-		auto iter = m_resources.find(i->getPath().getHash());
+		auto iter = m_resources.find(i->getPath().getStableHash());
 		if (iter.value()->isReady()) iter.value()->doUnload();
 	}
 }
@@ -119,9 +172,9 @@ void ResourceManager::enableUnload(bool enable)
 
 	for (auto* resource : m_resources)
 	{
-		if (resource->getRefCount() == 0)
+		if (resource->getRefCount() == 0 && !resource->m_is_unused)
 		{
-			resource->doUnload();
+			onUnreferenced(*resource);
 		}
 	}
 }
@@ -143,15 +196,220 @@ ResourceManagerHub::ResourceManagerHub(IAllocator& allocator)
 	, m_allocator(allocator)
 	, m_load_hook(nullptr)
 	, m_file_system(nullptr)
+	, m_manifest(allocator)
+	, m_prefetched(allocator)
+	, m_dictionaries_blob(allocator)
+	, m_dictionaries(allocator)
+	, m_type_dictionaries(allocator)
 {
+	m_loading_counter = profiler::createCounter("resources loading", profiler::CounterType::GAUGE);
+	m_loaded_bytes_counter = profiler::createCounter("resource bytes loaded", profiler::CounterType::SUM);
 }
 
-ResourceManagerHub::~ResourceManagerHub() = default;
+ResourceManagerHub::~ResourceManagerHub()
+{
+	ASSERT(m_prefetched.empty());
+}
 
 
 void ResourceManagerHub::init(FileSystem& fs)
 {
 	m_file_system = &fs;
+	loadDependencyManifest();
+	loadDictionaries();
+}
+
+
+void ResourceManagerHub::onLoadStarted()
+{
+	++m_loading_count;
+	profiler::setCounter(m_loading_counter, m_loading_count);
+}
+
+
+void ResourceManagerHub::onLoadFinished(u64 size)
+{
+	ASSERT(m_loading_count > 0);
+	--m_loading_count;
+	profiler::setCounter(m_loading_counter, m_loading_count);
+	profiler::addCounter(m_loaded_bytes_counter, size);
+}
+
+
+void ResourceManagerHub::loadDependencyManifest()
+{
+	m_manifest.clear();
+	OutputMemoryStream content(m_allocator);
+	if (!m_file_system->getContentSync(Path(DEPENDENCY_MANIFEST_PATH), content)) return;
+
+	InputMemoryStream blob(content);
+	// manifests without header have 32bit hashes, they are ignored and recorded again
+	const u32 magic = blob.read<u32>();
+	if (magic != DEPENDENCY_MANIFEST_MAGIC) return;
+	const u32 version = blob.read<u32>();
+	if (version != DEPENDENCY_MANIFEST_VERSION) return;
+	u32 count;
+	blob.read(count);
+	for (u32 i = 0; i < count && blob.getPosition() < blob.size(); ++i) {
+		ManifestEntry entry(m_allocator);
+		blob.read(entry.type);
+		entry.path = blob.readString();
+		u32 deps_count;
+		blob.read(deps_count);
+		if (blob.getPosition() + deps_count * sizeof(StableHash) > blob.size()) break;
+		entry.dependencies.resize(deps_count);
+		if (deps_count > 0) blob.read(entry.dependencies.begin(), entry.dependencies.byte_size());
+		m_manifest.insert(entry.path.getStableHash(), static_cast<ManifestEntry&&>(entry));
+	}
+}
+
+
+void ResourceManagerHub::loadDictionaries()
+{
+	m_dictionaries.clear();
+	m_type_dictionaries.clear();
+	m_dictionaries_blob.clear();
+	if (!m_file_system->getContentSync(Path(DICTIONARIES_PATH), m_dictionaries_blob)) return;
+
+	InputMemoryStream blob(m_dictionaries_blob);
+	if (blob.read<u32>() != DICTIONARIES_MAGIC) return;
+	if (blob.read<u32>() != DICTIONARIES_VERSION) return;
+	const u32 count = blob.read<u32>();
+	for (u32 i = 0; i < count && blob.getPosition() < blob.size(); ++i) {
+		const u32 type = blob.read<u32>();
+		const u32 size = blob.read<u32>();
+		if (size > MAX_DICTIONARY_SIZE || blob.getPosition() + size > blob.size()) break;
+		const u8* data = (const u8*)blob.skip(size);
+		const u32 hash = crc32(data, size);
+		m_dictionaries.insert(hash, Span(data, size));
+		m_type_dictionaries.insert(type, hash);
+	}
+}
+
+
+Span<const u8> ResourceManagerHub::getDictionary(u32 hash) const
+{
+	auto iter = m_dictionaries.find(hash);
+	return iter.isValid() ? iter.value() : Span<const u8>();
+}
+
+
+u32 ResourceManagerHub::getDictionaryHash(ResourceType type) const
+{
+	auto iter = m_type_dictionaries.find(type.type);
+	return iter.isValid() ? iter.value() : 0;
+}
+
+
+bool ResourceManagerHub::decompress(const CompiledResourceHeader& header, Span<const u8> payload, OutputMemoryStream& out) const
+{
+	ASSERT(header.flags & CompiledResourceHeader::COMPRESSED);
+	out.resize(header.decompressed_size);
+	i32 res;
+	if (header.flags & CompiledResourceHeader::DICTIONARY) {
+		const Span<const u8> dict = getDictionary(header.dictionary);
+		if (dict.length() == 0) {
+			logError("Missing compression dictionary, please delete .lumix directory");
+			return false;
+		}
+		res = LZ4_decompress_safe_usingDict((const char*)payload.begin()
+			, (char*)out.getMutableData()
+			, (i32)payload.length()
+			, (i32)out.size()
+			, (const char*)dict.begin()
+			, (i32)dict.length());
+	}
+	else {
+		res = LZ4_decompress_safe((const char*)payload.begin(), (char*)out.getMutableData(), (i32)payload.length(), (i32)out.size());
+	}
+	return res == (i32)header.decompressed_size;
+}
+
+
+void ResourceManagerHub::saveDependencyManifest(OutputMemoryStream& stream) const
+{
+	stream.write(DEPENDENCY_MANIFEST_MAGIC);
+	stream.write(DEPENDENCY_MANIFEST_VERSION);
+	stream.write((u32)m_manifest.size());
+	for (const ManifestEntry& entry : m_manifest) {
+		stream.write(entry.type);
+		stream.writeString(entry.path.c_str());
+		stream.write((u32)entry.dependencies.size());
+		if (!entry.dependencies.empty()) stream.write(entry.dependencies.begin(), entry.dependencies.byte_size());
+	}
+}
+
+
+ResourceManagerHub::ManifestEntry& ResourceManagerHub::getManifestEntry(Resource& resource)
+{
+	const StableHash hash = resource.getPath().getStableHash();
+	auto iter = m_manifest.find(hash);
+	if (iter.isValid()) return iter.value();
+
+	ManifestEntry entry(m_allocator);
+	entry.type = resource.getType().type;
+	entry.path = resource.getPath();
+	return m_manifest.insert(hash, static_cast<ManifestEntry&&>(entry)).value();
+}
+
+
+void ResourceManagerHub::onDependencyAdded(Resource& parent, Resource& dependency)
+{
+	if (!m_record_dependencies) return;
+
+	getManifestEntry(dependency);
+	ManifestEntry& entry = getManifestEntry(parent);
+	const StableHash hash = dependency.getPath().getStableHash();
+	if (entry.dependencies.indexOf(hash) < 0) entry.dependencies.push(hash);
+}
+
+
+void ResourceManagerHub::prefetchDependencies(const Path& path)
+{
+	if (m_manifest.empty()) return;
+
+	auto iter = m_manifest.find(path.getStableHash());
+	if (!iter.isValid()) return;
+
+	for (StableHash dep_hash : iter.value().dependencies) {
+		auto dep_iter = m_manifest.find(dep_hash);
+		if (!dep_iter.isValid()) continue;
+		
+		ResourceType type;
+		type.type = dep_iter.value().type;
+		ResourceManager* manager = get(type);
+		if (!manager) continue;
+		
+		// manifest is changed only from load callbacks, so `iter` is still valid after this
+		Resource* res = manager->load(dep_iter.value().path);
+		if (res) m_prefetched.push(res);
+	}
+}
+
+
+void ResourceManagerHub::prefetch(Span<const Path> paths)
+{
+	for (const Path& path : paths) {
+		auto iter = m_manifest.find(path.getStableHash());
+		if (!iter.isValid()) continue;
+
+		ResourceType type;
+		type.type = iter.value().type;
+		ResourceManager* manager = get(type);
+		if (!manager) continue;
+
+		Resource* res = manager->load(path);
+		if (res) m_prefetched.push(res);
+	}
+}
+
+
+void ResourceManagerHub::releasePrefetched()
+{
+	for (Resource* res : m_prefetched) {
+		res->decRefCount();
+	}
+	m_prefetched.clear();
 }
 
 Resource* ResourceManagerHub::load(ResourceType type, const Path& path)
@@ -196,6 +454,7 @@ ResourceManagerHub::LoadHook::Action ResourceManagerHub::onBeforeLoad(Resource&
 void ResourceManagerHub::add(ResourceType type, ResourceManager* rm)
 { 
 	m_resource_managers.insert(type.type, rm);
+	rm->setUnusedBudget(m_unused_budget);
 }
 
 void ResourceManagerHub::remove(ResourceType type)
@@ -219,6 +478,15 @@ void ResourceManagerHub::enableUnload(bool enable)
 	}
 }
 
+void ResourceManagerHub::setUnusedBudget(u64 bytes)
+{
+	m_unused_budget = bytes;
+	for (auto* manager : m_resource_managers)
+	{
+		manager->setUnusedBudget(bytes);
+	}
+}
+
 void ResourceManagerHub::reloadAll() {
 	while (m_file_system->hasWork()) m_file_system->processCallbacks();
 	
@@ -1,7 +1,11 @@
 #pragma once
 
 
+#include "engine/array.h"
+#include "engine/flat_hash_map.h"
 #include "engine/hash_map.h"
+#include "engine/path.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
@@ -11,13 +15,20 @@ namespace Lumix
 struct LUMIX_ENGINE_API ResourceManager {
 	friend struct Resource;
 	friend struct ResourceManagerHub;
-	using ResourceTable = HashMap<u32, struct Resource*, HashFuncDirect<u32>>;
+	// keyed by stable path hash, 32bit crc32 collides too often in big projects
+	using ResourceTable = FlatHashMap<StableHash, struct Resource*>;
 
 	void create(struct ResourceType type, struct ResourceManagerHub& owner);
 	void destroy();
 
 	void enableUnload(bool enable);
+	// unreferenced resources stay loaded until their total size exceeds `bytes`, least recently used are unloaded first
+	// 0 unloads resources as soon as they are unreferenced
+	void setUnusedBudget(u64 bytes);
+	u64 getUnusedBudget() const { return m_unused_budget; }
+	u64 getUnusedSize() const { return m_unused_size; }
 
+	// unloads also unused resources kept by the budget
 	void removeUnreferenced();
 
 	void reload(const Path& path);
@@ -34,17 +45,38 @@ protected:
 	virtual void destroyResource(Resource& resource) = 0;
 	Resource* get(const Path& path);
 
+private:
+	void onUnreferenced(Resource& resource);
+	void removeUnused(Resource& resource);
+	void evictUnused();
+
 protected:
 	IAllocator& m_allocator;
 	ResourceTable m_resources;
 	ResourceManagerHub* m_owner;
 	bool m_is_unload_enabled;
+	u64 m_unused_budget = 0;
+	u64 m_unused_size = 0;
+	// most recently unreferenced first
+	Resource* m_unused_first = nullptr;
+	Resource* m_unused_last = nullptr;
 };
 
 
 struct LUMIX_ENGINE_API ResourceManagerHub {
+	friend struct ResourceManager;
 	using ResourceManagerTable = HashMap<u32, ResourceManager*>;
 
+	// editor records which resources each resource depends on, so they can be prefetched together next time
+	static constexpr const char* DEPENDENCY_MANIFEST_PATH = ".lumix/assets/_deps.bin";
+	static constexpr u32 DEPENDENCY_MANIFEST_MAGIC = '_LDM';
+	static constexpr u32 DEPENDENCY_MANIFEST_VERSION = 1;
+	// lz4 dictionaries trained by the editor per resource type, they help small compiled resources the most
+	static constexpr const char* DICTIONARIES_PATH = ".lumix/assets/_dicts.bin";
+	static constexpr u32 DICTIONARIES_MAGIC = '_LCD';
+	static constexpr u32 DICTIONARIES_VERSION = 1;
+	static constexpr u32 MAX_DICTIONARY_SIZE = 64 * 1024;
+
 	struct LUMIX_ENGINE_API LoadHook {
 		enum class Action { IMMEDIATE, DEFERRED };
 		virtual ~LoadHook() {}
@@ -69,6 +101,21 @@ struct LUMIX_ENGINE_API ResourceManagerHub {
 	}
 
 	Resource* load(ResourceType type, const Path& path);
+	// starts loading paths and all their dependencies (according to manifest) at once, instead of discovering them one level at a time
+	// prefetched resources are referenced until all pending loads finish
+	void prefetch(Span<const Path> paths);
+	void releasePrefetched();
+	void enableDependencyRecording(bool enable) { m_record_dependencies = enable; }
+	void onDependencyAdded(Resource& parent, Resource& dependency);
+	void saveDependencyManifest(struct OutputMemoryStream& stream) const;
+
+	void loadDictionaries();
+	// empty if there is no such dictionary
+	Span<const u8> getDictionary(u32 hash) const;
+	// 0 if resources of `type` do not have a dictionary
+	u32 getDictionaryHash(ResourceType type) const;
+	// `payload` is what follows `header` in a compiled resource
+	bool decompress(const struct CompiledResourceHeader& header, Span<const u8> payload, OutputMemoryStream& out) const;
 
 	void setLoadHook(LoadHook* hook);
 	LoadHook::Action onBeforeLoad(Resource& resource) const;
@@ -78,15 +125,42 @@ struct LUMIX_ENGINE_API ResourceManagerHub {
 	void reloadAll();
 	void removeUnreferenced();
 	void enableUnload(bool enable);
+	// applied to all managers, including those added later
+	void setUnusedBudget(u64 bytes);
 
 	FileSystem& getFileSystem() { return *m_file_system; }
+	// called by resources, publishes profiler counters
+	void onLoadStarted();
+	void onLoadFinished(u64 size);
 
 private:
+	struct ManifestEntry {
+		ManifestEntry(IAllocator& allocator) : dependencies(allocator) {}
+		u32 type; // ResourceType::type
+		Path path;
+		Array<StableHash> dependencies; // path hashes
+	};
+
 	Resource* load(ResourceManager& manager, const Path& path);
+	void prefetchDependencies(const Path& path);
+	void loadDependencyManifest();
+	ManifestEntry& getManifestEntry(Resource& resource);
+
 	IAllocator& m_allocator;
 	ResourceManagerTable m_resource_managers;
 	FileSystem* m_file_system;
 	LoadHook* m_load_hook;
+	HashMap<StableHash, ManifestEntry> m_manifest;
+	// content of DICTIONARIES_PATH, spans in m_dictionaries point to it
+	OutputMemoryStream m_dictionaries_blob;
+	HashMap<u32, Span<const u8>> m_dictionaries;
+	HashMap<u32, u32> m_type_dictionaries;
+	Array<Resource*> m_prefetched;
+	bool m_record_dependencies = false;
+	u64 m_unused_budget = 0;
+	u32 m_loading_count = 0;
+	u32 m_loading_counter;
+	u32 m_loaded_bytes_counter;
 };
 
 
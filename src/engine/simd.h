@@ -4,18 +4,36 @@
 #include "engine/lumix.h"
 
 
-#ifdef _WIN32
+// sse2 is always available on x64, neon on aarch64, other platforms use scalar fallback
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define LUMIX_SSE2
+	#include <emmintrin.h>
 	#include <xmmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define LUMIX_NEON
+	#include <arm_neon.h>
 #else
 	#include <math.h>
 	#include <string.h>
 #endif
 
+// avx2 is not guaranteed on x64, functions using float8 must be LUMIX_AVX2_FUNC and called only if cpuHasAVX2()
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+	#define LUMIX_AVX2
+	#define LUMIX_AVX2_FUNC
+	#include <immintrin.h>
+	#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+	#define LUMIX_AVX2
+	#define LUMIX_AVX2_FUNC __attribute__((target("avx2")))
+	#include <immintrin.h>
+#endif
+
 namespace Lumix
 {
 
 
-#ifdef _WIN32
+#ifdef LUMIX_SSE2
 	using float4 = __m128;
 
 
@@ -133,16 +151,230 @@ namespace Lumix
 		return _mm_max_ps(a, b);
 	}
 
-	LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
-		return _mm_add_ps(a, b);
+	// __m128 is a builtin vector type in gcc and clang, which already has these operators
+	#if defined(_MSC_VER) && !defined(__clang__)
+		LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
+			return _mm_add_ps(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator -(float4 a, float4 b) {
+			return _mm_sub_ps(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator *(float4 a, float4 b) {
+			return _mm_mul_ps(a, b);
+		}
+	#endif
+
+	LUMIX_FORCE_INLINE float4 f4Or(float4 a, float4 b)
+	{
+		return _mm_or_ps(a, b);
 	}
 
-	LUMIX_FORCE_INLINE float4 operator -(float4 a, float4 b) {
-		return _mm_sub_ps(a, b);
+	// lanes of `a` where `mask` is set, lanes of `b` elsewhere; `mask` is a result of comparison
+	LUMIX_FORCE_INLINE float4 f4Select(float4 mask, float4 a, float4 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
 	}
 
-	LUMIX_FORCE_INLINE float4 operator *(float4 a, float4 b) {
-		return _mm_mul_ps(a, b);
+	// rounds toward zero, values must fit in i32
+	LUMIX_FORCE_INLINE float4 f4Trunc(float4 a)
+	{
+		return _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+	}
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		return _mm_and_ps(a, b);
+	}
+
+	// a, b, c, d are rows of 4x4 matrix, after the call they are its columns
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+	}
+
+	// bit i is set if i-th byte of 16B `group` is equal to `value`
+	LUMIX_FORCE_INLINE u32 u8x16MatchMask(const void* group, u8 value)
+	{
+		const __m128i g = _mm_loadu_si128((const __m128i*)group);
+		return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)value)));
+	}
+
+#elif defined(LUMIX_NEON)
+	using float4 = float32x4_t;
+
+
+	LUMIX_FORCE_INLINE float4 f4LoadUnaligned(const void* src)
+	{
+		return vld1q_f32((const float*)src);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Load(const void* src)
+	{
+		return vld1q_f32((const float*)src);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Splat(float value)
+	{
+		return vdupq_n_f32(value);
+	}
+
+	LUMIX_FORCE_INLINE float f4GetX(float4 v)
+	{
+		return vgetq_lane_f32(v, 0);
+	}
+
+	LUMIX_FORCE_INLINE float f4GetY(float4 v)
+	{
+		return vgetq_lane_f32(v, 1);
+	}
+
+	LUMIX_FORCE_INLINE float f4GetZ(float4 v)
+	{
+		return vgetq_lane_f32(v, 2);
+	}
+
+	LUMIX_FORCE_INLINE float f4GetW(float4 v)
+	{
+		return vgetq_lane_f32(v, 3);
+	}
+
+	LUMIX_FORCE_INLINE void f4Store(void* dest, float4 src)
+	{
+		vst1q_f32((float*)dest, src);
+	}
+
+	LUMIX_FORCE_INLINE float4 f4CmpGT(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(vcgtq_f32(a, b));
+	}
+
+	LUMIX_FORCE_INLINE float4 f4CmpLT(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(vcltq_f32(a, b));
+	}
+
+	// same as _mm_movemask_ps, i.e. sign bits
+	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
+	{
+		static const i32 shifts[4] = {0, 1, 2, 3};
+		const uint32x4_t sign = vshrq_n_u32(vreinterpretq_u32_f32(a), 31);
+		return (int)vaddvq_u32(vshlq_u32(sign, vld1q_s32(shifts)));
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Add(float4 a, float4 b)
+	{
+		return vaddq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Sub(float4 a, float4 b)
+	{
+		return vsubq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Mul(float4 a, float4 b)
+	{
+		return vmulq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Div(float4 a, float4 b)
+	{
+		return vdivq_f32(a, b);
+	}
+
+
+	// estimate, same precision as _mm_rcp_ps
+	LUMIX_FORCE_INLINE float4 f4Rcp(float4 a)
+	{
+		return vrecpeq_f32(a);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Sqrt(float4 a)
+	{
+		return vsqrtq_f32(a);
+	}
+
+
+	// estimate, same precision as _mm_rsqrt_ps
+	LUMIX_FORCE_INLINE float4 f4Rsqrt(float4 a)
+	{
+		return vrsqrteq_f32(a);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Min(float4 a, float4 b)
+	{
+		return vminq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Max(float4 a, float4 b)
+	{
+		return vmaxq_f32(a, b);
+	}
+
+	// neon types are builtin vector types in gcc and clang, which already have these operators
+	#if defined(_MSC_VER) && !defined(__clang__)
+		LUMIX_FORCE_INLINE float4 operator +(float4 a, float4 b) {
+			return vaddq_f32(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator -(float4 a, float4 b) {
+			return vsubq_f32(a, b);
+		}
+
+		LUMIX_FORCE_INLINE float4 operator *(float4 a, float4 b) {
+			return vmulq_f32(a, b);
+		}
+	#endif
+
+	LUMIX_FORCE_INLINE float4 f4Or(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+
+	LUMIX_FORCE_INLINE float4 f4Select(float4 mask, float4 a, float4 b)
+	{
+		return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+	}
+
+	LUMIX_FORCE_INLINE float4 f4Trunc(float4 a)
+	{
+		return vcvtq_f32_s32(vcvtq_s32_f32(a));
+	}
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float4 t0 = vzip1q_f32(a, c);
+		const float4 t1 = vzip2q_f32(a, c);
+		const float4 t2 = vzip1q_f32(b, d);
+		const float4 t3 = vzip2q_f32(b, d);
+		a = vzip1q_f32(t0, t2);
+		b = vzip2q_f32(t0, t2);
+		c = vzip1q_f32(t1, t3);
+		d = vzip2q_f32(t1, t3);
+	}
+
+	// there's no movemask in neon, matching bytes are weighted by their bit and summed per half
+	LUMIX_FORCE_INLINE u32 u8x16MatchMask(const void* group, u8 value)
+	{
+		static const u8 bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+		const uint8x16_t eq = vceqq_u8(vld1q_u8((const u8*)group), vdupq_n_u8(value));
+		const uint8x16_t masked = vandq_u8(eq, vld1q_u8(bits));
+		return (u32)vaddv_u8(vget_low_u8(masked)) | ((u32)vaddv_u8(vget_high_u8(masked)) << 8);
 	}
 
 #else 
@@ -349,8 +581,145 @@ namespace Lumix
 		return f4Mul(a, b);
 	}
 
+	LUMIX_FORCE_INLINE float4 f4Or(float4 a, float4 b)
+	{
+		u32 ua[4], ub[4];
+		memcpy(ua, &a, sizeof(a));
+		memcpy(ub, &b, sizeof(b));
+		for (u32 i = 0; i < 4; ++i) ua[i] |= ub[i];
+		float4 res;
+		memcpy(&res, ua, sizeof(res));
+		return res;
+	}
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		u32 ua[4], ub[4];
+		memcpy(ua, &a, sizeof(a));
+		memcpy(ub, &b, sizeof(b));
+		for (u32 i = 0; i < 4; ++i) ua[i] &= ub[i];
+		float4 res;
+		memcpy(&res, ua, sizeof(res));
+		return res;
+	}
+
+	LUMIX_FORCE_INLINE float4 f4Select(float4 mask, float4 a, float4 b)
+	{
+		u32 um[4];
+		memcpy(um, &mask, sizeof(mask));
+		return {
+			um[0] ? a.x : b.x,
+			um[1] ? a.y : b.y,
+			um[2] ? a.z : b.z,
+			um[3] ? a.w : b.w
+		};
+	}
+
+	LUMIX_FORCE_INLINE float4 f4Trunc(float4 a)
+	{
+		return {
+			(float)(i32)a.x,
+			(float)(i32)a.y,
+			(float)(i32)a.z,
+			(float)(i32)a.w
+		};
+	}
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float4 ta = a, tb = b, tc = c, td = d;
+		a = {ta.x, tb.x, tc.x, td.x};
+		b = {ta.y, tb.y, tc.y, td.y};
+		c = {ta.z, tb.z, tc.z, td.z};
+		d = {ta.w, tb.w, tc.w, td.w};
+	}
+
+	LUMIX_FORCE_INLINE u32 u8x16MatchMask(const void* group, u8 value)
+	{
+		const u8* g = (const u8*)group;
+		u32 res = 0;
+		for (u32 i = 0; i < 16; ++i) {
+			res |= g[i] == value ? 1 << i : 0;
+		}
+		return res;
+	}
+
 #endif
 
 
+// 4 quaternions at once, `a`, `b` and `out` are x, y, z, w streams; same as nlerp in math.h
+LUMIX_FORCE_INLINE void f4Nlerp(const float4* a, const float4* b, float4 t, float4* out)
+{
+	const float4 zero = f4Splat(0);
+	const float4 dot = f4Add(f4Add(f4Mul(a[0], b[0]), f4Mul(a[1], b[1])), f4Add(f4Mul(a[2], b[2]), f4Mul(a[3], b[3])));
+	const float4 tb = f4Select(f4CmpLT(dot, zero), f4Sub(zero, t), t);
+	const float4 ta = f4Sub(f4Splat(1), t);
+	float4 r[4];
+	for (u32 i = 0; i < 4; ++i) r[i] = f4Add(f4Mul(a[i], ta), f4Mul(b[i], tb));
+	const float4 len_sq = f4Add(f4Add(f4Mul(r[0], r[0]), f4Mul(r[1], r[1])), f4Add(f4Mul(r[2], r[2]), f4Mul(r[3], r[3])));
+	const float4 inv_len = f4Div(f4Splat(1), f4Sqrt(len_sq));
+	for (u32 i = 0; i < 4; ++i) out[i] = f4Mul(r[i], inv_len);
+}
+
+#ifdef LUMIX_AVX2
+	inline bool cpuHasAVX2()
+	{
+		static const bool res = [](){
+			#if defined(_MSC_VER) && !defined(__clang__)
+				int info[4];
+				__cpuid(info, 0);
+				if (info[0] < 7) return false;
+				__cpuid(info, 1);
+				const bool osxsave = info[2] & (1 << 27);
+				const bool avx = info[2] & (1 << 28);
+				// os must save ymm registers
+				if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+				__cpuidex(info, 7, 0);
+				return (info[1] & (1 << 5)) != 0;
+			#else
+				__builtin_cpu_init();
+				return __builtin_cpu_supports("avx2") != 0;
+			#endif
+		}();
+		return res;
+	}
+
+	using float8 = __m256;
+
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8LoadUnaligned(const void* src) { return _mm256_loadu_ps((const float*)src); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE void f8StoreUnaligned(void* dest, float8 src) { _mm256_storeu_ps((float*)dest, src); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Splat(float value) { return _mm256_set1_ps(value); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Add(float8 a, float8 b) { return _mm256_add_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Sub(float8 a, float8 b) { return _mm256_sub_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Mul(float8 a, float8 b) { return _mm256_mul_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Div(float8 a, float8 b) { return _mm256_div_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Sqrt(float8 a) { return _mm256_sqrt_ps(a); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Min(float8 a, float8 b) { return _mm256_min_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Max(float8 a, float8 b) { return _mm256_max_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Or(float8 a, float8 b) { return _mm256_or_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8And(float8 a, float8 b) { return _mm256_and_ps(a, b); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8CmpGT(float8 a, float8 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8CmpLT(float8 a, float8 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE float8 f8Select(float8 mask, float8 a, float8 b) { return _mm256_blendv_ps(b, a, mask); }
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE int f8MoveMask(float8 a) { return _mm256_movemask_ps(a); }
+
+	// `v01`, `v23`, `v45`, `v67` are pairs of consecutive xyzw vectors, outputs are their x, y, z, w streams
+	LUMIX_AVX2_FUNC LUMIX_FORCE_INLINE void f8Deinterleave(float8 v01, float8 v23, float8 v45, float8 v67, float8& x, float8& y, float8& z, float8& w)
+	{
+		const float8 v04 = _mm256_permute2f128_ps(v01, v45, 0x20);
+		const float8 v15 = _mm256_permute2f128_ps(v01, v45, 0x31);
+		const float8 v26 = _mm256_permute2f128_ps(v23, v67, 0x20);
+		const float8 v37 = _mm256_permute2f128_ps(v23, v67, 0x31);
+		const float8 t0 = _mm256_unpacklo_ps(v04, v15);
+		const float8 t1 = _mm256_unpackhi_ps(v04, v15);
+		const float8 t2 = _mm256_unpacklo_ps(v26, v37);
+		const float8 t3 = _mm256_unpackhi_ps(v26, v37);
+		x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		w = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+#endif
+
 
 } // namespace Lumix
\ No newline at end of file
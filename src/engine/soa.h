@@ -0,0 +1,149 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/crt.h"
+#include "engine/lumix.h"
+#include "engine/metaprogramming.h"
+
+namespace Lumix {
+
+// structure of arrays - each of Ts is stored in its own contiguous column, all columns share one allocation
+// loops which touch only some columns do not pull the rest into cache
+// Ts must be trivially copyable, items are moved around with memcpy
+template <typename... Ts> struct SoA {
+	static constexpr u32 COLUMNS_COUNT = sizeof...(Ts);
+	static_assert(COLUMNS_COUNT > 0);
+	static_assert((__is_trivially_copyable(Ts) && ...), "SoA columns must be trivially copyable");
+
+	template <u32 I> using Column = typename TypeAt<I, Ts...>::Type;
+
+	explicit SoA(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+		for (void*& c : m_columns) c = nullptr;
+	}
+
+	SoA(SoA&& rhs)
+		: m_allocator(rhs.m_allocator)
+		, m_data(rhs.m_data)
+		, m_size(rhs.m_size)
+		, m_capacity(rhs.m_capacity)
+	{
+		for (u32 i = 0; i < COLUMNS_COUNT; ++i) {
+			m_columns[i] = rhs.m_columns[i];
+			rhs.m_columns[i] = nullptr;
+		}
+		rhs.m_data = nullptr;
+		rhs.m_size = 0;
+		rhs.m_capacity = 0;
+	}
+
+	SoA(const SoA&) = delete;
+	void operator=(const SoA&) = delete;
+	void operator=(SoA&&) = delete;
+
+	~SoA() { m_allocator.deallocate_aligned(m_data); }
+
+	template <u32 I> Column<I>* begin() const { return (Column<I>*)m_columns[I]; }
+	template <u32 I> Column<I>* end() const { return (Column<I>*)m_columns[I] + m_size; }
+	template <u32 I> Span<Column<I>> column() const { return Span(begin<I>(), end<I>()); }
+
+	template <u32 I> Column<I>& get(u32 idx) {
+		ASSERT(idx < m_size);
+		return ((Column<I>*)m_columns[I])[idx];
+	}
+
+	template <u32 I> const Column<I>& get(u32 idx) const {
+		ASSERT(idx < m_size);
+		return ((const Column<I>*)m_columns[I])[idx];
+	}
+
+	// returns index of the new item
+	u32 push(const Ts&... values) {
+		if (m_size == m_capacity) grow(m_capacity < 16 ? 16 : m_capacity * 2);
+		set(m_size, typename BuildIndices<-1, COLUMNS_COUNT>::result{}, values...);
+		return m_size++;
+	}
+
+	// new item is default constructed, returns its index
+	u32 emplace() {
+		if (m_size == m_capacity) grow(m_capacity < 16 ? 16 : m_capacity * 2);
+		construct(m_size, m_size + 1, typename BuildIndices<-1, COLUMNS_COUNT>::result{});
+		return m_size++;
+	}
+
+	void swapAndPop(u32 idx) {
+		ASSERT(idx < m_size);
+		--m_size;
+		if (idx == m_size) return;
+		for (u32 i = 0; i < COLUMNS_COUNT; ++i) {
+			u8* column = (u8*)m_columns[i];
+			memcpy(column + idx * SIZES[i], column + m_size * SIZES[i], SIZES[i]);
+		}
+	}
+
+	void pop() {
+		ASSERT(m_size > 0);
+		--m_size;
+	}
+
+	void clear() { m_size = 0; }
+
+	void reserve(u32 capacity) {
+		if (capacity > m_capacity) grow(capacity);
+	}
+
+	// new items are default constructed
+	void resize(u32 size) {
+		reserve(size);
+		if (size > m_size) construct(m_size, size, typename BuildIndices<-1, COLUMNS_COUNT>::result{});
+		m_size = size;
+	}
+
+	bool empty() const { return m_size == 0; }
+	int size() const { return m_size; }
+	u32 capacity() const { return m_capacity; }
+
+private:
+	static constexpr u32 SIZES[] = { sizeof(Ts)... };
+	static constexpr u32 ALIGNS[] = { alignof(Ts)... };
+
+	template <int... I> void set(u32 idx, Indices<I...>, const Ts&... values) {
+		((new (NewPlaceholder(), (Ts*)m_columns[I] + idx) Ts(values)), ...);
+	}
+
+	template <int... I> void construct(u32 from, u32 to, Indices<I...>) {
+		for (u32 idx = from; idx < to; ++idx) {
+			((new (NewPlaceholder(), (Ts*)m_columns[I] + idx) Ts), ...);
+		}
+	}
+
+	void grow(u32 new_capacity) {
+		u32 offsets[COLUMNS_COUNT];
+		u32 total = 0;
+		u32 max_align = 1;
+		for (u32 i = 0; i < COLUMNS_COUNT; ++i) {
+			total = (total + ALIGNS[i] - 1) & ~(ALIGNS[i] - 1);
+			offsets[i] = total;
+			total += SIZES[i] * new_capacity;
+			max_align = ALIGNS[i] > max_align ? ALIGNS[i] : max_align;
+		}
+
+		u8* new_data = (u8*)m_allocator.allocate_aligned(total, max_align);
+		for (u32 i = 0; i < COLUMNS_COUNT; ++i) {
+			if (m_size > 0) memcpy(new_data + offsets[i], m_columns[i], SIZES[i] * m_size);
+			m_columns[i] = new_data + offsets[i];
+		}
+		m_allocator.deallocate_aligned(m_data);
+		m_data = new_data;
+		m_capacity = new_capacity;
+	}
+
+	IAllocator& m_allocator;
+	u8* m_data = nullptr;
+	void* m_columns[COLUMNS_COUNT];
+	u32 m_size = 0;
+	u32 m_capacity = 0;
+};
+
+} // namespace Lumix
@@ -1,6 +1,9 @@
 #include "stream.h"
 #include "engine/allocator.h"
+#include "engine/crc32.h"
 #include "engine/crt.h"
+#include "engine/math.h"
+#include "engine/page_allocator.h"
 #include "engine/string.h"
 
 
@@ -292,6 +295,121 @@ void OutputMemoryStream::resize(u64 size)
 
 
 
+// rest of each page is used by Page header
+static constexpr u32 PAGE_DATA_SIZE = PageAllocator::PAGE_SIZE - 16;
+
+
+OutputPagedStream::OutputPagedStream(PageAllocator& allocator)
+	: m_allocator(allocator)
+{
+	static_assert(sizeof(Page) <= PageAllocator::PAGE_SIZE - PAGE_DATA_SIZE);
+}
+
+
+OutputPagedStream::~OutputPagedStream()
+{
+	clear();
+}
+
+
+void OutputPagedStream::clear()
+{
+	Page* page = m_first;
+	while (page) {
+		Page* next = page->next;
+		m_allocator.deallocate(page, true);
+		page = next;
+	}
+	m_first = m_last = nullptr;
+	m_size = 0;
+}
+
+
+OutputPagedStream::Page* OutputPagedStream::pushPage()
+{
+	Page* page = (Page*)m_allocator.allocate(true);
+	page->next = nullptr;
+	page->size = 0;
+	if (m_last) m_last->next = page;
+	else m_first = page;
+	m_last = page;
+	return page;
+}
+
+
+bool OutputPagedStream::write(const void* data, u64 size)
+{
+	const u8* src = (const u8*)data;
+	while (size > 0) {
+		Page* page = m_last && m_last->size < PAGE_DATA_SIZE ? m_last : pushPage();
+		const u32 chunk = (u32)minimum(size, u64(PAGE_DATA_SIZE - page->size));
+		memcpy(page->data() + page->size, src, chunk);
+		page->size += chunk;
+		m_size += chunk;
+		src += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+
+void OutputPagedStream::writeString(const char* string)
+{
+	if (string) {
+		write(string, stringLength(string) + 1);
+	} else {
+		write((char)0);
+	}
+}
+
+
+void* OutputPagedStream::skip(u32 size)
+{
+	ASSERT(size <= PAGE_DATA_SIZE);
+	// the rest of the last page is left unused
+	Page* page = m_last && m_last->size + size <= PAGE_DATA_SIZE ? m_last : pushPage();
+	void* ret = page->data() + page->size;
+	page->size += size;
+	m_size += size;
+	return ret;
+}
+
+
+bool OutputPagedStream::writeTo(IOutputStream& stream) const
+{
+	bool res = true;
+	forEachChunk([&](Span<const u8> chunk){
+		res = res && stream.write(chunk.begin(), chunk.length());
+	});
+	return res;
+}
+
+
+void OutputPagedStream::copyTo(OutputMemoryStream& stream) const
+{
+	u8* dst = (u8*)stream.skip(m_size);
+	forEachChunk([&](Span<const u8> chunk){
+		memcpy(dst, chunk.begin(), chunk.length());
+		dst += chunk.length();
+	});
+}
+
+
+u32 OutputPagedStream::computeCrc32(u64 offset) const
+{
+	u32 crc = 0;
+	forEachChunk([&](Span<const u8> chunk){
+		if (offset >= chunk.length()) {
+			offset -= chunk.length();
+			return;
+		}
+		crc = continueCrc32(crc, chunk.begin() + offset, u32(chunk.length() - offset));
+		offset = 0;
+	});
+	return crc;
+}
+
+
 InputMemoryStream::InputMemoryStream(const void* data, u64 size)
 	: m_data((const u8*)data)
 	, m_size(size)
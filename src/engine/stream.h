@@ -67,6 +67,52 @@ private:
 };
 
 
+// output split to pages from PageAllocator, growing never copies already written data
+// data is not contiguous, use writeTo / forEachChunk, copyTo only if a contiguous copy is really needed
+struct LUMIX_ENGINE_API OutputPagedStream final : IOutputStream {
+	explicit OutputPagedStream(struct PageAllocator& allocator);
+	~OutputPagedStream();
+
+	using IOutputStream::write;
+	bool write(const void* data, u64 size) override;
+	void writeString(const char* string);
+	// contiguous `size` bytes, valid until clear, e.g. to patch a header once the rest is written
+	void* skip(u32 size);
+	u64 size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	void clear();
+
+	// one write per page, e.g. to os::OutputFile
+	bool writeTo(IOutputStream& stream) const;
+	// appends all data to `stream`, reserving it only once
+	void copyTo(OutputMemoryStream& stream) const;
+	// crc32 of data starting at `offset`
+	u32 computeCrc32(u64 offset) const;
+
+	template <typename F> void forEachChunk(F&& f) const {
+		for (Page* page = m_first; page; page = page->next) {
+			f(Span<const u8>(page->data(), page->data() + page->size));
+		}
+	}
+
+private:
+	struct Page {
+		Page* next;
+		u32 size;
+		u8* data() { return (u8*)(this + 1); }
+	};
+
+	OutputPagedStream(const OutputPagedStream&) = delete;
+	void operator =(const OutputPagedStream&) = delete;
+	Page* pushPage();
+
+	PageAllocator& m_allocator;
+	Page* m_first = nullptr;
+	Page* m_last = nullptr;
+	u64 m_size = 0;
+};
+
+
 template <typename T> void OutputMemoryStream::write(const T& value)
 {
 	write(&value, sizeof(T));
@@ -1,10 +1,13 @@
 #include "universe.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/engine.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/plugin.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/string.h"
 
@@ -13,6 +16,20 @@ namespace Lumix
 {
 
 static constexpr int RESERVED_ENTITIES_COUNT = 1024;
+static constexpr u32 SNAPSHOT_MAGIC = '_USN';
+// less dirty subtrees are flushed on the calling thread
+static constexpr i32 PARALLEL_FLUSH_MIN_ROOTS = 64;
+
+enum DirtyTransformFlags : u8 {
+	DIRTY = 1 << 0,
+	// world transform was set, local transform is computed from it; otherwise world is computed from local
+	DIRTY_LOCAL = 1 << 1,
+	// ancestor is dirty, used only by flushFlat
+	PROPAGATED = 1 << 2
+};
+
+// flushFlat is used if there's at least one dirty entity per this many entities in the flat hierarchy
+static constexpr u32 FLAT_FLUSH_RATIO = 32;
 
 const ComponentUID ComponentUID::INVALID(INVALID_ENTITY, { -1 }, 0);
 
@@ -49,14 +66,29 @@ Universe::Universe(Engine& engine, IAllocator& allocator)
 	, m_names(m_allocator)
 	, m_entities(m_allocator)
 	, m_component_added(m_allocator)
+	, m_components_added(m_allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_destroyed(m_allocator)
+	, m_entity_enabled(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
+	, m_entities_interpolated(m_allocator)
 	, m_entity_created(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
 	, m_transforms(m_allocator)
+	, m_dirty_transforms(m_allocator)
+	, m_moved_entities(m_allocator)
+	, m_deferred_component_scenes(m_allocator)
+	, m_deferred_components(m_allocator)
+	, m_deferred_entities(m_allocator)
+	, m_flat_levels(m_allocator)
+	, m_flat_locations(m_allocator)
+	, m_journal(m_allocator)
+	, m_prev_transforms(m_allocator)
+	, m_interpolated_transforms(m_allocator)
+	, m_interpolated_entities(m_allocator)
 	, m_name("")
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
@@ -96,6 +128,7 @@ void Universe::addScene(UniquePtr<IScene>&& scene)
 		if (cmp.scene == hash) {
 			m_component_type_map[cmp.cmp->component_type.index].scene = scene.get();
 			m_component_type_map[cmp.cmp->component_type.index].create = cmp.cmp->creator;
+			m_component_type_map[cmp.cmp->component_type.index].create_bulk = cmp.cmp->bulk_creator;
 			m_component_type_map[cmp.cmp->component_type.index].destroy = cmp.cmp->destroyer;
 		}
 	}
@@ -116,9 +149,325 @@ const Quat& Universe::getRotation(EntityRef entity) const
 }
 
 
+void Universe::beginDeferredTransforms() {
+	++m_deferred_transforms;
+}
+
+
+void Universe::endDeferredTransforms() {
+	ASSERT(m_deferred_transforms > 0);
+	--m_deferred_transforms;
+	if (m_deferred_transforms == 0) flushTransforms();
+}
+
+
+void Universe::markTransformDirty(EntityRef entity, bool update_local) {
+	MutexGuard lock(m_dirty_mutex);
+	EntityData& data = m_entities[entity.index];
+	if (data.dirty_transform == 0) m_dirty_transforms.push(entity);
+	// the last set* call wins
+	data.dirty_transform = DIRTY | (update_local ? DIRTY_LOCAL : 0);
+}
+
+
+void Universe::flushSubtree(EntityRef entity, Array<EntityRef>& moved) {
+	moved.push(entity);
+	const i32 hierarchy_idx = m_entities[entity.index].hierarchy;
+	if (hierarchy_idx < 0) return;
+
+	Hierarchy& h = m_hierarchy[hierarchy_idx];
+	const Transform my_transform = m_transforms[entity.index];
+	if ((m_entities[entity.index].dirty_transform & DIRTY_LOCAL) && h.parent.isValid()) {
+		h.local_transform = m_transforms[h.parent.index].inverted() * my_transform;
+	}
+
+	EntityPtr child = h.first_child;
+	while (child.isValid()) {
+		const EntityData& child_data = m_entities[child.index];
+		const Hierarchy& child_h = m_hierarchy[child_data.hierarchy];
+		if ((child_data.dirty_transform & DIRTY_LOCAL) == 0) {
+			m_transforms[child.index] = my_transform * child_h.local_transform;
+		}
+		const EntityPtr next = child_h.next_sibling;
+		flushSubtree((EntityRef)child, moved);
+		child = next;
+	}
+}
+
+
+void Universe::flushFlat() {
+	PROFILE_FUNCTION();
+	Array<Array<EntityRef>> moved(m_allocator);
+	for (u32 i = 0, c = jobs::getWorkersCount(); i < c; ++i) moved.emplace(m_allocator);
+
+	for (EntityRef e : m_dirty_transforms) {
+		if (getParent(e).isValid()) continue;
+		m_moved_entities.push(e);
+	}
+
+	// parents are always in a previous level, entities in one level can be updated in parallel
+	for (const Array<FlatNode>& level : m_flat_levels) {
+		jobs::forEach(level.size(), jobs::GrainHint{50}, [&](i32 from, i32 to, const jobs::ForEachContext& ctx){
+			Array<EntityRef>& worker_moved = moved[ctx.worker_index];
+			for (i32 i = from; i < to; ++i) {
+				const FlatNode& node = level[i];
+				EntityData& data = m_entities[node.entity.index];
+				const u8 parent_dirty = m_entities[node.parent.index].dirty_transform;
+				if (parent_dirty == 0 && data.dirty_transform == 0) continue;
+
+				Hierarchy& h = m_hierarchy[data.hierarchy];
+				if (data.dirty_transform & DIRTY_LOCAL) {
+					h.local_transform = m_transforms[node.parent.index].inverted() * m_transforms[node.entity.index];
+				}
+				else {
+					m_transforms[node.entity.index] = m_transforms[node.parent.index] * h.local_transform;
+				}
+				data.dirty_transform |= PROPAGATED;
+				worker_moved.push(node.entity);
+			}
+		});
+	}
+
+	for (const Array<EntityRef>& worker_moved : moved) {
+		for (EntityRef e : worker_moved) {
+			m_entities[e.index].dirty_transform = 0;
+			m_moved_entities.push(e);
+		}
+	}
+}
+
+
+void Universe::removeFromFlat(EntityRef entity) {
+	if (entity.index >= m_flat_locations.size()) return;
+	FlatLocation& loc = m_flat_locations[entity.index];
+	if (loc.level < 0) return;
+
+	Array<FlatNode>& level = m_flat_levels[loc.level];
+	const EntityRef last = level.back().entity;
+	m_flat_locations[last.index].idx = loc.idx;
+	level.swapAndPop(loc.idx);
+	loc = {};
+	--m_flat_count;
+}
+
+
+// moves entity and its descendants to levels matching their new depth
+void Universe::updateFlatSubtree(EntityRef entity) {
+	removeFromFlat(entity);
+	const EntityPtr parent = getParent(entity);
+	if (parent.isValid()) {
+		const i32 parent_level = parent.index < m_flat_locations.size() ? m_flat_locations[parent.index].level : -1;
+		const i32 level = parent_level + 1;
+		while (m_flat_levels.size() <= level) m_flat_levels.emplace(m_allocator);
+		while (m_flat_locations.size() <= entity.index) m_flat_locations.emplace();
+		m_flat_locations[entity.index] = {level, m_flat_levels[level].size()};
+		m_flat_levels[level].push({entity, (EntityRef)parent});
+		++m_flat_count;
+	}
+
+	for (EntityPtr child = getFirstChild(entity); child.isValid(); child = getNextSibling((EntityRef)child)) {
+		updateFlatSubtree((EntityRef)child);
+	}
+}
+
+
+void Universe::rebuildFlatHierarchy() {
+	m_flat_levels.clear();
+	m_flat_locations.clear();
+	m_flat_count = 0;
+	if (!m_flat_hierarchy_enabled) return;
+
+	m_flat_locations.resize(m_entities.size());
+	for (const Hierarchy& h : m_hierarchy) {
+		if (!h.parent.isValid()) updateFlatSubtree(h.entity);
+	}
+}
+
+
+void Universe::enableFlatHierarchy(bool enable) {
+	if (m_flat_hierarchy_enabled == enable) return;
+	m_flat_hierarchy_enabled = enable;
+	rebuildFlatHierarchy();
+}
+
+
+void Universe::flushTransforms() {
+	if (m_dirty_transforms.empty()) return;
+	PROFILE_FUNCTION();
+
+	m_moved_entities.clear();
+	if (m_flat_hierarchy_enabled && m_dirty_transforms.size() * FLAT_FLUSH_RATIO >= m_flat_count) {
+		flushFlat();
+		for (EntityRef e : m_dirty_transforms) m_entities[e.index].dirty_transform = 0;
+		m_dirty_transforms.clear();
+		for (EntityRef e : m_moved_entities) journalTransformed(e);
+		m_entities_moved.invoke(m_moved_entities);
+		return;
+	}
+
+	// topmost dirty entities, the rest is updated from them; their subtrees are disjoint, so they can be updated in parallel
+	Array<EntityRef> roots(m_allocator);
+	for (EntityRef e : m_dirty_transforms) {
+		bool is_root = true;
+		for (EntityPtr parent = getParent(e); parent.isValid(); parent = getParent((EntityRef)parent)) {
+			if (m_entities[parent.index].dirty_transform) {
+				is_root = false;
+				break;
+			}
+		}
+		if (is_root) roots.push(e);
+	}
+
+	if (roots.size() < PARALLEL_FLUSH_MIN_ROOTS) {
+		for (EntityRef root : roots) flushSubtree(root, m_moved_entities);
+	}
+	else {
+		Array<Array<EntityRef>> moved(m_allocator);
+		for (u32 i = 0, c = jobs::getWorkersCount(); i < c; ++i) moved.emplace(m_allocator);
+		jobs::forEach(roots.size(), jobs::GrainHint{500}, [&](i32 from, i32 to, const jobs::ForEachContext& ctx){
+			Array<EntityRef>& worker_moved = moved[ctx.worker_index];
+			for (i32 i = from; i < to; ++i) flushSubtree(roots[i], worker_moved);
+		});
+		for (const Array<EntityRef>& worker_moved : moved) {
+			for (EntityRef e : worker_moved) m_moved_entities.push(e);
+		}
+	}
+
+	for (EntityRef e : m_dirty_transforms) m_entities[e.index].dirty_transform = 0;
+	m_dirty_transforms.clear();
+
+	for (EntityRef e : m_moved_entities) journalTransformed(e);
+	m_entities_moved.invoke(m_moved_entities);
+}
+
+
+void Universe::beginSimulationStep() {
+	restoreSimulatedTransforms();
+	m_interpolated_transforms.clear();
+	m_prev_transforms.resize(m_transforms.size());
+	if (!m_transforms.empty()) memcpy(m_prev_transforms.begin(), m_transforms.begin(), m_transforms.byte_size());
+}
+
+
+void Universe::endSimulationStep() {
+	PROFILE_FUNCTION();
+	m_interpolated_transforms.clear();
+	const u32 count = minimum(m_prev_transforms.size(), m_transforms.size());
+	for (u32 i = 0; i < count; ++i) {
+		if (!m_entities[i].valid) continue;
+		const Transform& prev = m_prev_transforms[i];
+		// entity created during the step
+		if (prev.scale < 0) continue;
+		const Transform& tr = m_transforms[i];
+		if (memcmp(&prev, &tr, sizeof(tr)) == 0) continue;
+
+		InterpolatedTransform& it = m_interpolated_transforms.emplace();
+		it.entity = EntityRef{(i32)i};
+		it.prev = prev;
+		it.simulated = tr;
+		it.applied = false;
+	}
+}
+
+
+void Universe::interpolateTransforms(float alpha) {
+	PROFILE_FUNCTION();
+	restoreSimulatedTransforms();
+	m_interpolated_entities.clear();
+	for (InterpolatedTransform& it : m_interpolated_transforms) {
+		if (!m_entities[it.entity.index].valid) continue;
+		Transform& tr = m_transforms[it.entity.index];
+		// moved outside of simulation, e.g. teleported in lateUpdate
+		if (memcmp(&tr, &it.simulated, sizeof(tr)) != 0) continue;
+
+		it.interpolated.pos = lerp(it.prev.pos, it.simulated.pos, alpha);
+		it.interpolated.rot = nlerp(it.prev.rot, it.simulated.rot, alpha);
+		it.interpolated.scale = lerp(it.prev.scale, it.simulated.scale, alpha);
+		it.applied = true;
+		tr = it.interpolated;
+		m_interpolated_entities.push(it.entity);
+	}
+	if (!m_interpolated_entities.empty()) m_entities_interpolated.invoke(m_interpolated_entities);
+}
+
+
+void Universe::restoreSimulatedTransforms() {
+	m_interpolated_entities.clear();
+	for (InterpolatedTransform& it : m_interpolated_transforms) {
+		if (!it.applied) continue;
+		it.applied = false;
+		Transform& tr = m_transforms[it.entity.index];
+		// set after interpolation, the new value wins
+		if (memcmp(&tr, &it.interpolated, sizeof(tr)) != 0) continue;
+		tr = it.simulated;
+		m_interpolated_entities.push(it.entity);
+	}
+	if (!m_interpolated_entities.empty()) m_entities_interpolated.invoke(m_interpolated_entities);
+}
+
+
+void Universe::enableJournal(bool enable) {
+	m_journal_enabled = enable;
+	if (!enable) m_journal.clear();
+}
+
+
+void Universe::trimJournal(u32 generation) {
+	u32 first = 0;
+	while (first < (u32)m_journal.size() && m_journal[first].generation < generation) ++first;
+	if (first == 0) return;
+	const u32 count = m_journal.size() - first;
+	if (count > 0) memmove(m_journal.begin(), m_journal.begin() + first, count * sizeof(JournalRecord));
+	m_journal.resize(count);
+}
+
+
+void Universe::journal(JournalRecord::Type type, EntityRef entity, ComponentType cmp_type, u32 property) {
+	if (!m_journal_enabled) return;
+	JournalRecord& rec = m_journal.emplace();
+	rec.type = type;
+	rec.cmp_type = cmp_type;
+	rec.generation = m_journal_generation;
+	rec.entity = entity;
+	rec.property = property;
+}
+
+
+void Universe::journalTransformed(EntityRef entity) {
+	if (!m_journal_enabled) return;
+	// one record per entity and generation
+	EntityData& data = m_entities[entity.index];
+	if (data.journal_transformed == m_journal_generation + 1) return;
+	data.journal_transformed = m_journal_generation + 1;
+	journal(JournalRecord::Type::TRANSFORMED, entity);
+}
+
+
+void Universe::journalPropertyChanged(EntityRef entity, ComponentType type, const char* property_name) {
+	if (!m_journal_enabled) return;
+	const u32 property = crc32(property_name);
+	// the same property set several times in one frame, e.g. dragged in the editor
+	if (!m_journal.empty()) {
+		const JournalRecord& last = m_journal.back();
+		if (last.type == JournalRecord::Type::PROPERTY_CHANGED && last.generation == m_journal_generation
+			&& last.entity == entity && last.cmp_type == type && last.property == property)
+		{
+			return;
+		}
+	}
+	journal(JournalRecord::Type::PROPERTY_CHANGED, entity, type, property);
+}
+
+
 void Universe::transformEntity(EntityRef entity, bool update_local)
 {
+	if (m_deferred_transforms > 0) {
+		markTransformDirty(entity, update_local);
+		return;
+	}
+
 	const int hierarchy_idx = m_entities[entity.index].hierarchy;
+	journalTransformed(entity);
 	m_entity_moved.invoke(entity);
 	if (hierarchy_idx >= 0) {
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -163,8 +512,20 @@ bool Universe::hasEntity(EntityRef entity) const
 }
 
 
+void Universe::enableEntity(EntityRef entity, bool enable)
+{
+	EntityData& data = m_entities[entity.index];
+	ASSERT(data.valid);
+	if (data.enabled == enable) return;
+	data.enabled = enable;
+	m_entity_enabled.invoke(entity, enable);
+}
+
+
 void Universe::setTransformKeepChildren(EntityRef entity, const Transform& transform)
 {
+	// children's transforms must be up to date
+	flushTransforms();
 	Transform& tmp = m_transforms[entity.index];
 	tmp = transform;
 	
@@ -334,11 +695,16 @@ void Universe::emplaceEntity(EntityRef entity)
 	tr.pos = DVec3(0, 0, 0);
 	tr.rot.set(0, 0, 0, 1);
 	tr.scale = 1;
+	if (entity.index < m_prev_transforms.size()) m_prev_transforms[entity.index].scale = -1;
 	data.name = -1;
 	data.hierarchy = -1;
 	data.components = 0;
 	data.valid = true;
+	data.enabled = true;
+	data.dirty_transform = 0;
+	data.journal_transformed = 0;
 
+	journal(JournalRecord::Type::ENTITY_CREATED, entity);
 	m_entity_created.invoke(entity);
 }
 
@@ -365,10 +731,16 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 	tr->pos = position;
 	tr->rot = rotation;
 	tr->scale = 1;
+	// not interpolated, there's no previous transform
+	if (entity.index < m_prev_transforms.size()) m_prev_transforms[entity.index].scale = -1;
 	data->name = -1;
 	data->hierarchy = -1;
 	data->components = 0;
 	data->valid = true;
+	data->enabled = true;
+	data->dirty_transform = 0;
+	data->journal_transformed = 0;
+	journal(JournalRecord::Type::ENTITY_CREATED, entity);
 	m_entity_created.invoke(entity);
 
 	return entity;
@@ -377,6 +749,7 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 
 void Universe::destroyEntity(EntityRef entity)
 {
+	flushTransforms();
 	EntityData& entity_data = m_entities[entity.index];
 	ASSERT(entity_data.valid);
 	for (EntityPtr first_child = getFirstChild(entity); first_child.isValid(); first_child = getFirstChild(entity))
@@ -418,6 +791,7 @@ void Universe::destroyEntity(EntityRef entity)
 	}
 
 	m_first_free_slot = entity.index;
+	journal(JournalRecord::Type::ENTITY_DESTROYED, entity);
 	m_entity_destroyed.invoke(entity);
 }
 
@@ -480,12 +854,15 @@ bool Universe::isDescendant(EntityRef ancestor, EntityRef descendant) const
 
 void Universe::setParent(EntityPtr new_parent, EntityRef child)
 {
+	flushTransforms();
+
 	bool would_create_cycle = new_parent.isValid() && isDescendant(child, (EntityRef)new_parent);
 	if (would_create_cycle)
 	{
 		logError("Hierarchy can not contains a cycle.");
 		return;
 	}
+	++m_hierarchy_version;
 
 	auto collectGarbage = [this](EntityRef entity) {
 		Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
@@ -560,6 +937,8 @@ void Universe::setParent(EntityPtr new_parent, EntityRef child)
 	{
 		if (child_idx >= 0) collectGarbage(child);
 	}
+
+	if (m_flat_hierarchy_enabled) updateFlatSubtree(child);
 }
 
 
@@ -570,6 +949,12 @@ void Universe::updateGlobalTransform(EntityRef entity)
 	Transform parent_tr = getTransform((EntityRef)h.parent);
 	
 	Transform new_tr = parent_tr * h.local_transform;
+	if (m_deferred_transforms > 0) {
+		// keep local, parent can be dirty too
+		m_transforms[entity.index] = new_tr;
+		markTransformDirty(entity, false);
+		return;
+	}
 	setTransform(entity, new_tr);
 }
 
@@ -651,13 +1036,23 @@ void Universe::serialize(OutputMemoryStream& serializer)
 {
 	serializer.write((u32)m_entities.size());
 
+	u32 count = 0;
+	for (const EntityData& data : m_entities) {
+		if (data.valid) ++count;
+	}
+	// entities and transforms are separate blocks, so they can be read in one go
+	serializer.write(count);
 	for (u32 i = 0, c = m_entities.size(); i < c; ++i) {
-		if (!m_entities[i].valid) continue;
-		const EntityRef e = {(i32)i};
-		serializer.write(e);
-		serializer.write(m_transforms[i]);
+		if (m_entities[i].valid) serializer.write(EntityRef{(i32)i});
+	}
+	if (count == m_entities.size()) {
+		if (count > 0) serializer.write(&m_transforms[0], m_transforms.byte_size());
+	}
+	else {
+		for (u32 i = 0, c = m_entities.size(); i < c; ++i) {
+			if (m_entities[i].valid) serializer.write(m_transforms[i]);
+		}
 	}
-	serializer.write(INVALID_ENTITY);
 
 	serializer.write((u32)m_names.size());
 	for (const EntityName& name : m_names) {
@@ -669,29 +1064,226 @@ void Universe::serialize(OutputMemoryStream& serializer)
 	if (!m_hierarchy.empty()) serializer.write(&m_hierarchy[0], m_hierarchy.byte_size());
 }
 
+template <typename T>
+static void writeArray(OutputMemoryStream& blob, const Array<T>& array) {
+	blob.write(array.size());
+	blob.write(array.begin(), array.byte_size());
+}
+
+template <typename T>
+static void readArray(InputMemoryStream& blob, Array<T>& array) {
+	array.resize(blob.read<u32>());
+	blob.read(array.begin(), array.byte_size());
+}
+
+void Universe::saveSnapshot(OutputMemoryStream& blob) {
+	PROFILE_FUNCTION();
+	ASSERT(m_deferred_transforms == 0);
+	restoreSimulatedTransforms();
+
+	blob.write(SNAPSHOT_MAGIC);
+	blob.write(UniverseSnapshotVersion::LAST);
+	blob.write(m_scenes.size());
+	writeArray(blob, m_entities);
+	writeArray(blob, m_transforms);
+	writeArray(blob, m_hierarchy);
+	writeArray(blob, m_names);
+	blob.write(m_first_free_slot);
+
+	SnapshotLayout layout(m_allocator);
+	for (UniquePtr<IScene>& scene : m_scenes) {
+		layout.entries.clear();
+		const bool registered = scene->registerSnapshot(layout);
+		blob.write(registered);
+		if (!registered) {
+			scene->serialize(blob);
+			continue;
+		}
+
+		for (const SnapshotLayout::Entry& e : layout.entries) {
+			if (!e.get_count) {
+				blob.write(e.ptr, e.size);
+				continue;
+			}
+			const u32 count = e.get_count(e.ptr);
+			blob.write(count);
+			blob.write(e.get_data(e.ptr), u64(count) * e.size);
+		}
+		scene->serializeSnapshot(blob);
+	}
+}
+
+void Universe::destroySceneComponents(IScene& scene) {
+	u64 mask = 0;
+	for (u32 i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i) {
+		if (m_component_type_map[i].scene == &scene) mask |= (u64)1 << i;
+	}
+	if (mask == 0) return;
+
+	for (i32 i = 0, c = m_entities.size(); i < c; ++i) {
+		if (!m_entities[i].valid) continue;
+		for (u32 t = 0; t < ComponentType::MAX_TYPES_COUNT; ++t) {
+			const u64 bit = (u64)1 << t;
+			if ((mask & bit) == 0 || (m_entities[i].components & bit) == 0) continue;
+			m_component_type_map[t].destroy(&scene, EntityRef{i});
+		}
+	}
+}
+
+bool Universe::restoreSnapshot(InputMemoryStream& blob) {
+	PROFILE_FUNCTION();
+	ASSERT(m_deferred_transforms == 0);
+	if (blob.read<u32>() != SNAPSHOT_MAGIC) {
+		logError("Invalid universe snapshot");
+		return false;
+	}
+	if (blob.read<UniverseSnapshotVersion>() != UniverseSnapshotVersion::LAST) {
+		logError("Unsupported universe snapshot version");
+		return false;
+	}
+	if (blob.read<u32>() != (u32)m_scenes.size()) {
+		logError("Universe snapshot was made with different scenes");
+		return false;
+	}
+
+	const bool journal_enabled = m_journal_enabled;
+	m_journal_enabled = false;
+	m_interpolated_transforms.clear();
+	m_prev_transforms.clear();
+
+	// while the universe is still in the current state
+	SnapshotLayout layout(m_allocator);
+	for (UniquePtr<IScene>& scene : m_scenes) {
+		layout.entries.clear();
+		if (!scene->registerSnapshot(layout)) destroySceneComponents(*scene.get());
+	}
+
+	readArray(blob, m_entities);
+	readArray(blob, m_transforms);
+	readArray(blob, m_hierarchy);
+	readArray(blob, m_names);
+	blob.read(m_first_free_slot);
+	m_dirty_transforms.clear();
+	if (m_flat_hierarchy_enabled) rebuildFlatHierarchy();
+	++m_hierarchy_version;
+
+	EntityMap identity(m_allocator);
+	identity.reserve(m_entities.size());
+	for (i32 i = 0, c = m_entities.size(); i < c; ++i) identity.set(EntityRef{i}, EntityRef{i});
+
+	for (UniquePtr<IScene>& scene : m_scenes) {
+		layout.entries.clear();
+		const bool registered = scene->registerSnapshot(layout);
+		if (blob.read<bool>() != registered) {
+			logError("Universe snapshot does not match scene ", scene->getPlugin().getName());
+			m_journal_enabled = journal_enabled;
+			return false;
+		}
+		if (!registered) {
+			scene->deserialize(blob, identity, scene->getVersion());
+			continue;
+		}
+
+		for (const SnapshotLayout::Entry& e : layout.entries) {
+			if (!e.get_count) {
+				blob.read(e.ptr, e.size);
+				continue;
+			}
+			const u32 count = blob.read<u32>();
+			e.resize(e.ptr, count);
+			blob.read(e.get_data(e.ptr), u64(count) * e.size);
+		}
+		scene->deserializeSnapshot(blob);
+	}
+
+	m_journal_enabled = journal_enabled;
+	return true;
+}
+
 void Universe::setName(const char* name) { 
 	copyString(m_name, name);
 }
 
-void Universe::deserialize(InputMemoryStream& serializer, EntityMap& entity_map)
+// returns base offset if source entities were dense and got mapped to a contiguous range, -1 otherwise
+i32 Universe::deserializeEntities(InputMemoryStream& serializer, EntityMap& entity_map, SerializedEngineVersion version)
 {
+	if (version < SerializedEngineVersion::CHUNKED) {
+		for (EntityPtr e = serializer.read<EntityPtr>(); e.isValid(); e = serializer.read<EntityPtr>()) {
+			EntityRef orig = (EntityRef)e;
+			const EntityRef new_e = createEntity({0, 0, 0}, {0, 0, 0, 1});
+			entity_map.set(orig, new_e);
+			serializer.read(m_transforms[new_e.index]);
+		}
+		return -1;
+	}
+
+	u32 count;
+	serializer.read(count);
+	const u8* src = (const u8*)serializer.skip(count * sizeof(EntityRef));
+	const u8* transforms = (const u8*)serializer.skip(count * sizeof(Transform));
+
+	bool dense = true;
+	for (u32 i = 0; i < count && dense; ++i) {
+		EntityRef e;
+		memcpy(&e, src + i * sizeof(EntityRef), sizeof(e));
+		dense = e.index == (i32)i;
+	}
+
+	if (!dense) {
+		for (u32 i = 0; i < count; ++i) {
+			EntityRef orig;
+			memcpy(&orig, src + i * sizeof(EntityRef), sizeof(orig));
+			const EntityRef new_e = createEntity({0, 0, 0}, {0, 0, 0, 1});
+			entity_map.set(orig, new_e);
+			memcpy(&m_transforms[new_e.index], transforms + i * sizeof(Transform), sizeof(Transform));
+		}
+		return -1;
+	}
+
+	// new entities are appended as one block, free slots are left for later createEntity calls
+	const i32 base = m_entities.size();
+	m_entities.resize(base + count);
+	m_transforms.resize(base + count);
+	if (count > 0) memcpy(&m_transforms[base], transforms, count * sizeof(Transform));
+	entity_map.reserve(count);
+	for (u32 i = 0; i < count; ++i) {
+		EntityData& data = m_entities[base + i];
+		data.name = -1;
+		data.hierarchy = -1;
+		data.components = 0;
+		data.valid = true;
+		data.enabled = true;
+		data.dirty_transform = 0;
+		data.journal_transformed = 0;
+		entity_map.set(EntityRef{(i32)i}, EntityRef{base + (i32)i});
+	}
+	for (u32 i = 0; i < count; ++i) {
+		journal(JournalRecord::Type::ENTITY_CREATED, EntityRef{base + (i32)i});
+		m_entity_created.invoke(EntityRef{base + (i32)i});
+	}
+	return base;
+}
+
+void Universe::deserialize(InputMemoryStream& serializer, EntityMap& entity_map, SerializedEngineVersion version)
+{
+	PROFILE_FUNCTION();
 	u32 to_reserve;
 	serializer.read(to_reserve);
 	entity_map.reserve(to_reserve);
 
-	for (EntityPtr e = serializer.read<EntityPtr>(); e.isValid(); e = serializer.read<EntityPtr>()) {
-		EntityRef orig = (EntityRef)e;
-		const EntityRef new_e = createEntity({0, 0, 0}, {0, 0, 0, 1});
-		entity_map.set(orig, new_e);
-		serializer.read(m_transforms[new_e.index]);
-	}
+	const i32 base = deserializeEntities(serializer, entity_map, version);
+
+	auto relocate = [&](EntityPtr e) -> EntityPtr {
+		if (base < 0) return entity_map.get(e);
+		return e.isValid() ? EntityPtr{e.index + base} : e;
+	};
 
 	u32 count;
 	serializer.read(count);
 	for (u32 i = 0; i < count; ++i) {
 		EntityName& name = m_names.emplace();
 		serializer.read(name.entity);
-		name.entity = entity_map.get(name.entity);
+		name.entity = (EntityRef)relocate(name.entity);
 		copyString(name.name, serializer.readString());
 		m_entities[name.entity.index].name = m_names.size() - 1;
 	}
@@ -699,17 +1291,19 @@ void Universe::deserialize(InputMemoryStream& serializer, EntityMap& entity_map)
 	serializer.read(count);
 	const u32 old_count = m_hierarchy.size();
 	m_hierarchy.resize(count + old_count);
+	++m_hierarchy_version;
 	if (count > 0) {
 		serializer.read(&m_hierarchy[old_count], sizeof(m_hierarchy[0]) * count);
 
 		for (u32 i = old_count; i < count + old_count; ++i) {
-			m_hierarchy[i].entity = entity_map.get(m_hierarchy[i].entity);
-			m_hierarchy[i].first_child = entity_map.get(m_hierarchy[i].first_child);
-			m_hierarchy[i].next_sibling = entity_map.get(m_hierarchy[i].next_sibling);
-			m_hierarchy[i].parent = entity_map.get(m_hierarchy[i].parent);
+			m_hierarchy[i].entity = (EntityRef)relocate(m_hierarchy[i].entity);
+			m_hierarchy[i].first_child = relocate(m_hierarchy[i].first_child);
+			m_hierarchy[i].next_sibling = relocate(m_hierarchy[i].next_sibling);
+			m_hierarchy[i].parent = relocate(m_hierarchy[i].parent);
 			m_entities[m_hierarchy[i].entity.index].hierarchy = i;
 		}
 	}
+	if (m_flat_hierarchy_enabled) rebuildFlatHierarchy();
 }
 
 
@@ -785,6 +1379,7 @@ void Universe::onComponentDestroyed(EntityRef entity, ComponentType component_ty
 	mask &= ~((u64)1 << component_type.index);
 	ASSERT(old_mask != mask);
 	m_entities[entity.index].components = mask;
+	journal(JournalRecord::Type::COMPONENT_DESTROYED, entity, component_type);
 	m_component_destroyed.invoke(ComponentUID(entity, component_type, scene));
 }
 
@@ -797,6 +1392,17 @@ void Universe::createComponent(ComponentType type, EntityRef entity)
 }
 
 
+void Universe::createComponents(ComponentType type, Span<const EntityRef> entities)
+{
+	const ComponentTypeEntry& entry = m_component_type_map[type.index];
+	if (entry.create_bulk) {
+		entry.create_bulk(entry.scene, entities);
+		return;
+	}
+	for (EntityRef e : entities) entry.create(entry.scene, e);
+}
+
+
 void Universe::destroyComponent(EntityRef entity, ComponentType type)
 {
 	IScene* scene = m_component_type_map[type.index].scene;
@@ -805,12 +1411,68 @@ void Universe::destroyComponent(EntityRef entity, ComponentType type)
 }
 
 
+void Universe::beginDeferredComponents(Span<IScene* const> scenes)
+{
+	ASSERT(m_deferred_component_scenes.empty());
+	for (IScene* scene : scenes) m_deferred_component_scenes.push(scene);
+}
+
+
+void Universe::endDeferredComponents()
+{
+	// cleared first, so the calls below are not deferred again
+	Array<IScene*> scenes(static_cast<Array<IScene*>&&>(m_deferred_component_scenes));
+	for (IScene* scene : scenes) {
+		for (const DeferredComponents& cmps : m_deferred_components) {
+			if (cmps.scene != scene) continue;
+			if (cmps.bulk) {
+				onComponentsCreated(Span<const EntityRef>(&m_deferred_entities[cmps.from], cmps.count), cmps.type, scene);
+			}
+			else {
+				onComponentCreated(m_deferred_entities[cmps.from], cmps.type, scene);
+			}
+		}
+	}
+	m_deferred_components.clear();
+	m_deferred_entities.clear();
+}
+
+
+bool Universe::deferComponents(Span<const EntityRef> entities, ComponentType component_type, IScene* scene, bool bulk)
+{
+	// the list does not change while the scenes are deserialized, so it can be read without the lock
+	if (m_deferred_component_scenes.empty() || m_deferred_component_scenes.indexOf(scene) < 0) return false;
+
+	MutexGuard lock(m_deferred_components_mutex);
+	m_deferred_components.push({scene, component_type, (u32)m_deferred_entities.size(), entities.length(), bulk});
+	for (EntityRef e : entities) m_deferred_entities.push(e);
+	return true;
+}
+
+
 void Universe::onComponentCreated(EntityRef entity, ComponentType component_type, IScene* scene)
 {
+	if (deferComponents(Span<const EntityRef>(&entity, 1), component_type, scene, false)) return;
+
 	ComponentUID cmp(entity, component_type, scene);
 	m_entities[entity.index].components |= (u64)1 << component_type.index;
+	journal(JournalRecord::Type::COMPONENT_ADDED, entity, component_type);
 	m_component_added.invoke(cmp);
 }
 
 
+void Universe::onComponentsCreated(Span<const EntityRef> entities, ComponentType component_type, IScene* scene)
+{
+	if (deferComponents(entities, component_type, scene, true)) return;
+
+	const u64 bit = (u64)1 << component_type.index;
+	for (EntityRef e : entities) {
+		m_entities[e.index].components |= bit;
+		journal(JournalRecord::Type::COMPONENT_ADDED, e, component_type);
+	}
+	m_components_added.invoke(entities, component_type, scene);
+	for (EntityRef e : entities) m_component_added.invoke(ComponentUID(e, component_type, scene));
+}
+
+
 } // namespace Lumix
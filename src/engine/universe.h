@@ -5,6 +5,7 @@
 #include "engine/delegate_list.h"
 #include "engine/lumix.h"
 #include "engine/math.h"
+#include "engine/sync.h"
 
 
 namespace Lumix {
@@ -12,6 +13,47 @@ namespace Lumix {
 struct ComponentUID;
 struct IScene;
 
+enum class UniverseSnapshotVersion : u32 {
+	FIRST,
+
+	LAST
+};
+
+// trivially copyable state of a scene, which is copied into snapshots with memcpy, see IScene::registerSnapshot
+struct LUMIX_ENGINE_API SnapshotLayout {
+	struct Entry {
+		void* ptr;
+		u32 size; // block size or array element size
+		// arrays only
+		u32 (*get_count)(void* array);
+		void* (*get_data)(void* array);
+		void (*resize)(void* array, u32 count);
+	};
+
+	explicit SnapshotLayout(IAllocator& allocator) : entries(allocator) {}
+
+	void addBlock(void* ptr, u32 size) { entries.push({ptr, size, nullptr, nullptr, nullptr}); }
+
+	template <typename T> void addArray(Array<T>& array) {
+		static_assert(__is_trivially_copyable(T), "snapshot arrays must be trivially copyable");
+		Entry& e = entries.emplace();
+		e.ptr = &array;
+		e.size = sizeof(T);
+		e.get_count = [](void* a) { return ((Array<T>*)a)->size(); };
+		e.get_data = [](void* a) -> void* { return ((Array<T>*)a)->begin(); };
+		e.resize = [](void* a, u32 count) { ((Array<T>*)a)->resize(count); };
+	}
+
+	Array<Entry> entries;
+};
+
+enum class SerializedEngineVersion : u32 {
+	BASE,
+	CHUNKED, // size prefixed scene blocks, entities stored as contiguous blocks
+
+	LATEST
+};
+
 struct LUMIX_ENGINE_API EntityMap {
 	EntityMap(IAllocator& allocator);
 	void reserve(u32 count);
@@ -40,6 +82,27 @@ struct LUMIX_ENGINE_API Universe {
 			};
 		};
 		bool valid;
+		bool enabled; // disabled entities are inert, scenes do not render or simulate them
+		u8 dirty_transform; // see beginDeferredTransforms
+		u32 journal_transformed; // journal generation + 1 of the last TRANSFORMED record, 0 if none
+	};
+
+	// compact record of a change, see enableJournal
+	struct JournalRecord {
+		enum class Type : u8 {
+			ENTITY_CREATED,
+			ENTITY_DESTROYED,
+			TRANSFORMED,
+			COMPONENT_ADDED,
+			COMPONENT_DESTROYED,
+			PROPERTY_CHANGED
+		};
+
+		Type type;
+		ComponentType cmp_type; // component and property records
+		u32 generation;
+		EntityRef entity;
+		u32 property; // crc32 of property name, property records; name of the dynamic property, e.g. a script property
 	};
 
 	explicit Universe(struct Engine& engine, IAllocator& allocator);
@@ -51,9 +114,16 @@ struct LUMIX_ENGINE_API Universe {
 	EntityRef createEntity(const DVec3& position, const Quat& rotation);
 	void destroyEntity(EntityRef entity);
 	void createComponent(ComponentType type, EntityRef entity);
+	// one call to the scene if it registered bulk creator, see reflection::builder::bulk_create
+	void createComponents(ComponentType type, Span<const EntityRef> entities);
 	void destroyComponent(EntityRef entity, ComponentType type);
 	void onComponentCreated(EntityRef entity, ComponentType component_type, IScene* scene);
+	void onComponentsCreated(Span<const EntityRef> entities, ComponentType component_type, IScene* scene);
 	void onComponentDestroyed(EntityRef entity, ComponentType component_type, IScene* scene);
+	// onComponent(s)Created of `scenes` only record the components, so the scenes can deserialize on worker threads;
+	// endDeferredComponents sets the masks and invokes the callbacks, in order of `scenes`, on the calling thread
+	void beginDeferredComponents(Span<IScene* const> scenes);
+	void endDeferredComponents();
     u64 getComponentsMask(EntityRef entity) const;
     bool hasComponent(EntityRef entity, ComponentType component_type) const;
 	ComponentUID getComponent(EntityRef entity, ComponentType type) const;
@@ -67,6 +137,9 @@ struct LUMIX_ENGINE_API Universe {
 	EntityPtr findByName(EntityPtr parent, const char* name);
 	void setEntityName(EntityRef entity, const char* name);
 	bool hasEntity(EntityRef entity) const;
+	// does not propagate to children, entityEnabled is invoked only if the state changed
+	void enableEntity(EntityRef entity, bool enable);
+	bool isEntityEnabled(EntityRef entity) const { return m_entities[entity.index].enabled; }
 
 	bool isDescendant(EntityRef ancestor, EntityRef descendant) const;
 	EntityPtr getParent(EntityRef entity) const;
@@ -75,6 +148,8 @@ struct LUMIX_ENGINE_API Universe {
 	Transform getLocalTransform(EntityRef entity) const;
 	float getLocalScale(EntityRef entity) const;
 	void setParent(EntityPtr parent, EntityRef child);
+	// changed whenever any parent or sibling link changes
+	u32 getHierarchyVersion() const { return m_hierarchy_version; }
 	void setLocalPosition(EntityRef entity, const DVec3& pos);
 	void setLocalRotation(EntityRef entity, const Quat& rot);
 	void setLocalTransform(EntityRef entity, const Transform& transform);
@@ -93,17 +168,62 @@ struct LUMIX_ENGINE_API Universe {
 	float getScale(EntityRef entity) const;
 	const DVec3& getPosition(EntityRef entity) const;
 	const Quat& getRotation(EntityRef entity) const;
+	// set* functions only write the entity's own transform and mark it dirty, hierarchy is updated
+	// and entitiesTransformed invoked in flushTransforms, called when the outermost scope ends;
+	// children of dirty entities have stale transforms until then; set* can be called from multiple threads
+	void beginDeferredTransforms();
+	void endDeferredTransforms();
+	void flushTransforms();
+	// keeps parented entities also in arrays sorted by depth, so big flushes are linear sweeps instead of tree walks
+	void enableFlatHierarchy(bool enable);
+	bool isFlatHierarchyEnabled() const { return m_flat_hierarchy_enabled; }
+	// fixed rate simulation, see Engine::setSimulationRate
+	// beginSimulationStep restores simulated transforms and remembers them as the previous state,
+	// endSimulationStep collects entities moved by the step
+	void beginSimulationStep();
+	void endSimulationStep();
+	// entities moved by the last step, and not moved since then, get transforms interpolated between the last two steps,
+	// only entitiesInterpolated is invoked; the engine interpolates at the end of the frame, right before rendering,
+	// and restores simulated transforms at the beginning of the next one, so lateUpdate works with simulated transforms
+	// transforms set since interpolation are not restored
+	void interpolateTransforms(float alpha);
+	void restoreSimulatedTransforms();
+
+	// fast in-memory copy of the whole state, e.g. to restart game mode or for rollback in netcode
+	// scenes, which implement IScene::registerSnapshot, are restored by memcpy and without any callbacks,
+	// components of other scenes are destroyed and deserialized; the journal does not record the restore
+	void saveSnapshot(struct OutputMemoryStream& blob);
+	bool restoreSnapshot(struct InputMemoryStream& blob);
 	const char* getName() const { return m_name; }
 	void setName(const char* name);
 
 	DelegateList<void(EntityRef)>& entityCreated() { return m_entity_created; }
 	DelegateList<void(EntityRef)>& entityTransformed() { return m_entity_moved; }
+	// instead of entityTransformed for entities moved in deferred mode, each entity is there once
+	DelegateList<void(Span<const EntityRef>)>& entitiesTransformed() { return m_entities_moved; }
+	// transforms written by interpolateTransforms and restoreSimulatedTransforms, only for presentation, e.g. culling;
+	// simulation must not react to these, entitiesTransformed is not invoked for them
+	DelegateList<void(Span<const EntityRef>)>& entitiesInterpolated() { return m_entities_interpolated; }
 	DelegateList<void(EntityRef)>& entityDestroyed() { return m_entity_destroyed; }
+	DelegateList<void(EntityRef, bool)>& entityEnabled() { return m_entity_enabled; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentAdded() { return m_component_added; }
+	// once per createComponents, componentAdded is invoked for each entity too
+	DelegateList<void(Span<const EntityRef>, ComponentType, IScene*)>& componentsAdded() { return m_components_added; }
+
+	// change journal, records are stamped with generation, which the engine advances every frame
+	// consumers (autosave, replication) remember the last generation they have seen and read newer records
+	void enableJournal(bool enable);
+	bool isJournalEnabled() const { return m_journal_enabled; }
+	u32 getJournalGeneration() const { return m_journal_generation; }
+	void advanceJournal() { ++m_journal_generation; }
+	Span<const JournalRecord> getJournal() const { return m_journal; }
+	// removes records older than `generation`
+	void trimJournal(u32 generation);
+	void journalPropertyChanged(EntityRef entity, ComponentType type, const char* property_name);
 
 	void serialize(struct OutputMemoryStream& serializer);
-	void deserialize(struct InputMemoryStream& serializer, EntityMap& entity_map);
+	void deserialize(struct InputMemoryStream& serializer, EntityMap& entity_map, SerializedEngineVersion version);
 
 	IScene* getScene(ComponentType type) const;
 	IScene* getScene(u32 hash) const;
@@ -111,8 +231,19 @@ struct LUMIX_ENGINE_API Universe {
 	void addScene(UniquePtr<IScene>&& scene);
 
 private:
+	i32 deserializeEntities(struct InputMemoryStream& serializer, EntityMap& entity_map, SerializedEngineVersion version);
+	void journal(JournalRecord::Type type, EntityRef entity, ComponentType cmp_type = {-1}, u32 property = 0);
+	void journalTransformed(EntityRef entity);
 	void transformEntity(EntityRef entity, bool update_local);
 	void updateGlobalTransform(EntityRef entity);
+	void markTransformDirty(EntityRef entity, bool update_local);
+	bool deferComponents(Span<const EntityRef> entities, ComponentType component_type, IScene* scene, bool bulk);
+	void flushSubtree(EntityRef entity, Array<EntityRef>& moved);
+	void flushFlat();
+	void rebuildFlatHierarchy();
+	void destroySceneComponents(IScene& scene);
+	void updateFlatSubtree(EntityRef entity);
+	void removeFromFlat(EntityRef entity);
 
 	struct Hierarchy {
 		EntityRef entity;
@@ -123,6 +254,26 @@ private:
 		Transform local_transform;
 	};
 
+	// entity in a flat hierarchy level, level `i` contains entities with `i + 1` ancestors
+	struct FlatNode {
+		EntityRef entity;
+		EntityRef parent;
+	};
+
+	struct FlatLocation {
+		i32 level = -1;
+		i32 idx = -1;
+	};
+
+	// components created by one onComponent(s)Created call, see beginDeferredComponents
+	struct DeferredComponents {
+		IScene* scene;
+		ComponentType type;
+		u32 from; // in m_deferred_entities
+		u32 count;
+		bool bulk;
+	};
+
 	struct EntityName {
 		EntityRef entity;
 		char name[ENTITY_NAME_MAX_LENGTH];
@@ -131,6 +282,7 @@ private:
 	struct ComponentTypeEntry {
 		IScene* scene = nullptr;
 		void (*create)(IScene*, EntityRef);
+		void (*create_bulk)(IScene*, Span<const EntityRef>) = nullptr;
 		void (*destroy)(IScene*, EntityRef);
 	};
 
@@ -144,11 +296,44 @@ private:
 	Array<EntityName> m_names;
 	DelegateList<void(EntityRef)> m_entity_created;
 	DelegateList<void(EntityRef)> m_entity_moved;
+	DelegateList<void(Span<const EntityRef>)> m_entities_moved;
+	DelegateList<void(Span<const EntityRef>)> m_entities_interpolated;
 	DelegateList<void(EntityRef)> m_entity_destroyed;
+	DelegateList<void(EntityRef, bool)> m_entity_enabled;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
+	DelegateList<void(Span<const EntityRef>, ComponentType, IScene*)> m_components_added;
 	int m_first_free_slot;
 	char m_name[64];
+	i32 m_deferred_transforms = 0;
+	Mutex m_dirty_mutex;
+	Array<EntityRef> m_dirty_transforms;
+	Array<EntityRef> m_moved_entities;
+	Array<IScene*> m_deferred_component_scenes;
+	Mutex m_deferred_components_mutex;
+	Array<DeferredComponents> m_deferred_components;
+	Array<EntityRef> m_deferred_entities;
+	bool m_flat_hierarchy_enabled = false;
+	u32 m_hierarchy_version = 0;
+	u32 m_flat_count = 0;
+	Array<Array<FlatNode>> m_flat_levels;
+	Array<FlatLocation> m_flat_locations; // indexed by entity
+	bool m_journal_enabled = false;
+	u32 m_journal_generation = 0;
+	Array<JournalRecord> m_journal;
+
+	struct InterpolatedTransform {
+		EntityRef entity;
+		Transform prev;
+		Transform simulated;
+		Transform interpolated;
+		bool applied;
+	};
+
+	// transforms at the beginning of the last simulation step, indexed by entity
+	Array<Transform> m_prev_transforms;
+	Array<InterpolatedTransform> m_interpolated_transforms;
+	Array<EntityRef> m_interpolated_entities; // passed to m_entities_interpolated
 };
 
 struct LUMIX_ENGINE_API ComponentUID final {
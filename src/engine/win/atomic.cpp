@@ -25,6 +25,11 @@ i32 atomicAdd(i32 volatile* addend, i32 value)
 	return _InterlockedExchangeAdd((volatile long*)addend, value);
 }
 
+i64 atomicAdd(i64 volatile* addend, i64 value)
+{
+	return _InterlockedExchangeAdd64((volatile long long*)addend, value);
+}
+
 i32 atomicSubtract(i32 volatile* addend, i32 value)
 {
 	return _InterlockedExchangeAdd((volatile long*)addend, -value);
@@ -56,4 +61,18 @@ LUMIX_ENGINE_API void memoryBarrier()
 }
 
 
+LUMIX_ENGINE_API void writeBarrier()
+{
+	// x86 does not reorder stores with other stores, keep the compiler from doing it
+	_ReadWriteBarrier();
+}
+
+
+LUMIX_ENGINE_API void readBarrier()
+{
+	// x86 does not reorder loads with other loads
+	_ReadWriteBarrier();
+}
+
+
 } // namespace Lumix
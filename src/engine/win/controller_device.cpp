@@ -116,10 +116,13 @@ void ControllerDevice::frame(float dt)
 	{
 		if (g_controllers.connected[i] || i == g_controllers.last_checked)
 		{
-			auto status = g_controllers.get_state(i, &g_controllers.states[i]);
+			// states of connected devices are owned by their update(), which can run on the polling thread
+			XINPUT_STATE state;
+			auto status = g_controllers.get_state(i, &state);
 			g_controllers.connected[i] = status == ERROR_SUCCESS;
 			if (g_controllers.connected[i] && !g_controllers.devices[i])
 			{
+				g_controllers.states[i] = state;
 				XInputControllerDevice* new_device = LUMIX_NEW(g_controllers.input->getAllocator(), XInputControllerDevice);
 				new_device->type = InputSystem::Device::CONTROLLER;
 				new_device->index = i;
@@ -19,7 +19,8 @@ void initThread(FiberProc proc, Handle* out)
 
 Handle create(int stack_size, FiberProc proc, void* parameter)
 {
-	return CreateFiber(stack_size, proc, parameter);
+	// reserve whole stack but commit on demand, the OS puts a guard page below the committed part
+	return CreateFiberEx(0, stack_size, 0, proc, parameter);
 }
 
 
@@ -0,0 +1,110 @@
+#include "engine/crt.h"
+#include "engine/math.h"
+#include "engine/network.h"
+#define WIN32_LEAN_AND_MEAN
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+
+namespace Lumix::os {
+
+
+static bool initWinsock() {
+	static bool initialized = []() {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return initialized;
+}
+
+// 0 might be a valid SOCKET, so handles are offset by one
+static SOCKET toSOCKET(Socket* socket) { return SOCKET((uintptr)socket - 1); }
+static Socket* toSocket(SOCKET s) { return s == INVALID_SOCKET ? nullptr : (Socket*)(uintptr)(s + 1); }
+
+
+Socket* listenTCP(u16 port) {
+	if (!initWinsock()) return nullptr;
+	const SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET) return nullptr;
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(s, 1) != 0) {
+		closesocket(s);
+		return nullptr;
+	}
+	return toSocket(s);
+}
+
+
+Socket* acceptTCP(Socket* listener) {
+	const SOCKET s = ::accept(toSOCKET(listener), nullptr, nullptr);
+	if (s == INVALID_SOCKET) return nullptr;
+	const BOOL no_delay = TRUE;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+	return toSocket(s);
+}
+
+
+Socket* connectTCP(const char* host, u16 port) {
+	if (!initWinsock()) return nullptr;
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* info;
+	if (getaddrinfo(host, nullptr, &hints, &info) != 0) return nullptr;
+
+	sockaddr_in addr;
+	memcpy(&addr, info->ai_addr, sizeof(addr));
+	freeaddrinfo(info);
+	addr.sin_port = htons(port);
+
+	const SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET) return nullptr;
+	if (::connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		closesocket(s);
+		return nullptr;
+	}
+	const BOOL no_delay = TRUE;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+	return toSocket(s);
+}
+
+
+bool send(Socket* socket, const void* data, u64 size) {
+	const char* iter = (const char*)data;
+	while (size > 0) {
+		const int sent = ::send(toSOCKET(socket), iter, (int)minimum(size, (u64)1 << 30), 0);
+		if (sent <= 0) return false;
+		iter += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+
+bool receive(Socket* socket, void* data, u64 size) {
+	char* iter = (char*)data;
+	while (size > 0) {
+		const int received = ::recv(toSOCKET(socket), iter, (int)minimum(size, (u64)1 << 30), 0);
+		if (received <= 0) return false;
+		iter += received;
+		size -= received;
+	}
+	return true;
+}
+
+
+void close(Socket* socket) {
+	if (!socket) return;
+	shutdown(toSOCKET(socket), SD_BOTH);
+	closesocket(toSOCKET(socket));
+}
+
+
+} // namespace Lumix::os
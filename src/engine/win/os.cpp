@@ -187,6 +187,68 @@ bool InputFile::seek(u64 pos)
 }
 
 
+bool InputFile::readAt(u64 offset, void* data, u64 size)
+{
+	ASSERT(INVALID_HANDLE_VALUE != m_handle);
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = DWORD(offset & 0xffFFffFF);
+	overlapped.OffsetHigh = DWORD(offset >> 32);
+	DWORD readed = 0;
+	BOOL success = ::ReadFile((HANDLE)m_handle, data, (DWORD)size, &readed, &overlapped);
+	return success && size == readed;
+}
+
+
+void MappedFile::operator=(MappedFile&& rhs)
+{
+	if (this == &rhs) return;
+	close();
+	m_data = rhs.m_data;
+	m_size = rhs.m_size;
+	m_copy_on_write = rhs.m_copy_on_write;
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+}
+
+
+bool MappedFile::open(const char* path, bool copy_on_write)
+{
+	ASSERT(!m_data);
+	HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		::CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = ::CreateFileMappingA(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+	::CloseHandle(file);
+	if (!mapping) return false;
+
+	// view keeps the mapping alive
+	void* mem = ::MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	::CloseHandle(mapping);
+	if (!mem) return false;
+
+	m_data = (const u8*)mem;
+	m_size = (u64)size.QuadPart;
+	m_copy_on_write = copy_on_write;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (m_data) {
+		::UnmapViewOfFile(m_data);
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
+
+
 static void fromWChar(Span<char> out, const WCHAR* in)
 {
 	const WCHAR* c = in;
@@ -247,6 +309,51 @@ u32 getCPUsCount() {
 	return num;
 }
 
+u32 getCPUCores(Span<CPUCore> cores) {
+	// enough for hundreds of logical processors
+	alignas(8) u8 buffer[64 * 1024];
+	DWORD size = sizeof(buffer);
+	if (!GetLogicalProcessorInformationEx(RelationAll, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)buffer, &size)) return 0;
+
+	// only processor group 0 is used, affinity masks are 64bit
+	u32 count = 0;
+	for (DWORD offset = 0; offset < size;) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(buffer + offset);
+		offset += info->Size;
+		if (info->Relationship != RelationProcessorCore) continue;
+		if (info->Processor.GroupMask[0].Group != 0) continue;
+		if (count == cores.length()) break;
+		cores[count].mask = info->Processor.GroupMask[0].Mask;
+		// 0 on non-hybrid CPUs, higher is faster
+		cores[count].performance = info->Processor.EfficiencyClass;
+		cores[count].cache_domain = 0;
+		++count;
+	}
+
+	u8 domain = 0;
+	for (DWORD offset = 0; offset < size;) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(buffer + offset);
+		offset += info->Size;
+		if (info->Relationship != RelationCache || info->Cache.Level != 3) continue;
+		if (info->Cache.GroupMask.Group != 0) continue;
+		for (u32 i = 0; i < count; ++i) {
+			if (cores[i].mask & info->Cache.GroupMask.Mask) cores[i].cache_domain = domain;
+		}
+		++domain;
+	}
+
+	for (u32 i = 1; i < count; ++i) {
+		const CPUCore core = cores[i];
+		u32 j = i;
+		while (j > 0 && (cores[j - 1].performance < core.performance || (cores[j - 1].performance == core.performance && cores[j - 1].cache_domain > core.cache_domain))) {
+			cores[j] = cores[j - 1];
+			--j;
+		}
+		cores[j] = core;
+	}
+	return count;
+}
+
 void logInfo() {
 	DWORD dwVersion = 0;
 	DWORD dwMajorVersion = 0;
@@ -832,6 +939,30 @@ void memRelease(void* ptr, size_t size) {
 	VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+size_t getLargeMemPageSize() {
+	return GetLargePageMinimum();
+}
+
+void* memReserveLargePages(size_t size) {
+	static bool has_privilege = [](){
+		// large pages need SeLockMemoryPrivilege, which the user must have been granted
+		HANDLE token;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+		TOKEN_PRIVILEGES tp = {};
+		tp.PrivilegeCount = 1;
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		bool res = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+			&& AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr)
+			&& GetLastError() == ERROR_SUCCESS;
+		CloseHandle(token);
+		return res;
+	}();
+	const size_t page_size = GetLargePageMinimum();
+	if (!has_privilege || page_size == 0) return nullptr;
+	ASSERT(size % page_size == 0);
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+}
+
 struct FileIterator
 {
 	HANDLE handle;
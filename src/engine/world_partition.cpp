@@ -0,0 +1,263 @@
+#include "engine/crt.h"
+#include "engine/engine.h"
+#include "engine/log.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
+#include "engine/universe.h"
+#include "world_partition.h"
+
+namespace Lumix
+{
+
+
+// in-flight reads are limited, so closer cells are not stuck behind far ones in file system queue
+static constexpr u32 MAX_PENDING_REQUESTS = 4;
+
+
+WorldPartition::Cell::Cell(WorldPartition& partition, IAllocator& allocator)
+	: partition(partition)
+	, data(allocator)
+	, entities(allocator)
+{}
+
+
+void WorldPartition::Cell::fileLoaded(u64 size, const u8* mem, bool success) {
+	handle = FileSystem::AsyncHandle::invalid();
+	--partition.m_pending_count;
+	if (!success) {
+		logError("Failed to load world partition cell ", coord.x, ", ", coord.y);
+		state = State::FAILED;
+		return;
+	}
+	data.resize(size);
+	memcpy(data.getMutableData(), mem, size);
+	state = State::LOADED;
+}
+
+
+WorldPartition::WorldPartition(Engine& engine, Universe& universe, IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_engine(engine)
+	, m_universe(universe)
+	, m_cells(allocator)
+{}
+
+
+WorldPartition::~WorldPartition() {
+	FileSystem& fs = m_engine.getFileSystem();
+	for (Cell* cell : m_cells) {
+		if (cell->handle.isValid()) fs.cancel(cell->handle);
+		LUMIX_DELETE(m_allocator, cell);
+	}
+}
+
+
+IVec2 WorldPartition::getCellCoord(const DVec3& pos, float cell_size) {
+	return IVec2((i32)floor(pos.x / cell_size), (i32)floor(pos.z / cell_size));
+}
+
+
+void WorldPartition::getCellPath(Span<char> out, const char* dir, const IVec2& coord) {
+	copyString(out, StaticString<LUMIX_MAX_PATH>(dir, "/", coord.x, "_", coord.y, ".wpc"));
+}
+
+
+void WorldPartition::getHeaderPath(Span<char> out, const char* dir) {
+	copyString(out, StaticString<LUMIX_MAX_PATH>(dir, "/partition.wpt"));
+}
+
+
+void WorldPartition::getGlobalPath(Span<char> out, const char* dir) {
+	copyString(out, StaticString<LUMIX_MAX_PATH>(dir, "/global.wpc"));
+}
+
+
+bool WorldPartition::load(const char* dir) {
+	ASSERT(m_cells.empty());
+	char path[LUMIX_MAX_PATH];
+	getHeaderPath(Span(path), dir);
+	OutputMemoryStream content(m_allocator);
+	if (!m_engine.getFileSystem().getContentSync(Path(path), content)) {
+		logError("Failed to read ", path);
+		return false;
+	}
+
+	InputMemoryStream blob(content);
+	Header header;
+	blob.read(header);
+	if (header.magic != MAGIC) {
+		logError("Wrong or corrupted file ", path);
+		return false;
+	}
+	if (header.version > WorldPartitionVersion::LAST) {
+		logError("Unsupported version of ", path);
+		return false;
+	}
+	if (header.cell_size <= 0) {
+		logError("Invalid cell size in ", path);
+		return false;
+	}
+
+	m_dir = dir;
+	m_cell_size = header.cell_size;
+	m_cells.reserve(header.cells_count);
+	for (u32 i = 0; i < header.cells_count; ++i) {
+		Cell* cell = LUMIX_NEW(m_allocator, Cell)(*this, m_allocator);
+		blob.read(cell->coord);
+		m_cells.push(cell);
+	}
+
+	getGlobalPath(Span(path), dir);
+	FileSystem& fs = m_engine.getFileSystem();
+	if (!fs.fileExists(path)) return true;
+
+	content.clear();
+	if (!fs.getContentSync(Path(path), content)) {
+		logError("Failed to read ", path);
+		return false;
+	}
+	InputMemoryStream global_blob(content);
+	EntityMap entity_map(m_allocator);
+	if (!m_engine.deserialize(m_universe, global_blob, entity_map)) {
+		logError("Failed to deserialize ", path);
+		return false;
+	}
+	return true;
+}
+
+
+void WorldPartition::setStreamingSource(u32 idx, const DVec3& pos) {
+	ASSERT(idx < MAX_STREAMING_SOURCES);
+	m_sources[idx].pos = pos;
+	m_sources[idx].active = true;
+}
+
+
+void WorldPartition::removeStreamingSource(u32 idx) {
+	ASSERT(idx < MAX_STREAMING_SOURCES);
+	m_sources[idx].active = false;
+}
+
+
+void WorldPartition::setRadius(float load_radius, float unload_radius) {
+	// unload radius is bigger so cells on the border do not load and unload every frame
+	m_load_radius = load_radius;
+	m_unload_radius = maximum(load_radius, unload_radius);
+}
+
+
+u32 WorldPartition::getInstantiatedCellsCount() const {
+	u32 count = 0;
+	for (const Cell* cell : m_cells) {
+		if (cell->state == Cell::State::INSTANTIATED) ++count;
+	}
+	return count;
+}
+
+
+void WorldPartition::instantiate(Cell& cell) {
+	PROFILE_FUNCTION();
+	ASSERT(cell.state == Cell::State::LOADED);
+	EntityMap entity_map(m_allocator);
+	InputMemoryStream blob(cell.data);
+	if (!m_engine.deserialize(m_universe, blob, entity_map)) {
+		logError("Failed to instantiate world partition cell ", cell.coord.x, ", ", cell.coord.y);
+	}
+	cell.entities.reserve(entity_map.m_map.size());
+	for (EntityPtr e : entity_map.m_map) {
+		if (e.isValid()) cell.entities.push((EntityRef)e);
+	}
+	cell.data.clear();
+	cell.state = Cell::State::INSTANTIATED;
+}
+
+
+void WorldPartition::unload(Cell& cell) {
+	switch (cell.state) {
+		case Cell::State::LOADING:
+			m_engine.getFileSystem().cancel(cell.handle);
+			cell.handle = FileSystem::AsyncHandle::invalid();
+			--m_pending_count;
+			break;
+		case Cell::State::INSTANTIATED:
+			for (EntityRef e : cell.entities) m_universe.destroyEntity(e);
+			cell.entities.clear();
+			break;
+		case Cell::State::LOADED: cell.data.clear(); break;
+		case Cell::State::UNLOADED:
+		case Cell::State::FAILED: return;
+	}
+	cell.state = Cell::State::UNLOADED;
+}
+
+
+void WorldPartition::unloadAll() {
+	for (Cell* cell : m_cells) unload(*cell);
+}
+
+
+void WorldPartition::update() {
+	PROFILE_FUNCTION();
+	if (m_cells.empty()) return;
+
+	bool any_source = false;
+	for (const StreamingSource& src : m_sources) any_source = any_source || src.active;
+	if (!any_source) return;
+
+	// distance from the closest source to the closest point of the cell
+	for (Cell* cell : m_cells) {
+		const DVec2 min(cell->coord.x * (double)m_cell_size, cell->coord.y * (double)m_cell_size);
+		const DVec2 max = min + DVec2(m_cell_size, m_cell_size);
+		cell->sq_dist = DBL_MAX;
+		for (const StreamingSource& src : m_sources) {
+			if (!src.active) continue;
+			const double dx = maximum(min.x - src.pos.x, 0.0, src.pos.x - max.x);
+			const double dz = maximum(min.y - src.pos.z, 0.0, src.pos.z - max.y);
+			cell->sq_dist = minimum(cell->sq_dist, dx * dx + dz * dz);
+		}
+	}
+
+	const double sq_unload = (double)m_unload_radius * m_unload_radius;
+	const double sq_load = (double)m_load_radius * m_load_radius;
+
+	Array<Cell*> candidates(m_allocator);
+	for (Cell* cell : m_cells) {
+		if (cell->sq_dist > sq_unload) {
+			unload(*cell);
+		}
+		else if (cell->sq_dist <= sq_load && (cell->state == Cell::State::UNLOADED || cell->state == Cell::State::LOADED)) {
+			candidates.push(cell);
+		}
+	}
+	if (candidates.empty()) return;
+
+	qsort(candidates.begin(), candidates.size(), sizeof(candidates[0]), [](const void* a, const void* b) {
+		const double da = (*(const Cell**)a)->sq_dist;
+		const double db = (*(const Cell**)b)->sq_dist;
+		return da < db ? -1 : (da > db ? 1 : 0);
+	});
+
+	FileSystem& fs = m_engine.getFileSystem();
+	const double sq_high_priority = sq_load * 0.25;
+	for (Cell* cell : candidates) {
+		if (cell->state != Cell::State::UNLOADED) continue;
+		if (m_pending_count >= MAX_PENDING_REQUESTS) break;
+		char path[LUMIX_MAX_PATH];
+		getCellPath(Span(path), m_dir, cell->coord);
+		const FileSystem::Priority priority = cell->sq_dist < sq_high_priority ? FileSystem::Priority::HIGH : FileSystem::Priority::NORMAL;
+		cell->state = Cell::State::LOADING;
+		++m_pending_count;
+		cell->handle = fs.getContent(Path(path), makeDelegate<&Cell::fileLoaded>(cell), priority);
+	}
+
+	// at least one cell per frame, so streaming always progresses
+	os::Timer timer;
+	for (Cell* cell : candidates) {
+		if (cell->state != Cell::State::LOADED) continue;
+		instantiate(*cell);
+		if (timer.getTimeSinceStart() * 1000 > m_time_budget_ms) break;
+	}
+}
+
+
+} // namespace Lumix
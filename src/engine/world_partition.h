@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/file_system.h"
+#include "engine/math.h"
+#include "engine/path.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+enum class WorldPartitionVersion : u32
+{
+	FIRST,
+
+	LAST
+};
+
+
+// universe split into square cells on XZ plane, each cell is a universe blob (see Engine::serialize) in its own file
+// cells are loaded asynchronously around streaming sources, closer cells first
+// loaded cells are instantiated in main thread, limited by time budget per frame
+struct LUMIX_ENGINE_API WorldPartition
+{
+	static constexpr u32 MAGIC = '_WPT';
+	static constexpr u32 MAX_STREAMING_SOURCES = 8;
+
+	struct Header {
+		u32 magic = MAGIC;
+		WorldPartitionVersion version = WorldPartitionVersion::LAST;
+		float cell_size;
+		u32 cells_count;
+		// followed by `cells_count` IVec2 cell coordinates
+	};
+
+	WorldPartition(struct Engine& engine, struct Universe& universe, IAllocator& allocator);
+	~WorldPartition();
+
+	// `dir` contains partition.wpt, cell files and optional global.wpc, which is instantiated immediately and never unloaded
+	bool load(const char* dir);
+	// destroys entities of all instantiated cells
+	void unloadAll();
+	void update();
+
+	void setStreamingSource(u32 idx, const DVec3& pos);
+	void removeStreamingSource(u32 idx);
+	// cells closer than `load_radius` are loaded, cells further than `unload_radius` are unloaded
+	void setRadius(float load_radius, float unload_radius);
+	void setTimeBudget(float ms) { m_time_budget_ms = ms; }
+	float getCellSize() const { return m_cell_size; }
+	u32 getCellsCount() const { return m_cells.size(); }
+	u32 getInstantiatedCellsCount() const;
+
+	static IVec2 getCellCoord(const DVec3& pos, float cell_size);
+	static void getCellPath(Span<char> out, const char* dir, const IVec2& coord);
+	static void getHeaderPath(Span<char> out, const char* dir);
+	static void getGlobalPath(Span<char> out, const char* dir);
+
+private:
+	struct Cell {
+		Cell(WorldPartition& partition, IAllocator& allocator);
+		void fileLoaded(u64 size, const u8* mem, bool success);
+
+		enum class State : u8 {
+			UNLOADED,
+			LOADING,
+			LOADED,
+			INSTANTIATED,
+			FAILED
+		};
+
+		WorldPartition& partition;
+		IVec2 coord;
+		State state = State::UNLOADED;
+		FileSystem::AsyncHandle handle = FileSystem::AsyncHandle::invalid();
+		OutputMemoryStream data;
+		Array<EntityRef> entities;
+		double sq_dist = 0;
+	};
+
+	struct StreamingSource {
+		DVec3 pos;
+		bool active = false;
+	};
+
+	void instantiate(Cell& cell);
+	void unload(Cell& cell);
+
+	IAllocator& m_allocator;
+	Engine& m_engine;
+	Universe& m_universe;
+	StaticString<LUMIX_MAX_PATH> m_dir;
+	float m_cell_size = 0;
+	float m_load_radius = 256;
+	float m_unload_radius = 320;
+	float m_time_budget_ms = 2;
+	u32 m_pending_count = 0;
+	Array<Cell*> m_cells;
+	StreamingSource m_sources[MAX_STREAMING_SOURCES];
+};
+
+
+} // namespace Lumix
@@ -152,6 +152,68 @@ struct GUIRect
 	GUIText* text = nullptr;
 	GUIInputField* input_field = nullptr;
 	gpu::TextureHandle* render_target = nullptr;
+
+	// absolute rect on canvas of `layout_canvas_size`, see GUISceneImpl::getLayout
+	GUIScene::Rect layout;
+	Vec2 layout_canvas_size;
+	bool is_layout_valid = false;
+};
+
+
+// retained geometry of a canvas, rebuilt only when something in the canvas changes
+struct GUICanvasCache
+{
+	struct View
+	{
+		View(IAllocator& allocator) : draw(allocator) {}
+
+		Draw2D draw;
+		Vec2 size;
+		Vec2 atlas_size;
+		u32 atlas_version = 0;
+		u32 sprite_atlas_version = 0;
+		os::CursorType cursor_type = os::CursorType::UNDEFINED;
+		bool is_3d = false;
+		bool is_valid = false;
+	};
+
+	// enabled buttons with their computed rects, bucketed in a grid over the canvas
+	struct HitIndex
+	{
+		static constexpr u32 GRID_SIZE = 16;
+
+		struct Item
+		{
+			GUIScene::Rect rect;
+			EntityRef entity;
+		};
+
+		HitIndex(IAllocator& allocator) : items(allocator), cell_items(allocator) {}
+
+		// in tree order
+		Array<Item> items;
+		// indices to `items`, cell i is [cells[i], cells[i + 1])
+		Array<u32> cell_items;
+		u32 cells[GRID_SIZE * GRID_SIZE + 1];
+		Vec2 size;
+		bool is_valid = false;
+	};
+
+	GUICanvasCache(IAllocator& allocator)
+		: views{{allocator}, {allocator}}
+		, hit_index(allocator)
+	{}
+
+	// `layout_changed` is false if only the look changed, e.g. hover color
+	void invalidate(bool layout_changed = true) {
+		views[0].is_valid = false;
+		views[1].is_valid = false;
+		if (layout_changed) hit_index.is_valid = false;
+	}
+
+	// main and non-main (e.g. editor's scene view) rendering differ in hover state
+	View views[2];
+	HitIndex hit_index;
 };
 
 
@@ -168,8 +230,10 @@ struct GUISceneImpl final : GUIScene
 		, m_rects(allocator)
 		, m_buttons(allocator)
 		, m_canvas(allocator)
+		, m_canvas_cache(allocator)
+		, m_hit_candidates(allocator)
+		, m_hover_changes(allocator)
 		, m_rect_hovered(allocator)
-		, m_draw_2d(allocator)
 		, m_rect_hovered_out(allocator)
 		, m_rect_mouse_down(allocator)
 		, m_unhandled_mouse_button(allocator)
@@ -178,6 +242,7 @@ struct GUISceneImpl final : GUIScene
 		, m_canvas_size(800, 600)
 	{
 		m_font_manager = (FontManager*)system.getEngine().getResourceManager().get(FontResource::TYPE);
+		m_sprite_manager = (SpriteManager*)system.getEngine().getResourceManager().get(Sprite::TYPE);
 	}
 	
 	i32 getVersion() const override { return (i32)Version::LATEST; }
@@ -228,9 +293,11 @@ struct GUISceneImpl final : GUIScene
 		if (rect.image && rect.image->flags.isSet(GUIImage::IS_ENABLED))
 		{
 			const Color color = *img_color;
-			if (rect.image->sprite && rect.image->sprite->getTexture())
+			Sprite* sprite = rect.image->sprite;
+			if (sprite && (!sprite->getTexture() || !sprite->getTexture()->isReady())) m_cache_incomplete = true;
+			gpu::TextureHandle* draw_tex = sprite ? sprite->getDrawTexture() : nullptr;
+			if (draw_tex)
 			{
-				Sprite* sprite = rect.image->sprite;
 				Texture* tex = sprite->getTexture();
 				if (sprite->type == Sprite::PATCH9)
 				{
@@ -255,21 +322,21 @@ struct GUISceneImpl final : GUIScene
 						sprite->bottom / (float)tex->height
 					};
 
-					draw.addImage(&tex->handle, { l, t }, { pos.l, pos.t }, { 0, 0 }, { uvs.l, uvs.t }, color);
-					draw.addImage(&tex->handle, { pos.l, t }, { pos.r, pos.t }, { uvs.l, 0 }, { uvs.r, uvs.t }, color);
-					draw.addImage(&tex->handle, { pos.r, t }, { r, pos.t }, { uvs.r, 0 }, { 1, uvs.t }, color);
-
-					draw.addImage(&tex->handle, { l, pos.t }, { pos.l, pos.b }, { 0, uvs.t }, { uvs.l, uvs.b }, color);
-					draw.addImage(&tex->handle, { pos.l, pos.t }, { pos.r, pos.b }, { uvs.l, uvs.t }, { uvs.r, uvs.b }, color);
-					draw.addImage(&tex->handle, { pos.r, pos.t }, { r, pos.b }, { uvs.r, uvs.t }, { 1, uvs.b }, color);
-
-					draw.addImage(&tex->handle, { l, pos.b }, { pos.l, b }, { 0, uvs.b }, { uvs.l, 1 }, color);
-					draw.addImage(&tex->handle, { pos.l, pos.b }, { pos.r, b }, { uvs.l, uvs.b }, { uvs.r, 1 }, color);
-					draw.addImage(&tex->handle, { pos.r, pos.b }, { r, b }, { uvs.r, uvs.b }, { 1, 1 }, color);
+					const float us[] = { 0, uvs.l, uvs.r, 1 };
+					const float vs[] = { 0, uvs.t, uvs.b, 1 };
+					const float xs[] = { l, pos.l, pos.r, r };
+					const float ys[] = { t, pos.t, pos.b, b };
+					for (u32 j = 0; j < 3; ++j) {
+						for (u32 i = 0; i < 3; ++i) {
+							const Vec2 uv0 = sprite->mapUV({ us[i], vs[j] });
+							const Vec2 uv1 = sprite->mapUV({ us[i + 1], vs[j + 1] });
+							draw.addImage(draw_tex, { xs[i], ys[j] }, { xs[i + 1], ys[j + 1] }, uv0, uv1, color);
+						}
+					}
 				}
 				else
 				{
-					draw.addImage(&tex->handle, { l, t }, { r, b }, {0, 0}, {1, 1}, color);
+					draw.addImage(draw_tex, { l, t }, { r, b }, sprite->mapUV({ 0, 0 }), sprite->mapUV({ 1, 1 }), color);
 				}
 			}
 			else
@@ -285,6 +352,7 @@ struct GUISceneImpl final : GUIScene
 
 		if (rect.text) {
 			Font* font = rect.text->getFont();
+			if (!font && rect.text->getFontResource()) m_cache_incomplete = true;
 			if (font) {
 				const char* text_cstr = rect.text->text.c_str();
 				float ascender = getAscender(*font);
@@ -323,21 +391,112 @@ struct GUISceneImpl final : GUIScene
 
 	IVec2 getCursorPosition() override { return m_cursor_pos; }
 
-	void draw3D(GUICanvas& canvas, Pipeline& pipeline) {
-		m_draw_2d.clear({2, 2});
+	// invalidates cached geometry of the canvas containing `e`
+	void markDirty(EntityRef e, bool layout_changed = true) {
+		for (EntityPtr i = e; i.isValid(); i = m_universe.getParent((EntityRef)i)) {
+			auto iter = m_canvas_cache.find((EntityRef)i);
+			if (iter.isValid()) {
+				iter.value()->invalidate(layout_changed);
+				return;
+			}
+		}
+	}
 
-		EntityPtr child = m_universe.getFirstChild(canvas.entity);
-		while (child.isValid())
+	void setFocusedEntity(EntityPtr e) {
+		if (m_focused_entity.isValid() && m_universe.hasEntity((EntityRef)m_focused_entity)) markDirty((EntityRef)m_focused_entity, false);
+		m_focused_entity = e;
+	}
+
+	// there's no notification about reparenting
+	void checkHierarchyVersion() const {
+		if (m_hierarchy_version == m_universe.getHierarchyVersion()) return;
+		m_hierarchy_version = m_universe.getHierarchyVersion();
+		for (GUICanvasCache* cache : m_canvas_cache) cache->invalidate();
+		for (GUIRect* rect : m_rects) rect->is_layout_valid = false;
+	}
+
+	// `rect` and its descendants must recompute their layout
+	void invalidateLayout(GUIRect& rect) {
+		rect.is_layout_valid = false;
+		for (EntityPtr e = m_universe.getFirstChild(rect.entity); e.isValid(); e = m_universe.getNextSibling((EntityRef)e)) {
+			auto iter = m_rects.find((EntityRef)e);
+			// rects without rect parent are relative to the whole canvas
+			if (iter.isValid()) invalidateLayout(*iter.value());
+		}
+	}
+
+	void markLayoutDirty(EntityRef e) {
+		auto iter = m_rects.find(e);
+		if (iter.isValid()) invalidateLayout(*iter.value());
+		markDirty(e);
+	}
+
+	// absolute rect of `rect`, `parent_rect` must be the layout of its parent
+	// cached until anchors of the rect or its ancestors change, the hierarchy changes or the canvas is resized
+	static const Rect& getLayout(GUIRect& rect, const Rect& parent_rect, const Vec2& canvas_size) {
+		if (!rect.is_layout_valid || rect.layout_canvas_size != canvas_size) {
+			rect.layout = getRectOnCanvas(parent_rect, rect);
+			rect.layout_canvas_size = canvas_size;
+			rect.is_layout_valid = true;
+		}
+		return rect.layout;
+	}
+
+	GUICanvasCache& getCanvasCache(EntityRef canvas) {
+		auto iter = m_canvas_cache.find(canvas);
+		if (!iter.isValid()) iter = m_canvas_cache.insert(canvas, LUMIX_NEW(m_allocator, GUICanvasCache)(m_allocator));
+		return *iter.value();
+	}
+
+	// returns cached geometry of `canvas`, rebuilds it if anything changed since the last time
+	GUICanvasCache::View& getCanvasView(const GUICanvas& canvas, const Vec2& size, const Vec2& atlas_size, bool is_main) {
+		GUICanvasCache::View& view = getCanvasCache(canvas.entity).views[is_main ? 1 : 0];
+		const u32 atlas_version = m_font_manager->getAtlasVersion();
+		const u32 sprite_atlas_version = m_sprite_manager->m_atlas.getVersion();
+		if (view.is_valid
+			&& view.is_3d == canvas.is_3d
+			&& view.size == size
+			&& view.atlas_size == atlas_size
+			&& view.atlas_version == atlas_version
+			&& view.sprite_atlas_version == sprite_atlas_version)
 		{
-			auto iter = m_rects.find((EntityRef)child);
-			if (iter.isValid())
-			{
-				renderRect(*iter.value(), m_draw_2d, { 0, 0, canvas.virtual_size.x, canvas.virtual_size.y }, false);
+			return view;
+		}
+
+		view.draw.clear(atlas_size);
+		view.size = size;
+		view.atlas_size = atlas_size;
+		view.atlas_version = atlas_version;
+		view.sprite_atlas_version = sprite_atlas_version;
+		view.is_3d = canvas.is_3d;
+
+		// cursor requested by hovered buttons is replayed together with the geometry
+		const bool cursor_set = m_cursor_set;
+		const os::CursorType cursor_type = m_cursor_type;
+		m_cursor_set = false;
+		m_cache_incomplete = false;
+
+		if (canvas.is_3d) {
+			for (EntityPtr child = m_universe.getFirstChild(canvas.entity); child.isValid(); child = m_universe.getNextSibling((EntityRef)child)) {
+				auto rect_iter = m_rects.find((EntityRef)child);
+				if (rect_iter.isValid()) {
+					renderRect(*rect_iter.value(), view.draw, { 0, 0, size.x, size.y }, false);
+				}
+			}
+		}
+		else {
+			auto rect_iter = m_rects.find(canvas.entity);
+			if (rect_iter.isValid()) {
+				renderRect(*rect_iter.value(), view.draw, { 0, 0, size.x, size.y }, is_main);
 			}
-			child = m_universe.getNextSibling((EntityRef)child);
 		}
 
-		pipeline.render3DUI(canvas.entity, m_draw_2d, canvas.virtual_size, canvas.orient_to_camera);
+		view.cursor_type = m_cursor_set ? m_cursor_type : os::CursorType::UNDEFINED;
+		m_cursor_set = cursor_set;
+		m_cursor_type = cursor_type;
+		// something is still loading, try again next frame
+		view.is_valid = !m_cache_incomplete;
+		return view;
 	}
 
 	void render(Pipeline& pipeline, const Vec2& canvas_size, bool is_main) override {
@@ -346,15 +505,23 @@ struct GUISceneImpl final : GUIScene
 			m_cursor_type = os::CursorType::DEFAULT;
 			m_cursor_set = false;
 		}
+
+		checkHierarchyVersion();
+		// blinking text cursor
+		if (getInput(m_focused_entity)) markDirty((EntityRef)m_focused_entity, false);
+
+		Draw2D& draw = pipeline.getDraw2D();
 		for (GUICanvas& canvas : m_canvas) {
 			if (canvas.is_3d) {
-				draw3D(canvas, pipeline);
+				const GUICanvasCache::View& view = getCanvasView(canvas, canvas.virtual_size, {2, 2}, false);
+				pipeline.render3DUI(canvas.entity, view.draw, canvas.virtual_size, canvas.orient_to_camera);
 			}
 			else {
-				auto iter = m_rects.find(canvas.entity);
-				if (iter.isValid()) {
-					GUIRect* r = iter.value();
-					renderRect(*r, pipeline.getDraw2D(), {0, 0, canvas_size.x, canvas_size.y}, is_main);
+				const GUICanvasCache::View& view = getCanvasView(canvas, canvas_size, draw.getAtlasSize(), is_main);
+				draw.append(view.draw);
+				if (is_main && view.cursor_type != os::CursorType::UNDEFINED && !m_cursor_set) {
+					m_cursor_type = view.cursor_type;
+					m_cursor_set = true;
 				}
 			}
 		}
@@ -369,6 +536,7 @@ struct GUISceneImpl final : GUIScene
 	void setButtonHoveredColorRGBA(EntityRef entity, const Vec4& color) override
 	{
 		m_buttons[entity].hovered_color = RGBAVec4ToABGRu32(color);
+		markDirty(entity);
 	}
 
 	os::CursorType getButtonHoveredCursor(EntityRef entity) override {
@@ -377,9 +545,10 @@ struct GUISceneImpl final : GUIScene
 
 	void setButtonHoveredCursor(EntityRef entity, os::CursorType cursor) override {
 		m_buttons[entity].hovered_cursor = cursor;
+		markDirty(entity);
 	}
 
-	void enableImage(EntityRef entity, bool enable) override { m_rects[entity]->image->flags.set(GUIImage::IS_ENABLED, enable); }
+	void enableImage(EntityRef entity, bool enable) override { m_rects[entity]->image->flags.set(GUIImage::IS_ENABLED, enable); markDirty(entity); }
 	bool isImageEnabled(EntityRef entity) override { return m_rects[entity]->image->flags.isSet(GUIImage::IS_ENABLED); }
 
 
@@ -435,6 +604,7 @@ struct GUISceneImpl final : GUIScene
 		} else {
 			image->sprite = manager.load<Sprite>(path);
 		}
+		markDirty(entity);
 	}
 
 
@@ -442,6 +612,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIImage* image = m_rects[entity]->image;
 		image->color = RGBAVec4ToABGRu32(color);
+		markDirty(entity);
 	}
 
 
@@ -453,20 +624,13 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
-	EntityPtr getRectAt(const GUIRect& rect, const Vec2& pos, const Rect& parent_rect, EntityPtr limit) const
+	EntityPtr getRectAt(GUIRect& rect, const Vec2& pos, const Rect& parent_rect, const Vec2& canvas_size, EntityPtr limit) const
 	{
 		if (!rect.flags.isSet(GUIRect::IS_VALID)) return INVALID_ENTITY;
 		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return INVALID_ENTITY;
 		if (rect.entity.index == limit.index) return INVALID_ENTITY;
 
-		Rect r;
-		r.x = parent_rect.x + rect.left.points + parent_rect.w * rect.left.relative;
-		r.y = parent_rect.y + rect.top.points + parent_rect.h * rect.top.relative;
-		float right = parent_rect.x + rect.right.points + parent_rect.w * rect.right.relative;
-		float bottom = parent_rect.y + rect.bottom.points + parent_rect.h * rect.bottom.relative;
-
-		r.w = right - r.x;
-		r.h = bottom - r.y;
+		const Rect& r = getLayout(rect, parent_rect, canvas_size);
 
 		bool intersect = pos.x >= r.x && pos.y >= r.y && pos.x <= r.x + r.w && pos.y <= r.y + r.h;
 
@@ -476,7 +640,7 @@ struct GUISceneImpl final : GUIScene
 			if (!iter.isValid()) continue;
 
 			GUIRect* child_rect = iter.value();
-			EntityPtr entity = getRectAt(*child_rect, pos, r, limit);
+			EntityPtr entity = getRectAt(*child_rect, pos, r, canvas_size, limit);
 			if (entity.isValid()) return entity;
 		}
 
@@ -492,11 +656,12 @@ struct GUISceneImpl final : GUIScene
 
 	EntityPtr getRectAtEx(const Vec2& pos, const Vec2& canvas_size, EntityPtr limit) const override
 	{
+		checkHierarchyVersion();
 		for (const GUICanvas& canvas : m_canvas) {
 			auto iter = m_rects.find(canvas.entity);
 			if (iter.isValid()) {
-				const GUIRect* r = iter.value();
-				const EntityPtr e = getRectAt(*r, pos, { 0, 0, canvas_size.x, canvas_size.y }, limit);
+				GUIRect* r = iter.value();
+				const EntityPtr e = getRectAt(*r, pos, { 0, 0, canvas_size.x, canvas_size.y }, canvas_size, limit);
 				if (e.isValid()) return e;
 			}
 		}
@@ -527,45 +692,44 @@ struct GUISceneImpl final : GUIScene
 		auto iter = m_rects.find((EntityRef)entity);
 		if (!iter.isValid()) return { 0, 0, canvas_size.x, canvas_size.y };
 
-		EntityPtr parent = m_universe.getParent((EntityRef)entity);
-		Rect parent_rect = getRectEx(parent, canvas_size);
-		GUIRect* gui = m_rects[(EntityRef)entity];
-		float l = parent_rect.x + parent_rect.w * gui->left.relative + gui->left.points;
-		float r = parent_rect.x + parent_rect.w * gui->right.relative + gui->right.points;
-		float t = parent_rect.y + parent_rect.h * gui->top.relative + gui->top.points;
-		float b = parent_rect.y + parent_rect.h * gui->bottom.relative + gui->bottom.points;
+		checkHierarchyVersion();
+		GUIRect* gui = iter.value();
+		if (gui->is_layout_valid && gui->layout_canvas_size == canvas_size) return gui->layout;
 
-		return { l, t, r - l, b - t };
+		EntityPtr parent = m_universe.getParent((EntityRef)entity);
+		const Rect parent_rect = getRectEx(parent, canvas_size);
+		return getLayout(*gui, parent_rect, canvas_size);
 	}
 
-	void setRectClip(EntityRef entity, bool enable) override { m_rects[entity]->flags.set(GUIRect::IS_CLIP, enable); }
+	void setRectClip(EntityRef entity, bool enable) override { m_rects[entity]->flags.set(GUIRect::IS_CLIP, enable); markDirty(entity); }
 	bool getRectClip(EntityRef entity) override { return m_rects[entity]->flags.isSet(GUIRect::IS_CLIP); }
-	void enableRect(EntityRef entity, bool enable) override { return m_rects[entity]->flags.set(GUIRect::IS_ENABLED, enable); }
+	void enableRect(EntityRef entity, bool enable) override { m_rects[entity]->flags.set(GUIRect::IS_ENABLED, enable); markDirty(entity); }
 	bool isRectEnabled(EntityRef entity) override { return m_rects[entity]->flags.isSet(GUIRect::IS_ENABLED); }
 	float getRectLeftPoints(EntityRef entity) override { return m_rects[entity]->left.points; }
-	void setRectLeftPoints(EntityRef entity, float value) override { m_rects[entity]->left.points = value; }
+	void setRectLeftPoints(EntityRef entity, float value) override { m_rects[entity]->left.points = value; markLayoutDirty(entity); }
 	float getRectLeftRelative(EntityRef entity) override { return m_rects[entity]->left.relative; }
-	void setRectLeftRelative(EntityRef entity, float value) override { m_rects[entity]->left.relative = value; }
+	void setRectLeftRelative(EntityRef entity, float value) override { m_rects[entity]->left.relative = value; markLayoutDirty(entity); }
 
 	float getRectRightPoints(EntityRef entity) override { return m_rects[entity]->right.points; }
-	void setRectRightPoints(EntityRef entity, float value) override { m_rects[entity]->right.points = value; }
+	void setRectRightPoints(EntityRef entity, float value) override { m_rects[entity]->right.points = value; markLayoutDirty(entity); }
 	float getRectRightRelative(EntityRef entity) override { return m_rects[entity]->right.relative; }
-	void setRectRightRelative(EntityRef entity, float value) override { m_rects[entity]->right.relative = value; }
+	void setRectRightRelative(EntityRef entity, float value) override { m_rects[entity]->right.relative = value; markLayoutDirty(entity); }
 
 	float getRectTopPoints(EntityRef entity) override { return m_rects[entity]->top.points; }
-	void setRectTopPoints(EntityRef entity, float value) override { m_rects[entity]->top.points = value; }
+	void setRectTopPoints(EntityRef entity, float value) override { m_rects[entity]->top.points = value; markLayoutDirty(entity); }
 	float getRectTopRelative(EntityRef entity) override { return m_rects[entity]->top.relative; }
-	void setRectTopRelative(EntityRef entity, float value) override { m_rects[entity]->top.relative = value; }
+	void setRectTopRelative(EntityRef entity, float value) override { m_rects[entity]->top.relative = value; markLayoutDirty(entity); }
 
 	float getRectBottomPoints(EntityRef entity) override { return m_rects[entity]->bottom.points; }
-	void setRectBottomPoints(EntityRef entity, float value) override { m_rects[entity]->bottom.points = value; }
+	void setRectBottomPoints(EntityRef entity, float value) override { m_rects[entity]->bottom.points = value; markLayoutDirty(entity); }
 	float getRectBottomRelative(EntityRef entity) override { return m_rects[entity]->bottom.relative; }
-	void setRectBottomRelative(EntityRef entity, float value) override { m_rects[entity]->bottom.relative = value; }
+	void setRectBottomRelative(EntityRef entity, float value) override { m_rects[entity]->bottom.relative = value; markLayoutDirty(entity); }
 
 	void setTextFontSize(EntityRef entity, int value) override
 	{
 		GUIText* gui_text = m_rects[entity]->text;
 		gui_text->setFontSize(value);
+		markDirty(entity);
 	}
 	
 	
@@ -587,6 +751,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIText* gui_text = m_rects[entity]->text;
 		gui_text->color = RGBAVec4ToABGRu32(color);
+		markDirty(entity);
 	}
 
 
@@ -602,6 +767,7 @@ struct GUISceneImpl final : GUIScene
 		GUIText* gui_text = m_rects[entity]->text;
 		FontResource* res = path.isEmpty() ? nullptr : m_font_manager->getOwner().load<FontResource>(path);
 		gui_text->setFontResource(res);
+		markDirty(entity);
 	}
 
 
@@ -619,12 +785,14 @@ struct GUISceneImpl final : GUIScene
 	void setTextVAlign(EntityRef entity, TextVAlign align) override {
 		GUIText* gui_text = m_rects[entity]->text;
 		gui_text->vertical_align = align;
+		markDirty(entity);
 	}
 
 	void setTextHAlign(EntityRef entity, TextHAlign value) override
 	{
 		GUIText* gui_text = m_rects[entity]->text;
 		gui_text->horizontal_align = value;
+		markDirty(entity);
 	}
 
 
@@ -632,6 +800,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIText* gui_text = m_rects[entity]->text;
 		gui_text->text = value;
+		markDirty(entity);
 	}
 
 
@@ -655,45 +824,143 @@ struct GUISceneImpl final : GUIScene
 		}
 		m_rects.clear();
 		m_buttons.clear();
+		for (GUICanvasCache* cache : m_canvas_cache) LUMIX_DELETE(m_allocator, cache);
+		m_canvas_cache.clear();
 	}
 
 
-	void hoverOut(const GUIRect& rect)
+	void hoverOut(EntityRef e)
 	{
-		auto iter = m_buttons.find(rect.entity);
+		auto iter = m_buttons.find(e);
 		if (!iter.isValid()) return;
-		m_rect_hovered_out.invoke(rect.entity);
+		m_rect_hovered_out.invoke(e);
 	}
 
 
-	void hover(const GUIRect& rect)
+	void hover(EntityRef e)
 	{
-		auto iter = m_buttons.find(rect.entity);
+		auto iter = m_buttons.find(e);
 		if (!iter.isValid()) return;
-		m_rect_hovered.invoke(rect.entity);
+		m_rect_hovered.invoke(e);
 	}
 
 
-	void handleMouseAxisEvent(const Rect& parent_rect, GUIRect& rect, const Vec2& mouse_pos, const Vec2& prev_mouse_pos)
+	// rects of disabled rects' subtrees are not included, same as in input handling
+	void collectHitItems(const Rect& parent_rect, GUIRect& rect, GUICanvasCache::HitIndex& index)
 	{
 		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return;
 
-		const Rect& r = getRectOnCanvas(parent_rect, rect);
-
-		const bool is = contains(r, mouse_pos);
-		const bool was = contains(r, prev_mouse_pos);
-		if (is != was && m_buttons.find(rect.entity).isValid()) {
-			is  ? hover(rect) : hoverOut(rect);
-		}
-
-
+		const Rect& r = getLayout(rect, parent_rect, index.size);
+		if (m_buttons.find(rect.entity).isValid()) index.items.push({r, rect.entity});
 
 		for (EntityPtr e = m_universe.getFirstChild(rect.entity); e.isValid(); e = m_universe.getNextSibling((EntityRef)e))
 		{
 			auto iter = m_rects.find((EntityRef)e);
 			if (!iter.isValid()) continue;
-			handleMouseAxisEvent(r, *iter.value(), mouse_pos, prev_mouse_pos);
+			collectHitItems(r, *iter.value(), index);
+		}
+	}
+
+
+	static u32 getHitCell(float v, float size)
+	{
+		using HitIndex = GUICanvasCache::HitIndex;
+		if (size <= 0) return 0;
+		return (u32)clamp(i32(v / size * HitIndex::GRID_SIZE), 0, i32(HitIndex::GRID_SIZE - 1));
+	}
+
+
+	// rebuilt only if the layout changed
+	const GUICanvasCache::HitIndex& getHitIndex(const GUICanvas& canvas, const Vec2& size)
+	{
+		using HitIndex = GUICanvasCache::HitIndex;
+		HitIndex& index = getCanvasCache(canvas.entity).hit_index;
+		if (index.is_valid && index.size == size) return index;
+
+		index.is_valid = true;
+		index.size = size;
+		index.items.clear();
+		auto iter = m_rects.find(canvas.entity);
+		if (iter.isValid()) collectHitItems({0, 0, size.x, size.y}, *iter.value(), index);
+
+		// counting sort of items into cells
+		memset(index.cells, 0, sizeof(index.cells));
+		for (u32 pass = 0; pass < 2; ++pass) {
+			if (pass == 1) {
+				u32 offset = 0;
+				for (u32& c : index.cells) {
+					const u32 count = c;
+					c = offset;
+					offset += count;
+				}
+				index.cell_items.resize(offset);
+			}
+			for (u32 i = 0, c = index.items.size(); i < c; ++i) {
+				const Rect& r = index.items[i].rect;
+				const u32 x0 = getHitCell(r.x, size.x);
+				const u32 x1 = getHitCell(r.x + r.w, size.x);
+				const u32 y0 = getHitCell(r.y, size.y);
+				const u32 y1 = getHitCell(r.y + r.h, size.y);
+				for (u32 y = y0; y <= y1; ++y) {
+					for (u32 x = x0; x <= x1; ++x) {
+						u32& cell = index.cells[y * HitIndex::GRID_SIZE + x];
+						if (pass == 1) index.cell_items[cell] = i;
+						++cell;
+					}
+				}
+			}
 		}
+		// cells were advanced to their ends in the second pass, shift them back to starts
+		for (u32 i = lengthOf(index.cells) - 1; i > 0; --i) index.cells[i] = index.cells[i - 1];
+		index.cells[0] = 0;
+		return index;
+	}
+
+
+	static int compareU32(const void* a, const void* b)
+	{
+		const u32 ua = *(const u32*)a;
+		const u32 ub = *(const u32*)b;
+		return ua < ub ? -1 : (ua > ub ? 1 : 0);
+	}
+
+
+	// only buttons in grid cells under the current and the previous position are checked
+	void handleMouseAxisEvent(const GUICanvas& canvas, const Vec2& mouse_pos, const Vec2& prev_mouse_pos)
+	{
+		using HitIndex = GUICanvasCache::HitIndex;
+		const HitIndex& index = getHitIndex(canvas, m_canvas_size);
+		if (index.items.empty()) return;
+
+		m_hit_candidates.clear();
+		auto addCell = [&](const Vec2& p){
+			const u32 cell = getHitCell(p.y, index.size.y) * HitIndex::GRID_SIZE + getHitCell(p.x, index.size.x);
+			for (u32 i = index.cells[cell]; i < index.cells[cell + 1]; ++i) m_hit_candidates.push(index.cell_items[i]);
+		};
+		addCell(mouse_pos);
+		addCell(prev_mouse_pos);
+		// tree order, without duplicates
+		qsort(m_hit_candidates.begin(), m_hit_candidates.size(), sizeof(u32), &compareU32);
+
+		for (u32 i = 0, c = m_hit_candidates.size(); i < c; ++i) {
+			if (i > 0 && m_hit_candidates[i] == m_hit_candidates[i - 1]) continue;
+			const HitIndex::Item& item = index.items[m_hit_candidates[i]];
+			const bool is = contains(item.rect, mouse_pos);
+			const bool was = contains(item.rect, prev_mouse_pos);
+			if (is != was) m_hover_changes.push({item.entity, is});
+		}
+	}
+
+
+	// called after all canvases are checked, callbacks can change the gui
+	void applyHoverChanges()
+	{
+		for (const HoverChange& change : m_hover_changes) {
+			if (!m_universe.hasEntity(change.entity)) continue;
+			markDirty(change.entity, false);
+			change.is_hovered ? hover(change.entity) : hoverOut(change.entity);
+		}
+		m_hover_changes.clear();
 	}
 
 
@@ -713,13 +980,13 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
-	bool handleMouseButtonEvent(const Rect& parent_rect, const GUIRect& rect, const InputSystem::Event& event)
+	bool handleMouseButtonEvent(const Rect& parent_rect, GUIRect& rect, const InputSystem::Event& event)
 	{
 		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return false;
 		const bool is_up = !event.data.button.down;
 
 		Vec2 pos(event.data.button.x, event.data.button.y);
-		const Rect& r = getRectOnCanvas(parent_rect, rect);
+		const Rect& r = getLayout(rect, parent_rect, m_canvas_size);
 		bool handled = false;
 		
 		if (contains(r, pos)) {
@@ -731,7 +998,7 @@ struct GUISceneImpl final : GUIScene
 					handled = true;
 					if (is_up && isButtonDown(rect.entity))
 					{
-						m_focused_entity = INVALID_ENTITY;
+						setFocusedEntity(INVALID_ENTITY);
 						m_button_clicked.invoke(rect.entity);
 					}
 					if (!is_up)
@@ -750,7 +1017,7 @@ struct GUISceneImpl final : GUIScene
 			
 				if (rect.input_field && is_up) {
 					handled = true;
-					m_focused_entity = rect.entity;
+					setFocusedEntity(rect.entity);
 					if (rect.text)
 					{
 						rect.input_field->cursor = rect.text->text.length();
@@ -851,13 +1118,11 @@ struct GUISceneImpl final : GUIScene
 					{
 						Vec2 pos(event.data.axis.x_abs, event.data.axis.y_abs);
 						m_cursor_pos = IVec2((i32)pos.x, (i32)pos.y);
+						checkHierarchyVersion();
 						for (const GUICanvas& canvas : m_canvas) {
-							auto iter = m_rects.find(canvas.entity);
-							if (iter.isValid()) {
-								GUIRect* r = iter.value();
-								handleMouseAxisEvent({0, 0,  m_canvas_size.x, m_canvas_size.y }, *r, pos, old_pos);
-							}
+							handleMouseAxisEvent(canvas, pos, old_pos);
 						}
+						applyHoverChanges();
 						old_pos = pos;
 					}
 					break;
@@ -871,6 +1136,7 @@ struct GUISceneImpl final : GUIScene
 							m_mouse_down_pos.y = event.data.button.y;
 						}
 						bool handled = false;
+						checkHierarchyVersion();
 						for (const GUICanvas& canvas : m_canvas) {
 							auto iter = m_rects.find(canvas.entity);
 							if (iter.isValid()) {
@@ -917,6 +1183,20 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
+	SceneAccess getUpdateAccess() const override {
+		// bound callbacks, e.g. lua scripts, can do anything
+		if (!m_button_clicked.empty() || !m_rect_hovered.empty() || !m_rect_hovered_out.empty()
+			|| !m_rect_mouse_down.empty() || !m_unhandled_mouse_button.empty())
+		{
+			return {};
+		}
+		SceneAccess access;
+		access.reads = SceneAccess::INPUT | SceneAccess::TRANSFORMS;
+		access.writes = 0;
+		return access;
+	}
+
+
 	void createRect(EntityRef entity)
 	{
 		auto iter = m_rects.find(entity);
@@ -935,6 +1215,7 @@ struct GUISceneImpl final : GUIScene
 		rect->entity = entity;
 		rect->flags.set(GUIRect::IS_VALID);
 		rect->flags.set(GUIRect::IS_ENABLED);
+		markLayoutDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_RECT_TYPE, this);
 	}
 
@@ -950,6 +1231,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect& rect = *iter.value();
 		rect.text = LUMIX_NEW(m_allocator, GUIText)(m_allocator);
 
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_TEXT_TYPE, this);
 	}
 
@@ -963,6 +1245,7 @@ struct GUISceneImpl final : GUIScene
 			iter = m_rects.find(entity);
 		}
 		iter.value()->render_target = &EMPTY_RENDER_TARGET;
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_RENDER_TARGET_TYPE, this);
 	}
 
@@ -980,6 +1263,7 @@ struct GUISceneImpl final : GUIScene
 		if (image) {
 			button.hovered_color = image->color;
 		}
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_BUTTON_TYPE, this);
 	}
 	
@@ -988,6 +1272,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUICanvas& canvas = m_canvas.insert(entity);
 		canvas.entity = entity;
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_CANVAS_TYPE, this);
 	}
 
@@ -1002,6 +1287,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect& rect = *iter.value();
 		rect.input_field = LUMIX_NEW(m_allocator, GUIInputField);
 
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_INPUT_FIELD_TYPE, this);
 	}
 
@@ -1018,6 +1304,7 @@ struct GUISceneImpl final : GUIScene
 		rect.image = LUMIX_NEW(m_allocator, GUIImage);
 		rect.image->flags.set(GUIImage::IS_ENABLED);
 
+		markDirty(entity);
 		m_universe.onComponentCreated(entity, GUI_IMAGE_TYPE, this);
 	}
 
@@ -1026,6 +1313,8 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIRect* rect = m_rects[entity];
 		rect->flags.set(GUIRect::IS_VALID, false);
+		// children are relative to something else now
+		markLayoutDirty(entity);
 		if (!rect->image && !rect->text && !rect->input_field && !rect->render_target)
 		{
 			LUMIX_DELETE(m_allocator, rect);
@@ -1038,11 +1327,18 @@ struct GUISceneImpl final : GUIScene
 	void destroyButton(EntityRef entity)
 	{
 		m_buttons.erase(entity);
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_BUTTON_TYPE, this);
 	}
 
 	void destroyCanvas(EntityRef entity) {
 		m_canvas.erase(entity);
+		auto iter = m_canvas_cache.find(entity);
+		if (iter.isValid()) {
+			LUMIX_DELETE(m_allocator, iter.value());
+			m_canvas_cache.erase(iter);
+		}
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_CANVAS_TYPE, this);
 	}
 
@@ -1050,6 +1346,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIRect* rect = m_rects[entity];
 		rect->render_target = nullptr;
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_RENDER_TARGET_TYPE, this);
 		checkGarbage(*rect);
 	}
@@ -1060,6 +1357,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->input_field);
 		rect->input_field = nullptr;
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_INPUT_FIELD_TYPE, this);
 		checkGarbage(*rect);
 	}
@@ -1083,6 +1381,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->image);
 		rect->image = nullptr;
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_IMAGE_TYPE, this);
 		checkGarbage(*rect);
 	}
@@ -1093,6 +1392,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->text);
 		rect->text = nullptr;
+		markDirty(entity);
 		m_universe.onComponentDestroyed(entity, GUI_TEXT_TYPE, this);
 		checkGarbage(*rect);
 	}
@@ -1155,6 +1455,7 @@ struct GUISceneImpl final : GUIScene
 
 	void deserialize(InputMemoryStream& serializer, const EntityMap& entity_map, i32 version) override
 	{
+		for (GUICanvasCache* cache : m_canvas_cache) cache->invalidate();
 		u32 count = serializer.read<u32>();
 		for (u32 i = 0; i < count; ++i)
 		{
@@ -1258,6 +1559,7 @@ struct GUISceneImpl final : GUIScene
 	void setRenderTarget(EntityRef entity, gpu::TextureHandle* texture_handle) override
 	{
 		m_rects[entity]->render_target = texture_handle;
+		markDirty(entity);
 	}
 
 	DelegateList<void(EntityRef)>& buttonClicked() override { return m_button_clicked; }
@@ -1276,6 +1578,7 @@ struct GUISceneImpl final : GUIScene
 	HashMap<EntityRef, GUIRect*> m_rects;
 	HashMap<EntityRef, GUIButton> m_buttons;
 	HashMap<EntityRef, GUICanvas> m_canvas;
+	HashMap<EntityRef, GUICanvasCache*> m_canvas_cache;
 	EntityRef m_buttons_down[16];
 	u32 m_buttons_down_count;
 	EntityPtr m_focused_entity = INVALID_ENTITY;
@@ -1283,6 +1586,7 @@ struct GUISceneImpl final : GUIScene
 	os::CursorType m_cursor_type = os::CursorType::DEFAULT;
 	bool m_cursor_set;
 	FontManager* m_font_manager = nullptr;
+	SpriteManager* m_sprite_manager = nullptr;
 	Vec2 m_canvas_size;
 	Vec2 m_mouse_down_pos;
 	DelegateList<void(EntityRef)> m_button_clicked;
@@ -1290,7 +1594,15 @@ struct GUISceneImpl final : GUIScene
 	DelegateList<void(EntityRef)> m_rect_hovered_out;
 	DelegateList<void(EntityRef, float, float)> m_rect_mouse_down;
 	DelegateList<void(bool, i32, i32)> m_unhandled_mouse_button;
-	Draw2D m_draw_2d;
+	mutable u32 m_hierarchy_version = 0;
+	struct HoverChange {
+		EntityRef entity;
+		bool is_hovered;
+	};
+	Array<u32> m_hit_candidates;
+	Array<HoverChange> m_hover_changes;
+	// set by renderRect if some resource is not ready, so the result can not be cached
+	bool m_cache_incomplete = false;
 };
 
 
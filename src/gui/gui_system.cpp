@@ -25,26 +25,6 @@ namespace Lumix
 struct GUISystemImpl;
 
 
-struct SpriteManager final : ResourceManager
-{
-	SpriteManager(IAllocator& allocator)
-		: ResourceManager(allocator)
-		, m_allocator(allocator)
-	{
-	}
-
-	Resource* createResource(const Path& path) override {
-		return LUMIX_NEW(m_allocator, Sprite)(path, *this, m_allocator);
-	}
-
-	void destroyResource(Resource& resource) override {
-		LUMIX_DELETE(m_allocator, static_cast<Sprite*>(&resource));
-	}
-
-	IAllocator& m_allocator;
-};
-
-
 struct GUISystemImpl final : GUISystem
 {
 	static const char* getTextHAlignName(int index)
@@ -81,8 +61,16 @@ struct GUISystemImpl final : GUISystem
 		universe.addScene(scene.move());
 	}
 
+	// scenes can be updated on workers, the cursor is changed later on the main thread in update()
 	void setCursor(os::CursorType type) override {
-		if (m_interface) m_interface->setCursor(type);
+		m_cursor_type = type;
+		m_cursor_requested = true;
+	}
+
+	void update(float) override {
+		if (!m_cursor_requested) return;
+		m_cursor_requested = false;
+		if (m_interface) m_interface->setCursor(m_cursor_type);
 	}
 
 	void enableCursor(bool enable) override {
@@ -129,6 +117,8 @@ struct GUISystemImpl final : GUISystem
 	Engine& m_engine;
 	SpriteManager m_sprite_manager;
 	Interface* m_interface;
+	os::CursorType m_cursor_type = os::CursorType::DEFAULT;
+	bool m_cursor_requested = false;
 };
 
 
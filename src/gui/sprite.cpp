@@ -4,8 +4,14 @@
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
 #include "engine/string.h"
+#include "renderer/renderer.h"
 #include "renderer/texture.h"
 
+// renderer has its own copy, gui can be a separate module
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#include <stb/stb_rect_pack.h>
+
 
 namespace Lumix
 {
@@ -13,10 +19,146 @@ namespace Lumix
 
 const ResourceType Sprite::TYPE("sprite");
 
+static constexpr u32 ATLAS_PAGE_SIZE = 2048;
+// regions are aligned to 4x4 blocks, so compressed textures can be copied to the atlas too
+static constexpr u32 ATLAS_CELL_SIZE = 4;
+// bigger sprites would waste pages, they are drawn with their own texture
+static constexpr u32 MAX_ATLAS_SPRITE_SIZE = 512;
+
+
+struct SpriteAtlas::Page {
+	Page(IAllocator& allocator) : nodes(allocator) {}
+
+	void reset() {
+		stbrp_init_target(&packer, ATLAS_PAGE_SIZE / ATLAS_CELL_SIZE, ATLAS_PAGE_SIZE / ATLAS_CELL_SIZE, nodes.begin(), nodes.size());
+	}
+
+	gpu::TextureHandle texture = gpu::INVALID_TEXTURE;
+	gpu::TextureFormat format;
+	gpu::TextureFlags flags;
+	stbrp_context packer;
+	Array<stbrp_node> nodes;
+	u32 sprites_count = 0;
+};
+
+
+static bool isAtlasFormat(gpu::TextureFormat format) {
+	switch (format) {
+		case gpu::TextureFormat::RGBA8:
+		case gpu::TextureFormat::SRGBA:
+		case gpu::TextureFormat::BGRA8:
+		case gpu::TextureFormat::BC1:
+		case gpu::TextureFormat::BC2:
+		case gpu::TextureFormat::BC3:
+		case gpu::TextureFormat::BC7:
+			return true;
+		default: return false;
+	}
+}
+
+
+static bool isCompressed(gpu::TextureFormat format) {
+	return format >= gpu::TextureFormat::BC1;
+}
+
+
+SpriteAtlas::SpriteAtlas(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_pages(allocator)
+{}
+
+
+SpriteAtlas::~SpriteAtlas() {
+	for (Page* page : m_pages) {
+		if (page->texture) m_renderer->destroy(page->texture);
+		LUMIX_DELETE(m_allocator, page);
+	}
+}
+
+
+u32 SpriteAtlas::getPageSize() const { return ATLAS_PAGE_SIZE; }
+
+
+gpu::TextureHandle* SpriteAtlas::getPageTexture(u32 page_idx) { return &m_pages[page_idx]->texture; }
+
+
+bool SpriteAtlas::pack(Texture& texture, Region& region) {
+	if (!isAtlasFormat(texture.format)) return false;
+	if (texture.is_cubemap || texture.depth != 1 || texture.is_streamed) return false;
+	if (texture.width > MAX_ATLAS_SPRITE_SIZE || texture.height > MAX_ATLAS_SPRITE_SIZE) return false;
+	// copies of compressed textures must cover whole blocks
+	if (isCompressed(texture.format) && ((texture.width | texture.height) & (ATLAS_CELL_SIZE - 1))) return false;
+
+	const gpu::TextureFlags flags = (texture.getGPUFlags() & gpu::TextureFlags::SRGB) | gpu::TextureFlags::NO_MIPS;
+	stbrp_rect r = {};
+	r.w = (texture.width + ATLAS_CELL_SIZE - 1) / ATLAS_CELL_SIZE;
+	r.h = (texture.height + ATLAS_CELL_SIZE - 1) / ATLAS_CELL_SIZE;
+
+	u32 page_idx = 0;
+	for (; page_idx < (u32)m_pages.size(); ++page_idx) {
+		Page* page = m_pages[page_idx];
+		if (page->format != texture.format || page->flags != flags) continue;
+		stbrp_pack_rects(&page->packer, &r, 1);
+		if (r.was_packed) break;
+	}
+
+	if (!r.was_packed) {
+		m_renderer = &texture.renderer;
+		Page* page = LUMIX_NEW(m_allocator, Page)(m_allocator);
+		page->format = texture.format;
+		page->flags = flags;
+		page->nodes.resize(ATLAS_PAGE_SIZE / ATLAS_CELL_SIZE);
+		page->reset();
+		const StaticString<32> name("sprite_atlas_", m_pages.size());
+		page->texture = m_renderer->createTexture(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 1, page->format, page->flags, Renderer::MemRef(), name);
+		page_idx = m_pages.size();
+		m_pages.push(page);
+		stbrp_pack_rects(&page->packer, &r, 1);
+		if (!r.was_packed) return false;
+	}
+
+	Page* page = m_pages[page_idx];
+	if (!page->texture) return false;
+	++page->sprites_count;
+	region.page = page_idx;
+	region.x = r.x * ATLAS_CELL_SIZE;
+	region.y = r.y * ATLAS_CELL_SIZE;
+	// queued after the source texture is created and before any draw2d using the region
+	m_renderer->copy(page->texture, texture.handle, region.x, region.y);
+	return true;
+}
+
+
+void SpriteAtlas::release(u32 page_idx) {
+	Page* page = m_pages[page_idx];
+	ASSERT(page->sprites_count > 0);
+	--page->sprites_count;
+	if (page->sprites_count == 0) page->reset();
+	++m_version;
+}
+
+
+SpriteManager::SpriteManager(IAllocator& allocator)
+	: ResourceManager(allocator)
+	, m_allocator(allocator)
+	, m_atlas(allocator)
+{}
+
+
+Resource* SpriteManager::createResource(const Path& path) {
+	return LUMIX_NEW(m_allocator, Sprite)(path, *this, m_allocator);
+}
+
+
+void SpriteManager::destroyResource(Resource& resource) {
+	LUMIX_DELETE(m_allocator, static_cast<Sprite*>(&resource));
+}
+
 
 Sprite::Sprite(const Path& path, ResourceManager& manager, IAllocator& allocator)
 	: Resource(path, manager, allocator)
 	, m_texture(nullptr)
+	, m_atlas_page(SpriteAtlas::INVALID_PAGE)
 {
 }
 
@@ -25,14 +167,65 @@ void Sprite::unload()
 {
 	if (!m_texture) return;
 	
+	releaseAtlasRegion();
+	m_texture->getObserverCb().unbind<&Sprite::onTextureStateChanged>(this);
 	m_texture->decRefCount();
 	m_texture = nullptr;
 }
 
 
+void Sprite::releaseAtlasRegion() {
+	m_atlas_failed = false;
+	m_uv0 = m_uv_min = {0, 0};
+	m_uv1 = m_uv_max = {1, 1};
+	if (m_atlas_page == SpriteAtlas::INVALID_PAGE) return;
+
+	static_cast<SpriteManager&>(getResourceManager()).m_atlas.release(m_atlas_page);
+	m_atlas_page = SpriteAtlas::INVALID_PAGE;
+}
+
+
+void Sprite::onTextureStateChanged(State old_state, State new_state, Resource&) {
+	// reloaded texture is packed again on next use
+	if (old_state == State::READY) releaseAtlasRegion();
+}
+
+
+gpu::TextureHandle* Sprite::getDrawTexture() {
+	if (!m_texture || !m_texture->isReady()) return nullptr;
+
+	SpriteAtlas& atlas = static_cast<SpriteManager&>(getResourceManager()).m_atlas;
+	if (m_atlas_page != SpriteAtlas::INVALID_PAGE) return atlas.getPageTexture(m_atlas_page);
+	if (m_atlas_failed) return &m_texture->handle;
+
+	SpriteAtlas::Region region;
+	if (!atlas.pack(*m_texture, region)) {
+		m_atlas_failed = true;
+		return &m_texture->handle;
+	}
+
+	const float page_size = (float)atlas.getPageSize();
+	m_atlas_page = region.page;
+	m_uv0 = Vec2((float)region.x, (float)region.y) / page_size;
+	m_uv1 = Vec2(float(region.x + m_texture->width), float(region.y + m_texture->height)) / page_size;
+	m_uv_min = m_uv0 + Vec2(0.5f / page_size);
+	m_uv_max = m_uv1 - Vec2(0.5f / page_size);
+	return atlas.getPageTexture(m_atlas_page);
+}
+
+
+Vec2 Sprite::mapUV(const Vec2& uv) const {
+	const Vec2 res = m_uv0 + (m_uv1 - m_uv0) * uv;
+	if (m_atlas_page == SpriteAtlas::INVALID_PAGE) return res;
+	return Vec2(clamp(res.x, m_uv_min.x, m_uv_max.x), clamp(res.y, m_uv_min.y, m_uv_max.y));
+}
+
+
 void Sprite::setTexture(const Path& path)
 {
 	if (m_texture) {
+		releaseAtlasRegion();
+		m_texture->getObserverCb().unbind<&Sprite::onTextureStateChanged>(this);
 		m_texture->decRefCount();
 	}
 
@@ -40,6 +233,7 @@ void Sprite::setTexture(const Path& path)
 		m_texture = nullptr;
 	} else {
 		m_texture = (Texture*)getResourceManager().getOwner().load<Texture>(path);
+		m_texture->getObserverCb().bind<&Sprite::onTextureStateChanged>(this);
 	}
 }
 
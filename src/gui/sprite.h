@@ -1,7 +1,11 @@
 #pragma once
 
 
+#include "engine/array.h"
+#include "engine/math.h"
 #include "engine/resource.h"
+#include "engine/resource_manager.h"
+#include "renderer/gpu/gpu.h"
 
 
 namespace Lumix
@@ -26,6 +30,10 @@ public:
 	
 	void setTexture(const Path& path);
 	struct Texture* getTexture() const { return m_texture; }
+	// texture to draw the sprite with, atlas page if the sprite is packed, the sprite is packed on first use
+	gpu::TextureHandle* getDrawTexture();
+	// maps uv in the sprite's texture to uv in getDrawTexture
+	Vec2 mapUV(const Vec2& uv) const;
 
 	Type type = SIMPLE;
 	int top = 0;
@@ -36,7 +44,61 @@ public:
 	static const ResourceType TYPE;
 
 private:
+	void releaseAtlasRegion();
+	void onTextureStateChanged(State old_state, State new_state, Resource&);
+
 	Texture* m_texture;
+	u32 m_atlas_page;
+	bool m_atlas_failed = false;
+	Vec2 m_uv0 = {0, 0};
+	Vec2 m_uv1 = {1, 1};
+	// half texel inside the packed region, so linear filtering does not bleed from neighbours
+	Vec2 m_uv_min = {0, 0};
+	Vec2 m_uv_max = {1, 1};
+};
+
+
+// sprite textures are copied to shared pages, so consecutive GUI images end up in a single Draw2D command
+// page is reset once all its sprites are released
+struct SpriteAtlas
+{
+	static constexpr u32 INVALID_PAGE = 0xffFFffFF;
+
+	struct Region {
+		u32 page;
+		u32 x, y;
+	};
+
+	SpriteAtlas(IAllocator& allocator);
+	~SpriteAtlas();
+
+	// false if `texture` can not be packed, e.g. it's too big or in an unsupported format
+	bool pack(Texture& texture, Region& region);
+	void release(u32 page_idx);
+	gpu::TextureHandle* getPageTexture(u32 page_idx);
+	u32 getPageSize() const;
+	// changes every time a region is released, i.e. draws referencing the atlas may be stale
+	u32 getVersion() const { return m_version; }
+
+private:
+	struct Page;
+
+	IAllocator& m_allocator;
+	struct Renderer* m_renderer = nullptr;
+	Array<Page*> m_pages;
+	u32 m_version = 0;
+};
+
+
+struct SpriteManager final : ResourceManager
+{
+	SpriteManager(IAllocator& allocator);
+
+	Resource* createResource(const Path& path) override;
+	void destroyResource(Resource& resource) override;
+
+	IAllocator& m_allocator;
+	SpriteAtlas m_atlas;
 };
 
 
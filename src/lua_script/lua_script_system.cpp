@@ -8,6 +8,7 @@
 #include "engine/flag_set.h"
 #include "engine/allocator.h"
 #include "engine/input_system.h"
+#include "engine/job_system.h"
 #include "engine/metaprogramming.h"
 #include "engine/plugin.h"
 #include "engine/log.h"
@@ -209,6 +210,7 @@ namespace Lumix
 
 	enum class LuaSceneVersion : i32
 	{
+		TYPED_PROPERTIES,
 		LATEST
 	};
 
@@ -232,6 +234,48 @@ namespace Lumix
 		return r;
 	}
 
+	template <typename T> static void setStoredValue(LuaScriptScene::Property& prop, LuaScriptScene::Property::Type type, const T& value) {
+		static_assert(sizeof(value) <= sizeof(prop.stored_data));
+		memcpy(prop.stored_data, &value, sizeof(value));
+		prop.stored_type = type;
+	}
+
+	template <typename T> static T getStoredData(const LuaScriptScene::Property& prop) {
+		T res;
+		memcpy(&res, prop.stored_data, sizeof(res));
+		return res;
+	}
+
+	// text form of stored value, as it was stored before typed properties
+	static void storedValueToString(const LuaScriptScene::Property& prop, Span<char> out) {
+		using Property = LuaScriptScene::Property;
+		switch (prop.stored_type) {
+			case Property::BOOLEAN: copyString(out, getStoredData<bool>(prop) ? "true" : "false"); break;
+			case Property::FLOAT: toCString(getStoredData<float>(prop), out, 10); break;
+			case Property::INT: toCString(getStoredData<i32>(prop), out); break;
+			case Property::ENTITY: toCString(getStoredData<EntityPtr>(prop).index, out); break;
+			case Property::COLOR: {
+				const Vec3 v = getStoredData<Vec3>(prop);
+				const StaticString<512> tmp("{", v.x, ",", v.y, ",", v.z, "}");
+				copyString(out, tmp.data);
+				break;
+			}
+			default: copyString(out, prop.stored_value.c_str()); break;
+		}
+	}
+
+	template <typename T> static T getStoredValue(const LuaScriptScene::Property& prop) {
+		// strings are always stored as text
+		if constexpr (IsSame<T, const char*>::Value) {
+			return prop.stored_value.c_str();
+		}
+		else {
+			char tmp[512];
+			storedValueToString(prop, Span(tmp));
+			return fromString<T>(tmp);
+		}
+	}
+
 	template <typename T> static void toString(T val, String& out) {
 		char tmp[128];
 		toCString(val, Span(tmp));
@@ -292,11 +336,17 @@ namespace Lumix
 	{
 		struct TimerData
 		{
-			float time;
 			lua_State* state;
 			int func;
 		};
 
+		// min-heap item, cancelled timers stay in the heap until they expire and are skipped then
+		struct TimerHeapItem
+		{
+			double time;
+			i32 id;
+		};
+
 		struct CallbackData
 		{
 			LuaScript* script;
@@ -304,6 +354,70 @@ namespace Lumix
 			int environment;
 		};
 
+		struct UpdateData
+		{
+			LuaScript* script;
+			lua_State* state;
+			int environment;
+			int func; // `update` function, cached when the script is registered
+			u32 interval; // in frames, set by `update_interval` in script
+			u32 phase; // staggers scripts with the same interval
+			int group_functions; // table of the group the function is in, LUA_NOREF if not in any
+			u32 group_slot;
+		};
+
+		// updates of scripts with the same interval and bucket are called from a single lua-side loop
+		struct UpdateGroup
+		{
+			u32 interval;
+			u32 bucket; // updated in frames where frame % interval == bucket
+			u32 count;
+			int functions;
+			float time_delta; // accumulated since the group was last updated
+		};
+
+		// deferred universe write from an isolated script
+		struct IsolatedCommand
+		{
+			enum class Type : u8 {
+				SET_POSITION,
+				SET_ROTATION,
+				SET_SCALE
+			};
+
+			Type type;
+			EntityRef entity;
+			DVec3 pos;
+			Quat rot;
+			float scale;
+		};
+
+		struct IsolatedScript
+		{
+			lua_State* owner; // thread of the script instance in the engine state
+			int environment; // in the isolated state
+			int func;
+		};
+
+		static constexpr float ISOLATED_GC_BUDGET_MS = 0.2f;
+
+		// own lua state, updated on the job system in parallel with other isolated states
+		struct IsolatedState
+		{
+			IsolatedState(LuaScriptSceneImpl& scene, IAllocator& allocator)
+				: scene(scene)
+				, lua_allocator(allocator)
+				, scripts(allocator)
+				, commands(allocator)
+			{}
+
+			LuaScriptSceneImpl& scene;
+			LuaWrapper::LuaAllocator lua_allocator;
+			lua_State* L = nullptr;
+			Array<IsolatedScript> scripts;
+			Array<IsolatedCommand> commands;
+		};
+
 		struct ScriptComponent;
 
 		struct ScriptInstance
@@ -457,6 +571,8 @@ namespace Lumix
 					inst.m_properties.shrink(sizeof(valid_properties) * 8);
 				}
 				memset(valid_properties, 0, (inst.m_properties.size() + 7) / 8);
+				// only these can have stored values
+				const i32 existing_count = inst.m_properties.size();
 
 				while (lua_next(L, -2)) // [env, key, value] | [env]
 				{
@@ -483,7 +599,6 @@ namespace Lumix
 											default: existing_prop.type = Property::FLOAT;
 										}
 									}
-									m_scene.applyProperty(inst, existing_prop, existing_prop.stored_value.c_str());
 								}
 								else {
 									const int prop_index = inst.m_properties.size();
@@ -508,6 +623,10 @@ namespace Lumix
 					lua_pop(L, 1); // [env, key]
 				}
 				// [env]
+				// values can not be set while the environment is traversed, since lua_next does not allow adding fields
+				for (i32 i = 0; i < existing_count; ++i) {
+					if (valid_properties[i / 8] & (1 << (i % 8))) m_scene.applyStoredProperty(inst, inst.m_properties[i]);
+				}
 				for (int i = inst.m_properties.size() - 1; i >= 0; --i)
 				{
 					if (valid_properties[i / 8] & (1 << (i % 8))) continue;
@@ -574,6 +693,17 @@ namespace Lumix
 			}
 
 
+			void add(Span<const float> parameter) override
+			{
+				lua_createtable(state, parameter.length(), 0);
+				for (u32 i = 0; i < parameter.length(); ++i) {
+					lua_pushnumber(state, parameter[i]);
+					lua_rawseti(state, -2, i + 1);
+				}
+				++parameter_count;
+			}
+
+
 			void addEnvironment(int env) override
 			{
 				lua_rawgeti(state, LUA_REGISTRYINDEX, env);
@@ -596,8 +726,11 @@ namespace Lumix
 			, m_universe(ctx)
 			, m_scripts(system.m_allocator)
 			, m_updates(system.m_allocator)
+			, m_update_groups(system.m_allocator)
+			, m_isolated_states(system.m_allocator)
 			, m_input_handlers(system.m_allocator)
 			, m_timers(system.m_allocator)
+			, m_timer_heap(system.m_allocator)
 			, m_property_names(system.m_allocator)
 			, m_is_game_running(false)
 			, m_is_api_registered(false)
@@ -680,6 +813,11 @@ namespace Lumix
 		void clear() override
 		{
 			Path invalid_path;
+			clearUpdates();
+			if (m_update_dispatcher != LUA_NOREF) {
+				luaL_unref(m_system.m_engine.getState(), LUA_REGISTRYINDEX, m_update_dispatcher);
+				m_update_dispatcher = LUA_NOREF;
+			}
 			for (auto* script_cmp : m_scripts) {
 				ASSERT(script_cmp);
 				LUMIX_DELETE(m_system.m_allocator, script_cmp);
@@ -783,14 +921,7 @@ namespace Lumix
 				lua_pop(instance.m_state, 1);
 				return 0;
 			}
-			lua_getfield(instance.m_state, -1, "update");
-			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION) {
-				auto& update_data = scene->m_updates.emplace();
-				update_data.script = instance.m_script;
-				update_data.state = instance.m_state;
-				update_data.environment = instance.m_environment;
-			}
-			lua_pop(instance.m_state, 1);
+			scene->registerUpdate(instance);
 			lua_getfield(instance.m_state, -1, "onInputEvent");
 			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION) {
 				auto& callback = scene->m_input_handlers.emplace();
@@ -1095,6 +1226,99 @@ namespace Lumix
 			return 0;
 		}
 
+		// plain C signatures called from lua through ffi, see installFFIProperties
+		static float ffiGetFloatProperty(const reflection::Property<float>* prop, IScene* scene, i32 entity) {
+			return prop->get(ComponentUID(EntityRef{entity}, {-1}, scene), -1);
+		}
+
+		static void ffiSetFloatProperty(const reflection::Property<float>* prop, IScene* scene, i32 cmp_type, i32 entity, float value) {
+			prop->set(ComponentUID(EntityRef{entity}, {cmp_type}, scene), -1, value);
+		}
+
+		static void ffiGetVec3Property(const reflection::Property<Vec3>* prop, IScene* scene, i32 entity, Vec3* out) {
+			*out = prop->get(ComponentUID(EntityRef{entity}, {-1}, scene), -1);
+		}
+
+		static void ffiSetVec3Property(const reflection::Property<Vec3>* prop, IScene* scene, i32 cmp_type, i32 entity, float x, float y, float z) {
+			prop->set(ComponentUID(EntityRef{entity}, {cmp_type}, scene), -1, Vec3(x, y, z));
+		}
+
+		// fills component's _ffi_* tables with properties, which can be accessed through ffi
+		struct FFIPropertyVisitor : reflection::IEmptyPropertyVisitor
+		{
+			void add(const char* getters, const char* setters, const reflection::PropertyBase& prop, bool has_setter) {
+				char name[50];
+				convertPropertyToLuaName(prop.name, Span(name));
+				lua_getfield(L, -1, getters); // [cmp, getters]
+				lua_pushlightuserdata(L, (void*)&prop);
+				lua_setfield(L, -2, name);
+				lua_pop(L, 1); // [cmp]
+				if (!has_setter) return;
+				lua_getfield(L, -1, setters); // [cmp, setters]
+				lua_pushlightuserdata(L, (void*)&prop);
+				lua_setfield(L, -2, name);
+				lua_pop(L, 1); // [cmp]
+			}
+
+			void visit(const reflection::Property<float>& prop) override { add("_ffi_float_get", "_ffi_float_set", prop, prop.setter); }
+			void visit(const reflection::Property<Vec3>& prop) override { add("_ffi_vec3_get", "_ffi_vec3_set", prop, prop.setter); }
+
+			lua_State* L;
+		};
+
+		static void installFFIProperties(lua_State* L)
+		{
+			LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_getFloatProperty", (void*)&ffiGetFloatProperty);
+			LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_setFloatProperty", (void*)&ffiSetFloatProperty);
+			LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_getVec3Property", (void*)&ffiGetVec3Property);
+			LuaWrapper::createSystemVariable(L, "LumixAPI", "_ffi_setVec3Property", (void*)&ffiSetVec3Property);
+
+			// float and vec3 properties skip the C __index/__newindex, rest is forwarded to them
+			static const char* src = R"#(
+				local ok, ffi = pcall(require, "ffi")
+				if not ok then return end
+				if not pcall(ffi.typeof, "LumixVec3") then
+					ffi.cdef[[ typedef struct { float x, y, z; } LumixVec3; ]]
+				end
+				local api = LumixAPI
+				local get_float = ffi.cast("float (*)(void*, void*, int)", api._ffi_getFloatProperty)
+				local set_float = ffi.cast("void (*)(void*, void*, int, int, float)", api._ffi_setFloatProperty)
+				local get_vec3 = ffi.cast("void (*)(void*, void*, int, LumixVec3*)", api._ffi_getVec3Property)
+				local set_vec3 = ffi.cast("void (*)(void*, void*, int, int, float, float, float)", api._ffi_setVec3Property)
+				local tmp = ffi.new("LumixVec3[1]")
+				for _, cmp in pairs(Lumix) do
+					if type(cmp) == "table" and cmp._ffi_float_get ~= nil and not cmp._ffi_installed then
+						cmp._ffi_installed = true
+						local float_get, float_set = cmp._ffi_float_get, cmp._ffi_float_set
+						local vec3_get, vec3_set = cmp._ffi_vec3_get, cmp._ffi_vec3_set
+						local cmp_type = cmp.cmp_type
+						local c_index, c_newindex = cmp.__index, cmp.__newindex
+						cmp.__index = function(t, k)
+							local p = float_get[k]
+							if p ~= nil then return get_float(p, t._scene, t._entity) end
+							p = vec3_get[k]
+							if p ~= nil then
+								get_vec3(p, t._scene, t._entity, tmp)
+								local v = tmp[0]
+								return { v.x, v.y, v.z }
+							end
+							return c_index(t, k)
+						end
+						cmp.__newindex = function(t, k, value)
+							local p = float_set[k]
+							if p ~= nil then return set_float(p, t._scene, cmp_type, t._entity, value) end
+							p = vec3_set[k]
+							if p ~= nil then return set_vec3(p, t._scene, cmp_type, t._entity, value[1], value[2], value[3]) end
+							return c_newindex(t, k, value)
+						end
+					end
+				end
+			)#";
+			if (!LuaWrapper::execute(L, Span(src, stringLength(src)), "ffi_properties", 0)) {
+				logError("Failed to init ffi properties");
+			}
+		}
+
 		static int lua_new_scene(lua_State* L) {
 			LuaWrapper::DebugGuard guard(L, 1);
 			LuaWrapper::checkTableArg(L, 1); // self
@@ -1163,19 +1387,67 @@ namespace Lumix
 				lua_pushcclosure(L, lua_prop_setter, 1); // [ cmp, fn_prop_setter ]
 				lua_setfield(L, -2, "__newindex"); // [ cmp ]
 
+				static const char* ffi_tables[] = { "_ffi_float_get", "_ffi_float_set", "_ffi_vec3_get", "_ffi_vec3_set" };
+				for (const char* table : ffi_tables) {
+					lua_newtable(L); // [ cmp, table ]
+					lua_setfield(L, -2, table); // [ cmp ]
+				}
+				FFIPropertyVisitor ffi_visitor;
+				ffi_visitor.L = L;
+				cmp.cmp->visit(ffi_visitor);
+
 				lua_pop(L, 1);
 			}
+
+			installFFIProperties(L);
+		}
+
+		// `timer` is the handle returned from setTimer, handles are never reused
+		void cancelTimer(int timer)
+		{
+			auto iter = m_timers.find(timer);
+			if (!iter.isValid()) return;
+
+			luaL_unref(iter.value().state, LUA_REGISTRYINDEX, iter.value().func);
+			m_timers.erase(iter);
+		}
+
+
+		static bool isTimerEarlier(const TimerHeapItem& a, const TimerHeapItem& b)
+		{
+			// same time timers are called in the order they were set
+			return a.time < b.time || (a.time == b.time && a.id < b.id);
+		}
+
+
+		void pushTimerHeap(const TimerHeapItem& item)
+		{
+			u32 idx = m_timer_heap.size();
+			m_timer_heap.push(item);
+			while (idx > 0) {
+				const u32 parent = (idx - 1) / 2;
+				if (!isTimerEarlier(m_timer_heap[idx], m_timer_heap[parent])) break;
+				swap(m_timer_heap[idx], m_timer_heap[parent]);
+				idx = parent;
+			}
 		}
 
-		void cancelTimer(int timer_func)
+
+		void popTimerHeap()
 		{
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
-			{
-				if (m_timers[i].func == timer_func)
-				{
-					m_timers.swapAndPop(i);
-					break;
-				}
+			m_timer_heap[0] = m_timer_heap.back();
+			m_timer_heap.pop();
+			const u32 size = m_timer_heap.size();
+			u32 idx = 0;
+			for (;;) {
+				const u32 left = idx * 2 + 1;
+				const u32 right = left + 1;
+				u32 smallest = idx;
+				if (left < size && isTimerEarlier(m_timer_heap[left], m_timer_heap[smallest])) smallest = left;
+				if (right < size && isTimerEarlier(m_timer_heap[right], m_timer_heap[smallest])) smallest = right;
+				if (smallest == idx) break;
+				swap(m_timer_heap[idx], m_timer_heap[smallest]);
+				idx = smallest;
 			}
 		}
 
@@ -1185,13 +1457,15 @@ namespace Lumix
 			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
 			float time = LuaWrapper::checkArg<float>(L, 2);
 			if (!lua_isfunction(L, 3)) LuaWrapper::argError(L, 3, "function");
-			TimerData& timer = scene->m_timers.emplace();
-			timer.time = time;
+			const i32 id = scene->m_next_timer_id;
+			++scene->m_next_timer_id;
+			TimerData& timer = scene->m_timers.insert(id);
 			timer.state = L;
 			lua_pushvalue(L, 3);
 			timer.func = luaL_ref(L, LUA_REGISTRYINDEX);
 			lua_pop(L, 1);
-			LuaWrapper::push(L, timer.func);
+			scene->pushTimerHeap({scene->m_timer_time + time, id});
+			LuaWrapper::push(L, id);
 			return 1;
 		}
 
@@ -1237,11 +1511,15 @@ namespace Lumix
 		}
 
 		void applyEntityProperty(ScriptInstance& script, const char* name, Property& prop, const char* value)
+		{
+			applyEntityProperty(script, name, fromString<EntityPtr>(value));
+		}
+
+		void applyEntityProperty(ScriptInstance& script, const char* name, EntityPtr e)
 		{
 			LuaWrapper::DebugGuard guard(script.m_state);
 			lua_rawgeti(script.m_state, LUA_REGISTRYINDEX, script.m_environment); // [env]
 			ASSERT(lua_type(script.m_state, -1));
-			const EntityPtr e = fromString<EntityPtr>(value);
 
 			if (!e.isValid()) {
 				lua_newtable(script.m_state); // [env, {}]
@@ -1279,6 +1557,40 @@ namespace Lumix
 			lua_pop(script.m_state, 1);
 		}
 
+		// typed values are set directly, text values (older files, values of different type) are parsed by lua
+		void applyStoredProperty(ScriptInstance& script, Property& prop) {
+			lua_State* L = script.m_state;
+			const char* name = getPropertyName(prop.name_hash);
+			if (!name || !L) return;
+
+			const bool is_typed = prop.stored_type != Property::ANY;
+			if (!is_typed || prop.stored_type != prop.type) {
+				char tmp[1024];
+				storedValueToString(prop, Span(tmp));
+				applyProperty(script, prop, (const char*)tmp);
+				return;
+			}
+
+			switch (prop.type) {
+				case Property::ENTITY: applyEntityProperty(script, name, getStoredData<EntityPtr>(prop)); return;
+				case Property::RESOURCE: applyResourceProperty(script, name, prop, prop.stored_value.c_str()); return;
+				default: break;
+			}
+
+			LuaWrapper::DebugGuard guard(L);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, script.m_environment); // [env]
+			switch (prop.type) {
+				case Property::BOOLEAN: lua_pushboolean(L, getStoredData<bool>(prop)); break;
+				case Property::FLOAT: lua_pushnumber(L, getStoredData<float>(prop)); break;
+				case Property::INT: lua_pushinteger(L, getStoredData<i32>(prop)); break;
+				case Property::COLOR: LuaWrapper::push(L, getStoredData<Vec3>(prop)); break;
+				case Property::STRING: lua_pushstring(L, prop.stored_value.c_str()); break;
+				default: ASSERT(false); lua_pushnil(L); break;
+			}
+			lua_setfield(L, -2, name); // [env]
+			lua_pop(L, 1);
+		}
+
 		template <typename T>
 		void applyProperty(ScriptInstance& script, Property& prop, T value) {
 			char tmp[64];
@@ -1357,6 +1669,7 @@ namespace Lumix
 			Property& prop = getScriptProperty(entity, scr_index, property_name);
 			if (!script_cmp->m_scripts[scr_index].m_state) {
 				toString(value, prop.stored_value);
+				prop.stored_type = Property::ANY;
 				return;
 			}
 
@@ -1374,6 +1687,7 @@ namespace Lumix
 			if (!script_cmp->m_scripts[scr_index].m_state)
 			{
 				prop.stored_value = value;
+				prop.stored_type = Property::ANY;
 				return;
 			}
 
@@ -1416,20 +1730,19 @@ namespace Lumix
 
 		void disableScript(ScriptInstance& inst)
 		{
-			for (int i = 0; i < m_timers.size(); ++i)
-			{
-				if (m_timers[i].state == inst.m_state)
-				{
-					luaL_unref(m_timers[i].state, LUA_REGISTRYINDEX, m_timers[i].func);
-					m_timers.swapAndPop(i);
-					--i;
-				}
-			}
+			// heap items of removed timers are skipped when they expire
+			m_timers.eraseIf([&](const TimerData& timer){
+				if (timer.state != inst.m_state) return false;
+				luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+				return true;
+			});
 
+			unregisterIsolated(inst.m_state);
 			for (int i = 0; i < m_updates.size(); ++i)
 			{
 				if (m_updates[i].state == inst.m_state)
 				{
+					unregisterUpdate(m_updates[i]);
 					m_updates.swapAndPop(i);
 					break;
 				}
@@ -1446,6 +1759,361 @@ namespace Lumix
 		}
 
 
+		// expects environment of `inst` on top of the stack
+		void registerUpdate(const ScriptInstance& inst)
+		{
+			lua_State* L = inst.m_state;
+			lua_getfield(L, -1, "update"); // [env, update]
+			if (lua_type(L, -1) != LUA_TFUNCTION) {
+				lua_pop(L, 1);
+				return;
+			}
+
+			lua_getfield(L, -2, "isolated"); // [env, update, isolated]
+			const bool isolated = lua_toboolean(L, -1) != 0;
+			lua_pop(L, 1); // [env, update]
+			if (isolated) {
+				lua_pop(L, 1); // [env]
+				registerIsolated(inst);
+				return;
+			}
+
+			UpdateData& update_data = m_updates.emplace();
+			update_data.script = inst.m_script;
+			update_data.state = L;
+			update_data.environment = inst.m_environment;
+			update_data.func = luaL_ref(L, LUA_REGISTRYINDEX); // [env]
+			update_data.interval = 1;
+			update_data.phase = m_update_phase++;
+			update_data.group_functions = LUA_NOREF;
+			update_data.group_slot = 0;
+
+			lua_getfield(L, -1, "update_interval"); // [env, interval]
+			if (lua_type(L, -1) == LUA_TNUMBER) update_data.interval = (u32)maximum(1, (i32)lua_tointeger(L, -1));
+			lua_pop(L, 1); // [env]
+			m_update_groups_dirty = true;
+		}
+
+
+		static IsolatedState& getIsolatedState(lua_State* L) {
+			return *(IsolatedState*)lua_touserdata(L, lua_upvalueindex(1));
+		}
+
+
+		static int isolatedGetPosition(lua_State* L) {
+			IsolatedState& state = getIsolatedState(L);
+			const EntityRef e = {LuaWrapper::checkArg<i32>(L, 1)};
+			LuaWrapper::push(L, state.scene.m_universe.getPosition(e));
+			return 1;
+		}
+
+
+		static int isolatedGetRotation(lua_State* L) {
+			IsolatedState& state = getIsolatedState(L);
+			const EntityRef e = {LuaWrapper::checkArg<i32>(L, 1)};
+			LuaWrapper::push(L, state.scene.m_universe.getRotation(e));
+			return 1;
+		}
+
+
+		static int isolatedSetPosition(lua_State* L) {
+			IsolatedState& state = getIsolatedState(L);
+			IsolatedCommand& cmd = state.commands.emplace();
+			cmd.type = IsolatedCommand::Type::SET_POSITION;
+			cmd.entity = {LuaWrapper::checkArg<i32>(L, 1)};
+			cmd.pos = LuaWrapper::checkArg<DVec3>(L, 2);
+			return 0;
+		}
+
+
+		static int isolatedSetRotation(lua_State* L) {
+			IsolatedState& state = getIsolatedState(L);
+			IsolatedCommand& cmd = state.commands.emplace();
+			cmd.type = IsolatedCommand::Type::SET_ROTATION;
+			cmd.entity = {LuaWrapper::checkArg<i32>(L, 1)};
+			cmd.rot = LuaWrapper::checkArg<Quat>(L, 2);
+			return 0;
+		}
+
+
+		static int isolatedSetScale(lua_State* L) {
+			IsolatedState& state = getIsolatedState(L);
+			IsolatedCommand& cmd = state.commands.emplace();
+			cmd.type = IsolatedCommand::Type::SET_SCALE;
+			cmd.entity = {LuaWrapper::checkArg<i32>(L, 1)};
+			cmd.scale = LuaWrapper::checkArg<float>(L, 2);
+			return 0;
+		}
+
+
+		static int isolatedLogError(lua_State* L) {
+			logError(LuaWrapper::checkArg<const char*>(L, 1));
+			return 0;
+		}
+
+
+		void initIsolatedStates()
+		{
+			IAllocator& allocator = m_system.m_allocator;
+			for (u32 i = 0, c = jobs::getWorkersCount(); i < c; ++i) {
+				IsolatedState* state = LUMIX_NEW(allocator, IsolatedState)(*this, allocator);
+				lua_State* L = LuaWrapper::newState(state->lua_allocator);
+				luaL_openlibs(L);
+				state->L = L;
+
+				// isolated scripts can not access the engine api, only this
+				lua_newtable(L); // [api]
+				auto addFunction = [&](const char* name, lua_CFunction f) {
+					lua_pushlightuserdata(L, state); // [api, state]
+					lua_pushcclosure(L, f, 1); // [api, f]
+					lua_setfield(L, -2, name); // [api]
+				};
+				addFunction("getPosition", &isolatedGetPosition);
+				addFunction("getRotation", &isolatedGetRotation);
+				addFunction("setPosition", &isolatedSetPosition);
+				addFunction("setRotation", &isolatedSetRotation);
+				addFunction("setScale", &isolatedSetScale);
+				addFunction("logError", &isolatedLogError);
+				lua_setglobal(L, "LumixIsolated"); // []
+
+				m_isolated_states.push(state);
+			}
+		}
+
+
+		void destroyIsolatedStates()
+		{
+			for (IsolatedState* state : m_isolated_states) {
+				lua_close(state->L);
+				LUMIX_DELETE(m_system.m_allocator, state);
+			}
+			m_isolated_states.clear();
+			m_isolated_count = 0;
+		}
+
+
+		// script is loaded again in one of the isolated states, `this` is entity index there
+		// number, boolean and string variables are copied from the instance's environment
+		void registerIsolated(const ScriptInstance& inst)
+		{
+			if (m_isolated_states.empty()) initIsolatedStates();
+
+			IsolatedState& state = *m_isolated_states[m_isolated_next % m_isolated_states.size()];
+			++m_isolated_next;
+			lua_State* L = state.L;
+			LuaWrapper::DebugGuard guard(L);
+
+			lua_newtable(L); // [env]
+			lua_newtable(L); // [env, meta]
+			lua_pushvalue(L, LUA_GLOBALSINDEX); // [env, meta, _G]
+			lua_setfield(L, -2, "__index"); // [env, meta]
+			lua_setmetatable(L, -2); // [env]
+
+			lua_State* src = inst.m_state;
+			lua_pushnil(src); // [src_env, nil]
+			while (lua_next(src, -2)) { // [src_env, key, value]
+				const int type = lua_type(src, -1);
+				if (lua_type(src, -2) == LUA_TSTRING && (type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING)) {
+					size_t len;
+					const char* key = lua_tostring(src, -2);
+					switch (type) {
+						case LUA_TNUMBER: lua_pushnumber(L, lua_tonumber(src, -1)); break;
+						case LUA_TBOOLEAN: lua_pushboolean(L, lua_toboolean(src, -1)); break;
+						default: {
+							const char* value = lua_tolstring(src, -1, &len);
+							lua_pushlstring(L, value, len);
+							break;
+						}
+					}
+					lua_setfield(L, -2, key);
+				}
+				lua_pop(src, 1); // [src_env, key]
+			}
+			lua_pushinteger(L, inst.m_cmp->m_entity.index); // [env, this]
+			lua_setfield(L, -2, "this"); // [env]
+
+			const char* code = inst.m_script->getSourceCode();
+			if (luaL_loadbuffer(L, code, stringLength(code), inst.m_script->getPath().c_str()) != 0) { // [env, func]
+				logError(inst.m_script->getPath(), ": ", lua_tostring(L, -1));
+				lua_pop(L, 2);
+				return;
+			}
+			lua_pushvalue(L, -2); // [env, func, env]
+			lua_setfenv(L, -2); // [env, func]
+			if (!LuaWrapper::pcall(L, 0, 0)) { // [env]
+				lua_pop(L, 1);
+				return;
+			}
+
+			lua_getfield(L, -1, "update"); // [env, update]
+			if (lua_type(L, -1) != LUA_TFUNCTION) {
+				lua_pop(L, 2);
+				return;
+			}
+			IsolatedScript& script = state.scripts.emplace();
+			script.owner = src;
+			script.func = luaL_ref(L, LUA_REGISTRYINDEX); // [env]
+			script.environment = luaL_ref(L, LUA_REGISTRYINDEX); // []
+			++m_isolated_count;
+		}
+
+
+		void unregisterIsolated(lua_State* owner)
+		{
+			for (IsolatedState* state : m_isolated_states) {
+				for (i32 i = state->scripts.size() - 1; i >= 0; --i) {
+					const IsolatedScript& script = state->scripts[i];
+					if (script.owner != owner) continue;
+					luaL_unref(state->L, LUA_REGISTRYINDEX, script.func);
+					luaL_unref(state->L, LUA_REGISTRYINDEX, script.environment);
+					state->scripts.swapAndPop(i);
+					--m_isolated_count;
+				}
+			}
+		}
+
+
+		// isolated scripts only read universe, their writes are applied after all of them finished
+		void updateIsolated(float time_delta)
+		{
+			if (m_isolated_count == 0) return;
+			PROFILE_FUNCTION();
+
+			jobs::forEach(m_isolated_states.size(), 1, [&](i32 from, i32 to){
+				PROFILE_BLOCK("isolated scripts");
+				for (i32 i = from; i < to; ++i) {
+					IsolatedState& state = *m_isolated_states[i];
+					lua_State* L = state.L;
+					for (const IsolatedScript& script : state.scripts) {
+						lua_rawgeti(L, LUA_REGISTRYINDEX, script.func);
+						lua_pushnumber(L, time_delta);
+						LuaWrapper::pcall(L, 1, 0);
+					}
+					LuaWrapper::stepGC(L, ISOLATED_GC_BUDGET_MS);
+				}
+			});
+
+			m_universe.beginDeferredTransforms();
+			for (IsolatedState* state : m_isolated_states) {
+				for (const IsolatedCommand& cmd : state->commands) {
+					if (cmd.entity.index < 0 || !m_universe.isValid(cmd.entity)) continue;
+					switch (cmd.type) {
+						case IsolatedCommand::Type::SET_POSITION: m_universe.setPosition(cmd.entity, cmd.pos); break;
+						case IsolatedCommand::Type::SET_ROTATION: m_universe.setRotation(cmd.entity, cmd.rot); break;
+						case IsolatedCommand::Type::SET_SCALE: m_universe.setScale(cmd.entity, cmd.scale); break;
+					}
+				}
+				state->commands.clear();
+			}
+			m_universe.endDeferredTransforms();
+		}
+
+
+		void unregisterUpdate(const UpdateData& update_data)
+		{
+			lua_State* L = update_data.state;
+			// groups are rebuilt next frame, until then the slot is skipped by the dispatcher
+			if (update_data.group_functions != LUA_NOREF) {
+				lua_rawgeti(L, LUA_REGISTRYINDEX, update_data.group_functions);
+				lua_pushboolean(L, false);
+				lua_rawseti(L, -2, update_data.group_slot);
+				lua_pop(L, 1);
+			}
+			luaL_unref(L, LUA_REGISTRYINDEX, update_data.func);
+			m_update_groups_dirty = true;
+		}
+
+
+		void clearUpdates()
+		{
+			lua_State* L = m_system.m_engine.getState();
+			for (const UpdateData& update_data : m_updates) {
+				luaL_unref(L, LUA_REGISTRYINDEX, update_data.func);
+			}
+			for (const UpdateGroup& group : m_update_groups) {
+				luaL_unref(L, LUA_REGISTRYINDEX, group.functions);
+			}
+			m_updates.clear();
+			m_update_groups.clear();
+			m_update_groups_dirty = false;
+			destroyIsolatedStates();
+		}
+
+
+		void rebuildUpdateGroups()
+		{
+			PROFILE_FUNCTION();
+			m_update_groups_dirty = false;
+			lua_State* L = m_system.m_engine.getState();
+			// groups are reused, so they keep accumulated time delta
+			for (UpdateGroup& group : m_update_groups) {
+				luaL_unref(L, LUA_REGISTRYINDEX, group.functions);
+				lua_newtable(L);
+				group.functions = luaL_ref(L, LUA_REGISTRYINDEX);
+				group.count = 0;
+			}
+
+			for (UpdateData& update_data : m_updates) {
+				const u32 bucket = update_data.phase % update_data.interval;
+				UpdateGroup* group = nullptr;
+				for (UpdateGroup& g : m_update_groups) {
+					if (g.interval == update_data.interval && g.bucket == bucket) {
+						group = &g;
+						break;
+					}
+				}
+				if (!group) {
+					group = &m_update_groups.emplace();
+					group->interval = update_data.interval;
+					group->bucket = bucket;
+					group->count = 0;
+					group->time_delta = 0;
+					lua_newtable(L);
+					group->functions = luaL_ref(L, LUA_REGISTRYINDEX);
+				}
+
+				++group->count;
+				update_data.group_functions = group->functions;
+				update_data.group_slot = group->count;
+				lua_rawgeti(L, LUA_REGISTRYINDEX, group->functions); // [fns]
+				lua_rawgeti(L, LUA_REGISTRYINDEX, update_data.func); // [fns, update]
+				lua_rawseti(L, -2, group->count); // [fns]
+				lua_pop(L, 1); // []
+			}
+
+			for (i32 i = m_update_groups.size() - 1; i >= 0; --i) {
+				if (m_update_groups[i].count > 0) continue;
+				luaL_unref(L, LUA_REGISTRYINDEX, m_update_groups[i].functions);
+				m_update_groups.swapAndPop(i);
+			}
+		}
+
+
+		bool initUpdateDispatcher(lua_State* L)
+		{
+			static const char* src = R"#(
+				local logError = LumixAPI.logError
+				return function(fns, count, time_delta)
+					for i = 1, count do
+						local f = fns[i]
+						if f then
+							local ok, err = pcall(f, time_delta)
+							if not ok then logError(err) end
+						end
+					end
+				end
+			)#";
+			if (luaL_loadbuffer(L, src, stringLength(src), "update_dispatcher") != 0) {
+				logError(lua_tostring(L, -1));
+				lua_pop(L, 1);
+				return false;
+			}
+			if (!LuaWrapper::pcall(L, 0, 1)) return false;
+			m_update_dispatcher = luaL_ref(L, LUA_REGISTRYINDEX);
+			return true;
+		}
+
+
 		void setPath(ScriptComponent& cmp, ScriptInstance& inst, const Path& path)
 		{
 			registerAPI();
@@ -1476,15 +2144,7 @@ namespace Lumix
 				lua_pop(instance.m_state, 1);
 				return;
 			}
-			lua_getfield(instance.m_state, -1, "update");
-			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
-			{
-				auto& update_data = m_updates.emplace();
-				update_data.script = instance.m_script;
-				update_data.state = instance.m_state;
-				update_data.environment = instance.m_environment;
-			}
-			lua_pop(instance.m_state, 1);
+			registerUpdate(instance);
 			lua_getfield(instance.m_state, -1, "onInputEvent");
 			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
 			{
@@ -1570,9 +2230,11 @@ namespace Lumix
 			m_gui_scene = nullptr;
 			m_scripts_start_called = false;
 			m_is_game_running = false;
-			m_updates.clear();
+			clearUpdates();
 			m_input_handlers.clear();
 			m_timers.clear();
+			m_timer_heap.clear();
+			m_timer_time = 0;
 			m_animation_scene = nullptr;
 		}
 
@@ -1600,7 +2262,7 @@ namespace Lumix
 				if (prop.name_hash == hash)
 				{
 					if (inst.m_script && inst.m_script->isReady()) return getProperty<T>(prop, property_name, inst);
-					return fromString<T>(prop.stored_value.c_str());
+					return getStoredValue<T>(prop);
 				}
 			}
 			return {};
@@ -1622,7 +2284,7 @@ namespace Lumix
 					if (inst.m_script->isReady())
 						getProperty(prop, property_name, inst, out);
 					else
-						copyString(out, prop.stored_value.c_str());
+						storedValueToString(prop, out);
 					return;
 				}
 			}
@@ -1650,7 +2312,7 @@ namespace Lumix
 			if (out.length() <= 0) return;
 			if (!scr.m_state)
 			{
-				copyString(out, prop.stored_value.c_str());
+				storedValueToString(prop, out);
 				return;
 			}
 
@@ -1660,7 +2322,7 @@ namespace Lumix
 			const int type = lua_type(scr.m_state, -1);
 			if (type == LUA_TNIL)
 			{
-				copyString(out, prop.stored_value.c_str());
+				storedValueToString(prop, out);
 				lua_pop(scr.m_state, 2);
 				return;
 			}
@@ -1724,6 +2386,46 @@ namespace Lumix
 		}
 
 
+		// value of a loaded script is in its environment, otherwise it's stored in the property
+		template <typename T>
+		T getSerializedValue(Property& prop, const char* name, ScriptInstance& scr) {
+			if (scr.m_state) {
+				lua_rawgeti(scr.m_state, LUA_REGISTRYINDEX, scr.m_environment);
+				lua_getfield(scr.m_state, -1, name);
+				const bool is_nil = lua_isnil(scr.m_state, -1);
+				lua_pop(scr.m_state, 2);
+				if (!is_nil) return getProperty<T>(prop, name, scr);
+			}
+			return getStoredValue<T>(prop);
+		}
+
+		// typed, so values do not need to be parsed when loaded, strings and resources are paths
+		void serializeProperty(OutputMemoryStream& serializer, ScriptInstance& scr, Property& prop) {
+			// type is not known until the script is loaded
+			const Property::Type type = prop.type == Property::ANY && !scr.m_state ? prop.stored_type : prop.type;
+			serializer.write(prop.name_hash);
+			serializer.write(type);
+			const char* name = getPropertyName(prop.name_hash);
+			if (!name) {
+				serializer.writeString("");
+				return;
+			}
+
+			switch (type) {
+				case Property::BOOLEAN: serializer.write(getSerializedValue<bool>(prop, name, scr)); break;
+				case Property::FLOAT: serializer.write(getSerializedValue<float>(prop, name, scr)); break;
+				case Property::INT: serializer.write(getSerializedValue<i32>(prop, name, scr)); break;
+				case Property::ENTITY: serializer.write(getSerializedValue<EntityPtr>(prop, name, scr)); break;
+				case Property::COLOR: serializer.write(getSerializedValue<Vec3>(prop, name, scr)); break;
+				default: {
+					char tmp[1024];
+					getProperty(prop, name, scr, Span(tmp));
+					serializer.writeString(tmp);
+					break;
+				}
+			}
+		}
+
 		void serialize(OutputMemoryStream& serializer) override
 		{
 			serializer.write(m_scripts.size());
@@ -1737,28 +2439,31 @@ namespace Lumix
 					serializer.writeString(scr.m_script ? scr.m_script->getPath().c_str() : "");
 					serializer.write(scr.m_flags);
 					serializer.write(scr.m_properties.size());
-					for (Property& prop : scr.m_properties)
-					{
-						serializer.write(prop.name_hash);
-						serializer.write(prop.type);
-						int idx = m_property_names.find(prop.name_hash);
-						if (idx >= 0)
-						{
-							const char* name = m_property_names.at(idx).c_str();
-							char tmp[1024];
-							getProperty(prop, name, scr, Span(tmp));
-							serializer.writeString(tmp);
-						}
-						else
-						{
-							serializer.writeString("");
-						}
-					}
+					for (Property& prop : scr.m_properties) serializeProperty(serializer, scr, prop);
 				}
 			}
 		}
 
 
+		void deserializeProperty(InputMemoryStream& serializer, Property& prop, Property::Type type, const EntityMap& entity_map) {
+			switch (type) {
+				case Property::BOOLEAN: setStoredValue(prop, type, serializer.read<bool>()); break;
+				case Property::FLOAT: setStoredValue(prop, type, serializer.read<float>()); break;
+				case Property::INT: setStoredValue(prop, type, serializer.read<i32>()); break;
+				case Property::ENTITY: setStoredValue(prop, type, entity_map.get(serializer.read<EntityPtr>())); break;
+				case Property::COLOR: setStoredValue(prop, type, serializer.read<Vec3>()); break;
+				case Property::STRING:
+				case Property::RESOURCE:
+					prop.stored_value = serializer.readString();
+					prop.stored_type = type;
+					break;
+				default:
+					prop.stored_value = serializer.readString();
+					prop.stored_type = Property::ANY;
+					break;
+			}
+		}
+
 		void deserialize(InputMemoryStream& serializer, const EntityMap& entity_map, i32 version) override
 		{
 			int len = serializer.read<int>();
@@ -1790,6 +2495,10 @@ namespace Lumix
 						serializer.read(prop.name_hash);
 						Property::Type type;
 						serializer.read(type);
+						if (version > (i32)LuaSceneVersion::TYPED_PROPERTIES) {
+							deserializeProperty(serializer, prop, type, entity_map);
+							continue;
+						}
 						const char* tmp = serializer.readString();
 						if (type == Property::ENTITY) {
 							EntityPtr entity;
@@ -1834,41 +2543,35 @@ namespace Lumix
 		}
 
 
+		// only expired timers are touched
 		void updateTimers(float time_delta)
 		{
-			int timers_to_remove[1024];
-			u32 timers_to_remove_count = 0;
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
+			m_timer_time += time_delta;
+			// strictly earlier, so timers set from callbacks with zero time wait for the next frame
+			while (!m_timer_heap.empty() && m_timer_heap[0].time < m_timer_time)
 			{
-				auto& timer = m_timers[i];
-				timer.time -= time_delta;
-				if (timer.time < 0)
+				const i32 id = m_timer_heap[0].id;
+				popTimerHeap();
+
+				auto iter = m_timers.find(id);
+				if (!iter.isValid()) continue; // cancelled
+
+				// the callback can set or cancel timers
+				const TimerData timer = iter.value();
+				m_timers.erase(iter);
+
+				lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
+				if (lua_type(timer.state, -1) != LUA_TFUNCTION)
 				{
-					lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
-					if (lua_type(timer.state, -1) != LUA_TFUNCTION)
-					{
-						ASSERT(false);
-					}
+					ASSERT(false);
+				}
 
-					if (lua_pcall(timer.state, 0, 0, 0) != 0)
-					{
-						logError(lua_tostring(timer.state, -1));
-						lua_pop(timer.state, 1);
-					}
-					timers_to_remove[timers_to_remove_count] = i;
-					++timers_to_remove_count;
-					if (timers_to_remove_count >= lengthOf(timers_to_remove))
-					{
-						logError("Too many lua timers in one frame, some are not executed");
-						break;
-					}
+				if (lua_pcall(timer.state, 0, 0, 0) != 0)
+				{
+					logError(lua_tostring(timer.state, -1));
+					lua_pop(timer.state, 1);
 				}
-			}
-			for (u32 i = timers_to_remove_count - 1; i != 0xffFFffFF; --i)
-			{
-				auto& timer = m_timers[timers_to_remove[i]];
 				luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
-				m_timers.swapAndPop(timers_to_remove[i]);
 			}
 		}
 
@@ -1974,25 +2677,26 @@ namespace Lumix
 			processInputEvents();
 			updateTimers(time_delta);
 
-			for (int i = 0; i < m_updates.size(); ++i)
-			{
-				CallbackData update_item = m_updates[i];
-				LuaWrapper::DebugGuard guard(update_item.state, 0);
-				lua_rawgeti(update_item.state, LUA_REGISTRYINDEX, update_item.environment);
-				if (lua_type(update_item.state, -1) != LUA_TTABLE)
-				{
-					ASSERT(false);
-				}
-				lua_getfield(update_item.state, -1, "update");
-				if (lua_type(update_item.state, -1) != LUA_TFUNCTION)
-				{
-					lua_pop(update_item.state, 2);
-					continue;
-				}
+			updateIsolated(time_delta);
+
+			if (m_update_groups_dirty) rebuildUpdateGroups();
+			if (m_update_groups.empty()) return;
+
+			lua_State* L = m_system.m_engine.getState();
+			if (m_update_dispatcher == LUA_NOREF && !initUpdateDispatcher(L)) return;
+
+			++m_update_frame;
+			for (UpdateGroup& group : m_update_groups) {
+				group.time_delta += time_delta;
+				if (m_update_frame % group.interval != group.bucket) continue;
 
-				lua_pushnumber(update_item.state, time_delta);
-				LuaWrapper::pcall(update_item.state, 1, 0);
-				lua_pop(update_item.state, 1);
+				LuaWrapper::DebugGuard guard(L);
+				lua_rawgeti(L, LUA_REGISTRYINDEX, m_update_dispatcher);
+				lua_rawgeti(L, LUA_REGISTRYINDEX, group.functions);
+				lua_pushinteger(L, group.count);
+				lua_pushnumber(L, group.time_delta);
+				LuaWrapper::pcall(L, 3, 0);
+				group.time_delta = 0;
 			}
 		}
 
@@ -2114,8 +2818,21 @@ namespace Lumix
 		AssociativeArray<u32, String> m_property_names;
 		Array<CallbackData> m_input_handlers;
 		Universe& m_universe;
-		Array<CallbackData> m_updates;
-		Array<TimerData> m_timers;
+		Array<UpdateData> m_updates;
+		Array<UpdateGroup> m_update_groups;
+		bool m_update_groups_dirty = false;
+		int m_update_dispatcher = LUA_NOREF;
+		u32 m_update_phase = 0;
+		u32 m_update_frame = 0;
+		Array<IsolatedState*> m_isolated_states;
+		u32 m_isolated_count = 0;
+		u32 m_isolated_next = 0;
+		// live timers by handle
+		HashMap<i32, TimerData> m_timers;
+		Array<TimerHeapItem> m_timer_heap;
+		// game time, timers expire at absolute time
+		double m_timer_time = 0;
+		i32 m_next_timer_id = 1;
 		FunctionCall m_function_call;
 		ScriptInstance* m_current_script_instance;
 		bool m_scripts_start_called = false;
@@ -2296,6 +3013,7 @@ namespace Lumix
 				case COLOR: scene.setPropertyValue(e, array_idx, name, v.v3); break;
 				default: ASSERT(false); break;
 			}
+			reflection::journalPropertyChanged(cmp, name);
 		}
 
 		void set(ComponentUID cmp, int array_idx, u32 idx, Value v) const override {
@@ -2313,6 +3031,7 @@ namespace Lumix
 				case LuaScriptScene::Property::Type::COLOR: scene.setPropertyValue(e, array_idx, name, v.v3); break;
 				default: ASSERT(false); break;
 			}
+			reflection::journalPropertyChanged(cmp, name);
 		}
 	};
 
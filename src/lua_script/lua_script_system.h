@@ -41,6 +41,10 @@ struct LuaScriptScene : IScene
 		u32 name_hash;
 		Type type;
 		ResourceType resource_type;
+		// value set before the script is loaded, applied when its environment is created
+		// BOOLEAN, FLOAT, INT, ENTITY and COLOR values are in stored_data, others and ANY (text) are in stored_value
+		Type stored_type = ANY;
+		u8 stored_data[sizeof(float) * 3];
 		String stored_value;
 	};
 
@@ -53,6 +57,8 @@ struct LuaScriptScene : IScene
 		virtual void add(float parameter) = 0;
 		virtual void add(void* parameter) = 0;
 		virtual void add(EntityPtr parameter) = 0;
+		// pushed as an array table
+		virtual void add(Span<const float> parameter) = 0;
 		virtual void addEnvironment(int env) = 0;
 	};
 
@@ -7,6 +7,7 @@
 #include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/lz4.h"
 #include "engine/os.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
@@ -23,6 +24,7 @@
 #include <DetourNavMeshBuilder.h>
 #include <DetourNavMeshQuery.h>
 #include <Recast.h>
+#include <RecastAlloc.h>
 
 
 namespace Lumix
@@ -33,6 +35,7 @@ enum class NavigationSceneVersion : i32 {
 	ZONE_GUID,
 	DETAILED,
 	GENERATOR_PARAMS,
+	OBSTACLES,
 	LATEST
 };
 
@@ -40,10 +43,168 @@ enum class NavigationSceneVersion : i32 {
 static const ComponentType LUA_SCRIPT_TYPE = reflection::getComponentType("lua_script");
 static const ComponentType NAVMESH_ZONE_TYPE = reflection::getComponentType("navmesh_zone");
 static const ComponentType NAVMESH_AGENT_TYPE = reflection::getComponentType("navmesh_agent");
+static const ComponentType NAVMESH_OBSTACLE_TYPE = reflection::getComponentType("navmesh_obstacle");
 static const int CELLS_PER_TILE_SIDE = 256;
+static constexpr i32 MAX_PATH_POLYS = 256; // same as dtCrowd's path result
+static constexpr u32 PATH_CACHE_SIZE = 256;
+static constexpr i32 PATH_SLICE_ITERATIONS = 64; // how often a running path query checks for cancel
+static constexpr i32 LONG_PATH_MIN_TILES = 2; // navigate uses HierGraph if start and destination tiles are at least this far apart
+static constexpr float WAYPOINT_RADIUS = 3.f; // agent continues to the next waypoint of a long path when it's this close
+static constexpr u32 MAX_STREAMING_SOURCES = 8;
+static constexpr u32 NAVMESH_TILE_ALIGNMENT = 4096; // page size, so each tile is copied on write separately
+
+
+// NavmeshFileHeader, NavmeshFileTile for each tile, aligned data of each tile, cache of each tile
+// tile data are added to Detour navmesh directly from copy on write mapped file, Detour writes links to them
+// older files start with tiles count, followed by size and data of each tile and size and data of each cache
+struct NavmeshFileHeader {
+	static constexpr u32 MAGIC = '_LNV';
+	static constexpr u32 VERSION = 0;
+
+	u32 magic = MAGIC;
+	u32 version = VERSION;
+	u32 tiles_x;
+	u32 tiles_z;
+	dtNavMeshParams params;
+};
+
+struct NavmeshFileTile {
+	u64 offset; // from the start of file, multiple of NAVMESH_TILE_ALIGNMENT
+	u64 cache_offset;
+	u32 size; // 0 for empty tiles
+	u32 cache_size;
+};
+
+
+// upright box in zone space, its area is not walkable
+struct ObstacleShape {
+	Vec3 verts[4];
+	float hmin;
+	float hmax;
+};
+
+
+// rebuilds dirty tiles from the tile cache on a worker, results are added to navmesh on the main thread
+struct TileRebuild {
+	struct Tile {
+		Tile(IAllocator& allocator) : cache(allocator) {}
+		u32 x;
+		u32 z;
+		OutputMemoryStream cache;
+		u8* nav_data = nullptr;
+		int nav_data_size = 0;
+		bool success = false;
+	};
+
+	TileRebuild(IAllocator& allocator) : tiles(allocator), obstacles(allocator) {}
+
+	struct NavigationSceneImpl* scene;
+	NavmeshZone zone;
+	Transform zone_tr;
+	Array<Tile> tiles;
+	Array<ObstacleShape> obstacles;
+	jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+	volatile i32 is_finished = 0;
+};
+
+
+// path requests from one findPaths call in one zone, solved on workers
+struct PathBatch {
+	// agents with the same start and end polygons share one query
+	struct Query {
+		dtPolyRef start_ref;
+		dtPolyRef end_ref;
+		Vec3 start_pos;
+		Vec3 end_pos;
+		dtPolyRef path[MAX_PATH_POLYS];
+		i32 path_size = 0;
+		bool partial = false;
+	};
+
+	struct Request {
+		EntityRef entity;
+		u32 path_request; // see Agent::path_request
+		u32 query;
+		Vec3 dest;
+		float speed;
+		float stop_distance;
+	};
+
+	PathBatch(IAllocator& allocator) : queries(allocator), requests(allocator), query_indices(allocator) {}
+
+	dtNavMesh* navmesh;
+	dtNavMeshQuery** worker_queries; // RecastZone::worker_queries
+	Array<Query> queries;
+	Array<Request> requests;
+	HashMap<u64, u32> query_indices;
+	jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+	bool is_started = false;
+	volatile i32 is_finished = 0;
+	volatile i32 cancel = 0;
+};
+
+
+struct CachedPath {
+	explicit CachedPath(IAllocator& allocator) : path(allocator) {}
+
+	Array<dtPolyRef> path;
+	bool partial;
+	u32 last_used;
+};
+
+
+// abstract graph over navmesh tiles, nodes are portals between neighbouring tiles, edges connect portals of the same tile
+// long paths are searched in this graph first and then refined by detour from waypoint to waypoint
+struct HierGraph {
+	struct Node {
+		Vec3 pos;
+		dtPolyRef poly; // valid only while the graph is built
+		u32 first_edge = 0;
+		u32 edges_count = 0;
+	};
+
+	struct Edge {
+		u32 to;
+		float cost;
+	};
+
+	HierGraph(IAllocator& allocator) : nodes(allocator), edges(allocator), tile_nodes(allocator), tile_offsets(allocator) {}
+
+	Span<const u32> getTileNodes(u32 tile) const {
+		return Span<const u32>(tile_nodes.begin() + tile_offsets[tile], tile_nodes.begin() + tile_offsets[tile + 1]);
+	}
+
+	Array<Node> nodes;
+	Array<Edge> edges;
+	// nodes of tile i are tile_nodes[tile_offsets[i]] .. tile_nodes[tile_offsets[i + 1]], each node is in two tiles
+	Array<u32> tile_nodes;
+	Array<u32> tile_offsets;
+};
+
+
+// coarse path of an agent's navigate request, see HierGraph
+struct LongPath {
+	explicit LongPath(IAllocator& allocator) : waypoints(allocator) {}
+
+	Array<Vec3> waypoints; // zone space
+	u32 next = 0;
+	Vec3 dest;
+	DVec3 world_dest;
+	float stop_distance;
+};
 
 
 struct RecastZone {
+	explicit RecastZone(IAllocator& allocator)
+		: tile_cache(allocator)
+		, dirty_tiles(allocator)
+		, path_batches(allocator)
+		, path_cache(allocator)
+		, worker_queries(allocator)
+		, nav_file_data(allocator)
+		, file_tiles(allocator)
+	{}
+
 	EntityRef entity;
 	NavmeshZone zone;
 
@@ -59,9 +220,42 @@ struct RecastZone {
 	rcCompactHeightfield* debug_compact_heightfield = nullptr;
 	rcHeightfield* debug_heightfield = nullptr;
 	rcContourSet* debug_contours = nullptr;
+
+	// compressed rasterized tiles without obstacles, so tiles can be quickly rebuilt when obstacles change
+	Array<OutputMemoryStream> tile_cache;
+	Array<u32> dirty_tiles; // x + z * m_num_tiles_x
+	TileRebuild* rebuild = nullptr;
+
+	// only the first one is running, so it can use worker_queries
+	Array<PathBatch*> path_batches;
+	// key is start poly << 32 | end poly, evicts least recently used
+	HashMap<u64, CachedPath> path_cache;
+	// one per worker, do not resize while a path batch is running
+	Array<dtNavMeshQuery*> worker_queries;
+	HierGraph* graph = nullptr;
+
+	// navmesh file, tiles added from it are owned by it, generated and rebuilt tiles own their data
+	os::MappedFile nav_file;
+	// used instead of nav_file if it can not be mapped, e.g. in packs
+	OutputMemoryStream nav_file_data;
+	Array<NavmeshFileTile> file_tiles;
+
+	u8* getFileData() { return nav_file.data() ? nav_file.getMutableData() : nav_file_data.getMutableData(); }
 };
 
 
+struct Obstacle {
+	EntityRef entity;
+	Vec3 half_extents = Vec3(0.5f);
+	Transform dirty_tr; // transform when tiles were last marked dirty
+};
+
+
+// agents farther than this from the camera do not avoid each other
+static constexpr float AGENT_LOD_DISTANCE = 50.f;
+// far agents (and lod of all agents) are updated only every n-th frame, staggered by entity
+static constexpr u32 AGENT_LOD_PERIOD = 8;
+
 struct Agent
 {
 	enum Flags : u32 {
@@ -78,6 +272,10 @@ struct Agent
 	float speed = 0;
 	float yaw_diff = 0;
 	float stop_distance = 0;
+	bool is_far = false; // cheaper crowd update, see AGENT_LOD_DISTANCE
+	bool is_path_pending = false; // waiting for findPaths
+	u32 path_request = 0; // incremented by each navigation request, so stale findPaths results are ignored
+	bool has_long_path = false; // see m_long_paths
 };
 
 
@@ -90,16 +288,20 @@ struct NavigationSceneImpl final : NavigationScene
 		, m_engine(engine)
 		, m_agents(m_allocator)
 		, m_zones(m_allocator)
+		, m_obstacles(m_allocator)
+		, m_long_paths(m_allocator)
 		, m_script_scene(nullptr)
 		, m_on_update(m_allocator)
 	{
 		m_universe.entityTransformed().bind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().bind<&NavigationSceneImpl::onEntitiesMoved>(this);
 	}
 
 
 	~NavigationSceneImpl()
 	{
 		m_universe.entityTransformed().unbind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<&NavigationSceneImpl::onEntitiesMoved>(this);
 	}
 
 
@@ -110,11 +312,22 @@ struct NavigationSceneImpl final : NavigationScene
 		}
 		m_agents.clear();
 		m_zones.clear();
+		m_obstacles.clear();
+		m_long_paths.clear();
+	}
+
+
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef e : entities) onEntityMoved(e);
 	}
 
 
 	void onEntityMoved(EntityRef entity)
 	{
+		auto obstacle_iter = m_obstacles.find(entity);
+		if (obstacle_iter.isValid()) markDirty(obstacle_iter.value());
+
 		auto iter = m_agents.find(entity);
 		if (!iter.isValid()) return;
 		if (m_moving_agent == entity) return;
@@ -134,18 +347,31 @@ struct NavigationSceneImpl final : NavigationScene
 		const Vec3 pos = Vec3(zone_tr.inverted().transform(agent_pos));
 		if (squaredLength(pos.xz() - (*(Vec3*)dt_agent->npos).xz()) > 0.1f) {
 			const Transform old_zone_tr = m_universe.getTransform(zone.entity);
-			const DVec3 target_pos = old_zone_tr.transform(*(Vec3*)dt_agent->targetPos);
+			DVec3 target_pos = old_zone_tr.transform(*(Vec3*)dt_agent->targetPos);
+			float stop_distance = agent.stop_distance;
+			if (agent.has_long_path) {
+				const LongPath& long_path = m_long_paths[entity];
+				target_pos = long_path.world_dest;
+				stop_distance = long_path.stop_distance;
+			}
 			float speed = dt_agent->params.maxSpeed;
 			zone.crowd->removeAgent(agent.agent);
 			addCrowdAgent(iter.value(), zone);
-			if (!agent.is_finished) {
-				navigate({entity.index}, target_pos, speed, agent.stop_distance);
+			if (!agent.is_finished && !agent.is_path_pending) {
+				navigate({entity.index}, target_pos, speed, stop_distance);
 			}
 		}
 	}
 
 
 	void clearNavmesh(RecastZone& zone) {
+		cancelTileRebuild(zone);
+		cancelPathBatches(zone);
+		freeWorkerQueries(zone);
+		LUMIX_DELETE(m_allocator, zone.graph);
+		zone.graph = nullptr;
+		zone.tile_cache.clear();
+		zone.dirty_tiles.clear();
 		dtFreeNavMeshQuery(zone.navquery);
 		dtFreeNavMesh(zone.navmesh);
 		rcFreeCompactHeightfield(zone.debug_compact_heightfield);
@@ -158,6 +384,10 @@ struct NavigationSceneImpl final : NavigationScene
 		zone.debug_heightfield = nullptr;
 		zone.debug_contours = nullptr;
 		zone.crowd = nullptr;
+		// after the navmesh, which references tile data in them
+		zone.nav_file.close();
+		zone.nav_file_data.free();
+		zone.file_tiles.clear();
 	}
 
 
@@ -328,15 +558,32 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
-	void update(RecastZone& zone, float time_delta) {
+	void update(RecastZone& zone, float time_delta, const DVec3* lod_ref_pos) {
 		if (!zone.crowd) return;
-		zone.crowd->update(time_delta, nullptr);
 
-		const Transform inv_tr = m_universe.getTransform(zone.entity).inverted();
+		const Transform zone_tr = m_universe.getTransform(zone.entity);
+		const float lod_dist2 = AGENT_LOD_DISTANCE * AGENT_LOD_DISTANCE;
+		for (Agent& agent : m_agents) {
+			if (agent.agent < 0) continue;
+			if (agent.zone != zone.entity) continue;
+			if ((agent.entity.index + m_frame) % AGENT_LOD_PERIOD != 0) continue;
+
+			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
+			const bool is_far = lod_ref_pos && squaredLength(zone_tr.transform(*(Vec3*)dt_agent->npos) - *lod_ref_pos) > lod_dist2;
+			if (is_far == agent.is_far) continue;
 
-		for (auto& agent : m_agents) {
+			agent.is_far = is_far;
+			dtCrowdAgentParams params = dt_agent->params;
+			setAgentLODParams(agent, params);
+			zone.crowd->updateAgentParameters(agent.agent, &params);
+		}
+
+		zone.crowd->update(time_delta, nullptr);
+
+		for (Agent& agent : m_agents) {
 			if (agent.agent < 0) continue;
 			if (agent.zone != zone.entity) continue;
+			if (agent.is_far && (agent.entity.index + m_frame) % AGENT_LOD_PERIOD != 0) continue;
 			
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
@@ -354,14 +601,194 @@ struct NavigationSceneImpl final : NavigationScene
 		}
 	}
 
+	struct ZoneUpdateJob {
+		NavigationSceneImpl* scene;
+		Array<RecastZone*>* zones;
+		float time_delta;
+		const DVec3* lod_ref_pos;
+	};
+
 	void update(float time_delta, bool paused) override {
 		PROFILE_FUNCTION();
+		// obstacles can change in editor too
+		for (RecastZone& zone : m_zones) {
+			updateTileRebuild(zone);
+			streamTiles(zone);
+		}
+
 		if (paused) return;
 		if (!m_is_game_running) return;
 		
 		for (RecastZone& zone : m_zones) {
-			update(zone, time_delta);
+			updatePathBatches(zone);
+		}
+
+		++m_frame;
+		DVec3 lod_ref_pos;
+		bool has_lod_ref = false;
+		auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
+		if (render_scene) {
+			const EntityPtr camera = render_scene->getActiveCamera();
+			if (camera.isValid()) {
+				lod_ref_pos = m_universe.getPosition((EntityRef)camera);
+				has_lod_ref = true;
+			}
+		}
+
+		Array<RecastZone*> zones(m_allocator);
+		for (RecastZone& zone : m_zones) {
+			if (zone.crowd) zones.push(&zone);
+		}
+
+		// each crowd has its own navquery and agents, so zones can be updated in parallel
+		ZoneUpdateJob job = { this, &zones, time_delta, has_lod_ref ? &lod_ref_pos : nullptr };
+		jobs::forEach(zones.size(), 1, [&job](i32 from, i32 to){
+			PROFILE_BLOCK("navigation zone update");
+			for (i32 i = from; i < to; ++i) {
+				job.scene->update(*(*job.zones)[i], job.time_delta, job.lod_ref_pos);
+			}
+		});
+	}
+
+	void getObstacleShapes(const RecastZone& zone, Array<ObstacleShape>& shapes) {
+		const Transform inv_zone_tr = m_universe.getTransform(zone.entity).inverted();
+		for (const Obstacle& obstacle : m_obstacles) {
+			const Transform rel_tr = inv_zone_tr * m_universe.getTransform(obstacle.entity);
+			const Vec3 e = obstacle.half_extents;
+			ObstacleShape& shape = shapes.emplace();
+			shape.hmin = FLT_MAX;
+			shape.hmax = -FLT_MAX;
+			for (u32 i = 0; i < 8; ++i) {
+				const Vec3 corner((i & 1) ? e.x : -e.x, (i & 2) ? e.y : -e.y, (i & 4) ? e.z : -e.z);
+				const Vec3 p = Vec3(rel_tr.transform(corner));
+				shape.hmin = minimum(shape.hmin, p.y);
+				shape.hmax = maximum(shape.hmax, p.y);
+			}
+			// bottom face, in order around the box
+			shape.verts[0] = Vec3(rel_tr.transform(Vec3(-e.x, -e.y, -e.z)));
+			shape.verts[1] = Vec3(rel_tr.transform(Vec3(e.x, -e.y, -e.z)));
+			shape.verts[2] = Vec3(rel_tr.transform(Vec3(e.x, -e.y, e.z)));
+			shape.verts[3] = Vec3(rel_tr.transform(Vec3(-e.x, -e.y, e.z)));
+		}
+	}
+
+	void markDirty(RecastZone& zone, const Transform& obstacle_tr, const Vec3& half_extents) {
+		const Transform rel_tr = m_universe.getTransform(zone.entity).inverted() * obstacle_tr;
+		AABB aabb(Vec3(FLT_MAX), Vec3(-FLT_MAX));
+		for (u32 i = 0; i < 8; ++i) {
+			const Vec3 corner((i & 1) ? half_extents.x : -half_extents.x, (i & 2) ? half_extents.y : -half_extents.y, (i & 4) ? half_extents.z : -half_extents.z);
+			aabb.addPoint(Vec3(rel_tr.transform(corner)));
+		}
+		
+		const Vec3 min = -zone.zone.extents;
+		const Vec3 max = zone.zone.extents;
+		if (aabb.max.x < min.x || aabb.max.z < min.z || aabb.min.x > max.x || aabb.min.z > max.z) return;
+		if (aabb.max.y < min.y || aabb.min.y > max.y) return;
+
+		// tiles are rasterized with border, so their neighbours are affected too
+		const float tile_size = CELLS_PER_TILE_SIDE * zone.zone.cell_size;
+		const float border = (1 + zone.getBorderSize()) * zone.zone.cell_size;
+		const i32 from_x = maximum(0, i32((aabb.min.x - border - min.x) / tile_size));
+		const i32 from_z = maximum(0, i32((aabb.min.z - border - min.z) / tile_size));
+		const i32 to_x = minimum((i32)zone.m_num_tiles_x - 1, i32((aabb.max.x + border - min.x) / tile_size));
+		const i32 to_z = minimum((i32)zone.m_num_tiles_z - 1, i32((aabb.max.z + border - min.z) / tile_size));
+		for (i32 z = from_z; z <= to_z; ++z) {
+			for (i32 x = from_x; x <= to_x; ++x) {
+				const u32 tile = x + z * zone.m_num_tiles_x;
+				if (zone.dirty_tiles.indexOf(tile) < 0) zone.dirty_tiles.push(tile);
+			}
+		}
+	}
+
+	// both the old and the new footprint of the obstacle must be rebuilt
+	void markDirty(Obstacle& obstacle) {
+		const Transform tr = m_universe.getTransform(obstacle.entity);
+		for (RecastZone& zone : m_zones) {
+			if (!zone.navmesh) continue;
+			markDirty(zone, obstacle.dirty_tr, obstacle.half_extents);
+			markDirty(zone, tr, obstacle.half_extents);
 		}
+		obstacle.dirty_tr = tr;
+	}
+
+	static void rebuildTilesJob(void* data) {
+		PROFILE_FUNCTION();
+		TileRebuild* rebuild = (TileRebuild*)data;
+		jobs::forEach(rebuild->tiles.size(), 1, [rebuild](i32 from, i32 to){
+			for (i32 i = from; i < to; ++i) {
+				TileRebuild::Tile& tile = rebuild->tiles[i];
+				rebuild->scene->rebuildTile(*rebuild, tile);
+			}
+		});
+		memoryBarrier();
+		rebuild->is_finished = 1;
+	}
+
+	void rebuildTile(const TileRebuild& rebuild, TileRebuild::Tile& tile) {
+		PROFILE_FUNCTION();
+		const rcConfig config = getTileConfig(rebuild.zone, tile.x, tile.z);
+		rcCompactHeightfield* chf = decompressTile(tile.cache);
+		if (!chf) {
+			// e.g. navmesh was saved without tile cache
+			chf = rasterizeTile(rebuild.zone_tr, config, nullptr);
+			if (!chf) return;
+			compressTile(*chf, tile.cache);
+		}
+		tile.success = buildTileData(rebuild.zone, config, tile.x, tile.z, *chf, rebuild.obstacles, nullptr, &tile.nav_data, &tile.nav_data_size);
+		rcFreeCompactHeightfield(chf);
+	}
+
+	void cancelTileRebuild(RecastZone& zone) {
+		if (!zone.rebuild) return;
+		jobs::wait(zone.rebuild->signal);
+		for (TileRebuild::Tile& tile : zone.rebuild->tiles) {
+			if (tile.nav_data) dtFree(tile.nav_data);
+		}
+		LUMIX_DELETE(m_allocator, zone.rebuild);
+		zone.rebuild = nullptr;
+	}
+
+	void updateTileRebuild(RecastZone& zone) {
+		if (zone.rebuild) {
+			if (!zone.rebuild->is_finished) return;
+
+			PROFILE_BLOCK("add rebuilt tiles");
+			jobs::wait(zone.rebuild->signal);
+			// path queries read the navmesh
+			finishRunningPathBatch(zone);
+			zone.path_cache.clear();
+			for (TileRebuild::Tile& tile : zone.rebuild->tiles) {
+				if (!tile.success) continue;
+				zone.navmesh->removeTile(zone.navmesh->getTileRefAt(tile.x, tile.z, 0), 0, 0);
+				zone.tile_cache[tile.x + tile.z * zone.m_num_tiles_x] = static_cast<OutputMemoryStream&&>(tile.cache);
+				if (!tile.nav_data) continue;
+				if (dtStatusFailed(zone.navmesh->addTile(tile.nav_data, tile.nav_data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+					logError("Could not add Detour tile.");
+					dtFree(tile.nav_data);
+				}
+				tile.nav_data = nullptr;
+			}
+			LUMIX_DELETE(m_allocator, zone.rebuild);
+			zone.rebuild = nullptr;
+		}
+
+		if (zone.dirty_tiles.empty() || !zone.navmesh) return;
+
+		PROFILE_BLOCK("start tiles rebuild");
+		TileRebuild* rebuild = LUMIX_NEW(m_allocator, TileRebuild)(m_allocator);
+		rebuild->scene = this;
+		rebuild->zone = zone.zone;
+		rebuild->zone_tr = m_universe.getTransform(zone.entity);
+		getObstacleShapes(zone, rebuild->obstacles);
+		for (u32 tile_idx : zone.dirty_tiles) {
+			TileRebuild::Tile& tile = rebuild->tiles.emplace(m_allocator);
+			tile.x = tile_idx % zone.m_num_tiles_x;
+			tile.z = tile_idx / zone.m_num_tiles_x;
+			tile.cache = zone.tile_cache[tile_idx];
+		}
+		zone.dirty_tiles.clear();
+		zone.rebuild = rebuild;
+		jobs::run(rebuild, &rebuildTilesJob, &rebuild->signal, jobs::Priority::LOW);
 	}
 
 	void lateUpdate(RecastZone& zone, float time_delta) {
@@ -398,7 +825,12 @@ struct NavigationSceneImpl final : NavigationScene
 				*(Vec3*)dt_agent->npos = Vec3(zone_tr.inverted().transform(m_universe.getPosition(agent.entity)));
 			}
 
-			if (dt_agent->ncorners == 0 && dt_agent->targetState != DT_CROWDAGENT_TARGET_REQUESTING) {
+			if (agent.has_long_path) updateLongPath(zone, agent);
+
+			if (agent.is_path_pending || agent.has_long_path) {
+				agent.is_finished = false;
+			}
+			else if (dt_agent->ncorners == 0 && dt_agent->targetState != DT_CROWDAGENT_TARGET_REQUESTING) {
 				if (!agent.is_finished) {
 					zone.crowd->resetMoveTarget(agent.agent);
 					agent.is_finished = true;
@@ -445,7 +877,7 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
-	static void drawPoly(RenderScene* render_scene, const Transform& tr, const dtMeshTile& tile, const dtPoly& poly)
+	static void drawPoly(DebugShapes& shapes, const Transform& tr, const dtMeshTile& tile, const dtPoly& poly)
 	{
 		const unsigned int ip = (unsigned int)(&poly - tile.polys);
 		const dtPolyDetail& pd = tile.detailMeshes[ip];
@@ -465,7 +897,7 @@ struct NavigationSceneImpl final : NavigationScene
 					v[k] = *(Vec3*)&tile.detailVerts[(pd.vertBase + t[k] - poly.vertCount) * 3];
 				}
 			}
-			render_scene->addDebugTriangle(tr.transform(v[0]), tr.transform(v[1]), tr.transform(v[2]), 0xff00aaff);
+			shapes.addTriangle(tr.transform(v[0]), tr.transform(v[1]), tr.transform(v[2]), 0xff00aaff);
 		}
 
 		for (int k = 0; k < pd.triCount; ++k)
@@ -482,7 +914,7 @@ struct NavigationSceneImpl final : NavigationScene
 			for (int m = 0, n = 2; m < 3; n = m++)
 			{
 				if (((t[3] >> (n * 2)) & 0x3) == 0) continue; // Skip inner detail edges.
-				render_scene->addDebugLine(tr.transform(*(Vec3*)tv[n]), tr.transform(*(Vec3*)tv[m]), 0xff0000ff);
+				shapes.addLine(tr.transform(*(Vec3*)tv[n]), tr.transform(*(Vec3*)tv[m]), 0xff0000ff);
 			}
 		}
 	}
@@ -527,14 +959,17 @@ struct NavigationSceneImpl final : NavigationScene
 
 		const dtPolyRef* path = dt_agent->corridor.getPath();
 		const int npath = dt_agent->corridor.getPathCount();
+		DebugShapes shapes(m_allocator);
 		for (int j = 0; j < npath; ++j) {
 			dtPolyRef ref = path[j];
 			const dtMeshTile* tile = nullptr;
 			const dtPoly* poly = nullptr;
 			if (dtStatusFailed(zone.navmesh->getTileAndPolyByRef(ref, &tile, &poly))) continue;
 
-			drawPoly(render_scene, zone_tr, *tile, *poly);
+			drawPoly(shapes, zone_tr, *tile, *poly);
 		}
+		if (!shapes.lines.empty()) memcpy(render_scene->addDebugLines(shapes.lines.size()), shapes.lines.begin(), shapes.lines.byte_size());
+		if (!shapes.triangles.empty()) memcpy(render_scene->addDebugTriangles(shapes.triangles.size()), shapes.triangles.begin(), shapes.triangles.byte_size());
 
 		Vec3 prev = *(Vec3*)dt_agent->npos;
 		for (int i = 0; i < dt_agent->ncorners; ++i) {
@@ -608,52 +1043,139 @@ struct NavigationSceneImpl final : NavigationScene
 			}
 
 			RecastZone& zone = iter.value();
-			if (!scene.initNavmesh(zone)) {
-				LUMIX_DELETE(scene.m_allocator, this);
-				return;
+			// tiles are added from the buffer without copying
+			zone.nav_file_data.resize(size);
+			memcpy(zone.nav_file_data.getMutableData(), mem, size);
+			if (!scene.initFromFile(zone, zone.nav_file_data.getMutableData(), size)) {
+				logError("Could not load navmesh, GUID ", zone.zone.guid);
+				scene.clearNavmesh(zone);
 			}
 
-			InputMemoryStream file(mem, size);
-			file.read(zone.m_num_tiles_x);
-			file.read(zone.m_num_tiles_z);
-			dtNavMeshParams params;
-			file.read(&params, sizeof(params));
-			if (dtStatusFailed(zone.navmesh->init(&params))) {
+			LUMIX_DELETE(scene.m_allocator, this);
+		}
+
+		NavigationSceneImpl& scene;
+		EntityRef entity;
+	};
+
+	// older files, tiles are copied
+	bool loadLegacyFile(RecastZone& zone, InputMemoryStream& file) {
+		file.read(zone.m_num_tiles_x);
+		file.read(zone.m_num_tiles_z);
+		dtNavMeshParams params;
+		file.read(&params, sizeof(params));
+		if (dtStatusFailed(zone.navmesh->init(&params))) {
+			logError("Could not init Detour navmesh");
+			return false;
+		}
+		for (u32 j = 0; j < zone.m_num_tiles_z; ++j) {
+			for (u32 i = 0; i < zone.m_num_tiles_x; ++i) {
+				int data_size;
+				file.read(&data_size, sizeof(data_size));
+				if (data_size == 0) continue;
+				u8* data = (u8*)dtAlloc(data_size, DT_ALLOC_PERM);
+				file.read(data, data_size);
+				if (dtStatusFailed(zone.navmesh->addTile(data, data_size, DT_TILE_FREE_DATA, 0, 0))) {
+					dtFree(data);
+					return false;
+				}
+			}
+		}
+
+		// tile cache is optional, older files do not have it
+		for (u32 i = 0, c = zone.m_num_tiles_x * zone.m_num_tiles_z; i < c; ++i) {
+			OutputMemoryStream& cache = zone.tile_cache.emplace(m_allocator);
+			u32 cache_size = 0;
+			if (file.getPosition() < file.size()) file.read(cache_size);
+			if (cache_size == 0) continue;
+			cache.resize(cache_size);
+			file.read(cache.getMutableData(), cache_size);
+		}
+		return true;
+	}
+
+	// tile is added only if it's not in navmesh yet
+	bool addFileTile(RecastZone& zone, u32 x, u32 z) {
+		const NavmeshFileTile& tile = zone.file_tiles[x + z * zone.m_num_tiles_x];
+		if (tile.size == 0 || zone.navmesh->getTileRefAt(x, z, 0)) return true;
+		// data are owned by the file
+		if (dtStatusFailed(zone.navmesh->addTile(zone.getFileData() + tile.offset, tile.size, 0, 0, nullptr))) {
+			logError("Could not add Detour tile.");
+			return false;
+		}
+		return true;
+	}
+
+	// `data` must stay valid while navmesh exists, tiles are not copied
+	bool initFromFile(RecastZone& zone, u8* data, u64 size) {
+		if (!initNavmesh(zone)) return false;
+
+		NavmeshFileHeader header;
+		header.magic = 0;
+		if (size >= sizeof(header)) memcpy(&header, data, sizeof(header));
+		if (header.magic != NavmeshFileHeader::MAGIC) {
+			InputMemoryStream file(data, size);
+			if (!loadLegacyFile(zone, file)) return false;
+			// tiles are copied, buffer is not needed anymore
+			zone.nav_file.close();
+			zone.nav_file_data.free();
+		}
+		else {
+			if (header.version > NavmeshFileHeader::VERSION) {
+				logError("Unsupported navmesh version ", header.version);
+				return false;
+			}
+			const u32 count = header.tiles_x * header.tiles_z;
+			if (size < sizeof(header) + count * sizeof(NavmeshFileTile)) return false;
+			if (dtStatusFailed(zone.navmesh->init(&header.params))) {
 				logError("Could not init Detour navmesh");
-				LUMIX_DELETE(scene.m_allocator, this);
-				return;
+				return false;
 			}
-			for (u32 j = 0; j < zone.m_num_tiles_z; ++j) {
-				for (u32 i = 0; i < zone.m_num_tiles_x; ++i) {
-					int data_size;
-					file.read(&data_size, sizeof(data_size));
-					u8* data = (u8*)dtAlloc(data_size, DT_ALLOC_PERM);
-					file.read(data, data_size);
-					if (dtStatusFailed(zone.navmesh->addTile(data, data_size, DT_TILE_FREE_DATA, 0, 0))) {
-						dtFree(data);
-						LUMIX_DELETE(scene.m_allocator, this);
-						return;
-					}
+			zone.m_num_tiles_x = header.tiles_x;
+			zone.m_num_tiles_z = header.tiles_z;
+			zone.file_tiles.resize(count);
+			memcpy(zone.file_tiles.begin(), data + sizeof(header), count * sizeof(NavmeshFileTile));
+			for (const NavmeshFileTile& tile : zone.file_tiles) {
+				if (tile.offset % NAVMESH_TILE_ALIGNMENT != 0 || tile.offset + tile.size > size || tile.cache_offset + tile.cache_size > size) {
+					logError("Corrupted navmesh file");
+					return false;
 				}
+				OutputMemoryStream& cache = zone.tile_cache.emplace(m_allocator);
+				if (tile.cache_size > 0) cache.write(data + tile.cache_offset, tile.cache_size);
 			}
 
-			if (!zone.crowd) scene.initCrowd(zone);
-
-			LUMIX_DELETE(scene.m_allocator, this);
+			// streamed tiles are added in update
+			if (!(zone.zone.flags & NavmeshZone::STREAMED)) {
+				for (u32 z = 0; z < zone.m_num_tiles_z; ++z) {
+					for (u32 x = 0; x < zone.m_num_tiles_x; ++x) {
+						if (!addFileTile(zone, x, z)) return false;
+					}
+				}
+			}
 		}
 
-		NavigationSceneImpl& scene;
-		EntityRef entity;
-	};
+		buildGraph(zone);
+		if (!zone.crowd) initCrowd(zone);
+		return true;
+	}
 
 	bool loadZone(EntityRef zone_entity) override {
 		RecastZone& zone = m_zones[zone_entity];
 		clearNavmesh(zone);
 
-		LoadCallback* lcb = LUMIX_NEW(m_allocator, LoadCallback)(*this, zone_entity);
-
 		StaticString<LUMIX_MAX_PATH> path("universes/navzones/", zone.zone.guid, ".nav");
 		FileSystem& fs = m_engine.getFileSystem();
+
+		// pages of mapped file are read only when tiles are added
+		const StaticString<LUMIX_MAX_PATH> full_path(fs.getBasePath(), path);
+		if (zone.nav_file.open(full_path, true)) {
+			if (initFromFile(zone, zone.nav_file.getMutableData(), zone.nav_file.size())) return true;
+			logError("Could not load navmesh ", full_path);
+			clearNavmesh(zone);
+			return false;
+		}
+
+		LoadCallback* lcb = LUMIX_NEW(m_allocator, LoadCallback)(*this, zone_entity);
 		return fs.getContent(Path(path), makeDelegate<&LoadCallback::fileLoaded>(lcb)).isValid();
 	}
 
@@ -661,26 +1183,122 @@ struct NavigationSceneImpl final : NavigationScene
 		RecastZone& zone = m_zones[zone_entity];
 		if (!zone.navmesh) return false;
 
+		NavmeshFileHeader header;
+		header.tiles_x = zone.m_num_tiles_x;
+		header.tiles_z = zone.m_num_tiles_z;
+		header.params = *zone.navmesh->getParams();
+
+		const u32 count = zone.m_num_tiles_x * zone.m_num_tiles_z;
+		Array<NavmeshFileTile> tiles(m_allocator);
+		tiles.resize(count);
+		OutputMemoryStream blob(m_allocator);
+		blob.write(header);
+		blob.resize(sizeof(header) + count * sizeof(NavmeshFileTile));
+		for (u32 j = 0; j < zone.m_num_tiles_z; ++j) {
+			for (u32 i = 0; i < zone.m_num_tiles_x; ++i) {
+				NavmeshFileTile& dst = tiles[i + j * zone.m_num_tiles_x];
+				const dtMeshTile* tile = zone.navmesh->getTileAt(i, j, 0);
+				const u8* data = nullptr;
+				dst.size = 0;
+				if (tile && tile->header) {
+					data = tile->data;
+					dst.size = tile->dataSize;
+				}
+				else if (!zone.file_tiles.empty()) {
+					// streamed out, empty tiles do not exist
+					const NavmeshFileTile& src = zone.file_tiles[i + j * zone.m_num_tiles_x];
+					data = zone.getFileData() + src.offset;
+					dst.size = src.size;
+				}
+				blob.resize((blob.size() + NAVMESH_TILE_ALIGNMENT - 1) & ~u64(NAVMESH_TILE_ALIGNMENT - 1));
+				dst.offset = blob.size();
+				if (dst.size) blob.write(data, dst.size);
+			}
+		}
+
+		for (u32 i = 0; i < count; ++i) {
+			const OutputMemoryStream& cache = zone.tile_cache[i];
+			tiles[i].cache_offset = blob.size();
+			tiles[i].cache_size = (u32)cache.size();
+			blob.write(cache.data(), cache.size());
+		}
+		memcpy(blob.getMutableData() + sizeof(header), tiles.begin(), tiles.byte_size());
+
+		// mapped file can not be overwritten, it's reloaded after it's saved
+		const bool reload = zone.nav_file.data();
+		if (reload) clearNavmesh(zone);
+
 		FileSystem& fs = m_engine.getFileSystem();
-		
 		os::OutputFile file;
 		StaticString<LUMIX_MAX_PATH> path("universes/navzones/", zone.zone.guid, ".nav");
-		if (!fs.open(path, file)) return false;
+		bool success = fs.open(path, file);
+		if (success) {
+			success = file.write(blob.data(), blob.size());
+			file.close();
+		}
+		if (reload) loadZone(zone_entity);
+		return success;
+	}
+
+	void setStreamingSource(u32 idx, const DVec3& pos) override {
+		ASSERT(idx < MAX_STREAMING_SOURCES);
+		m_streaming_sources[idx].pos = pos;
+		m_streaming_sources[idx].active = true;
+	}
+
+	void removeStreamingSource(u32 idx) override {
+		ASSERT(idx < MAX_STREAMING_SOURCES);
+		m_streaming_sources[idx].active = false;
+	}
+
+	void setStreamingRadius(float load_radius, float unload_radius) override {
+		ASSERT(unload_radius >= load_radius);
+		m_streaming_load_radius = load_radius;
+		m_streaming_unload_radius = unload_radius;
+	}
+
+	// adds file tiles closer than load radius to any streaming source, removes tiles further than unload radius from all of them
+	void streamTiles(RecastZone& zone) {
+		if (!(zone.zone.flags & NavmeshZone::STREAMED) || zone.file_tiles.empty() || !zone.navmesh) return;
+
+		const Transform zone_tr = m_universe.getTransform(zone.entity).inverted();
+		Vec2 sources[MAX_STREAMING_SOURCES];
+		u32 sources_count = 0;
+		for (const StreamingSource& src : m_streaming_sources) {
+			if (src.active) sources[sources_count++] = Vec3(zone_tr.transform(src.pos)).xz();
+		}
 
-		bool success = file.write(zone.m_num_tiles_x);
-		success = success && file.write(zone.m_num_tiles_z);
 		const dtNavMeshParams* params = zone.navmesh->getParams();
-		success = success && file.write(params, sizeof(*params));
-		for (u32 j = 0; j < zone.m_num_tiles_z; ++j) {
-			for (u32 i = 0; i < zone.m_num_tiles_x; ++i) {
-				const auto* tile = zone.navmesh->getTileAt(i, j, 0);
-				success = success && file.write(&tile->dataSize, sizeof(tile->dataSize));
-				success = success && file.write(tile->data, tile->dataSize);
+		const float load_radius2 = m_streaming_load_radius * m_streaming_load_radius;
+		const float unload_radius2 = m_streaming_unload_radius * m_streaming_unload_radius;
+		bool changed = false;
+		for (u32 z = 0; z < zone.m_num_tiles_z; ++z) {
+			for (u32 x = 0; x < zone.m_num_tiles_x; ++x) {
+				const Vec2 tile_min(params->orig[0] + x * params->tileWidth, params->orig[2] + z * params->tileHeight);
+				const Vec2 tile_max = tile_min + Vec2(params->tileWidth, params->tileHeight);
+				float dist2 = FLT_MAX;
+				for (u32 i = 0; i < sources_count; ++i) {
+					const Vec2 closest(clamp(sources[i].x, tile_min.x, tile_max.x), clamp(sources[i].y, tile_min.y, tile_max.y));
+					dist2 = minimum(dist2, squaredLength(sources[i] - closest));
+				}
+
+				const dtTileRef ref = zone.navmesh->getTileRefAt(x, z, 0);
+				const bool load = !ref && dist2 < load_radius2 && zone.file_tiles[x + z * zone.m_num_tiles_x].size > 0;
+				const bool unload = ref && dist2 > unload_radius2;
+				if (!load && !unload) continue;
+
+				if (!changed) {
+					// path queries read the navmesh
+					finishRunningPathBatch(zone);
+					zone.path_cache.clear();
+					changed = true;
+				}
+				if (load) addFileTile(zone, x, z);
+				// tiles from file do not own their data, rebuilt tiles are freed
+				else zone.navmesh->removeTile(ref, nullptr, nullptr);
 			}
 		}
-
-		file.close();
-		return success;
+		if (changed) buildGraph(zone);
 	}
 
 
@@ -757,7 +1375,7 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
-	static void drawPolyBoundaries(RenderScene* render_scene,
+	static void drawPolyBoundaries(DebugShapes& shapes,
 		const Transform& tr,
 		const dtMeshTile& tile,
 		const unsigned int col,
@@ -824,7 +1442,7 @@ struct NavigationSceneImpl final : NavigationScene
 						if (((t[3] >> (n * 2)) & 0x3) == 0) continue; // Skip inner detail edges.
 						if (distancePtLine2d(tv[n], v0, v1) < thr && distancePtLine2d(tv[m], v0, v1) < thr)
 						{
-							render_scene->addDebugLine(tr.transform(*(Vec3*)tv[n] + Vec3(0, 0.5f, 0))
+							shapes.addLine(tr.transform(*(Vec3*)tv[n] + Vec3(0, 0.5f, 0))
 								, tr.transform(*(Vec3*)tv[m] + Vec3(0, 0.5f, 0))
 								, c);
 						}
@@ -834,7 +1452,7 @@ struct NavigationSceneImpl final : NavigationScene
 		}
 	}
 
-	static void drawTilePortal(RenderScene* render_scene, const Transform& zone_tr, const dtMeshTile& tile) {
+	static void drawTilePortal(DebugShapes& shapes, const Transform& zone_tr, const dtMeshTile& tile) {
 		const float padx = 0.04f;
 		const float pady = tile.header->walkableClimb;
 
@@ -856,20 +1474,20 @@ struct NavigationSceneImpl final : NavigationScene
 
 						const float x = va[0] + ((side == 0) ? -padx : padx);
 
-						render_scene->addDebugLine(zone_tr.transform(Vec3(x, va[1] - pady, va[2])), zone_tr.transform(Vec3(x, va[1] + pady, va[2])), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(x, va[1] + pady, va[2])), zone_tr.transform(Vec3(x, vb[1] + pady, vb[2])), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(x, vb[1] + pady, vb[2])), zone_tr.transform(Vec3(x, vb[1] - pady, vb[2])), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(x, vb[1] - pady, vb[2])), zone_tr.transform(Vec3(x, va[1] - pady, va[2])), col);
+						shapes.addLine(zone_tr.transform(Vec3(x, va[1] - pady, va[2])), zone_tr.transform(Vec3(x, va[1] + pady, va[2])), col);
+						shapes.addLine(zone_tr.transform(Vec3(x, va[1] + pady, va[2])), zone_tr.transform(Vec3(x, vb[1] + pady, vb[2])), col);
+						shapes.addLine(zone_tr.transform(Vec3(x, vb[1] + pady, vb[2])), zone_tr.transform(Vec3(x, vb[1] - pady, vb[2])), col);
+						shapes.addLine(zone_tr.transform(Vec3(x, vb[1] - pady, vb[2])), zone_tr.transform(Vec3(x, va[1] - pady, va[2])), col);
 					}
 					else if (side == 2 || side == 6) {
 						unsigned int col = side == 2 ? 0xff00aa00 : 0xffaaaa00;
 
 						const float z = va[2] + ((side == 2) ? -padx : padx);
 
-						render_scene->addDebugLine(zone_tr.transform(Vec3(va[0], va[1] - pady, z)), zone_tr.transform(Vec3(va[0], va[1] + pady, z)), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(va[0], va[1] + pady, z)), zone_tr.transform(Vec3(vb[0], vb[1] + pady, z)), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(vb[0], vb[1] + pady, z)), zone_tr.transform(Vec3(vb[0], vb[1] - pady, z)), col);
-						render_scene->addDebugLine(zone_tr.transform(Vec3(vb[0], vb[1] - pady, z)), zone_tr.transform(Vec3(va[0], va[1] - pady, z)), col);
+						shapes.addLine(zone_tr.transform(Vec3(va[0], va[1] - pady, z)), zone_tr.transform(Vec3(va[0], va[1] + pady, z)), col);
+						shapes.addLine(zone_tr.transform(Vec3(va[0], va[1] + pady, z)), zone_tr.transform(Vec3(vb[0], vb[1] + pady, z)), col);
+						shapes.addLine(zone_tr.transform(Vec3(vb[0], vb[1] + pady, z)), zone_tr.transform(Vec3(vb[0], vb[1] - pady, z)), col);
+						shapes.addLine(zone_tr.transform(Vec3(vb[0], vb[1] - pady, z)), zone_tr.transform(Vec3(va[0], va[1] - pady, z)), col);
 					}
 				}
 			}
@@ -897,16 +1515,34 @@ struct NavigationSceneImpl final : NavigationScene
 		const dtMeshTile* tile = zone.navmesh->getTileAt(x, z, 0);
 		if (!tile) return;
 
-		for (int i = 0; i < tile->header->polyCount; ++i) {
-			const dtPoly* p = &tile->polys[i];
-			if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) continue;
-			drawPoly(render_scene, tr, *tile, *p);
-		}
+		// tile is uploaded to GPU only when it or the options change, it's built in zone's space
+		NavmeshDebugShape& cache = m_navmesh_debug_shape;
+		const u8 flags = (inner_boundaries ? 1 : 0) | (outer_boundaries ? 2 : 0) | (portals ? 4 : 0);
+		if (cache.render_scene != render_scene) {
+			cache = {};
+			cache.render_scene = render_scene;
+			cache.shape = render_scene->createStaticDebugShape();
+		}
+		if (cache.zone.index != zone_entity.index || cache.tile != tile || cache.salt != tile->salt || cache.flags != flags) {
+			cache.zone = zone_entity;
+			cache.tile = tile;
+			cache.salt = tile->salt;
+			cache.flags = flags;
+
+			DebugShapes shapes(m_allocator);
+			for (int i = 0; i < tile->header->polyCount; ++i) {
+				const dtPoly* p = &tile->polys[i];
+				if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION) continue;
+				drawPoly(shapes, Transform::IDENTITY, *tile, *p);
+			}
 
-		if (outer_boundaries) drawPolyBoundaries(render_scene, tr, *tile, 0xffff0000, false);
-		if (inner_boundaries) drawPolyBoundaries(render_scene, tr, *tile, 0xffff0000, true);
+			if (outer_boundaries) drawPolyBoundaries(shapes, Transform::IDENTITY, *tile, 0xffff0000, false);
+			if (inner_boundaries) drawPolyBoundaries(shapes, Transform::IDENTITY, *tile, 0xffff0000, true);
 
-		if (portals) drawTilePortal(render_scene, tr, *tile);
+			if (portals) drawTilePortal(shapes, Transform::IDENTITY, *tile);
+			render_scene->setStaticDebugShape(cache.shape, shapes);
+		}
+		render_scene->drawStaticDebugShape(cache.shape, tr);
 	}
 
 
@@ -914,11 +1550,13 @@ struct NavigationSceneImpl final : NavigationScene
 	{
 		m_is_game_running = false;
 		for (RecastZone& zone : m_zones) {
+			cancelPathBatches(zone);
 			if (zone.crowd) {
 				for (Agent& agent : m_agents) {
 					if (agent.zone == zone.entity) {
 						zone.crowd->removeAgent(agent.agent);
 						agent.agent = -1;
+						clearLongPath(agent);
 					}
 				}
 				dtFreeCrowd(zone.crowd);
@@ -979,6 +1617,9 @@ struct NavigationSceneImpl final : NavigationScene
 		if (iter == m_agents.end()) return;
 
 		Agent& agent = iter.value();
+		++agent.path_request;
+		agent.is_path_pending = false;
+		clearLongPath(agent);
 		if (agent.agent < 0) return;
 		
 		RecastZone* zone = getZone(agent);
@@ -1011,6 +1652,9 @@ struct NavigationSceneImpl final : NavigationScene
 		if (iter == m_agents.end()) return false;
 		
 		Agent& agent = iter.value();
+		++agent.path_request;
+		agent.is_path_pending = false;
+		clearLongPath(agent);
 		if (agent.agent < 0) return false;
 		if (!agent.zone.isValid()) return false;
 
@@ -1030,6 +1674,25 @@ struct NavigationSceneImpl final : NavigationScene
 		dtCrowdAgentParams params = zone.crowd->getAgent(agent.agent)->params;
 		params.maxSpeed = speed;
 		zone.crowd->updateAgentParameters(agent.agent, &params);
+
+		if (end_poly_ref && zone.graph) {
+			// too far for detour's node pool, search the tile graph and walk from waypoint to waypoint
+			LongPath long_path(m_allocator);
+			const Vec3 from = *(Vec3*)zone.crowd->getAgent(agent.agent)->npos;
+			if (isLongPath(zone, from, dest) && findCoarsePath(zone, from, dest, long_path.waypoints)) {
+				long_path.dest = dest;
+				long_path.world_dest = world_dest;
+				long_path.stop_distance = stop_distance;
+				const Vec3 waypoint = long_path.waypoints[0];
+				m_long_paths.insert(entity, static_cast<LongPath&&>(long_path));
+				agent.has_long_path = true;
+				agent.stop_distance = 0;
+				agent.is_finished = false;
+				requestWaypoint(zone, agent, waypoint);
+				return true;
+			}
+		}
+
 		if (zone.crowd->requestMoveTarget(agent.agent, end_poly_ref, &dest.x)) {
 			agent.stop_distance = stop_distance;
 			agent.is_finished = false;
@@ -1041,6 +1704,593 @@ struct NavigationSceneImpl final : NavigationScene
 		return !agent.is_finished;
 	}
 
+	void clearLongPath(Agent& agent) {
+		if (!agent.has_long_path) return;
+		m_long_paths.erase(agent.entity);
+		agent.has_long_path = false;
+	}
+
+	void requestWaypoint(RecastZone& zone, Agent& agent, const Vec3& pos) {
+		static const float ext[] = { 1.0f, 20.0f, 1.0f };
+		dtQueryFilter filter;
+		dtPolyRef poly = 0;
+		zone.navquery->findNearestPoly(&pos.x, ext, &filter, &poly, 0);
+		if (!zone.crowd->requestMoveTarget(agent.agent, poly, &pos.x)) {
+			logError("requestMoveTarget failed");
+			clearLongPath(agent);
+			agent.is_finished = true;
+		}
+	}
+
+	void updateLongPath(RecastZone& zone, Agent& agent) {
+		LongPath& long_path = m_long_paths[agent.entity];
+		const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
+		const Vec3 pos = *(Vec3*)dt_agent->npos;
+		const bool reached = dt_agent->targetState == DT_CROWDAGENT_TARGET_VALID && dt_agent->ncorners == 0;
+		const bool is_close = squaredLength((pos - long_path.waypoints[long_path.next]).xz()) < WAYPOINT_RADIUS * WAYPOINT_RADIUS;
+		if (!reached && !is_close && dt_agent->targetState != DT_CROWDAGENT_TARGET_FAILED) return;
+
+		++long_path.next;
+		if (long_path.next < (u32)long_path.waypoints.size()) {
+			requestWaypoint(zone, agent, long_path.waypoints[long_path.next]);
+			return;
+		}
+
+		const Vec3 dest = long_path.dest;
+		agent.stop_distance = long_path.stop_distance;
+		clearLongPath(agent);
+		requestWaypoint(zone, agent, dest);
+	}
+
+	static bool isLongPath(const RecastZone& zone, const Vec3& from, const Vec3& to) {
+		int from_x, from_z, to_x, to_z;
+		zone.navmesh->calcTileLoc(&from.x, &from_x, &from_z);
+		zone.navmesh->calcTileLoc(&to.x, &to_x, &to_z);
+		return abs(from_x - to_x) >= LONG_PATH_MIN_TILES || abs(from_z - to_z) >= LONG_PATH_MIN_TILES;
+	}
+
+	// A* in zone.graph, start and destination are connected to the portals of their tiles by straight distance
+	bool findCoarsePath(const RecastZone& zone, const Vec3& from, const Vec3& to, Array<Vec3>& waypoints) {
+		PROFILE_FUNCTION();
+		const HierGraph& graph = *zone.graph;
+		int from_x, from_z, to_x, to_z;
+		zone.navmesh->calcTileLoc(&from.x, &from_x, &from_z);
+		zone.navmesh->calcTileLoc(&to.x, &to_x, &to_z);
+		const i32 num_x = (i32)zone.m_num_tiles_x;
+		const i32 num_z = (i32)zone.m_num_tiles_z;
+		if (from_x < 0 || from_z < 0 || from_x >= num_x || from_z >= num_z) return false;
+		if (to_x < 0 || to_z < 0 || to_x >= num_x || to_z >= num_z) return false;
+
+		const Span<const u32> start_nodes = graph.getTileNodes(from_x + from_z * num_x);
+		const Span<const u32> goal_nodes = graph.getTileNodes(to_x + to_z * num_x);
+		const u32 goal = graph.nodes.size();
+		constexpr u32 NO_PARENT = 0xffFFffFF;
+
+		struct OpenNode {
+			float f;
+			float g;
+			u32 node;
+		};
+
+		Array<float> costs(m_allocator);
+		Array<u32> parents(m_allocator);
+		Array<OpenNode> open(m_allocator);
+		costs.resize(goal + 1);
+		parents.resize(goal + 1);
+		for (float& c : costs) c = FLT_MAX;
+
+		// binary heap ordered by f
+		auto push = [&](u32 node, float g, u32 parent) {
+			if (g >= costs[node]) return;
+			costs[node] = g;
+			parents[node] = parent;
+			const Vec3 pos = node == goal ? to : graph.nodes[node].pos;
+			open.push({g + length(pos - to), g, node});
+			for (i32 i = open.size() - 1; i > 0;) {
+				const i32 p = (i - 1) / 2;
+				if (open[p].f <= open[i].f) break;
+				swap(open[p], open[i]);
+				i = p;
+			}
+		};
+		auto pop = [&]() {
+			const OpenNode res = open[0];
+			open[0] = open.back();
+			open.pop();
+			for (i32 i = 0;;) {
+				const i32 l = i * 2 + 1;
+				if (l >= open.size()) break;
+				const i32 c = l + 1 < open.size() && open[l + 1].f < open[l].f ? l + 1 : l;
+				if (open[i].f <= open[c].f) break;
+				swap(open[i], open[c]);
+				i = c;
+			}
+			return res;
+		};
+
+		for (u32 node : start_nodes) {
+			push(node, length(graph.nodes[node].pos - from), NO_PARENT);
+		}
+
+		while (!open.empty()) {
+			const OpenNode n = pop();
+			if (n.node == goal) break;
+			if (n.g > costs[n.node]) continue;
+
+			const HierGraph::Node& node = graph.nodes[n.node];
+			for (u32 goal_node : goal_nodes) {
+				if (goal_node == n.node) push(goal, n.g + length(node.pos - to), n.node);
+			}
+			for (u32 i = node.first_edge, c = node.first_edge + node.edges_count; i < c; ++i) {
+				const HierGraph::Edge& edge = graph.edges[i];
+				push(edge.to, n.g + edge.cost, n.node);
+			}
+		}
+
+		if (costs[goal] == FLT_MAX) return false;
+
+		waypoints.clear();
+		for (u32 node = parents[goal]; node != NO_PARENT; node = parents[node]) {
+			waypoints.push(graph.nodes[node].pos);
+		}
+		for (i32 i = 0, c = waypoints.size(); i < c / 2; ++i) {
+			swap(waypoints[i], waypoints[c - 1 - i]);
+		}
+		return !waypoints.empty();
+	}
+
+	// called when all tiles are in the navmesh
+	void buildGraph(RecastZone& zone) {
+		PROFILE_FUNCTION();
+		LUMIX_DELETE(m_allocator, zone.graph);
+		zone.graph = nullptr;
+		if (!zone.navmesh) return;
+
+		const dtNavMesh& navmesh = *zone.navmesh;
+		const u32 num_x = zone.m_num_tiles_x;
+		const u32 num_z = zone.m_num_tiles_z;
+		HierGraph* graph = LUMIX_NEW(m_allocator, HierGraph)(m_allocator);
+
+		// portal edges on one side of a tile
+		struct Segment {
+			float from;
+			float to;
+			Vec3 mid;
+			dtPolyRef poly;
+		};
+		Array<Segment> segments(m_allocator);
+		Array<u32> node_tiles(m_allocator); // two per node
+
+		// nodes on +x (side 0) and +z (side 2) borders of each tile, contiguous portal edges are merged
+		for (u32 z = 0; z < num_z; ++z) {
+			for (u32 x = 0; x < num_x; ++x) {
+				const dtMeshTile* tile = navmesh.getTileAt(x, z, 0);
+				if (!tile || !tile->header) continue;
+
+				for (u32 side = 0; side <= 2; side += 2) {
+					if (side == 0 && x + 1 >= num_x) continue;
+					if (side == 2 && z + 1 >= num_z) continue;
+
+					const u32 axis = side == 0 ? 2 : 0;
+					segments.clear();
+					for (i32 i = 0; i < tile->header->polyCount; ++i) {
+						const dtPoly& poly = tile->polys[i];
+						if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION) continue;
+						for (u32 k = poly.firstLink; k != DT_NULL_LINK; k = tile->links[k].next) {
+							const dtLink& link = tile->links[k];
+							if (link.side != side) continue;
+
+							const Vec3 a = *(Vec3*)&tile->verts[poly.verts[link.edge] * 3];
+							const Vec3 b = *(Vec3*)&tile->verts[poly.verts[(link.edge + 1) % poly.vertCount] * 3];
+							Segment& segment = segments.emplace();
+							segment.from = minimum((&a.x)[axis], (&b.x)[axis]);
+							segment.to = maximum((&a.x)[axis], (&b.x)[axis]);
+							segment.mid = (a + b) * 0.5f;
+							segment.poly = navmesh.getPolyRefBase(tile) | (dtPolyRef)i;
+						}
+					}
+					if (segments.empty()) continue;
+
+					qsort(segments.begin(), segments.size(), sizeof(segments[0]), [](const void* a, const void* b){
+						const float d = ((const Segment*)a)->from - ((const Segment*)b)->from;
+						return d < 0 ? -1 : (d > 0 ? 1 : 0);
+					});
+
+					const u32 neighbour = side == 0 ? x + 1 + z * num_x : x + (z + 1) * num_x;
+					for (i32 i = 0; i < segments.size();) {
+						float to = segments[i].to;
+						i32 j = i + 1;
+						while (j < segments.size() && segments[j].from <= to + zone.zone.cell_size * 2) {
+							to = maximum(to, segments[j].to);
+							++j;
+						}
+						// the edge closest to the middle of the portal
+						const float mid = (segments[i].from + to) * 0.5f;
+						i32 best = i;
+						for (i32 k = i + 1; k < j; ++k) {
+							if (fabsf((&segments[k].mid.x)[axis] - mid) < fabsf((&segments[best].mid.x)[axis] - mid)) best = k;
+						}
+						HierGraph::Node& node = graph->nodes.emplace();
+						node.pos = segments[best].mid;
+						node.poly = segments[best].poly;
+						node_tiles.push(x + z * num_x);
+						node_tiles.push(neighbour);
+						i = j;
+					}
+				}
+			}
+		}
+
+		const u32 tiles_count = num_x * num_z;
+		graph->tile_offsets.resize(tiles_count + 1);
+		for (u32& offset : graph->tile_offsets) offset = 0;
+		for (u32 tile : node_tiles) ++graph->tile_offsets[tile + 1];
+		for (u32 i = 0; i < tiles_count; ++i) graph->tile_offsets[i + 1] += graph->tile_offsets[i];
+		graph->tile_nodes.resize(node_tiles.size());
+		{
+			Array<u32> fill(m_allocator);
+			fill.resize(tiles_count);
+			for (u32 i = 0; i < tiles_count; ++i) fill[i] = graph->tile_offsets[i];
+			for (i32 i = 0; i < node_tiles.size(); ++i) {
+				graph->tile_nodes[fill[node_tiles[i]]++] = u32(i / 2);
+			}
+		}
+
+		// cost of moving between each pair of portals of a tile
+		struct Pair {
+			u32 a;
+			u32 b;
+			float cost;
+		};
+		Array<Pair> pairs(m_allocator);
+		for (u32 tile = 0; tile < tiles_count; ++tile) {
+			const Span<const u32> nodes = graph->getTileNodes(tile);
+			for (u32 i = 0; i < nodes.length(); ++i) {
+				for (u32 j = i + 1; j < nodes.length(); ++j) {
+					pairs.push({nodes[i], nodes[j], -1});
+				}
+			}
+		}
+
+		Array<dtNavMeshQuery*> navqueries(m_allocator);
+		for (u32 i = 0, c = jobs::getWorkersCount(); i < c; ++i) {
+			dtNavMeshQuery* navquery = dtAllocNavMeshQuery();
+			if (!navquery || dtStatusFailed(navquery->init(zone.navmesh, 2048))) {
+				logError("Could not init Detour navmesh query");
+				dtFreeNavMeshQuery(navquery);
+				for (dtNavMeshQuery* q : navqueries) dtFreeNavMeshQuery(q);
+				LUMIX_DELETE(m_allocator, graph);
+				return;
+			}
+			navqueries.push(navquery);
+		}
+
+		jobs::forEach(pairs.size(), jobs::GrainHint{100000}, [&](i32 from, i32 to, const jobs::ForEachContext& ctx){
+			PROFILE_BLOCK("portal costs");
+			dtNavMeshQuery& navquery = *navqueries[ctx.worker_index];
+			dtQueryFilter filter;
+			dtPolyRef path[MAX_PATH_POLYS];
+			float straight[MAX_PATH_POLYS * 3];
+			for (i32 i = from; i < to; ++i) {
+				Pair& pair = pairs[i];
+				const HierGraph::Node& a = graph->nodes[pair.a];
+				const HierGraph::Node& b = graph->nodes[pair.b];
+				i32 path_size = 0;
+				const dtStatus status = navquery.findPath(a.poly, b.poly, &a.pos.x, &b.pos.x, &filter, path, &path_size, MAX_PATH_POLYS);
+				if (dtStatusFailed(status) || path_size == 0 || path[path_size - 1] != b.poly) continue;
+
+				i32 straight_size = 0;
+				navquery.findStraightPath(&a.pos.x, &b.pos.x, path, path_size, straight, nullptr, nullptr, &straight_size, MAX_PATH_POLYS);
+				float cost = 0;
+				for (i32 k = 1; k < straight_size; ++k) {
+					cost += length(*(Vec3*)&straight[k * 3] - *(Vec3*)&straight[k * 3 - 3]);
+				}
+				pair.cost = cost;
+			}
+		});
+
+		for (dtNavMeshQuery* navquery : navqueries) dtFreeNavMeshQuery(navquery);
+
+		for (const Pair& pair : pairs) {
+			if (pair.cost < 0) continue;
+			++graph->nodes[pair.a].edges_count;
+			++graph->nodes[pair.b].edges_count;
+		}
+		u32 edges_count = 0;
+		for (HierGraph::Node& node : graph->nodes) {
+			node.first_edge = edges_count;
+			edges_count += node.edges_count;
+			node.edges_count = 0;
+		}
+		graph->edges.resize(edges_count);
+		for (const Pair& pair : pairs) {
+			if (pair.cost < 0) continue;
+			HierGraph::Node& a = graph->nodes[pair.a];
+			HierGraph::Node& b = graph->nodes[pair.b];
+			graph->edges[a.first_edge + a.edges_count++] = {pair.b, pair.cost};
+			graph->edges[b.first_edge + b.edges_count++] = {pair.a, pair.cost};
+		}
+
+		zone.graph = graph;
+	}
+
+	static u64 getPathKey(dtPolyRef start, dtPolyRef end) {
+		static_assert(sizeof(dtPolyRef) == sizeof(u32), "path key needs 32bit poly refs");
+		return ((u64)start << 32) | end;
+	}
+
+	static void findPath(dtNavMeshQuery& navquery, PathBatch::Query& query, volatile i32& cancel) {
+		dtQueryFilter filter;
+		dtStatus status = navquery.initSlicedFindPath(query.start_ref, query.end_ref, &query.start_pos.x, &query.end_pos.x, &filter);
+		while (dtStatusInProgress(status)) {
+			if (cancel) return;
+			status = navquery.updateSlicedFindPath(PATH_SLICE_ITERATIONS, nullptr);
+		}
+		if (dtStatusFailed(status)) return;
+
+		status = navquery.finalizeSlicedFindPath(query.path, &query.path_size, MAX_PATH_POLYS);
+		if (dtStatusFailed(status)) {
+			query.path_size = 0;
+			return;
+		}
+		query.partial = dtStatusDetail(status, DT_PARTIAL_RESULT);
+	}
+
+	static void findPathsJob(void* data) {
+		PROFILE_FUNCTION();
+		PathBatch* batch = (PathBatch*)data;
+		jobs::forEach(batch->queries.size(), jobs::GrainHint{50000}, [batch](i32 from, i32 to, const jobs::ForEachContext& ctx){
+			dtNavMeshQuery* navquery = batch->worker_queries[ctx.worker_index];
+			for (i32 i = from; i < to; ++i) {
+				findPath(*navquery, batch->queries[i], batch->cancel);
+			}
+		});
+		memoryBarrier();
+		batch->is_finished = 1;
+	}
+
+	bool initWorkerQueries(RecastZone& zone) {
+		if (!zone.worker_queries.empty()) return true;
+
+		for (u32 i = 0, c = jobs::getWorkersCount(); i < c; ++i) {
+			dtNavMeshQuery* navquery = dtAllocNavMeshQuery();
+			if (!navquery || dtStatusFailed(navquery->init(zone.navmesh, 2048))) {
+				logError("Could not init Detour navmesh query");
+				dtFreeNavMeshQuery(navquery);
+				freeWorkerQueries(zone);
+				return false;
+			}
+			zone.worker_queries.push(navquery);
+		}
+		return true;
+	}
+
+	void freeWorkerQueries(RecastZone& zone) {
+		ASSERT(zone.path_batches.empty());
+		for (dtNavMeshQuery* navquery : zone.worker_queries) {
+			dtFreeNavMeshQuery(navquery);
+		}
+		zone.worker_queries.clear();
+	}
+
+	void startPathBatch(RecastZone& zone) {
+		PathBatch* batch = zone.path_batches[0];
+		ASSERT(!batch->is_started);
+		batch->is_started = true;
+		jobs::run(batch, &findPathsJob, &batch->signal);
+	}
+
+	void cancelPathBatches(RecastZone& zone) {
+		for (PathBatch* batch : zone.path_batches) {
+			batch->cancel = 1;
+		}
+		for (PathBatch* batch : zone.path_batches) {
+			jobs::wait(batch->signal);
+			for (const PathBatch::Request& request : batch->requests) {
+				auto iter = m_agents.find(request.entity);
+				if (!iter.isValid() || iter.value().path_request != request.path_request) continue;
+				iter.value().is_path_pending = false;
+				iter.value().is_finished = true;
+			}
+			LUMIX_DELETE(m_allocator, batch);
+		}
+		zone.path_batches.clear();
+		zone.path_cache.clear();
+	}
+
+	// applies the running batch, so the navmesh can be modified; the next one is started in updatePathBatches
+	void finishRunningPathBatch(RecastZone& zone) {
+		if (zone.path_batches.empty()) return;
+		PathBatch* batch = zone.path_batches[0];
+		if (!batch->is_started) return;
+
+		jobs::wait(batch->signal);
+		applyPathBatch(zone, *batch);
+		LUMIX_DELETE(m_allocator, batch);
+		zone.path_batches.erase(0);
+	}
+
+	void updatePathBatches(RecastZone& zone) {
+		if (zone.path_batches.empty()) return;
+		
+		if (zone.path_batches[0]->is_started) {
+			if (!zone.path_batches[0]->is_finished) return;
+			finishRunningPathBatch(zone);
+			if (zone.path_batches.empty()) return;
+		}
+		startPathBatch(zone);
+	}
+
+	void cachePath(RecastZone& zone, const PathBatch::Query& query) {
+		const u64 key = getPathKey(query.start_ref, query.end_ref);
+		if (zone.path_cache.find(key).isValid()) return;
+
+		if (zone.path_cache.size() >= PATH_CACHE_SIZE) {
+			auto lru = zone.path_cache.begin();
+			for (auto iter = zone.path_cache.begin(); iter.isValid(); ++iter) {
+				if (iter.value().last_used < lru.value().last_used) lru = iter;
+			}
+			zone.path_cache.erase(lru);
+		}
+
+		CachedPath& cached = zone.path_cache.insert(key, CachedPath(m_allocator)).value();
+		cached.path.resize(query.path_size);
+		memcpy(cached.path.begin(), query.path, sizeof(query.path[0]) * query.path_size);
+		cached.partial = query.partial;
+		cached.last_used = m_frame;
+	}
+
+	void applyPathBatch(RecastZone& zone, const PathBatch& batch) {
+		PROFILE_FUNCTION();
+		for (const PathBatch::Query& query : batch.queries) {
+			if (query.path_size > 0) cachePath(zone, query);
+		}
+
+		for (const PathBatch::Request& request : batch.requests) {
+			auto iter = m_agents.find(request.entity);
+			if (!iter.isValid()) continue;
+
+			Agent& agent = iter.value();
+			if (agent.path_request != request.path_request) continue;
+
+			agent.is_path_pending = false;
+			if (agent.agent < 0 || agent.zone != zone.entity || !zone.crowd) {
+				agent.is_finished = true;
+				continue;
+			}
+			const PathBatch::Query& query = batch.queries[request.query];
+			setAgentPath(zone, agent, request.dest, query.end_ref, Span<const dtPolyRef>(query.path, query.path_size), query.partial, request.speed, request.stop_distance);
+		}
+	}
+
+	// like dtCrowd::requestMoveTarget, but with a path found outside of the crowd's path queue
+	// false if the path does not start at the agent's current polygon
+	static bool setCorridor(dtCrowd& crowd, i32 idx, dtPolyRef end_ref, const Vec3& dest, Span<const dtPolyRef> path, bool partial) {
+		const dtCrowdAgent* agent = crowd.getAgent(idx);
+		if (path.length() == 0 || agent->corridor.getFirstPoly() != path[0]) return false;
+
+		Vec3 target = dest;
+		// partial path, the target is the closest point in the last polygon of the path
+		const dtPolyRef last = path[path.length() - 1];
+		if (last != end_ref) {
+			if (dtStatusFailed(crowd.getNavMeshQuery()->closestPointOnPoly(last, &dest.x, &target.x, nullptr))) return false;
+		}
+
+		if (!crowd.requestMoveTarget(idx, end_ref, &dest.x)) return false;
+		dtCrowdAgent* editable = crowd.getEditableAgent(idx);
+		editable->corridor.setCorridor(&target.x, path.begin(), (i32)minimum(path.length(), (u32)MAX_PATH_POLYS));
+		editable->boundary.reset();
+		editable->partial = partial;
+		editable->targetState = DT_CROWDAGENT_TARGET_VALID;
+		return true;
+	}
+
+	void setAgentPath(RecastZone& zone, Agent& agent, const Vec3& dest, dtPolyRef end_ref, Span<const dtPolyRef> path, bool partial, float speed, float stop_distance) {
+		dtCrowdAgentParams params = zone.crowd->getAgent(agent.agent)->params;
+		params.maxSpeed = speed;
+		zone.crowd->updateAgentParameters(agent.agent, &params);
+		agent.stop_distance = stop_distance;
+		agent.is_finished = false;
+		if (setCorridor(*zone.crowd, agent.agent, end_ref, dest, path, partial)) return;
+
+		// agent left the start polygon since the request or there's no path, let the crowd deal with it
+		if (!zone.crowd->requestMoveTarget(agent.agent, end_ref, &dest.x)) {
+			logError("requestMoveTarget failed");
+			agent.is_finished = true;
+		}
+	}
+
+	void findPaths(Span<const NavigationPathRequest> requests) override {
+		PROFILE_FUNCTION();
+		static const float ext[] = { 1.0f, 20.0f, 1.0f };
+		dtQueryFilter filter;
+		HashMap<EntityRef, PathBatch*> new_batches(m_allocator);
+
+		for (const NavigationPathRequest& request : requests) {
+			auto iter = m_agents.find(request.agent);
+			if (!iter.isValid()) continue;
+
+			Agent& agent = iter.value();
+			++agent.path_request;
+			agent.is_path_pending = false;
+			clearLongPath(agent);
+			if (agent.agent < 0) continue;
+			if (!agent.zone.isValid()) continue;
+
+			RecastZone& zone = m_zones[(EntityRef)agent.zone];
+			if (!zone.navquery) continue;
+			if (!zone.crowd) continue;
+
+			const Transform zone_tr = m_universe.getTransform(zone.entity);
+			const Vec3 dest = Vec3(zone_tr.inverted().transform(request.dest));
+			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
+			const dtPolyRef start_ref = dt_agent->corridor.getFirstPoly();
+			dtPolyRef end_ref = 0;
+			zone.navquery->findNearestPoly(&dest.x, ext, &filter, &end_ref, 0);
+			if (!start_ref || !end_ref) {
+				logError("requestMoveTarget failed");
+				agent.is_finished = true;
+				continue;
+			}
+
+			const u64 key = getPathKey(start_ref, end_ref);
+			auto cache_iter = zone.path_cache.find(key);
+			if (cache_iter.isValid()) {
+				CachedPath& cached = cache_iter.value();
+				cached.last_used = m_frame;
+				setAgentPath(zone, agent, dest, end_ref, Span<const dtPolyRef>(cached.path.begin(), cached.path.size()), cached.partial, request.speed, request.stop_distance);
+				continue;
+			}
+
+			PathBatch* batch;
+			auto batch_iter = new_batches.find(zone.entity);
+			if (batch_iter.isValid()) {
+				batch = batch_iter.value();
+			}
+			else {
+				if (!initWorkerQueries(zone)) continue;
+				batch = LUMIX_NEW(m_allocator, PathBatch)(m_allocator);
+				batch->navmesh = zone.navmesh;
+				batch->worker_queries = zone.worker_queries.begin();
+				zone.path_batches.push(batch);
+				new_batches.insert(zone.entity, batch);
+			}
+
+			u32 query_idx;
+			auto query_iter = batch->query_indices.find(key);
+			if (query_iter.isValid()) {
+				query_idx = query_iter.value();
+			}
+			else {
+				query_idx = batch->queries.size();
+				PathBatch::Query& query = batch->queries.emplace();
+				query.start_ref = start_ref;
+				query.end_ref = end_ref;
+				query.start_pos = *(Vec3*)dt_agent->npos;
+				query.end_pos = dest;
+				batch->query_indices.insert(key, query_idx);
+			}
+
+			PathBatch::Request& batch_request = batch->requests.emplace();
+			batch_request.entity = agent.entity;
+			batch_request.path_request = agent.path_request;
+			batch_request.query = query_idx;
+			batch_request.dest = dest;
+			batch_request.speed = request.speed;
+			batch_request.stop_distance = request.stop_distance;
+
+			// stand still until the path is found
+			zone.crowd->resetMoveTarget(agent.agent);
+			agent.is_path_pending = true;
+			agent.is_finished = false;
+		}
+
+		for (auto iter = new_batches.begin(); iter.isValid(); ++iter) {
+			RecastZone& zone = m_zones[iter.key()];
+			if (zone.path_batches[0] == iter.value()) startPathBatch(zone);
+		}
+	}
+
 	bool generateTileAt(EntityRef zone_entity, const DVec3& world_pos, bool keep_data) override {
 		RecastZone& zone = m_zones[zone_entity];
 		if (!zone.navmesh) return false;
@@ -1050,109 +2300,209 @@ struct NavigationSceneImpl final : NavigationScene
 		const Vec3 min = -zone.zone.extents;
 		const int x = int((pos.x - min.x + (1 + zone.getBorderSize()) * zone.zone.cell_size) / (CELLS_PER_TILE_SIDE * zone.zone.cell_size));
 		const int z = int((pos.z - min.z + (1 + zone.getBorderSize()) * zone.zone.cell_size) / (CELLS_PER_TILE_SIDE * zone.zone.cell_size));
+		finishRunningPathBatch(zone);
+		zone.path_cache.clear();
 		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), 0, 0);
 
+		Array<ObstacleShape> obstacles(m_allocator);
+		getObstacleShapes(zone, obstacles);
 		Mutex mutex;
-		return generateTile(zone, zone_entity, x, z, keep_data, mutex);
+		return generateTile(zone, zone_entity, x, z, keep_data, obstacles, mutex);
 	}
 
-	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data, Mutex& mutex) {
-		PROFILE_FUNCTION();
-		// TODO some stuff leaks on errors
-		ASSERT(zone.navmesh);
-
+	static rcConfig getTileConfig(const NavmeshZone& zone, int x, int z) {
 		rcConfig config;
 		static const float DETAIL_SAMPLE_DIST = 6;
 		static const float DETAIL_SAMPLE_MAX_ERROR = 1;
 
-		config.cs = zone.zone.cell_size;
-		config.ch = zone.zone.cell_height;
-		config.walkableSlopeAngle = zone.zone.walkable_slope_angle;
-		config.walkableHeight = (int)(zone.zone.agent_height / config.ch + 0.99f);
-		config.walkableClimb = (int)(zone.zone.max_climb / config.ch);
-		config.walkableRadius = (int)(zone.zone.agent_radius / config.cs + 0.99f);
+		config.cs = zone.cell_size;
+		config.ch = zone.cell_height;
+		config.walkableSlopeAngle = zone.walkable_slope_angle;
+		config.walkableHeight = (int)(zone.agent_height / config.ch + 0.99f);
+		config.walkableClimb = (int)(zone.max_climb / config.ch);
+		config.walkableRadius = (int)(zone.agent_radius / config.cs + 0.99f);
 		config.maxEdgeLen = (int)(12 / config.cs);
 		config.maxSimplificationError = 1.3f;
 		config.minRegionArea = 8 * 8;
 		config.mergeRegionArea = 20 * 20;
 		config.maxVertsPerPoly = 6;
-		config.detailSampleDist = DETAIL_SAMPLE_DIST < 0.9f ? 0 : zone.zone.cell_size * DETAIL_SAMPLE_DIST;
+		config.detailSampleDist = DETAIL_SAMPLE_DIST < 0.9f ? 0 : zone.cell_size * DETAIL_SAMPLE_DIST;
 		config.detailSampleMaxError = config.ch * DETAIL_SAMPLE_MAX_ERROR;
 		config.borderSize = config.walkableRadius + 3;
 		config.tileSize = CELLS_PER_TILE_SIDE;
 		config.width = config.tileSize + config.borderSize * 2;
 		config.height = config.tileSize + config.borderSize * 2;
 
-		rcContext ctx;
-		const Vec3 min = -zone.zone.extents;
-		const Vec3 max = zone.zone.extents;
-		Vec3 bmin(min.x + x * CELLS_PER_TILE_SIDE * zone.zone.cell_size - (1 + config.borderSize) * config.cs,
+		const Vec3 min = -zone.extents;
+		const Vec3 max = zone.extents;
+		Vec3 bmin(min.x + x * CELLS_PER_TILE_SIDE * zone.cell_size - (1 + config.borderSize) * config.cs,
 			min.y,
-			min.z + z * CELLS_PER_TILE_SIDE * zone.zone.cell_size - (1 + config.borderSize) * config.cs);
-		Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * zone.zone.cell_size + (1 + config.borderSize) * config.cs * 2,
+			min.z + z * CELLS_PER_TILE_SIDE * zone.cell_size - (1 + config.borderSize) * config.cs);
+		Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * zone.cell_size + (1 + config.borderSize) * config.cs * 2,
 			max.y,
-			bmin.z + CELLS_PER_TILE_SIDE * zone.zone.cell_size + (1 + config.borderSize) * config.cs * 2);
-		if (keep_data) m_debug_tile_origin = bmin;
+			bmin.z + CELLS_PER_TILE_SIDE * zone.cell_size + (1 + config.borderSize) * config.cs * 2);
 		rcVcopy(config.bmin, &bmin.x);
 		rcVcopy(config.bmax, &bmax.x);
+		return config;
+	}
+
+	// rasterizes geometry and filters it, obstacles are not applied yet
+	rcCompactHeightfield* rasterizeTile(const Transform& zone_tr, const rcConfig& config, rcHeightfield** keep_solid) {
+		PROFILE_FUNCTION();
+		rcContext ctx;
 		rcHeightfield* solid = rcAllocHeightfield();
-		zone.debug_heightfield = keep_data ? solid : nullptr;
 		if (!solid) {
 			logError("Could not generate navmesh: Out of memory 'solid'.");
-			return false;
+			return nullptr;
 		}
 
 		if (!rcCreateHeightfield(
 				&ctx, *solid, config.width, config.height, config.bmin, config.bmax, config.cs, config.ch))
 		{
 			logError("Could not generate navmesh: Could not create solid heightfield.");
-			return false;
+			rcFreeHeightField(solid);
+			return nullptr;
 		}
 
-		const Transform tr = m_universe.getTransform(zone_entity);
-		rasterizeGeometry(tr, AABB(bmin, bmax), ctx, config, *solid);
+		rcConfig cfg = config;
+		rasterizeGeometry(zone_tr, AABB(*(Vec3*)config.bmin, *(Vec3*)config.bmax), ctx, cfg, *solid);
 
 		rcFilterLowHangingWalkableObstacles(&ctx, config.walkableClimb, *solid);
 		rcFilterLedgeSpans(&ctx, config.walkableHeight, config.walkableClimb, *solid);
 		rcFilterWalkableLowHeightSpans(&ctx, config.walkableHeight, *solid);
 
 		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
-		zone.debug_compact_heightfield = keep_data ? chf : nullptr;
 		if (!chf) {
 			logError("Could not generate navmesh: Out of memory 'chf'.");
-			return false;
+			rcFreeHeightField(solid);
+			return nullptr;
 		}
 
 		if (!rcBuildCompactHeightfield(&ctx, config.walkableHeight, config.walkableClimb, *solid, *chf)) {
 			logError("Could not generate navmesh: Could not build compact data.");
-			return false;
+			rcFreeHeightField(solid);
+			rcFreeCompactHeightfield(chf);
+			return nullptr;
 		}
 
-		if (!zone.debug_heightfield) rcFreeHeightField(solid);
+		if (keep_solid) *keep_solid = solid;
+		else rcFreeHeightField(solid);
+		return chf;
+	}
 
-		if (!rcErodeWalkableArea(&ctx, config.walkableRadius, *chf)) {
+	// only what's needed to rebuild the tile is cached, i.e. regions and distance field are not
+	void compressTile(const rcCompactHeightfield& chf, OutputMemoryStream& out) {
+		PROFILE_FUNCTION();
+		OutputMemoryStream tmp(m_allocator);
+		tmp.write(chf.width);
+		tmp.write(chf.height);
+		tmp.write(chf.spanCount);
+		tmp.write(chf.walkableHeight);
+		tmp.write(chf.walkableClimb);
+		tmp.write(chf.borderSize);
+		tmp.write(chf.bmin);
+		tmp.write(chf.bmax);
+		tmp.write(chf.cs);
+		tmp.write(chf.ch);
+		tmp.write(chf.cells, sizeof(chf.cells[0]) * chf.width * chf.height);
+		tmp.write(chf.spans, sizeof(chf.spans[0]) * chf.spanCount);
+		tmp.write(chf.areas, sizeof(chf.areas[0]) * chf.spanCount);
+
+		const i32 cap = LZ4_compressBound((i32)tmp.size());
+		out.resize(cap + sizeof(u32));
+		const u32 uncompressed_size = (u32)tmp.size();
+		memcpy(out.getMutableData(), &uncompressed_size, sizeof(uncompressed_size));
+		const i32 compressed_size = LZ4_compress_default((const char*)tmp.data(), (char*)out.getMutableData() + sizeof(u32), (i32)tmp.size(), cap);
+		if (compressed_size <= 0) {
+			logError("Could not compress navmesh tile");
+			out.clear();
+			return;
+		}
+		out.resize(compressed_size + sizeof(u32));
+	}
+
+	rcCompactHeightfield* decompressTile(Span<const u8> compressed) {
+		PROFILE_FUNCTION();
+		u32 size;
+		if (compressed.length() < sizeof(size)) return nullptr;
+		memcpy(&size, compressed.begin(), sizeof(size));
+		OutputMemoryStream tmp(m_allocator);
+		tmp.resize(size);
+		const i32 res = LZ4_decompress_safe((const char*)compressed.begin() + sizeof(size), (char*)tmp.getMutableData(), compressed.length() - sizeof(size), size);
+		if (res != (i32)size) {
+			logError("Corrupted navmesh tile cache");
+			return nullptr;
+		}
+
+		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
+		if (!chf) return nullptr;
+		InputMemoryStream blob(tmp);
+		blob.read(chf->width);
+		blob.read(chf->height);
+		blob.read(chf->spanCount);
+		blob.read(chf->walkableHeight);
+		blob.read(chf->walkableClimb);
+		blob.read(chf->borderSize);
+		blob.read(chf->bmin);
+		blob.read(chf->bmax);
+		blob.read(chf->cs);
+		blob.read(chf->ch);
+		chf->cells = (rcCompactCell*)rcAlloc(sizeof(rcCompactCell) * chf->width * chf->height, RC_ALLOC_PERM);
+		chf->spans = (rcCompactSpan*)rcAlloc(sizeof(rcCompactSpan) * chf->spanCount, RC_ALLOC_PERM);
+		chf->areas = (u8*)rcAlloc(sizeof(u8) * chf->spanCount, RC_ALLOC_PERM);
+		if (!chf->cells || !chf->spans || !chf->areas) {
+			rcFreeCompactHeightfield(chf);
+			return nullptr;
+		}
+		blob.read(chf->cells, sizeof(chf->cells[0]) * chf->width * chf->height);
+		blob.read(chf->spans, sizeof(chf->spans[0]) * chf->spanCount);
+		blob.read(chf->areas, sizeof(chf->areas[0]) * chf->spanCount);
+		return chf;
+	}
+
+	// applies obstacles to rasterized tile and builds detour data from it, nav_data is null for empty tiles
+	static bool buildTileData(const NavmeshZone& zone
+		, const rcConfig& config
+		, int x
+		, int z
+		, rcCompactHeightfield& chf
+		, Span<const ObstacleShape> obstacles
+		, rcContourSet** keep_contours
+		, u8** nav_data
+		, int* nav_data_size)
+	{
+		PROFILE_FUNCTION();
+		// TODO some stuff leaks on errors
+		rcContext ctx;
+		*nav_data = nullptr;
+		*nav_data_size = 0;
+
+		for (const ObstacleShape& obstacle : obstacles) {
+			rcMarkConvexPolyArea(&ctx, &obstacle.verts[0].x, lengthOf(obstacle.verts), obstacle.hmin, obstacle.hmax, RC_NULL_AREA, chf);
+		}
+
+		if (!rcErodeWalkableArea(&ctx, config.walkableRadius, chf)) {
 			logError("Could not generate navmesh: Could not erode.");
 			return false;
 		}
 
-		if (!rcBuildDistanceField(&ctx, *chf)) {
+		if (!rcBuildDistanceField(&ctx, chf)) {
 			logError("Could not generate navmesh: Could not build distance field.");
 			return false;
 		}
 
-		if (!rcBuildRegions(&ctx, *chf, config.borderSize, config.minRegionArea, config.mergeRegionArea)) {
+		if (!rcBuildRegions(&ctx, chf, config.borderSize, config.minRegionArea, config.mergeRegionArea)) {
 			logError("Could not generate navmesh: Could not build regions.");
 			return false;
 		}
 
 		rcContourSet* cset = rcAllocContourSet();
-		zone.debug_contours = keep_data ? cset : nullptr;
 		if (!cset) {
 			ctx.log(RC_LOG_ERROR, "Could not generate navmesh: Out of memory 'cset'.");
 			return false;
 		}
 
-		if (!rcBuildContours(&ctx, *chf, config.maxSimplificationError, config.maxEdgeLen, *cset)) {
+		if (!rcBuildContours(&ctx, chf, config.maxSimplificationError, config.maxEdgeLen, *cset)) {
 			logError("Could not generate navmesh: Could not create contours.");
 			return false;
 		}
@@ -1168,25 +2518,22 @@ struct NavigationSceneImpl final : NavigationScene
 		}
 		
 		rcPolyMeshDetail* detail_mesh = nullptr;
-		if (zone.zone.flags & NavmeshZone::DETAILED) {
+		if (zone.flags & NavmeshZone::DETAILED) {
 			detail_mesh = rcAllocPolyMeshDetail();
 			if (!detail_mesh) {
 				logError("Could not generate navmesh: Out of memory 'pmdtl'.");
 				return false;
 			}
 
-			if (!rcBuildPolyMeshDetail(&ctx, *polymesh, *chf, config.detailSampleDist, config.detailSampleMaxError, *detail_mesh))
+			if (!rcBuildPolyMeshDetail(&ctx, *polymesh, chf, config.detailSampleDist, config.detailSampleMaxError, *detail_mesh))
 			{
 				logError("Could not generate navmesh: Could not build detail mesh.");
 				return false;
 			}
 		}
 
-		if (!zone.debug_compact_heightfield) rcFreeCompactHeightfield(chf);
-		if (!zone.debug_contours) rcFreeContourSet(cset);
-
-		unsigned char* nav_data = 0;
-		int nav_data_size = 0;
+		if (keep_contours) *keep_contours = cset;
+		else rcFreeContourSet(cset);
 
 		for (int i = 0; i < polymesh->npolys; ++i) {
 			polymesh->flags[i] = polymesh->areas[i] == RC_WALKABLE_AREA ? 1 : 0;
@@ -1218,22 +2565,47 @@ struct NavigationSceneImpl final : NavigationScene
 		params.ch = config.ch;
 		params.buildBvTree = false;
 
-		MutexGuard guard(mutex);
-		if (!dtCreateNavMeshData(&params, &nav_data, &nav_data_size)) {
-			if (polymesh->npolys == 0) {
-				// no geometry in tile
-				rcFreePolyMesh(polymesh);
-				if (detail_mesh) rcFreePolyMeshDetail(detail_mesh);
-				return true;
-			}
+		const bool created = dtCreateNavMeshData(&params, nav_data, nav_data_size);
+		const bool is_empty = polymesh->npolys == 0;
+		rcFreePolyMesh(polymesh);
+		if (detail_mesh) rcFreePolyMeshDetail(detail_mesh);
+		
+		if (!created) {
+			*nav_data = nullptr;
+			*nav_data_size = 0;
+			// no geometry in tile
+			if (is_empty) return true;
 			logError("Could not build Detour navmesh.");
 			return false;
 		}
+		return true;
+	}
 
-		rcFreePolyMesh(polymesh);
-		if (detail_mesh) rcFreePolyMeshDetail(detail_mesh);
+	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data, Span<const ObstacleShape> obstacles, Mutex& mutex) {
+		PROFILE_FUNCTION();
+		ASSERT(zone.navmesh);
+
+		const rcConfig config = getTileConfig(zone.zone, x, z);
+		if (keep_data) m_debug_tile_origin = *(Vec3*)config.bmin;
+
+		const Transform tr = m_universe.getTransform(zone_entity);
+		rcCompactHeightfield* chf = rasterizeTile(tr, config, keep_data ? &zone.debug_heightfield : nullptr);
+		if (!chf) return false;
 
+		// each tile has its own cache, so workers do not need to lock
+		compressTile(*chf, zone.tile_cache[x + z * zone.m_num_tiles_x]);
+
+		u8* nav_data;
+		int nav_data_size;
+		const bool built = buildTileData(zone.zone, config, x, z, *chf, obstacles, keep_data ? &zone.debug_contours : nullptr, &nav_data, &nav_data_size);
+		if (keep_data) zone.debug_compact_heightfield = chf;
+		else rcFreeCompactHeightfield(chf);
+		if (!built) return false;
+		if (!nav_data) return true;
+
+		MutexGuard guard(mutex);
 		if (dtStatusFailed(zone.navmesh->addTile(nav_data, nav_data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+			dtFree(nav_data);
 			logError("Could not add Detour tile.");
 			return false;
 		}
@@ -1269,6 +2641,8 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 	struct NavmeshBuildJobImpl : NavmeshBuildJob {
+		NavmeshBuildJobImpl(IAllocator& allocator) : obstacles(allocator) {}
+
 		~NavmeshBuildJobImpl() {
 			jobs::wait(signal);
 		}
@@ -1290,7 +2664,11 @@ struct NavigationSceneImpl final : NavigationScene
 					return;
 				}
 
-				if (!that->scene->generateTile(*that->zone, that->zone_entity, i % that->zone->m_num_tiles_x, i / that->zone->m_num_tiles_x, false, that->mutex)) {
+				const bool success = that->scene->generateTile(*that->zone, that->zone_entity, i % that->zone->m_num_tiles_x, i / that->zone->m_num_tiles_x, false, that->obstacles, that->mutex);
+				// the last tile builds the graph, before the job reports it's finished
+				if (atomicIncrement(&that->processed_counter) == that->total) that->scene->buildGraph(*that->zone);
+
+				if (!success) {
 					atomicIncrement(&that->fail_counter);
 				}
 				else {
@@ -1298,7 +2676,7 @@ struct NavigationSceneImpl final : NavigationScene
 				}
 
 				that->pushJob();
-			}, nullptr);
+			}, nullptr, jobs::Priority::LOW);
 		}
 
 		void run() {
@@ -1316,7 +2694,9 @@ struct NavigationSceneImpl final : NavigationScene
 		volatile i32 counter = 0;
 		volatile i32 fail_counter = 0;
 		volatile i32 done_counter = 0;
+		volatile i32 processed_counter = 0;
 		Mutex mutex;
+		Array<ObstacleShape> obstacles;
 		RecastZone* zone;
 		EntityRef zone_entity;
 		NavigationSceneImpl* scene;
@@ -1356,8 +2736,10 @@ struct NavigationSceneImpl final : NavigationScene
 				zone.navmesh->removeTile(zone.navmesh->getTileRefAt(i, j, 0), 0, 0);
 			}
 		}
+		for (u32 i = 0; i < params.maxTiles; ++i) zone.tile_cache.emplace(m_allocator);
 
-		NavmeshBuildJobImpl* job = LUMIX_NEW(m_allocator, NavmeshBuildJobImpl);
+		NavmeshBuildJobImpl* job = LUMIX_NEW(m_allocator, NavmeshBuildJobImpl)(m_allocator);
+		getObstacleShapes(zone, job->obstacles);
 		job->zone = &zone;
 		job->zone_entity = zone_entity;
 		job->scene = this;
@@ -1366,6 +2748,19 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
+	static void setAgentLODParams(const Agent& agent, dtCrowdAgentParams& params) {
+		if (agent.is_far) {
+			// no avoidance and path shortcuts, smaller neighbourhood only to not walk through each other
+			params.collisionQueryRange = params.radius * 4.0f;
+			params.pathOptimizationRange = params.radius * 10.0f;
+			params.updateFlags = DT_CROWD_ANTICIPATE_TURNS;
+			return;
+		}
+		params.collisionQueryRange = params.radius * 12.0f;
+		params.pathOptimizationRange = params.radius * 30.0f;
+		params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_OPTIMIZE_TOPO | DT_CROWD_OPTIMIZE_VIS;
+	}
+
 	void addCrowdAgent(Agent& agent, RecastZone& zone) {
 		ASSERT(zone.crowd);
 
@@ -1376,9 +2771,7 @@ struct NavigationSceneImpl final : NavigationScene
 		params.height = agent.height;
 		params.maxAcceleration = 10.0f;
 		params.maxSpeed = 10.0f;
-		params.collisionQueryRange = params.radius * 12.0f;
-		params.pathOptimizationRange = params.radius * 30.0f;
-		params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_OPTIMIZE_TOPO | DT_CROWD_OPTIMIZE_VIS;
+		setAgentLODParams(agent, params);
 		agent.agent = zone.crowd->addAgent(&pos.x, &params);
 		if (agent.agent < 0) {
 			logError("Failed to create navigation actor");
@@ -1386,21 +2779,52 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 	void createZone(EntityRef entity) {
-		RecastZone zone;
+		RecastZone& zone = m_zones.insert(entity, RecastZone(m_allocator)).value();
 		zone.zone.extents = Vec3(1);
 		zone.zone.guid = randGUID();
 		zone.zone.flags = NavmeshZone::AUTOLOAD | NavmeshZone::DETAILED;
 		zone.entity = entity;
-		m_zones.insert(entity, zone);
 		m_universe.onComponentCreated(entity, NAVMESH_ZONE_TYPE, this);
 	}
 
+	void createObstacle(EntityRef entity) {
+		Obstacle& obstacle = m_obstacles.insert(entity);
+		obstacle.entity = entity;
+		obstacle.dirty_tr = m_universe.getTransform(entity);
+		markDirty(obstacle);
+		m_universe.onComponentCreated(entity, NAVMESH_OBSTACLE_TYPE, this);
+	}
+
+	void destroyObstacle(EntityRef entity) {
+		Obstacle& obstacle = m_obstacles[entity];
+		markDirty(obstacle);
+		m_obstacles.erase(entity);
+		m_universe.onComponentDestroyed(entity, NAVMESH_OBSTACLE_TYPE, this);
+	}
+
+	Vec3 getObstacleHalfExtents(EntityRef entity) override {
+		return m_obstacles[entity].half_extents;
+	}
+
+	void setObstacleHalfExtents(EntityRef entity, const Vec3& value) override {
+		Obstacle& obstacle = m_obstacles[entity];
+		markDirty(obstacle);
+		obstacle.half_extents = value;
+		markDirty(obstacle);
+	}
+
 	void destroyZone(EntityRef entity) {
 		for (Agent& agent : m_agents) {
-			if (agent.zone == entity) agent.zone = INVALID_ENTITY;
+			if (agent.zone != entity) continue;
+			agent.zone = INVALID_ENTITY;
+			clearLongPath(agent);
 		}
 		auto iter = m_zones.find(entity);
-		const RecastZone& zone = iter.value();
+		RecastZone& zone = iter.value();
+		cancelTileRebuild(zone);
+		cancelPathBatches(zone);
+		freeWorkerQueries(zone);
+		LUMIX_DELETE(m_allocator, zone.graph);
 		if (zone.crowd) {
 			for (Agent& agent : m_agents) {
 				if (agent.zone == zone.entity) {
@@ -1447,6 +2871,7 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 	void destroyAgent(EntityRef entity) {
+		m_long_paths.erase(entity);
 		auto iter = m_agents.find(entity);
 		const Agent& agent = iter.value();
 		if (agent.zone.isValid()) {
@@ -1458,6 +2883,8 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 	i32 getVersion() const override { return (i32)NavigationSceneVersion::LATEST; }
+	// zones, agents and obstacles are our own, navmeshes are mapped or loaded asynchronously, transforms are only read
+	bool isDeserializeThreadSafe() const override { return true; }
 
 
 	void serialize(OutputMemoryStream& serializer) override
@@ -1486,6 +2913,12 @@ struct NavigationSceneImpl final : NavigationScene
 			serializer.write(iter.value().height);
 			serializer.write(iter.value().flags);
 		}
+
+		serializer.write(m_obstacles.size());
+		for (const Obstacle& obstacle : m_obstacles) {
+			serializer.write(obstacle.entity);
+			serializer.write(obstacle.half_extents);
+		}
 	}
 
 
@@ -1495,10 +2928,10 @@ struct NavigationSceneImpl final : NavigationScene
 		serializer.read(count);
 		m_zones.reserve(count + m_zones.size());
 		for (u32 i = 0; i < count; ++i) {
-			RecastZone zone;
 			EntityRef e;
 			serializer.read(e);
 			e = entity_map.get(e);
+			RecastZone& zone = m_zones.insert(e, RecastZone(m_allocator)).value();
 			serializer.read(zone.zone.extents);
 			zone.entity = e;
 			if (version > (i32)NavigationSceneVersion::ZONE_GUID) {
@@ -1522,7 +2955,6 @@ struct NavigationSceneImpl final : NavigationScene
 				serializer.read(zone.zone.agent_radius);
 			}
 
-			m_zones.insert(e, zone);
 			m_universe.onComponentCreated(e, NAVMESH_ZONE_TYPE, this);
 			if (version > (i32)NavigationSceneVersion::ZONE_GUID && (zone.zone.flags & NavmeshZone::AUTOLOAD) != 0) {
 				loadZone(e);
@@ -1544,6 +2976,21 @@ struct NavigationSceneImpl final : NavigationScene
 			m_agents.insert(agent.entity, agent);
 			m_universe.onComponentCreated(agent.entity, NAVMESH_AGENT_TYPE, this);
 		}
+
+		if (version > (i32)NavigationSceneVersion::OBSTACLES) {
+			serializer.read(count);
+			m_obstacles.reserve(count + m_obstacles.size());
+			for (u32 i = 0; i < count; ++i) {
+				EntityRef e;
+				serializer.read(e);
+				e = entity_map.get(e);
+				Obstacle& obstacle = m_obstacles.insert(e);
+				obstacle.entity = e;
+				serializer.read(obstacle.half_extents);
+				obstacle.dirty_tr = m_universe.getTransform(e);
+				m_universe.onComponentCreated(e, NAVMESH_OBSTACLE_TYPE, this);
+			}
+		}
 	}
 
 
@@ -1598,6 +3045,27 @@ struct NavigationSceneImpl final : NavigationScene
 		else m_zones[entity].zone.flags &= ~NavmeshZone::DETAILED;
 	}
 
+	bool isZoneStreamed(EntityRef entity) override {
+		return m_zones[entity].zone.flags & NavmeshZone::STREAMED;
+	}
+
+	void setZoneStreamed(EntityRef entity, bool value) override {
+		RecastZone& zone = m_zones[entity];
+		if (value) {
+			zone.zone.flags |= NavmeshZone::STREAMED;
+			return;
+		}
+		zone.zone.flags &= ~NavmeshZone::STREAMED;
+		if (zone.file_tiles.empty() || !zone.navmesh) return;
+
+		finishRunningPathBatch(zone);
+		zone.path_cache.clear();
+		for (u32 z = 0; z < zone.m_num_tiles_z; ++z) {
+			for (u32 x = 0; x < zone.m_num_tiles_x; ++x) addFileTile(zone, x, z);
+		}
+		buildGraph(zone);
+	}
+
 	bool isZoneAutoload(EntityRef entity) override {
 		return m_zones[entity].zone.flags & NavmeshZone::AUTOLOAD;
 	}
@@ -1615,9 +3083,27 @@ struct NavigationSceneImpl final : NavigationScene
 	IPlugin& m_system;
 	Engine& m_engine;
 	HashMap<EntityRef, RecastZone> m_zones;
+	struct StreamingSource {
+		DVec3 pos;
+		bool active = false;
+	};
+	StreamingSource m_streaming_sources[MAX_STREAMING_SOURCES];
+	float m_streaming_load_radius = 256;
+	float m_streaming_unload_radius = 320;
 	HashMap<EntityRef, Agent> m_agents;
+	HashMap<EntityRef, Obstacle> m_obstacles;
+	HashMap<EntityRef, LongPath> m_long_paths;
+	struct NavmeshDebugShape {
+		RenderScene* render_scene = nullptr;
+		u32 shape = 0;
+		EntityPtr zone = INVALID_ENTITY;
+		const dtMeshTile* tile = nullptr;
+		u32 salt = 0;
+		u8 flags = 0;
+	} m_navmesh_debug_shape;
 	EntityPtr m_moving_agent = INVALID_ENTITY;
 	bool m_is_game_running = false;
+	u32 m_frame = 0;
 	
 	Vec3 m_debug_tile_origin;
 	LuaScriptScene* m_script_scene;
@@ -1650,6 +3136,7 @@ void NavigationScene::reflect() {
 			.var_prop<&NavigationScene::getZone, &NavmeshZone::max_climb>("Max climb")
 			.prop<&NavigationScene::isZoneAutoload, &NavigationScene::setZoneAutoload>("Autoload")
 			.prop<&NavigationScene::isZoneDetailed, &NavigationScene::setZoneDetailed>("Detailed")
+			.prop<&NavigationScene::isZoneStreamed, &NavigationScene::setZoneStreamed>("Stream tiles")
 		.LUMIX_CMP(Agent, "navmesh_agent", "Navigation / Agent")
 			.icon(ICON_FA_MAP_MARKED_ALT)
 			.LUMIX_FUNC_EX(NavigationSceneImpl::setActorActive, "setActive")
@@ -1659,7 +3146,10 @@ void NavigationScene::reflect() {
 			.LUMIX_PROP(AgentRadius, "Radius").minAttribute(0)
 			.LUMIX_PROP(AgentHeight, "Height").minAttribute(0)
 			.LUMIX_PROP(AgentMoveEntity, "Move entity")
-			.prop<&NavigationSceneImpl::getAgentSpeed>("Speed");
+			.prop<&NavigationSceneImpl::getAgentSpeed>("Speed")
+		.LUMIX_CMP(Obstacle, "navmesh_obstacle", "Navigation / Obstacle")
+			.icon(ICON_FA_BAN)
+			.LUMIX_PROP(ObstacleHalfExtents, "Half extents");
 }
 
 } // namespace Lumix
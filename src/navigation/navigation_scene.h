@@ -19,7 +19,9 @@ template <typename T> struct DelegateList;
 struct NavmeshZone {
 	enum Flags {
 		AUTOLOAD = 1 << 0,
-		DETAILED = 1 << 1
+		DETAILED = 1 << 1,
+		// tiles are added only around streaming sources, see NavigationScene::setStreamingSource
+		STREAMED = 1 << 2
 	};
 	Vec3 extents;
 	u64 guid;
@@ -39,6 +41,13 @@ struct NavmeshBuildJob {
 	virtual float getProgress() = 0;
 };
 
+struct NavigationPathRequest {
+	EntityRef agent;
+	DVec3 dest;
+	float speed;
+	float stop_distance;
+};
+
 struct NavigationScene : IScene
 {
 	static UniquePtr<NavigationScene> create(Engine& engine, IPlugin& system, Universe& universe, IAllocator& allocator);
@@ -49,8 +58,18 @@ struct NavigationScene : IScene
 	virtual void setZoneAutoload(EntityRef entity, bool value) = 0;
 	virtual bool isZoneDetailed(EntityRef entity) = 0;
 	virtual void setZoneDetailed(EntityRef entity, bool value) = 0;
+	virtual bool isZoneStreamed(EntityRef entity) = 0;
+	virtual void setZoneStreamed(EntityRef entity, bool value) = 0;
+	// tiles of streamed zones closer than load radius to any source are added, tiles further than unload radius from all sources are removed
+	// e.g. the same positions as in WorldPartition
+	virtual void setStreamingSource(u32 idx, const DVec3& pos) = 0;
+	virtual void removeStreamingSource(u32 idx) = 0;
+	virtual void setStreamingRadius(float load_radius, float unload_radius) = 0;
 	virtual bool isFinished(EntityRef entity) = 0;
 	virtual bool navigate(EntityRef entity, const struct DVec3& dest, float speed, float stop_distance) = 0;
+	// paths are found on workers and agents start moving when they are ready,
+	// agents with the same start and end polygons share one query
+	virtual void findPaths(Span<const NavigationPathRequest> requests) = 0;
 	virtual void cancelNavigation(EntityRef entity) = 0;
 	virtual void setActorActive(EntityRef entity, bool active) = 0;
 	virtual float getAgentSpeed(EntityRef entity) = 0;
@@ -61,6 +80,8 @@ struct NavigationScene : IScene
 	virtual float getAgentHeight(EntityRef entity) = 0;
 	virtual bool getAgentMoveEntity(EntityRef entity) = 0;
 	virtual void setAgentMoveEntity(EntityRef entity, bool value) = 0;
+	virtual Vec3 getObstacleHalfExtents(EntityRef entity) = 0;
+	virtual void setObstacleHalfExtents(EntityRef entity, const Vec3& value) = 0;
 	virtual NavmeshBuildJob* generateNavmesh(EntityRef zone) = 0;
 	virtual void free(NavmeshBuildJob* job) = 0;
 	virtual bool generateTileAt(EntityRef zone, const DVec3& pos, bool keep_data) = 0;
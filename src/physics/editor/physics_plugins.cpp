@@ -432,12 +432,14 @@ struct PhysicsUIPlugin final : StudioApp::GUIPlugin
 	}
 
 
-	void onCollisionMatrixGUI()
+	// symmetric layer x layer matrix of checkboxes
+	void onLayerMatrixGUI(const char* label, bool (PhysicsSystem::*getter)(int, int), void (PhysicsSystem::*setter)(int, int, bool))
 	{
 		PhysicsSystem* system = static_cast<PhysicsSystem*>(m_app.getEngine().getPluginManager().getPlugin("physics"));
-		if (ImGui::CollapsingHeader("Collision matrix"))
+		if (ImGui::CollapsingHeader(label))
 		{
-			ImGui::Columns(1 + system->getCollisionsLayersCount(), "collision_matrix_col");
+			ImGui::PushID(label);
+			ImGui::Columns(1 + system->getCollisionsLayersCount(), "matrix_col");
 			ImGui::NextColumn();
 			ImGui::PushTextWrapPos(1);
 			float basic_offset = 0;
@@ -466,10 +468,10 @@ struct PhysicsUIPlugin final : StudioApp::GUIPlugin
 
 				for (int j = 0; j <= i; ++j)
 				{
-					bool b = system->canLayersCollide(i, j);
+					bool b = (system->*getter)(i, j);
 					if (ImGui::Checkbox(StaticString<10>("###", i, "-") << j, &b))
 					{
-						system->setLayersCanCollide(i, j, b);
+						(system->*setter)(i, j, b);
 					}
 					ImGui::NextColumn();
 				}
@@ -479,6 +481,7 @@ struct PhysicsUIPlugin final : StudioApp::GUIPlugin
 				}
 			}
 			ImGui::Columns();
+			ImGui::PopID();
 		}
 	}
 
@@ -720,7 +723,8 @@ struct PhysicsUIPlugin final : StudioApp::GUIPlugin
 		{
 			WorldEditor& editor = m_app.getWorldEditor();
 			onLayersGUI();
-			onCollisionMatrixGUI();
+			onLayerMatrixGUI("Collision matrix", &PhysicsSystem::canLayersCollide, &PhysicsSystem::setLayersCanCollide);
+			onLayerMatrixGUI("Contact reports", &PhysicsSystem::canLayersReportContacts, &PhysicsSystem::setLayersReportContacts);
 			onRagdollGUI(editor);
 			onDebugGUI(editor);
 		}
@@ -38,6 +38,7 @@ PhysicsGeometry::PhysicsGeometry(const Path& path, ResourceManager& resource_man
 	, system(system)
 	, convex_mesh(nullptr)
 	, tri_mesh(nullptr)
+	, m_cooked_data(allocator)
 {
 }
 
@@ -67,20 +68,45 @@ bool PhysicsGeometry::load(u64 size, const u8* mem)
 	}
 
 
-	const bool is_convex = header.m_convex != 0;
-	InputStream read_buffer(file);
-	if (is_convex) {
-		convex_mesh = system.getPhysics()->createConvexMesh(read_buffer);
-	} else {
-		tri_mesh = system.getPhysics()->createTriangleMesh(read_buffer);
- 	}
- 
+	// creating the mesh can take a while, do it on a worker and stay empty meanwhile
+	m_is_convex = header.m_convex != 0;
+	m_cooked_data.clear();
+	m_cooked_data.write(mem + file.getPosition(), size - file.getPosition());
+	++m_empty_dep_count;
+	jobs::run(this, &createMeshJob, &m_create_job, jobs::Priority::LOW);
 	return true;
 }
 
 
+void PhysicsGeometry::createMeshJob(void* data) {
+	PROFILE_FUNCTION();
+	PhysicsGeometry* geom = (PhysicsGeometry*)data;
+	InputMemoryStream blob(geom->m_cooked_data);
+	InputStream read_buffer(blob);
+	if (geom->m_is_convex) {
+		geom->convex_mesh = geom->system.getPhysics()->createConvexMesh(read_buffer);
+	} else {
+		geom->tri_mesh = geom->system.getPhysics()->createTriangleMesh(read_buffer);
+	}
+	geom->system.onGeometryCreated(*geom);
+}
+
+
+void PhysicsGeometry::onMeshCreated() {
+	m_cooked_data.free();
+	if (!convex_mesh && !tri_mesh) logError("Failed to create physics geometry ", getPath());
+	ASSERT(m_empty_dep_count > 0);
+	--m_empty_dep_count;
+	checkState();
+}
+
+
 void PhysicsGeometry::unload()
 {
+	// mesh might be still being created
+	jobs::wait(m_create_job);
+	system.cancelGeometry(*this);
+	m_cooked_data.free();
 	if (convex_mesh) convex_mesh->release();
 	if (tri_mesh) tri_mesh->release();
 	convex_mesh = nullptr;
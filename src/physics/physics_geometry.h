@@ -2,7 +2,9 @@
 
 
 #include "engine/lumix.h"
+#include "engine/job_system.h"
 #include "engine/resource.h"
+#include "engine/stream.h"
 
 
 namespace physx
@@ -44,6 +46,8 @@ struct PhysicsGeometry final : Resource
 		~PhysicsGeometry();
 
 		ResourceType getType() const override { return TYPE; }
+		// called on the main thread once the mesh is created on a worker
+		void onMeshCreated();
 
 
 	public:
@@ -52,7 +56,13 @@ struct PhysicsGeometry final : Resource
 
 	private:
 		PhysicsSystem& system;
+		OutputMemoryStream m_cooked_data;
+		bool m_is_convex = false;
+		jobs::SignalHandle m_create_job = jobs::INVALID_HANDLE;
 
+		static void createMeshJob(void* data);
+		// colliders are not needed before the rest of the scene
+		FileSystem::Priority getLoadPriority() const override { return FileSystem::Priority::LOW; }
 		void unload() override;
 		bool load(u64 size, const u8* mem) override;
 
@@ -19,6 +19,7 @@
 #include <geometry/PxHeightFieldSample.h>
 #include <PxBatchQuery.h>
 #include <PxMaterial.h>
+#include <PxPruningStructure.h>
 #include <PxRigidActor.h>
 #include <PxRigidStatic.h>
 #include <PxScene.h>
@@ -45,6 +46,7 @@
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "physics/physics_geometry.h"
@@ -85,10 +87,24 @@ enum class PhysicsSceneVersion
 	REMOVED_RAGDOLLS,
 	VEHICLE_PEAK_TORQUE,
 	VEHICLE_MAX_RPM,
+	HEIGHTFIELD_STREAMING,
 
 	LATEST,
 };
 
+// number of frames to rebuild scene query tree of moving actors, lower is faster queries but more work per frame
+static constexpr u32 DEFAULT_TREE_REBUILD_RATE = 100;
+// with fewer controllers, they are moved serially
+static constexpr u32 MIN_PARALLEL_CONTROLLERS = 32;
+// added to controllers' swept bounds, controllers closer than this are moved serially
+static constexpr float CONTROLLER_ISLAND_MARGIN = 0.5f;
+// physics runs at fixed rate, rendered poses are interpolated between steps
+static constexpr float FIXED_TIMESTEP = 1 / 60.f;
+// if a frame takes longer than this many steps, the simulation slows down
+static constexpr u32 MAX_SUBSTEPS = 4;
+// heightfields are split to tiles of this many quads, so they can be updated and streamed separately
+static constexpr u32 HEIGHTFIELD_TILE_SIZE = 128;
+
 static constexpr PxVehiclePadSmoothingData pad_smoothing =
 {
 	{
@@ -268,15 +284,21 @@ struct Wheel
 
 
 struct Heightfield {
+	explicit Heightfield(IAllocator& allocator) : m_tiles(allocator) {}
+	Heightfield(Heightfield&& rhs);
 	~Heightfield();
+	void operator =(Heightfield&& rhs) = delete;
 	void heightmapLoaded(Resource::State, Resource::State new_state, Resource&);
+	void releaseTiles();
 
 	struct PhysicsSceneImpl* m_scene;
 	EntityRef m_entity;
-	PxRigidActor* m_actor = nullptr;
+	Array<PxRigidActor*> m_tiles; // row by row, null if the tile is not resident
+	u32 m_tiles_x = 0;
 	Texture* m_heightmap = nullptr;
 	float m_xz_scale = 1.f;
 	float m_y_scale = 1.f;
+	float m_streaming_radius = 0; // tiles farther from cameras and moving objects are released, 0 - all tiles are resident
 	i32 m_layer = 0;
 };
 
@@ -285,6 +307,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 {
 	struct CPUDispatcher : physx::PxCpuDispatcher
 	{
+		// simulation is waited for later in the frame, so its tasks go before normal jobs
 		void submitTask(PxBaseTask& task) override
 		{
 			jobs::run(&task,
@@ -294,9 +317,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 					task->run();
 					task->release();
 				},
-				nullptr);
+				nullptr,
+				jobs::Priority::HIGH,
+				jobs::StackSize::LARGE);
 		}
-		PxU32 getWorkerCount() const override { return os::getCPUsCount(); }
+		PxU32 getWorkerCount() const override { return jobs::getWorkersCount(); }
 	};
 
 
@@ -321,15 +346,20 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 				if (!(cp.events & PxPairFlag::eNOTIFY_TOUCH_FOUND)) continue;
 
-				PxContactPairPoint contact;
-				cp.extractContacts(&contact, 1);
+				PxContactPairPoint points[8];
+				const PxU32 points_count = cp.extractContacts(points, lengthOf(points));
+				if (points_count == 0) continue;
+
+				float impulse = 0;
+				for (PxU32 j = 0; j < points_count; ++j) impulse += points[j].impulse.magnitude();
+				if (impulse < m_scene.m_contact_impulse_threshold) continue;
 
-				ContactData contact_data;
-				contact_data.position = fromPhysx(contact.position);
+				// delivered after the step is fetched, see dispatchContacts
+				ContactData& contact_data = m_scene.m_contacts.emplace();
+				contact_data.position = fromPhysx(points[0].position);
 				contact_data.e1 = {(int)(intptr_t)(pairHeader.actors[0]->userData)};
 				contact_data.e2 = {(int)(intptr_t)(pairHeader.actors[1]->userData)};
-
-				m_scene.onContact(contact_data);
+				contact_data.impulse = impulse;
 			}
 		}
 
@@ -376,6 +406,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 			, next_with_resource(rhs.next_with_resource)
 			, dynamic_type(rhs.dynamic_type)
 			, is_trigger(rhs.is_trigger)
+			, prev_pose(rhs.prev_pose)
+			, pose(rhs.pose)
+			, last_active_step(rhs.last_active_step)
+			, is_interpolated(rhs.is_interpolated)
+			, is_writing_pose(rhs.is_writing_pose)
 		{
 			rhs.resource = nullptr;
 			rhs.physx_actor = nullptr;
@@ -390,7 +425,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 		void rescale();
 		void setResource(PhysicsGeometry* resource);
-		void setPhysxActor(PxRigidActor* actor);
+		// `add_to_scene` is false if the caller adds the actor itself, e.g. in a batch
+		void setPhysxActor(PxRigidActor* actor, bool add_to_scene = true);
 		void onStateChanged(Resource::State old_state, Resource::State new_state, Resource&);
 		void setIsTrigger(bool is);
 
@@ -404,22 +440,31 @@ struct PhysicsSceneImpl final : PhysicsScene
 		EntityPtr next_with_resource = INVALID_ENTITY;
 		DynamicType dynamic_type = DynamicType::STATIC;
 		bool is_trigger = false;
+		// poses after the last two simulation steps, rendered pose is interpolated between them
+		RigidTransform prev_pose;
+		RigidTransform pose;
+		u32 last_active_step = 0;
+		bool is_interpolated = false; // in m_interpolated
+		bool is_writing_pose = false; // entity is moved by writeDynamicPoses, onEntityMoved must not move the actor back
 	};
 
 
 	PhysicsSceneImpl(Engine& engine, Universe& context, PhysicsSystem& system, IAllocator& allocator);
 
 
-	PxBatchQuery* createVehicleBatchQuery(u8* mem)
+	// one raycast per wheel, grows so all vehicles are updated in a single batch
+	void createVehicleBatchQuery(u32 max_queries)
 	{
-		const PxU32 maxNumQueriesInBatch = 64;
-		const PxU32 maxNumHitResultsInBatch = 64;
+		if (m_vehicle_batch_query) m_vehicle_batch_query->release();
+		m_vehicle_query_capacity = max_queries;
+		m_vehicle_query_mem.resize((sizeof(PxRaycastQueryResult) + sizeof(PxRaycastHit)) * max_queries);
+		u8* mem = m_vehicle_query_mem.begin();
 
-		PxBatchQueryDesc desc(maxNumQueriesInBatch, maxNumQueriesInBatch, 0);
+		PxBatchQueryDesc desc(max_queries, 0, 0);
 
-		desc.queryMemory.userRaycastResultBuffer = (PxRaycastQueryResult*)(mem + sizeof(PxRaycastHit) * 64);
+		desc.queryMemory.userRaycastResultBuffer = (PxRaycastQueryResult*)(mem + sizeof(PxRaycastHit) * max_queries);
 		desc.queryMemory.userRaycastTouchBuffer = (PxRaycastHit*)mem;
-		desc.queryMemory.raycastTouchBufferSize = maxNumHitResultsInBatch;
+		desc.queryMemory.raycastTouchBufferSize = max_queries;
 
 		m_vehicle_results = desc.queryMemory.userRaycastResultBuffer;
 
@@ -428,7 +473,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			return PxQueryHitType::eBLOCK;
 		};
 
-		return m_scene->createBatchQuery(desc);
+		m_vehicle_batch_query = m_scene->createBatchQuery(desc);
 	}
 
 
@@ -450,6 +495,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	~PhysicsSceneImpl()
 	{
+		fetchResults();
 		m_vehicle_batch_query->release();
 		m_vehicle_frictions->release();
 		m_controller_manager->release();
@@ -464,6 +510,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	void clear() override
 	{
+		fetchResults();
+		m_contacts.clear();
 		for (auto& controller : m_controllers)
 		{
 			controller.controller->release();
@@ -487,7 +535,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 		m_joints.clear();
 
 		m_actors.clear();
-		m_dynamic_actors.clear();
+		m_interpolated.clear();
+		m_pending_vehicles.clear();
 
 		m_terrains.clear();
 	}
@@ -528,31 +577,93 @@ struct PhysicsSceneImpl final : PhysicsScene
 		}
 	}
 
-	void onContact(const ContactData& contact_data)
+	struct ScriptContact {
+		EntityRef entity;
+		u32 contact;
+	};
+
+	static int compareScriptContacts(const void* a, const void* b) {
+		const ScriptContact* ca = (const ScriptContact*)a;
+		const ScriptContact* cb = (const ScriptContact*)b;
+		if (ca->entity.index != cb->entity.index) return ca->entity.index < cb->entity.index ? -1 : 1;
+		return ca->contact < cb->contact ? -1 : (ca->contact > cb->contact ? 1 : 0);
+	}
+
+	// each script gets all its contacts from the step in one onContacts(contacts) call
+	// contacts is a flat array, 5 numbers per contact - other entity index, position xyz and impulse
+	// scripts without onContacts get the old per contact onContact(other, x, y, z)
+	void dispatchScriptContacts()
 	{
 		if (!m_script_scene) return;
 
-		auto send = [this](EntityRef e1, EntityRef e2, const Vec3& position) {
-			if (!m_script_scene->getUniverse().hasComponent(e1, LUA_SCRIPT_TYPE)) return;
+		PROFILE_FUNCTION();
+		m_script_contacts.clear();
+		for (u32 i = 0, c = m_contacts.size(); i < c; ++i) {
+			const ContactData& contact = m_contacts[i];
+			if (m_universe.hasComponent(contact.e1, LUA_SCRIPT_TYPE)) m_script_contacts.push({contact.e1, i});
+			if (m_universe.hasComponent(contact.e2, LUA_SCRIPT_TYPE)) m_script_contacts.push({contact.e2, i});
+		}
+		if (m_script_contacts.empty()) return;
+		qsort(m_script_contacts.begin(), m_script_contacts.size(), sizeof(m_script_contacts[0]), &compareScriptContacts);
+
+		for (u32 from = 0, c = m_script_contacts.size(); from < c;) {
+			const EntityRef e = m_script_contacts[from].entity;
+			u32 to = from + 1;
+			while (to < c && m_script_contacts[to].entity == e) ++to;
+
+			// previous callbacks could destroy it
+			if (m_universe.hasComponent(e, LUA_SCRIPT_TYPE)) {
+				m_script_contacts_data.clear();
+				for (u32 i = from; i < to; ++i) {
+					const ContactData& contact = m_contacts[m_script_contacts[i].contact];
+					const EntityRef other = contact.e1 == e ? contact.e2 : contact.e1;
+					m_script_contacts_data.push((float)other.index);
+					m_script_contacts_data.push(contact.position.x);
+					m_script_contacts_data.push(contact.position.y);
+					m_script_contacts_data.push(contact.position.z);
+					m_script_contacts_data.push(contact.impulse);
+				}
 
-			for (int i = 0, c = m_script_scene->getScriptCount(e1); i < c; ++i)
-			{
-				auto* call = m_script_scene->beginFunctionCall(e1, i, "onContact");
-				if (!call) continue;
+				for (int i = 0, sc = m_script_scene->getScriptCount(e); i < sc; ++i) {
+					if (auto* call = m_script_scene->beginFunctionCall(e, i, "onContacts")) {
+						call->add(Span<const float>(m_script_contacts_data.begin(), m_script_contacts_data.end()));
+						m_script_scene->endFunctionCall();
+						continue;
+					}
 
-				call->add(e2.index);
-				call->add(position.x);
-				call->add(position.y);
-				call->add(position.z);
-				m_script_scene->endFunctionCall();
+					for (u32 j = 0; j < (u32)m_script_contacts_data.size(); j += 5) {
+						auto* call = m_script_scene->beginFunctionCall(e, i, "onContact");
+						if (!call) break;
+
+						call->add((int)m_script_contacts_data[j]);
+						call->add(m_script_contacts_data[j + 1]);
+						call->add(m_script_contacts_data[j + 2]);
+						call->add(m_script_contacts_data[j + 3]);
+						m_script_scene->endFunctionCall();
+					}
+				}
 			}
-		};
+			from = to;
+		}
+	}
 
-		send(contact_data.e1, contact_data.e2, contact_data.position);
-		send(contact_data.e2, contact_data.e1, contact_data.position);
-		m_contact_callbacks.invoke(contact_data);
+	// called after a step is fetched, not from inside physx callbacks
+	void dispatchContacts()
+	{
+		if (m_contacts.empty()) return;
+
+		PROFILE_FUNCTION();
+		dispatchScriptContacts();
+		m_contact_callbacks.invoke(m_contacts);
+		m_contacts.clear();
 	}
 
+	void setTreeRebuildRate(u32 frames) override { m_scene->setDynamicTreeRebuildRateHint(maximum(frames, 4u)); }
+	u32 getTreeRebuildRate() const override { return m_scene->getDynamicTreeRebuildRateHint(); }
+
+	void setContactImpulseThreshold(float impulse) override { m_contact_impulse_threshold = impulse; }
+	float getContactImpulseThreshold() const override { return m_contact_impulse_threshold; }
+
 
 	u32 getDebugVisualizationFlags() const override { return m_debug_visualization_flags; }
 
@@ -612,6 +723,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PxFilterData data;
 		data.word0 = 1 << layer;
 		data.word1 = m_layers.filter[layer];
+		data.word2 = m_layers.contact_report[layer];
 		controller.filter_data = data;
 		PxShape* shapes[8];
 		int shapes_count = controller.controller->getActor()->getShapes(shapes, lengthOf(shapes));
@@ -841,20 +953,19 @@ struct PhysicsSceneImpl final : PhysicsScene
 		auto& terrain = m_terrains[entity];
 		terrain.m_layer = layer;
 
-		if (terrain.m_actor)
-		{
-			PxFilterData data;
-			data.word0 = 1 << layer;
-			data.word1 = m_layers.filter[layer];
-			PxShape* shapes[8];
-			int shapes_count = terrain.m_actor->getShapes(shapes, lengthOf(shapes));
-			for (int i = 0; i < shapes_count; ++i)
-			{
-				shapes[i]->setSimulationFilterData(data);
-			}
+		for (PxRigidActor* tile : terrain.m_tiles) {
+			if (tile) updateFilterData(tile, layer);
 		}
 	}
 
+	float getHeightfieldStreamingRadius(EntityRef entity) override { return m_terrains[entity].m_streaming_radius; }
+	void setHeightfieldStreamingRadius(EntityRef entity, float radius) override { m_terrains[entity].m_streaming_radius = maximum(radius, 0.f); }
+
+	static PxI16 toHeightSample(const u8* data, u32 idx, u32 bytes_per_pixel) {
+		if (bytes_per_pixel == 2) return PxI16((i32)((const u16*)data)[idx] - 0x7fff);
+		return PxI16((i32)data[idx] - 0x7f);
+	}
+
 
 	void updateHeighfieldData(EntityRef entity,
 		int x,
@@ -865,55 +976,63 @@ struct PhysicsSceneImpl final : PhysicsScene
 		int bytes_per_pixel) override
 	{
 		PROFILE_FUNCTION();
+		ASSERT(bytes_per_pixel == 1 || bytes_per_pixel == 2);
 		Heightfield& terrain = m_terrains[entity];
-
-		PxShape* shape;
-		terrain.m_actor->getShapes(&shape, 1);
-		PxHeightFieldGeometry geom;
-		shape->getHeightFieldGeometry(geom);
+		if (terrain.m_tiles.empty()) return;
+
+		// only resident tiles are updated, others are created from the heightmap when they are streamed in
+		// samples on the edge of a tile are shared with its neighbour, so both are updated
+		const i32 tiles_x = terrain.m_tiles_x;
+		const i32 tiles_y = terrain.m_tiles.size() / tiles_x;
+		const i32 T = HEIGHTFIELD_TILE_SIZE;
+		const i32 tx_from = x > 0 ? (x - 1) / T : 0;
+		const i32 ty_from = y > 0 ? (y - 1) / T : 0;
+		const i32 tx_to = minimum((x + width - 1) / T, tiles_x - 1);
+		const i32 ty_to = minimum((y + height - 1) / T, tiles_y - 1);
 
 		Array<PxHeightFieldSample> heights(m_allocator);
-
-		heights.resize(width * height);
-		if (bytes_per_pixel == 2)
-		{
-			const i16* LUMIX_RESTRICT data = (const i16*)src_data;
-			for (int j = 0; j < height; ++j)
-			{
-				for (int i = 0; i < width; ++i)
-				{
-					int idx = j + i * height;
-					int idx2 = i + j * width;
-					heights[idx].height = PxI16((i32)data[idx2] - 0x7fff);
-					heights[idx].materialIndex0 = heights[idx].materialIndex1 = 0;
-				}
-			}
-		}
-		else
-		{
-			ASSERT(bytes_per_pixel == 1);
-			const u8* LUMIX_RESTRICT data = src_data;
-			for (int j = 0; j < height; ++j)
-			{
-				for (int i = 0; i < width; ++i)
-				{
-					int idx = j + i * height;
-					int idx2 = i + j * width;
-					heights[idx].height = PxI16((i32)data[idx2] - 0x7f);
-					heights[idx].materialIndex0 = heights[idx].materialIndex1 = 0;
+		for (i32 ty = ty_from; ty <= ty_to; ++ty) {
+			for (i32 tx = tx_from; tx <= tx_to; ++tx) {
+				PxRigidActor* tile = terrain.m_tiles[tx + ty * tiles_x];
+				if (!tile) continue;
+
+				PxShape* shape;
+				tile->getShapes(&shape, 1);
+				PxHeightFieldGeometry geom;
+				shape->getHeightFieldGeometry(geom);
+
+				// rows go along x, columns along y
+				const i32 x0 = tx * T;
+				const i32 y0 = ty * T;
+				const i32 from_x = maximum(x, x0);
+				const i32 from_y = maximum(y, y0);
+				const i32 to_x = minimum(x + width, x0 + (i32)geom.heightField->getNbRows());
+				const i32 to_y = minimum(y + height, y0 + (i32)geom.heightField->getNbColumns());
+				if (from_x >= to_x || from_y >= to_y) continue;
+
+				const i32 rows = to_x - from_x;
+				const i32 cols = to_y - from_y;
+				heights.resize(rows * cols);
+				for (i32 i = 0; i < rows; ++i) {
+					for (i32 j = 0; j < cols; ++j) {
+						PxHeightFieldSample& sample = heights[j + i * cols];
+						sample.height = toHeightSample(src_data, (from_x + i - x) + (from_y + j - y) * width, bytes_per_pixel);
+						sample.materialIndex0 = sample.materialIndex1 = 0;
+						sample.setTessFlag();
+					}
 				}
-			}
-		}
 
-		PxHeightFieldDesc hfDesc;
-		hfDesc.format = PxHeightFieldFormat::eS16_TM;
-		hfDesc.nbColumns = height;
-		hfDesc.nbRows = width;
-		hfDesc.samples.data = &heights[0];
-		hfDesc.samples.stride = sizeof(PxHeightFieldSample);
+				PxHeightFieldDesc hfDesc;
+				hfDesc.format = PxHeightFieldFormat::eS16_TM;
+				hfDesc.nbColumns = cols;
+				hfDesc.nbRows = rows;
+				hfDesc.samples.data = heights.begin();
+				hfDesc.samples.stride = sizeof(PxHeightFieldSample);
 
-		geom.heightField->modifySamples(y, x, hfDesc);
-		shape->setGeometry(geom);
+				geom.heightField->modifySamples(from_y - y0, from_x - x0, hfDesc);
+				shape->setGeometry(geom);
+			}
+		}
 	}
 
 
@@ -1327,6 +1446,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			veh->actor->release();
 		}
 		if (veh->drive) veh->drive->free();
+		m_pending_vehicles.eraseItem(entity);
 		if (veh->geom) {
 			veh->geom->getObserverCb().unbind<&Vehicle::onStateChanged>(veh.get());
 			veh->geom->decRefCount();
@@ -1346,8 +1466,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 	{
 		RigidActor& actor = m_actors[entity];
 		actor.setPhysxActor(nullptr);
+		if (actor.is_interpolated) m_interpolated.eraseItem(entity);
 		m_actors.erase(entity);
-		m_dynamic_actors.eraseItem(entity);
 		m_universe.onComponentDestroyed(entity, RIGID_ACTOR_TYPE, this);
 		if (m_is_game_running)
 		{
@@ -1444,10 +1564,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	void createHeightfield(EntityRef entity)
 	{
-		Heightfield& terrain = m_terrains.insert(entity);
-		terrain.m_heightmap = nullptr;
+		Heightfield& terrain = m_terrains.insert(entity, Heightfield(m_allocator)).value();
 		terrain.m_scene = this;
-		terrain.m_actor = nullptr;
 		terrain.m_entity = entity;
 
 		m_universe.onComponentCreated(entity, HEIGHTFIELD_TYPE, this);
@@ -1508,6 +1626,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 		int controller_layer = c.layer;
 		data.word0 = 1 << controller_layer;
 		data.word1 = m_layers.filter[controller_layer];
+		data.word2 = m_layers.contact_report[controller_layer];
 		c.filter_data = data;
 		PxShape* shapes[8];
 		int shapes_count = c.controller->getActor()->getShapes(shapes, lengthOf(shapes));
@@ -1648,41 +1767,86 @@ struct PhysicsSceneImpl final : PhysicsScene
 		if (num_lines) {
 			const PxDebugLine* PX_RESTRICT lines = rb.getLines();
 			DebugLine* tmp = render_scene->addDebugLines(num_lines);
-			for (PxU32 i = 0; i < num_lines; ++i)
-			{
-				const PxDebugLine& line = lines[i];
-				tmp[i].from = DVec3(fromPhysx(line.pos0));
-				tmp[i].to = DVec3(fromPhysx(line.pos1));
-				tmp[i].color = line.color0;
-			}
+			jobs::forEach(num_lines, jobs::GrainHint{5}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+				for (i32 i = from; i < to; ++i) {
+					const PxDebugLine& line = lines[i];
+					tmp[i].from = DVec3(fromPhysx(line.pos0));
+					tmp[i].to = DVec3(fromPhysx(line.pos1));
+					tmp[i].color = line.color0;
+				}
+			});
 		}
 		const PxU32 num_tris = rb.getNbTriangles();
 		if (num_tris) {
 			const PxDebugTriangle* PX_RESTRICT tris = rb.getTriangles();
 			DebugTriangle* tmp = render_scene->addDebugTriangles(num_tris);
-			for (PxU32 i = 0; i < num_tris; ++i)
-			{
-				const PxDebugTriangle& tri = tris[i];
-				tmp[i].p0 = DVec3(fromPhysx(tri.pos0));
-				tmp[i].p1 = DVec3(fromPhysx(tri.pos1));
-				tmp[i].p2 = DVec3(fromPhysx(tri.pos2));
-				tmp[i].color = tri.color0;
+			jobs::forEach(num_tris, jobs::GrainHint{5}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+				for (i32 i = from; i < to; ++i) {
+					const PxDebugTriangle& tri = tris[i];
+					tmp[i].p0 = DVec3(fromPhysx(tri.pos0));
+					tmp[i].p1 = DVec3(fromPhysx(tri.pos1));
+					tmp[i].p2 = DVec3(fromPhysx(tri.pos2));
+					tmp[i].color = tri.color0;
+				}
+			});
+		}
+	}
+
+
+	// called after each simulation step
+	void updateActivePoses()
+	{
+		PROFILE_FUNCTION();
+		++m_step;
+		for (EntityRef e : m_interpolated) {
+			RigidActor& actor = m_actors[e];
+			actor.prev_pose = actor.pose;
+		}
+
+		// only bodies moved by the last simulation, sleeping and kinematic bodies are not reported
+		PxU32 count;
+		PxActor** active_actors = m_scene->getActiveActors(count);
+		for (PxU32 i = 0; i < count; ++i)
+		{
+			const EntityRef e = {(int)(intptr_t)active_actors[i]->userData};
+			auto iter = m_actors.find(e);
+			if (!iter.isValid()) continue;
+
+			RigidActor& actor = iter.value();
+			// vehicles and controllers are handled elsewhere
+			if (actor.physx_actor != active_actors[i] || actor.dynamic_type != DynamicType::DYNAMIC) continue;
+
+			actor.pose = fromPhysx(actor.physx_actor->getGlobalPose());
+			actor.last_active_step = m_step;
+			if (!actor.is_interpolated) {
+				actor.is_interpolated = true;
+				actor.prev_pose = m_universe.getTransform(e).getRigidPart();
+				m_interpolated.push(e);
 			}
 		}
 	}
 
 
-	void updateDynamicActors()
+	// `t` is the time since the last step, as a fraction of the step
+	void writeDynamicPoses(float t)
 	{
 		PROFILE_FUNCTION();
-		for (EntityRef e : m_dynamic_actors)
+		// hierarchies and listeners are updated once for all bodies in endDeferredTransforms
+		m_universe.beginDeferredTransforms();
+		for (i32 i = m_interpolated.size() - 1; i >= 0; --i)
 		{
-			RigidActor& actor = m_actors[e];
-			m_update_in_progress = &actor;
-			PxTransform trans = actor.physx_actor->getGlobalPose();
-			m_universe.setTransform(actor.entity, fromPhysx(trans));
+			RigidActor& actor = m_actors[m_interpolated[i]];
+			actor.is_writing_pose = true;
+			RigidTransform tr;
+			tr.pos = lerp(actor.prev_pose.pos, actor.pose.pos, t);
+			tr.rot = nlerp(actor.prev_pose.rot, actor.pose.rot, t);
+			m_universe.setTransform(actor.entity, tr);
+			// came to rest, it's at its final pose now
+			if (actor.last_active_step != m_step) {
+				actor.is_interpolated = false;
+				m_interpolated.swapAndPop(i);
+			}
 		}
-		m_update_in_progress = nullptr;
 
 		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
 			Vehicle* veh = iter.value().get();
@@ -1704,31 +1868,129 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 			}
 		}
+		m_universe.endDeferredTransforms();
 	}
 
 
+	// does not wait, the simulation runs on workers while other scenes update
 	void simulateScene(float time_delta)
 	{
 		PROFILE_FUNCTION();
+		ASSERT(!m_is_simulating);
+		m_step_start = profiler::getCounterTimestamp();
 		m_scene->simulate(time_delta);
+		m_is_simulating = true;
 	}
 
 
-	void fetchResults()
+	// returns true if there was a running simulation
+	bool fetchResults()
 	{
+		if (!m_is_simulating) return false;
 		PROFILE_FUNCTION();
-		m_scene->fetchResults(true);
+		{
+			profiler::CounterScope wait_scope(m_fetch_wait_counter);
+			m_scene->fetchResults(true);
+		}
+		profiler::addCounterTime(m_step_counter, m_step_start);
+		m_is_simulating = false;
+		return true;
+	}
+
+
+	// finishes the frame started in update
+	void finishSimulation()
+	{
+		if (!m_is_frame_pending) return;
+		m_is_frame_pending = false;
+
+		if (fetchResults()) {
+			updateActivePoses();
+			dispatchContacts();
+		}
+		writeDynamicPoses(m_accumulator / FIXED_TIMESTEP);
+		updateControllers(m_frame_time_delta);
+
+		render();
+	}
+
+
+	static int compareControllerMovesX(const void* a, const void* b) {
+		const double ax = ((const ControllerMove*)a)->min.x;
+		const double bx = ((const ControllerMove*)b)->min.x;
+		return ax < bx ? -1 : (ax > bx ? 1 : 0);
+	}
+
+
+	static int compareControllerMovesIsland(const void* a, const void* b) {
+		const u32 ia = ((const ControllerMove*)a)->island;
+		const u32 ib = ((const ControllerMove*)b)->island;
+		return ia < ib ? -1 : (ia > ib ? 1 : 0);
+	}
+
+
+	u32 findControllerIsland(u32 idx) {
+		while (m_controller_moves[idx].island != idx) {
+			const u32 parent = m_controller_moves[idx].island;
+			m_controller_moves[idx].island = m_controller_moves[parent].island;
+			idx = parent;
+		}
+		return idx;
+	}
+
+
+	// controllers whose swept bounds overlap can touch each other, such controllers form an island
+	// fills m_controller_islands with ranges in sorted m_controller_moves
+	void computeControllerIslands() {
+		PROFILE_FUNCTION();
+		const u32 count = m_controller_moves.size();
+		qsort(m_controller_moves.begin(), count, sizeof(m_controller_moves[0]), &compareControllerMovesX);
+		for (u32 i = 0; i < count; ++i) m_controller_moves[i].island = i;
+
+		// sweep and prune on x axis
+		for (u32 i = 0; i < count; ++i) {
+			const ControllerMove& a = m_controller_moves[i];
+			for (u32 j = i + 1; j < count && m_controller_moves[j].min.x <= a.max.x; ++j) {
+				const ControllerMove& b = m_controller_moves[j];
+				if (a.min.y > b.max.y || b.min.y > a.max.y) continue;
+				if (a.min.z > b.max.z || b.min.z > a.max.z) continue;
+				const u32 ra = findControllerIsland(i);
+				const u32 rb = findControllerIsland(j);
+				if (ra != rb) m_controller_moves[maximum(ra, rb)].island = minimum(ra, rb);
+			}
+		}
+		for (u32 i = 0; i < count; ++i) m_controller_moves[i].island = findControllerIsland(i);
+		qsort(m_controller_moves.begin(), count, sizeof(m_controller_moves[0]), &compareControllerMovesIsland);
+
+		m_controller_islands.clear();
+		for (u32 i = 0; i < count; ++i) {
+			if (i == 0 || m_controller_moves[i].island != m_controller_moves[i - 1].island) m_controller_islands.push(i);
+		}
+		m_controller_islands.push(count);
+	}
+
+
+	void moveController(u32 idx, float time_delta) {
+		auto& move = m_controller_moves[idx];
+		auto& controller = *move.controller;
+		FilterCallback filter_callback;
+		filter_callback.m_filter_data = controller.filter_data;
+		PxControllerFilters filters(nullptr, &filter_callback);
+		controller.controller->move(toPhysx(move.dif), 0.001f, time_delta, filters);
+		move.foot = controller.controller->getFootPosition();
 	}
 
 
 	void updateControllers(float time_delta)
 	{
+		if (m_controllers.empty()) return;
+
 		PROFILE_FUNCTION();
+		m_controller_moves.clear();
 		for (auto& controller : m_controllers)
 		{
 			Vec3 dif = controller.frame_change;
 			controller.frame_change = Vec3(0, 0, 0);
-
 			PxControllerState state;
 			controller.controller->getState(state);
 			float gravity_acceleration = 0.0f;
@@ -1752,45 +2014,65 @@ struct PhysicsSceneImpl final : PhysicsScene
 				controller.gravity_speed = 0;
 			}
 
-			m_filter_callback.m_filter_data = controller.filter_data;
-			PxControllerFilters filters(nullptr, &m_filter_callback);
-			controller.controller->move(toPhysx(dif), 0.001f, time_delta, filters);
-			PxExtendedVec3 p = controller.controller->getFootPosition();
+			auto& move = m_controller_moves.emplace();
+			move.controller = &controller;
+			move.dif = dif;
+			const PxExtendedVec3 p = controller.controller->getFootPosition();
+			const DVec3 foot(p.x, p.y, p.z);
+			const float r = controller.radius + CONTROLLER_ISLAND_MARGIN;
+			move.min = foot + minimum(dif, Vec3(0)) - Vec3(r, CONTROLLER_ISLAND_MARGIN, r);
+			move.max = foot + maximum(dif, Vec3(0)) + Vec3(r, controller.height + 2 * controller.radius + CONTROLLER_ISLAND_MARGIN, r);
+		}
 
-			m_universe.setPosition(controller.entity, {p.x, p.y, p.z});
+		// islands are independent, each is moved serially on some worker
+		if (m_controller_moves.size() < MIN_PARALLEL_CONTROLLERS) {
+			for (u32 i = 0, c = m_controller_moves.size(); i < c; ++i) moveController(i, time_delta);
 		}
+		else {
+			computeControllerIslands();
+			jobs::forEach(m_controller_islands.size() - 1, 1, [&](i32 from, i32 to){
+				PROFILE_BLOCK("move controllers");
+				for (u32 i = m_controller_islands[from], end = m_controller_islands[to]; i < end; ++i) {
+					moveController(i, time_delta);
+				}
+			});
+		}
+
+		for (const auto& move : m_controller_moves) {
+			m_universe.setPosition(move.controller->entity, {move.foot.x, move.foot.y, move.foot.z});
+		}
+
+		// collected in HitReport during moves
+		for (const auto& hit : m_controller_hits) onControllerHit(hit.controller, hit.obj);
+		m_controller_hits.clear();
 	}
 
 	void updateVehicles(float time_delta) {
-		const u32 count = (u32)m_vehicles.size();
-		
-		PxVehicleWheels* vehicles[16];
+		if (m_vehicles.empty()) return;
 
-		u32 valid_count = 0;
+		PROFILE_FUNCTION();
+		m_vehicle_batch.clear();
 		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
 			Vehicle* veh = iter.value().get();
 			if (veh->drive) {
-				vehicles[valid_count] = veh->drive;
+				m_vehicle_batch.push(veh->drive);
 				PxVehicleDrive4WSmoothAnalogRawInputsAndSetAnalogInputs(pad_smoothing, steer_vs_forward_speed, veh->raw_input, time_delta, false, *veh->drive);
-				++valid_count;
-
-				if (valid_count == lengthOf(vehicles)) {
-					PxVehicleSuspensionRaycasts(m_vehicle_batch_query, valid_count, vehicles, valid_count * 4, m_vehicle_results);
-					PxVehicleUpdates(time_delta, m_scene->getGravity(), *m_vehicle_frictions, valid_count, vehicles, nullptr);
-					valid_count = 0;
-				}
 			}
 		}
+		if (m_vehicle_batch.empty()) return;
 
-		if (valid_count > 0) {
-			PxVehicleSuspensionRaycasts(m_vehicle_batch_query, valid_count, vehicles, valid_count * 4, m_vehicle_results);
-			PxVehicleUpdates(time_delta, m_scene->getGravity(), *m_vehicle_frictions, valid_count, vehicles, nullptr);
-		}
+		// all vehicles in one batch, so physx can process wheels of all of them at once
+		const u32 wheels_count = m_vehicle_batch.size() * 4;
+		if (wheels_count > m_vehicle_query_capacity) createVehicleBatchQuery(maximum(wheels_count, m_vehicle_query_capacity * 2));
+		PxVehicleSuspensionRaycasts(m_vehicle_batch_query, m_vehicle_batch.size(), m_vehicle_batch.begin(), wheels_count, m_vehicle_results);
+		PxVehicleUpdates(time_delta, m_scene->getGravity(), *m_vehicle_frictions, m_vehicle_batch.size(), m_vehicle_batch.begin(), nullptr);
 	}
 
 	void lateUpdate(float time_delta, bool paused) override {
 		if (!m_is_game_running || paused) return;
 
+		finishSimulation();
+
 		AnimationScene* anim_scene = (AnimationScene*)m_universe.getScene(crc32("animation"));
 		if (!anim_scene) return;
 
@@ -1808,18 +2090,38 @@ struct PhysicsSceneImpl final : PhysicsScene
 	{
 		if (!m_is_game_running || paused) return;
 
-		time_delta = minimum(1 / 20.0f, time_delta);
-		updateVehicles(time_delta);
-		simulateScene(time_delta);
-		fetchResults();
-		updateDynamicActors();
-		updateControllers(time_delta);
+		// in case lateUpdate did not run, e.g. the game was paused in the middle of the frame
+		finishSimulation();
+		rebuildPendingVehicles();
+		updateHeightfieldStreaming();
+
+		m_frame_time_delta = minimum(1 / 20.0f, time_delta);
+		m_accumulator += time_delta;
+		u32 steps = u32(m_accumulator / FIXED_TIMESTEP);
+		if (steps > MAX_SUBSTEPS) {
+			// can't catch up, simulation slows down instead
+			steps = MAX_SUBSTEPS;
+			m_accumulator = MAX_SUBSTEPS * FIXED_TIMESTEP;
+		}
+		m_accumulator -= steps * FIXED_TIMESTEP;
 
-		render();
+		for (u32 i = 0; i < steps; ++i) {
+			if (fetchResults()) {
+				updateActivePoses();
+				dispatchContacts();
+			}
+			updateVehicles(FIXED_TIMESTEP);
+			simulateScene(FIXED_TIMESTEP);
+		}
+		// results of the last step are fetched in lateUpdate
+		m_is_frame_pending = true;
+		// with fixed rate simulation, update is a simulation step and the universe interpolates between steps,
+		// so the poses must be written in the step, lateUpdate does not run after each step
+		if (m_engine.getSimulationRate() > 0) finishSimulation();
 	}
 
 
-	DelegateList<void(const ContactData&)>& onContact() override { return m_contact_callbacks; }
+	DelegateList<void(Span<const ContactData>)>& onContact() override { return m_contact_callbacks; }
 
 
 	void initJoint(EntityRef entity, Joint& joint)
@@ -1898,7 +2200,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			physx::PxFilterData filter;
 			filter.word0 = 1 << vehicle.wheels_layer;
 			filter.word1 = m_layers.filter[vehicle.wheels_layer];
-			filter.word2 = 0;
+			filter.word2 = m_layers.contact_report[vehicle.wheels_layer];
 			filter.word3 = (u32)FilterFlags::VEHICLE;
 			wheel_sim_data->setSceneQueryFilterData(idx, filter);
 		}
@@ -1964,9 +2266,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 		drive_sim_data.setAckermannGeometryData(ackermann);
 	}
 
-	PxRigidDynamic* createVehicleActor(const RigidTransform& transform, Span<const EntityRef> wheels_entities, Vehicle& vehicle) {
+	PxRigidDynamic* createVehicleActor(const RigidTransform& transform, Span<const EntityRef> wheels_entities, Span<PxConvexMesh*> wheel_meshes, Vehicle& vehicle) {
 		PxPhysics& physics = *m_system->getPhysics();
-		PxCooking& cooking = *m_system->getCooking();
 
 		RigidTransform wheel_transforms[4];
 		getTransforms(Span(wheels_entities), Span(wheel_transforms));
@@ -1974,14 +2275,12 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PxRigidDynamic* actor = physics.createRigidDynamic(toPhysx(transform));
 
 		for (int i = 0; i < 4; i++) {
-			const Wheel& w = m_wheels[wheels_entities[i]];
-			PxConvexMesh* wheel_mesh = createWheelMesh(w.width, w.radius, physics, cooking);
-			PxConvexMeshGeometry geom(wheel_mesh);
+			PxConvexMeshGeometry geom(wheel_meshes[i]);
 			PxShape* wheel_shape = PxRigidActorExt::createExclusiveShape(*actor, geom, *m_default_material);
 			physx::PxFilterData filter;
 			filter.word0 = 1 << vehicle.wheels_layer;
 			filter.word1 = m_layers.filter[vehicle.wheels_layer];
-			filter.word2 = 0;
+			filter.word2 = m_layers.contact_report[vehicle.wheels_layer];
 			filter.word3 = (u32)FilterFlags::VEHICLE;
 			wheel_shape->setQueryFilterData(filter);
 			wheel_shape->setSimulationFilterData(filter);
@@ -1993,7 +2292,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			physx::PxFilterData filter;
 			filter.word0 = 1 << vehicle.chassis_layer;
 			filter.word1 = m_layers.filter[vehicle.chassis_layer];
-			filter.word2 = 0;
+			filter.word2 = m_layers.contact_report[vehicle.chassis_layer];
 			filter.word3 = (u32)FilterFlags::VEHICLE;
 			PxMeshScale pxscale(1.f);
 			PxConvexMeshGeometry convex_geom(vehicle.geom->convex_mesh, pxscale);
@@ -2018,6 +2317,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 		if (vehicle.actor) {
 			m_scene->removeActor(*vehicle.actor);
 			vehicle.actor->release();
+			vehicle.actor = nullptr;
+		}
+		if (vehicle.drive) {
+			vehicle.drive->free();
+			vehicle.drive = nullptr;
 		}
 
 		PxVehicleWheelsSimData* wheel_sim_data = setupWheelsSimulationData(entity, vehicle);
@@ -2026,21 +2330,31 @@ struct PhysicsSceneImpl final : PhysicsScene
 			return;
 		}
 
-		PxVehicleDriveSimData4W drive_sim_data;
-		setupDriveSimData(*wheel_sim_data, drive_sim_data, vehicle);
-
-		const RigidTransform tr = m_universe.getTransform(entity).getRigidPart();
-
 		EntityPtr wheels_ptr[4];
 		getWheels(entity, Span(wheels_ptr));
 		
 		EntityRef wheels[4];
-		wheels[0] = (EntityRef)wheels_ptr[0];
-		wheels[1] = (EntityRef)wheels_ptr[1];
-		wheels[2] = (EntityRef)wheels_ptr[2];
-		wheels[3] = (EntityRef)wheels_ptr[3];
+		PxConvexMesh* wheel_meshes[4];
+		bool meshes_ready = true;
+		for (u32 i = 0; i < 4; ++i) {
+			wheels[i] = (EntityRef)wheels_ptr[i];
+			wheel_meshes[i] = getWheelMesh(m_wheels[wheels[i]]);
+			meshes_ready = meshes_ready && wheel_meshes[i];
+		}
 
-		vehicle.actor = createVehicleActor(tr, Span(wheels), vehicle);
+		if (!meshes_ready) {
+			// wheel meshes are being cooked, try again in next update
+			wheel_sim_data->free();
+			if (m_pending_vehicles.indexOf(entity) < 0) m_pending_vehicles.push(entity);
+			return;
+		}
+
+		PxVehicleDriveSimData4W drive_sim_data;
+		setupDriveSimData(*wheel_sim_data, drive_sim_data, vehicle);
+
+		const RigidTransform tr = m_universe.getTransform(entity).getRigidPart();
+
+		vehicle.actor = createVehicleActor(tr, Span(wheels), Span(wheel_meshes), vehicle);
 		m_scene->addActor(*vehicle.actor);
 
 		vehicle.drive = PxVehicleDrive4W::allocate(4);
@@ -2050,41 +2364,27 @@ struct PhysicsSceneImpl final : PhysicsScene
 		wheel_sim_data->free();
 	}
 
+	void rebuildPendingVehicles() {
+		if (m_pending_vehicles.empty()) return;
 
-	static PxConvexMesh* createConvexMesh(const PxVec3* verts, const PxU32 numVerts, PxPhysics& physics, PxCooking& cooking)
-	{
-		PxConvexMeshDesc convexDesc;
-		convexDesc.points.count = numVerts;
-		convexDesc.points.stride = sizeof(PxVec3);
-		convexDesc.points.data = verts;
-		convexDesc.flags = PxConvexFlag::eCOMPUTE_CONVEX;
-
-		PxConvexMesh* convexMesh = NULL;
-		PxDefaultMemoryOutputStream buf;
-		if (cooking.cookConvexMesh(convexDesc, buf))
-		{
-			PxDefaultMemoryInputData id(buf.getData(), buf.getSize());
-			convexMesh = physics.createConvexMesh(id);
+		PROFILE_FUNCTION();
+		Array<EntityRef> pending(m_allocator);
+		m_pending_vehicles.swap(pending);
+		for (EntityRef e : pending) {
+			rebuildVehicle(e, *m_vehicles[e]);
 		}
-
-		return convexMesh;
 	}
 
 
-	static PxConvexMesh* createWheelMesh(const PxF32 width, const PxF32 radius, PxPhysics& physics, PxCooking& cooking)
-	{
-		PxVec3 points[2 * 16];
-		for (PxU32 i = 0; i < 16; i++)
-		{
-			const PxF32 cosTheta = PxCos(i*PxPi*2.0f / 16.0f);
-			const PxF32 sinTheta = PxSin(i*PxPi*2.0f / 16.0f);
-			const PxF32 y = radius * cosTheta;
-			const PxF32 z = radius * sinTheta;
-			points[2 * i + 0] = PxVec3(-width / 2.0f, y, z);
-			points[2 * i + 1] = PxVec3(+width / 2.0f, y, z);
+	PxConvexMesh* getWheelMesh(const Wheel& wheel) {
+		Vec3 points[2 * 16];
+		for (u32 i = 0; i < 16; ++i) {
+			const float y = wheel.radius * cosf(i * PI * 2 / 16);
+			const float z = wheel.radius * sinf(i * PI * 2 / 16);
+			points[2 * i + 0] = Vec3(-wheel.width * 0.5f, y, z);
+			points[2 * i + 1] = Vec3(wheel.width * 0.5f, y, z);
 		}
-
-		return createConvexMesh(points, 32, physics, cooking);
+		return m_system->getConvexMesh(Span(points));
 	}
 
 	void getWheels(EntityRef car, Span<EntityPtr> wheels) {
@@ -2135,7 +2435,17 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void stopGame() override { m_is_game_running = false; }
+	void stopGame() override
+	{
+		finishSimulation();
+		m_is_game_running = false;
+		m_accumulator = 0;
+		m_pending_vehicles.clear();
+
+		for (Heightfield& terrain : m_terrains) {
+			updateHeightfieldResidency(terrain, {});
+		}
+	}
 
 
 	float getControllerRadius(EntityRef entity) override { return m_controllers[entity].radius; }
@@ -2282,6 +2592,18 @@ struct PhysicsSceneImpl final : PhysicsScene
 	};
 
 
+	static void toRaycastHit(const PxLocationHit& hit, RaycastHit& result)
+	{
+		result.normal = fromPhysx(hit.normal);
+		result.position = fromPhysx(hit.position);
+		result.entity = INVALID_ENTITY;
+		if (hit.shape)
+		{
+			PxRigidActor* actor = hit.shape->getActor();
+			if (actor) result.entity = EntityPtr{(int)(intptr_t)actor->userData};
+		}
+	}
+
 	bool raycastEx(const Vec3& origin,
 		const Vec3& dir,
 		float distance,
@@ -2303,21 +2625,70 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PxQueryFilterData filter_data;
 		filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
 		bool status = m_scene->raycast(physx_origin, unit_dir, max_distance, hit, flags, filter_data, &filter);
-		result.normal.x = hit.block.normal.x;
-		result.normal.y = hit.block.normal.y;
-		result.normal.z = hit.block.normal.z;
-		result.position.x = hit.block.position.x;
-		result.position.y = hit.block.position.y;
-		result.position.z = hit.block.position.z;
-		result.entity = INVALID_ENTITY;
-		if (hit.block.shape)
-		{
-			PxRigidActor* actor = hit.block.shape->getActor();
-			if (actor) result.entity = EntityPtr{(int)(intptr_t)actor->userData};
-		}
+		toRaycastHit(hit.block, result);
 		return status;
 	}
 
+	// physx scene can be queried from multiple threads as long as nothing modifies it,
+	// queries during simulation see the scene as it was before the simulation started
+	template <typename Q, typename F>
+	void batchQueries(Span<const Q> queries, Span<RaycastHit> results, const F& f)
+	{
+		PROFILE_FUNCTION();
+		ASSERT(queries.length() == results.length());
+		jobs::forEach(queries.length(), 64, [&](i32 from, i32 to){
+			PROFILE_BLOCK("queries");
+			for (i32 i = from; i < to; ++i) {
+				const Q& q = queries[i];
+				Filter filter;
+				filter.entity = q.ignored;
+				filter.layer = q.layer;
+				filter.scene = this;
+				f(q, filter, results[i]);
+			}
+		});
+	}
+
+	void raycasts(Span<const RaycastQuery> queries, Span<RaycastHit> results) override
+	{
+		batchQueries(queries, results, [&](const RaycastQuery& q, Filter& filter, RaycastHit& result){
+			PxRaycastBuffer hit;
+			PxQueryFilterData filter_data;
+			filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
+			m_scene->raycast(toPhysx(q.origin), toPhysx(q.dir), q.distance, hit, PxHitFlag::ePOSITION | PxHitFlag::eNORMAL, filter_data, &filter);
+			toRaycastHit(hit.block, result);
+		});
+	}
+
+	void sweeps(Span<const SweepQuery> queries, Span<RaycastHit> results) override
+	{
+		batchQueries(queries, results, [&](const SweepQuery& q, Filter& filter, RaycastHit& result){
+			PxSweepBuffer hit;
+			PxQueryFilterData filter_data;
+			filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
+			const PxSphereGeometry geom(q.radius);
+			const PxTransform pose(toPhysx(q.origin));
+			m_scene->sweep(geom, pose, toPhysx(q.dir), q.distance, hit, PxHitFlag::ePOSITION | PxHitFlag::eNORMAL, filter_data, &filter);
+			toRaycastHit(hit.block, result);
+		});
+	}
+
+	void overlaps(Span<const OverlapQuery> queries, Span<RaycastHit> results) override
+	{
+		batchQueries(queries, results, [&](const OverlapQuery& q, Filter& filter, RaycastHit& result){
+			PxOverlapBuffer hit;
+			PxQueryFilterData filter_data;
+			// overlaps have no closest hit, any blocking hit is enough
+			filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER | PxQueryFlag::eANY_HIT;
+			const PxSphereGeometry geom(q.radius);
+			m_scene->overlap(geom, PxTransform(toPhysx(q.position)), hit, filter_data, &filter);
+			result.position = q.position;
+			result.normal = Vec3(0);
+			result.entity = INVALID_ENTITY;
+			if (hit.hasBlock && hit.block.actor) result.entity = EntityPtr{(int)(intptr_t)hit.block.actor->userData};
+		});
+	}
+
 	void onEntityDestroyed(EntityRef entity)
 	{
 		for (int i = 0, c = m_joints.size(); i < c; ++i)
@@ -2329,6 +2700,35 @@ struct PhysicsSceneImpl final : PhysicsScene
 		}
 	}
 
+	// disabled entities do not collide and are not simulated
+	void onEntityEnabled(EntityRef entity, bool enable)
+	{
+		auto iter = m_actors.find(entity);
+		if (!iter.isValid()) return;
+
+		RigidActor& actor = iter.value();
+		if (!actor.physx_actor) return;
+
+		actor.physx_actor->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, !enable);
+		if (!enable) return;
+
+		// entity could be moved while it was disabled
+		const Transform tr = m_universe.getTransform(entity);
+		actor.physx_actor->setGlobalPose(toPhysx(tr.getRigidPart()));
+		if (actor.dynamic_type == DynamicType::DYNAMIC) {
+			PxRigidDynamic* dynamic = (PxRigidDynamic*)actor.physx_actor;
+			dynamic->setLinearVelocity(PxVec3(0));
+			dynamic->setAngularVelocity(PxVec3(0));
+			dynamic->wakeUp();
+		}
+	}
+
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef e : entities) onEntityMoved(e);
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
 		const u64 cmp_mask = m_universe.getComponentsMask(entity);
@@ -2349,7 +2749,9 @@ struct PhysicsSceneImpl final : PhysicsScene
 			auto iter = m_actors.find(entity);
 			if (iter.isValid()) {
 				RigidActor& actor = iter.value();
-				if (actor.physx_actor && m_update_in_progress != &actor)
+				const bool is_writing_pose = actor.is_writing_pose;
+				actor.is_writing_pose = false;
+				if (actor.physx_actor && !is_writing_pose)
 				{
 					Transform trans = m_universe.getTransform(entity);
 					if (actor.dynamic_type == DynamicType::KINEMATIC)
@@ -2360,6 +2762,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 					else
 					{
 						actor.physx_actor->setGlobalPose(toPhysx(trans.getRigidPart()), false);
+						// do not interpolate from the old pose
+						actor.prev_pose = actor.pose = trans.getRigidPart();
 					}
 					if (actor.resource && actor.scale != trans.scale)
 					{
@@ -2371,113 +2775,170 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void heightmapLoaded(Heightfield& terrain)
-	{
+	void createHeightfieldTile(Heightfield& terrain, u32 tile) {
 		PROFILE_FUNCTION();
-		Array<PxHeightFieldSample> heights(m_allocator);
+		const Texture& heightmap = *terrain.m_heightmap;
+		const u32 bytes_per_pixel = heightmap.format == gpu::TextureFormat::R16 ? 2 : 1;
+		const u8* data = heightmap.getData();
+		const u32 x0 = (tile % terrain.m_tiles_x) * HEIGHTFIELD_TILE_SIZE;
+		const u32 y0 = (tile / terrain.m_tiles_x) * HEIGHTFIELD_TILE_SIZE;
+		// tiles share samples on their edges, rows go along x, columns along y
+		const u32 rows = minimum(HEIGHTFIELD_TILE_SIZE + 1, heightmap.width - x0);
+		const u32 cols = minimum(HEIGHTFIELD_TILE_SIZE + 1, heightmap.height - y0);
 
-		int width = terrain.m_heightmap->width;
-		int height = terrain.m_heightmap->height;
-		heights.resize(width * height);
-		PxHeightFieldSample* heights_ptr = heights.begin();
-		if (terrain.m_heightmap->format == gpu::TextureFormat::R16)
-		{
-			PROFILE_BLOCK("copyData");
-			const i16* LUMIX_RESTRICT data = (const i16*)terrain.m_heightmap->getData();
-			for (int j = 0; j < height; ++j)
-			{
-				int idx = j * width;
-				for (int i = 0; i < width; ++i)
-				{
-					int idx2 = j + i * height;
-					heights_ptr[idx].height = PxI16((i32)data[idx2] - 0x7fff);
-					heights_ptr[idx].materialIndex0 = heights_ptr[idx].materialIndex1 = 0;
-					heights_ptr[idx].setTessFlag();
-					++idx;
-				}
+		Array<PxHeightFieldSample> heights(m_allocator);
+		heights.resize(rows * cols);
+		for (u32 i = 0; i < rows; ++i) {
+			for (u32 j = 0; j < cols; ++j) {
+				PxHeightFieldSample& sample = heights[j + i * cols];
+				sample.height = toHeightSample(data, (x0 + i) + (y0 + j) * heightmap.width, bytes_per_pixel);
+				sample.materialIndex0 = sample.materialIndex1 = 0;
+				sample.setTessFlag();
 			}
 		}
-		else if (terrain.m_heightmap->format == gpu::TextureFormat::R8)
-		{
-			PROFILE_BLOCK("copyData");
-			const u8* data = terrain.m_heightmap->getData();
-			for (int j = 0; j < height; ++j)
-			{
-				for (int i = 0; i < width; ++i)
-				{
-					int idx = i + j * width;
-					int idx2 = j + i * height;
-					heights_ptr[idx].height = PxI16((i32)data[idx2] - 0x7f);
-					heights_ptr[idx].materialIndex0 = heights_ptr[idx].materialIndex1 = 0;
-					heights_ptr[idx].setTessFlag();
-				}
-			}
+
+		PxHeightFieldDesc hfDesc;
+		hfDesc.format = PxHeightFieldFormat::eS16_TM;
+		hfDesc.nbColumns = cols;
+		hfDesc.nbRows = rows;
+		hfDesc.samples.data = heights.begin();
+		hfDesc.samples.stride = sizeof(PxHeightFieldSample);
+
+		PxHeightField* heightfield = m_system->getCooking()->createHeightField(hfDesc, m_system->getPhysics()->getPhysicsInsertionCallback());
+		if (!heightfield) {
+			logError("Could not create PhysX heightfield ", heightmap.getPath());
+			return;
 		}
-		else {
-			logError("Unsupported physics heightmap format ", terrain.m_heightmap->getPath());
+
+		const float height_scale = bytes_per_pixel == 2 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
+		PxHeightFieldGeometry hfGeom(heightfield,
+			PxMeshGeometryFlags(),
+			height_scale * terrain.m_y_scale,
+			terrain.m_xz_scale,
+			terrain.m_xz_scale);
+
+		RigidTransform transform = m_universe.getTransform(terrain.m_entity).getRigidPart();
+		transform.pos.y += terrain.m_y_scale * 0.5f;
+		transform.pos += transform.rot.rotate(Vec3(x0 * terrain.m_xz_scale, 0, y0 * terrain.m_xz_scale));
+
+		PxRigidActor* actor = PxCreateStatic(*m_system->getPhysics(), toPhysx(transform), hfGeom, *m_default_material);
+		// the shape keeps its own reference
+		heightfield->release();
+		if (!actor) {
+			logError("Could not create PhysX heightfield ", heightmap.getPath());
 			return;
 		}
 
-		{ // PROFILE_BLOCK scope
-			PROFILE_BLOCK("physX");
-			PxHeightFieldDesc hfDesc;
-			hfDesc.format = PxHeightFieldFormat::eS16_TM;
-			hfDesc.nbColumns = width;
-			hfDesc.nbRows = height;
-			hfDesc.samples.data = &heights[0];
-			hfDesc.samples.stride = sizeof(PxHeightFieldSample);
-
-			PxHeightField* heightfield = m_system->getCooking()->createHeightField(
-				hfDesc, m_system->getPhysics()->getPhysicsInsertionCallback());
-			float height_scale = terrain.m_heightmap->format == gpu::TextureFormat::R16 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
-			PxHeightFieldGeometry hfGeom(heightfield,
-				PxMeshGeometryFlags(),
-				height_scale * terrain.m_y_scale,
-				terrain.m_xz_scale,
-				terrain.m_xz_scale);
-			if (terrain.m_actor)
-			{
-				PxRigidActor* actor = terrain.m_actor;
-				m_scene->removeActor(*actor);
-				actor->release();
-				terrain.m_actor = nullptr;
+		actor->userData = (void*)(intptr_t)terrain.m_entity.index;
+		m_scene->addActor(*actor);
+		updateFilterData(actor, terrain.m_layer);
+		actor->setActorFlag(PxActorFlag::eVISUALIZATION, true);
+		terrain.m_tiles[tile] = actor;
+	}
+
+
+	void updateHeightfieldResidency(Heightfield& terrain, Span<const DVec3> points) {
+		if (terrain.m_tiles.empty()) return;
+
+		const bool streamed = m_is_game_running && terrain.m_streaming_radius > 0;
+		const RigidTransform tr = m_universe.getTransform(terrain.m_entity).getRigidPart();
+		const Quat inv_rot = tr.rot.conjugated();
+		const float tile_size = HEIGHTFIELD_TILE_SIZE * terrain.m_xz_scale;
+
+		for (u32 i = 0, c = terrain.m_tiles.size(); i < c; ++i) {
+			bool resident = !streamed;
+			if (streamed) {
+				// resident tiles are kept a bit farther, so tiles on the border are not recreated every frame
+				const float radius = terrain.m_streaming_radius * (terrain.m_tiles[i] ? 1.25f : 1.f);
+				const float from_x = (i % terrain.m_tiles_x) * tile_size;
+				const float from_z = (i / terrain.m_tiles_x) * tile_size;
+				for (const DVec3& p : points) {
+					const Vec3 local = inv_rot.rotate(Vec3(p - tr.pos));
+					const float dx = maximum(from_x - local.x, local.x - from_x - tile_size, 0.f);
+					const float dz = maximum(from_z - local.z, local.z - from_z - tile_size, 0.f);
+					if (dx * dx + dz * dz < radius * radius) {
+						resident = true;
+						break;
+					}
+				}
 			}
 
-			PxTransform transform = toPhysx(m_universe.getTransform(terrain.m_entity).getRigidPart());
-			transform.p.y += terrain.m_y_scale * 0.5f;
-
-			PxRigidActor* actor = PxCreateStatic(*m_system->getPhysics(), transform, hfGeom, *m_default_material);
-			if (actor)
-			{
-				actor->userData = (void*)(intptr_t)terrain.m_entity.index;
-				m_scene->addActor(*actor);
-				terrain.m_actor = actor;
-
-				PxFilterData data;
-				int terrain_layer = terrain.m_layer;
-				data.word0 = 1 << terrain_layer;
-				data.word1 = m_layers.filter[terrain_layer];
-				PxShape* shapes[8];
-				int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
-				for (int i = 0; i < shapes_count; ++i)
-				{
-					shapes[i]->setSimulationFilterData(data);
-				}
-				terrain.m_actor->setActorFlag(PxActorFlag::eVISUALIZATION, true);
+			if (resident && !terrain.m_tiles[i]) {
+				createHeightfieldTile(terrain, i);
 			}
-			else
-			{
-				logError("Could not create PhysX heightfield ", terrain.m_heightmap->getPath());
+			else if (!resident && terrain.m_tiles[i]) {
+				terrain.m_tiles[i]->release();
+				terrain.m_tiles[i] = nullptr;
 			}
 		}
 	}
 
 
+	void updateHeightfieldStreaming() {
+		bool any_streamed = false;
+		for (const Heightfield& terrain : m_terrains) {
+			any_streamed = any_streamed || (terrain.m_streaming_radius > 0 && !terrain.m_tiles.empty());
+		}
+		if (!any_streamed) return;
+
+		PROFILE_FUNCTION();
+		// tiles are kept around the active camera and everything which moves
+		Array<DVec3> points(m_allocator);
+		auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
+		if (render_scene) {
+			const EntityPtr camera = render_scene->getActiveCamera();
+			if (camera.isValid()) points.push(m_universe.getPosition((EntityRef)camera));
+		}
+		for (const Controller& controller : m_controllers) {
+			points.push(m_universe.getPosition(controller.entity));
+		}
+		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
+			points.push(m_universe.getPosition(iter.key()));
+		}
+		for (EntityRef e : m_interpolated) {
+			points.push(m_universe.getPosition(e));
+		}
+
+		for (Heightfield& terrain : m_terrains) {
+			if (terrain.m_streaming_radius > 0) updateHeightfieldResidency(terrain, points);
+		}
+	}
+
+
+	void heightmapLoaded(Heightfield& terrain)
+	{
+		PROFILE_FUNCTION();
+		terrain.releaseTiles();
+
+		const Texture& heightmap = *terrain.m_heightmap;
+		if (heightmap.format != gpu::TextureFormat::R16 && heightmap.format != gpu::TextureFormat::R8) {
+			logError("Unsupported physics heightmap format ", heightmap.getPath());
+			return;
+		}
+		if (heightmap.width < 2 || heightmap.height < 2) {
+			logError("Physics heightmap ", heightmap.getPath(), " is too small");
+			return;
+		}
+
+		terrain.m_tiles_x = (heightmap.width - 2) / HEIGHTFIELD_TILE_SIZE + 1;
+		const u32 tiles_y = (heightmap.height - 2) / HEIGHTFIELD_TILE_SIZE + 1;
+		terrain.m_tiles.resize(terrain.m_tiles_x * tiles_y);
+		for (PxRigidActor*& tile : terrain.m_tiles) tile = nullptr;
+
+		if (m_is_game_running && terrain.m_streaming_radius > 0) {
+			// tiles are created in next update
+			return;
+		}
+		updateHeightfieldResidency(terrain, {});
+	}
+
+
 	void updateFilterData(PxRigidActor* actor, int layer)
 	{
 		PxFilterData data;
 		data.word0 = 1 << layer;
 		data.word1 = m_layers.filter[layer];
+		data.word2 = m_layers.contact_report[layer];
 		PxShape* shapes[8];
 		int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
 		for (int i = 0; i < shapes_count; ++i)
@@ -2496,6 +2957,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			int actor_layer = actor.layer;
 			data.word0 = 1 << actor_layer;
 			data.word1 = m_layers.filter[actor_layer];
+			data.word2 = m_layers.contact_report[actor_layer];
 			PxShape* shapes[8];
 			int shapes_count = actor.physx_actor->getShapes(shapes, lengthOf(shapes));
 			for (int i = 0; i < shapes_count; ++i)
@@ -2510,6 +2972,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			int controller_layer = controller.layer;
 			data.word0 = 1 << controller_layer;
 			data.word1 = m_layers.filter[controller_layer];
+			data.word2 = m_layers.contact_report[controller_layer];
 			controller.filter_data = data;
 			PxShape* shapes[8];
 			int shapes_count = controller.controller->getActor()->getShapes(shapes, lengthOf(shapes));
@@ -2522,17 +2985,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 		for (auto& terrain : m_terrains)
 		{
-			if (!terrain.m_actor) continue;
-
-			PxFilterData data;
-			int terrain_layer = terrain.m_layer;
-			data.word0 = 1 << terrain_layer;
-			data.word1 = m_layers.filter[terrain_layer];
-			PxShape* shapes[8];
-			int shapes_count = terrain.m_actor->getShapes(shapes, lengthOf(shapes));
-			for (int i = 0; i < shapes_count; ++i)
-			{
-				shapes[i]->setSimulationFilterData(data);
+			for (PxRigidActor* tile : terrain.m_tiles) {
+				if (tile) updateFilterData(tile, terrain.m_layer);
 			}
 		}
 	}
@@ -2790,12 +3244,6 @@ struct PhysicsSceneImpl final : PhysicsScene
 		if (actor.dynamic_type == new_value) return;
 
 		actor.dynamic_type = new_value;
-		if (new_value == DynamicType::DYNAMIC) {
-			m_dynamic_actors.push(entity);
-		}
-		else {
-			m_dynamic_actors.swapAndPopItem(entity);
-		}
 		if (!actor.physx_actor) return;
 
 		PxTransform transform = toPhysx(m_universe.getTransform(actor.entity).getRigidPart());
@@ -2936,6 +3384,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			serializer.write(terrain.m_xz_scale);
 			serializer.write(terrain.m_y_scale);
 			serializer.write(terrain.m_layer);
+			serializer.write(terrain.m_streaming_radius);
 		}
 		serializeJoints(serializer);
 		serializeVehicles(serializer);
@@ -3043,7 +3492,6 @@ struct PhysicsSceneImpl final : PhysicsScene
 			RigidActor actor(*this, entity);
 			serializer.read(actor.dynamic_type);
 			serializer.read(actor.is_trigger);
-			if (actor.dynamic_type == DynamicType::DYNAMIC) m_dynamic_actors.push(entity);
 			actor.layer = 0;
 			serializer.read(actor.layer);
 			
@@ -3060,6 +3508,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			PxFilterData filter_data;
 			filter_data.word0 = 1 << actor.layer;
 			filter_data.word1 = m_layers.filter[actor.layer];
+			filter_data.word2 = m_layers.contact_report[actor.layer];
 
 			int geoms_count = serializer.read<int>();
 			for (int i = 0; i < geoms_count; ++i) {
@@ -3099,6 +3548,16 @@ struct PhysicsSceneImpl final : PhysicsScene
 					}
 				}
 			}
+			// statics are added to the scene at once in finishStaticBatch, with prebuilt query tree
+			// anything touching their shapes, e.g. loaded geometry, must wait until then
+			if (actor.dynamic_type == DynamicType::STATIC && physx_actor->getNbShapes() > 0) {
+				actor.setPhysxActor(physx_actor, false);
+				m_actors.insert(entity, static_cast<RigidActor&&>(actor));
+				m_static_batch.actors.push(physx_actor);
+				m_static_batch.pending.push({entity, Path(path)});
+				continue;
+			}
+
 			actor.setPhysxActor(physx_actor);
 			m_actors.insert(entity, static_cast<RigidActor&&>(actor));
 			if (path[0]) {
@@ -3109,6 +3568,46 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 			m_universe.onComponentCreated(entity, RIGID_ACTOR_TYPE, this);
 		}
+
+		if (m_static_batch.actors.empty()) return;
+
+		// the rest of the universe is deserialized meanwhile
+		m_static_batch.physics = m_system->getPhysics();
+		jobs::run(&m_static_batch, [](void* data){
+			PROFILE_BLOCK("build pruning structure");
+			StaticBatch* batch = (StaticBatch*)data;
+			batch->structure = batch->physics->createPruningStructure(batch->actors.begin(), batch->actors.size());
+		}, &m_static_batch.signal, jobs::Priority::HIGH, jobs::StackSize::LARGE);
+	}
+
+
+	void finishStaticBatch()
+	{
+		if (m_static_batch.actors.empty()) return;
+
+		PROFILE_FUNCTION();
+		jobs::wait(m_static_batch.signal);
+		m_static_batch.signal = jobs::INVALID_HANDLE;
+		if (m_static_batch.structure) {
+			m_scene->addActors(*m_static_batch.structure);
+			m_static_batch.structure->release();
+			m_static_batch.structure = nullptr;
+		}
+		else {
+			logWarning("Failed to create pruning structure, static actors are added one by one");
+			m_scene->addActors((PxActor**)m_static_batch.actors.begin(), m_static_batch.actors.size());
+		}
+
+		ResourceManagerHub& manager = m_engine.getResourceManager();
+		for (const StaticBatch::Pending& pending : m_static_batch.pending) {
+			if (!pending.path.isEmpty()) {
+				PhysicsGeometry* geom_res = manager.load<PhysicsGeometry>(pending.path);
+				m_actors[pending.entity].setResource(geom_res);
+			}
+			m_universe.onComponentCreated(pending.entity, RIGID_ACTOR_TYPE, this);
+		}
+		m_static_batch.actors.clear();
+		m_static_batch.pending.clear();
 	}
 
 
@@ -3143,6 +3642,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			PxFilterData data;
 			data.word0 = 1 << c.layer;
 			data.word1 = m_layers.filter[c.layer];
+			data.word2 = m_layers.contact_report[c.layer];
 			c.filter_data = data;
 			PxShape* shapes[8];
 			const u32 shapes_count = c.controller->getActor()->getShapes(shapes, lengthOf(shapes));
@@ -3290,23 +3790,25 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void deserializeTerrains(InputMemoryStream& serializer, const EntityMap& entity_map)
+	void deserializeTerrains(InputMemoryStream& serializer, const EntityMap& entity_map, i32 version)
 	{
 		u32 count;
 		serializer.read(count);
 		for (u32 i = 0; i < count; ++i) {
-			Heightfield terrain;
+			EntityRef e;
+			serializer.read(e);
+			e = entity_map.get(e);
+			Heightfield& terrain = m_terrains.insert(e, Heightfield(m_allocator)).value();
 			terrain.m_scene = this;
-			serializer.read(terrain.m_entity);
-			terrain.m_entity = entity_map.get(terrain.m_entity);
+			terrain.m_entity = e;
 			const char* tmp = serializer.readString();
 			serializer.read(terrain.m_xz_scale);
 			serializer.read(terrain.m_y_scale);
 			serializer.read(terrain.m_layer);
+			if (version > (i32)PhysicsSceneVersion::HEIGHTFIELD_STREAMING) serializer.read(terrain.m_streaming_radius);
 
-			m_terrains.insert(terrain.m_entity, terrain);
-			setHeightmapSource(terrain.m_entity, Path(tmp));
-			m_universe.onComponentCreated(terrain.m_entity, HEIGHTFIELD_TYPE, this);
+			setHeightmapSource(e, Path(tmp));
+			m_universe.onComponentCreated(e, HEIGHTFIELD_TYPE, this);
 		}
 	}
 
@@ -3315,7 +3817,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 	{
 		deserializeActors(serializer, entity_map);
 		deserializeControllers(serializer, entity_map);
-		deserializeTerrains(serializer, entity_map);
+		deserializeTerrains(serializer, entity_map, version);
 
 		if (version <= (i32)PhysicsSceneVersion::REMOVED_RAGDOLLS) {
 			u32 count;
@@ -3325,6 +3827,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 		deserializeJoints(serializer, entity_map);
 		deserializeVehicles(serializer, entity_map, version);
+		finishStaticBatch();
 	}
 
 
@@ -3434,7 +3937,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 		if (!(filterData0.word0 & filterData1.word1) || !(filterData1.word0 & filterData0.word1)) {
 			return PxFilterFlag::eSUPPRESS;
 		}
-		pairFlags = PxPairFlag::eCONTACT_DEFAULT | PxPairFlag::eNOTIFY_TOUCH_FOUND | PxPairFlag::eNOTIFY_CONTACT_POINTS;
+		pairFlags = PxPairFlag::eCONTACT_DEFAULT;
+		// word2 is the contact report mask, pairs which are not reported do not generate any callbacks
+		if ((filterData0.word0 & filterData1.word2) && (filterData1.word0 & filterData0.word2)) {
+			pairFlags |= PxPairFlag::eNOTIFY_TOUCH_FOUND | PxPairFlag::eNOTIFY_CONTACT_POINTS;
+		}
 		return PxFilterFlag::eDEFAULT;
 	}
 
@@ -3482,6 +3989,22 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PxFilterData m_filter_data;
 	};
 
+	struct ControllerMove {
+		Controller* controller;
+		Vec3 dif;
+		// swept bounds
+		DVec3 min;
+		DVec3 max;
+		u32 island;
+		PxExtendedVec3 foot;
+	};
+
+	struct ControllerHit {
+		EntityRef controller;
+		EntityRef obj;
+	};
+
+	// called from workers when controllers are moved in parallel, scripts are called after all moves
 	struct HitReport : PxUserControllerHitReport {
 		HitReport(PhysicsSceneImpl& scene) : scene(scene) {}
 		void onShapeHit(const PxControllerShapeHit& hit) override {
@@ -3489,7 +4012,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 			const EntityRef e1 {(i32)(uintptr)user_data};
 			const EntityRef e2 {(i32)(uintptr)hit.actor->userData};
 
-			scene.onControllerHit(e1, e2);
+			MutexGuard lock(scene.m_controller_hits_mutex);
+			scene.m_controller_hits.push({e1, e2});
 		}
 		void onControllerHit(const PxControllersHit& hit) override {}
 		void onObstacleHit(const PxControllerObstacleHit& hit) override {}
@@ -3509,7 +4033,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 	PxRigidDynamic* m_dummy_actor;
 	PxControllerManager* m_controller_manager;
 	PxMaterial* m_default_material;
-	FilterCallback m_filter_callback;
+	Array<ControllerMove> m_controller_moves;
+	// ranges in m_controller_moves
+	Array<u32> m_controller_islands;
+	Mutex m_controller_hits_mutex;
+	Array<ControllerHit> m_controller_hits;
 
 	HashMap<EntityRef, RigidActor> m_actors;
 	HashMap<PhysicsGeometry*, EntityRef> m_resource_actor_map;
@@ -3518,19 +4046,51 @@ struct PhysicsSceneImpl final : PhysicsScene
 	HashMap<EntityRef, Heightfield> m_terrains;
 	HashMap<EntityRef, UniquePtr<Vehicle>> m_vehicles;
 	HashMap<EntityRef, Wheel> m_wheels;
+	Array<EntityRef> m_pending_vehicles; // waiting for wheel meshes
 	PxVehicleDrivableSurfaceToTireFrictionPairs* m_vehicle_frictions;
 	PxBatchQuery* m_vehicle_batch_query;
-	u8 m_vehicle_query_mem[sizeof(PxRaycastQueryResult) * 64 + sizeof(PxRaycastHit) * 64];
+	Array<u8> m_vehicle_query_mem;
+	u32 m_vehicle_query_capacity = 0;
 	PxRaycastQueryResult* m_vehicle_results;
+	Array<PxVehicleWheels*> m_vehicle_batch;
 	u64 m_physics_cmps_mask;
 
-	Array<EntityRef> m_dynamic_actors;
-	RigidActor* m_update_in_progress;
-	DelegateList<void(const ContactData&)> m_contact_callbacks;
+	// static actors from deserialize, see finishStaticBatch
+	struct StaticBatch {
+		struct Pending {
+			EntityRef entity;
+			Path path;
+		};
+
+		StaticBatch(IAllocator& allocator) : actors(allocator), pending(allocator) {}
+
+		PxPhysics* physics = nullptr;
+		Array<PxRigidActor*> actors;
+		Array<Pending> pending;
+		PxPruningStructure* structure = nullptr;
+		jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+	} m_static_batch;
+
+	DelegateList<void(Span<const ContactData>)> m_contact_callbacks;
+	// collected during a step, filled from physx callbacks
+	Array<ContactData> m_contacts;
+	Array<ScriptContact> m_script_contacts;
+	Array<float> m_script_contacts_data;
+	float m_contact_impulse_threshold = 0;
 	bool m_is_game_running;
+	bool m_is_simulating = false;
+	bool m_is_frame_pending = false;
+	float m_frame_time_delta = 0;
+	float m_accumulator = 0; // simulation time not simulated yet
+	u32 m_step = 0;
+	Array<EntityRef> m_interpolated; // moving dynamic actors
 	u32 m_debug_visualization_flags;
 	CPUDispatcher m_cpu_dispatcher;
 	CollisionLayers& m_layers;
+	// to compare cpu and gpu simulation, step is from simulate to fetched results, wait is time blocked in fetchResults
+	u32 m_step_counter;
+	u32 m_fetch_wait_counter;
+	u64 m_step_start = 0;
 };
 
 PhysicsSceneImpl::PhysicsSceneImpl(Engine& engine, Universe& context, PhysicsSystem& system, IAllocator& allocator)
@@ -3541,21 +4101,32 @@ PhysicsSceneImpl::PhysicsSceneImpl(Engine& engine, Universe& context, PhysicsSys
 	, m_vehicles(m_allocator)
 	, m_wheels(m_allocator)
 	, m_terrains(m_allocator)
-	, m_dynamic_actors(m_allocator)
 	, m_universe(context)
 	, m_is_game_running(false)
+	, m_interpolated(m_allocator)
+	, m_pending_vehicles(m_allocator)
 	, m_contact_callback(*this)
 	, m_contact_callbacks(m_allocator)
+	, m_contacts(m_allocator)
+	, m_script_contacts(m_allocator)
+	, m_script_contacts_data(m_allocator)
 	, m_joints(m_allocator)
 	, m_script_scene(nullptr)
 	, m_debug_visualization_flags(0)
-	, m_update_in_progress(nullptr)
 	, m_vehicle_batch_query(nullptr)
+	, m_vehicle_query_mem(m_allocator)
+	, m_vehicle_batch(m_allocator)
+	, m_controller_moves(m_allocator)
+	, m_controller_islands(m_allocator)
+	, m_controller_hits(m_allocator)
 	, m_system(&system)
 	, m_hit_report(*this)
 	, m_layers(m_system->getCollisionLayers())
 	, m_resource_actor_map(m_allocator)
+	, m_static_batch(m_allocator)
 {
+	m_step_counter = profiler::createCounter("physics step (us)", profiler::CounterType::SUM);
+	m_fetch_wait_counter = profiler::createCounter("physics fetch wait (us)", profiler::CounterType::SUM);
 	m_physics_cmps_mask = 0;
 
 	const u32 hash = crc32("physics");
@@ -3573,27 +4144,47 @@ UniquePtr<PhysicsScene> PhysicsScene::create(PhysicsSystem& system, Universe& co
 {
 	PhysicsSceneImpl* impl = LUMIX_NEW(allocator, PhysicsSceneImpl)(engine, context, system, allocator);
 	impl->m_universe.entityTransformed().bind<&PhysicsSceneImpl::onEntityMoved>(impl);
+	impl->m_universe.entitiesTransformed().bind<&PhysicsSceneImpl::onEntitiesMoved>(impl);
 	impl->m_universe.entityDestroyed().bind<&PhysicsSceneImpl::onEntityDestroyed>(impl);
+	impl->m_universe.entityEnabled().bind<&PhysicsSceneImpl::onEntityEnabled>(impl);
 	PxSceneDesc sceneDesc(system.getPhysics()->getTolerancesScale());
 	sceneDesc.gravity = PxVec3(0.0f, -9.8f, 0.0f);
 	sceneDesc.cpuDispatcher = &impl->m_cpu_dispatcher;
 
 	sceneDesc.filterShader = impl->filterShader;
 	sceneDesc.simulationEventCallback = &impl->m_contact_callback;
+	sceneDesc.flags |= PxSceneFlag::eENABLE_ACTIVE_ACTORS | PxSceneFlag::eEXCLUDE_KINEMATICS_FROM_ACTIVE_ACTORS;
+	sceneDesc.dynamicTreeRebuildRateHint = DEFAULT_TREE_REBUILD_RATE;
+
+	// solver and broadphase on gpu, cpu dispatcher is still used for the rest
+	PxCudaContextManager* cuda_context_manager = system.getCudaContextManager();
+	if (cuda_context_manager) {
+		sceneDesc.cudaContextManager = cuda_context_manager;
+		sceneDesc.flags |= PxSceneFlag::eENABLE_GPU_DYNAMICS;
+		sceneDesc.broadPhaseType = PxBroadPhaseType::eGPU;
+	}
 
 	impl->m_scene = system.getPhysics()->createScene(sceneDesc);
+	if (!impl->m_scene && cuda_context_manager) {
+		logWarning("Failed to create GPU physics scene, using CPU");
+		sceneDesc.cudaContextManager = nullptr;
+		sceneDesc.flags.clear(PxSceneFlag::eENABLE_GPU_DYNAMICS);
+		sceneDesc.broadPhaseType = PxBroadPhaseType::eABP;
+		impl->m_scene = system.getPhysics()->createScene(sceneDesc);
+	}
 	if (!impl->m_scene)
 	{
 		LUMIX_DELETE(allocator, impl);
 		return UniquePtr<PhysicsScene>(nullptr, nullptr);
 	}
 
-	impl->m_controller_manager = PxCreateControllerManager(*impl->m_scene);
+	// locking, since controllers are moved from workers
+	impl->m_controller_manager = PxCreateControllerManager(*impl->m_scene, true);
 
 	impl->m_default_material = impl->m_system->getPhysics()->createMaterial(0.5f, 0.5f, 0.1f);
 	PxSphereGeometry geom(1);
 	impl->m_dummy_actor = PxCreateDynamic(impl->m_scene->getPhysics(), PxTransform(PxIdentity), geom, *impl->m_default_material, 1);
-	impl->m_vehicle_batch_query = impl->createVehicleBatchQuery(impl->m_vehicle_query_mem);
+	impl->createVehicleBatchQuery(64);
 	return UniquePtr<PhysicsSceneImpl>(impl, &allocator);
 }
 
@@ -3744,6 +4335,7 @@ void PhysicsScene::reflect() {
 			.LUMIX_PROP(HeightmapSource, "Heightmap").resourceAttribute(Texture::TYPE)
 			.LUMIX_PROP(HeightmapYScale, "Y scale").minAttribute(0)
 			.LUMIX_PROP(HeightmapXZScale, "XZ scale").minAttribute(0)
+			.LUMIX_PROP(HeightfieldStreamingRadius, "Streaming radius").minAttribute(0)
 	;
 }
 
@@ -3797,7 +4389,7 @@ void PhysicsSceneImpl::RigidActor::rescale()
 }
 
 
-void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor)
+void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor, bool add_to_scene)
 {
 	if (physx_actor)
 	{
@@ -3807,10 +4399,11 @@ void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor)
 	physx_actor = actor;
 	if (actor)
 	{
-		scene.m_scene->addActor(*actor);
+		if (add_to_scene) scene.m_scene->addActor(*actor);
 		actor->userData = (void*)(intptr_t)entity.index;
 		scene.updateFilterData(actor, layer);
 		setIsTrigger(is_trigger);
+		if (!scene.m_universe.isEntityEnabled(entity)) actor->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, true);
 	}
 }
 
@@ -3869,9 +4462,38 @@ void PhysicsSceneImpl::RigidActor::setResource(PhysicsGeometry* new_value)
 }
 
 
+Heightfield::Heightfield(Heightfield&& rhs)
+	: m_scene(rhs.m_scene)
+	, m_entity(rhs.m_entity)
+	, m_tiles(static_cast<Array<PxRigidActor*>&&>(rhs.m_tiles))
+	, m_tiles_x(rhs.m_tiles_x)
+	, m_heightmap(rhs.m_heightmap)
+	, m_xz_scale(rhs.m_xz_scale)
+	, m_y_scale(rhs.m_y_scale)
+	, m_streaming_radius(rhs.m_streaming_radius)
+	, m_layer(rhs.m_layer)
+{
+	if (m_heightmap) {
+		m_heightmap->getObserverCb().unbind<&Heightfield::heightmapLoaded>(&rhs);
+		m_heightmap->getObserverCb().bind<&Heightfield::heightmapLoaded>(this);
+	}
+	rhs.m_heightmap = nullptr;
+}
+
+
+void Heightfield::releaseTiles()
+{
+	for (PxRigidActor* tile : m_tiles) {
+		if (tile) tile->release();
+	}
+	m_tiles.clear();
+	m_tiles_x = 0;
+}
+
+
 Heightfield::~Heightfield()
 {
-	if (m_actor) m_actor->release();
+	releaseTiles();
 	if (m_heightmap)
 	{
 		m_heightmap->decRefCount();
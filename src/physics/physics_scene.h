@@ -48,6 +48,38 @@ struct RaycastHit
 };
 
 
+struct RaycastQuery
+{
+	Vec3 origin;
+	Vec3 dir; // normalized
+	float distance;
+	EntityPtr ignored;
+	int layer; // -1 to hit all layers
+};
+
+
+// sphere cast
+struct SweepQuery
+{
+	Vec3 origin;
+	Vec3 dir; // normalized
+	float radius;
+	float distance;
+	EntityPtr ignored;
+	int layer;
+};
+
+
+// sphere overlap, hit's position is the query's position
+struct OverlapQuery
+{
+	Vec3 position;
+	float radius;
+	EntityPtr ignored;
+	int layer;
+};
+
+
 struct LUMIX_PHYSICS_API PhysicsScene : IScene
 {
 	enum class D6Motion : int
@@ -80,6 +112,8 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 		Vec3 position;
 		EntityRef e1;
 		EntityRef e2;
+		// sum of impulses of all contact points
+		float impulse;
 	};
 
 	using ContactCallbackHandle = int;
@@ -91,9 +125,22 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 	virtual void render() = 0;
 	virtual EntityPtr raycast(const Vec3& origin, const Vec3& dir, EntityPtr ignore_entity) = 0;
 	virtual bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, EntityPtr ignored, int layer) = 0;
+	// batched queries run in parallel on the job system
+	// results[i].entity is INVALID_ENTITY if queries[i] did not hit anything
+	virtual void raycasts(Span<const RaycastQuery> queries, Span<RaycastHit> results) = 0;
+	virtual void sweeps(Span<const SweepQuery> queries, Span<RaycastHit> results) = 0;
+	virtual void overlaps(Span<const OverlapQuery> queries, Span<RaycastHit> results) = 0;
 	virtual PhysicsSystem& getSystem() const = 0;
 
-	virtual DelegateList<void(const ContactData&)>& onContact() = 0;
+	// contacts are collected during a simulation step and delivered at once after the step is fetched
+	// only contacts between layers with contact reports enabled, see PhysicsSystem::setLayersReportContacts
+	virtual DelegateList<void(Span<const ContactData>)>& onContact() = 0;
+	// weaker contacts are not reported
+	virtual void setContactImpulseThreshold(float impulse) = 0;
+	virtual float getContactImpulseThreshold() const = 0;
+	// frames to rebuild the scene query tree of dynamic actors, at least 4, see PxSceneDesc::dynamicTreeRebuildRateHint
+	virtual void setTreeRebuildRate(u32 frames) = 0;
+	virtual u32 getTreeRebuildRate() const = 0;
 	virtual void setActorLayer(EntityRef entity, u32 layer) = 0;
 	virtual u32 getActorLayer(EntityRef entity) = 0;
 	virtual bool getIsTrigger(EntityRef entity) = 0;
@@ -108,6 +155,8 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 	virtual void setHeightmapYScale(EntityRef entity, float scale) = 0;
 	virtual u32 getHeightfieldLayer(EntityRef entity) = 0;
 	virtual void setHeightfieldLayer(EntityRef entity, u32 layer) = 0;
+	virtual float getHeightfieldStreamingRadius(EntityRef entity) = 0;
+	virtual void setHeightfieldStreamingRadius(EntityRef entity, float radius) = 0;
 	virtual void updateHeighfieldData(EntityRef entity,
 		int x,
 		int y,
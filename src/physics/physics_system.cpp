@@ -1,5 +1,6 @@
 #include "physics/physics_system.h"
 
+#include <cudamanager/PxCudaContextManager.h>
 #include <foundation/PxAllocatorCallback.h>
 #include <foundation/PxErrorCallback.h>
 #include <foundation/PxIO.h>
@@ -8,14 +9,24 @@
 #include <PxFoundation.h>
 #include <PxPhysics.h>
 #include <PxPhysicsVersion.h>
+#include <gpu/PxGpu.h>
 #include <vehicle/PxVehicleSDK.h>
 
 #include "cooking/PxCooking.h"
+#include "engine/allocators.h"
+#include "engine/atomic.h"
+#include "engine/command_line_parser.h"
+#include "engine/crc32.h"
 #include "engine/engine.h"
+#include "engine/hash_map.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/resource_manager.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "physics/physics_geometry.h"
 #include "physics/physics_scene.h"
@@ -106,13 +117,136 @@ namespace Lumix
 		return 1;
 	}
 
+	// results of batched queries, false for queries which did not hit anything
+	static void pushHits(lua_State* L, PhysicsScene& scene, Span<const RaycastHit> hits)
+	{
+		lua_createtable(L, hits.length(), 0);
+		for (u32 i = 0; i < hits.length(); ++i) {
+			const RaycastHit& hit = hits[i];
+			if (hit.entity.isValid()) {
+				lua_createtable(L, 0, 3);
+				LuaWrapper::pushEntity(L, hit.entity, &scene.getUniverse());
+				lua_setfield(L, -2, "entity");
+				LuaWrapper::push(L, hit.position);
+				lua_setfield(L, -2, "position");
+				LuaWrapper::push(L, hit.normal);
+				lua_setfield(L, -2, "normal");
+			}
+			else {
+				lua_pushboolean(L, 0);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+	}
+
+	// each query is a table {origin, dir, [radius], [distance], [layer], [ignored]}
+	template <typename Q>
+	static Q toQuery(lua_State* L, int idx)
+	{
+		Q q;
+		q.distance = FLT_MAX;
+		q.layer = -1;
+		q.ignored = INVALID_ENTITY;
+		if (!LuaWrapper::checkField(L, idx, "origin", &q.origin)) luaL_error(L, "query is missing origin");
+		if (!LuaWrapper::checkField(L, idx, "dir", &q.dir)) luaL_error(L, "query is missing dir");
+		LuaWrapper::checkField(L, idx, "distance", &q.distance);
+		LuaWrapper::checkField(L, idx, "layer", &q.layer);
+		LuaWrapper::checkField(L, idx, "ignored", &q.ignored);
+		return q;
+	}
+
+	static void toQueryShape(lua_State* L, int idx, RaycastQuery& q) {}
+	static void toQueryShape(lua_State* L, int idx, SweepQuery& q)
+	{
+		if (!LuaWrapper::checkField(L, idx, "radius", &q.radius)) luaL_error(L, "query is missing radius");
+	}
+
+	template <typename Q, void (PhysicsScene::*Func)(Span<const Q>, Span<RaycastHit>)>
+	static int LUA_batchQueries(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsScene*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+		IAllocator& allocator = scene->getUniverse().getAllocator();
+		Array<Q> queries(allocator);
+		const int n = (int)lua_objlen(L, 2);
+		queries.reserve(n);
+		for (int i = 0; i < n; ++i) {
+			lua_rawgeti(L, 2, i + 1);
+			if (!lua_istable(L, -1)) luaL_argerror(L, 2, "array of queries expected");
+			Q& q = queries.emplace(toQuery<Q>(L, lua_gettop(L)));
+			toQueryShape(L, -1, q);
+			lua_pop(L, 1);
+		}
+
+		Array<RaycastHit> hits(allocator);
+		hits.resize(n);
+		(scene->*Func)(queries, hits);
+		pushHits(L, *scene, hits);
+		return 1;
+	}
+
+	static int LUA_overlaps(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsScene*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+		IAllocator& allocator = scene->getUniverse().getAllocator();
+		Array<OverlapQuery> queries(allocator);
+		const int n = (int)lua_objlen(L, 2);
+		queries.reserve(n);
+		for (int i = 0; i < n; ++i) {
+			lua_rawgeti(L, 2, i + 1);
+			if (!lua_istable(L, -1)) luaL_argerror(L, 2, "array of queries expected");
+			OverlapQuery& q = queries.emplace();
+			q.layer = -1;
+			q.ignored = INVALID_ENTITY;
+			if (!LuaWrapper::checkField(L, -1, "position", &q.position)) luaL_error(L, "query is missing position");
+			if (!LuaWrapper::checkField(L, -1, "radius", &q.radius)) luaL_error(L, "query is missing radius");
+			LuaWrapper::checkField(L, -1, "layer", &q.layer);
+			LuaWrapper::checkField(L, -1, "ignored", &q.ignored);
+			lua_pop(L, 1);
+		}
+
+		Array<RaycastHit> hits(allocator);
+		hits.resize(n);
+		scene->overlaps(queries, hits);
+		pushHits(L, *scene, hits);
+		return 1;
+	}
+
+	// convex mesh cooked at runtime, shared by everything with the same points
+	struct CookedConvex {
+		CookedConvex(IAllocator& allocator) : points(allocator) {}
+
+		Array<Vec3> points;
+		physx::PxConvexMesh* mesh = nullptr;
+		volatile i32 is_ready = 0;
+		physx::PxCooking* cooking;
+		physx::PxPhysics* physics;
+	};
+
+	static void cookConvexJob(void* data) {
+		PROFILE_FUNCTION();
+		CookedConvex* cooked = (CookedConvex*)data;
+		physx::PxConvexMeshDesc desc;
+		desc.points.count = cooked->points.size();
+		desc.points.stride = sizeof(Vec3);
+		desc.points.data = cooked->points.begin();
+		desc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
+		cooked->mesh = cooked->cooking->createConvexMesh(desc, cooked->physics->getPhysicsInsertionCallback());
+		if (!cooked->mesh) logError("Failed to cook convex mesh");
+		memoryBarrier();
+		cooked->is_ready = 1;
+	}
+
 	struct PhysicsSystemImpl final : PhysicsSystem
 	{
 		explicit PhysicsSystemImpl(Engine& engine)
-			: m_allocator(engine.getAllocator())
+			: m_allocator(engine.getAllocator(), "physics")
 			, m_engine(engine)
 			, m_manager(*this, engine.getAllocator())
 			, m_physx_allocator(m_allocator)
+			, m_convex_cache(m_allocator)
+			, m_created_geometries(m_allocator)
 		{
 			PhysicsScene::reflect();
 			m_layers.count = 2;
@@ -124,11 +258,21 @@ namespace Lumix
 				toCString(i, Span(tmp));
 				catString(m_layers.names[i], tmp);
 				m_layers.filter[i] = 1 << i;
+				m_layers.contact_report[i] = 0xffFFffFF;
 			}
 			
 			m_manager.create(PhysicsGeometry::TYPE, engine.getResourceManager());
 			LuaWrapper::createSystemFunction(engine.getState(), "Physics", "raycast", &LUA_raycast);
+			LuaWrapper::createSystemFunction(engine.getState(), "Physics", "raycasts", &LUA_batchQueries<RaycastQuery, &PhysicsScene::raycasts>);
+			LuaWrapper::createSystemFunction(engine.getState(), "Physics", "sweeps", &LUA_batchQueries<SweepQuery, &PhysicsScene::sweeps>);
+			LuaWrapper::createSystemFunction(engine.getState(), "Physics", "overlaps", &LUA_overlaps);
+		}
 
+		// only physx is initialized here, so it can run concurrently with other plugins
+		bool isInitThreadSafe() const override { return true; }
+
+		void init() override {
+			PROFILE_FUNCTION();
 			m_foundation = PxCreateFoundation(PX_PHYSICS_VERSION, m_physx_allocator, m_error_callback);
 
 			#ifdef LUMIX_DEBUG
@@ -140,45 +284,129 @@ namespace Lumix
 			m_physics = PxCreatePhysics(PX_PHYSICS_VERSION, *m_foundation, physx::PxTolerancesScale(), false, m_pvd);
 			LUMIX_FATAL(m_physics);
 
-			physx::PxTolerancesScale scale;
-			m_cooking = PxCreateCooking(PX_PHYSICS_VERSION, *m_foundation, physx::PxCookingParams(scale));
-
 			if (!PxInitVehicleSDK(*m_physics)) {
 				LUMIX_FATAL(false);
 			}
 			physx::PxVehicleSetBasisVectors(physx::PxVec3(0, 1, 0), physx::PxVec3(0, 0, -1));
 			physx::PxVehicleSetUpdateMode(physx::PxVehicleUpdateMode::eVELOCITY_CHANGE);
+
+			if (isGPURequested()) initGPU();
+		}
+
+
+		static bool isGPURequested() {
+			char cmd_line[4096];
+			os::getCommandLine(Span(cmd_line));
+			CommandLineParser parser(cmd_line);
+			while (parser.next()) {
+				if (parser.currentEquals("-physics_gpu")) return true;
+			}
+			return false;
 		}
 
 
+		void initGPU() {
+			#if PX_SUPPORT_GPU_PHYSX
+				PROFILE_FUNCTION();
+				physx::PxCudaContextManagerDesc desc;
+				m_cuda_context_manager = PxCreateCudaContextManager(*m_foundation, desc);
+				if (m_cuda_context_manager && !m_cuda_context_manager->contextIsValid()) {
+					m_cuda_context_manager->release();
+					m_cuda_context_manager = nullptr;
+				}
+				if (m_cuda_context_manager) {
+					logInfo("PhysX GPU simulation on ", m_cuda_context_manager->getDeviceName());
+					return;
+				}
+			#endif
+			logWarning("PhysX GPU simulation is not available, using CPU");
+		}
+
+
+		physx::PxCudaContextManager* getCudaContextManager() override { return m_cuda_context_manager; }
+
+
 		~PhysicsSystemImpl()
 		{
+			jobs::wait(m_cooking_signal);
+			for (CookedConvex* cooked : m_convex_cache) {
+				if (cooked->mesh) cooked->mesh->release();
+				LUMIX_DELETE(m_allocator, cooked);
+			}
+			m_convex_cache.clear();
 			m_manager.destroy();
 			physx::PxCloseVehicleSDK();
-			m_cooking->release();
+			if (m_cooking) m_cooking->release();
 			m_physics->release();
 			if (m_pvd) {
 				m_pvd->disconnect();
 				m_pvd->release();
 				m_pvd_transport->release();
 			}
+			if (m_cuda_context_manager) m_cuda_context_manager->release();
 			m_foundation->release();
 		}
 
-		u32 getVersion() const override { return 0; }
+		u32 getVersion() const override { return 1; }
+
+		void update(float) override {
+			PROFILE_FUNCTION();
+			// one by one, finishing a geometry can unload others
+			for (;;) {
+				PhysicsGeometry* geom;
+				{
+					MutexGuard lock(m_created_geometries_mutex);
+					if (m_created_geometries.empty()) break;
+					geom = m_created_geometries.back();
+					m_created_geometries.pop();
+				}
+				geom->onMeshCreated();
+			}
+		}
+
+		void onGeometryCreated(PhysicsGeometry& geom) override {
+			MutexGuard lock(m_created_geometries_mutex);
+			m_created_geometries.push(&geom);
+		}
+
+		void cancelGeometry(PhysicsGeometry& geom) override {
+			MutexGuard lock(m_created_geometries_mutex);
+			m_created_geometries.eraseItem(&geom);
+		}
+
+		physx::PxConvexMesh* getConvexMesh(Span<const Vec3> points) override {
+			const u32 hash = crc32(points.begin(), points.length() * sizeof(Vec3));
+			auto iter = m_convex_cache.find(hash);
+			if (iter.isValid()) {
+				CookedConvex* cooked = iter.value();
+				ASSERT(cooked->points.size() == points.length() && memcmp(cooked->points.begin(), points.begin(), points.length() * sizeof(Vec3)) == 0);
+				return cooked->is_ready ? cooked->mesh : nullptr;
+			}
+
+			CookedConvex* cooked = LUMIX_NEW(m_allocator, CookedConvex)(m_allocator);
+			cooked->points.resize(points.length());
+			memcpy(cooked->points.begin(), points.begin(), points.length() * sizeof(Vec3));
+			cooked->cooking = getCooking();
+			cooked->physics = m_physics;
+			m_convex_cache.insert(hash, cooked);
+			jobs::run(cooked, &cookConvexJob, &m_cooking_signal, jobs::Priority::LOW);
+			return nullptr;
+		}
 
 		void serialize(OutputMemoryStream& serializer) const override {
 			serializer.write(m_layers.count);
 			serializer.write(m_layers.names);
 			serializer.write(m_layers.filter);
+			serializer.write(m_layers.contact_report);
 		}
 
 		bool deserialize(u32 version, InputMemoryStream& serializer) override {
-			if (version != 0) return false;
+			if (version > 1) return false;
 
 			serializer.read(m_layers.count);
 			serializer.read(m_layers.names);
 			serializer.read(m_layers.filter);
+			if (version > 0) serializer.read(m_layers.contact_report);
 			return true;
 		}
 
@@ -189,7 +417,17 @@ namespace Lumix
 		}
 
 		physx::PxPhysics* getPhysics() override { return m_physics; }
-		physx::PxCooking* getCooking() override { return m_cooking; }
+		// cooking is needed only for runtime generated geometries and by asset import, so it's created on first use
+		physx::PxCooking* getCooking() override {
+			MutexGuard lock(m_cooking_mutex);
+			if (!m_cooking) {
+				PROFILE_BLOCK("create physx cooking");
+				physx::PxTolerancesScale scale;
+				m_cooking = PxCreateCooking(PX_PHYSICS_VERSION, *m_foundation, physx::PxCookingParams(scale));
+				LUMIX_FATAL(m_cooking);
+			}
+			return m_cooking;
+		}
 		CollisionLayers& getCollisionLayers() override { return m_layers; }
 
 		bool connect2VisualDebugger()
@@ -214,7 +452,7 @@ namespace Lumix
 			meshDesc.triangles.data = indices.begin();
 
 			OutputStream writeBuffer(blob);
-			return m_cooking->cookTriangleMesh(meshDesc, writeBuffer);
+			return getCooking()->cookTriangleMesh(meshDesc, writeBuffer);
 		}
 
 		bool cookConvex(Span<const Vec3> verts, IOutputStream& blob) override {
@@ -225,7 +463,7 @@ namespace Lumix
 			meshDesc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
 
 			OutputStream writeBuffer(blob);
-			return m_cooking->cookConvexMesh(meshDesc, writeBuffer);
+			return getCooking()->cookConvexMesh(meshDesc, writeBuffer);
 		}
 
 		int getCollisionsLayersCount() const override { return m_layers.count; }
@@ -246,19 +484,38 @@ namespace Lumix
 			}
 		}
 
+		bool canLayersReportContacts(int layer1, int layer2) override { return (m_layers.contact_report[layer1] & (1 << layer2)) != 0; }
 
-		IAllocator& m_allocator;
-		physx::PxPhysics* m_physics;
-		physx::PxFoundation* m_foundation;
+		void setLayersReportContacts(int layer1, int layer2, bool report) override {
+			if (report) {
+				m_layers.contact_report[layer1] |= 1 << layer2;
+				m_layers.contact_report[layer2] |= 1 << layer1;
+			}
+			else {
+				m_layers.contact_report[layer1] &= ~(1 << layer2);
+				m_layers.contact_report[layer2] &= ~(1 << layer1);
+			}
+		}
+
+
+		TagAllocator m_allocator;
+		physx::PxPhysics* m_physics = nullptr;
+		physx::PxFoundation* m_foundation = nullptr;
 		physx::PxControllerManager* m_controller_manager;
 		AssertNullAllocator m_physx_allocator;
 		CustomErrorCallback m_error_callback;
-		physx::PxCooking* m_cooking;
+		Mutex m_cooking_mutex;
+		physx::PxCooking* m_cooking = nullptr;
+		physx::PxCudaContextManager* m_cuda_context_manager = nullptr;
 		PhysicsGeometryManager m_manager;
 		Engine& m_engine;
 		CollisionLayers m_layers;
 		physx::PxPvd* m_pvd = nullptr;
 		physx::PxPvdTransport* m_pvd_transport = nullptr;
+		HashMap<u32, CookedConvex*> m_convex_cache;
+		jobs::SignalHandle m_cooking_signal = jobs::INVALID_HANDLE;
+		Mutex m_created_geometries_mutex;
+		Array<PhysicsGeometry*> m_created_geometries;
 	};
 
 
@@ -8,7 +8,9 @@ namespace physx
 {
 
 	class PxControllerManager;
+	class PxConvexMesh;
 	class PxCooking;
+	class PxCudaContextManager;
 	class PxPhysics;
 
 } // namespace physx
@@ -19,6 +21,8 @@ namespace Lumix
 
 struct CollisionLayers {
 	u32 filter[32];
+	// contacts between colliding layers are reported only if enabled here
+	u32 contact_report[32];
 	char names[32][30];
 	u32 count = 0;
 };
@@ -32,16 +36,26 @@ struct PhysicsSystem : IPlugin
 	
 	virtual physx::PxPhysics* getPhysics() = 0;
 	virtual physx::PxCooking* getCooking() = 0;
+	// scenes simulate rigid bodies and broadphase on gpu if not null
+	// requested with -physics_gpu command line option, null if cuda is not available
+	virtual physx::PxCudaContextManager* getCudaContextManager() = 0;
 	virtual CollisionLayers& getCollisionLayers() = 0;
 	virtual const char* getCollisionLayerName(int index) = 0;
 	virtual void setCollisionLayerName(int index, const char* name) = 0;
 	virtual bool canLayersCollide(int layer1, int layer2) = 0;
 	virtual void setLayersCanCollide(int layer1, int layer2, bool can_collide) = 0;
+	virtual bool canLayersReportContacts(int layer1, int layer2) = 0;
+	virtual void setLayersReportContacts(int layer1, int layer2, bool report) = 0;
 	virtual int getCollisionsLayersCount() const = 0;
 	virtual void addCollisionLayer() = 0;
 	virtual void removeCollisionLayer() = 0;
 	virtual bool cookTriMesh(Span<const struct Vec3> verts, Span<const u32> indices, struct IOutputStream& blob) = 0;
 	virtual bool cookConvex(Span<const Vec3> verts, IOutputStream& blob) = 0;
+	// meshes are cooked on workers and cached by content, returns null until the mesh is ready
+	virtual physx::PxConvexMesh* getConvexMesh(Span<const Vec3> points) = 0;
+	// called from a worker once the geometry's mesh is created, it's finished in the next update
+	virtual void onGeometryCreated(struct PhysicsGeometry& geom) = 0;
+	virtual void cancelGeometry(PhysicsGeometry& geom) = 0;
 };
 
 
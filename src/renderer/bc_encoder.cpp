@@ -0,0 +1,323 @@
+#include "bc_encoder.h"
+#include "engine/crt.h"
+#include "engine/math.h"
+#include "meshoptimizer/meshoptimizer.h"
+
+namespace Lumix {
+
+namespace BCEncoder {
+
+// 4bit index interpolation weights, same for BC6H and BC7
+static const u32 WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// blocks are written from the least significant bit
+struct BitWriter {
+	BitWriter(u8* dst) : dst(dst) { memset(dst, 0, 16); }
+
+	void write(u32 value, u32 bits) {
+		for (u32 i = 0; i < bits; ++i) {
+			if (value & (1 << i)) dst[pos >> 3] |= 1 << (pos & 7);
+			++pos;
+		}
+	}
+
+	u8* dst;
+	u32 pos = 0;
+};
+
+// endpoints at the extremes of the principal axis
+template <u32 N>
+static void computeEndpoints(const float (&px)[16][N], float (&e0)[N], float (&e1)[N]) {
+	float mean[N] = {};
+	for (u32 i = 0; i < 16; ++i) {
+		for (u32 c = 0; c < N; ++c) mean[c] += px[i][c] / 16;
+	}
+
+	float cov[N][N] = {};
+	for (u32 i = 0; i < 16; ++i) {
+		for (u32 a = 0; a < N; ++a) {
+			for (u32 b = 0; b < N; ++b) {
+				cov[a][b] += (px[i][a] - mean[a]) * (px[i][b] - mean[b]);
+			}
+		}
+	}
+
+	// power iteration
+	float axis[N];
+	for (u32 c = 0; c < N; ++c) axis[c] = 1 / sqrtf(float(N));
+	for (u32 iter = 0; iter < 8; ++iter) {
+		float tmp[N] = {};
+		float len = 0;
+		for (u32 a = 0; a < N; ++a) {
+			for (u32 b = 0; b < N; ++b) tmp[a] += cov[a][b] * axis[b];
+			len += tmp[a] * tmp[a];
+		}
+		len = sqrtf(len);
+		if (len < 1e-6f) break;
+		for (u32 c = 0; c < N; ++c) axis[c] = tmp[c] / len;
+	}
+
+	float t_min = FLT_MAX;
+	float t_max = -FLT_MAX;
+	for (u32 i = 0; i < 16; ++i) {
+		float t = 0;
+		for (u32 c = 0; c < N; ++c) t += (px[i][c] - mean[c]) * axis[c];
+		t_min = minimum(t_min, t);
+		t_max = maximum(t_max, t);
+	}
+
+	for (u32 c = 0; c < N; ++c) {
+		e0[c] = mean[c] + axis[c] * t_min;
+		e1[c] = mean[c] + axis[c] * t_max;
+	}
+}
+
+// optimal endpoints for fixed indices
+template <u32 N>
+static bool leastSquares(const float (&px)[16][N], const u8 (&indices)[16], float (&e0)[N], float (&e1)[N]) {
+	float a = 0, b = 0, c = 0;
+	float x0[N] = {};
+	float x1[N] = {};
+	for (u32 i = 0; i < 16; ++i) {
+		const float w = WEIGHTS[indices[i]] / 64.f;
+		const float iw = 1 - w;
+		a += iw * iw;
+		b += iw * w;
+		c += w * w;
+		for (u32 ch = 0; ch < N; ++ch) {
+			x0[ch] += iw * px[i][ch];
+			x1[ch] += w * px[i][ch];
+		}
+	}
+
+	const float det = a * c - b * b;
+	if (det < 1e-6f && det > -1e-6f) return false;
+
+	for (u32 ch = 0; ch < N; ++ch) {
+		e0[ch] = (c * x0[ch] - b * x1[ch]) / det;
+		e1[ch] = (a * x1[ch] - b * x0[ch]) / det;
+	}
+	return true;
+}
+
+template <u32 N>
+static float computeIndices(const float (&px)[16][N], const i32 (&palette)[16][N], u8 (&indices)[16]) {
+	float total = 0;
+	for (u32 i = 0; i < 16; ++i) {
+		float best = FLT_MAX;
+		for (u32 j = 0; j < 16; ++j) {
+			float err = 0;
+			for (u32 c = 0; c < N; ++c) {
+				const float d = palette[j][c] - px[i][c];
+				err += d * d;
+			}
+			if (err < best) {
+				best = err;
+				indices[i] = u8(j);
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+struct BC7Candidate {
+	u8 q0[4];
+	u8 q1[4];
+	u32 p0;
+	u32 p1;
+	u8 indices[16];
+	float error;
+};
+
+// 7 bits per channel and shared p-bit per endpoint
+static void quantizeBC7(const float (&e)[4], u8 (&q)[4], u32& p, bool opaque) {
+	float best = FLT_MAX;
+	// opaque blocks need p-bit 1, otherwise alpha would be 254
+	for (u32 pbit = opaque ? 1 : 0; pbit < 2; ++pbit) {
+		float err = 0;
+		u8 tmp[4];
+		for (u32 c = 0; c < 4; ++c) {
+			const i32 v = clamp(i32((e[c] - pbit) * 0.5f + 0.5f), 0, 127);
+			tmp[c] = u8(v);
+			const float d = float((v << 1) | pbit) - e[c];
+			err += d * d;
+		}
+		if (err < best) {
+			best = err;
+			p = pbit;
+			memcpy(q, tmp, sizeof(q));
+		}
+	}
+}
+
+static BC7Candidate evaluateBC7(const float (&px)[16][4], const float (&e0)[4], const float (&e1)[4], bool opaque) {
+	BC7Candidate res;
+	quantizeBC7(e0, res.q0, res.p0, opaque);
+	quantizeBC7(e1, res.q1, res.p1, opaque);
+
+	i32 palette[16][4];
+	for (u32 c = 0; c < 4; ++c) {
+		const i32 a = (res.q0[c] << 1) | res.p0;
+		const i32 b = (res.q1[c] << 1) | res.p1;
+		for (u32 i = 0; i < 16; ++i) {
+			palette[i][c] = ((64 - WEIGHTS[i]) * a + WEIGHTS[i] * b + 32) >> 6;
+		}
+	}
+	res.error = computeIndices(px, palette, res.indices);
+	return res;
+}
+
+void encodeBC7(u8* dst, const u8* rgba, u32 refine_iterations) {
+	float px[16][4];
+	bool opaque = true;
+	for (u32 i = 0; i < 16; ++i) {
+		for (u32 c = 0; c < 4; ++c) px[i][c] = rgba[i * 4 + c];
+		opaque = opaque && rgba[i * 4 + 3] == 255;
+	}
+
+	float e0[4], e1[4];
+	computeEndpoints(px, e0, e1);
+	BC7Candidate best = evaluateBC7(px, e0, e1, opaque);
+	for (u32 iter = 0; iter < refine_iterations && best.error > 0; ++iter) {
+		if (!leastSquares(px, best.indices, e0, e1)) break;
+		const BC7Candidate c = evaluateBC7(px, e0, e1, opaque);
+		if (c.error >= best.error) break;
+		best = c;
+	}
+
+	// msb of the first index is implicit 0
+	if (best.indices[0] & 8) {
+		for (u32 c = 0; c < 4; ++c) swap(best.q0[c], best.q1[c]);
+		swap(best.p0, best.p1);
+		for (u8& idx : best.indices) idx = 15 - idx;
+	}
+
+	BitWriter writer(dst);
+	writer.write(1 << 6, 7);
+	for (u32 c = 0; c < 4; ++c) {
+		writer.write(best.q0[c], 7);
+		writer.write(best.q1[c], 7);
+	}
+	writer.write(best.p0, 1);
+	writer.write(best.p1, 1);
+	writer.write(best.indices[0], 3);
+	for (u32 i = 1; i < 16; ++i) writer.write(best.indices[i], 4);
+}
+
+struct BC6HCandidate {
+	u32 q0[3];
+	u32 q1[3];
+	u8 indices[16];
+	float error;
+};
+
+static i32 unquantizeBC6H(u32 v) {
+	if (v == 0) return 0;
+	if (v == 1023) return 0xffFF;
+	return ((v << 16) + 0x8000) >> 10;
+}
+
+// endpoints are interpolated as integers in the half float bit space
+static BC6HCandidate evaluateBC6H(const float (&px)[16][3], const float (&e0)[3], const float (&e1)[3]) {
+	BC6HCandidate res;
+	for (u32 c = 0; c < 3; ++c) {
+		// inverse of unquantize + final scale by 31/64
+		res.q0[c] = (u32)clamp(i32((e0[c] - 15.5f) / 31 + 0.5f), 0, 1023);
+		res.q1[c] = (u32)clamp(i32((e1[c] - 15.5f) / 31 + 0.5f), 0, 1023);
+	}
+
+	i32 palette[16][3];
+	for (u32 c = 0; c < 3; ++c) {
+		const i32 a = unquantizeBC6H(res.q0[c]);
+		const i32 b = unquantizeBC6H(res.q1[c]);
+		for (u32 i = 0; i < 16; ++i) {
+			palette[i][c] = ((((64 - WEIGHTS[i]) * a + WEIGHTS[i] * b + 32) >> 6) * 31) >> 6;
+		}
+	}
+	res.error = computeIndices(px, palette, res.indices);
+	return res;
+}
+
+void encodeBC6H(u8* dst, const float* rgb, u32 refine_iterations) {
+	float px[16][3];
+	for (u32 i = 0; i < 16; ++i) {
+		for (u32 c = 0; c < 3; ++c) {
+			const float v = rgb[i * 3 + c];
+			// also catches NaN
+			const float clamped = v > 0 ? minimum(v, 65504.f) : 0.f;
+			px[i][c] = meshopt_quantizeHalf(clamped);
+		}
+	}
+
+	float e0[3], e1[3];
+	computeEndpoints(px, e0, e1);
+	BC6HCandidate best = evaluateBC6H(px, e0, e1);
+	for (u32 iter = 0; iter < refine_iterations && best.error > 0; ++iter) {
+		if (!leastSquares(px, best.indices, e0, e1)) break;
+		const BC6HCandidate c = evaluateBC6H(px, e0, e1);
+		if (c.error >= best.error) break;
+		best = c;
+	}
+
+	if (best.indices[0] & 8) {
+		for (u32 c = 0; c < 3; ++c) swap(best.q0[c], best.q1[c]);
+		for (u8& idx : best.indices) idx = 15 - idx;
+	}
+
+	BitWriter writer(dst);
+	// mode 11 - one region, 10bit endpoints, no delta
+	writer.write(0x03, 5);
+	for (u32 c = 0; c < 3; ++c) writer.write(best.q0[c], 10);
+	for (u32 c = 0; c < 3; ++c) writer.write(best.q1[c], 10);
+	writer.write(best.indices[0], 3);
+	for (u32 i = 1; i < 16; ++i) writer.write(best.indices[i], 4);
+}
+
+static void decode565(u16 v, u8* rgb) {
+	const u32 r = (v >> 11) & 31;
+	const u32 g = (v >> 5) & 63;
+	const u32 b = v & 31;
+	rgb[0] = u8((r << 3) | (r >> 2));
+	rgb[1] = u8((g << 2) | (g >> 4));
+	rgb[2] = u8((b << 3) | (b >> 2));
+}
+
+void decodeBC3(u8* rgba, const u8* src) {
+	// alpha, 8 values interpolated between two endpoints, or 6 values plus 0 and 255
+	u8 alphas[8];
+	alphas[0] = src[0];
+	alphas[1] = src[1];
+	if (alphas[0] > alphas[1]) {
+		for (u32 i = 1; i < 7; ++i) alphas[i + 1] = u8(((7 - i) * alphas[0] + i * alphas[1]) / 7);
+	}
+	else {
+		for (u32 i = 1; i < 5; ++i) alphas[i + 1] = u8(((5 - i) * alphas[0] + i * alphas[1]) / 5);
+		alphas[6] = 0;
+		alphas[7] = 255;
+	}
+	u64 alpha_indices = 0;
+	for (u32 i = 0; i < 6; ++i) alpha_indices |= u64(src[2 + i]) << (8 * i);
+
+	// color, always 4 values in BC3
+	u8 colors[4][3];
+	decode565(u16(src[8] | (src[9] << 8)), colors[0]);
+	decode565(u16(src[10] | (src[11] << 8)), colors[1]);
+	for (u32 c = 0; c < 3; ++c) {
+		colors[2][c] = u8((2 * colors[0][c] + colors[1][c]) / 3);
+		colors[3][c] = u8((colors[0][c] + 2 * colors[1][c]) / 3);
+	}
+	const u32 color_indices = src[12] | (src[13] << 8) | (src[14] << 16) | (u32(src[15]) << 24);
+
+	for (u32 i = 0; i < 16; ++i) {
+		const u8* color = colors[(color_indices >> (2 * i)) & 3];
+		rgba[i * 4 + 0] = color[0];
+		rgba[i * 4 + 1] = color[1];
+		rgba[i * 4 + 2] = color[2];
+		rgba[i * 4 + 3] = alphas[(alpha_indices >> (3 * i)) & 7];
+	}
+}
+
+} // namespace BCEncoder
+
+} // namespace Lumix
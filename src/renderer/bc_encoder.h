@@ -0,0 +1,20 @@
+#pragma once
+
+#include "engine/lumix.h"
+
+namespace Lumix {
+
+namespace BCEncoder {
+
+// `rgba` is 4x4 block of RGBA8 pixels, writes 16B BC7 block using mode 6
+// with higher `refine_iterations` endpoints are refined more times, slower but better quality
+void encodeBC7(u8* dst, const u8* rgba, u32 refine_iterations);
+// `rgb` is 4x4 block of linear RGB floats (3 floats per pixel), writes 16B BC6H unsigned block using mode 11
+// negative values are clamped to 0
+void encodeBC6H(u8* dst, const float* rgb, u32 refine_iterations);
+// decodes 16B BC3 block to 4x4 block of RGBA8 pixels, used to convert data in old formats
+void decodeBC3(u8* rgba, const u8* src);
+
+} // namespace BCEncoder
+
+} // namespace Lumix
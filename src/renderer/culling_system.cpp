@@ -11,6 +11,8 @@
 #include "engine/page_allocator.h"
 #include "engine/profiler.h"
 #include "engine/simd.h"
+#include "engine/sync.h"
+#include "occlusion_buffer.h"
 
 
 namespace Lumix
@@ -38,12 +40,34 @@ struct CellIndicesHasher
 {
 	// http://www.beosil.com/download/CollisionDetectionHashing_VMV03.pdf
 	static u32 get(const CellIndices& indices) {
-		// TODO indices.is_big, indices.type
-		return (u32)indices.pos.x * 73856093 + (u32)indices.pos.y * 19349663 + (u32)indices.pos.z * 83492791; 
+		return (u32)indices.pos.x * 73856093 + (u32)indices.pos.y * 19349663 + (u32)indices.pos.z * 83492791
+			+ (u32)indices.type * 2654435761 + (indices.is_big ? 42196321 : 0); 
 	}
 };
 
 
+struct RegionIndicesHasher
+{
+	static u32 get(const IVec3& indices) {
+		return (u32)indices.x * 73856093 + (u32)indices.y * 19349663 + (u32)indices.z * 83492791; 
+	}
+};
+
+
+struct CellPage;
+
+
+// coarse level of the grid, REGION_CELLS^3 cells, all types
+// culling tests region's bounds first and cells only when the region intersects frustum
+struct CullingRegion {
+	CullingRegion(IAllocator& allocator) : pages(allocator) {}
+
+	IVec3 indices;
+	DVec3 origin;
+	Array<CellPage*> pages; // all pages of all cells in the region
+};
+
+
 struct alignas(4096) CellPage {
 	struct {
 		CellPage* next = nullptr;
@@ -51,6 +75,11 @@ struct alignas(4096) CellPage {
 		DVec3 origin;
 		CellIndices indices;
 		int count = 0;
+		CullingRegion* region = nullptr; // big objects' pages are not in any region
+		u32 version = 0; // changes whenever spheres or entities change, see CullCache
+		// relative to origin, only grows while the page exists, used for occlusion
+		Vec3 bounds_min = Vec3(FLT_MAX);
+		Vec3 bounds_max = Vec3(-FLT_MAX);
 	} header;
 
 	enum { MAX_COUNT = (PageAllocator::PAGE_SIZE - sizeof(header)) / (sizeof(Sphere) + sizeof(EntityPtr)) };
@@ -60,18 +89,216 @@ struct alignas(4096) CellPage {
 };
 
 static_assert(sizeof(CellPage) == PageAllocator::PAGE_SIZE);
+static_assert(CellPage::MAX_COUNT <= sizeof(CullCache::Page::visible) * 8);
+static_assert(sizeof(CullCache::planes[0]) == sizeof(ShiftedFrustum::xs));
+
+
+static u32 firstBit(u32 mask) {
+	ASSERT(mask != 0);
+	#ifdef _WIN32
+		unsigned long res;
+		_BitScanForward(&res, mask);
+		return res;
+	#else
+		return __builtin_ctz(mask);
+	#endif
+}
+
+
+static u32 firstBit64(u64 mask) {
+	ASSERT(mask != 0);
+	#ifdef _WIN32
+		unsigned long res;
+		_BitScanForward64(&res, mask);
+		return res;
+	#else
+		return __builtin_ctzll(mask);
+	#endif
+}
+
+
+#ifdef LUMIX_AVX2
+	static const bool s_has_avx2 = cpuHasAVX2();
+
+	// 8 spheres per iteration, returns number of processed spheres, the rest is left for cullSpheres
+	LUMIX_AVX2_FUNC static int cullSpheresAVX2(const Sphere* LUMIX_RESTRICT spheres, int count, const Frustum& frustum, u16* LUMIX_RESTRICT visible, int& visible_count) {
+		float8 px[8], py[8], pz[8], pd[8];
+		for (u32 p = 0; p < 8; ++p) {
+			px[p] = f8Splat(frustum.xs[p]);
+			py[p] = f8Splat(frustum.ys[p]);
+			pz[p] = f8Splat(frustum.zs[p]);
+			pd[p] = f8Splat(frustum.ds[p]);
+		}
+		
+		int out = visible_count;
+		int i = 0;
+		for (; i + 8 <= count; i += 8) {
+			const float* ptr = &spheres[i].position.x;
+			// transpose to xs, ys, zs, radii
+			float8 cx, cy, cz, r;
+			f8Deinterleave(f8LoadUnaligned(ptr), f8LoadUnaligned(ptr + 8), f8LoadUnaligned(ptr + 16), f8LoadUnaligned(ptr + 24), cx, cy, cz, r);
+
+			// sign bit is set if a sphere is outside of any plane
+			float8 outside = f8Splat(0);
+			for (u32 p = 0; p < 8; ++p) {
+				float8 t = f8Add(f8Mul(cx, px[p]), f8Mul(cy, py[p]));
+				t = f8Add(t, f8Mul(cz, pz[p]));
+				t = f8Add(t, pd[p]);
+				t = f8Add(t, r);
+				outside = f8Or(outside, t);
+			}
+
+			u32 mask = ~(u32)f8MoveMask(outside) & 0xff;
+			while (mask) {
+				visible[out] = u16(i + firstBit(mask));
+				++out;
+				mask &= mask - 1;
+			}
+		}
+		visible_count = out;
+		return i;
+	}
+#endif
+
+
+// indices of spheres inside frustum are written to `visible`, returns their count
+static int cullSpheres(const Sphere* LUMIX_RESTRICT spheres, int count, const Frustum& frustum, u16* LUMIX_RESTRICT visible) {
+	int out = 0;
+	int i = 0;
+	#ifdef LUMIX_AVX2
+		if (s_has_avx2) i = cullSpheresAVX2(spheres, count, frustum, visible, out);
+	#endif
+
+	const float4 px = f4Load(frustum.xs);
+	const float4 py = f4Load(frustum.ys);
+	const float4 pz = f4Load(frustum.zs);
+	const float4 pd = f4Load(frustum.ds);
+	const float4 px2 = f4Load(&frustum.xs[4]);
+	const float4 py2 = f4Load(&frustum.ys[4]);
+	const float4 pz2 = f4Load(&frustum.zs[4]);
+	const float4 pd2 = f4Load(&frustum.ds[4]);
+
+	float4 sx[8], sy[8], sz[8], sd[8];
+	for (u32 p = 0; p < 8; ++p) {
+		sx[p] = f4Splat(frustum.xs[p]);
+		sy[p] = f4Splat(frustum.ys[p]);
+		sz[p] = f4Splat(frustum.zs[p]);
+		sd[p] = f4Splat(frustum.ds[p]);
+	}
+
+	// 4 spheres per iteration
+	for (; i + 4 <= count; i += 4) {
+		float4 cx = f4LoadUnaligned(&spheres[i]);
+		float4 cy = f4LoadUnaligned(&spheres[i + 1]);
+		float4 cz = f4LoadUnaligned(&spheres[i + 2]);
+		float4 r = f4LoadUnaligned(&spheres[i + 3]);
+		f4Transpose(cx, cy, cz, r);
+
+		float4 outside = f4Splat(0);
+		for (u32 p = 0; p < 8; ++p) {
+			const float4 t = cx * sx[p] + cy * sy[p] + cz * sz[p] + sd[p] + r;
+			outside = f4Or(outside, t);
+		}
+
+		u32 mask = ~(u32)f4MoveMask(outside) & 0xf;
+		while (mask) {
+			visible[out] = u16(i + firstBit(mask));
+			++out;
+			mask &= mask - 1;
+		}
+	}
+
+	// the rest one by one, all planes at once
+	for (; i < count; ++i) {
+		const Sphere& sphere = spheres[i];
+		const float4 cx = f4Splat(sphere.position.x);
+		const float4 cy = f4Splat(sphere.position.y);
+		const float4 cz = f4Splat(sphere.position.z);
+		const float4 r = f4Splat(-sphere.radius);
+
+		float4 t = cx * px + cy * py + cz * pz + pd;
+		t = t - r;
+		if (f4MoveMask(t)) continue;
+
+		t = cx * px2 + cy * py2 + cz * pz2 + pd2;
+		t = t - r;
+		if (f4MoveMask(t)) continue;
+
+		visible[out] = u16(i);
+		++out;
+	}
+	return out;
+}
+
+
+// bit `v` of `masks[i]` is set if sphere `i` is inside `frusta[v]`, only views in `view_mask` are tested
+// each group of spheres is loaded once and tested against all views
+static void cullSpheres(const Sphere* LUMIX_RESTRICT spheres, int count, const Frustum* frusta, u32 view_mask, u32* LUMIX_RESTRICT masks) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float4 cx = f4LoadUnaligned(&spheres[i]);
+		float4 cy = f4LoadUnaligned(&spheres[i + 1]);
+		float4 cz = f4LoadUnaligned(&spheres[i + 2]);
+		float4 r = f4LoadUnaligned(&spheres[i + 3]);
+		f4Transpose(cx, cy, cz, r);
+
+		u32 m[4] = {};
+		u32 views = view_mask;
+		while (views) {
+			const u32 v = firstBit(views);
+			views &= views - 1;
+			const Frustum& frustum = frusta[v];
+
+			float4 outside = f4Splat(0);
+			for (u32 p = 0; p < 8; ++p) {
+				const float4 t = cx * f4Splat(frustum.xs[p]) + cy * f4Splat(frustum.ys[p]) + cz * f4Splat(frustum.zs[p]) + f4Splat(frustum.ds[p]) + r;
+				outside = f4Or(outside, t);
+			}
+
+			u32 inside = ~(u32)f4MoveMask(outside) & 0xf;
+			while (inside) {
+				m[firstBit(inside)] |= 1 << v;
+				inside &= inside - 1;
+			}
+		}
+		memcpy(&masks[i], m, sizeof(m));
+	}
+
+	for (; i < count; ++i) {
+		const Sphere& sphere = spheres[i];
+		u32 m = 0;
+		u32 views = view_mask;
+		while (views) {
+			const u32 v = firstBit(views);
+			views &= views - 1;
+			const Frustum& frustum = frusta[v];
+			bool inside = true;
+			for (u32 p = 0; p < 8 && inside; ++p) {
+				const float t = sphere.position.x * frustum.xs[p] + sphere.position.y * frustum.ys[p] + sphere.position.z * frustum.zs[p] + frustum.ds[p] + sphere.radius;
+				inside = t >= 0;
+			}
+			if (inside) m |= 1 << v;
+		}
+		masks[i] = m;
+	}
+}
 
 
 struct CullingSystemImpl final : CullingSystem
 {
+	static constexpr i32 REGION_CELLS = 8; // per axis
+
 	CullingSystemImpl(IAllocator& allocator, PageAllocator& page_allocator) 
 		: m_allocator(allocator)
 		, m_cell_map(allocator)
 		, m_entity_to_cell(allocator)
-		, m_cells(allocator)
+		, m_region_map(allocator)
+		, m_regions(allocator)
+		, m_big_pages(allocator)
 		, m_cell_size(300.0f)
 		, m_page_allocator(page_allocator)
 	{
+		m_culled_counter = profiler::createCounter("culled objects", profiler::CounterType::SUM);
 	}
 	
 	~CullingSystemImpl()
@@ -79,6 +306,62 @@ struct CullingSystemImpl final : CullingSystem
 		clear();
 	}
 	
+	static i32 floorDiv(i32 a, i32 b) { return a >= 0 ? a / b : (a - b + 1) / b; }
+
+	void addPage(CellPage& page)
+	{
+		++m_structure_version;
+		if (page.header.indices.is_big) {
+			m_big_pages.push(&page);
+			return;
+		}
+
+		const IVec3& cell = page.header.indices.pos;
+		const IVec3 indices(floorDiv(cell.x, REGION_CELLS), floorDiv(cell.y, REGION_CELLS), floorDiv(cell.z, REGION_CELLS));
+		auto iter = m_region_map.find(indices);
+		CullingRegion* region;
+		if (iter.isValid()) {
+			region = iter.value();
+		}
+		else {
+			region = LUMIX_NEW(m_allocator, CullingRegion)(m_allocator);
+			region->indices = indices;
+			region->origin = indices * double(m_cell_size * REGION_CELLS);
+			m_region_map.insert(indices, region);
+			m_regions.push(region);
+		}
+		page.header.region = region;
+		region->pages.push(&page);
+	}
+
+	void removePage(CellPage& page)
+	{
+		++m_structure_version;
+		CullingRegion* region = page.header.region;
+		if (!region) {
+			m_big_pages.swapAndPopItem(&page);
+			return;
+		}
+		
+		region->pages.swapAndPopItem(&page);
+		if (region->pages.empty()) {
+			m_region_map.erase(region->indices);
+			m_regions.swapAndPopItem(region);
+			LUMIX_DELETE(m_allocator, region);
+		}
+	}
+
+	static void expandBounds(CellPage& cell, const Sphere& sphere)
+	{
+		cell.header.bounds_min = AABB::minCoords(cell.header.bounds_min, sphere.position - Vec3(sphere.radius));
+		cell.header.bounds_max = AABB::maxCoords(cell.header.bounds_max, sphere.position + Vec3(sphere.radius));
+	}
+
+	static bool isOccluded(const CellPage& cell, const OcclusionBuffer& occlusion)
+	{
+		return occlusion.isOccluded(cell.header.origin + cell.header.bounds_min, cell.header.bounds_max - cell.header.bounds_min);
+	}
+
 	Sphere* addToCell(CellPage& cell, EntityPtr entity, const DVec3& pos, float radius)
 	{
 		const Vec3 rel_pos = Vec3(pos - cell.header.origin);
@@ -88,6 +371,8 @@ struct CullingSystemImpl final : CullingSystem
 			cell.spheres[count] = {rel_pos, radius};
 			cell.entities[count] = entity;
 			++cell.header.count;
+			++cell.header.version;
+			expandBounds(cell, cell.spheres[count]);
 			return &cell.spheres[count];
 		}
 
@@ -101,43 +386,75 @@ struct CullingSystemImpl final : CullingSystem
 		new_cell->header.next->header.prev = new_cell;
 		if (new_cell->header.prev) new_cell->header.prev->header.next = new_cell;
 
-		m_cells.push(new_cell);
+		addPage(*new_cell);
 		if(!new_cell->header.prev) m_cell_map[new_cell->header.indices] = new_cell;
 
 		new_cell->spheres[0] = {rel_pos, radius};
 		new_cell->entities[0] = entity;
 		new_cell->header.count = 1;
+		expandBounds(*new_cell, new_cell->spheres[0]);
 
 		return &new_cell->spheres[0];
 	}
 
 
-	void add(EntityRef entity, u8 type, const DVec3& pos, float radius) override
-	{
-		if(m_entity_to_cell.size() <= entity.index) {
-			m_entity_to_cell.reserve(entity.index);
-			while(m_entity_to_cell.size() <= entity.index) {
-				m_entity_to_cell.push(nullptr);
-			}
+	void reserveEntityToCell(i32 max_entity_index) {
+		if (m_entity_to_cell.size() > max_entity_index) return;
+		m_entity_to_cell.reserve(max_entity_index + 1);
+		while (m_entity_to_cell.size() <= max_entity_index) {
+			m_entity_to_cell.push(nullptr);
 		}
-		
-		const CellIndices i(pos, m_cell_size, type, radius > m_cell_size);
+	}
 
+	// first page of the cell
+	CellPage& getOrCreateCell(const CellIndices& i) {
 		auto iter = m_cell_map.find(i);
-		if (!iter.isValid()) {
-			void* mem = m_page_allocator.allocate(true);
-			CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
-			new_cell->header.origin = i.pos * double(m_cell_size);
-			new_cell->header.indices = i;
-			m_cell_map.insert(i, new_cell);
-			m_cells.push(new_cell);
-			iter = m_cell_map.find(i);
-		}
+		if (iter.isValid()) return *iter.value();
+
+		void* mem = m_page_allocator.allocate(true);
+		CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
+		new_cell->header.origin = i.pos * double(m_cell_size);
+		new_cell->header.indices = i;
+		m_cell_map.insert(i, new_cell);
+		addPage(*new_cell);
+		return *new_cell;
+	}
 
-		CellPage& cell = *iter.value();
+	void add(EntityRef entity, u8 type, const DVec3& pos, float radius) override
+	{
+		reserveEntityToCell(entity.index);
+		
+		const CellIndices i(pos, m_cell_size, type, radius > m_cell_size);
+		CellPage& cell = getOrCreateCell(i);
 		Sphere* sphere = addToCell(cell, entity, pos, radius);
 		m_entity_to_cell[entity.index] = sphere;
-		return;
+	}
+
+	void add(Span<const EntityRef> entities, u8 type, Span<const DVec3> positions, Span<const float> radii) override
+	{
+		ASSERT(positions.length() == entities.length());
+		ASSERT(radii.length() == entities.length() || radii.length() == 1);
+		if (entities.length() == 0) return;
+
+		i32 max_index = 0;
+		for (EntityRef e : entities) max_index = maximum(max_index, e.index);
+		reserveEntityToCell(max_index);
+
+		// consecutive entities are usually close to each other, so the cell's lookup is reused
+		CellPage* cell = nullptr;
+		CellIndices cell_indices;
+		for (u32 j = 0; j < entities.length(); ++j) {
+			const float radius = radii[radii.length() == 1 ? 0 : j];
+			const CellIndices i(positions[j], m_cell_size, type, radius > m_cell_size);
+			if (!cell || !(i == cell_indices)) {
+				cell = &getOrCreateCell(i);
+				cell_indices = i;
+			}
+			Sphere* sphere = addToCell(*cell, entities[j], positions[j], radius);
+			m_entity_to_cell[entities[j].index] = sphere;
+			// a new first page is created when the cell is full
+			cell = &getCell(*sphere);
+		}
 	}
 
 
@@ -156,7 +473,7 @@ struct CullingSystemImpl final : CullingSystem
 			}
 			if (cell.header.prev) cell.header.prev->header.next = cell.header.next;
 			if (cell.header.next) cell.header.next->header.prev = cell.header.prev;
-			m_cells.swapAndPopItem(&cell);
+			removePage(cell);
 			cell.~CellPage();
 			m_page_allocator.deallocate(&cell, true);
 		}
@@ -167,6 +484,7 @@ struct CullingSystemImpl final : CullingSystem
 			cell.spheres[idx] = cell.spheres[cell.header.count - 1];
 			m_entity_to_cell[last.index] = &cell.spheres[idx];
 			--cell.header.count;
+			++cell.header.version;
 		}
 		m_entity_to_cell[entity.index] = nullptr;
 	}
@@ -189,6 +507,8 @@ struct CullingSystemImpl final : CullingSystem
 
 		if(new_indices == cell.header.indices.pos) {
 			sphere->position = Vec3(pos - cell.header.origin);
+			++cell.header.version;
+			expandBounds(cell, *sphere);
 			return;
 		}
 
@@ -204,6 +524,12 @@ struct CullingSystemImpl final : CullingSystem
 		return m_entity_to_cell[entity.index]->radius;
 	}
 
+	DVec3 getPosition(EntityRef entity) override
+	{
+		const Sphere* sphere = m_entity_to_cell[entity.index];
+		return getCell(*sphere).header.origin + DVec3(sphere->position);
+	}
+
 	void set(EntityRef entity, const DVec3& pos, float radius) override {
 		Sphere* sphere = m_entity_to_cell[entity.index];
 		CellPage& cell = getCell(*sphere);
@@ -215,6 +541,8 @@ struct CullingSystemImpl final : CullingSystem
 		if (was_big == is_big && new_indices == cell.header.indices.pos) {
 			sphere->radius = radius;
 			sphere->position = Vec3(pos - cell.header.origin);
+			++cell.header.version;
+			expandBounds(cell, *sphere);
 			return;
 		}
 
@@ -233,6 +561,8 @@ struct CullingSystemImpl final : CullingSystem
 
 		if (was_big == is_big) {
 			sphere->radius = radius;
+			++cell.header.version;
+			expandBounds(cell, *sphere);
 			return;
 		}
 		const u8 type = cell.header.indices.type;
@@ -255,47 +585,38 @@ struct CullingSystemImpl final : CullingSystem
 			}
 		}
 	   
-		m_cells.clear();
+		for (CullingRegion* region : m_regions) {
+			LUMIX_DELETE(m_allocator, region);
+		}
+		m_regions.clear();
+		m_region_map.clear();
+		m_big_pages.clear();
 		m_cell_map.clear();
 		m_entity_to_cell.clear();
+		++m_structure_version;
 	}
 
 	LUMIX_FORCE_INLINE void doCulling(const CellPage& cell
 		, const Frustum& frustum
-		, CullResult* LUMIX_RESTRICT results
+		, CullResult*& results
 		, PagedList<CullResult>& list
-		, u8 type)
+		, u8 type
+		, CullCache::Page* cached)
 	{
-		const Sphere* LUMIX_RESTRICT start = cell.spheres;
-		const Sphere* LUMIX_RESTRICT end = cell.spheres + cell.header.count;
+		u16 visible[CellPage::MAX_COUNT];
+		const int visible_count = cullSpheres(cell.spheres, cell.header.count, frustum, visible);
 		const EntityPtr* LUMIX_RESTRICT sphere_to_entity_map = cell.entities;
 
-		const float4 px = f4Load(frustum.xs);
-		const float4 py = f4Load(frustum.ys);
-		const float4 pz = f4Load(frustum.zs);
-		const float4 pd = f4Load(frustum.ds);
-		const float4 px2 = f4Load(&frustum.xs[4]);
-		const float4 py2 = f4Load(&frustum.ys[4]);
-		const float4 pz2 = f4Load(&frustum.zs[4]);
-		const float4 pd2 = f4Load(&frustum.ds[4]);
-		int cursor = results->header.count;
-
-		int i = 0;
-
-		for (const Sphere *sphere = start; sphere < end; ++sphere, ++i) {
-			const float4 cx = f4Splat(sphere->position.x);
-			const float4 cy = f4Splat(sphere->position.y);
-			const float4 cz = f4Splat(sphere->position.z);
-			const float4 r = f4Splat(-sphere->radius);
-
-			float4 t = cx * px + cy * py + cz * pz + pd;
-			t = t - r;
-			if (f4MoveMask(t)) continue;
-
-			t = cx * px2 + cy * py2 + cz * pz2 + pd2;
-			t = t - r;
-			if (f4MoveMask(t)) continue;
+		if (cached) {
+			cached->all_visible = false;
+			memset(cached->visible, 0, sizeof(cached->visible));
+			for (int i = 0; i < visible_count; ++i) {
+				cached->visible[visible[i] >> 6] |= u64(1) << (visible[i] & 63);
+			}
+		}
 
+		int cursor = results->header.count;
+		for (int i = 0; i < visible_count; ++i) {
 			if(cursor == lengthOf(results->entities)) {
 				results->header.count = cursor;
 				results = list.push();
@@ -303,7 +624,7 @@ struct CullingSystemImpl final : CullingSystem
 				cursor = 0;
 			}
 
-			results->entities[cursor] = (EntityRef)sphere_to_entity_map[i];
+			results->entities[cursor] = (EntityRef)sphere_to_entity_map[visible[i]];
 			++cursor;
 		}
 		results->header.count = cursor;
@@ -312,70 +633,606 @@ struct CullingSystemImpl final : CullingSystem
 	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
 	{
 		ASSERT(type != 0xff); // 0xff type is reserved for `all types`
-		return cullInternal(frustum, type);
+		return cullInternal(frustum, type, nullptr, nullptr);
 	}
 
 	CullResult* cull(const ShiftedFrustum& frustum) override
 	{
-		return cullInternal(frustum, 0xff);
+		return cullInternal(frustum, 0xff, nullptr, nullptr);
 	}
-	
-	CullResult* cullInternal(const ShiftedFrustum& frustum, u8 type)
+
+	CullResult* cull(const ShiftedFrustum& frustum, CullCache& cache, const OcclusionBuffer* occlusion) override
+	{
+		if (isCacheValid(cache, frustum, 0xff)) return cullCached(frustum, cache, occlusion);
+		return cullInternal(frustum, 0xff, &cache, occlusion);
+	}
+
+	void cull(Span<CullView> views) override
+	{
+		ASSERT(views.length() <= MAX_CULL_VIEWS);
+		u32 view_mask = 0;
+		for (u32 i = 0, c = views.length(); i < c; ++i) {
+			CullView& view = views[i];
+			if (view.cache && isCacheValid(*view.cache, *view.frustum, 0xff)) {
+				view.result = cullCached(*view.frustum, *view.cache, view.occlusion);
+			}
+			else {
+				view_mask |= 1 << i;
+			}
+		}
+
+		if (!view_mask) return;
+		if ((view_mask & (view_mask - 1)) == 0) {
+			CullView& view = views[firstBit(view_mask)];
+			view.result = cullInternal(*view.frustum, 0xff, view.cache, view.occlusion);
+			return;
+		}
+		cullMulti(views, view_mask);
+	}
+
+	bool isCacheValid(const CullCache& cache, const ShiftedFrustum& frustum, u8 type) const
+	{
+		if (cache.system != this || cache.structure_version != m_structure_version || cache.type != type) return false;
+		if (cache.origin.x != frustum.origin.x || cache.origin.y != frustum.origin.y || cache.origin.z != frustum.origin.z) return false;
+		return memcmp(cache.planes[0], frustum.xs, sizeof(frustum.xs)) == 0
+			&& memcmp(cache.planes[1], frustum.ys, sizeof(frustum.ys)) == 0
+			&& memcmp(cache.planes[2], frustum.zs, sizeof(frustum.zs)) == 0
+			&& memcmp(cache.planes[3], frustum.ds, sizeof(frustum.ds)) == 0;
+	}
+
+	static void copyCached(const CellPage& cell, const CullCache::Page& cached, CullResult*& result, PagedList<CullResult>& list)
+	{
+		if (cached.all_visible) {
+			copyAll(cell, result, list);
+			return;
+		}
+
+		int cursor = result->header.count;
+		for (u32 w = 0; w < lengthOf(cached.visible); ++w) {
+			u64 mask = cached.visible[w];
+			while (mask) {
+				if (cursor == lengthOf(result->entities)) {
+					result->header.count = cursor;
+					result = list.push();
+					result->header.type = cell.header.indices.type;
+					cursor = 0;
+				}
+				result->entities[cursor] = (EntityRef)cell.entities[w * 64 + firstBit64(mask)];
+				++cursor;
+				mask &= mask - 1;
+			}
+		}
+		result->header.count = cursor;
+	}
+
+	// frustum and pages did not change since the cache was filled, so only changed pages are culled
+	CullResult* cullCached(const ShiftedFrustum& frustum, CullCache& cache, const OcclusionBuffer* occlusion)
 	{
 		PROFILE_FUNCTION();
-		if (m_cells.empty()) return nullptr;
+		cache.occluded_pages = 0;
+		cache.changed_types = 0;
+		if (cache.pages.empty()) return nullptr;
 
-		volatile i32 cell_idx = 0;
+		volatile i32 page_idx = 0;
+		volatile i32 occluded_pages = 0;
 		PagedList<CullResult> list(m_page_allocator);
+		Mutex changed_mutex;
 
 		jobs::runOnWorkers([&](){
-			PROFILE_BLOCK("cull_job");
-			const Vec3 v3_cell_size(m_cell_size);
-			const Vec3 v3_2_cell_size(2 * m_cell_size);
+			PROFILE_BLOCK("cull_cached_job");
+			const Vec3 cell_bounds_size(4 * m_cell_size);
+			const DVec3 cell_bounds_offset(-2 * m_cell_size);
 			CullResult* result = nullptr;
-			u32 total_count = 0;
-			for(;;) {
-				const i32 idx = atomicIncrement(&cell_idx) - 1;
-				if (idx >= m_cells.size()) return;
+			u32 culled_count = 0;
+			u32 changed_types = 0;
+
+			for (;;) {
+				enum { STEP = 64 };
+				const i32 from = atomicAdd(&page_idx, STEP);
+				if (from >= cache.pages.size()) break;
+				const i32 to = minimum(from + STEP, cache.pages.size());
+
+				for (i32 i = from; i < to; ++i) {
+					CullCache::Page& cached = cache.pages[i];
+					const CellPage& cell = *cached.page;
+					// occluded page keeps its cached data, if it's outdated, it stays so until the page is visible again
+					if (occlusion && isOccluded(cell, *occlusion)) {
+						atomicIncrement(&occluded_pages);
+						changed_types |= 1 << cell.header.indices.type;
+						continue;
+					}
+					if (!result || result->header.type != cell.header.indices.type) {
+						result = list.push();
+						result->header.type = cell.header.indices.type;
+					}
 
-				CellPage& cell = *m_cells[idx];
-				if (type != 0xff && cell.header.indices.type != type) continue;
-				if (!result || result->header.type != cell.header.indices.type) {
-					result = list.push();
-					result->header.type = cell.header.indices.type;
+					if (cell.header.version == cached.version) {
+						copyCached(cell, cached, result, list);
+						continue;
+					}
+
+					culled_count += cell.header.count;
+					changed_types |= 1 << cell.header.indices.type;
+					cached.version = cell.header.version;
+					if (cell.header.region && frustum.containsAABB(cell.header.origin + cell_bounds_offset, cell_bounds_size)) {
+						cached.all_visible = true;
+						copyAll(cell, result, list);
+					}
+					else {
+						doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type, &cached);
+					}
 				}
+			}
+			profiler::pushInt("count", culled_count);
+			profiler::addCounter(m_culled_counter, culled_count);
+			if (changed_types) {
+				MutexGuard guard(changed_mutex);
+				cache.changed_types |= changed_types;
+			}
+		});
 
+		cache.occluded_pages = occluded_pages;
+		return list.detach();
+	}
+	
+	static void copyAll(const CellPage& cell, CullResult*& result, PagedList<CullResult>& list)
+	{
+		int to_cpy = cell.header.count;
+		int src_offset = 0;
+		while (to_cpy > 0) {
+			if(result->header.count == lengthOf(result->entities)) {
+				result = list.push();
+				result->header.type = cell.header.indices.type;
+			}
+			const int rem_space = lengthOf(result->entities) - result->header.count;
+			const int step = minimum(to_cpy, rem_space);
+			memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
+			src_offset += step;
+			result->header.count += step;
+			to_cpy -= step;
+		}
+	}
+
+	void resetCache(CullCache& cache, const ShiftedFrustum& frustum, u8 type) const
+	{
+		cache.occluded_pages = 0;
+		cache.changed_types = 0xffFFffFF;
+		cache.system = this;
+		cache.structure_version = m_structure_version;
+		cache.type = type;
+		cache.origin = frustum.origin;
+		memcpy(cache.planes[0], frustum.xs, sizeof(frustum.xs));
+		memcpy(cache.planes[1], frustum.ys, sizeof(frustum.ys));
+		memcpy(cache.planes[2], frustum.zs, sizeof(frustum.zs));
+		memcpy(cache.planes[3], frustum.ds, sizeof(frustum.ds));
+		cache.pages.clear();
+	}
+
+	// same as cullInternal, but for all views in `view_mask` at once
+	void cullMulti(Span<CullView> views, u32 view_mask)
+	{
+		PROFILE_FUNCTION();
+		volatile i32 occluded_pages[MAX_CULL_VIEWS] = {};
+		Local<PagedList<CullResult>> lists[MAX_CULL_VIEWS];
+		for (u32 mask = view_mask; mask; mask &= mask - 1) {
+			const u32 v = firstBit(mask);
+			if (views[v].cache) resetCache(*views[v].cache, *views[v].frustum, 0xff);
+			lists[v].create(m_page_allocator);
+		}
+
+		volatile i32 region_idx = 0;
+		volatile i32 big_idx = 0;
+		Mutex cache_mutex;
+
+		jobs::runOnWorkers([&](){
+			PROFILE_BLOCK("cull_multi_job");
+			const Vec3 cell_bounds_size(4 * m_cell_size);
+			const DVec3 cell_bounds_offset(-2 * m_cell_size);
+			const Vec3 region_bounds_size((REGION_CELLS + 3) * m_cell_size);
+			CullResult* results[MAX_CULL_VIEWS] = {};
+			Frustum relative[MAX_CULL_VIEWS];
+			u32 sphere_masks[CellPage::MAX_COUNT];
+			u32 total_count = 0;
+
+			struct CachedPage {
+				u32 view;
+				CullCache::Page page;
+			};
+			Array<CachedPage> cached(m_allocator);
+
+			auto push_cached = [&](u32 v, const CellPage& cell) -> CullCache::Page* {
+				if (!views[v].cache) return nullptr;
+				CachedPage& page = cached.emplace();
+				page.view = v;
+				page.page.page = &cell;
+				page.page.version = cell.header.version;
+				page.page.all_visible = true;
+				return &page.page;
+			};
+
+			// `candidates` intersect `cell`, `inside_mask` contain it
+			auto cull_page = [&](const CellPage& cell, u32 candidates, u32 inside_mask) {
+				const u8 page_type = cell.header.indices.type;
 				total_count += cell.header.count;
-				if (cell.header.indices.is_big) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type);
+				u32 partial_mask = 0;
+				for (u32 mask = candidates; mask; mask &= mask - 1) {
+					const u32 v = firstBit(mask);
+					if (views[v].occlusion && isOccluded(cell, *views[v].occlusion)) {
+						atomicIncrement(&occluded_pages[v]);
+						// outdated version, so the page is culled when it's not occluded anymore
+						CullCache::Page* page = push_cached(v, cell);
+						if (page) page->version = cell.header.version + 1;
+						continue;
+					}
+
+					if (!results[v] || results[v]->header.type != page_type) {
+						results[v] = lists[v]->push();
+						results[v]->header.type = page_type;
+					}
+
+					if (inside_mask & (1 << v)) {
+						push_cached(v, cell);
+						copyAll(cell, results[v], *lists[v]);
+					}
+					else {
+						partial_mask |= 1 << v;
+						relative[v] = views[v].frustum->getRelative(cell.header.origin);
+					}
 				}
-				else if (frustum.containsAABB(cell.header.origin + v3_cell_size, v3_cell_size)) {
-					int to_cpy = cell.header.count;
-					int src_offset = 0;
-					while (to_cpy > 0) {
-						if(result->header.count == lengthOf(result->entities)) {
-							result = list.push();
-							result->header.type = cell.header.indices.type;
+				if (!partial_mask) return;
+
+				cullSpheres(cell.spheres, cell.header.count, relative, partial_mask, sphere_masks);
+
+				for (u32 mask = partial_mask; mask; mask &= mask - 1) {
+					const u32 v = firstBit(mask);
+					const u32 bit = 1 << v;
+					CullCache::Page* page = push_cached(v, cell);
+					if (page) {
+						page->all_visible = false;
+						memset(page->visible, 0, sizeof(page->visible));
+					}
+					CullResult* result = results[v];
+					int cursor = result->header.count;
+					for (int i = 0, c = cell.header.count; i < c; ++i) {
+						if ((sphere_masks[i] & bit) == 0) continue;
+						if (page) page->visible[i >> 6] |= u64(1) << (i & 63);
+						if (cursor == lengthOf(result->entities)) {
+							result->header.count = cursor;
+							result = lists[v]->push();
+							result->header.type = page_type;
+							cursor = 0;
 						}
-						const int rem_space = lengthOf(result->entities) - result->header.count;
-						const int step = minimum(to_cpy, rem_space);
-						memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
-						src_offset += step;
-						result->header.count += step;
-						to_cpy -= step;
+						result->entities[cursor] = (EntityRef)cell.entities[i];
+						++cursor;
 					}
+					result->header.count = cursor;
+					results[v] = result;
+				}
+			};
+
+			for (;;) {
+				const i32 idx = atomicIncrement(&region_idx) - 1;
+				if (idx >= m_regions.size()) break;
+
+				const CullingRegion& region = *m_regions[idx];
+				const DVec3 region_min = region.origin + cell_bounds_offset;
+				u32 region_mask = 0;
+				u32 region_inside = 0;
+				for (u32 mask = view_mask; mask; mask &= mask - 1) {
+					const u32 v = firstBit(mask);
+					const ShiftedFrustum& frustum = *views[v].frustum;
+					if (!frustum.intersectsAABB(region_min, region_bounds_size)) continue;
+					region_mask |= 1 << v;
+					if (frustum.containsAABB(region_min, region_bounds_size)) region_inside |= 1 << v;
+				}
+				if (!region_mask) continue;
+
+				for (const CellPage* cell : region.pages) {
+					const DVec3 cell_min = cell->header.origin + cell_bounds_offset;
+					u32 candidates = region_inside;
+					u32 inside_mask = region_inside;
+					for (u32 mask = region_mask & ~region_inside; mask; mask &= mask - 1) {
+						const u32 v = firstBit(mask);
+						const ShiftedFrustum& frustum = *views[v].frustum;
+						if (frustum.containsAABB(cell_min, cell_bounds_size)) {
+							candidates |= 1 << v;
+							inside_mask |= 1 << v;
+						}
+						else if (frustum.intersectsAABB(cell_min, cell_bounds_size)) {
+							candidates |= 1 << v;
+						}
+					}
+					if (candidates) cull_page(*cell, candidates, inside_mask);
+				}
+			}
+
+			for (;;) {
+				const i32 idx = atomicIncrement(&big_idx) - 1;
+				if (idx >= m_big_pages.size()) break;
+				cull_page(*m_big_pages[idx], view_mask, 0);
+			}
+			profiler::pushInt("count", total_count);
+			profiler::addCounter(m_culled_counter, total_count);
+
+			if (!cached.empty()) {
+				MutexGuard guard(cache_mutex);
+				for (const CachedPage& page : cached) views[page.view].cache->pages.push(page.page);
+			}
+		});
+
+		for (u32 mask = view_mask; mask; mask &= mask - 1) {
+			const u32 v = firstBit(mask);
+			if (views[v].cache) views[v].cache->occluded_pages = occluded_pages[v];
+			views[v].result = lists[v]->detach();
+		}
+	}
+
+	// if `cache` is not null, it's filled with intersecting pages
+	CullResult* cullInternal(const ShiftedFrustum& frustum, u8 type, CullCache* cache, const OcclusionBuffer* occlusion)
+	{
+		PROFILE_FUNCTION();
+		volatile i32 occluded_pages = 0;
+		if (cache) resetCache(*cache, frustum, type);
+		if (m_regions.empty() && m_big_pages.empty()) return nullptr;
+
+		volatile i32 region_idx = 0;
+		volatile i32 big_idx = 0;
+		PagedList<CullResult> list(m_page_allocator);
+		Mutex cache_mutex;
+
+		jobs::runOnWorkers([&](){
+			PROFILE_BLOCK("cull_job");
+			// objects' positions are anywhere in (origin - cell_size, origin + 2 * cell_size) because of truncation to int
+			// and their radius is at most cell_size
+			const Vec3 cell_bounds_size(4 * m_cell_size);
+			const DVec3 cell_bounds_offset(-2 * m_cell_size);
+			const Vec3 region_bounds_size((REGION_CELLS + 3) * m_cell_size);
+			CullResult* result = nullptr;
+			u32 total_count = 0;
+			Array<CullCache::Page> cached(m_allocator);
+
+			auto push_cached = [&](const CellPage& cell) -> CullCache::Page* {
+				if (!cache) return nullptr;
+				CullCache::Page& page = cached.emplace();
+				page.page = &cell;
+				page.version = cell.header.version;
+				page.all_visible = true;
+				return &page;
+			};
+
+			auto is_occluded = [&](const CellPage& cell) {
+				if (!occlusion || !isOccluded(cell, *occlusion)) return false;
+				atomicIncrement(&occluded_pages);
+				// outdated version, so the page is culled when it's not occluded anymore
+				CullCache::Page* page = push_cached(cell);
+				if (page) page->version = cell.header.version + 1;
+				return true;
+			};
+
+			auto prepare_result = [&](u8 page_type) {
+				if (!result || result->header.type != page_type) {
+					result = list.push();
+					result->header.type = page_type;
 				}
-				else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type);
+			};
+
+			for(;;) {
+				const i32 idx = atomicIncrement(&region_idx) - 1;
+				if (idx >= m_regions.size()) break;
+
+				const CullingRegion& region = *m_regions[idx];
+				if (!frustum.intersectsAABB(region.origin + cell_bounds_offset, region_bounds_size)) continue;
+				const bool region_inside = frustum.containsAABB(region.origin + cell_bounds_offset, region_bounds_size);
+				
+				for (const CellPage* cell : region.pages) {
+					if (type != 0xff && cell->header.indices.type != type) continue;
+
+					prepare_result(cell->header.indices.type);
+					total_count += cell->header.count;
+					const DVec3 cell_min = cell->header.origin + cell_bounds_offset;
+					const bool inside = region_inside || frustum.containsAABB(cell_min, cell_bounds_size);
+					if (!inside && !frustum.intersectsAABB(cell_min, cell_bounds_size)) continue;
+					if (is_occluded(*cell)) continue;
+
+					if (inside) {
+						push_cached(*cell);
+						copyAll(*cell, result, list);
+					}
+					else {
+						doCulling(*cell, frustum.getRelative(cell->header.origin), result, list, cell->header.indices.type, push_cached(*cell));
+					}
 				}
 			}
+
+			for (;;) {
+				const i32 idx = atomicIncrement(&big_idx) - 1;
+				if (idx >= m_big_pages.size()) break;
+
+				const CellPage& cell = *m_big_pages[idx];
+				if (type != 0xff && cell.header.indices.type != type) continue;
+				
+				prepare_result(cell.header.indices.type);
+				total_count += cell.header.count;
+				if (is_occluded(cell)) continue;
+				doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type, push_cached(cell));
+			}
 			profiler::pushInt("count", total_count);
+			profiler::addCounter(m_culled_counter, total_count);
+
+			if (!cached.empty()) {
+				MutexGuard guard(cache_mutex);
+				for (const CullCache::Page& page : cached) cache->pages.push(page);
+			}
 		});
 
+		if (cache) cache->occluded_pages = occluded_pages;
 		return list.detach();
 	}
 	
 
+	// `t` is where the ray enters the box, 0 if the ray starts inside
+	static bool getRayBoxEntry(const Vec3& origin, const Vec3& dir, const Vec3& min, const Vec3& max, float& t) {
+		float t_min = 0;
+		float t_max = FLT_MAX;
+		for (u32 i = 0; i < 3; ++i) {
+			if (dir[i] == 0) {
+				if (origin[i] < min[i] || origin[i] > max[i]) return false;
+				continue;
+			}
+			const float inv = 1 / dir[i];
+			float t0 = (min[i] - origin[i]) * inv;
+			float t1 = (max[i] - origin[i]) * inv;
+			if (t0 > t1) swap(t0, t1);
+			t_min = maximum(t_min, t0);
+			t_max = minimum(t_max, t1);
+			if (t_min > t_max) return false;
+		}
+		t = t_min;
+		return true;
+	}
+
+	static bool getRaySphereEntry(const Vec3& origin, const Vec3& dir, const Sphere& sphere, float& t) {
+		const Vec3 o = origin - sphere.position;
+		const float a = dot(dir, dir);
+		const float b = dot(o, dir);
+		const float c = dot(o, o) - sphere.radius * sphere.radius;
+		const float d = b * b - a * c;
+		if (d < 0) return false;
+		const float sqrt_d = sqrtf(d);
+		if (-b + sqrt_d < 0) return false;
+		t = maximum(0.f, (-b - sqrt_d) / a);
+		return true;
+	}
+
+	void castRay(const DVec3& origin, const Vec3& dir, u32 types, const Delegate<double (EntityRef, double)>& f) override {
+		PROFILE_FUNCTION();
+		struct PageHit {
+			const CellPage* page;
+			float t;
+		};
+
+		Array<PageHit> pages(m_allocator);
+		auto checkPage = [&](const CellPage* page){
+			if ((types & (1 << page->header.indices.type)) == 0) return;
+			if (page->header.count == 0) return;
+			float t;
+			const Vec3 rel_origin = Vec3(origin - page->header.origin);
+			if (getRayBoxEntry(rel_origin, dir, page->header.bounds_min, page->header.bounds_max, t)) {
+				pages.push({page, t});
+			}
+		};
+
+		// cells are not aligned to regions and spheres can stick out of cells, hence the margin
+		const float region_size = m_cell_size * REGION_CELLS;
+		const Vec3 region_min(-2 * m_cell_size);
+		const Vec3 region_max(region_size + 2 * m_cell_size);
+		for (const CullingRegion* region : m_regions) {
+			float t;
+			if (!getRayBoxEntry(Vec3(origin - region->origin), dir, region_min, region_max, t)) continue;
+			for (const CellPage* page : region->pages) checkPage(page);
+		}
+		for (const CellPage* page : m_big_pages) checkPage(page);
+
+		qsort(pages.begin(), pages.size(), sizeof(pages[0]), [](const void* a, const void* b) -> int {
+			const float ta = ((const PageHit*)a)->t;
+			const float tb = ((const PageHit*)b)->t;
+			return ta < tb ? -1 : (ta > tb ? 1 : 0);
+		});
+
+		double best = DBL_MAX;
+		for (const PageHit& page_hit : pages) {
+			if (page_hit.t > best) break;
+
+			const CellPage& page = *page_hit.page;
+			const Vec3 rel_origin = Vec3(origin - page.header.origin);
+			for (i32 i = 0, c = page.header.count; i < c; ++i) {
+				float t;
+				if (!getRaySphereEntry(rel_origin, dir, page.spheres[i], t)) continue;
+				if (t > best) continue;
+				best = f.invoke((EntityRef)page.entities[i], t);
+			}
+		}
+	}
+
+	// `box_test(origin, min, max)` rejects whole regions and pages, `page_overlap(page, emit)` calls `emit` for overlapping spheres in the page
+	template <typename BoxTest, typename PageOverlap>
+	u32 overlap(u32 types, Span<EntityRef> out, const BoxTest& box_test, const PageOverlap& page_overlap) const {
+		u32 count = 0;
+		auto emit = [&](EntityRef e){
+			if (count < out.length()) out[count] = e;
+			++count;
+		};
+		auto check_page = [&](const CellPage& page){
+			if ((types & (1 << page.header.indices.type)) == 0) return;
+			if (page.header.count == 0) return;
+			if (!box_test(page.header.origin, page.header.bounds_min, page.header.bounds_max)) return;
+			page_overlap(page, emit);
+		};
+
+		// same margin as in castRay
+		const float region_size = m_cell_size * REGION_CELLS;
+		const Vec3 region_min(-2 * m_cell_size);
+		const Vec3 region_max(region_size + 2 * m_cell_size);
+		for (const CullingRegion* region : m_regions) {
+			if (!box_test(region->origin, region_min, region_max)) continue;
+			for (const CellPage* page : region->pages) check_page(*page);
+		}
+		for (const CellPage* page : m_big_pages) check_page(*page);
+		return count;
+	}
+
+	static float squaredDistance(const Vec3& p, const Vec3& min, const Vec3& max) {
+		return squaredLength(p - minimum(maximum(p, min), max));
+	}
+
+	u32 overlapSphere(const DVec3& center, float radius, u32 types, Span<EntityRef> out) const override {
+		PROFILE_FUNCTION();
+		return overlap(types, out
+			, [&](const DVec3& origin, const Vec3& min, const Vec3& max){
+				return squaredDistance(Vec3(center - origin), min, max) <= radius * radius;
+			}
+			, [&](const CellPage& page, auto& emit){
+				const Vec3 rel_center = Vec3(center - page.header.origin);
+				for (i32 i = 0, c = page.header.count; i < c; ++i) {
+					const Sphere& sphere = page.spheres[i];
+					const float r = radius + sphere.radius;
+					if (squaredLength(sphere.position - rel_center) <= r * r) emit((EntityRef)page.entities[i]);
+				}
+			});
+	}
+
+	u32 overlapBox(const DVec3& min, const DVec3& max, u32 types, Span<EntityRef> out) const override {
+		PROFILE_FUNCTION();
+		return overlap(types, out
+			, [&](const DVec3& origin, const Vec3& bounds_min, const Vec3& bounds_max){
+				const Vec3 rel_min = Vec3(min - origin);
+				const Vec3 rel_max = Vec3(max - origin);
+				return rel_min.x <= bounds_max.x && rel_min.y <= bounds_max.y && rel_min.z <= bounds_max.z
+					&& rel_max.x >= bounds_min.x && rel_max.y >= bounds_min.y && rel_max.z >= bounds_min.z;
+			}
+			, [&](const CellPage& page, auto& emit){
+				const Vec3 rel_min = Vec3(min - page.header.origin);
+				const Vec3 rel_max = Vec3(max - page.header.origin);
+				for (i32 i = 0, c = page.header.count; i < c; ++i) {
+					const Sphere& sphere = page.spheres[i];
+					if (squaredDistance(sphere.position, rel_min, rel_max) <= sphere.radius * sphere.radius) emit((EntityRef)page.entities[i]);
+				}
+			});
+	}
+
+	u32 overlapFrustum(const ShiftedFrustum& frustum, u32 types, Span<EntityRef> out) const override {
+		PROFILE_FUNCTION();
+		return overlap(types, out
+			, [&](const DVec3& origin, const Vec3& min, const Vec3& max){
+				return frustum.intersectsAABB(origin + DVec3(min), max - min);
+			}
+			, [&](const CellPage& page, auto& emit){
+				u16 visible[CellPage::MAX_COUNT];
+				const int count = cullSpheres(page.spheres, page.header.count, frustum.getRelative(page.header.origin), visible);
+				for (int i = 0; i < count; ++i) emit((EntityRef)page.entities[visible[i]]);
+			});
+	}
+
 	bool isAdded(EntityRef entity) override
 	{
 		return entity.index < m_entity_to_cell.size() && m_entity_to_cell[entity.index] != nullptr;
@@ -385,9 +1242,13 @@ struct CullingSystemImpl final : CullingSystem
 	IAllocator& m_allocator;
 	PageAllocator& m_page_allocator;
 	HashMap<CellIndices, CellPage*, CellIndicesHasher> m_cell_map;
-	Array<CellPage*> m_cells;
+	HashMap<IVec3, CullingRegion*, RegionIndicesHasher> m_region_map;
+	Array<CullingRegion*> m_regions;
+	Array<CellPage*> m_big_pages; // big objects are culled one by one, so they do not need regions
 	Array<Sphere*> m_entity_to_cell;
 	float m_cell_size;
+	u32 m_culled_counter;
+	u32 m_structure_version = 0; // changes when any page is created or destroyed, see CullCache
 };
 
 
@@ -1,20 +1,21 @@
 #pragma once
 
 
+#include "engine/array.h"
+#include "engine/delegate.h"
 #include "engine/lumix.h"
+#include "engine/math.h"
 
 
 namespace Lumix
 {
 
-template <typename T> struct Array;
 template <typename T> struct UniquePtr;
-struct DVec3;
 struct IAllocator;
+struct OcclusionBuffer;
 struct PageAllocator;
 struct ShiftedFrustum;
 struct Sphere;
-struct Vec3;
 
 struct CullResult {
 	void merge(CullResult* other) {
@@ -45,8 +46,44 @@ struct CullResult {
 	EntityRef entities[(16384 - sizeof(header)) / sizeof(EntityRef)];
 };
 
+struct CellPage;
+
+// results of the previous cull of one view
+// if the view's frustum does not change, only pages changed since then are culled again
+struct CullCache {
+	struct Page {
+		const CellPage* page;
+		u32 version;
+		bool all_visible;
+		u64 visible[4];
+	};
+
+	CullCache(IAllocator& allocator) : pages(allocator) {}
+	void invalidate() { system = nullptr; }
+
+	const struct CullingSystem* system = nullptr;
+	u32 structure_version;
+	u8 type;
+	float planes[4][8];
+	DVec3 origin;
+	Array<Page> pages; // pages intersecting the frustum
+	u32 occluded_pages = 0; // in the last cull
+	u32 changed_types = 0xffFFffFF; // bit per page type, set if any of its pages was culled again in the last cull
+};
+
+// one view of a multi view cull, see CullingSystem::cull(Span<CullView>)
+struct CullView {
+	const ShiftedFrustum* frustum = nullptr;
+	CullCache* cache = nullptr; // can be null
+	const OcclusionBuffer* occlusion = nullptr; // can be null
+	CullResult* result = nullptr; // output
+};
+
 struct LUMIX_RENDERER_API CullingSystem
 {
+	static constexpr u32 MAX_CULL_VIEWS = 32;
+
+
 	CullingSystem() { }
 	virtual ~CullingSystem() { }
 
@@ -56,9 +93,30 @@ struct LUMIX_RENDERER_API CullingSystem
 
 	virtual CullResult* cull(const ShiftedFrustum& frustum, u8 type) = 0;
 	virtual CullResult* cull(const ShiftedFrustum& frustum) = 0;
+	// one cache must not be used by multiple culls running at the same time
+	// pages hidden in `occlusion` are skipped, `occlusion` can be null
+	virtual CullResult* cull(const ShiftedFrustum& frustum, CullCache& cache, const OcclusionBuffer* occlusion) = 0;
+	// all views in one traversal, each page's spheres are tested against all frusta while they are in cache
+	// views with valid cache are culled from the cache, the others refill it, at most MAX_CULL_VIEWS views
+	virtual void cull(Span<CullView> views) = 0;
+
+	// calls `f(entity, t)` for spheres hit by the ray, ordered front to back by pages, `t` is where the ray enters the sphere
+	// `f` returns the closest hit found so far, pages further than that are skipped, `t` are in `dir` units
+	// `types` is a bit mask of types to check
+	virtual void castRay(const DVec3& origin, const Vec3& dir, u32 types, const Delegate<double (EntityRef, double)>& f) = 0;
+
+	// overlap queries write at most `out.length()` entities to `out` and return the number of all overlapping spheres,
+	// so the query can be repeated with bigger `out` if needed; `types` is a bit mask of types to check
+	// queries do not change the culling system, so they can run on any thread at the same time as other queries and culls,
+	// but not at the same time as add, remove or set*
+	virtual u32 overlapSphere(const DVec3& center, float radius, u32 types, Span<EntityRef> out) const = 0;
+	virtual u32 overlapBox(const DVec3& min, const DVec3& max, u32 types, Span<EntityRef> out) const = 0;
+	virtual u32 overlapFrustum(const ShiftedFrustum& frustum, u32 types, Span<EntityRef> out) const = 0;
 
 	virtual bool isAdded(EntityRef entity) = 0;
 	virtual void add(EntityRef entity, u8 type, const DVec3& pos, float radius) = 0;
+	// `radii` has either one value per entity or a single value used for all of them
+	virtual void add(Span<const EntityRef> entities, u8 type, Span<const DVec3> positions, Span<const float> radii) = 0;
 	virtual void remove(EntityRef entity) = 0;
 
 	virtual void setPosition(EntityRef entity, const DVec3& pos) = 0;
@@ -66,6 +124,7 @@ struct LUMIX_RENDERER_API CullingSystem
 	virtual void set(EntityRef entity, const DVec3& pos, float radius) = 0;
 
 	virtual float getRadius(EntityRef entity) = 0;
+	virtual DVec3 getPosition(EntityRef entity) = 0;
 };
 
 } // namespace Lumix
@@ -1,3 +1,4 @@
+#include "engine/string.h"
 #include "draw2d.h"
 #include "font.h"
 
@@ -172,11 +173,11 @@ void Draw2D::addImage(gpu::TextureHandle* tex, const Vec2& from, const Vec2& to,
 	cmd->indices_count += 6;
 }
 
-void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char* str) {
-	if (!*str) return;
+// glyphs can be on different atlas pages, nullptr is the default atlas
+Draw2D::Cmd& Draw2D::getCmd(gpu::TextureHandle* texture) {
 	Cmd* cmd = &m_cmds.back();
 
-	if (cmd->texture != nullptr && cmd->indices_count != 0) {
+	if (cmd->texture != texture && cmd->indices_count != 0) {
 		cmd = &m_cmds.emplace();
 		const Rect& r = m_clip_queue.back();
 		cmd->clip_pos = r.from;
@@ -185,25 +186,22 @@ void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char*
 		cmd->index_offset = m_indices.size();
 	}
 
-	cmd->texture = nullptr;
-	
-	Vec2 p = pos;
-	p.x = float(int(p.x));
-	p.y = float(int(p.y));
-
-	for (const char* c = str; *c; ++c) {
-		if (*c == '\r') continue;
-		if (*c == '\n') {
-			p.x = float(int(pos.x));
-			p.y += getAdvanceY(font);
-			continue;
-		}
-		const Glyph* glyph = findGlyph(font, *c);
-		if (!glyph) {
-			p.x += 16;
-			continue;
-		}
-	
+	cmd->texture = texture;
+	return *cmd;
+}
+
+void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char* str) {
+	if (!*str) return;
+	Cmd* cmd = &getCmd(nullptr);
+
+	const Vec2 origin(float(int(pos.x)), float(int(pos.y)));
+	const Span<const TextQuad> quads = layoutText(font, str);
+	m_vertices.reserve(m_vertices.size() + quads.length() * 4);
+	m_indices.reserve(m_indices.size() + quads.length() * 6);
+
+	for (const TextQuad& quad : quads) {
+		if (quad.texture != cmd->texture) cmd = &getCmd(quad.texture);
+
 		const u32 voff = m_vertices.size();
 		m_indices.push(voff);
 		m_indices.push(voff + 1);
@@ -213,14 +211,77 @@ void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char*
 		m_indices.push(voff + 2);
 		m_indices.push(voff + 3);
 
-		m_vertices.push({ p + Vec2(glyph->x0, glyph->y0), { glyph->u0, glyph->v0 }, color });
-		m_vertices.push({ p + Vec2(glyph->x1, glyph->y0), { glyph->u1, glyph->v0 }, color });
-		m_vertices.push({ p + Vec2(glyph->x1, glyph->y1), { glyph->u1, glyph->v1 }, color });
-		m_vertices.push({ p + Vec2(glyph->x0, glyph->y1), { glyph->u0, glyph->v1 }, color });
-		
-		p.x += glyph->advance_x;
+		m_vertices.push({ origin + quad.from, quad.uv0, color });
+		m_vertices.push({ origin + Vec2(quad.to.x, quad.from.y), { quad.uv1.x, quad.uv0.y }, color });
+		m_vertices.push({ origin + quad.to, quad.uv1, color });
+		m_vertices.push({ origin + Vec2(quad.from.x, quad.to.y), { quad.uv0.x, quad.uv1.y }, color });
 		cmd->indices_count += 6;
 	}
 }
 
+void Draw2D::addTexts(Span<const TextItem> items) {
+	if (items.length() == 0) return;
+	Cmd* cmd = &getCmd(nullptr);
+
+	u32 chars_count = 0;
+	for (const TextItem& item : items) chars_count += stringLength(item.text);
+	m_vertices.reserve(m_vertices.size() + chars_count * 4);
+	m_indices.reserve(m_indices.size() + chars_count * 6);
+
+	const Rect& clip = m_clip_queue.back();
+	const bool has_clip = clip.to.x >= 0;
+	for (const TextItem& item : items) {
+		if (!*item.text) continue;
+
+		const Vec2 origin(float(int(item.pos.x)), float(int(item.pos.y)));
+		for (const TextQuad& quad : layoutText(*item.font, item.text)) {
+			const Vec2 from = origin + quad.from;
+			const Vec2 to = origin + quad.to;
+			if (has_clip && (to.x < clip.from.x || to.y < clip.from.y || from.x > clip.to.x || from.y > clip.to.y)) continue;
+			if (quad.texture != cmd->texture) cmd = &getCmd(quad.texture);
+
+			const u32 voff = m_vertices.size();
+			m_indices.push(voff);
+			m_indices.push(voff + 1);
+			m_indices.push(voff + 2);
+
+			m_indices.push(voff);
+			m_indices.push(voff + 2);
+			m_indices.push(voff + 3);
+
+			m_vertices.push({ from, quad.uv0, item.color });
+			m_vertices.push({ { to.x, from.y }, { quad.uv1.x, quad.uv0.y }, item.color });
+			m_vertices.push({ to, quad.uv1, item.color });
+			m_vertices.push({ { from.x, to.y }, { quad.uv0.x, quad.uv1.y }, item.color });
+			cmd->indices_count += 6;
+		}
+	}
+}
+
+void Draw2D::append(const Draw2D& src) {
+	if (src.m_indices.empty()) return;
+
+	const u32 voff = m_vertices.size();
+	const u32 ioff = m_indices.size();
+	m_vertices.reserve(voff + src.m_vertices.size());
+	m_indices.reserve(ioff + src.m_indices.size());
+	for (const Vertex& v : src.m_vertices) m_vertices.push(v);
+	for (u32 i : src.m_indices) m_indices.push(i + voff);
+
+	for (const Cmd& src_cmd : src.m_cmds) {
+		if (src_cmd.indices_count == 0) continue;
+		Cmd& cmd = m_cmds.emplace(src_cmd);
+		cmd.index_offset += ioff;
+	}
+
+	// restore current clip rect for following draws
+	const Rect& r = m_clip_queue.back();
+	Cmd& cmd = m_cmds.emplace();
+	cmd.texture = nullptr;
+	cmd.clip_pos = r.from;
+	cmd.clip_size = r.to - r.from;
+	cmd.indices_count = 0;
+	cmd.index_offset = m_indices.size();
+}
+
 } // namespace Lumix
\ No newline at end of file
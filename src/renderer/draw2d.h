@@ -25,6 +25,13 @@ struct LUMIX_RENDERER_API Draw2D {
 		Color color; 
 	};
 
+	struct TextItem {
+		const Font* font;
+		Vec2 pos;
+		Color color;
+		const char* text;
+	};
+
 	Draw2D(IAllocator& allocator);
 
 	void clear(Vec2 atlas_size);
@@ -34,7 +41,12 @@ struct LUMIX_RENDERER_API Draw2D {
 	void addRect(const Vec2& from, const Vec2& to, Color color, float width);
 	void addRectFilled(const Vec2& from, const Vec2& to, Color color);
 	void addText(const Font& font, const Vec2& pos, Color color, const char* text);
+	// same as calling addText for each item, glyphs completely outside of current clip rect are skipped
+	void addTexts(Span<const TextItem> items);
 	void addImage(gpu::TextureHandle* tex, const Vec2& from, const Vec2& to, const Vec2& uv0, const Vec2& uv1, Color color);
+	// copies all geometry from `src`, clip rects in `src` are not intersected with current clip rect
+	void append(const Draw2D& src);
+	Vec2 getAtlasSize() const { return m_atlas_size; }
 	const Array<Vertex>& getVertices() const { return m_vertices; }
 	const Array<u32>& getIndices() const { return m_indices; }
 	const Array<Cmd>& getCmds() const { return m_cmds; }
@@ -45,6 +57,8 @@ private:
 		Vec2 to;
 	};
 
+	Cmd& getCmd(gpu::TextureHandle* texture);
+
 	Vec2 m_atlas_size;
 	Array<Cmd> m_cmds;
 	Array<u32> m_indices;
@@ -386,9 +386,14 @@ void FBXImporter::writePackedVec3(const ofbx::Vec3& vec, const Matrix& mtx, Outp
 }
 
 
-static void writeUV(const ofbx::Vec2& uv, OutputMemoryStream* blob)
+static void writeUV(const ofbx::Vec2& uv, bool half, OutputMemoryStream* blob)
 {
 	Vec2 tex_cooords = {(float)uv.x, 1 - (float)uv.y};
+	if (half) {
+		const u16 tmp[] = { meshopt_quantizeHalf(tex_cooords.x), meshopt_quantizeHalf(tex_cooords.y) };
+		blob->write(tmp);
+		return;
+	}
 	blob->write(tex_cooords);
 }
 
@@ -617,6 +622,46 @@ const FBXImporter::ImportGeometry& FBXImporter::getImportGeometry(const ofbx::Ge
 	return m_geometries[0];
 }
 
+// smaller meshes are not worth culling per meshlet
+static constexpr u32 MESHLETS_MIN_TRIANGLES = 4096;
+static constexpr u32 MESHLET_MAX_VERTICES = 64;
+static constexpr u32 MESHLET_MAX_TRIANGLES = 124;
+
+// reorders indices so each meshlet is a contiguous range
+static void buildMeshlets(FBXImporter::ImportMesh& mesh, u32 vertex_size, IAllocator& allocator)
+{
+	PROFILE_FUNCTION();
+	const u32 vertex_count = u32(mesh.vertex_data.size() / vertex_size);
+	const u32 indices_count = mesh.indices.size();
+	Array<meshopt_Meshlet> meshlets(allocator);
+	meshlets.resize((i32)meshopt_buildMeshletsBound(indices_count, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES));
+	const u32 meshlets_count = (u32)meshopt_buildMeshlets(meshlets.begin(), (const u32*)mesh.indices.begin(), indices_count, vertex_count, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+
+	Array<int> indices(allocator);
+	indices.reserve(indices_count);
+	mesh.meshlets.clear();
+	for (u32 i = 0; i < meshlets_count; ++i) {
+		const meshopt_Meshlet& src = meshlets[i];
+		const meshopt_Bounds bounds = meshopt_computeMeshletBounds(&src, (const float*)mesh.vertex_data.data(), vertex_count, vertex_size);
+		
+		Mesh::Meshlet meshlet;
+		meshlet.sphere = Vec4(bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
+		meshlet.cone = Vec4(bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff);
+		meshlet.first_index = indices.size();
+		meshlet.indices_count = src.triangle_count * 3;
+		meshlet.padding[0] = meshlet.padding[1] = 0;
+		mesh.meshlets.write(meshlet);
+
+		for (u32 j = 0; j < src.triangle_count; ++j) {
+			for (u32 k = 0; k < 3; ++k) {
+				indices.push((int)src.vertices[src.indices[j][k]]);
+			}
+		}
+	}
+	ASSERT(indices.size() == (i32)indices_count);
+	mesh.indices.swap(indices);
+}
+
 void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 {
 	jobs::forEach(m_geometries.size(), 1, [&](i32 geom_idx, i32){
@@ -743,7 +788,7 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 			aabb.max.z = maximum(aabb.max.z, pos.z);
 
 			if (normals) writePackedVec3(normals[i], transform_matrix, &import_mesh.vertex_data);
-			if (uvs) writeUV(uvs[i], &import_mesh.vertex_data);
+			if (uvs) writeUV(uvs[i], cfg.half_uvs, &import_mesh.vertex_data);
 			if (colors) writeColor(colors[i], &import_mesh.vertex_data);
 			if (tangents) writePackedVec3(tangents[i], transform_matrix, &import_mesh.vertex_data);
 			if (cfg.bake_vertex_ao) { /* TODO */ }
@@ -771,6 +816,11 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 			mem += vertex_size;
 		}
 
+		import_mesh.meshlets.clear();
+		if (cfg.build_meshlets && !import_mesh.is_skinned && (u32)import_mesh.indices.size() >= MESHLETS_MIN_TRIANGLES * 3) {
+			buildMeshlets(import_mesh, vertex_size, m_allocator);
+		}
+
 		if (import_mesh.lod >= 3 && cfg.create_impostor) {
 			logWarning(path, " has more than 3 LODs and some are replaced with impostor");
 			import_mesh.import = false;
@@ -1151,10 +1201,16 @@ struct CaptureImpostorJob : Renderer::RenderJob {
 	IVec2& m_tile_size;
 };
 
+bool FBXImporter::isImpostorShaderReady() const {
+	return m_impostor_shadow_shader && m_impostor_shadow_shader->isReady();
+}
+
 bool FBXImporter::createImpostorTextures(Model* model, Array<u32>& gb0_rgba, Array<u32>& gb1_rgba, Array<u32>& shadow, IVec2& size, bool bake_normals)
 {
 	ASSERT(model->isReady());
 	ASSERT(m_impostor_shadow_shader->isReady());
+	// impostor is captured from lod 0, it might not be streamed in yet
+	model->makeResident();
 
 	Engine& engine = m_app.getEngine();
 	Renderer* renderer = (Renderer*)engine.getPluginManager().getPlugin("renderer");
@@ -1334,11 +1390,11 @@ static float evalCurve(i64 time, const ofbx::AnimationCurve& curve) {
 
 // parent_scale - animated scale is not supported, but we can get rid of static scale if we ignore
 // it in writeSkeleton() and use `parent_scale` in this function
-static void compressPositions(float parent_scale, Array<FBXImporter::Key>& out)
+static void compressPositions(float parent_scale, float error, Array<FBXImporter::Key>& out)
 {
 	if (out.empty()) return;
 
-	const float ERROR = 0; 
+	const float ERROR = error; 
 	Vec3 dir = out[1].pos - out[0].pos;
 	dir *= float(1 / ofbx::fbxTimeToSeconds(out[1].time - out[0].time));
 	u32 prev = 0;
@@ -1359,11 +1415,11 @@ static void compressPositions(float parent_scale, Array<FBXImporter::Key>& out)
 	}
 }
 
-static void compressRotations(Array<FBXImporter::Key>& out)
+static void compressRotations(float error, Array<FBXImporter::Key>& out)
 {
 	if (out.empty()) return;
 
-	const float ERROR = 0; 
+	const float ERROR = error; 
 	u32 prev = 0;
 	for (u32 i = 2; i < (u32)out.size(); ++i) {
 		const float t = float(ofbx::fbxTimeToSeconds(out[prev + 1].time - out[prev].time) / ofbx::fbxTimeToSeconds(out[i].time - out[prev].time));
@@ -1379,6 +1435,41 @@ static void compressRotations(Array<FBXImporter::Key>& out)
 	}
 }
 
+// distance to the farthest descendant, bone's rotation error is amplified by this
+static float getChainLength(const ofbx::Object* bone, const Array<const ofbx::Object*>& bones) {
+	const ofbx::Matrix bone_mtx = bone->getGlobalTransform();
+	float res = 0;
+	for (const ofbx::Object* b : bones) {
+		const ofbx::Object* parent = b->getParent();
+		while (parent && parent != bone) parent = parent->getParent();
+		if (!parent) continue;
+
+		const ofbx::Matrix mtx = b->getGlobalTransform();
+		const Vec3 d(float(mtx.m[12] - bone_mtx.m[12]), float(mtx.m[13] - bone_mtx.m[13]), float(mtx.m[14] - bone_mtx.m[14]));
+		res = maximum(res, length(d));
+	}
+	return res;
+}
+
+static void writeQuantized(OutputMemoryStream& blob, Quat q) {
+	u32 largest = 0;
+	for (u32 i = 1; i < 4; ++i) {
+		if (fabsf((&q.x)[i]) > fabsf((&q.x)[largest])) largest = i;
+	}
+	if ((&q.x)[largest] < 0) q = -q;
+
+	u16 res[3];
+	for (u32 i = 0, j = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const float v = ((&q.x)[i] + 0.70710678f) / 1.41421356f;
+		res[j] = u16(clamp(v, 0.f, 1.f) * 0x7fff + 0.5f);
+		++j;
+	}
+	res[0] |= (largest & 1) << 15;
+	res[1] |= (largest >> 1) << 15;
+	blob.write(res);
+}
+
 static float getScaleX(const ofbx::Matrix& mtx)
 {
 	Vec3 v(float(mtx.m[0]), float(mtx.m[4]), float(mtx.m[8]));
@@ -1543,7 +1634,7 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 
 		Animation::Header header;
 		header.magic = Animation::HEADER_MAGIC;
-		header.version = 3;
+		header.version = u32(cfg.compress_animations ? Animation::Version::COMPRESSED : Animation::Version::FIRST);
 		header.length = Time::fromSeconds((float)anim_len);
 		header.frame_count = u32(anim_len * fps + 0.5f);
 		write(header);
@@ -1560,13 +1651,17 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 			fill(*bone, anim_len, *layer, keys);
 		}
 
+		const float scale = cfg.mesh_scale * m_fbx_scale;
 		for (const ofbx::Object*& bone : m_bones) {
 			Array<Key>& keys = all_keys[u32(&bone - m_bones.begin())];
 			ofbx::Object* parent = bone->getParent();
 			const float parent_scale = parent ? (float)getScaleX(parent->getGlobalTransform()) : 1;
+			// quat components change by ~angle / 2, points at the end of the chain move by ~angle * chain length
+			// vertices skinned to short chains can be farther than chain length, hence the lower limit
+			const float chain_length = maximum(getChainLength(bone, m_bones) * scale, 0.1f);
 			// TODO skip curves which do not change anything
-			compressRotations(keys);
-			compressPositions(parent_scale, keys);
+			compressRotations(cfg.animation_error / (2 * chain_length), keys);
+			compressPositions(parent_scale, cfg.animation_error / (parent_scale * scale), keys);
 		}
 
 		const u64 stream_translations_count_pos = out_file.size();
@@ -1611,9 +1706,36 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 					write(fbx_to_anim_time(key.time));
 				}
 			}
-			for (Key& key : keys) {
-				if ((key.flags & 1) == 0) {
-					write(fixOrientation(key.pos * cfg.mesh_scale * m_fbx_scale));
+			if (cfg.compress_animations) {
+				Vec3 min(FLT_MAX), max(-FLT_MAX);
+				for (Key& key : keys) {
+					if ((key.flags & 1) == 0) {
+						const Vec3 p = fixOrientation(key.pos * scale);
+						min = minimum(min, p);
+						max = maximum(max, p);
+					}
+				}
+				const Vec3 range = max - min;
+				const Vec3 quant_scale = range * (1.f / 0xffFF);
+				write(min);
+				write(quant_scale);
+				for (Key& key : keys) {
+					if ((key.flags & 1) == 0) {
+						const Vec3 p = fixOrientation(key.pos * scale) - min;
+						const u16 q[3] = {
+							u16(range.x > 0 ? p.x / range.x * 0xffFF + 0.5f : 0),
+							u16(range.y > 0 ? p.y / range.y * 0xffFF + 0.5f : 0),
+							u16(range.z > 0 ? p.z / range.z * 0xffFF + 0.5f : 0)
+						};
+						write(q);
+					}
+				}
+			}
+			else {
+				for (Key& key : keys) {
+					if ((key.flags & 1) == 0) {
+						write(fixOrientation(key.pos * scale));
+					}
 				}
 			}
 			++translation_curves_count;
@@ -1653,16 +1775,22 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 			}
 			//if (isBindPoseRotationTrack(count, keys, bind_rot, cfg.rotation_error)) continue;
 
+			auto write_rot = [&](const Quat& rot){
+				if (cfg.compress_animations) writeQuantized(out_file, rot);
+				else write(rot);
+			};
+
 			const u32 name_hash = crc32(bone->name);
 			write(name_hash);
-			if (shouldSample(count, float(anim_len), fps, sizeof(Quat))) {
+			const u32 key_size = cfg.compress_animations ? sizeof(u16) * 3 : sizeof(Quat);
+			if (shouldSample(count, float(anim_len), fps, key_size)) {
 				++sampled_count;
 				write(Animation::CurveType::SAMPLED);
 				count = u32(anim_len * fps + 0.5f);
 				write(count);
 				for (u32 i = 0; i < count; ++i) {
 					const float t = float(anim_len * ((float)i / (count - 1)));
-					write(fixOrientation(sample(*bone, *layer, t).rot));
+					write_rot(fixOrientation(sample(*bone, *layer, t).rot));
 				}
 			}
 			else {
@@ -1675,7 +1803,7 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 				}
 				for (Key& key : keys) {
 					if ((key.flags & 2) == 0) {
-						write(fixOrientation(key.rot));
+						write_rot(fixOrientation(key.rot));
 					}
 				}
 			}
@@ -1694,7 +1822,7 @@ int FBXImporter::getVertexSize(const ofbx::Geometry& geom, bool is_skinned, cons
 	static const int POSITION_SIZE = sizeof(float) * 3;
 	static const int NORMAL_SIZE = sizeof(u8) * 4;
 	static const int TANGENT_SIZE = sizeof(u8) * 4;
-	static const int UV_SIZE = sizeof(float) * 2;
+	const int UV_SIZE = cfg.half_uvs ? sizeof(u16) * 2 : sizeof(float) * 2;
 	static const int COLOR_SIZE = sizeof(u8) * 4;
 	static const int AO_SIZE = sizeof(u8);
 	static const int BONE_INDICES_WEIGHTS_SIZE = sizeof(float) * 4 + sizeof(u16) * 4;
@@ -1828,17 +1956,63 @@ void FBXImporter::writeImpostorVertices(const AABB& aabb)
 		{{center.x + max.x, center.y + min.y, center.z},	{128, 255, 128, 0},	 {255, 128, 128, 0}, {1, 0}}
 	};
 
-	const u32 vertex_data_size = sizeof(vertices);
-	write(vertex_data_size);
-	for (const Vertex& vertex : vertices) {
-		write(vertex.pos);
-		write(vertex.normal);
-		write(vertex.tangent);
-		write(vertex.uv);
+	writeVertices(vertices, sizeof(vertices), sizeof(vertices[0]));
+}
+
+
+// meshoptimizer's codecs, followed by lz4 in writeCompiledResource, shrink geometry several times
+void FBXImporter::writeIndices(const u32* indices, u32 count, bool indices_16bit)
+{
+	const i32 index_size = indices_16bit ? sizeof(u16) : sizeof(u32);
+	write(index_size);
+	write(count);
+
+	u32 vertex_count = 0;
+	for (u32 i = 0; i < count; ++i) vertex_count = maximum(vertex_count, indices[i] + 1);
+	OutputMemoryStream encoded(m_allocator);
+	encoded.resize(meshopt_encodeIndexBufferBound(count, vertex_count));
+	const u32 encoded_size = (u32)meshopt_encodeIndexBuffer(encoded.getMutableData(), encoded.size(), indices, count);
+	if (encoded_size > 0 && encoded_size < count * index_size) {
+		write(encoded_size);
+		write(encoded.data(), encoded_size);
+		return;
+	}
+
+	// not encoded
+	write((u32)0);
+	if (indices_16bit) {
+		for (u32 i = 0; i < count; ++i) {
+			ASSERT(indices[i] <= (1 << 16));
+			write((u16)indices[i]);
+		}
+	}
+	else {
+		write(indices, sizeof(indices[0]) * count);
 	}
 }
 
 
+void FBXImporter::writeVertices(const void* data, u32 size, u32 vertex_size)
+{
+	write(size);
+	// vertex codec can handle only sizes divisible by 4
+	if (vertex_size % 4 == 0 && vertex_size <= 256) {
+		OutputMemoryStream encoded(m_allocator);
+		encoded.resize(meshopt_encodeVertexBufferBound(size / vertex_size, vertex_size));
+		const u32 encoded_size = (u32)meshopt_encodeVertexBuffer(encoded.getMutableData(), encoded.size(), data, size / vertex_size, vertex_size);
+		if (encoded_size > 0 && encoded_size < size) {
+			write(encoded_size);
+			write(encoded.data(), encoded_size);
+			return;
+		}
+	}
+	
+	// not encoded
+	write((u32)0);
+	write(data, size);
+}
+
+
 void FBXImporter::writeGeometry(int mesh_idx, const ImportConfig& cfg)
 {
 	float origin_radius_squared = 0;
@@ -1846,31 +2020,12 @@ void FBXImporter::writeGeometry(int mesh_idx, const ImportConfig& cfg)
 	OutputMemoryStream vertices_blob(m_allocator);
 	const ImportMesh& import_mesh = m_meshes[mesh_idx];
 	
-	bool are_indices_16_bit = areIndices16Bit(import_mesh, cfg);
-	if (are_indices_16_bit)
-	{
-		int index_size = sizeof(u16);
-		write(index_size);
-		write(import_mesh.indices.size());
-		for (int i : import_mesh.indices)
-		{
-			ASSERT(i <= (1 << 16));
-			u16 index = (u16)i;
-			write(index);
-		}
-	}
-	else
-	{
-		int index_size = sizeof(import_mesh.indices[0]);
-		write(index_size);
-		write(import_mesh.indices.size());
-		write(&import_mesh.indices[0], sizeof(import_mesh.indices[0]) * import_mesh.indices.size());
-	}
+	writeIndices((const u32*)import_mesh.indices.begin(), import_mesh.indices.size(), areIndices16Bit(import_mesh, cfg));
 	origin_radius_squared = maximum(origin_radius_squared, import_mesh.origin_radius_squared);
 	center_radius_squared = maximum(center_radius_squared, import_mesh.center_radius_squared);
 
-	write((i32)import_mesh.vertex_data.size());
-	write(import_mesh.vertex_data.data(), import_mesh.vertex_data.size());
+	const int vertex_size = getVertexSize(*import_mesh.fbx->getGeometry(), import_mesh.is_skinned, cfg);
+	writeVertices(import_mesh.vertex_data.data(), (u32)import_mesh.vertex_data.size(), vertex_size);
 
 	write(sqrtf(origin_radius_squared));
 	write(sqrtf(center_radius_squared));
@@ -1887,45 +2042,22 @@ void FBXImporter::writeGeometry(const ImportConfig& cfg)
 	for (const ImportMesh& import_mesh : m_meshes)
 	{
 		if (!import_mesh.import) continue;
-		bool are_indices_16_bit = areIndices16Bit(import_mesh, cfg);
-		if (are_indices_16_bit)
-		{
-			int index_size = sizeof(u16);
-			write(index_size);
-			write(import_mesh.indices.size());
-			for (int i : import_mesh.indices)
-			{
-				ASSERT(i <= (1 << 16));
-				u16 index = (u16)i;
-				write(index);
-			}
-		}
-		else
-		{
-			int index_size = sizeof(import_mesh.indices[0]);
-			write(index_size);
-			write(import_mesh.indices.size());
-			write(&import_mesh.indices[0], sizeof(import_mesh.indices[0]) * import_mesh.indices.size());
-		}
+		writeIndices((const u32*)import_mesh.indices.begin(), import_mesh.indices.size(), areIndices16Bit(import_mesh, cfg));
 		aabb.merge(import_mesh.aabb);
 		origin_radius_squared = maximum(origin_radius_squared, import_mesh.origin_radius_squared);
 		center_radius_squared = maximum(center_radius_squared, import_mesh.center_radius_squared);
 	}
 
 	if (cfg.create_impostor) {
-		const int index_size = sizeof(u16);
-		write(index_size);
-		const u16 indices[] = {0, 1, 2, 0, 2, 3};
-		const u32 len = lengthOf(indices);
-		write(len);
-		write(indices, sizeof(indices));
+		const u32 indices[] = {0, 1, 2, 0, 2, 3};
+		writeIndices(indices, lengthOf(indices), true);
 	}
 
 	for (const ImportMesh& import_mesh : m_meshes)
 	{
 		if (!import_mesh.import) continue;
-		write((i32)import_mesh.vertex_data.size());
-		write(import_mesh.vertex_data.data(), import_mesh.vertex_data.size());
+		const int vertex_size = getVertexSize(*import_mesh.fbx->getGeometry(), import_mesh.is_skinned, cfg);
+		writeVertices(import_mesh.vertex_data.data(), (u32)import_mesh.vertex_data.size(), vertex_size);
 	}
 	if (cfg.create_impostor) {
 		writeImpostorVertices(aabb);
@@ -2001,7 +2133,7 @@ void FBXImporter::writeMeshes(const char* src, int mesh_idx, const ImportConfig&
 		const ofbx::Geometry* geom = mesh.getGeometry();
 		if (geom->getUVs()) {
 			write(Mesh::AttributeSemantic::TEXCOORD0);
-			write(gpu::AttributeType::FLOAT);
+			write(cfg.half_uvs ? gpu::AttributeType::HALF : gpu::AttributeType::FLOAT);
 			write((u8)2);
 		}
 		if (geom->getColors() && cfg.import_vertex_colors) {
@@ -2132,6 +2264,29 @@ void FBXImporter::writeLODs(const ImportConfig& cfg)
 }
 
 
+void FBXImporter::writeMeshlets(int mesh_idx, const ImportConfig& cfg)
+{
+	auto write_mesh = [&](const ImportMesh& mesh){
+		const u32 count = u32(mesh.meshlets.size() / sizeof(Mesh::Meshlet));
+		write(count);
+		write(mesh.meshlets.data(), mesh.meshlets.size());
+	};
+
+	if (mesh_idx >= 0) {
+		write_mesh(m_meshes[mesh_idx]);
+		return;
+	}
+
+	for (const ImportMesh& mesh : m_meshes) {
+		if (mesh.import) write_mesh(mesh);
+	}
+	if (cfg.create_impostor) {
+		const u32 count = 0;
+		write(count);
+	}
+}
+
+
 int FBXImporter::getAttributeCount(const ImportMesh& mesh, const ImportConfig& cfg) const
 {
 	int count = 2; // position & normals
@@ -2155,7 +2310,7 @@ void FBXImporter::writeModelHeader()
 {
 	Model::FileHeader header;
 	header.magic = 0x5f4c4d4f; // == '_LMO';
-	header.version = (u32)Model::FileVersion::LATEST;
+	header.version = (u32)Model::FileVersion::ENCODED_BUFFERS;
 	write(header);
 }
 
@@ -2301,6 +2456,7 @@ void FBXImporter::writeSubmodels(const char* src, const ImportConfig& cfg)
 		write(lod_count);
 		write(to_mesh);
 		write(factor);
+		writeMeshlets(i, cfg);
 
 		StaticString<LUMIX_MAX_PATH> resource_locator(name, ".fbx:", src);
 
@@ -2333,6 +2489,7 @@ void FBXImporter::writeModel(const char* src, const ImportConfig& cfg)
 	writeGeometry(cfg);
 	writeSkeleton(cfg);
 	writeLODs(cfg);
+	writeMeshlets(-1, cfg);
 
 	m_compiler.writeCompiledResource(src, Span(out_file.data(), (i32)out_file.size()));
 }
@@ -38,6 +38,11 @@ struct FBXImporter
 		Physics physics = Physics::NONE;
 		float lods_distances[4] = {-10, -100, -1000, -10000};
 		float bounding_scale = 1.f;
+		bool compress_animations = true;
+		// max error of bones' positions caused by key reduction, in meters
+		float animation_error = 0.001f;
+		bool build_meshlets = true;
+		bool half_uvs = false;
 	};
 
 
@@ -123,6 +128,7 @@ struct FBXImporter
 		ImportMesh(IAllocator& allocator)
 			: vertex_data(allocator)
 			, indices(allocator)
+			, meshlets(allocator)
 		{
 		}
 
@@ -135,6 +141,7 @@ struct FBXImporter
 		int submesh = -1;
 		OutputMemoryStream vertex_data;
 		Array<int> indices;
+		OutputMemoryStream meshlets; // Mesh::Meshlet, indices are in meshlet order if not empty
 		AABB aabb;
 		float origin_radius_squared;
 		float center_radius_squared;
@@ -153,6 +160,7 @@ struct FBXImporter
 	void writeModel(const char* src, const ImportConfig& cfg);
 	void writePhysics(const char* src, const ImportConfig& cfg);
 	bool createImpostorTextures(struct Model* model, Array<u32>& gb0_rgba, Array<u32>& gb1_rgba, Array<u32>& shadow, IVec2& size, bool bake_normals);
+	bool isImpostorShaderReady() const;
 
 	const Array<ImportMesh>& getMeshes() const { return m_meshes; }
 	const Array<ImportAnimation>& getAnimations() const { return m_animations; }
@@ -183,12 +191,15 @@ private:
 	Vec3 fixOrientation(const Vec3& v) const;
 	Quat fixOrientation(const Quat& v) const;
 	void writeImpostorVertices(const AABB& aabb);
+	void writeIndices(const u32* indices, u32 count, bool indices_16bit);
+	void writeVertices(const void* data, u32 size, u32 vertex_size);
 	void writeGeometry(const ImportConfig& cfg);
 	void writeGeometry(int mesh_idx, const ImportConfig& cfg);
 	void writeImpostorMesh(const char* dir, const char* model_name);
 	void writeMeshes(const char* src, int mesh_idx, const ImportConfig& cfg);
 	void writeSkeleton(const ImportConfig& cfg);
 	void writeLODs(const ImportConfig& cfg);
+	void writeMeshlets(int mesh_idx, const ImportConfig& cfg);
 	int getAttributeCount(const ImportMesh& mesh, const ImportConfig& cfg) const;
 	bool areIndices16Bit(const ImportMesh& mesh, const ImportConfig& cfg) const;
 	void writeModelHeader();
@@ -46,6 +46,7 @@ struct GUIInterface : GUISystem::Interface
 
 GameView::GameView(StudioApp& app)
 	: m_app(app)
+	, m_render_throttle(app)
 	, m_is_open(false)
 	, m_is_fullscreen(false)
 	, m_is_mouse_captured(false)
@@ -222,6 +223,11 @@ void GameView::onStatsGUI(const ImVec2& view_pos)
 		char buf[30];
 		toCStringPretty(stats.triangle_count, Span(buf));
 		ImGui::LabelText("Triangles", "%s", buf);
+		const Pipeline::OcclusionStats& occlusion = m_pipeline->getOcclusionStats();
+		if (occlusion.occluder_count > 0) {
+			ImGui::LabelText("Occluders", "%d, %d triangles", occlusion.occluder_count, occlusion.occluder_triangle_count);
+			ImGui::LabelText("Occluded", "%d meshes, %d cells", occlusion.occluded_meshes, occlusion.occluded_pages);
+		}
 		ImGui::LabelText("Resolution", "%dx%d", (int)m_size.x, (int)m_size.y);
 	}
 	ImGui::End();
@@ -335,7 +341,12 @@ void GameView::onWindowGUI()
 				vp.rot = Quat(0, 0, 0, 1);
 			}
 			m_pipeline->setViewport(vp);
-			m_pipeline->render(false);
+			m_render_throttle.setViewport(vp);
+			const bool is_game_mode = m_app.getWorldEditor().isGameMode();
+			if (is_game_mode) m_render_throttle.invalidate();
+			if (m_render_throttle.shouldRender(is_game_mode || ImGui::IsWindowFocused() || ImGui::IsWindowHovered())) {
+				m_pipeline->render(false);
+			}
 			const gpu::TextureHandle texture_handle = m_pipeline->getOutput();
 
 			if (texture_handle) {
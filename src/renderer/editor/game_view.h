@@ -56,6 +56,8 @@ private:
 
 private:
 	UniquePtr<Pipeline> m_pipeline;
+	// full rate in game mode, on demand while editing
+	RenderThrottle m_render_throttle;
 	StudioApp& m_app;
 	float m_time_multiplier;
 	Vec2 m_pos = Vec2(0);
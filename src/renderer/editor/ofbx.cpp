@@ -1655,6 +1655,8 @@ struct Scene : IScene
 	std::vector<AnimationStack*> m_animation_stacks;
 	std::vector<Connection> m_connections;
 	std::vector<u8> m_data;
+	// arrays decompressed in load, see decompressArrays
+	std::vector<u8> m_decompressed;
 	std::vector<TakeInfo> m_take_infos;
 	std::vector<Video> m_videos;
 	Allocator m_allocator;
@@ -3584,6 +3586,97 @@ Object* Object::getParent() const
 }
 
 
+struct DecompressJob
+{
+	Property* property;
+	u8* out;
+	u32 out_size; // including header
+	bool is_error;
+};
+
+
+// phase between tokenize and parsing of objects, all compressed arrays are inflated in parallel
+// properties are then pointed to uncompressed copies, so parseArrayRaw just memcpy's them
+static void decompressArrays(Element& root, Scene& scene, JobProcessor job_processor, void* job_user_ptr)
+{
+	std::vector<DecompressJob> jobs;
+	std::vector<Element*> stack;
+	size_t total_size = 0;
+	stack.push_back(&root);
+	while (!stack.empty())
+	{
+		Element* element = stack.back();
+		stack.pop_back();
+		if (element->sibling) stack.push_back(element->sibling);
+		if (element->child) stack.push_back(element->child);
+
+		for (Property* prop = element->first_property; prop; prop = prop->next)
+		{
+			u32 elem_size;
+			switch (prop->type)
+			{
+				case 'l': elem_size = 8; break;
+				case 'd': elem_size = 8; break;
+				case 'f': elem_size = 4; break;
+				case 'i': elem_size = 4; break;
+				default: continue;
+			}
+			if (prop->value.begin + sizeof(u32) * 3 > prop->value.end) continue;
+			u32 enc;
+			memcpy(&enc, prop->value.begin + 4, sizeof(enc));
+			if (enc != 1) continue;
+
+			const u32 count = (u32)prop->getCount();
+			DecompressJob job;
+			job.property = prop;
+			job.out = nullptr;
+			job.out_size = sizeof(u32) * 3 + count * elem_size;
+			job.is_error = false;
+			jobs.push_back(job);
+			total_size += (job.out_size + 7) & ~7;
+		}
+	}
+	if (jobs.empty()) return;
+
+	scene.m_decompressed.resize(total_size);
+	u8* out = &scene.m_decompressed[0];
+	for (DecompressJob& job : jobs)
+	{
+		job.out = out;
+		out += (job.out_size + 7) & ~7;
+	}
+
+	(*job_processor)([](void* ptr){
+		DecompressJob* job = (DecompressJob*)ptr;
+		const Property& prop = *job->property;
+		u32 len;
+		memcpy(&len, prop.value.begin + 8, sizeof(len));
+		const u8* data = prop.value.begin + sizeof(u32) * 3;
+		if (data + len > prop.value.end)
+		{
+			job->is_error = true;
+			return;
+		}
+		job->is_error = !decompress(data, len, job->out + sizeof(u32) * 3, job->out_size - sizeof(u32) * 3);
+	}, job_user_ptr, &jobs[0], (u32)sizeof(jobs[0]), (u32)jobs.size());
+
+	for (DecompressJob& job : jobs)
+	{
+		// invalid arrays are left as they are, it's an error only if they are used
+		if (job.is_error) continue;
+
+		const u32 count = (u32)job.property->getCount();
+		const u32 enc = 0;
+		const u32 len = job.out_size - sizeof(u32) * 3;
+		memcpy(job.out, &count, sizeof(count));
+		memcpy(job.out + 4, &enc, sizeof(enc));
+		memcpy(job.out + 8, &len, sizeof(len));
+		job.property->value.begin = job.out;
+		job.property->value.end = job.out + job.out_size;
+	}
+}
+
+
 IScene* load(const u8* data, int size, u64 flags, JobProcessor job_processor, void* job_user_ptr)
 {
 	std::unique_ptr<Scene> scene(new Scene());
@@ -3613,6 +3706,7 @@ IScene* load(const u8* data, int size, u64 flags, JobProcessor job_processor, vo
 
 	scene->m_root_element = root.getValue();
 	assert(scene->m_root_element);
+	if (is_binary) decompressArrays(*root.getValue(), *scene, job_processor ? job_processor : &sync_job_processor, job_user_ptr);
 
 	// if (parseTemplates(*root.getValue()).isError()) return nullptr;
 	if (!parseConnections(*root.getValue(), scene.get())) return nullptr;
@@ -33,9 +33,11 @@
 #include "engine/profiler.h"
 #include "engine/queue.h"
 #include "engine/resource_manager.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "fbx_importer.h"
 #include "game_view.h"
+#include "renderer/bc_encoder.h"
 #include "renderer/culling_system.h"
 #include "renderer/editor/composite_texture.h"
 #include "renderer/font.h"
@@ -49,6 +51,7 @@
 #include "renderer/shader.h"
 #include "renderer/texture.h"
 #include "scene_view.h"
+#include "static_batches.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_resize.h"
 #include "terrain_editor.h"
@@ -74,8 +77,16 @@ static const ComponentType FUR_TYPE = reflection::getComponentType("fur");
 
 namespace TextureCompressor {
 
+enum class Quality : u32 {
+	FAST,
+	NORMAL,
+	// BC7 instead of BC1/BC3
+	HIGH
+};
+
 struct Options {
 	bool compress = true;
+	Quality quality = Quality::NORMAL;
 	bool generate_mipmaps = false;
 	bool stochastic_mipmap = false;
 	float scale_coverage_ref = -0.5f;
@@ -214,7 +225,11 @@ static void computeMip(Span<const u8> src, Span<u8> dst, u32 w, u32 h, u32 dst_w
 	}
 }
 
-static void compressBC1(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h) {
+static u32 getRGBCXLevel(Quality quality) {
+	return quality == Quality::FAST ? 0 : 10;
+}
+
+static void compressBC1(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
 	PROFILE_FUNCTION();
 	
 	const u32 dst_block_size = 8;
@@ -239,17 +254,17 @@ static void compressBC1(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32
 
 			const u32 bi = i >> 2;
 			const u32 bj = j >> 2;
-			rgbcx::encode_bc1(10, &out[(bi + bj * ((w + 3) >> 2)) * dst_block_size], (const u8*)tmp, true, false);
+			rgbcx::encode_bc1(getRGBCXLevel(options.quality), &out[(bi + bj * ((w + 3) >> 2)) * dst_block_size], (const u8*)tmp, true, false);
 		}
 	});
 }
 
-static void compressRGBA(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h) {
+static void compressRGBA(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
 	PROFILE_FUNCTION();
 	dst.write(src.begin(), src.length());
 }
 
-static void compressBC5(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h) {
+static void compressBC5(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
 	PROFILE_FUNCTION();
 	
 	const u32 dst_block_size = 16;
@@ -279,7 +294,7 @@ static void compressBC5(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32
 	});
 }
 
-static void compressBC3(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h) {
+static void compressBC3(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
 	PROFILE_FUNCTION();
 	
 	const u32 dst_block_size = 16;
@@ -304,7 +319,70 @@ static void compressBC3(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32
 
 			const u32 bi = i >> 2;
 			const u32 bj = j >> 2;
-			rgbcx::encode_bc3(10, &out[(bi + bj * ((w + 3) >> 2)) * dst_block_size], (const u8*)tmp);
+			rgbcx::encode_bc3(getRGBCXLevel(options.quality), &out[(bi + bj * ((w + 3) >> 2)) * dst_block_size], (const u8*)tmp);
+		}
+	});
+}
+
+static void compressBC7(Span<const u8> src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
+	PROFILE_FUNCTION();
+	
+	const u32 dst_block_size = 16;
+	const u32 size = getCompressedMipSize(w, h, dst_block_size);
+	const u64 offset = dst.size();
+	dst.resize(offset + size);
+	u8* out = dst.getMutableData() + offset;
+	const u32 refine_iterations = options.quality == Quality::HIGH ? 3 : 1;
+
+	jobs::forEach(h, 4, [&](i32 j, i32){
+		PROFILE_FUNCTION();
+		u32 tmp[16];
+		const u8* src_row_begin = &src[j * w * 4];
+
+		const u32 src_block_h = minimum(h - j, 4);
+		for (u32 i = 0; i < w; i += 4) {
+			const u8* src_block_begin = src_row_begin + i * 4;
+			
+			const u32 src_block_w = minimum(w - i, 4);
+			for (u32 jj = 0; jj < src_block_h; ++jj) {
+				memcpy(&tmp[jj * 4], &src_block_begin[jj * w * 4], 4 * src_block_w);
+			}
+
+			const u32 bi = i >> 2;
+			const u32 bj = j >> 2;
+			BCEncoder::encodeBC7(&out[(bi + bj * ((w + 3) >> 2)) * dst_block_size], (const u8*)tmp, refine_iterations);
+		}
+	});
+}
+
+// `src` is w * h linear RGBA floats, alpha is ignored
+static void compressBC6H(const Vec4* src, OutputMemoryStream& dst, u32 w, u32 h, const Options& options) {
+	PROFILE_FUNCTION();
+	ASSERT(w % 4 == 0 && h % 4 == 0);
+	
+	const u32 dst_block_size = 16;
+	const u32 size = getCompressedMipSize(w, h, dst_block_size);
+	const u64 offset = dst.size();
+	dst.resize(offset + size);
+	u8* out = dst.getMutableData() + offset;
+	const u32 refine_iterations = options.quality == Quality::FAST ? 0 : options.quality == Quality::HIGH ? 3 : 1;
+
+	jobs::forEach(h, 4, [&](i32 j, i32){
+		PROFILE_FUNCTION();
+		float tmp[16 * 3];
+		for (u32 i = 0; i < w; i += 4) {
+			for (u32 jj = 0; jj < 4; ++jj) {
+				for (u32 ii = 0; ii < 4; ++ii) {
+					const Vec4& p = src[i + ii + (j + jj) * w];
+					tmp[(ii + jj * 4) * 3 + 0] = p.x;
+					tmp[(ii + jj * 4) * 3 + 1] = p.y;
+					tmp[(ii + jj * 4) * 3 + 2] = p.z;
+				}
+			}
+
+			const u32 bi = i >> 2;
+			const u32 bj = j >> 2;
+			BCEncoder::encodeBC6H(&out[(bi + bj * (w >> 2)) * dst_block_size], tmp, refine_iterations);
 		}
 	});
 }
@@ -357,10 +435,9 @@ static void scaleCoverage(Span<u8> data, u32 w, u32 h, float ref_norm, float wan
 	}
 }
 
-static void compress(void (*compressor)(Span<const u8>, OutputMemoryStream&, u32, u32), const Input& src_data, const Options& options, OutputMemoryStream& dst, IAllocator& allocator) {
+static void compress(void (*compressor)(Span<const u8>, OutputMemoryStream&, u32, u32, const Options&), u32 block_size, const Input& src_data, const Options& options, OutputMemoryStream& dst, IAllocator& allocator) {
 	const u32 mips = options.generate_mipmaps ? 1 + log2(maximum(src_data.w, src_data.h)) : src_data.mips;
 	const u32 faces = src_data.is_cubemap ? 6 : 1;
-	const u32 block_size = src_data.has_alpha || src_data.is_normalmap ? 16 : 8;
 	const u32 total_compressed_size = getCompressedSize(src_data.w, src_data.h, mips, faces, block_size);
 	dst.reserve(dst.size() + total_compressed_size);
 	Array<u8> mip_data(allocator);
@@ -378,7 +455,7 @@ static void compress(void (*compressor)(Span<const u8>, OutputMemoryStream&, u32
 				if (options.generate_mipmaps) {
 					if (mip == 0) {
 						const Input::Image& src_mip = src_data.get(face, slice, mip);
-						compressor(src_mip.pixels, dst, mip_w, mip_h);
+						compressor(src_mip.pixels, dst, mip_w, mip_h, options);
 					}
 					else {
 						mip_data.resize(mip_w * mip_h * 4);
@@ -388,13 +465,13 @@ static void compress(void (*compressor)(Span<const u8>, OutputMemoryStream&, u32
 						if (options.scale_coverage_ref >= 0.f) {
 							scaleCoverage(mip_data, mip_w, mip_h, options.scale_coverage_ref, coverage);
 						}
-						compressor(mip_data, dst, mip_w, mip_h);
+						compressor(mip_data, dst, mip_w, mip_h, options);
 						prev_mip.swap(mip_data);
 					}
 				}
 				else {
 					const Input::Image& src_mip = src_data.get(face, slice, mip);
-					compressor(src_mip.pixels, dst, mip_w, mip_h);
+					compressor(src_mip.pixels, dst, mip_w, mip_h, options);
 				}
 			}
 		}
@@ -425,22 +502,36 @@ static bool isValid(const Input& src_data, const Options& options) {
 	const bool can_compress = options.compress && (src_data.w % 4) == 0 && (src_data.h % 4) == 0;
 	if (!can_compress) format = gpu::TextureFormat::RGBA8;
 	else if (src_data.is_normalmap) format = gpu::TextureFormat::BC5;
+	else if (options.quality == Quality::HIGH) format = gpu::TextureFormat::BC7;
 	else if (src_data.has_alpha) format = gpu::TextureFormat::BC3;
 	else format = gpu::TextureFormat::BC1;
 		
 	writeLBCHeader(dst, src_data.w, src_data.h, src_data.slices, mips, format, false, src_data.is_cubemap);
 
-	if (!can_compress) {
-		compress(compressRGBA, src_data, options, dst, allocator);
-	}
-	if (src_data.is_normalmap) {
-		compress(compressBC5, src_data, options, dst, allocator);
+	switch (format) {
+		case gpu::TextureFormat::RGBA8: compress(compressRGBA, 16, src_data, options, dst, allocator); break;
+		case gpu::TextureFormat::BC5: compress(compressBC5, 16, src_data, options, dst, allocator); break;
+		case gpu::TextureFormat::BC7: compress(compressBC7, 16, src_data, options, dst, allocator); break;
+		case gpu::TextureFormat::BC3: compress(compressBC3, 16, src_data, options, dst, allocator); break;
+		case gpu::TextureFormat::BC1: compress(compressBC1, 8, src_data, options, dst, allocator); break;
+		default: ASSERT(false); return false;
 	}
-	else if (src_data.has_alpha) {
-		compress(compressBC3, src_data, options, dst, allocator);
-	}
-	else {
-		compress(compressBC1, src_data, options, dst, allocator);
+	return true;
+}
+
+// HDR cubemap, `data` are all faces of mip 0, then all faces of mip 1, ...
+[[nodiscard]] static bool compressCubemapBC6H(const Vec4* data, u32 size, u32 mips, const Options& options, OutputMemoryStream& dst) {
+	PROFILE_FUNCTION();
+	if ((size >> (mips - 1)) % 4 != 0) return false;
+
+	writeLBCHeader(dst, size, size, 1, mips, gpu::TextureFormat::BC6H, false, true);
+	for (u32 face = 0; face < 6; ++face) {
+		const Vec4* mip_pixels = data;
+		for (u32 mip = 0; mip < mips; ++mip) {
+			const u32 mip_size = size >> mip;
+			compressBC6H(mip_pixels + face * mip_size * mip_size, dst, mip_size, mip_size, options);
+			mip_pixels += mip_size * mip_size * 6;
+		}
 	}
 	return true;
 }
@@ -773,11 +864,175 @@ struct MaterialPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return true;
 	}
 
+	// state of the source material, collected by running it with recording versions of functions from material.cpp
+	struct CompiledMaterial {
+		CompiledMaterial(IAllocator& allocator) : defines(allocator), flags(allocator), textures(allocator), uniforms(allocator) {}
+
+		Path path;
+		StaticString<LUMIX_MAX_PATH> shader;
+		StaticString<64> layer;
+		bool backface_culling = true;
+		Vec4 color = Vec4(1);
+		float roughness = 1;
+		float metallic = 0;
+		float emission = 0;
+		float translucency = 0;
+		u32 defines_count = 0;
+		u32 flags_count = 0;
+		u32 textures_count = 0;
+		u32 uniforms_count = 0;
+		OutputMemoryStream defines;
+		OutputMemoryStream flags;
+		OutputMemoryStream textures;
+		OutputMemoryStream uniforms;
+	};
+
+	static CompiledMaterial* getMaterial(lua_State* L) {
+		return (CompiledMaterial*)lua_touserdata(L, lua_upvalueindex(1));
+	}
+
+	static void addTexture(CompiledMaterial& m, const char* path, bool keep_data) {
+		// same as LuaAPI::texture, relative paths are relative to material's dir
+		StaticString<LUMIX_MAX_PATH> texture_path;
+		if (path[0] != '/' && path[0] != '\\' && path[0] != '\0') {
+			texture_path.add(Path::getDir(m.path.c_str()));
+		}
+		texture_path.add(path);
+		m.textures.writeString(texture_path);
+		m.textures.write(u8(keep_data ? 1 : 0));
+		++m.textures_count;
+	}
+
+	static void addUniform(lua_State* L, bool is_int) {
+		CompiledMaterial& m = *getMaterial(L);
+		const char* name = LuaWrapper::checkArg<const char*>(L, 1);
+		float value[16];
+		u8 size = 0;
+		if (is_int) {
+			const i32 v = LuaWrapper::checkArg<i32>(L, 2);
+			memcpy(value, &v, sizeof(v));
+			size = sizeof(v);
+		}
+		else if (lua_type(L, 2) == LUA_TNUMBER) {
+			value[0] = LuaWrapper::toType<float>(L, 2);
+			size = sizeof(float);
+		}
+		else if (lua_istable(L, 2)) {
+			const u32 len = (u32)lua_objlen(L, 2);
+			if (len != 2 && len != 3 && len != 4 && len != 16) luaL_error(L, "Uniform %s has unsupported type", name);
+			for (u32 i = 0; i < len; ++i) {
+				lua_rawgeti(L, 2, i + 1);
+				value[i] = (float)lua_tonumber(L, -1);
+				lua_pop(L, 1);
+			}
+			size = u8(len * sizeof(float));
+		}
+		else {
+			luaL_error(L, "Uniform %s has unsupported type", name);
+		}
+		m.uniforms.write(crc32(name));
+		m.uniforms.write(size);
+		m.uniforms.write(value, size);
+		++m.uniforms_count;
+	}
+
+	// .mat is lua, it's compiled to binary Material::CompiledHeader form, so it does not need a lua state to load
 	bool compile(const Path& src) override
 	{
-		return m_app.getAssetCompiler().copyCompile(src);
+		IAllocator& allocator = m_app.getAllocator();
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		OutputMemoryStream content(allocator);
+		if (!fs.getContentSync(src, content)) {
+			logError("Failed to read ", src);
+			return false;
+		}
+
+		CompiledMaterial material(allocator);
+		material.path = src;
+		lua_State* L = luaL_newstate();
+		auto reg = [&](const char* name, lua_CFunction f){
+			lua_pushlightuserdata(L, &material);
+			lua_pushcclosure(L, f, 1);
+			lua_setfield(L, LUA_GLOBALSINDEX, name);
+		};
+
+		reg("alpha_ref", [](lua_State* L) -> int { return 0; });
+		reg("backface_culling", [](lua_State* L) -> int { getMaterial(L)->backface_culling = LuaWrapper::checkArg<bool>(L, 1); return 0; });
+		reg("color", [](lua_State* L) -> int { getMaterial(L)->color = LuaWrapper::checkArg<Vec4>(L, 1); return 0; });
+		reg("emission", [](lua_State* L) -> int { getMaterial(L)->emission = LuaWrapper::checkArg<float>(L, 1); return 0; });
+		reg("translucency", [](lua_State* L) -> int { getMaterial(L)->translucency = LuaWrapper::checkArg<float>(L, 1); return 0; });
+		reg("layer", [](lua_State* L) -> int { getMaterial(L)->layer = LuaWrapper::checkArg<const char*>(L, 1); return 0; });
+		reg("metallic", [](lua_State* L) -> int { getMaterial(L)->metallic = LuaWrapper::checkArg<float>(L, 1); return 0; });
+		reg("roughness", [](lua_State* L) -> int { getMaterial(L)->roughness = LuaWrapper::checkArg<float>(L, 1); return 0; });
+		reg("shader", [](lua_State* L) -> int { getMaterial(L)->shader = LuaWrapper::checkArg<const char*>(L, 1); return 0; });
+		reg("uniform", [](lua_State* L) -> int { addUniform(L, false); return 0; });
+		reg("int_uniform", [](lua_State* L) -> int { addUniform(L, true); return 0; });
+		reg("custom_flag", [](lua_State* L) -> int {
+			CompiledMaterial& m = *getMaterial(L);
+			m.flags.writeString(LuaWrapper::checkArg<const char*>(L, 1));
+			++m.flags_count;
+			return 0;
+		});
+		reg("defines", [](lua_State* L) -> int {
+			CompiledMaterial& m = *getMaterial(L);
+			LuaWrapper::forEachArrayItem<const char*>(L, 1, "array of strings expected", [&](const char* v){
+				m.defines.writeString(v);
+				++m.defines_count;
+			});
+			return 0;
+		});
+		reg("texture", [](lua_State* L) -> int {
+			CompiledMaterial& m = *getMaterial(L);
+			if (!lua_istable(L, 1)) {
+				addTexture(m, LuaWrapper::checkArg<const char*>(L, 1), false);
+				return 0;
+			}
+			lua_getfield(L, 1, "source");
+			if (!lua_isstring(L, -1)) {
+				lua_pop(L, 1);
+				logError(m.path, " texture's source is not a string.");
+				return 0;
+			}
+			char path[LUMIX_MAX_PATH];
+			copyString(Span(path), lua_tostring(L, -1));
+			lua_pop(L, 1);
+			bool keep_data = false;
+			LuaWrapper::getOptionalField(L, 1, "keep_data", &keep_data);
+			addTexture(m, path, keep_data);
+			return 0;
+		});
+
+		const bool executed = LuaWrapper::execute(L, Span((const char*)content.data(), (u32)content.size()), src.c_str(), 0);
+		lua_close(L);
+		if (!executed) return false;
+		if (material.shader.empty()) {
+			logError("Material ", src, " does not have a shader.");
+			return false;
+		}
+
+		OutputMemoryStream blob(allocator);
+		blob.write(Material::CompiledHeader());
+		blob.writeString(material.shader);
+		blob.writeString(material.layer);
+		blob.write(material.backface_culling);
+		blob.write(material.color);
+		blob.write(material.roughness);
+		blob.write(material.metallic);
+		blob.write(material.emission);
+		blob.write(material.translucency);
+		blob.write(material.defines_count);
+		blob.write(material.defines.data(), material.defines.size());
+		blob.write(material.flags_count);
+		blob.write(material.flags.data(), material.flags.size());
+		blob.write(material.textures_count);
+		blob.write(material.textures.data(), material.textures.size());
+		blob.write(material.uniforms_count);
+		blob.write(material.uniforms.data(), material.uniforms.size());
+		return m_app.getAssetCompiler().writeCompiledResource(src.c_str(), Span(blob.data(), (u32)blob.size()));
 	}
 
+	u32 getVersion() const override { return 1; }
+
 
 	void saveMaterial(Material* material)
 	{
@@ -1122,6 +1377,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		float scale_coverage = -0.5f;
 		bool stochastic_mipmap = false;
 		bool compress = true;
+		TextureCompressor::Quality quality = TextureCompressor::Quality::NORMAL;
 		WrapMode wrap_mode_u = WrapMode::REPEAT;
 		WrapMode wrap_mode_v = WrapMode::REPEAT;
 		WrapMode wrap_mode_w = WrapMode::REPEAT;
@@ -1131,6 +1387,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	explicit TexturePlugin(StudioApp& app)
 		: m_app(app)
 		, m_composite(app.getAllocator())
+		, m_tile_jobs(app.getAllocator())
 	{
 		app.getAssetCompiler().registerExtension("png", Texture::TYPE);
 		app.getAssetCompiler().registerExtension("jpeg", Texture::TYPE);
@@ -1142,6 +1399,9 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 
 	~TexturePlugin() {
+		jobs::wait(m_tile_signal);
+		for (TextureTileJob* job : m_tile_jobs) LUMIX_DELETE(m_app.getAllocator(), job);
+
 		PluginManager& plugin_manager = m_app.getEngine().getPluginManager();
 		auto* renderer = (Renderer*)plugin_manager.getPlugin("renderer");
 		if(m_texture_view) {
@@ -1224,10 +1484,13 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			PROFILE_FUNCTION();
 			TextureTileJob* that = (TextureTileJob*)data;
 			that->execute();
+			i32 volatile* in_flight = that->m_in_flight;
 			LUMIX_DELETE(that->m_allocator, that);
+			atomicDecrement(in_flight);
 		}
 
 		StudioApp& m_app;
+		i32 volatile* m_in_flight = nullptr;
 		IAllocator& m_allocator;
 		FileSystem& m_filesystem;
 		StaticString<LUMIX_MAX_PATH> m_in_path; 
@@ -1245,14 +1508,26 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			job->m_in_path << in_path;
 			job->m_out_path = fs.getBasePath();
 			job->m_out_path << out_path;
-			jobs::SignalHandle signal = jobs::INVALID_HANDLE;
-			jobs::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, jobs::getWorkersCount() - 1);
-			m_tile_signal = signal;
+			job->m_in_flight = &m_tile_jobs_in_flight;
+			m_tile_jobs.push(job);
 			return true;
 		}
 		return false;
 	}
 
+
+	// tiles are created on all workers, but only few at once, so the rest of the editor is not starved
+	// the newest requests go first, they are the ones visible in asset browser
+	void update() override {
+		const i32 max_in_flight = maximum(1, (i32)jobs::getWorkersCount() - 1);
+		while (!m_tile_jobs.empty() && m_tile_jobs_in_flight < max_in_flight) {
+			TextureTileJob* job = m_tile_jobs.back();
+			m_tile_jobs.pop();
+			atomicIncrement(&m_tile_jobs_in_flight);
+			jobs::run(job, &TextureTileJob::execute, &m_tile_signal, jobs::Priority::LOW);
+		}
+	}
+
 	bool createComposite(const OutputMemoryStream& src_data, OutputMemoryStream& dst, const Meta& meta, const char* src_path) {
 		IAllocator& allocator = m_app.getAllocator();
 		CompositeTexture tc(allocator);
@@ -1428,6 +1703,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			options.stochastic_mipmap = meta.stochastic_mipmap; 
 			options.scale_coverage_ref = meta.scale_coverage;
 			options.compress = meta.compress;
+			options.quality = meta.quality;
 			const bool res = TextureCompressor::compress(input, options, dst, m_app.getAllocator());
 			stbi_image_free(data);
 			return res;
@@ -1450,6 +1726,11 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "normalmap", &meta.is_normalmap);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "mips", &meta.mips);
 			char tmp[32];
+			if(LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "quality", Span(tmp))) {
+				if (equalIStrings(tmp, "fast")) meta.quality = TextureCompressor::Quality::FAST;
+				else if (equalIStrings(tmp, "high")) meta.quality = TextureCompressor::Quality::HIGH;
+				else meta.quality = TextureCompressor::Quality::NORMAL;
+			}
 			if(LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "filter", Span(tmp))) {
 				if (equalIStrings(tmp, "point")) {
 					meta.filter = Meta::Filter::POINT;
@@ -1523,6 +1804,15 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		}
 	}
 
+	const char* toString(TextureCompressor::Quality quality) {
+		switch (quality) {
+			case TextureCompressor::Quality::FAST: return "fast";
+			case TextureCompressor::Quality::NORMAL: return "normal";
+			case TextureCompressor::Quality::HIGH: return "high";
+			default: ASSERT(false); return "normal";
+		}
+	}
+
 	const char* toString(Meta::WrapMode wrap) {
 		switch (wrap) {
 			case Meta::WrapMode::CLAMP: return "clamp";
@@ -1689,6 +1979,13 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			case gpu::TextureFormat::R32F: format = "R32F"; break;
 			case gpu::TextureFormat::SRGB: format = "SRGB"; break;
 			case gpu::TextureFormat::SRGBA: format = "SRGBA"; break;
+			case gpu::TextureFormat::BC1: format = "BC1"; break;
+			case gpu::TextureFormat::BC2: format = "BC2"; break;
+			case gpu::TextureFormat::BC3: format = "BC3"; break;
+			case gpu::TextureFormat::BC4: format = "BC4"; break;
+			case gpu::TextureFormat::BC5: format = "BC5"; break;
+			case gpu::TextureFormat::BC6H: format = "BC6H"; break;
+			case gpu::TextureFormat::BC7: format = "BC7"; break;
 			default: ASSERT(false); break;
 		}
 		ImGuiEx::Label("Format");
@@ -1744,6 +2041,10 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			if (m_meta.compress && (texture->width % 4 != 0 || texture->height % 4 != 0)) {
 				ImGui::TextUnformatted(ICON_FA_EXCLAMATION_TRIANGLE " Block compression will not be used because texture size is not multiple of 4");
 			}
+			if (m_meta.compress) {
+				ImGuiEx::Label("Quality");
+				ImGui::Combo("##cmpqual", (int*)&m_meta.quality, "Fast\0Normal\0High (BC7)\0");
+			}
 
 			bool scale_coverage = m_meta.scale_coverage >= 0;
 			ImGuiEx::Label("Mipmap scale coverage");
@@ -1769,6 +2070,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			if (ImGui::Button(ICON_FA_CHECK "Apply")) {
 				const StaticString<512> src("srgb = ", m_meta.srgb ? "true" : "false"
 					, "\ncompress = ", m_meta.compress ? "true" : "false"
+					, "\nquality = \"", toString(m_meta.quality), "\""
 					, "\nstochastic_mip = ", m_meta.stochastic_mipmap ? "true" : "false"
 					, "\nmip_scale_coverage = ", m_meta.scale_coverage
 					, "\nmips = ", m_meta.mips ? "true" : "false"
@@ -1793,6 +2095,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	Texture* m_texture;
 	gpu::TextureHandle m_texture_view = gpu::INVALID_TEXTURE;
 	jobs::SignalHandle m_tile_signal = jobs::INVALID_HANDLE;
+	Array<TextureTileJob*> m_tile_jobs;
+	i32 volatile m_tile_jobs_in_flight = 0;
 	Meta m_meta;
 	u32 m_meta_res = 0;
 	CompositeTexture m_composite;
@@ -1873,6 +2177,10 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		bool force_skin = false;
 		bool import_vertex_colors = false;
 		bool bake_vertex_ao = false;
+		bool compress_animations = true;
+		float animation_error = 0.001f;
+		bool build_meshlets = true;
+		bool half_uvs = false;
 		float lods_distances[4] = { -1, -1, -1, -1 };
 		FBXImporter::ImportConfig::Origin origin = FBXImporter::ImportConfig::Origin::SOURCE;
 		FBXImporter::ImportConfig::Physics physics = FBXImporter::ImportConfig::Physics::NONE;
@@ -1885,6 +2193,9 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		, m_is_mouse_captured(false)
 		, m_tile(app.getAllocator())
 		, m_fbx_importer(app)
+		, m_impostor_importer(app)
+		, m_impostor_queue(app.getAllocator())
+		, m_preview_throttle(app)
 	{
 		app.getAssetCompiler().registerExtension("fbx", Model::TYPE);
 	}
@@ -1893,6 +2204,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	~ModelPlugin()
 	{
 		jobs::wait(m_subres_signal);
+		if (m_impostor_model) m_impostor_model->decRefCount();
 		auto& engine = m_app.getEngine();
 		engine.destroyUniverse(*m_universe);
 		m_pipeline.reset();
@@ -1908,6 +2220,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		m_viewport.near = 0.f;
 		m_viewport.far = 1000.f;
 		m_fbx_importer.init();
+		m_impostor_importer.init();
 	}
 
 
@@ -1925,6 +2238,10 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "create_impostor", &meta.create_impostor);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "import_vertex_colors", &meta.import_vertex_colors);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "bake_vertex_ao", &meta.bake_vertex_ao);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "compress_animations", &meta.compress_animations);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "animation_error", &meta.animation_error);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "build_meshlets", &meta.build_meshlets);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "half_uvs", &meta.half_uvs);
 
 			if (LuaWrapper::getField(L, LUA_GLOBALSINDEX, "position_error") != LUA_TNIL) logWarning(path, ": `position_error` deprecated");
 			if (LuaWrapper::getField(L, LUA_GLOBALSINDEX, "rotation_error") != LUA_TNIL) logWarning(path, ": `rotation_error` deprecated");
@@ -2000,6 +2317,9 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return *c != ':' ? str : c + 1;
 	}
 
+	// m_fbx_importer is shared
+	u32 getMaxConcurrency() const override { return 1; }
+
 	bool compile(const Path& src) override
 	{
 		ASSERT(Path::hasExtension(src.c_str(), "fbx"));
@@ -2012,10 +2332,22 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		cfg.physics = meta.physics;
 		cfg.import_vertex_colors = meta.import_vertex_colors;
 		cfg.bake_vertex_ao = meta.bake_vertex_ao;
+		cfg.compress_animations = meta.compress_animations;
+		cfg.animation_error = meta.animation_error;
+		cfg.build_meshlets = meta.build_meshlets;
+		cfg.half_uvs = meta.half_uvs;
 		memcpy(cfg.lods_distances, meta.lods_distances, sizeof(meta.lods_distances));
 		cfg.create_impostor = meta.create_impostor;
 		const PathInfo src_info(filepath);
 		m_fbx_importer.setSource(filepath, false, meta.force_skin);
+		if (cfg.create_impostor) {
+			for (const FBXImporter::ImportMesh& mesh : m_fbx_importer.getMeshes()) {
+				if (!mesh.is_skinned) continue;
+				logWarning(filepath, " is skinned, impostor is not created");
+				cfg.create_impostor = false;
+				break;
+			}
+		}
 		if (m_fbx_importer.getMeshes().empty() && m_fbx_importer.getAnimations().empty()) {
 			if (m_fbx_importer.getOFBXScene()) {
 				if (m_fbx_importer.getOFBXScene()->getMeshCount() > 0) {
@@ -2038,6 +2370,13 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		m_fbx_importer.writeMaterials(filepath, cfg);
 		m_fbx_importer.writeAnimations(filepath, cfg);
 		m_fbx_importer.writePhysics(filepath, cfg);
+
+		// impostor textures are captured from the compiled model on the main thread
+		const StaticString<LUMIX_MAX_PATH> impostor_path(src_info.m_dir, src_info.m_basename, "_impostor0.tga");
+		if (cfg.create_impostor && !m_app.getEngine().getFileSystem().fileExists(impostor_path)) {
+			MutexGuard lock(m_impostor_mutex);
+			m_impostor_queue.push(Path(filepath));
+		}
 		return true;
 	}
 
@@ -2106,6 +2445,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		if (render_scene->getModelInstanceModel((EntityRef)m_mesh) != &model)
 		{
 			render_scene->setModelInstancePath((EntityRef)m_mesh, model.getPath());
+			m_preview_throttle.invalidate();
 			AABB aabb = model.getAABB();
 
 			const Vec3 center = (aabb.max + aabb.min) * 0.5f;
@@ -2125,7 +2465,8 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		m_viewport.h = (int)image_size.y;
 		m_viewport.ortho_size = model.getCenterBoundingRadius();
 		m_pipeline->setViewport(m_viewport);
-		m_pipeline->render(false);
+		m_preview_throttle.setViewport(m_viewport);
+		if (m_preview_throttle.shouldRender(ImGui::IsWindowFocused() || ImGui::IsWindowHovered())) m_pipeline->render(false);
 		m_preview = m_pipeline->getOutput();
 		if (gpu::isOriginBottomLeft()) {
 			ImGui::Image(m_preview, image_size);
@@ -2203,6 +2544,74 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	}
 
 
+	void createImpostorTextures(FBXImporter& importer, Model& model, bool bake_normals) {
+		if (!importer.isImpostorShaderReady()) {
+			logError("Impostor shader is not ready, can not create impostor for ", model.getPath());
+			return;
+		}
+		IAllocator& allocator = m_app.getAllocator();
+		Array<u32> gb0(allocator); 
+		Array<u32> gb1(allocator); 
+		Array<u32> shadow(allocator); 
+		IVec2 tile_size;
+		importer.createImpostorTextures(&model, gb0, gb1, shadow, tile_size, bake_normals);
+		postprocessImpostor(gb0, gb1, tile_size, allocator);
+		const PathInfo fi(model.getPath().c_str());
+		StaticString<LUMIX_MAX_PATH> img_path(fi.m_dir, fi.m_basename, "_impostor0.tga");
+		ASSERT(gb0.size() == tile_size.x * 9 * tile_size.y * 9);
+		
+		os::OutputFile file;
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		if (fs.open(img_path, file)) {
+			Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb0.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
+			file.close();
+		}
+		else {
+			logError("Failed to open ", img_path);
+		}
+
+		if (!bake_normals) {
+			img_path = fi.m_dir;
+			img_path << fi.m_basename << "_impostor1.tga";
+			if (fs.open(img_path, file)) {
+				Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb1.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
+				file.close();
+			}
+			else {
+				logError("Failed to open ", img_path);
+			}
+		}
+
+		img_path = fi.m_dir;
+		img_path << fi.m_basename << "_impostor2.tga";
+		if (fs.open(img_path, file)) {
+			Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)shadow.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
+			file.close();
+		}
+		else {
+			logError("Failed to open ", img_path);
+		}
+	}
+
+	// models compiled with `create_impostor` and without impostor textures get them here
+	void processImpostorQueue() {
+		if (!m_impostor_model) {
+			MutexGuard lock(m_impostor_mutex);
+			if (m_impostor_queue.empty()) return;
+			m_impostor_model = m_app.getEngine().getResourceManager().load<Model>(m_impostor_queue.back());
+			m_impostor_queue.pop();
+		}
+
+		if (m_impostor_model->isEmpty()) return;
+		if (m_impostor_model->isReady()) {
+			if (!m_impostor_importer.isImpostorShaderReady()) return;
+			const Meta meta = getMeta(m_impostor_model->getPath());
+			createImpostorTextures(m_impostor_importer, *m_impostor_model, meta.bake_impostor_normals);
+		}
+		m_impostor_model->decRefCount();
+		m_impostor_model = nullptr;
+	}
+
 	static void postprocessImpostor(Array<u32>& gb0, Array<u32>& gb1, const IVec2& tile_size, IAllocator& allocator) {
 		struct Cell {
 			i16 x, y;
@@ -2466,6 +2875,29 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			ImGui::Checkbox("##vercol", &m_meta.import_vertex_colors);
 			ImGuiEx::Label("Bake vertex AO");
 			ImGui::Checkbox("##verao", &m_meta.bake_vertex_ao);
+			ImGuiEx::Label("Compress animations");
+			ImGui::Checkbox("##cmpanim", &m_meta.compress_animations);
+			ImGuiEx::Label("Animation error");
+			ImGui::Text("(?)");
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("%s", "Max error of bones' positions, in meters, caused by removing keyframes.");
+			}
+			ImGui::SameLine();
+			ImGui::InputFloat("##animerr", &m_meta.animation_error);
+			ImGuiEx::Label("Build meshlets");
+			ImGui::Text("(?)");
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("%s", "Big static meshes are split into clusters of triangles, which are culled on GPU.");
+			}
+			ImGui::SameLine();
+			ImGui::Checkbox("##meshlets", &m_meta.build_meshlets);
+			ImGuiEx::Label("Half float UVs");
+			ImGui::Text("(?)");
+			if (ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("%s", "Smaller vertices, but UVs far from [0, 1] lose precision.");
+			}
+			ImGui::SameLine();
+			ImGui::Checkbox("##half_uvs", &m_meta.half_uvs);
 			
 			ImGuiEx::Label("Physics");
 			if (ImGui::BeginCombo("##phys", toString(m_meta.physics))) {
@@ -2500,7 +2932,11 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 					.cat("\nculling_scale = ").cat(m_meta.culling_scale)
 					.cat("\nsplit = ").cat(m_meta.split ? "true\n" : "false\n")
 					.cat("\nimport_vertex_colors = ").cat(m_meta.import_vertex_colors ? "true\n" : "false\n")
-					.cat("\nbake_vertex_ao = ").cat(m_meta.bake_vertex_ao ? "true\n" : "false\n");
+					.cat("\nbake_vertex_ao = ").cat(m_meta.bake_vertex_ao ? "true\n" : "false\n")
+					.cat("\ncompress_animations = ").cat(m_meta.compress_animations ? "true\n" : "false\n")
+					.cat("\nanimation_error = ").cat(m_meta.animation_error).cat("\n")
+					.cat("\nbuild_meshlets = ").cat(m_meta.build_meshlets ? "true\n" : "false\n")
+					.cat("\nhalf_uvs = ").cat(m_meta.half_uvs ? "true\n" : "false\n");
 
 				for (u32 i = 0; i < lengthOf(m_meta.lods_distances); ++i) {
 					if (m_meta.lods_distances[i] > 0) {
@@ -2512,50 +2948,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			}
 			ImGui::SameLine();
 			if (ImGui::Button("Create impostor texture")) {
-				FBXImporter importer(m_app);
-				importer.init();
-				IAllocator& allocator = m_app.getAllocator();
-				Array<u32> gb0(allocator); 
-				Array<u32> gb1(allocator); 
-				Array<u32> shadow(allocator); 
-				IVec2 tile_size;
-				importer.createImpostorTextures(model, gb0, gb1, shadow, tile_size, m_meta.bake_impostor_normals);
-				postprocessImpostor(gb0, gb1, tile_size, allocator);
-				const PathInfo fi(model->getPath().c_str());
-				StaticString<LUMIX_MAX_PATH> img_path(fi.m_dir, fi.m_basename, "_impostor0.tga");
-				ASSERT(gb0.size() == tile_size.x * 9 * tile_size.y * 9);
-				
-				os::OutputFile file;
-				FileSystem& fs = m_app.getEngine().getFileSystem();
-				if (fs.open(img_path, file)) {
-					Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb0.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
-					file.close();
-				}
-				else {
-					logError("Failed to open ", img_path);
-				}
-
-				if (!m_meta.bake_impostor_normals) {
-					img_path = fi.m_dir;
-					img_path << fi.m_basename << "_impostor1.tga";
-					if (fs.open(img_path, file)) {
-						Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb1.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
-						file.close();
-					}
-					else {
-						logError("Failed to open ", img_path);
-					}
-				}
-
-				img_path = fi.m_dir;
-				img_path << fi.m_basename << "_impostor2.tga";
-				if (fs.open(img_path, file)) {
-					Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)shadow.begin(), gpu::isOriginBottomLeft(), Path(img_path), allocator);
-					file.close();
-				}
-				else {
-					logError("Failed to open ", img_path);
-				}
+				createImpostorTextures(m_impostor_importer, *model, m_meta.bake_impostor_normals);
 			}
 			ImGui::SameLine();
 			ImGui::TextDisabled("(?)");
@@ -2618,6 +3011,8 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 	void update() override
 	{
+		processImpostorQueue();
+
 		if (m_tile.waiting) {
 			if (!m_app.getEngine().getFileSystem().hasWork()) {
 				renderPrefabSecondStage();
@@ -2625,7 +3020,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			}
 		}
 		if (m_tile.frame_countdown >= 0) {
-			--m_tile.frame_countdown;
+			if (m_tile.readback_done) --m_tile.frame_countdown;
 			if (m_tile.frame_countdown == -1) {
 				destroyEntityRecursive(*m_tile.universe, (EntityRef)m_tile.entity);
 				Engine& engine = m_app.getEngine();
@@ -2761,17 +3156,27 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		renderer->copy(tile_tmp, m_tile.pipeline->getOutput());
 		renderer->downscale(tile_tmp, AssetBrowser::TILE_SIZE * 4, AssetBrowser::TILE_SIZE * 4, m_tile.texture, AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE);
 
-		renderer->getTextureImage(m_tile.texture
+		getTileImage(*renderer);
+		renderer->destroy(tile_tmp);
+	}
+
+
+	void onTileImageReady() { m_tile.readback_done = true; }
+
+	// does not block, update() saves the tile once the data are read
+	void getTileImage(Renderer& renderer) {
+		Delegate<void()> callback;
+		callback.bind<&ModelPlugin::onTileImageReady>(this);
+		m_tile.readback_done = false;
+		m_tile.frame_countdown = 0;
+		renderer.getTextureImageAsync(m_tile.texture
 			, AssetBrowser::TILE_SIZE
 			, AssetBrowser::TILE_SIZE
 			, gpu::TextureFormat::RGBA8
-			, Span(m_tile.data.getMutableData(), (u32)m_tile.data.size()));
-		renderer->destroy(tile_tmp);
-
-		m_tile.frame_countdown = 2;
+			, Span(m_tile.data.getMutableData(), (u32)m_tile.data.size())
+			, callback);
 	}
 
-
 	void renderTile(Material* material) {
 		if (material->getTextureCount() == 0) return;
 		const char* in_path = material->getTexture(0)->getPath().c_str();
@@ -2824,15 +3229,10 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		renderer->downscale(tile_tmp, AssetBrowser::TILE_SIZE * 4, AssetBrowser::TILE_SIZE * 4, m_tile.texture, AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE);
 
 		m_tile.data.resize(AssetBrowser::TILE_SIZE * AssetBrowser::TILE_SIZE * 4);
-		renderer->getTextureImage(m_tile.texture 
-			, AssetBrowser::TILE_SIZE
-			, AssetBrowser::TILE_SIZE
-			, gpu::TextureFormat::RGBA8
-			, Span(m_tile.data.getMutableData(), (u32)m_tile.data.size()));
+		getTileImage(*renderer);
 		
 		renderer->destroy(tile_tmp);
 		m_tile.entity = mesh_entity;
-		m_tile.frame_countdown = 2;
 		m_tile.path_hash = model->getPath().getHash();
 		model->decRefCount();
 	}
@@ -2871,6 +3271,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		UniquePtr<Pipeline> pipeline;
 		EntityPtr entity = INVALID_ENTITY;
 		int frame_countdown = -1;
+		bool readback_done = false;
 		u32 path_hash;
 		OutputMemoryStream data;
 		gpu::TextureHandle texture = gpu::INVALID_TEXTURE;
@@ -2885,12 +3286,18 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	Universe* m_universe;
 	Viewport m_viewport;
 	UniquePtr<Pipeline> m_pipeline;
+	RenderThrottle m_preview_throttle;
 	EntityPtr m_mesh = INVALID_ENTITY;
 	bool m_is_mouse_captured;
 	int m_captured_mouse_x;
 	int m_captured_mouse_y;
 	TexturePlugin* m_texture_plugin;
 	FBXImporter m_fbx_importer;
+	// m_fbx_importer is used by compile on worker threads, this one on the main thread
+	FBXImporter m_impostor_importer;
+	Mutex m_impostor_mutex;
+	Array<Path> m_impostor_queue;
+	Model* m_impostor_model = nullptr;
 	jobs::SignalHandle m_subres_signal = jobs::INVALID_HANDLE;
 };
 
@@ -3052,19 +3459,16 @@ struct ShaderPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	StudioApp& m_app;
 };
 
-template <typename F>
-void captureCubemap(StudioApp& app
+// renders one face of cubemap, `data` is filled asynchronously, `callback` is called from Renderer::frame once it's ready
+static void captureCubemapFace(Renderer& renderer
 	, Universe& universe
 	, Pipeline& pipeline
 	, const u32 texture_size
 	, const DVec3& position
-	, Array<Vec4>& data
-	, F&& f) {
-	memoryBarrier();
-
-	Engine& engine = app.getEngine();
-	auto& plugin_manager = engine.getPluginManager();
-
+	, u32 face
+	, Span<u8> data
+	, const Delegate<void()>& callback)
+{
 	Viewport viewport;
 	viewport.is_ortho = false;
 	viewport.fov = degreesToRadians(90.f);
@@ -3073,54 +3477,38 @@ void captureCubemap(StudioApp& app
 	viewport.w = texture_size;
 	viewport.h = texture_size;
 
-	pipeline.setUniverse(&universe);
-	pipeline.setViewport(viewport);
-
-	Renderer* renderer = static_cast<Renderer*>(plugin_manager.getPlugin("renderer"));
-	Vec3 dirs[] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
-	Vec3 ups[] = {{0, 1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, -1}, {0, 1, 0}, {0, 1, 0}};
-	Vec3 ups_opengl[] = { { 0, -1, 0 },{ 0, -1, 0 },{ 0, 0, 1 },{ 0, 0, -1 },{ 0, -1, 0 },{ 0, -1, 0 } };
-
-	data.resize(6 * texture_size * texture_size);
+	static const Vec3 dirs[] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+	static const Vec3 ups[] = {{0, 1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, -1}, {0, 1, 0}, {0, 1, 0}};
+	static const Vec3 ups_opengl[] = { { 0, -1, 0 },{ 0, -1, 0 },{ 0, 0, 1 },{ 0, 0, -1 },{ 0, -1, 0 },{ 0, -1, 0 } };
 
 	const bool ndc_bottom_left = gpu::isOriginBottomLeft();
-	for (int i = 0; i < 6; ++i) {
-		Vec3 side = cross(ndc_bottom_left ? ups_opengl[i] : ups[i], dirs[i]);
-		Matrix mtx = Matrix::IDENTITY;
-		mtx.setZVector(dirs[i]);
-		mtx.setYVector(ndc_bottom_left ? ups_opengl[i] : ups[i]);
-		mtx.setXVector(side);
-		viewport.pos = position;
-		viewport.rot = mtx.getRotation();
-		pipeline.setViewport(viewport);
-		pipeline.render(false);
-
-		const gpu::TextureHandle res = pipeline.getOutput();
-		ASSERT(res);
-		renderer->getTextureImage(res
-			, texture_size
-			, texture_size
-			, gpu::TextureFormat::RGBA32F
-			, Span((u8*)(data.begin() + (i * texture_size * texture_size)), u32(texture_size * texture_size * sizeof(*data.begin())))
-		);
-	}
-
-	struct RenderJob : Renderer::RenderJob {
-		RenderJob(F&& f) : f(f) {}
-
-		void setup() override {}
-		void execute() override {
-			f();
-		}
-		F f;
-	};
+	const Vec3 up = ndc_bottom_left ? ups_opengl[face] : ups[face];
+	Matrix mtx = Matrix::IDENTITY;
+	mtx.setZVector(dirs[face]);
+	mtx.setYVector(up);
+	mtx.setXVector(cross(up, dirs[face]));
+	viewport.pos = position;
+	viewport.rot = mtx.getRotation();
+
+	pipeline.setUniverse(&universe);
+	pipeline.setViewport(viewport);
+	pipeline.render(false);
 
-	RenderJob& rjob = renderer->createJob<RenderJob>(static_cast<F&&>(f));
-	renderer->queue(rjob, 0);
+	const gpu::TextureHandle res = pipeline.getOutput();
+	ASSERT(res);
+	renderer.getTextureImageAsync(res, texture_size, texture_size, gpu::TextureFormat::RGBA32F, data, callback);
 }
 
+// probes are baked in stages spread over frames:
+// 1. `m_faces_per_frame` faces are rendered each frame and read back asynchronously
+// 2. faces are flipped (and SH computed for environment probes) in a job
+// 3. reflection probes are prefiltered on GPU, mips are read back asynchronously
+// 4. filtered cubemap is compressed and saved in a job
+// live update refreshes one face of one probe per frame, probes are updated round robin
 struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 {
+	static constexpr u32 ROUGHNESS_LEVELS = 5;
+
 	explicit EnvironmentProbePlugin(StudioApp& app)
 		: m_app(app)
 		, m_probes(app.getAllocator())
@@ -3130,17 +3518,18 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 
 	~EnvironmentProbePlugin()
 	{
+		if (m_live_job) LUMIX_DELETE(m_app.getAllocator(), m_live_job);
 		m_ibl_filter_shader->decRefCount();
 	}
 
 	void init() {
 		Engine& engine = m_app.getEngine();
 		PluginManager& plugin_manager = engine.getPluginManager();
-		Renderer* renderer = static_cast<Renderer*>(plugin_manager.getPlugin("renderer"));
+		m_renderer = static_cast<Renderer*>(plugin_manager.getPlugin("renderer"));
 		IAllocator& allocator = m_app.getAllocator();
 		ResourceManagerHub& rm = engine.getResourceManager();
 		PipelineResource* pres = rm.load<PipelineResource>(Path("pipelines/main.pln"));
-		m_pipeline = Pipeline::create(*renderer, pres, "PROBE", allocator);
+		m_pipeline = Pipeline::create(*m_renderer, pres, "PROBE", allocator);
 		m_ibl_filter_shader = rm.load<Shader>(Path("pipelines/ibl_filter.shd"));
 	}
 
@@ -3158,27 +3547,10 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		path << probe_guid << ".lbc";
 
 		OutputMemoryStream blob(m_app.getAllocator());
-
-		const Vec4* mip_pixels = data;
-		TextureCompressor::Input input(texture_size, texture_size, 1, mips_count, m_app.getAllocator());
-		for (u32 mip = 0; mip < mips_count; ++mip) {
-			const u32 mip_size = texture_size >> mip;
-			for (int face = 0; face < 6; ++face) {
-				TextureCompressor::Input::Image& img = input.add(face, 0, mip);
-				Color* rgbm = (Color*)img.pixels.getMutableData();
-				for (u32 j = 0, c = mip_size * mip_size; j < c; ++j) {
-					const float m = clamp(maximum(mip_pixels[j].x, mip_pixels[j].y, mip_pixels[j].z), 1 / 64.f, 4.f);
-					rgbm[j].r = u8(clamp(mip_pixels[j].x / m * 255 + 0.5f, 0.f, 255.f));
-					rgbm[j].g = u8(clamp(mip_pixels[j].y / m * 255 + 0.5f, 0.f, 255.f));
-					rgbm[j].b = u8(clamp(mip_pixels[j].z / m * 255 + 0.5f, 0.f, 255.f));
-					rgbm[j].a = u8(clamp(255.f * m / 4 + 0.5f, 1.f, 255.f));
-				}
-				mip_pixels += mip_size * mip_size;
-			}
+		if (!TextureCompressor::compressCubemapBC6H(data, texture_size, mips_count, TextureCompressor::Options(), blob)) {
+			logError("Failed to compress ", path);
+			return false;
 		}
-		input.has_alpha = true;
-		input.is_cubemap = true;
-		if (!TextureCompressor::compress(input, TextureCompressor::Options(), blob, m_app.getAllocator())) return false;
 
 		os::OutputFile file;
 		if (!file.open(path)) {
@@ -3191,48 +3563,40 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 	}
 
 
-	void generateCubemaps(bool bounce, Universe& universe) {
-		ASSERT(m_probes.empty());
-
-		m_pipeline->define("PROBE_BOUNCE", bounce);
-
-		auto* scene = (RenderScene*)universe.getScene(ENVIRONMENT_PROBE_TYPE);
-		const Span<EntityRef> env_probes = scene->getEnvironmentProbesEntities();
-		const Span<EntityRef> reflection_probes = scene->getReflectionProbesEntities();
-		m_probes.reserve(env_probes.length() + reflection_probes.length());
-		IAllocator& allocator = m_app.getAllocator();
-		for (EntityRef p : env_probes) {
-			ProbeJob* job = LUMIX_NEW(m_app.getAllocator(), ProbeJob)(*this, universe, p, allocator);
-			
-			const EntityPtr env_entity = scene->getActiveEnvironment();
-			job->env_probe = scene->getEnvironmentProbe(p);
-			job->is_reflection = false;
-			job->position = universe.getPosition(p);
-
-			m_probes.push(job);
-		}
-
-		for (EntityRef p : reflection_probes) {
-			ProbeJob* job = LUMIX_NEW(m_app.getAllocator(), ProbeJob)(*this, universe, p, allocator);
-			
-			job->reflection_probe = scene->getReflectionProbe(p);
-			job->is_reflection = true;
-			job->position = universe.getPosition(p);
-
-			m_probes.push(job);
-		}
-
-		m_probe_counter += m_probes.size();
-	}
-
 	struct ProbeJob {
 		ProbeJob(EnvironmentProbePlugin& plugin, Universe& universe, EntityRef& entity, IAllocator& allocator) 
 			: entity(entity)
 			, data(allocator)
+			, filtered_data(allocator)
 			, plugin(plugin)
 			, universe(universe)
 		{}
 		
+		// main thread, called by renderer once face data is read
+		void faceRead() {
+			++faces_read;
+			if (faces_read < 6) return;
+			jobs::run(this, [](void* ptr) {
+				ProbeJob* pjob = (ProbeJob*)ptr;
+				pjob->plugin.processData(*pjob);
+			}, nullptr);
+		}
+
+		// main thread, called by renderer once filtered mip is read
+		void mipRead() {
+			++mips_read;
+			if (mips_read < ROUGHNESS_LEVELS) return;
+			plugin.m_renderer->destroy(filtered);
+			filtered = gpu::INVALID_TEXTURE;
+			jobs::run(this, [](void* ptr) {
+				ProbeJob* pjob = (ProbeJob*)ptr;
+				const u32 texture_size = pjob->reflection_probe.size;
+				pjob->plugin.saveCubemap(pjob->reflection_probe.guid, (const Vec4*)pjob->filtered_data.begin(), texture_size, ROUGHNESS_LEVELS);
+				memoryBarrier();
+				pjob->done = true;
+			}, nullptr);
+		}
+
 		EntityRef entity;
 		union {
 			EnvironmentProbe env_probe;
@@ -3244,22 +3608,121 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 
 		Universe& universe;
 		Array<Vec4> data;
+		Array<u8> filtered_data;
+		gpu::TextureHandle filtered = gpu::INVALID_TEXTURE;
 		SphericalHarmonics sh;
-		bool render_dispatched = false;
+		u32 faces_rendered = 0;
+		u32 faces_read = 0;
+		u32 mips_read = 0;
+		// set in job, filter is dispatched from main thread
+		bool filter_requested = false;
+		bool filter_dispatched = false;
 		bool done = false;
 		bool done_counted = false;
 	};
 
-	void render(ProbeJob& job) {
+	ProbeJob* createJob(Universe& universe, EntityRef entity, bool is_reflection) {
+		auto* scene = (RenderScene*)universe.getScene(ENVIRONMENT_PROBE_TYPE);
+		IAllocator& allocator = m_app.getAllocator();
+		ProbeJob* job = LUMIX_NEW(allocator, ProbeJob)(*this, universe, entity, allocator);
+		job->is_reflection = is_reflection;
+		if (is_reflection) {
+			job->reflection_probe = scene->getReflectionProbe(entity);
+		}
+		else {
+			job->env_probe = scene->getEnvironmentProbe(entity);
+		}
+		job->position = universe.getPosition(entity);
+		return job;
+	}
+
+	void generateCubemaps(bool bounce, Universe& universe) {
+		ASSERT(m_probes.empty());
+
+		m_pipeline->define("PROBE_BOUNCE", bounce);
+
+		auto* scene = (RenderScene*)universe.getScene(ENVIRONMENT_PROBE_TYPE);
+		const Span<EntityRef> env_probes = scene->getEnvironmentProbesEntities();
+		const Span<EntityRef> reflection_probes = scene->getReflectionProbesEntities();
+		m_probes.reserve(env_probes.length() + reflection_probes.length());
+		for (EntityRef p : env_probes) m_probes.push(createJob(universe, p, false));
+		for (EntityRef p : reflection_probes) m_probes.push(createJob(universe, p, true));
+
+		m_probe_counter += m_probes.size();
+	}
+
+	void renderFace(ProbeJob& job) {
+		ASSERT(job.faces_rendered < 6);
 		const u32 texture_size = job.is_reflection ? job.reflection_probe.size : 128;
+		const u32 face_pixels = texture_size * texture_size;
+		if (job.faces_rendered == 0) job.data.resize(6 * face_pixels);
+		
+		const u32 face = job.faces_rendered;
+		++job.faces_rendered;
+		const Span<u8> face_data((u8*)(job.data.begin() + face * face_pixels), u32(face_pixels * sizeof(Vec4)));
+		captureCubemapFace(*m_renderer, job.universe, *m_pipeline, texture_size, job.position, face, face_data, makeDelegate<&ProbeJob::faceRead>(&job));
+	}
 
-		captureCubemap(m_app, job.universe, *m_pipeline, texture_size, job.position, job.data, [&job](){
-			jobs::run(&job, [](void* ptr) {
-				ProbeJob* pjob = (ProbeJob*)ptr;
-				pjob->plugin.processData(*pjob);
-			}, nullptr);
+	void dispatchFilter(ProbeJob& job) {
+		if (!job.filter_requested || job.filter_dispatched) return;
+		job.filter_dispatched = true;
+		radianceFilter(job);
+	}
 
-		});
+	// moves filtered cubemap to its final place or copies SH to the probe
+	void finishJob(ProbeJob& job) {
+		ASSERT(job.done);
+		auto* scene = (RenderScene*)job.universe.getScene(ENVIRONMENT_PROBE_TYPE);
+		if (job.is_reflection) {
+			const char* base_path = m_app.getEngine().getFileSystem().getBasePath();
+			const u64 guid = job.reflection_probe.guid;
+			const StaticString<LUMIX_MAX_PATH> tmp_path(base_path, "/universes/probes_tmp/", guid, ".lbc");
+			const StaticString<LUMIX_MAX_PATH> path(base_path, "/universes/probes/", guid, ".lbc");
+			if (!os::fileExists(tmp_path)) return;
+			if (!os::moveFile(tmp_path, path)) {
+				logError("Failed to move file ", tmp_path, " to ", path);
+				return;
+			}
+			if (job.universe.hasComponent(job.entity, REFLECTION_PROBE_TYPE)) scene->reloadReflectionProbe(job.entity);
+			return;
+		}
+
+		if (job.universe.hasComponent(job.entity, ENVIRONMENT_PROBE_TYPE)) {
+			EnvironmentProbe& p = scene->getEnvironmentProbe(job.entity);
+			static_assert(sizeof(p.sh_coefs) == sizeof(job.sh.coefs));
+			memcpy(p.sh_coefs, job.sh.coefs, sizeof(p.sh_coefs));
+		}
+	}
+
+	void updateLive() {
+		if (m_live_job) {
+			if (m_live_job->faces_rendered < 6) {
+				renderFace(*m_live_job);
+				return;
+			}
+			if (!m_live_job->done) return;
+
+			// universe could have changed since the job was created
+			if (&m_live_job->universe == m_app.getWorldEditor().getUniverse()) finishJob(*m_live_job);
+			LUMIX_DELETE(m_app.getAllocator(), m_live_job);
+			m_live_job = nullptr;
+		}
+
+		if (!m_live_update || !m_probes.empty()) return;
+
+		Universe* universe = m_app.getWorldEditor().getUniverse();
+		if (!universe) return;
+		auto* scene = (RenderScene*)universe->getScene(ENVIRONMENT_PROBE_TYPE);
+		const Span<EntityRef> env_probes = scene->getEnvironmentProbesEntities();
+		const Span<EntityRef> reflection_probes = scene->getReflectionProbesEntities();
+		const u32 count = env_probes.length() + reflection_probes.length();
+		if (count == 0) return;
+
+		m_live_probe_idx = (m_live_probe_idx + 1) % count;
+		const bool is_reflection = m_live_probe_idx >= env_probes.length();
+		const EntityRef e = is_reflection ? reflection_probes[m_live_probe_idx - env_probes.length()] : env_probes[m_live_probe_idx];
+		m_live_job = createJob(*universe, e, is_reflection);
+		renderFace(*m_live_job);
 	}
 
 	void update() override
@@ -3293,16 +3756,17 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 			m_done_counter = 0;
 		}
 
-		for (ProbeJob* j : m_probes) {
-			if (!j->render_dispatched) {
-				j->render_dispatched = true;
-				render(*j);
-				break;
-			}
-		}
-
 		memoryBarrier();
+		if (m_live_job) dispatchFilter(*m_live_job);
+		updateLive();
+
+		u32 faces_budget = (u32)m_faces_per_frame;
 		for (ProbeJob* j : m_probes) {
+			dispatchFilter(*j);
+			while (j->faces_rendered < 6 && faces_budget > 0) {
+				renderFace(*j);
+				--faces_budget;
+			}
 			if (j->done && !j->done_counted) {
 				j->done_counted = true;
 				++m_done_counter;
@@ -3319,133 +3783,109 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 			if (!os::dirExists(path) && !os::makePath(path)) {
 				logError("Failed to create ", path);
 			}
-			RenderScene* scene = nullptr;
 			while (!m_probes.empty()) {
 				ProbeJob& job = *m_probes.back();
 				m_probes.pop();
 				ASSERT(job.done);
 				ASSERT(job.done_counted);
 
-				if (job.is_reflection) {
-
-					const u64 guid = job.reflection_probe.guid;
-
-					const StaticString<LUMIX_MAX_PATH> tmp_path(base_path, "/universes/probes_tmp/", guid, ".lbc");
-					const StaticString<LUMIX_MAX_PATH> path(base_path, "/universes/probes/", guid, ".lbc");
-					if (!os::fileExists(tmp_path)) {
-						if (scene) scene->reloadReflectionProbes();
-						return;
-					}
-					if (!os::moveFile(tmp_path, path)) {
-						logError("Failed to move file ", tmp_path, " to ", path);
-					}
-				}
-
-				if (job.universe.hasComponent(job.entity, ENVIRONMENT_PROBE_TYPE)) {
-					scene = (RenderScene*)job.universe.getScene(ENVIRONMENT_PROBE_TYPE);
-					EnvironmentProbe& p = scene->getEnvironmentProbe(job.entity);
-					static_assert(sizeof(p.sh_coefs) == sizeof(job.sh.coefs));
-					memcpy(p.sh_coefs, job.sh.coefs, sizeof(p.sh_coefs));
-				}
+				finishJob(job);
 
 				IAllocator& allocator = m_app.getAllocator();
 				LUMIX_DELETE(allocator, &job);
 			}
-			if (scene) scene->reloadReflectionProbes();
 		}
 	}
 
-	void radianceFilter(const Vec4* data, u32 size, u64 guid) {
+	// main thread
+	void radianceFilter(ProbeJob& job) {
 		PROFILE_FUNCTION();
-		if (!m_ibl_filter_shader->isReady()) {
+		if (!m_ibl_filter_program) {
 			logError(m_ibl_filter_shader->getPath(), "is not ready");
+			memoryBarrier();
+			job.done = true;
 			return;
 		}
-		jobs::SignalHandle finished = jobs::INVALID_HANDLE;
-		PluginManager& plugin_manager = m_app.getEngine().getPluginManager();
-		Renderer* renderer = (Renderer*)plugin_manager.getPlugin("renderer");
 
-		auto lambda = [&](){
-			renderer->beginProfileBlock("radiance_filter", 0);
-			gpu::pushDebugGroup("radiance_filter");
-			gpu::TextureHandle src = gpu::allocTextureHandle();
-			gpu::TextureHandle dst = gpu::allocTextureHandle();
-			bool created = gpu::createTexture(src, size, size, 1, gpu::TextureFormat::RGBA32F, gpu::TextureFlags::IS_CUBE, "env");
-			ASSERT(created);
-			for (u32 face = 0; face < 6; ++face) {
-				gpu::update(src, 0, 0, 0, face, size, size, gpu::TextureFormat::RGBA32F, (void*)(data + size * size * face), size * size * sizeof(*data));
-			}
-			gpu::generateMipmaps(src);
-			created = gpu::createTexture(dst, size, size, 1, gpu::TextureFormat::RGBA32F, gpu::TextureFlags::IS_CUBE, "env_filtered");
-			ASSERT(created);
-			gpu::BufferHandle buf = gpu::allocBufferHandle();
-			gpu::createBuffer(buf, gpu::BufferFlags::UNIFORM_BUFFER, 256, nullptr);
-
-			const u32 roughness_levels = 5;
-			
-			gpu::startCapture();
-			gpu::useProgram(m_ibl_filter_program);
-			gpu::bindTextures(&src, 0, 1);
-			for (u32 mip = 0; mip < roughness_levels; ++mip) {
-				const float roughness = float(mip) / (roughness_levels - 1);
+		const u32 size = job.reflection_probe.size;
+		u32 data_size = 0;
+		for (u32 mip = 0; mip < ROUGHNESS_LEVELS; ++mip) {
+			const u32 mip_size = size >> mip;
+			data_size += mip_size * mip_size * sizeof(Vec4) * 6;
+		}
+		job.filtered_data.resize(data_size);
+		job.filtered = gpu::allocTextureHandle();
+
+		struct FilterJob : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				renderer->beginProfileBlock("radiance_filter", 0);
+				gpu::pushDebugGroup("radiance_filter");
+				gpu::TextureHandle src = gpu::allocTextureHandle();
+				bool created = gpu::createTexture(src, size, size, 1, gpu::TextureFormat::RGBA32F, gpu::TextureFlags::IS_CUBE, "env");
+				ASSERT(created);
 				for (u32 face = 0; face < 6; ++face) {
-					gpu::setFramebufferCube(dst, face, mip);
-					gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, buf, 0, 256);
-					struct {
-						float roughness;
-						u32 face;
-						u32 mip;
-					} drawcall = {roughness, face, mip};
-					gpu::setState(gpu::StateFlags::NONE);
-					gpu::viewport(0, 0, size >> mip, size >> mip);
-					gpu::update(buf, &drawcall, sizeof(drawcall));
-					gpu::drawArrays(gpu::PrimitiveType::TRIANGLE_STRIP, 0, 4);
+					gpu::update(src, 0, 0, 0, face, size, size, gpu::TextureFormat::RGBA32F, (void*)(data + size * size * face), size * size * sizeof(*data));
+				}
+				gpu::generateMipmaps(src);
+				created = gpu::createTexture(dst, size, size, 1, gpu::TextureFormat::RGBA32F, gpu::TextureFlags::IS_CUBE, "env_filtered");
+				ASSERT(created);
+				gpu::BufferHandle buf = gpu::allocBufferHandle();
+				gpu::createBuffer(buf, gpu::BufferFlags::UNIFORM_BUFFER, 256, nullptr);
+
+				gpu::useProgram(program);
+				gpu::bindTextures(&src, 0, 1);
+				for (u32 mip = 0; mip < ROUGHNESS_LEVELS; ++mip) {
+					const float roughness = float(mip) / (ROUGHNESS_LEVELS - 1);
+					for (u32 face = 0; face < 6; ++face) {
+						gpu::setFramebufferCube(dst, face, mip);
+						gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, buf, 0, 256);
+						struct {
+							float roughness;
+							u32 face;
+							u32 mip;
+						} drawcall = {roughness, face, mip};
+						gpu::setState(gpu::StateFlags::NONE);
+						gpu::viewport(0, 0, size >> mip, size >> mip);
+						gpu::update(buf, &drawcall, sizeof(drawcall));
+						gpu::drawArrays(gpu::PrimitiveType::TRIANGLE_STRIP, 0, 4);
+					}
 				}
-			}
-
-			gpu::setFramebuffer(nullptr, 0, gpu::INVALID_TEXTURE, gpu::FramebufferFlags::NONE);
-
-			gpu::TextureHandle staging = gpu::allocTextureHandle();
-			const gpu::TextureFlags flags = gpu::TextureFlags::IS_CUBE | gpu::TextureFlags::READBACK;
-			gpu::createTexture(staging, size, size, 1, gpu::TextureFormat::RGBA32F, flags, "staging_buffer");
-			
-			u32 data_size = 0;
-			u32 mip_size = size;
-			for (u32 mip = 0; mip < roughness_levels; ++mip) {
-				data_size += mip_size * mip_size * sizeof(Vec4) * 6;
-				mip_size >>= 1;
-			}
 
-			Array<u8> tmp(m_app.getAllocator());
-			tmp.resize(data_size);
+				gpu::setFramebuffer(nullptr, 0, gpu::INVALID_TEXTURE, gpu::FramebufferFlags::NONE);
+				gpu::popDebugGroup();
+				renderer->endProfileBlock();
 
-			gpu::copy(staging, dst, 0, 0);
-			u8* tmp_ptr = tmp.begin();
-			for (u32 mip = 0; mip < roughness_levels; ++mip) {
-				const u32 mip_size = size >> mip;
-				gpu::readTexture(staging, mip, Span(tmp_ptr, mip_size * mip_size * sizeof(Vec4) * 6));
-				tmp_ptr += mip_size * mip_size * sizeof(Vec4) * 6;
+				gpu::destroy(buf);
+				gpu::destroy(src);
 			}
-			gpu::stopCapture();
-
-			saveCubemap(guid, (Vec4*)tmp.begin(), size, roughness_levels);
-			gpu::destroy(staging);
-			gpu::popDebugGroup();
-			renderer->endProfileBlock();
 
-			gpu::destroy(buf);
-			gpu::destroy(src);
-			gpu::destroy(dst);
+			Renderer* renderer;
+			gpu::ProgramHandle program;
+			gpu::TextureHandle dst;
+			const Vec4* data;
+			u32 size;
 		};
-		
-		// TODO RenderJob
-		jobs::runEx(&lambda, [](void* data){
-			auto* l = ((decltype(lambda)*)data);
-			(*l)();
-		}, &finished, jobs::INVALID_HANDLE, 1);
-		jobs::wait(finished);
+
+		FilterJob& filter = m_renderer->createJob<FilterJob>();
+		filter.renderer = m_renderer;
+		filter.program = m_ibl_filter_program;
+		filter.dst = job.filtered;
+		filter.data = job.data.begin();
+		filter.size = size;
+		m_renderer->queue(filter, 0);
+
+		// render jobs are executed in order, so mips are read after they are filtered
+		u8* ptr = job.filtered_data.begin();
+		for (u32 mip = 0; mip < ROUGHNESS_LEVELS; ++mip) {
+			const u32 mip_size = size >> mip;
+			const u32 mip_bytes = mip_size * mip_size * sizeof(Vec4) * 6;
+			m_renderer->readTextureMipAsync(job.filtered, mip, Span(ptr, mip_bytes), makeDelegate<&ProbeJob::mipRead>(&job));
+			ptr += mip_bytes;
+		}
 	}
 
+	// worker thread
 	void processData(ProbeJob& job) {
 		Array<Vec4>& data = job.data;
 		const u32 texture_size = (u32)sqrtf(data.size() / 6.f);
@@ -3464,12 +3904,12 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		}
 
 		if (job.is_reflection) {
-			radianceFilter(data.begin(), texture_size, job.reflection_probe.guid);
-		}
-		else {
-			job.sh.compute(data);
+			memoryBarrier();
+			job.filter_requested = true;
+			return;
 		}
-
+		
+		job.sh.compute(data);
 		memoryBarrier();
 		job.done = true;
 	}
@@ -3477,43 +3917,39 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 
 	void onGUI(PropertyGrid& grid, ComponentUID cmp, WorldEditor& editor) override {
 		Universe& universe = *editor.getUniverse();
-		if (cmp.type == ENVIRONMENT_PROBE_TYPE) {
-			const EntityRef e = (EntityRef)cmp.entity;
-			auto* scene = static_cast<RenderScene*>(cmp.scene);
-			if (m_probe_counter) ImGui::Text("Generating...");
-			else {
-				const EnvironmentProbe& probe = scene->getEnvironmentProbe(e);
-				if (ImGui::CollapsingHeader("Generator")) {
-					if (ImGui::Button("Generate")) generateCubemaps(false, universe);
-					ImGui::SameLine();
-					if (ImGui::Button("Add bounce")) generateCubemaps(true, universe);
-				}
-			}
+		if (cmp.type != ENVIRONMENT_PROBE_TYPE && cmp.type != REFLECTION_PROBE_TYPE) return;
+
+		const EntityRef e = (EntityRef)cmp.entity;
+		auto* scene = static_cast<RenderScene*>(cmp.scene);
+		if (m_probe_counter) {
+			ImGui::Text("Generating...");
+			return;
 		}
 
 		if (cmp.type == REFLECTION_PROBE_TYPE) {
-			const EntityRef e = (EntityRef)cmp.entity;
-			auto* scene = static_cast<RenderScene*>(cmp.scene);
-			if (m_probe_counter) ImGui::Text("Generating...");
-			else {
-				const ReflectionProbe& probe = scene->getReflectionProbe(e);
-				if (probe.flags.isSet(ReflectionProbe::ENABLED)) {
-					StaticString<LUMIX_MAX_PATH> path("universes/probes/", probe.guid, ".lbc");
-					ImGuiEx::Label("Path");
-					ImGui::TextUnformatted(path);
-					if (ImGui::Button("View radiance")) m_app.getAssetBrowser().selectResource(Path(path), true, false);
-				}
-				if (ImGui::CollapsingHeader("Generator")) {
-					if (ImGui::Button("Generate")) generateCubemaps(false, universe);
-					ImGui::SameLine();
-					if (ImGui::Button("Add bounce")) generateCubemaps(true, universe);
-				}
+			const ReflectionProbe& probe = scene->getReflectionProbe(e);
+			if (probe.flags.isSet(ReflectionProbe::ENABLED)) {
+				StaticString<LUMIX_MAX_PATH> path("universes/probes/", probe.guid, ".lbc");
+				ImGuiEx::Label("Path");
+				ImGui::TextUnformatted(path);
+				if (ImGui::Button("View radiance")) m_app.getAssetBrowser().selectResource(Path(path), true, false);
 			}
 		}
+
+		if (ImGui::CollapsingHeader("Generator")) {
+			ImGuiEx::Label("Faces per frame");
+			ImGui::SliderInt("##fpf", &m_faces_per_frame, 1, 6);
+			ImGuiEx::Label("Live update");
+			ImGui::Checkbox("##live", &m_live_update);
+			if (ImGui::Button("Generate")) generateCubemaps(false, universe);
+			ImGui::SameLine();
+			if (ImGui::Button("Add bounce")) generateCubemaps(true, universe);
+		}
 	}
 
 
 	StudioApp& m_app;
+	Renderer* m_renderer = nullptr;
 	UniquePtr<Pipeline> m_pipeline;
 	Shader* m_ibl_filter_shader = nullptr;
 	gpu::ProgramHandle m_ibl_filter_program = gpu::INVALID_PROGRAM;
@@ -3522,6 +3958,10 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 	Array<ProbeJob*> m_probes;
 	u32 m_done_counter = 0;
 	u32 m_probe_counter = 0;
+	i32 m_faces_per_frame = 6;
+	bool m_live_update = false;
+	ProbeJob* m_live_job = nullptr;
+	u32 m_live_probe_idx = 0;
 };
 
 
@@ -4242,8 +4682,14 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_particle_emitter_plugin.m_particle_editor = m_particle_editor.get();
 		m_particle_emitter_property_plugin.m_particle_editor = m_particle_editor.get();
+
+		m_bake_static_batches_action.init("Bake static batches", "Bake static batches", "bake_static_batches", "", true);
+		m_bake_static_batches_action.func.bind<&StudioAppPlugin::bakeStaticBatches>(this);
+		m_app.addAction(&m_bake_static_batches_action);
 	}
 
+	void bakeStaticBatches() { StaticBatches::bake(m_app); }
+
 	void showEnvironmentProbeGizmo(UniverseView& view, ComponentUID cmp) {
 		RenderScene* scene = static_cast<RenderScene*>(cmp.scene);
 		const Universe& universe = scene->getUniverse();
@@ -4476,9 +4922,12 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		property_grid.removePlugin(m_env_probe_plugin);
 		property_grid.removePlugin(m_terrain_plugin);
 		property_grid.removePlugin(m_particle_emitter_property_plugin);
+
+		m_app.removeAction(&m_bake_static_batches_action);
 	}
 
 	StudioApp& m_app;
+	Action m_bake_static_batches_action;
 	UniquePtr<ParticleEditor> m_particle_editor;
 	EditorUIRenderPlugin m_editor_ui_render_plugin;
 	MaterialPlugin m_material_plugin;
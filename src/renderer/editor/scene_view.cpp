@@ -21,6 +21,7 @@
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "renderer/culling_system.h"
 #include "renderer/draw2d.h"
@@ -42,6 +43,45 @@ static const ComponentType MODEL_INSTANCE_TYPE = reflection::getComponentType("m
 static const ComponentType PARTICLE_EMITTER_TYPE = reflection::getComponentType("particle_emitter");
 static const ComponentType MESH_ACTOR_TYPE = reflection::getComponentType("rigid_actor");
 
+// pixel under the mouse cursor is rendered with entity IDs of rigid meshes, see SceneView::renderPickIDs
+// the result is copied to a staging texture and read back a few frames later, so it does not stall
+struct GPUPicker {
+	static constexpr u32 LATENCY = 3; // in frames
+
+	struct Request {
+		bool matches(const Request& rhs) const {
+			return mouse_pos.x == rhs.mouse_pos.x && mouse_pos.y == rhs.mouse_pos.y
+				&& viewport.pos.x == rhs.viewport.pos.x && viewport.pos.y == rhs.viewport.pos.y && viewport.pos.z == rhs.viewport.pos.z
+				&& viewport.rot.x == rhs.viewport.rot.x && viewport.rot.y == rhs.viewport.rot.y
+				&& viewport.rot.z == rhs.viewport.rot.z && viewport.rot.w == rhs.viewport.rot.w
+				&& viewport.w == rhs.viewport.w && viewport.h == rhs.viewport.h
+				&& viewport.is_ortho == rhs.viewport.is_ortho && viewport.fov == rhs.viewport.fov
+				&& viewport.ortho_size == rhs.viewport.ortho_size;
+		}
+
+		Vec2 mouse_pos;
+		Viewport viewport;
+	};
+
+	// render thread
+	gpu::TextureHandle id_rt = gpu::INVALID_TEXTURE;
+	gpu::TextureHandle depth_rt = gpu::INVALID_TEXTURE;
+	gpu::BufferHandle pass_ub = gpu::INVALID_BUFFER;
+	gpu::TextureHandle staging[LATENCY + 1] = {};
+	Request staging_requests[LATENCY + 1];
+	bool staging_used[LATENCY + 1] = {};
+	u32 frame = 0;
+
+	// main thread
+	bool has_request = false;
+	Request request;
+
+	Mutex mutex; // guards the result
+	bool has_result = false;
+	Request result_request;
+	EntityPtr result = INVALID_ENTITY;
+};
+
 struct UniverseViewImpl final : UniverseView {
 	enum class MouseMode
 	{
@@ -104,12 +144,38 @@ struct UniverseViewImpl final : UniverseView {
 	void onUniverseCreated(){
 		m_scene = (RenderScene*)m_editor.getUniverse()->getScene(crc32("renderer"));
 		m_icons = EditorIcons::create(m_editor, *m_scene);
+
+		// scene view is rendered only when something changes
+		m_universe = m_editor.getUniverse();
+		m_universe->entityCreated().bind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entityDestroyed().bind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entityTransformed().bind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entitiesTransformed().bind<&UniverseViewImpl::onEntitiesTransformed>(this);
+		m_universe->entityEnabled().bind<&UniverseViewImpl::onEntityEnabled>(this);
+		m_universe->componentAdded().bind<&UniverseViewImpl::onComponentChanged>(this);
+		m_universe->componentDestroyed().bind<&UniverseViewImpl::onComponentChanged>(this);
+		m_scene_view.m_render_throttle.invalidate();
 	}
 
 	void onUniverseDestroyed(){
 		m_icons.reset();
+		if (!m_universe) return;
+
+		m_universe->entityCreated().unbind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entityDestroyed().unbind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entityTransformed().unbind<&UniverseViewImpl::onEntityChanged>(this);
+		m_universe->entitiesTransformed().unbind<&UniverseViewImpl::onEntitiesTransformed>(this);
+		m_universe->entityEnabled().unbind<&UniverseViewImpl::onEntityEnabled>(this);
+		m_universe->componentAdded().unbind<&UniverseViewImpl::onComponentChanged>(this);
+		m_universe->componentDestroyed().unbind<&UniverseViewImpl::onComponentChanged>(this);
+		m_universe = nullptr;
 	}
 
+	void onEntityChanged(EntityRef) { m_scene_view.m_render_throttle.invalidate(); }
+	void onEntitiesTransformed(Span<const EntityRef>) { m_scene_view.m_render_throttle.invalidate(); }
+	void onEntityEnabled(EntityRef, bool) { m_scene_view.m_render_throttle.invalidate(); }
+	void onComponentChanged(const ComponentUID&) { m_scene_view.m_render_throttle.invalidate(); }
+
 	void setSnapMode(bool enable, bool vertex_snap) override
 	{
 		m_snap_mode = enable ? (vertex_snap ? SnapMode::VERTEX : SnapMode::FREE) : SnapMode::NONE;
@@ -175,19 +241,24 @@ struct UniverseViewImpl final : UniverseView {
 				DVec3 origin;
 				Vec3 dir;
 				m_viewport.getRay(m_mouse_pos, origin, dir);
-				const RayCastModelHit hit = m_scene->castRay(origin, dir, INVALID_ENTITY);
 
 				const Array<EntityRef>& selected_entities = m_editor.getSelectedEntities();
-				if (m_snap_mode != SnapMode::NONE && !selected_entities.empty() && hit.is_hit)
+				bool snapped = false;
+				if (m_snap_mode != SnapMode::NONE && !selected_entities.empty())
 				{
-					DVec3 snap_pos = origin + dir * hit.t;
-					if (m_snap_mode == SnapMode::VERTEX) snap_pos = getClosestVertex(hit);
-					const Quat rot = m_editor.getUniverse()->getRotation(selected_entities[0]);
-					const Gizmo::Config& gizmo_cfg = m_app.getGizmoConfig();
-					const Vec3 offset = rot.rotate(gizmo_cfg.getOffset());
-					m_editor.snapEntities(snap_pos - offset, gizmo_cfg.isTranslateMode());
+					const RayCastModelHit hit = m_scene->castRay(origin, dir, INVALID_ENTITY);
+					if (hit.is_hit) {
+						DVec3 snap_pos = origin + dir * hit.t;
+						if (m_snap_mode == SnapMode::VERTEX) snap_pos = getClosestVertex(hit);
+						const Quat rot = m_editor.getUniverse()->getRotation(selected_entities[0]);
+						const Gizmo::Config& gizmo_cfg = m_app.getGizmoConfig();
+						const Vec3 offset = rot.rotate(gizmo_cfg.getOffset());
+						m_editor.snapEntities(snap_pos - offset, gizmo_cfg.isTranslateMode());
+						snapped = true;
+					}
 				}
-				else
+				
+				if (!snapped)
 				{
 					auto icon_hit = m_icons->raycast(origin, dir);
 					if (icon_hit.entity != INVALID_ENTITY)
@@ -197,10 +268,16 @@ struct UniverseViewImpl final : UniverseView {
 							m_editor.selectEntities(Span(&e, 1), ImGui::GetIO().KeyCtrl);
 						}
 					}
-					else if (hit.is_hit)
+					else
 					{
-						if(hit.entity.isValid()) {
-							EntityRef entity = (EntityRef)hit.entity;
+						// ray cast only if the ID pass did not hit anything, it does not have e.g. terrains
+						EntityPtr picked = m_scene_view.getGPUPick(m_mouse_pos);
+						if (!picked.isValid()) {
+							const RayCastModelHit hit = m_scene->castRay(origin, dir, INVALID_ENTITY);
+							if (hit.is_hit) picked = hit.entity;
+						}
+						if (picked.isValid()) {
+							EntityRef entity = (EntityRef)picked;
 							m_editor.selectEntities(Span(&entity, 1), ImGui::GetIO().KeyCtrl);
 						}
 					}
@@ -592,11 +669,13 @@ struct UniverseViewImpl final : UniverseView {
 	RenderScene* m_scene;
 	Array<Vertex> m_draw_vertices;
 	Array<DrawCmd> m_draw_cmds;
+	Universe* m_universe = nullptr;
 };
 
 
 SceneView::SceneView(StudioApp& app)
 	: m_app(app)
+	, m_render_throttle(app)
 	, m_log_ui(app.getLogUI())
 	, m_editor(m_app.getWorldEditor())
 {
@@ -650,6 +729,8 @@ void SceneView::init() {
 	m_pipeline->addCustomCommandHandler("renderSelection").callback.bind<&SceneView::renderSelection>(this);
 	m_pipeline->addCustomCommandHandler("renderGizmos").callback.bind<&SceneView::renderGizmos>(this);
 	m_pipeline->addCustomCommandHandler("renderIcons").callback.bind<&SceneView::renderIcons>(this);
+	m_pipeline->addCustomCommandHandler("renderPickIDs").callback.bind<&SceneView::renderPickIDs>(this);
+	m_gpu_picker = LUMIX_NEW(renderer->getAllocator(), GPUPicker);
 
 	ResourceManagerHub& rm = engine.getResourceManager();
 	m_debug_shape_shader = rm.load<Shader>(Path("pipelines/debug_shape.shd"));
@@ -677,6 +758,18 @@ SceneView::~SceneView()
 	m_editor.setView(nullptr);
 	LUMIX_DELETE(m_app.getAllocator(), m_view);
 	m_debug_shape_shader->decRefCount();
+
+	Renderer* renderer = static_cast<Renderer*>(m_app.getEngine().getPluginManager().getPlugin("renderer"));
+	renderer->runInRenderThread(m_gpu_picker, [](Renderer& renderer, void* ptr){
+		GPUPicker* picker = (GPUPicker*)ptr;
+		if (picker->id_rt) gpu::destroy(picker->id_rt);
+		if (picker->depth_rt) gpu::destroy(picker->depth_rt);
+		if (picker->pass_ub) gpu::destroy(picker->pass_ub);
+		for (gpu::TextureHandle tex : picker->staging) {
+			if (tex) gpu::destroy(tex);
+		}
+		LUMIX_DELETE(renderer.getAllocator(), picker);
+	});
 }
 
 void SceneView::manipulate() {
@@ -804,7 +897,8 @@ void SceneView::renderIcons()
 				const Model* model = rd.model;
 				if (!model || !model->isReady()) continue;
 
-				for (int i = 0; i <= model->getLODIndices()[0].to; ++i) {
+				const LODMeshIndices& lod = model->getLODIndices()[model->getResidentLOD()];
+				for (int i = lod.from; i <= lod.to; ++i) {
 					const Mesh& mesh = model->getMesh(i);
 					Item& item = m_items.emplace();
 					item.mesh = mesh.render_data;
@@ -824,6 +918,7 @@ void SceneView::renderIcons()
 				const Mesh::RenderData* rd = item.mesh;
 			
 				gpu::update(drawcall_ub, &item.mtx.columns[0].x, sizeof(item.mtx));
+				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, drawcall_ub, 0, sizeof(item.mtx));
 				gpu::bindTextures(item.material->textures, 0, item.material->textures_count);
 				gpu::useProgram(item.program);
 				gpu::bindIndexBuffer(rd->index_buffer_handle);
@@ -879,7 +974,8 @@ void SceneView::renderSelection()
 				if (!model || !model->isReady()) continue;
 
 				const Pose* pose = scene->lockPose(e);
-				for (int i = 0; i <= model->getLODIndices()[0].to; ++i) {
+				const LODMeshIndices& lod = model->getLODIndices()[model->getResidentLOD()];
+				for (int i = lod.from; i <= lod.to; ++i) {
 					const Mesh& mesh = model->getMesh(i);
 					
 					Item& item = m_items.emplace(m_allocator);
@@ -913,6 +1009,7 @@ void SceneView::renderSelection()
 			
 				if (item.pose.empty()) {
 					gpu::update(drawcall_ub, &item.mtx.columns[0].x, sizeof(item.mtx));
+					gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, drawcall_ub, 0, sizeof(item.mtx));
 				}
 				else {
 					struct {
@@ -974,6 +1071,239 @@ void SceneView::renderSelection()
 }
 
 
+EntityPtr SceneView::getGPUPick(const Vec2& mouse_pos) {
+	GPUPicker::Request request;
+	request.mouse_pos = mouse_pos;
+	request.viewport = m_view->getViewport();
+
+	EntityPtr res;
+	{
+		MutexGuard guard(m_gpu_picker->mutex);
+		if (!m_gpu_picker->has_result || !m_gpu_picker->result_request.matches(request)) return INVALID_ENTITY;
+		res = m_gpu_picker->result;
+	}
+
+	// picked entity could be destroyed since then
+	const Universe& universe = *m_editor.getUniverse();
+	if (!res.isValid() || !universe.hasEntity((EntityRef)res)) return INVALID_ENTITY;
+	if (!universe.hasComponent((EntityRef)res, MODEL_INSTANCE_TYPE)) return INVALID_ENTITY;
+	return res;
+}
+
+
+void SceneView::renderPickIDs()
+{
+	struct RenderJob : Renderer::RenderJob
+	{
+		RenderJob(IAllocator& allocator) 
+			: m_items(allocator)
+		{}
+
+		void setup() override
+		{
+			PROFILE_FUNCTION();
+			if (!m_has_request) return;
+
+			const Viewport& vp = m_request.viewport;
+			const Vec2 p = m_request.mouse_pos;
+			const ShiftedFrustum frustum = vp.getFrustum(p - Vec2(1, 1), p + Vec2(1, 1));
+			const Universe& universe = m_scene->getUniverse();
+			
+			// rigid meshes only, skinned ones are left to ray casts
+			const RenderableTypes types[] = { RenderableTypes::MESH, RenderableTypes::MESH_MATERIAL_OVERRIDE };
+			for (RenderableTypes type : types) {
+				CullResult* renderables = m_scene->getRenderables(frustum, type);
+				if (!renderables) continue;
+
+				renderables->forEach([&](EntityRef e){
+					const ModelInstance* mi = m_scene->getModelInstance(e);
+					Model* model = mi->model;
+					const Transform& tr = universe.getTransform(e);
+					const float squared_dist = float(squaredLength(tr.pos - vp.pos));
+					const LODMeshIndices& lod = model->getLODIndices()[model->useLOD(model->getLODMeshIndices(squared_dist))];
+					for (i32 i = lod.from; i <= lod.to; ++i) {
+						const Mesh& mesh = mi->meshes[i];
+						if (!mesh.render_data->vertex_buffer_handle) continue;
+
+						Material* material = type == RenderableTypes::MESH_MATERIAL_OVERRIDE ? mi->custom_material : mesh.material;
+						if (!material->isReady()) continue;
+						// only this shader knows PICK
+						Shader* shader = material->getShader();
+						if (shader->getPath() != m_pick_shader) continue;
+
+						Item& item = m_items.emplace();
+						item.id = e.index + 1;
+						item.mesh = mesh.render_data;
+						item.material = material->getRenderData();
+						item.program = shader->getProgram(mesh.vertex_decl, m_define_mask | material->getDefineMask());
+						item.rot = tr.rot;
+						item.pos = Vec3(tr.pos - vp.pos);
+						item.scale = tr.scale;
+					}
+				});
+				renderables->free(*m_page_allocator);
+			}
+
+			// same layout as in pipeline
+			m_instances = m_renderer->allocTransient(m_items.size() * INSTANCE_SIZE);
+			u8* out = m_instances.ptr;
+			for (const Item& item : m_items) {
+				const float lod = 0;
+				const float material_idx = float(item.material->material_constants);
+				memcpy(out, &item.rot, sizeof(item.rot));
+				memcpy(out + 16, &item.pos, sizeof(item.pos));
+				memcpy(out + 28, &item.scale, sizeof(item.scale));
+				memcpy(out + 32, &lod, sizeof(lod));
+				memcpy(out + 36, &material_idx, sizeof(material_idx));
+				out += INSTANCE_SIZE;
+			}
+		}
+
+		void execute() override
+		{
+			PROFILE_FUNCTION();
+			GPUPicker& picker = *m_picker;
+			if (!picker.id_rt) {
+				const gpu::TextureFlags flags = gpu::TextureFlags::NO_MIPS | gpu::TextureFlags::RENDER_TARGET | gpu::TextureFlags::POINT_FILTER;
+				picker.id_rt = gpu::allocTextureHandle();
+				picker.depth_rt = gpu::allocTextureHandle();
+				gpu::createTexture(picker.id_rt, 1, 1, 1, gpu::TextureFormat::RGBA8, flags, "pick_id");
+				gpu::createTexture(picker.depth_rt, 1, 1, 1, gpu::TextureFormat::D32, flags, "pick_depth");
+				for (gpu::TextureHandle& tex : picker.staging) {
+					tex = gpu::allocTextureHandle();
+					gpu::createTexture(tex, 1, 1, 1, gpu::TextureFormat::RGBA8, gpu::TextureFlags::NO_MIPS | gpu::TextureFlags::READBACK, "pick_staging");
+				}
+				picker.pass_ub = gpu::allocBufferHandle();
+				gpu::createBuffer(picker.pass_ub, gpu::BufferFlags::UNIFORM_BUFFER, sizeof(PassState), nullptr);
+			}
+
+			gpu::pushDebugGroup("pick IDs");
+			const u32 slot = picker.frame % lengthOf(picker.staging);
+			picker.staging_used[slot] = m_has_request;
+			if (m_has_request) {
+				gpu::setFramebuffer(&picker.id_rt, 1, picker.depth_rt, gpu::FramebufferFlags::NONE);
+				gpu::viewport(0, 0, 1, 1);
+				const float clear_color[] = {0, 0, 0, 0};
+				// depth is reversed
+				gpu::clear(gpu::ClearFlags::COLOR | gpu::ClearFlags::DEPTH, clear_color, 0);
+				gpu::update(picker.pass_ub, &m_pass_state, sizeof(m_pass_state));
+				gpu::bindUniformBuffer(UniformBuffer::PASS, picker.pass_ub, 0, sizeof(PassState));
+
+				const gpu::BufferHandle drawcall_ub = m_pipeline->getDrawcallUniformBuffer();
+				const gpu::BufferHandle material_ub = m_renderer->getMaterialUniformBuffer();
+				gpu::bindShaderBuffer(material_ub, ShaderBuffer::MATERIALS, gpu::BindShaderBufferFlags::NONE);
+				for (i32 i = 0, c = m_items.size(); i < c; ++i) {
+					const Item& item = m_items[i];
+					const u32 pick[4] = { item.id, m_pixel_x, m_pixel_y, 0 };
+					gpu::update(drawcall_ub, pick, sizeof(pick));
+					gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, drawcall_ub, 0, sizeof(pick));
+					gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, item.material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
+					if (!item.material->bindless) gpu::bindTextures(item.material->textures, 0, item.material->textures_count);
+					
+					// no blending, IDs must not be mixed
+					const gpu::StateFlags cull = item.material->render_states & (gpu::StateFlags::CULL_BACK | gpu::StateFlags::CULL_FRONT);
+					gpu::setState(cull | gpu::StateFlags::DEPTH_TEST | gpu::StateFlags::DEPTH_WRITE);
+					gpu::useProgram(item.program);
+					gpu::bindIndexBuffer(item.mesh->index_buffer_handle);
+					gpu::bindVertexBuffer(0, item.mesh->vertex_buffer_handle, 0, item.mesh->vb_stride);
+					gpu::bindVertexBuffer(1, m_instances.buffer, m_instances.offset + i * INSTANCE_SIZE, INSTANCE_SIZE);
+					gpu::drawTrianglesInstanced(item.mesh->indices_count, 1, item.mesh->index_type);
+				}
+				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+				gpu::copy(picker.staging[slot], picker.id_rt, 0, 0);
+				picker.staging_requests[slot] = m_request;
+			}
+
+			// copied LATENCY frames ago, gpu is done with it
+			const u32 read_slot = (picker.frame + 1) % lengthOf(picker.staging);
+			if (picker.staging_used[read_slot]) {
+				u8 id[4];
+				gpu::readTexture(picker.staging[read_slot], 0, Span(id, sizeof(id)));
+				const u32 entity_id = id[0] | (id[1] << 8) | (id[2] << 16) | (id[3] << 24);
+				
+				MutexGuard guard(picker.mutex);
+				picker.has_result = true;
+				picker.result_request = picker.staging_requests[read_slot];
+				picker.result = entity_id == 0 ? INVALID_ENTITY : EntityPtr{i32(entity_id - 1)};
+				picker.staging_used[read_slot] = false;
+			}
+			++picker.frame;
+			gpu::popDebugGroup();
+		}
+
+		struct Item {
+			u32 id; // entity index + 1
+			gpu::ProgramHandle program;
+			Mesh::RenderData* mesh;
+			Material::RenderData* material;
+			Quat rot;
+			Vec3 pos;
+			float scale;
+		};
+
+		enum { INSTANCE_SIZE = 40 };
+
+		Array<Item> m_items;
+		Renderer::TransientSlice m_instances;
+		GPUPicker* m_picker;
+		GPUPicker::Request m_request;
+		bool m_has_request;
+		PassState m_pass_state;
+		u32 m_pixel_x;
+		u32 m_pixel_y;
+		u32 m_define_mask;
+		Path m_pick_shader;
+		RenderScene* m_scene;
+		Pipeline* m_pipeline;
+		Renderer* m_renderer;
+		PageAllocator* m_page_allocator;
+	};
+
+	Engine& engine = m_app.getEngine();
+	Renderer* renderer = static_cast<Renderer*>(engine.getPluginManager().getPlugin("renderer"));
+	RenderJob& job = renderer->createJob<RenderJob>(renderer->getAllocator());
+	job.m_picker = m_gpu_picker;
+	job.m_has_request = m_gpu_picker->has_request && m_pipeline->getScene();
+	job.m_request = m_gpu_picker->request;
+	job.m_define_mask = (1 << renderer->getShaderDefineIdx("INSTANCED")) | (1 << renderer->getShaderDefineIdx("PICK"));
+	job.m_pick_shader = Path("pipelines/standard.shd");
+	job.m_scene = m_pipeline->getScene();
+	job.m_pipeline = m_pipeline.get();
+	job.m_renderer = renderer;
+	job.m_page_allocator = &engine.getPageAllocator();
+	m_gpu_picker->has_request = false;
+
+	if (job.m_has_request) {
+		const Viewport& vp = job.m_request.viewport;
+		const Vec2 p = job.m_request.mouse_pos;
+		// maps the picked pixel to the whole 1x1 render target
+		Matrix projection = vp.getProjection();
+		const float ndc_x = 2 * (p.x + 0.5f) / vp.w - 1;
+		const float ndc_y = 1 - 2 * (p.y + 0.5f) / vp.h;
+		for (Vec4& col : projection.columns) {
+			col.x = (col.x - ndc_x * col.w) * vp.w;
+			col.y = (col.y - ndc_y * col.w) * vp.h;
+		}
+		const Matrix view = vp.getView(vp.pos);
+		PassState& ps = job.m_pass_state;
+		memset(&ps, 0, sizeof(ps));
+		ps.projection = projection;
+		ps.inv_projection = projection.inverted();
+		ps.view = view;
+		ps.inv_view = view.fastInverted();
+		ps.view_projection = projection * view;
+		ps.inv_view_projection = ps.view_projection.inverted();
+		ps.view_dir = Vec4(vp.rot.rotate(Vec3(0, 0, -1)), 0);
+		ps.camera_up = Vec4(vp.rot.rotate(Vec3(0, 1, 0)), 0);
+		
+		job.m_pixel_x = (u32)clamp(i32(p.x), 0, vp.w - 1);
+		const u32 y = (u32)clamp(i32(p.y), 0, vp.h - 1);
+		job.m_pixel_y = gpu::isOriginBottomLeft() ? vp.h - 1 - y : y;
+	}
+	renderer->queue(job, 0);
+}
+
+
 void SceneView::renderGizmos()
 {
 	struct Cmd : Renderer::RenderJob
@@ -1005,6 +1335,7 @@ void SceneView::renderGizmos()
 			const Matrix mtx = Matrix::IDENTITY;
 			for (const UniverseViewImpl::DrawCmd& cmd : cmds) {
 				gpu::update(drawcall_ub, &mtx.columns[0].x, sizeof(mtx));
+				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, drawcall_ub, 0, sizeof(mtx));
 				gpu::useProgram(program);
 				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
 				gpu::bindVertexBuffer(0, vb.buffer, vb.offset + offset, sizeof(UniverseView::Vertex));
@@ -1314,6 +1645,11 @@ void SceneView::statsUI(float x, float y) {
 		char buf[30];
 		toCStringPretty(stats.triangle_count, Span(buf));
 		ImGui::LabelText("Triangles (scene view only)", "%s", buf);
+		const Pipeline::OcclusionStats& occlusion = m_pipeline->getOcclusionStats();
+		if (occlusion.occluder_count > 0) {
+			ImGui::LabelText("Occluders", "%d, %d triangles", occlusion.occluder_count, occlusion.occluder_triangle_count);
+			ImGui::LabelText("Occluded", "%d meshes, %d cells", occlusion.occluded_meshes, occlusion.occluded_pages);
+		}
 		ImGui::LabelText("Resolution", "%dx%d", m_width, m_height);
 	}
 	ImGui::End();
@@ -1456,7 +1792,21 @@ void SceneView::onWindowGUI()
 		vp.h = (int)size.y;
 		m_view->setViewport(vp);
 		m_pipeline->setViewport(vp);
-		m_pipeline->render(false);
+		const Vec2 mouse_pos = m_view->getMousePos();
+		if (!m_is_mouse_captured && mouse_pos.x >= 0 && mouse_pos.y >= 0 && mouse_pos.x < vp.w && mouse_pos.y < vp.h) {
+			m_gpu_picker->has_request = true;
+			m_gpu_picker->request.mouse_pos = mouse_pos;
+			m_gpu_picker->request.viewport = vp;
+		}
+		// debug shapes would pile up in render scene if they were not rendered
+		RenderScene* render_scene = m_pipeline->getScene();
+		if (m_editor.isGameMode() || (render_scene && render_scene->hasDebugShapes())) m_render_throttle.invalidate();
+		m_render_throttle.setViewport(vp);
+		const bool focused = m_is_mouse_captured || ImGui::IsWindowFocused() || ImGui::IsWindowHovered();
+		if (m_render_throttle.shouldRender(focused)) {
+			// output of the last render is kept until the next one, so it can be shown in skipped frames
+			m_pipeline->render(false);
+		}
 		m_view->m_draw_vertices.clear();
 		m_view->m_draw_cmds.clear();
 		m_view->inputFrame();
@@ -44,6 +44,9 @@ struct SceneView : StudioApp::GUIPlugin
 		void renderSelection();
 		void renderGizmos();
 		void renderIcons();
+		void renderPickIDs();
+		// entity under the mouse rendered by the last finished ID pass, if it was rendered for `mouse_pos` and the current view
+		EntityPtr getGPUPick(const Vec2& mouse_pos);
 		void captureMouse(bool capture);
 		RayCastModelHit castRay(float x, float y);
 		void handleDrop(const char* path, float x, float y);
@@ -87,9 +90,11 @@ struct SceneView : StudioApp::GUIPlugin
 		float m_camera_speed;
 		WorldEditor& m_editor;
 		UniquePtr<Pipeline> m_pipeline;
+		RenderThrottle m_render_throttle;
 		LogUI& m_log_ui;
 		Shader* m_debug_shape_shader;
 		struct UniverseViewImpl* m_view;
+		struct GPUPicker* m_gpu_picker = nullptr;
 
 		bool m_is_measure_active = false;
 		bool m_is_measure_from_set = false;
@@ -0,0 +1,328 @@
+#include "static_batches.h"
+#include "editor/asset_compiler.h"
+#include "editor/studio_app.h"
+#include "editor/world_editor.h"
+#include "engine/engine.h"
+#include "engine/hash_map.h"
+#include "engine/log.h"
+#include "engine/math.h"
+#include "engine/path.h"
+#include "engine/plugin.h"
+#include "engine/profiler.h"
+#include "engine/reflection.h"
+#include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include "engine/universe.h"
+#include "renderer/material.h"
+#include "renderer/model.h"
+#include "renderer/render_scene.h"
+#include "renderer/renderer.h"
+
+namespace Lumix {
+
+namespace StaticBatches {
+
+static const ComponentType MODEL_INSTANCE_TYPE = reflection::getComponentType("model_instance");
+
+struct BatchKey {
+	bool operator==(const BatchKey& rhs) const {
+		return cell.x == rhs.cell.x && cell.y == rhs.cell.y && material == rhs.material && decl_hash == rhs.decl_hash;
+	}
+
+	IVec2 cell;
+	Material* material;
+	u32 decl_hash;
+};
+
+struct BatchKeyHasher {
+	static u32 get(const BatchKey& key) {
+		return (u32)key.cell.x * 73856093 ^ (u32)key.cell.y * 19349663 ^ (u32)(uintptr)key.material ^ key.decl_hash;
+	}
+};
+
+struct Source {
+	Model* model;
+	u32 mesh_idx;
+	Transform transform;
+};
+
+struct Batch {
+	Batch(IAllocator& allocator) : sources(allocator) {}
+
+	Material* material;
+	const Mesh* layout; // all sources have the same vertex layout as this mesh
+	Array<Source> sources;
+	u32 vertices_count = 0;
+	u32 indices_count = 0;
+	DVec3 min = DVec3(DBL_MAX);
+	DVec3 max = DVec3(-DBL_MAX);
+};
+
+static i32 getAttributeOffset(const Mesh& mesh, Mesh::AttributeSemantic semantic, gpu::AttributeType& type) {
+	for (u32 i = 0; i < mesh.vertex_decl.attributes_count; ++i) {
+		if (mesh.attributes_semantic[i] != semantic) continue;
+		type = mesh.vertex_decl.attributes[i].type;
+		return mesh.vertex_decl.attributes[i].byte_offset;
+	}
+	return -1;
+}
+
+// normals and tangents are rotated, so only known encodings can be merged
+static bool canMerge(const Mesh& mesh) {
+	if (mesh.type != Mesh::RIGID) return false;
+	gpu::AttributeType type;
+	if (getAttributeOffset(mesh, Mesh::AttributeSemantic::POSITION, type) < 0 || type != gpu::AttributeType::FLOAT) return false;
+	const Mesh::AttributeSemantic rotated[] = {Mesh::AttributeSemantic::NORMAL, Mesh::AttributeSemantic::TANGENT};
+	for (Mesh::AttributeSemantic semantic : rotated) {
+		if (getAttributeOffset(mesh, semantic, type) >= 0 && type != gpu::AttributeType::FLOAT && type != gpu::AttributeType::I8) return false;
+	}
+	return true;
+}
+
+static void rotateDirection(u8* ptr, gpu::AttributeType type, const Quat& rot) {
+	if (type == gpu::AttributeType::FLOAT) {
+		Vec3 v;
+		memcpy(&v, ptr, sizeof(v));
+		v = rot.rotate(v);
+		memcpy(ptr, &v, sizeof(v));
+		return;
+	}
+
+	// same packing as in FBXImporter
+	i8* packed = (i8*)ptr;
+	const Vec3 v = rot.rotate(Vec3(packed[0], packed[1], packed[2]) * (1 / 127.f));
+	packed[0] = i8(clamp((v.x * 0.5f + 0.5f) * 255, 0.f, 255.f) - 128);
+	packed[1] = i8(clamp((v.y * 0.5f + 0.5f) * 255, 0.f, 255.f) - 128);
+	packed[2] = i8(clamp((v.z * 0.5f + 0.5f) * 255, 0.f, 255.f) - 128);
+}
+
+// same format as FBXImporter::writeModel writes, with unencoded buffers, no skeleton, one lod and no meshlets
+static void writeModel(const Batch& batch, const DVec3& origin, const HashMap<Model*, Array<Renderer::MemRef>*>& vertices, IAllocator& allocator, OutputMemoryStream& out) {
+	const Mesh& layout = *batch.layout;
+	const u32 stride = layout.render_data->vb_stride;
+	gpu::AttributeType pos_type, normal_type, tangent_type;
+	const i32 pos_offset = getAttributeOffset(layout, Mesh::AttributeSemantic::POSITION, pos_type);
+	const i32 normal_offset = getAttributeOffset(layout, Mesh::AttributeSemantic::NORMAL, normal_type);
+	const i32 tangent_offset = getAttributeOffset(layout, Mesh::AttributeSemantic::TANGENT, tangent_type);
+
+	OutputMemoryStream vertex_data(allocator);
+	OutputMemoryStream index_data(allocator);
+	vertex_data.resize(batch.vertices_count * stride);
+	const bool indices_16bit = batch.vertices_count <= 0xffFF;
+	index_data.resize(batch.indices_count * (indices_16bit ? 2 : 4));
+
+	AABB aabb(Vec3(FLT_MAX), Vec3(-FLT_MAX));
+	float origin_radius_squared = 0;
+	u32 base_vertex = 0;
+	u32 index_cursor = 0;
+	for (const Source& src : batch.sources) {
+		const Mesh& mesh = src.model->getMesh(src.mesh_idx);
+		const Renderer::MemRef& src_vertices = (*vertices[src.model])[src.mesh_idx];
+		const u32 count = src_vertices.size / stride;
+		u8* dst = vertex_data.getMutableData() + base_vertex * stride;
+		memcpy(dst, src_vertices.data, src_vertices.size);
+
+		const Vec3 rel_pos = Vec3(src.transform.pos - origin);
+		for (u32 i = 0; i < count; ++i) {
+			u8* vertex = dst + i * stride;
+			Vec3 p;
+			memcpy(&p, vertex + pos_offset, sizeof(p));
+			p = src.transform.rot.rotate(p * src.transform.scale) + rel_pos;
+			memcpy(vertex + pos_offset, &p, sizeof(p));
+			aabb.addPoint(p);
+			origin_radius_squared = maximum(origin_radius_squared, squaredLength(p));
+
+			if (normal_offset >= 0) rotateDirection(vertex + normal_offset, normal_type, src.transform.rot);
+			if (tangent_offset >= 0) rotateDirection(vertex + tangent_offset, tangent_type, src.transform.rot);
+		}
+
+		const u32 src_indices_count = mesh.render_data->indices_count;
+		for (u32 i = 0; i < src_indices_count; ++i) {
+			const u32 idx = base_vertex + (mesh.areIndices16() ? ((const u16*)mesh.indices.data())[i] : ((const u32*)mesh.indices.data())[i]);
+			if (indices_16bit) ((u16*)index_data.getMutableData())[index_cursor] = (u16)idx;
+			else ((u32*)index_data.getMutableData())[index_cursor] = idx;
+			++index_cursor;
+		}
+		base_vertex += count;
+	}
+
+	const Vec3 center = (aabb.min + aabb.max) * 0.5f;
+	float center_radius_squared = 0;
+	const u8* vertices_ptr = vertex_data.data();
+	for (u32 i = 0; i < batch.vertices_count; ++i) {
+		Vec3 p;
+		memcpy(&p, vertices_ptr + i * stride + pos_offset, sizeof(p));
+		center_radius_squared = maximum(center_radius_squared, squaredLength(p - center));
+	}
+
+	Model::FileHeader header;
+	header.magic = Model::FILE_MAGIC;
+	header.version = (u32)Model::FileVersion::ENCODED_BUFFERS;
+	out.write(header);
+
+	const i32 mesh_count = 1;
+	out.write(mesh_count);
+	u32 attributes_count = 0;
+	while (attributes_count < layout.vertex_decl.attributes_count && layout.attributes_semantic[attributes_count] != Mesh::AttributeSemantic::NONE) {
+		++attributes_count;
+	}
+	out.write(attributes_count);
+	for (u32 i = 0; i < attributes_count; ++i) {
+		out.write(layout.attributes_semantic[i]);
+		out.write(layout.vertex_decl.attributes[i].type);
+		out.write(layout.vertex_decl.attributes[i].components_count);
+	}
+	const char* material_path = batch.material->getPath().c_str();
+	out.write((u32)stringLength(material_path));
+	out.write(material_path, stringLength(material_path));
+	const char* mesh_name = "static_batch";
+	out.write((i32)stringLength(mesh_name));
+	out.write(mesh_name, stringLength(mesh_name));
+
+	out.write(i32(indices_16bit ? 2 : 4));
+	out.write((i32)batch.indices_count);
+	out.write(u32(0)); // not encoded
+	out.write(index_data.data(), index_data.size());
+
+	out.write((i32)vertex_data.size());
+	out.write(u32(0)); // not encoded
+	out.write(vertex_data.data(), vertex_data.size());
+
+	out.write(sqrtf(origin_radius_squared));
+	out.write(sqrtf(center_radius_squared));
+	out.write(aabb);
+
+	out.write(i32(0)); // bones
+
+	const u32 lod_count = 1;
+	out.write(lod_count);
+	out.write(i32(0)); // last mesh of the lod
+	out.write(FLT_MAX); // squared distance
+
+	out.write(u32(0)); // meshlets
+}
+
+bool bake(StudioApp& app) {
+	PROFILE_FUNCTION();
+	WorldEditor& editor = app.getWorldEditor();
+	Universe& universe = *editor.getUniverse();
+	RenderScene* scene = (RenderScene*)universe.getScene(MODEL_INSTANCE_TYPE);
+	if (!scene) return false;
+
+	IAllocator& allocator = app.getAllocator();
+	Renderer& renderer = *(Renderer*)app.getEngine().getPluginManager().getPlugin("renderer");
+
+	Array<EntityRef> old_batches(allocator);
+	Array<Batch> batches(allocator);
+	HashMap<BatchKey, u32, BatchKeyHasher> open_batches(allocator);
+	u32 skipped = 0;
+	for (EntityPtr e = scene->getFirstModelInstance(); e.isValid(); e = scene->getNextModelInstance(e)) {
+		const EntityRef entity = (EntityRef)e;
+		ModelInstance* mi = scene->getModelInstance(entity);
+		if (mi->flags.isSet(ModelInstance::STATIC_BATCH)) {
+			old_batches.push(entity);
+			// empty parent created by the previous bake
+			const EntityPtr parent = universe.getParent(entity);
+			if (parent.isValid() && !universe.hasComponent((EntityRef)parent, MODEL_INSTANCE_TYPE)) old_batches.push((EntityRef)parent);
+			continue;
+		}
+		if (!mi->flags.isSet(ModelInstance::BATCHED)) continue;
+		if (!mi->model || !mi->model->isReady() || mi->model->isSkinned()) {
+			++skipped;
+			continue;
+		}
+
+		const Transform tr = universe.getTransform(entity);
+		const IVec2 cell((i32)floor(tr.pos.x / CELL_SIZE), (i32)floor(tr.pos.z / CELL_SIZE));
+		const LODMeshIndices& lod = mi->model->getLODIndices()[0];
+		for (i32 mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
+			const Mesh& mesh = mi->model->getMesh(mesh_idx);
+			if (!canMerge(mesh)) {
+				++skipped;
+				continue;
+			}
+
+			const BatchKey key = {cell, mi->custom_material ? mi->custom_material : mesh.material, mesh.vertex_decl.hash};
+			const u32 mesh_vertices_count = mesh.vertices.size();
+			auto iter = open_batches.find(key);
+			if (!iter.isValid() || batches[iter.value()].vertices_count + mesh_vertices_count > MAX_VERTICES) {
+				Batch& batch = batches.emplace(allocator);
+				batch.material = key.material;
+				batch.layout = &mesh;
+				if (iter.isValid()) iter.value() = batches.size() - 1;
+				else open_batches.insert(key, batches.size() - 1);
+				iter = open_batches.find(key);
+			}
+
+			Batch& batch = batches[iter.value()];
+			batch.sources.push({mi->model, (u32)mesh_idx, tr});
+			batch.vertices_count += mesh_vertices_count;
+			batch.indices_count += mesh.render_data->indices_count;
+			batch.min = DVec3(minimum(batch.min.x, tr.pos.x), minimum(batch.min.y, tr.pos.y), minimum(batch.min.z, tr.pos.z));
+			batch.max = DVec3(maximum(batch.max.x, tr.pos.x), maximum(batch.max.y, tr.pos.y), maximum(batch.max.z, tr.pos.z));
+		}
+	}
+	if (skipped > 0) logWarning(skipped, " batched meshes can not be merged (not loaded, skinned or unsupported vertex format)");
+
+	// vertex data are not kept in memory after upload, so they are read from compiled models
+	HashMap<Model*, Array<Renderer::MemRef>*> vertices(allocator);
+	bool success = true;
+	for (const Batch& batch : batches) {
+		for (const Source& src : batch.sources) {
+			if (vertices.find(src.model).isValid()) continue;
+			Array<Renderer::MemRef>* model_vertices = LUMIX_NEW(allocator, Array<Renderer::MemRef>)(allocator);
+			vertices.insert(src.model, model_vertices);
+			const LODMeshIndices& lod = src.model->getLODIndices()[0];
+			if (!src.model->readVertices(lod.from, lod.to + 1, *model_vertices)) {
+				logError("Could not read vertices of ", src.model->getPath());
+				model_vertices->clear();
+				success = false;
+			}
+		}
+	}
+
+	if (success) {
+		editor.beginCommandGroup("bake_static_batches");
+		if (!old_batches.empty()) editor.destroyEntities(old_batches.begin(), old_batches.size());
+
+		const EntityRef parent = editor.addEntity();
+		editor.setEntityName(parent, "static_batches");
+
+		OutputMemoryStream blob(allocator);
+		for (i32 i = 0; i < batches.size(); ++i) {
+			const Batch& batch = batches[i];
+			const DVec3 origin = (batch.min + batch.max) * 0.5;
+			blob.clear();
+			writeModel(batch, origin, vertices, allocator, blob);
+
+			// there's no source file, so the compiled resource is loaded directly
+			const StaticString<LUMIX_MAX_PATH> path("universes/", universe.getName(), "_batches/", i, ".fbx");
+			if (!app.getAssetCompiler().writeCompiledResource(path, Span(blob.data(), (u32)blob.size()))) {
+				success = false;
+				break;
+			}
+			app.getEngine().getResourceManager().reload(Path(path));
+
+			const EntityRef entity = editor.addEntityAt(origin);
+			editor.makeParent(parent, entity);
+			editor.addComponent(Span(&entity, 1), MODEL_INSTANCE_TYPE);
+			editor.setProperty(MODEL_INSTANCE_TYPE, "", -1, "Static batch", Span(&entity, 1), true);
+			editor.setProperty(MODEL_INSTANCE_TYPE, "", -1, "Source", Span(&entity, 1), Path(path));
+		}
+		editor.endCommandGroup();
+		logInfo("Baked ", batches.size(), " static batches");
+	}
+
+	for (Array<Renderer::MemRef>* model_vertices : vertices) {
+		for (const Renderer::MemRef& mem : *model_vertices) {
+			if (mem.own) renderer.free(mem);
+		}
+		LUMIX_DELETE(allocator, model_vertices);
+	}
+	return success;
+}
+
+} // namespace StaticBatches
+
+} // namespace Lumix
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "engine/lumix.h"
+
+namespace Lumix {
+
+struct StudioApp;
+
+// offline merging of static model instances marked as `Batched`
+// instances are grouped by cell on XZ plane, material and vertex layout, each group is merged to one model
+// merged models are written as compiled resources and instantiated as `Static batch` model instances
+// source instances stay in the universe for editing, they are rendered only in editor, batches only in game
+namespace StaticBatches {
+
+static constexpr float CELL_SIZE = 64;
+// bigger groups are split to several batches
+static constexpr u32 MAX_VERTICES = 1 << 20;
+
+// destroys previous batches of the edited universe and bakes new ones, undoable
+bool bake(StudioApp& app);
+
+} // namespace StaticBatches
+
+} // namespace Lumix
@@ -11,7 +11,9 @@
 #include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
+#include "engine/lz4.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/prefab.h"
@@ -74,6 +76,8 @@ struct PaintTerrainCommand final : IEditorCommand
 		, m_can_be_merged(can_be_merged)
 		, m_new_data(editor.getAllocator())
 		, m_old_data(editor.getAllocator())
+		, m_compressed_old(editor.getAllocator())
+		, m_compressed_delta(editor.getAllocator())
 		, m_items(editor.getAllocator())
 		, m_action_type(action_type)
 		, m_textures_mask(textures_mask)
@@ -107,6 +111,21 @@ struct PaintTerrainCommand final : IEditorCommand
 
 	bool execute() override
 	{
+		if (m_is_compressed) {
+			Array<u8> old_data(m_world_editor.getAllocator());
+			Array<u8> new_data(m_world_editor.getAllocator());
+			decompress(old_data, new_data);
+			applyData(new_data);
+			return true;
+		}
+
+		// merged item, only its rectangle changed
+		if (m_has_dirty_rect) {
+			m_has_dirty_rect = false;
+			applyData(m_new_data, m_dirty_rect);
+			return true;
+		}
+
 		if (m_new_data.empty())
 		{
 			saveOldData();
@@ -117,7 +136,78 @@ struct PaintTerrainCommand final : IEditorCommand
 	}
 
 
-	void undo() override { applyData(m_old_data); }
+	void undo() override {
+		if (m_is_compressed) {
+			Array<u8> old_data(m_world_editor.getAllocator());
+			Array<u8> new_data(m_world_editor.getAllocator());
+			decompress(old_data, new_data);
+			applyData(old_data);
+			return;
+		}
+		applyData(m_old_data);
+	}
+
+
+	// old data and xor delta of new data are LZ4 compressed, delta is mostly zeros outside of the brush
+	void compact() override {
+		if (m_is_compressed || m_new_data.empty() || m_new_data.size() != m_old_data.size()) return;
+
+		Array<u8> delta(m_world_editor.getAllocator());
+		delta.resize(m_new_data.size());
+		for (i32 i = 0, c = m_new_data.size(); i < c; ++i) delta[i] = m_new_data[i] ^ m_old_data[i];
+
+		if (!compressBlock(m_old_data, m_compressed_old) || !compressBlock(delta, m_compressed_delta)) {
+			m_compressed_old.free();
+			m_compressed_delta.free();
+			return;
+		}
+
+		m_data_size = m_new_data.size();
+		m_old_data.free();
+		m_new_data.free();
+		m_is_compressed = true;
+	}
+
+
+	u64 getMemorySize() const override {
+		return m_old_data.capacity() + m_new_data.capacity() + m_compressed_old.capacity() + m_compressed_delta.capacity();
+	}
+
+
+	bool compressBlock(const Array<u8>& src, Array<u8>& dst) {
+		const i32 cap = LZ4_compressBound(src.size());
+		dst.resize(cap);
+		const i32 size = LZ4_compress_default((const char*)src.begin(), (char*)dst.begin(), src.size(), cap);
+		if (size <= 0) return false;
+		
+		Array<u8> tmp(m_world_editor.getAllocator());
+		tmp.resize(size);
+		memcpy(tmp.begin(), dst.begin(), size);
+		dst.swap(tmp);
+		return true;
+	}
+
+
+	void decompress(Array<u8>& old_data, Array<u8>& new_data) {
+		ASSERT(m_is_compressed);
+		old_data.resize(m_data_size);
+		new_data.resize(m_data_size);
+		const i32 old_res = LZ4_decompress_safe((const char*)m_compressed_old.begin(), (char*)old_data.begin(), m_compressed_old.size(), m_data_size);
+		const i32 delta_res = LZ4_decompress_safe((const char*)m_compressed_delta.begin(), (char*)new_data.begin(), m_compressed_delta.size(), m_data_size);
+		ASSERT(old_res == (i32)m_data_size && delta_res == (i32)m_data_size);
+		(void)old_res;
+		(void)delta_res;
+		for (u32 i = 0; i < m_data_size; ++i) new_data[i] ^= old_data[i];
+	}
+
+
+	void uncompact() {
+		if (!m_is_compressed) return;
+		decompress(m_old_data, m_new_data);
+		m_compressed_old.free();
+		m_compressed_delta.free();
+		m_is_compressed = false;
+	}
 
 
 	const char* getType() override
@@ -133,12 +223,23 @@ struct PaintTerrainCommand final : IEditorCommand
 			return false;
 		}
 		PaintTerrainCommand& my_command = static_cast<PaintTerrainCommand&>(command);
+		// merging to a command which was compacted, e.g. after undo
+		my_command.uncompact();
 		if (m_terrain == my_command.m_terrain && m_action_type == my_command.m_action_type &&
 			m_textures_mask == my_command.m_textures_mask && m_layers_masks == my_command.m_layers_masks)
 		{
+			Texture* texture = getDestinationTexture();
 			my_command.m_items.push(m_items.back());
 			my_command.resizeData();
-			my_command.rasterItem(getDestinationTexture(), my_command.m_new_data, m_items.back());
+			my_command.rasterItem(texture, my_command.m_new_data, m_items.back());
+			
+			Rectangle dirty = m_items.back().getBoundingRectangle(texture->width);
+			dirty.from_x = maximum(dirty.from_x, my_command.m_x);
+			dirty.from_y = maximum(dirty.from_y, my_command.m_y);
+			dirty.to_x = minimum(dirty.to_x, my_command.m_x + my_command.m_width);
+			dirty.to_y = minimum(dirty.to_y, my_command.m_y + my_command.m_height);
+			my_command.m_dirty_rect = dirty;
+			my_command.m_has_dirty_rect = true;
 			return true;
 		}
 		return false;
@@ -222,6 +323,15 @@ private:
 	}
 
 
+	// rows are independent, so they are rasterized on all workers
+	template <typename F>
+	static void forEachRow(const Rectangle& rect, const F& f) {
+		jobs::forEach(maximum(rect.to_y - rect.from_y, 0), 16, [&](i32 from, i32 to){
+			for (i32 j = from; j < to; ++j) f(rect.from_y + j);
+		});
+	}
+
+
 	void rasterLayerItem(Texture* texture, Array<u8>& data, Item& item)
 	{
 		int texture_size = texture->width;
@@ -296,12 +406,12 @@ private:
 			return;
 		}
 
-		float fx = 0;
-		float fstepx = 1.0f / (r.to_x - r.from_x);
-		float fstepy = 1.0f / (r.to_y - r.from_y);
-		for (int i = r.from_x, end = r.to_x; i < end; ++i, fx += fstepx) {
-			float fy = 0;
-			for (int j = r.from_y, end2 = r.to_y; j < end2; ++j, fy += fstepy) {
+		const float fstepx = 1.0f / (r.to_x - r.from_x);
+		const float fstepy = 1.0f / (r.to_y - r.from_y);
+		forEachRow(r, [&](int j){
+			const float fy = (j - r.from_y) * fstepy;
+			float fx = 0;
+			for (int i = r.from_x, end = r.to_x; i < end; ++i, fx += fstepx) {
 				if (isMasked(fx, fy)) {
 					int offset = 4 * (i - m_x + (j - m_y) * m_width) + 2;
 					float attenuation = getAttenuation(item, i, j, texture_size);
@@ -317,7 +427,7 @@ private:
 					}
 				}
 			}
-		}
+		});
 	}
 
 
@@ -329,9 +439,8 @@ private:
 		Rectangle rect = item.getBoundingRectangle(texture_size);
 
 		float avg = computeAverage16(texture, rect.from_x, rect.to_x, rect.from_y, rect.to_y);
-		for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
-		{
-			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
+		forEachRow(rect, [&](int j){
+			for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
 			{
 				float attenuation = getAttenuation(item, i, j, texture_size);
 				int offset = i - m_x + (j - m_y) * m_width;
@@ -339,7 +448,7 @@ private:
 				x += u16((avg - x) * item.m_amount * attenuation);
 				((u16*)&data[0])[offset] = x;
 			}
-		}
+		});
 	}
 
 
@@ -350,9 +459,8 @@ private:
 		int texture_size = texture->width;
 		Rectangle rect = item.getBoundingRectangle(texture_size);
 
-		for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
-		{
-			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
+		forEachRow(rect, [&](int j){
+			for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
 			{
 				int offset = i - m_x + (j - m_y) * m_width;
 				float dist = sqrtf(
@@ -364,7 +472,7 @@ private:
 				u16 old_value = ((u16*)&data[0])[offset];
 				((u16*)&data[0])[offset] = (u16)(m_flat_height * t + old_value * (1-t));
 			}
-		}
+		});
 	}
 
 
@@ -399,9 +507,8 @@ private:
 		const float STRENGTH_MULTIPLICATOR = 256.0f;
 		float amount = maximum(item.m_amount * item.m_amount * STRENGTH_MULTIPLICATOR, 1.0f);
 
-		for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
-		{
-			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
+		forEachRow(rect, [&](int j){
+			for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
 			{
 				float attenuation = getAttenuation(item, i, j, texture_size);
 				int offset = i - m_x + (j - m_y) * m_width;
@@ -412,7 +519,7 @@ private:
 														   : maximum(-add, -x);
 				((u16*)&data[0])[offset] = x;
 			}
-		}
+		});
 	}
 
 
@@ -464,31 +571,59 @@ private:
 
 	void applyData(Array<u8>& data)
 	{
+		Rectangle rect;
+		rect.from_x = m_x;
+		rect.from_y = m_y;
+		rect.to_x = m_x + m_width;
+		rect.to_y = m_y + m_height;
+		applyData(data, rect);
+	}
+
+
+	// `rect` is a part of the command's rectangle, only it is copied to the texture and uploaded
+	void applyData(Array<u8>& data, const Rectangle& rect)
+	{
+		const int w = rect.to_x - rect.from_x;
+		const int h = rect.to_y - rect.from_y;
+		if (w <= 0 || h <= 0) return;
+
 		auto texture = getDestinationTexture();
 		const u32 bpp = gpu::getBytesPerPixel(texture->format);
 
-		for (int j = m_y; j < m_y + m_height; ++j)
+		for (int j = rect.from_y; j < rect.to_y; ++j)
 		{
-			for (int i = m_x; i < m_x + m_width; ++i)
-			{
-				int index = bpp * (i + j * texture->width);
-				for (u32 k = 0; k < bpp; ++k)
-				{
-					texture->getData()[index + k] = data[bpp * (i - m_x + (j - m_y) * m_width) + k];
-				}
-			}
+			memcpy(&texture->getData()[bpp * (rect.from_x + j * texture->width)]
+				, &data[bpp * (rect.from_x - m_x + (j - m_y) * m_width)]
+				, bpp * w);
 		}
-		texture->onDataUpdated(m_x, m_y, m_width, m_height);
+		texture->onDataUpdated(rect.from_x, rect.from_y, w, h);
 
-		if (m_action_type != TerrainEditor::LAYER && m_action_type != TerrainEditor::REMOVE_GRASS)
+		RenderScene* render_scene = (RenderScene*)m_world_editor.getUniverse()->getScene(TERRAIN_TYPE);
+		if (m_action_type == TerrainEditor::LAYER) {
+			render_scene->getTerrain(m_terrain)->onSplatmapChanged(rect.from_x, rect.from_y, w, h);
+		}
+		else if (m_action_type != TerrainEditor::REMOVE_GRASS)
 		{
+			render_scene->getTerrain(m_terrain)->onHeightmapChanged(rect.from_x, rect.from_y, w, h);
+
 			IScene* scene = m_world_editor.getUniverse()->getScene(crc32("physics"));
 			if (!scene) return;
 
 			auto* phy_scene = static_cast<PhysicsScene*>(scene);
 			if (!scene->getUniverse().hasComponent(m_terrain, HEIGHTFIELD_TYPE)) return;
 
-			phy_scene->updateHeighfieldData(m_terrain, m_x, m_y, m_width, m_height, &data[0], bpp);
+			if (w == m_width && h == m_height) {
+				phy_scene->updateHeighfieldData(m_terrain, m_x, m_y, m_width, m_height, &data[0], bpp);
+				return;
+			}
+
+			// physics expects tightly packed rectangle
+			Array<u8> tmp(m_world_editor.getAllocator());
+			tmp.resize(bpp * w * h);
+			for (int j = 0; j < h; ++j) {
+				memcpy(&tmp[bpp * j * w], &data[bpp * (rect.from_x - m_x + (j + rect.from_y - m_y) * m_width)], bpp * w);
+			}
+			phy_scene->updateHeighfieldData(m_terrain, rect.from_x, rect.from_y, w, h, tmp.begin(), bpp);
 		}
 	}
 
@@ -565,6 +700,12 @@ private:
 	WorldEditor& m_world_editor;
 	Array<u8> m_new_data;
 	Array<u8> m_old_data;
+	Array<u8> m_compressed_old;
+	Array<u8> m_compressed_delta;
+	bool m_is_compressed = false;
+	u32 m_data_size = 0;
+	Rectangle m_dirty_rect;
+	bool m_has_dirty_rect = false;
 	u64 m_textures_mask;
 	u16 m_grass_mask;
 	int m_width;
@@ -1,6 +1,11 @@
+#include "engine/atomic.h"
+#include "engine/crc32.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/stream.h"
+#include "engine/string.h"
 #include "font.h"
 #include "renderer/texture.h"
 #include "renderer/renderer.h"
@@ -17,14 +22,54 @@
 namespace Lumix
 {
 
+static constexpr u32 MAX_TEXT_RUNS_PER_FONT = 256;
+static constexpr u32 ATLAS_PAGE_SIZE = 1024;
+// least recently used page is evicted when all pages are full
+static constexpr u32 MAX_ATLAS_PAGES = 8;
+static constexpr u32 GLYPH_PADDING = 1;
+
+struct TextRun {
+	TextRun(IAllocator& allocator) : text(allocator), quads(allocator) {}
+
+	String text;
+	u32 hash;
+	Array<TextQuad> quads;
+	TextRun* prev = nullptr;
+	TextRun* next = nullptr;
+};
+
 struct Font {
-	Font(IAllocator& allocator) : glyphs(allocator) {}
+	Font(IAllocator& allocator)
+		: allocator(allocator)
+		, glyphs(allocator)
+		, requests(allocator)
+		, runs(allocator)
+	{}
+
+	~Font() { clearRuns(); }
+
+	void clearRuns() {
+		for (TextRun* run : runs) LUMIX_DELETE(allocator, run);
+		runs.clear();
+		lru_first = lru_last = nullptr;
+	}
+
+	IAllocator& allocator;
 	FontResource* resource;
-	HashMap<u32, Glyph> glyphs;
+	FT_Face face = nullptr;
+	// contains also requested glyphs which are not rasterized yet
+	mutable HashMap<u32, Glyph> glyphs;
+	mutable Array<u32> requests;
+	// bit per atlas page, set when a glyph from the page is used
+	mutable u32 used_pages = 0;
 	u32 font_size = 0;
 	float descender = 0;
 	float ascender = 0;
 	u32 ref = 0;
+	// text layout cache, lru_first is the most recently used
+	mutable HashMap<u32, TextRun*> runs;
+	mutable TextRun* lru_first = nullptr;
+	mutable TextRun* lru_last = nullptr;
 };
 
 float getAdvanceY(const Font& font) { return float(font.font_size); }
@@ -33,8 +78,38 @@ float getAscender(const Font& font) { return font.ascender; }
 
 const Glyph* findGlyph(const Font& font, u32 codepoint) {
 	auto iter = font.glyphs.find(codepoint);
-	if (!iter.isValid()) return nullptr;
-	return &iter.value();
+	if (!iter.isValid()) {
+		Glyph glyph = {};
+		glyph.codepoint = codepoint;
+		glyph.page = Glyph::NOT_READY;
+		font.glyphs.insert(codepoint, glyph);
+		font.requests.push(codepoint);
+		return nullptr;
+	}
+	const Glyph& glyph = iter.value();
+	if (glyph.page == Glyph::NOT_READY) return nullptr;
+	font.used_pages |= 1 << glyph.page;
+	return &glyph;
+}
+
+// invalid sequences are returned byte by byte
+static u32 decodeUTF8(const char*& str, const char* str_end) {
+	const u8* c = (const u8*)str;
+	u32 len = 1;
+	u32 cp = c[0];
+	if ((c[0] & 0xe0) == 0xc0) { len = 2; cp = c[0] & 0x1f; }
+	else if ((c[0] & 0xf0) == 0xe0) { len = 3; cp = c[0] & 0x0f; }
+	else if ((c[0] & 0xf8) == 0xf0) { len = 4; cp = c[0] & 0x07; }
+
+	for (u32 i = 1; i < len; ++i) {
+		if ((const char*)c + i == str_end || (c[i] & 0xc0) != 0x80) {
+			++str;
+			return c[0];
+		}
+		cp = (cp << 6) | (c[i] & 0x3f);
+	}
+	str += len;
+	return cp;
 }
 
 Vec2 measureTextA(const Font& font, const char* str, const char* str_end) {
@@ -43,188 +118,371 @@ Vec2 measureTextA(const Font& font, const char* str, const char* str_end) {
 	res.y = (float)font.font_size;
 	const char* c = str;
 	while (*c && c != str_end) {
-		auto iter = font.glyphs.find(*c);
-		if (iter.isValid()) {
-			const Glyph& glyph = iter.value();
-			res.x += glyph.advance_x;
-		}
-		++c;
+		const Glyph* glyph = findGlyph(font, decodeUTF8(c, str_end));
+		if (glyph) res.x += glyph->advance_x;
 	}
 	return res;
 }
 
-struct ToChar {
+static void unlinkRun(const Font& font, TextRun* run) {
+	if (run->prev) run->prev->next = run->next;
+	else font.lru_first = run->next;
+	if (run->next) run->next->prev = run->prev;
+	else font.lru_last = run->prev;
+	run->prev = run->next = nullptr;
+}
+
+static void pushFrontRun(const Font& font, TextRun* run) {
+	run->next = font.lru_first;
+	if (font.lru_first) font.lru_first->prev = run;
+	font.lru_first = run;
+	if (!font.lru_last) font.lru_last = run;
+}
+
+Span<const TextQuad> layoutText(const Font& font, const char* str) {
+	const u32 hash = crc32(str);
+	TextRun* run;
+	auto iter = font.runs.find(hash);
+	if (iter.isValid()) {
+		run = iter.value();
+		unlinkRun(font, run);
+		pushFrontRun(font, run);
+		if (run->text == str) return Span<const TextQuad>(run->quads.begin(), run->quads.end());
+		// hash collision, run is reused for the new text
+	}
+	else if (font.runs.size() >= MAX_TEXT_RUNS_PER_FONT) {
+		run = font.lru_last;
+		font.runs.erase(run->hash);
+		font.runs.insert(hash, run);
+		unlinkRun(font, run);
+		pushFrontRun(font, run);
+	}
+	else {
+		run = LUMIX_NEW(font.allocator, TextRun)(font.allocator);
+		font.runs.insert(hash, run);
+		pushFrontRun(font, run);
+	}
+
+	run->text = str;
+	run->hash = hash;
+	run->quads.clear();
+
+	Vec2 p(0, 0);
+	for (const char* c = str; *c;) {
+		if (*c == '\r') { ++c; continue; }
+		if (*c == '\n') {
+			++c;
+			p.x = 0;
+			p.y += getAdvanceY(font);
+			continue;
+		}
+		const Glyph* glyph = findGlyph(font, decodeUTF8(c, nullptr));
+		if (!glyph) {
+			p.x += 16;
+			continue;
+		}
+
+		TextQuad& quad = run->quads.emplace();
+		quad.from = p + Vec2(glyph->x0, glyph->y0);
+		quad.to = p + Vec2(glyph->x1, glyph->y1);
+		quad.uv0 = Vec2(glyph->u0, glyph->v0);
+		quad.uv1 = Vec2(glyph->u1, glyph->v1);
+		quad.texture = glyph->texture;
+		p.x += glyph->advance_x;
+	}
+	return Span<const TextQuad>(run->quads.begin(), run->quads.end());
+}
+
+struct AtlasPage {
+	AtlasPage(IAllocator& allocator) : nodes(allocator) {}
+
+	Texture* texture = nullptr;
+	stbrp_context packer;
+	Array<stbrp_node> nodes;
+	u32 last_used = 0;
+};
+
+struct GlyphRequest {
+	Font* font;
+	u32 codepoint;
+};
+
+struct RasterizedGlyph {
 	Font* font;
 	u32 codepoint;
+	bool is_valid;
 	u32 bmp_offset;
-	u32 advance_x;
+	u32 w, h;
+	float x0, y0;
+	float advance_x;
 };
 
-static void blit(FT_Bitmap* bitmap,  Array<u8>* out) {
+struct FontAtlas {
+	FontAtlas(IAllocator& allocator)
+		: pages(allocator)
+		, requests(allocator)
+		, results(allocator)
+		, bitmaps(allocator)
+	{}
+
+	FT_MemoryRec_ memory;
+	FT_Library library = nullptr;
+	Array<AtlasPage*> pages;
+	u32 frame = 0;
+
+	// owned by the rasterization job while in_flight != 0
+	Array<GlyphRequest> requests;
+	Array<RasterizedGlyph> results;
+	Array<u8> bitmaps;
+	jobs::SignalHandle signal = jobs::INVALID_HANDLE;
+	i32 volatile in_flight = 0;
+};
+
+static void blit(FT_Bitmap* bitmap, Array<u8>* out) {
 	ASSERT(bitmap->pixel_mode == FT_PIXEL_MODE_GRAY);
 	const u32 offset = out->size();
 	const u32 src_pitch = bitmap->pitch;
 	const u8* src = bitmap->buffer;
-	u8* dst = out->begin() + offset;
 	out->resize(out->size() + bitmap->width * bitmap->rows);
+	u8* dst = out->begin() + offset;
 	for (u32 y = 0; y < bitmap->rows; ++y, src += src_pitch, dst += bitmap->width) {
 		memcpy(dst, src, bitmap->width);
 	}
 }
 
-static void blit(const ToChar& tc, const Array<u8>& src_bmp, const IVec2& size, Array<u32>* out) {
-	const Glyph& c = tc.font->glyphs[tc.codepoint];
-	const u8* src = &src_bmp[tc.bmp_offset];
-	const u32 u0 = u32(c.u0 * size.x + 0.5f);
-	const u32 v0 = u32(c.v0 * size.y + 0.5f);
-	const u32 u1 = u32(c.u1 * size.x + 0.5f);
-	const u32 v1 = u32(c.v1 * size.y + 0.5f);
-	const u32 w = u1 - u0;
-	const u32 h = v1 - v0;
-	u32* dst = &(*out)[u0 + v0 * size.x];
-	for (u32 y = 0; y < h; ++y, dst += size.x, src += w) {
-		for (u32 x = 0; x < w; ++x) {
-			dst[x] = 0x00ffFFff | ((u32)src[x] << 24);
-		}
+// runs on a worker, faces are not touched by the main thread until it finishes
+static void rasterizeGlyphs(void* data) {
+	PROFILE_FUNCTION();
+	FontAtlas* atlas = (FontAtlas*)data;
+	for (const GlyphRequest& req : atlas->requests) {
+		RasterizedGlyph& res = atlas->results.emplace();
+		res.font = req.font;
+		res.codepoint = req.codepoint;
+		res.is_valid = false;
+
+		FT_Face face = req.font->face;
+		const u32 glyph_index = FT_Get_Char_Index(face, req.codepoint);
+		if (glyph_index == 0) continue;
+		if (FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP) != 0) continue;
+
+		FT_GlyphSlot slot = face->glyph;
+		if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) != 0) continue;
+
+		res.bmp_offset = atlas->bitmaps.size();
+		res.w = slot->bitmap.width;
+		res.h = slot->bitmap.rows;
+		res.x0 = float(slot->bitmap_left);
+		res.y0 = float(-slot->bitmap_top);
+		res.advance_x = float(((slot->advance.x + 63) & -64) / 64);
+		blit(&slot->bitmap, &atlas->bitmaps);
+		res.is_valid = true;
+	}
+	atomicDecrement(&atlas->in_flight);
+}
+
+static AtlasPage* createPage(FontAtlas& atlas, Renderer& renderer, IAllocator& allocator) {
+	AtlasPage* page = LUMIX_NEW(allocator, AtlasPage)(allocator);
+	page->nodes.resize(ATLAS_PAGE_SIZE);
+	stbrp_init_target(&page->packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, page->nodes.begin(), page->nodes.size());
+
+	Array<u32> pixels(allocator);
+	pixels.resize(ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE);
+	memset(pixels.begin(), 0, pixels.byte_size());
+	if (atlas.pages.empty()) {
+		// white pixel for untextured draw2d commands
+		pixels[0] = 0xffFFffFF;
+		stbrp_rect r = {};
+		r.w = r.h = 2;
+		stbrp_pack_rects(&page->packer, &r, 1);
 	}
+
+	const StaticString<32> name("draw2d_atlas_", atlas.pages.size());
+	auto& texture_manager = renderer.getTextureManager();
+	page->texture = LUMIX_NEW(allocator, Texture)(Path(name), texture_manager, renderer, allocator);
+	page->texture->create(ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, gpu::TextureFormat::RGBA8, pixels.begin(), pixels.byte_size());
+	atlas.pages.push(page);
+	return page;
 }
 
 Texture* FontManager::getAtlasTexture() {
-	if (m_dirty) build();
-	return m_atlas_texture;
+	return m_atlas->pages[0]->texture;
 }
 
-bool FontManager::build()
-{
-	ASSERT(m_dirty);
-	for(Font* font : m_fonts) {
-		if (!font->resource->isReady()) return false;
-	}
-	m_dirty = false;
-	FT_MemoryRec_ memory_rec = {};
-	memory_rec.user = &m_allocator;
-	memory_rec.alloc = [](FT_Memory memory, long size) -> void* { 
-		IAllocator* alloc = (IAllocator*)memory->user;
-		return alloc->allocate(size);
-	};
-	memory_rec.free = [](FT_Memory memory, void* block) -> void { 
-		IAllocator* alloc = (IAllocator*)memory->user;
-		alloc->deallocate(block);
-	};
-	memory_rec.realloc = [](FT_Memory memory, long cur_size, long new_size, void* block) -> void* {
-		IAllocator* alloc = (IAllocator*)memory->user;
-		return alloc->reallocate(block, new_size);
-	};
+void FontManager::waitForRasterization() {
+	jobs::wait(m_atlas->signal);
+	m_atlas->signal = jobs::INVALID_HANDLE;
+}
 
-	FT_Library ft_library;
-	FT_Error error = FT_New_Library(&memory_rec, &ft_library);
-	if (error != 0) return false;
+void FontManager::evictPage(u32 page_idx) {
+	AtlasPage* page = m_atlas->pages[page_idx];
+	stbrp_init_target(&page->packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, page->nodes.begin(), page->nodes.size());
+	if (page_idx == 0) {
+		// keep the white pixel
+		stbrp_rect r = {};
+		r.w = r.h = 2;
+		stbrp_pack_rects(&page->packer, &r, 1);
+	}
+	// evicted glyphs are requested again by findGlyph
+	for (Font* font : m_fonts) {
+		font->glyphs.eraseIf([page_idx](const Glyph& g){ return g.page == page_idx; });
+		font->clearRuns();
+	}
+}
 
-	FT_Add_Default_Modules(ft_library);
+void FontManager::uploadRasterized() {
+	PROFILE_FUNCTION();
+	FontAtlas& atlas = *m_atlas;
+	for (const RasterizedGlyph& res : atlas.results) {
+		res.font->clearRuns();
+		// failed glyphs stay NOT_READY, so they are not requested again
+		if (!res.is_valid) continue;
+
+		Glyph glyph;
+		glyph.codepoint = res.codepoint;
+		glyph.x0 = res.x0;
+		glyph.y0 = res.y0;
+		glyph.x1 = res.x0 + res.w;
+		glyph.y1 = res.y0 + res.h;
+		glyph.advance_x = res.advance_x;
+		if (res.w == 0 || res.h == 0) {
+			// e.g. space, nothing to draw
+			glyph.u0 = glyph.v0 = glyph.u1 = glyph.v1 = 0;
+			glyph.page = 0;
+			glyph.texture = nullptr;
+			res.font->glyphs[res.codepoint] = glyph;
+			continue;
+		}
 
-	Array<u8> tmp_bmp(m_allocator);
-	tmp_bmp.reserve(1024 * 1024);
-	Array<stbrp_rect> rects(m_allocator);
-	Array<ToChar> to_char(m_allocator);
-	constexpr u32 PADDING = 1;
+		stbrp_rect r = {};
+		r.w = res.w + 2 * GLYPH_PADDING;
+		r.h = res.h + 2 * GLYPH_PADDING;
+		if (r.w > ATLAS_PAGE_SIZE || r.h > ATLAS_PAGE_SIZE) continue;
 
-	for(Font* font : m_fonts) {
-		FT_Face face;
-		error = FT_New_Memory_Face(ft_library, font->resource->file_data.data(), (u32)font->resource->file_data.size(), 0, &face);
-		if (error != 0) {
-			logError("Failed to create font ", font->resource->getPath());
-			continue;
+		u32 page_idx = 0;
+		for (; page_idx < (u32)atlas.pages.size(); ++page_idx) {
+			stbrp_pack_rects(&atlas.pages[page_idx]->packer, &r, 1);
+			if (r.was_packed) break;
 		}
-	
-		FT_Size_RequestRec size_req;
-		size_req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
-		size_req.width = 0;
-		size_req.height = (u32)font->font_size * 64;
-		size_req.horiResolution = 0;
-		size_req.vertResolution = 0;
-		error = FT_Request_Size(face, &size_req);
-		if (error != 0) {
-			logError("Failed to request font size ", font->font_size, " for ", font->resource->getPath());
-			continue;
+		if (!r.was_packed) {
+			if ((u32)atlas.pages.size() < MAX_ATLAS_PAGES) {
+				createPage(atlas, m_renderer, m_allocator);
+			}
+			else {
+				page_idx = 0;
+				for (u32 i = 1; i < (u32)atlas.pages.size(); ++i) {
+					if (atlas.pages[i]->last_used < atlas.pages[page_idx]->last_used) page_idx = i;
+				}
+				evictPage(page_idx);
+			}
+			stbrp_pack_rects(&atlas.pages[page_idx]->packer, &r, 1);
+			if (!r.was_packed) continue;
 		}
 
-		error = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
-		if (error != 0) {
-			logError("Failed to select unicode charmap of font ", font->resource->getPath());
-			continue;
-		}
-		
-		font->descender = face->size->metrics.descender / 64.f;
-		font->ascender = face->size->metrics.ascender / 64.f;
-		for (Glyph& c : font->glyphs) {
-			c.u0 = c.v0 = 0;
-			c.u1 = c.v1 = 1;
-
-			const u32 glyph_index = FT_Get_Char_Index(face, c.codepoint);
-			if (glyph_index == 0) continue;
-
-			error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP);
-			if (error) continue;
-
-			FT_GlyphSlot slot = face->glyph;
-			error = FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-			if (error != 0) continue;
-
-			FT_Bitmap* ft_bitmap = &face->glyph->bitmap;
-			stbrp_rect& r = rects.emplace();
-			r.w = ft_bitmap->width + 2 * PADDING;
-			r.h = ft_bitmap->rows + 2 * PADDING;
-			to_char.push({font, c.codepoint, (u32)tmp_bmp.size(), static_cast<u32>(slot->advance.x)});
-			blit(ft_bitmap, &tmp_bmp);
-			c.x0 = float(slot->bitmap_left);
-			c.y0 = float(-slot->bitmap_top);
-			c.x1 = float(c.x0 + r.w - 2 * PADDING);
-			c.y1 = float(c.y0 + r.h - 2 * PADDING);
+		AtlasPage* page = atlas.pages[page_idx];
+		page->last_used = atlas.frame;
+		glyph.page = page_idx;
+		glyph.texture = page_idx == 0 ? nullptr : &page->texture->handle;
+		glyph.u0 = (r.x + GLYPH_PADDING) / (float)ATLAS_PAGE_SIZE;
+		glyph.v0 = (r.y + GLYPH_PADDING) / (float)ATLAS_PAGE_SIZE;
+		glyph.u1 = float(r.x + r.w - GLYPH_PADDING) / ATLAS_PAGE_SIZE;
+		glyph.v1 = float(r.y + r.h - GLYPH_PADDING) / ATLAS_PAGE_SIZE;
+		res.font->glyphs[res.codepoint] = glyph;
+
+		const Renderer::MemRef mem = m_renderer.allocate(r.w * r.h * sizeof(u32));
+		u32* dst = (u32*)mem.data;
+		memset(dst, 0, mem.size);
+		const u8* src = &atlas.bitmaps[res.bmp_offset];
+		for (u32 y = 0; y < res.h; ++y) {
+			u32* row = dst + (y + GLYPH_PADDING) * r.w + GLYPH_PADDING;
+			for (u32 x = 0; x < res.w; ++x) {
+				row[x] = 0x00ffFFff | ((u32)src[x + y * res.w] << 24);
+			}
 		}
+		m_renderer.updateTexture(page->texture->handle, 0, r.x, r.y, r.w, r.h, gpu::TextureFormat::RGBA8, mem);
 	}
+	atlas.results.clear();
+	atlas.bitmaps.clear();
+	++m_atlas_version;
+}
 
-	stbrp_context ctx;
-	Array<stbrp_node> nodes(m_allocator);
-	nodes.resize(2048);
-	stbrp_init_target(&ctx, 2048, 32 * 1024, nodes.begin(), nodes.size());
-	stbrp_pack_rects(&ctx, rects.begin(), rects.size());
-
-	u32 w = 2048;
-	u32 h = 1;
-	for (const stbrp_rect& r : rects) {
-		ASSERT(u32(r.x + r.w) <= w);
-		h = maximum(h, r.y + r.h);
+void FontManager::update() {
+	PROFILE_FUNCTION();
+	FontAtlas& atlas = *m_atlas;
+	++atlas.frame;
+	for (Font* font : m_fonts) {
+		for (u32 i = 0; i < (u32)atlas.pages.size(); ++i) {
+			if (font->used_pages & (1 << i)) atlas.pages[i]->last_used = atlas.frame;
+		}
+		font->used_pages = 0;
 	}
 
-	for (const stbrp_rect& r : rects) {
-		const ToChar& tc = to_char[int(&r - rects.begin())];
-		Glyph& c = tc.font->glyphs[tc.codepoint];
-		c.advance_x = float(((tc.advance_x + 63) & -64) / 64);
-		c.u0 = (r.x + PADDING) / (float)w;
-		c.v0 = (r.y + PADDING) / (float)h;
-		c.u1 = float(r.x + r.w - PADDING) / w;
-		c.v1 = float(r.y + r.h - PADDING) / h;
-	}
+	if (atlas.in_flight != 0) return;
+	waitForRasterization();
+	if (!atlas.results.empty()) uploadRasterized();
 
-	Array<u32> pixels(m_allocator);
-	pixels.resize(w * h);
-	for (u32& p : pixels) p = 0;
-	for (const ToChar& tc : to_char) {
-		blit(tc, tmp_bmp, IVec2(w, h), &pixels);
-	}
+	// faces can be created only while no rasterization is running
+	atlas.requests.clear();
+	for (Font* font : m_fonts) {
+		if (!font->face && font->resource->isReady()) {
+			FT_Face face;
+			FT_Error error = FT_New_Memory_Face(atlas.library, font->resource->file_data.data(), (u32)font->resource->file_data.size(), 0, &face);
+			if (error != 0) {
+				logError("Failed to create font ", font->resource->getPath());
+				font->requests.clear();
+				continue;
+			}
+
+			FT_Size_RequestRec size_req;
+			size_req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
+			size_req.width = 0;
+			size_req.height = (u32)font->font_size * 64;
+			size_req.horiResolution = 0;
+			size_req.vertResolution = 0;
+			error = FT_Request_Size(face, &size_req);
+			if (error != 0) {
+				logError("Failed to request font size ", font->font_size, " for ", font->resource->getPath());
+				FT_Done_Face(face);
+				font->requests.clear();
+				continue;
+			}
+
+			error = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+			if (error != 0) {
+				logError("Failed to select unicode charmap of font ", font->resource->getPath());
+				FT_Done_Face(face);
+				font->requests.clear();
+				continue;
+			}
+
+			font->face = face;
+			font->descender = face->size->metrics.descender / 64.f;
+			font->ascender = face->size->metrics.ascender / 64.f;
+			// ascii is almost always needed, so rasterize it in one batch
+			for (u32 cp = 0x20; cp < 0x7f; ++cp) findGlyph(*font, cp);
+		}
+		if (!font->face) continue;
 
-	pixels[0] = 0xffFFffFF;
-	if (m_atlas_texture) {
-		m_atlas_texture->destroy();
-	}
-	else {
-		auto& texture_manager = m_renderer.getTextureManager();
-		m_atlas_texture = LUMIX_NEW(m_allocator, Texture)(Path("draw2d_atlas"), texture_manager, m_renderer, m_allocator);
+		for (u32 cp : font->requests) atlas.requests.push({font, cp});
+		font->requests.clear();
 	}
-	m_atlas_texture->create(w, h, gpu::TextureFormat::RGBA8, pixels.begin(), pixels.byte_size());
 
-	FT_Done_Library(ft_library);
-	return true;
+	if (atlas.requests.empty()) return;
+
+	atomicIncrement(&atlas.in_flight);
+	jobs::run(&atlas, &rasterizeGlyphs, &atlas.signal, jobs::Priority::LOW);
+}
+
+void FontManager::releaseFace(Font& font) {
+	if (!font.face) return;
+
+	// rasterization job could use the face
+	waitForRasterization();
+	m_atlas->results.eraseItems([&font](const RasterizedGlyph& g){ return g.font == &font; });
+	FT_Done_Face(font.face);
+	font.face = nullptr;
+	font.glyphs.clear();
+	font.requests.clear();
+	font.clearRuns();
 }
 
 
@@ -238,6 +496,17 @@ FontResource::FontResource(const Path& path, ResourceManager& manager, IAllocato
 }
 
 
+void FontResource::unload()
+{
+	// faces reference file_data
+	auto& manager = (FontManager&)m_resource_manager;
+	for (Font* f : manager.m_fonts) {
+		if (f->resource == this) manager.releaseFace(*f);
+	}
+	file_data.free();
+}
+
+
 bool FontResource::load(u64 size, const u8* mem)
 {
 	if (size <= 0) return false;
@@ -257,18 +526,12 @@ Font* FontResource::addRef(int font_size)
 			return f;
 		}
 	}
+	// face is created and glyphs are rasterized in FontManager::update
 	Font* font = LUMIX_NEW(manager.m_allocator, Font)(manager.m_allocator);
 	font->ref = 1;
 	font->resource = this;
 	font->font_size = font_size;
-	for(u32 cp = 0x20; cp < 0xff; ++cp) {
-		Glyph c;
-		c.codepoint = cp;
-		font->glyphs.insert(cp, c);
-	}
 	manager.m_fonts.push(font);
-	manager.m_dirty = true;
-	if (isReady()) manager.build();
 	return font;
 }
 
@@ -279,10 +542,9 @@ void FontResource::removeRef(Font& font)
 	--font.ref;
 	if(font.ref == 0) {
 		auto& manager = (FontManager&)m_resource_manager;
-		LUMIX_DELETE(manager.m_allocator, &font);
+		manager.releaseFace(font);
 		manager.m_fonts.eraseItem(&font);
-		manager.m_dirty = true;
-		if (isReady()) manager.build();
+		LUMIX_DELETE(manager.m_allocator, &font);
 	}
 }
 
@@ -291,23 +553,52 @@ FontManager::FontManager(Renderer& renderer, IAllocator& allocator)
 	: ResourceManager(allocator)
 	, m_allocator(allocator)
 	, m_renderer(renderer)
-	, m_atlas_texture(nullptr)
 	, m_fonts(allocator)
 {
-	build();
+	m_atlas = LUMIX_NEW(m_allocator, FontAtlas)(m_allocator);
+	FT_MemoryRec_& memory_rec = m_atlas->memory;
+	memory_rec = {};
+	memory_rec.user = &m_allocator;
+	memory_rec.alloc = [](FT_Memory memory, long size) -> void* { 
+		IAllocator* alloc = (IAllocator*)memory->user;
+		return alloc->allocate(size);
+	};
+	memory_rec.free = [](FT_Memory memory, void* block) -> void { 
+		IAllocator* alloc = (IAllocator*)memory->user;
+		alloc->deallocate(block);
+	};
+	memory_rec.realloc = [](FT_Memory memory, long cur_size, long new_size, void* block) -> void* {
+		IAllocator* alloc = (IAllocator*)memory->user;
+		return alloc->reallocate(block, new_size);
+	};
+
+	if (FT_New_Library(&memory_rec, &m_atlas->library) != 0) {
+		logError("Failed to initialize FreeType");
+		m_atlas->library = nullptr;
+	}
+	else {
+		FT_Add_Default_Modules(m_atlas->library);
+	}
+
+	createPage(*m_atlas, m_renderer, m_allocator);
 }
 
 
 FontManager::~FontManager()
 {
+	waitForRasterization();
 	for (Font* font : m_fonts) {
+		if (font->face) FT_Done_Face(font->face);
 		LUMIX_DELETE(m_allocator, font);
 	}
+	if (m_atlas->library) FT_Done_Library(m_atlas->library);
 
-	if (m_atlas_texture) {
-		m_atlas_texture->destroy();
-		LUMIX_DELETE(m_allocator, m_atlas_texture);
+	for (AtlasPage* page : m_atlas->pages) {
+		page->texture->destroy();
+		LUMIX_DELETE(m_allocator, page->texture);
+		LUMIX_DELETE(m_allocator, page);
 	}
+	LUMIX_DELETE(m_allocator, m_atlas);
 }
 
 
@@ -323,4 +614,4 @@ void FontManager::destroyResource(Resource& resource)
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
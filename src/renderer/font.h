@@ -6,6 +6,7 @@
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "renderer/gpu/gpu.h"
 
 
 namespace Lumix
@@ -13,23 +14,44 @@ namespace Lumix
 
 
 struct Font;
+struct FontAtlas;
 struct Renderer;
 struct Texture;
 
 
 struct Glyph {
+	static constexpr u32 NOT_READY = 0xffFFffFF;
+
 	u32 codepoint;
 	float u0, v0, u1, v1;
 	float x0, y0, x1, y1;
 	float advance_x;
+	// atlas page, NOT_READY if the glyph is not rasterized (yet)
+	u32 page;
+	// nullptr for the first page, i.e. the default Draw2D atlas
+	gpu::TextureHandle* texture;
+};
+
+
+// glyph quad relative to the pen origin
+struct TextQuad {
+	Vec2 from;
+	Vec2 to;
+	Vec2 uv0;
+	Vec2 uv1;
+	gpu::TextureHandle* texture;
 };
 
 
 LUMIX_RENDERER_API Vec2 measureTextA(const Font& font, const char* str, const char* str_end);
+// glyphs are rasterized on first use, so this returns nullptr until the glyph is ready
 LUMIX_RENDERER_API const Glyph* findGlyph(const Font& font, u32 codepoint);
 LUMIX_RENDERER_API float getAdvanceY(const Font& font);
 LUMIX_RENDERER_API float getDescender(const Font& font);
 LUMIX_RENDERER_API float getAscender(const Font& font);
+// layouts are cached per font, least recently used are evicted
+// returned quads are valid until the next layoutText call with the same font or until the atlas is rebuilt
+LUMIX_RENDERER_API Span<const TextQuad> layoutText(const Font& font, const char* str);
 
 
 struct LUMIX_RENDERER_API FontResource final : Resource
@@ -38,7 +60,7 @@ struct LUMIX_RENDERER_API FontResource final : Resource
 
 	ResourceType getType() const override { return TYPE; }
 
-	void unload() override { file_data.free(); }
+	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	Font* addRef(int font_size);
 	void removeRef(Font& font);
@@ -55,19 +77,27 @@ public:
 	FontManager(Renderer& renderer, IAllocator& allocator);
 	~FontManager();
 
+	// first atlas page, it also contains the white pixel used by untextured Draw2D commands
 	Texture* getAtlasTexture();
+	// changes every time glyphs are added to or evicted from the atlas
+	u32 getAtlasVersion() const { return m_atlas_version; }
+	// rasterizes glyphs requested by findGlyph on a worker and uploads finished ones to the atlas
+	void update();
 
 private:
 	Resource* createResource(const Path& path) override;
 	void destroyResource(Resource& resource) override;
-	bool build();
+	void waitForRasterization();
+	void uploadRasterized();
+	void evictPage(u32 page_idx);
+	void releaseFace(Font& font);
 
 private:
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
-	Texture* m_atlas_texture;
+	FontAtlas* m_atlas;
 	Array<Font*> m_fonts;
-	bool m_dirty = true;
+	u32 m_atlas_version = 0;
 };
 
 
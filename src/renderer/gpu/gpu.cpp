@@ -7,6 +7,7 @@
 #include "engine/stream.h"
 #include "engine/sync.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/stream.h"
 #include "engine/string.h"
 #ifdef _WIN32
@@ -34,6 +35,13 @@ namespace gpu {
 #undef GPU_GL_IMPORT_TYPEDEFS
 #undef GPU_GL_IMPORT
 
+// optional, loaded only if GL_ARB_bindless_texture is present
+static PFNGLGETTEXTUREHANDLEARBPROC glGetTextureHandleARB = nullptr;
+static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glMakeTextureHandleResidentARB = nullptr;
+static PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glMakeTextureHandleNonResidentARB = nullptr;
+// optional, GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = nullptr;
+
 struct Buffer {
 	~Buffer() {
 		if (gl_handle) glDeleteBuffers(1, &gl_handle);
@@ -43,12 +51,25 @@ struct Buffer {
 	BufferFlags flags;
 };
 
+struct Readback {
+	~Readback() {
+		if (fence) glDeleteSync(fence);
+		if (buffer) glDeleteBuffers(1, &buffer);
+	}
+
+	GLuint buffer = 0;
+	GLsync fence = 0;
+	u32 size = 0;
+};
+
 struct Texture {
 	~Texture() {
+		if (bindless_handle) glMakeTextureHandleNonResidentARB(bindless_handle);
 		if (gl_handle) glDeleteTextures(1, &gl_handle);
 	}
 
 	GLuint gl_handle = 0;
+	GLuint64 bindless_handle = 0; // resident since the first getBindlessHandle
 	GLenum target;
 	GLenum format;
 	u32 width;
@@ -61,24 +82,79 @@ struct Texture {
 };
 
 struct Program {
+	static constexpr u32 MAX_SHADERS = 16;
+
 	~Program() {
+		for (u32 i = 0; i < shaders_count; ++i) glDeleteShader(shaders[i]);
 		if(gl_handle) glDeleteProgram(gl_handle);
 	}
 
 	GLuint gl_handle = 0;
 	VertexDecl decl;
+	// compiled in parallel by driver, shaders are kept until it's linked to report errors
+	bool pending = false;
+	u32 shaders_count = 0;
+	GLuint shaders[MAX_SHADERS];
+	ShaderType shader_types[MAX_SHADERS];
+	StaticString<64> name;
+};
+
+// vertex formats are baked in a VAO per vertex declaration, so a program switch binds a VAO
+// instead of respecifying all attributes; VAOs are not shared between contexts
+struct CachedVAO {
+	u32 decl_hash;
+	GLuint vao;
 };
 
 struct WindowContext {
 	u32 last_frame;
 	void* window_handle = nullptr;
 	GLuint vao;
+	GLuint bound_vao = 0;
+	u32 vaos_count = 0;
+	CachedVAO vaos[32];
 	#ifdef _WIN32
 		HDC device_context;
 		HGLRC hglrc;
 	#endif
 };
 
+// shadow copy of bindings, so redundant gl calls can be skipped
+// UNKNOWN_BINDING means we do not know what's bound, e.g. after context switch
+struct Bindings {
+	static constexpr GLuint UNKNOWN_BINDING = 0xffFFffFF;
+
+	struct RangeBinding {
+		GLuint buffer;
+		size_t offset;
+		size_t size;
+	};
+
+	struct VertexBinding {
+		GLuint buffer;
+		u32 offset;
+		u32 stride;
+	};
+
+	GLuint textures[64];
+	GLuint shader_buffers[32];
+	RangeBinding uniform_buffers[16];
+	VertexBinding vertex_buffers[2];
+	GLuint index_buffer;
+};
+
+// persistently mapped pixel unpack buffer, texture data are copied to it and gl uploads them asynchronously
+// the ring is split to chunks, a chunk is fenced when we move to the next one and reused only after the fence is signaled
+struct StagingRing {
+	static constexpr u32 CHUNK_SIZE = 8 * 1024 * 1024;
+	static constexpr u32 CHUNKS_COUNT = 8;
+
+	GLuint buffer = 0;
+	u8* ptr = nullptr;
+	u32 offset = 0;
+	GLsync fences[CHUNKS_COUNT] = {};
+};
+
 struct GL {
 	GL(IAllocator& allocator) : allocator(allocator) {}
 
@@ -91,15 +167,57 @@ struct GL {
 	int max_vertex_attributes = 16;
 	ProgramHandle last_program = INVALID_PROGRAM;
 	StateFlags last_state = StateFlags::NONE;
+	bool is_state_known = false; // false after context switch, next setState applies everything
+	WindowContext* current_context = nullptr;
+	Bindings bindings;
+	StagingRing staging;
+	// signaled when gpu finishes the frame, indexed by frame % lengthOf(frame_fences)
+	GLsync frame_fences[4] = {};
 	GLuint framebuffer = 0;
 	GLuint helper_indirect_buffer = 0;
 	ProgramHandle default_program = INVALID_PROGRAM;
 	bool has_gpu_mem_info_ext = false;
+	bool has_bindless_textures = false;
+	bool has_parallel_shader_compile = false;
+	bool skip_draws = false; // current program is not compiled yet
 	float max_anisotropy = 0;
+	u32 driver_hash = 0;
+	Stats stats;
+	u32 draw_calls_counter = profiler::INVALID_COUNTER;
+	u32 triangles_counter = profiler::INVALID_COUNTER;
+	u32 binds_counter = profiler::INVALID_COUNTER;
+	u32 skipped_binds_counter = profiler::INVALID_COUNTER;
 };
 
 Local<GL> gl;
 
+static void invalidateBindings() {
+	memset(&gl->bindings, 0xff, sizeof(gl->bindings));
+	gl->is_state_known = false;
+}
+
+// gl unbinds deleted objects and can reuse their names, so we must forget them
+static void forgetBinding(GLuint handle) {
+	Bindings& b = gl->bindings;
+	for (GLuint& t : b.textures) {
+		if (t == handle) t = Bindings::UNKNOWN_BINDING;
+	}
+	for (GLuint& sb : b.shader_buffers) {
+		if (sb == handle) sb = Bindings::UNKNOWN_BINDING;
+	}
+	for (Bindings::RangeBinding& ub : b.uniform_buffers) {
+		if (ub.buffer == handle) ub.buffer = Bindings::UNKNOWN_BINDING;
+	}
+	for (Bindings::VertexBinding& vb : b.vertex_buffers) {
+		if (vb.buffer == handle) vb.buffer = Bindings::UNKNOWN_BINDING;
+	}
+	if (b.index_buffer == handle) b.index_buffer = Bindings::UNKNOWN_BINDING;
+}
+
+static void countBind(bool skipped) {
+	profiler::addCounter(skipped ? gl->skipped_binds_counter : gl->binds_counter, 1);
+}
+
 struct FormatDesc {
 	bool compressed;
 	bool swap;
@@ -116,6 +234,8 @@ struct FormatDesc {
 			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : return get(TextureFormat::BC3);
 			case GL_COMPRESSED_RED_RGTC1 : return get(TextureFormat::BC4);
 			case GL_COMPRESSED_RG_RGTC2 : return get(TextureFormat::BC5);
+			case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT : return get(TextureFormat::BC6H);
+			case GL_COMPRESSED_RGBA_BPTC_UNORM : return get(TextureFormat::BC7);
 			case GL_R16 : return get(TextureFormat::R16);
 			case GL_R8 : return get(TextureFormat::R8);
 			case GL_RG8 : return get(TextureFormat::RG8);
@@ -138,6 +258,8 @@ struct FormatDesc {
 			case TextureFormat::BC3: return {		true,		false,	16, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,	GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT};
 			case TextureFormat::BC4: return {		true,		false,	8,	GL_COMPRESSED_RED_RGTC1,			GL_ZERO};
 			case TextureFormat::BC5: return {		true,		false,	16, GL_COMPRESSED_RG_RGTC2,				GL_ZERO};
+			case TextureFormat::BC6H: return {		true,		false,	16, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,	GL_ZERO};
+			case TextureFormat::BC7: return {		true,		false,	16, GL_COMPRESSED_RGBA_BPTC_UNORM,		GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM};
 			case TextureFormat::R16: return {		false,		false,	2,	GL_R16,								GL_ZERO, GL_RED, GL_UNSIGNED_SHORT};
 			case TextureFormat::R8: return {		false,		false,	1,	GL_R8,								GL_ZERO, GL_RED, GL_UNSIGNED_BYTE};
 			case TextureFormat::RG8: return {		false,		false,	2,	GL_RG8,								GL_ZERO, GL_RG, GL_UNSIGNED_BYTE};
@@ -425,6 +547,7 @@ int getSize(AttributeType type)
 		case AttributeType::I8: return 1;
 		case AttributeType::U8: return 1;
 		case AttributeType::I16: return 2;
+		case AttributeType::HALF: return 2;
 		default: ASSERT(false); return 0;
 	}
 }
@@ -461,9 +584,17 @@ void scissor(u32 x,u32 y,u32 w,u32 h)
 	glScissor(x, y, w, h);
 }
 
-static void setVAO(const VertexDecl& decl) {
-	checkThread();
+static void bindVAO(WindowContext& ctx, GLuint vao) {
+	countBind(ctx.bound_vao == vao);
+	if (ctx.bound_vao == vao) return;
+	ctx.bound_vao = vao;
+	glBindVertexArray(vao);
+	// vertex and index buffer bindings are part of the VAO
+	for (Bindings::VertexBinding& vb : gl->bindings.vertex_buffers) vb.buffer = Bindings::UNKNOWN_BINDING;
+	gl->bindings.index_buffer = Bindings::UNKNOWN_BINDING;
+}
 
+static void specifyAttributes(const VertexDecl& decl) {
 	u32 mask = 0;
 	
 	for (u32 i = 0; i < decl.attributes_count; ++i) {
@@ -474,6 +605,7 @@ static void setVAO(const VertexDecl& decl) {
 			case AttributeType::FLOAT: gl_attr_type = GL_FLOAT; break;
 			case AttributeType::I8: gl_attr_type = GL_BYTE; break;
 			case AttributeType::U8: gl_attr_type = GL_UNSIGNED_BYTE; break;
+			case AttributeType::HALF: gl_attr_type = GL_HALF_FLOAT; break;
 			default: ASSERT(false); break;
 		}
 
@@ -498,16 +630,136 @@ static void setVAO(const VertexDecl& decl) {
 	}
 }
 
+static void setVAO(const VertexDecl& decl) {
+	checkThread();
+
+	WindowContext& ctx = *gl->current_context;
+	for (u32 i = 0; i < ctx.vaos_count; ++i) {
+		if (ctx.vaos[i].decl_hash == decl.hash) {
+			bindVAO(ctx, ctx.vaos[i].vao);
+			return;
+		}
+	}
+
+	if (ctx.vaos_count == lengthOf(ctx.vaos)) {
+		// cache is full, respecify attributes in the context's default VAO
+		bindVAO(ctx, ctx.vao);
+		specifyAttributes(decl);
+		return;
+	}
+
+	CachedVAO& cached = ctx.vaos[ctx.vaos_count];
+	++ctx.vaos_count;
+	cached.decl_hash = decl.hash;
+	glGenVertexArrays(1, &cached.vao);
+	bindVAO(ctx, cached.vao);
+	glVertexBindingDivisor(0, 0);
+	glVertexBindingDivisor(1, 1);
+	specifyAttributes(decl);
+}
+
 void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z)
 {
+	if (gl->skip_draws) return;
 	glDispatchCompute(num_groups_x, num_groups_y, num_groups_z);
 }
 
+void memoryBarrier()
+{
+	checkThread();
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT
+		| GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+static const char* shaderTypeToString(ShaderType type)
+{
+	switch(type) {
+		case ShaderType::GEOMETRY: return "geometry shader";		
+		case ShaderType::FRAGMENT: return "fragment shader";
+		case ShaderType::VERTEX: return "vertex shader";
+		default: return "unknown shader type";
+	}
+}
+
+static bool checkShader(GLuint shd, const char* name, ShaderType type) {
+	GLint compile_status;
+	glGetShaderiv(shd, GL_COMPILE_STATUS, &compile_status);
+	if (compile_status == GL_TRUE) return true;
+
+	GLint log_len = 0;
+	glGetShaderiv(shd, GL_INFO_LOG_LENGTH, &log_len);
+	if (log_len > 0) {
+		Array<char> log_buf(gl->allocator);
+		log_buf.resize(log_len);
+		glGetShaderInfoLog(shd, log_len, &log_len, &log_buf[0]);
+		logError(name, " - ", shaderTypeToString(type), ": ", &log_buf[0]);
+	}
+	else {
+		logError("Failed to compile shader ", name, " - ", shaderTypeToString(type));
+	}
+	return false;
+}
+
+static bool checkProgram(GLuint prg, const char* name) {
+	GLint linked;
+	glGetProgramiv(prg, GL_LINK_STATUS, &linked);
+	if (linked == GL_TRUE) return true;
+
+	GLint log_len = 0;
+	glGetProgramiv(prg, GL_INFO_LOG_LENGTH, &log_len);
+	if (log_len > 0) {
+		Array<char> log_buf(gl->allocator);
+		log_buf.resize(log_len);
+		glGetProgramInfoLog(prg, log_len, &log_len, &log_buf[0]);
+		logError(name, ": ", &log_buf[0]);
+	}
+	else {
+		logError("Failed to link program ", name);
+	}
+	return false;
+}
+
+// returns false while driver is still compiling program
+static bool pollProgram(Program& program) {
+	if (!program.pending) return true;
+	
+	GLint completed;
+	glGetProgramiv(program.gl_handle, GL_COMPLETION_STATUS_KHR, &completed);
+	if (completed == GL_FALSE) return false;
+
+	program.pending = false;
+	if (!checkProgram(program.gl_handle, program.name)) {
+		for (u32 i = 0; i < program.shaders_count; ++i) {
+			checkShader(program.shaders[i], program.name, program.shader_types[i]);
+		}
+		glDeleteProgram(program.gl_handle);
+		program.gl_handle = 0;
+	}
+	for (u32 i = 0; i < program.shaders_count; ++i) glDeleteShader(program.shaders[i]);
+	program.shaders_count = 0;
+	return true;
+}
+
+bool isProgramReady(ProgramHandle program) {
+	checkThread();
+	ASSERT(program);
+	return pollProgram(*program);
+}
+
 void useProgram(ProgramHandle program)
 {
+	if (program && !pollProgram(*program)) {
+		// draw nothing until the program is compiled, instead of waiting for it
+		gl->skip_draws = true;
+		return;
+	}
+	gl->skip_draws = false;
+
 	const Program* prev = gl->last_program;
+	countBind(prev == program);
 	if (prev != program) {
 		gl->last_program = program;
+		++gl->stats.state_changes;
 		if (program) {
 			glUseProgram(program->gl_handle);
 
@@ -533,31 +785,52 @@ void bindImageTexture(TextureHandle texture, u32 unit) {
 void bindTextures(const TextureHandle* handles, u32 offset, u32 count)
 {
 	GLuint gl_handles[64];
-	ASSERT(count <= lengthOf(gl_handles));
+	ASSERT(offset + count <= lengthOf(gl_handles));
 	ASSERT(handles);
 	
+	// bind only the range which differs from what's already bound
+	GLuint* bound = gl->bindings.textures + offset;
+	u32 first = count;
+	u32 last = 0;
 	for(u32 i = 0; i < count; ++i) {
-		if (handles[i]) {
-			gl_handles[i] = handles[i]->gl_handle;
-		}
-		else {
-			gl_handles[i] = 0;
+		gl_handles[i] = handles[i] ? handles[i]->gl_handle : 0;
+		if (gl_handles[i] != bound[i]) {
+			first = minimum(first, i);
+			last = i;
+			bound[i] = gl_handles[i];
 		}
 	}
 
-	glBindTextures(offset, count, gl_handles);
+	countBind(first == count);
+	if (first == count) return;
+
+	++gl->stats.state_changes;
+	glBindTextures(offset + first, last - first + 1, gl_handles + first);
 }
 
 void bindShaderBuffer(BufferHandle buffer, u32 binding_idx, BindShaderBufferFlags flags)
 {
 	checkThread();
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding_idx, buffer ? buffer->gl_handle : 0);
+	const GLuint gl_handle = buffer ? buffer->gl_handle : 0;
+	if (binding_idx < lengthOf(gl->bindings.shader_buffers)) {
+		GLuint& bound = gl->bindings.shader_buffers[binding_idx];
+		countBind(bound == gl_handle);
+		if (bound == gl_handle) return;
+		bound = gl_handle;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding_idx, gl_handle);
 }
 
 void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u32 stride) {
 	checkThread();
 	ASSERT(binding_idx < 2);
-	glBindVertexBuffer(binding_idx, buffer ? buffer->gl_handle : 0, buffer_offset, stride);
+	const GLuint gl_handle = buffer ? buffer->gl_handle : 0;
+	Bindings::VertexBinding& bound = gl->bindings.vertex_buffers[binding_idx];
+	const bool same = bound.buffer == gl_handle && bound.offset == buffer_offset && bound.stride == stride;
+	countBind(same);
+	if (same) return;
+	bound = {gl_handle, buffer_offset, stride};
+	glBindVertexBuffer(binding_idx, gl_handle, buffer_offset, stride);
 }
 
 
@@ -565,30 +838,51 @@ void setState(StateFlags state)
 {
 	checkThread();
 	
-	if(state == gl->last_state) return;
+	// only the groups of gl state which differ from the last state are applied
+	const u64 prev = u64(gl->last_state);
+	const u64 changed = gl->is_state_known ? u64(state) ^ prev : ~u64(0);
+	countBind(changed == 0);
+	if (changed == 0) return;
 	gl->last_state = state;
-
-	if (u64(state & StateFlags::DEPTH_TEST)) glEnable(GL_DEPTH_TEST);
-	else glDisable(GL_DEPTH_TEST);
-	
-	glDepthMask(u64(state & StateFlags::DEPTH_WRITE) != 0);
+	++gl->stats.state_changes;
+
+	constexpr u64 BLEND_BITS = u64(0xffFF) << 6;
+	constexpr u64 STENCIL_WRITE_MASK_BITS = u64(0xff) << 22;
+	constexpr u64 STENCIL_FUNC_BITS = u64(0xf) << 30;
+	constexpr u64 STENCIL_BITS = ~u64(0) << 30;
+	const bool was_blend = gl->is_state_known && (prev & BLEND_BITS);
+	const bool was_stencil = gl->is_state_known && (prev & STENCIL_FUNC_BITS);
+	gl->is_state_known = true;
+
+	if (changed & u64(StateFlags::DEPTH_TEST)) {
+		if (u64(state & StateFlags::DEPTH_TEST)) glEnable(GL_DEPTH_TEST);
+		else glDisable(GL_DEPTH_TEST);
+	}
 	
-	if (u64(state & StateFlags::SCISSOR_TEST)) glEnable(GL_SCISSOR_TEST);
-	else glDisable(GL_SCISSOR_TEST);
+	if (changed & u64(StateFlags::DEPTH_WRITE)) glDepthMask(u64(state & StateFlags::DEPTH_WRITE) != 0);
 	
-	if (u64(state & StateFlags::CULL_BACK)) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
+	if (changed & u64(StateFlags::SCISSOR_TEST)) {
+		if (u64(state & StateFlags::SCISSOR_TEST)) glEnable(GL_SCISSOR_TEST);
+		else glDisable(GL_SCISSOR_TEST);
 	}
-	else if(u64(state & StateFlags::CULL_FRONT)) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
-	}
-	else {
-		glDisable(GL_CULL_FACE);
+	
+	if (changed & u64(StateFlags::CULL_BACK | StateFlags::CULL_FRONT)) {
+		if (u64(state & StateFlags::CULL_BACK)) {
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_BACK);
+		}
+		else if(u64(state & StateFlags::CULL_FRONT)) {
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_FRONT);
+		}
+		else {
+			glDisable(GL_CULL_FACE);
+		}
 	}
 
-	glPolygonMode(GL_FRONT_AND_BACK, u64(state & StateFlags::WIREFRAME) ? GL_LINE : GL_FILL);
+	if (changed & u64(StateFlags::WIREFRAME)) {
+		glPolygonMode(GL_FRONT_AND_BACK, u64(state & StateFlags::WIREFRAME) ? GL_LINE : GL_FILL);
+	}
 
 	auto to_gl = [&](BlendFactors factor) -> GLenum{
 		static const GLenum table[] = {
@@ -612,27 +906,29 @@ void setState(StateFlags state)
 
 	u16 blend_bits = u16(u64(state) >> 6);
 
-	if (blend_bits) {
+	if (!(changed & BLEND_BITS)) {}
+	else if (blend_bits) {
 		const BlendFactors src_rgb = (BlendFactors)(blend_bits & 0xf);
 		const BlendFactors dst_rgb = (BlendFactors)((blend_bits >> 4) & 0xf);
 		const BlendFactors src_a = (BlendFactors)((blend_bits >> 8) & 0xf);
 		const BlendFactors dst_a = (BlendFactors)((blend_bits >> 12) & 0xf);
-		glEnable(GL_BLEND);
+		if (!was_blend) glEnable(GL_BLEND);
 		glBlendFuncSeparate(to_gl(src_rgb), to_gl(dst_rgb), to_gl(src_a), to_gl(dst_a));
 	}
 	else {
 		glDisable(GL_BLEND);
 	}
 	
-	glStencilMask(u8(u64(state) >> 22));
+	if (changed & STENCIL_WRITE_MASK_BITS) glStencilMask(u8(u64(state) >> 22));
 	const StencilFuncs func = (StencilFuncs)((u64(state) >> 30) & 0xf);
-	if (func == StencilFuncs::DISABLE) {
+	if (!(changed & STENCIL_BITS)) {}
+	else if (func == StencilFuncs::DISABLE) {
 		glDisable(GL_STENCIL_TEST);
 	}
 	else {
 		const u8 ref = u8(u64(state) >> 34);
 		const u8 mask = u8(u64(state) >> 42);
-		glEnable(GL_STENCIL_TEST);
+		if (!was_stencil) glEnable(GL_STENCIL_TEST);
 		GLenum gl_func;
 		switch(func) {
 			case StencilFuncs::ALWAYS: gl_func = GL_ALWAYS; break;
@@ -665,7 +961,11 @@ void setState(StateFlags state)
 void bindIndexBuffer(BufferHandle buffer)
 {
 	checkThread();
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer ? buffer->gl_handle : 0);
+	const GLuint gl_handle = buffer ? buffer->gl_handle : 0;
+	countBind(gl->bindings.index_buffer == gl_handle);
+	if (gl->bindings.index_buffer == gl_handle) return;
+	gl->bindings.index_buffer = gl_handle;
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_handle);
 }
 
 
@@ -676,9 +976,29 @@ void bindIndirectBuffer(BufferHandle buffer)
 }
 
 
+// triangles from indirect draws are not known on cpu
+static void countDraw(PrimitiveType type, u32 count, u32 instances) {
+	profiler::addCounter(gl->draw_calls_counter, 1);
+	u32 triangles = 0;
+	switch (type) {
+		case PrimitiveType::TRIANGLES: triangles = count / 3; break;
+		case PrimitiveType::TRIANGLE_STRIP: triangles = count > 2 ? count - 2 : 0; break;
+		default: break;
+	}
+	profiler::addCounter(gl->triangles_counter, i64(triangles) * instances);
+	++gl->stats.draw_calls;
+	gl->stats.triangles += u64(triangles) * instances;
+}
+
+Stats getStats() {
+	checkThread();
+	return gl->stats;
+}
+
 void drawElements(PrimitiveType primitive_type, u32 offset, u32 count, DataType type)
 {
 	checkThread();
+	if (gl->skip_draws) return;
 	
 	GLuint pt;
 	switch (primitive_type) {
@@ -697,17 +1017,21 @@ void drawElements(PrimitiveType primitive_type, u32 offset, u32 count, DataType
 	}
 
 	glDrawElements(pt, count, t, (void*)(intptr_t)offset);
+	countDraw(primitive_type, count, 1);
 }
 
 void drawIndirect(DataType index_type)
 {
+	if (gl->skip_draws) return;
 	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 	glMultiDrawElementsIndirect(GL_TRIANGLES, type, nullptr, 1, 0);
+	countDraw(PrimitiveType::TRIANGLES, 0, 0);
 }
 
 void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType index_type)
 {
 	checkThread();
+	if (gl->skip_draws) return;
 	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 	if (instances_count * indices_count > 4096) {
 		struct {
@@ -731,20 +1055,24 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 	else {
 		glDrawElementsInstanced(GL_TRIANGLES, indices_count, type, 0, instances_count);
 	}
+	countDraw(PrimitiveType::TRIANGLES, indices_count, instances_count);
 }
 
 
 void drawTriangles(u32 indices_byte_offset, u32 indices_count, DataType index_type)
 {
 	checkThread();
+	if (gl->skip_draws) return;
 
 	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 	glDrawElements(GL_TRIANGLES, indices_count, type, (const GLvoid*)(uintptr_t)indices_byte_offset);
+	countDraw(PrimitiveType::TRIANGLES, indices_count, 1);
 }
 
 
 void drawArraysInstanced(PrimitiveType type, u32 indices_count, u32 instances_count)
 {
+	if (gl->skip_draws) return;
 	GLuint pt;
 	switch (type) {
 		case PrimitiveType::TRIANGLES: pt = GL_TRIANGLES; break;
@@ -754,12 +1082,30 @@ void drawArraysInstanced(PrimitiveType type, u32 indices_count, u32 instances_co
 		default: ASSERT(0); break;
 	}
 	glDrawArraysInstanced(pt, 0, indices_count, instances_count);
+	countDraw(type, indices_count, instances_count);
+}
+
+void drawArraysIndirect(PrimitiveType type)
+{
+	checkThread();
+	if (gl->skip_draws) return;
+	GLuint pt;
+	switch (type) {
+		case PrimitiveType::TRIANGLES: pt = GL_TRIANGLES; break;
+		case PrimitiveType::TRIANGLE_STRIP: pt = GL_TRIANGLE_STRIP; break;
+		case PrimitiveType::LINES: pt = GL_LINES; break;
+		case PrimitiveType::POINTS: pt = GL_POINTS; break;
+		default: ASSERT(0); break;
+	}
+	glDrawArraysIndirect(pt, nullptr);
+	countDraw(type, 0, 0);
 }
 
 
 void drawArrays(PrimitiveType type, u32 offset, u32 count)
 {
 	checkThread();
+	if (gl->skip_draws) return;
 	
 	GLuint pt;
 	switch (type) {
@@ -771,11 +1117,20 @@ void drawArrays(PrimitiveType type, u32 offset, u32 count)
 	}
 
 	glDrawArrays(pt, offset, count);
+	countDraw(type, count, 1);
 }
 
 void bindUniformBuffer(u32 index, BufferHandle buffer, size_t offset, size_t size) {
 	checkThread();
-	glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer ? buffer->gl_handle : 0, offset, size);
+	const GLuint gl_handle = buffer ? buffer->gl_handle : 0;
+	if (index < lengthOf(gl->bindings.uniform_buffers)) {
+		Bindings::RangeBinding& bound = gl->bindings.uniform_buffers[index];
+		const bool same = bound.buffer == gl_handle && bound.offset == offset && bound.size == size;
+		countBind(same);
+		if (same) return;
+		bound = {gl_handle, offset, size};
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, index, gl_handle, offset, size);
 }
 
 
@@ -784,6 +1139,9 @@ void* map(BufferHandle buffer, size_t size)
 	checkThread();
 	ASSERT(buffer);
 	ASSERT(u32(buffer->flags & BufferFlags::IMMUTABLE) == 0);
+	if (u32(buffer->flags & BufferFlags::MAPPABLE)) {
+		return glMapNamedBufferRange(buffer->gl_handle, 0, size, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	}
 	const GLbitfield gl_flags = GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_WRITE_BIT;
 	return glMapNamedBufferRange(buffer->gl_handle, 0, size, gl_flags);
 }
@@ -931,6 +1289,7 @@ void setCurrentWindow(void* window_handle) {
 			glBindVertexArray(ctx.vao);
 			glVertexBindingDivisor(0, 0);
 			glVertexBindingDivisor(1, 1);
+			ctx.bound_vao = ctx.vao;
 
 			#ifdef LUMIX_DEBUG
 				glEnable(GL_DEBUG_OUTPUT);
@@ -942,6 +1301,8 @@ void setCurrentWindow(void* window_handle) {
 		}
 
 		wglMakeCurrent(ctx.device_context, ctx.hglrc);
+		gl->current_context = &ctx;
+		invalidateBindings();
 	#endif
 	useProgram(INVALID_PROGRAM);
 }
@@ -960,6 +1321,8 @@ u32 swapBuffers()
 				BOOL res = wglMakeCurrent(ctx.device_context, ctx.hglrc);
 				ASSERT(res);
 				glDeleteVertexArrays(1, &ctx.vao);
+				for (u32 i = 0; i < ctx.vaos_count; ++i) glDeleteVertexArrays(1, &ctx.vaos[i].vao);
+				ctx.vaos_count = 0;
 				SwapBuffers(ctx.device_context);
 				
 				ASSERT(res);
@@ -970,15 +1333,35 @@ u32 swapBuffers()
 		}
 		BOOL res = wglMakeCurrent(gl->contexts[0].device_context, gl->contexts[0].hglrc);
 		ASSERT(res);
+		gl->current_context = &gl->contexts[0];
+		invalidateBindings();
 	#else
 		glXSwapBuffers(gdisplay, (Window)gl->contexts[0].window_handle);
 	#endif
+	const u32 frame = gl->frame;
+	GLsync& fence = gl->frame_fences[frame % lengthOf(gl->frame_fences)];
+	if (fence) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 	++gl->frame;
-	return 0;
+	return frame;
 }
 
-bool frameFinished(u32 frame) { return true; }
-void waitFrame(u32 frame) {}
+bool frameFinished(u32 frame) {
+	checkThread();
+	GLsync fence = gl->frame_fences[frame % lengthOf(gl->frame_fences)];
+	if (!fence) return true;
+	const GLenum res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	return res != GL_TIMEOUT_EXPIRED;
+}
+
+void waitFrame(u32 frame) {
+	checkThread();
+	GLsync& fence = gl->frame_fences[frame % lengthOf(gl->frame_fences)];
+	if (!fence) return;
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED) {}
+	glDeleteSync(fence);
+	fence = 0;
+}
 
 void createBuffer(BufferHandle buffer, BufferFlags flags, size_t size, const void* data)
 {
@@ -989,6 +1372,7 @@ void createBuffer(BufferHandle buffer, BufferFlags flags, size_t size, const voi
 	
 	GLbitfield gl_flags = 0;
 	if (u64(flags & BufferFlags::IMMUTABLE) == 0) gl_flags |= GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT | GL_MAP_READ_BIT;
+	if (u64(flags & BufferFlags::MAPPABLE)) gl_flags |= GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 	glNamedBufferStorage(buf, size, data, gl_flags);
 
 	buffer->gl_handle = buf;
@@ -1001,6 +1385,31 @@ void destroy(ProgramHandle program)
 	LUMIX_DELETE(gl->allocator, program);
 }
 
+// returns nullptr if there's no free space in the staging ring, caller should upload from client memory then
+static u8* allocStaging(u32 size, u32& offset) {
+	StagingRing& ring = gl->staging;
+	if (!ring.ptr || size > StagingRing::CHUNK_SIZE) return nullptr;
+
+	u32 start = (ring.offset + 15) & ~15;
+	const u32 chunk = ring.offset / StagingRing::CHUNK_SIZE;
+	if (start + size > (chunk + 1) * StagingRing::CHUNK_SIZE) {
+		const u32 next = (chunk + 1) % StagingRing::CHUNKS_COUNT;
+		GLsync& next_fence = ring.fences[next];
+		if (next_fence) {
+			// gpu still reads the next chunk
+			if (glClientWaitSync(next_fence, 0, 0) == GL_TIMEOUT_EXPIRED) return nullptr;
+			glDeleteSync(next_fence);
+			next_fence = 0;
+		}
+		ring.fences[chunk] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		start = next * StagingRing::CHUNK_SIZE;
+	}
+
+	ring.offset = start + size;
+	offset = start;
+	return ring.ptr + start;
+}
+
 void update(TextureHandle texture, u32 mip, u32 x, u32 y, u32 z, u32 w, u32 h, TextureFormat format, const void* buf, u32 buf_size) {
 	checkThread();
 
@@ -1014,9 +1423,19 @@ void update(TextureHandle texture, u32 mip, u32 x, u32 y, u32 z, u32 w, u32 h, T
 
 	ASSERT(!is_2d || z == 0);
 
+	// uploads through staging ring do not wait for the driver to copy client memory
+	auto stage = [](const u8* data, u32 size) -> const u8* {
+		u32 offset;
+		u8* dst = allocStaging(size, offset);
+		if (!dst) return data;
+		memcpy(dst, data, size);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->staging.buffer);
+		return (const u8*)(uintptr)offset;
+	};
+
 	if (fd.compressed) {
 		const u32 size = sizeDXTC(w, h, internal_format);
-		const u8* data_ptr = (u8*)blob.skip(size);
+		const u8* data_ptr = stage((u8*)blob.skip(size), size);
 		if (is_2d) {
 			glCompressedTextureSubImage2D(texture->gl_handle, mip, x, y, w, h, internal_format, size, data_ptr);
 		}
@@ -1030,7 +1449,7 @@ void update(TextureHandle texture, u32 mip, u32 x, u32 y, u32 z, u32 w, u32 h, T
 			glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_TRUE);
 		}
 		const u32 size = w * h * fd.block_bytes;
-		const u8* data_ptr = (u8*)blob.skip(size);
+		const u8* data_ptr = stage((u8*)blob.skip(size), size);
 		if (is_2d) {
 			glTextureSubImage2D(texture->gl_handle, mip, x, y, w, h, fd.external, fd.type, data_ptr);
 		}
@@ -1039,6 +1458,7 @@ void update(TextureHandle texture, u32 mip, u32 x, u32 y, u32 z, u32 w, u32 h, T
 		}
 		glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
 	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
 
 static void setSampler(GLuint texture, TextureFlags flags) {
@@ -1095,6 +1515,7 @@ void createTextureView(TextureHandle view, TextureHandle texture)
 	ASSERT(view);
 
 	if (view->gl_handle != 0) {
+		forgetBinding(view->gl_handle);
 		glDeleteTextures(1, &view->gl_handle);
 	}
 
@@ -1134,6 +1555,12 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 
 	const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(w, h, depth));
 
+	// handle can be reused, e.g. when streamed texture changes its resident mips
+	if (handle->gl_handle) {
+		forgetBinding(handle->gl_handle);
+		glDeleteTextures(1, &handle->gl_handle);
+	}
+
 	glCreateTextures(target, 1, &texture);
 	const FormatDesc& fd = FormatDesc::get(format);
 
@@ -1176,11 +1603,13 @@ void generateMipmaps(TextureHandle texture)
 void destroy(TextureHandle texture)
 {
 	checkThread();
+	if (texture->gl_handle) forgetBinding(texture->gl_handle);
 	LUMIX_DELETE(gl->allocator, texture);
 }
 
 void destroy(BufferHandle buffer) {
 	checkThread();
+	if (buffer->gl_handle) forgetBinding(buffer->gl_handle);
 	LUMIX_DELETE(gl->allocator, buffer);
 }
 
@@ -1190,7 +1619,7 @@ void clear(ClearFlags flags, const float* color, float depth)
 	gl->last_program = INVALID_PROGRAM;
 	glDisable(GL_SCISSOR_TEST);
 	glDisable(GL_BLEND);
-	gl->last_state = gl->last_state & ~StateFlags(0xffFF << 6);
+	gl->last_state = gl->last_state & ~(StateFlags(0xffFF << 6) | StateFlags::SCISSOR_TEST);
 	checkThread();
 	GLbitfield gl_flags = 0;
 	if (u32(flags & ClearFlags::COLOR)) {
@@ -1199,6 +1628,7 @@ void clear(ClearFlags flags, const float* color, float depth)
 	}
 	if (u32(flags & ClearFlags::DEPTH)) {
 		glDepthMask(GL_TRUE);
+		gl->last_state = gl->last_state | StateFlags::DEPTH_WRITE;
 		glClearDepth(depth);
 		gl_flags |= GL_DEPTH_BUFFER_BIT;
 	}
@@ -1211,15 +1641,6 @@ void clear(ClearFlags flags, const float* color, float depth)
 	glClear(gl_flags);
 }
 
-static const char* shaderTypeToString(ShaderType type)
-{
-	switch(type) {
-		case ShaderType::GEOMETRY: return "geometry shader";		
-		case ShaderType::FRAGMENT: return "fragment shader";
-		case ShaderType::VERTEX: return "vertex shader";
-		default: return "unknown shader type";
-	}
-}
 
 
 bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs, const ShaderType* types, u32 num, const char** prefixes, u32 prefixes_count, const char* name)
@@ -1244,9 +1665,9 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 
 	const char* combined_srcs[32];
 	ASSERT(prefixes_count < lengthOf(combined_srcs) - 1); 
-	enum { MAX_SHADERS_PER_PROGRAM = 16 };
+	ASSERT(prog);
 
-	if (num > MAX_SHADERS_PER_PROGRAM) {
+	if (num > Program::MAX_SHADERS) {
 		logError("Too many shaders per program in ", name);
 		return false;
 	}
@@ -1268,6 +1689,10 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 			#define _ORIGIN_BOTTOM_LEFT
 		)#";
 		++src_idx;
+		if (gl->has_bindless_textures) {
+			combined_srcs[src_idx] = "#extension GL_ARB_bindless_texture : require\n#define LUMIX_BINDLESS\n";
+			++src_idx;
+		}
 		switch (types[i]) {
 			case ShaderType::GEOMETRY: {
 				combined_srcs[src_idx] = "#define LUMIX_GEOMETRY_SHADER\n"; 
@@ -1307,20 +1732,16 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 		glShaderSource(shd, src_idx, combined_srcs, 0);
 		glCompileShader(shd);
 
-		GLint compile_status;
-		glGetShaderiv(shd, GL_COMPILE_STATUS, &compile_status);
-		if (compile_status == GL_FALSE) {
-			GLint log_len = 0;
-			glGetShaderiv(shd, GL_INFO_LOG_LENGTH, &log_len);
-			if (log_len > 0) {
-				Array<char> log_buf(gl->allocator);
-				log_buf.resize(log_len);
-				glGetShaderInfoLog(shd, log_len, &log_len, &log_buf[0]);
-				logError(name, " - ", shaderTypeToString(types[i]), ": ", &log_buf[0]);
-			}
-			else {
-				logError("Failed to compile shader ", name, " - ", shaderTypeToString(types[i]));
-			}
+		if (gl->has_parallel_shader_compile) {
+			// do not wait for the driver, status is checked in pollProgram
+			prog->shaders[prog->shaders_count] = shd;
+			prog->shader_types[prog->shaders_count] = types[i];
+			++prog->shaders_count;
+			glAttachShader(prg, shd);
+			continue;
+		}
+
+		if (!checkShader(shd, name, types[i])) {
 			glDeleteShader(shd);
 			return false;
 		}
@@ -1329,22 +1750,43 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 		glDeleteShader(shd);
 	}
 
+	glProgramParameteri(prg, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(prg);
+
+	if (gl->has_parallel_shader_compile) {
+		prog->gl_handle = prg;
+		prog->decl = decl;
+		prog->pending = true;
+		prog->name = name ? name : "";
+		return true;
+	}
+
+	if (!checkProgram(prg, name)) {
+		glDeleteProgram(prg);
+		return false;
+	}
+
+	prog->gl_handle = prg;
+	prog->decl = decl;
+	return true;
+}
+
+
+bool createProgramFromBinary(ProgramHandle prog, const VertexDecl& decl, const void* data, u32 size, const char* name) {
+	checkThread();
+	GLenum format;
+	if (size < sizeof(format)) return false;
+	memcpy(&format, data, sizeof(format));
+
+	const GLuint prg = glCreateProgram();
+	if (name && name[0]) {
+		glObjectLabel(GL_PROGRAM, prg, stringLength(name), name);
+	}
+	glProgramBinary(prg, format, (const u8*)data + sizeof(format), GLsizei(size - sizeof(format)));
 	GLint linked;
 	glGetProgramiv(prg, GL_LINK_STATUS, &linked);
-
+	// driver can reject binary anytime, e.g. after update
 	if (linked == GL_FALSE) {
-		GLint log_len = 0;
-		glGetProgramiv(prg, GL_INFO_LOG_LENGTH, &log_len);
-		if (log_len > 0) {
-			Array<char> log_buf(gl->allocator);
-			log_buf.resize(log_len);
-			glGetProgramInfoLog(prg, log_len, &log_len, &log_buf[0]);
-			logError(name, ": ", &log_buf[0]);
-		}
-		else {
-			logError("Failed to link program ", name);
-		}
 		glDeleteProgram(prg);
 		return false;
 	}
@@ -1356,6 +1798,31 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 }
 
 
+bool getProgramBinary(ProgramHandle prog, OutputMemoryStream& blob) {
+	checkThread();
+	ASSERT(prog);
+	GLint size = 0;
+	glGetProgramiv(prog->gl_handle, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0) return false;
+
+	const u64 offset = blob.size();
+	blob.resize(offset + sizeof(GLenum) + size);
+	GLenum format;
+	GLsizei len = 0;
+	glGetProgramBinary(prog->gl_handle, size, &len, &format, blob.getMutableData() + offset + sizeof(GLenum));
+	if (len == 0) {
+		blob.resize(offset);
+		return false;
+	}
+	memcpy(blob.getMutableData() + offset, &format, sizeof(format));
+	blob.resize(offset + sizeof(GLenum) + len);
+	return true;
+}
+
+
+u32 getDriverHash() { return gl->driver_hash; }
+
+
 void preinit(IAllocator& allocator, bool load_renderdoc)
 {
 	gl.create(allocator);
@@ -1399,19 +1866,48 @@ bool init(void* window_handle, InitFlags init_flags)
 
 	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &gl->max_vertex_attributes);
 
+	gl->draw_calls_counter = profiler::createCounter("draw calls", profiler::CounterType::SUM);
+	gl->triangles_counter = profiler::createCounter("triangles", profiler::CounterType::SUM);
+	gl->binds_counter = profiler::createCounter("gl binds", profiler::CounterType::SUM);
+	gl->skipped_binds_counter = profiler::createCounter("skipped gl binds", profiler::CounterType::SUM);
+	invalidateBindings();
+
+	// program binaries are valid only for the same driver
+	gl->driver_hash = 0;
+	const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (GLenum e : driver_strings) {
+		const char* str = (const char*)glGetString(e);
+		if (str) gl->driver_hash = continueCrc32(gl->driver_hash, str);
+	}
+
 	int extensions_count;
 	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions_count);
 	gl->has_gpu_mem_info_ext = false; 
+	gl->has_bindless_textures = false;
 	for(int i = 0; i < extensions_count; ++i) {
 		const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
 		if (equalStrings(ext, "GL_NVX_gpu_memory_info")) {
 			gl->has_gpu_mem_info_ext = true; 
-			break;
+		}
+		else if (equalStrings(ext, "GL_KHR_parallel_shader_compile") || equalStrings(ext, "GL_ARB_parallel_shader_compile")) {
+			if (!glMaxShaderCompilerThreadsKHR) {
+				glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getGLFunc(equalStrings(ext, "GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+			}
+		}
+		else if (equalStrings(ext, "GL_ARB_bindless_texture")) {
+			glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)getGLFunc("glGetTextureHandleARB");
+			glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)getGLFunc("glMakeTextureHandleResidentARB");
+			glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)getGLFunc("glMakeTextureHandleNonResidentARB");
+			gl->has_bindless_textures = glGetTextureHandleARB && glMakeTextureHandleResidentARB && glMakeTextureHandleNonResidentARB;
 		}
 		//OutputDebugString(ext);
 		//OutputDebugString("\n");
 	}
 	//const unsigned char* version = glGetString(GL_VERSION);
+	if (glMaxShaderCompilerThreadsKHR) {
+		glMaxShaderCompilerThreadsKHR(0xffFFffFF);
+		gl->has_parallel_shader_compile = true;
+	}
 
 	glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
 	glDepthFunc(GL_GREATER);
@@ -1436,6 +1932,8 @@ bool init(void* window_handle, InitFlags init_flags)
 	glBindVertexArray(gl->contexts[0].vao);
 	glVertexBindingDivisor(0, 0);
 	glVertexBindingDivisor(1, 1);
+	gl->contexts[0].bound_vao = gl->contexts[0].vao;
+	gl->current_context = &gl->contexts[0];
 
 	const GLuint vs = glCreateShader(GL_VERTEX_SHADER);
 	const char* vs_src = "void main() { gl_Position = vec4(0, 0, 0, 0); }";
@@ -1449,15 +1947,35 @@ bool init(void* window_handle, InitFlags init_flags)
 	glNamedBufferStorage(gl->helper_indirect_buffer, 256, nullptr, GL_DYNAMIC_STORAGE_BIT);
 
 	glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &gl->max_anisotropy);
-	gl->last_state = StateFlags(1);
+	gl->is_state_known = false;
 	setState(StateFlags::NONE);
 
+	const GLbitfield staging_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const u32 staging_size = StagingRing::CHUNK_SIZE * StagingRing::CHUNKS_COUNT;
+	glCreateBuffers(1, &gl->staging.buffer);
+	glNamedBufferStorage(gl->staging.buffer, staging_size, nullptr, staging_flags);
+	gl->staging.ptr = (u8*)glMapNamedBufferRange(gl->staging.buffer, 0, staging_size, staging_flags);
+	if (!gl->staging.ptr) logWarning("Failed to map texture staging buffer, textures are uploaded synchronously");
+
 	return true;
 }
 
 
 bool isOriginBottomLeft() { return true; }
 
+bool isBindlessSupported() { return gl->has_bindless_textures; }
+
+u64 getBindlessHandle(TextureHandle texture) {
+	checkThread();
+	if (!gl->has_bindless_textures || !texture || !texture->gl_handle) return 0;
+	
+	if (!texture->bindless_handle) {
+		texture->bindless_handle = glGetTextureHandleARB(texture->gl_handle);
+		if (texture->bindless_handle) glMakeTextureHandleResidentARB(texture->bindless_handle);
+	}
+	return texture->bindless_handle;
+}
+
 
 void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y) {
 	checkThread();
@@ -1483,6 +2001,17 @@ void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y) {
 	}
 }
 
+void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y, u32 src_x, u32 src_y, u32 w, u32 h) {
+	checkThread();
+	ASSERT(dst);
+	ASSERT(src);
+	ASSERT(src->target == GL_TEXTURE_2D && dst->target == GL_TEXTURE_2D);
+	ASSERT(src_x + w <= src->width && src_y + h <= src->height);
+	ASSERT(dst_x + w <= dst->width && dst_y + h <= dst->height);
+
+	glCopyImageSubData(src->gl_handle, src->target, 0, src_x, src_y, 0, dst->gl_handle, dst->target, 0, dst_x, dst_y, 0, w, h, 1);
+}
+
 void readTexture(TextureHandle texture, u32 mip, Span<u8> buf)
 {
 	checkThread();
@@ -1493,6 +2022,56 @@ void readTexture(TextureHandle texture, u32 mip, Span<u8> buf)
 	glGetTextureImage(handle, mip, fd.external, fd.type, buf.length(), buf.begin());
 }
 
+ReadbackHandle readTextureAsync(TextureHandle texture, u32 mip)
+{
+	checkThread();
+	ASSERT(texture);
+	const FormatDesc& fd = FormatDesc::get(texture->format);
+	ASSERT(!fd.compressed);
+	ASSERT(texture->target == GL_TEXTURE_2D || texture->target == GL_TEXTURE_CUBE_MAP);
+
+	Readback* readback = LUMIX_NEW(gl->allocator, Readback);
+	readback->size = fd.block_bytes * maximum(texture->width >> mip, 1) * maximum(texture->height >> mip, 1);
+	// all faces are read
+	if (texture->target == GL_TEXTURE_CUBE_MAP) readback->size *= 6;
+	glCreateBuffers(1, &readback->buffer);
+	glNamedBufferStorage(readback->buffer, readback->size, nullptr, GL_MAP_READ_BIT);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+	glGetTextureImage(texture->gl_handle, mip, fd.external, fd.type, readback->size, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	return readback;
+}
+
+bool isReadbackReady(ReadbackHandle readback)
+{
+	checkThread();
+	ASSERT(readback);
+	const GLenum res = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+}
+
+void getReadbackData(ReadbackHandle readback, Span<u8> buf)
+{
+	checkThread();
+	ASSERT(readback);
+	ASSERT(buf.length() <= readback->size);
+	const void* src = glMapNamedBufferRange(readback->buffer, 0, buf.length(), GL_MAP_READ_BIT);
+	if (!src) {
+		logError("Failed to map readback buffer");
+		return;
+	}
+	memcpy(buf.begin(), src, buf.length());
+	glUnmapNamedBuffer(readback->buffer);
+}
+
+void destroy(ReadbackHandle readback)
+{
+	checkThread();
+	LUMIX_DELETE(gl->allocator, readback);
+}
+
 
 void popDebugGroup()
 {
@@ -1575,6 +2154,7 @@ void setFramebufferCube(TextureHandle cube, u32 face, u32 mip)
 void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle ds, FramebufferFlags flags)
 {
 	checkThread();
+	++gl->stats.state_changes;
 
 	if (u32(flags & FramebufferFlags::SRGB)) {
 		glEnable(GL_FRAMEBUFFER_SRGB);
@@ -1592,6 +2172,7 @@ void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle ds, Frame
 		ASSERT(attachments[i]);
 		const GLuint t = attachments[i]->gl_handle;
 		glBindTexture(GL_TEXTURE_2D, t);
+		gl->bindings.textures[0] = Bindings::UNKNOWN_BINDING;
 		glBindFramebuffer(GL_FRAMEBUFFER, gl->framebuffer);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, t, 0);
 	}
@@ -1638,6 +2219,14 @@ void shutdown()
 {
 	checkThread();
 	destroy(gl->default_program);
+	for (GLsync fence : gl->staging.fences) {
+		if (fence) glDeleteSync(fence);
+	}
+	for (GLsync fence : gl->frame_fences) {
+		if (fence) glDeleteSync(fence);
+	}
+	if (gl->staging.ptr) glUnmapNamedBuffer(gl->staging.buffer);
+	glDeleteBuffers(1, &gl->staging.buffer);
 	for (WindowContext& ctx : gl->contexts) {
 		if (!ctx.window_handle) continue;
 		#ifdef _WIN32
@@ -6,6 +6,7 @@
 namespace Lumix {
 
 struct IAllocator;
+struct OutputMemoryStream;
 
 namespace gpu {
 
@@ -13,10 +14,12 @@ using BufferHandle = struct Buffer*;
 using ProgramHandle = struct Program*;
 using TextureHandle = struct Texture*;
 using QueryHandle = struct Query*;
+using ReadbackHandle = struct Readback*;
 const BufferHandle INVALID_BUFFER = nullptr;
 const ProgramHandle INVALID_PROGRAM = nullptr;
 const TextureHandle INVALID_TEXTURE = nullptr;
 const QueryHandle INVALID_QUERY = nullptr;
+const ReadbackHandle INVALID_READBACK = nullptr;
 
 enum class InitFlags : u32 {
 	NONE = 0,
@@ -103,11 +106,13 @@ enum class BlendFactors : u8 {
 };
 
 
+// keep order, this is serialized
 enum class AttributeType : u8 {
 	U8,
 	FLOAT,
 	I16,
-	I8
+	I8,
+	HALF
 };
 
 
@@ -132,7 +137,9 @@ enum class TextureFormat : u32 {
 	BC2,
 	BC3,
 	BC4,
-	BC5
+	BC5,
+	BC6H,
+	BC7
 };
 
 enum class BindShaderBufferFlags : u32 {
@@ -162,7 +169,7 @@ enum class BufferFlags : u32 {
 	UNIFORM_BUFFER = 1 << 1,
 	SHADER_BUFFER = 1 << 2,
 	COMPUTE_WRITE = 1 << 3,
-	MAPPABLE = 1 << 4,
+	MAPPABLE = 1 << 4, // persistently mapped and coherent, map once and keep the pointer
 };
 
 enum class DataType {
@@ -212,16 +219,28 @@ struct MemoryStats {
 	u64 dedicated_vidmem;
 };
 
+// totals since init, differences between two getStats() calls give cost of the work in between
+struct Stats {
+	u64 draw_calls = 0;
+	u64 triangles = 0;
+	// program, render state, framebuffer and texture bindings changes
+	u64 state_changes = 0;
+};
+
 
 void preinit(IAllocator& allocator, bool load_renderdoc);
 bool init(void* window_handle, InitFlags flags);
 void launchRenderDoc();
 void setCurrentWindow(void* window_handle);
 bool getMemoryStats(MemoryStats& stats);
+Stats getStats();
 u32 swapBuffers();
 void waitFrame(u32 frame);
 bool frameFinished(u32 frame);
 LUMIX_RENDERER_API bool isOriginBottomLeft();
+LUMIX_RENDERER_API bool isBindlessSupported();
+// GL_ARB_bindless_texture handle, texture is resident from the first call until destroyed; 0 if not supported
+u64 getBindlessHandle(TextureHandle texture);
 void checkThread();
 void shutdown();
 void startCapture();
@@ -251,8 +270,17 @@ ProgramHandle allocProgramHandle();
 
 void setState(StateFlags state);
 bool createProgram(ProgramHandle program, const VertexDecl& decl, const char** srcs, const ShaderType* types, u32 num, const char** prefixes, u32 prefixes_count, const char* name);
+// blob from getProgramBinary, fails if the driver does not accept it anymore
+bool createProgramFromBinary(ProgramHandle program, const VertexDecl& decl, const void* data, u32 size, const char* name);
+bool getProgramBinary(ProgramHandle program, OutputMemoryStream& blob);
+// programs can be compiled asynchronously by driver, draws using not yet compiled program are skipped
+bool isProgramReady(ProgramHandle program);
+// identifies driver and gpu, program binaries are not portable between different ones
+u32 getDriverHash();
 void useProgram(ProgramHandle prg);
 void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z);
+// makes compute shader writes visible to following draws (indirect args, vertex attributes, shader buffers)
+void memoryBarrier();
 
 void createBuffer(BufferHandle handle, BufferFlags flags, size_t size, const void* data);
 bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, TextureFlags flags, const char* debug_name);
@@ -270,8 +298,15 @@ void* map(BufferHandle buffer, size_t size);
 void unmap(BufferHandle buffer);
 void bindUniformBuffer(u32 ub_index, BufferHandle buffer, size_t offset, size_t size);
 void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y);
+// copies `w` x `h` texels of the first mip of 2D textures
+void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y, u32 src_x, u32 src_y, u32 w, u32 h);
 void copy(BufferHandle dst, BufferHandle src, u32 dst_offset, u32 size);
 void readTexture(TextureHandle texture, u32 mip, Span<u8> buf);
+// non-blocking readback, texture is copied to a readback buffer, data can be read once isReadbackReady returns true
+// 2D or cubemap textures, cubemaps are read with all faces
+ReadbackHandle readTextureAsync(TextureHandle texture, u32 mip);
+bool isReadbackReady(ReadbackHandle readback);
+void getReadbackData(ReadbackHandle readback, Span<u8> buf);
 void queryTimestamp(QueryHandle query);
 u64 getQueryResult(QueryHandle query);
 u64 getQueryFrequency();
@@ -281,6 +316,7 @@ void destroy(ProgramHandle program);
 void destroy(BufferHandle buffer);
 void destroy(TextureHandle texture);
 void destroy(QueryHandle query);
+void destroy(ReadbackHandle readback);
 
 void bindIndexBuffer(BufferHandle handle);
 void bindIndirectBuffer(BufferHandle handle);
@@ -290,6 +326,8 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 void drawElements(PrimitiveType primitive_type, u32 byte_offset, u32 count, DataType index_type);
 void drawArrays(PrimitiveType type, u32 offset, u32 count);
 void drawArraysInstanced(PrimitiveType type, u32 indices_count, u32 instances_count);
+// args are read from buffer bound by bindIndirectBuffer, {count, instances_count, first, base_instance}
+void drawArraysIndirect(PrimitiveType type);
 
 void pushDebugGroup(const char* msg);
 void popDebugGroup();
@@ -135,6 +135,7 @@ void Material::unload()
 		tex = nullptr;
 	}
 	
+	m_renderer.markRenderDataChanged();
 	m_renderer.runInRenderThread(m_render_data, [](Renderer& renderer, void* ptr){
 		LUMIX_DELETE(renderer.getAllocator(), (RenderData*)ptr);
 	});
@@ -379,6 +380,7 @@ void Material::updateRenderData(bool on_before_ready)
 	if (!m_shader) return;
 	if (!on_before_ready && !isReady()) return;
 
+	m_renderer.markRenderDataChanged();
 	if(m_render_data) {
 		m_renderer.destroyMaterialConstants(m_render_data->material_constants);
 		m_renderer.runInRenderThread(m_render_data, [](Renderer& renderer, void* ptr){
@@ -391,13 +393,20 @@ void Material::updateRenderData(bool on_before_ready)
 	m_render_data->render_states = m_render_states;
 	m_render_data->textures_count = m_texture_count;
 	MaterialConsts cs = {};
-	static_assert(sizeof(cs) == 256, "Renderer::MaterialConstants must have 256B");
+	static_assert(sizeof(cs) == 512, "Renderer::MaterialConstants must have 512B");
+	static_assert(lengthOf(cs.textures) == MAX_TEXTURE_COUNT, "");
 	cs.color = m_color;
 	cs.emission = m_emission;
 	cs.translucency = m_translucency;
 	cs.metallic = m_metallic;
 	cs.roughness = m_roughness;
 	memset(cs.custom, 0, sizeof(cs.custom));
+	m_render_data->bindless = m_shader->m_bindless_textures && gpu::isBindlessSupported();
+	if (m_render_data->bindless) {
+		for (u32 i = 0; i < m_texture_count; ++i) {
+			cs.textures[i] = m_textures[i] ? (u64)(uintptr)m_textures[i]->handle : 0;
+		}
+	}
 	for (const Shader::Uniform& shader_uniform : m_shader->m_uniforms) {
 		bool found = false;
 		const u32 size = shader_uniform.size();
@@ -695,17 +704,85 @@ int texture(lua_State* L)
 } // namespace LuaAPI
 
 
+bool Material::loadCompiled(u64 size, const u8* mem)
+{
+	InputMemoryStream blob(mem, size);
+	CompiledHeader header;
+	blob.read(header);
+	if (header.version != 0) {
+		logError("Unsupported version of compiled material ", getPath());
+		return false;
+	}
+
+	setShader(Path(blob.readString()));
+	const char* layer = blob.readString();
+	if (layer[0]) setLayer(m_renderer.getLayerIdx(layer));
+	enableBackfaceCulling(blob.read<bool>());
+	blob.read(m_color);
+	blob.read(m_roughness);
+	blob.read(m_metallic);
+	blob.read(m_emission);
+	blob.read(m_translucency);
+
+	const u32 defines_count = blob.read<u32>();
+	for (u32 i = 0; i < defines_count; ++i) {
+		setDefine(m_renderer.getShaderDefineIdx(blob.readString()), true);
+	}
+
+	const u32 flags_count = blob.read<u32>();
+	for (u32 i = 0; i < flags_count; ++i) {
+		setCustomFlag(getCustomFlag(blob.readString()));
+	}
+
+	const u32 textures_count = blob.read<u32>();
+	if (textures_count > MAX_TEXTURE_COUNT) {
+		logError("Too many textures in ", getPath());
+		return false;
+	}
+	for (u32 i = 0; i < textures_count; ++i) {
+		const char* path = blob.readString();
+		const bool keep_data = blob.read<u8>() != 0;
+		setTexturePath(m_texture_count, Path(path));
+		Texture* texture = m_textures[m_texture_count - 1];
+		if (keep_data && texture) texture->addDataReference();
+	}
+
+	const u32 uniforms_count = blob.read<u32>();
+	for (u32 i = 0; i < uniforms_count; ++i) {
+		Uniform u;
+		blob.read(u.name_hash);
+		const u8 size = blob.read<u8>();
+		if (size > sizeof(u.matrix)) {
+			logError("Invalid uniform in ", getPath());
+			return false;
+		}
+		blob.read(u.matrix, size);
+		m_uniforms.push(u);
+	}
+
+	if (!m_shader) {
+		logError("Material ", getPath(), " does not have a shader.");
+		return false;
+	}
+	return true;
+}
+
+
 bool Material::load(u64 size, const u8* mem)
 {
 	PROFILE_FUNCTION();
 
-	MaterialManager& mng = static_cast<MaterialManager&>(getResourceManager());
-	lua_State* L = mng.getState(*this);
-	
 	m_uniforms.clear();
 	m_render_states = gpu::StateFlags::CULL_BACK;
 	m_custom_flags = 0;
 
+	if (size >= sizeof(CompiledHeader) && ((const CompiledHeader*)mem)->magic == CompiledHeader::MAGIC) {
+		return loadCompiled(size, mem);
+	}
+
+	MaterialManager& mng = static_cast<MaterialManager&>(getResourceManager());
+	lua_State* L = mng.getState(*this);
+
 	const Span<const char> content((const char*)mem, (u32)size);
 	if (!LuaWrapper::execute(L, content, getPath().c_str(), 0)) {
 		return false;
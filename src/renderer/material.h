@@ -2,6 +2,7 @@
 
 
 #include "engine/array.h"
+#include "engine/inline_array.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/math.h"
@@ -25,9 +26,12 @@ struct  MaterialConsts {
 	float metallic;
 	float emission;
 	float translucency;
-	float custom[56];
+	// gpu::TextureHandle of bindless materials, replaced with resident bindless handles when uploaded to gpu
+	u64 textures[16];
+	float custom[88];
 };
 
+// lua state is used only by materials in source form, compiled materials are binary, see Material::CompiledHeader
 struct MaterialManager : ResourceManager {
 public:
 	MaterialManager(Renderer& renderer, IAllocator& allocator);
@@ -52,6 +56,7 @@ struct LUMIX_RENDERER_API Material final : Resource {
 		gpu::StateFlags render_states;
 		u32 material_constants;
 		u32 define_mask;
+		bool bindless; // shader reads textures through handles in material constants, no need to bind them
 	};
 
 	struct Uniform
@@ -68,6 +73,16 @@ struct LUMIX_RENDERER_API Material final : Resource {
 		};
 	};
 
+	// binary form of .mat written by the asset compiler, loaded without lua
+	// header is followed by shader path, layer name, backface culling (bool), color, roughness, metallic, emission, translucency,
+	// then u32 count prefixed arrays of define names, custom flag names, textures (path, keep data as u8) and uniforms (name hash, u8 size, value)
+	// strings are zero terminated, texture paths are relative to project root
+	struct CompiledHeader {
+		static constexpr u32 MAGIC = '_LMT';
+		u32 magic = MAGIC;
+		u32 version = 0;
+	};
+
 	static const ResourceType TYPE;
 
 	Material(const Path& path, ResourceManager& resource_manager, Renderer& renderer, IAllocator& allocator);
@@ -126,12 +141,18 @@ struct LUMIX_RENDERER_API Material final : Resource {
 	static const char* getCustomFlagName(int index);
 	static int getCustomFlagCount();
 	void updateRenderData(bool on_before_ready);
-	Array<Uniform>& getUniforms() { return m_uniforms; }
+	InlineArray<Uniform, 4>& getUniforms() { return m_uniforms; }
+
+	// feedback for texture streaming, size in pixels of the biggest object using this material on screen
+	// called from several workers at once, lost updates are fixed in the next frame
+	void reportScreenSize(float size) { if (size > m_screen_size) m_screen_size = size; }
+	float consumeScreenSize() { const float res = m_screen_size; m_screen_size = 0; return res; }
 
 private:
 	void onBeforeReady() override;
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
+	bool loadCompiled(u64 size, const u8* mem);
 
 	static int uniform(lua_State* L);
 	static int int_uniform(lua_State* L);
@@ -152,8 +173,9 @@ private:
 	u8 m_layer;
 	u32 m_sort_key;
 
-	Array<Uniform> m_uniforms;
+	InlineArray<Uniform, 4> m_uniforms;
 	u32 m_custom_flags;
+	float m_screen_size = 0;
 };
 
 } // namespace Lumix
@@ -1,15 +1,20 @@
 #include "engine/lumix.h"
 
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/file_system.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
+#include "engine/string.h"
+#include "meshoptimizer/meshoptimizer.h"
 #include "renderer/material.h"
 #include "renderer/model.h"
 #include "renderer/pose.h"
@@ -40,7 +45,9 @@ Mesh::Mesh(Material* mat,
 	, material(mat)
 	, indices(allocator)
 	, vertices(allocator)
+	, aabb(Vec3(0), Vec3(0))
 	, skin(allocator)
+	, meshlets(allocator)
 	, vertex_decl(vertex_decl)
 	, renderer(renderer)
 {
@@ -49,6 +56,8 @@ Mesh::Mesh(Material* mat,
 	render_data->vertex_buffer_handle = gpu::INVALID_BUFFER;
 	render_data->index_buffer_handle = gpu::INVALID_BUFFER;
 	render_data->index_type = gpu::DataType::U32;
+	render_data->meshlets_buffer = gpu::INVALID_BUFFER;
+	render_data->meshlets_count = 0;
 	for(AttributeSemantic& attr : attributes_semantic) {
 		attr = AttributeSemantic::NONE;
 	}
@@ -65,7 +74,9 @@ Mesh::Mesh(Mesh&& rhs)
 	: type(rhs.type)
 	, indices(rhs.indices)
 	, vertices(rhs.vertices.move())
+	, aabb(rhs.aabb)
 	, skin(rhs.skin.move())
+	, meshlets(rhs.meshlets.move())
 	, flags(rhs.flags)
 	, sort_key(rhs.sort_key)
 	, layer(rhs.layer)
@@ -73,16 +84,53 @@ Mesh::Mesh(Mesh&& rhs)
 	, material(rhs.material)
 	, vertex_decl(rhs.vertex_decl)
 	, render_data(rhs.render_data)
+	, raycast_cache(rhs.raycast_cache)
 	, lod(rhs.lod)
 	, renderer(rhs.renderer)
+	, vertex_data_offset(rhs.vertex_data_offset)
+	, vertex_data_size(rhs.vertex_data_size)
 {
 	memmove(attributes_semantic, rhs.attributes_semantic, sizeof(attributes_semantic));
 	rhs.sort_key = 0;
+	rhs.raycast_cache = nullptr;
 	ASSERT(false); // renderer keeps Mesh* pointer, so we should not move
 }
 
+// 4 triangles in SoA layout, unused slots have zero edges and never hit
+struct alignas(16) TrianglePacket {
+	float v0[3][4];
+	float e1[3][4];
+	float e2[3][4];
+};
+
+// 4-wide BVH node, children's bounds in SoA layout
+struct alignas(16) BVHNode {
+	enum : u32 {
+		LEAF = 0x80000000, // lower bits are index of a packet
+		EMPTY = 0xffFFffFF
+	};
+
+	float min[3][4];
+	float max[3][4];
+	u32 children[4];
+};
+
+struct Mesh::RayCastCache {
+	RayCastCache(IAllocator& allocator)
+		: nodes(allocator)
+		, packets(allocator)
+		, skinned_vertices(allocator)
+	{}
+
+	Array<BVHNode> nodes; // rigid meshes, root is nodes[0]
+	Array<TrianglePacket> packets;
+	Array<Vec3> skinned_vertices; // skinned meshes
+	u32 pose_hash = 0; // of the pose `skinned_vertices` are computed for
+};
+
 Mesh::~Mesh() {
 	renderer.freeSortKey(sort_key);
+	LUMIX_DELETE(renderer.getAllocator(), raycast_cache);
 }
 
 static bool hasAttribute(Mesh& mesh, Mesh::AttributeSemantic attribute)
@@ -113,6 +161,7 @@ Model::Model(const Path& path, ResourceManager& resource_manager, Renderer& rend
 	, m_bones(m_allocator)
 	, m_first_nonroot_bone_index(0)
 	, m_renderer(renderer)
+	, m_stream_data(allocator)
 {
 	for (LODMeshIndices& i : m_lod_indices) i = {0, -1};
 	for (float & i : m_lod_distances) i = FLT_MAX;
@@ -145,6 +194,367 @@ static void computeSkinMatrices(const Pose& pose, const Model& model, Matrix* ma
 }
 
 
+static Vec3 getTriangleVertex(const Mesh& mesh, const Vec3* vertices, u32 index) {
+	return mesh.areIndices16() ? vertices[((const u16*)mesh.indices.data())[index]] : vertices[((const u32*)mesh.indices.data())[index]];
+}
+
+
+static void setPacketTriangle(TrianglePacket& packet, u32 slot, const Vec3& p0, const Vec3& p1, const Vec3& p2) {
+	const Vec3 e1 = p1 - p0;
+	const Vec3 e2 = p2 - p0;
+	for (u32 c = 0; c < 3; ++c) {
+		packet.v0[c][slot] = p0[c];
+		packet.e1[c][slot] = e1[c];
+		packet.e2[c][slot] = e2[c];
+	}
+}
+
+
+struct BVHRay {
+	float4 origin[3];
+	float4 dir[3];
+	float4 inv_dir[3];
+};
+
+
+static BVHRay makeBVHRay(const Vec3& origin, const Vec3& dir) {
+	BVHRay ray;
+	for (u32 c = 0; c < 3; ++c) {
+		ray.origin[c] = f4Splat(origin[c]);
+		ray.dir[c] = f4Splat(dir[c]);
+		// finite so 0 * inv_dir does not produce NaN
+		const float inv = dir[c] == 0 ? 1e30f : 1 / dir[c];
+		ray.inv_dir[c] = f4Splat(inv);
+	}
+	return ray;
+}
+
+
+// Moller-Trumbore, double sided; returns mask of hits closer than `max_t`
+static u32 intersectPacket(const TrianglePacket& packet, const BVHRay& ray, float max_t, float4& t) {
+	const float4 v0x = f4Load(packet.v0[0]), v0y = f4Load(packet.v0[1]), v0z = f4Load(packet.v0[2]);
+	const float4 e1x = f4Load(packet.e1[0]), e1y = f4Load(packet.e1[1]), e1z = f4Load(packet.e1[2]);
+	const float4 e2x = f4Load(packet.e2[0]), e2y = f4Load(packet.e2[1]), e2z = f4Load(packet.e2[2]);
+	const float4 dx = ray.dir[0], dy = ray.dir[1], dz = ray.dir[2];
+
+	// pvec = dir x e2
+	const float4 px = f4Sub(f4Mul(dy, e2z), f4Mul(dz, e2y));
+	const float4 py = f4Sub(f4Mul(dz, e2x), f4Mul(dx, e2z));
+	const float4 pz = f4Sub(f4Mul(dx, e2y), f4Mul(dy, e2x));
+	const float4 det = f4Add(f4Add(f4Mul(e1x, px), f4Mul(e1y, py)), f4Mul(e1z, pz));
+	const float4 inv_det = f4Div(f4Splat(1), det);
+
+	const float4 tx = f4Sub(ray.origin[0], v0x);
+	const float4 ty = f4Sub(ray.origin[1], v0y);
+	const float4 tz = f4Sub(ray.origin[2], v0z);
+	const float4 u = f4Mul(f4Add(f4Add(f4Mul(tx, px), f4Mul(ty, py)), f4Mul(tz, pz)), inv_det);
+
+	// qvec = tvec x e1
+	const float4 qx = f4Sub(f4Mul(ty, e1z), f4Mul(tz, e1y));
+	const float4 qy = f4Sub(f4Mul(tz, e1x), f4Mul(tx, e1z));
+	const float4 qz = f4Sub(f4Mul(tx, e1y), f4Mul(ty, e1x));
+	const float4 v = f4Mul(f4Add(f4Add(f4Mul(dx, qx), f4Mul(dy, qy)), f4Mul(dz, qz)), inv_det);
+	t = f4Mul(f4Add(f4Add(f4Mul(e2x, qx), f4Mul(e2y, qy)), f4Mul(e2z, qz)), inv_det);
+
+	// comparisons are false for NaNs of degenerate triangles
+	const float4 eps = f4Splat(1e-6f);
+	const float4 zero = f4Splat(0);
+	const float4 abs_det = f4Max(det, f4Sub(zero, det));
+	float4 mask = f4CmpGT(abs_det, f4Splat(1e-20f));
+	mask = f4And(mask, f4CmpGT(u, f4Sub(zero, eps)));
+	mask = f4And(mask, f4CmpGT(v, f4Sub(zero, eps)));
+	mask = f4And(mask, f4CmpLT(f4Add(u, v), f4Splat(1 + 1e-6f)));
+	mask = f4And(mask, f4CmpGT(t, zero));
+	mask = f4And(mask, f4CmpLT(t, f4Splat(max_t)));
+	return f4MoveMask(mask);
+}
+
+
+// returns mask of children hit closer than `max_t`, `t` is where the ray enters them
+static u32 intersectNode(const BVHNode& node, const BVHRay& ray, float max_t, float4& t) {
+	float4 t_min = f4Splat(0);
+	float4 t_max = f4Splat(max_t);
+	for (u32 c = 0; c < 3; ++c) {
+		const float4 t0 = f4Mul(f4Sub(f4Load(node.min[c]), ray.origin[c]), ray.inv_dir[c]);
+		const float4 t1 = f4Mul(f4Sub(f4Load(node.max[c]), ray.origin[c]), ray.inv_dir[c]);
+		t_min = f4Max(t_min, f4Min(t0, t1));
+		t_max = f4Min(t_max, f4Max(t0, t1));
+	}
+	t = t_min;
+	return f4MoveMask(f4CmpLT(t_min, f4Add(t_max, f4Splat(1e-6f))));
+}
+
+
+struct BVHBuilder {
+	static constexpr u32 BINS = 16;
+	static constexpr u32 MAX_SAH_DEPTH = 32; // deeper nodes are split in half to bound the depth
+
+	struct Triangle {
+		Vec3 min;
+		Vec3 max;
+		Vec3 center;
+		u32 index; // of the first vertex in index buffer
+	};
+
+	struct Range {
+		u32 from;
+		u32 to;
+	};
+
+	BVHBuilder(const Mesh& mesh, Mesh::RayCastCache& cache, IAllocator& allocator)
+		: mesh(mesh)
+		, cache(cache)
+		, triangles(allocator)
+	{}
+
+	static float area(const Vec3& min, const Vec3& max) {
+		const Vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	// binned SAH along the longest axis of centroids' bounds
+	u32 split(Range range, u32 depth) {
+		const u32 mid = (range.from + range.to) / 2;
+		Vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+		for (u32 i = range.from; i < range.to; ++i) {
+			cmin = minimum(cmin, triangles[i].center);
+			cmax = maximum(cmax, triangles[i].center);
+		}
+		const Vec3 extent = cmax - cmin;
+		const u32 axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (depth > MAX_SAH_DEPTH || extent[axis] <= 0) return mid;
+
+		struct Bin {
+			Vec3 min = Vec3(FLT_MAX);
+			Vec3 max = Vec3(-FLT_MAX);
+			u32 count = 0;
+		} bins[BINS];
+		const float scale = BINS / extent[axis] * 0.9999f;
+		auto getBin = [&](const Triangle& tri){ return u32((tri.center[axis] - cmin[axis]) * scale); };
+		for (u32 i = range.from; i < range.to; ++i) {
+			Bin& bin = bins[getBin(triangles[i])];
+			bin.min = minimum(bin.min, triangles[i].min);
+			bin.max = maximum(bin.max, triangles[i].max);
+			++bin.count;
+		}
+
+		float right_cost[BINS];
+		Vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+		u32 rcount = 0;
+		for (u32 i = BINS - 1; i > 0; --i) {
+			rmin = minimum(rmin, bins[i].min);
+			rmax = maximum(rmax, bins[i].max);
+			rcount += bins[i].count;
+			right_cost[i] = rcount ? area(rmin, rmax) * rcount : 0;
+		}
+
+		float best_cost = FLT_MAX;
+		u32 best_bin = 0;
+		Vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+		u32 lcount = 0;
+		for (u32 i = 0; i < BINS - 1; ++i) {
+			lmin = minimum(lmin, bins[i].min);
+			lmax = maximum(lmax, bins[i].max);
+			lcount += bins[i].count;
+			if (lcount == 0 || lcount == range.to - range.from) continue;
+			const float cost = area(lmin, lmax) * lcount + right_cost[i + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_bin = i;
+			}
+		}
+		if (best_cost == FLT_MAX) return mid;
+
+		u32 l = range.from;
+		u32 r = range.to;
+		while (l < r) {
+			if (getBin(triangles[l]) <= best_bin) ++l;
+			else swap(triangles[l], triangles[--r]);
+		}
+		return l;
+	}
+
+	void computeBounds(Range range, Vec3& min, Vec3& max) const {
+		min = Vec3(FLT_MAX);
+		max = Vec3(-FLT_MAX);
+		for (u32 i = range.from; i < range.to; ++i) {
+			min = minimum(min, triangles[i].min);
+			max = maximum(max, triangles[i].max);
+		}
+	}
+
+	u32 createLeaf(Range range) {
+		ASSERT(range.to - range.from <= 4);
+		TrianglePacket& packet = cache.packets.emplace();
+		memset(&packet, 0, sizeof(packet));
+		for (u32 i = range.from; i < range.to; ++i) {
+			const u32 idx = triangles[i].index;
+			const Vec3* vertices = mesh.vertices.begin();
+			setPacketTriangle(packet, i - range.from, getTriangleVertex(mesh, vertices, idx), getTriangleVertex(mesh, vertices, idx + 1), getTriangleVertex(mesh, vertices, idx + 2));
+		}
+		return BVHNode::LEAF | (cache.packets.size() - 1);
+	}
+
+	// splits the range twice to get up to 4 children
+	u32 createNode(Range range, u32 depth) {
+		const u32 node_idx = cache.nodes.size();
+		BVHNode& node = cache.nodes.emplace();
+		memset(&node, 0, sizeof(node));
+
+		Range ranges[4];
+		u32 count = 0;
+		const u32 m = split(range, depth);
+		const Range halves[] = { {range.from, m}, {m, range.to} };
+		for (Range half : halves) {
+			if (half.to - half.from <= 4) {
+				ranges[count++] = half;
+				continue;
+			}
+			const u32 m2 = split(half, depth);
+			ranges[count++] = {half.from, m2};
+			ranges[count++] = {m2, half.to};
+		}
+
+		for (u32 i = 0; i < 4; ++i) {
+			Vec3 min(FLT_MAX), max(-FLT_MAX);
+			u32 child = BVHNode::EMPTY;
+			if (i < count && ranges[i].to > ranges[i].from) {
+				computeBounds(ranges[i], min, max);
+				child = ranges[i].to - ranges[i].from <= 4 ? createLeaf(ranges[i]) : createNode(ranges[i], depth + 1);
+			}
+			// `node` can be invalidated by the recursion
+			BVHNode& n = cache.nodes[node_idx];
+			for (u32 c = 0; c < 3; ++c) {
+				n.min[c][i] = min[c];
+				n.max[c][i] = max[c];
+			}
+			n.children[i] = child;
+		}
+		return node_idx;
+	}
+
+	void build() {
+		const u32 tri_count = u32(mesh.indices.size() / (mesh.areIndices16() ? 2 : 4) / 3);
+		triangles.reserve(tri_count);
+		const Vec3* vertices = mesh.vertices.begin();
+		for (u32 i = 0; i < tri_count; ++i) {
+			const Vec3 p0 = getTriangleVertex(mesh, vertices, i * 3);
+			const Vec3 p1 = getTriangleVertex(mesh, vertices, i * 3 + 1);
+			const Vec3 p2 = getTriangleVertex(mesh, vertices, i * 3 + 2);
+			Triangle& tri = triangles.emplace();
+			tri.min = minimum(p0, minimum(p1, p2));
+			tri.max = maximum(p0, maximum(p1, p2));
+			tri.center = (tri.min + tri.max) * 0.5f;
+			tri.index = i * 3;
+		}
+		if (tri_count == 0) return;
+		
+		cache.packets.reserve((tri_count + 3) / 4);
+		createNode({0, tri_count}, 0);
+	}
+
+	const Mesh& mesh;
+	Mesh::RayCastCache& cache;
+	Array<Triangle> triangles;
+};
+
+
+static void castRayBVH(const Mesh::RayCastCache& cache, const BVHRay& ray, float& best_t, Mesh* mesh, EntityPtr entity, const RayCastModelHit::Filter* filter, RayCastModelHit& hit) {
+	if (cache.nodes.empty()) return;
+
+	u32 stack[256];
+	float stack_t[256];
+	u32 stack_size = 1;
+	stack[0] = 0;
+	stack_t[0] = 0;
+	while (stack_size > 0) {
+		--stack_size;
+		if (stack_t[stack_size] > best_t) continue;
+		const u32 child = stack[stack_size];
+
+		if (child & BVHNode::LEAF) {
+			float4 t4;
+			u32 mask = intersectPacket(cache.packets[child & ~BVHNode::LEAF], ray, best_t, t4);
+			if (!mask) continue;
+			alignas(16) float ts[4];
+			f4Store(ts, t4);
+			for (u32 i = 0; i < 4; ++i) {
+				if ((mask & (1 << i)) == 0 || ts[i] >= best_t) continue;
+				RayCastModelHit prev = hit;
+				hit.is_hit = true;
+				hit.t = ts[i];
+				hit.entity = entity;
+				hit.mesh = mesh;
+				if (filter && !filter->invoke(hit)) hit = prev;
+				else best_t = ts[i];
+			}
+			continue;
+		}
+
+		const BVHNode& node = cache.nodes[child];
+		float4 t4;
+		const u32 mask = intersectNode(node, ray, best_t, t4);
+		if (!mask) continue;
+		alignas(16) float ts[4];
+		f4Store(ts, t4);
+		
+		// push the farthest first so the nearest is popped first
+		u32 order[4];
+		u32 count = 0;
+		for (u32 i = 0; i < 4; ++i) {
+			if ((mask & (1 << i)) == 0 || node.children[i] == BVHNode::EMPTY) continue;
+			u32 j = count++;
+			while (j > 0 && ts[order[j - 1]] < ts[i]) {
+				order[j] = order[j - 1];
+				--j;
+			}
+			order[j] = i;
+		}
+		ASSERT(stack_size + count <= lengthOf(stack));
+		for (u32 i = 0; i < count; ++i) {
+			stack[stack_size] = node.children[order[i]];
+			stack_t[stack_size] = ts[order[i]];
+			++stack_size;
+		}
+	}
+}
+
+
+static void castRaySkinned(Mesh& mesh, const Vec3* vertices, const BVHRay& ray, float& best_t, EntityPtr entity, const RayCastModelHit::Filter* filter, RayCastModelHit& hit) {
+	const u32 tri_count = u32(mesh.indices.size() / (mesh.areIndices16() ? 2 : 4) / 3);
+	for (u32 i = 0; i < tri_count; i += 4) {
+		TrianglePacket packet;
+		memset(&packet, 0, sizeof(packet));
+		const u32 count = minimum(4u, tri_count - i);
+		for (u32 j = 0; j < count; ++j) {
+			const u32 idx = (i + j) * 3;
+			setPacketTriangle(packet, j, getTriangleVertex(mesh, vertices, idx), getTriangleVertex(mesh, vertices, idx + 1), getTriangleVertex(mesh, vertices, idx + 2));
+		}
+
+		float4 t4;
+		const u32 mask = intersectPacket(packet, ray, best_t, t4);
+		if (!mask) continue;
+		alignas(16) float ts[4];
+		f4Store(ts, t4);
+		for (u32 j = 0; j < 4; ++j) {
+			if ((mask & (1 << j)) == 0 || ts[j] >= best_t) continue;
+			RayCastModelHit prev = hit;
+			hit.is_hit = true;
+			hit.t = ts[j];
+			hit.entity = entity;
+			hit.mesh = &mesh;
+			if (filter && !filter->invoke(hit)) hit = prev;
+			else best_t = ts[j];
+		}
+	}
+}
+
+
+static u32 getPoseHash(const Pose& pose) {
+	return crc32(pose.positions, pose.count * sizeof(pose.positions[0])) ^ crc32(pose.rotations, pose.count * sizeof(pose.rotations[0]));
+}
+
+
 bool Model::isSkinned() const
 {
 	ASSERT(isReady());
@@ -157,84 +567,49 @@ bool Model::isSkinned() const
 
 RayCastModelHit Model::castRay(const Vec3& origin, const Vec3& dir, const Pose* pose, EntityPtr entity, const RayCastModelHit::Filter* filter)
 {
+	PROFILE_FUNCTION();
 	RayCastModelHit hit;
 	hit.is_hit = false;
 	if (!isReady()) return hit;
 
 	Matrix matrices[256];
 	ASSERT(!pose || pose->count <= lengthOf(matrices));
-	bool is_skinned = false;
+	const bool can_skin = pose && pose->count <= lengthOf(matrices);
+	bool matrices_computed = false;
+	const u32 pose_hash = can_skin ? getPoseHash(*pose) : 0;
+	const BVHRay ray = makeBVHRay(origin, dir);
+	float best_t = FLT_MAX;
+
+	// caches are created and used under the lock, model can be shared by many threads
+	MutexGuard guard(m_raycast_mutex);
 	for (int mesh_index = m_lod_indices[0].from; mesh_index <= m_lod_indices[0].to; ++mesh_index) {
 		Mesh& mesh = m_meshes[mesh_index];
-		is_skinned = pose && !mesh.skin.empty() && pose->count <= lengthOf(matrices);
-	}
-	if (is_skinned) {
-		computeSkinMatrices(*pose, *this, matrices);
-	}
-
-	for (int mesh_index = m_lod_indices[0].from; mesh_index <= m_lod_indices[0].to; ++mesh_index) {
-		const Mesh& mesh = m_meshes[mesh_index];
-		const bool is_mesh_skinned = !mesh.skin.empty() && is_skinned;
-		const u16* indices16 = (const u16*)mesh.indices.data();
-		const u32* indices32 = (const u32*)mesh.indices.data();
-		const bool is16 = mesh.flags.isSet(Mesh::Flags::INDICES_16_BIT);
-		const int index_size = is16 ? 2 : 4;
-		const Vec3* vertices = mesh.vertices.begin();
+		if (!mesh.raycast_cache) mesh.raycast_cache = LUMIX_NEW(m_renderer.getAllocator(), Mesh::RayCastCache)(m_allocator);
+		Mesh::RayCastCache& cache = *mesh.raycast_cache;
 		
-		for (i32 i = 0, c = (i32)mesh.indices.size() / index_size; i < c; i += 3) {
-			Vec3 p0, p1, p2;
-			if (is16) {
-				p0 = vertices[indices16[i]];
-				p1 = vertices[indices16[i + 1]];
-				p2 = vertices[indices16[i + 2]];
-				if (is_mesh_skinned) {
-					p0 = evaluateSkin(p0, mesh.skin[indices16[i]], matrices);
-					p1 = evaluateSkin(p1, mesh.skin[indices16[i + 1]], matrices);
-					p2 = evaluateSkin(p2, mesh.skin[indices16[i + 2]], matrices);
+		if (!mesh.skin.empty() && can_skin) {
+			if (cache.skinned_vertices.empty() || cache.pose_hash != pose_hash) {
+				PROFILE_BLOCK("skin");
+				if (!matrices_computed) {
+					computeSkinMatrices(*pose, *this, matrices);
+					matrices_computed = true;
 				}
-			} else {
-				p0 = vertices[indices32[i]];
-				p1 = vertices[indices32[i + 1]];
-				p2 = vertices[indices32[i + 2]];
-				if (is_mesh_skinned) {
-					p0 = evaluateSkin(p0, mesh.skin[indices32[i]], matrices);
-					p1 = evaluateSkin(p1, mesh.skin[indices32[i + 1]], matrices);
-					p2 = evaluateSkin(p2, mesh.skin[indices32[i + 2]], matrices);
+				cache.skinned_vertices.resize(mesh.vertices.size());
+				for (i32 i = 0, c = mesh.vertices.size(); i < c; ++i) {
+					cache.skinned_vertices[i] = evaluateSkin(mesh.vertices[i], mesh.skin[i], matrices);
 				}
+				cache.pose_hash = pose_hash;
 			}
+			castRaySkinned(mesh, cache.skinned_vertices.begin(), ray, best_t, entity, filter, hit);
+			continue;
+		}
 
-			Vec3 normal = cross(p1 - p0, p2 - p0);
-			float q = dot(normal, dir);
-			if (q == 0)	continue;
-
-			float d = -dot(normal, p0);
-			float t = -(dot(normal, origin) + d) / q;
-			if (t < 0) continue;
-
-			Vec3 hit_point = origin + dir * t;
-
-			Vec3 edge0 = p1 - p0;
-			Vec3 VP0 = hit_point - p0;
-			if (dot(normal, cross(edge0, VP0)) < 0) continue;
-
-			Vec3 edge1 = p2 - p1;
-			Vec3 VP1 = hit_point - p1;
-			if (dot(normal, cross(edge1, VP1)) < 0) continue;
-
-			Vec3 edge2 = p0 - p2;
-			Vec3 VP2 = hit_point - p2;
-			if (dot(normal, cross(edge2, VP2)) < 0) continue;
-
-			if (!hit.is_hit || hit.t > t)
-			{
-				RayCastModelHit prev = hit;
-				hit.is_hit = true;
-				hit.t = t;
-				hit.entity = entity;
-				hit.mesh = &m_meshes[mesh_index];
-				if (filter && !filter->invoke(hit)) hit = prev;
-			}
+		if (cache.nodes.empty() && !mesh.indices.empty()) {
+			PROFILE_BLOCK("build BVH");
+			BVHBuilder builder(mesh, cache, m_allocator);
+			builder.build();
 		}
+		castRayBVH(cache, ray, best_t, &mesh, entity, filter, hit);
 	}
 	hit.origin = DVec3(origin.x, origin.y, origin.z);
 	hit.dir = dir;
@@ -332,10 +707,18 @@ static bool parseVertexDecl(IInputStream& file, gpu::VertexDecl* vertex_decl, Me
 	}
 	vb_stride = offset;
 
-	if (!is_skinned) {
+	if (is_skinned) {
+		// rotation, position & scale, offset of the first bone in the bone buffer
+		vertex_decl->addAttribute(9, 0, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		vertex_decl->addAttribute(10, 16, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		vertex_decl->addAttribute(11, 32, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+	}
+	else {
+		// rotation, position & scale, lod, index of material constants
 		vertex_decl->addAttribute(4, 0, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
 		vertex_decl->addAttribute(5, 16, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
 		vertex_decl->addAttribute(6, 32, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		vertex_decl->addAttribute(12, 36, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
 	}
 
 	return true;
@@ -448,7 +831,27 @@ static int getAttributeOffset(Mesh& mesh, Mesh::AttributeSemantic attr)
 }
 
 
-bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
+// vertex data are copied even if they are not encoded, since the resource is freed before gpu buffers are created
+static bool decodeMeshVertices(const Mesh& mesh, const u8* data, Renderer& renderer, Renderer::MemRef& out)
+{
+	const u8* src = data + mesh.vertex_data_offset;
+	if (mesh.vertex_data_encoded_size == 0) {
+		out = renderer.copy(src, mesh.vertex_data_size);
+		return true;
+	}
+
+	out = renderer.allocate(mesh.vertex_data_size);
+	const u32 stride = mesh.render_data->vb_stride;
+	if (meshopt_decodeVertexBuffer(out.data, mesh.vertex_data_size / stride, stride, src, mesh.vertex_data_encoded_size) != 0) {
+		renderer.free(out);
+		out = {};
+		return false;
+	}
+	return true;
+}
+
+
+bool Model::parseMeshes(InputMemoryStream& file, FileVersion version, Array<Renderer::MemRef>& vertices)
 {
 	int object_count = 0;
 	file.read(object_count);
@@ -486,6 +889,11 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		addDependency(*material);
 	}
 
+	const bool encoded = version >= FileVersion::ENCODED_BUFFERS;
+	// offset and size of encoded indices of each mesh, they are decoded on workers
+	struct EncodedIndices { u32 offset; u32 size; };
+	Array<EncodedIndices> encoded_indices(m_allocator);
+	encoded_indices.resize(object_count);
 	for (int i = 0; i < object_count; ++i)
 	{
 		Mesh& mesh = m_meshes[i];
@@ -497,48 +905,97 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		if (indices_count <= 0) return false;
 		mesh.indices.resize(index_size * indices_count);
 		mesh.render_data->indices_count = indices_count;
-		file.read(mesh.indices.getMutableData(), mesh.indices.size());
+		encoded_indices[i].size = 0;
+		if (encoded && !file.read(&encoded_indices[i].size, sizeof(encoded_indices[i].size))) return false;
+		if (encoded_indices[i].size == 0) {
+			if (!file.read(mesh.indices.getMutableData(), mesh.indices.size())) return false;
+		}
+		else {
+			if (file.getPosition() + encoded_indices[i].size > file.size()) return false;
+			encoded_indices[i].offset = (u32)file.getPosition();
+			file.skip(encoded_indices[i].size);
+		}
 
 		if (index_size == 2) mesh.flags.set(Mesh::Flags::INDICES_16_BIT);
-		const Renderer::MemRef mem = m_renderer.copy(mesh.indices.data(), (u32)mesh.indices.size());
-		mesh.render_data->index_buffer_handle = m_renderer.createBuffer(mem, gpu::BufferFlags::IMMUTABLE);
 		mesh.render_data->index_type = index_size == 2 ? gpu::DataType::U16 : gpu::DataType::U32;
-		if (!mesh.render_data->index_buffer_handle) return false;
 	}
 
+	// gpu buffers are created later, only for resident lods
 	for (int i = 0; i < object_count; ++i)
 	{
 		Mesh& mesh = m_meshes[i];
 		int data_size;
 		file.read(data_size);
-		Renderer::MemRef vertices_mem = m_renderer.allocate(data_size);
-		file.read(vertices_mem.data, data_size);
-
-		int position_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::POSITION);
-		int weights_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::WEIGHTS);
-		int bone_indices_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::INDICES);
-		bool keep_skin = hasAttribute(mesh, Mesh::AttributeSemantic::WEIGHTS) && hasAttribute(mesh, Mesh::AttributeSemantic::INDICES);
-
-		int vertex_size = mesh.render_data->vb_stride;
-		int mesh_vertex_count = data_size / vertex_size;
-		mesh.vertices.resize(mesh_vertex_count);
-		if (keep_skin) mesh.skin.resize(mesh_vertex_count);
-		const u8* vertices = (const u8*)vertices_mem.data;
-		for (int j = 0; j < mesh_vertex_count; ++j)
-		{
-			int offset = j * vertex_size;
-			if (keep_skin)
+		if (data_size < 0 || data_size % mesh.render_data->vb_stride != 0) return false;
+		u32 encoded_size = 0;
+		if (encoded && !file.read(&encoded_size, sizeof(encoded_size))) return false;
+		const u32 stored_size = encoded_size == 0 ? data_size : encoded_size;
+		if (file.getPosition() + stored_size > file.size()) return false;
+		mesh.vertex_data_offset = (u32)file.getPosition();
+		mesh.vertex_data_size = data_size;
+		mesh.vertex_data_encoded_size = encoded_size;
+		file.skip(stored_size);
+	}
+
+	const u8* data = (const u8*)file.getBuffer();
+	vertices.resize(object_count);
+	volatile i32 failed = 0;
+	jobs::forEach(object_count, 1, [&](i32 from, i32 to){
+		PROFILE_BLOCK("parse vertices");
+		for (i32 i = from; i < to; ++i) {
+			Mesh& mesh = m_meshes[i];
+			vertices[i] = {};
+			if (encoded_indices[i].size != 0) {
+				const u32 index_size = mesh.areIndices16() ? 2 : 4;
+				const u8* src = data + encoded_indices[i].offset;
+				if (meshopt_decodeIndexBuffer(mesh.indices.getMutableData(), mesh.render_data->indices_count, index_size, src, encoded_indices[i].size) != 0) {
+					failed = 1;
+					continue;
+				}
+			}
+			if (!decodeMeshVertices(mesh, data, m_renderer, vertices[i])) {
+				failed = 1;
+				continue;
+			}
+
+			const int position_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::POSITION);
+			const int weights_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::WEIGHTS);
+			const int bone_indices_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::INDICES);
+			const bool keep_skin = hasAttribute(mesh, Mesh::AttributeSemantic::WEIGHTS) && hasAttribute(mesh, Mesh::AttributeSemantic::INDICES);
+
+			const int vertex_size = mesh.render_data->vb_stride;
+			const int mesh_vertex_count = mesh.vertex_data_size / vertex_size;
+			mesh.vertices.resize(mesh_vertex_count);
+			if (keep_skin) mesh.skin.resize(mesh_vertex_count);
+			const u8* vertices_data = (const u8*)vertices[i].data;
+			for (int j = 0; j < mesh_vertex_count; ++j)
 			{
-				mesh.skin[j].weights = *(const Vec4*)&vertices[offset + weights_attribute_offset];
-				memcpy(mesh.skin[j].indices,
-					&vertices[offset + bone_indices_attribute_offset],
-					sizeof(mesh.skin[j].indices));
+				int offset = j * vertex_size;
+				if (keep_skin)
+				{
+					mesh.skin[j].weights = *(const Vec4*)&vertices_data[offset + weights_attribute_offset];
+					memcpy(mesh.skin[j].indices,
+						&vertices_data[offset + bone_indices_attribute_offset],
+						sizeof(mesh.skin[j].indices));
+				}
+				mesh.vertices[j] = *(const Vec3*)&vertices_data[offset + position_attribute_offset];
+			}
+			if (mesh_vertex_count > 0) {
+				mesh.aabb = AABB(mesh.vertices[0], mesh.vertices[0]);
+				for (const Vec3& v : mesh.vertices) mesh.aabb.addPoint(v);
 			}
-			mesh.vertices[j] = *(const Vec3*)&vertices[offset + position_attribute_offset];
 		}
-		mesh.render_data->vertex_buffer_handle = m_renderer.createBuffer(vertices_mem, gpu::BufferFlags::IMMUTABLE);
-		if (!mesh.render_data->vertex_buffer_handle) return false;
+	});
+
+	if (failed) {
+		logError("Failed to decode ", getPath());
+		for (Renderer::MemRef& mem : vertices) {
+			if (mem.own) m_renderer.free(mem);
+		}
+		vertices.clear();
+		return false;
 	}
+
 	file.read(m_origin_bounding_radius);
 	file.read(m_center_bounding_radius);
 	file.read(m_aabb);
@@ -565,6 +1022,23 @@ bool Model::parseLODs(InputMemoryStream& file)
 }
 
 
+bool Model::parseMeshlets(InputMemoryStream& file)
+{
+	for (Mesh& mesh : m_meshes) {
+		u32 count;
+		if (!file.read(&count, sizeof(count))) return false;
+		if (count == 0) continue;
+
+		mesh.meshlets.resize(count);
+		if (!file.read(mesh.meshlets.begin(), mesh.meshlets.byte_size())) return false;
+		for (const Mesh::Meshlet& meshlet : mesh.meshlets) {
+			if (meshlet.first_index + meshlet.indices_count > (u32)mesh.render_data->indices_count) return false;
+		}
+	}
+	return true;
+}
+
+
 bool Model::load(u64 size, const u8* mem)
 {
 	PROFILE_FUNCTION();
@@ -578,41 +1052,341 @@ bool Model::load(u64 size, const u8* mem)
 		return false;
 	}
 
-	if(header.version > (u32)FileVersion::LATEST)
+	if(header.version >= (u32)FileVersion::LATEST)
 	{
 		logWarning("Unsupported version of model ", getPath());
 		return false;
 	}
 
-	if (parseMeshes(file, (FileVersion)header.version)
-		&& parseBones(file)
-		&& parseLODs(file))
+	Array<Renderer::MemRef> vertices(m_allocator);
+	if (!parseMeshes(file, (FileVersion)header.version, vertices)) return false;
+
+	auto freeVertices = [&](i32 from, i32 to){
+		for (i32 i = from; i < to; ++i) m_renderer.free(vertices[i]);
+	};
+
+	if (!parseBones(file)
+		|| !parseLODs(file)
+		|| (header.version >= (u32)FileVersion::MESHLETS && !parseMeshlets(file)))
 	{
+		freeVertices(0, vertices.size());
+		return false;
+	}
+
+	// cpu geometry is enough for raycasts
+	if (m_renderer.isHeadless()) {
+		freeVertices(0, vertices.size());
+		m_data_size = size;
 		return true;
 	}
 
-	return false;
+	// only the coarsest lod is uploaded now, finer lods are streamed when they are rendered
+	u32 lod_count = 0;
+	while (lod_count < MAX_LOD_COUNT && m_lod_indices[lod_count].to >= m_lod_indices[lod_count].from) ++lod_count;
+	m_data_size = size;
+	m_base_lod = lod_count > 0 ? lod_count - 1 : 0;
+	m_is_streamed = m_base_lod > 0;
+	m_resident_lod = m_is_streamed ? m_base_lod : 0;
+	m_wanted_lod = m_resident_lod;
+	const i32 first_resident = m_lod_indices[m_resident_lod].from;
+	freeVertices(0, first_resident);
+	if (!createBuffers(first_resident, m_meshes.size(), vertices)) return false;
+	if (m_is_streamed) m_renderer.getModelStreamer().add(*this);
+	return true;
+}
+
+
+bool Model::decodeVertices(i32 from_mesh, i32 to_mesh, const u8* data, u64 size, Array<Renderer::MemRef>& vertices)
+{
+	PROFILE_FUNCTION();
+	for (i32 i = from_mesh; i < to_mesh; ++i) {
+		const Mesh& mesh = m_meshes[i];
+		const u32 stored_size = mesh.vertex_data_encoded_size == 0 ? mesh.vertex_data_size : mesh.vertex_data_encoded_size;
+		if (mesh.vertex_data_offset + (u64)stored_size > size) return false;
+	}
+
+	vertices.resize(m_meshes.size());
+	volatile i32 failed = 0;
+	jobs::forEach(to_mesh - from_mesh, 1, [&](i32 from, i32 to){
+		PROFILE_BLOCK("decode vertices");
+		for (i32 i = from_mesh + from; i < from_mesh + to; ++i) {
+			if (!decodeMeshVertices(m_meshes[i], data, m_renderer, vertices[i])) failed = 1;
+		}
+	});
+
+	if (failed) {
+		for (i32 i = from_mesh; i < to_mesh; ++i) {
+			if (vertices[i].own) m_renderer.free(vertices[i]);
+		}
+		return false;
+	}
+	return true;
+}
+
+
+bool Model::readVertices(i32 from_mesh, i32 to_mesh, Array<Renderer::MemRef>& vertices)
+{
+	PROFILE_FUNCTION();
+	ASSERT(isReady());
+	FileSystem& fs = getResourceManager().getOwner().getFileSystem();
+	const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", getPath().getHash(), ".res");
+	OutputMemoryStream content(m_allocator);
+	if (!fs.getContentSync(Path(res_path), content)) return false;
+
+	const CompiledResourceHeader* header = (const CompiledResourceHeader*)content.data();
+	if (content.size() < sizeof(*header) || header->magic != CompiledResourceHeader::MAGIC) return false;
+
+	const u8* payload = content.data() + sizeof(*header);
+	const u64 payload_size = content.size() - sizeof(*header);
+	OutputMemoryStream decompressed(m_allocator);
+	if (header->flags & CompiledResourceHeader::COMPRESSED) {
+		if (!getResourceManager().getOwner().decompress(*header, Span(payload, (u32)payload_size), decompressed)) return false;
+	}
+	else {
+		decompressed.write(payload, payload_size);
+	}
+	// file changed since it was loaded
+	if (decompressed.size() != m_data_size) return false;
+
+	return decodeVertices(from_mesh, to_mesh, decompressed.data(), decompressed.size(), vertices);
+}
+
+
+// takes ownership of decoded vertices of meshes [from_mesh, to_mesh)
+bool Model::createBuffers(i32 from_mesh, i32 to_mesh, Array<Renderer::MemRef>& vertices)
+{
+	for (i32 i = from_mesh; i < to_mesh; ++i) {
+		Mesh& mesh = m_meshes[i];
+
+		if (mesh.meshlets.empty()) {
+			const Renderer::MemRef indices_mem = m_renderer.copy(mesh.indices.data(), (u32)mesh.indices.size());
+			mesh.render_data->index_buffer_handle = m_renderer.createBuffer(indices_mem, gpu::BufferFlags::IMMUTABLE);
+		}
+		else {
+			// meshlet culling reads indices in a shader as uints, so 16bit indices are padded
+			const u32 indices_size = ((u32)mesh.indices.size() + 3) & ~3;
+			const Renderer::MemRef indices_mem = m_renderer.allocate(indices_size);
+			memset(indices_mem.data, 0, indices_size);
+			memcpy(indices_mem.data, mesh.indices.data(), mesh.indices.size());
+			mesh.render_data->index_buffer_handle = m_renderer.createBuffer(indices_mem, gpu::BufferFlags::IMMUTABLE | gpu::BufferFlags::SHADER_BUFFER);
+			
+			const Renderer::MemRef meshlets_mem = m_renderer.copy(mesh.meshlets.begin(), mesh.meshlets.byte_size());
+			mesh.render_data->meshlets_buffer = m_renderer.createBuffer(meshlets_mem, gpu::BufferFlags::IMMUTABLE | gpu::BufferFlags::SHADER_BUFFER);
+			mesh.render_data->meshlets_count = mesh.meshlets.size();
+		}
+
+		mesh.render_data->vertex_buffer_handle = m_renderer.createBuffer(vertices[i], gpu::BufferFlags::IMMUTABLE);
+		vertices[i] = {};
+		if (!mesh.render_data->index_buffer_handle || !mesh.render_data->vertex_buffer_handle) {
+			for (i32 j = i + 1; j < to_mesh; ++j) m_renderer.free(vertices[j]);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+u32 Model::useLOD(u32 lod)
+{
+	if (!m_is_streamed) return lod;
+	for (;;) {
+		const i32 wanted = m_wanted_lod;
+		if (wanted <= (i32)lod) break;
+		if (compareAndExchange(&m_wanted_lod, lod, wanted)) break;
+	}
+	return maximum(lod, m_resident_lod);
+}
+
+
+void Model::streamLODs(u32 lod)
+{
+	ASSERT(m_is_streamed);
+	ASSERT(!m_stream_op.isValid());
+	ASSERT(lod < m_resident_lod);
+
+	m_stream_lod = lod;
+	FileSystem& fs = getResourceManager().getOwner().getFileSystem();
+	const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", getPath().getHash(), ".res");
+	m_stream_op = fs.getContent(Path(res_path), makeDelegate<&Model::onLODsLoaded>(this), FileSystem::Priority::LOW);
+}
+
+
+void Model::onLODsLoaded(u64 size, const u8* mem, bool success)
+{
+	PROFILE_FUNCTION();
+	m_stream_op = FileSystem::AsyncHandle::invalid();
+	if (!success || !isReady()) return;
+
+	const CompiledResourceHeader* header = (const CompiledResourceHeader*)mem;
+	if (size < sizeof(*header) || header->magic != CompiledResourceHeader::MAGIC) return;
+
+	// buffers are created in ModelStreamer::update, render job setups can use render data now
+	const u8* payload = mem + sizeof(*header);
+	const u64 payload_size = size - sizeof(*header);
+	if (header->flags & CompiledResourceHeader::COMPRESSED) {
+		if (!getResourceManager().getOwner().decompress(*header, Span(payload, (u32)payload_size), m_stream_data)) m_stream_data.clear();
+	}
+	else {
+		m_stream_data.clear();
+		m_stream_data.write(payload, payload_size);
+	}
+	// file changed since it was loaded, reload takes care of it
+	if (m_stream_data.size() != m_data_size) m_stream_data.clear();
+}
+
+
+void Model::applyStreamedLODs()
+{
+	if (m_stream_data.empty()) return;
+	
+	if (m_stream_lod < m_resident_lod) {
+		const i32 from = m_lod_indices[m_stream_lod].from;
+		const i32 to = m_lod_indices[m_resident_lod].from;
+		Array<Renderer::MemRef> vertices(m_allocator);
+		if (decodeVertices(from, to, m_stream_data.data(), m_stream_data.size(), vertices) && createBuffers(from, to, vertices)) {
+			m_resident_lod = m_stream_lod;
+			m_renderer.markRenderDataChanged();
+		}
+	}
+	m_stream_data.clear();
+	m_stream_data.free();
+}
+
+
+static void destroyRenderData(Renderer& renderer, Mesh::RenderData* render_data)
+{
+	renderer.runInRenderThread(render_data, [](Renderer& renderer, void* ptr){
+		Mesh::RenderData* rd = (Mesh::RenderData*)ptr;
+		if (rd->index_buffer_handle) gpu::destroy(rd->index_buffer_handle);
+		if (rd->vertex_buffer_handle) gpu::destroy(rd->vertex_buffer_handle);
+		if (rd->meshlets_buffer) gpu::destroy(rd->meshlets_buffer);
+		LUMIX_DELETE(renderer.getAllocator(), rd); 
+	});
+}
+
+
+void Model::evictLODs(u32 lod)
+{
+	ASSERT(lod > m_resident_lod && lod <= m_base_lod);
+
+	for (i32 i = m_lod_indices[m_resident_lod].from, c = m_lod_indices[lod].from; i < c; ++i) {
+		Mesh& mesh = m_meshes[i];
+		// render thread can still draw the old render data from queued frames
+		Mesh::RenderData* rd = LUMIX_NEW(m_renderer.getAllocator(), Mesh::RenderData);
+		*rd = *mesh.render_data;
+		rd->index_buffer_handle = gpu::INVALID_BUFFER;
+		rd->vertex_buffer_handle = gpu::INVALID_BUFFER;
+		rd->meshlets_buffer = gpu::INVALID_BUFFER;
+		destroyRenderData(m_renderer, mesh.render_data);
+		mesh.render_data = rd;
+	}
+	m_resident_lod = lod;
+	m_renderer.markRenderDataChanged();
+}
+
+
+void Model::makeResident()
+{
+	if (!isReady() || m_resident_lod == 0) return;
+
+	if (m_stream_op.isValid()) {
+		getResourceManager().getOwner().getFileSystem().cancel(m_stream_op);
+		m_stream_op = FileSystem::AsyncHandle::invalid();
+	}
+
+	FileSystem& fs = getResourceManager().getOwner().getFileSystem();
+	const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", getPath().getHash(), ".res");
+	OutputMemoryStream content(m_allocator);
+	if (!fs.getContentSync(Path(res_path), content)) {
+		logError("Failed to read ", res_path);
+		return;
+	}
+	m_stream_lod = 0;
+	onLODsLoaded(content.size(), content.data(), true);
+	applyStreamedLODs();
+	m_last_used_frame = m_renderer.getModelStreamer().getFrame();
 }
 
 
 void Model::unload()
 {
+	if (m_stream_op.isValid()) {
+		getResourceManager().getOwner().getFileSystem().cancel(m_stream_op);
+		m_stream_op = FileSystem::AsyncHandle::invalid();
+	}
+	if (m_is_streamed) m_renderer.getModelStreamer().remove(*this);
+	m_is_streamed = false;
+	m_stream_data.clear();
+	m_resident_lod = 0;
+	m_base_lod = 0;
+
 	for (int i = 0; i < m_meshes.size(); ++i) {
 		removeDependency(*m_meshes[i].material);
 		m_meshes[i].material->decRefCount();
 	}
 
 	for (Mesh& mesh : m_meshes) {
-		m_renderer.runInRenderThread(mesh.render_data, [](Renderer& renderer, void* ptr){
-			Mesh::RenderData* rd = (Mesh::RenderData*)ptr;
-			if (rd->index_buffer_handle) gpu::destroy(rd->index_buffer_handle);
-			if (rd->vertex_buffer_handle) gpu::destroy(rd->vertex_buffer_handle);
-			LUMIX_DELETE(renderer.getAllocator(), rd); 
-		});
+		destroyRenderData(m_renderer, mesh.render_data);
 	}
 	m_meshes.clear();
 	m_bones.clear();
 }
 
 
+ModelStreamer::ModelStreamer(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_models(allocator)
+{}
+
+
+ModelStreamer::~ModelStreamer()
+{
+	ASSERT(m_models.empty());
+}
+
+
+void ModelStreamer::add(Model& model)
+{
+	model.m_last_used_frame = m_frame;
+	m_models.push(&model);
+}
+
+
+void ModelStreamer::remove(Model& model)
+{
+	m_models.swapAndPopItem(&model);
+}
+
+
+void ModelStreamer::update()
+{
+	++m_frame;
+	for (Model* model : m_models) model->applyStreamedLODs();
+	if (m_frame % UPDATE_PERIOD != 0) return;
+
+	PROFILE_FUNCTION();
+	u32 pending = 0;
+	for (Model* model : m_models) {
+		if (model->isStreaming()) ++pending;
+	}
+
+	for (Model* model : m_models) {
+		// nothing renders models while this runs, so there's no need for atomics
+		const u32 wanted = minimum((u32)model->m_wanted_lod, model->m_base_lod);
+		model->m_wanted_lod = model->m_base_lod;
+
+		if (wanted <= model->m_resident_lod) model->m_last_used_frame = m_frame;
+		
+		if (wanted < model->m_resident_lod) {
+			if (pending >= MAX_PENDING || model->isStreaming()) continue;
+			model->streamLODs(wanted);
+			++pending;
+		}
+		else if (wanted > model->m_resident_lod && m_frame - model->m_last_used_frame > EVICT_FRAMES && !model->isStreaming()) {
+			model->evictLODs(wanted);
+		}
+	}
+}
+
+
 } // namespace Lumix
@@ -9,7 +9,9 @@
 #include "engine/resource.h"
 #include "engine/stream.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 #include "gpu/gpu.h"
+#include "renderer.h"
 
 
 struct lua_State;
@@ -21,7 +23,6 @@ struct Material;
 struct Mesh;
 struct Model;
 struct Pose;
-struct Renderer;
 template <typename T> struct Delegate;
 
 
@@ -66,6 +67,17 @@ struct LUMIX_RENDERER_API Mesh {
 		gpu::BufferHandle index_buffer_handle;
 		gpu::DataType index_type;
 		int indices_count;
+		gpu::BufferHandle meshlets_buffer; // invalid if the mesh has no meshlets
+		u32 meshlets_count;
+	};
+
+	// cluster of triangles, contiguous range of the index buffer, culled on gpu
+	struct Meshlet {
+		Vec4 sphere; // center, radius; in mesh space
+		Vec4 cone; // normal cone axis, cosine of half of the cone angle
+		u32 first_index;
+		u32 indices_count;
+		u32 padding[2];
 	};
 
 	struct Skin {
@@ -82,6 +94,9 @@ struct LUMIX_RENDERER_API Mesh {
 
 	enum Flags : u8 { INDICES_16_BIT = 1 << 0 };
 
+	// triangle BVH of rigid meshes, skinned vertices of the last pose of skinned meshes, see Model::castRay
+	struct RayCastCache;
+
 	Mesh(Material* mat,
 		const gpu::VertexDecl& vertex_decl,
 		u8 vb_stride,
@@ -100,7 +115,9 @@ struct LUMIX_RENDERER_API Mesh {
 	Type type;
 	OutputMemoryStream indices;
 	Array<Vec3> vertices;
+	AABB aabb; // of vertices, in model space
 	Array<Skin> skin;
+	Array<Meshlet> meshlets;
 	FlagSet<Flags, u8> flags;
 	u32 sort_key;
 	u8 layer;
@@ -109,8 +126,13 @@ struct LUMIX_RENDERER_API Mesh {
 	gpu::VertexDecl vertex_decl;
 	AttributeSemantic attributes_semantic[gpu::VertexDecl::MAX_ATTRIBUTES];
 	RenderData* render_data;
+	RayCastCache* raycast_cache = nullptr; // created on the first ray cast
 	Renderer& renderer;
 	float lod = 0;
+	// position of vertex data in the loaded resource, lods are streamed from there
+	u32 vertex_data_offset = 0;
+	u32 vertex_data_size = 0; // decoded
+	u32 vertex_data_encoded_size = 0; // 0 if vertex data are not encoded
 };
 
 
@@ -136,6 +158,9 @@ public:
 
 	enum class FileVersion : u32
 	{
+		FIRST,
+		MESHLETS, // meshlets of each mesh follow lods
+		ENCODED_BUFFERS, // vertex and index data are encoded by meshoptimizer
 		LATEST // keep this last
 	};
 
@@ -172,6 +197,17 @@ public:
 		return 4;
 	}
 
+	// `current_lod` is kept until `squared_distance` is past the lod threshold by `hysteresis` (fraction of distance)
+	u32 getLODMeshIndices(float squared_distance, float current_lod, float hysteresis) const {
+		const u32 lod = getLODMeshIndices(squared_distance);
+		const u32 cur = u32(current_lod);
+		// in the middle of transition
+		if (float(cur) != current_lod) return lod;
+		if (lod > cur) return maximum(cur, getLODMeshIndices(squared_distance * (1 - hysteresis) * (1 - hysteresis)));
+		if (lod < cur) return minimum(cur, getLODMeshIndices(squared_distance * (1 + hysteresis) * (1 + hysteresis)));
+		return lod;
+	}
+
 	Mesh& getMesh(u32 index) { return m_meshes[index]; }
 	const Mesh& getMesh(u32 index) const { return m_meshes[index]; }
 	int getMeshCount() const { return m_meshes.size(); }
@@ -191,6 +227,19 @@ public:
 	bool isSkinned() const;
 	float* getLODDistances() { return m_lod_distances; }
 	const LODMeshIndices* getLODIndices() const { return m_lod_indices; }
+	
+	// lod streaming, managed by ModelStreamer
+	// thread-safe, requests `lod` and returns the closest resident lod which can be rendered instead
+	u32 useLOD(u32 lod);
+	// meshes of lods >= this have gpu buffers
+	u32 getResidentLOD() const { return m_resident_lod; }
+	// synchronously creates gpu buffers of all lods
+	void makeResident();
+	bool isStreaming() const { return m_stream_op.isValid(); }
+
+	// synchronously reads the compiled file and decodes vertices of meshes [from_mesh, to_mesh), for offline tools
+	// `vertices` are indexed by mesh, caller frees them with Renderer::free
+	bool readVertices(i32 from_mesh, i32 to_mesh, Array<Renderer::MemRef>& vertices);
 
 public:
 	static const u32 FILE_MAGIC = 0x5f4c4d4f; // == '_LM2'
@@ -201,9 +250,16 @@ private:
 	void operator=(const Model&);
 
 	bool parseBones(InputMemoryStream& file);
-	bool parseMeshes(InputMemoryStream& file, FileVersion version);
+	bool parseMeshes(InputMemoryStream& file, FileVersion version, Array<Renderer::MemRef>& vertices);
 	bool parseLODs(InputMemoryStream& file);
+	bool parseMeshlets(InputMemoryStream& file);
 	int getBoneIdx(const char* name);
+	bool decodeVertices(i32 from_mesh, i32 to_mesh, const u8* data, u64 size, Array<Renderer::MemRef>& vertices);
+	bool createBuffers(i32 from_mesh, i32 to_mesh, Array<Renderer::MemRef>& vertices);
+	void streamLODs(u32 lod);
+	void onLODsLoaded(u64 size, const u8* mem, bool success);
+	void applyStreamedLODs();
+	void evictLODs(u32 lod);
 
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
@@ -220,6 +276,39 @@ private:
 	BoneMap m_bone_map;
 	AABB m_aabb;
 	int m_first_nonroot_bone_index;
+
+	friend struct ModelStreamer;
+	bool m_is_streamed = false;
+	u32 m_base_lod = 0; // coarsest lod, always resident
+	u32 m_resident_lod = 0;
+	volatile i32 m_wanted_lod = 0;
+	u32 m_last_used_frame = 0;
+	u64 m_data_size = 0; // of the loaded resource, streamed data must match it
+	FileSystem::AsyncHandle m_stream_op = FileSystem::AsyncHandle::invalid();
+	u32 m_stream_lod = 0;
+	OutputMemoryStream m_stream_data;
+	Mutex m_raycast_mutex; // guards meshes' raycast_cache
+};
+
+
+struct LUMIX_RENDERER_API ModelStreamer {
+	static constexpr u32 UPDATE_PERIOD = 8; // in frames
+	static constexpr u32 EVICT_FRAMES = 300; // finer lods not used for this long are dropped
+	static constexpr u32 MAX_PENDING = 4;
+
+	ModelStreamer(IAllocator& allocator);
+	~ModelStreamer();
+
+	// call only when no render job setup is running, it changes meshes' render data
+	void update();
+	void add(Model& model);
+	void remove(Model& model);
+	u32 getFrame() const { return m_frame; }
+
+private:
+	IAllocator& m_allocator;
+	Array<Model*> m_models;
+	u32 m_frame = 0;
 };
 
 
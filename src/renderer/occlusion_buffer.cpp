@@ -1,399 +1,330 @@
-// clipping is inspired by urho 
-// https://github.com/urho3d/Urho3D/blob/9c666ae6b82e21e67bfb003d84e95e26f8a3d341/Source/Urho3D/Graphics/OcclusionBuffer.cpp#L681 
-
 #include "occlusion_buffer.h"
 #include "engine/array.h"
+#include "engine/atomic.h"
+#include "engine/crt.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
-#include "engine/universe.h"
+#include "engine/simd.h"
+#include "engine/sync.h"
 #include "renderer/model.h"
-#include "renderer/render_scene.h"
 
 
 namespace Lumix
 {
 
 
-static const int Z_SCALE = 1 << 30;
-static const int XY_SCALE = 1 << 16;
-static const int WIDTH = 384;
-static const int HEIGHT = 192;
+static constexpr float NEAR_W = 0.01f;
+// triangles are clipped to this multiple of screen size, so edge functions do not lose precision
+static constexpr float GUARD_BAND = 2.f;
+static constexpr u32 MAX_POLYGON_VERTICES = 3 + 5;
 
 
 OcclusionBuffer::OcclusionBuffer(IAllocator& allocator)
-	: m_mips(allocator)
-	, m_allocator(allocator)
+	: m_allocator(allocator)
+	, m_triangles(allocator)
+	, m_tiles(allocator)
+	, m_tile_depth(allocator)
 {
 }
 
 
-void OcclusionBuffer::setCamera(const DVec3& pos, const Quat& rot, const Matrix& projection)
-{
-	m_view_projection_matrix = projection * rot.toMatrix();
-	m_camera_pos = pos;
-}
+enum ClipPlane : u32 {
+	NEAR = 1 << 0,
+	POSITIVE_X = 1 << 1,
+	NEGATIVE_X = 1 << 2,
+	POSITIVE_Y = 1 << 3,
+	NEGATIVE_Y = 1 << 4
+};
 
 
-static LUMIX_FORCE_INLINE Vec3 toViewport(const Vec4& v)
-{
-	float inv = 0.5f / v.w;
-	return { v.x * inv + 0.5f, v.y * inv + 0.5f, v.z * inv + 0.5f };
+static LUMIX_FORCE_INLINE u32 getClipMask(const Vec4& v, float scale) {
+	u32 mask = 0;
+	if (v.w < NEAR_W) mask |= NEAR;
+	if (v.x > v.w * scale) mask |= POSITIVE_X;
+	if (v.x < -v.w * scale) mask |= NEGATIVE_X;
+	if (v.y > v.w * scale) mask |= POSITIVE_Y;
+	if (v.y < -v.w * scale) mask |= NEGATIVE_Y;
+	return mask;
 }
 
 
-Vec3 OcclusionBuffer::transform(const Transform& world_transform, float x, float y, float z)
-{
-	Vec3 tmp = world_transform.scale * Vec3(x, y, z);
-	tmp = world_transform.rot.rotate(tmp);
-	tmp += Vec3(world_transform.pos - m_camera_pos);
-	return m_view_projection_matrix.transformPoint(tmp);
+static LUMIX_FORCE_INLINE float getPlaneDistance(const Vec4& v, u32 plane) {
+	switch (plane) {
+		case NEAR: return v.w - NEAR_W;
+		case POSITIVE_X: return v.w * GUARD_BAND - v.x;
+		case NEGATIVE_X: return v.w * GUARD_BAND + v.x;
+		case POSITIVE_Y: return v.w * GUARD_BAND - v.y;
+		case NEGATIVE_Y: return v.w * GUARD_BAND + v.y;
+	}
+	ASSERT(false);
+	return 0;
 }
 
 
-bool OcclusionBuffer::isOccluded(const Transform& world_transform, const AABB& aabb)
-{
-	// TODO simd
-	const Vec3 vertices[] = {
-		transform(world_transform, aabb.min.x, aabb.min.y, aabb.min.z),
-		transform(world_transform, aabb.min.x, aabb.min.y, aabb.max.z),
-		transform(world_transform, aabb.min.x, aabb.max.y, aabb.min.z),
-		transform(world_transform, aabb.min.x, aabb.max.y, aabb.max.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.min.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.max.z),
-		transform(world_transform, aabb.max.x, aabb.max.y, aabb.min.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.min.z)
-	};
-	
-	Vec3 min = vertices[0];
-	Vec3 max = vertices[0];
-
-	for (u32 i = 1; i < lengthOf(vertices); ++i)
-	{
-		min.x = minimum(vertices[i].x, min.x);
-		min.y = minimum(vertices[i].y, min.y);
-		min.z = minimum(vertices[i].z, min.z);
-
-		max.x = maximum(vertices[i].x, max.x);
-		max.y = maximum(vertices[i].y, max.y);
-	}
-
-	if (max.x < 0) return false;
-	if (max.y < 0) return false;
-	if (min.x >= 1) return false;
-	if (min.y >= 1) return false;
-
-	const int min_x = maximum(0, int(min.x * (WIDTH - 1) + 0.5f));
-	const int max_x = minimum(WIDTH - 1, int(max.x * (WIDTH - 1) + 0.5f));
-	const int min_y = maximum(0, int(min.y * (HEIGHT - 1) + 0.5f));
-	const int max_y = minimum(HEIGHT - 1, int(max.y * (HEIGHT - 1) + 0.5f));
-
-	const int z = int(min.z * Z_SCALE);
-
-	// TODO check whole hierarchy
-	const int* LUMIX_RESTRICT depth = &m_mips[0][0];
-	for (int j = min_y; j <= max_y; ++j)
-	{
-		for (int i = min_x; i < max_x; ++i)
-		{
-			if (depth[i + j * WIDTH] > z) return false;
+// sutherland-hodgman, returns vertex count of clipped polygon
+static u32 clipPolygon(Vec4 (&vertices)[MAX_POLYGON_VERTICES], u32 count, u32 planes) {
+	Vec4 tmp[MAX_POLYGON_VERTICES];
+	for (u32 plane = 1; plane <= NEGATIVE_Y; plane <<= 1) {
+		if ((planes & plane) == 0) continue;
+
+		u32 out = 0;
+		Vec4 prev = vertices[count - 1];
+		float prev_d = getPlaneDistance(prev, plane);
+		for (u32 i = 0; i < count; ++i) {
+			const Vec4 cur = vertices[i];
+			const float d = getPlaneDistance(cur, plane);
+			if ((d >= 0) != (prev_d >= 0)) {
+				const float t = prev_d / (prev_d - d);
+				tmp[out] = prev + (cur - prev) * t;
+				++out;
+			}
+			if (d >= 0) {
+				tmp[out] = cur;
+				++out;
+			}
+			prev = cur;
+			prev_d = d;
 		}
+		if (out < 3) return 0;
+		memcpy(vertices, tmp, sizeof(tmp[0]) * out);
+		count = out;
 	}
-	return true;
+	return count;
 }
 
 
-void OcclusionBuffer::init()
-{
-	PROFILE_FUNCTION();
-	ASSERT(m_mips.empty());
-
-	int w = WIDTH;
-	int h = HEIGHT;
-
-	while (w % 2 != 1 && h % 2 != 1)
-	{
-		auto& mip = m_mips.emplace(m_allocator);
-		mip.resize(w * h);
-		w >>= 1;
-		h >>= 1;
-	}
+static LUMIX_FORCE_INLINE Vec3 toScreen(const Vec4& v) {
+	const float inv_w = 1 / v.w;
+	return {
+		(v.x * inv_w * 0.5f + 0.5f) * OcclusionBuffer::WIDTH,
+		(v.y * inv_w * 0.5f + 0.5f) * OcclusionBuffer::HEIGHT,
+		inv_w
+	};
 }
 
 
-void OcclusionBuffer::buildHierarchy()
+void OcclusionBuffer::setupTriangles(const Occluder& occluder, Array<Triangle>& out) const
 {
-	// TODO multithreading
-	PROFILE_FUNCTION();
-	for (int level = 1; level < m_mips.size(); ++level)
-	{
-		int prev_w = WIDTH >> (level - 1);
-		int w = WIDTH >> level;
-		int h = HEIGHT >> level;
-		for (int j = 0; j < h; ++j)
-		{
-			int prev_j = j << 1;
-			const int* LUMIX_RESTRICT prev_mip = &m_mips[level - 1][prev_j * prev_w];
-			int* LUMIX_RESTRICT mip = &m_mips[level][j * w];
-			int* end = mip + w;
-			while (mip != end)
-			{
-				*mip = maximum(prev_mip[0], prev_mip[1], prev_mip[prev_w], prev_mip[prev_w + 1]);
-				++mip;
-				prev_mip += 2;
+	const Matrix mvp = m_view_projection * occluder.mtx;
+	const Mesh& mesh = *occluder.mesh;
+	const Vec3* LUMIX_RESTRICT vertices = mesh.vertices.begin();
+	const bool indices16 = mesh.areIndices16();
+	const u8* indices = mesh.indices.data();
+	const u32 indices_count = u32(mesh.indices.size() / (indices16 ? sizeof(u16) : sizeof(u32)));
+
+	for (u32 i = 0; i + 2 < indices_count; i += 3) {
+		Vec4 polygon[MAX_POLYGON_VERTICES];
+		u32 reject_mask = 0xff;
+		u32 clip_mask = 0;
+		for (u32 j = 0; j < 3; ++j) {
+			const u32 idx = indices16 ? ((const u16*)indices)[i + j] : ((const u32*)indices)[i + j];
+			polygon[j] = mvp * Vec4(vertices[idx], 1);
+			reject_mask &= getClipMask(polygon[j], 1);
+			clip_mask |= getClipMask(polygon[j], GUARD_BAND);
+		}
+		if (reject_mask) continue;
+
+		const u32 count = clip_mask ? clipPolygon(polygon, 3, clip_mask) : 3;
+		if (count < 3) continue;
+
+		Vec3 screen[MAX_POLYGON_VERTICES];
+		for (u32 j = 0; j < count; ++j) screen[j] = toScreen(polygon[j]);
+
+		for (u32 j = 1; j + 1 < count; ++j) {
+			Vec3 a = screen[0];
+			Vec3 b = screen[j];
+			Vec3 c = screen[j + 1];
+			float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+			if (fabsf(area) < 1e-4f) continue;
+			// both sides are rasterized, occluders do not have to be closed
+			if (area < 0) {
+				swap(b, c);
+				area = -area;
+			}
+
+			Triangle t;
+			t.min_x = maximum(0, (i32)floorf(minimum(a.x, b.x, c.x)));
+			t.min_y = maximum(0, (i32)floorf(minimum(a.y, b.y, c.y)));
+			t.max_x = minimum((i32)WIDTH - 1, (i32)ceilf(maximum(a.x, b.x, c.x)));
+			t.max_y = minimum((i32)HEIGHT - 1, (i32)ceilf(maximum(a.y, b.y, c.y)));
+			if (t.min_x > t.max_x || t.min_y > t.max_y) continue;
+
+			const Vec3* edge_vertices[] = { &a, &b, &c, &a };
+			for (u32 e = 0; e < 3; ++e) {
+				const Vec3& p = *edge_vertices[e];
+				const Vec3& q = *edge_vertices[e + 1];
+				t.edges[e][0] = p.y - q.y;
+				t.edges[e][1] = q.x - p.x;
+				t.edges[e][2] = p.x * q.y - p.y * q.x;
 			}
+
+			const float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+			const float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+			t.depth[0] = dzdx;
+			t.depth[1] = dzdy;
+			t.depth[2] = a.z - dzdx * a.x - dzdy * a.y;
+			out.push(t);
 		}
 	}
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
+void OcclusionBuffer::rasterizeTileRow(u32 row)
 {
-	Vec3 n = cross(v[1] - v[0], v[2] - v[0]);
-	bool is_backface = n.z <= 0;
-	if (is_backface) return;
-
-	if (v[0].y > v[2].y) swap(v[0], v[2]);
-	if (v[0].y > v[1].y) swap(v[0], v[1]);
-	if (v[1].y > v[2].y) swap(v[1], v[2]);
-
-	int width = WIDTH;
-	int height = HEIGHT;
-
-	struct Point { int x, y; };
-	Point p0 = { int(v[0].x * (width - 1) + 0.5f), int(v[0].y * (height - 1) + 0.5f) };
-	Point p1 = { int(v[1].x * (width - 1) + 0.5f), int(v[1].y * (height - 1) + 0.5f) };
-	Point p2 = { int(v[2].x * (width - 1) + 0.5f), int(v[2].y * (height - 1) + 0.5f) };
-
-	if (p0.y == p2.y) return;
-
-	float xdz = -n.x / n.z;
-	int xdz_int = int(xdz * Z_SCALE / WIDTH);
-
-	if (p1.y != p0.y)
-	{
-		int dl = (p1.x - p0.x) * 2 * XY_SCALE / (2*p1.y - 2*p0.y + 1);
-		int dr = (p2.x - p0.x) * 2 * XY_SCALE / (2*p2.y - 2*p0.y + 1);
-		Vec3 left_p = dl > dr ? v[2] : v[1];
-		int dz_left = int((left_p.z - v[0].z) * Z_SCALE / (left_p.y - (v[0].y + 0.5f / HEIGHT)) / HEIGHT);
-		int z_left = int(v[0].z * Z_SCALE) + (dz_left >> 1);
-		if (dl > dr) swap(dl, dr);
-		int left = p0.x * XY_SCALE + (dl >> 1);
-		int right = p0.x * XY_SCALE + (dr >> 1);
-		for (int y = p0.y; y <= p1.y; ++y)
-		{
-			int base = y * width + left / XY_SCALE;
-			int z = z_left;
-			for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
-			{
-				if (z < depth[base + x]) depth[base + x] = z;
-				z += xdz_int;
-			}
-			left += dl;
-			right += dr;
-			z_left += dz_left;
+	const u32 y0 = row * TILE_HEIGHT;
+	Tile* LUMIX_RESTRICT tiles = &m_tiles[row * TILES_X];
+	const float4 zero = f4Splat(0);
+	alignas(16) const float offsets[] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+	const float4 offsets_lo = f4Load(offsets);
+	const float4 offsets_hi = f4Load(offsets + 4);
+
+	for (const Triangle& t : m_triangles) {
+		if (t.max_y < (i32)y0 || t.min_y >= i32(y0 + TILE_HEIGHT)) continue;
+
+		float4 ea[3], eb[3], ec[3];
+		for (u32 e = 0; e < 3; ++e) {
+			ea[e] = f4Splat(t.edges[e][0]);
+			eb[e] = f4Splat(t.edges[e][1]);
+			ec[e] = f4Splat(t.edges[e][2]);
 		}
-	}
-	
-	if (p2.y == p1.y) return;
-
-	int dl = -(p1.x - p2.x) * 2 * XY_SCALE / (2 * p1.y - 2 * p2.y - 1);
-	int dr = -(p0.x - p2.x) * 2 * XY_SCALE / (2 * p0.y - 2 * p2.y - 1);
-	Vec3 left_p = dl > dr ? v[0] : v[1];
-	int dz_left = -int((left_p.z - v[2].z) * Z_SCALE / (left_p.y - (v[2].y - 0.5f / HEIGHT)) / HEIGHT);
-
-	if (dl > dr) swap(dl, dr);
-	int left = p2.x * XY_SCALE + (dl >> 1);
-	int right = p2.x * XY_SCALE + (dr >> 1);
-	int z_left = int(v[2].z * Z_SCALE) + (dz_left >> 1);
-	for (int y = p2.y; y >= p1.y; --y)
-	{
-		int base = y * width + left / XY_SCALE;
-		int z = z_left;
-		for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
-		{
-			if (z < depth[base + x]) depth[base + x] = z;
-			z += xdz_int;
+		const float4 za = f4Splat(t.depth[0]);
+		const float4 zb = f4Splat(t.depth[1]);
+		const float4 zc = f4Splat(t.depth[2]);
+
+		for (i32 tx = t.min_x / TILE_WIDTH, tx_end = t.max_x / TILE_WIDTH; tx <= tx_end; ++tx) {
+			float* LUMIX_RESTRICT tile = tiles[tx].depth;
+			const float4 base_x = f4Splat(float(tx * TILE_WIDTH));
+			const float4 xs[] = { base_x + offsets_lo, base_x + offsets_hi };
+			for (u32 r = 0; r < TILE_HEIGHT; ++r) {
+				const float4 y = f4Splat(y0 + r + 0.5f);
+				for (u32 h = 0; h < 2; ++h) {
+					const float4 x = xs[h];
+					const float4 e0 = ea[0] * x + eb[0] * y + ec[0];
+					const float4 e1 = ea[1] * x + eb[1] * y + ec[1];
+					const float4 e2 = ea[2] * x + eb[2] * y + ec[2];
+					const float4 inside = f4CmpGT(f4Min(e0, f4Min(e1, e2)), zero);
+					if (!f4MoveMask(inside)) continue;
+
+					const float4 z = za * x + zb * y + zc;
+					float* depth = tile + r * TILE_WIDTH + h * 4;
+					f4Store(depth, f4Max(f4Load(depth), f4And(inside, z)));
+				}
+			}
 		}
-		left += dl;
-		right += dr;
-		z_left += dz_left;
 	}
 
-}
-
-
-static LUMIX_FORCE_INLINE Vec4 clip(const Vec4& v0, const Vec4& v1, float d0, float d1)
-{
-	float t = d0 / (d0 - d1);
-	return v0 + t * (v1 - v0);
-}
-
-
-static LUMIX_FORCE_INLINE bool tryClip2Vertices(Vec4* vertices, int index, float* d, int d0, int d1, int d2)
-{
-	if (d[d0] < 0.0f && d[d1] < 0.0f)
-	{
-		vertices[index + d0] = clip(vertices[index + d0], vertices[index + d2], d[d0], d[d2]);
-		vertices[index + d1] = clip(vertices[index + d1], vertices[index + d2], d[d1], d[d2]);
-		return true;
+	for (u32 tx = 0; tx < TILES_X; ++tx) {
+		const float* tile = tiles[tx].depth;
+		float4 farthest = f4Load(tile);
+		for (u32 i = 4; i < lengthOf(tiles[tx].depth); i += 4) farthest = f4Min(farthest, f4Load(tile + i));
+		m_tile_depth[row * TILES_X + tx] = minimum(f4GetX(farthest), f4GetY(farthest), f4GetZ(farthest), f4GetW(farthest));
 	}
-	return false;
-}
-
-
-static LUMIX_FORCE_INLINE bool tryClip1Vertex(Vec4* vertices, int index, float* d, int d0, int d1, int d2, bool* triangles, int& tringles_count)
-{
-	bool is_behind_plane = d[d0] < 0;
-	if (!is_behind_plane) return false;
-
-	int new_index = tringles_count * 3;
-	triangles[tringles_count] = true;
-	++tringles_count;
-
-	vertices[new_index + 0] = clip(vertices[index + d0], vertices[index + d2], d[d0], d[d2]);
-	vertices[new_index + 1] = clip(vertices[index + d0], vertices[index + d1], d[d0], d[d1]);
-	vertices[new_index + 2] = vertices[index + d2];
-	vertices[index + d0] = vertices[new_index + 1];
-
-	return true;
 }
 
 
-static void clipTriangles(const Vec4& plane, Vec4* vertices, bool* triangles, int& triangles_count)
+void OcclusionBuffer::rasterize(const Matrix& view_projection, const DVec3& camera_pos, Span<const Occluder> occluders)
 {
-	int count = triangles_count;
-	for (int i = 0; i < count; ++i)
-	{
-		if (!triangles[i]) continue;
-		int index = i * 3;
-		float d[3] = { dot(plane, vertices[index])
-			, dot(plane, vertices[index + 1])
-			, dot(plane, vertices[index + 2])
-		};
-		
-		bool all_behind = d[0] < 0.0f && d[1] < 0.0f && d[2] < 0.0f;
-		if (all_behind)
-		{
-			triangles[i] = false;
-			continue;
+	PROFILE_FUNCTION();
+	m_view_projection = view_projection;
+	m_camera_pos = camera_pos;
+	m_tiles.resize(TILES_X * TILES_Y);
+	m_tile_depth.resize(TILES_X * TILES_Y);
+	memset(m_tiles.begin(), 0, m_tiles.byte_size());
+	memset(m_tile_depth.begin(), 0, m_tile_depth.byte_size());
+	m_triangles.clear();
+
+	volatile i32 occluder_idx = 0;
+	Mutex mutex;
+	jobs::runOnWorkers([&](){
+		PROFILE_BLOCK("setup occluders");
+		Array<Triangle> triangles(m_allocator);
+		for (;;) {
+			const i32 idx = atomicIncrement(&occluder_idx) - 1;
+			if (idx >= (i32)occluders.length()) break;
+			setupTriangles(occluders[idx], triangles);
 		}
-		if (tryClip2Vertices(vertices, index, d, 0, 1, 2)) continue;
-		if (tryClip2Vertices(vertices, index, d, 0, 2, 1)) continue;
-		if (tryClip2Vertices(vertices, index, d, 1, 2, 0)) continue;
-		if (tryClip1Vertex(vertices, index, d, 0, 1, 2, triangles, triangles_count)) continue;
-		if (tryClip1Vertex(vertices, index, d, 1, 2, 0, triangles, triangles_count)) continue;
-		if (tryClip1Vertex(vertices, index, d, 2, 0, 1, triangles, triangles_count)) continue;
-	}
+		if (triangles.empty()) return;
+
+		MutexGuard guard(mutex);
+		m_triangles.reserve(m_triangles.size() + triangles.size());
+		for (const Triangle& t : triangles) m_triangles.push(t);
+	});
+	profiler::pushInt("triangles", m_triangles.size());
+
+	// each job owns whole rows of tiles, so there are no write conflicts
+	volatile i32 row_idx = 0;
+	jobs::runOnWorkers([&](){
+		PROFILE_BLOCK("rasterize occluders");
+		for (;;) {
+			const i32 row = atomicIncrement(&row_idx) - 1;
+			if (row >= (i32)TILES_Y) break;
+			rasterizeTileRow(row);
+		}
+	});
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int* depth)
+bool OcclusionBuffer::isOccluded(const Vec3* corners) const
 {
-	enum ClipMask
-	{
-		NEGATIVE_X = 1 << 0,
-		POSITIVE_X = 1 << 1,
-		NEGATIVE_Y = 1 << 2,
-		POSITIVE_Y = 1 << 3,
-		NEGATIVE_Z = 1 << 4,
-		POSITIVE_Z = 1 << 5
-	};
-	u32 triangle_mask = 0;
-	u32 and_mask = 0;
-	for (int i = 0; i < 3; ++i)
-	{
-		Vec4 v = vertices[i];
-		u32 vertex_mask = 0;
-		if (v.x < -v.w) vertex_mask |= NEGATIVE_X;
-		if (v.y < -v.w) vertex_mask |= NEGATIVE_Y;
-		if (v.z < -v.w) vertex_mask |= NEGATIVE_Z;
-
-		if (v.x > v.w) vertex_mask |= POSITIVE_X;
-		if (v.y > v.w) vertex_mask |= POSITIVE_Y;
-		if (v.z > v.w) vertex_mask |= POSITIVE_Z;
-
-		triangle_mask |= vertex_mask;
-		if (i == 0) and_mask = vertex_mask;
-		else and_mask &= vertex_mask;
+	if (m_tile_depth.empty()) return false;
+
+	float min_x = FLT_MAX, min_y = FLT_MAX;
+	float max_x = -FLT_MAX, max_y = -FLT_MAX;
+	float nearest = 0;
+	for (u32 i = 0; i < 8; ++i) {
+		const Vec4 v = m_view_projection * Vec4(corners[i], 1);
+		if (v.w < NEAR_W) return false;
+		const Vec3 p = toScreen(v);
+		min_x = minimum(min_x, p.x);
+		min_y = minimum(min_y, p.y);
+		max_x = maximum(max_x, p.x);
+		max_y = maximum(max_y, p.y);
+		nearest = maximum(nearest, p.z);
 	}
 
-	bool all_vertices_outside = and_mask != 0;
-	if (all_vertices_outside) return;
+	if (max_x < 0 || max_y < 0 || min_x >= WIDTH || min_y >= HEIGHT) return false;
 
-	if (triangle_mask == 0)
-	{
-		Vec3 projected[] = { toViewport(vertices[0]), toViewport(vertices[1]), toViewport(vertices[2]) };
-		rasterizeProjectedTriangle(projected, depth);
-	}
-	else
-	{
-		int triangles_count = 1;
-		bool triangles[64];
-		if (triangle_mask & POSITIVE_X) clipTriangles(Vec4(-1.0f, 0.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & NEGATIVE_X) clipTriangles(Vec4(1.0f, 0.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & POSITIVE_Y) clipTriangles(Vec4(0.0f, -1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & NEGATIVE_Y) clipTriangles(Vec4(0.0f, 1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & POSITIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, -1.0f, 1.0f), vertices, triangles, triangles_count);
-		if (triangle_mask & NEGATIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, 1.0f, 0.0f), vertices, triangles, triangles_count);
-
-		for (int i = 0; i < triangles_count; ++i)
-		{
-			if (!triangles[i]) continue;
-			int index = i * 3;
-			Vec3 projected[] = { toViewport(vertices[index]), toViewport(vertices[index + 1]), toViewport(vertices[index + 2]) };
-			rasterizeProjectedTriangle(projected, depth);
+	const u32 tx0 = u32(maximum(0.f, min_x)) / TILE_WIDTH;
+	const u32 ty0 = u32(maximum(0.f, min_y)) / TILE_HEIGHT;
+	const u32 tx1 = u32(minimum(WIDTH - 1.f, max_x)) / TILE_WIDTH;
+	const u32 ty1 = u32(minimum(HEIGHT - 1.f, max_y)) / TILE_HEIGHT;
+	for (u32 ty = ty0; ty <= ty1; ++ty) {
+		const float* LUMIX_RESTRICT row = &m_tile_depth[ty * TILES_X];
+		for (u32 tx = tx0; tx <= tx1; ++tx) {
+			if (row[tx] <= nearest) return false;
 		}
 	}
+	return true;
 }
 
 
-template <typename IndexType>
-static void rasterizeOccludingTriangles(const Mesh* mesh, const Matrix& mvp_mtx, int* depth)
-{
-	const Vec3* LUMIX_RESTRICT vertices = &mesh->vertices[0];
-	const IndexType* LUMIX_RESTRICT indices = (const IndexType*)mesh->indices.data();
-	for (i32 i = 0, n = (i32)mesh->indices.size() / sizeof(IndexType); i < n; i += 3)
-	{
-		Vec4 v[64*3] = {
-			mvp_mtx * Vec4(vertices[indices[i + 0]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 1]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 2]], 1)
-		};
-		rasterizeOccludingTriangle(v, depth);
-	}
-}
-
-
-void OcclusionBuffer::rasterize(Universe* universe, const Array<MeshInstance>& meshes)
+bool OcclusionBuffer::isOccluded(const DVec3& min, const Vec3& size) const
 {
-	PROFILE_FUNCTION();
-	if (m_mips.empty()) init();
-	int* depth = &m_mips[0][0];
-	for (const MeshInstance& mesh_instance : meshes) {
-		const Mesh* mesh = mesh_instance.mesh;
-		const Matrix mtx = m_view_projection_matrix * universe->getRelativeMatrix(mesh_instance.owner, m_camera_pos);
-		if (mesh->flags.isSet(Mesh::INDICES_16_BIT)) {
-			rasterizeOccludingTriangles<u16>(mesh, mtx, depth);
-		}
-		else {
-			rasterizeOccludingTriangles<u32>(mesh, mtx, depth);
-		}
-	}
+	const Vec3 rel_min = Vec3(min - m_camera_pos);
+	const Vec3 corners[] = {
+		rel_min,
+		rel_min + Vec3(size.x, 0, 0),
+		rel_min + Vec3(0, size.y, 0),
+		rel_min + Vec3(size.x, size.y, 0),
+		rel_min + Vec3(0, 0, size.z),
+		rel_min + Vec3(size.x, 0, size.z),
+		rel_min + Vec3(0, size.y, size.z),
+		rel_min + size
+	};
+	return isOccluded(corners);
 }
 
 
-void OcclusionBuffer::clear()
+bool OcclusionBuffer::isOccluded(const Transform& world_transform, const AABB& aabb) const
 {
-	PROFILE_FUNCTION();
-	for (auto& mip : m_mips)
-	{
-		for (int& i : mip)
-		{
-			i = Z_SCALE;
-		}
-	}
+	DVec3 points[8];
+	aabb.getCorners(world_transform, points);
+	Vec3 corners[8];
+	for (u32 i = 0; i < 8; ++i) corners[i] = Vec3(points[i] - m_camera_pos);
+	return isOccluded(corners);
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -9,35 +9,62 @@ namespace Lumix
 {
 
 
-template <typename T> struct Array;
 struct IAllocator;
 struct Mesh;
-struct MeshInstance;
 struct AABB;
-struct Universe;
 
 
+// software depth buffer rasterized on cpu from meshes marked as occluders
+// depth is 1/w, stored in 8x4 pixel tiles; tests use the farthest depth of each tile, so they are conservative
 struct OcclusionBuffer
 {
 public:
+	static constexpr u32 WIDTH = 384;
+	static constexpr u32 HEIGHT = 192;
+	static constexpr u32 TILE_WIDTH = 8;
+	static constexpr u32 TILE_HEIGHT = 4;
+	static constexpr u32 TILES_X = WIDTH / TILE_WIDTH;
+	static constexpr u32 TILES_Y = HEIGHT / TILE_HEIGHT;
+
+	struct Occluder {
+		const Mesh* mesh;
+		Matrix mtx; // model to camera relative world space
+	};
+
 	OcclusionBuffer(IAllocator& allocator);
 
-	bool isOccluded(const Transform& world_transform, const AABB& aabb);
-	void clear();
-	void setCamera(const DVec3& pos, const Quat& rot, const Matrix& projection);
-	void rasterize(Universe* universe, const Array<MeshInstance>& meshes);
-	void buildHierarchy();
-	const int* getMip(int level) { return &m_mips[level][0]; }
+	// view_projection is camera relative, only perspective projections are supported
+	void rasterize(const Matrix& view_projection, const DVec3& camera_pos, Span<const Occluder> occluders);
+	bool isOccluded(const DVec3& min, const Vec3& size) const;
+	bool isOccluded(const Transform& world_transform, const AABB& aabb) const;
+	u32 getTrianglesCount() const { return m_triangles.size(); }
+	// WIDTH * HEIGHT, tile by tile
+	const float* getDepth() const { return m_tiles.begin()->depth; }
+	// TILES_X * TILES_Y, row by row, empty if nothing was rasterized
+	Span<const float> getTileDepth() const { return m_tile_depth; }
+	const Matrix& getViewProjection() const { return m_view_projection; }
+	const DVec3& getCameraPos() const { return m_camera_pos; }
 
 private:
-	void init();
-	Vec3 transform(const Transform& world_transform, float x, float y, float z);
+	struct Triangle {
+		float edges[3][3]; // a * x + b * y + c >= 0 inside
+		float depth[3]; // depth plane, a * x + b * y + c
+		i32 min_x, min_y, max_x, max_y;
+	};
+
+	struct alignas(16) Tile {
+		float depth[TILE_WIDTH * TILE_HEIGHT]; // row by row
+	};
 
-	using Mip = Array<int>;
+	void setupTriangles(const Occluder& occluder, Array<Triangle>& out) const;
+	void rasterizeTileRow(u32 row);
+	bool isOccluded(const Vec3* corners) const;
 
 	IAllocator& m_allocator;
-	Array<Mip> m_mips;
-	Matrix m_view_projection_matrix;
+	Array<Triangle> m_triangles;
+	Array<Tile> m_tiles;
+	Array<float> m_tile_depth; // farthest depth in tile
+	Matrix m_view_projection;
 	DVec3 m_camera_pos;
 };
 
@@ -11,10 +11,13 @@
 #include "engine/resource_manager.h"
 #include "engine/simd.h"
 #include "engine/stream.h"
+#include "engine/string.h"
 #include "editor/gizmo.h"
 #include "editor/world_editor.h"
 #include "renderer/material.h"
+#include "renderer/pipeline.h"
 #include "renderer/render_scene.h"
+#include "renderer/renderer.h"
 #include "engine/universe.h"
 
 
@@ -32,7 +35,11 @@ ParticleEmitterResource::ParticleEmitterResource(const Path& path
 	, Renderer& renderer
 	, IAllocator& allocator)
 	: Resource(path, manager, allocator)
+	, m_renderer(renderer)
 	, m_instructions(allocator)
+	, m_update_ops(allocator)
+	, m_output_ops(allocator)
+	, m_compute_source(allocator)
 	, m_material(nullptr)
 {
 }
@@ -47,6 +54,13 @@ void ParticleEmitterResource::unload()
 		tmp->decRefCount();
 	}
 	m_instructions.clear();
+	m_update_ops.clear();
+	m_output_ops.clear();
+	m_compute_source.clear();
+	if (m_compute_program) {
+		m_renderer.destroy(m_compute_program);
+		m_compute_program = gpu::INVALID_PROGRAM;
+	}
 }
 
 
@@ -67,6 +81,10 @@ void ParticleEmitterResource::overrideData(OutputMemoryStream&& instructions,
 	m_channels_count = channels_count;
 	m_registers_count = registers_count;
 	m_outputs_count = outputs_count;
+	if (!compile()) {
+		m_update_ops.clear();
+		m_output_ops.clear();
+	}
 	
 	--m_empty_dep_count;
 	checkState();
@@ -110,6 +128,10 @@ bool ParticleEmitterResource::load(u64 size, const u8* mem) {
 	blob.read(m_registers_count);
 	blob.read(m_outputs_count);
 
+	if (!compile()) {
+		logError("Invalid instructions in ", getPath());
+		return false;
+	}
 	return true;
 }
 
@@ -131,7 +153,18 @@ ParticleEmitter::ParticleEmitter(ParticleEmitter&& rhs)
 	, m_emit_rate(rhs.m_emit_rate)
 	, m_particles_count(rhs.m_particles_count)
 	, m_autodestroy(rhs.m_autodestroy)
+	, m_gpu(rhs.m_gpu)
+	, m_gpu_capacity(rhs.m_gpu_capacity)
+	, m_sort(rhs.m_sort)
+	, m_radius(rhs.m_radius)
+	, m_lod_distance(rhs.m_lod_distance)
+	, m_catch_up(rhs.m_catch_up)
+	, m_visible(rhs.m_visible)
+	, m_offscreen_time(rhs.m_offscreen_time)
+	, m_lod_time(rhs.m_lod_time)
+	, m_gpu_data(rhs.m_gpu_data)
 {
+	rhs.m_gpu_data = {};
 	memcpy(m_channels, rhs.m_channels, sizeof(m_channels));
 	memcpy(m_constants, rhs.m_constants, sizeof(m_constants));
 	memset(rhs.m_channels, 0, sizeof(rhs.m_channels));
@@ -146,6 +179,8 @@ ParticleEmitter::ParticleEmitter(ParticleEmitter&& rhs)
 
 ParticleEmitter::~ParticleEmitter()
 {
+	// owner must call releaseGPUData, we don't have renderer here
+	ASSERT(!m_gpu_data.instances);
 	setResource(nullptr);
 	for (const Channel& c : m_channels) {
 		m_allocator.deallocate_aligned(c.data);
@@ -156,6 +191,8 @@ void ParticleEmitter::onResourceChanged(Resource::State old_state, Resource::Sta
 	m_particles_count = 0;
 	m_capacity = 0;
 	m_emit_timer = 0;
+	m_gpu_data.capacity = 0;
+	m_gpu_data.emit_count = 0;
 	for (Channel& c : m_channels) {
 		m_allocator.deallocate_aligned(c.data);
 		c.data = nullptr;
@@ -241,21 +278,55 @@ void ParticleEmitter::serialize(OutputMemoryStream& blob) const
 	blob.write(m_entity);
 	blob.write(m_emit_rate);
 	blob.write(m_autodestroy);
+	blob.write(m_gpu);
+	blob.write(m_gpu_capacity);
+	blob.write(m_radius);
+	blob.write(m_lod_distance);
+	blob.write(m_catch_up);
+	blob.write(m_sort);
 	blob.writeString(m_resource ? m_resource->getPath().c_str() : "");
 }
 
 
-void ParticleEmitter::deserialize(InputMemoryStream& blob, bool has_autodestroy, ResourceManagerHub& manager)
+void ParticleEmitter::deserialize(InputMemoryStream& blob, bool has_autodestroy, bool has_gpu, bool has_lod, bool has_sort, ResourceManagerHub& manager)
 {
 	blob.read(m_entity);
 	blob.read(m_emit_rate);
 	m_autodestroy = false;
 	if (has_autodestroy) blob.read(m_autodestroy);
+	if (has_gpu) {
+		blob.read(m_gpu);
+		blob.read(m_gpu_capacity);
+	}
+	if (has_lod) {
+		blob.read(m_radius);
+		blob.read(m_lod_distance);
+		blob.read(m_catch_up);
+	}
+	m_sort = false;
+	if (has_sort) blob.read(m_sort);
 	const char* path = blob.readString();
 	auto* res = manager.load<ParticleEmitterResource>(Path(path));
 	setResource(res);
 }
 
+struct ParticleEmitterResource::OpContext {
+	const ParticleEmitter* emitter;
+	const u8* instructions;
+	float4* reg_mem;
+	float* out_mem;
+	u32 out_stride;
+	i32 from; // first particle
+	i32 fromf4;
+	i32 stepf4;
+	u32 particles_count;
+	u32* kill_list;
+	volatile i32* kill_counter;
+};
+
+using Op = ParticleEmitterResource::Op;
+using OpContext = ParticleEmitterResource::OpContext;
+
 static float4* getStream(const ParticleEmitter& emitter
 	, DataStream stream
 	, u32 offset
@@ -269,169 +340,541 @@ static float4* getStream(const ParticleEmitter& emitter
 }
 
 struct LiteralGetter {
-	LiteralGetter(DataStream stream) : stream(stream) {}
-
-	float4* get(const ParticleEmitter& emitter, i32, i32, float4*) {
-		value = f4Splat(stream.value);
-		return &value;
-	}
-
-	static void step(float4*&) {}
+	LiteralGetter(DataStream stream, const OpContext&) : value(f4Splat(stream.value)) {}
+	float4 get(i32) const { return value; }
 	float4 value;
-	DataStream stream;
 };
 
 struct ChannelGetter {
-	ChannelGetter(DataStream stream) : stream(stream) {}
-	float4* get(const ParticleEmitter& emitter, i32, i32, float4*) {
-		return (float4*)emitter.getChannelData(stream.index);
-	}
-	static void step(float4*& val) { ++val; }
-	DataStream stream;
+	ChannelGetter(DataStream stream, const OpContext& ctx) : ptr(getStream(*ctx.emitter, stream, ctx.fromf4, ctx.reg_mem)) {}
+	float4 get(i32 i) const { return ptr[i]; }
+	const float4* ptr;
 };
 
 struct ConstGetter {
-	ConstGetter(DataStream stream) : stream(stream) {}
-
-	float4* get(const ParticleEmitter& emitter, i32, i32, float4*) {
-		value = f4Splat(emitter.m_constants[stream.index]);
-		return &value;
-	}
-	static void step(float4*& val) {}
-
+	ConstGetter(DataStream stream, const OpContext& ctx) : value(f4Splat(ctx.emitter->m_constants[stream.index])) {}
+	float4 get(i32) const { return value; }
 	float4 value;
-	DataStream stream;
 };
 
 struct RegisterGetter {
-	RegisterGetter(DataStream stream) : stream(stream) {}
+	RegisterGetter(DataStream stream, const OpContext& ctx) : ptr(ctx.reg_mem + 256 * stream.index) {}
+	float4 get(i32 i) const { return ptr[i]; }
+	const float4* ptr;
+};
+
+// channel or register
+struct StreamSetter {
+	StreamSetter(DataStream stream, const OpContext& ctx) : ptr(getStream(*ctx.emitter, stream, ctx.fromf4, ctx.reg_mem)) {}
+	void set(i32 i, float4 v) { ptr[i] = v; }
+	float4* ptr;
+};
 
-	float4* get(const ParticleEmitter& emitter, i32, i32 stepf4, float4* reg_mem) {
-		return reg_mem + 256 * stream.index;
+// interleaved instance data
+struct OutputSetter {
+	OutputSetter(DataStream stream, const OpContext& ctx)
+		: ptr(ctx.out_mem + stream.index + ctx.fromf4 * 4 * ctx.out_stride)
+		, stride(ctx.out_stride)
+	{}
+
+	void set(i32 i, float4 v) {
+		float* LUMIX_RESTRICT dst = ptr + i * 4 * stride;
+		dst[0] = f4GetX(v);
+		dst[stride] = f4GetY(v);
+		dst[stride * 2] = f4GetZ(v);
+		dst[stride * 3] = f4GetW(v);
 	}
 
-	static void step(float4*& val) { ++val; }
-	DataStream stream;
+	float* ptr;
+	u32 stride;
 };
 
-struct BinaryHelper {
-	template <auto F, typename... T>
-	void run(DataStream dst, InputMemoryStream& ip, T&... args) {
-		const DataStream stream = ip.read<DataStream>();
-		switch(stream.type) {
-			case DataStream::CHANNEL: { ChannelGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::LITERAL: { LiteralGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::CONST: { ConstGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::REGISTER: { RegisterGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			default: ASSERT(false);
+// value is a comparison mask, particles with set lanes are killed
+struct KillSetter {
+	KillSetter(DataStream, const OpContext& ctx) : ctx(ctx) {}
+
+	void set(i32 i, float4 v) {
+		const int m = f4MoveMask(v);
+		if (m == 0) return;
+		for (int j = 0; j < 4; ++j) {
+			if ((m & (1 << j)) == 0) continue;
+			const u32 idx = u32(ctx.from + i * 4 + j);
+			if (idx >= ctx.particles_count) continue;
+			const i32 kill_idx = atomicIncrement(ctx.kill_counter) - 1;
+			if (kill_idx < PageAllocator::PAGE_SIZE / sizeof(ctx.kill_list[0])) {
+				ctx.kill_list[kill_idx] = idx;
+			}
+			else {
+				ASSERT(false);
+			}
 		}
 	}
 
-	template <auto F, typename T0, typename T1>
-	void run(DataStream dst, InputMemoryStream& ip, T0& t0, T1& t1) {
-		float4* arg0 = t0.get(*emitter, fromf4, stepf4, reg_mem);
-		float4* arg1 = t1.get(*emitter, fromf4, stepf4, reg_mem);
-		
-		if (dst.type == DataStream::OUT) {
-			const u32 stride = emitter->getResource()->getOutputsCount();
-			for (i32 i = 0; i < stepf4; ++i, T0::step(arg0), T1::step(arg1)) {
-				float4 tmp = F(*arg0, *arg1);
-				u32 idx = dst.index + (fromf4 + i) * 4 * stride;
-				out_mem[idx] = f4GetX(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetY(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetZ(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetW(tmp);
-			}
+	const OpContext& ctx;
+};
+
+static float4 f4Identity(float4 v) { return v; }
+
+static float4 f4Sin(float4 v) {
+	alignas(16) float tmp[4];
+	f4Store(tmp, v);
+	for (float& f : tmp) f = sinf(f);
+	return f4Load(tmp);
+}
+
+static float4 f4Cos(float4 v) {
+	alignas(16) float tmp[4];
+	f4Store(tmp, v);
+	for (float& f : tmp) f = cosf(f);
+	return f4Load(tmp);
+}
+
+static float4 f4MultiplyAdd(float4 a, float4 b, float4 c) {
+	return f4Add(f4Mul(a, b), c);
+}
+
+static float4 f4Mix(float4 a, float4 b, float4 c) {
+	float4 invc = f4Sub(f4Splat(1.f), c);
+	return f4Add(f4Mul(b, c), f4Mul(a, invc));
+}
+
+// dst = F(args...) for all particles in the chunk
+template <auto F, typename D>
+struct MapKernel {
+	template <typename... T> struct Impl;
+
+	template <typename T0> struct Impl<T0> {
+		static void run(const Op& op, const OpContext& ctx) {
+			D dst(op.dst, ctx);
+			const T0 arg0(op.args[0], ctx);
+			for (i32 i = 0; i < ctx.stepf4; ++i) dst.set(i, F(arg0.get(i)));
+		}
+	};
+
+	template <typename T0, typename T1> struct Impl<T0, T1> {
+		static void run(const Op& op, const OpContext& ctx) {
+			D dst(op.dst, ctx);
+			const T0 arg0(op.args[0], ctx);
+			const T1 arg1(op.args[1], ctx);
+			for (i32 i = 0; i < ctx.stepf4; ++i) dst.set(i, F(arg0.get(i), arg1.get(i)));
 		}
-		else {
-			float4* result = getStream(*emitter, dst, fromf4, reg_mem);
-			const float4* const end = result + stepf4;
+	};
+
+	template <typename T0, typename T1, typename T2> struct Impl<T0, T1, T2> {
+		static void run(const Op& op, const OpContext& ctx) {
+			D dst(op.dst, ctx);
+			const T0 arg0(op.args[0], ctx);
+			const T1 arg1(op.args[1], ctx);
+			const T2 arg2(op.args[2], ctx);
+			for (i32 i = 0; i < ctx.stepf4; ++i) dst.set(i, F(arg0.get(i), arg1.get(i), arg2.get(i)));
+		}
+	};
+};
 
-			for (; result != end; ++result, T0::step(arg0), T1::step(arg1)) {
-				*result = F(*arg0, *arg1);
+template <typename D>
+struct GradientKernel {
+	template <typename... T> struct Impl;
+
+	template <typename T0> struct Impl<T0> {
+		static void run(const Op& op, const OpContext& ctx) {
+			const u8* data = ctx.instructions + op.data_offset;
+			u32 count;
+			memcpy(&count, data, sizeof(count));
+			alignas(16) float keys[8];
+			alignas(16) float values[8];
+			memcpy(keys, data + sizeof(count), sizeof(keys[0]) * count);
+			memcpy(values, data + sizeof(count) + sizeof(keys[0]) * count, sizeof(values[0]) * count);
+
+			D dst(op.dst, ctx);
+			const T0 arg0(op.args[0], ctx);
+			for (i32 i = 0; i < ctx.stepf4; ++i) {
+				alignas(16) float tmp[4];
+				f4Store(tmp, arg0.get(i));
+				for (float& t : tmp) {
+					if (t < keys[0]) {
+						t = values[0];
+						continue;
+					}
+					if (t >= keys[count - 1]) {
+						t = values[count - 1];
+						continue;
+					}
+					for (u32 k = 1; k < count; ++k) {
+						if (t < keys[k]) {
+							const float rel = (t - keys[k - 1]) / (keys[k] - keys[k - 1]);
+							ASSERT(rel >= 0 && rel <= 1);
+							t = rel * values[k] + (1 - rel) * values[k - 1];
+							break;
+						}
+					}
+				}
+				dst.set(i, f4Load(tmp));
 			}
 		}
-	}
-
-	const ParticleEmitter* emitter;
-	i32 fromf4;
-	i32 stepf4;
-	float4* reg_mem;
-	float* out_mem = nullptr;
+	};
 };
 
-struct TernaryHelper {
-	static float4 madd(float4 a, float4 b, float4 c) {
-		return f4Add(f4Mul(a, b), c);
+// picks K<Getter0, ..., GetterN-1> matching the types of the first N args
+template <template <typename...> class K, u32 N, typename... T>
+static void (*selectKernel(const DataStream* args))(const Op&, const OpContext&)
+{
+	if constexpr (sizeof...(T) == N) {
+		return &K<T...>::run;
 	}
-
-	static float4 mix(float4 a, float4 b, float4 c) {
-		float4 invc = f4Sub(f4Splat(1.f), c);
-		return f4Add(f4Mul(b, c), f4Mul(a, invc));
+	else {
+		switch (args[sizeof...(T)].type) {
+			case DataStream::CHANNEL: return selectKernel<K, N, T..., ChannelGetter>(args);
+			case DataStream::LITERAL: return selectKernel<K, N, T..., LiteralGetter>(args);
+			case DataStream::CONST: return selectKernel<K, N, T..., ConstGetter>(args);
+			case DataStream::REGISTER: return selectKernel<K, N, T..., RegisterGetter>(args);
+			default: return nullptr;
+		}
 	}
+}
 
-	template <auto F, typename... T>
-	void run(DataStream dst, InputMemoryStream& ip, T&... args) {
-		const DataStream stream = ip.read<DataStream>();
-		switch(stream.type) {
-			case DataStream::CHANNEL: { ChannelGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::LITERAL: { LiteralGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::CONST: { ConstGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			case DataStream::REGISTER: { RegisterGetter tmp(stream); run<F>(dst, ip, args..., tmp); break; }
-			default: ASSERT(false);
-		}
+template <auto F, u32 N>
+static void (*selectMapKernel(DataStream dst, const DataStream* args))(const Op&, const OpContext&)
+{
+	switch (dst.type) {
+		case DataStream::OUT: return selectKernel<MapKernel<F, OutputSetter>::template Impl, N>(args);
+		case DataStream::CHANNEL:
+		case DataStream::REGISTER: return selectKernel<MapKernel<F, StreamSetter>::template Impl, N>(args);
+		default: return nullptr;
 	}
+}
 
-	template <auto F, typename T0, typename T1, typename T2>
-	void run(DataStream dst, InputMemoryStream& ip, T0& t0, T1& t1, T2& t2) {
-		float4* arg0 = t0.get(*emitter, fromf4, stepf4, reg_mem);
-		float4* arg1 = t1.get(*emitter, fromf4, stepf4, reg_mem);
-		float4* arg2 = t2.get(*emitter, fromf4, stepf4, reg_mem);
-
-		if (dst.type == DataStream::OUT) {
-			const u32 stride = emitter->getResource()->getOutputsCount();
-			for (i32 i = 0; i < stepf4; ++i, T0::step(arg0), T1::step(arg1), T2::step(arg2)) {
-				float4 tmp = F(*arg0, *arg1, *arg2);
-				u32 idx = dst.index + (fromf4 + i) * 4 * stride;
-				out_mem[idx] = f4GetX(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetY(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetZ(tmp);
-				idx += stride;
-				out_mem[idx] = f4GetW(tmp);
+static bool compile(const OutputMemoryStream& instructions, u32 offset, Array<Op>& ops)
+{
+	ops.clear();
+	InputMemoryStream ip(instructions);
+	ip.skip(offset);
+	for (;;) {
+		const InstructionType itype = ip.read<InstructionType>();
+		if (itype == InstructionType::END) return true;
+
+		Op& op = ops.emplace();
+		op.dst = {};
+		op.data_offset = 0;
+		auto readArgs = [&](u32 count){
+			for (u32 i = 0; i < count; ++i) op.args[i] = ip.read<DataStream>();
+		};
+		switch (itype) {
+			case InstructionType::LT:
+			case InstructionType::GT: {
+				readArgs(2);
+				if (ip.read<InstructionType>() != InstructionType::KILL) return false;
+				op.function = itype == InstructionType::GT
+					? selectKernel<MapKernel<f4CmpGT, KillSetter>::Impl, 2>(op.args)
+					: selectKernel<MapKernel<f4CmpLT, KillSetter>::Impl, 2>(op.args);
+				break;
 			}
+			case InstructionType::ADD: op.dst = ip.read<DataStream>(); readArgs(2); op.function = selectMapKernel<f4Add, 2>(op.dst, op.args); break;
+			case InstructionType::SUB: op.dst = ip.read<DataStream>(); readArgs(2); op.function = selectMapKernel<f4Sub, 2>(op.dst, op.args); break;
+			case InstructionType::MUL: op.dst = ip.read<DataStream>(); readArgs(2); op.function = selectMapKernel<f4Mul, 2>(op.dst, op.args); break;
+			case InstructionType::DIV: op.dst = ip.read<DataStream>(); readArgs(2); op.function = selectMapKernel<f4Div, 2>(op.dst, op.args); break;
+			case InstructionType::MULTIPLY_ADD: op.dst = ip.read<DataStream>(); readArgs(3); op.function = selectMapKernel<f4MultiplyAdd, 3>(op.dst, op.args); break;
+			case InstructionType::MIX: op.dst = ip.read<DataStream>(); readArgs(3); op.function = selectMapKernel<f4Mix, 3>(op.dst, op.args); break;
+			case InstructionType::MOV: op.dst = ip.read<DataStream>(); readArgs(1); op.function = selectMapKernel<f4Identity, 1>(op.dst, op.args); break;
+			case InstructionType::SIN: op.dst = ip.read<DataStream>(); readArgs(1); op.function = selectMapKernel<f4Sin, 1>(op.dst, op.args); break;
+			case InstructionType::COS: op.dst = ip.read<DataStream>(); readArgs(1); op.function = selectMapKernel<f4Cos, 1>(op.dst, op.args); break;
+			case InstructionType::GRADIENT: {
+				op.dst = ip.read<DataStream>();
+				readArgs(1);
+				op.data_offset = (u32)ip.getPosition();
+				const u32 count = ip.read<u32>();
+				if (count == 0 || count > 8) return false;
+				ip.skip(count * sizeof(float) * 2);
+				switch (op.dst.type) {
+					case DataStream::OUT: op.function = selectKernel<GradientKernel<OutputSetter>::Impl, 1>(op.args); break;
+					case DataStream::CHANNEL:
+					case DataStream::REGISTER: op.function = selectKernel<GradientKernel<StreamSetter>::Impl, 1>(op.args); break;
+					default: op.function = nullptr; break;
+				}
+				break;
+			}
+			default: return false;
 		}
-		else {
-			float4* result = getStream(*emitter, dst, fromf4, reg_mem);
-			const float4* const end = result + stepf4;
+		if (!op.function) return false;
+		if (ip.getPosition() > ip.size()) return false;
+	}
+}
+
+bool ParticleEmitterResource::compile()
+{
+	PROFILE_FUNCTION();
+	if (m_instructions.empty()) return false;
+	if (!Lumix::compile(m_instructions, 0, m_update_ops)) return false;
+	if (!Lumix::compile(m_instructions, m_output_offset, m_output_ops)) return false;
+	if (!generateComputeShader()) {
+		logWarning(getPath(), " can not be simulated on GPU");
+	}
+	return true;
+}
+
+
+static void writeFloat(OutputMemoryStream& out, float value) {
+	u32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	out << "uintBitsToFloat(" << bits << "u)";
+}
+
+
+static bool writeOperand(OutputMemoryStream& out, DataStream stream) {
+	switch (stream.type) {
+		case DataStream::CHANNEL: out << "c[" << (u32)stream.index << "]"; return true;
+		case DataStream::REGISTER: out << "r[" << (u32)stream.index << "]"; return true;
+		case DataStream::OUT: out << "o[" << (u32)stream.index << "]"; return true;
+		case DataStream::CONST: out << "u_constants[" << u32(stream.index / 4) << "][" << u32(stream.index % 4) << "]"; return true;
+		case DataStream::LITERAL: writeFloat(out, stream.value); return true;
+		default: return false;
+	}
+}
 
-			for (; result != end; ++result, T0::step(arg0), T1::step(arg1), T2::step(arg2)) {
-				*result = F(*arg0, *arg1, *arg2);
+
+// translates one instruction stream to glsl, same semantics as the cpu kernels
+static bool writeInstructions(OutputMemoryStream& out, InputMemoryStream& ip) {
+	for (;;) {
+		const InstructionType itype = ip.read<InstructionType>();
+		auto binary = [&](const char* op){
+			const DataStream dst = ip.read<DataStream>();
+			const DataStream a = ip.read<DataStream>();
+			const DataStream b = ip.read<DataStream>();
+			out << "\t";
+			bool res = writeOperand(out, dst);
+			out << " = ";
+			res = writeOperand(out, a) && res;
+			out << op;
+			res = writeOperand(out, b) && res;
+			out << ";\n";
+			return res;
+		};
+		auto call = [&](const char* fn, u32 args_count){
+			const DataStream dst = ip.read<DataStream>();
+			out << "\t";
+			bool res = writeOperand(out, dst);
+			out << " = " << fn << "(";
+			for (u32 i = 0; i < args_count; ++i) {
+				if (i > 0) out << ", ";
+				res = writeOperand(out, ip.read<DataStream>()) && res;
+			}
+			out << ");\n";
+			return res;
+		};
+		bool res = true;
+		switch (itype) {
+			case InstructionType::END: return true;
+			case InstructionType::LT:
+			case InstructionType::GT: {
+				const DataStream a = ip.read<DataStream>();
+				const DataStream b = ip.read<DataStream>();
+				if (ip.read<InstructionType>() != InstructionType::KILL) return false;
+				out << "\tif (";
+				res = writeOperand(out, a);
+				out << (itype == InstructionType::GT ? " > " : " < ");
+				res = writeOperand(out, b) && res;
+				out << ") return;\n";
+				break;
+			}
+			case InstructionType::ADD: res = binary(" + "); break;
+			case InstructionType::SUB: res = binary(" - "); break;
+			case InstructionType::MUL: res = binary(" * "); break;
+			case InstructionType::DIV: res = binary(" / "); break;
+			case InstructionType::MULTIPLY_ADD: res = call("fma", 3); break;
+			case InstructionType::MIX: res = call("mix", 3); break;
+			case InstructionType::MOV: res = call("", 1); break;
+			case InstructionType::SIN: res = call("sin", 1); break;
+			case InstructionType::COS: res = call("cos", 1); break;
+			case InstructionType::RAND: {
+				const DataStream dst = ip.read<DataStream>();
+				const float from = ip.read<float>();
+				const float to = ip.read<float>();
+				out << "\t";
+				res = writeOperand(out, dst);
+				out << " = randFloat(";
+				writeFloat(out, from);
+				out << ", ";
+				writeFloat(out, to);
+				out << ");\n";
+				break;
+			}
+			case InstructionType::GRADIENT: {
+				const DataStream dst = ip.read<DataStream>();
+				const DataStream arg = ip.read<DataStream>();
+				const u32 count = ip.read<u32>();
+				if (count == 0 || count > 8) return false;
+				float keys[8];
+				float values[8];
+				ip.read(keys, sizeof(keys[0]) * count);
+				ip.read(values, sizeof(values[0]) * count);
+				out << "\t{\n\t\tfloat t = ";
+				res = writeOperand(out, arg);
+				out << ";\n\t\tfloat v = ";
+				writeFloat(out, values[count - 1]);
+				out << ";\n\t\tif (t < ";
+				writeFloat(out, keys[0]);
+				out << ") v = ";
+				writeFloat(out, values[0]);
+				out << ";\n";
+				for (u32 k = 1; k < count; ++k) {
+					out << "\t\telse if (t < ";
+					writeFloat(out, keys[k]);
+					out << ") v = mix(";
+					writeFloat(out, values[k - 1]);
+					out << ", ";
+					writeFloat(out, values[k]);
+					out << ", (t - ";
+					writeFloat(out, keys[k - 1]);
+					out << ") / ";
+					writeFloat(out, keys[k] - keys[k - 1]);
+					out << ");\n";
+				}
+				out << "\t\t";
+				res = writeOperand(out, dst) && res;
+				out << " = v;\n\t}\n";
+				break;
 			}
+			default: return false;
 		}
+		if (!res) return false;
+		if (ip.getPosition() > ip.size()) return false;
 	}
+}
 
-	const ParticleEmitter* emitter;
-	i32 fromf4;
-	i32 stepf4;
-	float4* reg_mem;
-	float* out_mem = nullptr;
+
+bool ParticleEmitterResource::generateComputeShader()
+{
+	if (m_compute_program) {
+		m_renderer.destroy(m_compute_program);
+		m_compute_program = gpu::INVALID_PROGRAM;
+	}
+	m_compute_source.clear();
+
+	// particle is emitted, updated, written to the other buffer if it's not killed and then its instance data are generated,
+	// all in one invocation, so channels, registers and outputs are just local variables
+	OutputMemoryStream& out = m_compute_source;
+	out << R"#(
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) readonly buffer Src { uint b_src_header[4]; float b_src[]; };
+layout(std430, binding = 1) buffer Dst { uint b_dst_header[4]; float b_dst[]; };
+layout(std430, binding = 2) writeonly buffer Instances { float b_instances[]; };
+layout(std140, binding = 4) uniform Drawcall {
+	vec4 u_constants[4];
+	uint u_capacity;
+	uint u_emit_count;
+	uint u_seed;
 };
+uint g_rng;
+float randFloat(float from, float to) {
+	g_rng = g_rng * 1664525u + 1013904223u;
+	return from + (to - from) * float(g_rng >> 8) * (1.0 / 16777216.0);
+}
+void main() {
+	uint id = gl_GlobalInvocationID.x;
+	g_rng = (id ^ u_seed) * 747796405u + 2891336453u;
+)#";
+	out << "\tfloat c[" << maximum(m_channels_count, 1u) << "];\n";
+	out << "\tfloat r[" << maximum(m_registers_count, 1u) << "];\n";
+	out << "\tfloat o[" << maximum(m_outputs_count, 1u) << "];\n";
+	out << "\tif (id < u_emit_count) {\n";
+	for (u32 i = 0; i < m_channels_count; ++i) out << "\tc[" << i << "] = 0;\n";
+	InputMemoryStream emit_ip(m_instructions);
+	emit_ip.skip(m_emit_offset);
+	if (!writeInstructions(out, emit_ip)) {
+		m_compute_source.clear();
+		return false;
+	}
+	out << "\t}\n\telse {\n\tuint src_idx = id - u_emit_count;\n\tif (src_idx >= b_src_header[1]) return;\n";
+	for (u32 i = 0; i < m_channels_count; ++i) out << "\tc[" << i << "] = b_src[" << i << " * u_capacity + src_idx];\n";
+	out << "\t}\n";
 
+	InputMemoryStream update_ip(m_instructions);
+	if (!writeInstructions(out, update_ip)) {
+		m_compute_source.clear();
+		return false;
+	}
+	out << R"#(
+	uint dst_idx = atomicAdd(b_dst_header[1], 1);
+	if (dst_idx >= u_capacity) {
+		atomicAdd(b_dst_header[1], uint(-1));
+		return;
+	}
+)#";
+	for (u32 i = 0; i < m_channels_count; ++i) out << "\tb_dst[" << i << " * u_capacity + dst_idx] = c[" << i << "];\n";
 
-bool ParticleEmitter::update(float dt, PageAllocator& allocator)
+	InputMemoryStream output_ip(m_instructions);
+	output_ip.skip(m_output_offset);
+	if (!writeInstructions(out, output_ip)) {
+		m_compute_source.clear();
+		return false;
+	}
+	for (u32 i = 0; i < m_outputs_count; ++i) out << "\tb_instances[dst_idx * " << m_outputs_count << " + " << i << "] = o[" << i << "];\n";
+	out << "}\n";
+	out.write("", 1);
+	return true;
+}
+
+
+gpu::ProgramHandle ParticleEmitterResource::getComputeProgram()
+{
+	if (m_compute_program || m_compute_source.empty()) return m_compute_program;
+
+	struct Cmd : Renderer::RenderJob {
+		Cmd(IAllocator& allocator) : source(allocator) {}
+
+		void setup() override {}
+
+		void execute() override {
+			PROFILE_FUNCTION();
+			const gpu::ShaderType type = gpu::ShaderType::COMPUTE;
+			const char* srcs[] = { (const char*)source.data() };
+			gpu::createProgram(program, {}, srcs, &type, 1, nullptr, 0, name);
+		}
+
+		OutputMemoryStream source;
+		gpu::ProgramHandle program;
+		StaticString<LUMIX_MAX_PATH> name;
+	};
+
+	m_compute_program = gpu::allocProgramHandle();
+	Cmd& cmd = m_renderer.createJob<Cmd>(m_renderer.getAllocator());
+	cmd.source = m_compute_source;
+	cmd.program = m_compute_program;
+	cmd.name = getPath().c_str();
+	m_renderer.queue(cmd, 0);
+	return m_compute_program;
+}
+
+
+bool ParticleEmitter::update(float dt, float emit_scale, u32& emit_budget, PageAllocator& allocator)
 {
 	if (!m_resource || !m_resource->isReady()) return false;
 	
+	ASSERT(emit_scale > 0);
+	if (m_gpu && m_resource->canSimulateOnGPU()) {
+		// simulated in simulateGPU
+		if (m_emit_rate > 0) {
+			m_emit_timer += dt;
+			const float d = 1.f / (m_emit_rate * emit_scale);
+			while(m_emit_timer > 0) {
+				if (emit_budget > 0) {
+					++m_gpu_data.emit_count;
+					--emit_budget;
+				}
+				m_emit_timer -= d;
+			}
+		}
+		m_constants[0] = dt;
+		return false;
+	}
+
 	if (m_emit_rate > 0) {
 		m_emit_timer += dt;
-		const float d = 1.f / m_emit_rate;
+		const float d = 1.f / (m_emit_rate * emit_scale);
 		while(m_emit_timer > 0) {
-			emit(nullptr);
+			if (emit_budget > 0) {
+				emit(nullptr);
+				--emit_budget;
+			}
 			m_emit_timer -= d;
 		}
 	}
@@ -444,176 +887,31 @@ bool ParticleEmitter::update(float dt, PageAllocator& allocator)
 	u32* kill_list = (u32*)allocator.allocate(true);
 	volatile i32 kill_counter = 0;
 
+	const Span<const Op> ops = m_resource->getUpdateOps();
 	volatile i32 counter = 0;
 	jobs::runOnWorkers([&](){
 		PROFILE_FUNCTION();
-		Array<float4> reg_mem(m_allocator);
-		reg_mem.resize(m_resource->getRegistersCount() * 256);
+		// Array<float4> would drop __m128 alignment attribute, allocate the registers explicitly
+		float4* reg_mem = (float4*)m_allocator.allocate_aligned(m_resource->getRegistersCount() * 256 * sizeof(float4), 16);
+		OpContext ctx;
+		ctx.emitter = this;
+		ctx.instructions = m_resource->getInstructions().data();
+		ctx.reg_mem = reg_mem;
+		ctx.out_mem = nullptr;
+		ctx.out_stride = 0;
+		ctx.particles_count = m_particles_count;
+		ctx.kill_list = kill_list;
+		ctx.kill_counter = &kill_counter;
 		for (;;) {
 			const i32 from = atomicAdd(&counter, 1024);
-			if (from >= (i32)m_particles_count) return;
-
-			const i32 fromf4 = from / 4;
-			const i32 stepf4 = minimum(1024, m_particles_count - from + 3) / 4;
-			InputMemoryStream ip = InputMemoryStream(m_resource->getInstructions());
-			InstructionType itype = ip.read<InstructionType>();
-
-			while (itype != InstructionType::END) {
-				switch (itype) {
-					case InstructionType::LT:
-					case InstructionType::GT: {
-						DataStream dst = ip.read<DataStream>();
-						DataStream op0 = ip.read<DataStream>();
-						const float4* arg0 = getStream(*this, dst, fromf4, reg_mem.begin());
-						const float4* end = arg0 + stepf4;
-						const InstructionType inner_type = ip.read<InstructionType>();
-
-						auto helper = [&](auto f, auto arg1_getter){
-							float4* arg1 = arg1_getter.get(*this, fromf4, stepf4, reg_mem.begin());
-							for (const float4* beg = arg0; arg0 != end; ++arg0) {
-								const float4 tmp = f(*arg0, *arg1);
-								const int m = f4MoveMask(tmp);
-								for (int i = 0; i < 4; ++i) {
-									if ((m & (1 << i))) {
-										switch(inner_type) {
-											case InstructionType::KILL: {
-												const u32 idx = u32(from + (arg0 - beg) * 4 + i);
-												if (idx < m_particles_count) {
-													const i32 kill_idx = atomicIncrement(&kill_counter) - 1;
-													if (kill_idx < PageAllocator::PAGE_SIZE / sizeof(kill_list[0])) {
-														kill_list[kill_idx] = idx;
-													}
-													else {
-														ASSERT(false);
-													}
-												}
-												break;
-											}
-											default: ASSERT(false); break;
-										}
-									}
-								}
-								decltype(arg1_getter)::step(arg1);
-							}						
-						};
-					
-						switch(op0.type) {
-							case DataStream::CHANNEL: {
-								ChannelGetter getter(op0);
-								helper(itype == InstructionType::GT ? f4CmpGT : f4CmpLT, getter);
-								break;
-							}
-							case DataStream::REGISTER: {
-								RegisterGetter getter(op0);
-								helper(itype == InstructionType::GT ? f4CmpGT : f4CmpLT, getter);
-								break;
-							}
-							case DataStream::LITERAL: {
-								LiteralGetter getter(op0);
-								helper(itype == InstructionType::GT ? f4CmpGT : f4CmpLT, getter);
-								break;
-							}
-							case DataStream::CONST: {
-								ConstGetter getter(op0);
-								helper(itype == InstructionType::GT ? f4CmpGT : f4CmpLT, getter);
-								break;
-							}
-							default: ASSERT(false); break;
-						}
-						break;
-					}	
-					case InstructionType::MUL: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						const DataStream dst = ip.read<DataStream>();
-						helper.run<f4Mul>(dst, ip);
-					}
-					case InstructionType::DIV: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						const DataStream dst = ip.read<DataStream>();
-						helper.run<f4Div>(dst, ip);
-					}
-					case InstructionType::MULTIPLY_ADD: {
-						TernaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						const DataStream dst = ip.read<DataStream>();
-						helper.run<TernaryHelper::madd>(dst, ip);
-						break;
-					}
-					case InstructionType::ADD: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						const DataStream dst = ip.read<DataStream>();
-						helper.run<f4Add>(dst, ip);
-						break;
-					}
-					case InstructionType::MOV: {
-						const DataStream dst = ip.read<DataStream>();
-						const DataStream op0 = ip.read<DataStream>();
-						float4* result = getStream(*this, dst, fromf4, reg_mem.begin());
-						const float4* const end = result + stepf4;
-				
-						if (op0.type == DataStream::CONST) {
-							ASSERT(op0.index == 0);
-							const float4 src = f4Splat(dt);
-							for (; result != end; ++result) {
-								*result = src;
-							}
-						}
-						else {
-							const float4* src = getStream(*this, op0, fromf4, reg_mem.begin());
+			if (from >= (i32)m_particles_count) break;
 
-							for (; result != end; ++result, ++src) {
-								*result = *src;
-							}
-						}
-
-						break;
-					}
-					case InstructionType::COS: {
-						const DataStream dst = ip.read<DataStream>();
-						const DataStream op0 = ip.read<DataStream>();
-						const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-						float* result = (float*)getStream(*this, dst, fromf4, reg_mem.begin());
-						const float* const end = result + stepf4 * 4;
-
-						for (; result != end; ++result, ++arg) {
-							*result = cosf(*arg);
-						}
-						break;
-					}
-					case InstructionType::SIN: {
-						const DataStream dst = ip.read<DataStream>();
-						const DataStream op0 = ip.read<DataStream>();
-						const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-						float* result = (float*)getStream(*this, dst, fromf4, reg_mem.begin());
-						const float* const end = result + stepf4 * 4;
-
-						for (; result != end; ++result, ++arg) {
-							*result = sinf(*arg);
-						}
-						break;
-					}
-					default:
-						ASSERT(false);
-						break;
-				}
-				itype = ip.read<InstructionType>();
-			}
+			ctx.from = from;
+			ctx.fromf4 = from / 4;
+			ctx.stepf4 = minimum(1024, m_particles_count - from + 3) / 4;
+			for (const Op& op : ops) op.function(op, ctx);
 		}
+		m_allocator.deallocate_aligned(reg_mem);
 	});
 
 	if (kill_counter > 0) {
@@ -643,6 +941,106 @@ bool ParticleEmitter::update(float dt, PageAllocator& allocator)
 }
 
 
+void ParticleEmitter::releaseGPUData(Renderer& renderer)
+{
+	for (gpu::BufferHandle& buffer : m_gpu_data.particles) {
+		if (buffer) renderer.destroy(buffer);
+	}
+	if (m_gpu_data.instances) renderer.destroy(m_gpu_data.instances);
+	if (m_gpu_data.sort_keys) renderer.destroy(m_gpu_data.sort_keys);
+	if (m_gpu_data.sorted_instances) renderer.destroy(m_gpu_data.sorted_instances);
+	m_gpu_data = {};
+}
+
+
+void ParticleEmitter::simulateGPU(Renderer& renderer)
+{
+	if (!m_gpu || !m_resource || !m_resource->canSimulateOnGPU()) {
+		if (m_gpu_data.instances) releaseGPUData(renderer);
+		return;
+	}
+	if (!m_resource || !m_resource->isReady()) return;
+	const gpu::ProgramHandle program = m_resource->getComputeProgram();
+	if (!program) return;
+
+	PROFILE_FUNCTION();
+	const u32 capacity = maximum((m_gpu_capacity + 63) & ~63, 64u);
+	if (m_gpu_data.capacity != capacity || m_sort != (bool)m_gpu_data.sort_keys) {
+		releaseGPUData(renderer);
+		const u32 header[] = { 4, 0, 0, 0 }; // vertices, instances, first vertex, base instance
+		const u32 size = sizeof(header) + capacity * m_resource->getChannelsCount() * sizeof(float);
+		for (gpu::BufferHandle& buffer : m_gpu_data.particles) {
+			const Renderer::MemRef mem = renderer.allocate(size);
+			memset(mem.data, 0, size);
+			memcpy(mem.data, header, sizeof(header));
+			buffer = renderer.createBuffer(mem, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE);
+		}
+		Renderer::MemRef instances_mem;
+		instances_mem.size = capacity * maximum(m_resource->getOutputsCount(), 1u) * sizeof(float);
+		m_gpu_data.instances = renderer.createBuffer(instances_mem, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE);
+		m_gpu_data.capacity = capacity;
+		if (m_sort) {
+			// bitonic sort needs power of two, sort_particles.shd sorts blocks of 512 keys in shared memory
+			m_gpu_data.sort_capacity = maximum(nextPow2(capacity), 512u);
+			Renderer::MemRef keys_mem;
+			keys_mem.size = m_gpu_data.sort_capacity * sizeof(u32) * 2;
+			m_gpu_data.sort_keys = renderer.createBuffer(keys_mem, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE);
+			m_gpu_data.sorted_instances = renderer.createBuffer(instances_mem, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE);
+		}
+	}
+
+	struct Cmd : Renderer::RenderJob {
+		void setup() override {}
+
+		void execute() override {
+			PROFILE_FUNCTION();
+			const u32 header[] = { 4, 0, 0, 0 };
+			gpu::update(dst, header, sizeof(header));
+			
+			const Renderer::TransientSlice ub = renderer->allocUniform(&data, sizeof(data));
+			if (!ub.buffer) return;
+			gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, ub.buffer, ub.offset, sizeof(data));
+			gpu::bindShaderBuffer(src, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(dst, 1, gpu::BindShaderBufferFlags::OUTPUT);
+			gpu::bindShaderBuffer(instances, 2, gpu::BindShaderBufferFlags::OUTPUT);
+			gpu::useProgram(program);
+			gpu::dispatch((data.capacity + data.emit_count + 63) / 64, 1, 1);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 2, gpu::BindShaderBufferFlags::NONE);
+			gpu::memoryBarrier();
+		}
+
+		Renderer* renderer;
+		gpu::ProgramHandle program;
+		gpu::BufferHandle src;
+		gpu::BufferHandle dst;
+		gpu::BufferHandle instances;
+		struct {
+			float constants[16];
+			u32 capacity;
+			u32 emit_count;
+			u32 seed;
+		} data;
+	};
+
+	Cmd& cmd = renderer.createJob<Cmd>();
+	cmd.renderer = &renderer;
+	cmd.program = program;
+	cmd.src = m_gpu_data.particles[m_gpu_data.current];
+	cmd.dst = m_gpu_data.particles[1 - m_gpu_data.current];
+	cmd.instances = m_gpu_data.instances;
+	memcpy(cmd.data.constants, m_constants, sizeof(m_constants));
+	cmd.data.capacity = capacity;
+	cmd.data.emit_count = minimum(m_gpu_data.emit_count, capacity);
+	cmd.data.seed = rand();
+	renderer.queue(cmd, 0);
+
+	m_gpu_data.current = 1 - m_gpu_data.current;
+	m_gpu_data.emit_count = 0;
+}
+
+
 u32 ParticleEmitter::getParticlesDataSizeBytes() const
 {
 	return m_resource ? ((m_particles_count + 3) & ~3) * m_resource->getOutputsCount() * sizeof(float) : 0;
@@ -652,189 +1050,31 @@ u32 ParticleEmitter::getParticlesDataSizeBytes() const
 void ParticleEmitter::fillInstanceData(float* data) const {
 	if (m_particles_count == 0) return;
 
+	const Span<const Op> ops = m_resource->getOutputOps();
 	volatile i32 counter = 0;
 	jobs::runOnWorkers([&](){
 		PROFILE_FUNCTION();
-		Array<float4> reg_mem(m_allocator);
-		reg_mem.resize(m_resource->getRegistersCount() * 256);
+		// Array<float4> would drop __m128 alignment attribute, allocate the registers explicitly
+		float4* reg_mem = (float4*)m_allocator.allocate_aligned(m_resource->getRegistersCount() * 256 * sizeof(float4), 16);
+		OpContext ctx;
+		ctx.emitter = this;
+		ctx.instructions = m_resource->getInstructions().data();
+		ctx.reg_mem = reg_mem;
+		ctx.out_mem = data;
+		ctx.out_stride = m_resource->getOutputsCount();
+		ctx.particles_count = m_particles_count;
+		ctx.kill_list = nullptr;
+		ctx.kill_counter = nullptr;
 		for (;;) {
-			const u32 from = (u32)atomicAdd(&counter, 1024);
-			if (from >= m_particles_count) return;
-			const u32 fromf4 = from / 4;
-			const u32 stepf4 = minimum(1024, m_particles_count - from + 3) / 4;
-
-			InputMemoryStream ip(m_resource->getInstructions());
-			ip.skip(m_resource->getOutputOffset());
-
-			InstructionType itype = ip.read<InstructionType>();
-			while (itype != InstructionType::END) {
-				switch (itype) {
-					case InstructionType::SIN: {
-						DataStream dst = ip.read<DataStream>();
-						DataStream op0 = ip.read<DataStream>();
-						const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-						
-						if (dst.type == DataStream::OUT) {
-							u8 output_idx = dst.index;
-							const u32 stride = m_resource->getOutputsCount();
-							float* dst = data + output_idx + fromf4 * 4 * stride;
-							for (u32 i = 0, j = 0; i < stepf4 * 4; ++i, j += stride) {
-								dst[j] = sinf(arg[i]);
-							}
-						}
-						else {
-							float* result = (float*)getStream(*this, dst, fromf4, reg_mem.begin());
-							const float* const end = result + stepf4 * 4;
-
-							for (; result != end; ++result, ++arg) {
-								*result = sinf(*arg);
-							}
-						}
-						break;
-					}
-					case InstructionType::COS: {
-						DataStream dst = ip.read<DataStream>();
-						DataStream op0 = ip.read<DataStream>();
-						const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-						if (dst.type == DataStream::OUT) {
-							i32 output_idx = dst.index;
-							const u32 stride = m_resource->getOutputsCount();
-							float* dst = data + output_idx + fromf4 * 4 * stride;
-							for (u32 i = 0, j = 0; i < stepf4 * 4; ++i, j += stride) {
-								dst[j] = cosf(arg[i]);
-							}
-						}
-						else {
-							float* result = (float*)getStream(*this, dst, fromf4, reg_mem.begin());
-							const float* const end = result + stepf4 * 4;
+			const i32 from = atomicAdd(&counter, 1024);
+			if (from >= (i32)m_particles_count) break;
 
-							for (; result != end; ++result, ++arg) {
-								*result = cosf(*arg);
-							}
-						}
-						break;
-					}
-					case InstructionType::MULTIPLY_ADD: {
-						TernaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						helper.out_mem = data;
-						DataStream dst = ip.read<DataStream>();
-						helper.run<TernaryHelper::madd>(dst, ip);
-						break;
-					}
-					case InstructionType::MIX: {
-						TernaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						helper.out_mem = data;
-						DataStream dst = ip.read<DataStream>();
-						helper.run<TernaryHelper::mix>(dst, ip);
-						break;
-					}
-					case InstructionType::MUL: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						helper.out_mem = data;
-						DataStream dst = ip.read<DataStream>();
-						helper.run<f4Mul>(dst, ip);
-						break;
-					}
-					case InstructionType::DIV: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						helper.out_mem = data;
-						DataStream dst = ip.read<DataStream>();
-						helper.run<f4Div>(dst, ip);
-						break;
-					}
-					case InstructionType::ADD: {
-						BinaryHelper helper;
-						helper.emitter = this;
-						helper.fromf4 = fromf4;
-						helper.stepf4 = stepf4;
-						helper.reg_mem = reg_mem.begin();
-						helper.out_mem = data;
-						DataStream dst = ip.read<DataStream>();
-						helper.run<f4Add>(dst, ip);
-						break;
-					}
-					case InstructionType::GRADIENT: {
-						DataStream dst = ip.read<DataStream>();
-						DataStream op0 = ip.read<DataStream>();
-						u32 count = ip.read<u32>();
-						float keys[8];
-						float values[8];
-						ip.read(keys, sizeof(keys[0]) * count);
-						ip.read(values, sizeof(values[0]) * count);
-
-						ASSERT(dst.type == DataStream::OUT);
-						const u8 output_idx = dst.index;
-						const u32 stride = m_resource->getOutputsCount();
-						const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-						float* out = data + output_idx + fromf4 * 4 * stride;
-						for (u32 i = 0, j = 0; i < stepf4 * 4; ++i, j += stride) {
-							if (arg[i] < keys[0]) {
-								out[j] = values[0];
-							}
-							else if (arg[i] >= keys[count - 1]) {
-								out[j] = values[count - 1];
-							}
-							else {
-								for (u32 k = 1; k < count; ++k) {
-									if (arg[i] < keys[k]) {
-										const float t = (arg[i] - keys[k - 1]) / (keys[k] - keys[k - 1]);
-										ASSERT(t >= 0 && t <= 1);
-										out[j] = t * values[k] + (1 - t) * values[k - 1];
-										break;
-									}
-								}
-							}
-						}
-						break;
-					}
-					case InstructionType::MOV: {
-						const u32 stride = m_resource->getOutputsCount();
-						DataStream dst = ip.read<DataStream>();
-						DataStream op0 = ip.read<DataStream>();
-
-						if (op0.type == DataStream::LITERAL) {
-							const float arg = op0.value;
-							ASSERT(dst.type == DataStream::OUT);
-							u8 output_idx = dst.index;
-							float* res = data + output_idx + fromf4 * 4 * stride;
-							for (u32 i = 0; i < stepf4 * 4; ++i) {
-								res[i * stride] = arg;
-							}
-						}
-						else {
-							const float* arg = (float*)getStream(*this, op0, fromf4, reg_mem.begin());
-							ASSERT(dst.type == DataStream::OUT);
-							u8 output_idx = dst.index;
-							float* res = data + output_idx + fromf4 * 4 * stride;
-							for (u32 i = 0, j = 0; i < stepf4 * 4; ++i, j += stride) {
-								res[j] = arg[i];
-							}
-						}
-						break;
-					}
-					default:
-						ASSERT(false);
-						break;
-				}
-				itype = ip.read<InstructionType>();
-			}
+			ctx.from = from;
+			ctx.fromf4 = from / 4;
+			ctx.stepf4 = minimum(1024, m_particles_count - from + 3) / 4;
+			for (const Op& op : ops) op.function(op, ctx);
 		}
+		m_allocator.deallocate_aligned(reg_mem);
 	});
 }
 
@@ -6,6 +6,7 @@
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "gpu/gpu.h"
 
 
 namespace Lumix
@@ -61,6 +62,16 @@ struct ParticleEmitterResource final : Resource
 		DIV
 	};
 
+	struct OpContext;
+
+	// instruction decoded at load time, `function` is specialized for the types of operands
+	struct Op {
+		void (*function)(const Op& op, const OpContext& ctx);
+		DataStream dst;
+		DataStream args[3];
+		u32 data_offset; // inline data in instructions, e.g. gradient keys
+	};
+
 	static const ResourceType TYPE;
 
 	ParticleEmitterResource(const Path& path, ResourceManager& manager, Renderer& renderer, IAllocator& allocator);
@@ -69,6 +80,12 @@ struct ParticleEmitterResource final : Resource
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	const OutputMemoryStream& getInstructions() const { return m_instructions; }
+	Span<const Op> getUpdateOps() const { return m_update_ops; }
+	Span<const Op> getOutputOps() const { return m_output_ops; }
+	// compute shader running emit, update and output instructions, compiled on first call
+	// invalid if the instructions can not be translated
+	gpu::ProgramHandle getComputeProgram();
+	bool canSimulateOnGPU() const { return !m_compute_source.empty(); }
 	u32 getEmitOffset() const { return m_emit_offset; }
 	u32 getOutputOffset() const { return m_output_offset; }
 	u32 getChannelsCount() const { return m_channels_count; }
@@ -85,7 +102,15 @@ struct ParticleEmitterResource final : Resource
 	);
 
 private:
+	bool compile();
+	bool generateComputeShader();
+
+	Renderer& m_renderer;
 	OutputMemoryStream m_instructions;
+	Array<Op> m_update_ops;
+	Array<Op> m_output_ops;
+	OutputMemoryStream m_compute_source; // empty if not supported
+	gpu::ProgramHandle m_compute_program = gpu::INVALID_PROGRAM;
 	u32 m_emit_offset;
 	u32 m_output_offset;
 	u32 m_channels_count;
@@ -101,13 +126,34 @@ struct ResourceManagerHub;
 struct LUMIX_RENDERER_API ParticleEmitter
 {
 public:
+	// particles simulated by compute shader, they never leave gpu memory
+	struct GPUData {
+		// header with indirect draw args, then channels; one is read and the other written by each simulation step
+		gpu::BufferHandle particles[2] = { gpu::INVALID_BUFFER, gpu::INVALID_BUFFER };
+		gpu::BufferHandle instances = gpu::INVALID_BUFFER;
+		u32 current = 0; // particles[current] holds the result of the last queued step
+		u32 capacity = 0; // 0 if buffers must be recreated
+		u32 emit_count = 0; // since the last step
+		// only if m_sort, filled by the pipeline, see sort_particles.shd
+		gpu::BufferHandle sort_keys = gpu::INVALID_BUFFER; // key and index pair per particle
+		gpu::BufferHandle sorted_instances = gpu::INVALID_BUFFER;
+		u32 sort_capacity = 0; // power of two
+	};
+
+	// offscreen emitters with m_catch_up simulate at most this much time when they become visible
+	static constexpr float MAX_CATCH_UP = 2;
+	static constexpr float CATCH_UP_STEP = 1 / 30.f;
+	// update interval of emitters far beyond m_lod_distance
+	static constexpr float MAX_LOD_UPDATE_INTERVAL = 0.25f;
+
 	ParticleEmitter(EntityPtr entity, IAllocator& allocator);
 	ParticleEmitter(ParticleEmitter&& rhs);
 	~ParticleEmitter();
 
 	void serialize(OutputMemoryStream& blob) const;
-	void deserialize(InputMemoryStream& blob, bool has_autodestroy, ResourceManagerHub& manager);
-	bool update(float dt, struct PageAllocator& allocator);
+	void deserialize(InputMemoryStream& blob, bool has_autodestroy, bool has_gpu, bool has_lod, bool has_sort, ResourceManagerHub& manager);
+	// emit rate is multiplied by `emit_scale`, at most `emit_budget` particles are emitted, `emit_budget` is decreased by their count
+	bool update(float dt, float emit_scale, u32& emit_budget, struct PageAllocator& allocator);
 	void emit(const float* args);
 	void fillInstanceData(float* data) const;
 	u32 getParticlesDataSizeBytes() const;
@@ -116,13 +162,28 @@ public:
 	u32 getParticlesCount() const { return m_particles_count; }
 	float* getChannelData(u32 idx) const { return m_channels[idx].data; }
 	void reset() { m_particles_count = 0; }
+	// queues gpu simulation step with particles emitted since the last one, only if m_gpu is set
+	void simulateGPU(Renderer& renderer);
+	void releaseGPUData(Renderer& renderer);
+	const GPUData& getGPUData() const { return m_gpu_data; }
 
 	EntityPtr m_entity;
 	u32 m_emit_rate = 10;
 	u32 m_particles_count = 0;
 	bool m_autodestroy = false;
+	bool m_gpu = false;
+	u32 m_gpu_capacity = 16 * 1024;
+	bool m_sort = false; // back to front, only gpu simulated particles
+	float m_radius = 10; // culling bounds around the entity
+	float m_lod_distance = 0; // further emitters emit less and are updated less often, 0 to disable
+	bool m_catch_up = false;
 	float m_constants[16];
 
+	// runtime state of RenderScene::update, not serialized
+	bool m_visible = true; // in the active camera's frustum
+	float m_offscreen_time = 0;
+	float m_lod_time = 0; // accumulated since the last update
+
 private:
 	struct Channel
 	{
@@ -140,6 +201,7 @@ private:
 	u32 m_capacity = 0;
 	float m_emit_timer = 0;
 	ParticleEmitterResource* m_resource = nullptr;
+	GPUData m_gpu_data;
 };
 
 
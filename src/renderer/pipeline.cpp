@@ -1,4 +1,5 @@
 #include "gpu/gpu.h"
+#include "engine/allocators.h"
 #include "engine/associative_array.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
@@ -15,6 +16,7 @@
 #include "engine/page_allocator.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
+#include "engine/radix_sort.h"
 #include "engine/resource_manager.h"
 #include "engine/universe.h"
 #include "culling_system.h"
@@ -22,6 +24,7 @@
 #include "font.h"
 #include "material.h"
 #include "model.h"
+#include "occlusion_buffer.h"
 #include "particle_system.h"
 #include "pipeline.h"
 #include "pose.h"
@@ -44,20 +47,41 @@ namespace Lumix
 // instance group 15 - 0; if instanced
 
 static constexpr u32 DRAWCALL_UB_SIZE = 32*1024;
+static constexpr u32 TERRAIN_PATCH_INDICES_COUNT = 16 * 16 * 6;
+static constexpr u32 TERRAIN_MAX_PATCHES = 4096;
 static constexpr u32 SORT_VALUE_TYPE_MASK = (1 << 5) - 1;
 static constexpr u64 SORT_KEY_BUCKET_SHIFT = 56;
 static constexpr u64 SORT_KEY_INSTANCED_FLAG = (u64)1 << 55;
 static constexpr u64 SORT_KEY_DEPTH_MASK = 0xffFFffFF;
 static constexpr u64 SORT_KEY_INSTANCER_SHIFT = 16;
+// auto-instanced groups with at least this many instances are frustum culled per instance in a compute shader
+static constexpr u32 GPU_CULL_MIN_INSTANCES = 256;
+// rot quat, pos, scale, lod and index of material constants of a rigid mesh instance, see Mesh::vertex_decl
+static constexpr u32 INSTANCE_DATA_SIZE = 40;
+// lod changes only after the object moves this fraction of distance past the threshold
+static constexpr float LOD_HYSTERESIS = 0.1f;
+static constexpr float MAX_LOD_BIAS = 8.f;
+// render scale changes in steps, so render targets are not reallocated every frame
+static constexpr float RENDER_SCALE_STEP = 0.05f;
+// gpu timings lag behind, wait for them to reflect the last change
+static constexpr u32 RENDER_SCALE_COOLDOWN_FRAMES = 8;
 
 struct CameraParams
 {
+	enum class Casters : u8 {
+		ALL,
+		STATIC,
+		DYNAMIC
+	};
+
 	ShiftedFrustum frustum;
 	DVec3 pos;
 	float lod_multiplier;
 	bool is_shadow;
 	Matrix view;
 	Matrix projection;
+	// cached shadow slices keep static casters, dynamic casters are rendered every frame
+	Casters casters = Casters::ALL;
 };
 
 struct PipelineTexture {
@@ -246,6 +270,13 @@ namespace LuaWrapper {
 			luaL_error(L, "Missing position in camera params");
 		}
 
+		if (LuaWrapper::getField(L, idx, "casters") == LUA_TSTRING) {
+			const char* casters = LuaWrapper::toType<const char*>(L, -1);
+			if (equalStrings(casters, "static")) cp.casters = CameraParams::Casters::STATIC;
+			else if (equalStrings(casters, "dynamic")) cp.casters = CameraParams::Casters::DYNAMIC;
+		}
+		lua_pop(L, 1);
+
 		return cp;
 	}
 
@@ -342,6 +373,9 @@ namespace LuaWrapper {
 		LuaWrapper::setField(L, -1, "is_shadow", params.is_shadow);
 		LuaWrapper::setField(L, -1, "position", params.pos);
 		LuaWrapper::setField(L, -1, "lod_multiplier", params.lod_multiplier);
+		if (params.casters != CameraParams::Casters::ALL) {
+			LuaWrapper::setField(L, -1, "casters", params.casters == CameraParams::Casters::STATIC ? "static" : "dynamic");
+		}
 
 		lua_createtable(L, 16, 0);
 		for (int i = 0; i < 16; ++i) {
@@ -395,6 +429,7 @@ struct ShadowAtlas {
 	
 	ShadowAtlas(IAllocator& allocator)
 		: map(allocator)
+		, moved_casters(allocator)
 	{
 		for (EntityPtr& e : inv_map) e = INVALID_ENTITY;
 	}
@@ -447,16 +482,292 @@ struct ShadowAtlas {
 		u32 idx = iter.value();
 		map.erase(iter);
 		inv_map[idx] = INVALID_ENTITY;
+		slots[idx].dirty = true;
+	}
+
+	// light moved or changed since the slot was rendered
+	bool isStale(u32 idx, const PointLight& light, const Transform& tr) const {
+		const Slot& slot = slots[idx];
+		return slot.dirty
+			|| slot.pos.x != tr.pos.x || slot.pos.y != tr.pos.y || slot.pos.z != tr.pos.z
+			|| slot.rot.x != tr.rot.x || slot.rot.y != tr.rot.y || slot.rot.z != tr.rot.z || slot.rot.w != tr.rot.w
+			|| slot.fov != light.fov
+			|| slot.range != light.range;
+	}
+
+	void baked(u32 idx, const PointLight& light, const Transform& tr) {
+		Slot& slot = slots[idx];
+		slot.pos = tr.pos;
+		slot.rot = tr.rot;
+		slot.fov = light.fov;
+		slot.range = light.range;
+		slot.dynamic = light.flags.isSet(PointLight::DYNAMIC);
+		slot.dirty = false;
+	}
+
+	// only dynamic lights are rerendered when casters move around them
+	void invalidate(Span<const MovedShadowCaster> casters) {
+		for (u32 i = 0; i < lengthOf(slots); ++i) {
+			Slot& slot = slots[i];
+			if (!inv_map[i].isValid() || !slot.dynamic || slot.dirty) continue;
+			for (const MovedShadowCaster& caster : casters) {
+				const float r = slot.range + caster.radius;
+				if (squaredLength(caster.pos - slot.pos) < double(r) * r) {
+					slot.dirty = true;
+					break;
+				}
+			}
+		}
 	}
 
+	void invalidateAll() {
+		for (Slot& slot : slots) slot.dirty = true;
+	}
+
+	struct Slot {
+		DVec3 pos;
+		Quat rot;
+		float fov;
+		float range;
+		bool dynamic = false;
+		bool dirty = true;
+	};
+
 	gpu::TextureHandle texture = gpu::INVALID_TEXTURE;
 	gpu::BufferHandle uniform_buffer = gpu::INVALID_BUFFER;
 	HashMap<EntityRef, u32> map;
 	EntityPtr inv_map[64];
+	Slot slots[64];
+	u64 moved_casters_cursor = 0;
+	Array<MovedShadowCaster> moved_casters;
+};
+
+// runtime virtual texture of terrain detail layers, used by renderTerrains with `virtual_texture = true`
+// layers are composited by terrain_vt.shd to pages of a cache atlas, only where and at mip terrain shader needs them
+// terrain shader writes pages it needs to a feedback image, which is read back asynchronously
+// indirection texture maps each page of each mip to the finest resident page covering it
+// accessed only on render thread
+struct TerrainVirtualTexture {
+	// must match terrain.shd
+	static constexpr u32 PAGE_SIZE = 128;
+	static constexpr u32 PAGE_BORDER = 4;
+	static constexpr u32 PAGE_STRIDE = PAGE_SIZE + 2 * PAGE_BORDER;
+	// pages per side of cache atlas
+	static constexpr u32 CACHE_SIZE = 16;
+	static constexpr u32 MIPS = 9;
+	// pages per side at mip 0
+	static constexpr u32 PAGES = 1 << (MIPS - 1);
+	static constexpr u32 FEEDBACK_WIDTH = PAGES * 2;
+	static constexpr u32 FEEDBACK_HEIGHT = PAGES;
+	static constexpr u32 FEEDBACK_INTERVAL = 4;
+	static constexpr u32 MAX_COMPOSITED_PAGES = 8;
+	static constexpr u16 INVALID_SLOT = 0xffFF;
+	// marks pages in page_table while processing feedback
+	static constexpr u16 REQUESTED_SLOT = 0xfffE;
+	static constexpr u32 INVALID_PAGE = 0xffFFffFF;
+
+	struct Slot {
+		u32 page = INVALID_PAGE;
+		u32 last_used = 0;
+	};
+
+	TerrainVirtualTexture(IAllocator& allocator)
+		: page_table(allocator)
+		, indirection_data(allocator)
+		, slots(allocator)
+		, missing(allocator)
+		, feedback_data(allocator)
+	{
+		u32 count = 0;
+		for (u32 mip = 0; mip < MIPS; ++mip) {
+			mip_offsets[mip] = count;
+			count += (PAGES >> mip) * (PAGES >> mip);
+		}
+		page_table.resize(count);
+		indirection_data.resize(count);
+		slots.resize(CACHE_SIZE * CACHE_SIZE);
+		feedback_data.resize(FEEDBACK_WIDTH * FEEDBACK_HEIGHT);
+		memset(feedback_data.begin(), 0, feedback_data.byte_size());
+		reset();
+	}
+
+	void createTextures() {
+		const gpu::TextureFlags cache_flags = gpu::TextureFlags::NO_MIPS | gpu::TextureFlags::COMPUTE_WRITE | gpu::TextureFlags::CLAMP_U | gpu::TextureFlags::CLAMP_V;
+		albedo = gpu::allocTextureHandle();
+		normal = gpu::allocTextureHandle();
+		indirection = gpu::allocTextureHandle();
+		feedback = gpu::allocTextureHandle();
+		gpu::createTexture(albedo, CACHE_SIZE * PAGE_STRIDE, CACHE_SIZE * PAGE_STRIDE, 1, gpu::TextureFormat::RGBA8, cache_flags, "terrain_vt_albedo");
+		gpu::createTexture(normal, CACHE_SIZE * PAGE_STRIDE, CACHE_SIZE * PAGE_STRIDE, 1, gpu::TextureFormat::RG8, cache_flags, "terrain_vt_normal");
+		gpu::createTexture(indirection, PAGES, PAGES, 1, gpu::TextureFormat::RGBA8, gpu::TextureFlags::POINT_FILTER | gpu::TextureFlags::CLAMP_U | gpu::TextureFlags::CLAMP_V, "terrain_vt_indirection");
+		gpu::createTexture(feedback, FEEDBACK_WIDTH, FEEDBACK_HEIGHT, 1, gpu::TextureFormat::R8, gpu::TextureFlags::NO_MIPS | gpu::TextureFlags::COMPUTE_WRITE | gpu::TextureFlags::POINT_FILTER, "terrain_vt_feedback");
+	}
+
+	void destroyTextures() {
+		if (readback) gpu::destroy(readback);
+		if (albedo) gpu::destroy(albedo);
+		if (normal) gpu::destroy(normal);
+		if (indirection) gpu::destroy(indirection);
+		if (feedback) gpu::destroy(feedback);
+	}
+
+	u32 getPage(u32 mip, u32 x, u32 y) const { return mip_offsets[mip] + x + y * (PAGES >> mip); }
+	u32 getRootPage() const { return mip_offsets[MIPS - 1]; }
+	bool isRootResident() const { return page_table[getRootPage()] != INVALID_SLOT; }
+	
+	u32 getMip(u32 page) const {
+		u32 mip = MIPS - 1;
+		while (page < mip_offsets[mip]) --mip;
+		return mip;
+	}
+
+	// must match vtFeedbackOrigin in terrain.shd
+	static IVec2 getFeedbackOrigin(u32 mip) {
+		return mip == 0 ? IVec2(0) : IVec2(PAGES, PAGES - (PAGES >> (mip - 1)));
+	}
+
+	// drops all pages, e.g. when terrain's splatmap is replaced
+	void reset() {
+		for (u16& slot : page_table) slot = INVALID_SLOT;
+		for (Slot& slot : slots) slot = {};
+		missing.clear();
+		missing.push(getRootPage());
+		indirection_dirty = true;
+	}
+
+	// resident pages covering `uv_rect` are composited again, stale content is visible until then
+	void invalidate(const Vec4& uv_rect) {
+		for (const Slot& slot : slots) {
+			if (slot.page == INVALID_PAGE) continue;
+			const u32 mip = getMip(slot.page);
+			const u32 size = PAGES >> mip;
+			const u32 idx = slot.page - mip_offsets[mip];
+			const Vec2 from = Vec2(float(idx % size), float(idx / size)) / float(size);
+			const Vec2 to = from + Vec2(1.f / size);
+			if (from.x > uv_rect.z || from.y > uv_rect.w || to.x < uv_rect.x || to.y < uv_rect.y) continue;
+			if (missing.indexOf(slot.page) < 0) missing.push(slot.page);
+		}
+	}
+
+	// requested pages and all their parents, which are not resident yet, become `missing`
+	void processFeedback() {
+		PROFILE_FUNCTION();
+		++epoch;
+		// pages being recomposited stay in the list, requests from previous feedback are replaced
+		missing.eraseItems([&](u32 page){ return page_table[page] == INVALID_SLOT; });
+		for (u32 mip = 0; mip < MIPS; ++mip) {
+			const u32 size = PAGES >> mip;
+			const IVec2 origin = getFeedbackOrigin(mip);
+			for (u32 y = 0; y < size; ++y) {
+				const u8* row = &feedback_data[origin.x + (origin.y + y) * FEEDBACK_WIDTH];
+				for (u32 x = 0; x < size; ++x) {
+					if (!row[x]) continue;
+					for (u32 m = mip, px = x, py = y; m < MIPS; ++m, px >>= 1, py >>= 1) {
+						const u32 page = getPage(m, px, py);
+						const u16 slot = page_table[page];
+						if (slot == REQUESTED_SLOT) break;
+						if (slot == INVALID_SLOT) {
+							page_table[page] = REQUESTED_SLOT;
+							missing.push(page);
+							continue;
+						}
+						if (slots[slot].last_used == epoch) break;
+						slots[slot].last_used = epoch;
+					}
+				}
+			}
+		}
+		for (u32 page : missing) {
+			if (page_table[page] == REQUESTED_SLOT) page_table[page] = INVALID_SLOT;
+		}
+		// coarse pages are composited first, they are popped from back
+		qsort(missing.begin(), missing.size(), sizeof(missing[0]), [](const void* a, const void* b) -> int {
+			const u32 pa = *(const u32*)a;
+			const u32 pb = *(const u32*)b;
+			return pa < pb ? -1 : (pa > pb ? 1 : 0);
+		});
+		memset(feedback_data.begin(), 0, feedback_data.byte_size());
+	}
+
+	// returns INVALID_SLOT if all slots are used by pages requested in the last feedback
+	u16 allocSlot(u32 page) {
+		if (page_table[page] != INVALID_SLOT) return page_table[page];
+		// root is always resident in slot 0, so there's always something to sample
+		u16 best = 0;
+		if (page != getRootPage()) {
+			best = 1;
+			for (u16 i = 2, c = (u16)slots.size(); i < c; ++i) {
+				if (slots[i].page == INVALID_PAGE) {
+					best = i;
+					break;
+				}
+				if (slots[i].last_used < slots[best].last_used) best = i;
+			}
+			if (slots[best].page != INVALID_PAGE && slots[best].last_used == epoch) return INVALID_SLOT;
+		}
+
+		Slot& slot = slots[best];
+		if (slot.page != INVALID_PAGE) page_table[slot.page] = INVALID_SLOT;
+		slot.page = page;
+		slot.last_used = epoch;
+		page_table[page] = best;
+		indirection_dirty = true;
+		return best;
+	}
+
+	void updateIndirection() {
+		PROFILE_FUNCTION();
+		indirection_dirty = false;
+		for (i32 mip = MIPS - 1; mip >= 0; --mip) {
+			const u32 size = PAGES >> mip;
+			for (u32 y = 0; y < size; ++y) {
+				for (u32 x = 0; x < size; ++x) {
+					const u32 page = getPage(mip, x, y);
+					const u16 slot = page_table[page];
+					if (slot != INVALID_SLOT) {
+						indirection_data[page] = (slot % CACHE_SIZE) | ((slot / CACHE_SIZE) << 8) | (mip << 16) | 0xff000000;
+					}
+					else {
+						indirection_data[page] = mip + 1 < MIPS ? indirection_data[getPage(mip + 1, x >> 1, y >> 1)] : 0;
+					}
+				}
+			}
+			gpu::update(indirection, mip, 0, 0, 0, size, size, gpu::TextureFormat::RGBA8, &indirection_data[mip_offsets[mip]], size * size * sizeof(u32));
+		}
+	}
+
+	gpu::TextureHandle albedo = gpu::INVALID_TEXTURE;
+	gpu::TextureHandle normal = gpu::INVALID_TEXTURE;
+	gpu::TextureHandle indirection = gpu::INVALID_TEXTURE;
+	gpu::TextureHandle feedback = gpu::INVALID_TEXTURE;
+	gpu::ReadbackHandle readback = gpu::INVALID_READBACK;
+	// slot of each page of each mip, mip 0 first
+	Array<u16> page_table;
+	u32 mip_offsets[MIPS];
+	Array<u32> indirection_data;
+	bool indirection_dirty = true;
+	Array<Slot> slots;
+	// sorted by page, i.e. from mip 0, finer pages are composited after their parents
+	Array<u32> missing;
+	Array<u8> feedback_data;
+	// incremented with each processed feedback
+	u32 epoch = 0;
+	u32 frames_to_feedback = 0;
+	u32 feedback_jitter = 0;
+	u32 last_used_frame = 0;
+	gpu::TextureHandle splatmap = gpu::INVALID_TEXTURE;
+	u32 splatmap_version = 0;
 };
 
 
 static const float SHADOW_CAM_FAR = 500.0f;
+// shadow slices move in steps of this many texels, so a cached slice is valid until the camera moves a step
+static const u32 SHADOW_SLICE_SNAP_TEXELS = 64;
+
+
+static double dot(const DVec3& a, const Vec3& b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
 
 
 ResourceType PipelineResource::TYPE("pipeline");
@@ -499,8 +810,9 @@ struct PipelineImpl final : Pipeline
 		u32 width;
 		u32 height;
 		gpu::TextureFormat format;
+		gpu::TextureFlags flags;
 		gpu::TextureHandle handle;
-		int frame_counter;
+		// non-persistent renderbuffers live only during a single render() and are shared with other pipelines through renderer's pool
 		bool persistent;
 	};
 
@@ -509,6 +821,35 @@ struct PipelineImpl final : Pipeline
 		int id;
 	};
 
+	// draws of a bucket which has only auto-instanced meshes from a reused sort key cache
+	// such bucket does not change between frames, so it's baked once and replayed without recording commands
+	struct BakedBucket {
+		struct Draw {
+			Mesh::RenderData* mesh;
+			Material::RenderData* material;
+			gpu::ProgramHandle program;
+			u32 instances_count;
+			u32 offset; // in instance buffer
+			gpu::ProgramHandle cull_program;
+			Vec4 bounding_sphere; // if cull_program is valid
+		};
+
+		BakedBucket(IAllocator& allocator)
+			: keys(allocator)
+			, values(allocator)
+			, draws(allocator)
+		{}
+
+		u8 layer;
+		u32 define_mask;
+		u32 render_data_version;
+		gpu::BufferHandle instance_buffer;
+		// sorted keys and values the bucket was baked from
+		Array<u64> keys;
+		Array<u64> values;
+		Array<Draw> draws;
+	};
+
 	struct Bucket {
 		enum Sort {
 			DEFAULT,
@@ -519,6 +860,7 @@ struct PipelineImpl final : Pipeline
 		u32 view_id;
 		u32 define_mask;
 		CmdPage* cmd_page = nullptr; 
+		const BakedBucket* baked = nullptr;
 	};
 
 	struct Sorter {
@@ -746,6 +1088,7 @@ struct PipelineImpl final : Pipeline
 			Page::Group* begin;
 			Page::Group* end;
 			Renderer::TransientSlice slice;
+			float screen_size; // max of all instances, for texture streaming
 		};
 
 		Array<Instances> instances;
@@ -755,6 +1098,37 @@ struct PipelineImpl final : Pipeline
 		Mutex mutex;
 	};
 
+	// mesh part of a view's sort keys, reused in following frames while nothing it depends on changes
+	// other renderable types are created each frame and merged with it
+	struct SortKeyCache {
+		SortKeyCache(IAllocator& allocator)
+			: instancers(allocator)
+			, keys(allocator)
+			, values(allocator)
+			, screen_sizes(allocator)
+			, baked(allocator)
+		{}
+
+		bool valid = false;
+		Array<AutoInstancer> instancers;
+		// instance data of `instancers`, created the first time the cache is reused
+		gpu::BufferHandle instance_buffer = gpu::INVALID_BUFFER;
+		Array<BakedBucket*> baked;
+		// meshes in depth sorted buckets are not instanced
+		Array<u64> keys;
+		Array<u64> values;
+		Array<float> screen_sizes;
+		DVec3 camera_pos;
+		DVec3 lod_ref_point;
+		float screen_size_scale;
+		u32 sort_keys_version;
+		u32 lod_version;
+		// instance data contain indices of material constants
+		u32 render_data_version;
+		CameraParams::Casters casters;
+		u32 bucket_map[255];
+	};
+
 	struct View {
 		View(IAllocator& allocator, PageAllocator& page_allocator) 
 			: sorter(allocator, page_allocator)
@@ -764,6 +1138,11 @@ struct PipelineImpl final : Pipeline
 		View(View&& rhs)
 			: sorter(static_cast<Sorter&&>(rhs.sorter))
 			, renderables(rhs.renderables)
+			, occlusion(rhs.occlusion)
+			, sort_key_cache(rhs.sort_key_cache)
+			, meshes_changed(rhs.meshes_changed)
+			, cache_instancers(rhs.cache_instancers)
+			, sort_keys_cached(rhs.sort_keys_cached)
 			, cp(rhs.cp)
 			, instancers(rhs.instancers.move())
 		{
@@ -775,6 +1154,11 @@ struct PipelineImpl final : Pipeline
 		Array<AutoInstancer> instancers;
 		Sorter sorter;
 		CullResult* renderables = nullptr;
+		const OcclusionBuffer* occlusion = nullptr;
+		SortKeyCache* sort_key_cache = nullptr;
+		bool meshes_changed = true; // since the last frame, according to culling
+		bool cache_instancers = false;
+		bool sort_keys_cached = false; // mesh part of the keys is from sort_key_cache
 		CameraParams cp;
 		u8 layer_to_bucket[255];
 	};
@@ -805,13 +1189,28 @@ struct PipelineImpl final : Pipeline
 		, m_textures(allocator)
 		, m_buffers(allocator)
 		, m_views(allocator)
+		, m_cull_caches(allocator)
+		, m_sort_key_caches(allocator)
+		, m_occlusion_buffer(allocator)
+		, m_occluders(allocator)
 		, m_buckets(allocator)
+		, m_moved_shadow_casters(allocator)
+		, m_preskinned(allocator)
+		, m_terrain_vts(allocator)
 	{
 		m_viewport.w = m_viewport.h = 800;
+		m_render_scale_counter = profiler::createCounter("render scale (%)", profiler::CounterType::GAUGE);
 		ResourceManagerHub& rm = renderer.getEngine().getResourceManager();
 		m_draw2d_shader = rm.load<Shader>(Path("pipelines/draw2d.shd"));
 		m_debug_shape_shader = rm.load<Shader>(Path("pipelines/debug_shape.shd"));
 		m_place_grass_shader = rm.load<Shader>(Path("pipelines/place_grass.shd"));
+		m_cull_instances_shader = rm.load<Shader>(Path("pipelines/cull_instances.shd"));
+		m_cull_meshlets_shader = rm.load<Shader>(Path("pipelines/cull_meshlets.shd"));
+		m_sort_particles_shader = rm.load<Shader>(Path("pipelines/sort_particles.shd"));
+		m_fill_clusters_shader = rm.load<Shader>(Path("pipelines/fill_clusters.shd"));
+		m_terrain_quadtree_shader = rm.load<Shader>(Path("pipelines/terrain_quadtree.shd"));
+		m_terrain_vt_shader = rm.load<Shader>(Path("pipelines/terrain_vt.shd"));
+		m_preskin_shader = rm.load<Shader>(Path("pipelines/preskin.shd"));
 		
 		m_draw2d.clear({1, 1});
 
@@ -850,6 +1249,23 @@ struct PipelineImpl final : Pipeline
 		const Renderer::MemRef ib_mem = m_renderer.copy(cube_indices, sizeof(cube_indices));
 		m_cube_ib = m_renderer.createBuffer(ib_mem, gpu::BufferFlags::IMMUTABLE);
 
+		// 16x16 quads, vertex position is computed from gl_VertexID in terrain shader
+		u16 patch_indices[TERRAIN_PATCH_INDICES_COUNT];
+		u16* patch_index = patch_indices;
+		for (u16 j = 0; j < 16; ++j) {
+			for (u16 i = 0; i < 16; ++i) {
+				const u16 v = i + j * 17;
+				*patch_index++ = v;
+				*patch_index++ = v + 17;
+				*patch_index++ = v + 1;
+				*patch_index++ = v + 1;
+				*patch_index++ = v + 17;
+				*patch_index++ = v + 18;
+			}
+		}
+		const Renderer::MemRef patch_ib_mem = m_renderer.copy(patch_indices, sizeof(patch_indices));
+		m_terrain_patch_ib = m_renderer.createBuffer(patch_ib_mem, gpu::BufferFlags::IMMUTABLE);
+
 		m_resource->onLoaded<&PipelineImpl::onStateChanged>(this);
 
 		GlobalState global_state;
@@ -864,6 +1280,8 @@ struct PipelineImpl final : Pipeline
 		const gpu::BufferFlags dc_ub_flags = gpu::BufferFlags::UNIFORM_BUFFER;
 		m_drawcall_ub = m_renderer.createBuffer(dc_mem, dc_ub_flags);
 
+		m_decal_layer = m_renderer.getLayerIdx("decal");
+
 		m_base_vertex_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0);
 		m_base_vertex_decl.addAttribute(1, 12, 4, gpu::AttributeType::U8, gpu::Attribute::NORMALIZED);
 
@@ -896,12 +1314,33 @@ struct PipelineImpl final : Pipeline
 		m_point_light_decl.addAttribute(5, 36, 3, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED); // color
 		m_point_light_decl.addAttribute(6, 48, 3, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED); // dir
 		m_point_light_decl.addAttribute(7, 60, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED); // fov
+
+		// written by preskin.shd, instance data are the same as for rigid meshes
+		m_preskinned_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0); // pos
+		m_preskinned_decl.addAttribute(1, 12, 2, gpu::AttributeType::FLOAT, 0); // uv
+		m_preskinned_decl.addAttribute(2, 20, 3, gpu::AttributeType::FLOAT, 0); // normal
+		m_preskinned_decl.addAttribute(3, 32, 3, gpu::AttributeType::FLOAT, 0); // tangent
+		m_preskinned_decl.addAttribute(4, 0, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		m_preskinned_decl.addAttribute(5, 16, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		m_preskinned_decl.addAttribute(6, 32, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		m_preskinned_decl.addAttribute(12, 36, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		m_preskinned_fur_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0); // pos
+		m_preskinned_fur_decl.addAttribute(1, 12, 2, gpu::AttributeType::FLOAT, 0); // uv
+		m_preskinned_fur_decl.addAttribute(2, 20, 3, gpu::AttributeType::FLOAT, 0); // normal
+		m_preskinned_fur_decl.addAttribute(3, 32, 3, gpu::AttributeType::FLOAT, 0); // tangent
 	}
 
 	~PipelineImpl()
 	{
+		flushCommands();
+		for (CullCache* cache : m_cull_caches) LUMIX_DELETE(m_allocator, cache);
+		for (SortKeyCache* cache : m_sort_key_caches) {
+			invalidate(*cache);
+			LUMIX_DELETE(m_allocator, cache);
+		}
 		for (gpu::TextureHandle t : m_textures) m_renderer.destroy(t);
 		for (gpu::BufferHandle b : m_buffers) m_renderer.destroy(b);
+		clearPreskinned();
 
 		m_renderer.frame();
 		m_renderer.frame();
@@ -910,9 +1349,18 @@ struct PipelineImpl final : Pipeline
 		m_draw2d_shader->decRefCount();
 		m_debug_shape_shader->decRefCount();
 		m_place_grass_shader->decRefCount();
+		m_cull_instances_shader->decRefCount();
+		m_cull_meshlets_shader->decRefCount();
+		m_sort_particles_shader->decRefCount();
+		m_fill_clusters_shader->decRefCount();
+		m_terrain_quadtree_shader->decRefCount();
+		m_terrain_vt_shader->decRefCount();
+		m_preskin_shader->decRefCount();
 
 		for (const Renderbuffer& rb : m_renderbuffers) {
-			m_renderer.destroy(rb.handle);
+			if (!rb.handle) continue;
+			if (rb.persistent) m_renderer.destroy(rb.handle);
+			else m_renderer.releaseRenderTarget(rb.handle);
 		}
 
 		for(ShaderRef& shader : m_shaders) {
@@ -921,6 +1369,17 @@ struct PipelineImpl final : Pipeline
 		if (m_resource) m_resource->decRefCount();
 
 		m_renderer.destroy(m_cube_ib);
+		m_renderer.destroy(m_terrain_patch_ib);
+		if (m_terrain_patches) m_renderer.destroy(m_terrain_patches);
+		for (TerrainVirtualTexture* vt : m_terrain_vts) {
+			m_renderer.runInRenderThread(vt, [](Renderer& renderer, void* ptr){
+				TerrainVirtualTexture* vt = (TerrainVirtualTexture*)ptr;
+				vt->destroyTextures();
+				LUMIX_DELETE(renderer.getAllocator(), vt);
+			});
+		}
+		if (m_grass_occlusion_buffer) m_renderer.destroy(m_grass_occlusion_buffer);
+		if (m_meshlets_occlusion_buffer) m_renderer.destroy(m_meshlets_occlusion_buffer);
 		m_renderer.destroy(m_cube_vb);
 		m_renderer.destroy(m_global_state_buffer);
 		m_renderer.destroy(m_pass_state_buffer);
@@ -930,10 +1389,10 @@ struct PipelineImpl final : Pipeline
 		m_renderer.destroy(m_cluster_buffers.clusters.buffer);
 		m_renderer.destroy(m_cluster_buffers.lights.buffer);
 		m_renderer.destroy(m_cluster_buffers.maps.buffer);
+		m_renderer.destroy(m_cluster_buffers.probe_maps.buffer);
 		m_renderer.destroy(m_cluster_buffers.env_probes.buffer);
 		m_renderer.destroy(m_cluster_buffers.refl_probes.buffer);
-
-		clearBuffers();
+		m_renderer.destroy(m_cluster_buffers.decals.buffer);
 	}
 
 	void callInitScene()
@@ -995,6 +1454,8 @@ struct PipelineImpl final : Pipeline
 		{
 			if(handler.hash == name_hash)
 			{
+				// handlers queue their own jobs
+				flushCommands();
 				handler.callback.invoke();
 				break;
 			}
@@ -1029,6 +1490,8 @@ struct PipelineImpl final : Pipeline
 		if (new_state != Resource::State::READY) return;
 
 		cleanup();
+		// cached shadow slices live in renderbuffers owned by the script
+		for (ShadowSlice& slice : m_shadow_slices) slice.dirty = true;
 
 		m_lua_state = lua_newthread(m_renderer.getEngine().getState());
 		m_lua_thread_ref = luaL_ref(m_renderer.getEngine().getState(), LUA_REGISTRYINDEX);
@@ -1082,14 +1545,15 @@ struct PipelineImpl final : Pipeline
 		if (m_scene) callInitScene();
 	}
 
-	void clearBuffers() {
+	// returns transient renderbuffers to renderer's pool, so they can be reused by this or other pipelines
+	void releaseTransientBuffers(bool keep_output) {
 		PROFILE_FUNCTION();
-		for (Renderbuffer& rb : m_renderbuffers) {
-			++rb.frame_counter;
-			if (rb.frame_counter > 2 && !rb.persistent && rb.handle) {
-				m_renderer.destroy(rb.handle);
-				rb.handle = gpu::INVALID_TEXTURE;
-			}
+		for (i32 i = 0, c = m_renderbuffers.size(); i < c; ++i) {
+			Renderbuffer& rb = m_renderbuffers[i];
+			if (rb.persistent || !rb.handle) continue;
+			if (keep_output && i == m_output) continue;
+			m_renderer.releaseRenderTarget(rb.handle);
+			rb.handle = gpu::INVALID_TEXTURE;
 		}
 	}
 
@@ -1102,6 +1566,17 @@ struct PipelineImpl final : Pipeline
 
 	gpu::BufferHandle getDrawcallUniformBuffer() override { return m_drawcall_ub; }
 
+	// render thread only, each drawcall gets its own slice of the persistently mapped transient buffer
+	void setDrawcallData(const void* data, u32 size) {
+		const Renderer::TransientSlice slice = m_renderer.allocUniform(data, size);
+		if (slice.buffer) {
+			gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, slice.buffer, slice.offset, slice.size);
+			return;
+		}
+		gpu::update(m_drawcall_ub, data, size);
+		gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, m_drawcall_ub, 0, DRAWCALL_UB_SIZE);
+	}
+
 	Viewport getViewport() override {
 		return m_viewport;
 	}
@@ -1151,24 +1626,40 @@ struct PipelineImpl final : Pipeline
 			const float bb_size = frustum_bounding_sphere.radius;
 			const Vec3 light_forward = light_mtx.getZVector();
 
-			const Vec3 view_dir = m_viewport.rot * Vec3(0, 0, -1);
-			const Vec3 xvec = normalize(cross(light_forward, view_dir));
-			const Vec3 yvec = normalize(cross(light_forward, xvec));
-
-			Vec2 min = Vec2(FLT_MAX);
-			Vec2 max = Vec2(-FLT_MAX);
-			for (u32 i = 0; i < 8; ++i) {
-				const Vec2 proj = Vec2(dot(xvec, camera_frustum.points[i]), dot(yvec, camera_frustum.points[i]));
-				min.x = minimum(min.x, proj.x);
-				min.y = minimum(min.y, proj.y);
-				max.x = maximum(max.x, proj.x);
-				max.y = maximum(max.y, proj.y);
-			}
-
-			const float ortho_size = maximum(max.x - min.x, max.y - min.y) * 0.5f;
-			Vec3 shadow_cam_pos = xvec * (max.x + min.x) * 0.5f;
-			shadow_cam_pos += yvec * (max.y + min.y) * 0.5f;
-			shadow_cam_pos -= light_forward * (SHADOW_CAM_FAR - 2 * bb_size);
+			// basis and size do not depend on camera rotation and the center is snapped to a grid in light space,
+			// so the slice does not change until the camera moves by a snap step and its content can be cached
+			const Vec3 xvec = normalize(light_mtx.getXVector());
+			const Vec3 yvec = normalize(light_mtx.getYVector());
+			const Quat light_rot = light.isValid() ? universe.getRotation((EntityRef)light) : Quat::IDENTITY;
+			ShadowSlice& cache = m_shadow_slices[slice];
+
+			float ortho_size = bb_size / (1 - 2.f * SHADOW_SLICE_SNAP_TEXELS / shadowmap_width);
+			// bounding sphere radius is not exactly the same when the camera rotates
+			if (fabsf(cache.ortho_size - ortho_size) < ortho_size * 1e-3f) ortho_size = cache.ortho_size;
+			const double snap = 2.0 * ortho_size / shadowmap_width * SHADOW_SLICE_SNAP_TEXELS;
+
+			const DVec3 center = m_viewport.pos + DVec3(frustum_bounding_sphere.position);
+			const bool same_basis = cache.ortho_size == ortho_size
+				&& cache.light_rot.x == light_rot.x && cache.light_rot.y == light_rot.y && cache.light_rot.z == light_rot.z && cache.light_rot.w == light_rot.w;
+			double forward = floor(dot(center, light_forward) / snap) * snap;
+			// cached depth is relative to the shadow camera, so the camera moves along the light only after the slice drifts far enough
+			if (same_basis && fabs(forward - cache.forward) < ortho_size) forward = cache.forward;
+			const DVec3 snapped_center = DVec3(xvec) * (floor(dot(center, xvec) / snap) * snap)
+				+ DVec3(yvec) * (floor(dot(center, yvec) / snap) * snap)
+				+ DVec3(light_forward) * forward;
+
+			const DVec3 prev_center = cache.center;
+			const bool moved = prev_center.x != snapped_center.x || prev_center.y != snapped_center.y || prev_center.z != snapped_center.z;
+			if (!same_basis || forward != cache.forward) cache.dirty = true;
+			cache.ortho_size = ortho_size;
+			cache.center = snapped_center;
+			cache.forward = forward;
+			cache.light_rot = light_rot;
+			cache.xvec = xvec;
+			cache.yvec = yvec;
+
+			Vec3 shadow_cam_pos = Vec3(snapped_center - m_viewport.pos);
+			shadow_cam_pos -= light_forward * (SHADOW_CAM_FAR - 2 * ortho_size);
 			Matrix view_matrix;
 			view_matrix.lookAt(shadow_cam_pos, shadow_cam_pos + light_forward, yvec);
 
@@ -1187,23 +1678,177 @@ struct PipelineImpl final : Pipeline
 			vp.pos = m_viewport.pos + shadow_cam_pos;
 			vp.rot = view_matrix.getRotation().conjugated();
 			vp.near = 0;
-			vp.far = SHADOW_CAM_FAR + 2 * bb_size;
+			vp.far = SHADOW_CAM_FAR + 2 * ortho_size;
 
 			view_matrix = vp.getView(m_viewport.pos);
 
 			const Matrix projection_matrix = vp.getProjection();
 			const Matrix m = bias_matrix * projection_matrix * view_matrix;
 
+			if (moved && !cache.dirty) {
+				// the slice moved by whole snap steps in its plane, so cached texels are still valid, just shifted
+				const Vec4 prev = projection_matrix * (view_matrix * Vec4(Vec3(prev_center - m_viewport.pos), 1));
+				const float dy = prev.y * 0.5f * shadowmap_width;
+				cache.scroll.x += i32(roundf(prev.x * 0.5f * shadowmap_width));
+				cache.scroll.y += i32(roundf(gpu::isOriginBottomLeft() ? dy : -dy));
+				if (abs(cache.scroll.x) >= shadowmap_width || abs(cache.scroll.y) >= shadowmap_width) cache.dirty = true;
+			}
+			if (cache.dirty) cache.scroll = IVec2(0);
+
 			global_state.sm_slices[slice].world_to_slice = Matrix4x3(m).transposed();
 			global_state.sm_slices[slice].size = shadowmap_width;
 			global_state.sm_slices[slice].rcp_size = 1.f / shadowmap_width;
-			global_state.sm_slices[slice].size_world = bb_size * 2;
+			global_state.sm_slices[slice].size_world = ortho_size * 2;
 			global_state.sm_slices[slice].texel_world = global_state.sm_slices[slice].size_world * global_state.sm_slices[slice].rcp_size;
 			global_state.shadow_cam_depth_range = SHADOW_CAM_FAR;
 			global_state.shadow_cam_rcp_depth_range = 1.f / SHADOW_CAM_FAR;
 
 			//findExtraShadowcasterPlanes(light_forward, camera_frustum, &cp.frustum);
 		}
+
+		m_moved_shadow_casters.clear();
+		if (!m_scene->getMovedShadowCasters(m_shadow_slices_cursor, m_moved_shadow_casters)) {
+			for (ShadowSlice& cache : m_shadow_slices) cache.dirty = true;
+			return;
+		}
+
+		for (const MovedShadowCaster& caster : m_moved_shadow_casters) {
+			// slices cache only static casters
+			if (caster.dynamic) continue;
+			for (ShadowSlice& cache : m_shadow_slices) {
+				if (cache.dirty) continue;
+				const DVec3 rel = caster.pos - cache.center;
+				const double r = cache.ortho_size + caster.radius;
+				if (fabs(dot(rel, cache.xvec)) < r && fabs(dot(rel, cache.yvec)) < r) cache.dirty = true;
+			}
+		}
+	}
+
+	// camera of a part of the shadow slice, rendered with viewport set to the part, `x`, `y`, `w` and `h` are in texels
+	CameraParams getShadowStripParams(i32 slice, i32 x, i32 y, i32 w, i32 h) {
+		const Viewport& vp = m_shadow_camera_viewports[slice];
+		CameraParams cp = getShadowCameraParams(slice);
+		const float size = (float)vp.w;
+		const float texel = 2 * vp.ortho_size / size;
+		// y from the bottom
+		const float y0 = float(gpu::isOriginBottomLeft() ? y : vp.h - y - h);
+		cp.frustum = vp.getFrustum(Vec2((float)x, size - y0 - h), Vec2(float(x + w), size - y0));
+		cp.projection.setOrtho(-vp.ortho_size + x * texel
+			, -vp.ortho_size + (x + w) * texel
+			, -vp.ortho_size + y0 * texel
+			, -vp.ortho_size + (y0 + h) * texel
+			, vp.near
+			, vp.far
+			, true);
+		cp.casters = CameraParams::Casters::STATIC;
+		return cp;
+	}
+
+	// returns nil if static casters cached in the slice are valid, otherwise a table with
+	// `strips` - parts of the slice to rerender, each with `x`, `y`, `w`, `h` in texels and `params` of a camera limited to the part
+	// `copy` - set if the slice scrolled, the still valid part of the cache, `src_x`, `src_y`, `dst_x`, `dst_y`, `w`, `h` in texels
+	// the slice is considered up to date after the call
+	static int getShadowSliceUpdate(lua_State* L) {
+		PipelineImpl* pipeline = getClosureThis(L);
+		const i32 slice = LuaWrapper::checkArg<i32>(L, 1);
+		if (slice < 0 || slice >= (i32)lengthOf(pipeline->m_shadow_slices)) return luaL_argerror(L, 1, "invalid slice");
+
+		ShadowSlice& cache = pipeline->m_shadow_slices[slice];
+		const bool dirty = cache.dirty;
+		const IVec2 scroll = cache.scroll;
+		cache.dirty = false;
+		cache.scroll = IVec2(0);
+		if (!dirty && scroll.x == 0 && scroll.y == 0) {
+			lua_pushnil(L);
+			return 1;
+		}
+
+		const i32 size = pipeline->m_shadow_camera_viewports[slice].w;
+		lua_newtable(L);
+		lua_newtable(L);
+		i32 strips_count = 0;
+		auto push_strip = [&](i32 x, i32 y, i32 w, i32 h){
+			if (w <= 0 || h <= 0) return;
+			lua_newtable(L);
+			LuaWrapper::setField(L, -1, "x", x);
+			LuaWrapper::setField(L, -1, "y", y);
+			LuaWrapper::setField(L, -1, "w", w);
+			LuaWrapper::setField(L, -1, "h", h);
+			LuaWrapper::push(L, pipeline->getShadowStripParams(slice, x, y, w, h));
+			lua_setfield(L, -2, "params");
+			++strips_count;
+			lua_rawseti(L, -2, strips_count);
+		};
+
+		if (dirty) {
+			push_strip(0, 0, size, size);
+			lua_setfield(L, -2, "strips");
+			return 1;
+		}
+
+		// cached texels moved by `scroll`, the part of the slice they do not cover is exposed
+		const i32 keep_w = size - abs(scroll.x);
+		const i32 keep_h = size - abs(scroll.y);
+		push_strip(scroll.x > 0 ? 0 : keep_w, 0, abs(scroll.x), size);
+		push_strip(maximum(scroll.x, 0), scroll.y > 0 ? 0 : keep_h, keep_w, abs(scroll.y));
+		lua_setfield(L, -2, "strips");
+
+		lua_newtable(L);
+		LuaWrapper::setField(L, -1, "src_x", maximum(-scroll.x, 0));
+		LuaWrapper::setField(L, -1, "src_y", maximum(-scroll.y, 0));
+		LuaWrapper::setField(L, -1, "dst_x", maximum(scroll.x, 0));
+		LuaWrapper::setField(L, -1, "dst_y", maximum(scroll.y, 0));
+		LuaWrapper::setField(L, -1, "w", keep_w);
+		LuaWrapper::setField(L, -1, "h", keep_h);
+		lua_setfield(L, -2, "copy");
+		return 1;
+	}
+
+	void copyRenderbuffer(PipelineTexture dst, PipelineTexture src, u32 x, u32 y) {
+		struct Cmd : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::copy(dst, src, x, y);
+			}
+			gpu::TextureHandle dst;
+			gpu::TextureHandle src;
+			u32 x, y;
+		};
+
+		Cmd& cmd = m_renderer.createJob<Cmd>();
+		cmd.dst = toHandle(dst);
+		cmd.src = toHandle(src);
+		cmd.x = x;
+		cmd.y = y;
+		queue(cmd, m_profiler_link);
+	}
+
+	// copies `w` x `h` texels of the first mip
+	void copyRenderbufferRegion(PipelineTexture dst, PipelineTexture src, u32 dst_x, u32 dst_y, u32 src_x, u32 src_y, u32 w, u32 h) {
+		struct Cmd : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::copy(dst, src, dst_x, dst_y, src_x, src_y, w, h);
+			}
+			gpu::TextureHandle dst;
+			gpu::TextureHandle src;
+			u32 dst_x, dst_y;
+			u32 src_x, src_y;
+			u32 w, h;
+		};
+
+		Cmd& cmd = m_renderer.createJob<Cmd>();
+		cmd.dst = toHandle(dst);
+		cmd.src = toHandle(src);
+		cmd.dst_x = dst_x;
+		cmd.dst_y = dst_y;
+		cmd.src_x = src_x;
+		cmd.src_y = src_y;
+		cmd.w = w;
+		cmd.h = h;
+		queue(cmd, m_profiler_link);
 	}
 
 	Vec2 getAtlasSize() const {
@@ -1251,7 +1896,6 @@ struct PipelineImpl final : Pipeline
 		};
 
 		const gpu::TextureHandle src = getOutput();
-		m_renderbuffers[m_output].frame_counter = 1;
 		if (!src) {
 			logError(getPath(), ": can not bake shadows because the pipeline has no output");
 			return false;
@@ -1263,7 +1907,7 @@ struct PipelineImpl final : Pipeline
 		job.x = u32(ShadowAtlas::SIZE * uv.x + 0.5f);
 		job.y = u32(ShadowAtlas::SIZE * uv.y + 0.5f);
 
-		m_renderer.queue(job, m_profiler_link);
+		queue(job, m_profiler_link);
 		m_viewport = backup_viewport;
 		lua_rawgeti(m_lua_state, LUA_REGISTRYINDEX, m_lua_env);
 		LuaWrapper::setField(m_lua_state, -1, "viewport_w", m_viewport.w);
@@ -1298,24 +1942,77 @@ struct PipelineImpl final : Pipeline
 			cmd.matrix.multiply3x3(tr.scale);
 		}
 		cmd.matrix = m_viewport.getProjection() * m_viewport.getViewRotation() * cmd.matrix * normalize;
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
+	}
+
+
+	// lods are biased to lower detail while the last frame is over budget
+	void updateLODBias() {
+		const u32 triangle_budget = m_renderer.getLODTriangleBudget();
+		const u32 draw_call_budget = m_renderer.getLODDrawCallBudget();
+		float bias = 1;
+		if (triangle_budget > 0 || draw_call_budget > 0) {
+			const Stats& stats = m_last_frame_stats;
+			const bool over = (triangle_budget > 0 && stats.triangle_count > triangle_budget)
+				|| (draw_call_budget > 0 && stats.draw_call_count > draw_call_budget);
+			const bool under = (triangle_budget == 0 || stats.triangle_count < triangle_budget * 0.9f)
+				&& (draw_call_budget == 0 || stats.draw_call_count < draw_call_budget * 0.9f);
+			bias = m_lod_bias;
+			if (over) bias = minimum(bias * 1.05f, MAX_LOD_BIAS);
+			else if (under) bias = maximum(bias / 1.05f, 1.f);
+		}
+		if (bias != m_lod_bias) {
+			m_lod_bias = bias;
+			// cached views have lods selected with the old bias
+			++m_lod_version;
+		}
+	}
+
+	void setDynamicResolution(bool enable, float target_ms, float min_scale) override {
+		m_dynamic_resolution.enabled = enable;
+		m_dynamic_resolution.target_ms = target_ms;
+		m_dynamic_resolution.min_scale = clamp(min_scale, RENDER_SCALE_STEP, 1.f);
+		if (!enable) m_render_scale = 1;
 	}
 
+	float getRenderScale() const override { return m_render_scale; }
+
+	// gpu cost is mostly proportional to pixel count, scale goes down when over budget and up once there's headroom
+	void updateRenderScale() {
+		if (m_dynamic_resolution.enabled) {
+			const float gpu_ms = m_renderer.getGPUFrameTime();
+			if (m_dynamic_resolution.cooldown > 0) {
+				--m_dynamic_resolution.cooldown;
+			}
+			else if (gpu_ms > 0) {
+				float scale = m_render_scale;
+				if (gpu_ms > m_dynamic_resolution.target_ms) scale = maximum(scale - RENDER_SCALE_STEP, m_dynamic_resolution.min_scale);
+				else if (gpu_ms < m_dynamic_resolution.target_ms * 0.8f) scale = minimum(scale + RENDER_SCALE_STEP, 1.f);
+				if (scale != m_render_scale) {
+					m_render_scale = scale;
+					m_dynamic_resolution.cooldown = RENDER_SCALE_COOLDOWN_FRAMES;
+				}
+			}
+		}
+		m_scene_size.x = maximum(1, i32(m_viewport.w * m_render_scale + 0.5f));
+		m_scene_size.y = maximum(1, i32(m_viewport.h * m_render_scale + 0.5f));
+		if (m_dynamic_resolution.enabled) profiler::setCounter(m_render_scale_counter, i64(m_render_scale * 100 + 0.5f));
+	}
 
 	bool render(bool only_2d) override
 	{
 		PROFILE_FUNCTION();
 
 		if (!isReady() || m_viewport.w <= 0 || m_viewport.h <= 0) {
-			if (m_scene) {
-				m_scene->clearDebugLines();
-				m_scene->clearDebugTriangles();
-			}
+			if (m_scene) m_scene->clearDebugShapes();
 			m_draw2d.clear(getAtlasSize());
 			return false;
 		}
 
-		clearBuffers();
+		// previous output is not needed anymore
+		releaseTransientBuffers(false);
+		updateLODBias();
+		updateRenderScale();
 
 		const Matrix view = m_viewport.getViewRotation();
 		const Matrix projection = m_viewport.getProjection();
@@ -1329,8 +2026,8 @@ struct PipelineImpl final : Pipeline
 		global_state.time = m_timer.getTimeSinceStart();
 		global_state.frame_time_delta = m_timer.getTimeSinceTick();
 		m_timer.tick();
-		global_state.framebuffer_size.x = m_viewport.w;
-		global_state.framebuffer_size.y = m_viewport.h;
+		// scene passes render in scaled size
+		global_state.framebuffer_size = m_scene_size;
 		global_state.cam_world_pos = Vec4(Vec3(m_viewport.pos), 1);
 
 		if(m_scene) {
@@ -1372,24 +2069,26 @@ struct PipelineImpl final : Pipeline
 		start_job.global_state = global_state;
 		start_job.global_state_buffer = m_global_state_buffer;
 		start_job.pass_state_buffer = m_pass_state_buffer;
-		m_renderer.queue(start_job, 0);
+		queue(start_job, 0);
 		
 		m_buckets_ready = jobs::INVALID_HANDLE;
 		jobs::incSignal(&m_buckets_ready);
 		m_buckets.clear();
 		m_views.clear();
+		m_occlusion_buffer_used = false;
+		m_occlusion_stats = {};
 		
 		LuaWrapper::DebugGuard lua_debug_guard(m_lua_state);
 		lua_rawgeti(m_lua_state, LUA_REGISTRYINDEX, m_lua_env);
 		LuaWrapper::setField(m_lua_state, -1, "viewport_w", m_viewport.w);
 		LuaWrapper::setField(m_lua_state, -1, "viewport_h", m_viewport.h);
+		LuaWrapper::setField(m_lua_state, -1, "scene_w", m_scene_size.x);
+		LuaWrapper::setField(m_lua_state, -1, "scene_h", m_scene_size.y);
+		LuaWrapper::setField(m_lua_state, -1, "render_scale", m_render_scale);
 		lua_getfield(m_lua_state, -1, "main");
 		if (lua_type(m_lua_state, -1) != LUA_TFUNCTION) {
 			lua_pop(m_lua_state, 2);
-			if (m_scene) {
-				m_scene->clearDebugLines();
-				m_scene->clearDebugTriangles();
-			}
+			if (m_scene) m_scene->clearDebugShapes();
 			return false;
 		}
 		{
@@ -1397,6 +2096,9 @@ struct PipelineImpl final : Pipeline
 			LuaWrapper::pcall(m_lua_state, 0, 0);
 		}
 		lua_pop(m_lua_state, 1);
+		flushCommands();
+		// all commands using transient buffers are already queued, later users of the pool are queued after them
+		releaseTransientBuffers(true);
 
 
 		struct EndPipelineJob : Renderer::RenderJob {
@@ -1410,16 +2112,18 @@ struct PipelineImpl final : Pipeline
 
 		EndPipelineJob& end_job = m_renderer.createJob<EndPipelineJob>();
 		end_job.pipeline = this;
-		m_renderer.queue(end_job, 0);
+		queue(end_job, 0);
 		processBuckets();
 		m_renderer.waitForCommandSetup();
+		m_last_frame_occlusion_stats = m_occlusion_stats;
 
 		m_views.clear();
 
 		return true;
 	}
 
-	void renderDebugTriangles() {
+	void renderDebugShapes()
+	{
 		struct Cmd : Renderer::RenderJob
 		{
 			struct BaseVertex {
@@ -1427,130 +2131,106 @@ struct PipelineImpl final : Pipeline
 				u32 color;
 			};
 
+			Cmd(IAllocator& allocator)
+				: lines(allocator)
+				, triangles(allocator)
+				, instances(allocator)
+			{}
+
 			void setup() override {
 				PROFILE_FUNCTION();
-				const Array<DebugTriangle>& tris = pipeline->m_scene->getDebugTriangles();
-				vb.size = 0;
-				if (tris.size() == 0) return;
-
 				program = pipeline->m_debug_shape_shader->getProgram(pipeline->m_base_vertex_decl, 0);
-				vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * tris.size() * 3);
-				BaseVertex* vertices = (BaseVertex*)vb.ptr;
-				for (u32 i = 0, c = tris.size(); i < c; ++i) {
-					vertices[3 * i + 0].color = tris[i].color;
-					vertices[3 * i + 0].pos = Vec3(tris[i].p0 - viewport_pos);
-					vertices[3 * i + 1].color = tris[i].color;
-					vertices[3 * i + 1].pos = Vec3(tris[i].p1 - viewport_pos);
-					vertices[3 * i + 2].color = tris[i].color;
-					vertices[3 * i + 2].pos = Vec3(tris[i].p2 - viewport_pos);
-				}
-				pipeline->m_scene->clearDebugTriangles();
-			}
-
-
-			void execute() override {
-				PROFILE_FUNCTION();
-
-				if (vb.size == 0) return;
-
-				gpu::pushDebugGroup("debug triangles");
-
-				gpu::update(pipeline->m_drawcall_ub, &Matrix::IDENTITY.columns[0].x, sizeof(Matrix));
-
-				gpu::setState(gpu::StateFlags::DEPTH_TEST | gpu::StateFlags::DEPTH_WRITE | gpu::StateFlags::CULL_BACK);
-				gpu::useProgram(program);
-
-				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
-				gpu::bindVertexBuffer(0, vb.buffer, vb.offset, sizeof(BaseVertex));
-				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
-				gpu::drawArrays(gpu::PrimitiveType::TRIANGLES, 0, vb.size / sizeof(BaseVertex));
-				gpu::popDebugGroup();
+				
+				lines_vb.size = 0;
+				triangles_vb.size = 0;
+				if (!lines.empty()) lines_vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * lines.size() * 2);
+				if (!triangles.empty()) triangles_vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * triangles.size() * 3);
+
+				// physics and navigation can add hundreds of thousands of shapes
+				jobs::forEach(lines.size(), jobs::GrainHint{5}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+					BaseVertex* vertices = (BaseVertex*)lines_vb.ptr;
+					for (i32 i = from; i < to; ++i) {
+						vertices[2 * i + 0].color = lines[i].color;
+						vertices[2 * i + 0].pos = Vec3(lines[i].from - viewport_pos);
+						vertices[2 * i + 1].color = lines[i].color;
+						vertices[2 * i + 1].pos = Vec3(lines[i].to - viewport_pos);
+					}
+				});
+
+				jobs::forEach(triangles.size(), jobs::GrainHint{5}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+					BaseVertex* vertices = (BaseVertex*)triangles_vb.ptr;
+					for (i32 i = from; i < to; ++i) {
+						vertices[3 * i + 0].color = triangles[i].color;
+						vertices[3 * i + 0].pos = Vec3(triangles[i].p0 - viewport_pos);
+						vertices[3 * i + 1].color = triangles[i].color;
+						vertices[3 * i + 1].pos = Vec3(triangles[i].p1 - viewport_pos);
+						vertices[3 * i + 2].color = triangles[i].color;
+						vertices[3 * i + 2].pos = Vec3(triangles[i].p2 - viewport_pos);
+					}
+				});
 			}
 
-			PipelineImpl* pipeline;
-			DVec3 viewport_pos;
-			gpu::ProgramHandle program;
-			Renderer::TransientSlice vb;
-		};
-
-
-		const Array<DebugTriangle>& tris = m_scene->getDebugTriangles();
-		if (tris.empty() || !m_debug_shape_shader->isReady()) return;
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
-		cmd.pipeline = this;
-		cmd.viewport_pos = m_viewport.pos;
-		m_renderer.queue(cmd, m_profiler_link);
-	}
-
-	void renderDebugLines()	{
-		struct Cmd : Renderer::RenderJob
-		{
-			struct BaseVertex {
-				Vec3 pos;
-				u32 color;
-			};
-
-			void setup() override
-			{
-				PROFILE_FUNCTION();
-				const Array<DebugLine>& lines = pipeline->m_scene->getDebugLines();
-				vb.size = 0;
-				if (lines.size() == 0) return;
-
-				program = pipeline->m_debug_shape_shader->getProgram(pipeline->m_base_vertex_decl, 0);
-				vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * lines.size() * 2);
-				BaseVertex* vertices = (BaseVertex*)vb.ptr;
-				for (u32 i = 0, c = lines.size(); i < c; ++i) {
-					vertices[2 * i + 0].color = lines[i].color;
-					vertices[2 * i + 0].pos = Vec3(lines[i].from - viewport_pos);
-					vertices[2 * i + 1].color = lines[i].color;
-					vertices[2 * i + 1].pos = Vec3(lines[i].to - viewport_pos);
+			void draw(gpu::BufferHandle vb, u32 offset, u32 lines_count, u32 triangles_count) {
+				gpu::bindVertexBuffer(0, vb, offset, sizeof(BaseVertex));
+				if (triangles_count > 0) {
+					gpu::setState(gpu::StateFlags::DEPTH_TEST | gpu::StateFlags::DEPTH_WRITE | gpu::StateFlags::CULL_BACK);
+					gpu::useProgram(program);
+					gpu::drawArrays(gpu::PrimitiveType::TRIANGLES, lines_count * 2, triangles_count * 3);
+				}
+				if (lines_count > 0) {
+					gpu::setState(gpu::StateFlags::DEPTH_TEST | gpu::StateFlags::DEPTH_WRITE);
+					gpu::useProgram(program);
+					gpu::drawArrays(gpu::PrimitiveType::LINES, 0, lines_count * 2);
 				}
-				pipeline->m_scene->clearDebugLines();
 			}
 
-
 			void execute() override {
 				PROFILE_FUNCTION();
-				if (vb.size == 0) return;
-
-				gpu::pushDebugGroup("debug lines");
-
-				gpu::update(pipeline->m_drawcall_ub, &Matrix::IDENTITY.columns[0].x, sizeof(Matrix));
-
-				gpu::setState(gpu::StateFlags::DEPTH_TEST | gpu::StateFlags::DEPTH_WRITE);
-				gpu::useProgram(program);
 
+				gpu::pushDebugGroup("debug shapes");
 				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
-				gpu::bindVertexBuffer(0, vb.buffer, vb.offset, sizeof(BaseVertex));
 				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+				
+				pipeline->setDrawcallData(&Matrix::IDENTITY.columns[0].x, sizeof(Matrix));
+				if (triangles_vb.size > 0) draw(triangles_vb.buffer, triangles_vb.offset, 0, triangles.size());
+				if (lines_vb.size > 0) draw(lines_vb.buffer, lines_vb.offset, lines.size(), 0);
+
+				// static shapes are already on GPU, only the transform is uploaded
+				for (const DebugShapeInstance& inst : instances) {
+					Matrix mtx(Vec3(inst.transform.pos - viewport_pos), inst.transform.rot);
+					mtx.multiply3x3(inst.transform.scale);
+					pipeline->setDrawcallData(&mtx.columns[0].x, sizeof(mtx));
+					draw(inst.vertex_buffer, 0, inst.lines_count, inst.triangles_count);
+				}
 
-				gpu::drawArrays(gpu::PrimitiveType::LINES, 0, vb.size / sizeof(BaseVertex));
 				gpu::popDebugGroup();
 			}
 
 			PipelineImpl* pipeline;
 			DVec3 viewport_pos;
 			gpu::ProgramHandle program;
-			Renderer::TransientSlice vb;
+			Array<DebugLine> lines;
+			Array<DebugTriangle> triangles;
+			Array<DebugShapeInstance> instances;
+			Renderer::TransientSlice lines_vb;
+			Renderer::TransientSlice triangles_vb;
 		};
 
+		if (!m_debug_shape_shader->isReady()) {
+			m_scene->clearDebugShapes();
+			return;
+		}
 
-		const Array<DebugLine>& lines = m_scene->getDebugLines();
-		if (lines.empty() || !m_debug_shape_shader->isReady()) return;
+		Cmd& cmd = m_renderer.createJob<Cmd>(m_allocator);
+		m_scene->fetchDebugShapes(cmd.lines, cmd.triangles, cmd.instances);
+		if (cmd.lines.empty() && cmd.triangles.empty() && cmd.instances.empty()) {
+			m_renderer.destroyJob(cmd);
+			return;
+		}
 
-		Cmd& cmd = m_renderer.createJob<Cmd>();
 		cmd.pipeline = this;
 		cmd.viewport_pos = m_viewport.pos;
-		m_renderer.queue(cmd, m_profiler_link);
-	}
-
-	void renderDebugShapes()
-	{
-		renderDebugTriangles();
-		renderDebugLines();
-		//renderDebugPoints();
+		queue(cmd, m_profiler_link);
 	}
 
 	struct Draw2DJob : Renderer::RenderJob {
@@ -1581,7 +2261,7 @@ struct PipelineImpl final : Pipeline
 
 			gpu::pushDebugGroup("draw2d");
 
-			gpu::update(pipeline->m_drawcall_ub, &matrix.columns[0].x, sizeof(matrix));
+			pipeline->setDrawcallData(&matrix.columns[0].x, sizeof(matrix));
 			u32 elem_offset = 0;
 			gpu::StateFlags state = gpu::getBlendStateBits(gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA, gpu::BlendFactors::ONE, gpu::BlendFactors::ONE);
 			state = state | gpu::StateFlags::SCISSOR_TEST;
@@ -1657,16 +2337,28 @@ struct PipelineImpl final : Pipeline
 		cmd.matrix.setOrtho(0, (float)m_viewport.w, (float)m_viewport.h, 0, 0, 1, false);
 		cmd.prepare(m_draw2d);
 		m_draw2d.clear(getAtlasSize());
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
 	}
 
 	void setUniverse(Universe* universe) override {
 		RenderScene* scene = universe ? (RenderScene*)universe->getScene(crc32("renderer")) : nullptr;
 		if (m_scene == scene) return;
 		m_scene = scene;
+		m_shadow_atlas.moved_casters_cursor = 0;
+		m_shadow_atlas.invalidateAll();
+		m_shadow_slices_cursor = 0;
+		for (ShadowSlice& slice : m_shadow_slices) slice.dirty = true;
+		for (CullCache* cache : m_cull_caches) cache->invalidate();
+		for (SortKeyCache* cache : m_sort_key_caches) invalidate(*cache);
+		clearPreskinned();
 		if (m_lua_state && m_scene) callInitScene();
 	}
 
+	void clearPreskinned() {
+		for (const Preskinned& p : m_preskinned) m_renderer.destroy(p.buffer);
+		m_preskinned.clear();
+	}
+
 	RenderScene* getScene() const override { return m_scene; }
 
 	CustomCommandHandler& addCustomCommandHandler(const char* name) override 
@@ -1729,8 +2421,13 @@ struct PipelineImpl final : Pipeline
 		const i32 rb = toRenderbufferIdx(L, 1);
 
 		if (rb >= 0 && rb < m_renderbuffers.size()) {
-			m_renderbuffers[rb].frame_counter = 2;
-			m_renderbuffers[rb].persistent = false;
+			Renderbuffer& buffer = m_renderbuffers[rb];
+			if (!buffer.handle) return;
+			flushCommands();
+			if (buffer.persistent) m_renderer.destroy(buffer.handle);
+			else m_renderer.releaseRenderTarget(buffer.handle);
+			buffer.handle = gpu::INVALID_TEXTURE;
+			buffer.persistent = false;
 		}
 	}
 
@@ -1760,49 +2457,31 @@ struct PipelineImpl final : Pipeline
 
 		const gpu::TextureFormat format = getFormat(format_str);
 
-		for (int i = 0, n = m_renderbuffers.size(); i < n; ++i)
-		{
-			Renderbuffer& rb = m_renderbuffers[i];
-			if (!rb.handle) {
-				rb.handle = m_renderer.createTexture(rb_w, rb_h, 1, format, flags, Renderer::MemRef(), debug_name);
-				rb.width = rb_w;
-				rb.height = rb_h;
-				rb.format = format;
-			}
-			else {
-				if (rb.frame_counter < 2) continue;
-				if (rb.persistent) continue;
-				if (rb.width != rb_w) continue;
-				if (rb.height != rb_h) continue;
-				if (rb.format != format) continue;
+		i32 idx = -1;
+		for (i32 i = 0, n = m_renderbuffers.size(); i < n; ++i) {
+			if (!m_renderbuffers[i].handle) {
+				idx = i;
+				break;
 			}
-
-			rb.frame_counter = 0;
-			rb.persistent = persistent;
-			PipelineTexture res;
-			res.type = PipelineTexture::RENDERBUFFER;
-			res.renderbuffer = i;
-			return res;
+		}
+		if (idx < 0) {
+			idx = m_renderbuffers.size();
+			m_renderbuffers.emplace();
 		}
 
-		Renderbuffer& rb = [&]() -> Renderbuffer& {
-			for (int i = 0, n = m_renderbuffers.size(); i < n; ++i) {
-				if (!m_renderbuffers[i].handle) {
-					return m_renderbuffers[i];
-				}
-			}	
-			return m_renderbuffers.emplace();
-		}();
-		rb.frame_counter = 0;
+		Renderbuffer& rb = m_renderbuffers[idx];
 		rb.width = rb_w;
 		rb.height = rb_h;
 		rb.format = format;
+		rb.flags = flags;
 		rb.persistent = persistent;
-		rb.handle = m_renderer.createTexture(rb_w, rb_h, 1, format, flags, Renderer::MemRef(), debug_name);
+		rb.handle = persistent
+			? m_renderer.createTexture(rb_w, rb_h, 1, format, flags, Renderer::MemRef(), debug_name)
+			: m_renderer.acquireRenderTarget(rb_w, rb_h, format, flags, debug_name);
 
 		PipelineTexture res;
 		res.type = PipelineTexture::RENDERBUFFER;
-		res.renderbuffer = m_renderbuffers.size() - 1;
+		res.renderbuffer = idx;
 		return res;
 	}
 
@@ -1814,13 +2493,25 @@ struct PipelineImpl final : Pipeline
 
 		const char* define = "";
 		LuaWrapper::getOptionalField<const char*>(L, 2, "define", &define);
+		bool quadtree = false;
+		LuaWrapper::getOptionalField(L, 2, "quadtree", &quadtree);
+		bool virtual_texture = false;
+		LuaWrapper::getOptionalField(L, 2, "virtual_texture", &virtual_texture);
 
 		cmd.m_define_mask = define[0] ? 1 << m_renderer.getShaderDefineIdx(define) : 0;
+		if (quadtree && m_terrain_quadtree_shader->isReady()) {
+			cmd.m_quadtree_program = m_terrain_quadtree_shader->getProgram(gpu::VertexDecl(), 0);
+			cmd.m_define_mask |= 1 << m_renderer.getShaderDefineIdx("TERRAIN_QUADTREE");
+		}
+		if (virtual_texture && m_terrain_vt_shader->isReady()) {
+			cmd.m_vt_program = m_terrain_vt_shader->getProgram(gpu::VertexDecl(), 0);
+			cmd.m_vt_define_mask = 1 << m_renderer.getShaderDefineIdx("TERRAIN_VT");
+		}
 		cmd.m_render_state = state.value;
 		cmd.m_pipeline = this;
 		cmd.m_camera_params = cp;
 
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
 	}
 	
 	void renderGrass(lua_State* L, CameraParams cp, LuaWrapper::Optional<RenderState> state)
@@ -1842,7 +2533,25 @@ struct PipelineImpl final : Pipeline
 		cmd.m_camera_params = cp;
 		cmd.m_compute_shader = m_place_grass_shader->getProgram(gpu::VertexDecl(), 0);
 
-		m_renderer.queue(cmd, m_profiler_link);
+		// grass of the main view is culled against the occlusion buffer rasterized for it
+		for (const View& view : m_views) {
+			if (cp.is_shadow) break;
+			if (!view.occlusion || view.cp.is_shadow) continue;
+			if (memcmp(&view.cp.pos, &cp.pos, sizeof(cp.pos)) != 0) continue;
+			if (memcmp(&view.cp.view, &cp.view, sizeof(cp.view)) != 0) continue;
+			if (memcmp(&view.cp.projection, &cp.projection, sizeof(cp.projection)) != 0) continue;
+
+			const Span<const float> depth = view.occlusion->getTileDepth();
+			if (depth.length() == 0) break;
+			cmd.m_occlusion_depth.resize(depth.length());
+			memcpy(cmd.m_occlusion_depth.begin(), depth.begin(), depth.length() * sizeof(float));
+			Matrix translation = Matrix::IDENTITY;
+			translation.setTranslation(Vec3(cp.pos - view.occlusion->getCameraPos()));
+			cmd.m_occlusion_view_projection = view.occlusion->getViewProjection() * translation;
+			break;
+		}
+
+		queue(cmd, m_profiler_link);
 	}
 
 	void renderParticles(CameraParams cp)
@@ -1850,17 +2559,26 @@ struct PipelineImpl final : Pipeline
 		PROFILE_FUNCTION();
 		struct Cmd : Renderer::RenderJob
 		{
+			struct Drawcall;
+
 			Cmd(IAllocator& allocator) : m_drawcalls(allocator) {}
 
 			void setup() override
 			{
 				PROFILE_FUNCTION();
-				const auto& emitters = m_pipeline->m_scene->getParticleEmitters();
-				if (emitters.size() == 0) return;
+				RenderScene* scene = m_pipeline->m_scene;
+				if (scene->getParticleEmitters().size() == 0) return;
 				
-				Universe& universe = m_pipeline->m_scene->getUniverse();
+				CullResult* visible = scene->getParticleEmitters(m_camera_params.frustum);
+				if (!visible) return;
 
-				m_drawcalls.reserve(emitters.size());
+				Universe& universe = scene->getUniverse();
+
+				Shader* sort_shader = m_pipeline->m_sort_particles_shader;
+				if (sort_shader->isReady()) {
+					m_sort_program = sort_shader->getProgram(gpu::VertexDecl(), 0);
+					m_sort_local_program = sort_shader->getProgram(gpu::VertexDecl(), 1 << m_pipeline->m_renderer.getShaderDefineIdx("SORT_LOCAL"));
+				}
 
 				gpu::VertexDecl decl;
 				decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);	// pos
@@ -1869,17 +2587,21 @@ struct PipelineImpl final : Pipeline
 				decl.addAttribute(3, 32, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);  // rot
 				decl.addAttribute(4, 36, 1, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);  // frame
 
-				for (const ParticleEmitter& emitter : emitters) {
-					if (!emitter.getResource() || !emitter.getResource()->isReady()) continue;
+				visible->forEach([&](EntityRef entity){
+					const ParticleEmitter& emitter = scene->getParticleEmitter(entity);
+					if (!emitter.getResource() || !emitter.getResource()->isReady()) return;
 					
-					const int size = emitter.getParticlesDataSizeBytes();
-					if (size == 0) continue;
+					// simulated on gpu, instance count is read by indirect draw call
+					const ParticleEmitter::GPUData& gpu_data = emitter.getGPUData();
+					const bool is_gpu = emitter.m_gpu && gpu_data.instances;
+					const int size = is_gpu ? 0 : emitter.getParticlesDataSizeBytes();
+					if (size == 0 && !is_gpu) return;
 
-					const Transform tr = universe.getTransform((EntityRef)emitter.m_entity);
+					const Transform tr = universe.getTransform(entity);
 					const Vec3 lpos = Vec3(tr.pos - m_camera_params.pos);
 
 					const Material* material = emitter.getResource()->getMaterial();
-					if (!material) continue;
+					if (!material) return;
 
 					Drawcall& dc = m_drawcalls.emplace();
 					dc.pos = lpos;
@@ -1887,9 +2609,68 @@ struct PipelineImpl final : Pipeline
 					dc.program = material->getShader()->getProgram(decl, 0);
 					dc.material = material->getRenderData();
 					dc.size = size;
+					if (is_gpu) {
+						dc.particles_count = 0;
+						dc.slice = {};
+						dc.slice.buffer = gpu_data.instances;
+						dc.indirect = gpu_data.particles[gpu_data.current];
+						dc.sort_keys = emitter.m_sort ? gpu_data.sort_keys : gpu::INVALID_BUFFER;
+						dc.sorted_instances = gpu_data.sorted_instances;
+						dc.sort_capacity = gpu_data.sort_capacity;
+						dc.stride = emitter.getResource()->getOutputsCount();
+						return;
+					}
+					dc.indirect = gpu::INVALID_BUFFER;
+					dc.sort_keys = gpu::INVALID_BUFFER;
 					dc.particles_count = emitter.getParticlesCount();
 					dc.slice = m_pipeline->m_renderer.allocTransient(emitter.getParticlesDataSizeBytes());
 					emitter.fillInstanceData((float*)dc.slice.ptr);
+				});
+				visible->free(m_pipeline->m_renderer.getEngine().getPageAllocator());
+			}
+
+			// bitonic sort of particles by distance from camera, result is gathered to dc.sorted_instances
+			void sort(const Drawcall& dc, const Matrix& mtx) {
+				struct {
+					Matrix model;
+					u32 pass;
+					u32 size;
+					u32 stride;
+					u32 k;
+					u32 j;
+				} data = { mtx, 0, dc.sort_capacity, dc.stride, 0, 0 };
+
+				gpu::bindShaderBuffer(dc.slice.buffer, 0, gpu::BindShaderBufferFlags::NONE);
+				gpu::bindShaderBuffer(dc.indirect, 1, gpu::BindShaderBufferFlags::NONE);
+				gpu::bindShaderBuffer(dc.sort_keys, 2, gpu::BindShaderBufferFlags::OUTPUT);
+				gpu::bindShaderBuffer(dc.sorted_instances, 3, gpu::BindShaderBufferFlags::OUTPUT);
+				auto dispatch = [&](gpu::ProgramHandle program, u32 groups){
+					m_pipeline->setDrawcallData(&data, sizeof(data));
+					gpu::useProgram(program);
+					gpu::dispatch(groups, 1, 1);
+					gpu::memoryBarrier();
+				};
+
+				// keys
+				dispatch(m_sort_program, dc.sort_capacity / 64);
+				// 512 keys blocks, local_size_x = 256 and each invocation handles a pair
+				dispatch(m_sort_local_program, dc.sort_capacity / 512);
+				for (u32 k = 1024; k <= dc.sort_capacity; k <<= 1) {
+					data.pass = 1;
+					data.k = k;
+					for (u32 j = k >> 1; j >= 512; j >>= 1) {
+						data.j = j;
+						dispatch(m_sort_program, dc.sort_capacity / 2 / 64);
+					}
+					data.j = 256;
+					dispatch(m_sort_local_program, dc.sort_capacity / 512);
+				}
+				// gather
+				data.pass = 2;
+				dispatch(m_sort_program, dc.sort_capacity / 64);
+
+				for (u32 i = 0; i < 4; ++i) {
+					gpu::bindShaderBuffer(gpu::INVALID_BUFFER, i, gpu::BindShaderBufferFlags::NONE);
 				}
 			}
 
@@ -1899,6 +2680,14 @@ struct PipelineImpl final : Pipeline
 				
 				gpu::pushDebugGroup("particles");
 				
+				const bool can_sort = m_sort_program && m_sort_local_program;
+				for (const Drawcall& dc : m_drawcalls) {
+					if (!dc.sort_keys || !can_sort) continue;
+					Matrix mtx = dc.rot.toMatrix();
+					mtx.setTranslation(dc.pos);
+					sort(dc, mtx);
+				}
+
 				const gpu::StateFlags blend_state = gpu::getBlendStateBits(gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA, gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA);
 				gpu::setState(blend_state | gpu::StateFlags::DEPTH_TEST);
 				const gpu::BufferHandle material_ub = m_pipeline->m_renderer.getMaterialUniformBuffer();
@@ -1912,13 +2701,21 @@ struct PipelineImpl final : Pipeline
 						material_ub_idx = dc.material->material_constants;
 					}
 
-					gpu::bindTextures(dc.material->textures, 0, dc.material->textures_count);
-					gpu::update(m_pipeline->m_drawcall_ub, &mtx.columns[0].x, sizeof(mtx));
+					if (!dc.material->bindless) gpu::bindTextures(dc.material->textures, 0, dc.material->textures_count);
+					m_pipeline->setDrawcallData(&mtx.columns[0].x, sizeof(mtx));
 					gpu::useProgram(dc.program);
 					gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
 					gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
-					gpu::bindVertexBuffer(1, dc.slice.buffer, dc.slice.offset, 40);
-					gpu::drawArraysInstanced(gpu::PrimitiveType::TRIANGLE_STRIP, 4, dc.particles_count);
+					const bool sorted = dc.sort_keys && can_sort;
+					gpu::bindVertexBuffer(1, sorted ? dc.sorted_instances : dc.slice.buffer, dc.slice.offset, 40);
+					if (dc.indirect) {
+						gpu::bindIndirectBuffer(dc.indirect);
+						gpu::drawArraysIndirect(gpu::PrimitiveType::TRIANGLE_STRIP);
+						gpu::bindIndirectBuffer(gpu::INVALID_BUFFER);
+					}
+					else {
+						gpu::drawArraysInstanced(gpu::PrimitiveType::TRIANGLE_STRIP, 4, dc.particles_count);
+					}
 				}
 				gpu::popDebugGroup();
 			}
@@ -1931,9 +2728,16 @@ struct PipelineImpl final : Pipeline
 				int size;
 				int particles_count;
 				Renderer::TransientSlice slice; 
+				gpu::BufferHandle indirect;
+				gpu::BufferHandle sort_keys;
+				gpu::BufferHandle sorted_instances;
+				u32 sort_capacity;
+				u32 stride;
 			};
 
 			Array<Drawcall> m_drawcalls; 
+			gpu::ProgramHandle m_sort_program = gpu::INVALID_PROGRAM;
+			gpu::ProgramHandle m_sort_local_program = gpu::INVALID_PROGRAM;
 			PipelineImpl* m_pipeline;
 			CameraParams m_camera_params;
 		};
@@ -1942,7 +2746,7 @@ struct PipelineImpl final : Pipeline
 		cmd.m_pipeline = this;
 		cmd.m_camera_params = cp;
 
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
 	}
 
 	static CameraParams checkCameraParams(lua_State* L, int idx)
@@ -2027,42 +2831,199 @@ struct PipelineImpl final : Pipeline
 		return cp;
 	}
 	
-	void bindShaderBuffer(LuaBufferHandle buffer_handle, u32 binding_point, bool writable) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::bindShaderBuffer(buffer, binding_point, writable ? gpu::BindShaderBufferFlags::OUTPUT : gpu::BindShaderBufferFlags::NONE);
-			}
+	// state commands from the script (render targets, clears, bindings, dispatches, ...) are recorded to a plain stream
+	// and replayed by a single job, instead of a job with virtual calls per command
+	struct CommandsJob : Renderer::RenderJob {
+		enum class Type : u8 {
+			SET_FRAMEBUFFER,
+			VIEWPORT,
+			CLEAR,
+			BIND_TEXTURES,
+			BIND_IMAGE_TEXTURE,
+			BIND_SHADER_BUFFER,
+			BIND_UNIFORM_BUFFER,
+			DISPATCH,
+			PASS_STATE,
+			BEGIN_BLOCK,
+			END_BLOCK,
+			MEMORY_BARRIER
+		};
+
+		struct SetFramebuffer {
+			gpu::TextureHandle rbs[8];
+			gpu::TextureHandle ds;
+			gpu::FramebufferFlags flags;
+			u32 count;
+			u32 w;
+			u32 h;
+		};
+
+		struct Viewport { i32 x, y, w, h; };
+
+		struct Clear {
+			Vec4 color;
+			float depth;
+			gpu::ClearFlags flags;
+		};
+
+		// followed by `count` texture handles
+		struct BindTextures {
+			u32 offset;
+			u32 count;
+		};
+
+		struct BindImageTexture {
+			gpu::TextureHandle texture;
+			u32 unit;
+		};
+
+		struct BindBuffer {
+			gpu::BufferHandle buffer;
 			u32 binding_point;
+			u32 size;
 			bool writable;
-			gpu::BufferHandle buffer;
 		};
-		
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+
+		struct Dispatch {
+			gpu::ProgramHandle program;
+			u32 num_groups_x;
+			u32 num_groups_y;
+			u32 num_groups_z;
+		};
+
+		struct BeginBlock {
+			StaticString<32> name;
+			i64 link;
+		};
+
+		CommandsJob(IAllocator& allocator) : commands(allocator) {}
+
+		void setup() override {}
+
+		void execute() override {
+			PROFILE_FUNCTION();
+			InputMemoryStream blob(commands);
+			while (blob.getPosition() < blob.size()) {
+				switch (blob.read<Type>()) {
+					case Type::SET_FRAMEBUFFER: {
+						SetFramebuffer cmd = blob.read<SetFramebuffer>();
+						gpu::setFramebuffer(cmd.rbs, cmd.count, cmd.ds, cmd.flags);
+						gpu::viewport(0, 0, cmd.w, cmd.h);
+						break;
+					}
+					case Type::VIEWPORT: {
+						const Viewport& cmd = blob.read<Viewport>();
+						gpu::viewport(cmd.x, cmd.y, cmd.w, cmd.h);
+						break;
+					}
+					case Type::CLEAR: {
+						const Clear& cmd = blob.read<Clear>();
+						gpu::clear(cmd.flags, &cmd.color.x, cmd.depth);
+						break;
+					}
+					case Type::BIND_TEXTURES: {
+						const BindTextures& cmd = blob.read<BindTextures>();
+						const gpu::TextureHandle* handles = (const gpu::TextureHandle*)blob.skip(sizeof(gpu::TextureHandle) * cmd.count);
+						gpu::bindTextures(handles, cmd.offset, cmd.count);
+						break;
+					}
+					case Type::BIND_IMAGE_TEXTURE: {
+						const BindImageTexture& cmd = blob.read<BindImageTexture>();
+						gpu::bindImageTexture(cmd.texture, cmd.unit);
+						break;
+					}
+					case Type::BIND_SHADER_BUFFER: {
+						const BindBuffer& cmd = blob.read<BindBuffer>();
+						gpu::bindShaderBuffer(cmd.buffer, cmd.binding_point, cmd.writable ? gpu::BindShaderBufferFlags::OUTPUT : gpu::BindShaderBufferFlags::NONE);
+						break;
+					}
+					case Type::BIND_UNIFORM_BUFFER: {
+						const BindBuffer& cmd = blob.read<BindBuffer>();
+						gpu::bindUniformBuffer(cmd.binding_point, cmd.buffer, 0, cmd.size);
+						break;
+					}
+					case Type::DISPATCH: {
+						const Dispatch& cmd = blob.read<Dispatch>();
+						gpu::useProgram(cmd.program);
+						gpu::dispatch(cmd.num_groups_x, cmd.num_groups_y, cmd.num_groups_z);
+						break;
+					}
+					case Type::PASS_STATE: {
+						const PassState& pass_state = blob.read<PassState>();
+						gpu::update(pass_state_buffer, &pass_state, sizeof(pass_state));
+						gpu::bindUniformBuffer(UniformBuffer::PASS, pass_state_buffer, 0, sizeof(PassState));
+						break;
+					}
+					case Type::BEGIN_BLOCK: {
+						const BeginBlock& cmd = blob.read<BeginBlock>();
+						gpu::pushDebugGroup(cmd.name);
+						renderer->beginProfileBlock(cmd.name, cmd.link);
+						break;
+					}
+					case Type::END_BLOCK:
+						renderer->endProfileBlock();
+						gpu::popDebugGroup();
+						break;
+					case Type::MEMORY_BARRIER:
+						gpu::memoryBarrier();
+						break;
+				}
+			}
+		}
+
+		Renderer* renderer;
+		gpu::BufferHandle pass_state_buffer;
+		OutputMemoryStream commands;
+	};
+
+	OutputMemoryStream& recordCommand(CommandsJob::Type type) {
+		if (!m_commands_job) {
+			m_commands_job = &m_renderer.createJob<CommandsJob>(m_allocator);
+			m_commands_job->renderer = &m_renderer;
+			m_commands_job->pass_state_buffer = m_pass_state_buffer;
+		}
+		// results of dispatches are visible to everything recorded after them
+		if (m_barrier_pending) {
+			m_barrier_pending = false;
+			m_commands_job->commands.write(CommandsJob::Type::MEMORY_BARRIER);
+		}
+		m_commands_job->commands.write(type);
+		return m_commands_job->commands;
+	}
+
+	// must be called before any other job is queued, so commands keep the order in which the script issued them
+	void flushCommands() {
+		if (m_barrier_pending) {
+			m_barrier_pending = false;
+			recordCommand(CommandsJob::Type::MEMORY_BARRIER);
+		}
+		if (!m_commands_job) return;
+		m_renderer.queue(*m_commands_job, m_profiler_link);
+		m_commands_job = nullptr;
+	}
+
+	void queue(Renderer::RenderJob& job, i64 profiler_link) {
+		flushCommands();
+		m_renderer.queue(job, profiler_link);
+	}
+
+	void bindShaderBuffer(LuaBufferHandle buffer_handle, u32 binding_point, bool writable) {
+		CommandsJob::BindBuffer cmd;
 		cmd.binding_point = binding_point;
 		cmd.buffer = buffer_handle;
 		cmd.writable = writable;
-		m_renderer.queue(cmd, m_profiler_link);
+		cmd.size = 0;
+		recordCommand(CommandsJob::Type::BIND_SHADER_BUFFER).write(cmd);
+		m_compute_writes_bound = m_compute_writes_bound || writable;
 	}
 	
 	void bindUniformBuffer(LuaBufferHandle buffer_handle, u32 binding_point, u32 size) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::bindUniformBuffer(binding_point, buffer, 0, size);
-			}
-			u32 binding_point;
-			u32 size;
-			gpu::BufferHandle buffer;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		CommandsJob::BindBuffer cmd;
 		cmd.binding_point = binding_point;
 		cmd.buffer = (gpu::BufferHandle)(uintptr)buffer_handle;
 		cmd.size = size;
-		m_renderer.queue(cmd, m_profiler_link);
+		cmd.writable = false;
+		recordCommand(CommandsJob::Type::BIND_UNIFORM_BUFFER).write(cmd);
 	}
 
 	LuaBufferHandle createBuffer(u32 size) {
@@ -2150,17 +3111,16 @@ struct PipelineImpl final : Pipeline
 			void setup() override {}
 			void execute() override {
 				PROFILE_FUNCTION();
-				gpu::update(drawcall_ub, values, sizeof(values));
-				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, drawcall_ub, 0, sizeof(values));
+				pipeline->setDrawcallData(values, sizeof(values));
 			}
 			float values[32];
-			gpu::BufferHandle drawcall_ub;
+			PipelineImpl* pipeline;
 		};
 
 		Cmd& cmd = pipeline->m_renderer.createJob<Cmd>();
 		memcpy(cmd.values, values, sizeof(values));
-		cmd.drawcall_ub = pipeline->m_drawcall_ub;
-		pipeline->m_renderer.queue(cmd, pipeline->m_profiler_link);
+		cmd.pipeline = pipeline;
+		pipeline->queue(cmd, pipeline->m_profiler_link);
 
 		return 0;
 	}
@@ -2182,25 +3142,14 @@ struct PipelineImpl final : Pipeline
 		gpu::ProgramHandle program = shader->getProgram(gpu::VertexDecl(), defines);
 		if (!program) return;
 
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::useProgram(program);
-				gpu::dispatch(num_groups_x, num_groups_y, num_groups_z);
-			}
-			gpu::ProgramHandle program;
-			u32 num_groups_x;
-			u32 num_groups_y;
-			u32 num_groups_z;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		CommandsJob::Dispatch cmd;
 		cmd.num_groups_x = num_groups_x;
 		cmd.num_groups_y = num_groups_y;
 		cmd.num_groups_z = num_groups_z;
 		cmd.program = program;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::DISPATCH).write(cmd);
+		// bindings stay, so any dispatch after a writable binding can write
+		if (m_compute_writes_bound) m_barrier_pending = true;
 	}
 
 	gpu::TextureHandle toHandle(PipelineTexture tex) const {
@@ -2222,83 +3171,47 @@ struct PipelineImpl final : Pipeline
 	}
 
 	void bindImageTexture(PipelineTexture texture, u32 unit) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::bindImageTexture(texture, unit);
-			}
-			gpu::TextureHandle texture;
-			u32 unit;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		CommandsJob::BindImageTexture cmd;
 		cmd.texture = toHandle(texture);
 		cmd.unit = unit;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::BIND_IMAGE_TEXTURE).write(cmd);
+		m_compute_writes_bound = true;
 	}
 
 	void bindTextures(lua_State* L, LuaWrapper::Array<PipelineTexture, 16> textures, LuaWrapper::Optional<u32> offset) 	{
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override
-			{
-				PROFILE_FUNCTION();
-				gpu::bindTextures(m_textures_handles, m_offset, m_textures_count);
-			}
-
-			gpu::TextureHandle m_textures_handles[16];
-			int m_offset = 0;
-			u32 m_textures_count = 0;
-		};
-		
-		Cmd& cmd = m_renderer.createJob<Cmd>();
-		cmd.m_offset = offset.get(0);
-		
-		if (textures.size > lengthOf(cmd.m_textures_handles)) {
+		if (textures.size > 16) {
 			luaL_argerror(L, 1, "too many textures");
 			return;
 		}
 
+		CommandsJob::BindTextures cmd;
+		cmd.offset = offset.get(0);
+		cmd.count = textures.size;
+		OutputMemoryStream& commands = recordCommand(CommandsJob::Type::BIND_TEXTURES);
+		commands.write(cmd);
 		for (u32 i = 0; i < textures.size; ++i) {
-			cmd.m_textures_handles[cmd.m_textures_count] = toHandle(textures[i]);
-			++cmd.m_textures_count;
+			commands.write(toHandle(textures[i]));
 		}
-
-		m_renderer.queue(cmd, m_profiler_link);
 	};
 	
 	void pass(CameraParams cp)
 	{
 		PROFILE_FUNCTION();
-		struct PushPassStateCmd : Renderer::RenderJob {
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::update(pass_state_buffer, &pass_state, sizeof(pass_state));
-				gpu::bindUniformBuffer(UniformBuffer::PASS, pass_state_buffer, 0, sizeof(PassState));
-			}
-			void setup() override {}
-
-			gpu::BufferHandle pass_state_buffer;
-			PassState pass_state;
-		};
-
-		PushPassStateCmd& cmd = m_renderer.createJob<PushPassStateCmd>();
-		cmd.pass_state.view = cp.view;
-		cmd.pass_state.projection = cp.projection;
-		cmd.pass_state.inv_projection = cp.projection.inverted();
-		cmd.pass_state.inv_view = cp.view.fastInverted();
-		cmd.pass_state.view_projection = cp.projection * cp.view;
-		cmd.pass_state.inv_view_projection = cmd.pass_state.view_projection.inverted();
-		cmd.pass_state.view_dir = Vec4(cp.view.inverted().transformVector(Vec3(0, 0, -1)), 0);
-		cmd.pass_state.camera_up = Vec4(cp.view.inverted().transformVector(Vec3(0, 1, 0)), 0);
-		toPlanes(cp, Span(cmd.pass_state.camera_planes));
+		PassState pass_state;
+		pass_state.view = cp.view;
+		pass_state.projection = cp.projection;
+		pass_state.inv_projection = cp.projection.inverted();
+		pass_state.inv_view = cp.view.fastInverted();
+		pass_state.view_projection = cp.projection * cp.view;
+		pass_state.inv_view_projection = pass_state.view_projection.inverted();
+		pass_state.view_dir = Vec4(cp.view.inverted().transformVector(Vec3(0, 0, -1)), 0);
+		pass_state.camera_up = Vec4(cp.view.inverted().transformVector(Vec3(0, 1, 0)), 0);
+		toPlanes(cp, Span(pass_state.camera_planes));
 		if (cp.is_shadow) {
-			cmd.pass_state.shadow_to_camera = Vec4(Vec3(m_viewport.pos - cp.pos), 1);
+			pass_state.shadow_to_camera = Vec4(Vec3(m_viewport.pos - cp.pos), 1);
 		}
 		
-		cmd.pass_state_buffer = m_pass_state_buffer;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::PASS_STATE).write(pass_state);
 	}
 
 	static void toPlanes(const CameraParams& cp, Span<Vec4> planes) {
@@ -2324,7 +3237,7 @@ struct PipelineImpl final : Pipeline
 				gpu::bindTextures(m_textures_handles, 0, m_textures_count);
 
 				if (m_uniforms_count > 0) {
-					gpu::update(m_pipeline->m_drawcall_ub, m_uniforms, sizeof(m_uniforms[0]) * m_uniforms_count);
+					m_pipeline->setDrawcallData(m_uniforms, sizeof(m_uniforms[0]) * m_uniforms_count);
 				}
 
 				gpu::useProgram(m_program);
@@ -2414,7 +3327,7 @@ struct PipelineImpl final : Pipeline
 		cmd.m_shader = shader;
 		cmd.m_indices_count = indices_count;
 		cmd.m_indices_offset = indices_offset;
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
 	}
 
 	CameraParams getCameraParams()
@@ -2570,7 +3483,7 @@ struct PipelineImpl final : Pipeline
 		job.m_pipeline = this;
 		job.m_cmds = cmds;
 		job.m_program = shader->getProgram(m_point_light_decl, define_mask);
-		m_renderer.queue(job, m_profiler_link);
+		queue(job, m_profiler_link);
 	}
 
 	static gpu::StateFlags getState(lua_State* L, int idx)
@@ -2629,13 +3542,14 @@ struct PipelineImpl final : Pipeline
 			, m_point_lights(allocator)
 			, m_env_probes(allocator)
 			, m_refl_probes(allocator)
+			, m_decals(allocator)
 		{}
 
 		void setup() override {
 			PROFILE_FUNCTION();
 			const IVec3 size = {
-				(m_pipeline->m_viewport.w + 63) / 64,
-				(m_pipeline->m_viewport.h + 63) / 64,
+				(m_pipeline->m_scene_size.x + 63) / 64,
+				(m_pipeline->m_scene_size.y + 63) / 64,
 				16 };
 			Array<ClusterPointLight>& point_lights = m_point_lights;
 			Array<ClusterEnvProbe>& env_probes = m_env_probes;
@@ -2647,6 +3561,7 @@ struct PipelineImpl final : Pipeline
 				cluster.point_lights_count = 0;
 				cluster.env_probes_count = 0;
 				cluster.refl_probes_count = 0;
+				cluster.decals_count = 0;
 			}
 
 			if (m_is_clear) return;
@@ -2655,9 +3570,9 @@ struct PipelineImpl final : Pipeline
 			const DVec3 cam_pos = m_camera_params.pos;
 			Universe& universe = scene->getUniverse();
 			const ShiftedFrustum& frustum = m_camera_params.frustum;
-			Vec4 xplanes[65];
-			Vec4 yplanes[65];
-			Vec4 zplanes[17];
+			Vec4* xplanes = m_compute_data.xplanes;
+			Vec4* yplanes = m_compute_data.yplanes;
+			Vec4* zplanes = m_compute_data.zplanes;
 
 			const Vec3 cam_dir = normalize(cross(frustum.points[2] - frustum.points[0], frustum.points[1] - frustum.points[0]));
 			
@@ -2691,8 +3606,12 @@ struct PipelineImpl final : Pipeline
 				xplanes[i] = makePlane(n, a);
 			}
 
-			ASSERT(lengthOf(xplanes) >= (u32)size.x);
-			ASSERT(lengthOf(yplanes) >= (u32)size.y);
+			ASSERT(lengthOf(m_compute_data.xplanes) > (u32)size.x);
+			ASSERT(lengthOf(m_compute_data.yplanes) > (u32)size.y);
+			m_compute_data.size.x = size.x;
+			m_compute_data.size.y = size.y;
+			m_compute_data.size.z = size.z;
+			m_compute_data.size.w = point_lights.size();
 
 			const Span<const ReflectionProbe> scene_refl_probes = scene->getReflectionProbes();
 			const Span<EntityRef> refl_probe_entities = scene->getReflectionProbesEntities();
@@ -2830,9 +3749,33 @@ struct PipelineImpl final : Pipeline
 				}
 			};
 
-			for_each_light_pair([](Cluster& cluster, i32 light_idx){
-				++cluster.point_lights_count;
-			});
+			auto for_each_decal_pair = [&](auto f){
+				for (i32 i = 0, c = m_decals.size(); i < c; ++i) {
+					const Vec3 p = m_decals[i].pos;
+					const float r = length(m_decals[i].half_extents);
+				
+					const IVec2 xrange = range(p, r, size.x, xplanes);
+					const IVec2 yrange = range(p, r, size.y, yplanes);
+					const IVec2 zrange = range(p, r, size.z, zplanes);
+
+					for (i32 z = zrange.x; z < zrange.y; ++z) {
+						for (i32 y = yrange.x; y < yrange.y; ++y) {
+							for (i32 x = xrange.x; x < xrange.y; ++x) {
+								const u32 idx = x + y * size.x + z * size.x * size.y;
+								Cluster& cluster = clusters[idx];
+								f(cluster, i);
+							}
+						}
+					}
+				}
+			};
+
+			// point lights are assigned in fill_clusters compute shader, map contains only probes and decals
+			if (!m_use_compute) {
+				for_each_light_pair([](Cluster& cluster, i32 light_idx){
+					++cluster.point_lights_count;
+				});
+			}
 
 			for_each_env_probe_pair([](Cluster& cluster, i32){
 				++cluster.env_probes_count;
@@ -2842,18 +3785,24 @@ struct PipelineImpl final : Pipeline
 				++cluster.refl_probes_count;
 			});
 
+			for_each_decal_pair([](Cluster& cluster, i32){
+				++cluster.decals_count;
+			});
+
 			u32 offset = 0;
 			for (Cluster& cluster : clusters) {
 				cluster.offset = offset;
-				offset += cluster.point_lights_count + cluster.env_probes_count + cluster.refl_probes_count;
+				offset += cluster.point_lights_count + cluster.env_probes_count + cluster.refl_probes_count + cluster.decals_count;
 			}
 			
 			map.resize(offset);
 			
-			for_each_light_pair([&](Cluster& cluster, i32 light_idx){
-				map[cluster.offset] = light_idx;
-				++cluster.offset;
-			});
+			if (!m_use_compute) {
+				for_each_light_pair([&](Cluster& cluster, i32 light_idx){
+					map[cluster.offset] = light_idx;
+					++cluster.offset;
+				});
+			}
 
 			for_each_env_probe_pair([&](Cluster& cluster, i32 probe_idx){
 				map[cluster.offset] = probe_idx;
@@ -2865,8 +3814,13 @@ struct PipelineImpl final : Pipeline
 				++cluster.offset;
 			});
 
+			for_each_decal_pair([&](Cluster& cluster, i32 decal_idx){
+				map[cluster.offset] = decal_idx;
+				++cluster.offset;
+			});
+
 			for (Cluster& cluster : clusters) {
-				cluster.offset -= cluster.point_lights_count + cluster.env_probes_count + cluster.refl_probes_count;
+				cluster.offset -= cluster.point_lights_count + cluster.env_probes_count + cluster.refl_probes_count + cluster.decals_count;
 			}
 		}
 
@@ -2876,33 +3830,80 @@ struct PipelineImpl final : Pipeline
 			gpu::update(m_pipeline->m_shadow_atlas.uniform_buffer, m_shadow_atlas_matrices, sizeof(m_shadow_atlas_matrices));
 			gpu::bindUniformBuffer(UniformBuffer::SHADOW, m_pipeline->m_shadow_atlas.uniform_buffer, 0, sizeof(m_shadow_atlas_matrices));
 
-			auto bind = [](auto& buffer, const auto& data, i32 idx){
-				const u32 capacity = (data.byte_size() + 15) & ~15;
+			if (m_program) m_pipeline->m_compute_clusters_ready = gpu::isProgramReady(m_program);
+
+			auto reserve = [](auto& buffer, u32 size){
+				const u32 capacity = (size + 15) & ~15;
 				if (buffer.capacity < capacity) {
 					if (buffer.buffer) gpu::destroy(buffer.buffer);
 					buffer.buffer = gpu::allocBufferHandle();
 					gpu::createBuffer(buffer.buffer, gpu::BufferFlags::SHADER_BUFFER, capacity, nullptr);
 					buffer.capacity = capacity;
 				}
+			};
+
+			auto bind = [&](auto& buffer, const auto& data, i32 idx){
+				reserve(buffer, data.byte_size());
 				if (!data.empty()) {
 					gpu::update(buffer.buffer, data.begin(), data.byte_size());
 					gpu::bindShaderBuffer(buffer.buffer, idx, gpu::BindShaderBufferFlags::NONE);
 				}
 			};
 
-			bind(m_pipeline->m_cluster_buffers.lights, m_point_lights, 11);
-			bind(m_pipeline->m_cluster_buffers.clusters, m_clusters, 12);
-			bind(m_pipeline->m_cluster_buffers.maps, m_map, 13);
-			bind(m_pipeline->m_cluster_buffers.env_probes, m_env_probes, 14);
-			bind(m_pipeline->m_cluster_buffers.refl_probes, m_refl_probes, 15);
+			// textures are gpu::TextureHandle until here
+			for (ClusterDecal& decal : m_decals) {
+				decal.texture = gpu::getBindlessHandle((gpu::TextureHandle)(uintptr)decal.texture);
+			}
+
+			auto& buffers = m_pipeline->m_cluster_buffers;
+			bind(buffers.lights, m_point_lights, 11);
+			bind(buffers.env_probes, m_env_probes, 14);
+			bind(buffers.refl_probes, m_refl_probes, 15);
+			bind(buffers.decals, m_decals, 16);
+
+			if (!m_use_compute) {
+				bind(buffers.clusters, m_clusters, 12);
+				bind(buffers.maps, m_map, 13);
+				return;
+			}
+
+			// lights are distributed on average, clusters which do not fit are left empty
+			const u32 max_avg_lights = 32;
+			const u32 lights_per_cluster = minimum(max_avg_lights, (u32)m_point_lights.size());
+			m_compute_data.map_capacity = 1 + m_map.size() + m_clusters.size() * lights_per_cluster;
+			reserve(buffers.maps, m_compute_data.map_capacity * sizeof(i32));
+			const i32 map_start = 1;
+			gpu::update(buffers.maps.buffer, &map_start, sizeof(map_start));
+			bind(buffers.probe_maps, m_map, 0);
+			bind(buffers.clusters, m_clusters, 12);
+
+			gpu::bindShaderBuffer(buffers.clusters.buffer, 12, gpu::BindShaderBufferFlags::OUTPUT);
+			gpu::bindShaderBuffer(buffers.maps.buffer, 13, gpu::BindShaderBufferFlags::OUTPUT);
+			m_pipeline->setDrawcallData(&m_compute_data, sizeof(m_compute_data));
+			gpu::useProgram(m_program);
+			gpu::dispatch((m_clusters.size() + 63) / 64, 1, 1);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::memoryBarrier();
+			gpu::bindShaderBuffer(buffers.clusters.buffer, 12, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(buffers.maps.buffer, 13, gpu::BindShaderBufferFlags::NONE);
 		}
 
+		// matches Drawcall block in fill_clusters.shd
+		struct ComputeData {
+			Vec4 xplanes[65];
+			Vec4 yplanes[65];
+			Vec4 zplanes[17];
+			IVec4 size; // xyz - clusters, w - lights count
+			u32 map_capacity;
+		};
+
 
 		struct Cluster {
 			u32 offset;
 			u32 point_lights_count;
 			u32 env_probes_count;
 			u32 refl_probes_count;
+			u32 decals_count;
 		};
 
 		struct ClusterPointLight {
@@ -2935,16 +3936,33 @@ struct PipelineImpl final : Pipeline
 			float pad1;
 		};
 
+		// matches Decal in clustered_decals.shd
+		struct ClusterDecal {
+			Vec3 pos;
+			u32 is_curve;
+			Quat rot;
+			Vec3 half_extents;
+			float pad;
+			Vec2 uv_scale;
+			u64 texture;
+			Vec4 bezier;
+			Vec4 color;
+		};
+
 		Array<i32> m_map;
 		Array<Cluster> m_clusters;
 		Array<ClusterPointLight> m_point_lights;
 		Array<ClusterEnvProbe> m_env_probes;
 		Array<ClusterReflProbe> m_refl_probes;
+		Array<ClusterDecal> m_decals;
 
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
 		bool m_is_clear = false;
 		Matrix m_shadow_atlas_matrices[128];
+		gpu::ProgramHandle m_program = gpu::INVALID_PROGRAM;
+		bool m_use_compute = false;
+		ComputeData m_compute_data;
 	};
 	
 	Matrix getShadowMatrix(const PointLight& light, u32 atlas_idx) {
@@ -3003,237 +4021,740 @@ struct PipelineImpl final : Pipeline
 		return float(light.radius / length(cam_pos - light_pos));
 	}
 
-	u32 cull(CameraParams cp) {
+	// rasterizes occluders visible from `cp`, returns null if there are none
+	const OcclusionBuffer* rasterizeOccluders(const CameraParams& cp) {
+		PROFILE_FUNCTION();
+		Span<const EntityRef> occluders = m_scene->getOccluders();
+		if (occluders.length() == 0) return nullptr;
+
+		const Universe& universe = m_scene->getUniverse();
+		Span<const ModelInstance> model_instances = m_scene->getModelInstances();
+		m_occluders.clear();
+		for (EntityRef e : occluders) {
+			const ModelInstance& mi = model_instances[e.index];
+			if (!mi.flags.isSet(ModelInstance::ENABLED) || !mi.model || !mi.model->isReady()) continue;
+
+			const Transform& tr = universe.getTransform(e);
+			const float radius = mi.model->getOriginBoundingRadius() * tr.scale;
+			if (!cp.frustum.intersectsAABB(tr.pos - DVec3(radius), Vec3(2 * radius))) continue;
+
+			++m_occlusion_stats.occluder_count;
+			const Matrix mtx = universe.getRelativeMatrix(e, cp.pos);
+			const LODMeshIndices& lod = mi.model->getLODIndices()[0];
+			for (i32 i = lod.from; i <= lod.to; ++i) {
+				const Mesh& mesh = mi.meshes[i];
+				// skinned meshes are not in bind pose
+				if (mesh.type == Mesh::SKINNED) continue;
+				m_occluders.push({&mesh, mtx});
+			}
+		}
+		if (m_occluders.empty()) return nullptr;
+
+		m_occlusion_buffer.rasterize(cp.projection * cp.view, cp.pos, m_occluders);
+		m_occlusion_stats.occluder_triangle_count += m_occlusion_buffer.getTrianglesCount();
+		return &m_occlusion_buffer;
+	}
+
+	u32 createView(const CameraParams& cp) {
 		View& view = m_views.emplace(m_allocator, m_renderer.getEngine().getPageAllocator());
 		view.cp = cp;
-		view.renderables = m_scene->getRenderables(cp.frustum);
+		// there's one occlusion buffer, so only the first (main) camera view is occlusion culled
+		if (!cp.is_shadow && !m_viewport.is_ortho && !m_occlusion_buffer_used) {
+			m_occlusion_buffer_used = true;
+			view.occlusion = rasterizeOccluders(cp);
+		}
+		// views are culled in the same order every frame, so a view with the same index likely has the same frustum as in the previous frame
+		const u32 view_idx = m_views.size() - 1;
+		while (m_cull_caches.size() <= (i32)view_idx) m_cull_caches.push(LUMIX_NEW(m_allocator, CullCache)(m_allocator));
+		while (m_sort_key_caches.size() <= (i32)view_idx) m_sort_key_caches.push(LUMIX_NEW(m_allocator, SortKeyCache)(m_allocator));
+		view.sort_key_cache = m_sort_key_caches[view_idx];
 		memset(view.layer_to_bucket, 0xff, sizeof(view.layer_to_bucket));
-		return m_views.size() - 1;
+		return view_idx;
 	}
 
-	struct RenderBucketJob : Renderer::RenderJob {
-		void setup() override {
-			jobs::wait(m_pipeline->m_buckets_ready);
+	void viewCulled(u32 view_idx, CullResult* renderables) {
+		View& view = m_views[view_idx];
+		view.renderables = renderables;
+		m_occlusion_stats.occluded_pages += m_cull_caches[view_idx]->occluded_pages;
+		view.meshes_changed = m_cull_caches[view_idx]->changed_types & (1 << (u32)RenderableTypes::MESH);
+	}
 
-			m_cmds = m_pipeline->m_buckets[m_bucket_id].cmd_page;
+	u32 cull(CameraParams cp) {
+		const u32 view_idx = createView(cp);
+		View& view = m_views[view_idx];
+		viewCulled(view_idx, m_scene->getRenderables(cp.frustum, *m_cull_caches[view_idx], view.occlusion));
+		return view_idx;
+	}
+
+	// cullViews(cp0, cp1, ...) returns view of each camera params, all are culled in one traversal
+	static int cullViews(lua_State* L) {
+		PROFILE_FUNCTION();
+		PipelineImpl* pipeline = getClosureThis(L);
+		const u32 count = lua_gettop(L);
+		if (count > CullingSystem::MAX_CULL_VIEWS) {
+			luaL_error(L, "%s", "Too many views");
+			return 0;
 		}
 
-		void execute() override {
-			if (!m_cmds) return;
+		u32 view_indices[CullingSystem::MAX_CULL_VIEWS];
+		for (u32 i = 0; i < count; ++i) {
+			LuaWrapper::checkTableArg(L, i + 1);
+			view_indices[i] = pipeline->createView(LuaWrapper::toType<CameraParams>(L, i + 1));
+		}
 
-			// inline in debug
-			#define READ(T, N) \
-				const T N = *(T*)cmd; \
-				cmd += sizeof(T); \
-				do {} while(false)
-			PROFILE_FUNCTION();
-			if(m_cmds->header.size == 0 && !m_cmds->header.next) {
-				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(m_cmds, true);
-				return;
-			}
+		// m_views is not resized anymore, so pointers to frusta stay valid
+		CullView cull_views[CullingSystem::MAX_CULL_VIEWS];
+		for (u32 i = 0; i < count; ++i) {
+			const View& view = pipeline->m_views[view_indices[i]];
+			cull_views[i].frustum = &view.cp.frustum;
+			cull_views[i].cache = pipeline->m_cull_caches[view_indices[i]];
+			cull_views[i].occlusion = view.occlusion;
+		}
+		pipeline->m_scene->getRenderables(Span(cull_views, count));
 
-			Renderer& renderer = m_pipeline->m_renderer;
+		for (u32 i = 0; i < count; ++i) {
+			pipeline->viewCulled(view_indices[i], cull_views[i].result);
+			LuaWrapper::push(L, view_indices[i]);
+		}
+		return count;
+	}
 
-			Stats stats = {};
+	// backend-neutral gpu calls, recorded on any thread and replayed in order on the render thread
+	// drawcall data and buffer updates are copied in, so recording does not touch transient memory
+	struct CommandList {
+		enum class Type : u8 {
+			SET_STATE,
+			USE_PROGRAM,
+			BIND_TEXTURES,
+			BIND_UNIFORM_BUFFER,
+			BIND_VERTEX_BUFFER,
+			BIND_INDEX_BUFFER,
+			BIND_INDIRECT_BUFFER,
+			BIND_SHADER_BUFFER,
+			UPDATE_BUFFER,
+			DRAWCALL_DATA,
+			DISPATCH,
+			MEMORY_BARRIER,
+			DRAW_INSTANCED,
+			DRAW_INDIRECT
+		};
 
-			const gpu::StateFlags render_states = m_render_state;
-			gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, m_pipeline->m_drawcall_ub, 0, DRAWCALL_UB_SIZE);
-			const gpu::BufferHandle material_ub = renderer.getMaterialUniformBuffer();
-			u32 material_ub_idx = 0xffFFffFF;
-			CmdPage* page = m_cmds;
-			while (page) {
-				const u8* cmd = page->data;
-				const u8* cmd_end = page->data + page->header.size;
-				while (cmd != cmd_end) {
-					READ(RenderableTypes, type);
-					switch(type) {
-						case RenderableTypes::MESH:
-						case RenderableTypes::MESH_MATERIAL_OVERRIDE: {
-							READ(Mesh::RenderData*, mesh);
-							READ(Material::RenderData*, material);
-							READ(gpu::ProgramHandle, program);
-							READ(u32, instances_count);
-							READ(gpu::BufferHandle, buffer);
-							READ(u32, offset);
-
-							gpu::bindTextures(material->textures, 0, material->textures_count);
-							gpu::setState(material->render_states | render_states);
-							if (material_ub_idx != material->material_constants) {
-								gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
-								material_ub_idx = material->material_constants;
-							}
+		explicit CommandList(IAllocator& allocator) : data(allocator) {}
 
-							gpu::useProgram(program);
+		void setState(gpu::StateFlags state) {
+			data.write(Type::SET_STATE);
+			data.write(state);
+		}
 
-							gpu::bindIndexBuffer(mesh->index_buffer_handle);
-							gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
-							gpu::bindVertexBuffer(1, buffer, offset, 36);
+		void useProgram(gpu::ProgramHandle program) {
+			data.write(Type::USE_PROGRAM);
+			data.write(program);
+		}
 
-							gpu::drawTrianglesInstanced(mesh->indices_count, instances_count, mesh->index_type);
-							++stats.draw_call_count;
-							stats.triangle_count += instances_count * mesh->indices_count / 3;
-							stats.instance_count += instances_count;
-							break;
-						}
-						case RenderableTypes::FUR:
-						case RenderableTypes::SKINNED: {
-							READ(Mesh::RenderData*, mesh);
-							READ(Material::RenderData*, material);
-							READ(gpu::ProgramHandle, program);
-							READ(Vec3, pos);
-							READ(Quat, rot);
-							READ(float, scale);
-							READ(i32, bones_count);
-							u32 layers = 1;
-
-							struct {
-								float layer;
-								float fur_scale;
-								float gravity;
-								float padding;
-								Matrix model_mtx;
-								DualQuat bones[255];
-							} dc;
-							ASSERT(bones_count < (i32)lengthOf(dc.bones));
-
-							if (type == RenderableTypes::FUR) {
-								READ(u32, tmp);
-								READ(float, tmp2);
-								READ(float, tmp3);
-								layers = tmp;
-								dc.fur_scale = tmp2;
-								dc.gravity = tmp3;
-							}
+		void bindTextures(const gpu::TextureHandle* handles, u32 offset, u32 count) {
+			ASSERT(count <= Material::MAX_TEXTURE_COUNT);
+			data.write(Type::BIND_TEXTURES);
+			data.write(offset);
+			data.write(count);
+			data.write(handles, sizeof(handles[0]) * count);
+		}
 
-							DualQuat* bones = (DualQuat*)cmd;
-							cmd += sizeof(bones[0]) * bones_count;
+		void bindUniformBuffer(u32 ub_index, gpu::BufferHandle buffer, u32 offset, u32 size) {
+			data.write(Type::BIND_UNIFORM_BUFFER);
+			data.write(ub_index);
+			data.write(buffer);
+			data.write(offset);
+			data.write(size);
+		}
 
-							dc.model_mtx = Matrix(pos, rot);
-							dc.model_mtx.multiply3x3(scale);
+		void bindVertexBuffer(u32 binding_idx, gpu::BufferHandle buffer, u32 offset, u32 stride) {
+			data.write(Type::BIND_VERTEX_BUFFER);
+			data.write(binding_idx);
+			data.write(buffer);
+			data.write(offset);
+			data.write(stride);
+		}
 
-							gpu::bindTextures(material->textures, 0, material->textures_count);
+		void bindIndexBuffer(gpu::BufferHandle buffer) {
+			data.write(Type::BIND_INDEX_BUFFER);
+			data.write(buffer);
+		}
 
-							gpu::setState(material->render_states | render_states);
-							if (material_ub_idx != material->material_constants) {
-								gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
-								material_ub_idx = material->material_constants;
-							}
+		void bindIndirectBuffer(gpu::BufferHandle buffer) {
+			data.write(Type::BIND_INDIRECT_BUFFER);
+			data.write(buffer);
+		}
 
-							memcpy(&dc.bones[0], bones, sizeof(bones[0]) * bones_count);
+		void bindShaderBuffer(gpu::BufferHandle buffer, u32 binding_point, gpu::BindShaderBufferFlags flags) {
+			data.write(Type::BIND_SHADER_BUFFER);
+			data.write(buffer);
+			data.write(binding_point);
+			data.write(flags);
+		}
 
-							gpu::useProgram(program);
+		void update(gpu::BufferHandle buffer, const void* payload, u32 size) {
+			data.write(Type::UPDATE_BUFFER);
+			data.write(buffer);
+			data.write(size);
+			data.write(payload, size);
+		}
 
-							gpu::bindIndexBuffer(mesh->index_buffer_handle);
-							gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
-							gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
-							
-							for (u32 i = 0; i < layers; ++i) {
-								dc.layer = float(i) / layers;
-								// TODO do not update whole buffer each layer
-								gpu::update(m_pipeline->m_drawcall_ub, &dc, sizeof(Vec4) + sizeof(Matrix) * (bones_count + 1)); 
-								gpu::drawTriangles(0, mesh->indices_count, mesh->index_type);
-							}
-							++stats.draw_call_count;
-							stats.triangle_count += mesh->indices_count / 3;
-							++stats.instance_count;
-							break;
+		void setDrawcallData(const void* payload, u32 size) {
+			data.write(Type::DRAWCALL_DATA);
+			data.write(size);
+			data.write(payload, size);
+		}
+
+		void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z) {
+			data.write(Type::DISPATCH);
+			data.write(num_groups_x);
+			data.write(num_groups_y);
+			data.write(num_groups_z);
+		}
+
+		void memoryBarrier() { data.write(Type::MEMORY_BARRIER); }
+
+		void drawTrianglesInstanced(u32 indices_count, u32 instances_count, gpu::DataType index_type) {
+			data.write(Type::DRAW_INSTANCED);
+			data.write(indices_count);
+			data.write(instances_count);
+			data.write(index_type);
+		}
+
+		void drawIndirect(gpu::DataType index_type) {
+			data.write(Type::DRAW_INDIRECT);
+			data.write(index_type);
+		}
+
+		OutputMemoryStream data;
+	};
+
+	// render thread only
+	void replay(const CommandList& list) {
+		using Type = CommandList::Type;
+		InputMemoryStream blob(list.data);
+		while (blob.getPosition() < blob.size()) {
+			const Type type = blob.read<Type>();
+			switch (type) {
+				case Type::SET_STATE: gpu::setState(blob.read<gpu::StateFlags>()); break;
+				case Type::USE_PROGRAM: gpu::useProgram(blob.read<gpu::ProgramHandle>()); break;
+				case Type::BIND_TEXTURES: {
+					const u32 offset = blob.read<u32>();
+					const u32 count = blob.read<u32>();
+					gpu::TextureHandle textures[Material::MAX_TEXTURE_COUNT];
+					blob.read(textures, sizeof(textures[0]) * count);
+					gpu::bindTextures(textures, offset, count);
+					break;
+				}
+				case Type::BIND_UNIFORM_BUFFER: {
+					const u32 ub_index = blob.read<u32>();
+					const gpu::BufferHandle buffer = blob.read<gpu::BufferHandle>();
+					const u32 offset = blob.read<u32>();
+					const u32 size = blob.read<u32>();
+					gpu::bindUniformBuffer(ub_index, buffer, offset, size);
+					break;
+				}
+				case Type::BIND_VERTEX_BUFFER: {
+					const u32 binding_idx = blob.read<u32>();
+					const gpu::BufferHandle buffer = blob.read<gpu::BufferHandle>();
+					const u32 offset = blob.read<u32>();
+					const u32 stride = blob.read<u32>();
+					gpu::bindVertexBuffer(binding_idx, buffer, offset, stride);
+					break;
+				}
+				case Type::BIND_INDEX_BUFFER: gpu::bindIndexBuffer(blob.read<gpu::BufferHandle>()); break;
+				case Type::BIND_INDIRECT_BUFFER: gpu::bindIndirectBuffer(blob.read<gpu::BufferHandle>()); break;
+				case Type::BIND_SHADER_BUFFER: {
+					const gpu::BufferHandle buffer = blob.read<gpu::BufferHandle>();
+					const u32 binding_point = blob.read<u32>();
+					const gpu::BindShaderBufferFlags flags = blob.read<gpu::BindShaderBufferFlags>();
+					gpu::bindShaderBuffer(buffer, binding_point, flags);
+					break;
+				}
+				case Type::UPDATE_BUFFER: {
+					const gpu::BufferHandle buffer = blob.read<gpu::BufferHandle>();
+					const u32 size = blob.read<u32>();
+					gpu::update(buffer, blob.skip(size), size);
+					break;
+				}
+				case Type::DRAWCALL_DATA: {
+					const u32 size = blob.read<u32>();
+					setDrawcallData(blob.skip(size), size);
+					break;
+				}
+				case Type::DISPATCH: {
+					const u32 x = blob.read<u32>();
+					const u32 y = blob.read<u32>();
+					const u32 z = blob.read<u32>();
+					gpu::dispatch(x, y, z);
+					break;
+				}
+				case Type::MEMORY_BARRIER: gpu::memoryBarrier(); break;
+				case Type::DRAW_INSTANCED: {
+					const u32 indices_count = blob.read<u32>();
+					const u32 instances_count = blob.read<u32>();
+					gpu::drawTrianglesInstanced(indices_count, instances_count, blob.read<gpu::DataType>());
+					break;
+				}
+				case Type::DRAW_INDIRECT: gpu::drawIndirect(blob.read<gpu::DataType>()); break;
+			}
+		}
+	}
+
+	struct RenderBucketJob : Renderer::RenderJob {
+		struct Indirect {
+			u32 vertex_count;
+			u32 instance_count;
+			u32 first_index;
+			u32 base_vertex;
+			u32 base_instance;
+		};
+
+		// baked draws are recorded in chunks of this size, dynamic draws per page
+		static constexpr u32 BAKED_DRAWS_PER_LIST = 256;
+
+		// part of the bucket recorded by one worker
+		struct Part {
+			Part(IAllocator& allocator) : cmds(allocator) {}
+
+			const CmdPage* page = nullptr;
+			u32 baked_from = 0;
+			u32 baked_to = 0;
+			CommandList cmds;
+			Stats stats = {};
+		};
+
+		RenderBucketJob(IAllocator& allocator)
+			: m_occlusion_depth(allocator)
+		{}
+
+		void setup() override {
+			jobs::wait(m_pipeline->m_buckets_ready, jobs::Priority::HIGH);
+
+			m_cmds = m_pipeline->m_buckets[m_bucket_id].cmd_page;
+			m_baked = m_pipeline->m_buckets[m_bucket_id].baked;
+		}
+
+		// draws in a bucket are sorted by material, so consecutive draws often share it
+		struct BoundMaterial {
+			const Material::RenderData* material = nullptr;
+			u32 ub_idx = 0xffFFffFF;
+		};
+
+		void bindMaterial(const Material::RenderData* material, BoundMaterial& bound, CommandList& cmds) {
+			if (bound.material == material) return;
+			bound.material = material;
+			if (!material->bindless) cmds.bindTextures(material->textures, 0, material->textures_count);
+			if (bound.ub_idx != material->material_constants) {
+				cmds.bindUniformBuffer(UniformBuffer::MATERIAL, m_material_ub, material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
+				bound.ub_idx = material->material_constants;
+			}
+		}
+
+		void drawMesh(const Mesh::RenderData* mesh
+			, const Material::RenderData* material
+			, gpu::ProgramHandle program
+			, u32 instances_count
+			, gpu::BufferHandle buffer
+			, u32 offset
+			, gpu::ProgramHandle cull_program
+			, const Vec4& bounding_sphere
+			, BoundMaterial& bound_material
+			, CommandList& cmds
+			, Stats& stats)
+		{
+			const gpu::BufferHandle scratch = m_scratch_buffer;
+			if (cull_program) {
+				// visible instances are compacted to scratch buffer, indirect args are right before them
+				struct {
+					Vec4 bounding_sphere;
+					u32 input_offset;
+					u32 count;
+				} dc = { bounding_sphere, u32(offset / sizeof(float)), instances_count };
+				cmds.setDrawcallData(&dc, sizeof(dc));
+
+				Indirect indirect_dc;
+				indirect_dc.vertex_count = mesh->indices_count;
+				indirect_dc.instance_count = 0;
+				indirect_dc.first_index = 0;
+				indirect_dc.base_vertex = 0;
+				indirect_dc.base_instance = 0;
+				cmds.update(scratch, &indirect_dc, sizeof(indirect_dc));
+
+				cmds.bindShaderBuffer(scratch, 0, gpu::BindShaderBufferFlags::OUTPUT);
+				cmds.bindShaderBuffer(buffer, 1, gpu::BindShaderBufferFlags::NONE);
+				cmds.useProgram(cull_program);
+				cmds.dispatch((instances_count + 63) / 64, 1, 1);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+				cmds.memoryBarrier();
+			}
+
+			// single instance of a mesh with meshlets, visible meshlets' indices are compacted to scratch buffer
+			const bool cull_meshlets = !cull_program
+				&& instances_count == 1
+				&& mesh->meshlets_buffer
+				&& m_cull_meshlets_program
+				&& mesh->indices_count * sizeof(u32) + 32 <= Renderer::SCRATCH_BUFFER_SIZE;
+			if (cull_meshlets) {
+				const gpu::StateFlags state = material->render_states | m_render_state;
+				struct {
+					Matrix occlusion_view_projection;
+					u32 input_offset;
+					u32 meshlets_count;
+					u32 indices16;
+					u32 occlusion;
+					u32 cone_culling;
+				} dc;
+				dc.occlusion_view_projection = m_occlusion_view_projection;
+				dc.input_offset = u32(offset / sizeof(float));
+				dc.meshlets_count = mesh->meshlets_count;
+				dc.indices16 = mesh->index_type == gpu::DataType::U16 ? 1 : 0;
+				dc.occlusion = m_occlusion_depth.empty() ? 0 : 1;
+				dc.cone_culling = m_cone_culling && u64(state & gpu::StateFlags::CULL_BACK) ? 1 : 0;
+				cmds.setDrawcallData(&dc, sizeof(dc));
+
+				Indirect indirect_dc;
+				indirect_dc.vertex_count = 0;
+				indirect_dc.instance_count = 1;
+				indirect_dc.first_index = 32 / sizeof(u32);
+				indirect_dc.base_vertex = 0;
+				indirect_dc.base_instance = 0;
+				cmds.update(scratch, &indirect_dc, sizeof(indirect_dc));
+
+				cmds.bindShaderBuffer(scratch, 0, gpu::BindShaderBufferFlags::OUTPUT);
+				cmds.bindShaderBuffer(mesh->meshlets_buffer, 1, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(mesh->index_buffer_handle, 2, gpu::BindShaderBufferFlags::NONE);
+				if (!m_occlusion_depth.empty()) cmds.bindShaderBuffer(m_pipeline->m_meshlets_occlusion_buffer, 3, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(buffer, 5, gpu::BindShaderBufferFlags::NONE);
+				cmds.useProgram(m_cull_meshlets_program);
+				cmds.dispatch((mesh->meshlets_count + 63) / 64, 1, 1);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 2, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 3, gpu::BindShaderBufferFlags::NONE);
+				cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 5, gpu::BindShaderBufferFlags::NONE);
+				cmds.memoryBarrier();
+			}
+
+			bindMaterial(material, bound_material, cmds);
+			cmds.setState(material->render_states | m_render_state);
+
+			cmds.useProgram(program);
+
+			cmds.bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+
+			if (cull_meshlets) {
+				cmds.bindIndexBuffer(scratch);
+				cmds.bindVertexBuffer(1, buffer, offset, INSTANCE_DATA_SIZE);
+				cmds.bindIndirectBuffer(scratch);
+				cmds.drawIndirect(gpu::DataType::U32);
+				cmds.bindIndirectBuffer(gpu::INVALID_BUFFER);
+			}
+			else if (cull_program) {
+				cmds.bindIndexBuffer(mesh->index_buffer_handle);
+				cmds.bindVertexBuffer(1, scratch, (sizeof(Indirect) + 15) & ~15, INSTANCE_DATA_SIZE);
+				cmds.bindIndirectBuffer(scratch);
+				cmds.drawIndirect(mesh->index_type);
+				cmds.bindIndirectBuffer(gpu::INVALID_BUFFER);
+			}
+			else {
+				cmds.bindIndexBuffer(mesh->index_buffer_handle);
+				cmds.bindVertexBuffer(1, buffer, offset, INSTANCE_DATA_SIZE);
+				cmds.drawTrianglesInstanced(mesh->indices_count, instances_count, mesh->index_type);
+			}
+			++stats.draw_call_count;
+			stats.triangle_count += instances_count * mesh->indices_count / 3;
+			stats.instance_count += instances_count;
+		}
+
+		void recordBaked(Part& part) {
+			PROFILE_FUNCTION();
+			BoundMaterial bound_material;
+			const gpu::BufferHandle buffer = m_baked->instance_buffer;
+			for (u32 i = part.baked_from; i < part.baked_to; ++i) {
+				const BakedBucket::Draw& draw = m_baked->draws[i];
+				drawMesh(draw.mesh, draw.material, draw.program, draw.instances_count, buffer, draw.offset, draw.cull_program, draw.bounding_sphere, bound_material, part.cmds, part.stats);
+			}
+		}
+
+		void recordPage(Part& part) {
+			// inline in debug
+			#define READ(T, N) \
+				const T N = *(T*)cmd; \
+				cmd += sizeof(T); \
+				do {} while(false)
+			PROFILE_FUNCTION();
+			CommandList& cmds = part.cmds;
+			Stats& stats = part.stats;
+			const gpu::StateFlags render_states = m_render_state;
+			BoundMaterial bound_material;
+			const u8* cmd = part.page->data;
+			const u8* cmd_end = part.page->data + part.page->header.size;
+			while (cmd != cmd_end) {
+				READ(RenderableTypes, type);
+				switch(type) {
+					case RenderableTypes::MESH:
+					case RenderableTypes::MESH_MATERIAL_OVERRIDE: {
+						READ(Mesh::RenderData*, mesh);
+						READ(Material::RenderData*, material);
+						READ(gpu::ProgramHandle, program);
+						READ(u32, instances_count);
+						READ(gpu::BufferHandle, buffer);
+						READ(u32, offset);
+						READ(gpu::ProgramHandle, cull_program);
+						Vec4 bounding_sphere;
+						if (cull_program) {
+							memcpy(&bounding_sphere, cmd, sizeof(bounding_sphere));
+							cmd += sizeof(bounding_sphere);
 						}
-						case RenderableTypes::CURVE_DECAL: {
-							READ(Material::RenderData*, material);
-							READ(gpu::ProgramHandle, program);
-							READ(gpu::BufferHandle, buffer);
-							READ(u32, offset);
-							READ(u32, count);
-							READ(u32, nonintersecting_count);
-								
-							gpu::bindTextures(material->textures, 0, material->textures_count);
-							if (material_ub_idx != material->material_constants) {
-								gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
-								material_ub_idx = material->material_constants;
-							}
-							gpu::useProgram(program);
-							gpu::bindIndexBuffer(m_pipeline->m_cube_ib);
-							gpu::bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
 
-							gpu::StateFlags state = material->render_states | render_states;
-							state = state & ~gpu::StateFlags::CULL_FRONT | gpu::StateFlags::CULL_BACK;
-							if (nonintersecting_count) {
-								gpu::setState(state);
-								gpu::bindVertexBuffer(1, buffer, offset, 64);
-								gpu::drawTrianglesInstanced(36, nonintersecting_count, gpu::DataType::U16);
-							}
+						drawMesh(mesh, material, program, instances_count, buffer, offset, cull_program, bounding_sphere, bound_material, cmds, stats);
+						break;
+					}
+					case RenderableTypes::SKINNED: {
+						READ(Mesh::RenderData*, mesh);
+						READ(Material::RenderData*, material);
+						READ(gpu::ProgramHandle, program);
+						READ(u32, instances_count);
+						READ(gpu::BufferHandle, buffer);
+						READ(u32, offset);
+						READ(gpu::BufferHandle, bones_buffer);
+						READ(gpu::BufferHandle, preskinned);
+
+						bindMaterial(material, bound_material, cmds);
+						cmds.setState(material->render_states | render_states);
+
+						cmds.useProgram(program);
+						cmds.bindIndexBuffer(mesh->index_buffer_handle);
+						if (preskinned) {
+							cmds.bindVertexBuffer(0, preskinned, 0, 11 * sizeof(float));
+						}
+						else {
+							cmds.bindShaderBuffer(bones_buffer, 10, gpu::BindShaderBufferFlags::NONE);
+							cmds.bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+						}
+						cmds.bindVertexBuffer(1, buffer, offset, 36);
+						cmds.drawTrianglesInstanced(mesh->indices_count, instances_count, mesh->index_type);
+						cmds.bindShaderBuffer(gpu::INVALID_BUFFER, 10, gpu::BindShaderBufferFlags::NONE);
 
-							if (count - nonintersecting_count) {
-								state = state & ~gpu::StateFlags::DEPTH_TEST;
-								state = state & ~gpu::StateFlags::CULL_BACK;
-								state = state | gpu::StateFlags::CULL_FRONT;
-								gpu::setState(state);
-								const u32 offs = offset + sizeof(float) * 16 * nonintersecting_count;
-								gpu::bindVertexBuffer(1, buffer, offs, 64);
-								gpu::drawTrianglesInstanced(36, count - nonintersecting_count, gpu::DataType::U16);
-							}
-							++stats.draw_call_count;
-							stats.instance_count += count;
-							break;
+						++stats.draw_call_count;
+						stats.triangle_count += instances_count * mesh->indices_count / 3;
+						stats.instance_count += instances_count;
+						break;
+					}
+					case RenderableTypes::FUR: {
+						READ(Mesh::RenderData*, mesh);
+						READ(Material::RenderData*, material);
+						READ(gpu::ProgramHandle, program);
+						READ(Vec3, pos);
+						READ(Quat, rot);
+						READ(float, scale);
+						READ(i32, bones_count);
+						READ(u32, layers);
+						READ(float, fur_scale);
+						READ(float, gravity);
+						READ(gpu::BufferHandle, preskinned);
+
+						struct {
+							float layers_count;
+							float fur_scale;
+							float gravity;
+							float padding;
+							Matrix model_mtx;
+							DualQuat bones[255];
+						} dc;
+						ASSERT(bones_count < (i32)lengthOf(dc.bones));
+						dc.layers_count = float(layers);
+						dc.fur_scale = fur_scale;
+						dc.gravity = gravity;
+
+						DualQuat* bones = (DualQuat*)cmd;
+						cmd += sizeof(bones[0]) * bones_count;
+
+						dc.model_mtx = Matrix(pos, rot);
+						dc.model_mtx.multiply3x3(scale);
+
+						bindMaterial(material, bound_material, cmds);
+						cmds.setState(material->render_states | render_states);
+
+						memcpy(&dc.bones[0], bones, sizeof(bones[0]) * bones_count);
+
+						cmds.useProgram(program);
+
+						cmds.bindIndexBuffer(mesh->index_buffer_handle);
+						if (preskinned) {
+							cmds.bindVertexBuffer(0, preskinned, 0, 11 * sizeof(float));
 						}
-						case RenderableTypes::DECAL: {
-							READ(Material::RenderData*, material);
-							READ(gpu::ProgramHandle, program);
-							READ(gpu::BufferHandle, buffer);
-							READ(u32, offset);
-							READ(u32, count);
-							READ(u32, nonintersecting_count);
-								
-							gpu::bindTextures(material->textures, 0, material->textures_count);
-							if (material_ub_idx != material->material_constants) {
-								gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
-								material_ub_idx = material->material_constants;
-							}
-							gpu::useProgram(program);
-							gpu::bindIndexBuffer(m_pipeline->m_cube_ib);
-							gpu::bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
+						else {
+							cmds.bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+						}
+						cmds.bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+						
+						// layer is instance id
+						cmds.setDrawcallData(&dc, sizeof(Vec4) + sizeof(Matrix) + sizeof(DualQuat) * bones_count); 
+						cmds.drawTrianglesInstanced(mesh->indices_count, layers, mesh->index_type);
+						++stats.draw_call_count;
+						stats.triangle_count += layers * mesh->indices_count / 3;
+						stats.instance_count += layers;
+						break;
+					}
+					case RenderableTypes::CURVE_DECAL: {
+						READ(Material::RenderData*, material);
+						READ(gpu::ProgramHandle, program);
+						READ(gpu::BufferHandle, buffer);
+						READ(u32, offset);
+						READ(u32, count);
+						READ(u32, nonintersecting_count);
+							
+						bindMaterial(material, bound_material, cmds);
+						cmds.useProgram(program);
+						cmds.bindIndexBuffer(m_pipeline->m_cube_ib);
+						cmds.bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
 
-							gpu::StateFlags state = material->render_states | render_states;
-							state = state & ~gpu::StateFlags::CULL_FRONT | gpu::StateFlags::CULL_BACK;
-							if (nonintersecting_count) {
-								gpu::setState(state);
-								gpu::bindVertexBuffer(1, buffer, offset, 48);
-								gpu::drawTrianglesInstanced(36, nonintersecting_count, gpu::DataType::U16);
-							}
+						gpu::StateFlags state = material->render_states | render_states;
+						state = state & ~gpu::StateFlags::CULL_FRONT | gpu::StateFlags::CULL_BACK;
+						if (nonintersecting_count) {
+							cmds.setState(state);
+							cmds.bindVertexBuffer(1, buffer, offset, 64);
+							cmds.drawTrianglesInstanced(36, nonintersecting_count, gpu::DataType::U16);
+						}
 
-							if (count - nonintersecting_count) {
-								state = state & ~gpu::StateFlags::DEPTH_TEST;
-								state = state & ~gpu::StateFlags::CULL_BACK;
-								state = state | gpu::StateFlags::CULL_FRONT;
-								gpu::setState(state);
-								const u32 offs = offset + sizeof(float) * 12 * nonintersecting_count;
-								gpu::bindVertexBuffer(1, buffer, offs, 48);
-								gpu::drawTrianglesInstanced(36, count - nonintersecting_count, gpu::DataType::U16);
-							}
-							++stats.draw_call_count;
-							stats.instance_count += count;
-							break;
+						if (count - nonintersecting_count) {
+							state = state & ~gpu::StateFlags::DEPTH_TEST;
+							state = state & ~gpu::StateFlags::CULL_BACK;
+							state = state | gpu::StateFlags::CULL_FRONT;
+							cmds.setState(state);
+							const u32 offs = offset + sizeof(float) * 16 * nonintersecting_count;
+							cmds.bindVertexBuffer(1, buffer, offs, 64);
+							cmds.drawTrianglesInstanced(36, count - nonintersecting_count, gpu::DataType::U16);
+						}
+						++stats.draw_call_count;
+						stats.instance_count += count;
+						break;
+					}
+					case RenderableTypes::DECAL: {
+						READ(Material::RenderData*, material);
+						READ(gpu::ProgramHandle, program);
+						READ(gpu::BufferHandle, buffer);
+						READ(u32, offset);
+						READ(u32, count);
+						READ(u32, nonintersecting_count);
+							
+						bindMaterial(material, bound_material, cmds);
+						cmds.useProgram(program);
+						cmds.bindIndexBuffer(m_pipeline->m_cube_ib);
+						cmds.bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
+
+						gpu::StateFlags state = material->render_states | render_states;
+						state = state & ~gpu::StateFlags::CULL_FRONT | gpu::StateFlags::CULL_BACK;
+						if (nonintersecting_count) {
+							cmds.setState(state);
+							cmds.bindVertexBuffer(1, buffer, offset, 48);
+							cmds.drawTrianglesInstanced(36, nonintersecting_count, gpu::DataType::U16);
 						}
-						default: ASSERT(false); break;
+
+						if (count - nonintersecting_count) {
+							state = state & ~gpu::StateFlags::DEPTH_TEST;
+							state = state & ~gpu::StateFlags::CULL_BACK;
+							state = state | gpu::StateFlags::CULL_FRONT;
+							cmds.setState(state);
+							const u32 offs = offset + sizeof(float) * 12 * nonintersecting_count;
+							cmds.bindVertexBuffer(1, buffer, offs, 48);
+							cmds.drawTrianglesInstanced(36, count - nonintersecting_count, gpu::DataType::U16);
+						}
+						++stats.draw_call_count;
+						stats.instance_count += count;
+						break;
 					}
+					default: ASSERT(false); break;
 				}
+			}
+			#undef READ
+		}
+
+		void execute() override {
+			if (!m_baked && !m_cmds) return;
+			PROFILE_FUNCTION();
+
+			if (!m_occlusion_depth.empty()) {
+				gpu::BufferHandle& occlusion_buffer = m_pipeline->m_meshlets_occlusion_buffer;
+				if (!occlusion_buffer) {
+					occlusion_buffer = gpu::allocBufferHandle();
+					gpu::createBuffer(occlusion_buffer, gpu::BufferFlags::SHADER_BUFFER, m_occlusion_depth.byte_size(), nullptr);
+				}
+				gpu::update(occlusion_buffer, m_occlusion_depth.begin(), m_occlusion_depth.byte_size());
+			}
+
+			// render thread only, so fetched before recording
+			Renderer& renderer = m_pipeline->m_renderer;
+			m_material_ub = renderer.getMaterialUniformBuffer();
+			m_scratch_buffer = renderer.getScratchBuffer();
+
+			// baked draws go first, as before
+			Array<Part> parts(m_pipeline->m_allocator);
+			const u32 baked_count = m_baked ? m_baked->draws.size() : 0;
+			u32 pages_count = 0;
+			for (const CmdPage* page = m_cmds; page; page = page->header.next) {
+				if (page->header.size > 0) ++pages_count;
+			}
+			parts.reserve((baked_count + BAKED_DRAWS_PER_LIST - 1) / BAKED_DRAWS_PER_LIST + pages_count);
+			for (u32 i = 0; i < baked_count; i += BAKED_DRAWS_PER_LIST) {
+				Part& part = parts.emplace(m_pipeline->m_allocator);
+				part.baked_from = i;
+				part.baked_to = minimum(i + BAKED_DRAWS_PER_LIST, baked_count);
+			}
+			for (const CmdPage* page = m_cmds; page; page = page->header.next) {
+				if (page->header.size > 0) parts.emplace(m_pipeline->m_allocator).page = page;
+			}
+
+			// material render data, meshes and command pages are not modified while the render thread executes jobs,
+			// so the parts can be recorded on workers; with a single part it's recorded inline
+			jobs::forEach(parts.size(), 1, [&](i32 from, i32 to){
+				for (i32 i = from; i < to; ++i) {
+					Part& part = parts[i];
+					if (part.page) recordPage(part);
+					else recordBaked(part);
+				}
+			});
+
+			PageAllocator& page_allocator = renderer.getEngine().getPageAllocator();
+			CmdPage* page = m_cmds;
+			while (page) {
 				CmdPage* next = page->header.next;
-				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page, true);
+				page_allocator.deallocate(page, true);
 				page = next;
 			}
-			#undef READ
+
+			gpu::bindShaderBuffer(m_material_ub, ShaderBuffer::MATERIALS, gpu::BindShaderBufferFlags::NONE);
+			Stats stats = {};
+			for (const Part& part : parts) {
+				m_pipeline->replay(part.cmds);
+				stats.draw_call_count += part.stats.draw_call_count;
+				stats.instance_count += part.stats.instance_count;
+				stats.triangle_count += part.stats.triangle_count;
+			}
+
 			profiler::pushInt("drawcalls", stats.draw_call_count);
 			profiler::pushInt("instances", stats.instance_count);
 			profiler::pushInt("triangles", stats.triangle_count);
 			m_pipeline->m_stats.draw_call_count += stats.draw_call_count;
 			m_pipeline->m_stats.instance_count += stats.instance_count;
-			m_pipeline->m_stats.triangle_count += stats.triangle_count;		
+			m_pipeline->m_stats.triangle_count += stats.triangle_count;
 		}
 
 		CmdPage* m_cmds;
+		const BakedBucket* m_baked;
 		PipelineImpl* m_pipeline;
 		u32 m_bucket_id;
 		gpu::StateFlags m_render_state;
+		gpu::ProgramHandle m_cull_meshlets_program = gpu::INVALID_PROGRAM;
+		gpu::BufferHandle m_material_ub = gpu::INVALID_BUFFER;
+		gpu::BufferHandle m_scratch_buffer = gpu::INVALID_BUFFER;
+		bool m_cone_culling = false;
+		// tiles of the view's occlusion buffer, empty if the view is not occlusion culled
+		Array<float> m_occlusion_depth;
+		Matrix m_occlusion_view_projection;
 	};
 
 	void createCommands(View& view
@@ -3261,6 +4782,7 @@ struct PipelineImpl final : Pipeline
 		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
 		const ShiftedFrustum frustum = view.cp.frustum;
 		const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances().begin();
+		Pose* const* LUMIX_RESTRICT poses = scene->getModelInstancePoses().begin();
 		const Transform* LUMIX_RESTRICT entity_data = universe.getTransforms(); 
 		const DVec3 camera_pos = view.cp.pos;
 				
@@ -3298,6 +4820,8 @@ struct PipelineImpl final : Pipeline
 		};
 
 		const Mesh** sort_key_to_mesh = m_renderer.getSortKeyToMeshMap();
+		const gpu::ProgramHandle no_cull_program = gpu::INVALID_PROGRAM;
+		const gpu::ProgramHandle cull_program = m_cull_instances_shader->isReady() ? m_cull_instances_shader->getProgram(gpu::VertexDecl(), 0) : gpu::INVALID_PROGRAM;
 
 		for (u32 i = 0, c = count; i < c; ++i) {
 			const EntityRef e = {int(renderables[i] & 0xFFffFFff)};
@@ -3312,39 +4836,65 @@ struct PipelineImpl final : Pipeline
 					const u32 mesh_idx = renderables[i] >> 40;
 					const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
 					const Mesh& mesh = mi->meshes[mesh_idx];
+					const Material* material = mi->custom_material;
+					if (!material->isReady()) break;
+
+					Shader* shader = material->getShader();
+					const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, instanced_define_mask | material->getDefineMask());
+					const Material::RenderData* material_data = material->getRenderData();
+
+					// following instances of the same mesh with other bindless materials of the same shader and states
+					// are drawn in the same call, each instance reads constants and textures of its own material
+					const u32 start_i = i;
+					if (material_data->bindless) {
+						const u64 key = sort_keys[i] & instance_key_mask;
+						while (i + 1 < c
+							&& (sort_keys[i + 1] & instance_key_mask) == key
+							&& RenderableTypes((renderables[i + 1] >> 32) & SORT_VALUE_TYPE_MASK) == type)
+						{
+							const ModelInstance& next = model_instances[renderables[i + 1] & 0xFFffFFff];
+							const Material* next_material = next.custom_material;
+							if (!next_material->isReady()) break;
+							if (next.meshes[renderables[i + 1] >> 40].render_data != mesh.render_data) break;
+							if (next_material->getShader() != shader || next_material->getDefineMask() != material->getDefineMask()) break;
+							const Material::RenderData* next_data = next_material->getRenderData();
+							if (!next_data->bindless || next_data->render_states != material_data->render_states) break;
+							++i;
+						}
+					}
+					const u32 count = i - start_i + 1;
 
-					const Renderer::TransientSlice slice = renderer.allocTransient((sizeof(Vec4) + sizeof(float)) * 2);
+					const Renderer::TransientSlice slice = renderer.allocTransient(count * INSTANCE_DATA_SIZE);
 					u8* instance_data = slice.ptr;
-					const EntityRef e = { int(renderables[i] & 0xFFffFFff) };
-					const Transform& tr = entity_data[e.index];
-					const Vec3 lpos = Vec3(tr.pos - camera_pos);
-					memcpy(instance_data, &tr.rot, sizeof(tr.rot));
-					instance_data += sizeof(tr.rot);
-					memcpy(instance_data, &lpos, sizeof(lpos));
-					instance_data += sizeof(lpos);
-					memcpy(instance_data, &tr.scale, sizeof(tr.scale));
-					instance_data += sizeof(tr.scale);
-					const float lod_d = model_instances[e.index].lod - mesh.lod;
-					memcpy(instance_data, &lod_d, sizeof(lod_d));
-					instance_data += sizeof(lod_d);
-					if ((cmd_page->data + sizeof(cmd_page->data) - out) < 41) {
+					for (u32 j = start_i; j <= i; ++j) {
+						const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
+						const Transform& tr = entity_data[e.index];
+						const Vec3 lpos = Vec3(tr.pos - camera_pos);
+						memcpy(instance_data, &tr.rot, sizeof(tr.rot));
+						instance_data += sizeof(tr.rot);
+						memcpy(instance_data, &lpos, sizeof(lpos));
+						instance_data += sizeof(lpos);
+						memcpy(instance_data, &tr.scale, sizeof(tr.scale));
+						instance_data += sizeof(tr.scale);
+						const float lod_d = model_instances[e.index].lod - mesh.lod;
+						memcpy(instance_data, &lod_d, sizeof(lod_d));
+						instance_data += sizeof(lod_d);
+						const float material_idx = float(model_instances[e.index].custom_material->getRenderData()->material_constants);
+						memcpy(instance_data, &material_idx, sizeof(material_idx));
+						instance_data += sizeof(material_idx);
+					}
+					if ((cmd_page->data + sizeof(cmd_page->data) - out) < 65) {
 						new_page(bucket);
 					}
 
-
-					if (mi->custom_material->isReady()) {
-						Shader* shader = mi->custom_material->getShader();
-						const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, instanced_define_mask | mi->custom_material->getDefineMask());
-						WRITE(type);
-						WRITE(mesh.render_data);
-						WRITE_FN(mi->custom_material->getRenderData());
-						WRITE(prog);
-						u32 count = 1;
-						WRITE(count);
-						WRITE(slice.buffer);
-						WRITE(slice.offset);
-					}
-							
+					WRITE(type);
+					WRITE(mesh.render_data);
+					WRITE(material_data);
+					WRITE(prog);
+					WRITE(count);
+					WRITE(slice.buffer);
+					WRITE(slice.offset);
+					WRITE(no_cull_program);
 					break;
 				}
 				case RenderableTypes::MESH: {
@@ -3354,7 +4904,7 @@ struct PipelineImpl final : Pipeline
 						const AutoInstancer::Instances& instances = view.instancers[instancer_idx].instances[group_idx];
 						const u32 total_count = instances.end->offset + instances.end->count;
 						const Mesh& mesh = *sort_key_to_mesh[group_idx];
-						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 41) {
+						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 65) {
 							new_page(bucket);
 						}
 
@@ -3368,6 +4918,18 @@ struct PipelineImpl final : Pipeline
 						WRITE(total_count);
 						WRITE(instances.slice.buffer);
 						WRITE(instances.slice.offset);
+						// culled instances are compacted to scratch buffer, so they must fit in it
+						const bool gpu_cull = cull_program
+							&& total_count >= GPU_CULL_MIN_INSTANCES
+							&& total_count * INSTANCE_DATA_SIZE + 32 <= Renderer::SCRATCH_BUFFER_SIZE;
+						if (gpu_cull) {
+							const Vec4 bounding_sphere((mesh.aabb.min + mesh.aabb.max) * 0.5f, length(mesh.aabb.max - mesh.aabb.min) * 0.5f);
+							WRITE(cull_program);
+							WRITE(bounding_sphere);
+						}
+						else {
+							WRITE(no_cull_program);
+						}
 					}
 					else {
 						const u32 mesh_idx = renderables[i] >> 40;
@@ -3380,7 +4942,8 @@ struct PipelineImpl final : Pipeline
 							++i;
 						}
 						const u32 count = u32(i - start_i);
-						const Renderer::TransientSlice slice = renderer.allocTransient(count * (sizeof(Vec3) + sizeof(Vec4) + sizeof(float)) * 2);
+						const Renderer::TransientSlice slice = renderer.allocTransient(count * INSTANCE_DATA_SIZE);
+						const float material_idx = float(mesh.material->getRenderData()->material_constants);
 						u8* instance_data = slice.ptr;
 						for (int j = start_i; j < start_i + (i32)count; ++j) {
 							const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
@@ -3395,8 +4958,10 @@ struct PipelineImpl final : Pipeline
 							const float lod_d = model_instances[e.index].lod - mesh_lod;
 							memcpy(instance_data, &lod_d, sizeof(lod_d));
 							instance_data += sizeof(lod_d);
+							memcpy(instance_data, &material_idx, sizeof(material_idx));
+							instance_data += sizeof(material_idx);
 						}
-						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 41) {
+						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 65) {
 							new_page(bucket);
 						}
 
@@ -3410,24 +4975,146 @@ struct PipelineImpl final : Pipeline
 						WRITE(count);
 						WRITE(slice.buffer);
 						WRITE(slice.offset);
+						WRITE(no_cull_program);
 							
 						--i;
 					}
 					break;
 				}
-				case RenderableTypes::FUR:
 				case RenderableTypes::SKINNED: {
 					const u32 mesh_idx = renderables[i] >> 40;
 					const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
+					const Mesh& mesh = mi->meshes[mesh_idx];
+
+					auto preskinned = m_preskinned.find(e.index | ((u64)mesh_idx << 32));
+					if (preskinned.isValid() && preskinned.value().frame == m_preskin_frame && preskinned.value().mesh == &mesh) {
+						// already skinned in preskin(), render as rigid mesh
+						const Renderer::TransientSlice slice = renderer.allocTransient(INSTANCE_DATA_SIZE);
+						u8* instance_data = slice.ptr;
+						const Transform& tr = entity_data[e.index];
+						const Vec3 lpos = Vec3(tr.pos - camera_pos);
+						memcpy(instance_data, &tr.rot, sizeof(tr.rot));
+						instance_data += sizeof(tr.rot);
+						memcpy(instance_data, &lpos, sizeof(lpos));
+						instance_data += sizeof(lpos);
+						memcpy(instance_data, &tr.scale, sizeof(tr.scale));
+						instance_data += sizeof(tr.scale);
+						const float lod_d = mi->lod - mesh.lod;
+						memcpy(instance_data, &lod_d, sizeof(lod_d));
+						instance_data += sizeof(lod_d);
+						const float material_idx = float(mesh.material->getRenderData()->material_constants);
+						memcpy(instance_data, &material_idx, sizeof(material_idx));
+						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 65) {
+							new_page(bucket);
+						}
+
+						Shader* shader = mesh.material->getShader();
+						const gpu::ProgramHandle prog = shader->getProgram(m_preskinned_decl, instanced_define_mask | mesh.material->getDefineMask());
+						const u32 count = 1;
+						WRITE(type);
+						WRITE(mesh.render_data);
+						WRITE_FN(mesh.material->getRenderData());
+						WRITE(prog);
+						WRITE(count);
+						WRITE(slice.buffer);
+						WRITE(slice.offset);
+						const gpu::BufferHandle no_bones = gpu::INVALID_BUFFER;
+						WRITE(no_bones);
+						WRITE(preskinned.value().buffer);
+						break;
+					}
+
+					// instances with the same mesh are drawn in one call, poses of all of them are in one bone buffer
+					const int start_i = i;
+					const u64 key = sort_keys[i] & instance_key_mask;
+					u32 bones_count = 0;
+					while (i < c && (sort_keys[i] & instance_key_mask) == key && RenderableTypes((renderables[i] >> 32) & SORT_VALUE_TYPE_MASK) == type) {
+						const EntityRef e = { int(renderables[i] & 0xFFffFFff) };
+						if (i != (u32)start_i) {
+							auto iter = m_preskinned.find(e.index | ((u64)mesh_idx << 32));
+							if (iter.isValid() && iter.value().frame == m_preskin_frame) break;
+						}
+						bones_count += poses[e.index]->count;
+						++i;
+					}
+					const u32 count = u32(i - start_i);
+					const Renderer::TransientSlice instances = renderer.allocTransient(count * (sizeof(Quat) + sizeof(Vec3) + sizeof(float) * 2));
+					const Renderer::TransientSlice bones = renderer.allocTransient(bones_count * sizeof(DualQuat));
+					u8* instance_data = instances.ptr;
+					DualQuat* bones_data = (DualQuat*)bones.ptr;
+					// in vec4s
+					u32 bones_offset = bones.offset / sizeof(Vec4);
+					for (int j = start_i; j < start_i + (i32)count; ++j) {
+						const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
+						const Transform& tr = entity_data[e.index];
+						const Vec3 lpos = Vec3(tr.pos - camera_pos);
+						const float bones_offset_f = float(bones_offset);
+						memcpy(instance_data, &tr.rot, sizeof(tr.rot));
+						instance_data += sizeof(tr.rot);
+						memcpy(instance_data, &lpos, sizeof(lpos));
+						instance_data += sizeof(lpos);
+						memcpy(instance_data, &tr.scale, sizeof(tr.scale));
+						instance_data += sizeof(tr.scale);
+						memcpy(instance_data, &bones_offset_f, sizeof(bones_offset_f));
+						instance_data += sizeof(bones_offset_f);
+
+						const Pose* pose = poses[e.index];
+						const Model& model = *model_instances[e.index].model;
+						for (int k = 0, c = pose->count; k < c; ++k) {
+							const Model::Bone& bone = model.getBone(k);
+							const LocalRigidTransform tmp = {pose->positions[k], pose->rotations[k]};
+							*bones_data = (tmp * bone.inv_bind_transform).toDualQuat();
+							++bones_data;
+						}
+						bones_offset += pose->count * 2;
+					}
+					if ((cmd_page->data + sizeof(cmd_page->data) - out) < 65) {
+						new_page(bucket);
+					}
+
+					Shader* shader = mesh.material->getShader();
+					const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, skinned_define_mask | mesh.material->getDefineMask());
+
+					WRITE(type);
+					WRITE(mesh.render_data);
+					WRITE_FN(mesh.material->getRenderData());
+					WRITE(prog);
+					WRITE(count);
+					WRITE(instances.buffer);
+					WRITE(instances.offset);
+					WRITE(bones.buffer);
+					const gpu::BufferHandle no_preskinned = gpu::INVALID_BUFFER;
+					WRITE(no_preskinned);
+					--i;
+					break;
+				}
+				case RenderableTypes::FUR: {
+					const u32 mesh_idx = renderables[i] >> 40;
+					const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
+					const Pose* pose = poses[e.index];
 					const Transform& tr = entity_data[e.index];
 					const Vec3 rel_pos = Vec3(tr.pos - camera_pos);
 					const Mesh& mesh = mi->meshes[mesh_idx];
 					Shader* shader = mesh.material->getShader();
-					u32 defines = skinned_define_mask | mesh.material->getDefineMask();
-					if (type == RenderableTypes::FUR) defines |= fur_define_mask;
-					const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, defines);
 
-					if (u32(cmd_page->data + sizeof(cmd_page->data) - out) < (u32)mi->pose->count * sizeof(Matrix) + 69) {
+					// all layers are drawn by one instanced call, distant furs have less layers
+					FurComponent& fur = m_scene->getFur(e);
+					u32 layers = fur.layers;
+					const float dist = length(rel_pos);
+					if (fur.lod_distance > 0 && dist > fur.lod_distance) {
+						layers = maximum(u32(layers * fur.lod_distance / dist), 1u);
+					}
+
+					// already skinned in preskin(), bones are not needed
+					auto preskinned = m_preskinned.find(e.index | ((u64)mesh_idx << 32));
+					const bool is_preskinned = preskinned.isValid() && preskinned.value().frame == m_preskin_frame && preskinned.value().mesh == &mesh;
+					const gpu::BufferHandle preskinned_buffer = is_preskinned ? preskinned.value().buffer : gpu::INVALID_BUFFER;
+					const i32 bones_count = is_preskinned ? 0 : pose->count;
+					const gpu::ProgramHandle prog = is_preskinned
+						? shader->getProgram(m_preskinned_fur_decl, fur_define_mask | mesh.material->getDefineMask())
+						: shader->getProgram(mesh.vertex_decl, skinned_define_mask | fur_define_mask | mesh.material->getDefineMask());
+
+					if (u32(cmd_page->data + sizeof(cmd_page->data) - out) < (u32)bones_count * sizeof(Matrix) + 73) {
 						new_page(bucket);
 					}
 
@@ -3438,20 +5125,18 @@ struct PipelineImpl final : Pipeline
 					WRITE(rel_pos);
 					WRITE(tr.rot);
 					WRITE(tr.scale);
-					WRITE(mi->pose->count);
-
-					if (type == RenderableTypes::FUR) {
-						FurComponent& fur = m_scene->getFur(e);
-						WRITE(fur.layers);
-						WRITE(fur.scale);
-						WRITE(fur.gravity);
-					}
+					WRITE(bones_count);
+					WRITE(layers);
+					WRITE(fur.scale);
+					WRITE(fur.gravity);
+					WRITE(preskinned_buffer);
+					if (is_preskinned) break;
 
-					const Quat* rotations = mi->pose->rotations;
-					const Vec3* positions = mi->pose->positions;
+					const Quat* rotations = pose->rotations;
+					const Vec3* positions = pose->positions;
 
 					Model& model = *mi->model;
-					for (int j = 0, c = mi->pose->count; j < c; ++j) {
+					for (int j = 0, c = pose->count; j < c; ++j) {
 						const Model::Bone& bone = model.getBone(j);
 						const LocalRigidTransform tmp = {positions[j], rotations[j]};
 						const DualQuat dq = (tmp * bone.inv_bind_transform).toDualQuat();
@@ -3633,7 +5318,7 @@ struct PipelineImpl final : Pipeline
 		const i32 steps = (size + STEP - 1) / STEP;
 		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
 
-		Array<CmdPage*> pages(m_allocator);
+		Array<CmdPage*> pages(m_renderer.getEngine().getFrameAllocator());
 		pages.resize(steps);
 
 		volatile i32 iter = 0;
@@ -3656,13 +5341,112 @@ struct PipelineImpl final : Pipeline
 				if (prev) {
 					prev->header.next = prev->header.bucket != page->header.bucket ? nullptr : page;
 				}
-				Bucket& bucket = m_buckets[page->header.bucket];
-				if (!bucket.cmd_page) bucket.cmd_page = page;
-				
-				prev = page;
-				page = page->header.next;
+				Bucket& bucket = m_buckets[page->header.bucket];
+				if (!bucket.cmd_page) bucket.cmd_page = page;
+				
+				prev = page;
+				page = page->header.next;
+			}
+		}
+	}
+
+	const BakedBucket* bake(View& view, const Bucket& bucket, Span<const u64> keys, Span<const u64> values) {
+		SortKeyCache& cache = *view.sort_key_cache;
+		const u32 render_data_version = m_renderer.getRenderDataVersion();
+		BakedBucket** slot = nullptr;
+		for (BakedBucket*& baked : cache.baked) {
+			if (baked->layer != bucket.layer) continue;
+			if (baked->render_data_version == render_data_version
+				&& baked->define_mask == bucket.define_mask
+				&& baked->keys.size() == (i32)keys.length()
+				&& memcmp(baked->keys.begin(), keys.begin(), keys.length() * sizeof(keys[0])) == 0
+				&& memcmp(baked->values.begin(), values.begin(), values.length() * sizeof(values[0])) == 0)
+			{
+				return baked;
+			}
+			slot = &baked;
+			break;
+		}
+
+		PROFILE_FUNCTION();
+		BakedBucket* baked = LUMIX_NEW(m_renderer.getAllocator(), BakedBucket)(m_renderer.getAllocator());
+		baked->layer = bucket.layer;
+		baked->define_mask = bucket.define_mask;
+		baked->render_data_version = render_data_version;
+		baked->instance_buffer = cache.instance_buffer;
+		baked->keys.resize(keys.length());
+		baked->values.resize(values.length());
+		memcpy(baked->keys.begin(), keys.begin(), keys.length() * sizeof(keys[0]));
+		memcpy(baked->values.begin(), values.begin(), values.length() * sizeof(values[0]));
+
+		const Mesh** sort_key_to_mesh = m_renderer.getSortKeyToMeshMap();
+		const u32 instanced_define_mask = bucket.define_mask | (1 << m_renderer.getShaderDefineIdx("INSTANCED"));
+		const gpu::ProgramHandle cull_program = m_cull_instances_shader->isReady() ? m_cull_instances_shader->getProgram(gpu::VertexDecl(), 0) : gpu::INVALID_PROGRAM;
+		baked->draws.reserve(values.length());
+		for (u64 value : values) {
+			const u32 group_idx = value & 0xffFF;
+			const u32 instancer_idx = (value >> 16) & 0xffFF;
+			const AutoInstancer::Instances& instances = view.instancers[instancer_idx].instances[group_idx];
+			const Mesh& mesh = *sort_key_to_mesh[group_idx];
+			BakedBucket::Draw& draw = baked->draws.emplace();
+			draw.mesh = mesh.render_data;
+			draw.material = mesh.material->getRenderData();
+			draw.program = mesh.material->getShader()->getProgram(mesh.vertex_decl, instanced_define_mask | mesh.material->getDefineMask());
+			draw.instances_count = instances.end->offset + instances.end->count;
+			draw.offset = instances.slice.offset;
+			draw.cull_program = gpu::INVALID_PROGRAM;
+			if (cull_program && draw.instances_count >= GPU_CULL_MIN_INSTANCES && draw.instances_count * INSTANCE_DATA_SIZE + 32 <= Renderer::SCRATCH_BUFFER_SIZE) {
+				draw.cull_program = cull_program;
+				draw.bounding_sphere = Vec4((mesh.aabb.min + mesh.aabb.max) * 0.5f, length(mesh.aabb.max - mesh.aabb.min) * 0.5f);
+			}
+		}
+
+		if (slot) {
+			// render thread can still replay the old one
+			m_renderer.runInRenderThread(*slot, [](Renderer& renderer, void* ptr){
+				LUMIX_DELETE(renderer.getAllocator(), (BakedBucket*)ptr);
+			});
+			*slot = baked;
+		}
+		else {
+			cache.baked.push(baked);
+		}
+		return baked;
+	}
+
+	// buckets with only auto-instanced meshes are baked, their keys are removed so no commands are created for them
+	void bakeBuckets(View& view) {
+		if (!view.sort_key_cache->instance_buffer) return;
+
+		u64* keys = view.sorter.keys.begin();
+		u64* values = view.sorter.values.begin();
+		const i32 size = view.sorter.keys.size();
+		i32 write = 0;
+		i32 from = 0;
+		while (from < size) {
+			const u8 bucket_idx = u8(keys[from] >> SORT_KEY_BUCKET_SHIFT);
+			bool all_instanced = true;
+			i32 to = from;
+			while (to < size && u8(keys[to] >> SORT_KEY_BUCKET_SHIFT) == bucket_idx) {
+				all_instanced = all_instanced && (keys[to] & SORT_KEY_INSTANCED_FLAG);
+				++to;
+			}
+
+			Bucket& bucket = m_buckets[bucket_idx];
+			if (all_instanced && bucket.sort != Bucket::DEPTH) {
+				bucket.baked = bake(view, bucket, Span<const u64>(keys + from, keys + to), Span<const u64>(values + from, values + to));
+			}
+			else {
+				if (write != from) {
+					memmove(keys + write, keys + from, (to - from) * sizeof(keys[0]));
+					memmove(values + write, values + from, (to - from) * sizeof(values[0]));
+				}
+				write += to - from;
 			}
+			from = to;
 		}
+		view.sorter.keys.resize(write);
+		view.sorter.values.resize(write);
 	}
 
 	void processBuckets() {
@@ -3673,28 +5457,39 @@ struct PipelineImpl final : Pipeline
 		}
 
 		for (View& view : m_views) {
-			if (!view.renderables) continue;
+			if (!view.renderables) {
+				if (view.sort_key_cache) invalidate(*view.sort_key_cache);
+				continue;
+			}
 			createSortKeys(view);
 			view.renderables->free(m_renderer.getEngine().getPageAllocator());
 		}
 
 		for (View& view : m_views) {
 			if (!view.sorter.keys.empty()) {
-				radixSort(view.sorter.keys.begin(), view.sorter.values.begin(), view.sorter.keys.size());
+				radixSort(view.sorter.keys.begin(), view.sorter.values.begin(), view.sorter.keys.size(), m_allocator);
 			}
 		}
 
+		for (View& view : m_views) {
+			if (view.sort_keys_cached) bakeBuckets(view);
+		}
+
 		for (View& view : m_views) {
 			if (view.sorter.keys.empty()) continue;
 
 			createCommands(view);
 		}
 
+		for (View& view : m_views) {
+			if (view.cache_instancers) view.instancers.swap(view.sort_key_cache->instancers);
+		}
+
 		jobs::decSignal(m_buckets_ready);
 	}
 
 	void fur(u32 bucket_id) {
-		HashMap<EntityRef, FurComponent>& furs = m_scene->getFurs();
+		ComponentMap<FurComponent>& furs = m_scene->getFurs();
 		if (furs.empty()) return;
 
 		const Bucket& bucket = m_buckets[bucket_id];
@@ -3703,9 +5498,9 @@ struct PipelineImpl final : Pipeline
 		Sorter::Inserter inserter(view.sorter);
 		
 		const u64 type_mask = (u64)RenderableTypes::FUR << 32;
+		Universe& universe = m_scene->getUniverse();
 		
 		// TODO handle sort order
-		// TODO frustum culling
 		for (auto iter = furs.begin(); iter.isValid(); ++iter) {
 			const EntityRef e = iter.key();
 			if (e.index >= (i32)mi.length()) continue;
@@ -3716,6 +5511,10 @@ struct PipelineImpl final : Pipeline
 			if (!model) continue;
 			if (!model->isReady()) continue;
 
+			const Transform& tr = universe.getTransform(e);
+			const float radius = model->getOriginBoundingRadius() * tr.scale;
+			if (!view.cp.frustum.intersectsAABB(tr.pos - DVec3(radius), Vec3(2 * radius))) continue;
+
 			for (i32 i = 0; i < model->getMeshCount(); ++i) {
 				const Mesh& mesh = model->getMesh(i);
 				if (mesh.type != Mesh::SKINNED) continue;
@@ -3728,6 +5527,142 @@ struct PipelineImpl final : Pipeline
 		}
 	}
 
+	struct PreskinJob : Renderer::RenderJob {
+		struct Dispatch {
+			gpu::BufferHandle vertices;
+			gpu::BufferHandle output;
+			gpu::BufferHandle bones;
+			struct {
+				u32 attributes[6][4];
+				u32 stride;
+				u32 vertex_count;
+				u32 bones_offset;
+			} dc;
+		};
+
+		PreskinJob(IAllocator& allocator) : m_dispatches(allocator) {}
+
+		void setup() override {}
+
+		void execute() override {
+			PROFILE_FUNCTION();
+			if (m_dispatches.empty()) return;
+
+			gpu::pushDebugGroup("preskin");
+			gpu::useProgram(m_program);
+			for (const Dispatch& d : m_dispatches) {
+				m_pipeline->setDrawcallData(&d.dc, sizeof(d.dc));
+				gpu::bindShaderBuffer(d.vertices, 0, gpu::BindShaderBufferFlags::NONE);
+				gpu::bindShaderBuffer(d.output, 1, gpu::BindShaderBufferFlags::OUTPUT);
+				gpu::bindShaderBuffer(d.bones, 10, gpu::BindShaderBufferFlags::NONE);
+				gpu::dispatch((d.dc.vertex_count + 63) / 64, 1, 1);
+			}
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 10, gpu::BindShaderBufferFlags::NONE);
+			gpu::memoryBarrier();
+			gpu::popDebugGroup();
+		}
+
+		Array<Dispatch> m_dispatches;
+		gpu::ProgramHandle m_program;
+		PipelineImpl* m_pipeline;
+	};
+
+	// skin meshes on gpu once per frame, passes then render them as rigid meshes
+	// meshes whose pose did not change since the last time are not skinned again
+	void preskin() {
+		PROFILE_FUNCTION();
+		if (!m_preskin_shader->isReady()) return;
+		const gpu::ProgramHandle program = m_preskin_shader->getProgram(gpu::VertexDecl(), 0);
+		if (!program) return;
+
+		++m_preskin_frame;
+		PreskinJob& job = m_renderer.createJob<PreskinJob>(m_allocator);
+		job.m_program = program;
+		job.m_pipeline = this;
+
+		Span<const ModelInstance> instances = m_scene->getModelInstances();
+		Span<Pose* const> poses = m_scene->getModelInstancePoses();
+		for (u32 i = 0, c = instances.length(); i < c; ++i) {
+			const ModelInstance& mi = instances[i];
+			if (!mi.flags.isSet(ModelInstance::VALID) || !mi.flags.isSet(ModelInstance::ENABLED)) continue;
+			if (!mi.model || !mi.model->isReady() || !poses[i]) continue;
+			const Pose& pose = *poses[i];
+
+			for (u32 mesh_idx = 0; mesh_idx < mi.mesh_count; ++mesh_idx) {
+				const Mesh& mesh = mi.meshes[mesh_idx];
+				if (mesh.type != Mesh::SKINNED) continue;
+				// lod is not streamed in
+				if (!mesh.render_data->vertex_buffer_handle) continue;
+
+				const u64 key = i | ((u64)mesh_idx << 32);
+				auto iter = m_preskinned.find(key);
+				if (!iter.isValid() || iter.value().mesh != &mesh) {
+					if (iter.isValid()) {
+						m_renderer.destroy(iter.value().buffer);
+						m_preskinned.erase(iter);
+					}
+					Preskinned p;
+					p.mesh = &mesh;
+					p.pose_version = pose.version - 1;
+					Renderer::MemRef mem;
+					mem.size = mesh.vertices.size() * 11 * sizeof(float);
+					p.buffer = m_renderer.createBuffer(mem, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE);
+					iter = m_preskinned.insert(key, p);
+				}
+				Preskinned& p = iter.value();
+				p.frame = m_preskin_frame;
+				if (p.pose_version == pose.version) continue;
+				p.pose_version = pose.version;
+
+				const Renderer::TransientSlice bones = m_renderer.allocTransient(pose.count * sizeof(DualQuat));
+				DualQuat* LUMIX_RESTRICT bones_data = (DualQuat*)bones.ptr;
+				for (u32 j = 0; j < pose.count; ++j) {
+					const Model::Bone& bone = mi.model->getBone(j);
+					const LocalRigidTransform tmp = {pose.positions[j], pose.rotations[j]};
+					bones_data[j] = (tmp * bone.inv_bind_transform).toDualQuat();
+				}
+
+				PreskinJob::Dispatch& d = job.m_dispatches.emplace();
+				d.vertices = mesh.render_data->vertex_buffer_handle;
+				d.output = p.buffer;
+				d.bones = bones.buffer;
+				d.dc.stride = mesh.render_data->vb_stride;
+				d.dc.vertex_count = mesh.vertices.size();
+				d.dc.bones_offset = bones.offset / sizeof(Vec4);
+				for (u32 a = 0; a < 6; ++a) {
+					d.dc.attributes[a][0] = 0;
+					d.dc.attributes[a][1] = 0xff;
+					d.dc.attributes[a][2] = 0;
+					d.dc.attributes[a][3] = 0;
+				}
+				for (u32 a = 0; a < mesh.vertex_decl.attributes_count; ++a) {
+					const gpu::Attribute& attr = mesh.vertex_decl.attributes[a];
+					if (attr.idx >= 6 || (attr.flags & gpu::Attribute::INSTANCED)) continue;
+					d.dc.attributes[attr.idx][0] = attr.byte_offset;
+					d.dc.attributes[attr.idx][1] = (u32)attr.type;
+					d.dc.attributes[attr.idx][2] = attr.components_count;
+					d.dc.attributes[attr.idx][3] = (attr.flags & gpu::Attribute::NORMALIZED) ? 1 : 0;
+				}
+			}
+		}
+
+		// model instance was destroyed, disabled or changed its model
+		for (auto iter = m_preskinned.begin(); iter.isValid();) {
+			if (iter.value().frame != m_preskin_frame) {
+				m_renderer.destroy(iter.value().buffer);
+				m_preskinned.erase(iter);
+				iter = m_preskinned.begin();
+			}
+			else {
+				++iter;
+			}
+		}
+
+		queue(job, m_profiler_link);
+	}
+
 	u32 createBucket(u32 view_id, const char* layer_name, const char* define, LuaWrapper::Optional<const char*> sort_str) {
 		const u8 layer = m_renderer.getLayerIdx(layer_name);
 		const Bucket::Sort sort = equalStrings(sort_str.get(""), "depth") ? Bucket::DEPTH : Bucket::DEFAULT;
@@ -3741,11 +5676,26 @@ struct PipelineImpl final : Pipeline
 	}
 
 	void renderBucket(u32 bucket_id, RenderState state) {
-		RenderBucketJob& job = m_renderer.createJob<RenderBucketJob>();
+		RenderBucketJob& job = m_renderer.createJob<RenderBucketJob>(m_allocator);
 		job.m_render_state = state.value;
 		job.m_pipeline = this;
 		job.m_bucket_id = bucket_id;
-		m_renderer.queue(job, m_profiler_link);
+
+		if (m_cull_meshlets_shader->isReady()) {
+			job.m_cull_meshlets_program = m_cull_meshlets_shader->getProgram(gpu::VertexDecl(), 0);
+			const View& view = m_views[m_buckets[bucket_id].view_id];
+			// normal cones are tested against camera position
+			job.m_cone_culling = !view.cp.is_shadow && !m_viewport.is_ortho;
+			const Span<const float> depth = view.occlusion ? view.occlusion->getTileDepth() : Span<const float>();
+			if (depth.length() > 0) {
+				job.m_occlusion_depth.resize(depth.length());
+				memcpy(job.m_occlusion_depth.begin(), depth.begin(), depth.length() * sizeof(float));
+				Matrix translation = Matrix::IDENTITY;
+				translation.setTranslation(Vec3(view.cp.pos - view.occlusion->getCameraPos()));
+				job.m_occlusion_view_projection = view.occlusion->getViewProjection() * translation;
+			}
+		}
+		queue(job, m_profiler_link);
 	}
 
 	void fillClusters(LuaWrapper::Optional<CameraParams> cp) {
@@ -3759,6 +5709,12 @@ struct PipelineImpl final : Pipeline
 			job.m_is_clear = true;
 		}
 
+		if (m_fill_clusters_shader->isReady()) {
+			job.m_program = m_fill_clusters_shader->getProgram(gpu::VertexDecl(), 0);
+			// cpu path is used until the program is compiled
+			job.m_use_compute = job.m_program && m_compute_clusters_ready && !job.m_is_clear;
+		}
+
 		CullResult* lights = m_scene->getRenderables(cp.value.frustum, RenderableTypes::LOCAL_LIGHT);
 		const Universe& universe = m_scene->getUniverse();
 		const DVec3 cam_pos = m_viewport.pos;
@@ -3802,16 +5758,24 @@ struct PipelineImpl final : Pipeline
 			m_shadow_atlas.texture = m_renderer.createTexture(ShadowAtlas::SIZE, ShadowAtlas::SIZE, 1, gpu::TextureFormat::D32, gpu::TextureFlags::NO_MIPS, Renderer::MemRef(), "shadow_atlas");
 		}
 
+		m_shadow_atlas.moved_casters.clear();
+		if (m_scene->getMovedShadowCasters(m_shadow_atlas.moved_casters_cursor, m_shadow_atlas.moved_casters)) {
+			m_shadow_atlas.invalidate(m_shadow_atlas.moved_casters);
+		}
+		else {
+			m_shadow_atlas.invalidateAll();
+		}
+
 		for (u32 i = 0; i < atlas_sorter.count; ++i) {
 			FillClustersJob::ClusterPointLight& light = job.m_point_lights[atlas_sorter.lights[i].idx];
 			EntityRef e = atlas_sorter.lights[i].entity;
 			PointLight& pl = m_scene->getPointLight(e);
 			if (light.atlas_idx == -1) {
 				light.atlas_idx = m_shadow_atlas.add(ShadowAtlas::getGroup(i), e);
-				bakeShadow(pl, light.atlas_idx);
 			}
-			else if (pl.flags.isSet(PointLight::DYNAMIC)) {
-				bakeShadow(pl, light.atlas_idx);
+			const Transform tr = universe.getTransform(e);
+			if (m_shadow_atlas.isStale(light.atlas_idx, pl, tr)) {
+				if (bakeShadow(pl, light.atlas_idx)) m_shadow_atlas.baked(light.atlas_idx, pl, tr);
 			}
 			const Matrix mtx = getShadowMatrix(pl, light.atlas_idx);
 			job.m_shadow_atlas_matrices[light.atlas_idx] = mtx;
@@ -3819,7 +5783,68 @@ struct PipelineImpl final : Pipeline
 
 		if (lights) lights->free(m_renderer.getEngine().getPageAllocator());
 
-		m_renderer.queue(job, m_profiler_link);
+		if (cp.valid && m_clustered_decals) fillClusterDecals(job, cp.value);
+
+		queue(job, m_profiler_link);
+	}
+
+	// decals with default decal shaders are applied in one deferred pass (clustered_decals.shd) instead of per material draws
+	bool isClusteredDecal(const Material* material) const {
+		if (!m_clustered_decals) return false;
+		if (!material->isReady() || material->getLayer() != m_decal_layer) return false;
+		const Texture* texture = material->getTexture(0);
+		if (!texture || !texture->handle) return false;
+
+		static const Path decal_shader("pipelines/decal.shd");
+		static const Path curve_decal_shader("pipelines/curve_decal.shd");
+		const Path& path = material->getShader()->getPath();
+		return path == decal_shader || path == curve_decal_shader;
+	}
+
+	void fillClusterDecals(FillClustersJob& job, const CameraParams& cp) {
+		PROFILE_FUNCTION();
+		const Universe& universe = m_scene->getUniverse();
+		const DVec3 cam_pos = m_viewport.pos;
+		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
+
+		auto push = [&](const Material* material, const Vec3& half_extents, const Vec2& uv_scale, EntityRef e) -> FillClustersJob::ClusterDecal& {
+			const Transform tr = universe.getTransform(e);
+			FillClustersJob::ClusterDecal& decal = job.m_decals.emplace();
+			decal.pos = Vec3(tr.pos - cam_pos);
+			decal.rot = tr.rot;
+			decal.half_extents = half_extents;
+			decal.uv_scale = uv_scale;
+			decal.is_curve = 0;
+			decal.bezier = Vec4(0);
+			// converted to bindless handle in render thread
+			decal.texture = (u64)(uintptr)material->getTexture(0)->handle;
+			decal.color = material->getColor();
+			return decal;
+		};
+
+		if (CullResult* decals = m_scene->getRenderables(cp.frustum, RenderableTypes::DECAL)) {
+			decals->forEach([&](EntityRef e){
+				const Decal& d = m_scene->getDecal(e);
+				if (!isClusteredDecal(d.material)) return;
+				push(d.material, d.half_extents, d.uv_scale, e);
+			});
+			decals->free(page_allocator);
+		}
+
+		if (CullResult* decals = m_scene->getRenderables(cp.frustum, RenderableTypes::CURVE_DECAL)) {
+			decals->forEach([&](EntityRef e){
+				const CurveDecal& d = m_scene->getCurveDecal(e);
+				if (!isClusteredDecal(d.material)) return;
+				FillClustersJob::ClusterDecal& decal = push(d.material, d.half_extents, d.uv_scale, e);
+				decal.is_curve = 1;
+				decal.bezier = Vec4(d.bezier_p0, d.bezier_p2);
+			});
+			decals->free(page_allocator);
+		}
+	}
+
+	void setClusteredDecals(bool enable) {
+		m_clustered_decals = enable && gpu::isBindlessSupported();
 	}
 
 	CameraParams getShadowCameraParams(i32 slice)
@@ -3835,45 +5860,23 @@ struct PipelineImpl final : Pipeline
 		return cp;
 	}
 	
-	void setRenderTargets(Span<gpu::TextureHandle> renderbuffers, gpu::TextureHandle ds, bool readonly_ds, bool srgb) {
-		struct Cmd : Renderer::RenderJob
-		{
-			void setup() override { }
-
-			void execute() override
-			{
-				PROFILE_FUNCTION();
-			
-				gpu::setFramebuffer(rbs, count, ds, flags);
-				gpu::viewport(0, 0, w, h);
-			}
-
-			PipelineImpl* pipeline;
-			gpu::TextureHandle rbs[8];
-			gpu::TextureHandle ds;
-			gpu::FramebufferFlags flags;
-			u32 count;
-			u32 w;
-			u32 h;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+	void setRenderTargets(Span<gpu::TextureHandle> renderbuffers, gpu::TextureHandle ds, bool readonly_ds, bool srgb, const IVec2& size) {
+		CommandsJob::SetFramebuffer cmd;
 		ASSERT(renderbuffers.length() < lengthOf(cmd.rbs));
 
 		for (u32 i = 0; i < renderbuffers.length(); ++i) {
 			cmd.rbs[i] = renderbuffers[i];
 		}
 
-		cmd.pipeline = this;
 		cmd.ds = ds;
 		cmd.count = renderbuffers.length();
 		cmd.flags = srgb ? gpu::FramebufferFlags::SRGB : gpu::FramebufferFlags::NONE;
 		if (readonly_ds) {
 			cmd.flags = cmd.flags | gpu::FramebufferFlags::READONLY_DEPTH_STENCIL;
 		}
-		cmd.w = m_viewport.w;
-		cmd.h = m_viewport.h;
-		m_renderer.queue(cmd, m_profiler_link);
+		cmd.w = size.x;
+		cmd.h = size.y;
+		recordCommand(CommandsJob::Type::SET_FRAMEBUFFER).write(cmd);
 	}
 
 	static int setRenderTargets(lua_State* L, bool has_ds, bool readonly_ds) {
@@ -3898,7 +5901,15 @@ struct PipelineImpl final : Pipeline
 			ds = pipeline->m_renderbuffers[ds_idx].handle;
 		}
 
-		pipeline->setRenderTargets(Span(rbs, rb_count), ds, readonly_ds, true);
+		// targets in scaled scene size get scaled viewport, others keep the native one as before
+		IVec2 size(pipeline->m_viewport.w, pipeline->m_viewport.h);
+		const i32 first_idx = rb_count > 0 ? pipeline->toRenderbufferIdx(L, 1) : has_ds ? pipeline->toRenderbufferIdx(L, rb_count + 1) : -1;
+		if (first_idx >= 0) {
+			const Renderbuffer& first = pipeline->m_renderbuffers[first_idx];
+			if (first.width == (u32)pipeline->m_scene_size.x && first.height == (u32)pipeline->m_scene_size.y) size = pipeline->m_scene_size;
+		}
+
+		pipeline->setRenderTargets(Span(rbs, rb_count), ds, readonly_ds, true, size);
 		return 0;
 	}
 
@@ -3919,12 +5930,13 @@ struct PipelineImpl final : Pipeline
 		RenderGrassCommand(IAllocator& allocator)
 			: m_allocator(allocator)
 			, m_grass(allocator)
+			, m_occlusion_depth(allocator)
 		{
 		}
 
 		void setup() override {
 			PROFILE_FUNCTION();
-			const HashMap<EntityRef, Terrain*>& terrains = m_pipeline->m_scene->getTerrains();
+			const ComponentMap<Terrain*>& terrains = m_pipeline->m_scene->getTerrains();
 			const Universe& universe = m_pipeline->m_scene->getUniverse();
 
 			float fov_multiplier = 1;
@@ -3940,8 +5952,9 @@ struct PipelineImpl final : Pipeline
 				for (Terrain::GrassType& type : terrain->m_grass_types) {
 					if (!type.m_grass_model || !type.m_grass_model->isReady()) continue;
 
-					const i32 mesh_count = type.m_grass_model->getLODIndices()[0].to;
-					for (i32 i = 0; i <= mesh_count; ++i) {
+					const u32 lod_idx = type.m_grass_model->useLOD(0);
+					const LODMeshIndices& lod = type.m_grass_model->getLODIndices()[lod_idx];
+					for (i32 i = lod.from; i <= lod.to; ++i) {
 						const Mesh& mesh = type.m_grass_model->getMesh(i);
 						Grass& grass = m_grass.emplace();
 						grass.mesh = mesh.render_data;
@@ -3981,6 +5994,13 @@ struct PipelineImpl final : Pipeline
 			gpu::pushDebugGroup("grass");
 			renderer.beginProfileBlock("grass", 0);
 			gpu::BufferHandle data = m_pipeline->m_renderer.getScratchBuffer();
+			if (!m_occlusion_depth.empty()) {
+				if (!m_pipeline->m_grass_occlusion_buffer) {
+					m_pipeline->m_grass_occlusion_buffer = gpu::allocBufferHandle();
+					gpu::createBuffer(m_pipeline->m_grass_occlusion_buffer, gpu::BufferFlags::SHADER_BUFFER, m_occlusion_depth.byte_size(), nullptr);
+				}
+				gpu::update(m_pipeline->m_grass_occlusion_buffer, m_occlusion_depth.begin(), m_occlusion_depth.byte_size());
+			}
 			struct Indirect {
 				u32 vertex_count;
 				u32 instance_count;
@@ -4005,6 +6025,9 @@ struct PipelineImpl final : Pipeline
 					float radius;
 					u32 rotation_mode;
 					Vec2 terrain_xz_scale;
+					Matrix occlusion_view_projection;
+					u32 occlusion;
+					u32 max_instances;
 				} dc;
 				dc.pos = Vec4(grass.mtx.getTranslation(), 1);
 				dc.lod_ref_point = Vec4(grass.lod_ref_point, 1);
@@ -4020,7 +6043,10 @@ struct PipelineImpl final : Pipeline
 				dc.radius = grass.radius;
 				dc.rotation_mode = grass.rotation_mode;
 				dc.terrain_xz_scale = grass.terrain_xz_scale;
-				gpu::update(m_pipeline->m_drawcall_ub, &dc, sizeof(dc));
+				dc.occlusion_view_projection = m_occlusion_view_projection;
+				dc.occlusion = m_occlusion_depth.empty() ? 0 : 1;
+				dc.max_instances = (Renderer::SCRATCH_BUFFER_SIZE - 32) / 32;
+				m_pipeline->setDrawcallData(&dc, sizeof(dc));
 
 				Indirect indirect_dc;
 				indirect_dc.base_instance = 0;
@@ -4031,18 +6057,19 @@ struct PipelineImpl final : Pipeline
 				gpu::update(data, &indirect_dc, sizeof(indirect_dc));
 
 				gpu::bindShaderBuffer(data, 0, gpu::BindShaderBufferFlags::OUTPUT);
+				if (!m_occlusion_depth.empty()) gpu::bindShaderBuffer(m_pipeline->m_grass_occlusion_buffer, 1, gpu::BindShaderBufferFlags::NONE);
 				gpu::bindTextures(&grass.heightmap, 2, 1);
 				gpu::bindTextures(&grass.splatmap, 3, 1);
-				gpu::bindUniformBuffer(UniformBuffer::DRAWCALL, m_pipeline->m_drawcall_ub, 0, sizeof(dc));
 				gpu::useProgram(m_compute_shader);
 				const IVec2 size =  (grass.to - grass.from) / grass.step;
 				gpu::dispatch((size.x + 15) / 16, (size.y + 15) / 16, 1);
 				
 				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
 				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1, gpu::BindShaderBufferFlags::NONE);
+				gpu::memoryBarrier();
 
 				gpu::useProgram(grass.program);
-				gpu::bindTextures(grass.material->textures, 0, grass.material->textures_count);
+				if (!grass.material->bindless) gpu::bindTextures(grass.material->textures, 0, grass.material->textures_count);
 				gpu::bindIndexBuffer(grass.mesh->index_buffer_handle);
 				gpu::bindVertexBuffer(0, grass.mesh->vertex_buffer_handle, 0, grass.mesh->vb_stride);
 				gpu::bindVertexBuffer(1, data, (sizeof(Indirect) + 15) & ~15, 32);
@@ -4089,6 +6116,9 @@ struct PipelineImpl final : Pipeline
 		IAllocator& m_allocator;
 		gpu::ProgramHandle m_compute_shader;
 		Array<Grass> m_grass;
+		// farthest depth of occlusion buffer tiles, empty if there's no occlusion for this view
+		Array<float> m_occlusion_depth;
+		Matrix m_occlusion_view_projection;
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
 		gpu::StateFlags m_render_state;
@@ -4123,6 +6153,15 @@ struct PipelineImpl final : Pipeline
 				inst.hm_size = info.terrain->getSize();
 				inst.program = info.shader->getProgram(gpu::VertexDecl(), m_define_mask);
 				inst.material = info.terrain->m_material->getRenderData();
+				if (m_vt_program && info.terrain->m_splatmap && info.terrain->m_splatmap->isReady()) {
+					Terrain* terrain = info.terrain;
+					inst.terrain = terrain;
+					inst.vt_program = info.shader->getProgram(gpu::VertexDecl(), m_define_mask | m_vt_define_mask);
+					inst.splatmap = terrain->m_splatmap->handle;
+					inst.splatmap_size = IVec2(terrain->m_splatmap->width, terrain->m_splatmap->height);
+					inst.splatmap_version = terrain->m_splatmap_version;
+					memcpy(inst.splatmap_changes, terrain->m_splatmap_changes, sizeof(inst.splatmap_changes));
+				}
 				if (isinf(inst.pos.x) || isinf(inst.pos.y) || isinf(inst.pos.z)) m_instances.pop();
 			}
 		}
@@ -4136,9 +6175,26 @@ struct PipelineImpl final : Pipeline
 			gpu::StateFlags state = m_render_state;
 			Renderer& renderer = m_pipeline->m_renderer;
 			renderer.beginProfileBlock("terrain", 0);
+			if (m_vt_program) ++m_pipeline->m_terrain_vts_frame;
 			for (Instance& inst : m_instances) {
-				gpu::useProgram(inst.program);
 				gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, inst.material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
+				TerrainVirtualTexture* vt = inst.terrain ? updateVirtualTexture(inst) : nullptr;
+				bool vt_feedback = false;
+				if (vt) {
+					inst.program = inst.vt_program;
+					const gpu::TextureHandle vt_textures[] = { vt->albedo, vt->normal, vt->indirection };
+					gpu::bindTextures(vt_textures, 6, lengthOf(vt_textures));
+					if (!vt->readback && vt->frames_to_feedback-- == 0) {
+						vt->frames_to_feedback = TerrainVirtualTexture::FEEDBACK_INTERVAL - 1;
+						// feedback_data are zeroed after they are processed
+						const u32 size = TerrainVirtualTexture::FEEDBACK_WIDTH * TerrainVirtualTexture::FEEDBACK_HEIGHT;
+						gpu::update(vt->feedback, 0, 0, 0, 0, TerrainVirtualTexture::FEEDBACK_WIDTH, TerrainVirtualTexture::FEEDBACK_HEIGHT, gpu::TextureFormat::R8, vt->feedback_data.begin(), size);
+						gpu::bindImageTexture(vt->feedback, 0);
+						vt->feedback_jitter = (vt->feedback_jitter + 7) % 16;
+						vt_feedback = true;
+					}
+				}
+				gpu::useProgram(inst.program);
 				
 				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
 				gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
@@ -4152,14 +6208,27 @@ struct PipelineImpl final : Pipeline
 					Vec4 terrain_scale;
 					Vec2 hm_size;
 					float cell_size;
+					float pad;
+					Vec4 lod_pos;
+					IVec4 vt;
 				} dc_data;
+				dc_data.vt = IVec4(IVec2(vt_feedback ? 1 : 0, vt ? vt->feedback_jitter : 0), IVec2(0));
 				dc_data.pos = Vec4(inst.pos, 0);
 				dc_data.lpos = Vec4(inst.rot.conjugated().rotate(-inst.pos), 0);
 				dc_data.hm_size = inst.hm_size;
 
 				const Vec3 ref_pos = inst.rot.conjugated().rotate(-inst.ref_pos);
+				dc_data.lod_pos = Vec4(ref_pos, 0);
+
+				if (m_quadtree_program) {
+					dc_data.terrain_scale = Vec4(inst.scale, 0);
+					dc_data.cell_size = inst.scale.x;
+					renderQuadtree(inst, state, material_ub, &dc_data, sizeof(dc_data));
+					if (vt_feedback) requestFeedback(*vt);
+					continue;
+				}
 
-				gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
+				if (!inst.material->bindless) gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
 
 				gpu::setState(state);
 				IVec4 prev_from_to;
@@ -4185,7 +6254,7 @@ struct PipelineImpl final : Pipeline
 						dc_data.from_to = IVec4(subfrom, subto);
 						dc_data.terrain_scale = Vec4(inst.scale, 0);
 						dc_data.cell_size = s;
-						gpu::update(m_pipeline->m_drawcall_ub, &dc_data, sizeof(dc_data));
+						m_pipeline->setDrawcallData(&dc_data, sizeof(dc_data));
 						gpu::drawArraysInstanced(gpu::PrimitiveType::TRIANGLE_STRIP, (subto.x - subfrom.x) * 2 + 2, subto.y - subfrom.y);
 						m_pipeline->m_stats.draw_call_count += 1;
 						m_pipeline->m_stats.instance_count += 1;
@@ -4209,11 +6278,29 @@ struct PipelineImpl final : Pipeline
 					s *= 2;
 					prev_from_to = IVec4(from / 2, to / 2);
 				}
-
+				if (vt_feedback) requestFeedback(*vt);
+			}
+			
+			// virtual textures of terrains, which are not rendered anymore
+			if (m_vt_program) {
+				const u32 frame = m_pipeline->m_terrain_vts_frame;
+				IAllocator& allocator = renderer.getAllocator();
+				m_pipeline->m_terrain_vts.eraseIf([frame, &allocator](TerrainVirtualTexture* vt){
+					if (frame - vt->last_used_frame < 60) return false;
+					vt->destroyTextures();
+					LUMIX_DELETE(allocator, vt);
+					return true;
+				});
 			}
 			renderer.endProfileBlock();
 		}
 
+		void requestFeedback(TerrainVirtualTexture& vt) {
+			gpu::bindImageTexture(gpu::INVALID_TEXTURE, 0);
+			gpu::memoryBarrier();
+			vt.readback = gpu::readTextureAsync(vt.feedback, 0);
+		}
+
 		struct Instance
 		{
 			Vec2 hm_size;
@@ -4223,8 +6310,159 @@ struct PipelineImpl final : Pipeline
 			Vec3 scale;
 			gpu::ProgramHandle program;
 			Material::RenderData* material;
+			// virtual texture, set only if enabled
+			Terrain* terrain = nullptr;
+			gpu::ProgramHandle vt_program;
+			gpu::TextureHandle splatmap;
+			IVec2 splatmap_size;
+			u32 splatmap_version;
+			IVec4 splatmap_changes[Terrain::SPLATMAP_CHANGES_COUNT];
 		};
 
+		// returns null if virtual texture can not be used yet
+		TerrainVirtualTexture* updateVirtualTexture(const Instance& inst) {
+			PROFILE_FUNCTION();
+			PipelineImpl* pipeline = m_pipeline;
+			const u32 frame = pipeline->m_terrain_vts_frame;
+			auto iter = pipeline->m_terrain_vts.find(inst.terrain);
+			TerrainVirtualTexture* vt;
+			if (iter.isValid()) {
+				vt = iter.value();
+			}
+			else {
+				vt = LUMIX_NEW(pipeline->m_renderer.getAllocator(), TerrainVirtualTexture)(pipeline->m_renderer.getAllocator());
+				vt->createTextures();
+				vt->splatmap = inst.splatmap;
+				vt->splatmap_version = inst.splatmap_version;
+				pipeline->m_terrain_vts.insert(inst.terrain, vt);
+			}
+			vt->last_used_frame = frame;
+
+			// terrain's splatmap was replaced or terrain was recreated at the same address
+			if (vt->splatmap != inst.splatmap || vt->splatmap_version > inst.splatmap_version || inst.splatmap_version - vt->splatmap_version > Terrain::SPLATMAP_CHANGES_COUNT) {
+				vt->reset();
+			}
+			else {
+				const Vec2 size = Vec2(inst.splatmap_size - IVec2(1));
+				for (u32 i = vt->splatmap_version; i != inst.splatmap_version; ++i) {
+					const IVec4 rect = inst.splatmap_changes[i % Terrain::SPLATMAP_CHANGES_COUNT];
+					// neighbor texels are blended in and detail diffusion moves samples around
+					vt->invalidate(Vec4(Vec2(float(rect.x - 2), float(rect.y - 2)) / size, Vec2(float(rect.z + 2), float(rect.w + 2)) / size));
+				}
+			}
+			vt->splatmap = inst.splatmap;
+			vt->splatmap_version = inst.splatmap_version;
+
+			if (vt->readback && gpu::isReadbackReady(vt->readback)) {
+				gpu::getReadbackData(vt->readback, vt->feedback_data);
+				gpu::destroy(vt->readback);
+				vt->readback = gpu::INVALID_READBACK;
+				vt->processFeedback();
+			}
+
+			struct {
+				IVec4 page;
+				IVec4 dst;
+				Vec4 terrain_scale;
+				Vec2 hm_size;
+			} dc_data;
+			dc_data.terrain_scale = Vec4(inst.scale, 0);
+			dc_data.hm_size = inst.hm_size;
+
+			// pages would be marked resident without being composited
+			const bool can_composite = gpu::isProgramReady(m_vt_program);
+			bool composited = false;
+			for (u32 i = 0; can_composite && i < TerrainVirtualTexture::MAX_COMPOSITED_PAGES && !vt->missing.empty(); ++i) {
+				const u32 page = vt->missing.back();
+				const u16 slot = vt->allocSlot(page);
+				if (slot == TerrainVirtualTexture::INVALID_SLOT) break;
+				vt->missing.pop();
+
+				if (!composited) {
+					gpu::useProgram(m_vt_program);
+					gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
+					gpu::bindImageTexture(vt->albedo, 0);
+					gpu::bindImageTexture(vt->normal, 1);
+					composited = true;
+				}
+
+				const u32 mip = vt->getMip(page);
+				const u32 pages_count = TerrainVirtualTexture::PAGES >> mip;
+				const u32 idx = page - vt->mip_offsets[mip];
+				dc_data.page = IVec4(IVec2(idx % pages_count, idx / pages_count), IVec2(mip, pages_count));
+				const IVec2 dst_offset(slot % TerrainVirtualTexture::CACHE_SIZE, slot / TerrainVirtualTexture::CACHE_SIZE);
+				dc_data.dst = IVec4(dst_offset * TerrainVirtualTexture::PAGE_STRIDE, IVec2(TerrainVirtualTexture::PAGE_SIZE, TerrainVirtualTexture::PAGE_BORDER));
+				pipeline->setDrawcallData(&dc_data, sizeof(dc_data));
+				gpu::dispatch((TerrainVirtualTexture::PAGE_STRIDE + 7) / 8, (TerrainVirtualTexture::PAGE_STRIDE + 7) / 8, 1);
+			}
+			if (composited) {
+				gpu::bindImageTexture(gpu::INVALID_TEXTURE, 0);
+				gpu::bindImageTexture(gpu::INVALID_TEXTURE, 1);
+				gpu::memoryBarrier();
+			}
+
+			if (vt->indirection_dirty) vt->updateIndirection();
+			if (!vt->isRootResident() || !gpu::isProgramReady(inst.vt_program)) return nullptr;
+			return vt;
+		}
+
+		// patches are selected by distance to camera on gpu and drawn with a single indirect draw
+		void renderQuadtree(const Instance& inst, gpu::StateFlags state, gpu::BufferHandle material_ub, const void* dc_data, u32 dc_size) {
+			PipelineImpl* pipeline = m_pipeline;
+			if (!pipeline->m_terrain_patches) {
+				pipeline->m_terrain_patches = gpu::allocBufferHandle();
+				gpu::createBuffer(pipeline->m_terrain_patches, gpu::BufferFlags::SHADER_BUFFER, 32 + TERRAIN_MAX_PATCHES * sizeof(Vec4), nullptr);
+			}
+
+			const u32 header[8] = { TERRAIN_PATCH_INDICES_COUNT, 0, 0, 0, 0, 0, 0, 0 };
+			gpu::update(pipeline->m_terrain_patches, header, sizeof(header));
+
+			struct {
+				Vec4 pos;
+				Vec4 lod_pos;
+				Vec4 terrain_scale;
+				Vec2 hm_size;
+				float patch_size;
+				u32 level;
+				u32 levels_count;
+				u32 max_patches;
+			} select_data;
+			select_data.pos = Vec4(inst.pos, 0);
+			select_data.lod_pos = Vec4(inst.rot.conjugated().rotate(-inst.ref_pos), 0);
+			select_data.terrain_scale = Vec4(inst.scale, 0);
+			select_data.hm_size = inst.hm_size;
+			select_data.patch_size = inst.scale.x * 16;
+			select_data.max_patches = TERRAIN_MAX_PATCHES;
+
+			const u32 patches_count = u32(ceilf(maximum(inst.hm_size.x, inst.hm_size.y) / select_data.patch_size));
+			select_data.levels_count = 1;
+			while ((1u << (select_data.levels_count - 1)) < patches_count) ++select_data.levels_count;
+
+			gpu::bindShaderBuffer(pipeline->m_terrain_patches, 0, gpu::BindShaderBufferFlags::OUTPUT);
+			gpu::useProgram(m_quadtree_program);
+			for (u32 level = 0; level < select_data.levels_count; ++level) {
+				select_data.level = level;
+				const u32 count = (patches_count + (1 << level) - 1) >> level;
+				pipeline->setDrawcallData(&select_data, sizeof(select_data));
+				gpu::dispatch((count + 7) / 8, (count + 7) / 8, 1);
+			}
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0, gpu::BindShaderBufferFlags::NONE);
+			gpu::memoryBarrier();
+
+			gpu::useProgram(inst.program);
+			gpu::bindUniformBuffer(UniformBuffer::MATERIAL, material_ub, inst.material->material_constants * sizeof(MaterialConsts), sizeof(MaterialConsts));
+			if (!inst.material->bindless) gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
+			gpu::setState(state);
+			pipeline->setDrawcallData(dc_data, dc_size);
+			gpu::bindShaderBuffer(pipeline->m_terrain_patches, 2, gpu::BindShaderBufferFlags::NONE);
+			gpu::bindIndexBuffer(pipeline->m_terrain_patch_ib);
+			gpu::bindIndirectBuffer(pipeline->m_terrain_patches);
+			gpu::drawIndirect(gpu::DataType::U16);
+			gpu::bindIndirectBuffer(gpu::INVALID_BUFFER);
+			gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 2, gpu::BindShaderBufferFlags::NONE);
+			pipeline->m_stats.draw_call_count += 1;
+		}
+
 		IAllocator& m_allocator;
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
@@ -4233,43 +6471,138 @@ struct PipelineImpl final : Pipeline
 		gpu::TextureHandle m_global_textures[16];
 		int m_global_textures_count = 0;
 		u32 m_define_mask = 0;
+		gpu::ProgramHandle m_quadtree_program = gpu::INVALID_PROGRAM;
+		gpu::ProgramHandle m_vt_program = gpu::INVALID_PROGRAM;
+		u32 m_vt_define_mask = 0;
 	};
 
-	void createSortKeys(PipelineImpl::View& view) {
-		if (view.renderables->header.count == 0 && !view.renderables->header.next) return;
-		PagedListIterator<const CullResult> iterator(view.renderables);
+	void invalidate(SortKeyCache& cache) {
+		cache.valid = false;
+		cache.instancers.clear();
+		if (cache.instance_buffer) {
+			m_renderer.destroy(cache.instance_buffer);
+			cache.instance_buffer = gpu::INVALID_BUFFER;
+		}
+		// render thread can still replay them
+		for (BakedBucket* baked : cache.baked) {
+			m_renderer.runInRenderThread(baked, [](Renderer& renderer, void* ptr){
+				LUMIX_DELETE(renderer.getAllocator(), (BakedBucket*)ptr);
+			});
+		}
+		cache.baked.clear();
+	}
 
-		view.instancers.reserve(jobs::getWorkersCount());
-		for (u8 i = 0; i < jobs::getWorkersCount(); ++i) {
-			view.instancers.emplace(m_allocator, m_renderer.getEngine().getPageAllocator());
+	void createSortKeys(PipelineImpl::View& view) {
+		SortKeyCache* cache = view.sort_key_cache;
+		if (view.renderables->header.count == 0 && !view.renderables->header.next) {
+			if (cache) invalidate(*cache);
+			return;
 		}
+		PagedListIterator<const CullResult> iterator(view.renderables);
 
 		const float time_delta = m_renderer.getEngine().getLastTimeDelta();
 		volatile i32 worker_idx = 0;
+		volatile i32 occluded_meshes = 0;
+		volatile i32 lod_changes = 0;
+		volatile i32 lod_transitions = 0;
+		const OcclusionBuffer* occlusion = view.occlusion;
+		// texture streaming feedback, object's radius times this (divided by distance if perspective) is its size on screen in pixels
+		const bool is_ortho = m_viewport.is_ortho;
+		const float screen_size_scale = view.cp.is_shadow ? 0
+			: is_ortho ? m_viewport.h / m_viewport.ortho_size
+			: m_viewport.h / tanf(m_viewport.fov * 0.5f);
+		const DVec3 camera_pos = view.cp.pos;
+		const DVec3 lod_ref_point = m_viewport.pos;
+		// lod distances are for 60 degrees fov, objects are selected by their size on screen
+		const float lod_distance_scale = (is_ortho ? 1 : tanf(m_viewport.fov * 0.5f) / tanf(degreesToRadians(30))) * m_lod_bias;
+		const float lod_squared_distance_scale = lod_distance_scale * lod_distance_scale;
+		const u32 sort_keys_version = m_renderer.getSortKeysVersion();
+		const CameraParams::Casters casters = view.cp.casters;
+		// moved and animated instances are dynamic shadow casters, see CameraParams::casters
+		auto is_caster = [casters](const ModelInstance& mi){
+			if (casters == CameraParams::Casters::ALL) return true;
+			const bool dynamic = mi.flags.isSet(ModelInstance::DYNAMIC) || mi.model->isSkinned();
+			return dynamic == (casters == CameraParams::Casters::DYNAMIC);
+		};
+
+		u32 shared_bucket_map[255];
+		for (u32 i = 0; i < 255; ++i) {
+			shared_bucket_map[i] = view.layer_to_bucket[i];
+			if (shared_bucket_map[i] == 0xff) {
+				shared_bucket_map[i] = 0xffFFffFF;
+			}
+			else if (m_buckets[shared_bucket_map[i]].sort == Bucket::DEPTH) {
+				shared_bucket_map[i] |= 0x100;
+			}
+		}
+
+		// occlusion culled meshes change with every occluder's move, so such views are not cached
+		const bool use_cache = cache
+			&& cache->valid
+			&& !view.meshes_changed
+			&& !occlusion
+			&& cache->instancers.size() == jobs::getWorkersCount()
+			&& cache->camera_pos.x == camera_pos.x && cache->camera_pos.y == camera_pos.y && cache->camera_pos.z == camera_pos.z
+			&& cache->lod_ref_point.x == lod_ref_point.x && cache->lod_ref_point.y == lod_ref_point.y && cache->lod_ref_point.z == lod_ref_point.z
+			&& cache->screen_size_scale == screen_size_scale
+			&& cache->sort_keys_version == sort_keys_version
+			&& cache->lod_version == m_lod_version
+			&& cache->render_data_version == m_renderer.getRenderDataVersion()
+			&& cache->casters == view.cp.casters
+			&& memcmp(cache->bucket_map, shared_bucket_map, sizeof(shared_bucket_map)) == 0;
+		const bool fill_cache = cache && !use_cache && !occlusion;
+		// instance data in persistent buffer is still valid
+		const bool fill_instance_data = !use_cache || !cache->instance_buffer;
+		Mutex cache_mutex;
+
+		if (use_cache) {
+			view.instancers.swap(cache->instancers);
+		}
+		else {
+			view.instancers.reserve(jobs::getWorkersCount());
+			for (u8 i = 0; i < jobs::getWorkersCount(); ++i) {
+				view.instancers.emplace(m_allocator, m_renderer.getEngine().getPageAllocator());
+			}
+			if (cache) invalidate(*cache);
+			if (fill_cache) {
+				cache->keys.clear();
+				cache->values.clear();
+				cache->screen_sizes.clear();
+			}
+		}
 
 		jobs::runOnWorkers([&](){
 			PROFILE_BLOCK("create keys");
 			int total = 0;
 			u32 bucket_map[255];
-			for (u32 i = 0; i < 255; ++i) {
-				bucket_map[i] = view.layer_to_bucket[i];
-				if (bucket_map[i] == 0xff) {
-					bucket_map[i] = 0xffFFffFF;
-				}
-				else if (m_buckets[bucket_map[i]].sort == Bucket::DEPTH) {
-					bucket_map[i] |= 0x100;
-				}
-			}
+			memcpy(bucket_map, shared_bucket_map, sizeof(bucket_map));
 			RenderScene* scene = m_scene;
 			ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances().begin();
 			const Transform* LUMIX_RESTRICT entity_data = scene->getUniverse().getTransforms();
-			const DVec3 camera_pos = view.cp.pos;
-			const DVec3 lod_ref_point = m_viewport.pos;
 			Sorter::Inserter inserter(view.sorter);
 
 			const i32 instancer_idx = atomicIncrement(&worker_idx) - 1;
 			AutoInstancer& instancer = view.instancers[instancer_idx];
-			instancer.init(m_renderer.getMaxSortKey() + 1);
+			if (!use_cache) instancer.init(m_renderer.getMaxSortKey() + 1);
+			i32 worker_occluded_meshes = 0;
+			i32 worker_lod_changes = 0;
+			i32 worker_lod_transitions = 0;
+			Array<u64> cached_keys(m_allocator);
+			Array<u64> cached_values(m_allocator);
+			Array<float> cached_screen_sizes(m_allocator);
+
+			if (use_cache && instancer_idx == 0) {
+				for (i32 i = 0, c = cache->keys.size(); i < c; ++i) {
+					inserter.push(cache->keys[i], cache->values[i]);
+					const float screen_size = cache->screen_sizes[i];
+					const u64 value = cache->values[i];
+					const ModelInstance& mi = model_instances[value & 0xffFFffFF];
+					const Mesh& mesh = mi.meshes[value >> 40];
+					if (screen_size > 0) mesh.material->reportScreenSize(screen_size);
+					// keeps cached lods resident
+					mi.model->useLOD(u32(mesh.lod));
+				}
+			}
 
 			for(;;) {
 				const CullResult* page = iterator.next();
@@ -4288,6 +6621,7 @@ struct PipelineImpl final : Pipeline
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
 							const Material* material = scene->getDecal(e).material;
+							if (isClusteredDecal(material)) continue;
 							const int layer = material->getLayer();
 							const u8 bucket = bucket_map[layer];
 							if (bucket < 0xff) {
@@ -4302,6 +6636,7 @@ struct PipelineImpl final : Pipeline
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
 							const Material* material = scene->getCurveDecal(e).material;
+							if (isClusteredDecal(material)) continue;
 							const int layer = material->getLayer();
 							const u8 bucket = bucket_map[layer];
 							if (bucket < 0xff) {
@@ -4314,19 +6649,35 @@ struct PipelineImpl final : Pipeline
 					}
 					case RenderableTypes::SKINNED:
 					case RenderableTypes::MESH_MATERIAL_OVERRIDE: {
+						// skinned meshes' aabb is in bind pose
+						const bool test_occlusion = occlusion && type != RenderableTypes::SKINNED;
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
 							const DVec3 pos = entity_data[e.index].pos;
 							ModelInstance& mi = model_instances[e.index];
+							if (!is_caster(mi)) continue;
 							const float squared_length = float(squaredLength(pos - lod_ref_point));
 								
-							const u32 lod_idx = mi.model->getLODMeshIndices(squared_length);
+							// not yet streamed lods are replaced with the closest resident one
+							const u32 lod_idx = mi.model->useLOD(mi.model->getLODMeshIndices(squared_length * lod_squared_distance_scale, mi.lod, LOD_HYSTERESIS));
+							const float radius = mi.model->getOriginBoundingRadius() * entity_data[e.index].scale;
+							const float screen_size = radius * (is_ortho ? screen_size_scale : screen_size_scale / sqrtf(squared_length));
 
 							auto create_key = [&](const LODMeshIndices& lod){
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
 									const Mesh& mesh = mi.meshes[mesh_idx];
+									if (!mesh.render_data->vertex_buffer_handle) continue;
+									if (test_occlusion && occlusion->isOccluded(entity_data[e.index], mesh.aabb)) {
+										++worker_occluded_meshes;
+										continue;
+									}
+									if (screen_size > 0) mesh.material->reportScreenSize(screen_size);
 									const u32 bucket = bucket_map[mesh.layer];
-									const u32 mesh_sort_key = mi.custom_material ? 0x00FFffFF : mesh.sort_key;
+									// instances with bindless override materials are grouped by mesh, so they can be drawn in one call
+									const bool bindless_override = mi.custom_material
+										&& mi.custom_material->isReady()
+										&& mi.custom_material->getRenderData()->bindless;
+									const u32 mesh_sort_key = mi.custom_material && !bindless_override ? 0x00FFffFF : mesh.sort_key;
 									ASSERT(!mi.custom_material || mesh_idx == 0);
 									const u64 subrenderable = e.index | type_mask | ((u64)mesh_idx << 40);
 									if (bucket < 0xff) {
@@ -4372,23 +6723,37 @@ struct PipelineImpl final : Pipeline
 						break;
 					}
 					case RenderableTypes::MESH: {
+						if (use_cache) break;
 						const bool is_shadow = view.cp.is_shadow;
+						const bool test_occlusion = occlusion;
 						for (int i = 0, c = page->header.count; i < c; ++i) {
 							const EntityRef e = renderables[i];
 							const DVec3 pos = entity_data[e.index].pos;
 							ModelInstance& mi = model_instances[e.index];
+							if (!is_caster(mi)) continue;
 							const float squared_length = float(squaredLength(pos - lod_ref_point));
 								
-							const u32 lod_idx = mi.model->getLODMeshIndices(squared_length);
+							// not yet streamed lods are replaced with the closest resident one
+							const u32 lod_idx = mi.model->useLOD(mi.model->getLODMeshIndices(squared_length * lod_squared_distance_scale, mi.lod, LOD_HYSTERESIS));
+							const float radius = mi.model->getOriginBoundingRadius() * entity_data[e.index].scale;
+							const float screen_size = radius * (is_ortho ? screen_size_scale : screen_size_scale / sqrtf(squared_length));
 
 							auto create_key = [&](const LODMeshIndices& lod){
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
 									const Mesh& mesh = mi.meshes[mesh_idx];
+									if (!mesh.render_data->vertex_buffer_handle) continue;
+									if (test_occlusion && occlusion->isOccluded(entity_data[e.index], mesh.aabb)) {
+										++worker_occluded_meshes;
+										continue;
+									}
+									if (screen_size > 0) mesh.material->reportScreenSize(screen_size);
 									const u32 bucket = bucket_map[mesh.layer];
 									ASSERT(!mi.custom_material);
 									const u64 subrenderable = e.index | type_mask | ((u64)mesh_idx << 40);
 									if (bucket < 0xff) {
 										instancer.add(mesh.sort_key, subrenderable);
+										AutoInstancer::Instances& instances = instancer.instances[mesh.sort_key];
+										if (screen_size > instances.screen_size) instances.screen_size = screen_size;
 									} else if (bucket < 0xffFF) {
 										const DVec3 pos = entity_data[e.index].pos;
 										const DVec3 rel_pos = pos - camera_pos;
@@ -4396,6 +6761,11 @@ struct PipelineImpl final : Pipeline
 										const u32 depth_bits = floatFlip(*(u32*)&squared_length);
 										const u64 key = ((u64)bucket << SORT_KEY_BUCKET_SHIFT) | depth_bits;
 										inserter.push(key, subrenderable);
+										if (fill_cache) {
+											cached_keys.push(key);
+											cached_values.push(subrenderable);
+											cached_screen_sizes.push(screen_size);
+										}
 									}
 								}
 							};
@@ -4403,6 +6773,8 @@ struct PipelineImpl final : Pipeline
 							if (mi.lod != lod_idx) {
 								const float d = lod_idx - mi.lod;
 								const float ad = fabsf(d);
+								++worker_lod_transitions;
+								++worker_lod_changes;
 									
 								if (ad <= time_delta) {
 									mi.lod = float(lod_idx);
@@ -4426,23 +6798,39 @@ struct PipelineImpl final : Pipeline
 				}
 			}
 			profiler::pushInt("count", total);
+			if (worker_occluded_meshes > 0) atomicAdd(&occluded_meshes, worker_occluded_meshes);
+			if (worker_lod_changes > 0) atomicAdd(&lod_changes, worker_lod_changes);
+			if (worker_lod_transitions > 0) atomicAdd(&lod_transitions, worker_lod_transitions);
+			if (!cached_keys.empty()) {
+				MutexGuard guard(cache_mutex);
+				for (i32 i = 0, c = cached_keys.size(); i < c; ++i) {
+					cache->keys.push(cached_keys[i]);
+					cache->values.push(cached_values[i]);
+					cache->screen_sizes.push(cached_screen_sizes[i]);
+				}
+			}
 
 			const Mesh** sort_key_to_mesh = m_renderer.getSortKeyToMeshMap();
 			for (u32 i = 0, c = (u32)instancer.instances.size(); i < c; ++i) {
 				if (!instancer.instances[i].begin) continue;
 
 				const Mesh* mesh = sort_key_to_mesh[i];
+				// cached instances did not go through create_key this frame
+				if (use_cache && instancer.instances[i].screen_size > 0) mesh->material->reportScreenSize(instancer.instances[i].screen_size);
+				if (use_cache) model_instances[(i32)instancer.instances[i].begin->renderables[0]].model->useLOD(u32(mesh->lod));
 				const u8 bucket = view.layer_to_bucket[mesh->layer];
 				inserter.push(SORT_KEY_INSTANCED_FLAG | i | ((u64)bucket << SORT_KEY_BUCKET_SHIFT), i | (instancer_idx << SORT_KEY_INSTANCER_SHIFT));
 			}
 
+			if (!fill_instance_data) return;
+
 			PROFILE_BLOCK("fill instance data");
 			for (AutoInstancer::Instances& instances : instancer.instances) {
 				const AutoInstancer::Page::Group* group = instances.begin;
 				if (!group) continue;
 
 				const u32 count = instances.end->offset + instances.end->count;
-				instances.slice = m_renderer.allocTransient(count * (sizeof(Quat) + sizeof(Vec3) + sizeof(float) * 2));
+				instances.slice = m_renderer.allocTransient(count * INSTANCE_DATA_SIZE);
 				u8* instance_data = instances.slice.ptr;
 				const u32 sort_key = u32(&instances - instancer.instances.begin());
 				const Mesh* mesh = sort_key_to_mesh[sort_key];
@@ -4453,6 +6841,7 @@ struct PipelineImpl final : Pipeline
 				} while(false)
 
 				const float mesh_lod = mesh->lod;
+				const float material_idx = float(mesh->material->getRenderData()->material_constants);
 
 				while (group) {
 					for (u32 i = 0; i < group->count; ++i) {
@@ -4468,6 +6857,8 @@ struct PipelineImpl final : Pipeline
 						const float lod_d = model_instances[e.index].lod - mesh_lod;
 						memcpy(instance_data, &lod_d, sizeof(lod_d));
 						instance_data += sizeof(lod_d);
+						memcpy(instance_data, &material_idx, sizeof(material_idx));
+						instance_data += sizeof(material_idx);
 					}
 					group = group->next;
 				}
@@ -4475,191 +6866,91 @@ struct PipelineImpl final : Pipeline
 			}
 		});
 
+		m_occlusion_stats.occluded_meshes += occluded_meshes;
 		view.sorter.pack();
-	}
-
-	struct Histogram {
-		static constexpr u32 BITS = 11;
-		static constexpr u32 SIZE = 1 << BITS;
-		static constexpr u32 BIT_MASK = SIZE - 1;
-		static constexpr i32 STEP = 4096;
-
-		u32 m_histogram[SIZE];
-		bool m_sorted;
-		Mutex m_cs;
-
-		void compute(const u64* keys, const u64* values, int size, u16 shift) {
-			memset(m_histogram, 0, sizeof(m_histogram));
-			m_sorted = true;
-
-			volatile i32 counter = 0;
-			auto work = [&](){
-				PROFILE_FUNCTION();
-				u32 histogram[SIZE];
-				bool sorted = true;
-				memset(histogram, 0, sizeof(histogram));
-
-				i32 begin = atomicAdd(&counter, STEP);
-
-				while (begin < size) {
-					const i32 end = minimum(size, begin + STEP);
-
-					u64 key = begin > 0 ? keys[begin - 1] : keys[0];
-					u64 prev_key = key;
-					for (i32 i = begin; i < end; ++i) {
-						key = keys[i];
-						const u16 index = (key >> shift) & BIT_MASK;
-						++histogram[index];
-						sorted &= prev_key <= key;
-						prev_key = key;
-					}
-					begin = atomicAdd(&counter, STEP);
-				}
-
-				MutexGuard lock(m_cs);
-				m_sorted &= sorted;
-				for (u32 i = 0; i < lengthOf(m_histogram); ++i) {
-					m_histogram[i] += histogram[i]; 
-				}
-			};
 
-			if (size < STEP) {
-				work();
-			}
-			else {
-				jobs::runOnWorkers(work);
-			}
+		// lods of other views' cached meshes might be outdated now
+		if (lod_changes > 0) ++m_lod_version;
+		if (fill_cache) {
+			// meshes in the middle of lod transition change each frame
+			cache->valid = lod_transitions == 0;
+			cache->camera_pos = camera_pos;
+			cache->lod_ref_point = lod_ref_point;
+			cache->screen_size_scale = screen_size_scale;
+			cache->sort_keys_version = sort_keys_version;
+			cache->lod_version = m_lod_version;
+			cache->render_data_version = m_renderer.getRenderDataVersion();
+			cache->casters = view.cp.casters;
+			memcpy(cache->bucket_map, shared_bucket_map, sizeof(shared_bucket_map));
 		}
-	};
-
+		if (use_cache && !cache->instance_buffer) createInstanceBuffer(view);
+		// instancers are moved to the cache after commands are created from them
+		view.cache_instancers = cache && cache->valid;
+		view.sort_keys_cached = use_cache;
+	}
 
-	void radixSort(u64* _keys, u64* _values, int size) {
+	// cache is reused, so its instances most likely do not change in following frames either
+	// copy them from transient memory to a persistent buffer, so draws referencing them can be baked
+	void createInstanceBuffer(View& view) {
 		PROFILE_FUNCTION();
-		profiler::pushInt("count", size);
-		if (size == 0) return;
-
-		Array<u64> tmp_mem(m_allocator);
-
-		u64* keys = _keys;
-		u64* values = _values;
-		u64* tmp_keys = nullptr;
-		u64* tmp_values = nullptr;
-
-		Histogram histogram;
-		u16 shift = 0;
-
-		for (int pass = 0; pass < 6; ++pass) {
-			histogram.compute(keys, values, size, shift);
-
-			if (histogram.m_sorted) {
-				if (pass & 1) {
-					memcpy(_keys, tmp_mem.begin(), tmp_mem.byte_size() / 2);
-					memcpy(_values, &tmp_mem[size], tmp_mem.byte_size() / 2);
-				}
-				return;
-			}
-
-			if (!tmp_keys) {
-				tmp_mem.resize(size * 2);
-				tmp_keys = tmp_mem.begin();
-				tmp_values = &tmp_mem[size];
+		u32 size = 0;
+		for (const AutoInstancer& instancer : view.instancers) {
+			for (const AutoInstancer::Instances& instances : instancer.instances) {
+				if (instances.begin) size += instances.slice.size;
 			}
+		}
+		if (size == 0) return;
 
-			u32 offset = 0;
-			for (int i = 0; i < Histogram::SIZE; ++i) {
-				const u32 count = histogram.m_histogram[i];
-				histogram.m_histogram[i] = offset;
-				offset += count;
+		const Renderer::MemRef mem = m_renderer.allocate(size);
+		u32 offset = 0;
+		for (AutoInstancer& instancer : view.instancers) {
+			for (AutoInstancer::Instances& instances : instancer.instances) {
+				if (!instances.begin) continue;
+				memcpy((u8*)mem.data + offset, instances.slice.ptr, instances.slice.size);
+				instances.slice.offset = offset;
+				instances.slice.ptr = nullptr;
+				offset += instances.slice.size;
 			}
-
-			for (int i = 0; i < size; ++i) {
-				const u64 key = keys[i];
-				const u16 index = (key >> shift) & Histogram::BIT_MASK;
-				const u32 dest = histogram.m_histogram[index]++;
-				tmp_keys[dest] = key;
-				tmp_values[dest] = values[i];
+		}
+		const gpu::BufferHandle buffer = m_renderer.createBuffer(mem, gpu::BufferFlags::IMMUTABLE);
+		view.sort_key_cache->instance_buffer = buffer;
+		for (AutoInstancer& instancer : view.instancers) {
+			for (AutoInstancer::Instances& instances : instancer.instances) {
+				if (instances.begin) instances.slice.buffer = buffer;
 			}
-
-			swap(tmp_keys, keys);
-			swap(tmp_values, values);
-
-			shift += Histogram::BITS;
 		}
 	}
 
 	void clear(u32 flags, float r, float g, float b, float a, float depth) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::clear(flags, &color.x, depth);
-			}
-			Vec4 color;
-			float depth;
-			gpu::ClearFlags flags;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		CommandsJob::Clear cmd;
 		cmd.color = Vec4(r, g, b, a);
 		cmd.flags = (gpu::ClearFlags)flags;
 		cmd.depth = depth;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::CLEAR).write(cmd);
 	}
 
 	void viewport(int x, int y, int w, int h) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::viewport(x, y, w, h);
-			}
-			int x, y, w, h;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		CommandsJob::Viewport cmd;
 		cmd.x = x;
 		cmd.y = y;
 		cmd.w = w;
 		cmd.h = h;
-
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::VIEWPORT).write(cmd);
 	}
 
 	void beginBlock(const char* name) {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				gpu::pushDebugGroup(name);
-				renderer->beginProfileBlock(name, link);
-			}
-			StaticString<32> name;
-			Renderer* renderer;
-			i64 link;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
+		// jobs in the block are linked to it
+		flushCommands();
+		CommandsJob::BeginBlock cmd;
 		cmd.name = name;
-		cmd.renderer = &m_renderer;
 		m_profiler_link = profiler::createNewLinkID();
 		cmd.link = m_profiler_link;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::BEGIN_BLOCK).write(cmd);
 	}
 
 	void endBlock() {
-		struct Cmd : Renderer::RenderJob {
-			void setup() override {}
-			void execute() override {
-				PROFILE_FUNCTION();
-				renderer->endProfileBlock();
-				gpu::popDebugGroup();
-			}
-			Renderer* renderer;
-		};
-
-		Cmd& cmd = m_renderer.createJob<Cmd>();
-		cmd.renderer = &m_renderer;
-		m_renderer.queue(cmd, m_profiler_link);
+		recordCommand(CommandsJob::Type::END_BLOCK);
+		flushCommands();
 		m_profiler_link = 0;
 	}
 	
@@ -4709,6 +7000,7 @@ struct PipelineImpl final : Pipeline
 			lua_pop(m_lua_state, 1);
 		}
 		lua_pop(m_lua_state, 1);
+		flushCommands();
 	}
 
 	void saveRenderbuffer(lua_State* L)
@@ -4753,7 +7045,7 @@ struct PipelineImpl final : Pipeline
 		cmd.h = m_viewport.h;
 		cmd.path = out_path;
 		cmd.fs = &m_renderer.getEngine().getFileSystem();
-		m_renderer.queue(cmd, m_profiler_link);
+		queue(cmd, m_profiler_link);
 	}
 
 	void registerLuaAPI(lua_State* L)
@@ -4784,6 +7076,8 @@ struct PipelineImpl final : Pipeline
 		REGISTER_FUNCTION(bindTextures);
 		REGISTER_FUNCTION(bindUniformBuffer);
 		REGISTER_FUNCTION(clear);
+		REGISTER_FUNCTION(copyRenderbuffer);
+		REGISTER_FUNCTION(copyRenderbufferRegion);
 		REGISTER_FUNCTION(createBucket);
 		REGISTER_FUNCTION(createBuffer);
 		REGISTER_FUNCTION(createRenderbuffer);
@@ -4802,6 +7096,7 @@ struct PipelineImpl final : Pipeline
 		REGISTER_FUNCTION(getShadowCameraParams);
 		REGISTER_FUNCTION(pass);
 		REGISTER_FUNCTION(preloadShader);
+		REGISTER_FUNCTION(preskin);
 		REGISTER_FUNCTION(releaseRenderbuffer);
 		REGISTER_FUNCTION(render2D);
 		REGISTER_FUNCTION(renderBucket);
@@ -4814,6 +7109,7 @@ struct PipelineImpl final : Pipeline
 		REGISTER_FUNCTION(renderTransparent);
 		REGISTER_FUNCTION(renderUI);
 		REGISTER_FUNCTION(saveRenderbuffer);
+		REGISTER_FUNCTION(setClusteredDecals);
 		REGISTER_FUNCTION(setOutput);
 		REGISTER_FUNCTION(viewport);
 
@@ -4831,7 +7127,9 @@ struct PipelineImpl final : Pipeline
 		registerConst("STENCIL_KEEP", (u32)gpu::StencilOps::KEEP);
 		registerConst("STENCIL_REPLACE", (u32)gpu::StencilOps::REPLACE);
 
+		registerCFunction("cullViews", PipelineImpl::cullViews);
 		registerCFunction("drawcallUniforms", PipelineImpl::drawcallUniforms);
+		registerCFunction("getShadowSliceUpdate", PipelineImpl::getShadowSliceUpdate);
 		registerCFunction("setRenderTargets", PipelineImpl::setRenderTargets);
 		registerCFunction("setRenderTargetsDS", PipelineImpl::setRenderTargetsDS);
 		registerCFunction("setRenderTargetsReadonlyDS", PipelineImpl::setRenderTargetsReadonlyDS);
@@ -4865,6 +7163,7 @@ struct PipelineImpl final : Pipeline
 
 	bool isReady() const override { return m_resource->isReady(); }
 	const Stats& getStats() const override { return m_last_frame_stats; }
+	const OcclusionStats& getOcclusionStats() const override { return m_last_frame_occlusion_stats; }
 	const Path& getPath() override { return m_resource->getPath(); }
 
 	void clearDraw2D() override { return m_draw2d.clear(getAtlasSize()); }
@@ -4878,6 +7177,9 @@ struct PipelineImpl final : Pipeline
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
 	i64 m_profiler_link;
+	CommandsJob* m_commands_job = nullptr;
+	bool m_compute_writes_bound = false;
+	bool m_barrier_pending = false;
 	PipelineResource* m_resource;
 	lua_State* m_lua_state;
 	int m_lua_thread_ref;
@@ -4889,12 +7191,48 @@ struct PipelineImpl final : Pipeline
 	Stats m_last_frame_stats;
 	Stats m_stats; // accessed from render thread
 	Array<View> m_views;
+	Array<CullCache*> m_cull_caches; // indexed by view
+	Array<SortKeyCache*> m_sort_key_caches; // indexed by view
+	u32 m_lod_version = 0; // changes when any mesh's lod changes
+	struct {
+		bool enabled = false;
+		float target_ms = 16.6f;
+		float min_scale = 0.5f;
+		u32 cooldown = 0;
+	} m_dynamic_resolution;
+	float m_render_scale = 1;
+	IVec2 m_scene_size = {800, 800};
+	u32 m_render_scale_counter;
+	float m_lod_bias = 1; // > 1 while over lod budget, multiplies lod distance
+	OcclusionBuffer m_occlusion_buffer;
+	Array<OcclusionBuffer::Occluder> m_occluders;
+	bool m_occlusion_buffer_used = false;
+	OcclusionStats m_occlusion_stats = {};
+	OcclusionStats m_last_frame_occlusion_stats = {};
 	Array<Bucket> m_buckets;
 	jobs::SignalHandle m_buckets_ready;
 	Viewport m_viewport;
 	int m_output;
 	Shader* m_debug_shape_shader;
 	Shader* m_place_grass_shader;
+	Shader* m_cull_instances_shader;
+	Shader* m_cull_meshlets_shader;
+	Shader* m_sort_particles_shader;
+	Shader* m_fill_clusters_shader;
+	Shader* m_terrain_quadtree_shader;
+	Shader* m_terrain_vt_shader;
+	Shader* m_preskin_shader;
+	gpu::BufferHandle m_terrain_patch_ib;
+	gpu::BufferHandle m_terrain_patches = gpu::INVALID_BUFFER;
+	// render thread
+	HashMap<Terrain*, TerrainVirtualTexture*> m_terrain_vts;
+	u32 m_terrain_vts_frame = 0;
+	gpu::BufferHandle m_grass_occlusion_buffer = gpu::INVALID_BUFFER;
+	gpu::BufferHandle m_meshlets_occlusion_buffer = gpu::INVALID_BUFFER;
+	// written on render thread once fill_clusters program is compiled
+	volatile bool m_compute_clusters_ready = false;
+	bool m_clustered_decals = false;
+	u8 m_decal_layer;
 	Array<CustomCommandHandler> m_custom_commands_handlers;
 	Array<Renderbuffer> m_renderbuffers;
 	Array<ShaderRef> m_shaders;
@@ -4910,6 +7248,8 @@ struct PipelineImpl final : Pipeline
 	gpu::VertexDecl m_curve_decal_decl;
 	gpu::VertexDecl m_3D_pos_decl;
 	gpu::VertexDecl m_point_light_decl;
+	gpu::VertexDecl m_preskinned_decl;
+	gpu::VertexDecl m_preskinned_fur_decl; // without instance attributes, layer is instance id
 	gpu::BufferHandle m_cube_vb;
 	gpu::BufferHandle m_cube_ib;
 	gpu::BufferHandle m_drawcall_ub = gpu::INVALID_BUFFER;
@@ -4924,10 +7264,39 @@ struct PipelineImpl final : Pipeline
 		Buffer lights;
 		Buffer clusters;
 		Buffer maps;
+		Buffer probe_maps;
 		Buffer env_probes;
 		Buffer refl_probes;
+		Buffer decals;
 	} m_cluster_buffers;
 	Viewport m_shadow_camera_viewports[4];
+	
+	// static casters are cached in shadow slices, see getShadowSliceUpdate
+	struct ShadowSlice {
+		DVec3 center = DVec3(0);
+		double forward = 0; // snapped distance along the light, part of `center`
+		Quat light_rot = Quat::IDENTITY;
+		Vec3 xvec;
+		Vec3 yvec;
+		float ortho_size = 0;
+		bool dirty = true;
+		// texels the cached content moved by since the last update
+		IVec2 scroll = IVec2(0);
+	};
+	ShadowSlice m_shadow_slices[4];
+	u64 m_shadow_slices_cursor = 0;
+	Array<MovedShadowCaster> m_moved_shadow_casters;
+
+	// skinned vertices of a mesh of a model instance, see preskin()
+	struct Preskinned {
+		const Mesh* mesh;
+		gpu::BufferHandle buffer;
+		u32 pose_version;
+		u32 frame;
+	};
+	// key is entity index | mesh index << 32
+	HashMap<u64, Preskinned> m_preskinned;
+	u32 m_preskin_frame = 0;
 };
 
 
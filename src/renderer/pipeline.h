@@ -44,6 +44,14 @@ namespace UniformBuffer {
 	};
 }
 
+// binding points of shader buffers shared by several shaders
+namespace ShaderBuffer {
+	enum {
+		// all material constants, instanced draws of bindless materials index them per instance
+		MATERIALS = 9
+	};
+}
+
 struct LUMIX_RENDERER_API PipelineResource : Resource
 {
 	static ResourceType TYPE;
@@ -67,6 +75,14 @@ struct LUMIX_RENDERER_API Pipeline
 		u32 triangle_count;
 	};
 
+	struct OcclusionStats
+	{
+		u32 occluder_count;
+		u32 occluder_triangle_count;
+		u32 occluded_pages; // pages of culling system
+		u32 occluded_meshes;
+	};
+
 	struct CustomCommandHandler
 	{
 		Delegate<void ()> callback;
@@ -85,12 +101,17 @@ struct LUMIX_RENDERER_API Pipeline
 	virtual CustomCommandHandler& addCustomCommandHandler(const char* name) = 0;
 	virtual bool isReady() const = 0;
 	virtual const Stats& getStats() const = 0;
+	virtual const OcclusionStats& getOcclusionStats() const = 0;
 	virtual const Path& getPath() = 0;
 	virtual void callLuaFunction(const char* func) = 0;
 	virtual void setViewport(const Viewport& viewport) = 0;
 	virtual Viewport getViewport() = 0;
 	virtual gpu::BufferHandle getDrawcallUniformBuffer() = 0;
 	virtual void define(const char* define, bool enable) = 0;
+	// scene buffers are scaled down (up to `min_scale`) while gpu frame time is over `target_ms`, see scene_w, scene_h in pipeline scripts
+	// passes after tonemapping, UI and Draw2D stay in native resolution
+	virtual void setDynamicResolution(bool enable, float target_ms, float min_scale) = 0;
+	virtual float getRenderScale() const = 0;
 
 	virtual Draw2D& getDraw2D() = 0;
 	virtual void clearDraw2D() = 0;
@@ -1,7 +1,8 @@
 #include "renderer/pose.h"
+#include "engine/allocator.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
-#include "engine/math.h"
+#include "engine/simd.h"
 #include "renderer/model.h"
 
 
@@ -15,14 +16,15 @@ Pose::Pose(IAllocator& allocator)
 	positions = nullptr;
 	rotations = nullptr;
 	count = 0;
+	version = 0;
 	is_absolute = false;
 }
 
 
 Pose::~Pose()
 {
-	allocator.deallocate(positions);
-	allocator.deallocate(rotations);
+	allocator.deallocate_aligned(positions);
+	allocator.deallocate_aligned(rotations);
 }
 
 
@@ -31,11 +33,28 @@ void Pose::blend(Pose& rhs, float weight)
 	ASSERT(count == rhs.count);
 	if (weight <= 0.001f) return;
 	weight = clamp(weight, 0.0f, 1.0f);
-	float inv = 1.0f - weight;
-	for (int i = 0, c = count; i < c; ++i)
-	{
-		positions[i] = positions[i] * inv + rhs.positions[i] * weight;
-		rotations[i] = nlerp(rotations[i], rhs.rotations[i], weight);
+	const u32 padded_count = (count + 3) & ~3;
+	const float4 w = f4Splat(weight);
+	const float4 inv = f4Splat(1.0f - weight);
+
+	// 4 positions are 3 float4s
+	float* pos = &positions[0].x;
+	const float* rhs_pos = &rhs.positions[0].x;
+	for (u32 i = 0; i < padded_count * 3; i += 4) {
+		f4Store(pos + i, f4Add(f4Mul(f4Load(pos + i), inv), f4Mul(f4Load(rhs_pos + i), w)));
+	}
+
+	for (u32 i = 0; i < padded_count; i += 4) {
+		float4 a[4], b[4];
+		for (u32 j = 0; j < 4; ++j) {
+			a[j] = f4Load(&rotations[i + j]);
+			b[j] = f4Load(&rhs.rotations[i + j]);
+		}
+		f4Transpose(a[0], a[1], a[2], a[3]);
+		f4Transpose(b[0], b[1], b[2], b[3]);
+		f4Nlerp(a, b, w, a);
+		f4Transpose(a[0], a[1], a[2], a[3]);
+		for (u32 j = 0; j < 4; ++j) f4Store(&rotations[i + j], a[j]);
 	}
 }
 
@@ -43,13 +62,19 @@ void Pose::blend(Pose& rhs, float weight)
 void Pose::resize(int count)
 {
 	is_absolute = false;
-	allocator.deallocate(positions);
-	allocator.deallocate(rotations);
+	++version;
+	allocator.deallocate_aligned(positions);
+	allocator.deallocate_aligned(rotations);
 	this->count = count;
 	if (count)
 	{
-		positions = static_cast<Vec3*>(allocator.allocate(sizeof(Vec3) * count));
-		rotations = static_cast<Quat*>(allocator.allocate(sizeof(Quat) * count));
+		const u32 padded_count = (count + 3) & ~3;
+		positions = static_cast<Vec3*>(allocator.allocate_aligned(sizeof(Vec3) * padded_count, 16));
+		rotations = static_cast<Quat*>(allocator.allocate_aligned(sizeof(Quat) * padded_count, 16));
+		for (u32 i = count; i < padded_count; ++i) {
+			positions[i] = Vec3(0);
+			rotations[i] = Quat::IDENTITY;
+		}
 	}
 	else
 	{
@@ -28,6 +28,9 @@ struct LUMIX_RENDERER_API Pose
 	IAllocator& allocator;
 	bool is_absolute;
 	u32 count;
+	u32 version; // incremented in RenderScene::unlockPose when the pose is changed
+	// 16B aligned, allocated for `count` rounded up to multiple of 4 so SIMD code does not need to handle the tail
+	// padding is identity, it's never read by skinning
 	Vec3* positions;
 	Quat* rotations;
 	
@@ -2,6 +2,7 @@
 
 #include "engine/array.h"
 #include "engine/associative_array.h"
+#include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
@@ -14,10 +15,13 @@
 #include "engine/page_allocator.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
+#include "engine/soa.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "imgui/IconsFontAwesome5.h"
+#include "renderer/bc_encoder.h"
 #include "renderer/culling_system.h"
 #include "renderer/font.h"
 #include "renderer/material.h"
@@ -53,10 +57,21 @@ enum class RenderSceneVersion : i32
 	CURVE_DECALS,
 	AUTODESTROY_EMITTER,
 	SMALLER_MODEL_INSTANCES,
+	GPU_PARTICLES,
+	PARTICLE_LOD,
+	PARTICLE_SORT,
+	FUR_LOD,
 
 	LATEST
 };
 
+struct ModelInstanceLink
+{
+	EntityPtr next_model = INVALID_ENTITY;
+	EntityPtr prev_model = INVALID_ENTITY;
+};
+
+
 struct BoneAttachment
 {
 	EntityRef entity;
@@ -74,6 +89,31 @@ static RenderableTypes getRenderableType(const Model& model, bool custom_materia
 	return RenderableTypes::MESH;
 }
 
+// each thread adding debug shapes gets its own index, shared by all scenes
+static constexpr u32 MAX_DEBUG_THREADS = 64;
+static volatile i32 g_debug_threads_count = 0;
+static thread_local i32 g_debug_thread_idx = -1;
+
+struct ThreadDebugShapes {
+	explicit ThreadDebugShapes(IAllocator& allocator)
+		: lines(allocator)
+		, triangles(allocator)
+		, instances(allocator)
+	{}
+
+	// locked by the owner thread while adding and by the pipeline while fetching
+	Mutex mutex;
+	Array<DebugLine> lines;
+	Array<DebugTriangle> triangles;
+	Array<DebugShapeInstance> instances;
+};
+
+struct StaticDebugShape {
+	gpu::BufferHandle vertex_buffer = gpu::INVALID_BUFFER;
+	u32 lines_count = 0;
+	u32 triangles_count = 0;
+};
+
 struct ReflectionProbe::LoadJob {
 	LoadJob(struct RenderSceneImpl& scene, EntityRef probe, IAllocator& allocator)
 		: m_scene(scene)
@@ -100,9 +140,19 @@ struct RenderSceneImpl final : RenderScene {
 	~RenderSceneImpl()
 	{
 		m_renderer.destroy(m_reflection_probes_texture);
+		for (StaticDebugShape& shape : m_static_debug_shapes) {
+			if (shape.vertex_buffer) m_renderer.destroy(shape.vertex_buffer);
+		}
+		for (ThreadDebugShapes* shapes : m_thread_debug_shapes) {
+			LUMIX_DELETE(m_allocator, shapes);
+		}
 		m_universe.entityTransformed().unbind<&RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<&RenderSceneImpl::onEntitiesMoved>(this);
+		m_universe.entitiesInterpolated().unbind<&RenderSceneImpl::onEntitiesInterpolated>(this);
 		m_universe.entityDestroyed().unbind<&RenderSceneImpl::onEntityDestroyed>(this);
+		m_universe.entityEnabled().unbind<&RenderSceneImpl::onEntityEnabled>(this);
 		m_culling_system.reset();
+		m_particle_culling.reset();
 	}
 
 
@@ -193,20 +243,26 @@ struct RenderSceneImpl final : RenderScene {
 		}
 		m_terrains.clear();
 
+		for (ParticleEmitter& emitter : m_particle_emitters) {
+			emitter.releaseGPUData(m_renderer);
+		}
 		m_particle_emitters.clear();
 
-		for (ModelInstance& i : m_model_instances)
+		for (int idx = 0, c = m_model_instances.size(); idx < c; ++idx)
 		{
+			ModelInstance& i = m_model_instances.get<MI_DATA>(idx);
 			if (i.flags.isSet(ModelInstance::VALID) && i.model)
 			{
 				i.model->decRefCount();
 				if (i.custom_material) i.custom_material->decRefCount();
 				i.custom_material = nullptr;
-				LUMIX_DELETE(m_allocator, i.pose);
-				i.pose = nullptr;
+				Pose*& pose = m_model_instances.get<MI_POSE>(idx);
+				LUMIX_DELETE(m_allocator, pose);
+				pose = nullptr;
 			}
 		}
 		m_model_instances.clear();
+		m_occluders.clear();
 		for(auto iter = m_model_entity_map.begin(), end = m_model_entity_map.end(); iter != end; ++iter) {
 			Model* model = iter.key();
 			model->getObserverCb().unbind<&RenderSceneImpl::modelStateChanged>(this);
@@ -226,6 +282,7 @@ struct RenderSceneImpl final : RenderScene {
 		m_material_curve_decal_map.clear();
 
 		m_culling_system->clear();
+		m_particle_culling->clear();
 
 		for (const ReflectionProbe& probe : m_reflection_probes) {
 			LUMIX_DELETE(m_allocator, probe.load_job);
@@ -508,14 +565,57 @@ struct RenderSceneImpl final : RenderScene {
 		ba.parent_entity = parent;
 		if (parent.isValid() && parent.index < m_model_instances.size())
 		{
-			ModelInstance& mi = m_model_instances[parent.index];
+			ModelInstance& mi = m_model_instances.get<MI_DATA>(parent.index);
 			mi.flags.set(ModelInstance::IS_BONE_ATTACHMENT_PARENT);
 		}
 		updateRelativeMatrix(ba);
 	}
 
-	void startGame() override { m_is_game_running = true; }
-	void stopGame() override { m_is_game_running = false; }
+	void startGame() override {
+		m_is_game_running = true;
+		updateBatchedCulling();
+	}
+
+	void stopGame() override {
+		m_is_game_running = false;
+		updateBatchedCulling();
+	}
+
+	// batched instances are rendered in editor, their static batches in game
+	bool isHiddenByBatching(const ModelInstance& mi) const {
+		return mi.flags.isSet(m_is_game_running ? ModelInstance::BATCHED : ModelInstance::STATIC_BATCH);
+	}
+
+	void updateModelInstanceCulling(EntityRef entity) {
+		const ModelInstance& mi = m_model_instances.get<MI_DATA>(entity.index);
+		const bool visible = mi.flags.isSet(ModelInstance::ENABLED)
+			&& mi.model
+			&& mi.model->isReady()
+			&& m_universe.isEntityEnabled(entity)
+			&& !isHiddenByBatching(mi);
+		if (visible == m_culling_system->isAdded(entity)) return;
+
+		pushShadowCaster(entity);
+		if (visible) {
+			const RenderableTypes type = getRenderableType(*mi.model, mi.custom_material);
+			const DVec3 pos = m_universe.getPosition(entity);
+			const float radius = mi.model->getOriginBoundingRadius() * m_universe.getScale(entity);
+			m_culling_system->add(entity, (u8)type, pos, radius);
+		}
+		else {
+			m_culling_system->remove(entity);
+		}
+	}
+
+	void updateBatchedCulling() {
+		const Span<const ModelInstance> instances = m_model_instances.column<MI_DATA>();
+		for (u32 i = 0; i < instances.length(); ++i) {
+			const ModelInstance& mi = instances[i];
+			if (!mi.flags.isSet(ModelInstance::VALID)) continue;
+			if (!mi.flags.isSet(ModelInstance::BATCHED) && !mi.flags.isSet(ModelInstance::STATIC_BATCH)) continue;
+			updateModelInstanceCulling(EntityRef{(i32)i});
+		}
+	}
 
 	void update(float dt, bool paused) override {
 		PROFILE_FUNCTION();
@@ -523,11 +623,90 @@ struct RenderSceneImpl final : RenderScene {
 		if (!m_is_game_running) return;
 		if (paused) return;
 
+		updateParticleEmitters(dt);
+	}
+
+	SceneAccess getUpdateAccess() const override {
+		SceneAccess access;
+		access.reads = SceneAccess::TRANSFORMS;
+		// gpu emitters queue compute jobs
+		access.writes = SceneAccess::RENDERER;
+		// finished autodestroy emitters destroy their entities
+		for (const ParticleEmitter& emitter : m_particle_emitters) {
+			if (emitter.m_autodestroy) {
+				access.writes |= SceneAccess::COMPONENTS;
+				break;
+			}
+		}
+		return access;
+	}
+
+	// emitters outside of the active camera's frustum sleep, distant emitters emit less and are updated less often
+	void updateParticleEmitters(float dt) {
+		PROFILE_FUNCTION();
+		if (m_particle_emitters.size() == 0) return;
+
+		PageAllocator& page_allocator = m_engine.getPageAllocator();
+		const bool has_camera = m_active_camera.isValid();
+		DVec3 camera_pos(0);
+		if (has_camera) {
+			for (ParticleEmitter& emitter : m_particle_emitters) emitter.m_visible = false;
+			const ShiftedFrustum frustum = getCameraFrustum((EntityRef)m_active_camera);
+			CullResult* visible = m_particle_culling->cull(frustum);
+			if (visible) {
+				visible->forEach([&](EntityRef e){ m_particle_emitters[e].m_visible = true; });
+				visible->free(page_allocator);
+			}
+			camera_pos = m_universe.getPosition((EntityRef)m_active_camera);
+		}
+
+		u32 live_count = 0;
+		for (const ParticleEmitter& emitter : m_particle_emitters) live_count += emitter.getParticlesCount();
+		u32 emit_budget = m_particle_budget > live_count ? m_particle_budget - live_count : 0;
+
 		Array<EntityRef> to_delete(m_allocator);
 		for (ParticleEmitter& emitter : m_particle_emitters) {
-			if (emitter.update(dt, m_engine.getPageAllocator())) {
-				to_delete.push(*emitter.m_entity);
+			const EntityRef entity = *emitter.m_entity;
+			// disabled
+			if (!m_particle_culling->isAdded(entity)) continue;
+			if (has_camera && !emitter.m_visible) {
+				emitter.m_offscreen_time += dt;
+				continue;
+			}
+
+			bool destroy = false;
+			if (emitter.m_offscreen_time > 0) {
+				// warm start, so the effect does not look like it has just started
+				if (emitter.m_catch_up) {
+					float t = minimum(emitter.m_offscreen_time, ParticleEmitter::MAX_CATCH_UP);
+					while (t > 0 && !destroy) {
+						const float step = minimum(t, ParticleEmitter::CATCH_UP_STEP);
+						destroy = emitter.update(step, 1, emit_budget, page_allocator);
+						emitter.simulateGPU(m_renderer);
+						t -= step;
+					}
+				}
+				emitter.m_offscreen_time = 0;
+			}
+
+			float emit_scale = 1;
+			emitter.m_lod_time += dt;
+			if (has_camera && emitter.m_lod_distance > 0) {
+				const float dist = (float)length(m_universe.getPosition(entity) - camera_pos);
+				if (dist > emitter.m_lod_distance) {
+					const float ratio = dist / emitter.m_lod_distance;
+					emit_scale = maximum(1 / ratio, 0.1f);
+					const float interval = minimum((ratio - 1) * ParticleEmitter::CATCH_UP_STEP, ParticleEmitter::MAX_LOD_UPDATE_INTERVAL);
+					if (emitter.m_lod_time < interval && !destroy) continue;
+				}
+			}
+
+			if (!destroy) {
+				destroy = emitter.update(emitter.m_lod_time, emit_scale, emit_budget, page_allocator);
+				emitter.simulateGPU(m_renderer);
 			}
+			emitter.m_lod_time = 0;
+			if (destroy) to_delete.push(entity);
 		}
 		for (EntityRef e : to_delete) {
 			m_universe.destroyEntity(e);
@@ -586,7 +765,7 @@ struct RenderSceneImpl final : RenderScene {
 		}
 
 		serializer.write((i32)m_model_instances.size());
-		for (const ModelInstance& r : m_model_instances) {
+		for (const ModelInstance& r : m_model_instances.column<MI_DATA>()) {
 			serializer.write(r.flags.base);
 			if(r.flags.isSet(ModelInstance::VALID)) {
 				serializer.write(u32(r.model ? offsets[r.model] : 0xffFFffFF));
@@ -613,7 +792,7 @@ struct RenderSceneImpl final : RenderScene {
 		}
 	}
 
-	void deserializeFurs(InputMemoryStream& serializer, const EntityMap& entity_map) {
+	void deserializeFurs(InputMemoryStream& serializer, const EntityMap& entity_map, i32 version) {
 		u32 count;
 		serializer.read(count);
 		m_furs.reserve(count + m_furs.size());
@@ -622,7 +801,23 @@ struct RenderSceneImpl final : RenderScene {
 			serializer.read(e);
 			e = entity_map.get(e);
 			FurComponent fur;
-			serializer.read(fur);
+			if (version > (i32)RenderSceneVersion::FUR_LOD) {
+				serializer.read(fur);
+			}
+			else {
+				struct {
+					u32 layers;
+					float scale;
+					float gravity;
+					bool enabled;
+				} old;
+				serializer.read(old);
+				fur.layers = old.layers;
+				fur.scale = old.scale;
+				fur.gravity = old.gravity;
+				fur.enabled = old.enabled;
+				fur.lod_distance = 0;
+			}
 			m_furs.insert(e, fur);
 			m_universe.onComponentCreated(e, FUR_TYPE, this);
 		}
@@ -771,7 +966,7 @@ struct RenderSceneImpl final : RenderScene {
 		
 		probe.load_job = LUMIX_NEW(m_allocator, ReflectionProbe::LoadJob)(*this, entity, m_allocator);
 		FileSystem::ContentCallback cb = makeDelegate<&ReflectionProbe::LoadJob::callback>(probe.load_job);
-		probe.load_job->m_handle = m_engine.getFileSystem().getContent(Path(path_str), cb);
+		probe.load_job->m_handle = m_engine.getFileSystem().getContent(Path(path_str), cb, FileSystem::Priority::LOW);
 	}
 
 	void deserializeEnvironmentProbes(InputMemoryStream& serializer, const EntityMap& entity_map)
@@ -817,11 +1012,18 @@ struct RenderSceneImpl final : RenderScene {
 		m_particle_emitters.reserve(count + m_particle_emitters.size());
 		for (u32 i = 0; i < count; ++i) {
 			ParticleEmitter emitter(INVALID_ENTITY, m_allocator);
-			emitter.deserialize(serializer, version > (i32)RenderSceneVersion::AUTODESTROY_EMITTER, m_engine.getResourceManager());
+			emitter.deserialize(serializer
+				, version > (i32)RenderSceneVersion::AUTODESTROY_EMITTER
+				, version > (i32)RenderSceneVersion::GPU_PARTICLES
+				, version > (i32)RenderSceneVersion::PARTICLE_LOD
+				, version > (i32)RenderSceneVersion::PARTICLE_SORT
+				, m_engine.getResourceManager());
 			emitter.m_entity = entity_map.get(emitter.m_entity);
 			if (emitter.m_entity.isValid()) {
 				EntityRef e = *emitter.m_entity;
+				const float radius = emitter.m_radius;
 				m_particle_emitters.insert(e, static_cast<ParticleEmitter&&>(emitter));
+				if (m_universe.isEntityEnabled(e)) m_particle_culling->add(e, 0, m_universe.getPosition(e), radius);
 				m_universe.onComponentCreated(e, PARTICLE_EMITTER_TYPE, this);
 			}
 		}
@@ -883,19 +1085,17 @@ struct RenderSceneImpl final : RenderScene {
 				const EntityRef e = entity_map.get(EntityRef{(i32)i});
 
 				while (e.index >= m_model_instances.size()) {
-					auto& r = m_model_instances.emplace();
-					r.flags.clear();
-					r.flags.set(ModelInstance::VALID, false);
-					r.model = nullptr;
-					r.pose = nullptr;
+					emplaceModelInstance();
 				}
 
-				ModelInstance& r = m_model_instances[e.index];
+				ModelInstance& r = m_model_instances.get<MI_DATA>(e.index);
 				r.flags = flags;
+				// runtime state, loaded instances start in the static shadow layer
+				r.flags.set(ModelInstance::DYNAMIC, false);
 				r.model = nullptr;
-				r.pose = nullptr;
 				r.meshes = nullptr;
 				r.mesh_count = 0;
+				m_model_instances.get<MI_POSE>(e.index) = nullptr;
 
 				const char* path = serializer.readString();
 				if (path[0] != 0) {
@@ -929,19 +1129,18 @@ struct RenderSceneImpl final : RenderScene {
 				const EntityRef e = entity_map.get(EntityRef{(i32)i});
 
 				while (e.index >= m_model_instances.size()) {
-					ModelInstance& r = m_model_instances.emplace();
-					r.flags.clear();
-					r.flags.set(ModelInstance::VALID, false);
-					r.model = nullptr;
-					r.pose = nullptr;
+					emplaceModelInstance();
 				}
 
-				ModelInstance& r = m_model_instances[e.index];
+				ModelInstance& r = m_model_instances.get<MI_DATA>(e.index);
 				r.flags = flags;
+				// runtime state, loaded instances start in the static shadow layer
+				r.flags.set(ModelInstance::DYNAMIC, false);
 				r.model = nullptr;
-				r.pose = nullptr;
 				r.meshes = nullptr;
 				r.mesh_count = 0;
+				m_model_instances.get<MI_POSE>(e.index) = nullptr;
+				if (flags.isSet(ModelInstance::OCCLUDER)) m_occluders.push(e);
 
 				const u32 path_offset = serializer.read<u32>();
 				if (path_offset != 0xffFFffFF) {
@@ -1023,7 +1222,7 @@ struct RenderSceneImpl final : RenderScene {
 		deserializeReflectionProbes(serializer, entity_map);
 		deserializeDecals(serializer, entity_map, version);
 		deserializeCurveDecals(serializer, entity_map, version);
-		deserializeFurs(serializer, entity_map);
+		deserializeFurs(serializer, entity_map, version);
 	}
 
 
@@ -1033,7 +1232,7 @@ struct RenderSceneImpl final : RenderScene {
 		const EntityPtr parent_entity = bone_attachment.parent_entity;
 		if (parent_entity.isValid() && parent_entity.index < m_model_instances.size())
 		{
-			ModelInstance& mi = m_model_instances[bone_attachment.parent_entity.index];
+			ModelInstance& mi = m_model_instances.get<MI_DATA>(bone_attachment.parent_entity.index);
 			mi.flags.unset(ModelInstance::IS_BONE_ATTACHMENT_PARENT);
 		}
 		m_bone_attachments.erase(entity);
@@ -1058,9 +1257,11 @@ struct RenderSceneImpl final : RenderScene {
 	void destroyModelInstance(EntityRef entity)
 	{
 		setModel(entity, nullptr);
-		auto& model_instance = m_model_instances[entity.index];
-		LUMIX_DELETE(m_allocator, model_instance.pose);
-		model_instance.pose = nullptr;
+		auto& model_instance = m_model_instances.get<MI_DATA>(entity.index);
+		if (model_instance.flags.isSet(ModelInstance::OCCLUDER)) m_occluders.swapAndPopItem(entity);
+		Pose*& pose = m_model_instances.get<MI_POSE>(entity.index);
+		LUMIX_DELETE(m_allocator, pose);
+		pose = nullptr;
 		model_instance.flags.clear();
 		model_instance.flags.set(ModelInstance::VALID, false);
 		if (model_instance.custom_material) model_instance.custom_material->decRefCount();
@@ -1124,7 +1325,9 @@ struct RenderSceneImpl final : RenderScene {
 
 	void destroyParticleEmitter(EntityRef entity)
 	{
-		const ParticleEmitter& emitter = m_particle_emitters[entity];
+		ParticleEmitter& emitter = m_particle_emitters[entity];
+		emitter.releaseGPUData(m_renderer);
+		if (m_particle_culling->isAdded(entity)) m_particle_culling->remove(entity);
 		m_universe.onComponentDestroyed(*emitter.m_entity, PARTICLE_EMITTER_TYPE, this);
 		m_particle_emitters.erase(*emitter.m_entity);
 	}
@@ -1164,7 +1367,8 @@ struct RenderSceneImpl final : RenderScene {
 
 	void createParticleEmitter(EntityRef entity)
 	{
-		m_particle_emitters.insert(entity, ParticleEmitter(entity, m_allocator));
+		ParticleEmitter& emitter = m_particle_emitters.insert(entity, ParticleEmitter(entity, m_allocator));
+		if (m_universe.isEntityEnabled(entity)) m_particle_culling->add(entity, 0, m_universe.getPosition(entity), emitter.m_radius);
 		m_universe.onComponentCreated(entity, PARTICLE_EMITTER_TYPE, this);
 	}
 
@@ -1182,7 +1386,7 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
-	const HashMap<EntityRef, PointLight>& getPointLights() override
+	const ComponentMap<PointLight>& getPointLights() override
 	{
 		return m_point_lights;
 	}
@@ -1195,25 +1399,31 @@ struct RenderSceneImpl final : RenderScene {
 
 	Span<const ModelInstance> getModelInstances() const override
 	{
-		return m_model_instances;
+		return m_model_instances.column<MI_DATA>();
 	}
 
 
 	Span<ModelInstance> getModelInstances() override
 	{
-		return m_model_instances;
+		return m_model_instances.column<MI_DATA>();
+	}
+
+
+	Span<Pose* const> getModelInstancePoses() const override
+	{
+		return m_model_instances.column<MI_POSE>();
 	}
 
 
 	ModelInstance* getModelInstance(EntityRef entity) override
 	{
-		return &m_model_instances[entity.index];
+		return &m_model_instances.get<MI_DATA>(entity.index);
 	}
 
 
 	Vec3 getPoseBonePosition(EntityRef model_instance, int bone_index)
 	{
-		Pose* pose = m_model_instances[model_instance.index].pose;
+		Pose* pose = m_model_instances.get<MI_POSE>(model_instance.index);
 		return pose->positions[bone_index];
 	}
 
@@ -1231,38 +1441,105 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
-	void onEntityMoved(EntityRef entity)
+	// disabled entities are kept out of culling, so they are never rendered
+	void onEntityEnabled(EntityRef entity, bool enable)
 	{
-		const u64 cmp_mask = m_universe.getComponentsMask(entity);
-		if ((cmp_mask & m_render_cmps_mask) == 0) {
-			return;
+		if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
+			ModelInstance& mi = m_model_instances.get<MI_DATA>(entity.index);
+			if (!enable) {
+				if (m_culling_system->isAdded(entity)) {
+					pushShadowCaster(entity);
+					m_culling_system->remove(entity);
+				}
+			}
+			else if (mi.flags.isSet(ModelInstance::ENABLED) && mi.model && mi.model->isReady() && !isHiddenByBatching(mi) && !m_culling_system->isAdded(entity)) {
+				const RenderableTypes type = getRenderableType(*mi.model, mi.custom_material);
+				const DVec3 pos = m_universe.getPosition(entity);
+				const float radius = mi.model->getOriginBoundingRadius() * m_universe.getScale(entity);
+				m_culling_system->add(entity, (u8)type, pos, radius);
+				pushShadowCaster(entity);
+			}
 		}
 
-		if (m_culling_system->isAdded(entity)) {
-			if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
-				const Transform& tr = m_universe.getTransform(entity);
-				const Model* model = m_model_instances[entity.index].model;
-				ASSERT(model);
-				const float bounding_radius = model->getOriginBoundingRadius();
-				m_culling_system->set(entity, tr.pos, bounding_radius * tr.scale);
+		if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
+			if (!enable) {
+				if (m_culling_system->isAdded(entity)) m_culling_system->remove(entity);
 			}
-			else if (m_universe.hasComponent(entity, DECAL_TYPE)) {
-				auto iter = m_decals.find(entity);
-				updateDecalInfo(iter.value());
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
+			else if (!m_culling_system->isAdded(entity)) {
+				const PointLight& light = m_point_lights[entity];
+				m_culling_system->add(entity, (u8)RenderableTypes::LOCAL_LIGHT, m_universe.getPosition(entity), light.range);
 			}
-			else if (m_universe.hasComponent(entity, CURVE_DECAL_TYPE)) {
-				auto iter = m_curve_decals.find(entity);
-				updateDecalInfo(iter.value());
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
+		}
+
+		if (m_universe.hasComponent(entity, PARTICLE_EMITTER_TYPE)) {
+			if (!enable) {
+				if (m_particle_culling->isAdded(entity)) m_particle_culling->remove(entity);
 			}
-			else if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, pos);
+			else if (!m_particle_culling->isAdded(entity)) {
+				m_particle_culling->add(entity, 0, m_universe.getPosition(entity), m_particle_emitters[entity].m_radius);
+			}
+		}
+	}
+
+
+	void pushMovedShadowCaster(const DVec3& pos, float radius, bool dynamic) {
+		MovedShadowCaster& caster = m_moved_shadow_casters[m_moved_shadow_casters_count % lengthOf(m_moved_shadow_casters)];
+		caster.pos = pos;
+		caster.radius = radius;
+		caster.dynamic = dynamic;
+		++m_moved_shadow_casters_count;
+	}
+
+	// animated and moving instances are rendered into shadows every frame, the others are cached
+	static bool isDynamicShadowCaster(const ModelInstance& mi) {
+		return mi.flags.isSet(ModelInstance::DYNAMIC) || (mi.model && mi.model->isReady() && mi.model->isSkinned());
+	}
+
+	// model instance was added to or is going to be removed from culling, shadows around it are invalid
+	void pushShadowCaster(EntityRef entity) {
+		if (!m_culling_system->isAdded(entity)) return;
+		const ModelInstance& mi = m_model_instances.get<MI_DATA>(entity.index);
+		pushMovedShadowCaster(m_culling_system->getPosition(entity), m_culling_system->getRadius(entity), isDynamicShadowCaster(mi));
+	}
+
+	bool getMovedShadowCasters(u64& cursor, Array<MovedShadowCaster>& out) const override {
+		const u64 count = m_moved_shadow_casters_count;
+		const bool complete = count - cursor <= lengthOf(m_moved_shadow_casters);
+		if (complete) {
+			for (u64 i = cursor; i < count; ++i) {
+				out.push(m_moved_shadow_casters[i % lengthOf(m_moved_shadow_casters)]);
 			}
 		}
+		cursor = count;
+		return complete;
+	}
+
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		PROFILE_FUNCTION();
+		for (EntityRef e : entities) onEntityMoved(e);
+	}
+
+
+	// only bounds, bone attachments are simulation state and stay at the simulated transform
+	void onEntitiesInterpolated(Span<const EntityRef> entities)
+	{
+		PROFILE_FUNCTION();
+		for (EntityRef e : entities) {
+			if ((m_universe.getComponentsMask(e) & m_render_cmps_mask) == 0) continue;
+			updateBounds(e);
+		}
+	}
+
+
+	void onEntityMoved(EntityRef entity)
+	{
+		const u64 cmp_mask = m_universe.getComponentsMask(entity);
+		if ((cmp_mask & m_render_cmps_mask) == 0) {
+			return;
+		}
+
+		updateBounds(entity);
 
 		bool was_updating = m_is_updating_attachments;
 		m_is_updating_attachments = true;
@@ -1290,9 +1567,47 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	void updateBounds(EntityRef entity)
+	{
+		if (m_culling_system->isAdded(entity)) {
+			if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
+				const Transform& tr = m_universe.getTransform(entity);
+				ModelInstance& mi = m_model_instances.get<MI_DATA>(entity.index);
+				ASSERT(mi.model);
+				const float bounding_radius = mi.model->getOriginBoundingRadius();
+				// the first move removes the instance from the static shadow layer, later moves do not invalidate it
+				pushMovedShadowCaster(m_culling_system->getPosition(entity), m_culling_system->getRadius(entity), isDynamicShadowCaster(mi));
+				mi.flags.set(ModelInstance::DYNAMIC);
+				m_culling_system->set(entity, tr.pos, bounding_radius * tr.scale);
+				pushMovedShadowCaster(tr.pos, bounding_radius * tr.scale, true);
+			}
+			else if (m_universe.hasComponent(entity, DECAL_TYPE)) {
+				auto iter = m_decals.find(entity);
+				updateDecalInfo(iter.value());
+				const DVec3 position = m_universe.getPosition(entity);
+				m_culling_system->setPosition(entity, position);
+			}
+			else if (m_universe.hasComponent(entity, CURVE_DECAL_TYPE)) {
+				auto iter = m_curve_decals.find(entity);
+				updateDecalInfo(iter.value());
+				const DVec3 position = m_universe.getPosition(entity);
+				m_culling_system->setPosition(entity, position);
+			}
+			else if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
+				const DVec3 pos = m_universe.getPosition(entity);
+				m_culling_system->setPosition(entity, pos);
+			}
+		}
+
+		if (m_particle_culling->isAdded(entity)) {
+			m_particle_culling->setPosition(entity, m_universe.getPosition(entity));
+		}
+	}
+
+
 	Engine& getEngine() const override { return m_engine; }
 
-	const HashMap<EntityRef, Terrain*>& getTerrains() override {
+	const ComponentMap<Terrain*>& getTerrains() override {
 		return m_terrains;
 	}
 
@@ -1338,6 +1653,12 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	void getTerrainHeightsAt(EntityRef entity, Span<const Vec2> xz, Span<float> heights) override
+	{
+		m_terrains[entity]->getHeights(xz, heights);
+	}
+
+
 	AABB getTerrainAABB(EntityRef entity) override
 	{
 		return m_terrains[entity]->getAABB();
@@ -1529,12 +1850,17 @@ struct RenderSceneImpl final : RenderScene {
 	float getTerrainYScale(EntityRef entity) override { return m_terrains[entity]->getYScale(); }
 
 
-	Pose* lockPose(EntityRef entity) override { return m_model_instances[entity.index].pose; }
+	Pose* lockPose(EntityRef entity) override { return m_model_instances.get<MI_POSE>(entity.index); }
 	void unlockPose(EntityRef entity, bool changed) override
 	{
 		if (!changed) return;
+		if (entity.index < m_model_instances.size()) {
+			Pose* pose = m_model_instances.get<MI_POSE>(entity.index);
+			// pipelines compare this with the version their cached pre-skinned vertices have
+			if (pose) ++pose->version;
+		}
 		if (entity.index < m_model_instances.size()
-			&& (m_model_instances[entity.index].flags.isSet(ModelInstance::IS_BONE_ATTACHMENT_PARENT)) == 0)
+			&& (m_model_instances.get<MI_DATA>(entity.index).flags.isSet(ModelInstance::IS_BONE_ATTACHMENT_PARENT)) == 0)
 		{
 			return;
 		}
@@ -1550,39 +1876,89 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
-	Model* getModelInstanceModel(EntityRef entity) override { return m_model_instances[entity.index].model; }
+	Model* getModelInstanceModel(EntityRef entity) override { return m_model_instances.get<MI_DATA>(entity.index).model; }
 
 
 	bool isModelInstanceEnabled(EntityRef entity) override
 	{
-		ModelInstance& model_instance = m_model_instances[entity.index];
+		ModelInstance& model_instance = m_model_instances.get<MI_DATA>(entity.index);
 		return model_instance.flags.isSet(ModelInstance::ENABLED);
 	}
 
 
 	void enableModelInstance(EntityRef entity, bool enable) override
 	{
-		ModelInstance& model_instance = m_model_instances[entity.index];
+		ModelInstance& model_instance = m_model_instances.get<MI_DATA>(entity.index);
 		model_instance.flags.set(ModelInstance::ENABLED, enable);
 		if (enable)
 		{
 			if (!model_instance.model || !model_instance.model->isReady()) return;
+			if (!m_universe.isEntityEnabled(entity)) return;
+			if (isHiddenByBatching(model_instance)) return;
 
 			const DVec3 pos = m_universe.getPosition(entity);
 			const float radius = model_instance.model->getOriginBoundingRadius() * m_universe.getScale(entity);
 			if (!m_culling_system->isAdded(entity)) {
 				const RenderableTypes type = getRenderableType(*model_instance.model, model_instance.custom_material);
 				m_culling_system->add(entity, (u8)type, pos, radius);
+				pushShadowCaster(entity);
 			}
 		}
 		else
 		{
+			pushShadowCaster(entity);
 			m_culling_system->remove(entity);
 		}
 	}
 
+	void setModelInstanceOccluder(EntityRef entity, bool is_occluder) override
+	{
+		ModelInstance& model_instance = m_model_instances.get<MI_DATA>(entity.index);
+		if (model_instance.flags.isSet(ModelInstance::OCCLUDER) == is_occluder) return;
+		
+		model_instance.flags.set(ModelInstance::OCCLUDER, is_occluder);
+		if (is_occluder) m_occluders.push(entity);
+		else m_occluders.swapAndPopItem(entity);
+	}
+
+
+	bool isModelInstanceOccluder(EntityRef entity) override
+	{
+		return m_model_instances.get<MI_DATA>(entity.index).flags.isSet(ModelInstance::OCCLUDER);
+	}
+
+
+	void setModelInstanceBatched(EntityRef entity, bool batched) override
+	{
+		m_model_instances.get<MI_DATA>(entity.index).flags.set(ModelInstance::BATCHED, batched);
+		updateModelInstanceCulling(entity);
+	}
+
+
+	bool isModelInstanceBatched(EntityRef entity) override
+	{
+		return m_model_instances.get<MI_DATA>(entity.index).flags.isSet(ModelInstance::BATCHED);
+	}
+
+
+	void setModelInstanceStaticBatch(EntityRef entity, bool is_batch) override
+	{
+		m_model_instances.get<MI_DATA>(entity.index).flags.set(ModelInstance::STATIC_BATCH, is_batch);
+		updateModelInstanceCulling(entity);
+	}
+
+
+	bool isModelInstanceStaticBatch(EntityRef entity) override
+	{
+		return m_model_instances.get<MI_DATA>(entity.index).flags.isSet(ModelInstance::STATIC_BATCH);
+	}
+
+
+	Span<const EntityRef> getOccluders() const override { return m_occluders; }
+
+
 	void setModelInstanceMaterialOverride(EntityRef entity, const Path& path) override {
-		ModelInstance& mi = m_model_instances[entity.index];
+		ModelInstance& mi = m_model_instances.get<MI_DATA>(entity.index);
 		if (mi.custom_material) {
 			if (mi.custom_material->getPath() == path) return;
 			
@@ -1602,23 +1978,26 @@ struct RenderSceneImpl final : RenderScene {
 		if (m_culling_system->isAdded(entity)) {
 			m_culling_system->remove(entity);
 		}
+		if (!m_universe.isEntityEnabled(entity)) return;
+		if (isHiddenByBatching(mi)) return;
 		const RenderableTypes type = getRenderableType(*mi.model, mi.custom_material);
 		const DVec3 pos = m_universe.getPosition(entity);
 		const float radius = mi.model->getOriginBoundingRadius() * m_universe.getScale(entity);
 		m_culling_system->add(entity, (u8)type, pos, radius);
+		pushShadowCaster(entity);
 	}
 
 	Path getModelInstanceMaterialOverride(EntityRef entity) override {
-		return m_model_instances[entity.index].custom_material ? m_model_instances[entity.index].custom_material->getPath() : Path("");
+		return m_model_instances.get<MI_DATA>(entity.index).custom_material ? m_model_instances.get<MI_DATA>(entity.index).custom_material->getPath() : Path("");
 	}
 
 	Path getModelInstancePath(EntityRef entity) override
 	{
-		return m_model_instances[entity.index].model ? m_model_instances[entity.index].model->getPath() : Path("");
+		return m_model_instances.get<MI_DATA>(entity.index).model ? m_model_instances.get<MI_DATA>(entity.index).model->getPath() : Path("");
 	}
 
 	void setModelInstanceLOD(EntityRef entity, u32 lod) override {
-		m_model_instances[entity.index].lod = float(lod);
+		m_model_instances.get<MI_DATA>(entity.index).lod = float(lod);
 	}
 
 	void setModelInstancePath(EntityRef entity, const Path& path) override
@@ -1670,6 +2049,50 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	// each query is a table {position, radius} or {min, max}, with optional `types` bit mask of RenderableTypes
+	// returns an array of entity arrays, one per query
+	static int LUA_overlaps(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<RenderSceneImpl*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+		Array<EntityRef> entities(scene->m_allocator);
+		entities.resize(256);
+		const int n = (int)lua_objlen(L, 2);
+		lua_createtable(L, n, 0);
+		for (int i = 0; i < n; ++i) {
+			lua_rawgeti(L, 2, i + 1);
+			if (!lua_istable(L, -1)) luaL_argerror(L, 2, "array of queries expected");
+			u32 types = 0xffFFffFF;
+			LuaWrapper::checkField(L, -1, "types", &types);
+			DVec3 position, min, max;
+			float radius;
+			auto query = [&]() -> u32 {
+				if (LuaWrapper::checkField(L, -1, "position", &position)) {
+					if (!LuaWrapper::checkField(L, -1, "radius", &radius)) luaL_error(L, "query is missing radius");
+					return scene->overlapSphere(position, radius, types, entities);
+				}
+				if (!LuaWrapper::checkField(L, -1, "min", &min)) luaL_error(L, "query is missing position or min");
+				if (!LuaWrapper::checkField(L, -1, "max", &max)) luaL_error(L, "query is missing max");
+				return scene->overlapBox(min, max, types, entities);
+			};
+			u32 count = query();
+			if (count > (u32)entities.size()) {
+				entities.resize(count);
+				count = query();
+			}
+			lua_pop(L, 1);
+
+			lua_createtable(L, count, 0);
+			for (u32 j = 0; j < count; ++j) {
+				LuaWrapper::pushEntity(L, entities[j], &scene->m_universe);
+				lua_rawseti(L, -2, j + 1);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+
 	void setTerrainHeightAt(EntityRef entity, int x, int z, float height)
 	{
 		m_terrains[entity]->setHeight(x, z, height);
@@ -1772,7 +2195,7 @@ struct RenderSceneImpl final : RenderScene {
 	{
 		for(int i = entity.index + 1; i < m_model_instances.size(); ++i)
 		{
-			if (m_model_instances[i].flags.isSet(ModelInstance::VALID)) return EntityPtr{i};
+			if (m_model_instances.get<MI_DATA>(i).flags.isSet(ModelInstance::VALID)) return EntityPtr{i};
 		}
 		return INVALID_ENTITY;
 	}
@@ -1806,6 +2229,36 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	CullResult* getRenderables(const ShiftedFrustum& frustum, CullCache& cache, const OcclusionBuffer* occlusion) const override
+	{
+		return m_culling_system->cull(frustum, cache, occlusion);
+	}
+
+
+	void getRenderables(Span<CullView> views) const override
+	{
+		m_culling_system->cull(views);
+	}
+
+
+	u32 overlapSphere(const DVec3& center, float radius, u32 types, Span<EntityRef> out) const override
+	{
+		return m_culling_system->overlapSphere(center, radius, types, out);
+	}
+
+
+	u32 overlapBox(const DVec3& min, const DVec3& max, u32 types, Span<EntityRef> out) const override
+	{
+		return m_culling_system->overlapBox(min, max, types, out);
+	}
+
+
+	u32 overlapFrustum(const ShiftedFrustum& frustum, u32 types, Span<EntityRef> out) const override
+	{
+		return m_culling_system->overlapFrustum(frustum, types, out);
+	}
+
+
 	float getCameraScreenWidth(EntityRef camera) override { return m_cameras[camera].screen_width; }
 	float getCameraScreenHeight(EntityRef camera) override { return m_cameras[camera].screen_height; }
 
@@ -1854,15 +2307,130 @@ struct RenderSceneImpl final : RenderScene {
 		return m_furs[e];
 	}
 
-	HashMap<EntityRef, FurComponent>& getFurs() override {
+	ComponentMap<FurComponent>& getFurs() override {
 		return m_furs;
 	}
 
-	void clearDebugLines() override { m_debug_lines.clear(); }
-	void clearDebugTriangles() override { m_debug_triangles.clear(); }
+	ThreadDebugShapes& getThreadDebugShapes() {
+		if (g_debug_thread_idx < 0) g_debug_thread_idx = atomicIncrement(&g_debug_threads_count) - 1;
+		// threads over the limit share the last buffer, it's still safe since it's guarded by mutex
+		const u32 idx = minimum((u32)g_debug_thread_idx, MAX_DEBUG_THREADS - 1);
+		ThreadDebugShapes* shapes = m_thread_debug_shapes[idx];
+		if (!shapes) {
+			MutexGuard guard(m_thread_debug_shapes_mutex);
+			shapes = m_thread_debug_shapes[idx];
+			if (!shapes) {
+				shapes = LUMIX_NEW(m_allocator, ThreadDebugShapes)(m_allocator);
+				m_thread_debug_shapes[idx] = shapes;
+			}
+		}
+		return *shapes;
+	}
+
+	void clearDebugShapes() override {
+		MutexGuard guard(m_thread_debug_shapes_mutex);
+		for (ThreadDebugShapes* shapes : m_thread_debug_shapes) {
+			if (!shapes) continue;
+			MutexGuard shapes_guard(shapes->mutex);
+			shapes->lines.clear();
+			shapes->triangles.clear();
+			shapes->instances.clear();
+		}
+	}
+
+	bool hasDebugShapes() override {
+		MutexGuard guard(m_thread_debug_shapes_mutex);
+		for (ThreadDebugShapes* shapes : m_thread_debug_shapes) {
+			if (!shapes) continue;
+			MutexGuard shapes_guard(shapes->mutex);
+			if (!shapes->lines.empty() || !shapes->triangles.empty() || !shapes->instances.empty()) return true;
+		}
+		return false;
+	}
+
+	template <typename T>
+	static void moveAppend(Array<T>& dst, Array<T>& src) {
+		if (src.empty()) return;
+		// src keeps its capacity, so it does not need to grow again next frame
+		const u32 offset = dst.size();
+		dst.resize(offset + src.size());
+		memcpy(&dst[offset], src.begin(), src.byte_size());
+		src.clear();
+	}
+
+	void fetchDebugShapes(Array<DebugLine>& lines, Array<DebugTriangle>& triangles, Array<DebugShapeInstance>& instances) override {
+		PROFILE_FUNCTION();
+		MutexGuard guard(m_thread_debug_shapes_mutex);
+		for (ThreadDebugShapes* shapes : m_thread_debug_shapes) {
+			if (!shapes) continue;
+			MutexGuard shapes_guard(shapes->mutex);
+			moveAppend(lines, shapes->lines);
+			moveAppend(triangles, shapes->triangles);
+			moveAppend(instances, shapes->instances);
+		}
+	}
+
+	u32 createStaticDebugShape() override {
+		const u32 id = m_next_static_debug_shape;
+		++m_next_static_debug_shape;
+		m_static_debug_shapes.insert(id, {});
+		return id;
+	}
+
+	void destroyStaticDebugShape(u32 id) override {
+		auto iter = m_static_debug_shapes.find(id);
+		if (!iter.isValid()) return;
+		// draw jobs already queued keep using the buffer, destroy is queued after them
+		if (iter.value().vertex_buffer) m_renderer.destroy(iter.value().vertex_buffer);
+		m_static_debug_shapes.erase(iter);
+	}
+
+	void setStaticDebugShape(u32 id, const DebugShapes& shapes) override {
+		PROFILE_FUNCTION();
+		auto iter = m_static_debug_shapes.find(id);
+		if (!iter.isValid()) return;
+		StaticDebugShape& shape = iter.value();
+		if (shape.vertex_buffer) m_renderer.destroy(shape.vertex_buffer);
+		shape.vertex_buffer = gpu::INVALID_BUFFER;
+		shape.lines_count = shapes.lines.size();
+		shape.triangles_count = shapes.triangles.size();
+		if (shape.lines_count == 0 && shape.triangles_count == 0) return;
+
+		struct Vertex {
+			Vec3 pos;
+			u32 color;
+		};
+		const Renderer::MemRef mem = m_renderer.allocate(sizeof(Vertex) * (shape.lines_count * 2 + shape.triangles_count * 3));
+		Vertex* vertices = (Vertex*)mem.data;
+		for (const DebugLine& line : shapes.lines) {
+			vertices[0] = { Vec3(line.from), line.color };
+			vertices[1] = { Vec3(line.to), line.color };
+			vertices += 2;
+		}
+		for (const DebugTriangle& tri : shapes.triangles) {
+			vertices[0] = { Vec3(tri.p0), tri.color };
+			vertices[1] = { Vec3(tri.p1), tri.color };
+			vertices[2] = { Vec3(tri.p2), tri.color };
+			vertices += 3;
+		}
+		shape.vertex_buffer = m_renderer.createBuffer(mem, gpu::BufferFlags::IMMUTABLE);
+	}
+
+	void drawStaticDebugShape(u32 id, const Transform& tr) override {
+		auto iter = m_static_debug_shapes.find(id);
+		if (!iter.isValid()) return;
+		const StaticDebugShape& shape = iter.value();
+		if (!shape.vertex_buffer) return;
+
+		ThreadDebugShapes& shapes = getThreadDebugShapes();
+		MutexGuard guard(shapes.mutex);
+		DebugShapeInstance& inst = shapes.instances.emplace();
+		inst.vertex_buffer = shape.vertex_buffer;
+		inst.lines_count = shape.lines_count;
+		inst.triangles_count = shape.triangles_count;
+		inst.transform = tr;
+	}
 
-	const Array<DebugTriangle>& getDebugTriangles() const override { return m_debug_triangles; }
-	const Array<DebugLine>& getDebugLines() const override { return m_debug_lines; }
 
 
 	void addDebugHalfSphere(const RigidTransform& transform, float radius, bool top, u32 color)
@@ -1960,11 +2528,13 @@ struct RenderSceneImpl final : RenderScene {
 		const DVec3& p2,
 		u32 color) override
 	{
-		DebugTriangle& tri = m_debug_triangles.emplace();
+		ThreadDebugShapes& shapes = getThreadDebugShapes();
+		MutexGuard guard(shapes.mutex);
+		DebugTriangle& tri = shapes.triangles.emplace();
 		tri.p0 = p0;
 		tri.p1 = p1;
 		tri.p2 = p2;
-		tri.color = ARGBToABGR(color);
+		tri.color = DebugShapes::ARGBToABGR(color);
 	}
 
 
@@ -2113,39 +2683,41 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
-	static u32 ARGBToABGR(u32 color)
-	{
-		return ((color & 0xff) << 16) | (color & 0xff00) | ((color & 0xff0000) >> 16) | (color & 0xff000000);
-	}
-
 
 	void addDebugLine(const DVec3& from, const DVec3& to, u32 color) override 
 	{
-		DebugLine& line = m_debug_lines.emplace();
+		ThreadDebugShapes& shapes = getThreadDebugShapes();
+		MutexGuard guard(shapes.mutex);
+		DebugLine& line = shapes.lines.emplace();
 		line.from = from;
 		line.to = to;
-		line.color = ARGBToABGR(color);
+		line.color = DebugShapes::ARGBToABGR(color);
 	}
 
+	template <typename T>
+	static T* grow(Array<T>& array, int count) {
+		const u32 new_size = array.size() + count;
+		if (new_size > array.capacity()) {
+			array.reserve(maximum(new_size, array.capacity() * 3 / 2));
+		}
+		array.resize(new_size);
+		return &array[new_size - count];
+	}
+
+
 	DebugTriangle* addDebugTriangles(int count) override
 	{
-		const u32 new_size = m_debug_triangles.size() + count;
-		if (new_size > m_debug_triangles.capacity()) {
-			m_debug_triangles.reserve(maximum(new_size, m_debug_triangles.capacity() * 3 / 2));
-		}
-		m_debug_triangles.resize(new_size);
-		return &m_debug_triangles[new_size - count];
+		ThreadDebugShapes& shapes = getThreadDebugShapes();
+		MutexGuard guard(shapes.mutex);
+		return grow(shapes.triangles, count);
 	}
 
 
 	DebugLine* addDebugLines(int count) override
 	{
-		const u32 new_size = m_debug_lines.size() + count;
-		if (new_size > m_debug_lines.capacity()) {
-			m_debug_lines.reserve(maximum(new_size, m_debug_lines.capacity() * 3 / 2));
-		}
-		m_debug_lines.resize(new_size);
-		return &m_debug_lines[new_size - count];
+		ThreadDebugShapes& shapes = getThreadDebugShapes();
+		MutexGuard guard(shapes.mutex);
+		return grow(shapes.lines, count);
 	}
 
 
@@ -2173,41 +2745,34 @@ struct RenderSceneImpl final : RenderScene {
 		PROFILE_FUNCTION();
 		RayCastModelHit hit;
 		hit.is_hit = false;
-		double cur_dist = DBL_MAX;
 		const Universe& universe = getUniverse();
-		for (int i = 0; i < m_model_instances.size(); ++i) {
-			auto& r = m_model_instances[i];
-			if (!r.flags.isSet(ModelInstance::ENABLED)) continue;
-			if (!r.flags.isSet(ModelInstance::VALID)) continue;
-
-			const EntityRef entity{i};
-			const DVec3& pos = universe.getPosition(entity);
-			float scale = universe.getScale(entity);
-			float radius = r.model->getOriginBoundingRadius() * scale;
-			const double dist = length(pos - origin);
-			if (dist - radius > cur_dist) continue;
-			
-			float intersection_t;
-			Vec3 rel_pos = Vec3(origin - pos);
-			if (getRaySphereIntersection(rel_pos, dir, Vec3::ZERO, radius, intersection_t) && intersection_t >= 0) {
-				Vec3 aabb_hit;
-				const Quat rot = universe.getRotation(entity).conjugated();
-				const Vec3 rel_dir = rot.rotate(dir);
-				const AABB& aabb = r.model->getAABB();
-				rel_pos = rot.rotate(rel_pos / scale);
-				if (getRayAABBIntersection(rel_pos, rel_dir, aabb.min, aabb.max - aabb.min, aabb_hit)) {
-					RayCastModelHit new_hit = r.model->castRay(rel_pos, rel_dir, r.pose, entity, &filter);
-					if (new_hit.is_hit && (!hit.is_hit || new_hit.t * scale < hit.t)) {
-						new_hit.entity = entity;
-						new_hit.component_type = MODEL_INSTANCE_TYPE;
-						hit = new_hit;
-						hit.t *= scale;
-						hit.is_hit = true;
-						cur_dist = length(dir) * hit.t;
-					}
+		const u32 types = (1 << (u32)RenderableTypes::MESH)
+			| (1 << (u32)RenderableTypes::SKINNED)
+			| (1 << (u32)RenderableTypes::MESH_MATERIAL_OVERRIDE)
+			| (1 << (u32)RenderableTypes::FUR);
+		// culling system has bounding spheres of all enabled and ready model instances
+		m_culling_system->castRay(origin, dir, types, [&](EntityRef entity, double) -> double {
+			const auto& r = m_model_instances.get<MI_DATA>(entity.index);
+			if (!r.flags.isSet(ModelInstance::VALID)) return hit.is_hit ? hit.t : DBL_MAX;
+
+			const Transform& tr = universe.getTransform(entity);
+			const Quat rot = tr.rot.conjugated();
+			const Vec3 rel_dir = rot.rotate(dir);
+			const Vec3 rel_pos = rot.rotate(Vec3(origin - tr.pos) / tr.scale);
+			const AABB& aabb = r.model->getAABB();
+			Vec3 aabb_hit;
+			if (getRayAABBIntersection(rel_pos, rel_dir, aabb.min, aabb.max - aabb.min, aabb_hit)) {
+				RayCastModelHit new_hit = r.model->castRay(rel_pos, rel_dir, m_model_instances.get<MI_POSE>(entity.index), entity, &filter);
+				if (new_hit.is_hit && (!hit.is_hit || new_hit.t * tr.scale < hit.t)) {
+					new_hit.entity = entity;
+					new_hit.component_type = MODEL_INSTANCE_TYPE;
+					hit = new_hit;
+					hit.t *= tr.scale;
+					hit.is_hit = true;
 				}
 			}
-		}
+			return hit.is_hit ? hit.t : DBL_MAX;
+		});
 
 		for (auto* terrain : m_terrains) {
 			RayCastModelHit terrain_hit = terrain->castRay(origin, dir);
@@ -2301,7 +2866,7 @@ struct RenderSceneImpl final : RenderScene {
 		return m_reflection_probes_texture;
 	}
 
-	void reloadReflectionProbes() {
+	void reloadReflectionProbes() override {
 		for (i32 i = 0; i < m_reflection_probes.size(); ++i) {
 			ReflectionProbe& probe = m_reflection_probes.at(i);
 			const EntityRef e = m_reflection_probes.getKey(i);
@@ -2309,6 +2874,13 @@ struct RenderSceneImpl final : RenderScene {
 		}
 	}
 
+	void reloadReflectionProbe(EntityRef entity) override {
+		ReflectionProbe& probe = m_reflection_probes[entity];
+		// still loading previous version, live updated probes are reloaded again on next update
+		if (probe.load_job) return;
+		load(probe, entity);
+	}
+
 
 	Span<const EnvironmentProbe> getEnvironmentProbes() override {
 		return m_environment_probes.values();
@@ -2342,34 +2914,38 @@ struct RenderSceneImpl final : RenderScene {
 
 	void modelUnloaded(Model*, EntityRef entity)
 	{
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances.get<MI_DATA>(entity.index);
 		r.meshes = nullptr;
 		r.mesh_count = 0;
-		LUMIX_DELETE(m_allocator, r.pose);
-		r.pose = nullptr;
+		Pose*& pose = m_model_instances.get<MI_POSE>(entity.index);
+		LUMIX_DELETE(m_allocator, pose);
+		pose = nullptr;
 
+		pushShadowCaster(entity);
 		m_culling_system->remove(entity);
 	}
 
 
 	void modelLoaded(Model* model, EntityRef entity)
 	{
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances.get<MI_DATA>(entity.index);
 
 		float bounding_radius = r.model->getOriginBoundingRadius();
 		float scale = m_universe.getScale(entity);
 		const DVec3 pos = m_universe.getPosition(entity);
 		const float radius = bounding_radius * scale;
-		if(r.flags.isSet(ModelInstance::ENABLED)) {
+		if(r.flags.isSet(ModelInstance::ENABLED) && m_universe.isEntityEnabled(entity) && !isHiddenByBatching(r)) {
 			const RenderableTypes type = getRenderableType(*model, r.custom_material);
 			m_culling_system->add(entity, (u8)type, pos, radius);
+			pushShadowCaster(entity);
 		}
-		ASSERT(!r.pose);
+		Pose*& pose = m_model_instances.get<MI_POSE>(entity.index);
+		ASSERT(!pose);
 		if (model->getBoneCount() > 0)
 		{
-			r.pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
-			r.pose->resize(model->getBoneCount());
-			model->getPose(*r.pose);
+			pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
+			pose->resize(model->getBoneCount());
+			model->getPose(*pose);
 		}
 		r.meshes = &r.model->getMesh(0);
 		r.mesh_count = r.model->getMeshCount();
@@ -2395,7 +2971,7 @@ struct RenderSceneImpl final : RenderScene {
 	{
 		for (int i = 0, c = m_model_instances.size(); i < c; ++i)
 		{
-			if (m_model_instances[i].flags.isSet(ModelInstance::VALID) && m_model_instances[i].model == model)
+			if (m_model_instances.get<MI_DATA>(i).flags.isSet(ModelInstance::VALID) && m_model_instances.get<MI_DATA>(i).model == model)
 			{
 				modelUnloaded(model, {i});
 			}
@@ -2409,7 +2985,7 @@ struct RenderSceneImpl final : RenderScene {
 		EntityPtr e = map_iter.value();
 		while(e.isValid()) {
 			modelLoaded(model, (EntityRef)e);
-			e = m_model_instances[e.index].next_model;
+			e = m_model_instances.get<MI_LINK>(e.index).next_model;
 		}
 	}
 
@@ -2448,12 +3024,12 @@ struct RenderSceneImpl final : RenderScene {
 	
 	void addToModelEntityMap(Model* model, EntityRef entity)
 	{
-		ModelInstance& r = m_model_instances[entity.index];
+		ModelInstanceLink& r = m_model_instances.get<MI_LINK>(entity.index);
 		r.prev_model = INVALID_ENTITY;
 		auto map_iter = m_model_entity_map.find(model);
 		if(map_iter.isValid()) {
 			r.next_model = map_iter.value();
-			m_model_instances[r.next_model.index].prev_model = entity;
+			m_model_instances.get<MI_LINK>(r.next_model.index).prev_model = entity;
 			m_model_entity_map[model] = entity;
 		}
 		else {
@@ -2466,12 +3042,12 @@ struct RenderSceneImpl final : RenderScene {
 
 	void removeFromModelEntityMap(Model* model, EntityRef entity)
 	{
-		ModelInstance& r = m_model_instances[entity.index];
+		ModelInstanceLink& r = m_model_instances.get<MI_LINK>(entity.index);
 		if(r.prev_model.isValid()) {
-			m_model_instances[r.prev_model.index].next_model = r.next_model;
+			m_model_instances.get<MI_LINK>(r.prev_model.index).next_model = r.next_model;
 		}
 		if(r.next_model.isValid()) {
-			m_model_instances[r.next_model.index].prev_model = r.prev_model;
+			m_model_instances.get<MI_LINK>(r.next_model.index).prev_model = r.prev_model;
 		}
 		auto map_iter = m_model_entity_map.find(model);
 		if(map_iter.value() == entity) {
@@ -2531,7 +3107,7 @@ struct RenderSceneImpl final : RenderScene {
 
 	void setModel(EntityRef entity, Model* model)
 	{
-		auto& model_instance = m_model_instances[entity.index];
+		auto& model_instance = m_model_instances.get<MI_DATA>(entity.index);
 		ASSERT(model_instance.flags.isSet(ModelInstance::VALID));
 		Model* old_model = model_instance.model;
 		bool no_change = model == old_model && old_model;
@@ -2546,6 +3122,7 @@ struct RenderSceneImpl final : RenderScene {
 
 			if (old_model->isReady())
 			{
+				pushShadowCaster(entity);
 				m_culling_system->remove(entity);
 			}
 			old_model->decRefCount();
@@ -2553,8 +3130,9 @@ struct RenderSceneImpl final : RenderScene {
 		model_instance.model = model;
 		model_instance.meshes = nullptr;
 		model_instance.mesh_count = 0;
-		LUMIX_DELETE(m_allocator, model_instance.pose);
-		model_instance.pose = nullptr;
+		Pose*& pose = m_model_instances.get<MI_POSE>(entity.index);
+		LUMIX_DELETE(m_allocator, pose);
+		pose = nullptr;
 		if (model)
 		{
 			addToModelEntityMap(model, entity);
@@ -2603,6 +3181,30 @@ struct RenderSceneImpl final : RenderScene {
 		m_universe.onComponentCreated(entity, POINT_LIGHT_TYPE, this);
 	}
 
+	void createPointLights(Span<const EntityRef> entities)
+	{
+		m_point_lights.reserve(m_point_lights.size() + entities.length());
+		Array<DVec3> positions(m_allocator);
+		positions.reserve(entities.length());
+		for (EntityRef entity : entities) {
+			PointLight& light = m_point_lights.insert(entity);
+			light.entity = entity;
+			light.color = Vec3(1, 1, 1);
+			light.intensity = 1;
+			light.fov = degreesToRadians(360);
+			light.flags.base = 0;
+			light.attenuation_param = 2;
+			light.range = 10;
+			light.guid = randGUID();
+			positions.push(m_universe.getPosition(entity));
+		}
+		// all lights have the same default range
+		const float range = 10;
+		m_culling_system->add(entities, (u8)RenderableTypes::LOCAL_LIGHT, positions, Span(&range, 1));
+
+		m_universe.onComponentsCreated(entities, POINT_LIGHT_TYPE, this);
+	}
+
 
 	void updateDecalInfo(Decal& decal) const
 	{
@@ -2682,20 +3284,27 @@ struct RenderSceneImpl final : RenderScene {
 	}
 
 
+	// appends an invalid model instance, used to fill the gaps, since model instances are indexed by entity
+	void emplaceModelInstance()
+	{
+		const u32 idx = m_model_instances.emplace();
+		ModelInstance& r = m_model_instances.get<MI_DATA>(idx);
+		r.flags.clear();
+		r.flags.set(ModelInstance::VALID, false);
+		r.model = nullptr;
+		m_model_instances.get<MI_POSE>(idx) = nullptr;
+	}
+
 	void createModelInstance(EntityRef entity)
 	{
 		while(entity.index >= m_model_instances.size())
 		{
-			auto& r = m_model_instances.emplace();
-			r.flags.clear();
-			r.flags.set(ModelInstance::VALID, false);
-			r.model = nullptr;
-			r.pose = nullptr;
+			emplaceModelInstance();
 		}
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances.get<MI_DATA>(entity.index);
 		r.model = nullptr;
 		r.meshes = nullptr;
-		r.pose = nullptr;
+		m_model_instances.get<MI_POSE>(entity.index) = nullptr;
 		r.flags.clear();
 		r.flags.set(ModelInstance::VALID);
 		r.flags.set(ModelInstance::ENABLED);
@@ -2703,7 +3312,33 @@ struct RenderSceneImpl final : RenderScene {
 		m_universe.onComponentCreated(entity, MODEL_INSTANCE_TYPE, this);
 	}
 
-	void updateParticleEmitter(EntityRef entity, float dt) override { m_particle_emitters[entity].update(dt, m_engine.getPageAllocator()); }
+	// model instances are added to culling when their models are loaded, see ModelInstancePath
+	void createModelInstances(Span<const EntityRef> entities)
+	{
+		i32 max_index = -1;
+		for (EntityRef e : entities) max_index = maximum(max_index, e.index);
+		m_model_instances.reserve(max_index + 1);
+		while (max_index >= (i32)m_model_instances.size()) emplaceModelInstance();
+
+		for (EntityRef entity : entities) {
+			auto& r = m_model_instances.get<MI_DATA>(entity.index);
+			r.model = nullptr;
+			r.meshes = nullptr;
+			m_model_instances.get<MI_POSE>(entity.index) = nullptr;
+			r.flags.clear();
+			r.flags.set(ModelInstance::VALID);
+			r.flags.set(ModelInstance::ENABLED);
+			r.mesh_count = 0;
+		}
+		m_universe.onComponentsCreated(entities, MODEL_INSTANCE_TYPE, this);
+	}
+
+	void updateParticleEmitter(EntityRef entity, float dt) override {
+		ParticleEmitter& emitter = m_particle_emitters[entity];
+		u32 emit_budget = m_particle_budget;
+		emitter.update(dt, 1, emit_budget, m_engine.getPageAllocator());
+		emitter.simulateGPU(m_renderer);
+	}
 
 	void setParticleEmitterPath(EntityRef entity, const Path& path) override {
 		ParticleEmitterResource* res = m_engine.getResourceManager().load<ParticleEmitterResource>(path);
@@ -2723,33 +3358,61 @@ struct RenderSceneImpl final : RenderScene {
 		return iter.value();
 	}
 
-	const HashMap<EntityRef, ParticleEmitter>& getParticleEmitters() const override { return m_particle_emitters; }
+	const ComponentMap<ParticleEmitter>& getParticleEmitters() const override { return m_particle_emitters; }
+
+	CullResult* getParticleEmitters(const ShiftedFrustum& frustum) const override {
+		return m_particle_culling->cull(frustum);
+	}
+
+	void setParticleEmitterRadius(EntityRef entity, float radius) override {
+		ParticleEmitter& emitter = m_particle_emitters[entity];
+		emitter.m_radius = radius;
+		if (m_particle_culling->isAdded(entity)) m_particle_culling->setRadius(entity, radius);
+	}
+
+	float getParticleEmitterRadius(EntityRef entity) override {
+		return m_particle_emitters[entity].m_radius;
+	}
+
+	void setParticleBudget(u32 count) { m_particle_budget = count; }
+	u32 getParticleBudget() { return m_particle_budget; }
 
 	IAllocator& m_allocator;
 	Universe& m_universe;
 	Renderer& m_renderer;
 	Engine& m_engine;
 	UniquePtr<CullingSystem> m_culling_system;
+	// emitters have their own culling, their entities can have other renderables
+	UniquePtr<CullingSystem> m_particle_culling;
+	u32 m_particle_budget = 256 * 1024; // max live cpu particles, emitters stop emitting when reached
 	u64 m_render_cmps_mask;
 
 	EntityPtr m_active_global_light_entity;
-	HashMap<EntityRef, PointLight> m_point_lights;
-	HashMap<EntityRef, Decal> m_decals;
-	HashMap<EntityRef, CurveDecal> m_curve_decals;
-	Array<ModelInstance> m_model_instances;
+	ComponentMap<PointLight> m_point_lights;
+	ComponentMap<Decal> m_decals;
+	ComponentMap<CurveDecal> m_curve_decals;
+	// columns of m_model_instances, pose and links are not needed by culling and lod selection
+	enum { MI_DATA, MI_POSE, MI_LINK };
+	SoA<ModelInstance, Pose*, ModelInstanceLink> m_model_instances;
+	Array<EntityRef> m_occluders; // model instances with OCCLUDER flag
+	// ring buffer, m_moved_shadow_casters_count is never reset so consumers can keep a cursor
+	MovedShadowCaster m_moved_shadow_casters[4096];
+	u64 m_moved_shadow_casters_count = 0;
 	HashMap<EntityRef, Environment> m_environments;
-	HashMap<EntityRef, Camera> m_cameras;
+	ComponentMap<Camera> m_cameras;
 	EntityPtr m_active_camera = INVALID_ENTITY;
 	AssociativeArray<EntityRef, BoneAttachment> m_bone_attachments;
 	AssociativeArray<EntityRef, EnvironmentProbe> m_environment_probes;
 	AssociativeArray<EntityRef, ReflectionProbe> m_reflection_probes;
-	HashMap<EntityRef, Terrain*> m_terrains;
-	HashMap<EntityRef, ParticleEmitter> m_particle_emitters;
+	ComponentMap<Terrain*> m_terrains;
+	ComponentMap<ParticleEmitter> m_particle_emitters;
 	gpu::TextureHandle m_reflection_probes_texture = gpu::INVALID_TEXTURE;
 
-	Array<DebugTriangle> m_debug_triangles;
-	Array<DebugLine> m_debug_lines;
-	HashMap<EntityRef, FurComponent> m_furs;
+	ThreadDebugShapes* m_thread_debug_shapes[MAX_DEBUG_THREADS] = {};
+	Mutex m_thread_debug_shapes_mutex;
+	HashMap<u32, StaticDebugShape> m_static_debug_shapes;
+	u32 m_next_static_debug_shape = 1;
+	ComponentMap<FurComponent> m_furs;
 
 	float m_lod_multiplier;
 	bool m_is_updating_attachments;
@@ -2780,15 +3443,46 @@ void ReflectionProbe::LoadJob::callback(u64 size, const u8* data, bool success)
 	struct Job : Renderer::RenderJob {
 		Job(IAllocator& allocator) : data(allocator) {}
 
-		void setup() override {}
+		// probes baked before BC6H are RGBM in BC3, both formats have 16B blocks, so they are converted in place
+		void setup() override {
+			gpu::TextureDesc desc;
+			u8* image_data = Texture::getLBCInfo(data.getMutableData(), desc);
+			if (!image_data || desc.format != gpu::TextureFormat::BC3) return;
+
+			PROFILE_FUNCTION();
+			logWarning("Reflection probe ", guid, " is in old RGBM format, it's converted on load, bake probes again to fix this.");
+			u32 size = 0;
+			for (u32 mip = 0; mip < desc.mips; ++mip) {
+				size += 6 * gpu::getSize(desc.format, maximum(desc.width >> mip, 1), maximum(desc.height >> mip, 1));
+			}
+			const u32 offset = u32(image_data - data.data());
+			if (offset + size > data.size()) return;
+
+			for (u8* block = image_data, *end = image_data + size; block != end; block += 16) {
+				u8 rgbm[16 * 4];
+				BCEncoder::decodeBC3(rgbm, block);
+				float rgb[16 * 3];
+				for (u32 i = 0; i < 16; ++i) {
+					const float m = rgbm[i * 4 + 3] / 255.f * 4;
+					for (u32 c = 0; c < 3; ++c) rgb[i * 3 + c] = rgbm[i * 4 + c] / 255.f * m;
+				}
+				BCEncoder::encodeBC6H(block, rgb, 1);
+			}
+			converted = true;
+		}
 				
 		void execute() override {
 			gpu::TextureDesc desc;
-			const u8* image_data = Texture::getLBCInfo(data.data(), desc);
+			const u8* image_data = Texture::getLBCInfo(data.getMutableData(), desc);
 			if (!image_data) return;
 
 			ASSERT(desc.depth == 1);
 			ASSERT(desc.is_cubemap);
+			if (converted) desc.format = gpu::TextureFormat::BC6H;
+			if (desc.format != gpu::TextureFormat::BC6H) {
+				logError("Reflection probe ", guid, " has unsupported format");
+				return;
+			}
 
 			const u32 offset = u32(image_data - data.data());
 			InputMemoryStream blob(image_data, (u32)data.size() - offset);
@@ -2803,12 +3497,15 @@ void ReflectionProbe::LoadJob::callback(u64 size, const u8* data, bool success)
 		}
 
 		u32 layer;
+		u64 guid;
+		bool converted = false;
 		OutputMemoryStream data;
 		gpu::TextureHandle tex;
 	};
 			
 	Job& job = m_scene.m_renderer.createJob<Job>(m_allocator);
 	job.layer = probe.texture_id;
+	job.guid = probe.guid;
 	job.tex = m_scene.m_reflection_probes_texture;
 	job.data.write(data, size);
 	m_scene.m_renderer.queue(job, 0);	
@@ -2867,6 +3564,8 @@ void RenderScene::reflect() {
 		.LUMIX_FUNC(RenderSceneImpl::addDebugLine)
 		.LUMIX_FUNC(RenderSceneImpl::addDebugTriangle)
 		.LUMIX_FUNC(RenderSceneImpl::setActiveCamera)
+		.LUMIX_FUNC(RenderSceneImpl::setParticleBudget)
+		.LUMIX_FUNC(RenderSceneImpl::getParticleBudget)
 		.LUMIX_CMP(BoneAttachment, "bone_attachment", "Render / Bone attachment")
 			.icon(ICON_FA_BONE)
 			.LUMIX_PROP(BoneAttachmentParent, "Parent")
@@ -2878,6 +3577,7 @@ void RenderScene::reflect() {
 			.var_prop<&RenderScene::getFur, &FurComponent::scale>("Scale")
 			.var_prop<&RenderScene::getFur, &FurComponent::gravity>("Gravity")
 			.var_prop<&RenderScene::getFur, &FurComponent::enabled>("Enabled")
+			.var_prop<&RenderScene::getFur, &FurComponent::lod_distance>("LOD distance").minAttribute(0)
 		.LUMIX_CMP(EnvironmentProbe, "environment_probe", "Render / Environment probe")
 			.prop<&RenderScene::isEnvironmentProbeEnabled, &RenderScene::enableEnvironmentProbe>("Enabled")
 			.var_prop<&RenderScene::getEnvironmentProbe, &EnvironmentProbe::inner_range>("Inner range")
@@ -2889,6 +3589,12 @@ void RenderScene::reflect() {
 		.LUMIX_CMP(ParticleEmitter, "particle_emitter", "Render / Particle emitter")
 			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_emit_rate>("Emit rate")
 			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_autodestroy>("Autodestroy")
+			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_gpu>("GPU simulation")
+			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_gpu_capacity>("GPU capacity").minAttribute(64)
+			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_sort>("Depth sort")
+			.LUMIX_PROP(ParticleEmitterRadius, "Bounds radius").minAttribute(0)
+			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_lod_distance>("LOD distance").minAttribute(0)
+			.var_prop<&RenderScene::getParticleEmitter, &ParticleEmitter::m_catch_up>("Catch up offscreen time")
 			.LUMIX_PROP(ParticleEmitterPath, "Source").resourceAttribute(ParticleEmitterResource::TYPE)
 		.LUMIX_CMP(Camera, "camera", "Render / Camera")
 			.icon(ICON_FA_CAMERA)
@@ -2898,8 +3604,12 @@ void RenderScene::reflect() {
 			.var_prop<&RenderScene::getCamera, &Camera::is_ortho>("Orthographic")
 			.var_prop<&RenderScene::getCamera, &Camera::ortho_size>("Orthographic size").minAttribute(0)
 		.LUMIX_CMP(ModelInstance, "model_instance", "Render / Mesh")
+			.bulk_create<&ReflScene::createModelInstances>()
 			.LUMIX_FUNC_EX(RenderScene::getModelInstanceModel, "getModel")
 			.prop<&RenderScene::isModelInstanceEnabled, &RenderScene::enableModelInstance>("Enabled")
+			.prop<&RenderScene::isModelInstanceOccluder, &RenderScene::setModelInstanceOccluder>("Occluder")
+			.prop<&RenderScene::isModelInstanceBatched, &RenderScene::setModelInstanceBatched>("Batched")
+			.prop<&RenderScene::isModelInstanceStaticBatch, &RenderScene::setModelInstanceStaticBatch>("Static batch").noUIAttribute()
 			.prop<&RenderScene::getModelInstanceMaterialOverride,&RenderScene::setModelInstanceMaterialOverride>("Material").noUIAttribute()
 			.LUMIX_PROP(ModelInstancePath, "Source").resourceAttribute(Model::TYPE)
 		.LUMIX_CMP(Environment, "environment", "Render / Environment")
@@ -2910,6 +3620,7 @@ void RenderScene::reflect() {
 			.LUMIX_PROP(ShadowmapCascades, "Shadow cascades")
 			.LUMIX_PROP(EnvironmentCastShadows, "Cast shadows")
 		.LUMIX_CMP(PointLight, "point_light", "Render / Point light")
+			.bulk_create<&ReflScene::createPointLights>()
 			.icon(ICON_FA_LIGHTBULB)
 			.LUMIX_PROP(PointLightCastShadows, "Cast shadows")
 			.LUMIX_PROP(PointLightDynamic, "Dynamic")
@@ -2953,14 +3664,14 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_allocator(allocator)
 	, m_model_entity_map(m_allocator)
 	, m_model_instances(m_allocator)
+	, m_occluders(m_allocator)
 	, m_cameras(m_allocator)
 	, m_terrains(m_allocator)
 	, m_point_lights(m_allocator)
 	, m_environments(m_allocator)
 	, m_decals(m_allocator)
 	, m_curve_decals(m_allocator)
-	, m_debug_triangles(m_allocator)
-	, m_debug_lines(m_allocator)
+	, m_static_debug_shapes(m_allocator)
 	, m_active_global_light_entity(INVALID_ENTITY)
 	, m_active_camera(INVALID_ENTITY)
 	, m_is_game_running(false)
@@ -2976,14 +3687,18 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 {
 
 	m_universe.entityTransformed().bind<&RenderSceneImpl::onEntityMoved>(this);
+	m_universe.entitiesTransformed().bind<&RenderSceneImpl::onEntitiesMoved>(this);
+	m_universe.entitiesInterpolated().bind<&RenderSceneImpl::onEntitiesInterpolated>(this);
 	m_universe.entityDestroyed().bind<&RenderSceneImpl::onEntityDestroyed>(this);
+	m_universe.entityEnabled().bind<&RenderSceneImpl::onEntityEnabled>(this);
 	m_culling_system = CullingSystem::create(m_allocator, engine.getPageAllocator());
+	m_particle_culling = CullingSystem::create(m_allocator, engine.getPageAllocator());
 	m_model_instances.reserve(5000);
 
 	m_render_cmps_mask = 0;
 
 	Renderer::MemRef mem;
-	m_reflection_probes_texture = renderer.createTexture(128, 128, 32, gpu::TextureFormat::BC3, gpu::TextureFlags::IS_CUBE, mem, "reflection_probes");
+	m_reflection_probes_texture = renderer.createTexture(128, 128, 32, gpu::TextureFormat::BC6H, gpu::TextureFlags::IS_CUBE, mem, "reflection_probes");
 
 	const u32 hash = crc32("renderer");
 	for (const reflection::RegisteredComponent& cmp : reflection::getComponents()) {
@@ -3026,6 +3741,7 @@ void RenderScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(makeScreenshot);
 
 	LuaWrapper::createSystemFunction(L, "Renderer", "castCameraRay", &RenderSceneImpl::LUA_castCameraRay);
+	LuaWrapper::createSystemFunction(L, "Renderer", "overlaps", &RenderSceneImpl::LUA_overlaps);
 
 	#undef REGISTER_FUNCTION
 }
@@ -2,6 +2,8 @@
 
 
 #include "engine/lumix.h"
+#include "engine/array.h"
+#include "engine/component_map.h"
 #include "engine/flag_set.h"
 #include "engine/hash_map.h"
 #include "engine/math.h"
@@ -17,7 +19,9 @@ namespace Lumix
 
 
 struct AABB;
+struct CullCache;
 struct CullResult;
+struct OcclusionBuffer;
 struct Engine;
 struct Frustum;
 struct IAllocator;
@@ -151,20 +155,31 @@ struct ModelInstance
 		IS_BONE_ATTACHMENT_PARENT = 1 << 0,
 		ENABLED = 1 << 1,
 		VALID = 1 << 2,
+		OCCLUDER = 1 << 3, // rasterized into OcclusionBuffer
+		BATCHED = 1 << 4, // merged into a static batch, not rendered while the game runs
+		STATIC_BATCH = 1 << 5, // merged geometry of BATCHED instances, rendered only while the game runs
+		DYNAMIC = 1 << 6, // moved since it was added, its shadow is not cached
 	};
 
+	// only data needed by culling and lod selection is here, the rest is in separate columns, see getModelInstancePoses
 	Model* model;
 	Mesh* meshes;
-	Pose* pose;
 	Material* custom_material = nullptr; 
-	EntityPtr next_model = INVALID_ENTITY;
-	EntityPtr prev_model = INVALID_ENTITY;
 	float lod = 4;
 	FlagSet<Flags, u8> flags;
 	u16 mesh_count;
 };
 
 
+// bounding sphere of a model instance before or after it moved, used to invalidate cached shadows
+struct MovedShadowCaster
+{
+	DVec3 pos;
+	float radius;
+	bool dynamic; // dynamic casters are not in the static layer of cached shadow slices
+};
+
+
 struct MeshInstance
 {
 	EntityRef owner;
@@ -201,6 +216,49 @@ struct DebugLine
 };
 
 
+// collects shapes for RenderScene::setStaticDebugShape, colors are ARGB like in RenderScene::addDebugLine
+struct DebugShapes
+{
+	explicit DebugShapes(IAllocator& allocator) : lines(allocator), triangles(allocator) {}
+
+	static u32 ARGBToABGR(u32 color) { return (color & 0xff00ff00) | ((color & 0xff) << 16) | ((color >> 16) & 0xff); }
+
+	void addLine(const DVec3& from, const DVec3& to, u32 color) {
+		DebugLine& line = lines.emplace();
+		line.from = from;
+		line.to = to;
+		line.color = ARGBToABGR(color);
+	}
+
+	void addTriangle(const DVec3& p0, const DVec3& p1, const DVec3& p2, u32 color) {
+		DebugTriangle& tri = triangles.emplace();
+		tri.p0 = p0;
+		tri.p1 = p1;
+		tri.p2 = p2;
+		tri.color = ARGBToABGR(color);
+	}
+
+	void clear() {
+		lines.clear();
+		triangles.clear();
+	}
+
+	Array<DebugLine> lines;
+	Array<DebugTriangle> triangles;
+};
+
+
+// static debug shape requested to be rendered in this frame
+struct DebugShapeInstance
+{
+	// lines followed by triangles
+	gpu::BufferHandle vertex_buffer;
+	u32 lines_count;
+	u32 triangles_count;
+	Transform transform;
+};
+
+
 enum class RenderableTypes : u8 {
 	MESH,
 	SKINNED,
@@ -219,6 +277,7 @@ struct FurComponent {
 	float scale = 0.01f;
 	float gravity = 1.f;
 	bool enabled = true;
+	float lod_distance = 10; // further furs are drawn with less layers, 0 to disable
 };
 
 struct LUMIX_RENDERER_API RenderScene : IScene
@@ -234,6 +293,11 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual RayCastModelHit castRay(const DVec3& origin, const Vec3& dir, EntityPtr ignore) = 0;
 	virtual RayCastModelHit castRayTerrain(EntityRef entity, const DVec3& origin, const Vec3& dir) = 0;
 	virtual void getRay(EntityRef entity, const Vec2& screen_pos, DVec3& origin, Vec3& dir) = 0;
+	// entities whose bounding spheres overlap the shape, see CullingSystem::overlapSphere
+	// `types` is a bit mask of RenderableTypes, only enabled renderables with loaded resources are found
+	virtual u32 overlapSphere(const DVec3& center, float radius, u32 types, Span<EntityRef> out) const = 0;
+	virtual u32 overlapBox(const DVec3& min, const DVec3& max, u32 types, Span<EntityRef> out) const = 0;
+	virtual u32 overlapFrustum(const ShiftedFrustum& frustum, u32 types, Span<EntityRef> out) const = 0;
 
 	virtual void setActiveCamera(EntityRef camera) = 0;
 	virtual EntityPtr getActiveCamera() const = 0;
@@ -254,6 +318,9 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Vec4 getShadowmapCascades(EntityRef entity) = 0;
 	virtual void setShadowmapCascades(EntityRef entity, const Vec4& value) = 0;
 
+	// debug shapes are rendered only once, by the first pipeline calling renderDebugShapes
+	// add* functions are thread safe, each thread has its own buffer
+	// memory returned by addDebugTriangles and addDebugLines must be filled before pipelines are rendered
 	virtual DebugTriangle* addDebugTriangles(int count) = 0;
 	virtual void addDebugTriangle(const DVec3& p0, const DVec3& p1, const DVec3& p2, u32 color) = 0;
 	virtual void addDebugLine(const DVec3& from, const DVec3& to, u32 color) = 0; 
@@ -262,6 +329,13 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual void addDebugCube(const DVec3& pos, const Vec3& dir, const Vec3& up, const Vec3& right, u32 color) = 0;
 	virtual void addDebugCube(const DVec3& from, const DVec3& max, u32 color) = 0;
 	virtual void addDebugCubeSolid(const DVec3& from, const DVec3& max, u32 color) = 0;
+	// static shapes are uploaded to GPU only in setStaticDebugShape, use them for big data which rarely change, e.g. navmesh
+	// they are rendered only in frames in which drawStaticDebugShape is called, so they can be cheaply instanced
+	virtual u32 createStaticDebugShape() = 0;
+	virtual void destroyStaticDebugShape(u32 id) = 0;
+	// positions are in the shape's local space, see drawStaticDebugShape
+	virtual void setStaticDebugShape(u32 id, const DebugShapes& shapes) = 0;
+	virtual void drawStaticDebugShape(u32 id, const Transform& tr) = 0;
 
 	virtual EntityPtr getBoneAttachmentParent(EntityRef entity) = 0;
 	virtual void setBoneAttachmentParent(EntityRef entity, EntityPtr parent) = 0;
@@ -273,13 +347,14 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual void setBoneAttachmentRotation(EntityRef entity, const Vec3& rot) = 0;
 	virtual void setBoneAttachmentRotationQuat(EntityRef entity, const Quat& rot) = 0;
 
-	virtual HashMap<EntityRef, FurComponent>& getFurs() = 0;
+	virtual ComponentMap<FurComponent>& getFurs() = 0;
 	virtual FurComponent& getFur(EntityRef e) = 0;
 
-	virtual void clearDebugLines() = 0;
-	virtual void clearDebugTriangles() = 0;
-	virtual const Array<DebugTriangle>& getDebugTriangles() const = 0;
-	virtual const Array<DebugLine>& getDebugLines() const = 0;
+	virtual void clearDebugShapes() = 0;
+	// true if any shapes were added since they were last fetched or cleared
+	virtual bool hasDebugShapes() = 0;
+	// moves debug shapes added by all threads since the last call to the output arrays
+	virtual void fetchDebugShapes(Array<DebugLine>& lines, Array<DebugTriangle>& triangles, Array<DebugShapeInstance>& instances) = 0;
 
 	virtual Camera& getCamera(EntityRef entity) = 0;
 	virtual Matrix getCameraProjection(EntityRef entity) = 0;
@@ -291,14 +366,25 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual void setParticleEmitterPath(EntityRef entity, const Path& path) = 0;
 	virtual Path getParticleEmitterPath(EntityRef entity) = 0;
 	virtual void updateParticleEmitter(EntityRef entity, float dt) = 0;
-	virtual const HashMap<EntityRef, struct ParticleEmitter>& getParticleEmitters() const = 0;
+	virtual const ComponentMap<struct ParticleEmitter>& getParticleEmitters() const = 0;
 	virtual ParticleEmitter& getParticleEmitter(EntityRef e) = 0;
+	virtual CullResult* getParticleEmitters(const ShiftedFrustum& frustum) const = 0;
+	virtual void setParticleEmitterRadius(EntityRef entity, float radius) = 0;
+	virtual float getParticleEmitterRadius(EntityRef entity) = 0;
 
 	virtual void enableModelInstance(EntityRef entity, bool enable) = 0;
 	virtual bool isModelInstanceEnabled(EntityRef entity) = 0;
+	virtual void setModelInstanceOccluder(EntityRef entity, bool is_occluder) = 0;
+	virtual bool isModelInstanceOccluder(EntityRef entity) = 0;
+	virtual void setModelInstanceBatched(EntityRef entity, bool batched) = 0;
+	virtual bool isModelInstanceBatched(EntityRef entity) = 0;
+	virtual void setModelInstanceStaticBatch(EntityRef entity, bool is_batch) = 0;
+	virtual bool isModelInstanceStaticBatch(EntityRef entity) = 0;
+	virtual Span<const EntityRef> getOccluders() const = 0;
 	virtual ModelInstance* getModelInstance(EntityRef entity) = 0;
 	virtual Span<const ModelInstance> getModelInstances() const = 0;
 	virtual Span<ModelInstance> getModelInstances() = 0;
+	virtual Span<Pose* const> getModelInstancePoses() const = 0;
 	virtual Path getModelInstancePath(EntityRef entity) = 0;
 	virtual void setModelInstanceLOD(EntityRef entity, u32 lod) = 0;
 	virtual void setModelInstancePath(EntityRef entity, const Path& path) = 0;
@@ -306,9 +392,13 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Path getModelInstanceMaterialOverride(EntityRef entity) = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum, RenderableTypes type) const = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum) const = 0;
+	virtual CullResult* getRenderables(const ShiftedFrustum& frustum, CullCache& cache, const OcclusionBuffer* occlusion) const = 0;
+	virtual void getRenderables(Span<struct CullView> views) const = 0;
 	virtual EntityPtr getFirstModelInstance() = 0;
 	virtual EntityPtr getNextModelInstance(EntityPtr entity) = 0;
 	virtual Model* getModelInstanceModel(EntityRef entity) = 0;
+	// appends casters moved since `cursor` and advances it, returns false if some of them were already dropped from history
+	virtual bool getMovedShadowCasters(u64& cursor, Array<MovedShadowCaster>& out) const = 0;
 
 	virtual CurveDecal& getCurveDecal(EntityRef entity) = 0;
 	virtual void setCurveDecalMaterialPath(EntityRef entity, const Path& path) = 0;
@@ -329,9 +419,10 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Vec3 getDecalHalfExtents(EntityRef entity) = 0;
 
 	virtual Terrain* getTerrain(EntityRef entity) = 0;
-	virtual const HashMap<EntityRef, Terrain*>& getTerrains() = 0;
+	virtual const ComponentMap<Terrain*>& getTerrains() = 0;
 	virtual void getTerrainInfos(Array<TerrainInfo>& infos) = 0;
 	virtual float getTerrainHeightAt(EntityRef entity, float x, float z) = 0;
+	virtual void getTerrainHeightsAt(EntityRef entity, Span<const Vec2> xz, Span<float> heights) = 0;
 	virtual Vec3 getTerrainNormalAt(EntityRef entity, float x, float z) = 0;
 	virtual void setTerrainMaterialPath(EntityRef entity, const Path& path) = 0;
 	virtual Path getTerrainMaterialPath(EntityRef entity) = 0;
@@ -361,7 +452,7 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual bool getEnvironmentCastShadows(EntityRef entity) = 0;
 	virtual void setEnvironmentCastShadows(EntityRef entity, bool enable) = 0;
 	virtual Environment& getEnvironment(EntityRef entity) = 0;
-	virtual const HashMap<EntityRef, PointLight>& getPointLights() = 0;
+	virtual const ComponentMap<PointLight>& getPointLights() = 0;
 	virtual PointLight& getPointLight(EntityRef entity) = 0;
 	virtual float getLightRange(EntityRef entity) = 0;
 	virtual void setLightRange(EntityRef entity, float value) = 0;
@@ -377,6 +468,7 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Span<const ReflectionProbe> getReflectionProbes() = 0;
 	virtual gpu::TextureHandle getReflectionProbesTexture() = 0;
 	virtual void reloadReflectionProbes() = 0;
+	virtual void reloadReflectionProbe(EntityRef entity) = 0;
 
 	virtual Span<EntityRef> getEnvironmentProbesEntities() = 0;
 	virtual EnvironmentProbe& getEnvironmentProbe(EntityRef entity) = 0;
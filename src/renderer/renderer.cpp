@@ -5,6 +5,9 @@
 #include "engine/crc32.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
+#include "engine/file_system.h"
+#include "engine/hash.h"
+#include "engine/input_system.h"
 #include "engine/log.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
@@ -56,6 +59,7 @@ static const char* downscale_src = R"#(
 struct TransientBuffer {
 	static constexpr u32 INIT_SIZE = 1024 * 1024;
 	static constexpr u32 OVERFLOW_BUFFER_SIZE = 512 * 1024 * 1024;
+	static constexpr u32 UNIFORM_ALIGNMENT = 256; // max GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT of common drivers
 	
 	void init() {
 		m_buffer = gpu::allocBufferHandle();
@@ -95,16 +99,32 @@ struct TransientBuffer {
 		return slice;
 	} 
 
-	void prepareToRender() {
-		gpu::unmap(m_buffer);
-		m_ptr = nullptr;
+	// render thread only, after prepareToRender; never overflows, buffer is INVALID_BUFFER if there is no space left
+	Renderer::TransientSlice allocUniform(const void* data, u32 size) {
+		Renderer::TransientSlice slice;
+		const u32 offset = (u32(m_offset) + UNIFORM_ALIGNMENT - 1) & ~(UNIFORM_ALIGNMENT - 1);
+		if (m_offset < 0 || offset + size > m_size) {
+			m_uniform_overflow += size + UNIFORM_ALIGNMENT;
+			slice.buffer = gpu::INVALID_BUFFER;
+			return slice;
+		}
+		m_offset = offset + size;
+		slice.buffer = m_buffer;
+		slice.offset = offset;
+		slice.size = size;
+		slice.ptr = m_ptr + offset;
+		memcpy(slice.ptr, data, size);
+		return slice;
+	}
 
+	// buffers are persistently mapped and coherent, so there is nothing to unmap or flush
+	void prepareToRender() {
 		if (m_overflow.buffer) {
-			gpu::createBuffer(m_overflow.buffer, gpu::BufferFlags::MAPPABLE, nextPow2(m_overflow.size + m_size), nullptr);
-			void* mem = gpu::map(m_overflow.buffer, m_overflow.size + m_size);
-			if (mem) {
-				memcpy(mem, m_overflow.data, m_overflow.size);
-				gpu::unmap(m_overflow.buffer);
+			const u32 size = nextPow2(m_overflow.size + m_size);
+			gpu::createBuffer(m_overflow.buffer, gpu::BufferFlags::MAPPABLE, size, nullptr);
+			m_overflow.ptr = (u8*)gpu::map(m_overflow.buffer, size);
+			if (m_overflow.ptr) {
+				memcpy(m_overflow.ptr, m_overflow.data, m_overflow.size);
 			}
 			os::memRelease(m_overflow.data, OVERFLOW_BUFFER_SIZE);
 			m_overflow.data = nullptr;
@@ -112,28 +132,40 @@ struct TransientBuffer {
 		}
 	}
 
+	// called once gpu is done with the frame
 	void renderDone() {
 		if (m_overflow.buffer) {
 			m_size = nextPow2(m_overflow.size + m_size);
 			gpu::destroy(m_buffer);
 			m_buffer = m_overflow.buffer;
+			m_ptr = m_overflow.ptr;
 			m_overflow.buffer = gpu::INVALID_BUFFER;
+			m_overflow.ptr = nullptr;
 			m_overflow.size = 0;
 		}
+		else if (m_uniform_overflow > 0) {
+			// grow so next time all uniforms fit
+			m_size = nextPow2(m_size + m_uniform_overflow);
+			gpu::destroy(m_buffer);
+			m_buffer = gpu::allocBufferHandle();
+			gpu::createBuffer(m_buffer, gpu::BufferFlags::MAPPABLE, m_size, nullptr);
+			m_ptr = (u8*)gpu::map(m_buffer, m_size);
+		}
 
-		ASSERT(!m_ptr);
-		m_ptr = (u8*)gpu::map(m_buffer, m_size);
+		m_uniform_overflow = 0;
 		m_offset = 0;
 	}
 
 	gpu::BufferHandle m_buffer = gpu::INVALID_BUFFER;
 	i32 m_offset = 0;
 	u32 m_size = 0;
+	u32 m_uniform_overflow = 0;
 	u8* m_ptr = nullptr;
 	Mutex m_mutex;
 
 	struct {
 		gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
+		u8* ptr = nullptr;
 		u8* data = nullptr;
 		u32 size = 0;
 		u32 commit = 0;
@@ -141,11 +173,29 @@ struct TransientBuffer {
 };
 
 
+struct ProgramKey {
+	struct Hasher {
+		static u32 get(const ProgramKey& key) {
+			return HashFunc<u64>::get(((u64)key.decl_hash << 32) | key.defines) ^ HashFunc<Shader*>::get(key.shader);
+		}
+	};
+
+	bool operator==(const ProgramKey& rhs) const {
+		return shader == rhs.shader && decl_hash == rhs.decl_hash && defines == rhs.defines;
+	}
+
+	Shader* shader;
+	u32 decl_hash;
+	u32 defines;
+};
+
+
 struct FrameData {
 	FrameData(struct RendererImpl& renderer, IAllocator& allocator) 
 		: jobs(allocator)
 		, renderer(renderer)
 		, to_compile_shaders(allocator)
+		, to_compile_map(allocator)
 		, material_updates(allocator)
 	{}
 
@@ -164,17 +214,208 @@ struct FrameData {
 
 	TransientBuffer transient_buffer;
 	u32 gpu_frame = 0xffFFffFF;
+	// when the main thread started to prepare the frame, i.e. right before input is sampled
+	u64 begin_timestamp = 0;
+	// oldest input event consumed by this frame, 0 if none
+	u64 input_timestamp = 0;
 
 	Array<MaterialUpdates> material_updates;
+	// material buffer must have at least this many slots before updates are applied
+	u32 material_buffer_capacity = 0;
 	Array<Renderer::RenderJob*> jobs;
 	Mutex shader_mutex;
 	Array<ShaderToCompile> to_compile_shaders;
+	HashMap<ProgramKey, gpu::ProgramHandle, ProgramKey::Hasher> to_compile_map;
 	RendererImpl& renderer;
 	jobs::SignalHandle can_setup = jobs::INVALID_HANDLE;
 	jobs::SignalHandle setup_done = jobs::INVALID_HANDLE;
 };
 
 
+// binaries of compiled programs and permutations which produced them, persistent between runs
+struct ProgramBinaryCache {
+	static constexpr u32 MAGIC = '_LPC';
+	static constexpr u32 VERSION = 0;
+	static constexpr const char* PATH = ".lumix/shader_cache.bin";
+
+	struct Pending {
+		u64 key;
+		gpu::ProgramHandle program;
+		Path shader;
+		StaticString<256> defines;
+		gpu::VertexDecl decl;
+	};
+
+	struct Entry {
+		u64 key;
+		Path shader;
+		StaticString<256> defines; // space separated
+		gpu::VertexDecl decl;
+		u32 offset; // in binaries
+		u32 size; // 0 if there is no binary for current driver
+	};
+
+	ProgramBinaryCache(IAllocator& allocator)
+		: allocator(allocator)
+		, entries(allocator)
+		, pending(allocator)
+		, map(allocator)
+		, binaries(allocator)
+	{}
+
+	// binaries from a different driver are dropped, permutations are kept so they can be precompiled
+	void load(const char* base_path) {
+		const StaticString<LUMIX_MAX_PATH> path(base_path, PATH);
+		os::InputFile file;
+		if (!file.open(path)) return;
+
+		OutputMemoryStream content(allocator);
+		content.resize(file.size());
+		const bool read = file.read(content.getMutableData(), content.size());
+		file.close();
+		if (!read) return;
+
+		InputMemoryStream blob(content);
+		const u32 magic = blob.read<u32>();
+		const u32 version = blob.read<u32>();
+		const u32 driver_hash = blob.read<u32>();
+		const u32 count = blob.read<u32>();
+		if (magic != MAGIC || version != VERSION) return;
+
+		const bool same_driver = driver_hash == gpu::getDriverHash();
+		for (u32 i = 0; i < count; ++i) {
+			Entry& e = entries.emplace();
+			e.key = blob.read<u64>();
+			e.shader = blob.readString();
+			e.defines = blob.readString();
+			blob.read(e.decl);
+			e.size = blob.read<u32>();
+			e.offset = (u32)binaries.size();
+			const void* data = blob.skip(e.size);
+			if (blob.getPosition() > blob.size()) {
+				entries.pop();
+				break;
+			}
+			if (same_driver) {
+				binaries.write(data, e.size);
+			}
+			else {
+				e.size = 0;
+			}
+			map.insert(e.key, entries.size() - 1);
+		}
+	}
+
+	void save(const char* base_path) {
+		if (!dirty) return;
+
+		const StaticString<LUMIX_MAX_PATH> dir(base_path, ".lumix");
+		if (!os::dirExists(dir) && !os::makePath(dir)) return;
+
+		OutputMemoryStream blob(allocator);
+		blob.write(MAGIC);
+		blob.write(VERSION);
+		blob.write(gpu::getDriverHash());
+		blob.write((u32)entries.size());
+		for (const Entry& e : entries) {
+			blob.write(e.key);
+			blob.writeString(e.shader.c_str());
+			blob.writeString(e.defines);
+			blob.write(e.decl);
+			blob.write(e.size);
+			blob.write(binaries.data() + e.offset, e.size);
+		}
+
+		const StaticString<LUMIX_MAX_PATH> path(base_path, PATH);
+		os::OutputFile file;
+		if (!file.open(path)) {
+			logError("Could not create ", path);
+			return;
+		}
+		if (!file.write(blob.data(), blob.size())) {
+			logError("Could not write ", path);
+		}
+		file.close();
+		dirty = false;
+	}
+
+	// render thread only
+	bool createProgram(u64 key, gpu::ProgramHandle program, const gpu::VertexDecl& decl, const char* name) {
+		auto iter = map.find(key);
+		if (!iter.isValid()) return false;
+		
+		const Entry& e = entries[iter.value()];
+		if (e.size == 0) return false;
+		return gpu::createProgramFromBinary(program, decl, binaries.data() + e.offset, e.size, name);
+	}
+
+	// render thread only, binary is stored once driver finishes compiling the program
+	void add(u64 key, gpu::ProgramHandle program, const Path& shader, const gpu::VertexDecl& decl, const char* defines) {
+		Pending& p = pending.emplace();
+		p.key = key;
+		p.program = program;
+		p.shader = shader;
+		p.decl = decl;
+		p.defines = defines;
+	}
+
+	// render thread only
+	void update() {
+		for (i32 i = pending.size() - 1; i >= 0; --i) {
+			const Pending& p = pending[i];
+			if (!gpu::isProgramReady(p.program)) continue;
+			
+			store(p.key, p.program, p.shader, p.decl, p.defines);
+			pending.swapAndPop(i);
+		}
+	}
+
+	// render thread only, program is going to be destroyed
+	void cancel(gpu::ProgramHandle program) {
+		pending.eraseItems([program](const Pending& p){ return p.program == program; });
+	}
+
+	void store(u64 key, gpu::ProgramHandle program, const Path& shader, const gpu::VertexDecl& decl, const char* defines) {
+		const u32 offset = (u32)binaries.size();
+		if (!gpu::getProgramBinary(program, binaries)) return;
+
+		auto iter = map.find(key);
+		if (!iter.isValid()) {
+			// source of the shader changed, replace the old permutation
+			for (i32 i = 0, c = entries.size(); i < c; ++i) {
+				const Entry& e = entries[i];
+				if (e.shader == shader && e.decl.hash == decl.hash && equalStrings(e.defines, defines)) {
+					map.erase(e.key);
+					map.insert(key, i);
+					iter = map.find(key);
+					break;
+				}
+			}
+		}
+		if (!iter.isValid()) {
+			entries.emplace();
+			map.insert(key, entries.size() - 1);
+			iter = map.find(key);
+		}
+		Entry& e = entries[iter.value()];
+		e.key = key;
+		e.shader = shader;
+		e.defines = defines;
+		e.decl = decl;
+		e.offset = offset;
+		e.size = u32(binaries.size() - offset);
+		dirty = true;
+	}
+
+	IAllocator& allocator;
+	Array<Entry> entries;
+	Array<Pending> pending;
+	HashMap<u64, i32> map;
+	OutputMemoryStream binaries; // replaced binaries are not removed until restart
+	bool dirty = false;
+};
+
+
 template <typename T>
 struct RenderResourceManager : ResourceManager
 {
@@ -207,16 +448,38 @@ struct GPUProfiler
 		gpu::QueryHandle handle;
 		u64 result;
 		i64 profiler_link;
+		// render thread state when the query was issued, for per pass stats
+		u64 cpu_timestamp;
+		gpu::Stats stats;
 		bool is_end;
 		bool is_frame;
 	};
 
+	struct OpenBlock {
+		StaticString<32> name;
+		u64 gpu_timestamp;
+		u64 cpu_timestamp;
+		gpu::Stats stats;
+	};
+
+	// sum of all blocks with the same name in a frame
+	struct Pass {
+		StaticString<32> name;
+		u32 depth;
+		u64 gpu_time;
+		u64 cpu_time;
+		gpu::Stats stats;
+	};
+
 
 	GPUProfiler(IAllocator& allocator) 
 		: m_queries(allocator)
 		, m_pool(allocator)
+		, m_open_blocks(allocator)
+		, m_frame_passes(allocator)
 		, m_gpu_to_cpu_offset(0)
 	{
+		m_frame_time_counter = profiler::createCounter("gpu frame time (us)", profiler::CounterType::GAUGE);
 	}
 
 
@@ -287,6 +550,8 @@ struct GPUProfiler
 		q.is_end = false;
 		q.is_frame = false;
 		q.handle = allocQuery();
+		q.cpu_timestamp = os::Timer::getRawTimestamp();
+		q.stats = gpu::getStats();
 		gpu::queryTimestamp(q.handle);
 	}
 
@@ -298,9 +563,45 @@ struct GPUProfiler
 		q.is_end = true;
 		q.is_frame = false;
 		q.handle = allocQuery();
+		q.cpu_timestamp = os::Timer::getRawTimestamp();
+		q.stats = gpu::getStats();
 		gpu::queryTimestamp(q.handle);
 	}
 
+	void onBlockEnd(const Query& end, u64 gpu_timestamp) {
+		if (m_open_blocks.empty()) return;
+		const OpenBlock block = m_open_blocks.back();
+		m_open_blocks.pop();
+
+		Pass* pass = nullptr;
+		for (Pass& p : m_frame_passes) {
+			if (p.name == block.name) {
+				pass = &p;
+				break;
+			}
+		}
+		if (!pass) {
+			pass = &m_frame_passes.emplace();
+			pass->name = block.name;
+			pass->depth = m_open_blocks.size();
+			pass->gpu_time = pass->cpu_time = 0;
+		}
+		pass->gpu_time += gpu_timestamp - block.gpu_timestamp;
+		pass->cpu_time += end.cpu_timestamp - block.cpu_timestamp;
+		pass->stats.draw_calls += end.stats.draw_calls - block.stats.draw_calls;
+		pass->stats.triangles += end.stats.triangles - block.stats.triangles;
+		pass->stats.state_changes += end.stats.state_changes - block.stats.state_changes;
+	}
+
+	void reportPasses() {
+		const double to_ms = 1000.0 / os::Timer::getFrequency();
+		for (const Pass& p : m_frame_passes) {
+			profiler::gpuPassStats(p.name, p.depth, float(p.gpu_time * to_ms), float(p.cpu_time * to_ms), u32(p.stats.draw_calls), u32(p.stats.triangles), u32(p.stats.state_changes));
+		}
+		m_frame_passes.clear();
+		m_open_blocks.clear();
+	}
+
 
 	void frame()
 	{
@@ -313,19 +614,33 @@ struct GPUProfiler
 			Query q = m_queries[0];
 			if (q.is_frame) {
 				profiler::gpuFrame();
+				// from the first to the last query of the frame, idle time before the first query is not included
+				if (m_frame_begin != 0 && m_frame_end > m_frame_begin) {
+					profiler::setCounter(m_frame_time_counter, i64((m_frame_end - m_frame_begin) * 1'000'000 / os::Timer::getFrequency()));
+					m_last_frame_time_ms = float((m_frame_end - m_frame_begin) * 1000.0 / os::Timer::getFrequency());
+				}
+				m_frame_begin = m_frame_end = 0;
+				reportPasses();
 				m_queries.erase(0);
 				continue;
 			}
 			
 			if (!gpu::isQueryReady(q.handle)) break;
 
+			const u64 timestamp = toCPUTimestamp(gpu::getQueryResult(q.handle));
 			if (q.is_end) {
-				const u64 timestamp = toCPUTimestamp(gpu::getQueryResult(q.handle));
 				profiler::endGPUBlock(timestamp);
+				m_frame_end = timestamp;
+				onBlockEnd(q, timestamp);
 			}
 			else {
-				const u64 timestamp = toCPUTimestamp(gpu::getQueryResult(q.handle));
 				profiler::beginGPUBlock(q.name, timestamp, q.profiler_link);
+				if (m_frame_begin == 0) m_frame_begin = timestamp;
+				OpenBlock& block = m_open_blocks.emplace();
+				block.name = q.name;
+				block.gpu_timestamp = timestamp;
+				block.cpu_timestamp = q.cpu_timestamp;
+				block.stats = q.stats;
 			}
 			m_pool.push(q.handle);
 			m_queries.erase(0);
@@ -335,8 +650,15 @@ struct GPUProfiler
 
 	Array<Query> m_queries;
 	Array<gpu::QueryHandle> m_pool;
+	Array<OpenBlock> m_open_blocks;
+	Array<Pass> m_frame_passes;
 	Mutex m_mutex;
 	i64 m_gpu_to_cpu_offset;
+	u64 m_frame_begin = 0;
+	u64 m_frame_end = 0;
+	// written in render thread
+	volatile float m_last_frame_time_ms = 0;
+	u32 m_frame_time_counter;
 };
 
 
@@ -346,6 +668,8 @@ struct RendererImpl final : Renderer
 		: m_engine(engine)
 		, m_allocator(engine.getAllocator())
 		, m_texture_manager(*this, m_allocator)
+		, m_texture_streamer(m_allocator)
+		, m_model_streamer(m_allocator)
 		, m_pipeline_manager(*this, m_allocator)
 		, m_model_manager(*this, m_allocator)
 		, m_particle_emitter_manager(*this, m_allocator)
@@ -359,6 +683,11 @@ struct RendererImpl final : Renderer
 		, m_plugins(m_allocator)
 		, m_free_sort_keys(m_allocator)
 		, m_sort_key_to_mesh_map(m_allocator)
+		, m_render_targets(m_allocator)
+		, m_pending_texture_uploads(m_allocator)
+		, m_readbacks(m_allocator)
+		, m_program_cache(m_allocator)
+		, m_headless(engine.isHeadless())
 	{
 		RenderScene::reflect();
 
@@ -368,7 +697,7 @@ struct RendererImpl final : Renderer
 
 		m_shader_defines.reserve(32);
 
-		gpu::preinit(m_allocator, shouldLoadRenderdoc());
+		if (!m_headless) gpu::preinit(m_allocator, shouldLoadRenderdoc());
 		m_frames[0].create(*this, m_allocator);
 		m_frames[1].create(*this, m_allocator);
 		m_frames[2].create(*this, m_allocator);
@@ -388,12 +717,23 @@ struct RendererImpl final : Renderer
 		m_shader_manager.destroy();
 		m_font_manager->destroy();
 		LUMIX_DELETE(m_allocator, m_font_manager);
+		m_font_manager = nullptr;
+
+		if (m_headless) return;
+
+		for (const PooledRenderTarget& rt : m_render_targets) {
+			ASSERT(!rt.in_use);
+			destroy(rt.handle);
+		}
+		m_render_targets.clear();
+		flushTextureUploads(true);
 
 		frame();
 		frame();
 		frame();
 
 		waitForRender();
+		m_program_cache.save(m_engine.getFileSystem().getBasePath());
 		
 		jobs::SignalHandle signal = jobs::INVALID_HANDLE;
 		jobs::runEx(this, [](void* data) {
@@ -406,6 +746,11 @@ struct RendererImpl final : Renderer
 			gpu::destroy(renderer->m_tmp_uniform_buffer);
 			gpu::destroy(renderer->m_scratch_buffer);
 			gpu::destroy(renderer->m_downscale_program);
+			for (PendingReadback* readback : renderer->m_readbacks) {
+				if (readback->handle) gpu::destroy(readback->handle);
+				LUMIX_DELETE(renderer->m_allocator, readback);
+			}
+			renderer->m_readbacks.clear();
 			renderer->m_profiler.clear();
 			gpu::shutdown();
 		}, &signal, jobs::INVALID_HANDLE, 1);
@@ -435,12 +780,66 @@ struct RendererImpl final : Renderer
 		os::getCommandLine(Span(cmd_line));
 		CommandLineParser cmd_line_parser(cmd_line);
 		while (cmd_line_parser.next()) {
-			if (cmd_line_parser.currentEquals("-no_vsync")) {
+			// benchmark measures frame times, so it must not wait for vsync
+			if (cmd_line_parser.currentEquals("-no_vsync") || cmd_line_parser.currentEquals("-benchmark")) {
 				init_data.flags = init_data.flags & ~gpu::InitFlags::VSYNC;
 			}
 			else if (cmd_line_parser.currentEquals("-debug_opengl")) {
 				init_data.flags = init_data.flags | gpu::InitFlags::DEBUG_OUTPUT;
 			}
+			else if (cmd_line_parser.currentEquals("-texture_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, sizeof(tmp));
+				u32 budget_mb;
+				if (fromCString(Span(tmp, stringLength(tmp)), budget_mb)) m_texture_streamer.setBudget(u64(budget_mb) * 1024 * 1024);
+			}
+			else if (cmd_line_parser.currentEquals("-frames_in_flight")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, sizeof(tmp));
+				u32 count;
+				if (fromCString(Span(tmp, stringLength(tmp)), count)) m_frames_count = clamp(count, 1u, (u32)lengthOf(m_frames));
+			}
+			// main thread waits until gpu presents the frame, so the next input is sampled as late as possible
+			else if (cmd_line_parser.currentEquals("-low_latency")) {
+				m_frames_count = 1;
+			}
+			else if (cmd_line_parser.currentEquals("-texture_upload_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, sizeof(tmp));
+				u32 budget_mb;
+				if (fromCString(Span(tmp, stringLength(tmp)), budget_mb)) m_texture_upload_budget = u64(budget_mb) * 1024 * 1024;
+			}
+			else if (cmd_line_parser.currentEquals("-triangle_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, sizeof(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), m_lod_triangle_budget);
+			}
+			else if (cmd_line_parser.currentEquals("-draw_call_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, sizeof(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), m_lod_draw_call_budget);
+			}
+		}
+
+		m_frame_latency_counter = profiler::createCounter("frame latency (us)", profiler::CounterType::GAUGE);
+		m_input_latency_counter = profiler::createCounter("input latency (us)", profiler::CounterType::GAUGE);
+
+		if (m_headless) {
+			logInfo("Renderer is headless, gpu is not initialized");
+			m_cpu_frame = m_frames[0].get();
+			m_gpu_frame = m_frames[0].get();
+			MaterialBuffer& mb = m_material_buffer;
+			mb.map.insert(StableHash(), 0);
+			mb.data.emplace();
+			mb.data[0].ref_count = 1;
+			mb.grow(MaterialBuffer::INITIAL_CAPACITY);
+			createResourceManagers();
+			return;
 		}
 
 		jobs::SignalHandle signal = jobs::INVALID_HANDLE;
@@ -468,32 +867,19 @@ struct RendererImpl final : Renderer
 			}
 			renderer.m_cpu_frame = renderer.m_frames[0].get();
 			renderer.m_gpu_frame = renderer.m_frames[0].get();
+			renderer.m_cpu_frame->begin_timestamp = os::Timer::getRawTimestamp();
 
 			renderer.m_profiler.init();
 
 			MaterialBuffer& mb = renderer.m_material_buffer;
-			mb.buffer = gpu::allocBufferHandle();
-			mb.staging_buffer = gpu::allocBufferHandle();
-			mb.map.insert(0, 0);
-			mb.data.resize(400);
-			mb.data[0].hash = 0;
+			mb.map.insert(StableHash(), 0);
+			mb.data.emplace();
 			mb.data[0].ref_count = 1;
-			mb.first_free = 1;
-			for (int i = 1; i < 400; ++i) {
-				mb.data[i].ref_count = 0;
-				mb.data[i].next_free = i + 1;
-			}
-			mb.data.back().next_free = -1;
-			gpu::createBuffer(mb.buffer
-				, gpu::BufferFlags::UNIFORM_BUFFER
-				, sizeof(MaterialConsts) * 400
-				, nullptr
-			);
-			gpu::createBuffer(mb.staging_buffer
-				, gpu::BufferFlags::UNIFORM_BUFFER
-				, sizeof(MaterialConsts)
-				, nullptr
-			);
+			mb.grow(MaterialBuffer::INITIAL_CAPACITY);
+			mb.gpu_data.resize(MaterialBuffer::INITIAL_CAPACITY);
+			memset(mb.gpu_data.begin(), 0, mb.gpu_data.byte_size());
+			mb.gpu_data[0].color = Vec4(1, 0, 1, 1);
+			mb.recreateBuffers();
 
 			renderer.m_downscale_program = gpu::allocProgramHandle();
 			const gpu::ShaderType type = gpu::ShaderType::COMPUTE;
@@ -505,13 +891,14 @@ struct RendererImpl final : Renderer
 
 			renderer.m_scratch_buffer = gpu::allocBufferHandle();
 			gpu::createBuffer(renderer.m_scratch_buffer, gpu::BufferFlags::SHADER_BUFFER | gpu::BufferFlags::COMPUTE_WRITE, SCRATCH_BUFFER_SIZE, nullptr);
-
-			MaterialConsts default_mat;
-			default_mat.color = Vec4(1, 0, 1, 1);
-			gpu::update(mb.buffer, &default_mat, sizeof(MaterialConsts));
 		}, &signal, jobs::INVALID_HANDLE, 1);
 		jobs::wait(signal);
 
+		m_program_cache.load(m_engine.getFileSystem().getBasePath());
+		createResourceManagers();
+	}
+
+	void createResourceManagers() {
 		ResourceManagerHub& manager = m_engine.getResourceManager();
 		m_pipeline_manager.create(PipelineResource::TYPE, manager);
 		m_texture_manager.create(Texture::TYPE, manager);
@@ -607,10 +994,125 @@ struct RendererImpl final : Renderer
 		queue(cmd, 0);
 	}
 
+	void getTextureImageAsync(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, Span<u8> data, const Delegate<void()>& callback) override
+	{
+		PendingReadback* readback = LUMIX_NEW(m_allocator, PendingReadback);
+		readback->data = data;
+		readback->callback = callback;
+		{
+			MutexGuard lock(m_readbacks_mutex);
+			m_readbacks.push(readback);
+		}
+
+		struct Cmd : RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::pushDebugGroup("get image data async");
+				gpu::TextureHandle staging = gpu::allocTextureHandle();
+				const gpu::TextureFlags flags = gpu::TextureFlags::NO_MIPS | gpu::TextureFlags::READBACK;
+				gpu::createTexture(staging, w, h, 1, out_format, flags, "staging_buffer");
+				gpu::copy(staging, handle, 0, 0);
+				const gpu::ReadbackHandle res = gpu::readTextureAsync(staging, 0);
+				gpu::destroy(staging);
+				gpu::popDebugGroup();
+				
+				MutexGuard lock(renderer->m_readbacks_mutex);
+				readback->handle = res;
+			}
+
+			gpu::TextureHandle handle;
+			gpu::TextureFormat out_format;
+			u32 w;
+			u32 h;
+			PendingReadback* readback;
+			RendererImpl* renderer;
+		};
+
+		Cmd& cmd = createJob<Cmd>();
+		cmd.handle = texture;
+		cmd.w = w;
+		cmd.h = h;
+		cmd.out_format = out_format;
+		cmd.readback = readback;
+		cmd.renderer = this;
+		queue(cmd, 0);
+	}
+
+	void readTextureMipAsync(gpu::TextureHandle texture, u32 mip, Span<u8> data, const Delegate<void()>& callback) override
+	{
+		PendingReadback* readback = LUMIX_NEW(m_allocator, PendingReadback);
+		readback->data = data;
+		readback->callback = callback;
+		{
+			MutexGuard lock(m_readbacks_mutex);
+			m_readbacks.push(readback);
+		}
+
+		struct Cmd : RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				const gpu::ReadbackHandle res = gpu::readTextureAsync(handle, mip);
+				MutexGuard lock(renderer->m_readbacks_mutex);
+				readback->handle = res;
+			}
+
+			gpu::TextureHandle handle;
+			u32 mip;
+			PendingReadback* readback;
+			RendererImpl* renderer;
+		};
+
+		Cmd& cmd = createJob<Cmd>();
+		cmd.handle = texture;
+		cmd.mip = mip;
+		cmd.readback = readback;
+		cmd.renderer = this;
+		queue(cmd, 0);
+	}
+
+	// render thread
+	void pollReadbacks() {
+		PROFILE_FUNCTION();
+		MutexGuard lock(m_readbacks_mutex);
+		for (PendingReadback* readback : m_readbacks) {
+			if (!readback->handle) continue;
+			if (!gpu::isReadbackReady(readback->handle)) continue;
+			gpu::getReadbackData(readback->handle, readback->data);
+			gpu::destroy(readback->handle);
+			readback->handle = gpu::INVALID_READBACK;
+			readback->done = true;
+		}
+	}
+
+	// main thread
+	void dispatchReadbacks() {
+		Array<PendingReadback*> done(m_allocator);
+		{
+			MutexGuard lock(m_readbacks_mutex);
+			for (i32 i = 0; i < m_readbacks.size(); ++i) {
+				if (!m_readbacks[i]->done) continue;
+				done.push(m_readbacks[i]);
+				m_readbacks.erase(i);
+				--i;
+			}
+		}
+		// outside of lock, callbacks can request another readback
+		for (PendingReadback* readback : done) {
+			readback->callback.invoke();
+			LUMIX_DELETE(m_allocator, readback);
+		}
+	}
+
 
 	void updateTexture(gpu::TextureHandle handle, u32 slice, u32 x, u32 y, u32 w, u32 h, gpu::TextureFormat format, const MemRef& mem) override
 	{
 		ASSERT(mem.size > 0);
+		if (m_headless) {
+			if (mem.own) free(mem);
+			return;
+		}
 		ASSERT(handle);
 
 		struct Cmd : RenderJob {
@@ -648,10 +1150,59 @@ struct RendererImpl final : Renderer
 	gpu::TextureHandle loadTexture(const gpu::TextureDesc& desc, const MemRef& memory, gpu::TextureFlags flags, const char* debug_name) override
 	{
 		ASSERT(memory.size > 0);
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_TEXTURE;
+		}
 
 		const gpu::TextureHandle handle = gpu::allocTextureHandle();
 		if (!handle) return handle;
 
+		// new textures are uploaded immediately, there's no older content to show in the meantime
+		RenderJob& job = createTextureUploadJob(handle, desc, memory, flags, debug_name);
+		m_texture_upload_bytes += memory.size;
+		queue(job, 0);
+		return handle;
+	}
+
+
+	void recreateTexture(gpu::TextureHandle handle, const gpu::TextureDesc& desc, const MemRef& memory, gpu::TextureFlags flags, const char* debug_name) override
+	{
+		ASSERT(memory.size > 0);
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return;
+		}
+		ASSERT(handle);
+
+		// old content is valid until the job is executed, so we can postpone it if the frame's upload budget is exhausted
+		RenderJob& job = createTextureUploadJob(handle, desc, memory, flags, debug_name);
+		if (m_pending_texture_uploads.empty() && m_texture_upload_bytes + memory.size <= m_texture_upload_budget) {
+			m_texture_upload_bytes += memory.size;
+			queue(job, 0);
+			return;
+		}
+		m_pending_texture_uploads.push({&job, handle, memory.size});
+	}
+
+	void flushTextureUploads(bool all) {
+		m_texture_upload_bytes = 0;
+		u32 count = 0;
+		for (const PendingTextureUpload& upload : m_pending_texture_uploads) {
+			// at least one upload per frame, even if it's bigger than the budget
+			if (!all && count > 0 && m_texture_upload_bytes + upload.size > m_texture_upload_budget) break;
+			m_texture_upload_bytes += upload.size;
+			queue(*upload.job, 0);
+			++count;
+		}
+		for (u32 i = count, c = m_pending_texture_uploads.size(); i < c; ++i) {
+			m_pending_texture_uploads[i - count] = m_pending_texture_uploads[i];
+		}
+		for (u32 i = 0; i < count; ++i) m_pending_texture_uploads.pop();
+	}
+
+	RenderJob& createTextureUploadJob(gpu::TextureHandle handle, const gpu::TextureDesc& desc, const MemRef& memory, gpu::TextureFlags flags, const char* debug_name) {
+
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override {
@@ -695,9 +1246,7 @@ struct RendererImpl final : Renderer
 		if (desc.mips < 2) cmd.flags = cmd.flags | gpu::TextureFlags::NO_MIPS;
 		cmd.renderer = this;
 		cmd.desc = desc;
-		queue(cmd, 0);
-
-		return handle;
+		return cmd;
 	}
 
 
@@ -705,48 +1254,60 @@ struct RendererImpl final : Renderer
 	{
 		return m_cpu_frame->transient_buffer.alloc(size);
 	}
+
+	TransientSlice allocUniform(const void* data, u32 size) override
+	{
+		gpu::checkThread();
+		return m_gpu_frame->transient_buffer.allocUniform(data, size);
+	}
 	
+	// buffer can be recreated when it grows, so it's valid only in the current frame on render thread
 	gpu::BufferHandle getMaterialUniformBuffer() override {
+		gpu::checkThread();
 		return m_material_buffer.buffer;
 	}
 
 	u32 createMaterialConstants(const MaterialConsts& data) override {
-		const u32 hash = crc32(&data, sizeof(data));
-		auto iter = m_material_buffer.map.find(hash);
+		MaterialBuffer& mb = m_material_buffer;
+		const StableHash hash(&data, sizeof(data));
+		auto iter = mb.map.find(hash);
 		u32 idx;
 		if(iter.isValid()) {
 			idx = iter.value();
 		}
 		else {
-			if (m_material_buffer.first_free == -1) {
-				ASSERT(false);
-				++m_material_buffer.data[0].ref_count;
-				return 0;
+			if (mb.first_free == -1) {
+				mb.grow(mb.data.size() * 2);
+				m_cpu_frame->material_buffer_capacity = mb.data.size();
 			}
-			idx = m_material_buffer.first_free;
-			m_material_buffer.first_free = m_material_buffer.data[m_material_buffer.first_free].next_free;
-			m_material_buffer.data[idx].ref_count = 0;
-			m_material_buffer.data[idx].hash = crc32(&data, sizeof(data));
-			m_material_buffer.map.insert(hash, idx);
-			m_cpu_frame->material_updates.push({idx, data});
-		}
-		++m_material_buffer.data[idx].ref_count;
+			idx = mb.first_free;
+			mb.first_free = mb.data[idx].next_free;
+			mb.data[idx].ref_count = 0;
+			mb.data[idx].hash = hash;
+			mb.map.insert(hash, idx);
+			if (!m_headless) m_cpu_frame->material_updates.push({idx, data});
+		}
+		++mb.data[idx].ref_count;
 		return idx;
 	}
 
 	void destroyMaterialConstants(u32 idx) override {
-		--m_material_buffer.data[idx].ref_count;
-		if (m_material_buffer.data[idx].ref_count > 0) return;
+		MaterialBuffer& mb = m_material_buffer;
+		--mb.data[idx].ref_count;
+		if (mb.data[idx].ref_count > 0) return;
 			
-		const u32 hash = m_material_buffer.data[idx].hash;
-		m_material_buffer.data[idx].next_free = m_material_buffer.first_free;
-		m_material_buffer.first_free = idx;
-		m_material_buffer.map.erase(hash);
+		mb.map.erase(mb.data[idx].hash);
+		mb.data[idx].next_free = mb.first_free;
+		mb.first_free = idx;
 	}
 
 
 	gpu::BufferHandle createBuffer(const MemRef& memory, gpu::BufferFlags flags) override
 	{
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_BUFFER;
+		}
 		gpu::BufferHandle handle = gpu::allocBufferHandle();
 		if(!handle) return handle;
 
@@ -803,6 +1364,12 @@ struct RendererImpl final : Renderer
 
 	void runInRenderThread(void* user_ptr, void (*fnc)(Renderer& renderer, void*)) override
 	{
+		// there's no render thread, callbacks only free cpu data since no gpu object could be created
+		if (m_headless) {
+			fnc(*this, user_ptr);
+			return;
+		}
+
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override { 
@@ -828,6 +1395,7 @@ struct RendererImpl final : Renderer
 	}
 
 	u32 allocSortKey(Mesh* mesh) override {
+		++m_sort_keys_version;
 		if (!m_free_sort_keys.empty()) {
 			const u32 key = m_free_sort_keys.back();
 			m_free_sort_keys.pop();
@@ -848,6 +1416,7 @@ struct RendererImpl final : Renderer
 
 	void freeSortKey(u32 key) override {
 		if (key != 0) {
+			++m_sort_keys_version;
 			m_free_sort_keys.push(key);
 		}
 	}
@@ -856,12 +1425,29 @@ struct RendererImpl final : Renderer
 		return m_max_sort_key;
 	}
 
+	u32 getLODTriangleBudget() const override { return m_lod_triangle_budget; }
+	u32 getLODDrawCallBudget() const override { return m_lod_draw_call_budget; }
+	float getGPUFrameTime() const override { return m_profiler.m_last_frame_time_ms; }
+
+	u32 getSortKeysVersion() const override {
+		return m_sort_keys_version;
+	}
+
+	u32 getRenderDataVersion() const override {
+		return m_render_data_version;
+	}
+
+	void markRenderDataChanged() override {
+		++m_render_data_version;
+	}
+
 	void destroy(gpu::ProgramHandle program) override
 	{
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override { 
 				PROFILE_FUNCTION();
+				renderer->m_program_cache.cancel(program);
 				gpu::destroy(program); 
 			}
 
@@ -895,19 +1481,23 @@ struct RendererImpl final : Renderer
 		queue(cmd, 0);
 	}
 
-	void copy(gpu::TextureHandle dst, gpu::TextureHandle src) override {
+	void copy(gpu::TextureHandle dst, gpu::TextureHandle src, u32 dst_x, u32 dst_y) override {
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override {
 				PROFILE_FUNCTION();
-				gpu::copy(dst, src, 0, 0);
+				gpu::copy(dst, src, dst_x, dst_y);
 			}
 			gpu::TextureHandle src;
 			gpu::TextureHandle dst;
+			u32 dst_x;
+			u32 dst_y;
 		};
 		Cmd& cmd = createJob<Cmd>();
 		cmd.src = src;
 		cmd.dst = dst;
+		cmd.dst_x = dst_x;
+		cmd.dst_y = dst_y;
 		queue(cmd, 0);
 	}
 
@@ -948,6 +1538,10 @@ struct RendererImpl final : Renderer
 
 	gpu::TextureHandle createTexture(u32 w, u32 h, u32 depth, gpu::TextureFormat format, gpu::TextureFlags flags, const MemRef& memory, const char* debug_name) override
 	{
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_TEXTURE;
+		}
 		gpu::TextureHandle handle = gpu::allocTextureHandle();
 		if(!handle) return handle;
 
@@ -996,6 +1590,13 @@ struct RendererImpl final : Renderer
 	void destroy(gpu::TextureHandle tex) override
 	{
 		if (!tex) return;
+		// must be executed before the texture is destroyed
+		for (const PendingTextureUpload& upload : m_pending_texture_uploads) {
+			if (upload.handle == tex) {
+				flushTextureUploads(true);
+				break;
+			}
+		}
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override { 
@@ -1013,9 +1614,60 @@ struct RendererImpl final : Renderer
 		queue(cmd, 0);
 	}
 
+	gpu::TextureHandle acquireRenderTarget(u32 w, u32 h, gpu::TextureFormat format, gpu::TextureFlags flags, const char* debug_name) override {
+		MutexGuard lock(m_render_targets_mutex);
+		for (PooledRenderTarget& rt : m_render_targets) {
+			if (rt.in_use) continue;
+			if (rt.width != w || rt.height != h) continue;
+			if (rt.format != format || rt.flags != flags) continue;
+			rt.in_use = true;
+			return rt.handle;
+		}
+
+		PooledRenderTarget& rt = m_render_targets.emplace();
+		rt.width = w;
+		rt.height = h;
+		rt.format = format;
+		rt.flags = flags;
+		rt.in_use = true;
+		rt.release_frame = m_render_targets_frame;
+		rt.handle = createTexture(w, h, 1, format, flags, MemRef(), debug_name);
+		return rt.handle;
+	}
+
+	void releaseRenderTarget(gpu::TextureHandle tex) override {
+		if (!tex) return;
+		MutexGuard lock(m_render_targets_mutex);
+		for (PooledRenderTarget& rt : m_render_targets) {
+			if (rt.handle != tex) continue;
+			ASSERT(rt.in_use);
+			rt.in_use = false;
+			rt.release_frame = m_render_targets_frame;
+			return;
+		}
+		ASSERT(false);
+	}
+
+	void destroyUnusedRenderTargets() {
+		PROFILE_FUNCTION();
+		MutexGuard lock(m_render_targets_mutex);
+		++m_render_targets_frame;
+		for (i32 i = m_render_targets.size() - 1; i >= 0; --i) {
+			const PooledRenderTarget& rt = m_render_targets[i];
+			if (rt.in_use) continue;
+			if (m_render_targets_frame - rt.release_frame < RENDER_TARGET_MAX_UNUSED_FRAMES) continue;
+			destroy(rt.handle);
+			m_render_targets.swapAndPop(i);
+		}
+	}
+
 
 	void queue(RenderJob& cmd, i64 profiler_link) override
 	{
+		if (m_headless) {
+			destroyJob(cmd);
+			return;
+		}
 		cmd.profiler_link = profiler_link;
 		
 		m_cpu_frame->jobs.push(&cmd);
@@ -1024,7 +1676,7 @@ struct RendererImpl final : Renderer
 			RenderJob* cmd = (RenderJob*)data;
 			PROFILE_BLOCK("setup_render_job");
 			cmd->setup();
-		}, &m_cpu_frame->setup_done);
+		}, &m_cpu_frame->setup_done, jobs::Priority::HIGH);
 	}
 
 	void addPlugin(RenderPlugin& plugin) override {
@@ -1039,6 +1691,8 @@ struct RendererImpl final : Renderer
 
 
 	ResourceManager& getTextureManager() override { return m_texture_manager; }
+	TextureStreamer& getTextureStreamer() override { return m_texture_streamer; }
+	ModelStreamer& getModelStreamer() override { return m_model_streamer; }
 	FontManager& getFontManager() override { return *m_font_manager; }
 
 	void createScenes(Universe& ctx) override
@@ -1061,19 +1715,68 @@ struct RendererImpl final : Renderer
 	const char* getShaderDefine(int define_idx) const override { return m_shader_defines[define_idx]; }
 
 	gpu::ProgramHandle queueShaderCompile(Shader& shader, gpu::VertexDecl decl, u32 defines) override {
+		if (m_headless) return gpu::INVALID_PROGRAM;
 		ASSERT(shader.isReady());
 		MutexGuard lock(m_cpu_frame->shader_mutex);
 		
-		for (const auto& i : m_cpu_frame->to_compile_shaders) {
-			if (i.shader == &shader && decl.hash == i.decl.hash && defines == i.defines) {
-				return i.program;
-			}
-		}
+		const ProgramKey key = {&shader, decl.hash, defines};
+		auto iter = m_cpu_frame->to_compile_map.find(key);
+		if (iter.isValid()) return iter.value();
+
 		gpu::ProgramHandle program = gpu::allocProgramHandle();
 		m_cpu_frame->to_compile_shaders.push({&shader, decl, defines, program, shader.m_sources});
+		m_cpu_frame->to_compile_map.insert(key, program);
 		return program;
 	}
 
+	void precompileShaders() override {
+		PROFILE_FUNCTION();
+		waitForRender();
+
+		struct Permutation {
+			Shader* shader;
+			StaticString<256> defines;
+			gpu::VertexDecl decl;
+		};
+		Array<Permutation> permutations(m_allocator);
+		ResourceManagerHub& rm = m_engine.getResourceManager();
+		for (const ProgramBinaryCache::Entry& e : m_program_cache.entries) {
+			Permutation& p = permutations.emplace();
+			p.shader = rm.load<Shader>(e.shader);
+			p.defines = e.defines;
+			p.decl = e.decl;
+		}
+
+		FileSystem& fs = m_engine.getFileSystem();
+		while (fs.hasWork()) {
+			os::sleep(10);
+			fs.processCallbacks();
+		}
+		fs.processCallbacks();
+
+		for (const Permutation& p : permutations) {
+			if (!p.shader->isReady()) continue;
+			
+			u32 defines = 0;
+			const char* c = p.defines;
+			while (*c) {
+				StaticString<64> define;
+				const char* end = c;
+				while (*end && *end != ' ') ++end;
+				define.add(Span(c, end));
+				defines |= 1 << getShaderDefineIdx(define);
+				c = *end ? end + 1 : end;
+			}
+			p.shader->getProgram(p.decl, defines);
+		}
+		
+		// programs are compiled on render thread
+		frame();
+		waitForRender();
+		for (const Permutation& p : permutations) p.shader->decRefCount();
+		logInfo("Precompiled ", permutations.size(), " shader permutations");
+	}
+
 	void makeScreenshot(const Path& filename) override {  }
 
 
@@ -1126,6 +1829,41 @@ struct RendererImpl final : Renderer
 		queue(cmd, 0);
 	}
 
+	// all material changes in a frame are uploaded as one range, so animating material params is cheap
+	void updateMaterialBuffer(FrameData& frame) {
+		MaterialBuffer& mb = m_material_buffer;
+		if (frame.material_buffer_capacity > (u32)mb.gpu_data.size()) {
+			const u32 old_size = mb.gpu_data.size();
+			mb.gpu_data.resize(frame.material_buffer_capacity);
+			memset(&mb.gpu_data[old_size], 0, (mb.gpu_data.size() - old_size) * sizeof(MaterialConsts));
+			for (const auto& i : frame.material_updates) applyMaterialUpdate(i.idx, i.value);
+			// new buffer is initialized from cpu copy, so no gpu copy of the old content is needed
+			mb.recreateBuffers();
+		}
+		else if (!frame.material_updates.empty()) {
+			u32 from = 0xffFFffFF;
+			u32 to = 0;
+			for (const auto& i : frame.material_updates) {
+				applyMaterialUpdate(i.idx, i.value);
+				from = minimum(from, i.idx);
+				to = maximum(to, i.idx + 1);
+			}
+			const u32 size = (to - from) * sizeof(MaterialConsts);
+			gpu::update(mb.staging_buffer, &mb.gpu_data[from], size);
+			gpu::copy(mb.buffer, mb.staging_buffer, from * sizeof(MaterialConsts), size);
+		}
+		frame.material_buffer_capacity = 0;
+		frame.material_updates.clear();
+	}
+
+	void applyMaterialUpdate(u32 idx, const MaterialConsts& value) {
+		MaterialConsts& dst = m_material_buffer.gpu_data[idx];
+		dst = value;
+		for (u64& texture : dst.textures) {
+			if (texture) texture = gpu::getBindlessHandle((gpu::TextureHandle)(uintptr)texture);
+		}
+	}
+
 	void render() {
 		FrameData& frame = *m_gpu_frame;
 		frame.transient_buffer.prepareToRender();
@@ -1136,15 +1874,23 @@ struct RendererImpl final : Renderer
 		}
 
 		for (const auto& i : frame.to_compile_shaders) {
-			Shader::compile(i.program, i.decl, i.defines, i.sources, *this);
+			const u64 key = Shader::getBinaryKey(i.decl, i.defines, i.sources, *this);
+			if (m_program_cache.createProgram(key, i.program, i.decl, i.sources.path.c_str())) continue;
+			
+			if (Shader::compile(i.program, i.decl, i.defines, i.sources, *this)) {
+				StaticString<256> defines;
+				for (int j = 0; j < sizeof(i.defines) * 8; ++j) {
+					if ((i.defines & (1 << j)) == 0) continue;
+					defines << (defines.empty() ? "" : " ") << getShaderDefine(j);
+				}
+				m_program_cache.add(key, i.program, i.sources.path, i.decl, defines);
+			}
 		}
 		frame.to_compile_shaders.clear();
+		frame.to_compile_map.clear();
+		m_program_cache.update();
 
-		for (const auto& i : frame.material_updates) {
-			gpu::update(m_material_buffer.staging_buffer, &i.value, sizeof(MaterialConsts));
-			gpu::copy(m_material_buffer.buffer, m_material_buffer.staging_buffer, i.idx * sizeof(MaterialConsts), sizeof(MaterialConsts));
-		}
-		frame.material_updates.clear();
+		updateMaterialBuffer(frame);
 
 		gpu::useProgram(gpu::INVALID_PROGRAM);
 		gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
@@ -1156,6 +1902,7 @@ struct RendererImpl final : Renderer
 			destroyJob(*job);
 		}
 		frame.jobs.clear();
+		pollReadbacks();
 
 		PROFILE_BLOCK("swap buffers");
 		jobs::enableBackupWorker(true);
@@ -1165,23 +1912,32 @@ struct RendererImpl final : Renderer
 		jobs::enableBackupWorker(false);
 		m_profiler.frame();
 
-		m_gpu_frame = m_frames[(getFrameIndex(m_gpu_frame) + 1) % lengthOf(m_frames)].get();
-		FrameData& check_frame = *m_frames[(getFrameIndex(m_gpu_frame) + 1) % lengthOf(m_frames)].get();
+		m_gpu_frame = m_frames[(getFrameIndex(m_gpu_frame) + 1) % m_frames_count].get();
+		FrameData& check_frame = *m_frames[(getFrameIndex(m_gpu_frame) + 1) % m_frames_count].get();
 
 		if (check_frame.gpu_frame != 0xffFFffFF && gpu::frameFinished(check_frame.gpu_frame)) {
-			check_frame.gpu_frame = 0xffFFffFF;
-			check_frame.transient_buffer.renderDone();
-			jobs::decSignal(check_frame.can_setup);
+			gpuFrameDone(check_frame);
 		}
 
 		if (m_gpu_frame->gpu_frame != 0xffFFffFF) {
 			gpu::waitFrame(m_gpu_frame->gpu_frame);
-			m_gpu_frame->gpu_frame = 0xFFffFFff;   
-			m_gpu_frame->transient_buffer.renderDone();
-			jobs::decSignal(m_gpu_frame->can_setup);
+			gpuFrameDone(*m_gpu_frame);
 		}
 	}
 
+	void gpuFrameDone(FrameData& frame) {
+		frame.gpu_frame = 0xffFFffFF;
+		frame.transient_buffer.renderDone();
+		const u64 latency = os::Timer::getRawTimestamp() - frame.begin_timestamp;
+		profiler::setCounter(m_frame_latency_counter, i64(latency * 1'000'000 / os::Timer::getFrequency()));
+		if (frame.input_timestamp != 0) {
+			// gpu finished the frame, closest we get to input to photon
+			const u64 input_latency = os::Timer::getRawTimestamp() - frame.input_timestamp;
+			profiler::setCounter(m_input_latency_counter, i64(input_latency * 1'000'000 / os::Timer::getFrequency()));
+		}
+		jobs::decSignal(frame.can_setup);
+	}
+
 	void waitForCommandSetup() override
 	{
 		jobs::wait(m_cpu_frame->setup_done);
@@ -1192,6 +1948,8 @@ struct RendererImpl final : Renderer
 		jobs::wait(m_last_render);
 	}
 
+	bool isHeadless() const override { return m_headless; }
+
 	i32 getFrameIndex(FrameData* frame) const {
 		for (i32 i = 0; i < (i32)lengthOf(m_frames); ++i) {
 			if (frame == m_frames[i].get()) return i;
@@ -1203,9 +1961,18 @@ struct RendererImpl final : Renderer
 	void frame() override
 	{
 		PROFILE_FUNCTION();
+		if (m_headless) return;
 		
+		m_texture_streamer.update(m_material_manager);
+		if (m_font_manager) m_font_manager->update();
+		destroyUnusedRenderTargets();
+		flushTextureUploads(false);
+		dispatchReadbacks();
 		jobs::wait(m_cpu_frame->setup_done);
 		m_cpu_frame->setup_done = jobs::INVALID_HANDLE;
+		m_cpu_frame->input_timestamp = m_engine.getInputSystem().getConsumedEventsTimestamp();
+		// changes meshes' render data, so it must run after setup
+		m_model_streamer.update();
 		for (const auto& i : m_cpu_frame->to_compile_shaders) {
 			const u64 key = i.defines | ((u64)i.decl.hash << 32);
 			i.shader->m_programs.insert(key, i.program);
@@ -1213,13 +1980,14 @@ struct RendererImpl final : Renderer
 
 		jobs::incSignal(&m_cpu_frame->can_setup);
 		
-		m_cpu_frame = m_frames[(getFrameIndex(m_cpu_frame) + 1) % lengthOf(m_frames)].get();
+		m_cpu_frame = m_frames[(getFrameIndex(m_cpu_frame) + 1) % m_frames_count].get();
 		jobs::runEx(this, [](void* ptr){
 			auto* renderer = (RendererImpl*)ptr;
 			renderer->render();
 		}, &m_last_render, jobs::INVALID_HANDLE, 1);
 
 		jobs::wait(m_cpu_frame->can_setup);
+		m_cpu_frame->begin_timestamp = os::Timer::getRawTimestamp();
 	}
 
 	Engine& m_engine;
@@ -1234,15 +2002,63 @@ struct RendererImpl final : Renderer
 	RenderResourceManager<PipelineResource> m_pipeline_manager;
 	RenderResourceManager<Shader> m_shader_manager;
 	RenderResourceManager<Texture> m_texture_manager;
+	TextureStreamer m_texture_streamer;
+	ModelStreamer m_model_streamer;
 	gpu::ProgramHandle m_downscale_program;
 	gpu::BufferHandle m_tmp_uniform_buffer;
 	gpu::BufferHandle m_scratch_buffer;
 	Array<u32> m_free_sort_keys;
 	Array<const Mesh*> m_sort_key_to_mesh_map;
 	u32 m_max_sort_key = 0;
+	u32 m_sort_keys_version = 0;
+	u32 m_render_data_version = 0;
+
+	struct PooledRenderTarget {
+		u32 width;
+		u32 height;
+		gpu::TextureFormat format;
+		gpu::TextureFlags flags;
+		gpu::TextureHandle handle;
+		u32 release_frame;
+		bool in_use;
+	};
+
+	// unused render targets are kept for a few frames, e.g. while a view is being resized
+	enum { RENDER_TARGET_MAX_UNUSED_FRAMES = 3 };
+	Array<PooledRenderTarget> m_render_targets;
+	Mutex m_render_targets_mutex;
+	u32 m_render_targets_frame = 0;
+
+	struct PendingReadback {
+		gpu::ReadbackHandle handle = gpu::INVALID_READBACK;
+		Span<u8> data;
+		Delegate<void()> callback;
+		bool done = false;
+	};
+
+	// created on main thread, filled on render thread, callbacks are called on main thread
+	Array<PendingReadback*> m_readbacks;
+	Mutex m_readbacks_mutex;
+
+	struct PendingTextureUpload {
+		RenderJob* job;
+		gpu::TextureHandle handle;
+		u32 size;
+	};
+
+	// recreateTexture uploads over this per-frame budget are postponed to the next frames
+	Array<PendingTextureUpload> m_pending_texture_uploads;
+	u64 m_texture_upload_budget = 64 * 1024 * 1024;
+	u32 m_lod_triangle_budget = 0;
+	u32 m_lod_draw_call_budget = 0;
+	u64 m_texture_upload_bytes = 0;
 
 	Array<RenderPlugin*> m_plugins;
 	Local<FrameData> m_frames[3];
+	// how many of m_frames are used, 1 - lowest latency, 3 - best throughput
+	u32 m_frames_count = lengthOf(m_frames);
+	u32 m_frame_latency_counter = profiler::INVALID_COUNTER;
+	u32 m_input_latency_counter = profiler::INVALID_COUNTER;
 	FrameData* m_gpu_frame = nullptr;
 	FrameData* m_cpu_frame = nullptr;
 	jobs::SignalHandle m_last_render = jobs::INVALID_HANDLE;
@@ -1250,25 +2066,53 @@ struct RendererImpl final : Renderer
 	GPUProfiler m_profiler;
 
 	struct MaterialBuffer {
+		static constexpr u32 INITIAL_CAPACITY = 256;
+
 		MaterialBuffer(IAllocator& alloc) 
 			: map(alloc)
 			, data(alloc)
+			, gpu_data(alloc)
 		{}
 
+		// main thread, new slots are added to the free list
+		void grow(u32 new_size) {
+			const i32 old_size = data.size();
+			data.resize(new_size);
+			for (i32 i = old_size; i < (i32)new_size; ++i) {
+				data[i].ref_count = 0;
+				data[i].next_free = i + 1 < (i32)new_size ? i + 1 : first_free;
+			}
+			first_free = old_size;
+		}
+
+		// render thread, buffers are filled from `gpu_data`
+		void recreateBuffers() {
+			if (buffer) gpu::destroy(buffer);
+			if (staging_buffer) gpu::destroy(staging_buffer);
+			buffer = gpu::allocBufferHandle();
+			staging_buffer = gpu::allocBufferHandle();
+			// bound also as a shader buffer, so instanced draws can index it
+			gpu::createBuffer(buffer, gpu::BufferFlags::UNIFORM_BUFFER | gpu::BufferFlags::SHADER_BUFFER, gpu_data.byte_size(), gpu_data.begin());
+			gpu::createBuffer(staging_buffer, gpu::BufferFlags::UNIFORM_BUFFER, gpu_data.byte_size(), nullptr);
+		}
+
 		struct Data {
 			u32 ref_count;
-			union {
-				u32 hash;
-				u32 next_free;
-			};
+			i32 next_free;
+			StableHash hash;
 		};
 
 		gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
 		gpu::BufferHandle staging_buffer = gpu::INVALID_BUFFER;
+		// main thread
 		Array<Data> data;
-		int first_free;
-		HashMap<u32, u32> map;
+		i32 first_free = -1;
+		HashMap<StableHash, u32> map;
+		// render thread, copy of the buffer content with textures already converted to bindless handles
+		Array<MaterialConsts> gpu_data;
 	} m_material_buffer;
+	ProgramBinaryCache m_program_cache;
+	bool m_headless;
 };
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "engine/allocator.h"
+#include "engine/delegate.h"
 #include "engine/lumix.h"
 #include "engine/plugin.h"
 #include "gpu/gpu.h"
@@ -47,13 +48,19 @@ struct LUMIX_RENDERER_API Renderer : IPlugin {
 	virtual void frame() = 0;
 	virtual void waitForRender() = 0;
 	virtual void waitForCommandSetup() = 0;
+	// see Engine::InitArgs::headless, gpu is never initialized, resources keep only cpu data
+	virtual bool isHeadless() const = 0;
 	virtual void makeScreenshot(const struct Path& filename) = 0;
 	virtual u8 getShaderDefineIdx(const char* define) = 0;
 	virtual const char* getShaderDefine(int define_idx) const = 0;
 	virtual int getShaderDefinesCount() const = 0;
 	virtual gpu::ProgramHandle queueShaderCompile(struct Shader& shader, gpu::VertexDecl decl, u32 defines) = 0;
+	// compiles all permutations recorded in program binary cache, so they are ready next time
+	virtual void precompileShaders() = 0;
 	virtual struct FontManager& getFontManager() = 0;
 	virtual struct ResourceManager& getTextureManager() = 0;
+	virtual struct TextureStreamer& getTextureStreamer() = 0;
+	virtual struct ModelStreamer& getModelStreamer() = 0;
 	virtual void addPlugin(RenderPlugin& plugin) = 0;
 	virtual void removePlugin(RenderPlugin& plugin) = 0;
 	virtual Span<RenderPlugin*> getPlugins() = 0;
@@ -69,17 +76,31 @@ struct LUMIX_RENDERER_API Renderer : IPlugin {
 	
 	virtual gpu::BufferHandle getScratchBuffer() = 0;
 	virtual TransientSlice allocTransient(u32 size) = 0;
+	// render thread only, copies data to the transient buffer of the frame being rendered, aligned to be bound as uniform buffer
+	// buffer is gpu::INVALID_BUFFER if the frame's transient buffer is full
+	virtual TransientSlice allocUniform(const void* data, u32 size) = 0;
 	virtual gpu::BufferHandle createBuffer(const MemRef& memory, gpu::BufferFlags flags) = 0;
 	virtual void destroy(gpu::BufferHandle buffer) = 0;
 	virtual void destroy(gpu::ProgramHandle program) = 0;
 	
 	virtual gpu::TextureHandle createTexture(u32 w, u32 h, u32 depth, gpu::TextureFormat format, gpu::TextureFlags flags, const MemRef& memory, const char* debug_name) = 0;
 	virtual gpu::TextureHandle loadTexture(const gpu::TextureDesc& desc, const MemRef& image_data, gpu::TextureFlags flags, const char* debug_name) = 0;
-	virtual void copy(gpu::TextureHandle dst, gpu::TextureHandle src) = 0;
+	// replaces storage and content of existing texture, the handle stays valid
+	virtual void recreateTexture(gpu::TextureHandle handle, const gpu::TextureDesc& desc, const MemRef& image_data, gpu::TextureFlags flags, const char* debug_name) = 0;
+	virtual void copy(gpu::TextureHandle dst, gpu::TextureHandle src, u32 dst_x = 0, u32 dst_y = 0) = 0;
 	virtual void downscale(gpu::TextureHandle src, u32 src_w, u32 src_h, gpu::TextureHandle dst, u32 dst_w, u32 dst_h) = 0;
 	virtual void updateTexture(gpu::TextureHandle handle, u32 slice, u32 x, u32 y, u32 w, u32 h, gpu::TextureFormat format, const MemRef& memory) = 0;
 	virtual void getTextureImage(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, Span<u8> data) = 0;
+	// non-blocking version of getTextureImage, `callback` is called from frame() once `data` is filled
+	// `data` must stay alive until then
+	virtual void getTextureImageAsync(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, Span<u8> data, const Delegate<void()>& callback) = 0;
+	// reads `mip` of `texture` without staging copy, all faces for cubemaps, `texture` must stay alive until `callback` is called
+	virtual void readTextureMipAsync(gpu::TextureHandle texture, u32 mip, Span<u8> data, const Delegate<void()>& callback) = 0;
 	virtual void destroy(gpu::TextureHandle tex) = 0;
+	// transient render targets shared by all pipelines, released targets are reused by later acquires with the same desc
+	// released target must not be used anymore, since it can be acquired by another pipeline
+	virtual gpu::TextureHandle acquireRenderTarget(u32 w, u32 h, gpu::TextureFormat format, gpu::TextureFlags flags, const char* debug_name) = 0;
+	virtual void releaseRenderTarget(gpu::TextureHandle tex) = 0;
 	
 	virtual void queue(RenderJob& cmd, i64 profiler_link) = 0;
 
@@ -90,6 +111,16 @@ struct LUMIX_RENDERER_API Renderer : IPlugin {
 	virtual u32 allocSortKey(struct Mesh* mesh) = 0;
 	virtual void freeSortKey(u32 key) = 0;
 	virtual u32 getMaxSortKey() const = 0;
+	// pipelines bias lods to stay under these, 0 == no budget
+	virtual u32 getLODTriangleBudget() const = 0;
+	virtual u32 getLODDrawCallBudget() const = 0;
+	// from the first to the last gpu query of the last finished frame, lags a few frames behind, 0 if unknown
+	virtual float getGPUFrameTime() const = 0;
+	// changes whenever any sort key is allocated or freed
+	virtual u32 getSortKeysVersion() const = 0;
+	// changes whenever any material's render data or any shader's programs change, baked draws referencing them are invalid then
+	virtual u32 getRenderDataVersion() const = 0;
+	virtual void markRenderDataChanged() = 0;
 	virtual const Mesh** getSortKeyToMeshMap() const = 0;
 
 	virtual u8 getLayerIdx(const char* name) = 0;
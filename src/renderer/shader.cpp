@@ -8,6 +8,7 @@
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "renderer/material.h"
 #include "renderer/renderer.h"
 #include "renderer/texture.h"
 
@@ -45,6 +46,7 @@ Shader::Shader(const Path& path, ResourceManager& resource_manager, Renderer& re
 	, m_programs(m_allocator)
 	, m_sources(m_allocator)
 	, m_ignored_properties(0)
+	, m_bindless_textures(false)
 {
 	m_sources.path = path;
 }
@@ -59,7 +61,22 @@ bool Shader::hasDefine(u8 define) const {
 	return m_defines.indexOf(define) >= 0;
 }
 
-void Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer) {
+u64 Shader::getBinaryKey(const gpu::VertexDecl& decl, u32 defines, const Sources& sources, Renderer& renderer) {
+	u32 code_hash = crc32(sources.common.c_str());
+	for (const Stage& stage : sources.stages) {
+		code_hash = continueCrc32(code_hash, &stage.type, sizeof(stage.type));
+		code_hash = continueCrc32(code_hash, stage.code.begin(), stage.code.byte_size());
+	}
+	// define indices are not stable between runs, names are
+	u32 defines_hash = continueCrc32(decl.hash, &code_hash, sizeof(code_hash));
+	for (int i = 0; i < sizeof(defines) * 8; ++i) {
+		if ((defines & (1 << i)) == 0) continue;
+		defines_hash = continueCrc32(defines_hash, renderer.getShaderDefine(i));
+	}
+	return ((u64)code_hash << 32) | defines_hash;
+}
+
+bool Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer) {
 	PROFILE_BLOCK("compile_shader");
 
 	const char* codes[64];
@@ -82,7 +99,7 @@ void Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defin
 	}
 	prefixes[defines_count] = sources.common.length() == 0 ? "" : sources.common.c_str();
 
-	gpu::createProgram(program, decl, codes, types, sources.stages.size(), prefixes, 1 + defines_count, sources.path.c_str());
+	return gpu::createProgram(program, decl, codes, types, sources.stages.size(), prefixes, 1 + defines_count, sources.path.c_str());
 }
 
 gpu::ProgramHandle Shader::getProgram(const gpu::VertexDecl& decl, u32 defines) {
@@ -210,6 +227,15 @@ int uniform(lua_State* L)
 }
 
 
+// textures are accessed through LUMIX_MATERIAL_TEXTURE if LUMIX_BINDLESS is defined
+int bindless_textures(lua_State* L)
+{
+	Shader* shader = getShader(L);
+	shader->m_bindless_textures = true;
+	return 0;
+}
+
+
 int define(lua_State* L)
 {
 	Shader* shader = getShader(L);
@@ -362,6 +388,9 @@ int include(lua_State* L)
 
 bool Shader::load(u64 size, const u8* mem)
 {
+	// programs are never compiled in headless mode
+	if (m_renderer.isHeadless()) return true;
+	m_renderer.markRenderDataChanged();
 	lua_State* L = luaL_newstate();
 	luaL_openlibs(L);
 
@@ -383,6 +412,8 @@ bool Shader::load(u64 size, const u8* mem)
 	lua_setfield(L, LUA_GLOBALSINDEX, "texture_slot");
 	lua_pushcfunction(L, LuaAPI::define);
 	lua_setfield(L, LUA_GLOBALSINDEX, "define");
+	lua_pushcfunction(L, LuaAPI::bindless_textures);
+	lua_setfield(L, LUA_GLOBALSINDEX, "bindless_textures");
 	lua_pushcfunction(L, LuaAPI::uniform);
 	lua_setfield(L, LUA_GLOBALSINDEX, "uniform");
 	lua_pushcfunction(L, LuaAPI::ignore_property);
@@ -401,12 +432,14 @@ bool Shader::load(u64 size, const u8* mem)
 
 void Shader::unload()
 {
+	m_renderer.markRenderDataChanged();
 	for (gpu::ProgramHandle prg : m_programs) {
 		m_renderer.destroy(prg);
 	}
 	m_sources.common = "";
 	m_sources.stages.clear();
 	m_ignored_properties = 0;
+	m_bindless_textures = false;
 	m_programs.clear();
 	m_uniforms.clear();
 	for (u32 i = 0; i < m_texture_slot_count; ++i) {
@@ -458,6 +491,67 @@ static void toVarName(Span<char> out, const char* in) {
 }
 
 void Shader::onBeforeReady() {
+	if (m_bindless_textures) {
+		// instanced draws of bindless materials can mix materials, every instance indexes its material's constants
+		// in the whole material buffer, the struct is padded to sizeof(MaterialConsts) so it matches the array stride
+		m_sources.common.cat(R"#(
+		#if defined LUMIX_BINDLESS && defined INSTANCED
+			struct LumixMaterialConsts {
+				vec4 material_color;
+				float roughness;
+				float metallic;
+				float emission;
+				float translucency;
+				uvec4 material_textures[8];
+			)#");
+
+		// custom uniforms are at the end of MaterialConsts
+		const u32 custom_offset = sizeof(MaterialConsts) - sizeof(MaterialConsts::custom);
+		u32 size = custom_offset;
+		for (const Uniform& u : m_uniforms) {
+			m_sources.common.cat(toString(u.type));
+			m_sources.common.cat(" ");
+			char var_name[64];
+			toVarName(Span(var_name), u.name);
+			m_sources.common.cat(var_name + 2);
+			m_sources.common.cat(";\n");
+			size = maximum(size, custom_offset + u.offset + u.size());
+		}
+		ASSERT(size <= sizeof(MaterialConsts));
+		if (size < sizeof(MaterialConsts)) {
+			const StaticString<64> padding("float padding[", u32(sizeof(MaterialConsts) - size) / 4, "];\n");
+			m_sources.common.cat(padding);
+		}
+
+		m_sources.common.cat(R"#(};
+			layout(std430, binding = 9) readonly buffer LumixMaterials {
+				LumixMaterialConsts b_materials[];
+			};
+			#ifdef LUMIX_VERTEX_SHADER
+				layout(location = 12) in float i_material_index;
+				layout(location = 15) flat out uint v_material_index;
+				#define LUMIX_MATERIAL_INDEX uint(i_material_index)
+			#else
+				layout(location = 15) flat in uint v_material_index;
+				#define LUMIX_MATERIAL_INDEX v_material_index
+			#endif
+			#define u_material_color b_materials[LUMIX_MATERIAL_INDEX].material_color
+			#define u_roughness b_materials[LUMIX_MATERIAL_INDEX].roughness
+			#define u_metallic b_materials[LUMIX_MATERIAL_INDEX].metallic
+			#define u_emission b_materials[LUMIX_MATERIAL_INDEX].emission
+			#define u_translucency b_materials[LUMIX_MATERIAL_INDEX].translucency
+			#define u_material_textures b_materials[LUMIX_MATERIAL_INDEX].material_textures
+			)#");
+
+		for (const Uniform& u : m_uniforms) {
+			char var_name[64];
+			toVarName(Span(var_name), u.name);
+			const StaticString<192> define("#define ", var_name, " b_materials[LUMIX_MATERIAL_INDEX].", var_name + 2, "\n");
+			m_sources.common.cat(define);
+		}
+		m_sources.common.cat("#else\n");
+	}
+
 	m_sources.common.cat(R"#(
 		layout (std140, binding = 2) uniform MaterialState {
 			vec4 u_material_color;
@@ -465,6 +559,7 @@ void Shader::onBeforeReady() {
 			float u_metallic;
 			float u_emission;
 			float u_translucency;
+			uvec4 u_material_textures[8];
 		)#");
 
 	for (const Uniform& u : m_uniforms) {
@@ -477,6 +572,13 @@ void Shader::onBeforeReady() {
 	}
 
 	m_sources.common.cat("};\n");
+	if (m_bindless_textures) m_sources.common.cat("#endif\n");
+
+	m_sources.common.cat(R"#(
+		#ifdef LUMIX_BINDLESS
+			#define LUMIX_MATERIAL_TEXTURE(type, idx) type(((idx) & 1) == 0 ? u_material_textures[(idx) >> 1].xy : u_material_textures[(idx) >> 1].zw)
+		#endif
+		)#");
 }
 
 
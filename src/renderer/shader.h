@@ -107,7 +107,9 @@ public:
 	bool isIgnored(Property value) const { return m_ignored_properties & (1 << (u32)value); }
 	
 	gpu::ProgramHandle getProgram(const gpu::VertexDecl& decl, u32 defines);
-	static void compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer);
+	static bool compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer);
+	// identifies compiled program in program binary cache, does not depend on driver
+	static u64 getBinaryKey(const gpu::VertexDecl& decl, u32 defines, const Sources& sources, Renderer& renderer);
 
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
@@ -119,6 +121,7 @@ public:
 	HashMap<u64, gpu::ProgramHandle> m_programs;
 	Sources m_sources;
 	u32 m_ignored_properties;
+	bool m_bindless_textures;
 
 	static const ResourceType TYPE;
 
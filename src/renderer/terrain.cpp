@@ -1,12 +1,15 @@
 #include "terrain.h"
+#include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
 #include "renderer/material.h"
 #include "renderer/model.h"
@@ -44,6 +47,7 @@ Terrain::Terrain(Renderer& renderer, EntityPtr entity, RenderScene& scene, IAllo
 	, m_allocator(allocator)
 	, m_grass_types(m_allocator)
 	, m_renderer(renderer)
+	, m_height_pyramid(m_allocator)
 {
 }
 
@@ -329,6 +333,88 @@ float Terrain::getHeight(float x, float z) const
 }
 	
 
+void Terrain::getHeights(Span<const Vec2> xz, Span<float> heights) const
+{
+	PROFILE_FUNCTION();
+	ASSERT(xz.length() == heights.length());
+	const u32 count = xz.length();
+	// small batches are faster on a single thread
+	if (count < 4096) {
+		getHeights(xz.begin(), heights.begin(), count);
+		return;
+	}
+
+	jobs::forEach(count, jobs::GrainHint{20}, [&](i32 from, i32 to, const jobs::ForEachContext&){
+		getHeights(xz.begin() + from, heights.begin() + from, to - from);
+	});
+}
+
+
+float Terrain::getRawHeight(u32 idx) const
+{
+	const Texture* t = m_heightmap;
+	if (t->format == gpu::TextureFormat::R16) return ((const u16*)t->getData())[idx] * (1.0f / 65535.0f);
+	if (t->format == gpu::TextureFormat::RGBA8) return (((const u32*)t->getData())[idx] & 0xff) * (1.0f / 255.0f);
+	ASSERT(false);
+	return 0;
+}
+
+
+void Terrain::getHeights(const Vec2* LUMIX_RESTRICT xz, float* LUMIX_RESTRICT heights, u32 count) const
+{
+	if (!m_heightmap || !((const Texture*)m_heightmap)->getData()) {
+		for (u32 i = 0; i < count; ++i) heights[i] = 0;
+		return;
+	}
+
+	// 4 points at once, fetches are scalar, interpolation matches getHeight(float, float)
+	const float4 scale = f4Splat(m_scale.x);
+	const float4 inv_scale = f4Splat(1.0f / m_scale.x);
+	const float4 y_scale = f4Splat(m_scale.y);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		alignas(16) float tmp_x[4];
+		alignas(16) float tmp_z[4];
+		for (u32 j = 0; j < 4; ++j) {
+			tmp_x[j] = xz[i + j].x;
+			tmp_z[j] = xz[i + j].y;
+		}
+		const float4 x = f4Load(tmp_x);
+		const float4 z = f4Load(tmp_z);
+		const float4 int_x = f4Trunc(x * inv_scale);
+		const float4 int_z = f4Trunc(z * inv_scale);
+		const float4 dec_x = (x - int_x * scale) * inv_scale;
+		const float4 dec_z = (z - int_z * scale) * inv_scale;
+		f4Store(tmp_x, int_x);
+		f4Store(tmp_z, int_z);
+
+		alignas(16) float h[4][4];
+		for (u32 j = 0; j < 4; ++j) {
+			const i32 x0 = clamp((i32)tmp_x[j], 0, m_width - 1);
+			const i32 x1 = clamp((i32)tmp_x[j] + 1, 0, m_width - 1);
+			const i32 row0 = clamp((i32)tmp_z[j], 0, m_height - 1) * m_width;
+			const i32 row1 = clamp((i32)tmp_z[j] + 1, 0, m_height - 1) * m_width;
+			h[0][j] = getRawHeight(x0 + row0);
+			h[1][j] = getRawHeight(x1 + row0);
+			h[2][j] = getRawHeight(x0 + row1);
+			h[3][j] = getRawHeight(x1 + row1);
+		}
+
+		// both triangles of a cell in one expression
+		const float4 upper = f4CmpGT(dec_x, dec_z);
+		const float4 h0 = f4Load(h[0]);
+		const float4 h3 = f4Load(h[3]);
+		const float4 hm = f4Select(upper, f4Load(h[1]), f4Load(h[2]));
+		const float4 a = f4Select(upper, dec_x, dec_z);
+		const float4 b = f4Select(upper, dec_z, dec_x);
+		f4Store(h[0], (h0 + (hm - h0) * a + (h3 - hm) * b) * y_scale);
+		memcpy(heights + i, h[0], sizeof(h[0]));
+	}
+
+	for (; i < count; ++i) heights[i] = getHeight(xz[i].x, xz[i].y);
+}
+
+
 float Terrain::getHeight(int x, int z) const
 {
 	const float DIV64K = 1.0f / 65535.0f;
@@ -369,72 +455,198 @@ void Terrain::setHeight(int x, int z, float h)
 	ASSERT(t->format == gpu::TextureFormat::R16);
 	int idx = clamp(x, 0, m_width) + clamp(z, 0, m_height) * m_width;
 	((u16*)t->getData())[idx] = (u16)(h * (65535.0f / m_scale.y));
+	onHeightmapChanged(clamp(x, 0, m_width - 1), clamp(z, 0, m_height - 1), 1, 1);
 }
 
 
-RayCastModelHit Terrain::castRay(const DVec3& origin, const Vec3& dir)
+void Terrain::onHeightmapChanged(u32 x, u32 z, u32 w, u32 h)
 {
-	RayCastModelHit hit;
-	hit.is_hit = false;
-	hit.mesh = nullptr;
-	if (!m_heightmap || !m_heightmap->isReady()) return hit;
+	// not built yet or stale, it's rebuilt in the next castRay
+	if (!m_heightmap || ((const Texture*)m_heightmap)->getData() != m_height_pyramid_data) return;
+	// a sample is a corner of up to 4 cells
+	updateHeightPyramid(x > 0 ? x - 1 : 0, z > 0 ? z - 1 : 0, x + w, z + h);
+}
 
-	const Universe& universe = m_scene.getUniverse();
-	const Quat rot = universe.getRotation(m_entity);
-	const DVec3 pos = universe.getPosition(m_entity);
-	const Vec3 rel_dir = rot.rotate(dir);
-	const Vec3 terrain_to_ray = Vec3(origin - pos);
-	const Vec3 rel_origin = rot.conjugated().rotate(terrain_to_ray);
 
-	Vec3 start;
-	const Vec3 size(m_width * m_scale.x, m_scale.y * 65535.0f, m_height * m_scale.x);
-	if (!getRayAABBIntersection(rel_origin, rel_dir, Vec3::ZERO, size, start)) return hit;
+void Terrain::onSplatmapChanged(u32 x, u32 y, u32 w, u32 h)
+{
+	m_splatmap_changes[m_splatmap_version % SPLATMAP_CHANGES_COUNT] = IVec4(IVec2(x, y), IVec2(x + w, y + h));
+	++m_splatmap_version;
+}
 
-	int hx = (int)(start.x / m_scale.x);
-	int hz = (int)(start.z / m_scale.x);
 
-	float next_x = fabs(rel_dir.x) < 0.01f ? hx : ((hx + (rel_dir.x < 0 ? 0 : 1)) * m_scale.x - rel_origin.x) / rel_dir.x;
-	float next_z = fabs(rel_dir.z) < 0.01f ? hz : ((hz + (rel_dir.z < 0 ? 0 : 1)) * m_scale.x - rel_origin.z) / rel_dir.z;
+bool Terrain::updateHeightPyramid()
+{
+	if (!m_heightmap || !m_heightmap->isReady() || m_width < 2 || m_height < 2) return false;
+	const u8* data = ((const Texture*)m_heightmap)->getData();
+	if (!data) return false;
+	if (data == m_height_pyramid_data) return true;
 
-	float delta_x = fabsf(rel_dir.x) < 0.01f ? 0 : m_scale.x / fabsf(rel_dir.x);
-	float delta_z = fabsf(rel_dir.z) < 0.01f ? 0 : m_scale.z / fabsf(rel_dir.z);
-	int step_x = (int)signum(rel_dir.x);
-	int step_z = (int)signum(rel_dir.z);
+	PROFILE_FUNCTION();
+	u32 w = m_width - 1;
+	u32 h = m_height - 1;
+	u32 size = 0;
+	m_height_pyramid_levels = 0;
+	for (;;) {
+		m_height_pyramid_offsets[m_height_pyramid_levels] = size;
+		++m_height_pyramid_levels;
+		size += w * h;
+		if (w == 1 && h == 1) break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+	m_height_pyramid.resize(size);
+	m_height_pyramid_data = data;
+	updateHeightPyramid(0, 0, m_width - 1, m_height - 1);
+	return true;
+}
 
-	while (hx >= 0 && hz >= 0 && hx + step_x < m_width && hz + step_z < m_height) {
-		float t;
-		float x = hx * m_scale.x;
-		float z = hz * m_scale.x;
-		Vec3 p0(x, getHeight(x, z), z);
-		Vec3 p1(x + m_scale.x, getHeight(x + m_scale.x, z), z);
-		Vec3 p2(x + m_scale.x, getHeight(x + m_scale.x, z + m_scale.x), z + m_scale.x);
-		Vec3 p3(x, getHeight(x, z + m_scale.x), z + m_scale.x);
-		if (getRayTriangleIntersection(rel_origin, rel_dir, p0, p1, p2, &t)) {
-			hit.is_hit = true;
-			hit.origin = origin;
-			hit.dir = dir;
-			hit.t = t;
-			return hit;
-		}
-		if (getRayTriangleIntersection(rel_origin, rel_dir, p0, p2, p3, &t)) {
-			hit.is_hit = true;
-			hit.origin = origin;
-			hit.dir = dir;
-			hit.t = t;
-			return hit;
+
+// [from, to) in cells of level 0
+void Terrain::updateHeightPyramid(u32 from_x, u32 from_z, u32 to_x, u32 to_z)
+{
+	u32 w = m_width - 1;
+	u32 h = m_height - 1;
+	to_x = minimum(to_x, w);
+	to_z = minimum(to_z, h);
+
+	HeightRange* LUMIX_RESTRICT cells = m_height_pyramid.begin();
+	for (u32 z = from_z; z < to_z; ++z) {
+		for (u32 x = from_x; x < to_x; ++x) {
+			const u32 idx = x + z * m_width;
+			const float h0 = getRawHeight(idx);
+			const float h1 = getRawHeight(idx + 1);
+			const float h2 = getRawHeight(idx + m_width);
+			const float h3 = getRawHeight(idx + m_width + 1);
+			cells[x + z * w] = { minimum(h0, h1, h2, h3), maximum(h0, h1, h2, h3) };
 		}
-		if (next_x < next_z && step_x != 0) {
-			next_x += delta_x;
-			hx += step_x;
+	}
+
+	for (u32 level = 1; level < m_height_pyramid_levels; ++level) {
+		const HeightRange* LUMIX_RESTRICT src = &m_height_pyramid[m_height_pyramid_offsets[level - 1]];
+		HeightRange* LUMIX_RESTRICT dst = &m_height_pyramid[m_height_pyramid_offsets[level]];
+		const u32 src_w = w;
+		const u32 src_h = h;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+		from_x /= 2;
+		from_z /= 2;
+		to_x = (to_x + 1) / 2;
+		to_z = (to_z + 1) / 2;
+		for (u32 z = from_z; z < to_z; ++z) {
+			for (u32 x = from_x; x < to_x; ++x) {
+				HeightRange r = src[x * 2 + z * 2 * src_w];
+				auto merge = [&](u32 sx, u32 sz){
+					if (sx >= src_w || sz >= src_h) return;
+					const HeightRange& c = src[sx + sz * src_w];
+					r.min = minimum(r.min, c.min);
+					r.max = maximum(r.max, c.max);
+				};
+				merge(x * 2 + 1, z * 2);
+				merge(x * 2, z * 2 + 1);
+				merge(x * 2 + 1, z * 2 + 1);
+				dst[x + z * w] = r;
+			}
 		}
-		else {
-			next_z += delta_z;
-			hz += step_z;
+	}
+}
+
+
+RayCastModelHit Terrain::castRay(const DVec3& origin, const Vec3& dir)
+{
+	PROFILE_FUNCTION();
+	RayCastModelHit hit;
+	hit.is_hit = false;
+	hit.mesh = nullptr;
+	if (!updateHeightPyramid()) return hit;
+
+	const Universe& universe = m_scene.getUniverse();
+	const Quat inv_rot = universe.getRotation(m_entity).conjugated();
+	const DVec3 pos = universe.getPosition(m_entity);
+	const Vec3 rel_dir = inv_rot.rotate(dir);
+	const Vec3 rel_origin = inv_rot.rotate(Vec3(origin - pos));
+	auto safeRcp = [](float v) { return 1 / (fabsf(v) < 1e-9f ? 1e-9f : v); };
+	const Vec3 inv_dir(safeRcp(rel_dir.x), safeRcp(rel_dir.y), safeRcp(rel_dir.z));
+	const u32 cells_w = m_width - 1;
+	const u32 cells_h = m_height - 1;
+	float best_t = FLT_MAX;
+
+	// entry distance of the ray into node's bounding box
+	auto intersect = [&](u32 level, u32 x, u32 z, float& t) {
+		const u32 level_w = (cells_w + (1 << level) - 1) >> level;
+		const HeightRange& range = m_height_pyramid[m_height_pyramid_offsets[level] + x + z * level_w];
+		const u32 cx = x << level;
+		const u32 cz = z << level;
+		const Vec3 min(cx * m_scale.x, range.min * m_scale.y, cz * m_scale.x);
+		const Vec3 max(minimum(cx + (1 << level), cells_w) * m_scale.x, range.max * m_scale.y, minimum(cz + (1 << level), cells_h) * m_scale.x);
+		const Vec3 t0 = (min - rel_origin) * inv_dir;
+		const Vec3 t1 = (max - rel_origin) * inv_dir;
+		const float t_near = maximum(minimum(t0.x, t1.x), minimum(t0.y, t1.y), minimum(t0.z, t1.z), 0.f);
+		const float t_far = minimum(maximum(t0.x, t1.x), maximum(t0.y, t1.y), maximum(t0.z, t1.z));
+		t = t_near;
+		return t_near <= t_far && t_near < best_t;
+	};
+
+	struct Node {
+		u32 level;
+		u32 x, z;
+		float t;
+	};
+	// each level leaves at most 3 nodes on the stack
+	Node stack[32 * 3 + 4];
+	u32 stack_size = 0;
+	const u32 top = m_height_pyramid_levels - 1;
+	float top_t;
+	if (intersect(top, 0, 0, top_t)) stack[stack_size++] = {top, 0, 0, top_t};
+
+	while (stack_size > 0) {
+		const Node node = stack[--stack_size];
+		if (node.t >= best_t) continue;
+
+		if (node.level == 0) {
+			const i32 x0 = (i32)node.x;
+			const i32 z0 = (i32)node.z;
+			const float x = node.x * m_scale.x;
+			const float z = node.z * m_scale.x;
+			const Vec3 p0(x, getHeight(x0, z0), z);
+			const Vec3 p1(x + m_scale.x, getHeight(x0 + 1, z0), z);
+			const Vec3 p2(x + m_scale.x, getHeight(x0 + 1, z0 + 1), z + m_scale.x);
+			const Vec3 p3(x, getHeight(x0, z0 + 1), z + m_scale.x);
+			float t;
+			if (getRayTriangleIntersection(rel_origin, rel_dir, p0, p1, p2, &t) && t < best_t) best_t = t;
+			if (getRayTriangleIntersection(rel_origin, rel_dir, p0, p2, p3, &t) && t < best_t) best_t = t;
+			continue;
 		}
-		if (delta_x == 0 && delta_z == 0) {
-			return hit;
+
+		const u32 child_level = node.level - 1;
+		const u32 child_w = (cells_w + (1 << child_level) - 1) >> child_level;
+		const u32 child_h = (cells_h + (1 << child_level) - 1) >> child_level;
+		Node children[4];
+		u32 children_count = 0;
+		for (u32 i = 0; i < 4; ++i) {
+			const u32 x = node.x * 2 + (i & 1);
+			const u32 z = node.z * 2 + (i >> 1);
+			if (x >= child_w || z >= child_h) continue;
+			float t;
+			if (!intersect(child_level, x, z, t)) continue;
+			// sorted by distance, farthest first, so the nearest one is popped first
+			u32 j = children_count;
+			while (j > 0 && children[j - 1].t < t) {
+				children[j] = children[j - 1];
+				--j;
+			}
+			children[j] = {child_level, x, z, t};
+			++children_count;
 		}
+		for (u32 i = 0; i < children_count; ++i) stack[stack_size++] = children[i];
 	}
+
+	if (best_t == FLT_MAX) return hit;
+
+	hit.is_hit = true;
+	hit.origin = origin;
+	hit.dir = dir;
+	hit.t = best_t;
 	return hit;
 }
 
@@ -445,6 +657,7 @@ void Terrain::onMaterialLoaded(Resource::State, Resource::State new_state, Resou
 	if (new_state == Resource::State::READY)
 	{
 		m_heightmap = m_material->getTextureByName("Heightmap");
+		m_height_pyramid_data = nullptr;
 		bool is_data_ready = true;
 		if (m_heightmap && m_heightmap->getData() == nullptr)
 		{
@@ -32,6 +32,7 @@ struct Terrain
 {
 	public:
 		enum { TEXTURES_COUNT = 6 };
+		enum { SPLATMAP_CHANGES_COUNT = 16 };
 
 		struct GrassType
 		{
@@ -69,6 +70,8 @@ struct Terrain
 		EntityRef getEntity() const { return m_entity; }
 		Vec3 getNormal(float x, float z);
 		float getHeight(float x, float z) const;
+		// same as getHeight(x, z) for each point in terrain space, big batches are split among workers
+		void getHeights(Span<const Vec2> xz, Span<float> heights) const;
 		float getXZScale() const { return m_scale.x; }
 		float getYScale() const { return m_scale.y; }
 		Path getGrassTypePath(int index);
@@ -84,6 +87,10 @@ struct Terrain
 
 		float getHeight(int x, int z) const;
 		void setHeight(int x, int z, float height);
+		// must be called after heightmap data are modified outside of setHeight
+		void onHeightmapChanged(u32 x, u32 z, u32 w, u32 h);
+		// must be called after splatmap data are modified, virtual textures recomposite pages covering the rect
+		void onSplatmapChanged(u32 x, u32 y, u32 w, u32 h);
 		void setXZScale(float scale);
 		void setYScale(float scale);
 		void setGrassTypePath(int index, const Path& path);
@@ -102,7 +109,17 @@ struct Terrain
 		void removeGrassType(int index);
 
 	private: 
+		// normalized min and max height of a node of m_height_pyramid
+		struct HeightRange {
+			float min;
+			float max;
+		};
+
 		void onMaterialLoaded(Resource::State, Resource::State new_state, Resource&);
+		void getHeights(const Vec2* xz, float* heights, u32 count) const;
+		float getRawHeight(u32 idx) const;
+		bool updateHeightPyramid();
+		void updateHeightPyramid(u32 from_x, u32 from_z, u32 to_x, u32 to_z);
 
 	public:
 		IAllocator& m_allocator;
@@ -118,6 +135,14 @@ struct Terrain
 		RenderScene& m_scene;
 		Array<GrassType> m_grass_types;
 		Renderer& m_renderer;
+		// min/max heights of 1x1, 2x2, 4x4, ... cells used to skip empty space in castRay, built lazily
+		Array<HeightRange> m_height_pyramid;
+		u32 m_height_pyramid_offsets[32];
+		u32 m_height_pyramid_levels = 0;
+		const u8* m_height_pyramid_data = nullptr;
+		// splatmap texels modified by change `i` are in m_splatmap_changes[i % SPLATMAP_CHANGES_COUNT], as from.xy, to.xy
+		IVec4 m_splatmap_changes[SPLATMAP_CHANGES_COUNT];
+		u32 m_splatmap_version = 0;
 };
 
 
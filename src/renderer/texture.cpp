@@ -12,6 +12,7 @@
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
 #include "engine/string.h"
+#include "renderer/material.h"
 #include "renderer/renderer.h"
 #include "renderer/texture.h"
 #include "stb/stb_image.h"
@@ -636,6 +637,15 @@ static bool loadLBC(Texture& texture, const u8* data, u32 size)
 	const u32 offset = u32(image_data - data);
 	if (offset >= size) return false;
 
+	// streamed textures start with only the small mips, TextureStreamer loads the rest when they are visible
+	const bool stream = texture.data_reference == 0 && TextureStreamer::isStreamable(desc);
+	const u32 first_mip = stream ? TextureStreamer::getBaseMip(desc) : 0;
+	u32 first_mip_offset = 0;
+	for (u32 mip = 0; mip < first_mip; ++mip) {
+		first_mip_offset += gpu::getSize(desc.format, maximum(desc.width >> mip, 1), maximum(desc.height >> mip, 1));
+	}
+	if (first_mip_offset >= size - offset) return false;
+
 	if(texture.data_reference > 0) {
 		if (desc.format != gpu::TextureFormat::RGBA8) {
 			logError("Unsupported texture format ", texture.getPath(), " to access on CPU. Use uncompressed TGA without mipmaps or RAW.");
@@ -646,19 +656,243 @@ static bool loadLBC(Texture& texture, const u8* data, u32 size)
 		}
 	}
 
-	Renderer::MemRef mem = texture.renderer.copy(image_data, size - offset);
-	texture.handle = texture.renderer.loadTexture(desc, mem, texture.getGPUFlags(), texture.getPath().c_str());
+	gpu::TextureDesc gpu_desc = desc;
+	gpu_desc.width = maximum(desc.width >> first_mip, 1);
+	gpu_desc.height = maximum(desc.height >> first_mip, 1);
+	gpu_desc.mips = desc.mips - first_mip;
+	Renderer::MemRef mem = texture.renderer.copy(image_data + first_mip_offset, size - offset - first_mip_offset);
+	texture.handle = texture.renderer.loadTexture(gpu_desc, mem, texture.getGPUFlags(), texture.getPath().c_str());
 	if (texture.handle) {
 		texture.width = desc.width;
 		texture.height = desc.height;
 		texture.mips = desc.mips;
 		texture.depth = desc.depth;
 		texture.is_cubemap = desc.is_cubemap;
+		texture.format = desc.format;
+		if (stream) {
+			texture.base_mip = first_mip;
+			texture.resident_mip = first_mip;
+			texture.wanted_mip = first_mip;
+			texture.renderer.getTextureStreamer().add(texture);
+		}
 	}
 
 	return texture.handle;
 }
 
+
+u64 Texture::getMipsSize(u32 mip) const
+{
+	u64 res = 0;
+	for (u32 i = mip; i < mips; ++i) {
+		res += gpu::getSize(format, maximum(width >> i, 1), maximum(height >> i, 1));
+	}
+	return res;
+}
+
+
+void Texture::streamMips(u32 mip)
+{
+	ASSERT(is_streamed);
+	ASSERT(!stream_op.isValid());
+	ASSERT(mip <= base_mip);
+
+	stream_mip = mip;
+	FileSystem& fs = getResourceManager().getOwner().getFileSystem();
+	const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", getPath().getHash(), ".res");
+	stream_op = fs.getContent(Path(res_path), makeDelegate<&Texture::onMipsLoaded>(this), FileSystem::Priority::LOW);
+}
+
+
+void Texture::onMipsLoaded(u64 size, const u8* mem, bool success)
+{
+	PROFILE_FUNCTION();
+	stream_op = FileSystem::AsyncHandle::invalid();
+	if (!success || !isReady()) return;
+
+	const CompiledResourceHeader* header = (const CompiledResourceHeader*)mem;
+	if (size < sizeof(*header) || header->magic != CompiledResourceHeader::MAGIC) return;
+
+	const u8* payload = mem + sizeof(*header);
+	u64 payload_size = size - sizeof(*header);
+	OutputMemoryStream tmp(allocator);
+	if (header->flags & CompiledResourceHeader::COMPRESSED) {
+		if (!getResourceManager().getOwner().decompress(*header, Span(payload, (u32)payload_size), tmp)) return;
+		payload = tmp.data();
+		payload_size = tmp.size();
+	}
+
+	InputMemoryStream blob(payload, payload_size);
+
+	char ext[4] = {};
+	u32 file_flags;
+	if (!blob.read(ext, 3) || !blob.read(&file_flags, sizeof(file_flags))) return;
+	if (!equalIStrings(ext, "lbc")) return;
+
+	const u8* data = (const u8*)blob.getBuffer() + blob.getPosition();
+	const u32 data_size = u32(blob.size() - blob.getPosition());
+	gpu::TextureDesc desc;
+	const u8* image_data = getLBCInfo(data, desc);
+	if (!image_data) return;
+	// file changed since it was loaded, reload takes care of it
+	if (desc.width != width || desc.height != height || desc.mips != mips || desc.format != format) return;
+
+	const u32 offset = u32(image_data - data);
+	const u64 mip_offset = getMipsSize(0) - getMipsSize(stream_mip);
+	const u64 mips_size = getMipsSize(stream_mip);
+	if (offset + mip_offset + mips_size > data_size) return;
+
+	gpu::TextureDesc gpu_desc = desc;
+	gpu_desc.width = maximum(desc.width >> stream_mip, 1);
+	gpu_desc.height = maximum(desc.height >> stream_mip, 1);
+	gpu_desc.mips = desc.mips - stream_mip;
+	Renderer::MemRef mem_ref = renderer.copy(image_data + mip_offset, (u32)mips_size);
+	renderer.recreateTexture(handle, gpu_desc, mem_ref, getGPUFlags(), getPath().c_str());
+	resident_mip = stream_mip;
+}
+
+
+TextureStreamer::TextureStreamer(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_textures(allocator)
+{}
+
+
+TextureStreamer::~TextureStreamer()
+{
+	ASSERT(m_textures.empty());
+}
+
+
+bool TextureStreamer::isStreamable(const gpu::TextureDesc& desc)
+{
+	if (desc.is_cubemap || desc.depth != 1) return false;
+	const u32 size = maximum(desc.width, desc.height);
+	// gpu texture always has the full mip chain
+	if (desc.mips != 1 + log2(size)) return false;
+	return size > BASE_MIP_SIZE;
+}
+
+
+u32 TextureStreamer::getBaseMip(const gpu::TextureDesc& desc)
+{
+	u32 mip = 0;
+	while ((maximum(desc.width, desc.height) >> mip) > BASE_MIP_SIZE) ++mip;
+	return mip;
+}
+
+
+void TextureStreamer::add(Texture& texture)
+{
+	ASSERT(!texture.is_streamed);
+	texture.is_streamed = true;
+	texture.last_used_frame = m_frame;
+	m_textures.push(&texture);
+}
+
+
+void TextureStreamer::remove(Texture& texture)
+{
+	ASSERT(texture.is_streamed);
+	texture.is_streamed = false;
+	m_textures.swapAndPopItem(&texture);
+}
+
+
+void TextureStreamer::gatherFeedback(ResourceManager& material_manager)
+{
+	for (Resource* res : material_manager.getResourceTable()) {
+		if (!res->isReady()) continue;
+
+		Material* material = static_cast<Material*>(res);
+		const float screen_size = material->consumeScreenSize();
+		if (screen_size <= 0) continue;
+
+		for (u32 i = 0, c = material->getTextureCount(); i < c; ++i) {
+			Texture* texture = material->getTexture(i);
+			if (!texture || !texture->is_streamed) continue;
+			
+			// the smallest mip which still has at least one texel per pixel
+			const u32 size = maximum(texture->width, texture->height);
+			u32 mip = 0;
+			while (mip < texture->base_mip && float(size >> (mip + 1)) >= screen_size) ++mip;
+
+			if (texture->last_used_frame != m_frame) texture->wanted_mip = mip;
+			else texture->wanted_mip = minimum(texture->wanted_mip, mip);
+			texture->last_used_frame = m_frame;
+		}
+	}
+
+	for (Texture* texture : m_textures) {
+		if (m_frame - texture->last_used_frame > EVICT_FRAMES) texture->wanted_mip = texture->base_mip;
+	}
+}
+
+
+void TextureStreamer::applyBudget()
+{
+	m_resident_size = 0;
+	u64 wanted_size = 0;
+	for (Texture* texture : m_textures) {
+		m_resident_size += texture->getMipsSize(texture->resident_mip);
+		wanted_size += texture->getMipsSize(texture->wanted_mip);
+	}
+	if (wanted_size <= m_budget) return;
+
+	qsort(m_textures.begin(), m_textures.size(), sizeof(m_textures[0]), [](const void* a, const void* b) -> int {
+		const u32 fa = (*(const Texture**)a)->last_used_frame;
+		const u32 fb = (*(const Texture**)b)->last_used_frame;
+		return fa < fb ? -1 : (fa > fb ? 1 : 0);
+	});
+
+	// textures not visible now go to base mip, least recently used first
+	for (Texture* texture : m_textures) {
+		if (wanted_size <= m_budget) return;
+		if (texture->last_used_frame == m_frame) break;
+		wanted_size -= texture->getMipsSize(texture->wanted_mip);
+		texture->wanted_mip = texture->base_mip;
+		wanted_size += texture->getMipsSize(texture->wanted_mip);
+	}
+
+	// then visible textures lose one mip at a time
+	bool changed = true;
+	while (wanted_size > m_budget && changed) {
+		changed = false;
+		for (Texture* texture : m_textures) {
+			if (wanted_size <= m_budget) return;
+			if (texture->wanted_mip >= texture->base_mip) continue;
+			wanted_size -= texture->getMipsSize(texture->wanted_mip);
+			++texture->wanted_mip;
+			wanted_size += texture->getMipsSize(texture->wanted_mip);
+			changed = true;
+		}
+	}
+}
+
+
+void TextureStreamer::update(ResourceManager& material_manager)
+{
+	++m_frame;
+	if (m_frame % UPDATE_PERIOD != 0) return;
+
+	PROFILE_FUNCTION();
+	gatherFeedback(material_manager);
+	applyBudget();
+
+	u32 pending = 0;
+	for (Texture* texture : m_textures) {
+		if (texture->isStreaming()) ++pending;
+	}
+
+	for (Texture* texture : m_textures) {
+		if (pending >= MAX_PENDING) break;
+		if (texture->isStreaming() || texture->wanted_mip == texture->resident_mip) continue;
+		
+		texture->streamMips(texture->wanted_mip);
+		++pending;
+	}
+}
+
 gpu::TextureFlags Texture::getGPUFlags() const
 {
 	gpu::TextureFlags gpu_flags = gpu::TextureFlags::NONE;
@@ -689,7 +923,9 @@ bool Texture::load(u64 size, const u8* mem)
 	PROFILE_FUNCTION();
 	profiler::pushString(getPath().c_str());
 	
-	
+	// headless renderer needs only cpu data, e.g. heightmaps for physics
+	if (renderer.isHeadless() && !data_reference) return true;
+
 	char ext[4] = {};
 	InputMemoryStream file(mem, size);
 	if (!file.read(ext, 3)) return false;
@@ -717,6 +953,8 @@ bool Texture::load(u64 size, const u8* mem)
 	else {
 		loaded = loadTGA(file);
 	}
+	// there's no gpu texture in headless mode, so success means cpu data are loaded
+	if (renderer.isHeadless()) loaded = !data.empty();
 	if (!loaded) {
 		logWarning("Error loading texture ", getPath());
 		return false;
@@ -728,6 +966,12 @@ bool Texture::load(u64 size, const u8* mem)
 
 void Texture::unload()
 {
+	if (stream_op.isValid()) {
+		getResourceManager().getOwner().getFileSystem().cancel(stream_op);
+		stream_op = FileSystem::AsyncHandle::invalid();
+	}
+	if (is_streamed) renderer.getTextureStreamer().remove(*this);
+
 	if (handle) {
 		renderer.destroy(handle);
 		handle = gpu::INVALID_TEXTURE;
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "engine/array.h"
 #include "engine/resource.h"
 #include "engine/stream.h"
 #include "gpu/gpu.h"
@@ -102,6 +103,12 @@ struct LUMIX_RENDERER_API Texture final : Resource {
 	u32 getPixel(float x, float y) const;
 	gpu::TextureFlags getGPUFlags() const;
 
+	// loads mips from `mip` to the smallest one and replaces what is in vram, handle does not change
+	void streamMips(u32 mip);
+	bool isStreaming() const { return stream_op.isValid(); }
+	// vram used by mips from `mip` to the smallest one
+	u64 getMipsSize(u32 mip) const;
+
 	static u8* getLBCInfo(const void* data, gpu::TextureDesc& desc);
 	static bool saveTGA(IOutputStream* file,
 		int width,
@@ -127,10 +134,55 @@ struct LUMIX_RENDERER_API Texture final : Resource {
 	OutputMemoryStream data;
 	Renderer& renderer;
 
+	// mip streaming, managed by TextureStreamer
+	bool is_streamed = false;
+	u32 base_mip = 0; // always resident
+	u32 resident_mip = 0; // the biggest mip in vram
+	u32 wanted_mip = 0;
+	u32 last_used_frame = 0;
+
 private:
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	bool loadTGA(IInputStream& file);
+	void onMipsLoaded(u64 size, const u8* mem, bool success);
+
+	FileSystem::AsyncHandle stream_op = FileSystem::AsyncHandle::invalid();
+	u32 stream_mip = 0;
+};
+
+
+// keeps in vram only those mips of big LBC textures, which are visible on screen
+// feedback comes from pipeline through Material::reportScreenSize
+// if BUDGET is exceeded, least recently used textures are evicted to their base mip
+struct LUMIX_RENDERER_API TextureStreamer {
+	static constexpr u32 BASE_MIP_SIZE = 128; // textures bigger than this are streamed
+	static constexpr u32 UPDATE_PERIOD = 8; // in frames
+	static constexpr u32 EVICT_FRAMES = 300; // textures not visible for this long are dropped to base mip
+	static constexpr u32 MAX_PENDING = 4;
+
+	TextureStreamer(IAllocator& allocator);
+	~TextureStreamer();
+
+	void update(ResourceManager& material_manager);
+	void setBudget(u64 bytes) { m_budget = bytes; }
+	u64 getBudget() const { return m_budget; }
+	u64 getResidentSize() const { return m_resident_size; }
+	
+	static bool isStreamable(const gpu::TextureDesc& desc);
+	static u32 getBaseMip(const gpu::TextureDesc& desc);
+	void add(Texture& texture);
+	void remove(Texture& texture);
+
+private:
+	void gatherFeedback(ResourceManager& material_manager);
+	void applyBudget();
+
+	IAllocator& m_allocator;
+	Array<Texture*> m_textures;
+	u64 m_budget = 512 * 1024 * 1024;
+	u64 m_resident_size = 0;
+	u32 m_frame = 0;
 };
 
 